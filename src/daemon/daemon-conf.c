@@ -66,11 +66,18 @@ static const pa_daemon_conf default_conf = {
     .nice_level = -11,
     .realtime_scheduling = true,
     .realtime_priority = 5,  /* Half of JACK's default rtprio */
+    .realtime_deadline = false,
+    .flush_denormals = true,
+    .io_threads = 0,
+    .io_thread_cpus = NULL,
+    .device_thread_cpus = NULL,
     .disallow_module_loading = false,
     .disallow_exit = false,
     .flat_volumes = true,
     .exit_idle_time = 20,
     .scache_idle_time = 20,
+    .scache_compress = false,
+    .scache_decoded_max = 4 * 1024 * 1024,
     .script_commands = NULL,
     .dl_search_path = NULL,
     .load_default_script_file = true,
@@ -96,6 +103,9 @@ static const pa_daemon_conf default_conf = {
     .disable_shm = false,
     .disable_memfd = false,
     .lock_memory = false,
+    .shm_huge_pages = false,
+    .shm_prefault = false,
+    .rtclock_source = PA_RTCLOCK_SOURCE_PRECISE,
     .deferred_volume = true,
     .default_n_fragments = 4,
     .default_fragment_size_msec = 25,
@@ -171,6 +181,8 @@ void pa_daemon_conf_free(pa_daemon_conf *c) {
     pa_xfree(c->script_commands);
     pa_xfree(c->dl_search_path);
     pa_xfree(c->default_script_file);
+    pa_xfree(c->io_thread_cpus);
+    pa_xfree(c->device_thread_cpus);
 
     if (c->log_target)
         pa_log_target_free(c->log_target);
@@ -490,6 +502,23 @@ static int parse_rtprio(pa_config_parser_state *state) {
     return 0;
 }
 
+static int parse_rtclock_source(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+    pa_rtclock_source_t source;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    if ((source = pa_rtclock_source_from_string(state->rvalue)) == PA_RTCLOCK_SOURCE_INVALID) {
+        pa_log(_("[%s:%u] Invalid clock source '%s'."), state->filename, state->lineno, state->rvalue);
+        return -1;
+    }
+
+    c->rtclock_source = source;
+    return 0;
+}
+
 #ifdef HAVE_DBUS
 static int parse_server_type(pa_config_parser_state *state) {
     pa_daemon_conf *c;
@@ -516,6 +545,8 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "fail",                       pa_config_parse_bool,     &c->fail, NULL },
         { "high-priority",              pa_config_parse_bool,     &c->high_priority, NULL },
         { "realtime-scheduling",        pa_config_parse_bool,     &c->realtime_scheduling, NULL },
+        { "realtime-deadline",          pa_config_parse_bool,     &c->realtime_deadline, NULL },
+        { "flush-denormals",            pa_config_parse_bool,     &c->flush_denormals, NULL },
         { "disallow-module-loading",    pa_config_parse_bool,     &c->disallow_module_loading, NULL },
         { "allow-module-loading",       pa_config_parse_not_bool, &c->disallow_module_loading, NULL },
         { "disallow-exit",              pa_config_parse_bool,     &c->disallow_exit, NULL },
@@ -532,10 +563,18 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "enable-memfd",               pa_config_parse_not_bool, &c->disable_memfd, NULL },
         { "flat-volumes",               pa_config_parse_bool,     &c->flat_volumes, NULL },
         { "lock-memory",                pa_config_parse_bool,     &c->lock_memory, NULL },
+        { "shm-huge-pages",             pa_config_parse_bool,     &c->shm_huge_pages, NULL },
+        { "shm-prefault",               pa_config_parse_bool,     &c->shm_prefault, NULL },
+        { "rtclock-source",             parse_rtclock_source,     c, NULL },
         { "enable-deferred-volume",     pa_config_parse_bool,     &c->deferred_volume, NULL },
         { "exit-idle-time",             pa_config_parse_int,      &c->exit_idle_time, NULL },
         { "scache-idle-time",           pa_config_parse_int,      &c->scache_idle_time, NULL },
+        { "scache-compress",            pa_config_parse_bool,     &c->scache_compress, NULL },
+        { "scache-decoded-size-bytes",  pa_config_parse_size,     &c->scache_decoded_max, NULL },
         { "realtime-priority",          parse_rtprio,             c, NULL },
+        { "io-threads",                 pa_config_parse_unsigned, &c->io_threads, NULL },
+        { "io-thread-cpus",             pa_config_parse_string,   &c->io_thread_cpus, NULL },
+        { "device-thread-cpus",         pa_config_parse_string,   &c->device_thread_cpus, NULL },
         { "dl-search-path",             pa_config_parse_string,   &c->dl_search_path, NULL },
         { "default-script-file",        pa_config_parse_string,   &c->default_script_file, NULL },
         { "log-target",                 parse_log_target,         c, NULL },
@@ -733,6 +772,11 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "nice-level = %i\n", c->nice_level);
     pa_strbuf_printf(s, "realtime-scheduling = %s\n", pa_yes_no(c->realtime_scheduling));
     pa_strbuf_printf(s, "realtime-priority = %i\n", c->realtime_priority);
+    pa_strbuf_printf(s, "realtime-deadline = %s\n", pa_yes_no(c->realtime_deadline));
+    pa_strbuf_printf(s, "flush-denormals = %s\n", pa_yes_no(c->flush_denormals));
+    pa_strbuf_printf(s, "io-threads = %u\n", c->io_threads);
+    pa_strbuf_printf(s, "io-thread-cpus = %s\n", pa_strempty(c->io_thread_cpus));
+    pa_strbuf_printf(s, "device-thread-cpus = %s\n", pa_strempty(c->device_thread_cpus));
     pa_strbuf_printf(s, "allow-module-loading = %s\n", pa_yes_no(!c->disallow_module_loading));
     pa_strbuf_printf(s, "allow-exit = %s\n", pa_yes_no(!c->disallow_exit));
     pa_strbuf_printf(s, "use-pid-file = %s\n", pa_yes_no(c->use_pid_file));
@@ -744,8 +788,13 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "enable-shm = %s\n", pa_yes_no(!c->disable_shm));
     pa_strbuf_printf(s, "flat-volumes = %s\n", pa_yes_no(c->flat_volumes));
     pa_strbuf_printf(s, "lock-memory = %s\n", pa_yes_no(c->lock_memory));
+    pa_strbuf_printf(s, "shm-huge-pages = %s\n", pa_yes_no(c->shm_huge_pages));
+    pa_strbuf_printf(s, "shm-prefault = %s\n", pa_yes_no(c->shm_prefault));
+    pa_strbuf_printf(s, "rtclock-source = %s\n", pa_rtclock_source_to_string(c->rtclock_source));
     pa_strbuf_printf(s, "exit-idle-time = %i\n", c->exit_idle_time);
     pa_strbuf_printf(s, "scache-idle-time = %i\n", c->scache_idle_time);
+    pa_strbuf_printf(s, "scache-compress = %s\n", pa_yes_no(c->scache_compress));
+    pa_strbuf_printf(s, "scache-decoded-size-bytes = %lu\n", (unsigned long) c->scache_decoded_max);
     pa_strbuf_printf(s, "dl-search-path = %s\n", pa_strempty(c->dl_search_path));
     pa_strbuf_printf(s, "default-script-file = %s\n", pa_strempty(pa_daemon_conf_get_default_script_file(c)));
     pa_strbuf_printf(s, "load-default-script-file = %s\n", pa_yes_no(c->load_default_script_file));
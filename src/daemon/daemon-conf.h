@@ -28,6 +28,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/core-rtclock.h>
 
 #ifdef HAVE_SYS_RESOURCE_H
 #include <sys/resource.h>
@@ -61,6 +62,9 @@ typedef struct pa_daemon_conf {
         fail,
         high_priority,
         realtime_scheduling,
+        realtime_deadline,
+        flush_denormals,
+        scache_compress,
         disallow_module_loading,
         use_pid_file,
         system_instance,
@@ -77,8 +81,11 @@ typedef struct pa_daemon_conf {
         log_time,
         flat_volumes,
         lock_memory,
+        shm_huge_pages,
+        shm_prefault,
         deferred_volume;
     pa_server_type_t local_server_type;
+    pa_rtclock_source_t rtclock_source;
     int exit_idle_time,
         scache_idle_time,
         realtime_priority,
@@ -127,6 +134,10 @@ typedef struct pa_daemon_conf {
 #endif
 #endif
 
+    unsigned io_threads;
+    char *io_thread_cpus;
+    char *device_thread_cpus;
+
     unsigned default_n_fragments, default_fragment_size_msec;
     unsigned deferred_volume_safety_margin_usec;
     int deferred_volume_extra_delay_usec;
@@ -135,6 +146,7 @@ typedef struct pa_daemon_conf {
     uint32_t alternate_sample_rate;
     pa_channel_map default_channel_map;
     size_t shm_size;
+    size_t scache_decoded_max;
 } pa_daemon_conf;
 
 /* Allocate a new structure and fill it with sane defaults */
@@ -48,7 +48,7 @@
 #undef PA_BIND_NOW
 #endif
 
-#ifdef OS_IS_WIN32
+#if defined(OS_IS_WIN32) || defined(DISABLE_BIND_NOW)
 #undef PA_BIND_NOW
 #endif
 
@@ -74,6 +74,7 @@
 #include <pulsecore/core-scache.h>
 #include <pulsecore/core.h>
 #include <pulsecore/module.h>
+#include <pulsecore/io-pool.h>
 #include <pulsecore/cli-command.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
@@ -85,6 +86,7 @@
 #include <pulsecore/shm.h>
 #include <pulsecore/memtrap.h>
 #include <pulsecore/strlist.h>
+#include <pulsecore/thread.h>
 #ifdef HAVE_DBUS
 #include <pulsecore/dbus-shared.h>
 #endif
@@ -1014,6 +1016,19 @@ int main(int argc, char *argv[]) {
 
     pa_memtrap_install();
 
+    pa_shm_set_backing(conf->shm_huge_pages, conf->shm_prefault);
+
+    if (conf->rtclock_source != PA_RTCLOCK_SOURCE_PRECISE && pa_rtclock_set_source(conf->rtclock_source) < 0)
+        pa_log_warn("The %s clock source is not available, using the precise one.",
+                    pa_rtclock_source_to_string(conf->rtclock_source));
+
+    if (conf->flush_denormals) {
+        if (pa_flush_denormals() < 0)
+            pa_log_info("Flushing denormals is not supported on this system.");
+        else
+            pa_thread_set_flush_denormals(true);
+    }
+
     pa_assert_se(mainloop = pa_mainloop_new());
 
     if (!(c = pa_core_new(pa_mainloop_get_api(mainloop), !conf->disable_shm,
@@ -1033,9 +1048,12 @@ int main(int argc, char *argv[]) {
     c->lfe_crossover_freq = conf->lfe_crossover_freq;
     c->exit_idle_time = conf->exit_idle_time;
     c->scache_idle_time = conf->scache_idle_time;
+    c->scache_compress = conf->scache_compress;
+    c->scache_decoded_max = conf->scache_decoded_max;
     c->resample_method = conf->resample_method;
     c->realtime_priority = conf->realtime_priority;
     c->realtime_scheduling = conf->realtime_scheduling;
+    c->realtime_deadline = conf->realtime_deadline;
     c->avoid_resampling = conf->avoid_resampling;
     c->disable_remixing = conf->disable_remixing;
     c->remixing_use_all_sink_channels = conf->remixing_use_all_sink_channels;
@@ -1066,6 +1084,17 @@ int main(int argc, char *argv[]) {
     if (!conf->no_cpu_limit)
         pa_assert_se(pa_cpu_limit_init(pa_mainloop_get_api(mainloop)) == 0);
 
+    if (conf->device_thread_cpus &&
+        pa_parse_cpu_list(conf->device_thread_cpus, &c->device_thread_cpus, &c->n_device_thread_cpus) < 0) {
+        pa_log(_("Invalid device-thread-cpus setting."));
+        goto finish;
+    }
+
+    if (conf->io_threads > 0 && !(c->io_pool = pa_io_pool_new(c, conf->io_threads, conf->io_thread_cpus))) {
+        pa_log(_("Failed to start shared IO threads."));
+        goto finish;
+    }
+
     buf = pa_strbuf_new();
 
 #ifdef HAVE_DBUS
@@ -1085,7 +1114,8 @@ int main(int argc, char *argv[]) {
         if (r >= 0)
             r = pa_cli_command_execute(c, conf->script_commands, buf, &conf->fail);
 
-        pa_log_error("%s", s = pa_strbuf_to_string_free(buf));
+        s = pa_strbuf_to_string_free(buf);
+        pa_log_error("%s", s);
         pa_xfree(s);
 
         if (r < 0 && conf->fail) {
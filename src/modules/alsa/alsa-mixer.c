@@ -23,6 +23,7 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <asoundlib.h>
 #include <math.h>
 
@@ -2511,6 +2512,166 @@ static const char *get_default_paths_dir(void) {
         return PA_ALSA_PATHS_DIR;
 }
 
+static pa_alsa_option *option_copy(const pa_alsa_option *o, pa_alsa_element *e) {
+    pa_alsa_option *n;
+
+    n = pa_xnewdup(pa_alsa_option, o, 1);
+    n->element = e;
+    n->next = n->prev = NULL;
+    n->alsa_name = pa_xstrdup(o->alsa_name);
+    n->name = pa_xstrdup(o->name);
+    n->description = pa_xstrdup(o->description);
+
+    return n;
+}
+
+static pa_alsa_element *element_copy(const pa_alsa_element *e, pa_alsa_path *p) {
+    pa_alsa_element *n;
+    pa_alsa_option *o, *last = NULL;
+
+    /* Decibel fixes are only attached when the path joins a path set */
+    pa_assert(!e->db_fix);
+
+    n = pa_xnewdup(pa_alsa_element, e, 1);
+    n->path = p;
+    n->next = n->prev = NULL;
+    n->alsa_name = pa_xstrdup(e->alsa_name);
+    n->options = NULL;
+
+    PA_LLIST_FOREACH(o, e->options) {
+        pa_alsa_option *no = option_copy(o, n);
+
+        PA_LLIST_INSERT_AFTER(pa_alsa_option, n->options, last, no);
+        last = no;
+    }
+
+    return n;
+}
+
+static pa_alsa_jack *jack_copy(const pa_alsa_jack *j, pa_alsa_path *p) {
+    pa_alsa_jack *n;
+
+    n = pa_alsa_jack_new(p, j->name);
+    pa_xfree(n->alsa_name);
+    n->alsa_name = pa_xstrdup(j->alsa_name);
+    n->state_unplugged = j->state_unplugged;
+    n->state_plugged = j->state_plugged;
+    n->required = j->required;
+    n->required_any = j->required_any;
+    n->required_absent = j->required_absent;
+
+    return n;
+}
+
+/* Copies a path as it comes out of parsing, i.e. before probing */
+static pa_alsa_path *path_copy(const pa_alsa_path *p) {
+    pa_alsa_path *n;
+    pa_alsa_element *e;
+    pa_alsa_jack *j;
+
+    pa_assert(!p->probed);
+    pa_assert(!p->settings);
+
+    n = pa_xnewdup(pa_alsa_path, p, 1);
+    n->port = NULL;
+    n->name = pa_xstrdup(p->name);
+    n->description_key = pa_xstrdup(p->description_key);
+    n->description = pa_xstrdup(p->description);
+    n->proplist = pa_proplist_copy(p->proplist);
+    n->elements = NULL;
+    n->jacks = NULL;
+    n->last_element = NULL;
+    n->last_option = NULL;
+    n->last_setting = NULL;
+    n->last_jack = NULL;
+
+    PA_LLIST_FOREACH(e, p->elements) {
+        pa_alsa_element *ne = element_copy(e, n);
+
+        PA_LLIST_INSERT_AFTER(pa_alsa_element, n->elements, n->last_element, ne);
+        n->last_element = ne;
+    }
+
+    PA_LLIST_FOREACH(j, p->jacks) {
+        pa_alsa_jack *nj = jack_copy(j, n);
+
+        PA_LLIST_INSERT_AFTER(pa_alsa_jack, n->jacks, n->last_jack, nj);
+        n->last_jack = nj;
+    }
+
+    return n;
+}
+
+/* Every card parses the same path configuration files, so the result of
+ * parsing each file is kept and handed out as a copy, for as long as the
+ * file doesn't change. */
+struct path_cache_entry {
+    pa_alsa_path *path;
+    time_t mtime;
+    off_t size;
+};
+
+static pa_hashmap *path_cache = NULL;
+
+static void path_cache_entry_free(struct path_cache_entry *c) {
+    pa_alsa_path_free(c->path);
+    pa_xfree(c);
+}
+
+static char *path_cache_key(const char *fn, pa_alsa_direction_t direction) {
+    return pa_sprintf_malloc("%i:%s", (int) direction, fn);
+}
+
+static pa_alsa_path *path_cache_get(const char *fn, pa_alsa_direction_t direction) {
+    struct path_cache_entry *c;
+    struct stat st;
+    char *key;
+
+    if (!path_cache)
+        return NULL;
+
+    key = path_cache_key(fn, direction);
+    c = pa_hashmap_get(path_cache, key);
+
+    if (c && (stat(fn, &st) < 0 || st.st_mtime != c->mtime || st.st_size != c->size)) {
+        pa_hashmap_remove_and_free(path_cache, key);
+        c = NULL;
+    }
+
+    pa_xfree(key);
+
+    return c ? path_copy(c->path) : NULL;
+}
+
+static void path_cache_put(const char *fn, const pa_alsa_path *p) {
+    struct path_cache_entry *c;
+    struct stat st;
+    char *key;
+
+    if (stat(fn, &st) < 0)
+        return;
+
+    if (!path_cache)
+        path_cache = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                         pa_xfree, (pa_free_cb_t) path_cache_entry_free);
+
+    c = pa_xnew(struct path_cache_entry, 1);
+    c->path = path_copy(p);
+    c->mtime = st.st_mtime;
+    c->size = st.st_size;
+
+    key = path_cache_key(fn, p->direction);
+    pa_hashmap_remove_and_free(path_cache, key);
+    pa_hashmap_put(path_cache, key, c);
+}
+
+void pa_alsa_path_cache_free(void) {
+    if (path_cache) {
+        pa_hashmap_free(path_cache);
+        path_cache = NULL;
+    }
+}
+
 pa_alsa_path* pa_alsa_path_new(const char *paths_dir, const char *fname, pa_alsa_direction_t direction) {
     pa_alsa_path *p;
     char *fn;
@@ -2552,6 +2713,16 @@ pa_alsa_path* pa_alsa_path_new(const char *paths_dir, const char *fname, pa_alsa
 
     pa_assert(fname);
 
+    if (!paths_dir)
+        paths_dir = get_default_paths_dir();
+
+    fn = pa_maybe_prefix_path(fname, paths_dir);
+
+    if ((p = path_cache_get(fn, direction))) {
+        pa_xfree(fn);
+        return p;
+    }
+
     p = pa_xnew0(pa_alsa_path, 1);
     n = pa_path_get_filename(fname);
     p->name = pa_xstrndup(n, strcspn(n, "."));
@@ -2565,13 +2736,7 @@ pa_alsa_path* pa_alsa_path_new(const char *paths_dir, const char *fname, pa_alsa
     items[3].data = &mute_during_activation;
     items[4].data = &p->eld_device;
 
-    if (!paths_dir)
-        paths_dir = get_default_paths_dir();
-
-    fn = pa_maybe_prefix_path(fname, paths_dir);
-
     r = pa_config_parse(fn, NULL, items, p->proplist, false, p);
-    pa_xfree(fn);
 
     if (r < 0)
         goto fail;
@@ -2581,9 +2746,13 @@ pa_alsa_path* pa_alsa_path_new(const char *paths_dir, const char *fname, pa_alsa
     if (path_verify(p) < 0)
         goto fail;
 
+    path_cache_put(fn, p);
+    pa_xfree(fn);
+
     return p;
 
 fail:
+    pa_xfree(fn);
     pa_alsa_path_free(p);
     return NULL;
 }
@@ -3483,9 +3652,80 @@ void pa_alsa_profile_set_free(pa_alsa_profile_set *ps) {
     if (ps->decibel_fixes)
         pa_hashmap_free(ps->decibel_fixes);
 
+    if (ps->mixers)
+        pa_hashmap_free(ps->mixers);
+
     pa_xfree(ps);
 }
 
+static void mixer_close_cb(void *m) {
+    snd_mixer_close(m);
+}
+
+void pa_alsa_profile_set_park_mixer(pa_alsa_profile_set *ps, const char *ctl_device, snd_mixer_t *m) {
+    snd_mixer_elem_t *me;
+
+    pa_assert(ps);
+    pa_assert(ctl_device);
+    pa_assert(m);
+
+    if (!ps->mixers)
+        ps->mixers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, mixer_close_cb);
+
+    if (pa_hashmap_get(ps->mixers, ctl_device)) {
+        snd_mixer_close(m);
+        return;
+    }
+
+    /* The callbacks point into the sink or source that is going away */
+    for (me = snd_mixer_first_elem(m); me; me = snd_mixer_elem_next(me)) {
+        snd_mixer_elem_set_callback(me, NULL);
+        snd_mixer_elem_set_callback_private(me, NULL);
+    }
+
+    pa_hashmap_put(ps->mixers, pa_xstrdup(ctl_device), m);
+}
+
+snd_mixer_t *pa_alsa_profile_set_take_mixer(pa_alsa_profile_set *ps, snd_pcm_t *pcm, char **ctl_device) {
+    snd_pcm_info_t *info;
+    snd_mixer_t *m;
+    const char *dev;
+    char *md = NULL;
+
+    pa_assert(ps);
+    pa_assert(pcm);
+    pa_assert(ctl_device);
+
+    if (!ps->mixers || pa_hashmap_isempty(ps->mixers))
+        return NULL;
+
+    /* Same order as pa_alsa_open_mixer_for_pcm() */
+    if (!(dev = snd_pcm_name(pcm)) || !pa_hashmap_get(ps->mixers, dev)) {
+        int card_idx;
+
+        snd_pcm_info_alloca(&info);
+
+        if (snd_pcm_info(pcm, info) < 0 || (card_idx = snd_pcm_info_get_card(info)) < 0)
+            return NULL;
+
+        md = pa_sprintf_malloc("hw:%i", card_idx);
+        dev = md;
+    }
+
+    if (!(m = pa_hashmap_remove(ps->mixers, dev))) {
+        pa_xfree(md);
+        return NULL;
+    }
+
+    /* Catch up with whatever changed while nobody was listening */
+    snd_mixer_handle_events(m);
+
+    pa_log_debug("Reusing mixer of control device %s.", dev);
+
+    *ctl_device = md ? md : pa_xstrdup(dev);
+    return m;
+}
+
 pa_alsa_mapping *pa_alsa_mapping_get(pa_alsa_profile_set *ps, const char *name) {
     pa_alsa_mapping *m;
 
@@ -4564,6 +4804,12 @@ void pa_alsa_profile_set_probe(
         uint32_t idx;
         p = *pp;
 
+        /* Skip if an earlier probe found it unsupported */
+        if (p->probe_skip_unsupported && !p->supported) {
+            pa_log_debug("Skipping profile %s - known to be unsupported", p->name);
+            continue;
+        }
+
         /* Skip if fallback and already found something */
         if (found_input && p->fallback_input)
             continue;
@@ -4680,6 +4926,58 @@ void pa_alsa_profile_set_probe(
     ps->probed = true;
 }
 
+/* FNV-1a, the value only has to change when the configuration does */
+static uint32_t hash_string(uint32_t h, const char *s) {
+    if (!s)
+        s = "";
+
+    /* Include the terminator, to keep "ab" "c" apart from "a" "bc" */
+    do {
+        h ^= (uint8_t) *s;
+        h *= 16777619U;
+    } while (*(s++));
+
+    return h;
+}
+
+static uint32_t hash_strings(uint32_t h, char **l) {
+    if (l)
+        for (; *l; l++)
+            h = hash_string(h, *l);
+
+    return hash_string(h, NULL);
+}
+
+uint32_t pa_alsa_profile_set_get_hash(pa_alsa_profile_set *ps) {
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    char cm[PA_CHANNEL_MAP_SNPRINT_MAX];
+    void *state;
+    uint32_t h = 2166136261U;
+
+    pa_assert(ps);
+
+    PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+        h = hash_string(h, m->name);
+        h = hash_strings(h, m->device_strings);
+        h = hash_string(h, pa_channel_map_snprint(cm, sizeof(cm), &m->channel_map));
+        h = hash_string(h, m->direction == PA_ALSA_DIRECTION_OUTPUT ? "output" :
+                           m->direction == PA_ALSA_DIRECTION_INPUT ? "input" : "any");
+        h = hash_string(h, pa_yes_no(m->exact_channels));
+    }
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        h = hash_string(h, p->name);
+        h = hash_strings(h, p->input_mapping_names);
+        h = hash_strings(h, p->output_mapping_names);
+        h = hash_string(h, pa_yes_no(p->supported));
+        h = hash_string(h, pa_yes_no(p->fallback_input));
+        h = hash_string(h, pa_yes_no(p->fallback_output));
+    }
+
+    return h;
+}
+
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *ps) {
     pa_alsa_profile *p;
     pa_alsa_mapping *m;
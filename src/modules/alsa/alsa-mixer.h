@@ -243,6 +243,8 @@ int pa_alsa_path_set_mute(pa_alsa_path *path, snd_mixer_t *m, bool muted);
 int pa_alsa_path_select(pa_alsa_path *p, pa_alsa_setting *s, snd_mixer_t *m, bool device_is_muted);
 void pa_alsa_path_set_callback(pa_alsa_path *p, snd_mixer_t *m, snd_mixer_elem_callback_t cb, void *userdata);
 void pa_alsa_path_free(pa_alsa_path *p);
+/* Drops the parsed path configuration files that pa_alsa_path_new() keeps */
+void pa_alsa_path_cache_free(void);
 
 pa_alsa_path_set *pa_alsa_path_set_new(pa_alsa_mapping *m, pa_alsa_direction_t direction, const char *paths_dir);
 void pa_alsa_path_set_dump(pa_alsa_path_set *s);
@@ -300,6 +302,9 @@ struct pa_alsa_profile {
     bool fallback_input:1;
     bool fallback_output:1;
 
+    /* Known to be unsupported from an earlier probe, don't probe again */
+    bool probe_skip_unsupported:1;
+
     char **input_mapping_names;
     char **output_mapping_names;
 
@@ -330,6 +335,10 @@ struct pa_alsa_profile_set {
     pa_hashmap *input_paths;
     pa_hashmap *output_paths;
 
+    /* Mixers of freed sinks and sources, by control device, waiting to
+     * be picked up again after a profile switch */
+    pa_hashmap *mixers;
+
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
@@ -346,6 +355,17 @@ void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
 
+/* Hands a mixer that is no longer used over to the profile set, so that
+ * the next sink or source on the same control device can take it
+ * instead of opening and loading the mixer again. All element callbacks
+ * must be gone from the mixer's fds by then. */
+void pa_alsa_profile_set_park_mixer(pa_alsa_profile_set *ps, const char *ctl_device, snd_mixer_t *m);
+snd_mixer_t *pa_alsa_profile_set_take_mixer(pa_alsa_profile_set *ps, snd_pcm_t *pcm, char **ctl_device);
+
+/* A digest of everything in the profile set that affects probing, for
+ * caching the probe results */
+uint32_t pa_alsa_profile_set_get_hash(pa_alsa_profile_set *ps);
+
 snd_mixer_t *pa_alsa_open_mixer_for_pcm(snd_pcm_t *pcm, char **ctl_device);
 
 pa_alsa_fdlist *pa_alsa_fdlist_new(void);
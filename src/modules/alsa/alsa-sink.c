@@ -52,6 +52,8 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/wakeup-domain.h>
+#include <pulsecore/trace.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -90,6 +92,24 @@
 
 #define DEFAULT_WRITE_ITERATION_THRESHOLD 0.03 /* don't iterate write if < 3% of the buffer is available */
 
+#define STATS_INTERVAL_USEC (5*PA_USEC_PER_SEC)                    /* 5s    -- In fixed latency mode, publish wakeup statistics this often */
+
+#define IDLE_AFTER_USEC (5*PA_USEC_PER_SEC)                        /* 5s    -- Use the whole buffer after rendering only silence for this long */
+
+enum {
+    SINK_MESSAGE_UPDATE_STATS = PA_SINK_MESSAGE_MAX,
+    SINK_MESSAGE_CLOSE_PCM,
+    SINK_MESSAGE_PCM_CLOSED
+};
+
+/* What the IO thread did since the last update, in fixed latency mode */
+struct wakeup_stats {
+    pa_usec_t start;
+    unsigned wakeups;
+    pa_usec_t busy, busy_max;
+    unsigned underruns;
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -99,8 +119,34 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* CPUs the IO thread is restricted to, if not the daemon default */
+    int *thread_cpus;
+    unsigned n_thread_cpus;
+
     snd_pcm_t *pcm_handle;
 
+    /* On a suspend that is only because of idleness, the PCM is
+     * stopped but kept open for fast_resume_usec, so that resuming
+     * right after doesn't need to open and configure it again. While
+     * that is the case pcm_stopped is set, and the IO thread closes it
+     * for real at close_at. keep_open is decided by the main thread
+     * for each suspend, which is counted by suspend_serial; the IO
+     * thread keeps its own copy in pcm_serial. pcm_passthrough and
+     * pcm_sample_spec are what the PCM was last configured for. */
+    pa_usec_t fast_resume_usec;
+    bool keep_open;
+    unsigned suspend_serial, pcm_serial;
+    bool pcm_stopped;
+    bool pcm_passthrough;
+    pa_sample_spec pcm_sample_spec;
+    pa_usec_t close_at;
+
+    /* The hw params the PCM was last configured with. Negotiating them
+     * takes quite a few round trips to the driver, which is slow on
+     * e.g. USB devices, so on resume we first try to apply them as they
+     * are. Only valid for pcm_passthrough and pcm_sample_spec. */
+    snd_pcm_hw_params_t *hw_params;
+
     char *paths_dir;
     pa_alsa_fdlist *mixer_fdl;
     pa_alsa_mixer_pdata *mixer_pd;
@@ -133,23 +179,53 @@ struct userdata {
     pa_usec_t min_latency_ref;
     pa_usec_t tsched_watermark_usec;
 
+    /* If non-zero, the sink has a fixed latency of the whole buffer and
+     * never rewinds, so that a stream starting doesn't cause the others
+     * to be rendered again. */
+    pa_usec_t fixed_latency;
+    struct wakeup_stats stats;
+    unsigned underruns_total;
+    pa_rtpoll_stats cpu_stats;
+
     pa_memchunk memchunk;
 
     char *device_name;  /* name of the PCM device */
     char *control_device; /* name of the control device */
+    pa_alsa_profile_set *profile_set; /* of our card, to hand the mixer back to */
 
     bool use_mmap:1, use_tsched:1, deferred_volume:1, fixed_latency_range:1;
 
     bool first, after_rewind;
 
+    /* While no stream is playing we only render silence, so we fill the
+     * whole buffer regardless of the requested latency and rely on a
+     * rewind once a stream starts. idle_since is when we first noticed
+     * that nothing is playing, 0 if something is. */
+    bool idle;
+    pa_usec_t idle_since;
+
     pa_rtpoll_item *alsa_rtpoll_item;
 
+    /* Our timer wakeups are aligned with the other devices of the
+     * same card, or whatever wakeup_domain= says */
+    pa_wakeup_domain *wakeup_domain;
+    int wakeup_slot;
+
     pa_smoother *smoother;
     uint64_t write_count;
     uint64_t since_start;
     pa_usec_t smoother_interval;
     pa_usec_t last_smoother_update;
 
+    /* The device status as of the first avail query of an iteration
+     * of the IO loop, and the write_count it belongs to. Shared by the
+     * watermark, rewind and smoother logic so that they don't each
+     * query the device again. */
+    snd_pcm_status_t *status;
+    bool status_valid;
+    uint64_t status_write_count;
+    snd_pcm_sframes_t status_delay;
+
     pa_idxset *formats;
 
     pa_reserve_wrapper *reserve;
@@ -178,6 +254,15 @@ static pa_hook_result_t reserve_cb(pa_reserve_wrapper *r, void *forced, struct u
 
     pa_log_debug("Suspending sink %s, because another application requested us to release the device.", u->sink->name);
 
+    if (pa_sink_get_state(u->sink) == PA_SINK_SUSPENDED && u->keep_open) {
+        /* Suspended already, but the device might still be open */
+        pa_assert_se(pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_CLOSE_PCM, NULL, 0, NULL) == 0);
+        u->keep_open = false;
+        pa_sink_suspend(u->sink, true, PA_SUSPEND_APPLICATION);
+        reserve_done(u);
+        return PA_HOOK_OK;
+    }
+
     if (pa_sink_suspend(u->sink, true, PA_SUSPEND_APPLICATION) < 0)
         return PA_HOOK_CANCEL;
 
@@ -406,7 +491,7 @@ static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*p
     pa_assert(u);
     pa_assert(u->use_tsched);
 
-    usec = pa_sink_get_requested_latency_within_thread(u->sink);
+    usec = u->idle ? (pa_usec_t) -1 : pa_sink_get_requested_latency_within_thread(u->sink);
 
     if (usec == (pa_usec_t) -1)
         usec = pa_bytes_to_usec(u->hwbuf_size, &u->sink->sample_spec);
@@ -436,8 +521,10 @@ static int try_recover(struct userdata *u, const char *call, int err) {
 
     pa_assert(err != -EAGAIN);
 
-    if (err == -EPIPE)
+    if (err == -EPIPE) {
         pa_log_debug("%s: Buffer underrun!", call);
+        u->stats.underruns++;
+    }
 
     if (err == -ESTRPIPE)
         pa_log_debug("%s: System suspended!", call);
@@ -449,9 +536,30 @@ static int try_recover(struct userdata *u, const char *call, int err) {
 
     u->first = true;
     u->since_start = 0;
+    u->status_valid = false;
     return 0;
 }
 
+/* Called from IO context. snd_pcm_status() syncs the hardware pointer
+ * just like snd_pcm_avail() does, so the first time the avail is
+ * needed in an iteration we take the whole status instead and
+ * update_smoother() reuses it later on. alsa-lib's own idea of avail
+ * is then brought up to date without another round trip to the
+ * kernel. */
+static snd_pcm_sframes_t query_avail(struct userdata *u) {
+    int err;
+
+    if (!u->status_valid) {
+        if ((err = pa_alsa_safe_delay(u->pcm_handle, u->status, &u->status_delay, u->hwbuf_size, &u->sink->sample_spec, false)) < 0)
+            return err;
+
+        u->status_valid = true;
+        u->status_write_count = u->write_count;
+    }
+
+    return pa_alsa_safe_avail_update(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec);
+}
+
 static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_timeout) {
     size_t left_to_play;
     bool underrun = false;
@@ -473,9 +581,12 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_tim
         PA_DEBUG_TRAP;
 #endif
 
-        if (!u->first && !u->after_rewind)
+        if (!u->first && !u->after_rewind) {
+            u->stats.underruns++;
+
             if (pa_log_ratelimit(PA_LOG_INFO))
                 pa_log_info("Underrun!");
+        }
     }
 
 #ifdef DEBUG_TIMING
@@ -531,7 +642,12 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
         /* First we determine how many samples are missing to fill the
          * buffer up to 100% */
 
-        if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
+        if (j == 0)
+            n = query_avail(u);
+        else
+            n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec);
+
+        if (PA_UNLIKELY(n < 0)) {
 
             if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
                 continue;
@@ -719,7 +835,12 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
         int r;
         bool after_avail = true;
 
-        if (PA_UNLIKELY((n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
+        if (j == 0)
+            n = query_avail(u);
+        else
+            n = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec);
+
+        if (PA_UNLIKELY(n < 0)) {
 
             if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
                 continue;
@@ -863,26 +984,28 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
 }
 
 static void update_smoother(struct userdata *u) {
-    snd_pcm_sframes_t delay = 0;
     int64_t position;
     int err;
     pa_usec_t now1 = 0, now2;
-    snd_pcm_status_t *status;
     snd_htimestamp_t htstamp = { 0, 0 };
 
-    snd_pcm_status_alloca(&status);
-
     pa_assert(u);
     pa_assert(u->pcm_handle);
 
-    /* Let's update the time smoother */
+    /* Let's update the time smoother. Usually the status has been
+     * taken already when we figured out how much to write. */
 
-    if (PA_UNLIKELY((err = pa_alsa_safe_delay(u->pcm_handle, status, &delay, u->hwbuf_size, &u->sink->sample_spec, false)) < 0)) {
-        pa_log_warn("Failed to query DSP status data: %s", pa_alsa_strerror(err));
-        return;
+    if (!u->status_valid) {
+        if (PA_UNLIKELY((err = pa_alsa_safe_delay(u->pcm_handle, u->status, &u->status_delay, u->hwbuf_size, &u->sink->sample_spec, false)) < 0)) {
+            pa_log_warn("Failed to query DSP status data: %s", pa_alsa_strerror(err));
+            return;
+        }
+
+        u->status_valid = true;
+        u->status_write_count = u->write_count;
     }
 
-    snd_pcm_status_get_htstamp(status, &htstamp);
+    snd_pcm_status_get_htstamp(u->status, &htstamp);
     now1 = pa_timespec_load(&htstamp);
 
     /* Hmm, if the timestamp is 0, then it wasn't set and we take the current time */
@@ -894,7 +1017,7 @@ static void update_smoother(struct userdata *u) {
         if (u->last_smoother_update + u->smoother_interval > now1)
             return;
 
-    position = (int64_t) u->write_count - ((int64_t) delay * (int64_t) u->frame_size);
+    position = (int64_t) u->status_write_count - ((int64_t) u->status_delay * (int64_t) u->frame_size);
 
     if (PA_UNLIKELY(position < 0))
         position = 0;
@@ -941,6 +1064,26 @@ static int build_pollfd(struct userdata *u) {
     return 0;
 }
 
+/* Called from IO context */
+static void close_pcm(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(u->pcm_handle);
+
+    snd_pcm_close(u->pcm_handle);
+    u->pcm_handle = NULL;
+
+    if (u->pcm_stopped) {
+        u->pcm_stopped = false;
+
+        /* Let the main thread give up the device reservation it kept
+         * for us */
+        pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_PCM_CLOSED,
+                          NULL, (int64_t) u->pcm_serial, NULL, NULL);
+
+        pa_log_info("Closed the device after %0.2fms of suspension.", (double) u->fast_resume_usec / PA_USEC_PER_MSEC);
+    }
+}
+
 /* Called from IO context */
 static int suspend(struct userdata *u) {
     pa_assert(u);
@@ -950,8 +1093,13 @@ static int suspend(struct userdata *u) {
 
     /* Let's suspend -- we don't call snd_pcm_drain() here since that might
      * take awfully long with our long buffer sizes today. */
-    snd_pcm_close(u->pcm_handle);
-    u->pcm_handle = NULL;
+    if (u->keep_open) {
+        snd_pcm_drop(u->pcm_handle);
+        u->pcm_stopped = true;
+        u->pcm_serial = u->suspend_serial;
+        u->close_at = pa_rtclock_now() + u->fast_resume_usec;
+    } else
+        close_pcm(u);
 
     if (u->alsa_rtpoll_item) {
         pa_rtpoll_item_free(u->alsa_rtpoll_item);
@@ -966,7 +1114,7 @@ static int suspend(struct userdata *u) {
     pa_sink_set_max_rewind_within_thread(u->sink, 0);
     pa_sink_set_max_request_within_thread(u->sink, 0);
 
-    pa_log_info("Device suspended...");
+    pa_log_info("Device suspended%s...", u->pcm_stopped ? ", keeping it open" : "");
 
     return 0;
 }
@@ -984,7 +1132,7 @@ static int update_sw_params(struct userdata *u) {
     if (u->use_tsched) {
         pa_usec_t latency;
 
-        if ((latency = pa_sink_get_requested_latency_within_thread(u->sink)) != (pa_usec_t) -1) {
+        if (!u->idle && (latency = pa_sink_get_requested_latency_within_thread(u->sink)) != (pa_usec_t) -1) {
             size_t b;
 
             pa_log_debug("Latency set to %0.2fms", (double) latency / PA_USEC_PER_MSEC);
@@ -1023,7 +1171,9 @@ static int update_sw_params(struct userdata *u) {
     }
 
     pa_sink_set_max_request_within_thread(u->sink, u->hwbuf_size - u->hwbuf_unused);
-     if (pa_alsa_pcm_is_hw(u->pcm_handle))
+    if (u->fixed_latency)
+        pa_sink_set_max_rewind_within_thread(u->sink, 0);
+    else if (pa_alsa_pcm_is_hw(u->pcm_handle))
          pa_sink_set_max_rewind_within_thread(u->sink, u->hwbuf_size);
     else {
         pa_log_info("Disabling rewind_within_thread for device %s", u->device_name);
@@ -1047,19 +1197,22 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
     fix_min_sleep_wakeup(u);
     fix_tsched_watermark(u);
 
-    if (in_thread)
-        pa_sink_set_latency_range_within_thread(u->sink,
-                                                u->min_latency_ref,
-                                                pa_bytes_to_usec(u->hwbuf_size, ss));
-    else {
-        pa_sink_set_latency_range(u->sink,
-                                  0,
-                                  pa_bytes_to_usec(u->hwbuf_size, ss));
-
-        /* work-around assert in pa_sink_set_latency_within_thead,
-           keep track of min_latency and reuse it when
-           this routine is called from IO context */
-        u->min_latency_ref = u->sink->thread_info.min_latency;
+    /* A sink with fixed latency has no latency range */
+    if (!u->fixed_latency) {
+        if (in_thread)
+            pa_sink_set_latency_range_within_thread(u->sink,
+                                                    u->min_latency_ref,
+                                                    pa_bytes_to_usec(u->hwbuf_size, ss));
+        else {
+            pa_sink_set_latency_range(u->sink,
+                                      0,
+                                      pa_bytes_to_usec(u->hwbuf_size, ss));
+
+            /* work-around assert in pa_sink_set_latency_within_thead,
+               keep track of min_latency and reuse it when
+               this routine is called from IO context */
+            u->min_latency_ref = u->sink->thread_info.min_latency;
+        }
     }
 
     pa_log_info("Time scheduling watermark is %0.2fms",
@@ -1075,7 +1228,29 @@ static int unsuspend(struct userdata *u) {
     char *device_name = NULL;
 
     pa_assert(u);
-    pa_assert(!u->pcm_handle);
+
+    if (u->pcm_handle) {
+        pa_assert(u->pcm_stopped);
+
+        /* The PCM was kept open on suspend: unless something it was
+         * configured for changed since, we can just start it again */
+        if (u->pcm_passthrough == pa_sink_is_passthrough(u->sink) &&
+            pa_sample_spec_equal(&u->sink->sample_spec, &u->pcm_sample_spec)) {
+
+            u->pcm_stopped = false;
+
+            if ((err = snd_pcm_prepare(u->pcm_handle)) < 0) {
+                pa_log("Failed to prepare the PCM device for fast resume: %s", pa_alsa_strerror(err));
+                goto fail;
+            }
+
+            pa_log_info("Resuming the open device...");
+            goto resumed;
+        }
+
+        u->pcm_stopped = false;
+        close_pcm(u);
+    }
 
     pa_log_info("Trying resume...");
 
@@ -1096,6 +1271,17 @@ static int unsuspend(struct userdata *u) {
         goto fail;
     }
 
+    if (u->pcm_passthrough == pa_sink_is_passthrough(u->sink) &&
+        pa_sample_spec_equal(&u->sink->sample_spec, &u->pcm_sample_spec)) {
+
+        if ((err = snd_pcm_hw_params(u->pcm_handle, u->hw_params)) >= 0) {
+            pa_log_debug("Restored the previous hardware parameters.");
+            goto resumed;
+        }
+
+        pa_log_debug("Failed to restore the previous hardware parameters, negotiating them again: %s", pa_alsa_strerror(err));
+    }
+
     ss = u->sink->sample_spec;
     period_size = u->fragment_size / u->frame_size;
     buffer_size = u->hwbuf_size / u->frame_size;
@@ -1125,6 +1311,11 @@ static int unsuspend(struct userdata *u) {
         goto fail;
     }
 
+    u->pcm_passthrough = pa_sink_is_passthrough(u->sink);
+    u->pcm_sample_spec = ss;
+    snd_pcm_hw_params_current(u->pcm_handle, u->hw_params);
+
+resumed:
     if (update_sw_params(u) < 0)
         goto fail;
 
@@ -1149,26 +1340,99 @@ static int unsuspend(struct userdata *u) {
     return 0;
 
 fail:
-    if (u->pcm_handle) {
-        snd_pcm_close(u->pcm_handle);
-        u->pcm_handle = NULL;
-    }
+    if (u->pcm_handle)
+        close_pcm(u);
 
     pa_xfree(device_name);
 
     return -PA_ERR_IO;
 }
 
+/* Called from main context */
+static void publish_stats(struct userdata *u, const struct wakeup_stats *s, pa_usec_t interval) {
+    pa_proplist *pl;
+    pa_rtpoll_stats cpu;
+
+    u->underruns_total += s->underruns;
+    pa_rtpoll_get_stats(u->rtpoll, &cpu);
+
+    pl = pa_proplist_new();
+    pa_proplist_setf(pl, "alsa.stats.wakeups", "%u", s->wakeups);
+    pa_proplist_setf(pl, "alsa.stats.wakeup_usec_avg", "%llu",
+                     (unsigned long long) (s->wakeups > 0 ? s->busy / s->wakeups : 0));
+    pa_proplist_setf(pl, "alsa.stats.wakeup_usec_max", "%llu", (unsigned long long) s->busy_max);
+    pa_proplist_setf(pl, "alsa.stats.load", "%0.2f%%", (double) s->busy * 100 / (double) interval);
+    pa_proplist_setf(pl, "alsa.stats.underruns", "%u", u->underruns_total);
+
+    /* What the thread actually ran on the CPU, other than the wall
+     * clock time above this doesn't include being preempted */
+    if (cpu.wall_usec > u->cpu_stats.wall_usec) {
+        pa_proplist_setf(pl, "alsa.stats.cpu_load", "%0.2f%%",
+                         (double) (cpu.cpu_usec - u->cpu_stats.cpu_usec) * 100 /
+                         (double) (cpu.wall_usec - u->cpu_stats.wall_usec));
+        pa_proplist_setf(pl, "alsa.stats.cpu_usec_max", "%llu", (unsigned long long) cpu.max_cpu_usec);
+    }
+
+    u->cpu_stats = cpu;
+    pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, pl);
+    pa_proplist_free(pl);
+}
+
+/* Called from IO context */
+static void account_wakeup(struct userdata *u, pa_usec_t woken_up) {
+    pa_usec_t now, busy;
+
+    now = pa_rtclock_now();
+    busy = now - woken_up;
+
+    u->stats.wakeups++;
+    u->stats.busy += busy;
+    u->stats.busy_max = PA_MAX(u->stats.busy_max, busy);
+
+    if (now < u->stats.start + STATS_INTERVAL_USEC)
+        return;
+
+    pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_UPDATE_STATS,
+                      pa_xmemdup(&u->stats, sizeof(u->stats)), (int64_t) (now - u->stats.start), NULL, pa_xfree);
+
+    pa_zero(u->stats);
+    u->stats.start = now;
+}
+
 /* Called from IO context */
 static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SINK(o)->userdata;
 
     switch (code) {
 
+        case SINK_MESSAGE_UPDATE_STATS:
+
+            /* This one is delivered to us from the main context, like
+             * SINK_MESSAGE_POST in module-tunnel */
+            publish_stats(u, data, (pa_usec_t) offset);
+            return 0;
+
+        case SINK_MESSAGE_PCM_CLOSED:
+
+            /* Delivered to us from the IO thread, like
+             * SINK_MESSAGE_UPDATE_STATS. Ignore it if we resumed, or
+             * suspended again, in the meantime. */
+            if ((unsigned) offset == u->suspend_serial && u->sink->state == PA_SINK_SUSPENDED)
+                reserve_done(u);
+
+            return 0;
+
+        case SINK_MESSAGE_CLOSE_PCM:
+
+            if (u->pcm_stopped)
+                close_pcm(u);
+
+            return 0;
+
         case PA_SINK_MESSAGE_GET_LATENCY: {
             pa_usec_t r = 0;
 
-            if (u->pcm_handle)
+            if (u->pcm_handle && !u->pcm_stopped)
                 r = sink_get_latency(u);
 
             *((pa_usec_t*) data) = r;
@@ -1230,9 +1494,17 @@ static int sink_set_state_cb(pa_sink *s, pa_sink_state_t new_state) {
 
     old_state = pa_sink_get_state(u->sink);
 
-    if (PA_SINK_IS_OPENED(old_state) && new_state == PA_SINK_SUSPENDED)
-        reserve_done(u);
-    else if (old_state == PA_SINK_SUSPENDED && PA_SINK_IS_OPENED(new_state))
+    if (PA_SINK_IS_OPENED(old_state) && new_state == PA_SINK_SUSPENDED) {
+        /* Only idleness may keep the device open, anything else wants
+         * it closed right away. Since the IO thread doesn't learn about
+         * other reasons being added while we are suspended, it closes
+         * the device after fast_resume_usec in any case. */
+        u->keep_open = u->fast_resume_usec > 0 && s->suspend_cause == PA_SUSPEND_IDLE;
+        u->suspend_serial++;
+
+        if (!u->keep_open)
+            reserve_done(u);
+    } else if (old_state == PA_SINK_SUSPENDED && PA_SINK_IS_OPENED(new_state))
         if (reserve_init(u, u->device_name) < 0)
             return -PA_ERR_BUSY;
 
@@ -1527,7 +1799,7 @@ static void sink_update_requested_latency_cb(pa_sink *s) {
                                * we can dynamically adjust the
                                * latency */
 
-    if (!u->pcm_handle)
+    if (!u->pcm_handle || u->pcm_stopped)
         return;
 
     before = u->hwbuf_unused;
@@ -1545,6 +1817,68 @@ static void sink_update_requested_latency_cb(pa_sink *s) {
     }
 }
 
+/* Called from IO context */
+static bool inputs_silent(struct userdata *u) {
+    pa_sink_input *i;
+    void *state = NULL;
+
+    PA_HASHMAP_FOREACH(i, u->sink->thread_info.inputs, state)
+        if (i->thread_info.state == PA_SINK_INPUT_RUNNING)
+            return false;
+
+    return true;
+}
+
+/* Called from IO context */
+static void update_idle(struct userdata *u) {
+    pa_usec_t now;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    /* Without rewinds a starting stream would have to wait for the
+     * whole buffer to play out */
+    if (u->sink->thread_info.max_rewind <= 0 || !inputs_silent(u)) {
+        u->idle_since = 0;
+
+        if (u->idle) {
+            pa_log_debug("Leaving idle mode, requesting rewind.");
+
+            u->idle = false;
+            pa_rtclock_set_timer_slack(0);
+            update_sw_params(u);
+
+            /* Get rid of the silence we queued up */
+            pa_sink_request_rewind(u->sink, (size_t) -1);
+        }
+
+        return;
+    }
+
+    if (u->idle)
+        return;
+
+    now = pa_rtclock_now();
+
+    if (u->idle_since <= 0) {
+        u->idle_since = now;
+        return;
+    }
+
+    if (now - u->idle_since < IDLE_AFTER_USEC)
+        return;
+
+    pa_log_debug("Only silence for %0.2fs, entering idle mode.", (double) (now - u->idle_since) / PA_USEC_PER_SEC);
+
+    u->idle = true;
+    update_sw_params(u);
+
+    /* We wake up only a few times per buffer now, which the kernel may
+     * as well batch with other timers as long as we still make it in
+     * time */
+    pa_rtclock_set_timer_slack(u->tsched_watermark_usec / 2);
+}
+
 static pa_idxset* sink_get_formats(pa_sink *s) {
     struct userdata *u = s->userdata;
 
@@ -1642,7 +1976,7 @@ static int process_rewind(struct userdata *u) {
 
     pa_log_debug("Requested to rewind %lu bytes.", (unsigned long) rewind_nbytes);
 
-    if (PA_UNLIKELY((unused = pa_alsa_safe_avail(u->pcm_handle, u->hwbuf_size, &u->sink->sample_spec)) < 0)) {
+    if (PA_UNLIKELY((unused = query_avail(u)) < 0)) {
         if (try_recover(u, "snd_pcm_avail", (int) unused) < 0) {
             pa_log_warn("Trying to recover from underrun failed during rewind");
             return -1;
@@ -1700,16 +2034,19 @@ static int process_rewind(struct userdata *u) {
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
     unsigned short revents = 0;
+    pa_usec_t woken_up = 0;
 
     pa_assert(u);
 
     pa_log_debug("Thread starting up");
 
-    if (u->core->realtime_scheduling)
-        pa_make_realtime(u->core->realtime_priority);
+    pa_core_set_io_thread_cpus(u->core, u->thread_cpus, u->n_thread_cpus);
+    pa_alsa_make_thread_realtime(u->core, u->fragment_size, &u->sink->sample_spec);
 
     pa_thread_mq_install(&u->thread_mq);
 
+    u->stats.start = pa_rtclock_now();
+
     for (;;) {
         int ret;
         pa_usec_t rtpoll_sleep = 0, real_sleep;
@@ -1718,6 +2055,11 @@ static void thread_func(void *userdata) {
         pa_log_debug("Loop");
 #endif
 
+        u->status_valid = false;
+
+        if (u->use_tsched && PA_SINK_IS_OPENED(u->sink->thread_info.state))
+            update_idle(u);
+
         if (PA_UNLIKELY(u->sink->thread_info.rewind_requested)) {
             if (process_rewind(u) < 0)
                 goto fail;
@@ -1729,11 +2071,15 @@ static void thread_func(void *userdata) {
             pa_usec_t sleep_usec = 0;
             bool on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
 
+            pa_trace_begin(PA_TRACE_ALSA_SINK_WRITE, u->use_mmap);
+
             if (u->use_mmap)
                 work_done = mmap_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
             else
                 work_done = unix_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
 
+            pa_trace_end(PA_TRACE_ALSA_SINK_WRITE, work_done);
+
             if (work_done < 0)
                 goto fail;
 
@@ -1753,6 +2099,9 @@ static void thread_func(void *userdata) {
                 update_smoother(u);
             }
 
+            /* Lets the main thread read the latency without asking us */
+            pa_sink_update_latency_snapshot(u->sink, !u->first);
+
             if (u->use_tsched) {
                 pa_usec_t cusec;
 
@@ -1804,17 +2153,43 @@ static void thread_func(void *userdata) {
             }
         }
 
+        if (u->pcm_stopped) {
+            pa_usec_t now = pa_rtclock_now();
+
+            if (now >= u->close_at)
+                close_pcm(u);
+            else if (rtpoll_sleep == 0 || u->close_at - now < rtpoll_sleep)
+                rtpoll_sleep = u->close_at - now;
+        }
+
         if (rtpoll_sleep > 0) {
+            /* Waking up a bit early is harmless, the watermark covers
+             * far more than that */
+            if (u->wakeup_domain)
+                rtpoll_sleep = pa_wakeup_domain_align(u->wakeup_domain, u->wakeup_slot, pa_rtclock_now(), rtpoll_sleep, u->tsched_watermark_usec / 2);
+
             pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
             real_sleep = pa_rtclock_now();
         }
-        else
+        else {
+            if (u->wakeup_domain)
+                pa_wakeup_domain_clear(u->wakeup_domain, u->wakeup_slot);
+
             pa_rtpoll_set_timer_disabled(u->rtpoll);
+        }
+
+        if (u->fixed_latency && woken_up > 0)
+            account_wakeup(u, woken_up);
 
         /* Hmm, nothing to do. Let's sleep */
         if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
             goto fail;
 
+        if (u->fixed_latency && PA_SINK_IS_OPENED(u->sink->thread_info.state))
+            woken_up = pa_rtclock_now();
+        else
+            woken_up = 0;
+
         if (rtpoll_sleep > 0) {
             real_sleep = pa_rtclock_now() - real_sleep;
 #ifdef DEBUG_TIMING
@@ -1905,7 +2280,10 @@ static void find_mixer(struct userdata *u, pa_alsa_mapping *mapping, const char
     if (!mapping && !element)
         return;
 
-    if (!(u->mixer_handle = pa_alsa_open_mixer_for_pcm(u->pcm_handle, &u->control_device))) {
+    if (u->profile_set)
+        u->mixer_handle = pa_alsa_profile_set_take_mixer(u->profile_set, u->pcm_handle, &u->control_device);
+
+    if (!u->mixer_handle && !(u->mixer_handle = pa_alsa_open_mixer_for_pcm(u->pcm_handle, &u->control_device))) {
         pa_log_info("Failed to find a working mixer device.");
         return;
     }
@@ -2015,15 +2393,43 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
     return 0;
 }
 
+static void setup_wakeup_domain(struct userdata *u, pa_modargs *ma) {
+    const char *name, *card;
+    char *t = NULL;
+
+    pa_assert(u);
+    pa_assert(ma);
+
+    if (!(name = pa_modargs_get_value(ma, "wakeup_domain", NULL))) {
+        if (!(card = pa_proplist_gets(u->sink->proplist, "alsa.card")))
+            return;
+
+        name = t = pa_sprintf_malloc("alsa-card-%s", card);
+    }
+
+    /* An empty name opts out */
+    if (*name) {
+        u->wakeup_domain = pa_wakeup_domain_get(u->core, name);
+
+        if ((u->wakeup_slot = pa_wakeup_domain_join(u->wakeup_domain)) < 0) {
+            pa_wakeup_domain_unref(u->wakeup_domain);
+            u->wakeup_domain = NULL;
+        } else
+            pa_log_debug("Joined wakeup domain %s.", name);
+    }
+
+    pa_xfree(t);
+}
+
 pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping) {
 
     struct userdata *u = NULL;
-    const char *dev_id = NULL, *key, *mod_name;
+    const char *dev_id = NULL, *key, *mod_name, *thread_cpus;
     pa_sample_spec ss;
     char *thread_name = NULL;
     uint32_t alternate_sample_rate;
     pa_channel_map map;
-    uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark, rewind_safeguard;
+    uint32_t nfrags, frag_size, buffer_size, tsched_size, tsched_watermark, rewind_safeguard, fixed_latency_usec = 0, fast_resume_usec = 0;
     snd_pcm_uframes_t period_frames, buffer_frames, tsched_frames;
     size_t frame_size;
     bool use_mmap = true, b, use_tsched = true, d, ignore_dB = false, namereg_fail = false, deferred_volume = false, set_formats = false, fixed_latency_range = false;
@@ -2081,6 +2487,23 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "fixed_latency_usec", &fixed_latency_usec) < 0) {
+        pa_log("Failed to parse fixed_latency_usec argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "fast_resume_usec", &fast_resume_usec) < 0) {
+        pa_log("Failed to parse fast_resume_usec argument.");
+        goto fail;
+    }
+
+    /* In fixed latency mode the whole buffer is kept filled, so its size
+     * is the latency */
+    if (fixed_latency_usec > 0) {
+        tsched_size = (uint32_t) pa_usec_to_bytes(fixed_latency_usec, &ss);
+        frag_size = PA_MAX((uint32_t) pa_frame_align(tsched_size / PA_MAX(nfrags, 1U), &ss), (uint32_t) frame_size);
+    }
+
     buffer_size = nfrags * frag_size;
 
     period_frames = frag_size/frame_size;
@@ -2119,6 +2542,9 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    if (fixed_latency_usec > 0)
+        fixed_latency_range = true;
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -2128,10 +2554,18 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     u->use_tsched = use_tsched;
     u->deferred_volume = deferred_volume;
     u->fixed_latency_range = fixed_latency_range;
+    u->fixed_latency = fixed_latency_usec;
+    u->fast_resume_usec = fast_resume_usec;
     u->first = true;
     u->rewind_safeguard = rewind_safeguard;
     u->rtpoll = pa_rtpoll_new();
 
+    if ((thread_cpus = pa_modargs_get_value(ma, "thread_cpus", NULL)) &&
+        pa_parse_cpu_list(thread_cpus, &u->thread_cpus, &u->n_thread_cpus) < 0) {
+        pa_log("Failed to parse thread_cpus argument.");
+        goto fail;
+    }
+
     if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
         pa_log("pa_thread_mq_init() failed.");
         goto fail;
@@ -2147,6 +2581,11 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
             true);
     u->smoother_interval = SMOOTHER_MIN_INTERVAL;
 
+    if (snd_pcm_status_malloc(&u->status) < 0) {
+        pa_log("snd_pcm_status_malloc() failed.");
+        goto fail;
+    }
+
     /* use ucm */
     if (mapping && mapping->ucm_context.ucm)
         u->ucm_context = &mapping->ucm_context;
@@ -2255,6 +2694,9 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
             pa_log_info("Disabling latency range changes on underrun");
     }
 
+    if (u->fixed_latency)
+        pa_log_info("Using a fixed latency without rewinding.");
+
     /* All passthrough formats supported by PulseAudio require
      * IEC61937 framing with two fake channels. So, passthrough
      * clients will always send two channels. Multichannel sinks
@@ -2273,6 +2715,11 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     /* ALSA might tweak the sample spec, so recalculate the frame size */
     frame_size = pa_frame_size(&ss);
 
+    /* A card keeps its profile set, and so the mixers we hand back, for
+     * as long as it lives */
+    if (card && mapping)
+        u->profile_set = mapping->profile_set;
+
     if (!u->ucm_context)
         find_mixer(u, mapping, pa_modargs_get_value(ma, "control", NULL), ignore_dB);
 
@@ -2328,7 +2775,8 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     else if (u->mixer_path_set)
         pa_alsa_add_ports(&data, u->mixer_path_set, card);
 
-    u->sink = pa_sink_new(m->core, &data, PA_SINK_HARDWARE | PA_SINK_LATENCY | (u->use_tsched ? PA_SINK_DYNAMIC_LATENCY : 0) |
+    u->sink = pa_sink_new(m->core, &data, PA_SINK_HARDWARE | PA_SINK_LATENCY |
+                          (u->use_tsched && !u->fixed_latency ? PA_SINK_DYNAMIC_LATENCY : 0) |
                           (set_formats ? PA_SINK_SET_FORMATS : 0));
     volume_is_set = data.volume_is_set;
     mute_is_set = data.muted_is_set;
@@ -2339,6 +2787,10 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    u->pcm_sample_spec = u->sink->sample_spec;
+    snd_pcm_hw_params_malloc(&u->hw_params);
+    snd_pcm_hw_params_current(u->pcm_handle, u->hw_params);
+
     if (pa_modargs_get_value_u32(ma, "deferred_volume_safety_margin",
                                  &u->sink->thread_info.volume_change_safety_margin) < 0) {
         pa_log("Failed to parse deferred_volume_safety_margin parameter");
@@ -2352,7 +2804,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     }
 
     u->sink->parent.process_msg = sink_process_msg;
-    if (u->use_tsched)
+    if (u->use_tsched && !u->fixed_latency)
         u->sink->update_requested_latency = sink_update_requested_latency_cb;
     u->sink->set_state = sink_set_state_cb;
     if (u->ucm_context)
@@ -2380,7 +2832,9 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
                 (double) pa_bytes_to_usec(u->hwbuf_size, &ss) / PA_USEC_PER_MSEC);
 
     pa_sink_set_max_request(u->sink, u->hwbuf_size);
-    if (pa_alsa_pcm_is_hw(u->pcm_handle))
+    if (u->fixed_latency)
+        pa_sink_set_max_rewind(u->sink, 0);
+    else if (pa_alsa_pcm_is_hw(u->pcm_handle))
         pa_sink_set_max_rewind(u->sink, u->hwbuf_size);
     else {
         pa_log_info("Disabling rewind for device %s", u->device_name);
@@ -2390,7 +2844,9 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     if (u->use_tsched) {
         u->tsched_watermark_ref = tsched_watermark;
         reset_watermark(u, u->tsched_watermark_ref, &ss, false);
-    } else
+    }
+
+    if (!u->use_tsched || u->fixed_latency)
         pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->hwbuf_size, &ss));
 
     reserve_update(u);
@@ -2406,6 +2862,9 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
 
     pa_alsa_dump(PA_LOG_DEBUG, u->pcm_handle);
 
+    if (u->use_tsched)
+        setup_wakeup_domain(u, ma);
+
     thread_name = pa_sprintf_malloc("alsa-sink-%s", pa_strnull(pa_proplist_gets(u->sink->proplist, "alsa.id")));
     if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
         pa_log("Failed to create thread.");
@@ -2483,6 +2942,11 @@ static void userdata_free(struct userdata *u) {
         pa_thread_free(u->thread);
     }
 
+    if (u->wakeup_domain) {
+        pa_wakeup_domain_leave(u->wakeup_domain, u->wakeup_slot);
+        pa_wakeup_domain_unref(u->wakeup_domain);
+    }
+
     pa_thread_mq_done(&u->thread_mq);
 
     if (u->sink)
@@ -2511,12 +2975,22 @@ static void userdata_free(struct userdata *u) {
     if (u->mixer_path && !u->mixer_path_set)
         pa_alsa_path_free(u->mixer_path);
 
-    if (u->mixer_handle)
-        snd_mixer_close(u->mixer_handle);
+    if (u->mixer_handle) {
+        if (u->profile_set && u->control_device)
+            pa_alsa_profile_set_park_mixer(u->profile_set, u->control_device, u->mixer_handle);
+        else
+            snd_mixer_close(u->mixer_handle);
+    }
 
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->status)
+        snd_pcm_status_free(u->status);
+
+    if (u->hw_params)
+        snd_pcm_hw_params_free(u->hw_params);
+
     if (u->formats)
         pa_idxset_free(u->formats, (pa_free_cb_t) pa_format_info_free);
 
@@ -2526,6 +3000,7 @@ static void userdata_free(struct userdata *u) {
     reserve_done(u);
     monitor_done(u);
 
+    pa_xfree(u->thread_cpus);
     pa_xfree(u->device_name);
     pa_xfree(u->control_device);
     pa_xfree(u->paths_dir);
@@ -24,6 +24,7 @@
 
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <asoundlib.h>
 
@@ -47,6 +48,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/wakeup-domain.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -87,6 +89,10 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* CPUs the IO thread is restricted to, if not the daemon default */
+    int *thread_cpus;
+    unsigned n_thread_cpus;
+
     snd_pcm_t *pcm_handle;
 
     char *paths_dir;
@@ -122,6 +128,7 @@ struct userdata {
 
     char *device_name;  /* name of the PCM device */
     char *control_device; /* name of the control device */
+    pa_alsa_profile_set *profile_set; /* of our card, to hand the mixer back to */
 
     bool use_mmap:1, use_tsched:1, deferred_volume:1, fixed_latency_range:1;
 
@@ -129,6 +136,11 @@ struct userdata {
 
     pa_rtpoll_item *alsa_rtpoll_item;
 
+    /* Our timer wakeups are aligned with the other devices of the
+     * same card, or whatever wakeup_domain= says */
+    pa_wakeup_domain *wakeup_domain;
+    int wakeup_slot;
+
     pa_smoother *smoother;
     uint64_t read_count;
     pa_usec_t smoother_interval;
@@ -477,15 +489,36 @@ static size_t check_left_to_record(struct userdata *u, size_t n_bytes, bool on_t
     return left_to_record;
 }
 
+static void post_pending(struct userdata *u, pa_memchunk *pending) {
+    if (!pending->memblock)
+        return;
+
+    if (pending->length > 0)
+        pa_source_post(u->source, pending);
+
+    pa_memblock_unref(pending->memblock);
+    pa_memchunk_reset(pending);
+}
+
 static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bool on_timeout) {
     bool work_done = false;
     pa_usec_t max_sleep_usec = 0, process_usec = 0;
     size_t left_to_record;
     unsigned j = 0;
+    pa_memchunk pending;
+    bool copy;
 
     pa_assert(u);
     pa_source_assert_ref(u->source);
 
+    /* Outputs that keep what we post, e.g. in a memblockq, would make
+     * pa_memblock_unref_fixed() copy the mmap area anyway. So if there
+     * are any, we copy right away into pool blocks, filled across
+     * segments and posted once per call, which can then be passed on
+     * as they are, down to the clients' shared memory. */
+    copy = pa_hashmap_size(u->source->thread_info.outputs) > 0;
+    pa_memchunk_reset(&pending);
+
     if (u->use_tsched)
         hw_sleep_time(u, &max_sleep_usec, &process_usec);
 
@@ -500,6 +533,7 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
             if ((r = try_recover(u, "snd_pcm_avail", (int) n)) == 0)
                 continue;
 
+            post_pending(u, &pending);
             return r;
         }
 
@@ -572,6 +606,7 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
                 if ((r = try_recover(u, "snd_pcm_mmap_begin", err)) == 0)
                     continue;
 
+                post_pending(u, &pending);
                 return r;
             }
 
@@ -594,18 +629,37 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
 
             p = (uint8_t*) areas[0].addr + (offset * u->frame_size);
 
-            chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, frames * u->frame_size, true);
-            chunk.length = pa_memblock_get_length(chunk.memblock);
-            chunk.index = 0;
+            if (copy) {
+                uint8_t *d;
 
-            pa_source_post(u->source, &chunk);
-            pa_memblock_unref_fixed(chunk.memblock);
+                if (pending.memblock && pa_memblock_get_length(pending.memblock) - pending.length < u->frame_size)
+                    post_pending(u, &pending);
+
+                if (!pending.memblock)
+                    pending.memblock = pa_memblock_new(u->core->mempool, (size_t) -1);
+
+                frames = PA_MIN(frames, (pa_memblock_get_length(pending.memblock) - pending.length) / u->frame_size);
+
+                d = pa_memblock_acquire(pending.memblock);
+                memcpy(d + pending.length, p, frames * u->frame_size);
+                pa_memblock_release(pending.memblock);
+
+                pending.length += frames * u->frame_size;
+            } else {
+                chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, frames * u->frame_size, true);
+                chunk.length = pa_memblock_get_length(chunk.memblock);
+                chunk.index = 0;
+
+                pa_source_post(u->source, &chunk);
+                pa_memblock_unref_fixed(chunk.memblock);
+            }
 
             if (PA_UNLIKELY((sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames)) < 0)) {
 
                 if ((r = try_recover(u, "snd_pcm_mmap_commit", (int) sframes)) == 0)
                     continue;
 
+                post_pending(u, &pending);
                 return r;
             }
 
@@ -624,6 +678,8 @@ static int mmap_read(struct userdata *u, pa_usec_t *sleep_usec, bool polled, boo
         }
     }
 
+    post_pending(u, &pending);
+
     if (u->use_tsched) {
         *sleep_usec = pa_bytes_to_usec(left_to_record, &u->source->sample_spec);
         process_usec = u->tsched_watermark_usec;
@@ -1434,8 +1490,8 @@ static void thread_func(void *userdata) {
 
     pa_log_debug("Thread starting up");
 
-    if (u->core->realtime_scheduling)
-        pa_make_realtime(u->core->realtime_priority);
+    pa_core_set_io_thread_cpus(u->core, u->thread_cpus, u->n_thread_cpus);
+    pa_alsa_make_thread_realtime(u->core, u->fragment_size, &u->source->sample_spec);
 
     pa_thread_mq_install(&u->thread_mq);
 
@@ -1475,6 +1531,9 @@ static void thread_func(void *userdata) {
             if (work_done)
                 update_smoother(u);
 
+            /* Lets the main thread read the latency without asking us */
+            pa_source_update_latency_snapshot(u->source, true);
+
             if (u->use_tsched) {
                 pa_usec_t cusec;
 
@@ -1506,11 +1565,20 @@ static void thread_func(void *userdata) {
         }
 
         if (rtpoll_sleep > 0) {
+            /* Waking up a bit early is harmless, the watermark covers
+             * far more than that */
+            if (u->wakeup_domain)
+                rtpoll_sleep = pa_wakeup_domain_align(u->wakeup_domain, u->wakeup_slot, pa_rtclock_now(), rtpoll_sleep, u->tsched_watermark_usec / 2);
+
             pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
             real_sleep = pa_rtclock_now();
         }
-        else
+        else {
+            if (u->wakeup_domain)
+                pa_wakeup_domain_clear(u->wakeup_domain, u->wakeup_slot);
+
             pa_rtpoll_set_timer_disabled(u->rtpoll);
+        }
 
         /* Hmm, nothing to do. Let's sleep */
         if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
@@ -1605,7 +1673,10 @@ static void find_mixer(struct userdata *u, pa_alsa_mapping *mapping, const char
     if (!mapping && !element)
         return;
 
-    if (!(u->mixer_handle = pa_alsa_open_mixer_for_pcm(u->pcm_handle, &u->control_device))) {
+    if (u->profile_set)
+        u->mixer_handle = pa_alsa_profile_set_take_mixer(u->profile_set, u->pcm_handle, &u->control_device);
+
+    if (!u->mixer_handle && !(u->mixer_handle = pa_alsa_open_mixer_for_pcm(u->pcm_handle, &u->control_device))) {
         pa_log_info("Failed to find a working mixer device.");
         return;
     }
@@ -1714,10 +1785,38 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
     return 0;
 }
 
+static void setup_wakeup_domain(struct userdata *u, pa_modargs *ma) {
+    const char *name, *card;
+    char *t = NULL;
+
+    pa_assert(u);
+    pa_assert(ma);
+
+    if (!(name = pa_modargs_get_value(ma, "wakeup_domain", NULL))) {
+        if (!(card = pa_proplist_gets(u->source->proplist, "alsa.card")))
+            return;
+
+        name = t = pa_sprintf_malloc("alsa-card-%s", card);
+    }
+
+    /* An empty name opts out */
+    if (*name) {
+        u->wakeup_domain = pa_wakeup_domain_get(u->core, name);
+
+        if ((u->wakeup_slot = pa_wakeup_domain_join(u->wakeup_domain)) < 0) {
+            pa_wakeup_domain_unref(u->wakeup_domain);
+            u->wakeup_domain = NULL;
+        } else
+            pa_log_debug("Joined wakeup domain %s.", name);
+    }
+
+    pa_xfree(t);
+}
+
 pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping) {
 
     struct userdata *u = NULL;
-    const char *dev_id = NULL, *key, *mod_name;
+    const char *dev_id = NULL, *key, *mod_name, *thread_cpus;
     pa_sample_spec ss;
     char *thread_name = NULL;
     uint32_t alternate_sample_rate;
@@ -1824,6 +1923,12 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     u->first = true;
     u->rtpoll = pa_rtpoll_new();
 
+    if ((thread_cpus = pa_modargs_get_value(ma, "thread_cpus", NULL)) &&
+        pa_parse_cpu_list(thread_cpus, &u->thread_cpus, &u->n_thread_cpus) < 0) {
+        pa_log("Failed to parse thread_cpus argument.");
+        goto fail;
+    }
+
     if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
         pa_log("pa_thread_mq_init() failed.");
         goto fail;
@@ -1955,6 +2060,11 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     /* ALSA might tweak the sample spec, so recalculate the frame size */
     frame_size = pa_frame_size(&ss);
 
+    /* A card keeps its profile set, and so the mixers we hand back, for
+     * as long as it lives */
+    if (card && mapping)
+        u->profile_set = mapping->profile_set;
+
     if (!u->ucm_context)
         find_mixer(u, mapping, pa_modargs_get_value(ma, "control", NULL), ignore_dB);
 
@@ -2080,6 +2190,9 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
 
     pa_alsa_dump(PA_LOG_DEBUG, u->pcm_handle);
 
+    if (u->use_tsched)
+        setup_wakeup_domain(u, ma);
+
     thread_name = pa_sprintf_malloc("alsa-source-%s", pa_strnull(pa_proplist_gets(u->source->proplist, "alsa.id")));
     if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
         pa_log("Failed to create thread.");
@@ -2142,6 +2255,11 @@ static void userdata_free(struct userdata *u) {
         pa_thread_free(u->thread);
     }
 
+    if (u->wakeup_domain) {
+        pa_wakeup_domain_leave(u->wakeup_domain, u->wakeup_slot);
+        pa_wakeup_domain_unref(u->wakeup_domain);
+    }
+
     pa_thread_mq_done(&u->thread_mq);
 
     if (u->source)
@@ -2167,8 +2285,12 @@ static void userdata_free(struct userdata *u) {
     if (u->mixer_path && !u->mixer_path_set)
         pa_alsa_path_free(u->mixer_path);
 
-    if (u->mixer_handle)
-        snd_mixer_close(u->mixer_handle);
+    if (u->mixer_handle) {
+        if (u->profile_set && u->control_device)
+            pa_alsa_profile_set_park_mixer(u->profile_set, u->control_device, u->mixer_handle);
+        else
+            snd_mixer_close(u->mixer_handle);
+    }
 
     if (u->smoother)
         pa_smoother_free(u->smoother);
@@ -2179,6 +2301,7 @@ static void userdata_free(struct userdata *u) {
     reserve_done(u);
     monitor_done(u);
 
+    pa_xfree(u->thread_cpus);
     pa_xfree(u->device_name);
     pa_xfree(u->control_device);
     pa_xfree(u->paths_dir);
@@ -207,6 +207,7 @@ static int ucm_get_device_property(
         pa_alsa_ucm_device *device,
         snd_use_case_mgr_t *uc_mgr,
         pa_alsa_ucm_verb *verb,
+        const char *verb_name,
         const char *device_name) {
 
     const char *value;
@@ -218,7 +219,7 @@ static int ucm_get_device_property(
     int n_confdev, n_suppdev;
 
     for (i = 0; item[i].id; i++) {
-        id = pa_sprintf_malloc("=%s/%s", item[i].id, device_name);
+        id = pa_sprintf_malloc("=%s/%s/%s", item[i].id, device_name, verb_name);
         err = snd_use_case_get(uc_mgr, id, &value);
         pa_xfree(id);
         if (err < 0)
@@ -340,7 +341,7 @@ static int ucm_get_device_property(
         device->capture_priority = 100;
     }
 
-    id = pa_sprintf_malloc("%s/%s", "_conflictingdevs", device_name);
+    id = pa_sprintf_malloc("%s/%s/%s", "_conflictingdevs", device_name, verb_name);
     n_confdev = snd_use_case_get_list(uc_mgr, id, &devices);
     pa_xfree(id);
 
@@ -352,7 +353,7 @@ static int ucm_get_device_property(
         snd_use_case_free_list(devices, n_confdev);
     }
 
-    id = pa_sprintf_malloc("%s/%s", "_supporteddevs", device_name);
+    id = pa_sprintf_malloc("%s/%s/%s", "_supporteddevs", device_name, verb_name);
     n_suppdev = snd_use_case_get_list(uc_mgr, id, &devices);
     pa_xfree(id);
 
@@ -368,7 +369,12 @@ static int ucm_get_device_property(
 };
 
 /* Create a property list for this ucm modifier */
-static int ucm_get_modifier_property(pa_alsa_ucm_modifier *modifier, snd_use_case_mgr_t *uc_mgr, const char *modifier_name) {
+static int ucm_get_modifier_property(
+        pa_alsa_ucm_modifier *modifier,
+        snd_use_case_mgr_t *uc_mgr,
+        const char *verb_name,
+        const char *modifier_name) {
+
     const char *value;
     char *id;
     int i;
@@ -376,7 +382,7 @@ static int ucm_get_modifier_property(pa_alsa_ucm_modifier *modifier, snd_use_cas
     for (i = 0; item[i].id; i++) {
         int err;
 
-        id = pa_sprintf_malloc("=%s/%s", item[i].id, modifier_name);
+        id = pa_sprintf_malloc("=%s/%s/%s", item[i].id, modifier_name, verb_name);
         err = snd_use_case_get(uc_mgr, id, &value);
         pa_xfree(id);
         if (err < 0)
@@ -387,13 +393,13 @@ static int ucm_get_modifier_property(pa_alsa_ucm_modifier *modifier, snd_use_cas
         free((void*)value);
     }
 
-    id = pa_sprintf_malloc("%s/%s", "_conflictingdevs", modifier_name);
+    id = pa_sprintf_malloc("%s/%s/%s", "_conflictingdevs", modifier_name, verb_name);
     modifier->n_confdev = snd_use_case_get_list(uc_mgr, id, &modifier->conflicting_devices);
     pa_xfree(id);
     if (modifier->n_confdev < 0)
         pa_log_debug("No %s for modifier %s", "_conflictingdevs", modifier_name);
 
-    id = pa_sprintf_malloc("%s/%s", "_supporteddevs", modifier_name);
+    id = pa_sprintf_malloc("%s/%s/%s", "_supporteddevs", modifier_name, verb_name);
     modifier->n_suppdev = snd_use_case_get_list(uc_mgr, id, &modifier->supported_devices);
     pa_xfree(id);
     if (modifier->n_suppdev < 0)
@@ -403,11 +409,14 @@ static int ucm_get_modifier_property(pa_alsa_ucm_modifier *modifier, snd_use_cas
 };
 
 /* Create a list of devices for this verb */
-static int ucm_get_devices(pa_alsa_ucm_verb *verb, snd_use_case_mgr_t *uc_mgr) {
+static int ucm_get_devices(pa_alsa_ucm_verb *verb, snd_use_case_mgr_t *uc_mgr, const char *verb_name) {
     const char **dev_list;
+    char *id;
     int num_dev, i;
 
-    num_dev = snd_use_case_get_list(uc_mgr, "_devices", &dev_list);
+    id = pa_sprintf_malloc("%s/%s", "_devices", verb_name);
+    num_dev = snd_use_case_get_list(uc_mgr, id, &dev_list);
+    pa_xfree(id);
     if (num_dev < 0)
         return num_dev;
 
@@ -429,11 +438,14 @@ static int ucm_get_devices(pa_alsa_ucm_verb *verb, snd_use_case_mgr_t *uc_mgr) {
     return 0;
 };
 
-static int ucm_get_modifiers(pa_alsa_ucm_verb *verb, snd_use_case_mgr_t *uc_mgr) {
+static int ucm_get_modifiers(pa_alsa_ucm_verb *verb, snd_use_case_mgr_t *uc_mgr, const char *verb_name) {
     const char **mod_list;
+    char *id;
     int num_mod, i;
 
-    num_mod = snd_use_case_get_list(uc_mgr, "_modifiers", &mod_list);
+    id = pa_sprintf_malloc("%s/%s", "_modifiers", verb_name);
+    num_mod = snd_use_case_get_list(uc_mgr, id, &mod_list);
+    pa_xfree(id);
     if (num_mod < 0)
         return num_mod;
 
@@ -638,11 +650,11 @@ int pa_alsa_ucm_get_verb(snd_use_case_mgr_t *uc_mgr, const char *verb_name, cons
     pa_alsa_ucm_verb *verb;
     int err = 0;
 
+    /* Everything is looked up by the verb name, so that the verb doesn't
+     * need to be set here. Setting it would run its enable sequence for
+     * nothing, which takes a while on some cards. */
     *p_verb = NULL;
-    pa_log_info("Set UCM verb to %s", verb_name);
-    err = snd_use_case_set(uc_mgr, "_verb", verb_name);
-    if (err < 0)
-        return err;
+    pa_log_info("Query UCM verb %s", verb_name);
 
     verb = pa_xnew0(pa_alsa_ucm_verb, 1);
     verb->proplist = pa_proplist_new();
@@ -650,11 +662,11 @@ int pa_alsa_ucm_get_verb(snd_use_case_mgr_t *uc_mgr, const char *verb_name, cons
     pa_proplist_sets(verb->proplist, PA_ALSA_PROP_UCM_NAME, pa_strnull(verb_name));
     pa_proplist_sets(verb->proplist, PA_ALSA_PROP_UCM_DESCRIPTION, pa_strna(verb_desc));
 
-    err = ucm_get_devices(verb, uc_mgr);
+    err = ucm_get_devices(verb, uc_mgr, verb_name);
     if (err < 0)
         pa_log("No UCM devices for verb %s", verb_name);
 
-    err = ucm_get_modifiers(verb, uc_mgr);
+    err = ucm_get_modifiers(verb, uc_mgr, verb_name);
     if (err < 0)
         pa_log("No UCM modifiers for verb %s", verb_name);
 
@@ -665,7 +677,7 @@ int pa_alsa_ucm_get_verb(snd_use_case_mgr_t *uc_mgr, const char *verb_name, cons
         const char *dev_name = pa_proplist_gets(d->proplist, PA_ALSA_PROP_UCM_NAME);
 
         /* Devices properties */
-        ucm_get_device_property(d, uc_mgr, verb, dev_name);
+        ucm_get_device_property(d, uc_mgr, verb, verb_name, dev_name);
     }
     /* make conflicting or supported device mutual */
     PA_LLIST_FOREACH(d, verb->devices)
@@ -675,7 +687,7 @@ int pa_alsa_ucm_get_verb(snd_use_case_mgr_t *uc_mgr, const char *verb_name, cons
         const char *mod_name = pa_proplist_gets(mod->proplist, PA_ALSA_PROP_UCM_NAME);
 
         /* Modifier properties */
-        ucm_get_modifier_property(mod, uc_mgr, mod_name);
+        ucm_get_modifier_property(mod, uc_mgr, verb_name, mod_name);
 
         /* Set PA_PROP_DEVICE_INTENDED_ROLES property to devices */
         pa_log_debug("Set media roles for verb %s, modifier %s", verb_name, mod_name);
@@ -1473,14 +1485,11 @@ static snd_pcm_t* mapping_open_pcm(pa_alsa_ucm_config *ucm, pa_alsa_mapping *m,
     return pcm;
 }
 
-static void profile_finalize_probing(pa_alsa_profile *p) {
+static void profile_close_pcms(pa_alsa_profile *p) {
     pa_alsa_mapping *m;
     uint32_t idx;
 
     PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
-        if (p->supported)
-            m->supported++;
-
         if (!m->output_pcm)
             continue;
 
@@ -1489,9 +1498,6 @@ static void profile_finalize_probing(pa_alsa_profile *p) {
     }
 
     PA_IDXSET_FOREACH(m, p->input_mappings, idx) {
-        if (p->supported)
-            m->supported++;
-
         if (!m->input_pcm)
             continue;
 
@@ -1500,6 +1506,52 @@ static void profile_finalize_probing(pa_alsa_profile *p) {
     }
 }
 
+static void profile_finalize_probing(pa_alsa_profile *p) {
+    pa_alsa_mapping *m;
+    uint32_t idx;
+
+    if (p->supported) {
+        PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+            m->supported++;
+
+        PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+            m->supported++;
+    }
+
+    profile_close_pcms(p);
+}
+
+/* Returns false if any of the profile's PCMs fails to open. The ones
+ * that did open are left open, the caller has to close them. */
+static bool profile_open_pcms(pa_alsa_ucm_config *ucm, pa_alsa_profile *p) {
+    pa_alsa_mapping *m;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
+        if (PA_UCM_IS_MODIFIER_MAPPING(m)) {
+            /* Skip jack probing on modifier PCMs since we expect this to
+             * only be controlled on the main device/verb PCM. */
+            continue;
+        }
+
+        if (!(m->output_pcm = mapping_open_pcm(ucm, m, SND_PCM_STREAM_PLAYBACK)))
+            return false;
+    }
+
+    PA_IDXSET_FOREACH(m, p->input_mappings, idx) {
+        if (PA_UCM_IS_MODIFIER_MAPPING(m)) {
+            /* Skip jack probing on modifier PCMs since we expect this to
+             * only be controlled on the main device/verb PCM. */
+            continue;
+        }
+
+        if (!(m->input_pcm = mapping_open_pcm(ucm, m, SND_PCM_STREAM_CAPTURE)))
+            return false;
+    }
+
+    return true;
+}
+
 static void ucm_mapping_jack_probe(pa_alsa_mapping *m) {
     snd_pcm_t *pcm_handle;
     snd_mixer_t *mixer_handle;
@@ -1528,45 +1580,28 @@ static void ucm_probe_profile_set(pa_alsa_ucm_config *ucm, pa_alsa_profile_set *
     pa_alsa_profile *p;
     pa_alsa_mapping *m;
     uint32_t idx;
+    bool verb_set = false;
 
     PA_HASHMAP_FOREACH(p, ps->profiles, state) {
-        /* change verb */
-        pa_log_info("Set ucm verb to %s", p->name);
+        /* Setting a verb runs its enable sequence, which is the slow part
+         * of probing on some cards. Most PCMs open fine without it, so
+         * only change the verb if they don't. The verb is then activated
+         * for real when the profile is selected. */
+        if (!profile_open_pcms(ucm, p)) {
+            profile_close_pcms(p);
 
-        if ((snd_use_case_set(ucm->ucm_mgr, "_verb", p->name)) < 0) {
-            pa_log("Failed to set verb %s", p->name);
-            p->supported = false;
-            continue;
-        }
-
-        PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
-            if (PA_UCM_IS_MODIFIER_MAPPING(m)) {
-                /* Skip jack probing on modifier PCMs since we expect this to
-                 * only be controlled on the main device/verb PCM. */
-                continue;
-            }
+            pa_log_info("Set ucm verb to %s", p->name);
 
-            m->output_pcm = mapping_open_pcm(ucm, m, SND_PCM_STREAM_PLAYBACK);
-            if (!m->output_pcm) {
+            if ((snd_use_case_set(ucm->ucm_mgr, "_verb", p->name)) < 0) {
+                pa_log("Failed to set verb %s", p->name);
                 p->supported = false;
-                break;
+                continue;
             }
-        }
 
-        if (p->supported) {
-            PA_IDXSET_FOREACH(m, p->input_mappings, idx) {
-                if (PA_UCM_IS_MODIFIER_MAPPING(m)) {
-                    /* Skip jack probing on modifier PCMs since we expect this to
-                     * only be controlled on the main device/verb PCM. */
-                    continue;
-                }
+            verb_set = true;
 
-                m->input_pcm = mapping_open_pcm(ucm, m, SND_PCM_STREAM_CAPTURE);
-                if (!m->input_pcm) {
-                    p->supported = false;
-                    break;
-                }
-            }
+            if (!profile_open_pcms(ucm, p))
+                p->supported = false;
         }
 
         if (!p->supported) {
@@ -1588,7 +1623,8 @@ static void ucm_probe_profile_set(pa_alsa_ucm_config *ucm, pa_alsa_profile_set *
     }
 
     /* restore ucm state */
-    snd_use_case_set(ucm->ucm_mgr, "_verb", SND_USE_CASE_VERB_INACTIVE);
+    if (verb_set)
+        snd_use_case_set(ucm->ucm_mgr, "_verb", SND_USE_CASE_VERB_INACTIVE);
 
     pa_alsa_profile_set_drop_unsupported(ps);
 }
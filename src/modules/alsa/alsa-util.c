@@ -899,6 +899,7 @@ void pa_alsa_refcnt_dec(void) {
     if (r == 1) {
         snd_lib_error_set_handler(NULL);
         snd_config_update_free_global();
+        pa_alsa_path_cache_free();
     }
 }
 
@@ -1142,18 +1143,30 @@ pa_rtpoll_item* pa_alsa_build_pollfd(snd_pcm_t *pcm, pa_rtpoll *rtpoll) {
     return item;
 }
 
-snd_pcm_sframes_t pa_alsa_safe_avail(snd_pcm_t *pcm, size_t hwbuf_size, const pa_sample_spec *ss) {
-    snd_pcm_sframes_t n;
-    size_t k;
+/* Called from IO thread. With deadline scheduling the thread gets a
+ * quarter of the time one block takes to play as its CPU budget, which
+ * leaves room for other device threads on the same CPU. */
+void pa_alsa_make_thread_realtime(pa_core *c, size_t block_size, const pa_sample_spec *ss) {
+    pa_usec_t period;
 
-    pa_assert(pcm);
-    pa_assert(hwbuf_size > 0);
+    pa_assert(c);
     pa_assert(ss);
 
-    /* Some ALSA driver expose weird bugs, let's inform the user about
-     * what is going on */
+    if (!c->realtime_scheduling)
+        return;
 
-    n = snd_pcm_avail(pcm);
+    if (c->realtime_deadline) {
+        period = PA_CLAMP(pa_bytes_to_usec(block_size, ss), PA_USEC_PER_MSEC, 20 * PA_USEC_PER_MSEC);
+
+        if (pa_make_deadline(period / 4, period) >= 0)
+            return;
+    }
+
+    pa_make_realtime(c->realtime_priority);
+}
+
+static snd_pcm_sframes_t check_avail(snd_pcm_t *pcm, snd_pcm_sframes_t n, size_t hwbuf_size, const pa_sample_spec *ss) {
+    size_t k;
 
     if (n <= 0)
         return n;
@@ -1181,6 +1194,29 @@ snd_pcm_sframes_t pa_alsa_safe_avail(snd_pcm_t *pcm, size_t hwbuf_size, const pa
     return n;
 }
 
+snd_pcm_sframes_t pa_alsa_safe_avail(snd_pcm_t *pcm, size_t hwbuf_size, const pa_sample_spec *ss) {
+    pa_assert(pcm);
+    pa_assert(hwbuf_size > 0);
+    pa_assert(ss);
+
+    /* Some ALSA driver expose weird bugs, let's inform the user about
+     * what is going on */
+
+    return check_avail(pcm, snd_pcm_avail(pcm), hwbuf_size, ss);
+}
+
+snd_pcm_sframes_t pa_alsa_safe_avail_update(snd_pcm_t *pcm, size_t hwbuf_size, const pa_sample_spec *ss) {
+    pa_assert(pcm);
+    pa_assert(hwbuf_size > 0);
+    pa_assert(ss);
+
+    /* Unlike snd_pcm_avail() this doesn't sync the hardware pointer
+     * first, it relies on a snd_pcm_status() call having done that
+     * just before */
+
+    return check_avail(pcm, snd_pcm_avail_update(pcm), hwbuf_size, ss);
+}
+
 int pa_alsa_safe_delay(snd_pcm_t *pcm, snd_pcm_status_t *status, snd_pcm_sframes_t *delay, size_t hwbuf_size, const pa_sample_spec *ss,
                        bool capture) {
     ssize_t k;
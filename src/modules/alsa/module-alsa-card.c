@@ -21,12 +21,16 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
+
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/queue.h>
+#include <pulsecore/strbuf.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -64,11 +68,16 @@ PA_MODULE_USAGE(
         "tsched_buffer_watermark=<lower fill watermark> "
         "profile=<profile name> "
         "fixed_latency_range=<disable latency range changes on underrun?> "
+        "fixed_latency_usec=<use a fixed playback buffer of this size and never rewind> "
+        "fast_resume_usec=<keep the playback device open this long after an idle suspend> "
+        "thread_cpus=<CPUs to run the IO threads on> "
+        "wakeup_domain=<align timer wakeups with the devices of this domain, empty to disable> "
         "ignore_dB=<ignore dB information from the device?> "
         "deferred_volume=<Synchronize software and hardware volume changes to avoid momentary jumps?> "
         "profile_set=<profile set configuration file> "
         "paths_dir=<directory containing the path configuration files> "
         "use_ucm=<load use case manager> "
+        "probe_cache=<remember which profiles are unsupported across restarts?> "
 );
 
 static const char* const valid_modargs[] = {
@@ -90,17 +99,24 @@ static const char* const valid_modargs[] = {
     "tsched_buffer_size",
     "tsched_buffer_watermark",
     "fixed_latency_range",
+    "fixed_latency_usec",
+    "fast_resume_usec",
+    "thread_cpus",
+    "wakeup_domain",
     "profile",
     "ignore_dB",
     "deferred_volume",
     "profile_set",
     "paths_dir",
     "use_ucm",
+    "probe_cache",
     NULL
 };
 
 #define DEFAULT_DEVICE_ID "0"
 
+#define PROBE_CACHE_DATABASE "alsa-probe-cache"
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -692,6 +708,129 @@ static pa_hook_result_t source_output_unlink_hook_callback(pa_core *c, pa_source
     return PA_HOOK_OK;
 }
 
+/* Probing tries to open the PCM of every mapping, which adds up on cards
+ * with many of them. Which profiles turned out to be supported is cached
+ * per card, together with a stamp of the configuration that went into
+ * the probe. The profiles the cache doesn't list aren't probed again. The
+ * others are, since probing also sets up their paths. */
+static char *probe_cache_stamp(struct userdata *u) {
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX];
+
+    return pa_sprintf_malloc("%08x %s %u %u",
+                             pa_alsa_profile_set_get_hash(u->profile_set),
+                             pa_sample_spec_snprint(ss, sizeof(ss), &u->core->default_sample_spec),
+                             u->core->default_n_fragments,
+                             u->core->default_fragment_size_msec);
+}
+
+static pa_database *probe_cache_open(void) {
+    pa_database *db;
+    char *fname;
+
+    if (!(fname = pa_state_path(PROBE_CACHE_DATABASE, true)))
+        return NULL;
+
+    if (!(db = pa_database_open(fname, true)))
+        pa_log_debug("Failed to open probe cache '%s': %s", fname, pa_cstrerror(errno));
+
+    pa_xfree(fname);
+
+    return db;
+}
+
+static void probe_cache_load(struct userdata *u, pa_database *db, const pa_datum *key, const char *stamp) {
+    pa_datum data;
+    pa_idxset *supported;
+    pa_alsa_profile *p;
+    char *value, *name;
+    const char *state = NULL;
+    void *pstate;
+
+    if (!pa_database_get(db, key, &data))
+        return;
+
+    value = pa_xstrndup(data.data, data.size);
+    pa_datum_free(&data);
+
+    /* First line is the stamp, then one supported profile per line */
+    name = pa_split(value, "\n", &state);
+
+    if (!name || !pa_streq(name, stamp)) {
+        pa_log_debug("Probe cache of card %s is stale.", (char *) key->data);
+        pa_xfree(name);
+        pa_xfree(value);
+        return;
+    }
+
+    pa_xfree(name);
+
+    supported = pa_idxset_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    while ((name = pa_split(value, "\n", &state)))
+        pa_idxset_put(supported, name, NULL);
+
+    PA_HASHMAP_FOREACH(p, u->profile_set->profiles, pstate)
+        if (!pa_idxset_get_by_data(supported, p->name, NULL))
+            p->probe_skip_unsupported = true;
+
+    pa_log_debug("Using probe cache of card %s, %u profiles supported.", (char *) key->data, pa_idxset_size(supported));
+
+    pa_idxset_free(supported, pa_xfree);
+    pa_xfree(value);
+}
+
+static void probe_cache_save(struct userdata *u, pa_database *db, const pa_datum *key, const char *stamp) {
+    pa_datum data;
+    pa_strbuf *buf;
+    pa_alsa_profile *p;
+    char *value;
+    void *state;
+
+    buf = pa_strbuf_new();
+    pa_strbuf_puts(buf, stamp);
+
+    /* Only the supported profiles are left after probing */
+    PA_HASHMAP_FOREACH(p, u->profile_set->profiles, state)
+        pa_strbuf_printf(buf, "\n%s", p->name);
+
+    value = pa_strbuf_to_string_free(buf);
+
+    data.data = value;
+    data.size = strlen(value);
+
+    if (pa_database_set(db, key, &data, true) < 0 || pa_database_sync(db) < 0)
+        pa_log_debug("Failed to update the probe cache of card %s.", (char *) key->data);
+
+    pa_xfree(value);
+}
+
+static void probe_profile_set(struct userdata *u, bool use_cache) {
+    pa_database *db = NULL;
+    pa_datum key;
+    char *card_name = NULL, *stamp = NULL;
+
+    /* The long name includes the location of the card, e.g. the USB
+     * port, unlike the index, which depends on the order of detection */
+    if (use_cache && snd_card_get_longname(u->alsa_card_index, &card_name) >= 0) {
+        stamp = probe_cache_stamp(u);
+
+        key.data = card_name;
+        key.size = strlen(card_name);
+
+        if ((db = probe_cache_open()))
+            probe_cache_load(u, db, &key, stamp);
+    }
+
+    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &u->core->default_sample_spec, u->core->default_n_fragments, u->core->default_fragment_size_msec);
+
+    if (db) {
+        probe_cache_save(u, db, &key, stamp);
+        pa_database_close(db);
+    }
+
+    pa_xfree(stamp);
+    free(card_name);
+}
+
 int pa__init(pa_module *m) {
     pa_card_new_data data;
     bool ignore_dB = false;
@@ -701,6 +840,7 @@ int pa__init(pa_module *m) {
     const char *profile_str = NULL;
     char *fn = NULL;
     bool namereg_fail = false;
+    bool probe_cache = true;
 
     pa_alsa_refcnt_inc();
 
@@ -746,6 +886,11 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(u->modargs, "probe_cache", &probe_cache) < 0) {
+        pa_log("Failed to parse probe_cache argument.");
+        goto fail;
+    }
+
     /* Force ALSA to reread its configuration. This matters if our device
      * was hot-plugged after ALSA has already read its configuration - see
      * https://bugs.freedesktop.org/show_bug.cgi?id=54029
@@ -792,7 +937,8 @@ int pa__init(pa_module *m) {
 
     u->profile_set->ignore_dB = ignore_dB;
 
-    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
+    /* UCM doesn't probe the way profile sets do */
+    probe_profile_set(u, probe_cache && !u->use_ucm);
     pa_alsa_profile_set_dump(u->profile_set);
 
     pa_card_new_data_init(&data);
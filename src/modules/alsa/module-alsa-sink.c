@@ -58,7 +58,11 @@ PA_MODULE_USAGE(
         "deferred_volume=<Synchronize software and hardware volume changes to avoid momentary jumps?> "
         "deferred_volume_safety_margin=<usec adjustment depending on volume direction> "
         "deferred_volume_extra_delay=<usec adjustment to HW volume changes> "
-        "fixed_latency_range=<disable latency range changes on underrun?>");
+        "fixed_latency_range=<disable latency range changes on underrun?> "
+        "fixed_latency_usec=<use a fixed buffer of this size and never rewind> "
+        "fast_resume_usec=<keep the device open this long after an idle suspend> "
+        "thread_cpus=<CPUs to run the IO thread on> "
+        "wakeup_domain=<align timer wakeups with the devices of this domain, empty to disable>");
 
 static const char* const valid_modargs[] = {
     "name",
@@ -85,6 +89,10 @@ static const char* const valid_modargs[] = {
     "deferred_volume_safety_margin",
     "deferred_volume_extra_delay",
     "fixed_latency_range",
+    "fixed_latency_usec",
+    "fast_resume_usec",
+    "thread_cpus",
+    "wakeup_domain",
     NULL
 };
 
@@ -66,7 +66,9 @@ PA_MODULE_USAGE(
         "deferred_volume=<Synchronize software and hardware volume changes to avoid momentary jumps?> "
         "deferred_volume_safety_margin=<usec adjustment depending on volume direction> "
         "deferred_volume_extra_delay=<usec adjustment to HW volume changes> "
-        "fixed_latency_range=<disable latency range changes on overrun?>");
+        "fixed_latency_range=<disable latency range changes on overrun?> "
+        "thread_cpus=<CPUs to run the IO thread on> "
+        "wakeup_domain=<align timer wakeups with the devices of this domain, empty to disable>");
 
 static const char* const valid_modargs[] = {
     "name",
@@ -92,6 +94,8 @@ static const char* const valid_modargs[] = {
     "deferred_volume_safety_margin",
     "deferred_volume_extra_delay",
     "fixed_latency_range",
+    "thread_cpus",
+    "wakeup_domain",
     NULL
 };
 
@@ -0,0 +1,72 @@
+#ifndef fooa2dpcodecapihfoo
+#define fooa2dpcodecapihfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulsecore/core.h>
+
+/* An A2DP codec as seen by module-bluez5-device. The module takes care
+ * of the socket and of the RTP header, the codec of everything that
+ * follows the RTP header in a packet. All functions but init() and
+ * deinit() are called from the IO thread. */
+typedef struct pa_a2dp_codec {
+    const char *name;
+    const char *description;
+
+    /* A2DP_CODEC_* from a2dp-codecs.h, as found in the transport */
+    uint8_t id;
+
+    /* Latency added by the codec itself, on top of the transport */
+    pa_usec_t latency;
+
+    /* Set up a new encoder (for A2DP sinks) or decoder (for A2DP
+     * sources) for the configuration negotiated with the remote and
+     * fill in the sample spec that it expects. Returns NULL if the
+     * configuration is invalid. */
+    void *(*init)(bool for_encoding, const uint8_t *config, size_t config_size, pa_sample_spec *sample_spec);
+    void (*deinit)(void *codec_info);
+
+    /* Called whenever streaming starts. Resets the encoder to its
+     * highest quality. */
+    void (*reset)(void *codec_info);
+
+    /* Number of bytes of PCM audio that fit into one packet, given the
+     * space left after the RTP header */
+    size_t (*get_block_size)(void *codec_info, size_t payload_mtu);
+
+    /* Lower or raise the quality of the encoder by one step. Returns the
+     * new block size, or 0 if the encoder is already at its limit. May
+     * be NULL. */
+    size_t (*reduce_encoder_bitrate)(void *codec_info, size_t payload_mtu);
+    size_t (*increase_encoder_bitrate)(void *codec_info, size_t payload_mtu);
+
+    /* Current bitrate of the encoder in bits per second */
+    uint32_t (*get_encoder_bitrate)(void *codec_info);
+
+    /* Encode or decode as much of input as fits into output. The number
+     * of input bytes consumed is returned in processed, the number of
+     * output bytes written as return value. Both are 0 on error. The
+     * encoder reads straight from the rendered memchunk and writes
+     * straight into the packet. */
+    size_t (*encode_buffer)(void *codec_info, const uint8_t *input, size_t input_size,
+                            uint8_t *output, size_t output_size, size_t *processed);
+    size_t (*decode_buffer)(void *codec_info, const uint8_t *input, size_t input_size,
+                            uint8_t *output, size_t output_size, size_t *processed);
+} pa_a2dp_codec;
+
+#endif
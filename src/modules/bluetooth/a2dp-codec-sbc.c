@@ -0,0 +1,364 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sbc/sbc.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/once.h>
+
+#include "a2dp-codecs.h"
+#include "a2dp-codec-api.h"
+#include "rtp.h"
+
+#define BITPOOL_DEC_LIMIT 32
+#define BITPOOL_DEC_STEP 5
+#define BITPOOL_INC_STEP 1
+
+struct sbc_info {
+    sbc_t sbc;                           /* Codec data */
+    size_t codesize, frame_length;       /* SBC Codesize, frame_length. We simply cache those values here */
+    uint8_t min_bitpool;
+    uint8_t max_bitpool;
+
+    bool for_encoding;
+    pa_sample_spec sample_spec;
+};
+
+static void set_bitpool(struct sbc_info *sbc_info, uint8_t bitpool) {
+    if (bitpool > sbc_info->max_bitpool)
+        bitpool = sbc_info->max_bitpool;
+    else if (bitpool < sbc_info->min_bitpool)
+        bitpool = sbc_info->min_bitpool;
+
+    sbc_info->sbc.bitpool = bitpool;
+
+    sbc_info->codesize = sbc_get_codesize(&sbc_info->sbc);
+    sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
+
+    pa_log_debug("Bitpool has changed to %u", sbc_info->sbc.bitpool);
+}
+
+static void *init(bool for_encoding, const uint8_t *config_buffer, size_t config_size, pa_sample_spec *sample_spec) {
+    struct sbc_info *sbc_info;
+    const a2dp_sbc_t *config = (const a2dp_sbc_t *) config_buffer;
+
+    pa_assert(config_buffer);
+    pa_assert(sample_spec);
+
+    if (config_size != sizeof(*config)) {
+        pa_log_error("Invalid size of SBC configuration");
+        return NULL;
+    }
+
+    sbc_info = pa_xnew0(struct sbc_info, 1);
+    sbc_info->for_encoding = for_encoding;
+
+    sbc_init(&sbc_info->sbc, 0);
+
+    sample_spec->format = PA_SAMPLE_S16LE;
+
+    switch (config->frequency) {
+        case SBC_SAMPLING_FREQ_16000:
+            sbc_info->sbc.frequency = SBC_FREQ_16000;
+            sample_spec->rate = 16000U;
+            break;
+        case SBC_SAMPLING_FREQ_32000:
+            sbc_info->sbc.frequency = SBC_FREQ_32000;
+            sample_spec->rate = 32000U;
+            break;
+        case SBC_SAMPLING_FREQ_44100:
+            sbc_info->sbc.frequency = SBC_FREQ_44100;
+            sample_spec->rate = 44100U;
+            break;
+        case SBC_SAMPLING_FREQ_48000:
+            sbc_info->sbc.frequency = SBC_FREQ_48000;
+            sample_spec->rate = 48000U;
+            break;
+        default:
+            goto fail;
+    }
+
+    switch (config->channel_mode) {
+        case SBC_CHANNEL_MODE_MONO:
+            sbc_info->sbc.mode = SBC_MODE_MONO;
+            sample_spec->channels = 1;
+            break;
+        case SBC_CHANNEL_MODE_DUAL_CHANNEL:
+            sbc_info->sbc.mode = SBC_MODE_DUAL_CHANNEL;
+            sample_spec->channels = 2;
+            break;
+        case SBC_CHANNEL_MODE_STEREO:
+            sbc_info->sbc.mode = SBC_MODE_STEREO;
+            sample_spec->channels = 2;
+            break;
+        case SBC_CHANNEL_MODE_JOINT_STEREO:
+            sbc_info->sbc.mode = SBC_MODE_JOINT_STEREO;
+            sample_spec->channels = 2;
+            break;
+        default:
+            goto fail;
+    }
+
+    switch (config->allocation_method) {
+        case SBC_ALLOCATION_SNR:
+            sbc_info->sbc.allocation = SBC_AM_SNR;
+            break;
+        case SBC_ALLOCATION_LOUDNESS:
+            sbc_info->sbc.allocation = SBC_AM_LOUDNESS;
+            break;
+        default:
+            goto fail;
+    }
+
+    switch (config->subbands) {
+        case SBC_SUBBANDS_4:
+            sbc_info->sbc.subbands = SBC_SB_4;
+            break;
+        case SBC_SUBBANDS_8:
+            sbc_info->sbc.subbands = SBC_SB_8;
+            break;
+        default:
+            goto fail;
+    }
+
+    switch (config->block_length) {
+        case SBC_BLOCK_LENGTH_4:
+            sbc_info->sbc.blocks = SBC_BLK_4;
+            break;
+        case SBC_BLOCK_LENGTH_8:
+            sbc_info->sbc.blocks = SBC_BLK_8;
+            break;
+        case SBC_BLOCK_LENGTH_12:
+            sbc_info->sbc.blocks = SBC_BLK_12;
+            break;
+        case SBC_BLOCK_LENGTH_16:
+            sbc_info->sbc.blocks = SBC_BLK_16;
+            break;
+        default:
+            goto fail;
+    }
+
+    sbc_info->min_bitpool = config->min_bitpool;
+    sbc_info->max_bitpool = config->max_bitpool;
+    sbc_info->sample_spec = *sample_spec;
+
+    /* Set minimum bitpool for source to get the maximum possible block_size */
+    set_bitpool(sbc_info, for_encoding ? sbc_info->max_bitpool : sbc_info->min_bitpool);
+
+    pa_log_info("SBC parameters: allocation=%u, subbands=%u, blocks=%u, bitpool=%u",
+                sbc_info->sbc.allocation, sbc_info->sbc.subbands, sbc_info->sbc.blocks, sbc_info->sbc.bitpool);
+
+    return sbc_info;
+
+fail:
+    pa_log_error("Invalid SBC configuration");
+    sbc_finish(&sbc_info->sbc);
+    pa_xfree(sbc_info);
+    return NULL;
+}
+
+static void deinit(void *codec_info) {
+    struct sbc_info *sbc_info = codec_info;
+
+    sbc_finish(&sbc_info->sbc);
+    pa_xfree(sbc_info);
+}
+
+static void reset(void *codec_info) {
+    struct sbc_info *sbc_info = codec_info;
+
+    if (sbc_info->for_encoding && sbc_info->sbc.bitpool != sbc_info->max_bitpool)
+        set_bitpool(sbc_info, sbc_info->max_bitpool);
+}
+
+static size_t get_block_size(void *codec_info, size_t payload_mtu) {
+    struct sbc_info *sbc_info = codec_info;
+
+    return (payload_mtu - sizeof(struct rtp_payload)) / sbc_info->frame_length * sbc_info->codesize;
+}
+
+static size_t reduce_encoder_bitrate(void *codec_info, size_t payload_mtu) {
+    struct sbc_info *sbc_info = codec_info;
+    uint8_t bitpool;
+
+    /* Check if bitpool is already at its limit */
+    if (sbc_info->sbc.bitpool <= BITPOOL_DEC_LIMIT)
+        return 0;
+
+    bitpool = sbc_info->sbc.bitpool - BITPOOL_DEC_STEP;
+
+    if (bitpool < BITPOOL_DEC_LIMIT)
+        bitpool = BITPOOL_DEC_LIMIT;
+
+    set_bitpool(sbc_info, bitpool);
+    return get_block_size(codec_info, payload_mtu);
+}
+
+static size_t increase_encoder_bitrate(void *codec_info, size_t payload_mtu) {
+    struct sbc_info *sbc_info = codec_info;
+
+    if (sbc_info->sbc.bitpool >= sbc_info->max_bitpool)
+        return 0;
+
+    set_bitpool(sbc_info, sbc_info->sbc.bitpool + BITPOOL_INC_STEP);
+    return get_block_size(codec_info, payload_mtu);
+}
+
+static uint32_t get_encoder_bitrate(void *codec_info) {
+    struct sbc_info *sbc_info = codec_info;
+
+    /* One frame of frame_length bytes holds codesize bytes of audio */
+    return (uint32_t) ((uint64_t) sbc_info->frame_length * 8 * pa_bytes_per_second(&sbc_info->sample_spec) / sbc_info->codesize);
+}
+
+static size_t encode_buffer(void *codec_info, const uint8_t *input, size_t input_size,
+                            uint8_t *output, size_t output_size, size_t *processed) {
+    struct sbc_info *sbc_info = codec_info;
+    struct rtp_payload *payload;
+    const uint8_t *p;
+    uint8_t *d;
+    size_t to_write, to_encode;
+    unsigned frame_count;
+
+    pa_assert(output_size >= sizeof(*payload));
+
+    payload = (struct rtp_payload*) output;
+    frame_count = 0;
+
+    p = input;
+    to_encode = input_size;
+
+    d = output + sizeof(*payload);
+    to_write = output_size - sizeof(*payload);
+
+    while (PA_LIKELY(to_encode > 0 && to_write > 0)) {
+        ssize_t written;
+        ssize_t encoded;
+
+        encoded = sbc_encode(&sbc_info->sbc,
+                             p, to_encode,
+                             d, to_write,
+                             &written);
+
+        if (PA_UNLIKELY(encoded <= 0)) {
+            pa_log_error("SBC encoding error (%li)", (long) encoded);
+            *processed = p - input;
+            return 0;
+        }
+
+        pa_assert_fp((size_t) encoded <= to_encode);
+        pa_assert_fp((size_t) encoded == sbc_info->codesize);
+
+        pa_assert_fp((size_t) written <= to_write);
+        pa_assert_fp((size_t) written == sbc_info->frame_length);
+
+        p += encoded;
+        to_encode -= encoded;
+
+        d += written;
+        to_write -= written;
+
+        frame_count++;
+    }
+
+    PA_ONCE_BEGIN {
+        pa_log_debug("Using SBC encoder implementation: %s", pa_strnull(sbc_get_implementation_info(&sbc_info->sbc)));
+    } PA_ONCE_END;
+
+    memset(payload, 0, sizeof(*payload));
+    payload->frame_count = frame_count;
+
+    *processed = p - input;
+    return d - output;
+}
+
+static size_t decode_buffer(void *codec_info, const uint8_t *input, size_t input_size,
+                            uint8_t *output, size_t output_size, size_t *processed) {
+    struct sbc_info *sbc_info = codec_info;
+    const uint8_t *p;
+    uint8_t *d;
+    size_t to_write, to_decode;
+
+    if (input_size < sizeof(struct rtp_payload)) {
+        pa_log_error("Received SBC packet without payload header");
+        *processed = 0;
+        return 0;
+    }
+
+    p = input + sizeof(struct rtp_payload);
+    to_decode = input_size - sizeof(struct rtp_payload);
+
+    d = output;
+    to_write = output_size;
+
+    while (PA_LIKELY(to_decode > 0)) {
+        size_t written;
+        ssize_t decoded;
+
+        decoded = sbc_decode(&sbc_info->sbc,
+                             p, to_decode,
+                             d, to_write,
+                             &written);
+
+        if (PA_UNLIKELY(decoded <= 0)) {
+            pa_log_error("SBC decoding error (%li)", (long) decoded);
+            *processed = p - input;
+            return 0;
+        }
+
+        /* Reset frame length, it can be changed due to bitpool change */
+        sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
+
+        pa_assert_fp((size_t) decoded <= to_decode);
+        pa_assert_fp((size_t) decoded == sbc_info->frame_length);
+
+        pa_assert_fp((size_t) written == sbc_info->codesize);
+
+        p += decoded;
+        to_decode -= decoded;
+
+        d += written;
+        to_write -= written;
+    }
+
+    *processed = p - input;
+    return d - output;
+}
+
+const pa_a2dp_codec pa_a2dp_codec_sbc = {
+    .name = "sbc",
+    .description = "SBC",
+    .id = A2DP_CODEC_SBC,
+    .latency = 0,
+    .init = init,
+    .deinit = deinit,
+    .reset = reset,
+    .get_block_size = get_block_size,
+    .reduce_encoder_bitrate = reduce_encoder_bitrate,
+    .increase_encoder_bitrate = increase_encoder_bitrate,
+    .get_encoder_bitrate = get_encoder_bitrate,
+    .encode_buffer = encode_buffer,
+    .decode_buffer = decode_buffer,
+};
@@ -0,0 +1,43 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/core-util.h>
+
+#include "a2dp-codec-util.h"
+
+extern const pa_a2dp_codec pa_a2dp_codec_sbc;
+
+/* New codecs go here. Each of them lives in its own a2dp-codec-*.c.
+ * Codecs that need an external library should be conditional on it
+ * being available. */
+static const pa_a2dp_codec *const codecs[] = {
+    &pa_a2dp_codec_sbc,
+};
+
+const pa_a2dp_codec *pa_bluetooth_get_a2dp_codec(uint8_t id) {
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(codecs); i++)
+        if (codecs[i]->id == id)
+            return codecs[i];
+
+    return NULL;
+}
@@ -23,9 +23,14 @@
 #endif
 
 #include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
 
 #include <arpa/inet.h>
-#include <sbc/sbc.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -46,6 +51,7 @@
 #include <pulsecore/time-smoother.h>
 
 #include "a2dp-codecs.h"
+#include "a2dp-codec-util.h"
 #include "bluez5-util.h"
 #include "rtp.h"
 
@@ -64,10 +70,23 @@ PA_MODULE_USAGE("path=<device object path>"
 #define FIXED_LATENCY_RECORD_A2DP   (25 * PA_USEC_PER_MSEC)
 #define FIXED_LATENCY_RECORD_SCO    (25 * PA_USEC_PER_MSEC)
 
-#define BITPOOL_DEC_LIMIT 32
-#define BITPOOL_DEC_STEP 5
+/* The socket counts as congested when this many packets are still
+ * waiting in its output queue after a write */
+#define OUTQ_CONGESTED_PACKETS 4
+
+/* Don't lower the bitrate again before the queue had a chance to drain,
+ * and only raise it after the link has been fine for a while */
+#define BITRATE_DEC_INTERVAL (1 * PA_USEC_PER_SEC)
+#define BITRATE_INC_INTERVAL (5 * PA_USEC_PER_SEC)
 #define HSP_MAX_GAIN 15
 
+/* How many sent A2DP packets we remember, to match the kernel's
+ * transmission reports to playback positions */
+#define TX_HISTORY 64
+
+/* Upper limit of SCO packets picked up per wakeup */
+#define SCO_MAX_BATCH_PACKETS 8
+
 static const char* const valid_modargs[] = {
     "path",
     "autodetect_mtu",
@@ -77,6 +96,7 @@ static const char* const valid_modargs[] = {
 enum {
     BLUETOOTH_MESSAGE_IO_THREAD_FAILED,
     BLUETOOTH_MESSAGE_STREAM_FD_HUP,
+    BLUETOOTH_MESSAGE_A2DP_STATS,
     BLUETOOTH_MESSAGE_MAX
 };
 
@@ -87,17 +107,14 @@ typedef struct bluetooth_msg {
 PA_DEFINE_PRIVATE_CLASS(bluetooth_msg, pa_msgobject);
 #define BLUETOOTH_MSG(o) (bluetooth_msg_cast(o))
 
-typedef struct sbc_info {
-    sbc_t sbc;                           /* Codec data */
-    bool sbc_initialized;                /* Keep track if the encoder is initialized */
-    size_t codesize, frame_length;       /* SBC Codesize, frame_length. We simply cache those values here */
-    uint16_t seq_num;                    /* Cumulative packet sequence */
-    uint8_t min_bitpool;
-    uint8_t max_bitpool;
-
-    void* buffer;                        /* Codec transfer buffer */
-    size_t buffer_size;                  /* Size of the buffer */
-} sbc_info_t;
+/* Sent to the main thread whenever the encoder bitrate changes and
+ * exported in the sink's proplist */
+typedef struct a2dp_stats {
+    uint32_t bitrate;
+    unsigned bitrate_increases;
+    unsigned bitrate_decreases;
+    size_t queue_max;                    /* Longest socket output queue seen, in bytes */
+} a2dp_stats_t;
 
 struct userdata {
     pa_module *module;
@@ -137,8 +154,29 @@ struct userdata {
     pa_usec_t started_at;
     pa_smoother *read_smoother;
     pa_memchunk write_memchunk;
+
+    /* A2DP playback position, IO thread only. Follows the kernel's
+     * reports of when packets went out if there are any, otherwise what's
+     * left in the socket's output queue. */
+    pa_smoother *write_smoother;
+    bool tx_timestamps;                  /* SO_TIMESTAMPING reports transmissions */
+    bool tx_reported;
+    uint32_t tx_packet_id;               /* Packets written, as counted by the kernel */
+    uint64_t tx_write_index[TX_HISTORY]; /* write_index after each of the last packets */
+    size_t last_packet_size;
     pa_sample_spec sample_spec;
-    struct sbc_info sbc_info;
+
+    const pa_a2dp_codec *a2dp_codec;
+    void *a2dp_codec_info;
+    uint16_t seq_num;                    /* Cumulative RTP packet sequence */
+    void *buffer;                        /* Codec transfer buffer */
+    size_t buffer_size;                  /* Size of the buffer */
+
+    /* A2DP bitrate adaptation, IO thread only */
+    bool queue_monitoring;               /* SIOCOUTQ works on the stream socket */
+    pa_usec_t bitrate_changed_at;
+    pa_usec_t congested_at;
+    a2dp_stats_t a2dp_stats;
 };
 
 typedef enum pa_bluetooth_form_factor {
@@ -298,14 +336,15 @@ static int sco_process_render(struct userdata *u) {
     return 1;
 }
 
-/* Run from IO thread */
+/* Run from IO thread. Picks up all SCO packets that are queued on the
+ * socket, up to SCO_MAX_BATCH_PACKETS, and posts them to the source in
+ * one go. Each packet is read into a slot of its own so that the
+ * packets stay aligned to the MTU. */
 static int sco_process_push(struct userdata *u) {
-    ssize_t l;
     pa_memchunk memchunk;
-    struct cmsghdr *cm;
-    struct msghdr m;
-    bool found_tstamp = false;
     pa_usec_t tstamp = 0;
+    uint8_t *p;
+    unsigned n = 0;
 
     pa_assert(u);
     pa_assert(u->profile == PA_BLUETOOTH_PROFILE_HEADSET_HEAD_UNIT ||
@@ -313,13 +352,18 @@ static int sco_process_push(struct userdata *u) {
     pa_assert(u->source);
     pa_assert(u->read_smoother);
 
-    memchunk.memblock = pa_memblock_new(u->core->mempool, u->read_block_size);
+    memchunk.memblock = pa_memblock_new(u->core->mempool, u->read_block_size * SCO_MAX_BATCH_PACKETS);
     memchunk.index = memchunk.length = 0;
 
-    for (;;) {
-        void *p;
+    p = pa_memblock_acquire(memchunk.memblock);
+
+    while (n < SCO_MAX_BATCH_PACKETS) {
+        ssize_t l;
         uint8_t aux[1024];
+        struct cmsghdr *cm;
+        struct msghdr m;
         struct iovec iov;
+        bool found_tstamp = false;
 
         pa_zero(m);
         pa_zero(aux);
@@ -330,67 +374,75 @@ static int sco_process_push(struct userdata *u) {
         m.msg_control = aux;
         m.msg_controllen = sizeof(aux);
 
-        p = pa_memblock_acquire(memchunk.memblock);
-        iov.iov_base = p;
-        iov.iov_len = pa_memblock_get_length(memchunk.memblock);
+        iov.iov_base = p + memchunk.length;
+        iov.iov_len = u->read_block_size;
         l = recvmsg(u->stream_fd, &m, 0);
-        pa_memblock_release(memchunk.memblock);
-
-        if (l > 0)
-            break;
 
         if (l < 0 && errno == EINTR)
             /* Retry right away if we got interrupted */
             continue;
 
-        pa_memblock_unref(memchunk.memblock);
-
         if (l < 0 && errno == EAGAIN)
-            /* Hmm, apparently the socket was not readable, give up for now. */
-            return 0;
+            /* Hmm, apparently the socket was not readable (anymore), give up for now. */
+            break;
 
-        pa_log_error("Failed to read data from SCO socket: %s", l < 0 ? pa_cstrerror(errno) : "EOF");
-        return -1;
-    }
+        if (l <= 0) {
+            pa_log_error("Failed to read data from SCO socket: %s", l < 0 ? pa_cstrerror(errno) : "EOF");
+            goto fail;
+        }
 
-    pa_assert((size_t) l <= pa_memblock_get_length(memchunk.memblock));
+        pa_assert((size_t) l <= u->read_block_size);
 
-    /* In some rare occasions, we might receive packets of a very strange
-     * size. This could potentially be possible if the SCO packet was
-     * received partially over-the-air, or more probably due to hardware
-     * issues in our Bluetooth adapter. In these cases, in order to avoid
-     * an assertion failure due to unaligned data, just discard the whole
-     * packet */
-    if (!pa_frame_aligned(l, &u->sample_spec)) {
-        pa_log_warn("SCO packet received of unaligned size: %zu", l);
-        pa_memblock_unref(memchunk.memblock);
-        return -1;
-    }
+        /* In some rare occasions, we might receive packets of a very strange
+         * size. This could potentially be possible if the SCO packet was
+         * received partially over-the-air, or more probably due to hardware
+         * issues in our Bluetooth adapter. In these cases, in order to avoid
+         * an assertion failure due to unaligned data, just discard the whole
+         * packet */
+        if (!pa_frame_aligned(l, &u->sample_spec)) {
+            pa_log_warn("SCO packet received of unaligned size: %zu", l);
+            goto fail;
+        }
 
-    memchunk.length = (size_t) l;
-    u->read_index += (uint64_t) l;
+        memchunk.length += (size_t) l;
+        u->read_index += (uint64_t) l;
+        n++;
 
-    for (cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm))
-        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMP) {
-            struct timeval *tv = (struct timeval*) CMSG_DATA(cm);
-            pa_rtclock_from_wallclock(tv);
-            tstamp = pa_timeval_load(tv);
-            found_tstamp = true;
-            break;
+        for (cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm))
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMP) {
+                struct timeval *tv = (struct timeval*) CMSG_DATA(cm);
+                pa_rtclock_from_wallclock(tv);
+                tstamp = pa_timeval_load(tv);
+                found_tstamp = true;
+                break;
+            }
+
+        if (!found_tstamp) {
+            pa_log_warn("Couldn't find SO_TIMESTAMP data in auxiliary recvmsg() data!");
+            tstamp = pa_rtclock_now();
         }
 
-    if (!found_tstamp) {
-        pa_log_warn("Couldn't find SO_TIMESTAMP data in auxiliary recvmsg() data!");
-        tstamp = pa_rtclock_now();
+        pa_smoother_put(u->read_smoother, tstamp, pa_bytes_to_usec(u->read_index, &u->sample_spec));
+    }
+
+    pa_memblock_release(memchunk.memblock);
+
+    if (n == 0) {
+        pa_memblock_unref(memchunk.memblock);
+        return 0;
     }
 
-    pa_smoother_put(u->read_smoother, tstamp, pa_bytes_to_usec(u->read_index, &u->sample_spec));
     pa_smoother_resume(u->read_smoother, tstamp, true);
 
     pa_source_post(u->source, &memchunk);
     pa_memblock_unref(memchunk.memblock);
 
-    return l;
+    return (int) memchunk.length;
+
+fail:
+    pa_memblock_release(memchunk.memblock);
+    pa_memblock_unref(memchunk.memblock);
+    return -1;
 }
 
 /* Run from IO thread */
@@ -399,24 +451,19 @@ static void a2dp_prepare_buffer(struct userdata *u) {
 
     pa_assert(u);
 
-    if (u->sbc_info.buffer_size >= min_buffer_size)
+    if (u->buffer_size >= min_buffer_size)
         return;
 
-    u->sbc_info.buffer_size = 2 * min_buffer_size;
-    pa_xfree(u->sbc_info.buffer);
-    u->sbc_info.buffer = pa_xmalloc(u->sbc_info.buffer_size);
+    u->buffer_size = 2 * min_buffer_size;
+    pa_xfree(u->buffer);
+    u->buffer = pa_xmalloc(u->buffer_size);
 }
 
 /* Run from IO thread */
 static int a2dp_process_render(struct userdata *u) {
-    struct sbc_info *sbc_info;
     struct rtp_header *header;
-    struct rtp_payload *payload;
-    size_t nbytes;
-    void *d;
-    const void *p;
-    size_t to_write, to_encode;
-    unsigned frame_count;
+    size_t nbytes, encoded, processed;
+    const uint8_t *p;
     int ret = 0;
 
     pa_assert(u);
@@ -431,73 +478,35 @@ static int a2dp_process_render(struct userdata *u) {
 
     a2dp_prepare_buffer(u);
 
-    sbc_info = &u->sbc_info;
-    header = sbc_info->buffer;
-    payload = (struct rtp_payload*) ((uint8_t*) sbc_info->buffer + sizeof(*header));
-
-    frame_count = 0;
+    header = u->buffer;
 
     /* Try to create a packet of the full MTU */
 
-    p = (const uint8_t *) pa_memblock_acquire_chunk(&u->write_memchunk);
-    to_encode = u->write_memchunk.length;
-
-    d = (uint8_t*) sbc_info->buffer + sizeof(*header) + sizeof(*payload);
-    to_write = sbc_info->buffer_size - sizeof(*header) - sizeof(*payload);
-
-    while (PA_LIKELY(to_encode > 0 && to_write > 0)) {
-        ssize_t written;
-        ssize_t encoded;
-
-        encoded = sbc_encode(&sbc_info->sbc,
-                             p, to_encode,
-                             d, to_write,
-                             &written);
-
-        if (PA_UNLIKELY(encoded <= 0)) {
-            pa_log_error("SBC encoding error (%li)", (long) encoded);
-            pa_memblock_release(u->write_memchunk.memblock);
-            return -1;
-        }
-
-        pa_assert_fp((size_t) encoded <= to_encode);
-        pa_assert_fp((size_t) encoded == sbc_info->codesize);
-
-        pa_assert_fp((size_t) written <= to_write);
-        pa_assert_fp((size_t) written == sbc_info->frame_length);
-
-        p = (const uint8_t*) p + encoded;
-        to_encode -= encoded;
-
-        d = (uint8_t*) d + written;
-        to_write -= written;
-
-        frame_count++;
-    }
-
+    p = pa_memblock_acquire_chunk(&u->write_memchunk);
+    encoded = u->a2dp_codec->encode_buffer(u->a2dp_codec_info, p, u->write_memchunk.length,
+                                           (uint8_t*) u->buffer + sizeof(*header), u->buffer_size - sizeof(*header),
+                                           &processed);
     pa_memblock_release(u->write_memchunk.memblock);
 
-    pa_assert(to_encode == 0);
+    if (PA_UNLIKELY(encoded == 0))
+        return -1;
 
-    PA_ONCE_BEGIN {
-        pa_log_debug("Using SBC encoder implementation: %s", pa_strnull(sbc_get_implementation_info(&sbc_info->sbc)));
-    } PA_ONCE_END;
+    pa_assert(processed == u->write_memchunk.length);
 
     /* write it to the fifo */
-    memset(sbc_info->buffer, 0, sizeof(*header) + sizeof(*payload));
+    memset(header, 0, sizeof(*header));
     header->v = 2;
     header->pt = 1;
-    header->sequence_number = htons(sbc_info->seq_num++);
+    header->sequence_number = htons(u->seq_num++);
     header->timestamp = htonl(u->write_index / pa_frame_size(&u->sample_spec));
     header->ssrc = htonl(1);
-    payload->frame_count = frame_count;
 
-    nbytes = (uint8_t*) d - (uint8_t*) sbc_info->buffer;
+    nbytes = sizeof(*header) + encoded;
 
     for (;;) {
         ssize_t l;
 
-        l = pa_write(u->stream_fd, sbc_info->buffer, nbytes, &u->stream_write_type);
+        l = pa_write(u->stream_fd, u->buffer, nbytes, &u->stream_write_type);
 
         pa_assert(l != 0);
 
@@ -530,6 +539,10 @@ static int a2dp_process_render(struct userdata *u) {
         pa_memblock_unref(u->write_memchunk.memblock);
         pa_memchunk_reset(&u->write_memchunk);
 
+        u->tx_write_index[u->tx_packet_id % TX_HISTORY] = u->write_index;
+        u->tx_packet_id++;
+        u->last_packet_size = nbytes;
+
         ret = 1;
 
         break;
@@ -554,22 +567,13 @@ static int a2dp_process_push(struct userdata *u) {
     for (;;) {
         bool found_tstamp = false;
         pa_usec_t tstamp;
-        struct sbc_info *sbc_info;
-        struct rtp_header *header;
-        struct rtp_payload *payload;
-        const void *p;
         void *d;
         ssize_t l;
-        size_t to_write, to_decode;
-        size_t total_written = 0;
+        size_t processed, total_written;
 
         a2dp_prepare_buffer(u);
 
-        sbc_info = &u->sbc_info;
-        header = sbc_info->buffer;
-        payload = (struct rtp_payload*) ((uint8_t*) sbc_info->buffer + sizeof(*header));
-
-        l = pa_read(u->stream_fd, sbc_info->buffer, sbc_info->buffer_size, &u->stream_write_type);
+        l = pa_read(u->stream_fd, u->buffer, u->buffer_size, &u->stream_write_type);
 
         if (l <= 0) {
 
@@ -586,7 +590,7 @@ static int a2dp_process_push(struct userdata *u) {
             break;
         }
 
-        pa_assert((size_t) l <= sbc_info->buffer_size);
+        pa_assert((size_t) l <= u->buffer_size);
 
         /* TODO: get timestamp from rtp */
         if (!found_tstamp) {
@@ -594,50 +598,30 @@ static int a2dp_process_push(struct userdata *u) {
             tstamp = pa_rtclock_now();
         }
 
-        p = (uint8_t*) sbc_info->buffer + sizeof(*header) + sizeof(*payload);
-        to_decode = l - sizeof(*header) - sizeof(*payload);
+        if ((size_t) l < sizeof(struct rtp_header)) {
+            pa_log_error("Received packet without RTP header");
+            pa_memblock_unref(memchunk.memblock);
+            return 0;
+        }
 
         d = pa_memblock_acquire(memchunk.memblock);
-        to_write = memchunk.length = pa_memblock_get_length(memchunk.memblock);
-
-        while (PA_LIKELY(to_decode > 0)) {
-            size_t written;
-            ssize_t decoded;
-
-            decoded = sbc_decode(&sbc_info->sbc,
-                                 p, to_decode,
-                                 d, to_write,
-                                 &written);
-
-            if (PA_UNLIKELY(decoded <= 0)) {
-                pa_log_error("SBC decoding error (%li)", (long) decoded);
-                pa_memblock_release(memchunk.memblock);
-                pa_memblock_unref(memchunk.memblock);
-                return 0;
-            }
-
-            total_written += written;
+        memchunk.length = pa_memblock_get_length(memchunk.memblock);
 
-            /* Reset frame length, it can be changed due to bitpool change */
-            sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
+        total_written = u->a2dp_codec->decode_buffer(u->a2dp_codec_info,
+                                                     (uint8_t*) u->buffer + sizeof(struct rtp_header), l - sizeof(struct rtp_header),
+                                                     d, memchunk.length, &processed);
 
-            pa_assert_fp((size_t) decoded <= to_decode);
-            pa_assert_fp((size_t) decoded == sbc_info->frame_length);
-
-            pa_assert_fp((size_t) written == sbc_info->codesize);
-
-            p = (const uint8_t*) p + decoded;
-            to_decode -= decoded;
-
-            d = (uint8_t*) d + written;
-            to_write -= written;
+        if (PA_UNLIKELY(total_written == 0)) {
+            pa_memblock_release(memchunk.memblock);
+            pa_memblock_unref(memchunk.memblock);
+            return 0;
         }
 
         u->read_index += (uint64_t) total_written;
         pa_smoother_put(u->read_smoother, tstamp, pa_bytes_to_usec(u->read_index, &u->sample_spec));
         pa_smoother_resume(u->read_smoother, tstamp, true);
 
-        memchunk.length -= to_write;
+        memchunk.length = total_written;
 
         pa_memblock_release(memchunk.memblock);
 
@@ -653,62 +637,210 @@ static int a2dp_process_push(struct userdata *u) {
 }
 
 /* Run from I/O thread */
-static void a2dp_set_bitpool(struct userdata *u, uint8_t bitpool) {
-    struct sbc_info *sbc_info;
+static void a2dp_post_stats(struct userdata *u) {
+    pa_assert(u);
 
+    u->a2dp_stats.bitrate = u->a2dp_codec->get_encoder_bitrate(u->a2dp_codec_info);
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->msg), BLUETOOTH_MESSAGE_A2DP_STATS,
+                      pa_xmemdup(&u->a2dp_stats, sizeof(u->a2dp_stats)), 0, NULL, pa_xfree);
+}
+
+/* Run from I/O thread */
+static void a2dp_set_write_block_size(struct userdata *u, size_t write_block_size, bool increased) {
     pa_assert(u);
 
-    sbc_info = &u->sbc_info;
+    if (increased)
+        u->a2dp_stats.bitrate_increases++;
+    else
+        u->a2dp_stats.bitrate_decreases++;
+
+    u->bitrate_changed_at = pa_rtclock_now();
+    u->write_block_size = write_block_size;
+
+    pa_sink_set_max_request_within_thread(u->sink, u->write_block_size);
+    pa_sink_set_fixed_latency_within_thread(u->sink,
+            FIXED_LATENCY_PLAYBACK_A2DP + u->a2dp_codec->latency + pa_bytes_to_usec(u->write_block_size, &u->sample_spec));
 
-    if (sbc_info->sbc.bitpool == bitpool)
+    a2dp_post_stats(u);
+}
+
+/* Run from I/O thread */
+static void a2dp_reduce_bitrate(struct userdata *u) {
+    size_t write_block_size;
+
+    pa_assert(u);
+
+    if (!u->a2dp_codec->reduce_encoder_bitrate)
         return;
 
-    if (bitpool > sbc_info->max_bitpool)
-        bitpool = sbc_info->max_bitpool;
-    else if (bitpool < sbc_info->min_bitpool)
-        bitpool = sbc_info->min_bitpool;
+    if ((write_block_size = u->a2dp_codec->reduce_encoder_bitrate(u->a2dp_codec_info, u->write_link_mtu - sizeof(struct rtp_header))) > 0)
+        a2dp_set_write_block_size(u, write_block_size, false);
+}
+
+/* Run from I/O thread */
+static void a2dp_increase_bitrate(struct userdata *u) {
+    size_t write_block_size;
+
+    pa_assert(u);
 
-    sbc_info->sbc.bitpool = bitpool;
+    if (!u->a2dp_codec->increase_encoder_bitrate)
+        return;
 
-    sbc_info->codesize = sbc_get_codesize(&sbc_info->sbc);
-    sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
+    if ((write_block_size = u->a2dp_codec->increase_encoder_bitrate(u->a2dp_codec_info, u->write_link_mtu - sizeof(struct rtp_header))) > 0)
+        a2dp_set_write_block_size(u, write_block_size, true);
+}
 
-    pa_log_debug("Bitpool has changed to %u", sbc_info->sbc.bitpool);
+/* Run from I/O thread. Lowers the bitrate while packets pile up in the
+ * socket's output queue and slowly raises it again once the link has
+ * recovered. */
+static void a2dp_adapt_bitrate(struct userdata *u, pa_usec_t now, int queued) {
+    pa_assert(u);
 
-    u->read_block_size =
-        (u->read_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-        / sbc_info->frame_length * sbc_info->codesize;
+    if ((size_t) queued > u->a2dp_stats.queue_max)
+        u->a2dp_stats.queue_max = (size_t) queued;
 
-    u->write_block_size =
-        (u->write_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-        / sbc_info->frame_length * sbc_info->codesize;
+    if ((size_t) queued >= OUTQ_CONGESTED_PACKETS * u->write_link_mtu) {
+        u->congested_at = now;
 
-    pa_sink_set_max_request_within_thread(u->sink, u->write_block_size);
-    pa_sink_set_fixed_latency_within_thread(u->sink,
-            FIXED_LATENCY_PLAYBACK_A2DP + pa_bytes_to_usec(u->write_block_size, &u->sample_spec));
+        if (now - u->bitrate_changed_at >= BITRATE_DEC_INTERVAL)
+            a2dp_reduce_bitrate(u);
+
+        return;
+    }
+
+    if (now - u->congested_at >= BITRATE_INC_INTERVAL &&
+        now - u->bitrate_changed_at >= BITRATE_INC_INTERVAL)
+        a2dp_increase_bitrate(u);
 }
 
-/* Run from I/O thread */
-static void a2dp_reduce_bitpool(struct userdata *u) {
-    struct sbc_info *sbc_info;
-    uint8_t bitpool;
+/* Run from I/O thread. Called after each packet that has been written
+ * successfully. */
+static void a2dp_packet_written(struct userdata *u) {
+    pa_usec_t now, written, queued_usec;
+    int queued;
 
     pa_assert(u);
 
-    sbc_info = &u->sbc_info;
+    /* The kernel took the flags, but the driver doesn't report */
+    if (u->tx_timestamps && !u->tx_reported && u->tx_packet_id > TX_HISTORY) {
+        pa_log_debug("No transmission timestamps arrived, estimating the latency from the socket queue");
+        u->tx_timestamps = false;
+    }
 
-    /* Check if bitpool is already at its limit */
-    if (sbc_info->sbc.bitpool <= BITPOOL_DEC_LIMIT)
+    if (!u->queue_monitoring)
         return;
 
-    bitpool = sbc_info->sbc.bitpool - BITPOOL_DEC_STEP;
+    if (ioctl(u->stream_fd, SIOCOUTQ, &queued) < 0) {
+        pa_log_debug("Can't query the socket output queue, not adapting the bitrate: %s", pa_cstrerror(errno));
+        u->queue_monitoring = false;
+        return;
+    }
+
+    now = pa_rtclock_now();
+
+    /* Without transmission reports, take everything that has left the
+     * socket as played. The queue holds encoded data, so we go by the
+     * size of the last packet. */
+    if (!u->tx_timestamps && u->last_packet_size > 0) {
+        written = pa_bytes_to_usec(u->write_index, &u->sample_spec);
+        queued_usec = pa_bytes_to_usec((uint64_t) queued * u->write_block_size / u->last_packet_size, &u->sample_spec);
+
+        pa_smoother_put(u->write_smoother, now, written - PA_MIN(queued_usec, written));
+        pa_smoother_resume(u->write_smoother, now, true);
+    }
+
+    a2dp_adapt_bitrate(u, now, queued);
+}
+
+#ifdef SOF_TIMESTAMPING_TX_COMPLETION
+
+/* Run from I/O thread */
+static void a2dp_enable_tx_timestamps(struct userdata *u) {
+    int flags = SOF_TIMESTAMPING_TX_COMPLETION | SOF_TIMESTAMPING_SOFTWARE |
+                SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    u->tx_packet_id = 0;
+    u->tx_reported = false;
+
+    /* Kernels that don't know TX_COMPLETION refuse the flags */
+    if (!(u->tx_timestamps = setsockopt(u->stream_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) >= 0))
+        pa_log_debug("No transmission timestamps, estimating the latency from the socket queue: %s", pa_cstrerror(errno));
+}
+
+/* Run from I/O thread. Picks up the kernel's reports of when packets have
+ * been sent, which show up as POLLERR. */
+static void a2dp_read_tx_timestamps(struct userdata *u) {
+    pa_usec_t now_rt, now, at;
+    struct timeval tv;
+
+    pa_assert(u);
+
+    now_rt = pa_timeval_load(pa_gettimeofday(&tv));
+    now = pa_rtclock_now();
+
+    for (;;) {
+        uint8_t control[256];
+        struct msghdr m;
+        struct cmsghdr *cm;
+        struct scm_timestamping *ts = NULL;
+        struct sock_extended_err *err = NULL;
+        pa_usec_t sent;
+        uint32_t behind;
+
+        pa_zero(m);
+        m.msg_control = control;
+        m.msg_controllen = sizeof(control);
+
+        if (recvmsg(u->stream_fd, &m, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                pa_log_debug("Failed to read transmission timestamps: %s", pa_cstrerror(errno));
+                u->tx_timestamps = false;
+            }
+
+            return;
+        }
+
+        for (cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPING)
+                ts = (struct scm_timestamping *) CMSG_DATA(cm);
+            else if (cm->cmsg_len >= CMSG_LEN(sizeof(struct sock_extended_err))) {
+                struct sock_extended_err *e = (struct sock_extended_err *) CMSG_DATA(cm);
+
+                if (e->ee_errno == ENOMSG && e->ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+                    err = e;
+            }
+        }
+
+        if (!ts || !err || err->ee_info != SCM_TSTAMP_COMPLETION)
+            continue;
+
+        /* The report is for the packet counted as ee_data */
+        behind = u->tx_packet_id - err->ee_data;
+        if (behind == 0 || behind > TX_HISTORY)
+            continue;
 
-    if (bitpool < BITPOOL_DEC_LIMIT)
-        bitpool = BITPOOL_DEC_LIMIT;
+        /* The timestamp is taken on the system clock */
+        sent = (pa_usec_t) ts->ts[0].tv_sec * PA_USEC_PER_SEC + (pa_usec_t) ts->ts[0].tv_nsec / PA_NSEC_PER_USEC;
+        at = now - PA_MIN(now_rt > sent ? now_rt - sent : 0, now);
 
-    a2dp_set_bitpool(u, bitpool);
+        pa_smoother_put(u->write_smoother, at, pa_bytes_to_usec(u->tx_write_index[err->ee_data % TX_HISTORY], &u->sample_spec));
+        pa_smoother_resume(u->write_smoother, at, true);
+        u->tx_reported = true;
+    }
 }
 
+#else
+
+static void a2dp_enable_tx_timestamps(struct userdata *u) {
+    u->tx_timestamps = false;
+}
+
+static void a2dp_read_tx_timestamps(struct userdata *u) {
+    pa_assert_not_reached();
+}
+
+#endif
+
 static void teardown_stream(struct userdata *u) {
     if (u->rtpoll_item) {
         pa_rtpoll_item_free(u->rtpoll_item);
@@ -725,6 +857,13 @@ static void teardown_stream(struct userdata *u) {
         u->read_smoother = NULL;
     }
 
+    if (u->write_smoother) {
+        pa_smoother_free(u->write_smoother);
+        u->write_smoother = NULL;
+    }
+
+    u->tx_timestamps = false;
+
     if (u->write_memchunk.memblock) {
         pa_memblock_unref(u->write_memchunk.memblock);
         pa_memchunk_reset(&u->write_memchunk);
@@ -773,27 +912,22 @@ static void transport_config_mtu(struct userdata *u) {
         u->read_block_size = u->read_link_mtu;
         u->write_block_size = u->write_link_mtu;
     } else {
-        u->read_block_size =
-            (u->read_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-            / u->sbc_info.frame_length * u->sbc_info.codesize;
-
-        u->write_block_size =
-            (u->write_link_mtu - sizeof(struct rtp_header) - sizeof(struct rtp_payload))
-            / u->sbc_info.frame_length * u->sbc_info.codesize;
+        u->read_block_size = u->a2dp_codec->get_block_size(u->a2dp_codec_info, u->read_link_mtu - sizeof(struct rtp_header));
+        u->write_block_size = u->a2dp_codec->get_block_size(u->a2dp_codec_info, u->write_link_mtu - sizeof(struct rtp_header));
     }
 
     if (u->sink) {
         pa_sink_set_max_request_within_thread(u->sink, u->write_block_size);
         pa_sink_set_fixed_latency_within_thread(u->sink,
                                                 (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK ?
-                                                 FIXED_LATENCY_PLAYBACK_A2DP : FIXED_LATENCY_PLAYBACK_SCO) +
+                                                 FIXED_LATENCY_PLAYBACK_A2DP + u->a2dp_codec->latency : FIXED_LATENCY_PLAYBACK_SCO) +
                                                 pa_bytes_to_usec(u->write_block_size, &u->sample_spec));
     }
 
     if (u->source)
         pa_source_set_fixed_latency_within_thread(u->source,
                                                   (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SOURCE ?
-                                                   FIXED_LATENCY_RECORD_A2DP : FIXED_LATENCY_RECORD_SCO) +
+                                                   FIXED_LATENCY_RECORD_A2DP + u->a2dp_codec->latency : FIXED_LATENCY_RECORD_SCO) +
                                                   pa_bytes_to_usec(u->read_block_size, &u->sample_spec));
 }
 
@@ -804,6 +938,10 @@ static void setup_stream(struct userdata *u) {
 
     pa_log_info("Transport %s resuming", u->transport->path);
 
+    /* Start every stream at the highest quality again */
+    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
+        u->a2dp_codec->reset(u->a2dp_codec_info);
+
     transport_config_mtu(u);
 
     pa_make_fd_nonblock(u->stream_fd);
@@ -815,8 +953,15 @@ static void setup_stream(struct userdata *u) {
 
     pa_log_debug("Stream properly set up, we're ready to roll!");
 
-    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
-        a2dp_set_bitpool(u, u->sbc_info.max_bitpool);
+    if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
+        u->queue_monitoring = true;
+        u->congested_at = u->bitrate_changed_at = pa_rtclock_now();
+        a2dp_post_stats(u);
+
+        u->write_smoother = pa_smoother_new(PA_USEC_PER_SEC, 2*PA_USEC_PER_SEC, true, true, 10, pa_rtclock_now(), true);
+        u->last_packet_size = 0;
+        a2dp_enable_tx_timestamps(u);
+    }
 
     u->rtpoll_item = pa_rtpoll_item_new(u->rtpoll, PA_RTPOLL_NEVER, 1);
     pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
@@ -1052,6 +1197,10 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             if (u->read_smoother) {
                 ri = pa_smoother_get(u->read_smoother, pa_rtclock_now());
                 wi = pa_bytes_to_usec(u->write_index + u->write_block_size, &u->sample_spec);
+            } else if (u->write_smoother && (u->tx_timestamps || u->queue_monitoring)) {
+                /* What has actually been sent, or at least left the socket */
+                ri = pa_smoother_get(u->write_smoother, pa_rtclock_now());
+                wi = pa_bytes_to_usec(u->write_index, &u->sample_spec);
             } else {
                 ri = pa_rtclock_now() - u->started_at;
                 wi = pa_bytes_to_usec(u->write_index, &u->sample_spec);
@@ -1159,118 +1308,33 @@ static int add_sink(struct userdata *u) {
 }
 
 /* Run from main thread */
-static void transport_config(struct userdata *u) {
+static int transport_config(struct userdata *u) {
     if (u->profile == PA_BLUETOOTH_PROFILE_HEADSET_HEAD_UNIT || u->profile == PA_BLUETOOTH_PROFILE_HEADSET_AUDIO_GATEWAY) {
         u->sample_spec.format = PA_SAMPLE_S16LE;
         u->sample_spec.channels = 1;
         u->sample_spec.rate = 8000;
     } else {
-        sbc_info_t *sbc_info = &u->sbc_info;
-        a2dp_sbc_t *config;
-
         pa_assert(u->transport);
 
-        u->sample_spec.format = PA_SAMPLE_S16LE;
-        config = (a2dp_sbc_t *) u->transport->config;
-
-        if (sbc_info->sbc_initialized)
-            sbc_reinit(&sbc_info->sbc, 0);
-        else
-            sbc_init(&sbc_info->sbc, 0);
-        sbc_info->sbc_initialized = true;
-
-        switch (config->frequency) {
-            case SBC_SAMPLING_FREQ_16000:
-                sbc_info->sbc.frequency = SBC_FREQ_16000;
-                u->sample_spec.rate = 16000U;
-                break;
-            case SBC_SAMPLING_FREQ_32000:
-                sbc_info->sbc.frequency = SBC_FREQ_32000;
-                u->sample_spec.rate = 32000U;
-                break;
-            case SBC_SAMPLING_FREQ_44100:
-                sbc_info->sbc.frequency = SBC_FREQ_44100;
-                u->sample_spec.rate = 44100U;
-                break;
-            case SBC_SAMPLING_FREQ_48000:
-                sbc_info->sbc.frequency = SBC_FREQ_48000;
-                u->sample_spec.rate = 48000U;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->channel_mode) {
-            case SBC_CHANNEL_MODE_MONO:
-                sbc_info->sbc.mode = SBC_MODE_MONO;
-                u->sample_spec.channels = 1;
-                break;
-            case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-                sbc_info->sbc.mode = SBC_MODE_DUAL_CHANNEL;
-                u->sample_spec.channels = 2;
-                break;
-            case SBC_CHANNEL_MODE_STEREO:
-                sbc_info->sbc.mode = SBC_MODE_STEREO;
-                u->sample_spec.channels = 2;
-                break;
-            case SBC_CHANNEL_MODE_JOINT_STEREO:
-                sbc_info->sbc.mode = SBC_MODE_JOINT_STEREO;
-                u->sample_spec.channels = 2;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->allocation_method) {
-            case SBC_ALLOCATION_SNR:
-                sbc_info->sbc.allocation = SBC_AM_SNR;
-                break;
-            case SBC_ALLOCATION_LOUDNESS:
-                sbc_info->sbc.allocation = SBC_AM_LOUDNESS;
-                break;
-            default:
-                pa_assert_not_reached();
+        if (u->a2dp_codec_info) {
+            u->a2dp_codec->deinit(u->a2dp_codec_info);
+            u->a2dp_codec_info = NULL;
         }
 
-        switch (config->subbands) {
-            case SBC_SUBBANDS_4:
-                sbc_info->sbc.subbands = SBC_SB_4;
-                break;
-            case SBC_SUBBANDS_8:
-                sbc_info->sbc.subbands = SBC_SB_8;
-                break;
-            default:
-                pa_assert_not_reached();
-        }
-
-        switch (config->block_length) {
-            case SBC_BLOCK_LENGTH_4:
-                sbc_info->sbc.blocks = SBC_BLK_4;
-                break;
-            case SBC_BLOCK_LENGTH_8:
-                sbc_info->sbc.blocks = SBC_BLK_8;
-                break;
-            case SBC_BLOCK_LENGTH_12:
-                sbc_info->sbc.blocks = SBC_BLK_12;
-                break;
-            case SBC_BLOCK_LENGTH_16:
-                sbc_info->sbc.blocks = SBC_BLK_16;
-                break;
-            default:
-                pa_assert_not_reached();
+        if (!(u->a2dp_codec = pa_bluetooth_get_a2dp_codec(u->transport->codec))) {
+            pa_log_error("Unsupported A2DP codec 0x%02x", u->transport->codec);
+            return -1;
         }
 
-        sbc_info->min_bitpool = config->min_bitpool;
-        sbc_info->max_bitpool = config->max_bitpool;
-
-        /* Set minimum bitpool for source to get the maximum possible block_size */
-        sbc_info->sbc.bitpool = u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK ? sbc_info->max_bitpool : sbc_info->min_bitpool;
-        sbc_info->codesize = sbc_get_codesize(&sbc_info->sbc);
-        sbc_info->frame_length = sbc_get_frame_length(&sbc_info->sbc);
+        u->a2dp_codec_info = u->a2dp_codec->init(u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK,
+                                                 u->transport->config, u->transport->config_size, &u->sample_spec);
+        if (!u->a2dp_codec_info)
+            return -1;
 
-        pa_log_info("SBC parameters: allocation=%u, subbands=%u, blocks=%u, bitpool=%u",
-                    sbc_info->sbc.allocation, sbc_info->sbc.subbands, sbc_info->sbc.blocks, sbc_info->sbc.bitpool);
+        pa_log_info("Using A2DP codec %s", u->a2dp_codec->description);
     }
+
+    return 0;
 }
 
 /* Run from main thread */
@@ -1295,9 +1359,7 @@ static int setup_transport(struct userdata *u) {
     else if (transport_acquire(u, false) < 0)
         return -1; /* We need to fail here until the interactions with module-suspend-on-idle and alike get improved */
 
-    transport_config(u);
-
-    return 0;
+    return transport_config(u);
 }
 
 /* Run from main thread */
@@ -1363,6 +1425,12 @@ static void thread_func(void *userdata) {
 
         pollfd = u->rtpoll_item ? pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL) : NULL;
 
+        /* Transmission timestamps come in on the error queue */
+        if (pollfd && (pollfd->revents & POLLERR) && u->tx_timestamps) {
+            a2dp_read_tx_timestamps(u);
+            pollfd->revents &= ~POLLERR;
+        }
+
         if (pollfd && (pollfd->revents & ~(POLLOUT|POLLIN))) {
             pa_log_info("FD error: %s%s%s%s",
                         pollfd->revents & POLLERR ? "POLLERR " :"",
@@ -1451,7 +1519,7 @@ static void thread_func(void *userdata) {
                                 u->write_index += skip_bytes;
 
                                 if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK)
-                                    a2dp_reduce_bitpool(u);
+                                    a2dp_reduce_bitrate(u);
                             }
                         }
 
@@ -1469,6 +1537,9 @@ static void thread_func(void *userdata) {
                     if (u->profile == PA_BLUETOOTH_PROFILE_A2DP_SINK) {
                         if ((n_written = a2dp_process_render(u)) < 0)
                             goto fail;
+
+                        if (n_written > 0)
+                            a2dp_packet_written(u);
                     } else {
                         if ((n_written = sco_process_render(u)) < 0)
                             goto fail;
@@ -2138,6 +2209,24 @@ static int device_process_msg(pa_msgobject *obj, int code, void *data, int64_t o
             if (u->transport->state > PA_BLUETOOTH_TRANSPORT_STATE_IDLE)
                 pa_bluetooth_transport_set_state(u->transport, PA_BLUETOOTH_TRANSPORT_STATE_IDLE);
             break;
+        case BLUETOOTH_MESSAGE_A2DP_STATS: {
+            a2dp_stats_t *stats = data;
+            pa_proplist *pl;
+
+            /* The profile may have changed in the meantime */
+            if (!u->sink || u->profile != PA_BLUETOOTH_PROFILE_A2DP_SINK)
+                break;
+
+            pl = pa_proplist_new();
+            pa_proplist_sets(pl, "bluetooth.a2dp.codec", u->a2dp_codec->name);
+            pa_proplist_setf(pl, "bluetooth.a2dp.bitrate", "%u", stats->bitrate);
+            pa_proplist_setf(pl, "bluetooth.a2dp.bitrate_increases", "%u", stats->bitrate_increases);
+            pa_proplist_setf(pl, "bluetooth.a2dp.bitrate_decreases", "%u", stats->bitrate_decreases);
+            pa_proplist_setf(pl, "bluetooth.a2dp.queue_max", "%lu", (unsigned long) stats->queue_max);
+            pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, pl);
+            pa_proplist_free(pl);
+            break;
+        }
     }
 
     return 0;
@@ -2261,11 +2350,11 @@ void pa__done(pa_module *m) {
     if (u->transport_microphone_gain_changed_slot)
         pa_hook_slot_free(u->transport_microphone_gain_changed_slot);
 
-    if (u->sbc_info.buffer)
-        pa_xfree(u->sbc_info.buffer);
+    if (u->buffer)
+        pa_xfree(u->buffer);
 
-    if (u->sbc_info.sbc_initialized)
-        sbc_finish(&u->sbc_info.sbc);
+    if (u->a2dp_codec_info)
+        u->a2dp_codec->deinit(u->a2dp_codec_info);
 
     if (u->msg)
         pa_xfree(u->msg);
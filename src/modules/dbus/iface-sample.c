@@ -166,7 +166,7 @@ static void handle_get_sample_format(DBusConnection *conn, DBusMessage *msg, voi
     pa_assert(msg);
     pa_assert(s);
 
-    if (!s->sample->memchunk.memblock) {
+    if (!pa_scache_entry_is_loaded(s->sample)) {
         pa_dbus_send_error(conn, msg, PA_DBUS_ERROR_NO_SUCH_PROPERTY,
                            "Sample %s isn't loaded into memory yet, so its sample format is unknown.", s->sample->name);
         return;
@@ -185,7 +185,7 @@ static void handle_get_sample_rate(DBusConnection *conn, DBusMessage *msg, void
     pa_assert(msg);
     pa_assert(s);
 
-    if (!s->sample->memchunk.memblock) {
+    if (!pa_scache_entry_is_loaded(s->sample)) {
         pa_dbus_send_error(conn, msg, PA_DBUS_ERROR_NO_SUCH_PROPERTY,
                            "Sample %s isn't loaded into memory yet, so its sample rate is unknown.", s->sample->name);
         return;
@@ -205,7 +205,7 @@ static void handle_get_channels(DBusConnection *conn, DBusMessage *msg, void *us
     pa_assert(msg);
     pa_assert(s);
 
-    if (!s->sample->memchunk.memblock) {
+    if (!pa_scache_entry_is_loaded(s->sample)) {
         pa_dbus_send_error(conn, msg, PA_DBUS_ERROR_NO_SUCH_PROPERTY,
                            "Sample %s isn't loaded into memory yet, so its channel map is unknown.", s->sample->name);
         return;
@@ -246,7 +246,7 @@ static void handle_get_duration(DBusConnection *conn, DBusMessage *msg, void *us
     pa_assert(msg);
     pa_assert(s);
 
-    if (!s->sample->memchunk.memblock) {
+    if (!pa_scache_entry_is_loaded(s->sample)) {
         pa_dbus_send_error(conn, msg, PA_DBUS_ERROR_NO_SUCH_PROPERTY,
                            "Sample %s isn't loaded into memory yet, so its duration is unknown.", s->sample->name);
         return;
@@ -265,7 +265,7 @@ static void handle_get_bytes(DBusConnection *conn, DBusMessage *msg, void *userd
     pa_assert(msg);
     pa_assert(s);
 
-    if (!s->sample->memchunk.memblock) {
+    if (!pa_scache_entry_is_loaded(s->sample)) {
         pa_dbus_send_error(conn, msg, PA_DBUS_ERROR_NO_SUCH_PROPERTY,
                            "Sample %s isn't loaded into memory yet, so its size is unknown.", s->sample->name);
         return;
@@ -305,7 +305,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     pa_assert(s);
 
     idx = s->sample->index;
-    if (s->sample->memchunk.memblock) {
+    if (pa_scache_entry_is_loaded(s->sample)) {
         sample_format = s->sample->sample_spec.format;
         sample_rate = s->sample->sample_spec.rate;
         for (i = 0; i < s->sample->channel_map.channels; ++i)
@@ -326,7 +326,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_INDEX].property_name, DBUS_TYPE_UINT32, &idx);
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_NAME].property_name, DBUS_TYPE_STRING, &s->sample->name);
 
-    if (s->sample->memchunk.memblock) {
+    if (pa_scache_entry_is_loaded(s->sample)) {
         pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_SAMPLE_FORMAT].property_name, DBUS_TYPE_UINT32, &sample_format);
         pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_SAMPLE_RATE].property_name, DBUS_TYPE_UINT32, &sample_rate);
         pa_dbus_append_basic_array_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_CHANNELS].property_name, DBUS_TYPE_UINT32, channels, s->sample->channel_map.channels);
@@ -335,7 +335,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     if (s->sample->volume_is_set)
         pa_dbus_append_basic_array_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_DEFAULT_VOLUME].property_name, DBUS_TYPE_UINT32, default_volume, s->sample->volume.channels);
 
-    if (s->sample->memchunk.memblock) {
+    if (pa_scache_entry_is_loaded(s->sample)) {
         pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_DURATION].property_name, DBUS_TYPE_UINT64, &duration);
         pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_BYTES].property_name, DBUS_TYPE_UINT32, &bytes);
     }
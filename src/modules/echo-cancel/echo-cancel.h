@@ -157,6 +157,12 @@ bool pa_speex_ec_init(pa_core *c, pa_echo_canceller *ec,
                       uint32_t *nframes, const char *args);
 void pa_speex_ec_run(pa_echo_canceller *ec, const uint8_t *rec, const uint8_t *play, uint8_t *out);
 void pa_speex_ec_done(pa_echo_canceller *ec);
+
+/* Just the speex preprocessor, without echo cancellation, on mono S16NE
+ * blocks of nframes. Processes in place and returns false if VAD is
+ * enabled and there's no voice. Clean up with pa_speex_ec_done(). */
+bool pa_speex_pp_init(pa_core *c, pa_echo_canceller *ec, pa_sample_spec *ss, uint32_t *nframes, const char *args);
+bool pa_speex_pp_run(pa_echo_canceller *ec, uint8_t *data);
 #endif
 
 #ifdef HAVE_ADRIAN_EC
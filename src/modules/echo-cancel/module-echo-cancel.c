@@ -38,7 +38,10 @@
 #include <pulse/rtclock.h>
 
 #include <pulsecore/i18n.h>
+#include <pulsecore/asyncq.h>
 #include <pulsecore/atomic.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/llist.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sink.h>
@@ -48,8 +51,10 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/poll.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/ltdl-helper.h>
+#include <pulsecore/thread.h>
 
 #include "module-echo-cancel-symdef.h"
 
@@ -76,6 +81,9 @@ PA_MODULE_USAGE(
           "autoloaded=<set if this module is being loaded automatically> "
           "use_volume_sharing=<yes or no> "
           "use_master_format=<yes or no> "
+          "pipeline=<run the canceller in a thread of its own> "
+          "far_end=<sink of another echo canceller to share the played data of> "
+          "drift_tracking=<align playback and capture continuously in the I/O thread> "
         ));
 
 /* NOTE: Make sure the enum and ec_table are maintained in the correct order */
@@ -142,14 +150,27 @@ static const pa_echo_canceller ec_table[] = {
 #define DEFAULT_SAVE_AEC false
 #define DEFAULT_AUTOLOADED false
 #define DEFAULT_USE_MASTER_FORMAT false
+#define DEFAULT_DRIFT_TRACKING false
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+/* The canceller's block size rarely matches the size of the chunks we
+ * get, so the queues are backed by rings of this many blocks, which
+ * covers the usual amount of queued data */
+#define MEMBLOCKQ_RING_BLOCKS 32
+
 #define MAX_LATENCY_BLOCKS 10
 
+/* The drift tracker averages the alignment error over this many pushes,
+ * and only jumps if the error grows beyond this many times the
+ * adjust_threshold. Below that it slips the playback by one frame at
+ * most per push. */
+#define DRIFT_TRACKER_SMOOTHING 32
+#define DRIFT_TRACKER_JUMP_FACTOR 4
+
 /* Can only be used in main context */
 #define IS_ACTIVE(u) ((pa_source_get_state((u)->source) == PA_SOURCE_RUNNING) && \
-                      (pa_sink_get_state((u)->sink) == PA_SINK_RUNNING))
+                      far_end_running(u))
 
 /* This module creates a new (virtual) source and sink.
  *
@@ -191,6 +212,9 @@ PA_DEFINE_PRIVATE_CLASS(pa_echo_canceller_msg, pa_msgobject);
 #define PA_ECHO_CANCELLER_MSG(o) (pa_echo_canceller_msg_cast(o))
 
 struct snapshot {
+    /* The instance whose send_counter to report, see far_end= */
+    struct userdata *owner;
+
     pa_usec_t sink_now;
     pa_usec_t sink_latency;
     size_t sink_delay;
@@ -204,6 +228,11 @@ struct snapshot {
     size_t plen;
 };
 
+/* A block handed to the pipeline thread, see do_push() */
+struct ec_job {
+    pa_memchunk rchunk, pchunk, cchunk;
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -253,8 +282,49 @@ struct userdata {
 
     bool use_volume_sharing;
 
+    /* In pipelined mode the canceller runs in a thread of its own, one
+     * block behind the source I/O thread */
+    bool pipeline;
+    pa_thread *pipeline_thread;
+    pa_asyncq *pipeline_in, *pipeline_out;
+    pa_rtpoll_item *rtpoll_item_pipeline;
+    struct ec_job pipeline_jobs[2];
+    unsigned pipeline_next_job;
+    struct ec_job *pipeline_busy; /* accessed from source I/O thread */
+
+    /* The capture volume as seen by the canceller, and a volume it asked
+     * for from the pipeline thread, or PA_VOLUME_INVALID */
+    pa_atomic_t capture_volume;
+    pa_atomic_t pending_capture_volume;
+
+    /* With far_end= set we are a follower: the played data fed to our
+     * canceller comes from the sink input of another instance, the
+     * leader, instead of our own sink. This way several capture sources
+     * in a room can share the one stream rendered for the speakers. */
+    bool following;
+    struct userdata *far_end; /* the leader, NULL once it went away */
+    pa_idxset *followers; /* of the leader */
+    PA_LLIST_FIELDS(struct userdata); /* in the leader's thread_info list */
+
+    /* With drift_tracking= set the played chunks carry the time they
+     * reach the speaker, and the captured ones the time they left the
+     * mic, both derived from the device latencies. The source I/O thread
+     * keeps the two streams aligned from that, instead of time_callback()
+     * resyncing them periodically. Accessed from source I/O thread. */
+    bool drift_tracking;
+    struct {
+        int64_t far_end_index, near_end_index; /* queue index of ... */
+        pa_usec_t far_end_time, near_end_time; /* ... the sample at this time */
+        pa_sample_spec far_end_ss; /* of sink_memblockq */
+        double error; /* smoothed alignment error in usec */
+        bool primed;
+    } tracker;
+
     struct {
         pa_cvolume current_volume;
+
+        /* Followers we feed, accessed from our sink I/O thread */
+        PA_LLIST_HEAD(struct userdata, followers);
     } thread_info;
 };
 
@@ -279,6 +349,9 @@ static const char* const valid_modargs[] = {
     "autoloaded",
     "use_volume_sharing",
     "use_master_format",
+    "pipeline",
+    "far_end",
+    "drift_tracking",
     NULL
 };
 
@@ -290,13 +363,88 @@ enum {
 };
 
 enum {
-    SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT
+    SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT,
+    SINK_INPUT_MESSAGE_ADD_FOLLOWER,
+    SINK_INPUT_MESSAGE_REMOVE_FOLLOWER
 };
 
 enum {
     ECHO_CANCELLER_MESSAGE_SET_VOLUME,
 };
 
+/* Returns the sink input the played data for our canceller comes from,
+ * or NULL if a leader we follow went away.
+ *
+ * Called from main context */
+static pa_sink_input *far_end_sink_input(struct userdata *u) {
+    if (!u->following)
+        return u->sink_input;
+
+    if (!u->far_end || !u->far_end->sink_input ||
+        !PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(u->far_end->sink_input)))
+        return NULL;
+
+    return u->far_end->sink_input;
+}
+
+/* Called from main context */
+static bool far_end_running(struct userdata *u) {
+    if (!u->following)
+        return pa_sink_get_state(u->sink) == PA_SINK_RUNNING;
+
+    if (!far_end_sink_input(u))
+        return false;
+
+    return pa_sink_get_state(u->far_end->sink) == PA_SINK_RUNNING;
+}
+
+/* Sends msg to the I/O thread of the leader's sink input, or handles it
+ * right here if the sink input has no I/O thread at the moment.
+ *
+ * Called from main context */
+static void far_end_send(struct userdata *leader, int code, struct userdata *follower) {
+    pa_sink_input *i = leader->sink_input;
+
+    if (i && i->sink && PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(i))) {
+        pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), code, follower, 0, NULL);
+        return;
+    }
+
+    if (code == SINK_INPUT_MESSAGE_ADD_FOLLOWER)
+        PA_LLIST_PREPEND(struct userdata, leader->thread_info.followers, follower);
+    else
+        PA_LLIST_REMOVE(struct userdata, leader->thread_info.followers, follower);
+}
+
+/* Called from main context */
+static void far_end_attach(struct userdata *u, struct userdata *leader) {
+    pa_assert(u->following);
+    pa_assert(!u->far_end);
+
+    u->far_end = leader;
+
+    if (!leader->followers)
+        leader->followers = pa_idxset_new(NULL, NULL);
+
+    pa_idxset_put(leader->followers, u, NULL);
+    far_end_send(leader, SINK_INPUT_MESSAGE_ADD_FOLLOWER, u);
+}
+
+/* After this returns the leader won't post anything to us anymore.
+ *
+ * Called from main context */
+static void far_end_detach(struct userdata *u) {
+    struct userdata *leader;
+
+    if (!(leader = u->far_end))
+        return;
+
+    far_end_send(leader, SINK_INPUT_MESSAGE_REMOVE_FOLLOWER, u);
+    pa_idxset_remove_by_data(leader->followers, u, NULL);
+
+    u->far_end = NULL;
+}
+
 static int64_t calc_diff(struct userdata *u, struct snapshot *snapshot) {
     int64_t diff_time, buffer_latency;
     pa_usec_t plen, rlen, source_delay, sink_delay, recv_counter, send_counter;
@@ -342,6 +490,7 @@ static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct tim
     int64_t diff_time;
     /*size_t fs*/
     struct snapshot latency_snapshot;
+    pa_sink_input *far_end;
 
     pa_assert(u);
     pa_assert(a);
@@ -351,9 +500,12 @@ static void time_callback(pa_mainloop_api *a, pa_time_event *e, const struct tim
     if (!IS_ACTIVE(u))
         return;
 
+    pa_assert_se(far_end = far_end_sink_input(u));
+    latency_snapshot.owner = u;
+
     /* update our snapshots */
     pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
-    pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
+    pa_asyncmsgq_send(far_end->sink->asyncmsgq, PA_MSGOBJECT(far_end), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
 
     /* calculate drift between capture and playback */
     diff_time = calc_diff(u, &latency_snapshot);
@@ -421,12 +573,15 @@ static int source_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t
                 /* Add the latency internal to our source output on top */
                 pa_bytes_to_usec(pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq), &u->source_output->source->sample_spec) +
                 /* and the buffering we do on the source */
-                pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec);
+                pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec) +
+                /* and the block that may still be in the pipeline */
+                (u->pipeline ? pa_bytes_to_usec(u->source_output_blocksize, &u->source_output->source->sample_spec) : 0);
 
             return 0;
 
         case PA_SOURCE_MESSAGE_SET_VOLUME_SYNCED:
             u->thread_info.current_volume = u->source->reference_volume;
+            pa_atomic_store(&u->capture_volume, (int) pa_cvolume_avg(&u->thread_info.current_volume));
             break;
     }
 
@@ -477,7 +632,7 @@ static int source_set_state_cb(pa_source *s, pa_source_state_t state) {
 
     if (state == PA_SOURCE_RUNNING) {
         /* restart timer when both sink and source are active */
-        if ((pa_sink_get_state(u->sink) == PA_SINK_RUNNING) && u->adjust_time)
+        if (far_end_running(u) && u->adjust_time)
             pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
 
         pa_atomic_store(&u->request_resync, 1);
@@ -501,10 +656,19 @@ static int sink_set_state_cb(pa_sink *s, pa_sink_state_t state) {
         return 0;
 
     if (state == PA_SINK_RUNNING) {
+        struct userdata *f;
+        uint32_t idx;
+
         /* restart timer when both sink and source are active */
-        if ((pa_source_get_state(u->source) == PA_SOURCE_RUNNING) && u->adjust_time)
+        if (!u->following && (pa_source_get_state(u->source) == PA_SOURCE_RUNNING) && u->adjust_time)
             pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
 
+        /* and the same for everyone sharing our played data */
+        if (u->followers)
+            PA_IDXSET_FOREACH(f, u->followers, idx)
+                if (f->source && (pa_source_get_state(f->source) == PA_SOURCE_RUNNING) && f->adjust_time)
+                    pa_core_rttime_restart(f->core, f->time_event, pa_rtclock_now() + f->adjust_time);
+
         pa_atomic_store(&u->request_resync, 1);
         pa_sink_input_cork(u->sink_input, false);
     } else if (state == PA_SINK_SUSPENDED) {
@@ -679,6 +843,9 @@ static void apply_diff_time(struct userdata *u, int64_t diff_time) {
             u->sink_skip = 0;
         }
     }
+
+    /* The smoothed error is stale after the skip */
+    u->tracker.primed = false;
 }
 
 /* Called from source I/O thread context. */
@@ -688,6 +855,8 @@ static void do_resync(struct userdata *u) {
 
     pa_log("Doing resync");
 
+    latency_snapshot.owner = u;
+
     /* update our snapshot */
     /* 1. Get sink input latency snapshot, might cause buffers to be sent to source thread */
     pa_asyncmsgq_send(u->sink_input->sink->asyncmsgq, PA_MSGOBJECT(u->sink_input), SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT, &latency_snapshot, 0, NULL);
@@ -800,10 +969,126 @@ static void do_push_drift_comp(struct userdata *u) {
     }
 }
 
+/* Called from the pipeline thread. */
+static void pipeline_thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_debug("Echo canceller pipeline thread starting up.");
+
+    if (u->core->realtime_scheduling)
+        pa_make_realtime(u->core->realtime_priority);
+
+    for (;;) {
+        struct ec_job *job;
+        uint8_t *rdata, *pdata, *cdata;
+
+        /* The userdata itself asks us to quit */
+        if ((job = pa_asyncq_pop(u->pipeline_in, true)) == (void*) u)
+            break;
+
+        rdata = (uint8_t*) pa_memblock_acquire(job->rchunk.memblock) + job->rchunk.index;
+        pdata = (uint8_t*) pa_memblock_acquire(job->pchunk.memblock) + job->pchunk.index;
+        cdata = pa_memblock_acquire(job->cchunk.memblock);
+
+        u->ec->run(u->ec, rdata, pdata, cdata);
+
+        pa_memblock_release(job->cchunk.memblock);
+        pa_memblock_release(job->pchunk.memblock);
+        pa_memblock_release(job->rchunk.memblock);
+
+        pa_assert_se(pa_asyncq_push(u->pipeline_out, job, true) == 0);
+    }
+
+    pa_log_debug("Echo canceller pipeline thread shutting down.");
+}
+
+/* Called from source I/O thread context. */
+static void pipeline_finish(struct userdata *u, struct ec_job *job) {
+    int v;
+    int unused PA_GCC_UNUSED;
+
+    pa_assert(job == u->pipeline_busy);
+    u->pipeline_busy = NULL;
+
+    pa_memblock_unref(job->rchunk.memblock);
+    pa_memblock_unref(job->pchunk.memblock);
+
+    if (u->save_aec && u->canceled_file) {
+        unused = fwrite(pa_memblock_acquire(job->cchunk.memblock), 1, u->source_blocksize, u->canceled_file);
+        pa_memblock_release(job->cchunk.memblock);
+    }
+
+    /* The canceller can't post messages from the pipeline thread, so we
+     * do that for it */
+    if ((v = pa_atomic_load(&u->pending_capture_volume)) != (int) PA_VOLUME_INVALID &&
+        pa_atomic_cmpxchg(&u->pending_capture_volume, v, (int) PA_VOLUME_INVALID))
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->ec->msg), ECHO_CANCELLER_MESSAGE_SET_VOLUME, PA_UINT_TO_PTR((pa_volume_t) v),
+                0, NULL, NULL);
+
+    /* forward the (echo-canceled) data to the virtual source */
+    pa_source_post(u->source, &job->cchunk);
+    pa_memblock_unref(job->cchunk.memblock);
+}
+
+/* Waits for the block in the pipeline, if there is one, and posts it.
+ * Whatever touches the source or the queues in a way that depends on
+ * the block being posted first has to call this.
+ *
+ * Called from source I/O thread context. */
+static void pipeline_flush(struct userdata *u) {
+    struct ec_job *job;
+
+    if (!u->pipeline_busy)
+        return;
+
+    pa_assert_se(job = pa_asyncq_pop(u->pipeline_out, true));
+    pipeline_finish(u, job);
+}
+
+/* Called from source I/O thread context. */
+static int pipeline_work_cb(pa_rtpoll_item *i) {
+    struct userdata *u;
+    struct ec_job *job;
+
+    pa_assert_se(u = pa_rtpoll_item_get_userdata(i));
+
+    if ((job = pa_asyncq_pop(u->pipeline_out, false)))
+        pipeline_finish(u, job);
+
+    return 0;
+}
+
+/* Called from source I/O thread context. */
+static int pipeline_before_cb(pa_rtpoll_item *i) {
+    struct userdata *u;
+
+    pa_assert_se(u = pa_rtpoll_item_get_userdata(i));
+
+    if (pa_asyncq_read_before_poll(u->pipeline_out) < 0)
+        return 1; /* 1 means immediate restart of the loop */
+
+    return 0;
+}
+
+/* Called from source I/O thread context. */
+static void pipeline_after_cb(pa_rtpoll_item *i) {
+    struct userdata *u;
+
+    pa_assert_se(u = pa_rtpoll_item_get_userdata(i));
+
+    pa_asyncq_read_after_poll(u->pipeline_out);
+}
+
 /* This one's simpler than the drift compensation case -- we just iterate over
  * the capture buffer, and pass the canceller blocksize bytes of playback and
  * capture data. If playback is currently inactive, we just push silence.
  *
+ * In pipelined mode each block is handed to the pipeline thread instead, and
+ * posted once the canceller is done with it. Only one block is in the
+ * pipeline at a time, which bounds the extra latency to one block.
+ *
  * Called from source I/O thread context. */
 static void do_push(struct userdata *u) {
     size_t rlen, plen;
@@ -841,6 +1126,34 @@ static void do_push(struct userdata *u) {
                 unused = fwrite(pdata, 1, u->sink_blocksize, u->played_file);
         }
 
+        if (u->pipeline) {
+            struct ec_job *job;
+
+            pa_memblock_release(cchunk.memblock);
+            pa_memblock_release(pchunk.memblock);
+            pa_memblock_release(rchunk.memblock);
+
+            /* The job references the chunks from here on */
+            pa_memblockq_drop(u->source_memblockq, u->source_output_blocksize);
+            rlen -= u->source_output_blocksize;
+            pa_memblockq_drop(u->sink_memblockq, u->sink_blocksize);
+            plen = plen >= u->sink_blocksize ? plen - u->sink_blocksize : 0;
+
+            pipeline_flush(u);
+
+            job = &u->pipeline_jobs[u->pipeline_next_job];
+            u->pipeline_next_job ^= 1;
+
+            job->rchunk = rchunk;
+            job->pchunk = pchunk;
+            job->cchunk = cchunk;
+
+            u->pipeline_busy = job;
+            pa_assert_se(pa_asyncq_push(u->pipeline_in, job, true) == 0);
+
+            continue;
+        }
+
         /* perform echo cancellation */
         u->ec->run(u->ec, rdata, pdata, cdata);
 
@@ -873,6 +1186,69 @@ static void do_push(struct userdata *u) {
     }
 }
 
+/* Converts a signed queue index difference into usec */
+static double index_to_usec(int64_t delta, const pa_sample_spec *ss) {
+    return (double) (delta / (int64_t) pa_frame_size(ss)) * PA_USEC_PER_SEC / ss->rate;
+}
+
+/* Compares when the next played and captured samples the canceller gets
+ * were at the speaker and at the mic. Small errors are corrected by
+ * slipping the playback a frame at a time, so the canceller does not
+ * lose its convergence to a resync jump. Only a large error is corrected
+ * by skipping, like apply_diff_time() does.
+ *
+ * Called from source I/O thread context. */
+static void track_drift(struct userdata *u) {
+    const pa_sample_spec *pss = &u->tracker.far_end_ss;
+    const pa_sample_spec *rss = &u->source_output->sample_spec;
+    double play_time, capture_time, diff, frame_usec;
+    size_t fs;
+
+    if (!u->tracker.far_end_time || !u->tracker.near_end_time)
+        return;
+
+    play_time = (double) u->tracker.far_end_time +
+        index_to_usec(pa_memblockq_get_read_index(u->sink_memblockq) - u->tracker.far_end_index, pss);
+    capture_time = (double) u->tracker.near_end_time +
+        index_to_usec(pa_memblockq_get_read_index(u->source_memblockq) - u->tracker.near_end_index, rss);
+
+    /* > 0 means the playback we pair with the capture is too old */
+    diff = capture_time - play_time;
+
+    if (!u->tracker.primed) {
+        u->tracker.error = diff;
+        u->tracker.primed = true;
+    } else
+        u->tracker.error += (diff - u->tracker.error) / DRIFT_TRACKER_SMOOTHING;
+
+    if (fabs(u->tracker.error) > (double) u->adjust_threshold * DRIFT_TRACKER_JUMP_FACTOR) {
+        pa_log_debug("Drift tracker off by %0.0f usec, skipping.", u->tracker.error);
+
+        if (u->tracker.error > 0)
+            u->sink_skip += pa_usec_to_bytes((pa_usec_t) u->tracker.error, pss);
+        else
+            u->source_skip += pa_usec_to_bytes((pa_usec_t) -u->tracker.error, rss);
+
+        u->tracker.primed = false;
+        return;
+    }
+
+    fs = pa_frame_size(pss);
+    frame_usec = (double) PA_USEC_PER_SEC / pss->rate;
+
+    if (u->tracker.error >= frame_usec) {
+        if (pa_memblockq_get_length(u->sink_memblockq) >= fs) {
+            pa_memblockq_drop(u->sink_memblockq, fs);
+            u->tracker.error -= frame_usec;
+        }
+    } else if (u->tracker.error <= -frame_usec) {
+        /* Plays the previous frame again, or silence if the queue has
+         * no history left */
+        pa_memblockq_rewind(u->sink_memblockq, fs);
+        u->tracker.error += frame_usec;
+    }
+}
+
 /* Called from source I/O thread context. */
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
     struct userdata *u;
@@ -892,6 +1268,12 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     while (pa_asyncmsgq_process_one(u->asyncmsgq) > 0)
         ;
 
+    if (u->drift_tracking) {
+        u->tracker.near_end_index = pa_memblockq_get_write_index(u->source_memblockq);
+        u->tracker.near_end_time = pa_rtclock_now() - pa_source_get_latency_within_thread(o->source) -
+            pa_bytes_to_usec(chunk->length, &o->sample_spec);
+    }
+
     pa_memblockq_push_align(u->source_memblockq, chunk);
 
     rlen = pa_memblockq_get_length(u->source_memblockq);
@@ -901,8 +1283,13 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     if (rlen < u->source_output_blocksize)
         return;
 
-    /* See if we need to drop samples in order to sync */
-    if (pa_atomic_cmpxchg (&u->request_resync, 1, 0)) {
+    if (u->drift_tracking && !u->ec->params.drift_compensation)
+        track_drift(u);
+
+    /* See if we need to drop samples in order to sync. A follower can't
+     * safely talk to the leader's sink I/O thread from here, it is
+     * realigned from time_callback() instead. */
+    if (pa_atomic_cmpxchg (&u->request_resync, 1, 0) && !u->following) {
         do_resync(u);
     }
 
@@ -917,6 +1304,8 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
         to_skip -= to_skip % u->source_output_blocksize;
 
         if (to_skip) {
+            pipeline_flush(u);
+
             pa_memblockq_peek_fixed_size(u->source_memblockq, to_skip, &rchunk);
             pa_source_post(u->source, &rchunk);
 
@@ -953,7 +1342,8 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
 
 /* Called from sink I/O thread context. */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
-    struct userdata *u;
+    struct userdata *u, *f;
+    pa_usec_t play_time = 0;
 
     pa_sink_input_assert_ref(i);
     pa_assert(chunk);
@@ -964,16 +1354,33 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     pa_sink_render_full(u->sink, nbytes, chunk);
 
-    if (i->thread_info.underrun_for > 0) {
-        pa_log_debug("Handling end of underrun.");
-        pa_atomic_store(&u->request_resync, 1);
+    /* The chunk will be played after what is in the master sink and what
+     * our sink input has rendered already, see drift_tracking= */
+    if ((u->drift_tracking && !u->following) || u->thread_info.followers)
+        play_time = pa_rtclock_now() + pa_sink_get_latency_within_thread(i->sink) +
+            pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
+
+    /* A follower's own sink is played back, but it is not what its
+     * canceller listens to */
+    if (!u->following) {
+        if (i->thread_info.underrun_for > 0) {
+            pa_log_debug("Handling end of underrun.");
+            pa_atomic_store(&u->request_resync, 1);
+        }
+
+        /* let source thread handle the chunk. pass the sample count as well so that
+         * the source IO thread can update the right variables. */
+        pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_POST,
+            NULL, (int64_t) play_time, chunk, NULL);
+        u->send_counter += chunk->length;
     }
 
-    /* let source thread handle the chunk. pass the sample count as well so that
-     * the source IO thread can update the right variables. */
-    pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_POST,
-        NULL, 0, chunk, NULL);
-    u->send_counter += chunk->length;
+    /* The far-end is rendered once and handed to every follower */
+    PA_LLIST_FOREACH(f, u->thread_info.followers) {
+        pa_asyncmsgq_post(f->asyncmsgq, PA_MSGOBJECT(f->source_output), SOURCE_OUTPUT_MESSAGE_POST,
+            NULL, (int64_t) play_time, chunk, NULL);
+        f->send_counter += chunk->length;
+    }
 
     return 0;
 }
@@ -986,6 +1393,8 @@ static void source_output_process_rewind_cb(pa_source_output *o, size_t nbytes)
     pa_source_output_assert_io_context(o);
     pa_assert_se(u = o->userdata);
 
+    pipeline_flush(u);
+
     pa_source_process_rewind(u->source, nbytes);
 
     /* go back on read side, we need to use older sink data for this */
@@ -1000,7 +1409,7 @@ static void source_output_process_rewind_cb(pa_source_output *o, size_t nbytes)
 
 /* Called from sink I/O thread context. */
 static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
-    struct userdata *u;
+    struct userdata *u, *f;
 
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
@@ -1009,8 +1418,15 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
 
     pa_sink_process_rewind(u->sink, nbytes);
 
-    pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_REWIND, NULL, (int64_t) nbytes, NULL, NULL);
-    u->send_counter -= nbytes;
+    if (!u->following) {
+        pa_asyncmsgq_post(u->asyncmsgq, PA_MSGOBJECT(u->source_output), SOURCE_OUTPUT_MESSAGE_REWIND, NULL, (int64_t) nbytes, NULL, NULL);
+        u->send_counter -= nbytes;
+    }
+
+    PA_LLIST_FOREACH(f, u->thread_info.followers) {
+        pa_asyncmsgq_post(f->asyncmsgq, PA_MSGOBJECT(f->source_output), SOURCE_OUTPUT_MESSAGE_REWIND, NULL, (int64_t) nbytes, NULL, NULL);
+        f->send_counter -= nbytes;
+    }
 }
 
 /* Called from source I/O thread context. */
@@ -1044,9 +1460,14 @@ static int source_output_process_msg_cb(pa_msgobject *obj, int code, void *data,
 
             pa_source_output_assert_io_context(u->source_output);
 
-            if (u->source_output->source->thread_info.state == PA_SOURCE_RUNNING)
+            if (u->source_output->source->thread_info.state == PA_SOURCE_RUNNING) {
+                if (u->drift_tracking && offset > 0) {
+                    u->tracker.far_end_index = pa_memblockq_get_write_index(u->sink_memblockq);
+                    u->tracker.far_end_time = (pa_usec_t) offset;
+                }
+
                 pa_memblockq_push_align(u->sink_memblockq, chunk);
-            else
+            } else
                 pa_memblockq_flush_write(u->sink_memblockq, true);
 
             u->recv_counter += (int64_t) chunk->length;
@@ -1106,9 +1527,17 @@ static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, in
             snapshot->sink_now = now;
             snapshot->sink_latency = latency;
             snapshot->sink_delay = delay;
-            snapshot->send_counter = u->send_counter;
+            snapshot->send_counter = snapshot->owner->send_counter;
             return 0;
         }
+
+        case SINK_INPUT_MESSAGE_ADD_FOLLOWER:
+            PA_LLIST_PREPEND(struct userdata, u->thread_info.followers, (struct userdata *) data);
+            return 0;
+
+        case SINK_INPUT_MESSAGE_REMOVE_FOLLOWER:
+            PA_LLIST_REMOVE(struct userdata, u->thread_info.followers, (struct userdata *) data);
+            return 0;
     }
 
     return pa_sink_input_process_msg(obj, code, data, offset, chunk);
@@ -1254,6 +1683,21 @@ static void source_output_attach_cb(pa_source_output *o) {
             o->source->thread_info.rtpoll,
             PA_RTPOLL_LATE,
             u->asyncmsgq);
+
+    if (u->pipeline) {
+        struct pollfd *pollfd;
+
+        u->rtpoll_item_pipeline = pa_rtpoll_item_new(o->source->thread_info.rtpoll, PA_RTPOLL_NORMAL, 1);
+
+        pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item_pipeline, NULL);
+        pollfd->fd = pa_asyncq_read_fd(u->pipeline_out);
+        pollfd->events = POLLIN;
+
+        pa_rtpoll_item_set_work_callback(u->rtpoll_item_pipeline, pipeline_work_cb);
+        pa_rtpoll_item_set_before_callback(u->rtpoll_item_pipeline, pipeline_before_cb);
+        pa_rtpoll_item_set_after_callback(u->rtpoll_item_pipeline, pipeline_after_cb);
+        pa_rtpoll_item_set_userdata(u->rtpoll_item_pipeline, u);
+    }
 }
 
 /* Called from sink I/O thread context. */
@@ -1297,6 +1741,8 @@ static void source_output_detach_cb(pa_source_output *o) {
     pa_source_output_assert_io_context(o);
     pa_assert_se(u = o->userdata);
 
+    pipeline_flush(u);
+
     pa_source_detach_within_thread(u->source);
     pa_source_set_rtpoll(u->source, NULL);
 
@@ -1306,6 +1752,11 @@ static void source_output_detach_cb(pa_source_output *o) {
         pa_rtpoll_item_free(u->rtpoll_item_read);
         u->rtpoll_item_read = NULL;
     }
+
+    if (u->rtpoll_item_pipeline) {
+        pa_rtpoll_item_free(u->rtpoll_item_pipeline);
+        u->rtpoll_item_pipeline = NULL;
+    }
 }
 
 /* Called from sink I/O thread context. */
@@ -1365,6 +1816,9 @@ static void source_output_kill_cb(pa_source_output *o) {
 
     u->dead = true;
 
+    /* The leader must stop posting to our source output first */
+    far_end_detach(u);
+
     /* The order here matters! We first kill the source output, followed
      * by the source. That means the source callbacks must be protected
      * against an unconnected source output! */
@@ -1552,21 +2006,28 @@ static int canceller_process_msg_cb(pa_msgobject *o, int code, void *userdata, i
     return 0;
 }
 
-/* Called by the canceller, so source I/O thread context. */
+/* Called by the canceller, so source I/O thread context, or the pipeline
+ * thread in pipelined mode. */
 pa_volume_t pa_echo_canceller_get_capture_volume(pa_echo_canceller *ec) {
 #ifndef ECHO_CANCEL_TEST
-    return pa_cvolume_avg(&ec->msg->userdata->thread_info.current_volume);
+    return (pa_volume_t) pa_atomic_load(&ec->msg->userdata->capture_volume);
 #else
     return PA_VOLUME_NORM;
 #endif
 }
 
-/* Called by the canceller, so source I/O thread context. */
+/* Called by the canceller, so source I/O thread context, or the pipeline
+ * thread in pipelined mode. */
 void pa_echo_canceller_set_capture_volume(pa_echo_canceller *ec, pa_volume_t v) {
 #ifndef ECHO_CANCEL_TEST
-    if (pa_cvolume_avg(&ec->msg->userdata->thread_info.current_volume) != v) {
-        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(ec->msg), ECHO_CANCELLER_MESSAGE_SET_VOLUME, PA_UINT_TO_PTR(v),
-                0, NULL, NULL);
+    struct userdata *u = ec->msg->userdata;
+
+    if ((pa_volume_t) pa_atomic_load(&u->capture_volume) != v) {
+        if (u->pipeline)
+            pa_atomic_store(&u->pending_capture_volume, (int) v);
+        else
+            pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(ec->msg), ECHO_CANCELLER_MESSAGE_SET_VOLUME, PA_UINT_TO_PTR(v),
+                    0, NULL, NULL);
     }
 #endif
 }
@@ -1652,6 +2113,8 @@ int pa__init(pa_module*m) {
     pa_modargs *ma;
     pa_source *source_master=NULL;
     pa_sink *sink_master=NULL;
+    pa_sink *far_end_sink = NULL;
+    const char *far_end_name;
     bool autoloaded;
     pa_source_output_new_data source_output_data;
     pa_sink_input_new_data sink_input_data;
@@ -1687,6 +2150,19 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if ((far_end_name = pa_modargs_get_value(ma, "far_end", NULL))) {
+        if (!(far_end_sink = pa_namereg_get(m->core, far_end_name, PA_NAMEREG_SINK)) ||
+            far_end_sink->parent.process_msg != sink_process_msg_cb) {
+            pa_log("far_end= must name the sink of another echo canceller");
+            goto fail;
+        }
+
+        if (((struct userdata *) far_end_sink->userdata)->following) {
+            pa_log("The far-end of '%s' is shared from another echo canceller already", far_end_name);
+            goto fail;
+        }
+    }
+
     /* Set to true if we just want to inherit sample spec and channel map from the sink and source master */
     use_master_format = DEFAULT_USE_MASTER_FORMAT;
     if (pa_modargs_get_value_boolean(ma, "use_master_format", &use_master_format) < 0) {
@@ -1721,6 +2197,7 @@ int pa__init(pa_module*m) {
     u->module = m;
     m->userdata = u;
     u->dead = false;
+    u->following = !!far_end_sink;
 
     u->use_volume_sharing = true;
     if (pa_modargs_get_value_boolean(ma, "use_volume_sharing", &u->use_volume_sharing) < 0) {
@@ -1797,6 +2274,40 @@ int pa__init(pa_module*m) {
     if (u->ec->params.drift_compensation)
         pa_assert(u->ec->set_drift);
 
+    if (u->following) {
+        /* The played data is handed to us as is */
+        if (!pa_sample_spec_equal(&sink_ss, &far_end_sink->sample_spec)) {
+            pa_log("The sample spec of the sink must match the one of far_end=");
+            goto fail;
+        }
+
+        /* Drift compensation needs do_resync(), which we can't do */
+        if (u->ec->params.drift_compensation) {
+            pa_log("far_end= is not supported with drift compensation");
+            goto fail;
+        }
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "pipeline", &u->pipeline) < 0) {
+        pa_log("Failed to parse pipeline value");
+        goto fail;
+    }
+
+    if (u->pipeline && u->ec->params.drift_compensation) {
+        pa_log_warn("Pipelined cancellation is not supported with drift compensation, disabling.");
+        u->pipeline = false;
+    }
+
+    if (u->pipeline) {
+        u->pipeline_in = pa_asyncq_new(0);
+        u->pipeline_out = pa_asyncq_new(0);
+
+        if (!(u->pipeline_thread = pa_thread_new("echo-cancel", pipeline_thread_func, u))) {
+            pa_log("Failed to create pipeline thread.");
+            goto fail;
+        }
+    }
+
     /* Create source */
     pa_source_new_data_init(&source_data);
     source_data.driver = __FILE__;
@@ -1991,7 +2502,23 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
-    if (u->adjust_time > 0 && !u->ec->params.drift_compensation)
+    if (pa_memblockq_enable_ring(u->source_memblockq, MEMBLOCKQ_RING_BLOCKS * u->source_output_blocksize) < 0 ||
+        pa_memblockq_enable_ring(u->sink_memblockq, MEMBLOCKQ_RING_BLOCKS * u->sink_blocksize) < 0)
+        pa_log_debug("Not using rings for the memblockqs.");
+
+    u->drift_tracking = DEFAULT_DRIFT_TRACKING;
+    if (pa_modargs_get_value_boolean(ma, "drift_tracking", &u->drift_tracking) < 0) {
+        pa_log("Failed to parse drift_tracking value");
+        goto fail;
+    }
+
+    u->tracker.far_end_ss = sink_ss;
+
+    if (u->drift_tracking && !u->ec->params.drift_compensation) {
+        /* Align once at start, the tracker takes over from there */
+        u->adjust_time = 0;
+        pa_atomic_store(&u->request_resync, 1);
+    } else if (u->adjust_time > 0 && !u->ec->params.drift_compensation)
         u->time_event = pa_core_rttime_new(m->core, pa_rtclock_now() + u->adjust_time, time_callback, u);
     else if (u->ec->params.drift_compensation) {
         pa_log_info("Canceller does drift compensation -- built-in compensation will be disabled");
@@ -2023,6 +2550,8 @@ int pa__init(pa_module*m) {
     u->ec->msg->userdata = u;
 
     u->thread_info.current_volume = u->source->reference_volume;
+    pa_atomic_store(&u->capture_volume, (int) pa_cvolume_avg(&u->thread_info.current_volume));
+    pa_atomic_store(&u->pending_capture_volume, (int) PA_VOLUME_INVALID);
 
     /* We don't want to deal with too many chunks at a time */
     blocksize_usec = pa_bytes_to_usec(u->source_blocksize, &u->source->sample_spec);
@@ -2038,6 +2567,10 @@ int pa__init(pa_module*m) {
 
     pa_sink_input_put(u->sink_input);
     pa_source_output_put(u->source_output);
+
+    if (u->following)
+        far_end_attach(u, far_end_sink->userdata);
+
     pa_modargs_free(ma);
 
     return 0;
@@ -2072,6 +2605,20 @@ void pa__done(pa_module*m) {
 
     u->dead = true;
 
+    far_end_detach(u);
+
+    /* Whoever shares our played data has nothing to cancel anymore */
+    if (u->followers) {
+        struct userdata *f;
+
+        while ((f = pa_idxset_first(u->followers, NULL))) {
+            far_end_detach(f);
+            pa_module_unload_request(f->module, true);
+        }
+
+        pa_idxset_free(u->followers, NULL);
+    }
+
     /* See comments in source_output_kill_cb() above regarding
      * destruction order! */
 
@@ -2103,6 +2650,17 @@ void pa__done(pa_module*m) {
     if (u->sink_memblockq)
         pa_memblockq_free(u->sink_memblockq);
 
+    if (u->pipeline_thread) {
+        pa_assert_se(pa_asyncq_push(u->pipeline_in, u, true) == 0);
+        pa_thread_free(u->pipeline_thread);
+    }
+
+    /* Unlinking the source output flushed the pipeline */
+    if (u->pipeline_in)
+        pa_asyncq_free(u->pipeline_in, NULL);
+    if (u->pipeline_out)
+        pa_asyncq_free(u->pipeline_out, NULL);
+
     if (u->ec) {
         if (u->ec->done)
             u->ec->done(u->ec);
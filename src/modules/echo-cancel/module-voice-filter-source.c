@@ -0,0 +1,530 @@
+/***
+    This file is part of PulseAudio.
+
+    PulseAudio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 2.1 of the License,
+    or (at your option) any later version.
+
+    PulseAudio is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Noise suppression, AGC and voice activity detection for a capture
+ * device, with the speex preprocessor that module-echo-cancel runs after
+ * its canceller, but without the canceller and the sink it needs. When
+ * VAD is enabled, blocks without voice are replaced with silence once
+ * the hangover time has passed. Silence blocks are recognized as such
+ * downstream, so resamplers and the streams' memblockqs don't process
+ * them at all. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/i18n.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/namereg.h>
+#include <pulsecore/module.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/log.h>
+#include <pulsecore/sample-util.h>
+
+#include "echo-cancel.h"
+
+#include "module-voice-filter-source-symdef.h"
+
+PA_MODULE_DESCRIPTION("Noise suppression, AGC and voice activity detection for a source");
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(false);
+PA_MODULE_USAGE(
+        _("source_name=<name for the source> "
+          "source_properties=<properties for the source> "
+          "source_master=<name of source to filter> "
+          "rate=<sample rate> "
+          "pp_args=<arguments for the preprocessor: frame_size_ms, agc, denoise, vad> "
+          "vad_hangover_msec=<how long to keep passing audio after voice stops> "
+          "autoloaded=<set if this module is being loaded automatically> "
+        ));
+
+#define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
+#define DEFAULT_VAD_HANGOVER_MSEC 300
+#define DEFAULT_AUTOLOADED false
+
+struct userdata {
+    pa_core *core;
+    pa_module *module;
+
+    bool autoloaded;
+    bool auto_desc;
+
+    pa_source *source;
+    pa_source_output *source_output;
+
+    /* Collects the master's data into blocks of blocksize */
+    pa_memblockq *memblockq;
+    size_t blocksize;
+
+    pa_echo_canceller *pp;
+
+    /* How much audio without voice we have seen, and how much of it we
+     * let through before gating */
+    size_t quiet_bytes;
+    size_t hangover_bytes;
+};
+
+static const char* const valid_modargs[] = {
+    "source_name",
+    "source_properties",
+    "source_master",
+    "rate",
+    "pp_args",
+    "vad_hangover_msec",
+    "autoloaded",
+    NULL
+};
+
+/* The speex code takes the block size from us, like from
+ * module-echo-cancel */
+uint32_t pa_echo_canceller_blocksize_power2(unsigned rate, unsigned ms) {
+    unsigned nframes = (rate * ms) / 1000;
+    uint32_t y = 1 << ((8 * sizeof(uint32_t)) - 2);
+
+    pa_assert(rate >= 4000);
+    pa_assert(ms >= 1);
+
+    /* nframes should be a power of 2, round down to nearest power of two */
+    while (y > nframes)
+        y >>= 1;
+
+    pa_assert(y >= 1);
+    return y;
+}
+
+/* Called from I/O thread context */
+static int source_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = PA_SOURCE(o)->userdata;
+
+    switch (code) {
+
+        case PA_SOURCE_MESSAGE_GET_LATENCY:
+
+            /* The source is _put() before the source output is, so let's
+             * make sure we don't access it in that time. Also, the
+             * source output is first shut down, the source second. */
+            if (!PA_SOURCE_IS_LINKED(u->source->thread_info.state) ||
+                !PA_SOURCE_OUTPUT_IS_LINKED(u->source_output->thread_info.state)) {
+                *((pa_usec_t*) data) = 0;
+                return 0;
+            }
+
+            *((pa_usec_t*) data) =
+
+                /* Get the latency of the master source */
+                pa_source_get_latency_within_thread(u->source_output->source) +
+
+                /* Add the latency internal to our source output on top */
+                pa_bytes_to_usec(pa_memblockq_get_length(u->source_output->thread_info.delay_memblockq), &u->source_output->source->sample_spec) +
+
+                /* And what we are holding back for a full block */
+                pa_bytes_to_usec(pa_memblockq_get_length(u->memblockq), &u->source->sample_spec);
+
+            return 0;
+    }
+
+    return pa_source_process_msg(o, code, data, offset, chunk);
+}
+
+/* Called from main context */
+static int source_set_state_cb(pa_source *s, pa_source_state_t state) {
+    struct userdata *u;
+
+    pa_source_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SOURCE_IS_LINKED(state) ||
+        !PA_SOURCE_OUTPUT_IS_LINKED(pa_source_output_get_state(u->source_output)))
+        return 0;
+
+    pa_source_output_cork(u->source_output, state == PA_SOURCE_SUSPENDED);
+    return 0;
+}
+
+/* Called from I/O thread context */
+static void source_update_requested_latency_cb(pa_source *s) {
+    struct userdata *u;
+
+    pa_source_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SOURCE_IS_LINKED(u->source->thread_info.state) ||
+        !PA_SOURCE_OUTPUT_IS_LINKED(u->source_output->thread_info.state))
+        return;
+
+    /* Just hand this one over to the master source */
+    pa_source_output_set_requested_latency_within_thread(
+            u->source_output,
+            pa_source_get_requested_latency_within_thread(s));
+}
+
+/* Called from main context */
+static void source_set_mute_cb(pa_source *s) {
+    struct userdata *u;
+
+    pa_source_assert_ref(s);
+    pa_assert_se(u = s->userdata);
+
+    if (!PA_SOURCE_IS_LINKED(pa_source_get_state(s)) ||
+        !PA_SOURCE_OUTPUT_IS_LINKED(pa_source_output_get_state(u->source_output)))
+        return;
+
+    pa_source_output_set_mute(u->source_output, s->muted, s->save_muted);
+}
+
+/* Called from I/O thread context */
+static void post_silence(struct userdata *u, size_t length) {
+    pa_memchunk silence;
+
+    while (length > 0) {
+        pa_silence_memchunk_get(&u->core->silence_cache, u->core->mempool, &silence, &u->source->sample_spec, length);
+
+        pa_source_post(u->source, &silence);
+        length -= silence.length;
+
+        pa_memblock_unref(silence.memblock);
+    }
+}
+
+/* Called from I/O thread context */
+static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
+    struct userdata *u;
+
+    pa_source_output_assert_ref(o);
+    pa_source_output_assert_io_context(o);
+    pa_assert_se(u = o->userdata);
+
+    if (!PA_SOURCE_IS_LINKED(u->source->thread_info.state))
+        return;
+
+    pa_memblockq_push_align(u->memblockq, chunk);
+
+    while (pa_memblockq_get_length(u->memblockq) >= u->blocksize) {
+        pa_memchunk in, out;
+        void *src, *dst;
+        bool voice;
+
+        pa_assert_se(pa_memblockq_peek_fixed_size(u->memblockq, u->blocksize, &in) >= 0);
+
+        /* The preprocessor works in place, and the master's block
+         * may be shared */
+        out.memblock = pa_memblock_new(u->core->mempool, u->blocksize);
+        out.index = 0;
+        out.length = u->blocksize;
+
+        src = pa_memblock_acquire_chunk(&in);
+        dst = pa_memblock_acquire(out.memblock);
+        memcpy(dst, src, u->blocksize);
+        pa_memblock_release(in.memblock);
+
+        voice = pa_speex_pp_run(u->pp, dst);
+        pa_memblock_release(out.memblock);
+
+        pa_memblock_unref(in.memblock);
+        pa_memblockq_drop(u->memblockq, u->blocksize);
+
+        if (voice)
+            u->quiet_bytes = 0;
+        else if (u->quiet_bytes <= u->hangover_bytes)
+            u->quiet_bytes += u->blocksize;
+
+        if (u->quiet_bytes > u->hangover_bytes)
+            post_silence(u, u->blocksize);
+        else
+            pa_source_post(u->source, &out);
+
+        pa_memblock_unref(out.memblock);
+    }
+}
+
+/* Called from I/O thread context */
+static void source_output_attach_cb(pa_source_output *o) {
+    struct userdata *u;
+
+    pa_source_output_assert_ref(o);
+    pa_source_output_assert_io_context(o);
+    pa_assert_se(u = o->userdata);
+
+    pa_source_set_rtpoll(u->source, o->source->thread_info.rtpoll);
+    pa_source_set_latency_range_within_thread(u->source, o->source->thread_info.min_latency, o->source->thread_info.max_latency);
+    pa_source_set_fixed_latency_within_thread(u->source, o->source->thread_info.fixed_latency);
+    pa_source_set_max_rewind_within_thread(u->source, pa_source_output_get_max_rewind(o));
+
+    pa_source_attach_within_thread(u->source);
+}
+
+/* Called from I/O thread context */
+static void source_output_detach_cb(pa_source_output *o) {
+    struct userdata *u;
+
+    pa_source_output_assert_ref(o);
+    pa_source_output_assert_io_context(o);
+    pa_assert_se(u = o->userdata);
+
+    pa_source_detach_within_thread(u->source);
+    pa_source_set_rtpoll(u->source, NULL);
+}
+
+/* Called from main thread */
+static void source_output_kill_cb(pa_source_output *o) {
+    struct userdata *u;
+
+    pa_source_output_assert_ref(o);
+    pa_assert_ctl_context();
+    pa_assert_se(u = o->userdata);
+
+    /* The order here matters! We first kill the source output, followed
+     * by the source. That means the source callbacks must be protected
+     * against an unconnected source output! */
+    pa_source_output_unlink(u->source_output);
+    pa_source_unlink(u->source);
+
+    pa_source_output_unref(u->source_output);
+    u->source_output = NULL;
+
+    pa_source_unref(u->source);
+    u->source = NULL;
+
+    pa_module_unload_request(u->module, true);
+}
+
+/* Called from main thread */
+static void source_output_moving_cb(pa_source_output *o, pa_source *dest) {
+    struct userdata *u;
+
+    pa_source_output_assert_ref(o);
+    pa_assert_ctl_context();
+    pa_assert_se(u = o->userdata);
+
+    if (dest) {
+        pa_source_set_asyncmsgq(u->source, dest->asyncmsgq);
+        pa_source_update_flags(u->source, PA_SOURCE_LATENCY|PA_SOURCE_DYNAMIC_LATENCY, dest->flags);
+    } else
+        pa_source_set_asyncmsgq(u->source, NULL);
+
+    if (u->auto_desc && dest) {
+        const char *z;
+        pa_proplist *pl;
+
+        pl = pa_proplist_new();
+        z = pa_proplist_gets(dest->proplist, PA_PROP_DEVICE_DESCRIPTION);
+        pa_proplist_setf(pl, PA_PROP_DEVICE_DESCRIPTION, "Voice Filtered %s", z ? z : dest->name);
+
+        pa_source_update_proplist(u->source, PA_UPDATE_REPLACE, pl);
+        pa_proplist_free(pl);
+    }
+}
+
+int pa__init(pa_module*m) {
+    struct userdata *u;
+    pa_sample_spec ss;
+    pa_channel_map map;
+    pa_modargs *ma;
+    pa_source *master;
+    pa_source_output_new_data source_output_data;
+    pa_source_new_data source_data;
+    pa_memchunk silence;
+    uint32_t nframes = 0, hangover_msec;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments.");
+        goto fail;
+    }
+
+    if (!(master = pa_namereg_get(m->core, pa_modargs_get_value(ma, "source_master", NULL), PA_NAMEREG_SOURCE))) {
+        pa_log("Master source not found");
+        goto fail;
+    }
+
+    /* The preprocessor only does mono */
+    ss = master->sample_spec;
+    ss.channels = 1;
+    if (pa_modargs_get_value_u32(ma, "rate", &ss.rate) < 0 || !pa_sample_rate_valid(ss.rate)) {
+        pa_log("Invalid rate specification");
+        goto fail;
+    }
+    pa_channel_map_init_mono(&map);
+
+    hangover_msec = DEFAULT_VAD_HANGOVER_MSEC;
+    if (pa_modargs_get_value_u32(ma, "vad_hangover_msec", &hangover_msec) < 0) {
+        pa_log("Invalid vad_hangover_msec specification");
+        goto fail;
+    }
+
+    u = pa_xnew0(struct userdata, 1);
+    u->core = m->core;
+    u->module = m;
+    m->userdata = u;
+
+    u->autoloaded = DEFAULT_AUTOLOADED;
+    if (pa_modargs_get_value_boolean(ma, "autoloaded", &u->autoloaded) < 0) {
+        pa_log("Failed to parse autoloaded value");
+        goto fail;
+    }
+
+    u->pp = pa_xnew0(pa_echo_canceller, 1);
+    if (!pa_speex_pp_init(m->core, u->pp, &ss, &nframes, pa_modargs_get_value(ma, "pp_args", NULL))) {
+        pa_log("Failed to init the speex preprocessor");
+        goto fail;
+    }
+
+    u->blocksize = nframes * pa_frame_size(&ss);
+    u->hangover_bytes = pa_usec_to_bytes(hangover_msec * PA_USEC_PER_MSEC, &ss);
+
+    pa_silence_memchunk_get(&m->core->silence_cache, m->core->mempool, &silence, &ss, 0);
+    u->memblockq = pa_memblockq_new("module-voice-filter-source memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0, &ss, 1, 1, 0, &silence);
+    pa_memblock_unref(silence.memblock);
+
+    /* Create source */
+    pa_source_new_data_init(&source_data);
+    source_data.driver = __FILE__;
+    source_data.module = m;
+    if (!(source_data.name = pa_xstrdup(pa_modargs_get_value(ma, "source_name", NULL))))
+        source_data.name = pa_sprintf_malloc("%s.voice-filter", master->name);
+    pa_source_new_data_set_sample_spec(&source_data, &ss);
+    pa_source_new_data_set_channel_map(&source_data, &map);
+    pa_proplist_sets(source_data.proplist, PA_PROP_DEVICE_MASTER_DEVICE, master->name);
+    pa_proplist_sets(source_data.proplist, PA_PROP_DEVICE_CLASS, "filter");
+    if (!u->autoloaded)
+        pa_proplist_sets(source_data.proplist, PA_PROP_DEVICE_INTENDED_ROLES, "phone");
+
+    if (pa_modargs_get_proplist(ma, "source_properties", source_data.proplist, PA_UPDATE_REPLACE) < 0) {
+        pa_log("Invalid properties");
+        pa_source_new_data_done(&source_data);
+        goto fail;
+    }
+
+    if ((u->auto_desc = !pa_proplist_contains(source_data.proplist, PA_PROP_DEVICE_DESCRIPTION))) {
+        const char *z;
+
+        z = pa_proplist_gets(master->proplist, PA_PROP_DEVICE_DESCRIPTION);
+        pa_proplist_setf(source_data.proplist, PA_PROP_DEVICE_DESCRIPTION, "Voice Filtered %s", z ? z : master->name);
+    }
+
+    u->source = pa_source_new(m->core, &source_data, (master->flags & (PA_SOURCE_LATENCY|PA_SOURCE_DYNAMIC_LATENCY))
+                                                     | PA_SOURCE_SHARE_VOLUME_WITH_MASTER);
+    pa_source_new_data_done(&source_data);
+
+    if (!u->source) {
+        pa_log("Failed to create source.");
+        goto fail;
+    }
+
+    u->source->parent.process_msg = source_process_msg_cb;
+    u->source->set_state = source_set_state_cb;
+    u->source->update_requested_latency = source_update_requested_latency_cb;
+    pa_source_set_set_mute_callback(u->source, source_set_mute_cb);
+    u->source->userdata = u;
+
+    pa_source_set_asyncmsgq(u->source, master->asyncmsgq);
+
+    /* Create source output */
+    pa_source_output_new_data_init(&source_output_data);
+    source_output_data.driver = __FILE__;
+    source_output_data.module = m;
+    pa_source_output_new_data_set_source(&source_output_data, master, false);
+    source_output_data.destination_source = u->source;
+
+    pa_proplist_sets(source_output_data.proplist, PA_PROP_MEDIA_NAME, "Voice Filter Source Stream");
+    pa_proplist_sets(source_output_data.proplist, PA_PROP_MEDIA_ROLE, "filter");
+    pa_source_output_new_data_set_sample_spec(&source_output_data, &ss);
+    pa_source_output_new_data_set_channel_map(&source_output_data, &map);
+
+    if (u->autoloaded)
+        source_output_data.flags |= PA_SOURCE_OUTPUT_DONT_MOVE;
+
+    pa_source_output_new(&u->source_output, m->core, &source_output_data);
+    pa_source_output_new_data_done(&source_output_data);
+
+    if (!u->source_output)
+        goto fail;
+
+    u->source_output->push = source_output_push_cb;
+    u->source_output->kill = source_output_kill_cb;
+    u->source_output->attach = source_output_attach_cb;
+    u->source_output->detach = source_output_detach_cb;
+    u->source_output->moving = source_output_moving_cb;
+    u->source_output->userdata = u;
+
+    u->source->output_from_master = u->source_output;
+
+    pa_source_put(u->source);
+    pa_source_output_put(u->source_output);
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    if (ma)
+        pa_modargs_free(ma);
+
+    pa__done(m);
+
+    return -1;
+}
+
+int pa__get_n_used(pa_module *m) {
+    struct userdata *u;
+
+    pa_assert(m);
+    pa_assert_se(u = m->userdata);
+
+    return pa_source_linked_by(u->source);
+}
+
+void pa__done(pa_module*m) {
+    struct userdata *u;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    /* See comments in source_output_kill_cb() above regarding
+     * destruction order! */
+
+    if (u->source_output)
+        pa_source_output_unlink(u->source_output);
+
+    if (u->source)
+        pa_source_unlink(u->source);
+
+    if (u->source_output)
+        pa_source_output_unref(u->source_output);
+
+    if (u->source)
+        pa_source_unref(u->source);
+
+    if (u->memblockq)
+        pa_memblockq_free(u->memblockq);
+
+    if (u->pp) {
+        pa_speex_ec_done(u->pp);
+        pa_xfree(u->pp);
+    }
+
+    pa_xfree(u);
+}
@@ -35,6 +35,7 @@
 #define DEFAULT_DENOISE_ENABLED true
 #define DEFAULT_ECHO_SUPPRESS_ENABLED true
 #define DEFAULT_ECHO_SUPPRESS_ATTENUATION 0
+#define DEFAULT_VAD_ENABLED false
 
 static const char* const valid_modargs[] = {
     "frame_size_ms",
@@ -47,6 +48,15 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
+/* For the preprocessor on its own there's no echo to suppress */
+static const char* const valid_pp_modargs[] = {
+    "frame_size_ms",
+    "agc",
+    "denoise",
+    "vad",
+    NULL
+};
+
 static void speex_ec_fixate_spec(pa_sample_spec *rec_ss, pa_channel_map *rec_map,
                                  pa_sample_spec *play_ss, pa_channel_map *play_map,
                                  pa_sample_spec *out_ss, pa_channel_map *out_map) {
@@ -61,6 +71,7 @@ static void speex_ec_fixate_spec(pa_sample_spec *rec_ss, pa_channel_map *rec_map
 static bool pa_speex_ec_preprocessor_init(pa_echo_canceller *ec, pa_sample_spec *out_ss, uint32_t nframes, pa_modargs *ma) {
     bool agc;
     bool denoise;
+    bool vad;
     bool echo_suppress;
     int32_t echo_suppress_attenuation;
     int32_t echo_suppress_attenuation_active;
@@ -77,7 +88,13 @@ static bool pa_speex_ec_preprocessor_init(pa_echo_canceller *ec, pa_sample_spec
         goto fail;
     }
 
-    echo_suppress = DEFAULT_ECHO_SUPPRESS_ENABLED;
+    vad = DEFAULT_VAD_ENABLED;
+    if (pa_modargs_get_value_boolean(ma, "vad", &vad) < 0) {
+        pa_log("Failed to parse vad value");
+        goto fail;
+    }
+
+    echo_suppress = ec->params.speex.state ? DEFAULT_ECHO_SUPPRESS_ENABLED : false;
     if (pa_modargs_get_value_boolean(ma, "echo_suppress", &echo_suppress) < 0) {
         pa_log("Failed to parse echo_suppress value");
         goto fail;
@@ -103,7 +120,7 @@ static bool pa_speex_ec_preprocessor_init(pa_echo_canceller *ec, pa_sample_spec
         goto fail;
     }
 
-    if (agc || denoise || echo_suppress) {
+    if (agc || denoise || vad || echo_suppress) {
         spx_int32_t tmp;
 
         if (out_ss->channels != 1) {
@@ -119,6 +136,9 @@ static bool pa_speex_ec_preprocessor_init(pa_echo_canceller *ec, pa_sample_spec
         tmp = denoise;
         speex_preprocess_ctl(ec->params.speex.pp_state, SPEEX_PREPROCESS_SET_DENOISE, &tmp);
 
+        tmp = vad;
+        speex_preprocess_ctl(ec->params.speex.pp_state, SPEEX_PREPROCESS_SET_VAD, &tmp);
+
         if (echo_suppress) {
             if (echo_suppress_attenuation)
                 speex_preprocess_ctl(ec->params.speex.pp_state, SPEEX_PREPROCESS_SET_ECHO_SUPPRESS,
@@ -133,8 +153,8 @@ static bool pa_speex_ec_preprocessor_init(pa_echo_canceller *ec, pa_sample_spec
                                  ec->params.speex.state);
         }
 
-        pa_log_info("Loaded speex preprocessor with params: agc=%s, denoise=%s, echo_suppress=%s", pa_yes_no(agc),
-                    pa_yes_no(denoise), pa_yes_no(echo_suppress));
+        pa_log_info("Loaded speex preprocessor with params: agc=%s, denoise=%s, vad=%s, echo_suppress=%s", pa_yes_no(agc),
+                    pa_yes_no(denoise), pa_yes_no(vad), pa_yes_no(echo_suppress));
     } else
         pa_log_info("All preprocessing options are disabled");
 
@@ -223,3 +243,44 @@ void pa_speex_ec_done(pa_echo_canceller *ec) {
         ec->params.speex.state = NULL;
     }
 }
+
+bool pa_speex_pp_init(pa_core *c, pa_echo_canceller *ec, pa_sample_spec *ss, uint32_t *nframes, const char *args) {
+    uint32_t frame_size_ms;
+    pa_modargs *ma;
+
+    if (!(ma = pa_modargs_new(args, valid_pp_modargs))) {
+        pa_log("Failed to parse preprocessor arguments.");
+        goto fail;
+    }
+
+    frame_size_ms = DEFAULT_FRAME_SIZE_MS;
+    if (pa_modargs_get_value_u32(ma, "frame_size_ms", &frame_size_ms) < 0 || frame_size_ms < 1 || frame_size_ms > 200) {
+        pa_log("Invalid frame_size_ms specification");
+        goto fail;
+    }
+
+    ss->format = PA_SAMPLE_S16NE;
+    *nframes = pa_echo_canceller_blocksize_power2(ss->rate, frame_size_ms);
+
+    pa_log_debug("Using nframes %d, channels %d, rate %d", *nframes, ss->channels, ss->rate);
+
+    if (!pa_speex_ec_preprocessor_init(ec, ss, *nframes, ma))
+        goto fail;
+
+    pa_modargs_free(ma);
+    return true;
+
+fail:
+    if (ma)
+        pa_modargs_free(ma);
+    pa_speex_ec_done(ec);
+    return false;
+}
+
+bool pa_speex_pp_run(pa_echo_canceller *ec, uint8_t *data) {
+    if (!ec->params.speex.pp_state)
+        return true;
+
+    /* Without VAD this always says there's voice */
+    return speex_preprocess_run(ec->params.speex.pp_state, (spx_int16_t *) data) != 0;
+}
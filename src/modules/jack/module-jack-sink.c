@@ -40,6 +40,9 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/ringbuffer.h>
 
 #include "module-jack-sink-symdef.h"
 
@@ -49,13 +52,20 @@
  * doesn't allow us to add our own event sources to the event thread
  * we cannot use the JACK real-time thread for dispatching our PA
  * work. Instead, we run an additional RT thread which does most of
- * the PA handling, and have the JACK RT thread request data from it
- * via pa_asyncmsgq. The cost is an additional context switch which
- * should hopefully not be that expensive if RT scheduling is
- * enabled. A better fix would only be possible with additional event
- * source support in JACK.
+ * the PA handling. It renders ahead into a lock-free ring buffer,
+ * which the JACK RT thread reads from without ever waiting for us.
+ * After each cycle the JACK thread kicks ours through an fdsem, so
+ * that we top the ring buffer up again, which makes JACK's cycles
+ * our clock.
  */
 
+/* How many JACK periods we render ahead */
+#define RING_PERIODS 2
+
+/* Upper limit for the ring buffer size, the JACK period times
+ * RING_PERIODS is capped to that */
+#define RING_FRAMES_MAX (16*1024)
+
 PA_MODULE_AUTHOR("Lennart Poettering");
 PA_MODULE_DESCRIPTION("JACK Sink");
 PA_MODULE_LOAD_ONCE(false);
@@ -81,8 +91,6 @@ struct userdata {
     jack_port_t* port[PA_CHANNELS_MAX];
     jack_client_t *client;
 
-    void *buffer[PA_CHANNELS_MAX];
-
     pa_thread_mq thread_mq;
     pa_asyncmsgq *jack_msgq;
     pa_rtpoll *rtpoll;
@@ -90,9 +98,22 @@ struct userdata {
 
     pa_thread *thread;
 
-    jack_nframes_t frames_in_buffer;
-    jack_nframes_t saved_frame_time;
-    bool saved_frame_time_valid;
+    size_t frame_size;
+
+    /* Written by our thread only, read by the JACK thread only */
+    pa_ringbuffer *ring;
+    pa_fdsem *ring_fdsem;
+    pa_rtpoll_item *ring_rtpoll_item;
+
+    /* Only accessed from our thread */
+    jack_nframes_t frames_written;
+
+    /* Written by the JACK thread */
+    pa_atomic_t frames_read;
+    pa_atomic_t period_frames;
+    pa_atomic_t cycle_frames;
+    pa_atomic_t cycle_frame_time;
+    pa_atomic_t cycle_valid;
 };
 
 static const char* const valid_modargs[] = {
@@ -107,8 +128,7 @@ static const char* const valid_modargs[] = {
 };
 
 enum {
-    SINK_MESSAGE_RENDER = PA_SINK_MESSAGE_MAX,
-    SINK_MESSAGE_BUFFER_SIZE,
+    SINK_MESSAGE_BUFFER_SIZE = PA_SINK_MESSAGE_MAX,
     SINK_MESSAGE_ON_SHUTDOWN
 };
 
@@ -117,45 +137,6 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 
     switch (code) {
 
-        case SINK_MESSAGE_RENDER:
-
-            /* Handle the request from the JACK thread */
-
-            if (u->sink->thread_info.state == PA_SINK_RUNNING) {
-                pa_memchunk chunk;
-                size_t nbytes;
-                void *p;
-
-                pa_assert(offset > 0);
-                nbytes = (size_t) offset * pa_frame_size(&u->sink->sample_spec);
-
-                pa_sink_render_full(u->sink, nbytes, &chunk);
-
-                p = pa_memblock_acquire_chunk(&chunk);
-                pa_deinterleave(p, u->buffer, u->channels, sizeof(float), (unsigned) offset);
-                pa_memblock_release(chunk.memblock);
-
-                pa_memblock_unref(chunk.memblock);
-            } else {
-                unsigned c;
-                pa_sample_spec ss;
-
-                /* Humm, we're not RUNNING, hence let's write some silence */
-                /* This can happen if we're paused, or during shutdown (when we're unlinked but jack is still running). */
-
-                ss = u->sink->sample_spec;
-                ss.channels = 1;
-
-                for (c = 0; c < u->channels; c++)
-                    pa_silence_memory(u->buffer[c], (size_t) offset * pa_sample_size(&ss), &ss);
-            }
-
-            u->frames_in_buffer = (jack_nframes_t) offset;
-            u->saved_frame_time = * (jack_nframes_t*) data;
-            u->saved_frame_time_valid = true;
-
-            return 0;
-
         case SINK_MESSAGE_BUFFER_SIZE:
             pa_sink_set_max_request_within_thread(u->sink, (size_t) offset * pa_frame_size(&u->sink->sample_spec));
             return 0;
@@ -169,16 +150,18 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             jack_latency_range_t r;
             size_t n;
 
-            /* This is the "worst-case" latency */
+            /* This is the "worst-case" latency: what the port adds,
+             * plus what is waiting in the ring buffer */
             jack_port_get_latency_range(u->port[0], JackPlaybackLatency, &r);
-            l = r.max + u->frames_in_buffer;
+            l = r.max + (u->frames_written - (jack_nframes_t) pa_atomic_load(&u->frames_read));
 
-            if (u->saved_frame_time_valid) {
-                /* Adjust the worst case latency by the time that
-                 * passed since we last handed data to JACK */
+            if (pa_atomic_load(&u->cycle_valid)) {
+                /* Plus what we handed to JACK in the last cycle,
+                 * minus the time that passed since then */
 
                 ft = jack_frame_time(u->client);
-                d = ft > u->saved_frame_time ? ft - u->saved_frame_time : 0;
+                d = ft - (jack_nframes_t) pa_atomic_load(&u->cycle_frame_time);
+                l += (jack_nframes_t) pa_atomic_load(&u->cycle_frames);
                 l = l > d ? l - d : 0;
             }
 
@@ -194,21 +177,95 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
     return pa_sink_process_msg(o, code, data, offset, memchunk);
 }
 
+/* Called from IO context */
+static void fill_ring(struct userdata *u) {
+    jack_nframes_t target;
+
+    target = PA_MIN(RING_PERIODS * (jack_nframes_t) pa_atomic_load(&u->period_frames), RING_FRAMES_MAX);
+
+    for (;;) {
+        jack_nframes_t fill;
+        pa_memchunk chunk;
+        void *p;
+        int count;
+        size_t n;
+
+        fill = u->frames_written - (jack_nframes_t) pa_atomic_load(&u->frames_read);
+
+        if (fill >= target)
+            break;
+
+        p = pa_ringbuffer_begin_write(u->ring, &count);
+        n = PA_MIN((size_t) (target - fill) * u->frame_size, (size_t) count);
+        n -= n % u->frame_size;
+
+        if (n <= 0)
+            break;
+
+        /* Render straight into the ring buffer */
+        chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, n, false);
+        chunk.index = 0;
+        chunk.length = n;
+
+        pa_sink_render_into_full(u->sink, &chunk);
+        pa_memblock_unref_fixed(chunk.memblock);
+
+        pa_ringbuffer_end_write(u->ring, (int) n);
+        u->frames_written += (jack_nframes_t) (n / u->frame_size);
+    }
+
+    pa_ringbuffer_commit_write(u->ring);
+}
+
 /* JACK Callback: This is called when JACK needs some data */
 static int jack_process(jack_nframes_t nframes, void *arg) {
     struct userdata *u = arg;
+    float *buffer[PA_CHANNELS_MAX];
+    jack_nframes_t done = 0;
     unsigned c;
-    jack_nframes_t frame_time;
-    pa_assert(u);
 
-    /* We just forward the request to our other RT thread */
+    pa_assert(u);
 
     for (c = 0; c < u->channels; c++)
-        pa_assert_se(u->buffer[c] = jack_port_get_buffer(u->port[c], nframes));
+        pa_assert_se(buffer[c] = jack_port_get_buffer(u->port[c], nframes));
+
+    /* Take whatever our thread rendered ahead, without waiting for it */
+    while (done < nframes) {
+        void *d[PA_CHANNELS_MAX];
+        const void *p;
+        jack_nframes_t n;
+        int count;
+
+        p = pa_ringbuffer_peek(u->ring, &count);
+        n = PA_MIN((jack_nframes_t) ((size_t) count / u->frame_size), nframes - done);
+
+        if (n <= 0)
+            break;
 
-    frame_time = jack_frame_time(u->client);
+        for (c = 0; c < u->channels; c++)
+            d[c] = buffer[c] + done;
+
+        pa_deinterleave(p, d, u->channels, sizeof(float), (unsigned) n);
+        pa_ringbuffer_drop(u->ring, (int) (n * u->frame_size));
+        done += n;
+    }
+
+    if (done > 0) {
+        pa_ringbuffer_commit_read(u->ring);
+        pa_atomic_add(&u->frames_read, (int) done);
+    }
+
+    /* Not RUNNING, or we didn't keep up: write silence */
+    if (done < nframes)
+        for (c = 0; c < u->channels; c++)
+            memset(buffer[c] + done, 0, (nframes - done) * sizeof(float));
+
+    pa_atomic_store(&u->cycle_frames, (int) nframes);
+    pa_atomic_store(&u->cycle_frame_time, (int) jack_frame_time(u->client));
+    pa_atomic_store(&u->cycle_valid, 1);
+
+    pa_fdsem_post(u->ring_fdsem);
 
-    pa_assert_se(pa_asyncmsgq_send(u->jack_msgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_RENDER, &frame_time, nframes, NULL) == 0);
     return 0;
 }
 
@@ -230,6 +287,11 @@ static void thread_func(void *userdata) {
         if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
             pa_sink_process_rewind(u->sink, 0);
 
+        /* If we aren't running, the JACK thread plays silence once it
+         * has used up what we rendered before */
+        if (u->sink->thread_info.state == PA_SINK_RUNNING)
+            fill_ring(u);
+
         if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
             goto fail;
 
@@ -279,6 +341,7 @@ static int jack_buffer_size(jack_nframes_t nframes, void *arg) {
     struct userdata *u = arg;
 
     pa_log_info("JACK buffer size changed.");
+    pa_atomic_store(&u->period_frames, (int) nframes);
     pa_asyncmsgq_post(u->jack_msgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_BUFFER_SIZE, NULL, nframes, NULL, NULL);
     return 0;
 }
@@ -318,7 +381,6 @@ int pa__init(pa_module*m) {
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->saved_frame_time_valid = false;
     u->rtpoll = pa_rtpoll_new();
 
     if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
@@ -333,12 +395,19 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
-    /* The msgq from the JACK RT thread should have an even higher
+    u->rtpoll_item = pa_rtpoll_item_new_asyncmsgq_read(u->rtpoll, PA_RTPOLL_EARLY, u->jack_msgq);
+
+    if (!(u->ring_fdsem = pa_fdsem_new())) {
+        pa_log("pa_fdsem_new() failed.");
+        goto fail;
+    }
+
+    /* The kicks from the JACK RT thread should have an even higher
      * priority than the normal message queues, to match the guarantee
      * all other drivers make: supplying the audio device with data is
      * the top priority -- and as long as that is possible we don't do
      * anything else */
-    u->rtpoll_item = pa_rtpoll_item_new_asyncmsgq_read(u->rtpoll, PA_RTPOLL_EARLY-1, u->jack_msgq);
+    u->ring_rtpoll_item = pa_rtpoll_item_new_fdsem(u->rtpoll, PA_RTPOLL_EARLY-1, u->ring_fdsem);
 
     if (!(u->client = jack_client_open(client_name, server_name ? JackServerName : JackNullOption, &status, server_name))) {
         pa_log("jack_client_open() failed.");
@@ -379,6 +448,10 @@ int pa__init(pa_module*m) {
 
     pa_assert(pa_sample_spec_valid(&ss));
 
+    u->frame_size = pa_frame_size(&ss);
+    u->ring = pa_ringbuffer_new((int) (RING_FRAMES_MAX * u->frame_size));
+    pa_atomic_store(&u->period_frames, (int) jack_get_buffer_size(u->client));
+
     for (i = 0; i < ss.channels; i++) {
         if (!(u->port[i] = jack_port_register(u->client, pa_channel_position_to_string(map.map[i]), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput|JackPortIsTerminal, 0))) {
             pa_log("jack_port_register() failed.");
@@ -452,7 +525,7 @@ int pa__init(pa_module*m) {
     }
 
     jack_port_get_latency_range(u->port[0], JackPlaybackLatency, &r);
-    n = r.max * pa_frame_size(&u->sink->sample_spec);
+    n = (r.max + RING_PERIODS * jack_get_buffer_size(u->client)) * pa_frame_size(&u->sink->sample_spec);
     pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(n, &u->sink->sample_spec));
     pa_sink_put(u->sink);
 
@@ -510,6 +583,15 @@ void pa__done(pa_module*m) {
     if (u->rtpoll_item)
         pa_rtpoll_item_free(u->rtpoll_item);
 
+    if (u->ring_rtpoll_item)
+        pa_rtpoll_item_free(u->ring_rtpoll_item);
+
+    if (u->ring_fdsem)
+        pa_fdsem_free(u->ring_fdsem);
+
+    if (u->ring)
+        pa_ringbuffer_free(u->ring);
+
     if (u->jack_msgq)
         pa_asyncmsgq_unref(u->jack_msgq);
 
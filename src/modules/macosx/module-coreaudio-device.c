@@ -43,15 +43,32 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/i18n.h>
+#include <pulsecore/ringbuffer.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/atomic.h>
 
 #include <CoreAudio/CoreAudio.h>
 #include <CoreAudio/CoreAudioTypes.h>
 #include <CoreAudio/AudioHardware.h>
+#include <CoreAudio/HostTime.h>
 
 #include "module-coreaudio-device-symdef.h"
 
+/* The IOProc runs on CoreAudio's real-time thread and must never wait
+ * for us. Playback is rendered ahead by our IO thread into a lock-free
+ * ring buffer per sink, which the IOProc just copies from; capture
+ * goes the other way round. After each cycle the IOProc kicks our
+ * thread through an fdsem to top up and drain the rings. */
+
 #define DEFAULT_FRAMES_PER_IOPROC 512
 
+/* How many IOProc periods we render ahead */
+#define RING_PERIODS 2
+
+/* Ring buffer size in frames, the period times RING_PERIODS is capped
+ * to that */
+#define RING_FRAMES_MAX (16*1024)
+
 PA_MODULE_AUTHOR("Daniel Mack");
 PA_MODULE_DESCRIPTION("CoreAudio device");
 PA_MODULE_VERSION(PACKAGE_VERSION);
@@ -65,10 +82,6 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
-enum {
-    CA_MESSAGE_RENDER = PA_SINK_MESSAGE_MAX,
-};
-
 typedef struct coreaudio_sink coreaudio_sink;
 typedef struct coreaudio_source coreaudio_source;
 
@@ -77,7 +90,9 @@ struct userdata {
     AudioDeviceIOProcID proc_id;
 
     pa_thread_mq thread_mq;
-    pa_asyncmsgq *async_msgq;
+
+    pa_fdsem *ring_fdsem;
+    pa_rtpoll_item *ring_rtpoll_item;
 
     pa_rtpoll *rtpoll;
     pa_thread *thread;
@@ -88,11 +103,20 @@ struct userdata {
 
     char *device_name, *vendor_name;
 
-    const AudioBufferList *render_input_data;
-    AudioBufferList       *render_output_data;
-
     AudioStreamBasicDescription stream_description;
 
+    /* What the device and its streams add on top of what the IOProc
+     * timestamps tell us, in frames */
+    UInt32 output_latency, input_latency;
+
+    /* Written by the IOProc: the length of its last cycle, when it
+     * happened (in usec of host time, truncated to 32 bits) and how far
+     * the output/input times were from it, in frames */
+    pa_atomic_t period_frames;
+    pa_atomic_t cycle_time;
+    pa_atomic_t output_lead, input_lead;
+    pa_atomic_t cycle_valid;
+
     PA_LLIST_HEAD(coreaudio_sink, sinks);
     PA_LLIST_HEAD(coreaudio_source, sources);
 };
@@ -107,6 +131,12 @@ struct coreaudio_sink {
 
     pa_channel_map map;
     pa_sample_spec ss;
+    size_t frame_size;
+
+    /* Written by our IO thread only, read by the IOProc only */
+    pa_ringbuffer *ring;
+    uint32_t frames_written;
+    pa_atomic_t frames_read;
 
     PA_LLIST_FIELDS(coreaudio_sink);
 };
@@ -121,6 +151,10 @@ struct coreaudio_source {
 
     pa_channel_map map;
     pa_sample_spec ss;
+    size_t frame_size;
+
+    /* Written by the IOProc only, read by our IO thread only */
+    pa_ringbuffer *ring;
 
     PA_LLIST_FIELDS(coreaudio_source);
 };
@@ -129,6 +163,69 @@ static int card_set_profile(pa_card *c, pa_card_profile *new_profile) {
     return 0;
 }
 
+static uint32_t host_time_usec(UInt64 host_time) {
+    return (uint32_t) (AudioConvertHostTimeToNanos(host_time) / 1000);
+}
+
+/* Called from the CoreAudio thread. Takes whatever our thread rendered
+ * ahead, without waiting for it. */
+static void ca_sink_play(coreaudio_sink *ca_sink, AudioBuffer *buf) {
+    uint8_t *d = buf->mData;
+    size_t done = 0;
+
+    while (done < buf->mDataByteSize) {
+        const void *p;
+        int count;
+        size_t n;
+
+        p = pa_ringbuffer_peek(ca_sink->ring, &count);
+        n = PA_MIN((size_t) count, buf->mDataByteSize - done);
+        n -= n % ca_sink->frame_size;
+
+        if (n == 0)
+            break;
+
+        memcpy(d + done, p, n);
+        pa_ringbuffer_drop(ca_sink->ring, (int) n);
+        done += n;
+    }
+
+    if (done > 0) {
+        pa_ringbuffer_commit_read(ca_sink->ring);
+        pa_atomic_add(&ca_sink->frames_read, (int) (done / ca_sink->frame_size));
+    }
+
+    /* Not RUNNING, or we didn't keep up: play silence */
+    if (done < buf->mDataByteSize)
+        memset(d + done, 0, buf->mDataByteSize - done);
+}
+
+/* Called from the CoreAudio thread. If our thread didn't keep up
+ * draining the ring, what doesn't fit is lost. */
+static void ca_source_record(coreaudio_source *ca_source, const AudioBuffer *buf) {
+    const uint8_t *p = buf->mData;
+    size_t done = 0;
+
+    while (done < buf->mDataByteSize) {
+        void *d;
+        int count;
+        size_t n;
+
+        d = pa_ringbuffer_begin_write(ca_source->ring, &count);
+        n = PA_MIN((size_t) count, buf->mDataByteSize - done);
+        n -= n % ca_source->frame_size;
+
+        if (n == 0)
+            break;
+
+        memcpy(d, p + done, n);
+        pa_ringbuffer_end_write(ca_source->ring, (int) n);
+        done += n;
+    }
+
+    pa_ringbuffer_commit_write(ca_source->ring);
+}
+
 static OSStatus io_render_proc (AudioDeviceID          device,
                                 const AudioTimeStamp  *now,
                                 const AudioBufferList *inputData,
@@ -137,20 +234,39 @@ static OSStatus io_render_proc (AudioDeviceID          device,
                                 const AudioTimeStamp  *outputTime,
                                 void                  *clientData) {
     struct userdata *u = clientData;
+    coreaudio_sink *ca_sink;
+    coreaudio_source *ca_source;
+    UInt32 i;
 
     pa_assert(u);
     pa_assert(device == u->object_id);
 
-    u->render_input_data = inputData;
-    u->render_output_data = outputData;
+    /* The sink and source lists are set up before the IOProc is, and
+     * never change while it exists */
+    for (i = 0, ca_sink = u->sinks; outputData && i < outputData->mNumberBuffers && ca_sink; i++, ca_sink = ca_sink->next) {
+        ca_sink_play(ca_sink, outputData->mBuffers + i);
 
-    if (u->sinks)
-        pa_assert_se(pa_asyncmsgq_send(u->async_msgq, PA_MSGOBJECT(u->sinks->pa_sink),
-                                        CA_MESSAGE_RENDER, NULL, 0, NULL) == 0);
+        if (i == 0)
+            pa_atomic_store(&u->period_frames, (int) (outputData->mBuffers[0].mDataByteSize / ca_sink->frame_size));
+    }
 
-    if (u->sources)
-        pa_assert_se(pa_asyncmsgq_send(u->async_msgq, PA_MSGOBJECT(u->sources->pa_source),
-                                        CA_MESSAGE_RENDER, NULL, 0, NULL) == 0);
+    for (i = 0, ca_source = u->sources; inputData && i < inputData->mNumberBuffers && ca_source; i++, ca_source = ca_source->next) {
+        ca_source_record(ca_source, inputData->mBuffers + i);
+
+        if (i == 0 && !u->sinks)
+            pa_atomic_store(&u->period_frames, (int) (inputData->mBuffers[0].mDataByteSize / ca_source->frame_size));
+    }
+
+    if ((now->mFlags & kAudioTimeStampHostTimeValid) && (now->mFlags & kAudioTimeStampSampleTimeValid)) {
+        pa_atomic_store(&u->cycle_time, (int) host_time_usec(now->mHostTime));
+        pa_atomic_store(&u->output_lead, (outputTime->mFlags & kAudioTimeStampSampleTimeValid) ?
+                        (int) PA_MAX(outputTime->mSampleTime - now->mSampleTime, 0) : 0);
+        pa_atomic_store(&u->input_lead, (inputTime->mFlags & kAudioTimeStampSampleTimeValid) ?
+                        (int) PA_MAX(now->mSampleTime - inputTime->mSampleTime, 0) : 0);
+        pa_atomic_store(&u->cycle_valid, 1);
+    }
+
+    pa_fdsem_post(u->ring_fdsem);
 
     return 0;
 }
@@ -175,31 +291,17 @@ static OSStatus ca_stream_format_changed(AudioObjectID objectID,
     return 0;
 }
 
-static pa_usec_t get_latency_us(pa_object *o) {
-    struct userdata *u;
-    pa_sample_spec *ss;
-    bool is_source;
+/* What the device and its streams add, in frames. This is what the
+ * IOProc timestamps don't cover; the buffer size and the safety offset
+ * are part of those already. Called once at start up, since querying
+ * it is too slow for every latency request. */
+static UInt32 get_device_latency(struct userdata *u, bool is_source) {
     UInt32 v = 0, total = 0;
     OSStatus err;
     UInt32 size = sizeof(v);
     AudioObjectPropertyAddress property_address;
     AudioObjectID stream_id;
 
-    if (pa_sink_isinstance(o)) {
-        coreaudio_sink *sink = PA_SINK(o)->userdata;
-
-        u = sink->userdata;
-        ss = &sink->ss;
-        is_source = false;
-    } else if (pa_source_isinstance(o)) {
-        coreaudio_source *source = PA_SOURCE(o)->userdata;
-
-        u = source->userdata;
-        ss = &source->ss;
-        is_source = true;
-    } else
-        pa_assert_not_reached();
-
     pa_assert(u);
 
     property_address.mScope = is_source ? kAudioDevicePropertyScopeInput : kAudioDevicePropertyScopeOutput;
@@ -214,24 +316,6 @@ static pa_usec_t get_latency_us(pa_object *o) {
     else
         pa_log_warn("Failed to get device latency: %d", err);
 
-    /* the IOProc buffer size */
-    property_address.mSelector = kAudioDevicePropertyBufferFrameSize;
-    size = sizeof(v);
-    err = AudioObjectGetPropertyData(u->object_id, &property_address, 0, NULL, &size, &v);
-    if (!err)
-        total += v;
-    else
-        pa_log_warn("Failed to get buffer frame size: %d", err);
-
-    /* IOProc safety offset - this value is the same for both directions, hence we divide it by 2 */
-    property_address.mSelector = kAudioDevicePropertySafetyOffset;
-    size = sizeof(v);
-    err = AudioObjectGetPropertyData(u->object_id, &property_address, 0, NULL, &size, &v);
-    if (!err)
-        total += v / 2;
-    else
-        pa_log_warn("Failed to get safety offset: %d", err);
-
     /* get the stream latency.
      * FIXME: this assumes the stream latency is the same for all streams */
     property_address.mSelector = kAudioDevicePropertyStreams;
@@ -249,7 +333,56 @@ static pa_usec_t get_latency_us(pa_object *o) {
     } else
         pa_log_warn("Failed to get streams: %d", err);
 
-    return pa_bytes_to_usec(total * pa_frame_size(ss), ss);
+    return total;
+}
+
+/* Frames that passed since the last IOProc cycle, or -1 if there was
+ * none yet */
+static int64_t frames_since_cycle(struct userdata *u, const pa_sample_spec *ss) {
+    uint32_t elapsed;
+
+    if (!pa_atomic_load(&u->cycle_valid))
+        return -1;
+
+    elapsed = host_time_usec(AudioGetCurrentHostTime()) - (uint32_t) pa_atomic_load(&u->cycle_time);
+
+    return (int64_t) pa_usec_to_bytes(elapsed, ss) / (int64_t) pa_frame_size(ss);
+}
+
+/* Called from IO context */
+static pa_usec_t sink_get_latency(coreaudio_sink *ca_sink) {
+    struct userdata *u = ca_sink->userdata;
+    int64_t l, elapsed;
+
+    /* What is waiting in the ring buffer plus what the device adds */
+    l = (int64_t) (ca_sink->frames_written - (uint32_t) pa_atomic_load(&ca_sink->frames_read)) + u->output_latency;
+
+    if ((elapsed = frames_since_cycle(u, &ca_sink->ss)) >= 0) {
+        /* Plus what we handed over in the last cycle and how long it
+         * takes to get played, minus the time that passed since then */
+        l += pa_atomic_load(&u->output_lead) + pa_atomic_load(&u->period_frames);
+        l = PA_MAX(l - elapsed, 0);
+    }
+
+    return pa_bytes_to_usec((uint64_t) l * ca_sink->frame_size, &ca_sink->ss);
+}
+
+/* Called from IO context */
+static pa_usec_t source_get_latency(coreaudio_source *ca_source) {
+    struct userdata *u = ca_source->userdata;
+    int64_t l, elapsed;
+    int count;
+
+    pa_ringbuffer_peek(ca_source->ring, &count);
+
+    /* What we haven't posted yet, plus what the device adds */
+    l = count / (int64_t) ca_source->frame_size + u->input_latency;
+
+    /* Plus what was recorded since the last cycle */
+    if ((elapsed = frames_since_cycle(u, &ca_source->ss)) >= 0)
+        l += pa_atomic_load(&u->input_lead) + elapsed;
+
+    return pa_bytes_to_usec((uint64_t) l * ca_source->frame_size, &ca_source->ss);
 }
 
 static void ca_device_check_device_state(struct userdata *u) {
@@ -275,80 +408,102 @@ static void ca_device_check_device_state(struct userdata *u) {
     u->running = active;
 }
 
-static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
-    coreaudio_sink *sink = PA_SINK(o)->userdata;
-    struct userdata *u = sink->userdata;
-    unsigned int i;
-    pa_memchunk audio_chunk;
+/* Called from IO context */
+static void fill_ring(coreaudio_sink *ca_sink) {
+    struct userdata *u = ca_sink->userdata;
+    uint32_t target;
 
-    switch (code) {
-        case CA_MESSAGE_RENDER: {
-            /* audio out */
-            for (i = 0; i < u->render_output_data->mNumberBuffers; i++) {
-                AudioBuffer *buf = u->render_output_data->mBuffers + i;
+    target = PA_MIN(RING_PERIODS * (uint32_t) pa_atomic_load(&u->period_frames), RING_FRAMES_MAX);
 
-                pa_assert(sink);
+    for (;;) {
+        uint32_t fill;
+        pa_memchunk chunk;
+        void *p;
+        int count;
+        size_t n;
 
-                if (PA_SINK_IS_OPENED(sink->pa_sink->thread_info.state)) {
-                    audio_chunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, buf->mData, buf->mDataByteSize, false);
-                    audio_chunk.length = buf->mDataByteSize;
-                    audio_chunk.index = 0;
+        fill = ca_sink->frames_written - (uint32_t) pa_atomic_load(&ca_sink->frames_read);
 
-                    pa_sink_render_into_full(sink->pa_sink, &audio_chunk);
-                    pa_memblock_unref_fixed(audio_chunk.memblock);
-                }
+        if (fill >= target)
+            break;
 
-                sink = sink->next;
-            }
+        p = pa_ringbuffer_begin_write(ca_sink->ring, &count);
+        n = PA_MIN((size_t) (target - fill) * ca_sink->frame_size, (size_t) count);
+        n -= n % ca_sink->frame_size;
 
-            return 0;
-        }
+        if (n == 0)
+            break;
 
-        case PA_SINK_MESSAGE_GET_LATENCY: {
-            *((pa_usec_t *) data) = get_latency_us(PA_OBJECT(o));
-            return 0;
-        }
+        /* Render straight into the ring buffer */
+        chunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, p, n, false);
+        chunk.index = 0;
+        chunk.length = n;
+
+        pa_sink_render_into_full(ca_sink->pa_sink, &chunk);
+        pa_memblock_unref_fixed(chunk.memblock);
+
+        pa_ringbuffer_end_write(ca_sink->ring, (int) n);
+        ca_sink->frames_written += (uint32_t) (n / ca_sink->frame_size);
     }
 
-    return pa_sink_process_msg(o, code, data, offset, chunk);
+    pa_ringbuffer_commit_write(ca_sink->ring);
 }
 
-static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
-    coreaudio_source *source = PA_SOURCE(o)->userdata;
-    struct userdata *u = source->userdata;
-    unsigned int i;
-    pa_memchunk audio_chunk;
+/* Called from IO context */
+static void drain_ring(coreaudio_source *ca_source) {
+    struct userdata *u = ca_source->userdata;
+    const void *p;
+    int count;
 
-    switch (code) {
-        case CA_MESSAGE_RENDER: {
-            /* audio in */
-            for (i = 0; i < u->render_input_data->mNumberBuffers; i++) {
-                const AudioBuffer *buf = u->render_input_data->mBuffers + i;
+    while ((p = pa_ringbuffer_peek(ca_source->ring, &count)) && count > 0) {
 
-                pa_assert(source);
+        if (PA_SOURCE_IS_OPENED(ca_source->pa_source->thread_info.state)) {
+            pa_memchunk chunk;
 
-                if (PA_SOURCE_IS_OPENED(source->pa_source->thread_info.state)) {
-                    audio_chunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, buf->mData, buf->mDataByteSize, true);
-                    audio_chunk.length = buf->mDataByteSize;
-                    audio_chunk.index = 0;
+            chunk.memblock = pa_memblock_new(u->module->core->mempool, (size_t) count);
+            chunk.index = 0;
+            chunk.length = pa_memblock_get_length(chunk.memblock);
+            chunk.length -= chunk.length % ca_source->frame_size;
 
-                    pa_source_post(source->pa_source, &audio_chunk);
-                    pa_memblock_unref_fixed(audio_chunk.memblock);
-                }
+            memcpy(pa_memblock_acquire(chunk.memblock), p, chunk.length);
+            pa_memblock_release(chunk.memblock);
 
-                source = source->next;
-            }
+            pa_source_post(ca_source->pa_source, &chunk);
+            pa_memblock_unref(chunk.memblock);
+
+            count = (int) chunk.length;
+        }
 
+        pa_ringbuffer_drop(ca_source->ring, count);
+    }
+
+    pa_ringbuffer_commit_read(ca_source->ring);
+}
+
+static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    coreaudio_sink *sink = PA_SINK(o)->userdata;
+
+    switch (code) {
+        case PA_SINK_MESSAGE_GET_LATENCY: {
+            *((pa_usec_t *) data) = sink_get_latency(sink);
             return 0;
         }
+    }
 
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    coreaudio_source *source = PA_SOURCE(o)->userdata;
+
+    switch (code) {
         case PA_SOURCE_MESSAGE_GET_LATENCY: {
-            *((pa_usec_t *) data) = get_latency_us(PA_OBJECT(o));
+            *((pa_usec_t *) data) = source_get_latency(source);
             return 0;
         }
     }
 
-    return pa_source_process_msg(o, code, data, offset, chunk);;
+    return pa_source_process_msg(o, code, data, offset, chunk);
 }
 
 static int ca_sink_set_state(pa_sink *s, pa_sink_state_t state) {
@@ -466,6 +621,8 @@ static int ca_device_create_sink(pa_module *m, AudioBuffer *buf, int channel_idx
 
     ca_sink->ss.rate = u->stream_description.mSampleRate;
     ca_sink->ss.format = PA_SAMPLE_FLOAT32LE;
+    ca_sink->frame_size = pa_frame_size(&ca_sink->ss);
+    ca_sink->ring = pa_ringbuffer_new((int) (RING_FRAMES_MAX * ca_sink->frame_size));
 
     pa_sink_new_data_init(&new_data);
     new_data.card = u->card;
@@ -600,6 +757,8 @@ static int ca_device_create_source(pa_module *m, AudioBuffer *buf, int channel_i
 
     ca_source->ss.rate = u->stream_description.mSampleRate;
     ca_source->ss.format = PA_SAMPLE_FLOAT32LE;
+    ca_source->frame_size = pa_frame_size(&ca_source->ss);
+    ca_source->ring = pa_ringbuffer_new((int) (RING_FRAMES_MAX * ca_source->frame_size));
 
     pa_source_new_data_init(&new_data);
     new_data.card = u->card;
@@ -726,13 +885,22 @@ static void thread_func(void *userdata) {
 
     for (;;) {
         coreaudio_sink *ca_sink;
+        coreaudio_source *ca_source;
         int ret;
 
         PA_LLIST_FOREACH(ca_sink, u->sinks) {
             if (PA_UNLIKELY(ca_sink->pa_sink->thread_info.rewind_requested))
                 pa_sink_process_rewind(ca_sink->pa_sink, 0);
+
+            /* If we aren't running, the IOProc plays silence once it
+             * has used up what we rendered before */
+            if (ca_sink->pa_sink->thread_info.state == PA_SINK_RUNNING)
+                fill_ring(ca_sink);
         }
 
+        PA_LLIST_FOREACH(ca_source, u->sources)
+            drain_ring(ca_source);
+
         ret = pa_rtpoll_run(u->rtpoll);
 
         if (ret < 0)
@@ -831,13 +999,12 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
-    u->async_msgq = pa_asyncmsgq_new(0);
-    if (!u->async_msgq) {
-        pa_log("pa_asyncmsgq_new() failed.");
+    if (!(u->ring_fdsem = pa_fdsem_new())) {
+        pa_log("pa_fdsem_new() failed.");
         goto fail;
     }
 
-    pa_rtpoll_item_new_asyncmsgq_read(u->rtpoll, PA_RTPOLL_EARLY-1, u->async_msgq);
+    u->ring_rtpoll_item = pa_rtpoll_item_new_fdsem(u->rtpoll, PA_RTPOLL_EARLY-1, u->ring_fdsem);
 
     PA_LLIST_HEAD_INIT(coreaudio_sink, u->sinks);
 
@@ -847,6 +1014,9 @@ int pa__init(pa_module *m) {
     /* create sources */
     ca_device_create_streams(m, true);
 
+    u->output_latency = get_device_latency(u, false);
+    u->input_latency = get_device_latency(u, true);
+
     /* create the message thread */
     if (!(u->thread = pa_thread_new(u->device_name, thread_func, u))) {
         pa_log("Failed to create thread.");
@@ -868,6 +1038,9 @@ int pa__init(pa_module *m) {
     AudioObjectSetPropertyData(u->object_id, &property_address, 0, NULL, sizeof(frames), &frames);
     pa_log_debug("%u frames per IOProc\n", (unsigned int) frames);
 
+    /* Until the first IOProc cycle tells us better */
+    pa_atomic_store(&u->period_frames, (int) PA_MIN(frames, RING_FRAMES_MAX));
+
     /* create one ioproc for both directions */
     err = AudioDeviceCreateIOProcID(u->object_id, io_render_proc, u, &u->proc_id);
     if (err) {
@@ -922,8 +1095,11 @@ void pa__done(pa_module *m) {
         pa_thread_mq_done(&u->thread_mq);
     }
 
-    if (u->async_msgq)
-        pa_asyncmsgq_unref(u->async_msgq);
+    /* The IOProc uses the ring buffers, stop it before they go away */
+    if (u->proc_id) {
+        AudioDeviceStop(u->object_id, u->proc_id);
+        AudioDeviceDestroyIOProcID(u->object_id, u->proc_id);
+    }
 
     /* free sinks */
     for (ca_sink = u->sinks; ca_sink;) {
@@ -932,6 +1108,9 @@ void pa__done(pa_module *m) {
         if (ca_sink->pa_sink)
             pa_sink_unref(ca_sink->pa_sink);
 
+        if (ca_sink->ring)
+            pa_ringbuffer_free(ca_sink->ring);
+
         pa_xfree(ca_sink->name);
         pa_xfree(ca_sink);
         ca_sink = next;
@@ -944,22 +1123,26 @@ void pa__done(pa_module *m) {
         if (ca_source->pa_source)
             pa_source_unref(ca_source->pa_source);
 
+        if (ca_source->ring)
+            pa_ringbuffer_free(ca_source->ring);
+
         pa_xfree(ca_source->name);
         pa_xfree(ca_source);
         ca_source = next;
     }
 
-    if (u->proc_id) {
-        AudioDeviceStop(u->object_id, u->proc_id);
-        AudioDeviceDestroyIOProcID(u->object_id, u->proc_id);
-    }
-
     property_address.mSelector = kAudioDevicePropertyStreamFormat;
     property_address.mScope = kAudioObjectPropertyScopeGlobal;
     property_address.mElement = kAudioObjectPropertyElementMaster;
 
     AudioObjectRemovePropertyListener(kAudioObjectSystemObject, &property_address, ca_stream_format_changed, u);
 
+    if (u->ring_rtpoll_item)
+        pa_rtpoll_item_free(u->ring_rtpoll_item);
+
+    if (u->ring_fdsem)
+        pa_fdsem_free(u->ring_fdsem);
+
     pa_xfree(u->device_name);
     pa_xfree(u->vendor_name);
     pa_rtpoll_free(u->rtpoll);
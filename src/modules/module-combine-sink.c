@@ -70,6 +70,16 @@ PA_MODULE_USAGE(
 
 #define BLOCK_USEC (PA_USEC_PER_MSEC * 200)
 
+/* Rate controller tuning. The latency error is low-pass filtered to
+ * keep the jitter of the latency measurements out of the rates, the
+ * gains are relative to correcting the whole error within one
+ * adjust_time and the integral term, which ends up holding the clock
+ * drift between the devices, is limited to 1% */
+#define RATE_FILTER_WEIGHT 0.3
+#define RATE_KP 0.5
+#define RATE_KI 0.1
+#define RATE_INTEGRAL_MAX 0.01
+
 static const char* const valid_modargs[] = {
     "sink_name",
     "sink_properties",
@@ -118,6 +128,11 @@ struct output {
     /* For communication of the stream latencies to the main thread */
     pa_usec_t total_latency;
 
+    /* Rate controller state, managed in main context */
+    bool controller_valid;
+    double filtered_error;
+    double integral;
+
     /* For communication of the stream parameters to the sink thread */
     pa_atomic_t max_request;
     pa_atomic_t max_latency;
@@ -201,8 +216,12 @@ static void adjust_rates(struct userdata *u) {
     PA_IDXSET_FOREACH(o, u->outputs, idx) {
         pa_usec_t sink_latency;
 
-        if (!o->sink_input || !PA_SINK_IS_OPENED(pa_sink_get_state(o->sink)))
+        if (!o->sink_input || !PA_SINK_IS_OPENED(pa_sink_get_state(o->sink))) {
+            /* Whatever we learned about this output is stale once it
+             * comes back */
+            o->controller_valid = false;
             continue;
+        }
 
         o->total_latency = pa_sink_input_get_latency(o->sink_input, &sink_latency);
         o->total_latency += sink_latency;
@@ -235,23 +254,35 @@ static void adjust_rates(struct userdata *u) {
     base_rate = u->sink->sample_spec.rate;
 
     PA_IDXSET_FOREACH(o, u->outputs, idx) {
-        uint32_t new_rate = base_rate;
+        uint32_t new_rate;
         uint32_t current_rate;
+        double error;
 
         if (!o->sink_input || !PA_SINK_IS_OPENED(pa_sink_get_state(o->sink)))
             continue;
 
         current_rate = o->sink_input->sample_spec.rate;
 
-        if (o->total_latency != target_latency)
-            new_rate += (uint32_t) (((double) o->total_latency - (double) target_latency) / (double) u->adjust_time * (double) new_rate);
+        /* The error as a fraction of the rate that would correct it
+         * within one adjust_time */
+        error = ((double) o->total_latency - (double) target_latency) / (double) u->adjust_time;
+
+        if (!o->controller_valid) {
+            o->filtered_error = error;
+            o->integral = 0;
+            o->controller_valid = true;
+        } else
+            o->filtered_error += RATE_FILTER_WEIGHT * (error - o->filtered_error);
+
+        o->integral = PA_CLAMP(o->integral + RATE_KI * o->filtered_error, -RATE_INTEGRAL_MAX, RATE_INTEGRAL_MAX);
+
+        new_rate = (uint32_t) ((double) base_rate * (1.0 + RATE_KP * o->filtered_error + o->integral) + 0.5);
 
         if (new_rate < (uint32_t) (base_rate*0.8) || new_rate > (uint32_t) (base_rate*1.25)) {
             pa_log_warn("[%s] sample rates too different, not adjusting (%u vs. %u).", o->sink_input->sink->name, base_rate, new_rate);
             new_rate = base_rate;
+            o->controller_valid = false;
         } else {
-            if (base_rate < new_rate + 20 && new_rate < base_rate + 20)
-              new_rate = base_rate;
             /* Do the adjustment in small steps; 2‰ can be considered inaudible */
             if (new_rate < (uint32_t) (current_rate*0.998) || new_rate > (uint32_t) (current_rate*1.002)) {
                 pa_log_info("[%s] new rate of %u Hz not within 2‰ of %u Hz, forcing smaller adjustment", o->sink_input->sink->name, new_rate, current_rate);
@@ -259,7 +290,9 @@ static void adjust_rates(struct userdata *u) {
             }
             pa_log_info("[%s] new rate is %u Hz; ratio is %0.3f; latency is %0.2f msec.", o->sink_input->sink->name, new_rate, (double) new_rate / base_rate, (double) o->total_latency / PA_USEC_PER_MSEC);
         }
-        pa_sink_input_set_rate(o->sink_input, new_rate);
+
+        if (new_rate != current_rate)
+            pa_sink_input_set_rate(o->sink_input, new_rate);
     }
 
     pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_UPDATE_LATENCY, NULL, (int64_t) avg_total_latency, NULL);
@@ -984,7 +1017,14 @@ static int output_create_sink_input(struct output *o) {
     pa_sink_input_new_data_set_channel_map(&data, &u->sink->channel_map);
     data.module = u->module;
     data.resample_method = u->resample_method;
-    data.flags = PA_SINK_INPUT_VARIABLE_RATE|PA_SINK_INPUT_DONT_MOVE|PA_SINK_INPUT_NO_CREATE_ON_SUSPEND;
+    data.flags = PA_SINK_INPUT_DONT_MOVE|PA_SINK_INPUT_NO_CREATE_ON_SUSPEND;
+
+    /* A variable rate stream always has a resampler, even when it
+     * ends up converting nothing. Without rate adjustments an output
+     * matching our sample spec can instead pass the rendered blocks,
+     * which are shared by all outputs, straight through. */
+    if (u->adjust_time > 0)
+        data.flags |= PA_SINK_INPUT_VARIABLE_RATE;
 
     pa_sink_input_new(&o->sink_input, u->core, &data);
 
@@ -993,6 +1033,8 @@ static int output_create_sink_input(struct output *o) {
     if (!o->sink_input)
         return -1;
 
+    o->controller_valid = false;
+
     o->sink_input->parent.process_msg = sink_input_process_msg;
     o->sink_input->pop = sink_input_pop_cb;
     o->sink_input->process_rewind = sink_input_process_rewind_cb;
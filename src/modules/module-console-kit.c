@@ -30,12 +30,15 @@
 
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-util.h>
 #include <pulsecore/module.h>
 #include <pulsecore/log.h>
 #include <pulsecore/hashmap.h>
 #include <pulsecore/idxset.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/dbus-shared.h>
+#include <pulsecore/dbus-util.h>
+#include <pulsecore/llist.h>
 
 #include "module-console-kit-symdef.h"
 
@@ -59,46 +62,44 @@ struct userdata {
     pa_dbus_connection *connection;
     pa_hashmap *sessions;
     bool filter_added;
+
+    /* ConsoleKit is queried asynchronously, so that a slow or not yet
+     * activated ConsoleKit doesn't hold up loading the other modules */
+    PA_LLIST_HEAD(pa_dbus_pending, pending);
 };
 
+static void send_and_add_to_pending(struct userdata *u, DBusMessage *m, DBusPendingCallNotifyFunction func, char *call_data) {
+    pa_dbus_pending *p;
+    DBusPendingCall *call;
+
+    pa_assert(u);
+    pa_assert(m);
+
+    pa_assert_se(dbus_connection_send_with_reply(pa_dbus_connection_get(u->connection), m, &call, -1));
+
+    p = pa_dbus_pending_new(pa_dbus_connection_get(u->connection), m, call, u, call_data);
+    PA_LLIST_PREPEND(pa_dbus_pending, u->pending, p);
+    dbus_pending_call_set_notify(call, func, p, NULL);
+}
+
+static void remove_pending(struct userdata *u, pa_dbus_pending *p) {
+    pa_assert(u);
+    pa_assert(p);
+
+    PA_LLIST_REMOVE(pa_dbus_pending, u->pending, p);
+    pa_xfree(p->call_data);
+    pa_dbus_pending_free(p);
+}
+
 static void add_session(struct userdata *u, const char *id) {
-    DBusError error;
-    DBusMessage *m = NULL, *reply = NULL;
-    uint32_t uid;
     struct session *session;
     pa_client_new_data data;
 
-    dbus_error_init(&error);
-
     if (pa_hashmap_get(u->sessions, id)) {
         pa_log_warn("Duplicate session %s, ignoring.", id);
         return;
     }
 
-    if (!(m = dbus_message_new_method_call("org.freedesktop.ConsoleKit", id, "org.freedesktop.ConsoleKit.Session", "GetUnixUser"))) {
-        pa_log("Failed to allocate GetUnixUser() method call.");
-        goto fail;
-    }
-
-    if (!(reply = dbus_connection_send_with_reply_and_block(pa_dbus_connection_get(u->connection), m, -1, &error))) {
-        pa_log("GetUnixUser() call failed: %s: %s", error.name, error.message);
-        goto fail;
-    }
-
-    /* CK 0.3 this changed from int32 to uint32 */
-    if (!dbus_message_get_args(reply, &error, DBUS_TYPE_UINT32, &uid, DBUS_TYPE_INVALID)) {
-        dbus_error_free(&error);
-
-        if (!dbus_message_get_args(reply, &error, DBUS_TYPE_INT32, &uid, DBUS_TYPE_INVALID)) {
-            pa_log("Failed to parse GetUnixUser() result: %s: %s", error.name, error.message);
-            goto fail;
-        }
-    }
-
-    /* We only care about our own sessions */
-    if ((uid_t) uid != getuid())
-        goto fail;
-
     session = pa_xnew(struct session, 1);
     session->id = pa_xstrdup(id);
 
@@ -113,22 +114,75 @@ static void add_session(struct userdata *u, const char *id) {
     if (!session->client) {
         pa_xfree(session->id);
         pa_xfree(session);
-        goto fail;
+        return;
     }
 
     pa_hashmap_put(u->sessions, session->id, session);
 
     pa_log_debug("Added new session %s", id);
+}
 
-fail:
+static void get_unix_user_reply(DBusPendingCall *pending, void *userdata) {
+    DBusError error;
+    DBusMessage *r;
+    pa_dbus_pending *p;
+    struct userdata *u;
+    const char *id;
+    uint32_t uid;
 
-    if (m)
-        dbus_message_unref(m);
+    pa_assert(pending);
+    pa_assert_se(p = userdata);
+    pa_assert_se(u = p->context_data);
+    pa_assert_se(id = p->call_data);
+    pa_assert_se(r = dbus_pending_call_steal_reply(pending));
 
-    if (reply)
-        dbus_message_unref(reply);
+    dbus_error_init(&error);
 
+    if (dbus_message_get_type(r) == DBUS_MESSAGE_TYPE_ERROR) {
+        pa_log("GetUnixUser() call failed: %s: %s", dbus_message_get_error_name(r), pa_dbus_get_error_message(r));
+        goto finish;
+    }
+
+    /* CK 0.3 this changed from int32 to uint32 */
+    if (!dbus_message_get_args(r, &error, DBUS_TYPE_UINT32, &uid, DBUS_TYPE_INVALID)) {
+        dbus_error_free(&error);
+
+        if (!dbus_message_get_args(r, &error, DBUS_TYPE_INT32, &uid, DBUS_TYPE_INVALID)) {
+            pa_log("Failed to parse GetUnixUser() result: %s: %s", error.name, error.message);
+            goto finish;
+        }
+    }
+
+    /* We only care about our own sessions */
+    if ((uid_t) uid == getuid())
+        add_session(u, id);
+
+finish:
+    dbus_message_unref(r);
     dbus_error_free(&error);
+
+    remove_pending(u, p);
+}
+
+static void request_session(struct userdata *u, const char *id) {
+    DBusMessage *m;
+    pa_dbus_pending *p;
+
+    if (pa_hashmap_get(u->sessions, id)) {
+        pa_log_warn("Duplicate session %s, ignoring.", id);
+        return;
+    }
+
+    PA_LLIST_FOREACH(p, u->pending)
+        if (p->call_data && pa_streq(p->call_data, id))
+            return;
+
+    if (!(m = dbus_message_new_method_call("org.freedesktop.ConsoleKit", id, "org.freedesktop.ConsoleKit.Session", "GetUnixUser"))) {
+        pa_log("Failed to allocate GetUnixUser() method call.");
+        return;
+    }
+
+    send_and_add_to_pending(u, m, get_unix_user_reply, pa_xstrdup(id));
 }
 
 static void free_session(struct session *session) {
@@ -142,9 +196,19 @@ static void free_session(struct session *session) {
 }
 
 static void remove_session(struct userdata *u, const char *id) {
+    pa_dbus_pending *p, *n;
+
     pa_assert(u);
     pa_assert(id);
 
+    /* Don't add the session when the lookup finishes after all */
+    for (p = u->pending; p; p = n) {
+        n = p->next;
+
+        if (p->call_data && pa_streq(p->call_data, id))
+            remove_pending(u, p);
+    }
+
     pa_hashmap_remove_and_free(u->sessions, id);
 }
 
@@ -171,7 +235,7 @@ static DBusHandlerResult filter_cb(DBusConnection *bus, DBusMessage *message, vo
             }
         }
 
-        add_session(u, path);
+        request_session(u, path);
 
     } else if (dbus_message_is_signal(message, "org.freedesktop.ConsoleKit.Seat", "SessionRemoved")) {
 
@@ -194,39 +258,28 @@ finish:
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-static int get_session_list(struct userdata *u) {
-    DBusError error;
-    DBusMessage *m = NULL, *reply = NULL;
-    uint32_t uid;
+static void get_sessions_reply(DBusPendingCall *pending, void *userdata) {
+    DBusMessage *r;
+    pa_dbus_pending *p;
+    struct userdata *u;
     DBusMessageIter iter, sub;
-    int ret = -1;
-
-    pa_assert(u);
-
-    dbus_error_init(&error);
-
-    if (!(m = dbus_message_new_method_call("org.freedesktop.ConsoleKit", "/org/freedesktop/ConsoleKit/Manager", "org.freedesktop.ConsoleKit.Manager", "GetSessionsForUnixUser"))) {
-        pa_log("Failed to allocate GetSessionsForUnixUser() method call.");
-        goto fail;
-    }
 
-    uid = (uint32_t) getuid();
-    if (!(dbus_message_append_args(m, DBUS_TYPE_UINT32, &uid, DBUS_TYPE_INVALID))) {
-        pa_log("Failed to append arguments to GetSessionsForUnixUser() method call.");
-        goto fail;
-    }
+    pa_assert(pending);
+    pa_assert_se(p = userdata);
+    pa_assert_se(u = p->context_data);
+    pa_assert_se(r = dbus_pending_call_steal_reply(pending));
 
-    if (!(reply = dbus_connection_send_with_reply_and_block(pa_dbus_connection_get(u->connection), m, -1, &error))) {
-        pa_log("GetSessionsForUnixUser() call failed: %s: %s", error.name, error.message);
-        goto fail;
+    if (dbus_message_get_type(r) == DBUS_MESSAGE_TYPE_ERROR) {
+        pa_log("GetSessionsForUnixUser() call failed: %s: %s", dbus_message_get_error_name(r), pa_dbus_get_error_message(r));
+        goto finish;
     }
 
-    dbus_message_iter_init(reply, &iter);
+    dbus_message_iter_init(r, &iter);
 
     if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY ||
         dbus_message_iter_get_element_type(&iter) != DBUS_TYPE_OBJECT_PATH) {
         pa_log("Failed to parse GetSessionsForUnixUser() result.");
-        goto fail;
+        goto finish;
     }
 
     dbus_message_iter_recurse(&iter, &sub);
@@ -241,24 +294,38 @@ static int get_session_list(struct userdata *u) {
         pa_assert(at == DBUS_TYPE_OBJECT_PATH);
         dbus_message_iter_get_basic(&sub, &id);
 
-        add_session(u, id);
+        request_session(u, id);
 
         dbus_message_iter_next(&sub);
     }
 
-    ret = 0;
+finish:
+    dbus_message_unref(r);
 
-fail:
+    remove_pending(u, p);
+}
 
-    if (m)
-        dbus_message_unref(m);
+static int get_session_list(struct userdata *u) {
+    DBusMessage *m;
+    uint32_t uid;
 
-    if (reply)
-        dbus_message_unref(reply);
+    pa_assert(u);
 
-    dbus_error_free(&error);
+    if (!(m = dbus_message_new_method_call("org.freedesktop.ConsoleKit", "/org/freedesktop/ConsoleKit/Manager", "org.freedesktop.ConsoleKit.Manager", "GetSessionsForUnixUser"))) {
+        pa_log("Failed to allocate GetSessionsForUnixUser() method call.");
+        return -1;
+    }
+
+    uid = (uint32_t) getuid();
+    if (!(dbus_message_append_args(m, DBUS_TYPE_UINT32, &uid, DBUS_TYPE_INVALID))) {
+        pa_log("Failed to append arguments to GetSessionsForUnixUser() method call.");
+        dbus_message_unref(m);
+        return -1;
+    }
 
-    return ret;
+    send_and_add_to_pending(u, m, get_sessions_reply, NULL);
+
+    return 0;
 }
 
 int pa__init(pa_module*m) {
@@ -295,6 +362,7 @@ int pa__init(pa_module*m) {
     u->module = m;
     u->connection = connection;
     u->sessions = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) free_session);
+    PA_LLIST_HEAD_INIT(pa_dbus_pending, u->pending);
 
     if (!dbus_connection_add_filter(pa_dbus_connection_get(connection), filter_cb, u, NULL)) {
         pa_log_error("Failed to add filter function");
@@ -336,6 +404,9 @@ void pa__done(pa_module *m) {
     if (!(u = m->userdata))
         return;
 
+    while (u->pending)
+        remove_pending(u, u->pending);
+
     if (u->sessions)
         pa_hashmap_free(u->sessions);
 
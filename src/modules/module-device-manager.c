@@ -115,6 +115,11 @@ struct userdata {
     pa_time_event *save_time_event;
     pa_database *database;
 
+    /* All valid entries of the database, decoded, by key. Kept up to
+     * date by entry_write() and entry_remove(), so that routing never
+     * has to go to the database. */
+    pa_hashmap *entries;
+
     pa_native_protocol *protocol;
     pa_idxset *subscribed;
 
@@ -198,6 +203,19 @@ static void entry_free(struct entry* e) {
     pa_xfree(e);
 }
 
+static struct entry* entry_copy(const struct entry *e) {
+    struct entry *r;
+
+    pa_assert(e);
+
+    r = entry_new();
+    *r = *e;
+    r->description = pa_xstrdup(e->description);
+    r->icon = pa_xstrdup(e->icon);
+
+    return r;
+}
+
 static bool entry_write(struct userdata *u, const char *name, const struct entry *e) {
     pa_tagstruct *t;
     pa_datum key, data;
@@ -224,9 +242,27 @@ static bool entry_write(struct userdata *u, const char *name, const struct entry
 
     pa_tagstruct_free(t);
 
+    if (r) {
+        pa_hashmap_remove_and_free(u->entries, name);
+        pa_assert_se(pa_hashmap_put(u->entries, pa_xstrdup(name), entry_copy(e)) == 0);
+    }
+
     return r;
 }
 
+static void entry_remove(struct userdata *u, const char *name) {
+    pa_datum key;
+
+    pa_assert(u);
+    pa_assert(name);
+
+    key.data = (char *) name;
+    key.size = strlen(name);
+
+    pa_database_unset(u->database, &key);
+    pa_hashmap_remove_and_free(u->entries, name);
+}
+
 #ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
 
 #define LEGACY_ENTRY_VERSION 1
@@ -278,7 +314,7 @@ static struct entry* legacy_entry_read(struct userdata *u, pa_datum *data) {
 }
 #endif
 
-static struct entry* entry_read(struct userdata *u, const char *name) {
+static struct entry* entry_read_database(struct userdata *u, const char *name) {
     pa_datum key, data;
     struct entry *e = NULL;
     pa_tagstruct *t = NULL;
@@ -359,6 +395,51 @@ fail:
     return NULL;
 }
 
+static struct entry* entry_read(struct userdata *u, const char *name) {
+    struct entry *e;
+
+    pa_assert(u);
+    pa_assert(name);
+
+    if (!(e = pa_hashmap_get(u->entries, name)))
+        return NULL;
+
+    return entry_copy(e);
+}
+
+/* Fills u->entries from the database, called once when it is opened */
+static void load_entries(struct userdata *u) {
+    pa_datum key;
+    bool done;
+
+    pa_assert(u);
+
+    done = !pa_database_first(u->database, &key, NULL);
+
+    while (!done) {
+        pa_datum next_key;
+        struct entry *e;
+        char *name;
+
+        done = !pa_database_next(u->database, &key, &next_key, NULL);
+
+        name = pa_xstrndup(key.data, key.size);
+
+        /* A converted legacy entry has been put in by entry_write()
+         * already */
+        if ((e = entry_read_database(u, name)) && !pa_hashmap_get(u->entries, name)) {
+            pa_assert_se(pa_hashmap_put(u->entries, name, e) == 0);
+            name = NULL;
+        } else if (e)
+            entry_free(e);
+
+        pa_xfree(name);
+
+        pa_datum_free(&key);
+        key = next_key;
+    }
+}
+
 #ifdef DUMP_DATABASE
 static void dump_database_helper(struct userdata *u, uint32_t role_index, const char* human, bool sink_mode) {
     pa_assert(u);
@@ -558,8 +639,10 @@ static uint32_t get_role_index(const char* role) {
 
 static void update_highest_priority_device_indexes(struct userdata *u, const char *prefix, void *ignore_device) {
     role_indexes_t *indexes, highest_priority_available;
-    pa_datum key;
-    bool done, sink_mode;
+    struct entry *e;
+    const char *name;
+    void *state;
+    bool sink_mode;
 
     pa_assert(u);
     pa_assert(prefix);
@@ -576,75 +659,45 @@ static void update_highest_priority_device_indexes(struct userdata *u, const cha
     }
     pa_zero(highest_priority_available);
 
-    done = !pa_database_first(u->database, &key, NULL);
-
     /* Find all existing devices with the same prefix so we find the highest priority device for each role */
-    while (!done) {
-        pa_datum next_key;
+    PA_HASHMAP_FOREACH_KV(name, e, u->entries, state) {
+        uint32_t idx = PA_INVALID_INDEX;
 
-        done = !pa_database_next(u->database, &key, &next_key, NULL);
+        if (!pa_startswith(name, prefix) || !name[strlen(prefix)])
+            continue;
+
+        /* Only look the device up once we know that we need it */
+        for (uint32_t i = 0; i < NUM_ROLES; ++i) {
+            if (!highest_priority_available[i] || e->priority[i] < highest_priority_available[i]) {
+                /* We've found a device with a higher priority than that we've currently got,
+                   so see if it is currently available or not and update our list */
+
+                if (idx == PA_INVALID_INDEX) {
+                    if (sink_mode) {
+                        pa_sink *sink;
+
+                        if (!(sink = pa_namereg_get(u->core, name + strlen(prefix), PA_NAMEREG_SINK)) ||
+                            (pa_sink*) ignore_device == sink ||
+                            !PA_SINK_IS_LINKED(sink->state))
+                            break;
+
+                        idx = sink->index;
+                    } else {
+                        pa_source *source;
 
-        if (key.size > strlen(prefix) && strncmp(key.data, prefix, strlen(prefix)) == 0) {
-            char *name, *device_name;
-            struct entry *e;
-
-            name = pa_xstrndup(key.data, key.size);
-            pa_assert_se(device_name = get_name(name, prefix));
-
-            if ((e = entry_read(u, name))) {
-                for (uint32_t i = 0; i < NUM_ROLES; ++i) {
-                    if (!highest_priority_available[i] || e->priority[i] < highest_priority_available[i]) {
-                        /* We've found a device with a higher priority than that we've currently got,
-                           so see if it is currently available or not and update our list */
-                        uint32_t idx;
-                        bool found = false;
-
-                        if (sink_mode) {
-                            pa_sink *sink;
-
-                            PA_IDXSET_FOREACH(sink, u->core->sinks, idx) {
-                                if ((pa_sink*) ignore_device == sink)
-                                    continue;
-                                if (!PA_SINK_IS_LINKED(sink->state))
-                                    continue;
-                                if (pa_streq(sink->name, device_name)) {
-                                    found = true;
-                                    idx = sink->index; /* Is this needed? */
-                                    break;
-                                }
-                            }
-                        } else {
-                            pa_source *source;
-
-                            PA_IDXSET_FOREACH(source, u->core->sources, idx) {
-                                if ((pa_source*) ignore_device == source)
-                                    continue;
-                                if (!PA_SOURCE_IS_LINKED(source->state))
-                                    continue;
-                                if (pa_streq(source->name, device_name)) {
-                                    found = true;
-                                    idx = source->index; /* Is this needed? */
-                                    break;
-                                }
-                            }
-                        }
-                        if (found) {
-                            highest_priority_available[i] = e->priority[i];
-                            (*indexes)[i] = idx;
-                        }
+                        if (!(source = pa_namereg_get(u->core, name + strlen(prefix), PA_NAMEREG_SOURCE)) ||
+                            (pa_source*) ignore_device == source ||
+                            !PA_SOURCE_IS_LINKED(source->state))
+                            break;
 
+                        idx = source->index;
                     }
                 }
 
-                entry_free(e);
+                highest_priority_available[i] = e->priority[i];
+                (*indexes)[i] = idx;
             }
-
-            pa_xfree(name);
-            pa_xfree(device_name);
         }
-
-        pa_datum_free(&key);
-        key = next_key;
     }
 }
 
@@ -1274,16 +1327,12 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
 
       while (!pa_tagstruct_eof(t)) {
         const char *name;
-        pa_datum key;
 
         if (pa_tagstruct_gets(t, &name) < 0)
           goto fail;
 
-        key.data = (char*) name;
-        key.size = strlen(name);
-
         /** @todo: Reindex the priorities */
-        pa_database_unset(u->database, &key);
+        entry_remove(u, name);
       }
 
       trigger_save(u);
@@ -1572,6 +1621,7 @@ int pa__init(pa_module*m) {
     u->on_hotplug = on_hotplug;
     u->on_rescue = on_rescue;
     u->subscribed = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    u->entries = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, (pa_free_cb_t) entry_free);
 
     u->protocol = pa_native_protocol_get(m->core);
     pa_native_protocol_install_ext(u->protocol, m, extension_cb);
@@ -1613,6 +1663,8 @@ int pa__init(pa_module*m) {
     pa_log_info("Successfully opened database file '%s'.", fname);
     pa_xfree(fname);
 
+    load_entries(u);
+
     /* Attempt to inject the devices into the list in priority order */
     total_devices = PA_MAX(pa_idxset_size(m->core->sinks), pa_idxset_size(m->core->sources));
     if (total_devices > 0 && total_devices < 128) {
@@ -1731,6 +1783,9 @@ void pa__done(pa_module*m) {
     if (u->database)
         pa_database_close(u->database);
 
+    if (u->entries)
+        pa_hashmap_free(u->entries);
+
     if (u->protocol) {
         pa_native_protocol_remove_ext(u->protocol, m);
         pa_native_protocol_unref(u->protocol);
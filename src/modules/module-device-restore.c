@@ -80,6 +80,7 @@ struct userdata {
     pa_subscription *subscription;
     pa_time_event *save_time_event;
     pa_database *database;
+    pa_database_cache *cache;
 
     pa_native_protocol *protocol;
     pa_idxset *subscribed;
@@ -130,7 +131,7 @@ static void save_time_callback(pa_mainloop_api*a, pa_time_event* e, const struct
     u->core->mainloop->time_free(u->save_time_event);
     u->save_time_event = NULL;
 
-    pa_database_sync(u->database);
+    pa_database_cache_sync(u->cache);
     pa_log_info("Synced.");
 }
 
@@ -201,7 +202,7 @@ static bool entry_write(struct userdata *u, const char *name, const struct entry
 
     data.data = (void*)pa_tagstruct_data(t, &data.size);
 
-    r = (pa_database_set(u->database, &key, &data, true) == 0);
+    r = (pa_database_cache_set(u->cache, &key, &data, true) == 0);
 
     pa_tagstruct_free(t);
 
@@ -222,7 +223,7 @@ static struct entry* entry_read(struct userdata *u, const char *name) {
 
     pa_zero(data);
 
-    if (!pa_database_get(u->database, &key, &data)) {
+    if (!pa_database_cache_get(u->cache, &key, &data)) {
         pa_log_debug("Database contains no data for key: %s", name);
         return NULL;
     }
@@ -380,7 +381,7 @@ static bool perportentry_write(struct userdata *u, const char *basekeyname, cons
 
     data.data = (void*)pa_tagstruct_data(t, &data.size);
 
-    r = (pa_database_set(u->database, &key, &data, true) == 0);
+    r = (pa_database_cache_set(u->cache, &key, &data, true) == 0);
 
     pa_tagstruct_free(t);
     pa_xfree(name);
@@ -405,7 +406,7 @@ static struct perportentry* perportentry_read(struct userdata *u, const char *ba
 
     pa_zero(data);
 
-    if (!pa_database_get(u->database, &key, &data))
+    if (!pa_database_cache_get(u->cache, &key, &data))
         goto fail;
 
     t = pa_tagstruct_new_fixed(data.data, data.size);
@@ -1266,6 +1267,9 @@ int pa__init(pa_module*m) {
     pa_log_info("Successfully opened database file '%s'.", fname);
     pa_xfree(fname);
 
+    /* Only write out volume changes when the save timer fires */
+    u->cache = pa_database_cache_new(u->database);
+
     PA_IDXSET_FOREACH(sink, m->core->sinks, idx)
         subscribe_callback(m->core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_NEW, sink->index, u);
 
@@ -1297,9 +1301,12 @@ void pa__done(pa_module*m) {
 
     if (u->save_time_event) {
         u->core->mainloop->time_free(u->save_time_event);
-        pa_database_sync(u->database);
+        pa_database_cache_sync(u->cache);
     }
 
+    if (u->cache)
+        pa_database_cache_free(u->cache);
+
     if (u->database)
         pa_database_close(u->database);
 
@@ -63,6 +63,7 @@
 #include <pulsecore/database.h>
 #include <pulsecore/protocol-dbus.h>
 #include <pulsecore/dbus-util.h>
+#include <pulsecore/filter/convolver.h>
 
 #include "module-equalizer-sink-symdef.h"
 
@@ -80,10 +81,17 @@ PA_MODULE_USAGE(
           "channel_map=<channel map> "
           "autoloaded=<set if this module is being loaded automatically> "
           "use_volume_sharing=<yes or no> "
+          "low_latency=<yes or no> "
+          "partition_size=<frames of latency in low latency mode, a power of two> "
          ));
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 #define DEFAULT_AUTOLOADED false
+#define DEFAULT_PARTITION_SIZE 256
+#define MIN_PARTITION_SIZE 16
+#define MAX_PARTITION_SIZE 8192
+/* Floor for the magnitude response when taking its logarithm, -120dB */
+#define MIN_MAGNITUDE 1e-6f
 
 struct userdata {
     pa_module *module;
@@ -127,6 +135,28 @@ struct userdata {
 
     pa_database *database;
     char **base_profiles;
+
+    /* All channels in one plan, for when they share the same filter */
+    float *work_buffers;
+    fftwf_complex *output_windows;
+    fftwf_plan forward_plan_many, inverse_plan_many;
+
+    /* Low latency mode: instead of the sliding STFT, the input is
+     * convolved with minimum phase versions of the filters, in
+     * partitions of partition_size frames. The impulse responses are
+     * designed in the main thread along with the filters and picked up
+     * by the IO thread whenever their serial changes. */
+    bool low_latency;
+    size_t partition_size;
+    size_t filter_taps;
+    pa_convolver *convolver;
+    float ***irs;
+    unsigned **ir_serials;
+    unsigned *applied_ir_serials;
+    unsigned ir_serial;
+    float *design_buffer;
+    fftwf_complex *design_window;
+    fftwf_plan design_forward_plan, design_inverse_plan;
 };
 
 static const char* const valid_modargs[] = {
@@ -139,6 +169,8 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "autoloaded",
     "use_volume_sharing",
+    "low_latency",
+    "partition_size",
     NULL
 };
 
@@ -165,6 +197,57 @@ static void fix_filter(float *H, size_t fft_size) {
         H[i] /= fft_size;
 }
 
+/* Turn a magnitude response into a minimum phase impulse response of
+ * filter_taps samples, using the real cepstrum: the logarithm of the
+ * magnitude is transformed back, folded onto its causal half and
+ * exponentiated again. Called from main context. */
+static void design_min_phase(struct userdata *u, float X, const float *H, float *ir) {
+    const size_t n = u->fft_size, fade = u->filter_taps / 8;
+    float *buffer = u->design_buffer;
+    fftwf_complex *window = u->design_window;
+
+    /* H has the fft gain divided out already */
+    for (size_t i = 0; i < FILTER_SIZE(u); ++i) {
+        window[i][0] = logf(PA_MAX(fabsf(X * H[i] * n), MIN_MAGNITUDE));
+        window[i][1] = 0;
+    }
+
+    fftwf_execute(u->design_inverse_plan);
+
+    buffer[0] /= n;
+    for (size_t i = 1; i < n / 2; ++i)
+        buffer[i] *= 2.0f / n;
+    buffer[n / 2] /= n;
+    memset(buffer + n / 2 + 1, 0, (n / 2 - 1) * sizeof(float));
+
+    fftwf_execute(u->design_forward_plan);
+
+    for (size_t i = 0; i < FILTER_SIZE(u); ++i) {
+        float m = expf(window[i][0]), phi = window[i][1];
+
+        window[i][0] = m * cosf(phi);
+        window[i][1] = m * sinf(phi);
+    }
+
+    fftwf_execute(u->design_inverse_plan);
+
+    for (size_t i = 0; i < u->filter_taps; ++i)
+        ir[i] = buffer[i] / n;
+
+    /* Fade out what is left of the response at the end */
+    for (size_t i = 0; i < fade; ++i)
+        ir[u->filter_taps - fade + i] *= (float) (.5 * (1 + cos(M_PI * (i + 1) / fade)));
+}
+
+/* To be called by writers of a filter before pa_aupdate_write_end() */
+static void filter_changed(struct userdata *u, size_t channel, unsigned a_i) {
+    if (!u->low_latency)
+        return;
+
+    design_min_phase(u, u->Xs[channel][a_i], u->Hs[channel][a_i], u->irs[channel][a_i]);
+    u->ir_serials[channel][a_i] = ++u->ir_serial;
+}
+
 static void interpolate(float *samples, size_t length, uint32_t *xs, float *ys, size_t n_points) {
     /* Note that xs must be monotonically increasing! */
     float x_range_lower, x_range_upper, c0;
@@ -263,6 +346,10 @@ static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t of
                 pa_bytes_to_usec(pa_memblockq_get_length(u->output_q) +
                                  pa_memblockq_get_length(u->input_q), &u->sink_input->sink->sample_spec) +
                 pa_bytes_to_usec(pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq), &u->sink_input->sink->sample_spec);
+
+            /* The partition the convolver is working on */
+            if (u->low_latency)
+                *((pa_usec_t*) data) += pa_bytes_to_usec(u->partition_size * pa_frame_size(&u->sink->sample_spec), &u->sink->sample_spec);
             //    pa_bytes_to_usec(u->samples_gathered * fs, &u->sink->sample_spec);
             //+ pa_bytes_to_usec(u->latency * fs, ss)
             return 0;
@@ -500,6 +587,71 @@ static void dsp_logic(
 }
 #endif
 
+/* Same as dsp_logic(), for all channels at once, with the same filter */
+static void dsp_logic_shared(struct userdata *u, const float X, const float *H) {
+    const size_t filter_size = FILTER_SIZE(u);
+
+    for (size_t c = 0; c < u->channels; ++c) {
+        float *dst = u->work_buffers + c * u->fft_size;
+
+        for (size_t j = 0; j < u->window_size; ++j)
+            dst[j] = X * u->W[j] * u->input[c][j];
+
+        memset(dst + u->window_size, 0, (u->fft_size - u->window_size) * sizeof(float));
+    }
+
+    fftwf_execute(u->forward_plan_many);
+
+    for (size_t j = 0; j < filter_size; ++j) {
+        const float h = H[j];
+
+        for (size_t c = 0; c < u->channels; ++c) {
+            u->output_windows[c * filter_size + j][0] *= h;
+            u->output_windows[c * filter_size + j][1] *= h;
+        }
+    }
+
+    fftwf_execute(u->inverse_plan_many);
+
+    for (size_t c = 0; c < u->channels; ++c) {
+        float *dst = u->work_buffers + c * u->fft_size;
+        float *overlap = u->overlap_accum[c];
+
+        for (size_t j = 0; j < u->overlap_size; ++j) {
+            dst[j] += overlap[j];
+            overlap[j] = dst[u->R + j];
+        }
+
+        memmove(u->input[c], u->input[c] + u->R, (u->samples_gathered - u->R) * sizeof(float));
+    }
+}
+
+static bool filters_shared(struct userdata *u, const unsigned *a_i) {
+    if (!u->forward_plan_many)
+        return false;
+
+    for (size_t c = 1; c < u->channels; ++c)
+        if (u->Xs[c][a_i[c]] != u->Xs[0][a_i[0]] ||
+            memcmp(u->Hs[c][a_i[c]], u->Hs[0][a_i[0]], FILTER_SIZE(u) * sizeof(float)) != 0)
+            return false;
+
+    return true;
+}
+
+static void output_channel(struct userdata *u, size_t c, float *buffer, size_t offset) {
+    size_t fs = pa_frame_size(&(u->sink->sample_spec));
+
+    if (u->first_iteration) {
+        /* The windowing function will make the audio ramped in, as a cheap fix we can
+         * undo the windowing (for non-zero window values)
+         */
+        for(size_t i = 0; i < u->overlap_size; ++i) {
+            buffer[i] = u->W[i] <= FLT_EPSILON ? buffer[i] : buffer[i] / u->W[i];
+        }
+    }
+    pa_sample_clamp(PA_SAMPLE_FLOAT32NE, (uint8_t *) (((float *)u->output_buffer) + c) + offset, fs, buffer, sizeof(float), u->R);
+}
+
 static void flatten_to_memblockq(struct userdata *u) {
     size_t mbs = pa_mempool_block_size_max(u->sink->core->mempool);
     pa_memchunk tchunk;
@@ -521,8 +673,7 @@ static void flatten_to_memblockq(struct userdata *u) {
 
 static void process_samples(struct userdata *u) {
     size_t fs = pa_frame_size(&(u->sink->sample_spec));
-    unsigned a_i;
-    float *H, X;
+    unsigned a_i[PA_CHANNELS_MAX];
     size_t iterations, offset;
     pa_assert(u->samples_gathered >= u->window_size);
     iterations = (u->samples_gathered - u->overlap_size) / u->R;
@@ -536,31 +687,33 @@ static void process_samples(struct userdata *u) {
 
     for(size_t iter = 0; iter < iterations; ++iter) {
         offset = iter * u->R * fs;
-        for(size_t c = 0;c < u->channels; c++) {
-            a_i = pa_aupdate_read_begin(u->a_H[c]);
-            X = u->Xs[c][a_i];
-            H = u->Hs[c][a_i];
-            dsp_logic(
-                u->work_buffer,
-                u->input[c],
-                u->overlap_accum[c],
-                X,
-                H,
-                u->W,
-                u->output_window,
-                u
-            );
-            pa_aupdate_read_end(u->a_H[c]);
-            if (u->first_iteration) {
-                /* The windowing function will make the audio ramped in, as a cheap fix we can
-                 * undo the windowing (for non-zero window values)
-                 */
-                for(size_t i = 0; i < u->overlap_size; ++i) {
-                    u->work_buffer[i] = u->W[i] <= FLT_EPSILON ? u->work_buffer[i] : u->work_buffer[i] / u->W[i];
-                }
+        for(size_t c = 0; c < u->channels; c++)
+            a_i[c] = pa_aupdate_read_begin(u->a_H[c]);
+
+        if (filters_shared(u, a_i)) {
+            dsp_logic_shared(u, u->Xs[0][a_i[0]], u->Hs[0][a_i[0]]);
+
+            for(size_t c = 0; c < u->channels; c++)
+                output_channel(u, c, u->work_buffers + c * u->fft_size, offset);
+        } else {
+            for(size_t c = 0; c < u->channels; c++) {
+                dsp_logic(
+                    u->work_buffer,
+                    u->input[c],
+                    u->overlap_accum[c],
+                    u->Xs[c][a_i[c]],
+                    u->Hs[c][a_i[c]],
+                    u->W,
+                    u->output_window,
+                    u
+                );
+                output_channel(u, c, u->work_buffer, offset);
             }
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, (uint8_t *) (((float *)u->output_buffer) + c) + offset, fs, u->work_buffer, sizeof(float), u->R);
         }
+
+        for(size_t c = 0; c < u->channels; c++)
+            pa_aupdate_read_end(u->a_H[c]);
+
         if (u->first_iteration) {
             u->first_iteration = false;
         }
@@ -586,6 +739,66 @@ static void input_buffer(struct userdata *u, pa_memchunk *in) {
     pa_memblock_release(in->memblock);
 }
 
+/* Called from I/O thread context */
+static void update_responses(struct userdata *u) {
+    for (size_t c = 0; c < u->channels; c++) {
+        unsigned a_i = pa_aupdate_read_begin(u->a_H[c]);
+
+        if (u->ir_serials[c][a_i] != u->applied_ir_serials[c]) {
+            pa_convolver_set_response(u->convolver, c, c, u->irs[c][a_i], u->filter_taps);
+            u->applied_ir_serials[c] = u->ir_serials[c][a_i];
+        }
+
+        pa_aupdate_read_end(u->a_H[c]);
+    }
+}
+
+/* Called from I/O thread context */
+static int pop_low_latency(struct userdata *u, size_t nbytes, pa_memchunk *chunk) {
+    size_t fs = pa_frame_size(&u->sink->sample_spec);
+    pa_memchunk tchunk;
+    float *src, *dst;
+    size_t n;
+
+    /* Hmm, process any rewind request that might be queued up */
+    pa_sink_process_rewind(u->sink, 0);
+
+    while (pa_memblockq_peek(u->input_q, &tchunk) < 0) {
+        pa_memchunk nchunk;
+
+        pa_sink_render(u->sink, nbytes, &nchunk);
+        pa_memblockq_push(u->input_q, &nchunk);
+        pa_memblock_unref(nchunk.memblock);
+    }
+
+    tchunk.length = PA_MIN(nbytes, tchunk.length);
+    pa_assert(tchunk.length > 0);
+
+    n = tchunk.length / fs;
+    pa_assert(n > 0);
+
+    chunk->index = 0;
+    chunk->length = n * fs;
+    chunk->memblock = pa_memblock_new(u->sink->core->mempool, chunk->length);
+
+    pa_memblockq_drop(u->input_q, chunk->length);
+
+    update_responses(u);
+
+    src = pa_memblock_acquire_chunk(&tchunk);
+    dst = pa_memblock_acquire(chunk->memblock);
+
+    pa_convolver_process(u->convolver, src, dst, n);
+    pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst, sizeof(float), dst, sizeof(float), n * u->channels);
+
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_release(chunk->memblock);
+
+    pa_memblock_unref(tchunk.memblock);
+
+    return 0;
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
@@ -599,6 +812,9 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     pa_assert(chunk);
     pa_assert(u->sink);
 
+    if (u->low_latency)
+        return pop_low_latency(u, nbytes, chunk);
+
     /* FIXME: Please clean this up. I see more commented code lines
      * than uncommented code lines. I am sorry, but I am too dumb to
      * understand this. */
@@ -738,6 +954,8 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
             pa_memblockq_seek(u->input_q, - (int64_t) amount, PA_SEEK_RELATIVE, true);
             pa_log("Resetting filter");
             //reset_filter(u); //this is the "proper" thing to do...
+            if (u->low_latency)
+                pa_convolver_reset(u->convolver);
         }
     }
 
@@ -767,7 +985,11 @@ static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
     pa_assert_se(u = i->userdata);
 
     fs = pa_frame_size(&u->sink_input->sample_spec);
-    pa_sink_set_max_request_within_thread(u->sink, PA_ROUND_UP(nbytes / fs, u->R) * fs);
+
+    if (u->low_latency)
+        pa_sink_set_max_request_within_thread(u->sink, nbytes);
+    else
+        pa_sink_set_max_request_within_thread(u->sink, PA_ROUND_UP(nbytes / fs, u->R) * fs);
 }
 
 /* Called from I/O thread context */
@@ -815,11 +1037,16 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
 
     fs = pa_frame_size(&u->sink_input->sample_spec);
-    /* set buffer size to max request, no overlap copy */
-    max_request = PA_ROUND_UP(pa_sink_input_get_max_request(u->sink_input) / fs, u->R);
-    max_request = PA_MAX(max_request, u->window_size);
 
-    pa_sink_set_max_request_within_thread(u->sink, max_request * fs);
+    if (u->low_latency)
+        pa_sink_set_max_request_within_thread(u->sink, pa_sink_input_get_max_request(u->sink_input));
+    else {
+        /* set buffer size to max request, no overlap copy */
+        max_request = PA_ROUND_UP(pa_sink_input_get_max_request(u->sink_input) / fs, u->R);
+        max_request = PA_MAX(max_request, u->window_size);
+
+        pa_sink_set_max_request_within_thread(u->sink, max_request * fs);
+    }
 
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
@@ -991,6 +1218,7 @@ static const char* load_profile(struct userdata *u, size_t channel, char *name)
             u->Xs[channel][a_i] = profile[0];
             memcpy(u->Hs[channel][a_i], profile + 1, FILTER_SIZE(u) * sizeof(float));
             fix_filter(u->Hs[channel][a_i], u->fft_size);
+            filter_changed(u, channel, a_i);
             pa_aupdate_write_end(u->a_H[channel]);
             pa_xfree(u->base_profiles[channel]);
             u->base_profiles[channel] = pa_xstrdup(name);
@@ -1031,6 +1259,7 @@ static void load_state(struct userdata *u) {
                 H = state + c * CHANNEL_PROFILE_SIZE(u) + 1;
                 u->Xs[c][a_i] = state[c * CHANNEL_PROFILE_SIZE(u)];
                 memcpy(u->Hs[c][a_i], H, FILTER_SIZE(u) * sizeof(float));
+                filter_changed(u, c, a_i);
                 pa_aupdate_write_end(u->a_H[c]);
             }
             unpack(((char *)value.data) + FILTER_STATE_SIZE(u) * sizeof(float), value.size - FILTER_STATE_SIZE(u) * sizeof(float), &names, &n_profs);
@@ -1092,6 +1321,8 @@ int pa__init(pa_module*m) {
     float *H;
     unsigned a_i;
     bool use_volume_sharing = true;
+    bool low_latency = false;
+    uint32_t partition_size = DEFAULT_PARTITION_SIZE;
 
     pa_assert(m);
 
@@ -1124,6 +1355,18 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "low_latency", &low_latency) < 0) {
+        pa_log("low_latency= expects a boolean argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "partition_size", &partition_size) < 0 ||
+        partition_size < MIN_PARTITION_SIZE || partition_size > MAX_PARTITION_SIZE ||
+        partition_size != pa_make_power_of_two(partition_size)) {
+        pa_log("partition_size= expects a power of two between %u and %u", MIN_PARTITION_SIZE, MAX_PARTITION_SIZE);
+        goto fail;
+    }
+
     u = pa_xnew0(struct userdata, 1);
     u->module = m;
     m->userdata = u;
@@ -1166,6 +1409,42 @@ int pa__init(pa_module*m) {
     hanning_window(u->W, u->window_size);
     u->first_iteration = true;
 
+    u->low_latency = low_latency;
+    u->partition_size = partition_size;
+
+    if (u->low_latency) {
+        u->filter_taps = u->fft_size / 8;
+        u->convolver = pa_convolver_new(u->partition_size, u->channels, u->channels, u->filter_taps);
+
+        u->irs = pa_xnew0(float **, u->channels);
+        u->ir_serials = pa_xnew0(unsigned *, u->channels);
+        u->applied_ir_serials = pa_xnew0(unsigned, u->channels);
+        for (c = 0; c < u->channels; ++c) {
+            u->irs[c] = pa_xnew0(float *, 2);
+            u->ir_serials[c] = pa_xnew0(unsigned, 2);
+            for (i = 0; i < 2; ++i)
+                u->irs[c][i] = alloc(u->filter_taps, sizeof(float));
+        }
+
+        u->design_buffer = alloc(u->fft_size, sizeof(float));
+        u->design_window = alloc(FILTER_SIZE(u), sizeof(fftwf_complex));
+        u->design_forward_plan = fftwf_plan_dft_r2c_1d(u->fft_size, u->design_buffer, u->design_window, FFTW_ESTIMATE);
+        u->design_inverse_plan = fftwf_plan_dft_c2r_1d(u->fft_size, u->design_window, u->design_buffer, FFTW_ESTIMATE);
+
+        pa_log_debug("Low latency mode with %zu taps in partitions of %zu", u->filter_taps, u->partition_size);
+    } else if (u->channels > 1) {
+        int n = (int) u->fft_size;
+
+        u->work_buffers = alloc(u->channels * u->fft_size, sizeof(float));
+        u->output_windows = alloc(u->channels * FILTER_SIZE(u), sizeof(fftwf_complex));
+        u->forward_plan_many = fftwf_plan_many_dft_r2c(1, &n, (int) u->channels,
+                                                       u->work_buffers, NULL, 1, n,
+                                                       u->output_windows, NULL, 1, (int) FILTER_SIZE(u), FFTW_ESTIMATE);
+        u->inverse_plan_many = fftwf_plan_many_dft_c2r(1, &n, (int) u->channels,
+                                                       u->output_windows, NULL, 1, (int) FILTER_SIZE(u),
+                                                       u->work_buffers, NULL, 1, n, FFTW_ESTIMATE);
+    }
+
     u->base_profiles = pa_xnew0(char *, u->channels);
     for (c = 0; c < u->channels; ++c)
         u->base_profiles[c] = pa_xstrdup("default");
@@ -1224,6 +1503,13 @@ int pa__init(pa_module*m) {
     u->output_buffer_max_length = 0;
 
     pa_sink_set_asyncmsgq(u->sink, master->asyncmsgq);
+
+    /* The overlap-add state can't be rewound, all a rewind through us
+     * does is reset the filter and redo whole FFT windows, so don't
+     * let streams on top of us ask for any */
+    if (!u->low_latency)
+        pa_sink_set_rewind_horizon(u->sink, 0);
+
     //pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->R*fs, &ss));
 
     /* Create sink input */
@@ -1274,6 +1560,7 @@ int pa__init(pa_module*m) {
             H[i] = 1.0 / sqrtf(2.0f);
 
         fix_filter(H, u->fft_size);
+        filter_changed(u, c, a_i);
         pa_aupdate_write_end(u->a_H[c]);
     }
 
@@ -1344,6 +1631,35 @@ void pa__done(pa_module*m) {
     fftwf_destroy_plan(u->inverse_plan);
     fftwf_destroy_plan(u->forward_plan);
     fftwf_free(u->output_window);
+
+    if (u->forward_plan_many) {
+        fftwf_destroy_plan(u->inverse_plan_many);
+        fftwf_destroy_plan(u->forward_plan_many);
+    }
+    fftwf_free(u->output_windows);
+    fftwf_free(u->work_buffers);
+
+    if (u->convolver)
+        pa_convolver_free(u->convolver);
+
+    if (u->design_forward_plan) {
+        fftwf_destroy_plan(u->design_inverse_plan);
+        fftwf_destroy_plan(u->design_forward_plan);
+    }
+    fftwf_free(u->design_window);
+    fftwf_free(u->design_buffer);
+
+    if (u->irs) {
+        for (c = 0; c < u->channels; ++c) {
+            for (size_t i = 0; i < 2; ++i)
+                fftwf_free(u->irs[c][i]);
+            pa_xfree(u->irs[c]);
+            pa_xfree(u->ir_serials[c]);
+        }
+        pa_xfree(u->irs);
+        pa_xfree(u->ir_serials);
+        pa_xfree(u->applied_ir_serials);
+    }
     for (c = 0; c < u->channels; ++c) {
         pa_aupdate_free(u->a_H[c]);
         fftwf_free(u->overlap_accum[c]);
@@ -1852,9 +2168,11 @@ void equalizer_handle_seed_filter(DBusConnection *conn, DBusMessage *msg, void *
             float *H_p = u->Hs[c][b_i];
             u->Xs[c][b_i] = preamp;
             memcpy(H_p, H, FILTER_SIZE(u) * sizeof(float));
+            filter_changed(u, c, b_i);
             pa_aupdate_write_end(u->a_H[c]);
         }
     }
+    filter_changed(u, r_channel, a_i);
     pa_aupdate_write_end(u->a_H[r_channel]);
     pa_xfree(ys);
 
@@ -2002,9 +2320,11 @@ static void set_filter(struct userdata *u, size_t channel, double *H_, double pr
             unsigned b_i = pa_aupdate_write_begin(u->a_H[c]);
             u->Xs[c][b_i] = u->Xs[r_channel][a_i];
             memcpy(u->Hs[c][b_i], u->Hs[r_channel][a_i], FILTER_SIZE(u) * sizeof(float));
+            filter_changed(u, c, b_i);
             pa_aupdate_write_end(u->a_H[c]);
         }
     }
+    filter_changed(u, r_channel, a_i);
     pa_aupdate_write_end(u->a_H[r_channel]);
 }
 
@@ -56,6 +56,7 @@ static const char* const valid_modargs[] = {
 
 struct filter {
     char *name;
+    char *parameters;
     uint32_t module_index;
     pa_sink *sink;
     pa_sink *sink_master;
@@ -74,15 +75,21 @@ struct userdata {
     pa_time_event *housekeeping_time_event;
 };
 
+/* Filters are identified by name, master(s) and parameters, so that all
+ * streams asking for the same thing end up on one instance */
 static unsigned filter_hash(const void *p) {
     const struct filter *f = p;
+    unsigned hash = pa_idxset_string_hash_func(f->name);
+
+    if (f->parameters)
+        hash = 31 * hash + pa_idxset_string_hash_func(f->parameters);
 
     if (f->sink_master && !f->source_master)
-        return (unsigned) (f->sink_master->index + pa_idxset_string_hash_func(f->name));
+        return (unsigned) (f->sink_master->index + hash);
     else if (!f->sink_master && f->source_master)
-        return (unsigned) ((f->source_master->index << 16) + pa_idxset_string_hash_func(f->name));
+        return (unsigned) ((f->source_master->index << 16) + hash);
     else
-        return (unsigned) (f->sink_master->index + (f->source_master->index << 16) + pa_idxset_string_hash_func(f->name));
+        return (unsigned) (f->sink_master->index + (f->source_master->index << 16) + hash);
 }
 
 static int filter_compare(const void *a, const void *b) {
@@ -93,17 +100,22 @@ static int filter_compare(const void *a, const void *b) {
         return 1;
     if ((r = strcmp(fa->name, fb->name)))
         return r;
+    if (!fa->parameters != !fb->parameters)
+        return 1;
+    if (fa->parameters && (r = strcmp(fa->parameters, fb->parameters)))
+        return r;
 
     return 0;
 }
 
-static struct filter *filter_new(const char *name, pa_sink *sink, pa_source *source) {
+static struct filter *filter_new(const char *name, const char *parameters, pa_sink *sink, pa_source *source) {
     struct filter *f;
 
     pa_assert(sink || source);
 
     f = pa_xnew(struct filter, 1);
     f->name = pa_xstrdup(name);
+    f->parameters = pa_xstrdup(parameters);
     f->sink_master = sink;
     f->source_master = source;
     f->module_index = PA_INVALID_INDEX;
@@ -117,6 +129,7 @@ static void filter_free(struct filter *f) {
     pa_assert(f);
 
     pa_xfree(f->name);
+    pa_xfree(f->parameters);
     pa_xfree(f);
 }
 
@@ -140,6 +153,42 @@ static const char* should_filter(pa_object *o, bool is_sink_input) {
     return NULL;
 }
 
+static const char* get_filter_parameters(pa_object *o, const char *want, bool is_sink_input) {
+    const char *parameters;
+    char *prop_parameters;
+    pa_proplist *pl;
+
+    if (is_sink_input)
+        pl = PA_SINK_INPUT(o)->proplist;
+    else
+        pl = PA_SOURCE_OUTPUT(o)->proplist;
+
+    prop_parameters = pa_sprintf_malloc(PA_PROP_FILTER_APPLY_PARAMETERS, want);
+    parameters = pa_proplist_gets(pl, prop_parameters);
+    pa_xfree(prop_parameters);
+
+    /* No parameters and empty parameters share the default instance */
+    if (parameters && !*parameters)
+        parameters = NULL;
+
+    return parameters;
+}
+
+/* The filter we loaded whose sink or source the stream is on, if any */
+static struct filter *find_filter_for_object(struct userdata *u, pa_object *o, bool is_sink_input) {
+    struct filter *filter;
+    void *state;
+
+    PA_HASHMAP_FOREACH(filter, u->filters, state) {
+        if (is_sink_input && filter->sink && filter->sink == PA_SINK_INPUT(o)->sink)
+            return filter;
+        if (!is_sink_input && filter->source && filter->source == PA_SOURCE_OUTPUT(o)->source)
+            return filter;
+    }
+
+    return NULL;
+}
+
 static bool should_group_filter(struct filter *filter) {
     return pa_streq(filter->name, "echo-cancel");
 }
@@ -359,7 +408,7 @@ static void move_objects_for_filter(struct userdata *u, pa_object *o, struct fil
 
 /* Note that we assume a filter will provide at most one sink and at most one
  * source (and at least one of either). */
-static void find_filters_for_module(struct userdata *u, pa_module *m, const char *name) {
+static void find_filters_for_module(struct userdata *u, pa_module *m, const char *name, const char *parameters) {
     uint32_t idx;
     pa_sink *sink;
     pa_source *source;
@@ -369,7 +418,7 @@ static void find_filters_for_module(struct userdata *u, pa_module *m, const char
         if (sink->module == m) {
             pa_assert(pa_sink_is_filter(sink));
 
-            fltr = filter_new(name, sink->input_to_master->sink, NULL);
+            fltr = filter_new(name, parameters, sink->input_to_master->sink, NULL);
             fltr->module_index = m->index;
             fltr->sink = sink;
 
@@ -382,7 +431,7 @@ static void find_filters_for_module(struct userdata *u, pa_module *m, const char
             pa_assert(pa_source_is_filter(source));
 
             if (!fltr) {
-                fltr = filter_new(name, NULL, source->output_from_master->source);
+                fltr = filter_new(name, parameters, NULL, source->output_from_master->source);
                 fltr->module_index = m->index;
                 fltr->source = source;
             } else {
@@ -411,7 +460,7 @@ static bool can_unload_module(struct userdata *u, uint32_t idx) {
 }
 
 static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_input) {
-    const char *want;
+    const char *want, *parameters;
     bool done_something = false;
     pa_sink *sink = NULL;
     pa_source *source = NULL;
@@ -443,13 +492,27 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
         if (!module)
             goto done;
 
+        parameters = get_filter_parameters(o, want, is_sink_input);
+
         module_name = pa_sprintf_malloc("module-%s", want);
         if (pa_streq(module->name, module_name)) {
-            pa_log_debug("Stream appears to be playing on an appropriate sink already. Ignoring.");
-            goto done;
+            struct filter *current;
+
+            /* If it's one of ours set up differently, go through its
+             * master to the instance this stream wants */
+            if (!(current = find_filter_for_object(u, o, is_sink_input)) ||
+                pa_safe_streq(current->parameters, parameters)) {
+                pa_log_debug("Stream appears to be playing on an appropriate sink already. Ignoring.");
+                goto done;
+            }
+
+            if (is_sink_input)
+                sink = current->sink_master;
+            else
+                source = current->source_master;
         }
 
-        fltr = filter_new(want, sink, source);
+        fltr = filter_new(want, parameters, sink, source);
 
         if (should_group_filter(fltr) && !find_paired_master(u, fltr, o, is_sink_input)) {
             pa_log_debug("Want group filtering but don't have enough streams.");
@@ -460,16 +523,17 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
             char *args;
             pa_module *m;
 
-            args = pa_sprintf_malloc("autoloaded=1 %s%s %s%s",
+            args = pa_sprintf_malloc("autoloaded=1 %s%s %s%s %s",
                     fltr->sink_master ? "sink_master=" : "",
                     fltr->sink_master ? fltr->sink_master->name : "",
                     fltr->source_master ? "source_master=" : "",
-                    fltr->source_master ? fltr->source_master->name : "");
+                    fltr->source_master ? fltr->source_master->name : "",
+                    fltr->parameters ? fltr->parameters : "");
 
             pa_log_debug("Loading %s with arguments '%s'", module_name, args);
 
             if ((m = pa_module_load(u->core, module_name, args))) {
-                find_filters_for_module(u, m, want);
+                find_filters_for_module(u, m, want, parameters);
                 filter = pa_hashmap_get(u->filters, fltr);
                 done_something = true;
             }
@@ -506,7 +570,9 @@ static pa_hook_result_t process(struct userdata *u, pa_object *o, bool is_sink_i
 
 done:
     pa_xfree(module_name);
-    pa_xfree(fltr);
+
+    if (fltr)
+        filter_free(fltr);
 
     return PA_HOOK_OK;
 }
@@ -47,6 +47,21 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
+/* Anything that might change which device a role maps to */
+static const pa_core_hook_t sink_flush_hooks[] = {
+    PA_CORE_HOOK_SINK_PUT,
+    PA_CORE_HOOK_SINK_UNLINK_POST,
+    PA_CORE_HOOK_SINK_PROPLIST_CHANGED,
+    PA_CORE_HOOK_DEFAULT_SINK_CHANGED
+};
+
+static const pa_core_hook_t source_flush_hooks[] = {
+    PA_CORE_HOOK_SOURCE_PUT,
+    PA_CORE_HOOK_SOURCE_UNLINK_POST,
+    PA_CORE_HOOK_SOURCE_PROPLIST_CHANGED,
+    PA_CORE_HOOK_DEFAULT_SOURCE_CHANGED
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -57,19 +72,132 @@ struct userdata {
         *sink_put_hook_slot,
         *source_put_hook_slot,
         *sink_unlink_hook_slot,
-        *source_unlink_hook_slot;
+        *source_unlink_hook_slot,
+        *sink_flush_slots[PA_ELEMENTSOF(sink_flush_hooks)],
+        *source_flush_slots[PA_ELEMENTSOF(source_flush_hooks)];
+
+    /* Role -> device the last lookup for that role ended up with, or
+     * NO_DEVICE. Flushed whenever a device comes or goes, changes its
+     * properties or the default changes, so that notification-heavy
+     * clients don't walk every device's intended roles per stream. */
+    pa_hashmap *sink_roles, *source_roles;
 
     bool on_hotplug:1;
     bool on_rescue:1;
 };
 
+/* Roles are made up by clients, so don't remember an unbounded number
+ * of them */
+#define ROLES_MAX 64
+
+static char no_device;
+#define NO_DEVICE ((void*) &no_device)
+
 static bool role_match(pa_proplist *proplist, const char *role) {
     return pa_str_in_list_spaces(pa_proplist_gets(proplist, PA_PROP_DEVICE_INTENDED_ROLES), role);
 }
 
+static void roles_remember(pa_hashmap *roles, const char *role, void *device) {
+    if (pa_hashmap_size(roles) >= ROLES_MAX)
+        pa_hashmap_remove_all(roles);
+
+    pa_hashmap_put(roles, pa_xstrdup(role), device);
+}
+
+static pa_sink *find_sink(struct userdata *u, const char *role) {
+    pa_sink *s, *def;
+    uint32_t idx;
+
+    if ((s = pa_hashmap_get(u->sink_roles, role))) {
+        if (s == NO_DEVICE)
+            return NULL;
+
+        if (PA_SINK_IS_LINKED(pa_sink_get_state(s)))
+            return s;
+
+        /* Being unlinked right now */
+        pa_hashmap_remove_all(u->sink_roles);
+    }
+
+    /* Prefer the default sink over any other sink, just in case... */
+    if ((def = pa_namereg_get_default_sink(u->core)) && role_match(def->proplist, role)) {
+        roles_remember(u->sink_roles, role, def);
+        return def;
+    }
+
+    /* @todo: favour the highest priority device, not the first one we find? */
+    PA_IDXSET_FOREACH(s, u->core->sinks, idx) {
+        if (s == def)
+            continue;
+
+        if (!PA_SINK_IS_LINKED(pa_sink_get_state(s)))
+            continue;
+
+        if (role_match(s->proplist, role)) {
+            roles_remember(u->sink_roles, role, s);
+            return s;
+        }
+    }
+
+    roles_remember(u->sink_roles, role, NO_DEVICE);
+    return NULL;
+}
+
+static pa_source *find_source(struct userdata *u, const char *role) {
+    pa_source *s, *def;
+    uint32_t idx;
+
+    if ((s = pa_hashmap_get(u->source_roles, role))) {
+        if (s == NO_DEVICE)
+            return NULL;
+
+        if (PA_SOURCE_IS_LINKED(pa_source_get_state(s)))
+            return s;
+
+        /* Being unlinked right now */
+        pa_hashmap_remove_all(u->source_roles);
+    }
+
+    /* Prefer the default source over any other source, just in case... */
+    if ((def = pa_namereg_get_default_source(u->core)) && role_match(def->proplist, role)) {
+        roles_remember(u->source_roles, role, def);
+        return def;
+    }
+
+    /* @todo: favour the highest priority device, not the first one we find? */
+    PA_IDXSET_FOREACH(s, u->core->sources, idx) {
+        if (s->monitor_of)
+            continue;
+
+        if (s == def)
+            continue;
+
+        if (!PA_SOURCE_IS_LINKED(pa_source_get_state(s)))
+            continue;
+
+        if (role_match(s->proplist, role)) {
+            roles_remember(u->source_roles, role, s);
+            return s;
+        }
+    }
+
+    roles_remember(u->source_roles, role, NO_DEVICE);
+    return NULL;
+}
+
+static pa_hook_result_t sink_flush_hook_callback(pa_core *c, void *call_data, struct userdata *u) {
+    pa_hashmap_remove_all(u->sink_roles);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_flush_hook_callback(pa_core *c, void *call_data, struct userdata *u) {
+    pa_hashmap_remove_all(u->source_roles);
+    return PA_HOOK_OK;
+}
+
 static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_new_data *new_data, struct userdata *u) {
     const char *role;
-    pa_sink *s, *def;
+    pa_sink *s, *def, *found;
     uint32_t idx;
 
     pa_assert(c);
@@ -91,14 +219,22 @@ static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_n
         return PA_HOOK_OK;
     }
 
-    /* Prefer the default sink over any other sink, just in case... */
-    if ((def = pa_namereg_get_default_sink(c)))
-        if (role_match(def->proplist, role) && pa_sink_input_new_data_set_sink(new_data, def, false))
-            return PA_HOOK_OK;
+    if (!(found = find_sink(u, role)))
+        return PA_HOOK_OK;
+
+    if (pa_sink_input_new_data_set_sink(new_data, found, false))
+        return PA_HOOK_OK;
+
+    /* The sink we'd pick doesn't support the stream's formats, so look
+     * for another one the slow way */
+    def = pa_namereg_get_default_sink(c);
+
+    if (def && def != found && role_match(def->proplist, role) && pa_sink_input_new_data_set_sink(new_data, def, false))
+        return PA_HOOK_OK;
 
     /* @todo: favour the highest priority device, not the first one we find? */
     PA_IDXSET_FOREACH(s, c->sinks, idx) {
-        if (s == def)
+        if (s == def || s == found)
             continue;
 
         if (!PA_SINK_IS_LINKED(pa_sink_get_state(s)))
@@ -113,8 +249,7 @@ static pa_hook_result_t sink_input_new_hook_callback(pa_core *c, pa_sink_input_n
 
 static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_output_new_data *new_data, struct userdata *u) {
     const char *role;
-    pa_source *s, *def;
-    uint32_t idx;
+    pa_source *s;
 
     pa_assert(c);
     pa_assert(new_data);
@@ -135,29 +270,8 @@ static pa_hook_result_t source_output_new_hook_callback(pa_core *c, pa_source_ou
         return PA_HOOK_OK;
     }
 
-    /* Prefer the default source over any other source, just in case... */
-    if ((def = pa_namereg_get_default_source(c)))
-        if (role_match(def->proplist, role)) {
-            pa_source_output_new_data_set_source(new_data, def, false);
-            return PA_HOOK_OK;
-        }
-
-    PA_IDXSET_FOREACH(s, c->sources, idx) {
-        if (s->monitor_of)
-            continue;
-
-        if (s == def)
-            continue;
-
-        if (!PA_SOURCE_IS_LINKED(pa_source_get_state(s)))
-            continue;
-
-        /* @todo: favour the highest priority device, not the first one we find? */
-        if (role_match(s->proplist, role)) {
-            pa_source_output_new_data_set_source(new_data, s, false);
-            return PA_HOOK_OK;
-        }
-    }
+    if ((s = find_source(u, role)))
+        pa_source_output_new_data_set_source(new_data, s, false);
 
     return PA_HOOK_OK;
 }
@@ -370,6 +484,7 @@ int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
     struct userdata *u;
     bool on_hotplug = true, on_rescue = true;
+    unsigned i;
 
     pa_assert(m);
 
@@ -389,6 +504,14 @@ int pa__init(pa_module*m) {
     u->module = m;
     u->on_hotplug = on_hotplug;
     u->on_rescue = on_rescue;
+    u->sink_roles = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, NULL);
+    u->source_roles = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, NULL);
+
+    /* Before anything else reacts to the change and sets up streams */
+    for (i = 0; i < PA_ELEMENTSOF(sink_flush_hooks); i++)
+        u->sink_flush_slots[i] = pa_hook_connect(&m->core->hooks[sink_flush_hooks[i]], PA_HOOK_EARLY-10, (pa_hook_cb_t) sink_flush_hook_callback, u);
+    for (i = 0; i < PA_ELEMENTSOF(source_flush_hooks); i++)
+        u->source_flush_slots[i] = pa_hook_connect(&m->core->hooks[source_flush_hooks[i]], PA_HOOK_EARLY-10, (pa_hook_cb_t) source_flush_hook_callback, u);
 
     /* A little bit later than module-stream-restore */
     u->sink_input_new_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_NEW], PA_HOOK_EARLY+10, (pa_hook_cb_t) sink_input_new_hook_callback, u);
@@ -420,6 +543,7 @@ fail:
 
 void pa__done(pa_module*m) {
     struct userdata* u;
+    unsigned i;
 
     pa_assert(m);
 
@@ -441,5 +565,17 @@ void pa__done(pa_module*m) {
     if (u->source_unlink_hook_slot)
         pa_hook_slot_free(u->source_unlink_hook_slot);
 
+    for (i = 0; i < PA_ELEMENTSOF(u->sink_flush_slots); i++)
+        if (u->sink_flush_slots[i])
+            pa_hook_slot_free(u->sink_flush_slots[i]);
+    for (i = 0; i < PA_ELEMENTSOF(u->source_flush_slots); i++)
+        if (u->source_flush_slots[i])
+            pa_hook_slot_free(u->source_flush_slots[i]);
+
+    if (u->sink_roles)
+        pa_hashmap_free(u->sink_roles);
+    if (u->source_roles)
+        pa_hashmap_free(u->source_roles);
+
     pa_xfree(u);
 }
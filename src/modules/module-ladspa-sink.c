@@ -25,6 +25,7 @@
 #endif
 
 #include <math.h>
+#include <string.h>
 
 #include <pulse/xmalloc.h>
 
@@ -90,6 +91,10 @@ struct userdata {
 
     pa_memblockq *memblockq;
 
+    /* The plugin has been fed silence until its output died away, so
+     * we can skip it for as long as the input stays silent */
+    bool quiet;
+
     bool *use_default;
     pa_sample_spec ss;
 
@@ -435,13 +440,59 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
+/* Called from I/O thread context */
+static void process_samples(struct userdata *u, float *dst, float *src, unsigned n) {
+    unsigned h, c;
+
+    for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
+        for (c = 0; c < u->input_count; c++)
+            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c], sizeof(float), src+ h*u->max_ladspaport_count + c, u->channels*sizeof(float), n);
+        u->descriptor->run(u->handle[h], n);
+        for (c = 0; c < u->output_count; c++)
+            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[c], sizeof(float), n);
+    }
+}
+
+/* Anything below this is as good as silence, -120 dB */
+#define QUIET_LEVEL 1e-6f
+
+/* Called from I/O thread context. Runs the plugin unless the input is
+ * silent and its output has already died away. Returns false if it
+ * didn't, the output then is silence. */
+static bool process_chunk(struct userdata *u, float *dst, const pa_memchunk *chunk, unsigned n) {
+    float *src;
+    unsigned k;
+
+    if (!pa_memblock_is_silence(chunk->memblock))
+        u->quiet = false;
+    else if (u->quiet)
+        return false;
+
+    src = pa_memblock_acquire_chunk(chunk);
+    process_samples(u, dst, src, n);
+    pa_memblock_release(chunk->memblock);
+
+    /* Keep feeding silence until reverbs, delays and the like have
+     * nothing left to say */
+    if (pa_memblock_is_silence(chunk->memblock)) {
+        for (k = 0; k < n * u->channels; k++)
+            if (fabsf(dst[k]) >= QUIET_LEVEL)
+                break;
+
+        u->quiet = k >= n * u->channels;
+    }
+
+    return true;
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
-    float *src, *dst;
+    float *dst;
     size_t fs;
-    unsigned n, h, c;
+    unsigned n;
     pa_memchunk tchunk;
+    bool processed;
 
     pa_sink_input_assert_ref(i);
     pa_assert(chunk);
@@ -472,19 +523,61 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     pa_memblockq_drop(u->memblockq, chunk->length);
 
-    src = pa_memblock_acquire_chunk(&tchunk);
+    tchunk.length = chunk->length;
     dst = pa_memblock_acquire(chunk->memblock);
+    processed = process_chunk(u, dst, &tchunk, n);
+    pa_memblock_release(chunk->memblock);
 
-    for (h = 0; h < (u->channels / u->max_ladspaport_count); h++) {
-        for (c = 0; c < u->input_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, u->input[c], sizeof(float), src+ h*u->max_ladspaport_count + c, u->channels*sizeof(float), n);
-        u->descriptor->run(u->handle[h], n);
-        for (c = 0; c < u->output_count; c++)
-            pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[c], sizeof(float), n);
+    pa_memblock_unref(tchunk.memblock);
+
+    /* Hand out shared silence, so that the master can skip us */
+    if (!processed) {
+        pa_memblock_unref(chunk->memblock);
+        pa_silence_memchunk_get(&i->sink->core->silence_cache, i->sink->core->mempool, chunk, &i->sample_spec, n*fs);
     }
 
-    pa_memblock_release(tchunk.memblock);
-    pa_memblock_release(chunk->memblock);
+    return 0;
+}
+
+/* Called from I/O thread context. Runs the plugin straight into the
+ * master's buffer, saving us a block and a copy per stage. */
+static int sink_input_pop_into_cb(pa_sink_input *i, pa_memchunk *target) {
+    struct userdata *u;
+    float *dst;
+    size_t fs;
+    unsigned n;
+    pa_memchunk tchunk;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert(target);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_process_rewind(u->sink, 0);
+
+    /* Data that is left over from a rewind is handled by
+     * sink_input_pop_cb() */
+    if (pa_memblockq_is_readable(u->memblockq))
+        return -1;
+
+    pa_sink_render(u->sink, PA_MIN(target->length, u->block_size), &tchunk);
+
+    /* We still need the history for rewinding */
+    pa_memblockq_push(u->memblockq, &tchunk);
+    pa_memblockq_drop(u->memblockq, tchunk.length);
+
+    fs = pa_frame_size(&i->sample_spec);
+    n = (unsigned) (tchunk.length / fs);
+
+    pa_assert(n > 0);
+
+    target->length = n*fs;
+
+    dst = pa_memblock_acquire_chunk(target);
+
+    if (!process_chunk(u, dst, &tchunk, n))
+        memset(dst, 0, target->length);
+
+    pa_memblock_release(target->memblock);
 
     pa_memblock_unref(tchunk.memblock);
 
@@ -1274,6 +1367,7 @@ int pa__init(pa_module*m) {
         goto fail;
 
     u->sink_input->pop = sink_input_pop_cb;
+    u->sink_input->pop_into = sink_input_pop_into_cb;
     u->sink_input->process_rewind = sink_input_process_rewind_cb;
     u->sink_input->update_max_rewind = sink_input_update_max_rewind_cb;
     u->sink_input->update_max_request = sink_input_update_max_request_cb;
@@ -23,6 +23,7 @@
 #endif
 
 #include <stdio.h>
+#include <math.h>
 
 #include <pulse/xmalloc.h>
 
@@ -65,6 +66,11 @@ PA_MODULE_USAGE(
 
 #define DEFAULT_ADJUST_TIME_USEC (10*PA_USEC_PER_SEC)
 
+/* Latency filter tuning: the drift we expect between the clocks per
+ * second (100 ppm), and the floor of the measurement noise */
+#define FILTER_DRIFT_PER_SEC 100.0
+#define FILTER_MIN_NOISE_USEC 100.0
+
 typedef struct loopback_msg loopback_msg;
 
 struct userdata {
@@ -100,6 +106,12 @@ struct userdata {
 
     bool fixed_alsa_source;
 
+    /* Latency filter state, see adjust_rates() */
+    bool filter_valid;
+    double latency_estimate;
+    double latency_variance;
+    double noise_variance;
+
     /* Used for sink input and source output snapshots */
     struct {
         int64_t send_counter;
@@ -274,8 +286,44 @@ static void adjust_rates(struct userdata *u) {
 
     pa_log_debug("Loopback latency at base rate is %0.2f ms", (double)latency_at_optimum_rate / PA_USEC_PER_MSEC);
 
+    /* Single snapshots can be way off, especially with devices that
+     * deliver their data in bursts (USB), and correcting each of them
+     * makes the rate hunt. So we track the latency difference with a
+     * Kalman filter: between two runs the difference moves by what the
+     * rate we set last time corrected, plus the slow drift of the
+     * clocks. Everything beyond that is considered noise, which is
+     * learned from the innovations. */
+    if (!u->filter_valid) {
+        u->latency_estimate = latency_difference;
+        u->latency_variance = (double) latency_difference * latency_difference;
+        u->noise_variance = FILTER_MIN_NOISE_USEC * FILTER_MIN_NOISE_USEC;
+        u->filter_valid = true;
+    } else {
+        double drift, innovation, gain;
+
+        u->latency_estimate -= ((double) old_rate - base_rate) / base_rate * u->adjust_time;
+
+        drift = FILTER_DRIFT_PER_SEC * u->adjust_time / PA_USEC_PER_SEC;
+        u->latency_variance += drift * drift;
+
+        innovation = latency_difference - u->latency_estimate;
+        gain = u->latency_variance / (u->latency_variance + u->noise_variance);
+
+        u->latency_estimate += gain * innovation;
+        u->latency_variance *= 1.0 - gain;
+
+        u->noise_variance += 0.1 * (innovation * innovation - u->noise_variance);
+        u->noise_variance = PA_MAX(u->noise_variance, FILTER_MIN_NOISE_USEC * FILTER_MIN_NOISE_USEC);
+
+        pa_log_debug("Latency filter: innovation %0.2f ms, gain %0.3f, noise %0.2f ms, deviation %0.2f ms",
+                     innovation / PA_USEC_PER_MSEC, gain,
+                     sqrt(u->noise_variance) / PA_USEC_PER_MSEC, sqrt(u->latency_variance) / PA_USEC_PER_MSEC);
+    }
+
+    pa_log_debug("Filtered latency difference is %0.2f ms", u->latency_estimate / PA_USEC_PER_MSEC);
+
     /* Calculate new rate */
-    new_rate = rate_controller(base_rate, u->adjust_time, latency_difference);
+    new_rate = rate_controller(base_rate, u->adjust_time, (int32_t) lrint(u->latency_estimate));
 
     /* Set rate */
     pa_sink_input_set_rate(u->sink_input, new_rate);
@@ -309,6 +357,9 @@ static void enable_adjust_timer(struct userdata *u, bool enable) {
         if (u->time_event)
             u->core->mainloop->time_free(u->time_event);
 
+        /* Whatever the filter learned is stale now */
+        u->filter_valid = false;
+
         u->time_event = pa_core_rttime_new(u->module->core, pa_rtclock_now() + 333 * PA_USEC_PER_MSEC, time_callback, u);
     } else {
         if (!u->time_event)
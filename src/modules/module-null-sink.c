@@ -23,6 +23,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <unistd.h>
 
@@ -40,6 +41,7 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/io-pool.h>
 
 #include "module-null-sink-symdef.h"
 
@@ -53,11 +55,24 @@ PA_MODULE_USAGE(
         "format=<sample format> "
         "rate=<sample rate> "
         "channels=<number of channels> "
-        "channel_map=<channel map>");
+        "channel_map=<channel map> "
+        "benchmark=<render as fast as possible and log statistics?> "
+        "offline=<render as fast as the sink inputs are fed?>");
 
 #define DEFAULT_SINK_NAME "null"
 #define BLOCK_USEC (PA_USEC_PER_SEC * 2)
 
+/* In benchmark mode, statistics are logged this often, and the
+ * percentiles are taken from up to this many of the latest renders */
+#define BENCHMARK_REPORT_USEC (PA_USEC_PER_SEC * 10)
+#define BENCHMARK_SAMPLES 1024
+
+/* In offline mode, if a sink input has had nothing queued for this
+ * long, this much is rendered anyway, so that it can underrun and e.g.
+ * finish draining */
+#define OFFLINE_STALL_USEC (PA_USEC_PER_MSEC * 250)
+#define OFFLINE_STALL_RENDER_USEC (PA_USEC_PER_MSEC * 10)
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -67,8 +82,27 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* Instead of the above, if we run on a shared IO thread */
+    pa_io_task *io_task;
+
     pa_usec_t block_usec;
     pa_usec_t timestamp;
+
+    /* With benchmark=1 there is no timer, we render the next block as
+     * soon as the last one is done. These are reset with each report. */
+    bool benchmark;
+    pa_usec_t report_timestamp;
+    uint64_t n_renders;
+    uint64_t n_rendered;
+    pa_usec_t render_usec[BENCHMARK_SAMPLES];
+    pa_usec_t render_usec_max;
+    int n_accumulated;
+
+    /* With offline=1 there is no timer either, we render whatever all
+     * sink inputs have queued up. Since nothing stays queued here, the
+     * only clock the clients see is the audio that has been rendered. */
+    bool offline;
+    pa_usec_t offline_stall_timestamp;
 };
 
 static const char* const valid_modargs[] = {
@@ -78,9 +112,88 @@ static const char* const valid_modargs[] = {
     "rate",
     "channels",
     "channel_map",
+    "benchmark",
+    "offline",
     NULL
 };
 
+enum {
+    SINK_MESSAGE_TAKE_BENCHMARK_REPORT = PA_SINK_MESSAGE_MAX
+};
+
+struct benchmark_report {
+    uint64_t n_renders;
+    double blocks_per_second;
+    double real_time_factor;
+    pa_usec_t p50, p90, p99, max;
+    double allocations_per_block;
+};
+
+static int usec_compare(const void *a, const void *b) {
+    const pa_usec_t *x = a, *y = b;
+
+    return *x < *y ? -1 : (*x > *y ? 1 : 0);
+}
+
+/* Logs the statistics since the last report and starts over. If r is
+ * not NULL, it is filled in as well. Called from the IO thread, or from
+ * the main thread once that is gone. */
+static void benchmark_report(struct userdata *u, pa_usec_t now, struct benchmark_report *r) {
+    pa_usec_t sorted[BENCHMARK_SAMPLES];
+    pa_usec_t elapsed, rendered_usec;
+    struct benchmark_report report;
+    unsigned n;
+    int n_accumulated;
+
+    pa_assert(u);
+
+    pa_zero(report);
+    n_accumulated = pa_atomic_load(&pa_mempool_get_stat(u->core->mempool)->n_accumulated);
+
+    if (u->n_renders > 0 && now > u->report_timestamp) {
+        n = (unsigned) PA_MIN(u->n_renders, (uint64_t) BENCHMARK_SAMPLES);
+        memcpy(sorted, u->render_usec, n * sizeof(pa_usec_t));
+        qsort(sorted, n, sizeof(pa_usec_t), usec_compare);
+
+        elapsed = now - u->report_timestamp;
+        rendered_usec = pa_bytes_to_usec(u->n_rendered, &u->sink->sample_spec);
+
+        report.n_renders = u->n_renders;
+        report.blocks_per_second = (double) u->n_renders * PA_USEC_PER_SEC / elapsed;
+        report.real_time_factor = (double) rendered_usec / elapsed;
+        report.p50 = sorted[n / 2];
+        report.p90 = sorted[n * 9 / 10];
+        report.p99 = sorted[n * 99 / 100];
+        report.max = u->render_usec_max;
+
+        /* The allocations are those of the whole daemon, which for a
+         * benchmark setup should mostly be ours and our clients' */
+        report.allocations_per_block = (double) (unsigned) (n_accumulated - u->n_accumulated) / u->n_renders;
+
+        pa_log_info("Rendered %llu blocks in %0.2f s, %0.1f blocks/s, %0.1fx real time. "
+                    "Render time p50 %llu us, p90 %llu us, p99 %llu us, max %llu us. "
+                    "%0.2f allocations per block.",
+                    (unsigned long long) report.n_renders,
+                    (double) elapsed / PA_USEC_PER_SEC,
+                    report.blocks_per_second,
+                    report.real_time_factor,
+                    (unsigned long long) report.p50,
+                    (unsigned long long) report.p90,
+                    (unsigned long long) report.p99,
+                    (unsigned long long) report.max,
+                    report.allocations_per_block);
+    }
+
+    if (r)
+        *r = report;
+
+    u->report_timestamp = now;
+    u->n_renders = 0;
+    u->n_rendered = 0;
+    u->render_usec_max = 0;
+    u->n_accumulated = n_accumulated;
+}
+
 static int sink_process_msg(
         pa_msgobject *o,
         int code,
@@ -94,12 +207,21 @@ static int sink_process_msg(
         case PA_SINK_MESSAGE_SET_STATE:
 
             if (pa_sink_get_state(u->sink) == PA_SINK_SUSPENDED || pa_sink_get_state(u->sink) == PA_SINK_INIT) {
-                if (PA_PTR_TO_UINT(data) == PA_SINK_RUNNING || PA_PTR_TO_UINT(data) == PA_SINK_IDLE)
+                if (PA_PTR_TO_UINT(data) == PA_SINK_RUNNING || PA_PTR_TO_UINT(data) == PA_SINK_IDLE) {
                     u->timestamp = pa_rtclock_now();
+
+                    /* Don't count the time we were suspended */
+                    if (u->benchmark)
+                        benchmark_report(u, u->timestamp, NULL);
+                }
             }
 
             break;
 
+        case SINK_MESSAGE_TAKE_BENCHMARK_REPORT:
+            benchmark_report(u, pa_rtclock_now(), data);
+            return 0;
+
         case PA_SINK_MESSAGE_GET_LATENCY: {
             pa_usec_t now;
 
@@ -113,6 +235,36 @@ static int sink_process_msg(
     return pa_sink_process_msg(o, code, data, offset, chunk);
 }
 
+/* Called from main context */
+static int sink_set_state_cb(pa_sink *s, pa_sink_state_t state) {
+    struct benchmark_report r;
+    pa_proplist *pl;
+
+    pa_sink_assert_ref(s);
+
+    if (!PA_SINK_IS_OPENED(pa_sink_get_state(s)) || state != PA_SINK_SUSPENDED)
+        return 0;
+
+    /* Publish the statistics on the sink, so that whoever suspended it
+     * can read them from there. This is what benchmark scripts and
+     * tests do when they are done. */
+    pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), SINK_MESSAGE_TAKE_BENCHMARK_REPORT, &r, 0, NULL) == 0);
+
+    pl = pa_proplist_new();
+    pa_proplist_setf(pl, "benchmark.blocks", "%llu", (unsigned long long) r.n_renders);
+    pa_proplist_setf(pl, "benchmark.blocks_per_second", "%0.1f", r.blocks_per_second);
+    pa_proplist_setf(pl, "benchmark.real_time_factor", "%0.2f", r.real_time_factor);
+    pa_proplist_setf(pl, "benchmark.render_usec.p50", "%llu", (unsigned long long) r.p50);
+    pa_proplist_setf(pl, "benchmark.render_usec.p90", "%llu", (unsigned long long) r.p90);
+    pa_proplist_setf(pl, "benchmark.render_usec.p99", "%llu", (unsigned long long) r.p99);
+    pa_proplist_setf(pl, "benchmark.render_usec.max", "%llu", (unsigned long long) r.max);
+    pa_proplist_setf(pl, "benchmark.allocations_per_block", "%0.2f", r.allocations_per_block);
+    pa_sink_update_proplist(s, PA_UPDATE_REPLACE, pl);
+    pa_proplist_free(pl);
+
+    return 0;
+}
+
 static void sink_update_requested_latency_cb(pa_sink *s) {
     struct userdata *u;
     size_t nbytes;
@@ -195,6 +347,126 @@ static void process_render(struct userdata *u, pa_usec_t now) {
 /*     pa_log_debug("Ate in sum %lu bytes (of %lu)", (unsigned long) ate, (unsigned long) nbytes); */
 }
 
+/* Renders a single block, as fast as we can. Nothing is ever queued
+ * up, so there is no latency and nothing to rewind. */
+static void process_render_benchmark(struct userdata *u, pa_usec_t now) {
+    pa_memchunk chunk;
+    pa_usec_t end;
+
+    pa_assert(u);
+
+    pa_sink_render(u->sink, u->sink->thread_info.max_request, &chunk);
+    pa_memblock_unref(chunk.memblock);
+
+    end = pa_rtclock_now();
+
+    u->render_usec[u->n_renders % BENCHMARK_SAMPLES] = end - now;
+    u->render_usec_max = PA_MAX(u->render_usec_max, end - now);
+    u->n_renders++;
+    u->n_rendered += chunk.length;
+
+    u->timestamp = end;
+
+    if (end >= u->report_timestamp + BENCHMARK_REPORT_USEC)
+        benchmark_report(u, end, NULL);
+}
+
+/* Returns how much audio all running sink inputs of s have queued at
+ * least, looking through filter sinks, or (pa_usec_t) -1 if there are
+ * none. Called from the IO thread, which filter sinks share with us. */
+static pa_usec_t offline_queued(pa_sink *s) {
+    pa_sink_input *i;
+    void *state = NULL;
+    pa_usec_t queued = (pa_usec_t) -1;
+
+    PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
+        pa_usec_t usec[2] = { 0, 0 };
+
+        if (i->thread_info.state != PA_SINK_INPUT_RUNNING)
+            continue;
+
+        if (i->origin_sink)
+            usec[0] = offline_queued(i->origin_sink);
+        else
+            pa_assert_se(i->parent.process_msg(PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_GET_LATENCY, usec, 0, NULL) == 0);
+
+        queued = PA_MIN(queued, usec[0]);
+    }
+
+    return queued;
+}
+
+/* Renders what all sink inputs can deliver without underrunning, as
+ * fast as they deliver it, so that the result is the same as when
+ * playing in real time. Returns when we want to be woken up next, or 0
+ * if only new data or a new stream can get us going again. */
+static pa_usec_t process_render_offline(struct userdata *u, pa_usec_t now) {
+    pa_memchunk chunk;
+    pa_usec_t queued;
+    size_t nbytes;
+
+    pa_assert(u);
+
+    if ((queued = offline_queued(u->sink)) == (pa_usec_t) -1) {
+        u->offline_stall_timestamp = 0;
+        return 0;
+    }
+
+    nbytes = PA_MIN(pa_usec_to_bytes(queued, &u->sink->sample_spec), u->sink->thread_info.max_request);
+
+    if (nbytes <= 0) {
+        if (u->offline_stall_timestamp == 0)
+            u->offline_stall_timestamp = now;
+
+        if (now < u->offline_stall_timestamp + OFFLINE_STALL_USEC)
+            return u->offline_stall_timestamp + OFFLINE_STALL_USEC;
+
+        pa_log_debug("A sink input has had nothing queued for a while, rendering anyway.");
+        nbytes = pa_usec_to_bytes(OFFLINE_STALL_RENDER_USEC, &u->sink->sample_spec);
+    }
+
+    u->offline_stall_timestamp = 0;
+
+    pa_sink_render(u->sink, nbytes, &chunk);
+    pa_memblock_unref(chunk.memblock);
+
+    u->timestamp = now;
+
+    /* Returning a time in the past gets us called again right away */
+    return now;
+}
+
+/* One iteration of the IO loop, returns when we want to be woken up
+ * next, or 0 */
+static pa_usec_t process_io(pa_io_task *t, void *userdata) {
+    struct userdata *u = userdata;
+    pa_usec_t now = 0;
+
+    pa_assert(u);
+
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
+        now = pa_rtclock_now();
+
+    if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
+        process_rewind(u, now);
+
+    /* Render some data and drop it immediately */
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        /* Returning a time in the past gets us called again right away */
+        if (u->offline)
+            return process_render_offline(u, now);
+
+        if (u->benchmark)
+            process_render_benchmark(u, now);
+        else if (u->timestamp <= now)
+            process_render(u, now);
+
+        return u->timestamp;
+    }
+
+    return 0;
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
 
@@ -207,22 +479,12 @@ static void thread_func(void *userdata) {
     u->timestamp = pa_rtclock_now();
 
     for (;;) {
-        pa_usec_t now = 0;
+        pa_usec_t next;
         int ret;
 
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
-            now = pa_rtclock_now();
-
-        if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
-            process_rewind(u, now);
-
-        /* Render some data and drop it immediately */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            if (u->timestamp <= now)
-                process_render(u, now);
-
-            pa_rtpoll_set_timer_absolute(u->rtpoll, u->timestamp);
-        } else
+        if ((next = process_io(NULL, u)) > 0)
+            pa_rtpoll_set_timer_absolute(u->rtpoll, next);
+        else
             pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
@@ -268,10 +530,23 @@ int pa__init(pa_module*m) {
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->rtpoll = pa_rtpoll_new();
+    u->timestamp = pa_rtclock_now();
+
+    if (pa_modargs_get_value_boolean(ma, "benchmark", &u->benchmark) < 0) {
+        pa_log("Failed to parse benchmark argument.");
+        goto fail;
+    }
+
+    if (u->benchmark)
+        benchmark_report(u, u->timestamp, NULL);
 
-    if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
-        pa_log("pa_thread_mq_init() failed.");
+    if (pa_modargs_get_value_boolean(ma, "offline", &u->offline) < 0) {
+        pa_log("Failed to parse offline argument.");
+        goto fail;
+    }
+
+    if (u->offline && u->benchmark) {
+        pa_log("benchmark and offline can't be used together.");
         goto fail;
     }
 
@@ -300,17 +575,35 @@ int pa__init(pa_module*m) {
 
     u->sink->parent.process_msg = sink_process_msg;
     u->sink->update_requested_latency = sink_update_requested_latency_cb;
+    if (u->benchmark)
+        u->sink->set_state = sink_set_state_cb;
     u->sink->userdata = u;
 
-    pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
-    pa_sink_set_rtpoll(u->sink, u->rtpoll);
+    /* Run on a shared IO thread if there are any, otherwise on our own */
+    if (m->core->io_pool)
+        u->io_task = pa_io_task_new(m->core->io_pool, m, process_io, u);
+
+    if (u->io_task) {
+        pa_sink_set_asyncmsgq(u->sink, pa_io_task_get_asyncmsgq(u->io_task));
+        pa_sink_set_rtpoll(u->sink, pa_io_task_get_rtpoll(u->io_task));
+    } else {
+        u->rtpoll = pa_rtpoll_new();
+
+        if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
+            pa_log("pa_thread_mq_init() failed.");
+            goto fail;
+        }
+
+        pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
+        pa_sink_set_rtpoll(u->sink, u->rtpoll);
+    }
 
     u->block_usec = BLOCK_USEC;
     nbytes = pa_usec_to_bytes(u->block_usec, &u->sink->sample_spec);
     pa_sink_set_max_rewind(u->sink, nbytes);
     pa_sink_set_max_request(u->sink, nbytes);
 
-    if (!(u->thread = pa_thread_new("null-sink", thread_func, u))) {
+    if (!u->io_task && !(u->thread = pa_thread_new("null-sink", thread_func, u))) {
         pa_log("Failed to create thread.");
         goto fail;
     }
@@ -352,6 +645,9 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unlink(u->sink);
 
+    if (u->io_task)
+        pa_io_task_free(u->io_task);
+
     if (u->thread) {
         pa_asyncmsgq_send(u->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
         pa_thread_free(u->thread);
@@ -359,6 +655,10 @@ void pa__done(pa_module*m) {
 
     pa_thread_mq_done(&u->thread_mq);
 
+    /* The IO thread is gone, so we may touch its data */
+    if (u->benchmark && u->sink)
+        benchmark_report(u, pa_rtclock_now(), NULL);
+
     if (u->sink)
         pa_sink_unref(u->sink);
 
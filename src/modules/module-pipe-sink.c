@@ -28,6 +28,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #ifdef HAVE_SYS_FILIO_H
 #include <sys/filio.h>
@@ -59,11 +60,23 @@ PA_MODULE_USAGE(
         "format=<sample format> "
         "rate=<sample rate> "
         "channels=<number of channels> "
-        "channel_map=<channel map>");
+        "channel_map=<channel map> "
+        "pipe_size=<kernel buffer size of the FIFO in bytes> "
+        "use_vmsplice=<map rendered blocks into the FIFO instead of copying?>");
 
 #define DEFAULT_FILE_NAME "fifo_output"
 #define DEFAULT_SINK_NAME "fifo_output"
 
+/* How many vmsplice()d blocks we keep referenced at most while the
+ * reader has not consumed them yet. If the ring is full we fall back
+ * to copying. */
+#define MAX_SPLICED 64
+
+struct spliced_block {
+    pa_memblock *memblock;
+    uint64_t end;
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -82,6 +95,13 @@ struct userdata {
     pa_rtpoll_item *rtpoll_item;
 
     int write_type;
+
+    bool use_vmsplice;
+    uint64_t bytes_written;
+
+    /* Blocks whose pages are still referenced by the pipe */
+    struct spliced_block spliced[MAX_SPLICED];
+    unsigned spliced_index, n_spliced;
 };
 
 static const char* const valid_modargs[] = {
@@ -92,6 +112,8 @@ static const char* const valid_modargs[] = {
     "rate",
     "channels",
     "channel_map",
+    "pipe_size",
+    "use_vmsplice",
     NULL
 };
 
@@ -120,9 +142,80 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
     return pa_sink_process_msg(o, code, data, offset, chunk);
 }
 
+/* vmsplice() without SPLICE_F_GIFT only makes the pipe reference our
+ * pages, so a block must stay alive until the reader has consumed
+ * everything up to its end. Everything we ever wrote minus what is
+ * still queued in the pipe is what the reader has consumed. */
+static void release_spliced(struct userdata *u, bool all) {
+    uint64_t consumed = u->bytes_written;
+
+    pa_assert(u);
+
+    if (u->n_spliced <= 0)
+        return;
+
+#ifdef FIONREAD
+    if (!all) {
+        int l;
+
+        if (ioctl(u->fd, FIONREAD, &l) < 0)
+            return;
+
+        if (l > 0)
+            consumed -= (uint64_t) l;
+    }
+#endif
+
+    while (u->n_spliced > 0) {
+        struct spliced_block *b = &u->spliced[u->spliced_index];
+
+        if (!all && b->end > consumed)
+            break;
+
+        pa_memblock_unref(b->memblock);
+        b->memblock = NULL;
+
+        u->spliced_index = (u->spliced_index + 1) % MAX_SPLICED;
+        u->n_spliced--;
+    }
+}
+
+static ssize_t write_chunk(struct userdata *u, void *p, bool *spliced) {
+    pa_assert(u);
+    pa_assert(p);
+    pa_assert(spliced);
+
+    *spliced = false;
+
+#ifdef SPLICE_F_NONBLOCK
+    if (u->use_vmsplice && u->n_spliced < MAX_SPLICED) {
+        struct iovec iov;
+        ssize_t l;
+
+        iov.iov_base = (uint8_t*) p + u->memchunk.index;
+        iov.iov_len = u->memchunk.length;
+
+        if ((l = vmsplice(u->fd, &iov, 1, SPLICE_F_NONBLOCK)) >= 0) {
+            *spliced = true;
+            return l;
+        }
+
+        if (errno != EINVAL && errno != ENOSYS)
+            return l;
+
+        pa_log_info("vmsplice() not supported on FIFO, falling back to copying: %s", pa_cstrerror(errno));
+        u->use_vmsplice = false;
+    }
+#endif
+
+    return pa_write(u->fd, (uint8_t*) p + u->memchunk.index, u->memchunk.length, &u->write_type);
+}
+
 static int process_render(struct userdata *u) {
     pa_assert(u);
 
+    release_spliced(u, false);
+
     if (u->memchunk.length <= 0)
         pa_sink_render(u->sink, u->buffer_size, &u->memchunk);
 
@@ -131,9 +224,10 @@ static int process_render(struct userdata *u) {
     for (;;) {
         ssize_t l;
         void *p;
+        bool spliced;
 
         p = pa_memblock_acquire(u->memchunk.memblock);
-        l = pa_write(u->fd, (uint8_t*) p + u->memchunk.index, u->memchunk.length, &u->write_type);
+        l = write_chunk(u, p, &spliced);
         pa_memblock_release(u->memchunk.memblock);
 
         pa_assert(l != 0);
@@ -151,6 +245,16 @@ static int process_render(struct userdata *u) {
 
         } else {
 
+            u->bytes_written += (uint64_t) l;
+
+            if (spliced) {
+                struct spliced_block *b = &u->spliced[(u->spliced_index + u->n_spliced) % MAX_SPLICED];
+
+                b->memblock = pa_memblock_ref(u->memchunk.memblock);
+                b->end = u->bytes_written;
+                u->n_spliced++;
+            }
+
             u->memchunk.index += (size_t) l;
             u->memchunk.length -= (size_t) l;
 
@@ -227,6 +331,7 @@ int pa__init(pa_module *m) {
     pa_modargs *ma;
     struct pollfd *pollfd;
     pa_sink_new_data data;
+    uint32_t pipe_size = 0;
 
     pa_assert(m);
 
@@ -279,6 +384,35 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "pipe_size", &pipe_size) < 0) {
+        pa_log("Failed to parse pipe_size argument.");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "use_vmsplice", &u->use_vmsplice) < 0) {
+        pa_log("Failed to parse use_vmsplice argument.");
+        goto fail;
+    }
+
+#ifndef SPLICE_F_NONBLOCK
+    if (u->use_vmsplice) {
+        pa_log_warn("vmsplice() is not supported on this system, copying instead.");
+        u->use_vmsplice = false;
+    }
+#endif
+
+    /* With the default PIPE_BUF sized pipe we would wake up for every
+     * 4 KiB, a larger pipe lets us render and write bigger blocks */
+    u->buffer_size = pa_pipe_buf(u->fd);
+    if (pipe_size > 0) {
+        size_t n;
+
+        if ((n = pa_pipe_set_size(u->fd, pipe_size)) > 0)
+            u->buffer_size = PA_MIN(n, pa_mempool_block_size_max(m->core->mempool));
+        else
+            pa_log_warn("Failed to resize FIFO '%s', using the default size.", u->filename);
+    }
+
     pa_sink_new_data_init(&data);
     data.driver = __FILE__;
     data.module = m;
@@ -308,7 +442,7 @@ int pa__init(pa_module *m) {
     pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
     pa_sink_set_rtpoll(u->sink, u->rtpoll);
 
-    u->buffer_size = pa_frame_align(pa_pipe_buf(u->fd), &u->sink->sample_spec);
+    u->buffer_size = pa_frame_align(u->buffer_size, &u->sink->sample_spec);
     pa_sink_set_max_request(u->sink, u->buffer_size);
     pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->buffer_size, &u->sink->sample_spec));
 
@@ -370,6 +504,8 @@ void pa__done(pa_module *m) {
     if (u->memchunk.memblock)
         pa_memblock_unref(u->memchunk.memblock);
 
+    release_spliced(u, true);
+
     if (u->rtpoll_item)
         pa_rtpoll_item_free(u->rtpoll_item);
 
@@ -59,7 +59,8 @@ PA_MODULE_USAGE(
         "format=<sample format> "
         "rate=<sample rate> "
         "channels=<number of channels> "
-        "channel_map=<channel map>");
+        "channel_map=<channel map> "
+        "pipe_size=<kernel buffer size of the FIFO in bytes>");
 
 #define DEFAULT_FILE_NAME "/tmp/music.input"
 #define DEFAULT_SOURCE_NAME "fifo_input"
@@ -75,6 +76,7 @@ struct userdata {
 
     char *filename;
     int fd;
+    size_t buffer_size;
 
     pa_memchunk memchunk;
 
@@ -89,6 +91,7 @@ static const char* const valid_modargs[] = {
     "rate",
     "channels",
     "channel_map",
+    "pipe_size",
     NULL
 };
 
@@ -143,7 +146,7 @@ static void thread_func(void *userdata) {
             void *p;
 
             if (!u->memchunk.memblock) {
-                u->memchunk.memblock = pa_memblock_new(u->core->mempool, pa_pipe_buf(u->fd));
+                u->memchunk.memblock = pa_memblock_new(u->core->mempool, u->buffer_size);
                 u->memchunk.index = u->memchunk.length = 0;
             }
 
@@ -214,6 +217,7 @@ int pa__init(pa_module *m) {
     pa_modargs *ma;
     struct pollfd *pollfd;
     pa_source_new_data data;
+    uint32_t pipe_size = 0;
 
     pa_assert(m);
 
@@ -263,6 +267,22 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "pipe_size", &pipe_size) < 0) {
+        pa_log("Failed to parse pipe_size argument.");
+        goto fail;
+    }
+
+    /* A larger pipe lets us drain it with fewer, bigger reads */
+    u->buffer_size = pa_pipe_buf(u->fd);
+    if (pipe_size > 0) {
+        size_t n;
+
+        if ((n = pa_pipe_set_size(u->fd, pipe_size)) > 0)
+            u->buffer_size = PA_MIN(n, pa_mempool_block_size_max(m->core->mempool));
+        else
+            pa_log_warn("Failed to resize FIFO '%s', using the default size.", u->filename);
+    }
+
     pa_source_new_data_init(&data);
     data.driver = __FILE__;
     data.module = m;
@@ -291,7 +311,7 @@ int pa__init(pa_module *m) {
 
     pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
     pa_source_set_rtpoll(u->source, u->rtpoll);
-    pa_source_set_fixed_latency(u->source, pa_bytes_to_usec(pa_pipe_buf(u->fd), &u->source->sample_spec));
+    pa_source_set_fixed_latency(u->source, pa_bytes_to_usec(u->buffer_size, &u->source->sample_spec));
 
     u->rtpoll_item = pa_rtpoll_item_new(u->rtpoll, PA_RTPOLL_NEVER, 1);
     pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
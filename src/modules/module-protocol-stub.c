@@ -44,9 +44,12 @@
 #include <pulsecore/creds.h>
 #include <pulsecore/arpa-inet.h>
 
-#ifdef USE_TCP_SOCKETS
+#if defined(USE_TCP_SOCKETS)
 #define SOCKET_DESCRIPTION "(TCP sockets)"
 #define SOCKET_USAGE "port=<TCP port number> listen=<address to listen on>"
+#elif defined(USE_VSOCK_SOCKETS)
+#define SOCKET_DESCRIPTION "(VSOCK sockets)"
+#define SOCKET_USAGE "port=<VSOCK port number>"
 #else
 #define SOCKET_DESCRIPTION "(UNIX sockets)"
 #define SOCKET_USAGE "socket=<path to UNIX socket>"
@@ -109,15 +112,17 @@
 #  define TCPWRAP_SERVICE "pulseaudio-native"
 #  define IPV4_PORT PA_NATIVE_DEFAULT_PORT
 #  define UNIX_SOCKET PA_NATIVE_DEFAULT_UNIX_SOCKET
-#  define MODULE_ARGUMENTS_COMMON "cookie", "auth-cookie", "auth-cookie-enabled", "auth-anonymous",
+#  define MODULE_ARGUMENTS_COMMON "cookie", "auth-cookie", "auth-cookie-enabled", "auth-anonymous", "auto-buffer-attr",
 
-#  ifdef USE_TCP_SOCKETS
+#  if defined(USE_TCP_SOCKETS)
 #    include "module-native-protocol-tcp-symdef.h"
+#  elif defined(USE_VSOCK_SOCKETS)
+#    include "module-native-protocol-vsock-symdef.h"
 #  else
 #    include "module-native-protocol-unix-symdef.h"
 #  endif
 
-#  if defined(HAVE_CREDS) && !defined(USE_TCP_SOCKETS)
+#  if defined(HAVE_CREDS) && !defined(USE_TCP_SOCKETS) && !defined(USE_VSOCK_SOCKETS)
 #    define MODULE_ARGUMENTS MODULE_ARGUMENTS_COMMON "auth-group", "auth-group-enable", "srbchannel",
 #    define AUTH_USAGE "auth-group=<system group to allow access> auth-group-enable=<enable auth by UNIX group?> "
 #    define SRB_USAGE "srbchannel=<enable shared ringbuffer communication channel?> "
@@ -135,6 +140,7 @@
   PA_MODULE_USAGE("auth-anonymous=<don't check for cookies?> "
                   "auth-cookie=<path to cookie file> "
                   "auth-cookie-enabled=<enable cookie authentication?> "
+                  "auto-buffer-attr=<adapt the buffering of latency adjusting playback streams?> "
                   AUTH_USAGE
                   SRB_USAGE
                   SOCKET_USAGE);
@@ -180,6 +186,8 @@ static const char* const valid_modargs[] = {
 #if defined(USE_TCP_SOCKETS)
     "port",
     "listen",
+#elif defined(USE_VSOCK_SOCKETS)
+    "port",
 #else
     "socket",
 #endif
@@ -209,6 +217,8 @@ struct userdata {
 #  ifdef HAVE_IPV6
     pa_socket_server *socket_server_ipv6;
 #  endif
+#elif defined(USE_VSOCK_SOCKETS)
+    pa_socket_server *socket_server_vsock;
 #else
     pa_socket_server *socket_server_unix;
     char *socket_path;
@@ -243,6 +253,8 @@ int pa__init(pa_module*m) {
     uint32_t port = IPV4_PORT;
     bool port_fallback = true;
     const char *listen_on;
+#elif defined(USE_VSOCK_SOCKETS)
+    uint32_t port = IPV4_PORT;
 #else
     int r;
 #endif
@@ -326,6 +338,18 @@ int pa__init(pa_module*m) {
         pa_socket_server_set_callback(u->socket_server_ipv6, socket_server_on_connection_cb, u);
 #  endif
 
+#elif defined(USE_VSOCK_SOCKETS)
+
+    if (pa_modargs_get_value_u32(ma, "port", &port) < 0 || port < 1) {
+        pa_log("port= expects a positive numerical argument.");
+        goto fail;
+    }
+
+    if (!(u->socket_server_vsock = pa_socket_server_new_vsock(m->core->mainloop, port)))
+        goto fail;
+
+    pa_socket_server_set_callback(u->socket_server_vsock, socket_server_on_connection_cb, u);
+
 #else
 
 #  if defined(USE_PROTOCOL_ESOUND)
@@ -375,6 +399,9 @@ int pa__init(pa_module*m) {
         if (pa_socket_server_get_address(u->socket_server_ipv6, t, sizeof(t)))
             pa_native_protocol_add_server_string(u->native_protocol, t);
 #    endif
+#  elif defined(USE_VSOCK_SOCKETS)
+    if (pa_socket_server_get_address(u->socket_server_vsock, t, sizeof(t)))
+        pa_native_protocol_add_server_string(u->native_protocol, t);
 #  else
     if (pa_socket_server_get_address(u->socket_server_unix, t, sizeof(t)))
         pa_native_protocol_add_server_string(u->native_protocol, t);
@@ -473,6 +500,10 @@ void pa__done(pa_module*m) {
             if (pa_socket_server_get_address(u->socket_server_ipv6, t, sizeof(t)))
                 pa_native_protocol_remove_server_string(u->native_protocol, t);
 #    endif
+#  elif defined(USE_VSOCK_SOCKETS)
+        if (u->socket_server_vsock)
+            if (pa_socket_server_get_address(u->socket_server_vsock, t, sizeof(t)))
+                pa_native_protocol_remove_server_string(u->native_protocol, t);
 #  else
         if (u->socket_server_unix)
             if (pa_socket_server_get_address(u->socket_server_unix, t, sizeof(t)))
@@ -500,6 +531,9 @@ void pa__done(pa_module*m) {
     if (u->socket_server_ipv6)
         pa_socket_server_unref(u->socket_server_ipv6);
 #  endif
+#elif defined(USE_VSOCK_SOCKETS)
+    if (u->socket_server_vsock)
+        pa_socket_server_unref(u->socket_server_vsock);
 #else
     if (u->socket_server_unix)
         pa_socket_server_unref(u->socket_server_unix);
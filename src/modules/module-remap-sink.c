@@ -30,6 +30,9 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/remap.h>
+#include <pulsecore/resampler.h>
+#include <pulsecore/sample-util.h>
 
 #include "module-remap-sink-symdef.h"
 
@@ -56,6 +59,12 @@ struct userdata {
     pa_sink_input *sink_input;
 
     bool auto_desc;
+
+    /* If only the channels differ from the master we create the sink
+     * input in the master's channel layout and run the remap kernels
+     * ourselves, so the sink input never needs a resampler. */
+    bool remap_only;
+    pa_remap_t remap;
 };
 
 static const char* const valid_modargs[] = {
@@ -72,6 +81,23 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
+/* Convert a byte count in the sample spec of our sink input into one
+ * in the sample spec of our sink and vice versa. Both only differ in
+ * the number of channels, hence only the frame sizes matter. */
+static size_t sink_input_to_sink_bytes(struct userdata *u, size_t nbytes) {
+    if (!u->remap_only)
+        return nbytes;
+
+    return nbytes / pa_frame_size(&u->sink_input->sample_spec) * pa_frame_size(&u->sink->sample_spec);
+}
+
+static size_t sink_to_sink_input_bytes(struct userdata *u, size_t nbytes) {
+    if (!u->remap_only)
+        return nbytes;
+
+    return nbytes / pa_frame_size(&u->sink->sample_spec) * pa_frame_size(&u->sink_input->sample_spec);
+}
+
 /* Called from I/O thread context */
 static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SINK(o)->userdata;
@@ -127,7 +153,7 @@ static void sink_request_rewind(pa_sink *s) {
         !PA_SINK_INPUT_IS_LINKED(u->sink_input->thread_info.state))
         return;
 
-    pa_sink_input_request_rewind(u->sink_input, s->thread_info.rewind_nbytes, true, false, false);
+    pa_sink_input_request_rewind(u->sink_input, sink_to_sink_input_bytes(u, s->thread_info.rewind_nbytes), true, false, false);
 }
 
 /* Called from I/O thread context */
@@ -150,6 +176,9 @@ static void sink_update_requested_latency(pa_sink *s) {
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
+    pa_memchunk tchunk;
+    unsigned n_frames;
+    void *src, *dst;
 
     pa_sink_input_assert_ref(i);
     pa_assert(chunk);
@@ -158,7 +187,32 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     /* Hmm, process any rewind request that might be queued up */
     pa_sink_process_rewind(u->sink, 0);
 
-    pa_sink_render(u->sink, nbytes, chunk);
+    if (!u->remap_only) {
+        pa_sink_render(u->sink, nbytes, chunk);
+        return 0;
+    }
+
+    pa_sink_render(u->sink, sink_input_to_sink_bytes(u, nbytes), &tchunk);
+    n_frames = (unsigned) (tchunk.length / pa_frame_size(&u->sink->sample_spec));
+
+    if (pa_memblock_is_silence(tchunk.memblock)) {
+        pa_silence_memchunk_get(&i->core->silence_cache, i->core->mempool, chunk,
+                                &i->sample_spec, n_frames * pa_frame_size(&i->sample_spec));
+        pa_memblock_unref(tchunk.memblock);
+        return 0;
+    }
+
+    chunk->index = 0;
+    chunk->length = n_frames * pa_frame_size(&i->sample_spec);
+    chunk->memblock = pa_memblock_new(i->core->mempool, chunk->length);
+
+    src = pa_memblock_acquire_chunk(&tchunk);
+    dst = pa_memblock_acquire(chunk->memblock);
+    u->remap.do_remap(&u->remap, dst, src, n_frames);
+    pa_memblock_release(chunk->memblock);
+    pa_memblock_release(tchunk.memblock);
+
+    pa_memblock_unref(tchunk.memblock);
     return 0;
 }
 
@@ -170,6 +224,8 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
 
+    nbytes = sink_input_to_sink_bytes(u, nbytes);
+
     if (u->sink->thread_info.rewind_nbytes > 0) {
         amount = PA_MIN(u->sink->thread_info.rewind_nbytes, nbytes);
         u->sink->thread_info.rewind_nbytes = 0;
@@ -187,7 +243,7 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes) {
 
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
-    pa_sink_set_max_rewind_within_thread(u->sink, nbytes);
+    pa_sink_set_max_rewind_within_thread(u->sink, sink_input_to_sink_bytes(u, nbytes));
 }
 
 /* Called from I/O thread context */
@@ -197,7 +253,7 @@ static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(u = i->userdata);
 
-    pa_sink_set_max_request_within_thread(u->sink, nbytes);
+    pa_sink_set_max_request_within_thread(u->sink, sink_input_to_sink_bytes(u, nbytes));
 }
 
 /* Called from I/O thread context */
@@ -242,11 +298,11 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_sink_set_rtpoll(u->sink, i->sink->thread_info.rtpoll);
     pa_sink_set_latency_range_within_thread(u->sink, i->sink->thread_info.min_latency, i->sink->thread_info.max_latency);
     pa_sink_set_fixed_latency_within_thread(u->sink, i->sink->thread_info.fixed_latency);
-    pa_sink_set_max_request_within_thread(u->sink, pa_sink_input_get_max_request(i));
+    pa_sink_set_max_request_within_thread(u->sink, sink_input_to_sink_bytes(u, pa_sink_input_get_max_request(i)));
 
     /* FIXME: Too small max_rewind:
      * https://bugs.freedesktop.org/show_bug.cgi?id=53709 */
-    pa_sink_set_max_rewind_within_thread(u->sink, pa_sink_input_get_max_rewind(i));
+    pa_sink_set_max_rewind_within_thread(u->sink, sink_input_to_sink_bytes(u, pa_sink_input_get_max_rewind(i)));
 
     pa_sink_attach_within_thread(u->sink);
 }
@@ -373,6 +429,28 @@ int pa__init(pa_module*m) {
     u->module = m;
     m->userdata = u;
 
+    /* The remap kernels only handle these two formats. With an LFE
+     * crossover filter the resampler has more to do than remapping. */
+    if (ss.rate == master->sample_spec.rate &&
+        ss.format == master->sample_spec.format &&
+        (ss.format == PA_SAMPLE_S16NE || ss.format == PA_SAMPLE_FLOAT32NE) &&
+        !(ss.channels == master->sample_spec.channels && pa_channel_map_equal(&stream_map, &master->channel_map))) {
+        bool lfe_remixed;
+
+        pa_resampler_setup_remap(&u->remap, ss.format, &ss, &stream_map, &master->sample_spec, &master->channel_map,
+                                 (m->core->disable_remixing || !remix ? PA_RESAMPLER_NO_REMIX : 0) |
+                                 (m->core->remixing_use_all_sink_channels ? 0 : PA_RESAMPLER_NO_FILL_SINK) |
+                                 (m->core->disable_lfe_remixing ? PA_RESAMPLER_NO_LFE : 0),
+                                 &lfe_remixed);
+
+        if (lfe_remixed && m->core->lfe_crossover_freq > 0)
+            pa_resampler_free_remap(&u->remap);
+        else
+            u->remap_only = true;
+    }
+
+    pa_log_debug("Remapping %s.", u->remap_only ? "directly in the sink input" : "through the resampler");
+
     /* Create sink */
     pa_sink_new_data_init(&sink_data);
     sink_data.driver = __FILE__;
@@ -421,8 +499,13 @@ int pa__init(pa_module*m) {
     sink_input_data.origin_sink = u->sink;
     pa_proplist_sets(sink_input_data.proplist, PA_PROP_MEDIA_NAME, "Remapped Stream");
     pa_proplist_sets(sink_input_data.proplist, PA_PROP_MEDIA_ROLE, "filter");
-    pa_sink_input_new_data_set_sample_spec(&sink_input_data, &ss);
-    pa_sink_input_new_data_set_channel_map(&sink_input_data, &stream_map);
+    if (u->remap_only) {
+        pa_sink_input_new_data_set_sample_spec(&sink_input_data, &master->sample_spec);
+        pa_sink_input_new_data_set_channel_map(&sink_input_data, &master->channel_map);
+    } else {
+        pa_sink_input_new_data_set_sample_spec(&sink_input_data, &ss);
+        pa_sink_input_new_data_set_channel_map(&sink_input_data, &stream_map);
+    }
     sink_input_data.flags = (remix ? 0 : PA_SINK_INPUT_NO_REMIX);
     sink_input_data.resample_method = resample_method;
 
@@ -495,5 +578,8 @@ void pa__done(pa_module*m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
+    if (u->remap_only)
+        pa_resampler_free_remap(&u->remap);
+
     pa_xfree(u);
 }
@@ -147,6 +147,8 @@ static pa_sink* find_evacuation_sink(pa_core *c, pa_sink_input *i, pa_sink *skip
 
 static pa_hook_result_t sink_unlink_hook_callback(pa_core *c, pa_sink *sink, void* userdata) {
     pa_sink_input *i;
+    pa_idxset *targets;
+    pa_sink *t;
     uint32_t idx;
 
     pa_assert(c);
@@ -161,12 +163,19 @@ static pa_hook_result_t sink_unlink_hook_callback(pa_core *c, pa_sink *sink, voi
         return PA_HOOK_OK;
     }
 
+    /* Batch the moves, so that each sink involved rewinds only once */
+    targets = pa_idxset_new(NULL, NULL);
+    pa_sink_move_batch_begin(sink);
+
     PA_IDXSET_FOREACH(i, sink->inputs, idx) {
         pa_sink *target;
 
         if (!(target = find_evacuation_sink(c, i, sink)))
             continue;
 
+        if (pa_idxset_put(targets, target, NULL) >= 0)
+            pa_sink_move_batch_begin(target);
+
         if (pa_sink_input_move_to(i, target, false) < 0)
             pa_log_info("Failed to move sink input %u \"%s\" to %s.", i->index,
                         pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), target->name);
@@ -175,6 +184,12 @@ static pa_hook_result_t sink_unlink_hook_callback(pa_core *c, pa_sink *sink, voi
                         pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), target->name);
     }
 
+    PA_IDXSET_FOREACH(t, targets, idx)
+        pa_sink_move_batch_end(t);
+
+    pa_sink_move_batch_end(sink);
+    pa_idxset_free(targets, NULL);
+
     return PA_HOOK_OK;
 }
 
@@ -36,6 +36,7 @@ PA_MODULE_USAGE(
         "ducking_roles=<Comma(and slash) separated list of roles which will be ducked. Slash can divide the roles into groups>"
         "global=<Should we operate globally or only inside the same device?>"
         "volume=<Volume for the attenuated streams. Default: -20dB. If trigger_roles and ducking_roles are separated by slash, use slash for dividing volume group>"
+        "ramp_time=<Time in ms the streams take to fade to and from the attenuated volume. Default: 0>"
 );
 
 static const char* const valid_modargs[] = {
@@ -43,6 +44,7 @@ static const char* const valid_modargs[] = {
     "ducking_roles",
     "global",
     "volume",
+    "ramp_time",
     NULL
 };
 
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <unistd.h>
+#include <math.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -38,21 +39,50 @@
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/random.h>
 
 #include "module-sine-source-symdef.h"
 
 PA_MODULE_AUTHOR("Lennart Poettering");
-PA_MODULE_DESCRIPTION("Sine wave generator source");
+PA_MODULE_DESCRIPTION("Sine wave and test signal generator source");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 PA_MODULE_LOAD_ONCE(false);
 PA_MODULE_USAGE(
         "source_name=<name for the source> "
         "source_properties=<properties for the source> "
         "rate=<sample rate> "
-        "frequency=<frequency in Hz>");
+        "channels=<number of channels> "
+        "channel_map=<channel map> "
+        "signal=<sine, sweep, noise or impulse> "
+        "frequency=<frequency in Hz, start frequency for sweeps> "
+        "frequency_end=<end frequency of sweeps in Hz> "
+        "sweep_msec=<duration of one sweep> "
+        "impulse_msec=<interval between impulses> "
+        "block_msec=<how much to generate at once>");
 
 #define DEFAULT_SOURCE_NAME "sine_input"
-#define BLOCK_USEC (PA_USEC_PER_SEC * 2)
+#define DEFAULT_BLOCK_MSEC 2000
+#define DEFAULT_SWEEP_MSEC 1000
+#define DEFAULT_IMPULSE_MSEC 1000
+
+/* The oscillator runs this many phase accumulators side by side, each
+ * one sample ahead of the previous one, so that there is no dependency
+ * between neighbouring samples and the inner loop can be vectorized.
+ * We always generate multiples of this many frames. */
+#define LANES 4
+
+/* Every impulse is followed by the frame position it was generated at,
+ * as this many samples of +/-0.5, most significant bit first. That way
+ * a recording of the signal can be matched up with the exact sample it
+ * was generated as. */
+#define MARKER_BITS 32
+
+typedef enum signal_type {
+    SIGNAL_SINE,
+    SIGNAL_SWEEP,
+    SIGNAL_NOISE,
+    SIGNAL_IMPULSE
+} signal_type_t;
 
 struct userdata {
     pa_core *core;
@@ -63,21 +93,48 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
-    pa_memchunk memchunk;
-    size_t peek_index;
-
     pa_usec_t block_usec; /* how much to push at once */
     pa_usec_t timestamp;  /* when to push next */
+
+    signal_type_t signal;
+    unsigned rate, channels;
+    double frequency, frequency_end;
+    uint64_t sweep_frames, impulse_frames;
+
+    uint64_t frame; /* frames generated so far */
+
+    /* The phase of each lane, how much it advances per iteration and,
+     * for sweeps, how that advance changes per iteration. All of them
+     * are unit phasors. */
+    double re[LANES], im[LANES];
+    double step_re[LANES], step_im[LANES];
+    double chirp_re, chirp_im;
+
+    uint32_t noise;
 };
 
 static const char* const valid_modargs[] = {
     "source_name",
     "source_properties",
     "rate",
+    "channels",
+    "channel_map",
+    "signal",
     "frequency",
+    "frequency_end",
+    "sweep_msec",
+    "impulse_msec",
+    "block_msec",
     NULL
 };
 
+static const char* const signal_names[] = {
+    [SIGNAL_SINE] = "sine",
+    [SIGNAL_SWEEP] = "sweep",
+    [SIGNAL_NOISE] = "noise",
+    [SIGNAL_IMPULSE] = "impulse"
+};
+
 static int source_process_msg(
         pa_msgobject *o,
         int code,
@@ -125,25 +182,184 @@ static void source_update_requested_latency_cb(pa_source *s) {
     pa_log_debug("new block msec = %lu", (unsigned long) (u->block_usec / PA_USEC_PER_MSEC));
 }
 
+/* The phase in radians n frames into the tone or sweep */
+static double phase_at(struct userdata *u, double n) {
+    double slope = 0;
+
+    if (u->signal == SIGNAL_SWEEP)
+        slope = (u->frequency_end - u->frequency) / (double) u->sweep_frames;
+
+    return 2.0 * M_PI * (u->frequency * n + slope * n * n / 2.0) / (double) u->rate;
+}
+
+/* (Re)start the tone or sweep from phase 0. This is the only place that
+ * needs sin() and cos(), generating the signal itself doesn't. */
+static void reset_oscillator(struct userdata *u) {
+    unsigned j;
+    double chirp;
+
+    for (j = 0; j < LANES; j++) {
+        double d = phase_at(u, j + LANES) - phase_at(u, j);
+
+        u->re[j] = cos(phase_at(u, j));
+        u->im[j] = sin(phase_at(u, j));
+        u->step_re[j] = cos(d);
+        u->step_im[j] = sin(d);
+    }
+
+    /* The second difference of the phase, 0 unless sweeping */
+    chirp = phase_at(u, 2 * LANES) - 2 * phase_at(u, LANES) + phase_at(u, 0);
+    u->chirp_re = cos(chirp);
+    u->chirp_im = sin(chirp);
+}
+
+static void renormalize(double *re, double *im) {
+    double l = sqrt(*re * *re + *im * *im);
+
+    *re /= l;
+    *im /= l;
+}
+
+static void generate_tone(struct userdata *u, float *d, size_t n) {
+    double re[LANES], im[LANES], step_re[LANES], step_im[LANES];
+    size_t i;
+    unsigned j, c;
+
+    pa_assert(n % LANES == 0);
+
+    memcpy(re, u->re, sizeof(re));
+    memcpy(im, u->im, sizeof(im));
+    memcpy(step_re, u->step_re, sizeof(step_re));
+    memcpy(step_im, u->step_im, sizeof(step_im));
+
+    for (i = 0; i < n; i += LANES) {
+        float s[LANES];
+
+        for (j = 0; j < LANES; j++) {
+            double t;
+
+            s[j] = (float) (0.5 * im[j]);
+
+            t = re[j] * step_re[j] - im[j] * step_im[j];
+            im[j] = re[j] * step_im[j] + im[j] * step_re[j];
+            re[j] = t;
+
+            t = step_re[j] * u->chirp_re - step_im[j] * u->chirp_im;
+            step_im[j] = step_re[j] * u->chirp_im + step_im[j] * u->chirp_re;
+            step_re[j] = t;
+        }
+
+        for (j = 0; j < LANES; j++)
+            for (c = 0; c < u->channels; c++)
+                *(d++) = s[j];
+    }
+
+    /* Keep rounding errors from accumulating */
+    for (j = 0; j < LANES; j++) {
+        renormalize(&re[j], &im[j]);
+        renormalize(&step_re[j], &step_im[j]);
+    }
+
+    memcpy(u->re, re, sizeof(re));
+    memcpy(u->im, im, sizeof(im));
+    memcpy(u->step_re, step_re, sizeof(step_re));
+    memcpy(u->step_im, step_im, sizeof(step_im));
+}
+
+static void generate_noise(struct userdata *u, float *d, size_t n) {
+    uint32_t x = u->noise;
+    size_t i;
+
+    /* xorshift32, uniform in [-0.5, 0.5) and independent per channel */
+    for (i = 0; i < n * u->channels; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        *(d++) = (float) ((int32_t) x / 4294967296.0);
+    }
+
+    u->noise = x;
+}
+
+static void generate_impulses(struct userdata *u, float *d, size_t n) {
+    size_t i;
+    unsigned c;
+
+    for (i = 0; i < n; i++) {
+        uint64_t pos = u->frame + i, offset = pos % u->impulse_frames;
+        float s = 0;
+
+        if (offset == 0)
+            s = 1.0f;
+        else if (offset <= MARKER_BITS)
+            s = (((uint32_t) (pos - offset) >> (MARKER_BITS - offset)) & 1) ? 0.5f : -0.5f;
+
+        for (c = 0; c < u->channels; c++)
+            *(d++) = s;
+    }
+}
+
+/* Generates n frames, n needs to be a multiple of LANES */
+static void generate(struct userdata *u, float *d, size_t n) {
+    size_t left = n;
+
+    switch (u->signal) {
+        case SIGNAL_SINE:
+            generate_tone(u, d, n);
+            break;
+
+        case SIGNAL_SWEEP:
+            while (left > 0) {
+                uint64_t pos = (u->frame + n - left) % u->sweep_frames;
+                size_t k = (size_t) PA_MIN((uint64_t) left, u->sweep_frames - pos);
+
+                generate_tone(u, d, k);
+                d += k * u->channels;
+                left -= k;
+
+                if (pos + k == u->sweep_frames)
+                    reset_oscillator(u);
+            }
+            break;
+
+        case SIGNAL_NOISE:
+            generate_noise(u, d, n);
+            break;
+
+        case SIGNAL_IMPULSE:
+            generate_impulses(u, d, n);
+            break;
+    }
+
+    u->frame += n;
+}
+
 static void process_render(struct userdata *u, pa_usec_t now) {
+    size_t frame_size, max_frames;
+
     pa_assert(u);
 
+    frame_size = pa_frame_size(&u->source->sample_spec);
+    max_frames = PA_ROUND_DOWN(pa_mempool_block_size_max(u->core->mempool) / frame_size, LANES);
+
     while (u->timestamp < now + u->block_usec) {
         pa_memchunk chunk;
-        size_t k;
+        size_t n;
+
+        n = pa_usec_to_bytes_round_up(now + u->block_usec - u->timestamp, &u->source->sample_spec) / frame_size;
+        n = PA_MIN(PA_ROUND_UP(n, LANES), max_frames);
 
-        k = pa_usec_to_bytes_round_up(now + u->block_usec - u->timestamp, &u->source->sample_spec);
+        chunk.memblock = pa_memblock_new(u->core->mempool, n * frame_size);
+        chunk.index = 0;
+        chunk.length = n * frame_size;
 
-        chunk = u->memchunk;
-        chunk.index += u->peek_index;
-        chunk.length = PA_MIN(chunk.length - u->peek_index, k);
+        generate(u, pa_memblock_acquire(chunk.memblock), n);
+        pa_memblock_release(chunk.memblock);
 
 /*         pa_log_debug("posting %lu", (unsigned long) chunk.length); */
         pa_source_post(u->source, &chunk);
-
-        u->peek_index += chunk.length;
-        while (u->peek_index >= u->memchunk.length)
-            u->peek_index -= u->memchunk.length;
+        pa_memblock_unref(chunk.memblock);
 
         u->timestamp += pa_bytes_to_usec(chunk.length, &u->source->sample_spec);
     }
@@ -197,8 +413,11 @@ int pa__init(pa_module*m) {
     struct userdata *u;
     pa_modargs *ma;
     pa_source_new_data data;
-    uint32_t frequency;
+    uint32_t frequency, frequency_end, sweep_msec, impulse_msec, block_msec;
     pa_sample_spec ss;
+    pa_channel_map map;
+    const char *signal;
+    signal_type_t signal_type;
 
     pa_assert(m);
 
@@ -211,8 +430,18 @@ int pa__init(pa_module*m) {
     ss.channels = 1;
     ss.rate = 44100;
 
-    if (pa_modargs_get_sample_rate(ma, &ss.rate) < 0) {
-        pa_log("Invalid rate specification");
+    if (pa_modargs_get_sample_spec_and_channel_map(ma, &ss, &map, PA_CHANNEL_MAP_DEFAULT) < 0) {
+        pa_log("Invalid sample format specification or channel map");
+        goto fail;
+    }
+
+    signal = pa_modargs_get_value(ma, "signal", signal_names[SIGNAL_SINE]);
+    for (signal_type = SIGNAL_SINE; signal_type < PA_ELEMENTSOF(signal_names); signal_type++)
+        if (pa_streq(signal, signal_names[signal_type]))
+            break;
+
+    if (signal_type >= PA_ELEMENTSOF(signal_names)) {
+        pa_log("Invalid signal specification");
         goto fail;
     }
 
@@ -222,6 +451,31 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    frequency_end = ss.rate/2;
+    if (pa_modargs_get_value_u32(ma, "frequency_end", &frequency_end) < 0 || frequency_end < 1 || frequency_end > ss.rate/2) {
+        pa_log("Invalid end frequency specification");
+        goto fail;
+    }
+
+    sweep_msec = DEFAULT_SWEEP_MSEC;
+    if (pa_modargs_get_value_u32(ma, "sweep_msec", &sweep_msec) < 0 || sweep_msec < 1) {
+        pa_log("Invalid sweep duration specification");
+        goto fail;
+    }
+
+    impulse_msec = DEFAULT_IMPULSE_MSEC;
+    if (pa_modargs_get_value_u32(ma, "impulse_msec", &impulse_msec) < 0 ||
+        (uint64_t) impulse_msec * ss.rate / PA_MSEC_PER_SEC <= MARKER_BITS) {
+        pa_log("Invalid impulse interval specification");
+        goto fail;
+    }
+
+    block_msec = DEFAULT_BLOCK_MSEC;
+    if (pa_modargs_get_value_u32(ma, "block_msec", &block_msec) < 0 || block_msec < 1) {
+        pa_log("Invalid block size specification");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
@@ -232,17 +486,45 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
-    u->peek_index = 0;
-    pa_memchunk_sine(&u->memchunk, m->core->mempool, ss.rate, frequency);
+    u->signal = signal_type;
+    u->rate = ss.rate;
+    u->channels = ss.channels;
+    u->frequency = frequency;
+    u->frequency_end = frequency_end;
+    u->sweep_frames = PA_ROUND_UP((uint64_t) sweep_msec * ss.rate / PA_MSEC_PER_SEC, LANES);
+    u->impulse_frames = (uint64_t) impulse_msec * ss.rate / PA_MSEC_PER_SEC;
+    reset_oscillator(u);
+
+    pa_random(&u->noise, sizeof(u->noise));
+    if (u->noise == 0)
+        u->noise = 1;
 
     pa_source_new_data_init(&data);
     data.driver = __FILE__;
     data.module = m;
     pa_source_new_data_set_name(&data, pa_modargs_get_value(ma, "source_name", DEFAULT_SOURCE_NAME));
-    pa_proplist_setf(data.proplist, PA_PROP_DEVICE_DESCRIPTION, "Sine source at %u Hz", (unsigned) frequency);
+
+    switch (signal_type) {
+        case SIGNAL_SINE:
+            pa_proplist_setf(data.proplist, PA_PROP_DEVICE_DESCRIPTION, "Sine source at %u Hz", (unsigned) frequency);
+            break;
+        case SIGNAL_SWEEP:
+            pa_proplist_setf(data.proplist, PA_PROP_DEVICE_DESCRIPTION, "Sweep source from %u to %u Hz",
+                             (unsigned) frequency, (unsigned) frequency_end);
+            break;
+        case SIGNAL_NOISE:
+            pa_proplist_sets(data.proplist, PA_PROP_DEVICE_DESCRIPTION, "Noise source");
+            break;
+        case SIGNAL_IMPULSE:
+            pa_proplist_setf(data.proplist, PA_PROP_DEVICE_DESCRIPTION, "Impulse source every %u ms", (unsigned) impulse_msec);
+            break;
+    }
+
     pa_proplist_sets(data.proplist, PA_PROP_DEVICE_CLASS, "abstract");
+    pa_proplist_sets(data.proplist, "sine.signal", signal_names[signal_type]);
     pa_proplist_setf(data.proplist, "sine.hz", "%u", frequency);
     pa_source_new_data_set_sample_spec(&data, &ss);
+    pa_source_new_data_set_channel_map(&data, &map);
 
     if (pa_modargs_get_proplist(ma, "source_properties", data.proplist, PA_UPDATE_REPLACE) < 0) {
         pa_log("Invalid properties");
@@ -262,7 +544,7 @@ int pa__init(pa_module*m) {
     u->source->update_requested_latency = source_update_requested_latency_cb;
     u->source->userdata = u;
 
-    u->block_usec = BLOCK_USEC;
+    u->block_usec = block_msec * PA_USEC_PER_MSEC;
 
     pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
     pa_source_set_rtpoll(u->source, u->rtpoll);
@@ -318,9 +600,6 @@ void pa__done(pa_module*m) {
     if (u->source)
         pa_source_unref(u->source);
 
-    if (u->memchunk.memblock)
-        pa_memblock_unref(u->memchunk.memblock);
-
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
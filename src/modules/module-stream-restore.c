@@ -104,6 +104,15 @@ struct userdata {
         *connection_unlink_hook_slot;
     pa_time_event *save_time_event;
     pa_database* database;
+    pa_database_cache *cache;
+
+    /* Decoded entries by name, and the names known to have no valid
+     * entry, so that setting up a stream doesn't need to decode the
+     * same entry up to three times. Everything that changes the
+     * database goes through entry_write(), entry_remove() or
+     * entries_clear(), which keep them up to date. */
+    pa_hashmap *entries;
+    pa_idxset *missing;
 
     bool restore_device:1;
     bool restore_volume:1;
@@ -123,6 +132,10 @@ struct userdata {
 
 #define ENTRY_VERSION 1
 
+/* Stream names can be made up of anything an application puts in its
+ * proplist, so don't remember an unbounded number of misses */
+#define MISSING_MAX 256
+
 struct entry {
     uint8_t version;
     bool muted_valid, volume_valid, device_valid, card_valid;
@@ -146,6 +159,7 @@ static struct entry* entry_new(void);
 static void entry_free(struct entry *e);
 static struct entry *entry_read(struct userdata *u, const char *name);
 static bool entry_write(struct userdata *u, const char *name, const struct entry *e, bool replace);
+static void entry_remove(struct userdata *u, const char *name);
 static struct entry* entry_copy(const struct entry *e);
 static void entry_apply(struct userdata *u, const char *name, struct entry *e);
 static void trigger_save(struct userdata *u);
@@ -933,16 +947,12 @@ static void handle_entry_get_all(DBusConnection *conn, DBusMessage *msg, void *u
 
 static void handle_entry_remove(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     struct dbus_entry *de = userdata;
-    pa_datum key;
 
     pa_assert(conn);
     pa_assert(msg);
     pa_assert(de);
 
-    key.data = de->entry_name;
-    key.size = strlen(de->entry_name);
-
-    pa_assert_se(pa_database_unset(de->userdata->database, &key) == 0);
+    entry_remove(de->userdata, de->entry_name);
 
     send_entry_removed_signal(de);
     trigger_save(de->userdata);
@@ -965,7 +975,7 @@ static void save_time_callback(pa_mainloop_api*a, pa_time_event* e, const struct
     u->core->mainloop->time_free(u->save_time_event);
     u->save_time_event = NULL;
 
-    pa_database_sync(u->database);
+    pa_database_cache_sync(u->cache);
     pa_log_info("Synced.");
 }
 
@@ -1009,13 +1019,43 @@ static bool entry_write(struct userdata *u, const char *name, const struct entry
 
     data.data = (void*)pa_tagstruct_data(t, &data.size);
 
-    r = (pa_database_set(u->database, &key, &data, replace) == 0);
+    r = (pa_database_cache_set(u->cache, &key, &data, replace) == 0);
 
     pa_tagstruct_free(t);
 
+    if (r) {
+        pa_hashmap_remove_and_free(u->entries, name);
+        pa_assert_se(pa_hashmap_put(u->entries, pa_xstrdup(name), entry_copy(e)) == 0);
+        pa_idxset_remove_by_data(u->missing, name, NULL);
+    }
+
     return r;
 }
 
+static void entry_remove(struct userdata *u, const char *name) {
+    pa_datum key;
+
+    pa_assert(u);
+    pa_assert(name);
+
+    key.data = (char *) name;
+    key.size = strlen(name);
+
+    pa_database_cache_unset(u->cache, &key);
+
+    pa_hashmap_remove_and_free(u->entries, name);
+    pa_idxset_remove_by_data(u->missing, name, NULL);
+}
+
+static void entries_clear(struct userdata *u) {
+    pa_assert(u);
+
+    pa_database_cache_clear(u->cache);
+
+    pa_hashmap_remove_all(u->entries);
+    pa_idxset_remove_all(u->missing, pa_xfree);
+}
+
 #ifdef ENABLE_LEGACY_DATABASE_ENTRY_FORMAT
 
 #define LEGACY_ENTRY_VERSION 3
@@ -1043,7 +1083,7 @@ static struct entry *legacy_entry_read(struct userdata *u, const char *name) {
 
     pa_zero(data);
 
-    if (!pa_database_get(u->database, &key, &data))
+    if (!pa_database_cache_get(u->cache, &key, &data))
         goto fail;
 
     if (data.size != sizeof(struct legacy_entry)) {
@@ -1107,7 +1147,7 @@ fail:
 }
 #endif
 
-static struct entry *entry_read(struct userdata *u, const char *name) {
+static struct entry *entry_read_database(struct userdata *u, const char *name) {
     pa_datum key, data;
     struct entry *e = NULL;
     pa_tagstruct *t = NULL;
@@ -1121,7 +1161,7 @@ static struct entry *entry_read(struct userdata *u, const char *name) {
 
     pa_zero(data);
 
-    if (!pa_database_get(u->database, &key, &data))
+    if (!pa_database_cache_get(u->cache, &key, &data))
         goto fail;
 
     t = pa_tagstruct_new_fixed(data.data, data.size);
@@ -1183,6 +1223,31 @@ fail:
     return NULL;
 }
 
+static struct entry *entry_read(struct userdata *u, const char *name) {
+    struct entry *e;
+
+    pa_assert(u);
+    pa_assert(name);
+
+    if ((e = pa_hashmap_get(u->entries, name)))
+        return entry_copy(e);
+
+    if (pa_idxset_get_by_data(u->missing, name, NULL))
+        return NULL;
+
+    if ((e = entry_read_database(u, name))) {
+        pa_assert_se(pa_hashmap_put(u->entries, pa_xstrdup(name), entry_copy(e)) == 0);
+        return e;
+    }
+
+    if (pa_idxset_size(u->missing) >= MISSING_MAX)
+        pa_idxset_remove_all(u->missing, pa_xfree);
+
+    pa_assert_se(pa_idxset_put(u->missing, pa_xstrdup(name), NULL) == 0);
+
+    return NULL;
+}
+
 static struct entry* entry_copy(const struct entry *e) {
     struct entry* r;
 
@@ -1968,14 +2033,14 @@ PA_GCC_UNUSED static void stream_restore_dump_database(struct userdata *u) {
     pa_datum key;
     bool done;
 
-    done = !pa_database_first(u->database, &key, NULL);
+    done = !pa_database_cache_first(u->cache, &key, NULL);
 
     while (!done) {
         pa_datum next_key;
         struct entry *e;
         char *name;
 
-        done = !pa_database_next(u->database, &key, &next_key, NULL);
+        done = !pa_database_cache_next(u->cache, &key, &next_key, NULL);
 
         name = pa_xstrndup(key.data, key.size);
         pa_datum_free(&key);
@@ -2036,14 +2101,14 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
             if (!pa_tagstruct_eof(t))
                 goto fail;
 
-            done = !pa_database_first(u->database, &key, NULL);
+            done = !pa_database_cache_first(u->cache, &key, NULL);
 
             while (!done) {
                 pa_datum next_key;
                 struct entry *e;
                 char *name;
 
-                done = !pa_database_next(u->database, &key, &next_key, NULL);
+                done = !pa_database_cache_next(u->cache, &key, &next_key, NULL);
 
                 name = pa_xstrndup(key.data, key.size);
                 pa_datum_free(&key);
@@ -2092,7 +2157,7 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
                     pa_hashmap_remove_and_free(u->dbus_entries, de->entry_name);
                 }
 #endif
-                pa_database_clear(u->database);
+                entries_clear(u);
             }
 
             while (!pa_tagstruct_eof(t)) {
@@ -2192,7 +2257,6 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
 
             while (!pa_tagstruct_eof(t)) {
                 const char *name;
-                pa_datum key;
 #ifdef HAVE_DBUS
                 struct dbus_entry *de;
 #endif
@@ -2207,10 +2271,7 @@ static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connectio
                 }
 #endif
 
-                key.data = (char*) name;
-                key.size = strlen(name);
-
-                pa_database_unset(u->database, &key);
+                entry_remove(u, name);
             }
 
             trigger_save(u);
@@ -2285,7 +2346,7 @@ static void clean_up_db(struct userdata *u) {
     PA_LLIST_HEAD_INIT(struct clean_up_item, to_be_converted);
 #endif
 
-    done = !pa_database_first(u->database, &key, NULL);
+    done = !pa_database_cache_first(u->cache, &key, NULL);
     while (!done) {
         pa_datum next_key;
         char *entry_name = NULL;
@@ -2318,18 +2379,15 @@ static void clean_up_db(struct userdata *u) {
             entry_free(e);
         }
 
-        done = !pa_database_next(u->database, &key, &next_key, NULL);
+        done = !pa_database_cache_next(u->cache, &key, &next_key, NULL);
         pa_datum_free(&key);
         key = next_key;
     }
 
     PA_LLIST_FOREACH_SAFE(item, next, to_be_removed) {
-        key.data = item->entry_name;
-        key.size = strlen(item->entry_name);
-
         pa_log_debug("Removing an invalid entry: %s", item->entry_name);
 
-        pa_assert_se(pa_database_unset(u->database, &key) >= 0);
+        entry_remove(u, item->entry_name);
         trigger_save(u);
 
         PA_LLIST_REMOVE(struct clean_up_item, to_be_removed, item);
@@ -2436,6 +2494,12 @@ int pa__init(pa_module*m) {
     pa_log_info("Successfully opened database file '%s'.", fname);
     pa_xfree(fname);
 
+    /* Volume changes tend to come in bursts, only write them out when
+     * the save timer fires */
+    u->cache = pa_database_cache_new(u->database);
+    u->entries = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, (pa_free_cb_t) entry_free);
+    u->missing = pa_idxset_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
     clean_up_db(u);
 
     if (fill_db(u, pa_modargs_get_value(ma, "fallback_table", NULL)) < 0)
@@ -2449,7 +2513,7 @@ int pa__init(pa_module*m) {
     pa_assert_se(pa_dbus_protocol_register_extension(u->dbus_protocol, INTERFACE_STREAM_RESTORE) >= 0);
 
     /* Create the initial dbus entries. */
-    done = !pa_database_first(u->database, &key, NULL);
+    done = !pa_database_cache_first(u->cache, &key, NULL);
     while (!done) {
         pa_datum next_key;
         char *name;
@@ -2460,7 +2524,7 @@ int pa__init(pa_module*m) {
         pa_assert_se(pa_hashmap_put(u->dbus_entries, de->entry_name, de) == 0);
         pa_xfree(name);
 
-        done = !pa_database_next(u->database, &key, &next_key, NULL);
+        done = !pa_database_cache_next(u->cache, &key, &next_key, NULL);
         pa_datum_free(&key);
         key = next_key;
     }
@@ -2508,8 +2572,19 @@ void pa__done(pa_module*m) {
     if (u->subscription)
         pa_subscription_free(u->subscription);
 
-    if (u->save_time_event)
+    if (u->save_time_event) {
         u->core->mainloop->time_free(u->save_time_event);
+        pa_database_cache_sync(u->cache);
+    }
+
+    if (u->cache)
+        pa_database_cache_free(u->cache);
+
+    if (u->entries)
+        pa_hashmap_free(u->entries);
+
+    if (u->missing)
+        pa_idxset_free(u->missing, pa_xfree);
 
     if (u->database)
         pa_database_close(u->database);
@@ -38,16 +38,20 @@ PA_MODULE_AUTHOR("Lennart Poettering");
 PA_MODULE_DESCRIPTION("When a sink/source is idle for too long, suspend it");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 PA_MODULE_LOAD_ONCE(true);
-PA_MODULE_USAGE("timeout=<timeout>");
+PA_MODULE_USAGE(
+        "timeout=<timeout> "
+        "max_keep_alive=<how many seconds the timeout may be extended by for devices that keep getting used again>");
 
 static const char* const valid_modargs[] = {
     "timeout",
+    "max_keep_alive",
     NULL,
 };
 
 struct userdata {
     pa_core *core;
     pa_usec_t timeout;
+    pa_usec_t max_keep_alive;
     pa_hashmap *device_infos;
 };
 
@@ -58,6 +62,13 @@ struct device_info {
     pa_usec_t last_use;
     pa_time_event *time_event;
     pa_usec_t timeout;
+
+    /* Learned from how soon the device was used again after we last
+     * suspended it: when we keep having to resume it shortly after,
+     * bursts of streams (think event sounds) are likely, so we wait
+     * keep_alive longer before suspending it again. */
+    pa_usec_t keep_alive;
+    pa_usec_t suspended_at; /* 0 if we didn't suspend it */
 };
 
 static void timeout_cb(pa_mainloop_api*a, pa_time_event* e, const struct timeval *t, void *userdata) {
@@ -70,12 +81,14 @@ static void timeout_cb(pa_mainloop_api*a, pa_time_event* e, const struct timeval
     if (d->sink && pa_sink_check_suspend(d->sink, NULL, NULL) <= 0 && !(d->sink->suspend_cause & PA_SUSPEND_IDLE)) {
         pa_log_info("Sink %s idle for too long, suspending ...", d->sink->name);
         pa_sink_suspend(d->sink, true, PA_SUSPEND_IDLE);
+        d->suspended_at = pa_rtclock_now();
         pa_core_maybe_vacuum(d->userdata->core);
     }
 
     if (d->source && pa_source_check_suspend(d->source, NULL) <= 0 && !(d->source->suspend_cause & PA_SUSPEND_IDLE)) {
         pa_log_info("Source %s idle for too long, suspending ...", d->source->name);
         pa_source_suspend(d->source, true, PA_SUSPEND_IDLE);
+        d->suspended_at = pa_rtclock_now();
         pa_core_maybe_vacuum(d->userdata->core);
     }
 }
@@ -87,12 +100,35 @@ static void restart(struct device_info *d) {
     pa_assert(d->sink || d->source);
 
     d->last_use = now = pa_rtclock_now();
-    pa_core_rttime_restart(d->userdata->core, d->time_event, now + d->timeout);
+    pa_core_rttime_restart(d->userdata->core, d->time_event, now + d->timeout + d->keep_alive);
 
     if (d->sink)
-        pa_log_debug("Sink %s becomes idle, timeout in %" PRIu64 " seconds.", d->sink->name, d->timeout / PA_USEC_PER_SEC);
+        pa_log_debug("Sink %s becomes idle, timeout in %" PRIu64 " seconds.", d->sink->name, (d->timeout + d->keep_alive) / PA_USEC_PER_SEC);
     if (d->source)
-        pa_log_debug("Source %s becomes idle, timeout in %" PRIu64 " seconds.", d->source->name, d->timeout / PA_USEC_PER_SEC);
+        pa_log_debug("Source %s becomes idle, timeout in %" PRIu64 " seconds.", d->source->name, (d->timeout + d->keep_alive) / PA_USEC_PER_SEC);
+}
+
+/* Called when a device we suspended is needed again */
+static void update_keep_alive(struct device_info *d) {
+    pa_usec_t suspended;
+
+    pa_assert(d);
+
+    suspended = pa_rtclock_now() - d->suspended_at;
+    d->suspended_at = 0;
+
+    if (suspended < d->timeout + d->keep_alive) {
+        /* We didn't wait for long enough, the device was idle for less
+         * time than we waited before suspending it. Double down. */
+        d->keep_alive = PA_MIN(PA_MAX(d->keep_alive * 2, PA_USEC_PER_SEC), d->userdata->max_keep_alive);
+    } else {
+        /* The suspend was worth it, get more eager again */
+        d->keep_alive /= 2;
+    }
+
+    pa_log_debug("%s %s was suspended for %0.1f seconds, keeping it alive %" PRIu64 " seconds longer from now on.",
+                 d->sink ? "Sink" : "Source", d->sink ? d->sink->name : d->source->name,
+                 (double) suspended / PA_USEC_PER_SEC, d->keep_alive / PA_USEC_PER_SEC);
 }
 
 static void resume(struct device_info *d) {
@@ -100,6 +136,11 @@ static void resume(struct device_info *d) {
 
     d->userdata->core->mainloop->time_restart(d->time_event, NULL);
 
+    if (d->suspended_at > 0 &&
+        ((d->sink && (d->sink->suspend_cause & PA_SUSPEND_IDLE)) ||
+         (d->source && (d->source->suspend_cause & PA_SUSPEND_IDLE))))
+        update_keep_alive(d);
+
     if (d->sink) {
         pa_log_debug("Sink %s becomes busy, resuming.", d->sink->name);
         pa_sink_suspend(d->sink, false, PA_SUSPEND_IDLE);
@@ -341,7 +382,7 @@ static pa_hook_result_t device_new_hook_cb(pa_core *c, pa_object *o, struct user
     if (timeout_valid && timeout < 0)
         return PA_HOOK_OK;
 
-    d = pa_xnew(struct device_info, 1);
+    d = pa_xnew0(struct device_info, 1);
     d->userdata = u;
     d->source = source ? pa_source_ref(source) : NULL;
     d->sink = sink ? pa_sink_ref(sink) : NULL;
@@ -417,7 +458,7 @@ static pa_hook_result_t device_state_changed_hook_cb(pa_core *c, pa_object *o, s
 int pa__init(pa_module*m) {
     pa_modargs *ma = NULL;
     struct userdata *u;
-    uint32_t timeout = 5;
+    uint32_t timeout = 5, max_keep_alive = 60;
     uint32_t idx;
     pa_sink *sink;
     pa_source *source;
@@ -434,9 +475,15 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_u32(ma, "max_keep_alive", &max_keep_alive) < 0) {
+        pa_log("Failed to parse max_keep_alive value.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew(struct userdata, 1);
     u->core = m->core;
     u->timeout = timeout * PA_USEC_PER_SEC;
+    u->max_keep_alive = max_keep_alive * PA_USEC_PER_SEC;
     u->device_infos = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, (pa_free_cb_t) device_info_free);
 
     PA_IDXSET_FOREACH(sink, m->core->sinks, idx)
@@ -92,6 +92,10 @@ static pa_hook_result_t sink_put_hook_callback(pa_core *c, pa_sink *sink, void*
         return PA_HOOK_OK;
     }
 
+    /* Both sinks rewind only once, not once for every stream */
+    pa_sink_move_batch_begin(def);
+    pa_sink_move_batch_begin(sink);
+
     PA_IDXSET_FOREACH(i, def->inputs, idx) {
         if (i->save_sink || !PA_SINK_INPUT_IS_LINKED(i->state))
             continue;
@@ -104,6 +108,9 @@ static pa_hook_result_t sink_put_hook_callback(pa_core *c, pa_sink *sink, void*
                         pa_strnull(pa_proplist_gets(i->proplist, PA_PROP_APPLICATION_NAME)), sink->name);
     }
 
+    pa_sink_move_batch_end(sink);
+    pa_sink_move_batch_end(def);
+
     return PA_HOOK_OK;
 }
 
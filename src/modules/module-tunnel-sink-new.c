@@ -39,6 +39,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/poll.h>
 #include <pulsecore/proplist-util.h>
+#include <pulsecore/resampler.h>
 
 #include "module-tunnel-sink-new-symdef.h"
 
@@ -55,6 +56,8 @@ PA_MODULE_USAGE(
         "channels=<number of channels> "
         "rate=<sample rate> "
         "channel_map=<channel map> "
+        "transport_format=<sample format on the wire> "
+        "transport_rate=<sample rate on the wire> "
         "cookie=<cookie file path>"
         );
 
@@ -85,6 +88,11 @@ struct userdata {
     char *cookie_file;
     char *remote_server;
     char *remote_sink_name;
+
+    /* The sample spec of the stream on the remote server, and the
+     * resampler converting to it if it differs from the sink's */
+    pa_sample_spec transport_sample_spec;
+    pa_resampler *resampler;
 };
 
 static const char* const valid_modargs[] = {
@@ -96,6 +104,8 @@ static const char* const valid_modargs[] = {
     "channels",
     "rate",
     "channel_map",
+    "transport_format",
+    "transport_rate",
     "cookie",
    /* "reconnect", reconnect if server comes back again - unimplemented */
     NULL,
@@ -140,6 +150,70 @@ static pa_proplist* tunnel_new_proplist(struct userdata *u) {
     return proplist;
 }
 
+/* Converts a length of the remote stream to the equivalent length in
+ * the sink's sample spec */
+static size_t transport_to_sink_bytes(struct userdata *u, size_t nbytes) {
+    if (!u->resampler)
+        return nbytes;
+
+    return pa_usec_to_bytes(pa_bytes_to_usec(nbytes, &u->transport_sample_spec), &u->sink->sample_spec);
+}
+
+static int write_chunk(struct userdata *u, pa_memchunk *memchunk) {
+    const void *p;
+    int ret;
+
+    pa_assert(memchunk->length > 0);
+
+    /* we have new data to write */
+    p = pa_memblock_acquire(memchunk->memblock);
+    /* TODO: Use pa_stream_begin_write() to reduce copying. */
+    ret = pa_stream_write(u->stream,
+                          (uint8_t*) p + memchunk->index,
+                          memchunk->length,
+                          NULL,     /**< A cleanup routine for the data or NULL to request an internal copy */
+                          0,        /** offset */
+                          PA_SEEK_RELATIVE);
+    pa_memblock_release(memchunk->memblock);
+    pa_memblock_unref(memchunk->memblock);
+
+    return ret;
+}
+
+static int write_to_stream(struct userdata *u, size_t writable) {
+    pa_memchunk memchunk;
+
+    if (!u->resampler) {
+        pa_sink_render_full(u->sink, writable, &memchunk);
+        return write_chunk(u, &memchunk);
+    }
+
+    /* Render just enough to fill what the remote side can take after
+     * conversion */
+    while (writable > 0) {
+        pa_memchunk rendered;
+        size_t request;
+        int ret;
+
+        if ((request = pa_resampler_request(u->resampler, writable)) <= 0)
+            break;
+
+        pa_sink_render_full(u->sink, PA_MIN(request, pa_resampler_max_block_size(u->resampler)), &rendered);
+        pa_resampler_run(u->resampler, &rendered, &memchunk);
+        pa_memblock_unref(rendered.memblock);
+
+        if (memchunk.length <= 0)
+            continue;
+
+        writable -= PA_MIN(memchunk.length, writable);
+
+        if ((ret = write_chunk(u, &memchunk)) != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
     pa_proplist *proplist;
@@ -193,24 +267,7 @@ static void thread_func(void *userdata) {
 
             writable = pa_stream_writable_size(u->stream);
             if (writable > 0) {
-                pa_memchunk memchunk;
-                const void *p;
-
-                pa_sink_render_full(u->sink, writable, &memchunk);
-
-                pa_assert(memchunk.length > 0);
-
-                /* we have new data to write */
-                p = pa_memblock_acquire(memchunk.memblock);
-                /* TODO: Use pa_stream_begin_write() to reduce copying. */
-                ret = pa_stream_write(u->stream,
-                                      (uint8_t*) p + memchunk.index,
-                                      memchunk.length,
-                                      NULL,     /**< A cleanup routine for the data or NULL to request an internal copy */
-                                      0,        /** offset */
-                                      PA_SEEK_RELATIVE);
-                pa_memblock_release(memchunk.memblock);
-                pa_memblock_unref(memchunk.memblock);
+                ret = write_to_stream(u, writable);
 
                 if (ret != 0) {
                     pa_log_error("Could not write data into the stream ... ret = %i", ret);
@@ -279,7 +336,7 @@ static void stream_changed_buffer_attr_cb(pa_stream *stream, void *userdata) {
     pa_assert(u);
 
     bufferattr = pa_stream_get_buffer_attr(u->stream);
-    pa_sink_set_max_request_within_thread(u->sink, bufferattr->tlength);
+    pa_sink_set_max_request_within_thread(u->sink, transport_to_sink_bytes(u, bufferattr->tlength));
 }
 
 /* called after we requested a change of the stream buffer_attr */
@@ -314,7 +371,7 @@ static void context_state_cb(pa_context *c, void *userdata) {
             proplist = tunnel_new_proplist(u);
             u->stream = pa_stream_new_with_proplist(u->context,
                                                     stream_name,
-                                                    &u->sink->sample_spec,
+                                                    &u->transport_sample_spec,
                                                     &u->sink->channel_map,
                                                     proplist);
             pa_proplist_free(proplist);
@@ -331,7 +388,7 @@ static void context_state_cb(pa_context *c, void *userdata) {
                 requested_latency = u->sink->thread_info.max_latency;
 
             reset_bufferattr(&bufferattr);
-            bufferattr.tlength = pa_usec_to_bytes(requested_latency, &u->sink->sample_spec);
+            bufferattr.tlength = pa_usec_to_bytes(requested_latency, &u->transport_sample_spec);
 
             pa_stream_set_state_callback(u->stream, stream_state_cb, userdata);
             pa_stream_set_buffer_attr_callback(u->stream, stream_changed_buffer_attr_cb, userdata);
@@ -377,6 +434,9 @@ static void sink_update_requested_latency_cb(pa_sink *s) {
     nbytes = pa_usec_to_bytes(block_usec, &s->sample_spec);
     pa_sink_set_max_request_within_thread(s, nbytes);
 
+    /* The stream's buffer attributes are in its own sample spec */
+    nbytes = pa_usec_to_bytes(block_usec, &u->transport_sample_spec);
+
     if (u->stream) {
         switch (pa_stream_get_state(u->stream)) {
             case PA_STREAM_READY:
@@ -457,11 +517,12 @@ int pa__init(pa_module *m) {
     struct userdata *u = NULL;
     pa_modargs *ma = NULL;
     pa_sink_new_data sink_data;
-    pa_sample_spec ss;
+    pa_sample_spec ss, transport_ss;
     pa_channel_map map;
-    const char *remote_server = NULL;
+    const char *remote_server = NULL, *transport_format;
     const char *sink_name = NULL;
     char *default_sink_name = NULL;
+    char buf[PA_SAMPLE_SPEC_SNPRINT_MAX];
 
     pa_assert(m);
 
@@ -477,6 +538,20 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    transport_ss = ss;
+
+    if ((transport_format = pa_modargs_get_value(ma, "transport_format", NULL)) &&
+        (transport_ss.format = pa_parse_sample_format(transport_format)) == PA_SAMPLE_INVALID) {
+        pa_log("Invalid transport sample format '%s'", transport_format);
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "transport_rate", &transport_ss.rate) < 0 ||
+        !pa_sample_spec_valid(&transport_ss)) {
+        pa_log("Invalid transport sample rate");
+        goto fail;
+    }
+
     remote_server = pa_modargs_get_value(ma, "server", NULL);
     if (!remote_server) {
         pa_log("No server given!");
@@ -487,6 +562,7 @@ int pa__init(pa_module *m) {
     u->module = m;
     m->userdata = u;
     u->remote_server = pa_xstrdup(remote_server);
+    u->transport_sample_spec = transport_ss;
     u->thread_mainloop = pa_mainloop_new();
     if (u->thread_mainloop == NULL) {
         pa_log("Failed to create mainloop");
@@ -534,6 +610,21 @@ int pa__init(pa_module *m) {
     }
 
     pa_sink_new_data_done(&sink_data);
+
+    if (!pa_sample_spec_equal(&u->sink->sample_spec, &u->transport_sample_spec)) {
+        if (!(u->resampler = pa_resampler_new(m->core->mempool,
+                                              &u->sink->sample_spec, &u->sink->channel_map,
+                                              &u->transport_sample_spec, &u->sink->channel_map,
+                                              m->core->lfe_crossover_freq,
+                                              m->core->resample_method,
+                                              0))) {
+            pa_log("Failed to create resampler.");
+            goto fail;
+        }
+
+        pa_log_info("Converting to %s on the wire.", pa_sample_spec_snprint(buf, sizeof(buf), &u->transport_sample_spec));
+    }
+
     u->sink->userdata = u;
     u->sink->parent.process_msg = sink_process_msg_cb;
     u->sink->update_requested_latency = sink_update_requested_latency_cb;
@@ -601,5 +692,8 @@ void pa__done(pa_module *m) {
     if (u->sink)
         pa_sink_unref(u->sink);
 
+    if (u->resampler)
+        pa_resampler_free(u->resampler);
+
     pa_xfree(u);
 }
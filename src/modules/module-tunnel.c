@@ -1065,6 +1065,25 @@ static int read_formats(struct userdata *u, pa_tagstruct *t) {
 
 #ifdef TUNNEL_SINK
 
+/* The glitch counters of sinks and sink inputs, which we don't use */
+static int read_sink_stats(struct userdata *u, pa_tagstruct *t) {
+    uint32_t n;
+    uint64_t bytes;
+    pa_usec_t usec;
+
+    if (pa_tagstruct_getu32(t, &n) < 0 ||
+        pa_tagstruct_getu64(t, &bytes) < 0 ||
+        pa_tagstruct_getu32(t, &n) < 0 ||
+        pa_tagstruct_getu64(t, &bytes) < 0 ||
+        pa_tagstruct_get_usec(t, &usec) < 0) {
+
+        pa_log("Parse failure");
+        return -PA_ERR_PROTOCOL;
+    }
+
+    return 0;
+}
+
 /* Called from main context */
 static void sink_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag, pa_tagstruct *t, void *userdata) {
     struct userdata *u = userdata;
@@ -1136,6 +1155,9 @@ static void sink_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag, pa_t
     if (u->version >= 21 && read_formats(u, t) < 0)
         goto fail;
 
+    if (u->version >= 33 && read_sink_stats(u, t) < 0)
+        goto fail;
+
     if (!pa_tagstruct_eof(t)) {
         pa_log("Packet too long");
         goto fail;
@@ -1239,6 +1261,9 @@ static void sink_input_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag
         pa_format_info_free(format);
     }
 
+    if (u->version >= 33 && read_sink_stats(u, t) < 0)
+        goto fail;
+
     if (!pa_tagstruct_eof(t)) {
         pa_log("Packet too long");
         goto fail;
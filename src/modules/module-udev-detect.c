@@ -27,6 +27,7 @@
 #include <sys/inotify.h>
 #include <libudev.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 
 #include <pulsecore/modargs.h>
@@ -46,6 +47,8 @@ PA_MODULE_USAGE(
         "tsched=<enable system timer based scheduling mode?> "
         "tsched_buffer_size=<buffer size when using timer based scheduling> "
         "fixed_latency_range=<disable latency range changes on underrun?> "
+        "fixed_latency_usec=<use a fixed playback buffer of this size and never rewind> "
+        "thread_cpus=<CPUs to run the IO threads on> "
         "ignore_dB=<ignore dB information from the device?> "
         "deferred_volume=<syncronize sw and hw volume changes in IO-thread?> "
         "use_ucm=<use ALSA UCM for card configuration?>");
@@ -53,6 +56,7 @@ PA_MODULE_USAGE(
 struct device {
     char *path;
     bool need_verify;
+    bool load_pending;
     char *card_name;
     char *args;
     uint32_t module;
@@ -71,6 +75,8 @@ struct userdata {
     bool use_ucm:1;
 
     uint32_t tsched_buffer_size;
+    uint32_t fixed_latency_usec;
+    char *thread_cpus;
 
     struct udev* udev;
     struct udev_monitor *monitor;
@@ -78,12 +84,18 @@ struct userdata {
 
     int inotify_fd;
     pa_io_event *inotify_io;
+
+    /* Fires once per main loop iteration while cards are waiting to
+     * have module-alsa-card loaded, see load_cb() */
+    pa_time_event *load_event;
 };
 
 static const char* const valid_modargs[] = {
     "tsched",
     "tsched_buffer_size",
     "fixed_latency_range",
+    "fixed_latency_usec",
+    "thread_cpus",
     "ignore_dB",
     "deferred_volume",
     "use_ucm",
@@ -277,6 +289,112 @@ fail:
     return busy;
 }
 
+static void load_card(struct userdata *u, struct device *d) {
+    pa_module *m;
+
+    pa_assert(u);
+    pa_assert(d);
+
+    /* So, why do we rate limit here? It's certainly ugly, but there
+     * seems to be no other way. Problem is this: if we are unable to
+     * configure/probe an audio device after opening it we will close
+     * it again and the module initialization will fail. This will
+     * then cause an inotify event on the device node which will be
+     * forwarded to us. We then try to reopen the audio device again,
+     * practically entering a busy loop.
+     *
+     * A clean fix would be if we would be able to ignore our own
+     * inotify close events. However, inotify lacks such
+     * functionality. Also, during probing of the device we cannot
+     * really distinguish between other processes causing EBUSY or
+     * ourselves, which means we have no way to figure out if the
+     * probing during opening was canceled by a "try again" failure or
+     * a "fatal" failure. */
+
+    if (!pa_ratelimit_test(&d->ratelimit, PA_LOG_DEBUG)) {
+        pa_log_warn("Tried to configure %s (%s) more often than %u times in %llus",
+                    d->path,
+                    d->card_name,
+                    d->ratelimit.burst,
+                    (long long unsigned) (d->ratelimit.interval / PA_USEC_PER_SEC));
+        return;
+    }
+
+    pa_log_debug("Loading module-alsa-card with arguments '%s'", d->args);
+    m = pa_module_load(u->core, "module-alsa-card", d->args);
+
+    if (m) {
+        d->module = m->index;
+        pa_log_info("Card %s (%s) module loaded.", d->path, d->card_name);
+    } else
+        pa_log_info("Card %s (%s) failed to load module.", d->path, d->card_name);
+}
+
+/* Loads the next card that is waiting for its module. Returns false
+ * if there was none. */
+static bool load_next_card(struct userdata *u) {
+    struct device *d;
+    void *state;
+
+    PA_HASHMAP_FOREACH(d, u->devices, state) {
+        if (!d->load_pending)
+            continue;
+
+        d->load_pending = false;
+
+        /* The module might have been loaded in the meantime */
+        if (d->module == PA_INVALID_INDEX)
+            load_card(u, d);
+
+        return true;
+    }
+
+    return false;
+}
+
+static bool have_pending_loads(struct userdata *u) {
+    struct device *d;
+    void *state;
+
+    PA_HASHMAP_FOREACH(d, u->devices, state)
+        if (d->load_pending)
+            return true;
+
+    return false;
+}
+
+static void load_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+    pa_assert(u->load_event == e);
+
+    /* Probing a card opens all its PCMs and can take quite a while,
+     * and it has to happen in the main thread since it creates the
+     * card, sinks and sources. Load only one card per main loop
+     * iteration, so that when a hub full of devices shows up clients
+     * and further udev events are still served between the cards. We
+     * use a time event rather than a defer event for this, since the
+     * main loop doesn't dispatch I/O while a defer event is
+     * enabled. */
+
+    load_next_card(u);
+
+    if (have_pending_loads(u))
+        pa_core_rttime_restart(u->core, e, pa_rtclock_now());
+    else
+        a->time_restart(e, NULL);
+}
+
+static void schedule_load(struct userdata *u) {
+    pa_assert(u);
+
+    if (!u->load_event)
+        u->load_event = pa_core_rttime_new(u->core, pa_rtclock_now(), load_cb, u);
+    else
+        pa_core_rttime_restart(u->core, u->load_event, pa_rtclock_now());
+}
+
 static void verify_access(struct userdata *u, struct device *d) {
     char *cd;
     pa_card *card;
@@ -296,7 +414,6 @@ static void verify_access(struct userdata *u, struct device *d) {
         /* If we are not loaded, try to load */
 
         if (accessible) {
-            pa_module *m;
             bool busy;
 
             /* Check if any of the PCM devices that belong to this
@@ -310,44 +427,15 @@ static void verify_access(struct userdata *u, struct device *d) {
             pa_log_debug("%s is busy: %s", d->path, pa_yes_no(busy));
 
             if (!busy) {
-
-                /* So, why do we rate limit here? It's certainly ugly,
-                 * but there seems to be no other way. Problem is
-                 * this: if we are unable to configure/probe an audio
-                 * device after opening it we will close it again and
-                 * the module initialization will fail. This will then
-                 * cause an inotify event on the device node which
-                 * will be forwarded to us. We then try to reopen the
-                 * audio device again, practically entering a busy
-                 * loop.
-                 *
-                 * A clean fix would be if we would be able to ignore
-                 * our own inotify close events. However, inotify
-                 * lacks such functionality. Also, during probing of
-                 * the device we cannot really distinguish between
-                 * other processes causing EBUSY or ourselves, which
-                 * means we have no way to figure out if the probing
-                 * during opening was canceled by a "try again"
-                 * failure or a "fatal" failure. */
-
-                if (pa_ratelimit_test(&d->ratelimit, PA_LOG_DEBUG)) {
-                    pa_log_debug("Loading module-alsa-card with arguments '%s'", d->args);
-                    m = pa_module_load(u->core, "module-alsa-card", d->args);
-
-                    if (m) {
-                        d->module = m->index;
-                        pa_log_info("Card %s (%s) module loaded.", d->path, d->card_name);
-                    } else
-                        pa_log_info("Card %s (%s) failed to load module.", d->path, d->card_name);
-                } else
-                    pa_log_warn("Tried to configure %s (%s) more often than %u times in %llus",
-                                d->path,
-                                d->card_name,
-                                d->ratelimit.burst,
-                                (long long unsigned) (d->ratelimit.interval / PA_USEC_PER_SEC));
+                d->load_pending = true;
+                schedule_load(u);
+                return;
             }
         }
 
+        /* A load might still be queued from an earlier change */
+        d->load_pending = false;
+
     } else {
 
         /* If we are already loaded update suspend status with
@@ -417,6 +505,12 @@ static void card_changed(struct userdata *u, struct udev_device *dev) {
     if (u->tsched_buffer_size_valid)
         pa_strbuf_printf(args_buf, " tsched_buffer_size=%" PRIu32, u->tsched_buffer_size);
 
+    if (u->fixed_latency_usec > 0)
+        pa_strbuf_printf(args_buf, " fixed_latency_usec=%" PRIu32, u->fixed_latency_usec);
+
+    if (u->thread_cpus)
+        pa_strbuf_printf(args_buf, " thread_cpus=%s", u->thread_cpus);
+
     d->args = pa_strbuf_to_string_free(args_buf);
 
     pa_hashmap_put(u->devices, d->path, d);
@@ -684,6 +778,7 @@ int pa__init(pa_module *m) {
     int fd;
     bool use_tsched = true, fixed_latency_range = false, ignore_dB = false, deferred_volume = m->core->deferred_volume;
     bool use_ucm = true;
+    const char *thread_cpus;
 
     pa_assert(m);
 
@@ -718,6 +813,25 @@ int pa__init(pa_module *m) {
     }
     u->fixed_latency_range = fixed_latency_range;
 
+    if (pa_modargs_get_value_u32(ma, "fixed_latency_usec", &u->fixed_latency_usec) < 0) {
+        pa_log("Failed to parse fixed_latency_usec= argument.");
+        goto fail;
+    }
+
+    if ((thread_cpus = pa_modargs_get_value(ma, "thread_cpus", NULL))) {
+        int *cpus;
+        unsigned n_cpus;
+
+        /* Only validated here, the cards parse it again */
+        if (pa_parse_cpu_list(thread_cpus, &cpus, &n_cpus) < 0) {
+            pa_log("Failed to parse thread_cpus= argument.");
+            goto fail;
+        }
+
+        pa_xfree(cpus);
+        u->thread_cpus = pa_xstrdup(thread_cpus);
+    }
+
     if (pa_modargs_get_value_boolean(ma, "ignore_dB", &ignore_dB) < 0) {
         pa_log("Failed to parse ignore_dB= argument.");
         goto fail;
@@ -792,6 +906,11 @@ int pa__init(pa_module *m) {
 
     udev_enumerate_unref(enumerate);
 
+    /* Cards found at startup are loaded right away, so that they are
+     * available to whatever is configured after us in default.pa. */
+    while (load_next_card(u))
+        ;
+
     pa_log_info("Found %u cards.", pa_hashmap_size(u->devices));
 
     pa_modargs_free(ma);
@@ -819,6 +938,9 @@ void pa__done(pa_module *m) {
     if (!(u = m->userdata))
         return;
 
+    if (u->load_event)
+        m->core->mainloop->time_free(u->load_event);
+
     if (u->udev_io)
         m->core->mainloop->io_free(u->udev_io);
 
@@ -837,5 +959,7 @@ void pa__done(pa_module *m) {
     if (u->devices)
         pa_hashmap_free(u->devices);
 
+    pa_xfree(u->thread_cpus);
+
     pa_xfree(u);
 }
@@ -190,12 +190,27 @@ static void sink_set_mute_cb(pa_sink *s) {
     pa_sink_input_set_mute(u->sink_input, s->muted, s->save_muted);
 }
 
+/* Called from I/O thread context */
+static void process_samples(struct userdata *u, float *dst, float *src, unsigned n) {
+    unsigned c;
+
+    /* (3) PUT YOUR CODE HERE TO DO SOMETHING WITH THE DATA */
+
+    /* As an example, copy input to output */
+    for (c = 0; c < u->channels; c++) {
+        pa_sample_clamp(PA_SAMPLE_FLOAT32NE,
+                        dst+c, u->channels * sizeof(float),
+                        src+c, u->channels * sizeof(float),
+                        n);
+    }
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
     float *src, *dst;
     size_t fs;
-    unsigned n, c;
+    unsigned n;
     pa_memchunk tchunk;
     pa_usec_t current_latency PA_GCC_UNUSED;
 
@@ -237,15 +252,7 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     src = pa_memblock_acquire_chunk(&tchunk);
     dst = pa_memblock_acquire(chunk->memblock);
 
-    /* (3) PUT YOUR CODE HERE TO DO SOMETHING WITH THE DATA */
-
-    /* As an example, copy input to output */
-    for (c = 0; c < u->channels; c++) {
-        pa_sample_clamp(PA_SAMPLE_FLOAT32NE,
-                        dst+c, u->channels * sizeof(float),
-                        src+c, u->channels * sizeof(float),
-                        n);
-    }
+    process_samples(u, dst, src, n);
 
     pa_memblock_release(tchunk.memblock);
     pa_memblock_release(chunk->memblock);
@@ -263,6 +270,53 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     return 0;
 }
 
+/* Called from I/O thread context. Same as sink_input_pop_cb(), but we
+ * process straight into the master's buffer. If your filter needs a
+ * fixed block size, don't set this callback. */
+static int sink_input_pop_into_cb(pa_sink_input *i, pa_memchunk *target) {
+    struct userdata *u;
+    float *src, *dst;
+    size_t fs;
+    unsigned n;
+    pa_memchunk tchunk;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert(target);
+    pa_assert_se(u = i->userdata);
+
+    pa_sink_process_rewind(u->sink, 0);
+
+    /* Data that is left over from a rewind is handled by
+     * sink_input_pop_cb() */
+    if (pa_memblockq_is_readable(u->memblockq))
+        return -1;
+
+    pa_sink_render(u->sink, target->length, &tchunk);
+
+    /* We still need the history for rewinding */
+    pa_memblockq_push(u->memblockq, &tchunk);
+    pa_memblockq_drop(u->memblockq, tchunk.length);
+
+    fs = pa_frame_size(&i->sample_spec);
+    n = (unsigned) (tchunk.length / fs);
+
+    pa_assert(n > 0);
+
+    target->length = n*fs;
+
+    src = pa_memblock_acquire_chunk(&tchunk);
+    dst = pa_memblock_acquire_chunk(target);
+
+    process_samples(u, dst, src, n);
+
+    pa_memblock_release(tchunk.memblock);
+    pa_memblock_release(target->memblock);
+
+    pa_memblock_unref(tchunk.memblock);
+
+    return 0;
+}
+
 /* Called from I/O thread context */
 static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
     struct userdata *u;
@@ -584,6 +638,7 @@ int pa__init(pa_module*m) {
         goto fail;
 
     u->sink_input->pop = sink_input_pop_cb;
+    u->sink_input->pop_into = sink_input_pop_into_cb;
     u->sink_input->process_rewind = sink_input_process_rewind_cb;
     u->sink_input->update_max_rewind = sink_input_update_max_rewind_cb;
     u->sink_input->update_max_request = sink_input_update_max_request_cb;
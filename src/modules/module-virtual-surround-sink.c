@@ -38,6 +38,7 @@
 #include <pulsecore/ltdl-helper.h>
 #include <pulsecore/sound-file.h>
 #include <pulsecore/resampler.h>
+#include <pulsecore/filter/convolver.h>
 
 #include <math.h>
 
@@ -62,6 +63,13 @@ PA_MODULE_USAGE(
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+/* The hrir is applied with a partitioned FFT convolution, which delays
+ * the output by one block. Longer hrirs result in more partitions of
+ * the same size rather than in more latency. */
+#define MIN_BLOCK_SIZE 16
+#define MAX_BLOCK_SIZE 512
+#define MAX_HRIR_SAMPLES 16384
+
 struct userdata {
     pa_module *module;
 
@@ -85,8 +93,8 @@ struct userdata {
     unsigned hrir_samples;
     float *hrir_data;
 
-    float *input_buffer;
-    int input_buffer_offset;
+    pa_convolver *convolver;
+    unsigned block_size;
 };
 
 static const char* const valid_modargs[] = {
@@ -126,7 +134,10 @@ static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t of
                 pa_sink_get_latency_within_thread(u->sink_input->sink) +
 
                 /* Add the latency internal to our sink input on top */
-                pa_bytes_to_usec(pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq), &u->sink_input->sink->sample_spec);
+                pa_bytes_to_usec(pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq), &u->sink_input->sink->sample_spec) +
+
+                /* And the block the convolver is working on */
+                pa_bytes_to_usec(u->block_size * u->sink_fs, &u->sink->sample_spec);
 
             return 0;
     }
@@ -215,13 +226,9 @@ static void sink_set_mute_cb(pa_sink *s) {
 static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
     struct userdata *u;
     float *src, *dst;
-    unsigned n;
+    unsigned n, l;
     pa_memchunk tchunk;
 
-    unsigned j, k, l;
-    float sum_right, sum_left;
-    float current_sample;
-
     pa_sink_input_assert_ref(i);
     pa_assert(chunk);
     pa_assert_se(u = i->userdata);
@@ -253,29 +260,11 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     src = pa_memblock_acquire_chunk(&tchunk);
     dst = pa_memblock_acquire(chunk->memblock);
 
-    for (l = 0; l < n; l++) {
-        memcpy(((char*) u->input_buffer) + u->input_buffer_offset * u->sink_fs, ((char *) src) + l * u->sink_fs, u->sink_fs);
+    /* fold the input with the impulse response */
+    pa_convolver_process(u->convolver, src, dst, n);
 
-        sum_right = 0;
-        sum_left = 0;
-
-        /* fold the input buffer with the impulse response */
-        for (j = 0; j < u->hrir_samples; j++) {
-            for (k = 0; k < u->channels; k++) {
-                current_sample = u->input_buffer[((u->input_buffer_offset + j) % u->hrir_samples) * u->channels + k];
-
-                sum_left += current_sample * u->hrir_data[j * u->hrir_channels + u->mapping_left[k]];
-                sum_right += current_sample * u->hrir_data[j * u->hrir_channels + u->mapping_right[k]];
-            }
-        }
-
-        dst[2 * l] = PA_CLAMP_UNLIKELY(sum_left, -1.0f, 1.0f);
-        dst[2 * l + 1] = PA_CLAMP_UNLIKELY(sum_right, -1.0f, 1.0f);
-
-        u->input_buffer_offset--;
-        if (u->input_buffer_offset < 0)
-            u->input_buffer_offset += u->hrir_samples;
-    }
+    for (l = 0; l < 2 * n; l++)
+        dst[l] = PA_CLAMP_UNLIKELY(dst[l], -1.0f, 1.0f);
 
     pa_memblock_release(tchunk.memblock);
     pa_memblock_release(chunk->memblock);
@@ -303,9 +292,8 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
         if (amount > 0) {
             pa_memblockq_seek(u->memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, true);
 
-            /* Reset the input buffer */
-            memset(u->input_buffer, 0, u->hrir_samples * u->sink_fs);
-            u->input_buffer_offset = 0;
+            /* Reset the convolution history */
+            pa_convolver_reset(u->convolver);
         }
     }
 
@@ -556,6 +544,13 @@ static void normalize_hrir(struct userdata *u) {
     }
 }
 
+static void get_hrir_column(struct userdata *u, unsigned channel, float *dst) {
+    unsigned i;
+
+    for (i = 0; i < u->hrir_samples; i++)
+        dst[i] = u->hrir_data[i * u->hrir_channels + channel];
+}
+
 int pa__init(pa_module*m) {
     struct userdata *u;
     pa_sample_spec ss, sink_input_ss;
@@ -570,7 +565,7 @@ int pa__init(pa_module*m) {
 
     const char *hrir_file;
     unsigned i, j, found_channel_left, found_channel_right;
-    float *hrir_data;
+    float *hrir_data, *hrir_column;
 
     pa_sample_spec hrir_ss;
     pa_channel_map hrir_map;
@@ -747,9 +742,16 @@ int pa__init(pa_module*m) {
                                  PA_RESAMPLER_SRC_SINC_BEST_QUALITY, PA_RESAMPLER_NO_REMAP);
 
     u->hrir_samples = hrir_temp_chunk.length / pa_frame_size(&hrir_temp_ss) * hrir_ss.rate / hrir_temp_ss.rate;
-    if (u->hrir_samples > 64) {
-        u->hrir_samples = 64;
-        pa_log("The (resampled) hrir contains more than 64 samples. Only the first 64 samples will be used to limit processor usage.");
+    if (u->hrir_samples > MAX_HRIR_SAMPLES) {
+        u->hrir_samples = MAX_HRIR_SAMPLES;
+        pa_log("The (resampled) hrir contains more than %u samples. Only the first %u samples will be used to limit processor usage.",
+               MAX_HRIR_SAMPLES, MAX_HRIR_SAMPLES);
+    }
+
+    if (u->hrir_samples == 0) {
+        pa_log("The hrir file does not contain any samples.");
+        pa_resampler_free(resampler);
+        goto fail;
     }
 
     hrir_total_length = u->hrir_samples * pa_frame_size(&hrir_ss);
@@ -771,10 +773,10 @@ int pa__init(pa_module*m) {
             hrir_data = (float *) pa_memblock_acquire(hrir_temp_chunk_resampled.memblock);
 
             if (hrir_total_length - hrir_copied_length >= hrir_temp_chunk_resampled.length) {
-                memcpy(u->hrir_data + hrir_copied_length, hrir_data, hrir_temp_chunk_resampled.length);
+                memcpy((uint8_t *) u->hrir_data + hrir_copied_length, hrir_data, hrir_temp_chunk_resampled.length);
                 hrir_copied_length += hrir_temp_chunk_resampled.length;
             } else {
-                memcpy(u->hrir_data + hrir_copied_length, hrir_data, hrir_total_length - hrir_copied_length);
+                memcpy((uint8_t *) u->hrir_data + hrir_copied_length, hrir_data, hrir_total_length - hrir_copied_length);
                 hrir_copied_length = hrir_total_length;
             }
 
@@ -825,8 +827,20 @@ int pa__init(pa_module*m) {
         }
     }
 
-    u->input_buffer = pa_xmalloc0(u->hrir_samples * u->sink_fs);
-    u->input_buffer_offset = 0;
+    u->block_size = PA_CLAMP(pa_make_power_of_two(u->hrir_samples), MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+    u->convolver = pa_convolver_new(u->block_size, u->channels, 2, u->hrir_samples);
+
+    hrir_column = pa_xnew(float, u->hrir_samples);
+    for (i = 0; i < u->channels; i++) {
+        get_hrir_column(u, u->mapping_left[i], hrir_column);
+        pa_convolver_set_response(u->convolver, i, 0, hrir_column, u->hrir_samples);
+
+        get_hrir_column(u, u->mapping_right[i], hrir_column);
+        pa_convolver_set_response(u->convolver, i, 1, hrir_column, u->hrir_samples);
+    }
+    pa_xfree(hrir_column);
+
+    pa_log_debug("Convolving with %u hrir samples in blocks of %u.", u->hrir_samples, u->block_size);
 
     pa_sink_put(u->sink);
     pa_sink_input_put(u->sink_input);
@@ -887,8 +901,8 @@ void pa__done(pa_module*m) {
     if (u->hrir_data)
         pa_xfree(u->hrir_data);
 
-    if (u->input_buffer)
-        pa_xfree(u->input_buffer);
+    if (u->convolver)
+        pa_convolver_free(u->convolver);
 
     if (u->mapping_left)
         pa_xfree(u->mapping_left);
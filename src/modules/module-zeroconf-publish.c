@@ -33,8 +33,11 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
+#include <pulse/rtclock.h>
 #include <pulse/thread-mainloop.h>
+#include <pulse/timeval.h>
 
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/parseaddr.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/source.h>
@@ -85,8 +88,16 @@ PA_MODULE_LOAD_ONCE(true);
  *
  * We do have message queue to pass messages from the Avahi mainloop to the PA
  * mainloop.
+ *
+ * Device changes only mark the service dirty in the PA mainloop; a timer in
+ * the Avahi mainloop then republishes everything that changed within
+ * PUBLISH_DELAY_USEC in one go. Services whose TXT record is all that changed
+ * are updated in place instead of resetting their entry group, and a TXT
+ * record identical to the published one is not sent at all.
  */
 
+#define PUBLISH_DELAY_USEC (500 * PA_USEC_PER_MSEC)
+
 static const char* const valid_modargs[] = {
     NULL
 };
@@ -124,6 +135,9 @@ struct service {
     pa_sample_spec ss;
     pa_channel_map cm;
     pa_proplist *proplist;
+
+    bool dirty; /* protect with mainloop lock */
+    AvahiStringList *published_txt; /* Used in the Avahi thread. NULL if not committed. */
 };
 
 struct userdata {
@@ -140,6 +154,11 @@ struct userdata {
     AvahiClient *client;
 
     pa_hashmap *services; /* protect with mainloop lock */
+    pa_dynarray *dead_services; /* Unlinked, freed in the Avahi thread. Protect with mainloop lock */
+    pa_time_event *publish_event; /* Avahi mainloop timer, coalesces republishing */
+    bool publish_scheduled; /* protect with mainloop lock */
+    bool main_service_dirty; /* protect with mainloop lock */
+    AvahiStringList *server_txt; /* Used in the Avahi thread */
     char *service_name;
     char *icon_name;
 
@@ -211,7 +230,17 @@ static AvahiStringList* txt_record_server_data(pa_core *c, AvahiStringList *l) {
     return l;
 }
 
-static void publish_service(pa_mainloop_api *api, void *service);
+/* Runs in Avahi mainloop context */
+static AvahiStringList *get_server_txt(struct userdata *u) {
+    pa_assert(u);
+
+    if (!u->server_txt)
+        u->server_txt = txt_record_server_data(u->core, NULL);
+
+    return u->server_txt;
+}
+
+static void publish_service(struct service *s);
 
 /* Runs in Avahi mainloop context */
 static void service_entry_group_callback(AvahiEntryGroup *g, AvahiEntryGroupState state, void *userdata) {
@@ -233,7 +262,10 @@ static void service_entry_group_callback(AvahiEntryGroup *g, AvahiEntryGroupStat
             pa_xfree(s->service_name);
             s->service_name = t;
 
-            publish_service(NULL, s);
+            avahi_string_list_free(s->published_txt);
+            s->published_txt = NULL;
+
+            publish_service(s);
             break;
         }
 
@@ -243,6 +275,9 @@ static void service_entry_group_callback(AvahiEntryGroup *g, AvahiEntryGroupStat
             avahi_entry_group_free(g);
             s->entry_group = NULL;
 
+            avahi_string_list_free(s->published_txt);
+            s->published_txt = NULL;
+
             break;
         }
 
@@ -280,10 +315,8 @@ static uint16_t compute_port(struct userdata *u) {
 }
 
 /* Runs in Avahi mainloop context */
-static void publish_service(pa_mainloop_api *api PA_GCC_UNUSED, void *service) {
-    struct service *s = (struct service *) service;
-    int r = -1;
-    AvahiStringList *txt = NULL;
+static AvahiStringList *service_txt(struct service *s) {
+    AvahiStringList *txt;
     char cm[PA_CHANNEL_MAP_SNPRINT_MAX];
     const char *t;
 
@@ -295,18 +328,7 @@ static void publish_service(pa_mainloop_api *api PA_GCC_UNUSED, void *service) {
 
     pa_assert(s);
 
-    if (!s->userdata->client || avahi_client_get_state(s->userdata->client) != AVAHI_CLIENT_S_RUNNING)
-        return;
-
-    if (!s->entry_group) {
-        if (!(s->entry_group = avahi_entry_group_new(s->userdata->client, service_entry_group_callback, s))) {
-            pa_log("avahi_entry_group_new(): %s", avahi_strerror(avahi_client_errno(s->userdata->client)));
-            goto finish;
-        }
-    } else
-        avahi_entry_group_reset(s->entry_group);
-
-    txt = txt_record_server_data(s->userdata->core, txt);
+    txt = avahi_string_list_copy(get_server_txt(s->userdata));
 
     txt = avahi_string_list_add_pair(txt, "device", s->name);
     txt = avahi_string_list_add_printf(txt, "rate=%u", s->ss.rate);
@@ -332,6 +354,59 @@ static void publish_service(pa_mainloop_api *api PA_GCC_UNUSED, void *service) {
         txt = avahi_string_list_add_pair(txt, "icon-name", t);
     }
 
+    return txt;
+}
+
+/* Runs in Avahi mainloop context */
+static void publish_service(struct service *s) {
+    int r = -1;
+    AvahiStringList *txt = NULL;
+
+    pa_assert(s);
+
+    if (!s->userdata->client || avahi_client_get_state(s->userdata->client) != AVAHI_CLIENT_S_RUNNING)
+        return;
+
+    txt = service_txt(s);
+
+    /* Once committed, only the TXT record can change: the service name only
+     * changes on collisions, which drop published_txt. */
+    if (s->published_txt) {
+        if (avahi_string_list_equal(txt, s->published_txt)) {
+            avahi_string_list_free(txt);
+            return;
+        }
+
+        if (avahi_entry_group_update_service_txt_strlst(
+                    s->entry_group,
+                    AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC,
+                    0,
+                    s->service_name,
+                    s->service_type,
+                    NULL,
+                    txt) >= 0) {
+
+            pa_log_debug("Updated TXT record for %s.", s->service_name);
+            avahi_string_list_free(s->published_txt);
+            s->published_txt = txt;
+            return;
+        }
+
+        pa_log_debug("avahi_entry_group_update_service_txt_strlst(): %s, republishing %s.",
+                     avahi_strerror(avahi_client_errno(s->userdata->client)), s->service_name);
+
+        avahi_string_list_free(s->published_txt);
+        s->published_txt = NULL;
+    }
+
+    if (!s->entry_group) {
+        if (!(s->entry_group = avahi_entry_group_new(s->userdata->client, service_entry_group_callback, s))) {
+            pa_log("avahi_entry_group_new(): %s", avahi_strerror(avahi_client_errno(s->userdata->client)));
+            goto finish;
+        }
+    } else
+        avahi_entry_group_reset(s->entry_group);
+
     if (avahi_entry_group_add_service_strlst(
                 s->entry_group,
                 AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC,
@@ -384,15 +459,33 @@ static void publish_service(pa_mainloop_api *api PA_GCC_UNUSED, void *service) {
     r = 0;
     pa_log_debug("Successfully created entry group for %s.", s->service_name);
 
+    s->published_txt = txt;
+    txt = NULL;
+
 finish:
 
-    /* Remove this service */
-    if (r < 0)
-        pa_hashmap_remove_and_free(s->userdata->services, s->key);
+    /* Leave the service unpublished until its device changes again */
+    if (r < 0 && s->entry_group) {
+        avahi_entry_group_free(s->entry_group);
+        s->entry_group = NULL;
+    }
 
     avahi_string_list_free(txt);
 }
 
+/* Runs in PA mainloop context, with the Avahi mainloop locked */
+static void schedule_publish(struct userdata *u) {
+    struct timeval tv;
+
+    pa_assert(u);
+
+    if (u->publish_scheduled)
+        return;
+
+    u->api->time_restart(u->publish_event, pa_timeval_rtstore(&tv, pa_rtclock_now() + PUBLISH_DELAY_USEC, true));
+    u->publish_scheduled = true;
+}
+
 /* Runs in PA mainloop context */
 static struct service *get_service(struct userdata *u, pa_object *device) {
     struct service *s;
@@ -404,13 +497,20 @@ static struct service *get_service(struct userdata *u, pa_object *device) {
 
     pa_threaded_mainloop_lock(u->mainloop);
 
-    if ((s = pa_hashmap_get(u->services, device)))
+    if ((s = pa_hashmap_get(u->services, device))) {
+        /* Refresh what the TXT record is built from */
+        pa_xfree(s->name);
+        pa_proplist_free(s->proplist);
+        get_service_data(s, device);
         goto out;
+    }
 
     s = pa_xnew(struct service, 1);
     s->key = device;
     s->userdata = u;
     s->entry_group = NULL;
+    s->dirty = false;
+    s->published_txt = NULL;
 
     get_service_data(s, device);
 
@@ -446,6 +546,7 @@ static void service_free(struct service *s) {
 
     pa_xfree(s->name);
     pa_proplist_free(s->proplist);
+    avahi_string_list_free(s->published_txt);
 
     pa_xfree(s);
 }
@@ -470,7 +571,8 @@ static pa_hook_result_t device_new_or_changed_cb(pa_core *c, pa_object *o, struc
 
     if (!shall_ignore(o)) {
         pa_threaded_mainloop_lock(u->mainloop);
-        pa_mainloop_api_once(u->api, publish_service, get_service(u, o));
+        get_service(u, o)->dirty = true;
+        schedule_publish(u);
         pa_threaded_mainloop_unlock(u->mainloop);
     }
 
@@ -479,11 +581,18 @@ static pa_hook_result_t device_new_or_changed_cb(pa_core *c, pa_object *o, struc
 
 /* Runs in PA mainloop context */
 static pa_hook_result_t device_unlink_cb(pa_core *c, pa_object *o, struct userdata *u) {
+    struct service *s;
+
     pa_assert(c);
     pa_object_assert_ref(o);
 
+    /* Freeing the entry group talks to the Avahi daemon, leave that to the
+     * Avahi mainloop */
     pa_threaded_mainloop_lock(u->mainloop);
-    pa_hashmap_remove_and_free(u->services, o);
+    if ((s = pa_hashmap_remove(u->services, o))) {
+        pa_dynarray_append(u->dead_services, s);
+        schedule_publish(u);
+    }
     pa_threaded_mainloop_unlock(u->mainloop);
 
     return PA_HOOK_OK;
@@ -543,7 +652,7 @@ static int publish_main_service(struct userdata *u) {
     } else
         avahi_entry_group_reset(u->main_entry_group);
 
-    txt = txt_record_server_data(u->core, txt);
+    txt = avahi_string_list_copy(get_server_txt(u));
 
     if (avahi_entry_group_add_service_strlst(
                 u->main_entry_group,
@@ -574,37 +683,59 @@ fail:
 }
 
 /* Runs in PA mainloop context */
-static int publish_all_services(struct userdata *u) {
+static void publish_all_services(struct userdata *u) {
     pa_sink *sink;
     pa_source *source;
-    int r = -1;
     uint32_t idx;
 
     pa_assert(u);
 
     pa_log_debug("Publishing services in Zeroconf");
 
-    for (sink = PA_SINK(pa_idxset_first(u->core->sinks, &idx)); sink; sink = PA_SINK(pa_idxset_next(u->core->sinks, &idx)))
-        if (!shall_ignore(PA_OBJECT(sink))) {
-            pa_threaded_mainloop_lock(u->mainloop);
-            pa_mainloop_api_once(u->api, publish_service, get_service(u, PA_OBJECT(sink)));
-            pa_threaded_mainloop_unlock(u->mainloop);
-        }
+    pa_threaded_mainloop_lock(u->mainloop);
 
-    for (source = PA_SOURCE(pa_idxset_first(u->core->sources, &idx)); source; source = PA_SOURCE(pa_idxset_next(u->core->sources, &idx)))
-        if (!shall_ignore(PA_OBJECT(source))) {
-            pa_threaded_mainloop_lock(u->mainloop);
-            pa_mainloop_api_once(u->api, publish_service, get_service(u, PA_OBJECT(source)));
-            pa_threaded_mainloop_unlock(u->mainloop);
-        }
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx)
+        if (!shall_ignore(PA_OBJECT(sink)))
+            get_service(u, PA_OBJECT(sink))->dirty = true;
 
-    if (publish_main_service(u) < 0)
-        goto fail;
+    PA_IDXSET_FOREACH(source, u->core->sources, idx)
+        if (!shall_ignore(PA_OBJECT(source)))
+            get_service(u, PA_OBJECT(source))->dirty = true;
 
-    r = 0;
+    u->main_service_dirty = true;
+    schedule_publish(u);
 
-fail:
-    return r;
+    pa_threaded_mainloop_unlock(u->mainloop);
+}
+
+/* Runs in Avahi mainloop context */
+static void publish_event_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+    struct service *s;
+    void *state = NULL;
+
+    pa_assert(u);
+
+    u->publish_scheduled = false;
+
+    while ((s = pa_dynarray_steal_last(u->dead_services)))
+        service_free(s);
+
+    if (!u->client || avahi_client_get_state(u->client) != AVAHI_CLIENT_S_RUNNING)
+        return;
+
+    if (u->main_service_dirty) {
+        u->main_service_dirty = false;
+        publish_main_service(u);
+    }
+
+    PA_HASHMAP_FOREACH(s, u->services, state) {
+        if (!s->dirty)
+            continue;
+
+        s->dirty = false;
+        publish_service(s);
+    }
 }
 
 /* Runs in Avahi mainloop context */
@@ -617,6 +748,9 @@ static void unpublish_all_services(struct userdata *u, bool rem) {
     pa_log_debug("Unpublishing services in Zeroconf");
 
     while ((s = pa_hashmap_iterate(u->services, &state, NULL))) {
+        avahi_string_list_free(s->published_txt);
+        s->published_txt = NULL;
+
         if (s->entry_group) {
             if (rem) {
                 pa_log_debug("Removing entry group for %s.", s->service_name);
@@ -839,6 +973,8 @@ int pa__init(pa_module*m) {
     u->avahi_poll = pa_avahi_poll_new(u->api);
 
     u->services = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL, (pa_free_cb_t) service_free);
+    u->dead_services = pa_dynarray_new((pa_free_cb_t) service_free);
+    u->publish_event = u->api->time_new(u->api, NULL, publish_event_cb, u);
 
     u->sink_new_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_PUT], PA_HOOK_LATE, (pa_hook_cb_t) device_new_or_changed_cb, u);
     u->sink_changed_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_PROPLIST_CHANGED], PA_HOOK_LATE, (pa_hook_cb_t) device_new_or_changed_cb, u);
@@ -878,11 +1014,18 @@ fail:
 static void client_free(pa_mainloop_api *api PA_GCC_UNUSED, void *userdata) {
     struct userdata *u = (struct userdata *) userdata;
 
+    if (u->publish_event)
+        u->api->time_free(u->publish_event);
+
     pa_hashmap_free(u->services);
+    pa_dynarray_free(u->dead_services);
 
     if (u->main_entry_group)
         avahi_entry_group_free(u->main_entry_group);
 
+    if (u->server_txt)
+        avahi_string_list_free(u->server_txt);
+
     if (u->client)
         avahi_client_free(u->client);
 
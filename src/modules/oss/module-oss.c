@@ -50,6 +50,8 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-error.h>
 #include <pulsecore/thread.h>
@@ -64,6 +66,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/poll.h>
+#include <pulsecore/time-smoother.h>
 
 #if defined(__NetBSD__) && !defined(SNDCTL_DSP_GETODELAY)
 #include <sys/audioio.h>
@@ -91,13 +94,25 @@ PA_MODULE_USAGE(
         "channel_map=<channel map> "
         "fragments=<number of fragments> "
         "fragment_size=<fragment size> "
-        "mmap=<enable memory mapping?>");
+        "mmap=<enable memory mapping?> "
+        "tsched=<enable system timer based scheduling mode?>");
 #ifdef __linux__
 PA_MODULE_DEPRECATED("Please use module-alsa-card instead of module-oss!");
 #endif
 
 #define DEFAULT_DEVICE "/dev/dsp"
 
+#define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms  -- Wakeup at least this long before the buffer runs empty/full */
+#define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  -- On underrun/overrun, increase watermark by this */
+#define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms   -- When everything's great, decrease watermark by this */
+#define TSCHED_WATERMARK_DEC_THRESHOLD_USEC (100*PA_USEC_PER_MSEC) /* 100ms -- If the buffer level didn't drop below this threshold in the verification time, decrease the watermark */
+#define TSCHED_WATERMARK_VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)    /* 20s   -- How long after a drop out recheck if things are good now */
+
+#define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s   -- smoother windows size */
+#define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s    -- smoother adjust time */
+#define SMOOTHER_MIN_INTERVAL (2*PA_USEC_PER_MSEC)                 /* 2ms   -- min smoother update interval */
+#define SMOOTHER_MAX_INTERVAL (200*PA_USEC_PER_MSEC)               /* 200ms -- max smoother update interval */
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -134,6 +149,19 @@ struct userdata {
 
     int in_mmap_saved_nfrags, out_mmap_saved_nfrags;
 
+    /* In tsched mode we don't wake up for every fragment, but sleep
+     * until the buffer is within tsched_watermark of running empty
+     * (playback) or full (capture), and then move everything there is
+     * in one go. The smoother translates between the sound card's
+     * clock and ours. */
+    bool use_tsched;
+    pa_usec_t tsched_watermark, watermark_dec_not_before;
+    uint64_t write_count;
+    bool first;
+
+    pa_smoother *smoother;
+    pa_usec_t smoother_interval, last_smoother_update;
+
     pa_rtpoll_item *rtpoll_item;
 };
 
@@ -152,6 +180,7 @@ static const char* const valid_modargs[] = {
     "channels",
     "channel_map",
     "mmap",
+    "tsched",
     NULL
 };
 
@@ -469,6 +498,270 @@ static pa_usec_t io_source_get_latency(struct userdata *u) {
     return r;
 }
 
+static void fix_tsched_watermark(struct userdata *u) {
+    const pa_sample_spec *ss;
+    pa_usec_t min_wakeup, max_use;
+
+    pa_assert(u);
+
+    ss = u->sink ? &u->sink->sample_spec : &u->source->sample_spec;
+
+    /* Wake up no more often than once per fragment, and never so late
+     * that there's less than a fragment left to sleep */
+    min_wakeup = pa_bytes_to_usec(PA_MAX(u->sink ? u->out_fragment_size : 0, u->source ? u->in_fragment_size : 0), ss);
+    max_use = pa_bytes_to_usec(PA_MIN(u->sink ? u->out_hwbuf_size : UINT32_MAX, u->source ? u->in_hwbuf_size : UINT32_MAX), ss);
+    max_use = max_use > min_wakeup ? max_use - min_wakeup : 0;
+
+    u->tsched_watermark = PA_CLAMP_UNLIKELY(u->tsched_watermark, min_wakeup, PA_MAX(min_wakeup, max_use));
+}
+
+static void increase_watermark(struct userdata *u) {
+    pa_usec_t old_watermark;
+
+    pa_assert(u);
+
+    old_watermark = u->tsched_watermark;
+    u->tsched_watermark = PA_MIN(u->tsched_watermark * 2, u->tsched_watermark + TSCHED_WATERMARK_INC_STEP_USEC);
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark)
+        pa_log_info("Increasing wakeup watermark to %0.2f ms",
+                    (double) u->tsched_watermark / PA_USEC_PER_MSEC);
+
+    u->watermark_dec_not_before = 0;
+}
+
+static void decrease_watermark(struct userdata *u) {
+    pa_usec_t old_watermark, now;
+
+    pa_assert(u);
+
+    now = pa_rtclock_now();
+
+    /* Only decrease once things have been good for a while */
+    if (u->watermark_dec_not_before <= 0 || u->watermark_dec_not_before > now) {
+        if (u->watermark_dec_not_before <= 0)
+            u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+        return;
+    }
+
+    old_watermark = u->tsched_watermark;
+
+    if (u->tsched_watermark < TSCHED_WATERMARK_DEC_STEP_USEC)
+        u->tsched_watermark = u->tsched_watermark / 2;
+    else
+        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - TSCHED_WATERMARK_DEC_STEP_USEC);
+
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark)
+        pa_log_info("Decreasing wakeup watermark to %0.2f ms",
+                    (double) u->tsched_watermark / PA_USEC_PER_MSEC);
+
+    u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+}
+
+/* Called from IO context */
+static void update_smoother(struct userdata *u) {
+    int delay;
+    int64_t position;
+    pa_usec_t now;
+
+    pa_assert(u);
+
+    now = pa_rtclock_now();
+
+    /* Check if the time since the last update is bigger than the interval */
+    if (u->last_smoother_update > 0)
+        if (u->last_smoother_update + u->smoother_interval > now)
+            return;
+
+    if (ioctl(u->fd, SNDCTL_DSP_GETODELAY, &delay) < 0) {
+        pa_log_warn("SNDCTL_DSP_GETODELAY: %s", pa_cstrerror(errno));
+        return;
+    }
+
+    position = (int64_t) u->write_count - delay;
+
+    if (PA_UNLIKELY(position < 0))
+        position = 0;
+
+    pa_smoother_put(u->smoother, now, pa_bytes_to_usec((uint64_t) position, &u->sink->sample_spec));
+
+    u->last_smoother_update = now;
+    u->smoother_interval = PA_MIN(u->smoother_interval * 2, SMOOTHER_MAX_INTERVAL);
+}
+
+static pa_usec_t tsched_sink_get_latency(struct userdata *u) {
+    int64_t delay;
+    pa_usec_t r;
+
+    pa_assert(u);
+
+    delay = (int64_t) pa_bytes_to_usec(u->write_count, &u->sink->sample_spec) - (int64_t) pa_smoother_get(u->smoother, pa_rtclock_now());
+    r = delay >= 0 ? (pa_usec_t) delay : 0;
+
+    if (u->memchunk.memblock)
+        r += pa_bytes_to_usec(u->memchunk.length, &u->sink->sample_spec);
+
+    return r;
+}
+
+/* Called from IO context. Fills up the whole buffer, rendering it in
+ * one go, and figures out how long we may sleep afterwards. */
+static int tsched_write(struct userdata *u, pa_usec_t *sleep_usec) {
+    struct audio_buf_info info;
+    size_t n, left_to_play;
+    pa_usec_t left_usec;
+    int write_type = 0;
+
+    pa_assert(u);
+    pa_assert(sleep_usec);
+
+    if (ioctl(u->fd, SNDCTL_DSP_GETOSPACE, &info) < 0) {
+        pa_log("SNDCTL_DSP_GETOSPACE: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    n = PA_MIN((size_t) PA_MAX(info.bytes, 0), (size_t) u->out_hwbuf_size);
+    left_to_play = u->out_hwbuf_size - n;
+
+    if (!u->first) {
+        if (left_to_play <= 0) {
+            pa_log_debug("Underrun!");
+            increase_watermark(u);
+        } else if (pa_bytes_to_usec(left_to_play, &u->sink->sample_spec) > TSCHED_WATERMARK_DEC_THRESHOLD_USEC)
+            decrease_watermark(u);
+        else
+            u->watermark_dec_not_before = 0;
+    }
+
+    /* Round down to multiples of the fragment size, because OSS needs
+     * that (at least some versions do) */
+    n = (n / u->out_fragment_size) * u->out_fragment_size;
+
+    while (n > 0) {
+        void *p;
+        ssize_t t;
+
+        if (u->memchunk.length <= 0)
+            pa_sink_render_full(u->sink, n, &u->memchunk);
+
+        p = pa_memblock_acquire(u->memchunk.memblock);
+        t = pa_write(u->fd, (uint8_t*) p + u->memchunk.index, PA_MIN(u->memchunk.length, n), &write_type);
+        pa_memblock_release(u->memchunk.memblock);
+
+        if (t < 0) {
+
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN)
+                break;
+
+            pa_log("Failed to write data to DSP: %s", pa_cstrerror(errno));
+            return -1;
+        }
+
+        u->memchunk.index += (size_t) t;
+        u->memchunk.length -= (size_t) t;
+
+        if (u->memchunk.length <= 0) {
+            pa_memblock_unref(u->memchunk.memblock);
+            pa_memchunk_reset(&u->memchunk);
+        }
+
+        u->write_count += (uint64_t) t;
+        left_to_play += (size_t) t;
+        n -= (size_t) t;
+    }
+
+    if (u->first) {
+        pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+        u->first = false;
+    }
+
+    update_smoother(u);
+
+    /* Sleep until the buffer has drained down to the watermark */
+    left_usec = pa_bytes_to_usec(left_to_play, &u->sink->sample_spec);
+    left_usec = left_usec > u->tsched_watermark ? left_usec - u->tsched_watermark : 0;
+
+    *sleep_usec = pa_smoother_translate(u->smoother, pa_rtclock_now(), left_usec);
+
+    return 0;
+}
+
+/* Called from IO context. Reads everything that's there and figures
+ * out how long we may sleep afterwards. */
+static int tsched_read(struct userdata *u, pa_usec_t *sleep_usec) {
+    struct audio_buf_info info;
+    size_t n, left_to_record;
+    pa_usec_t free_usec;
+    int read_type = 0;
+
+    pa_assert(u);
+    pa_assert(sleep_usec);
+
+    if (ioctl(u->fd, SNDCTL_DSP_GETISPACE, &info) < 0) {
+        pa_log("SNDCTL_DSP_GETISPACE: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    left_to_record = PA_MIN((size_t) PA_MAX(info.bytes, 0), (size_t) u->in_hwbuf_size);
+
+    if (left_to_record >= u->in_hwbuf_size) {
+        pa_log_debug("Overrun!");
+        increase_watermark(u);
+    }
+
+    n = (left_to_record / u->in_fragment_size) * u->in_fragment_size;
+
+    while (n > 0) {
+        pa_memchunk memchunk;
+        void *p;
+        ssize_t t;
+        size_t k;
+
+        memchunk.memblock = pa_memblock_new(u->core->mempool, (size_t) -1);
+
+        k = PA_MIN(pa_memblock_get_length(memchunk.memblock), n);
+        k = (k/u->frame_size)*u->frame_size;
+
+        p = pa_memblock_acquire(memchunk.memblock);
+        t = pa_read(u->fd, p, k, &read_type);
+        pa_memblock_release(memchunk.memblock);
+
+        if (t <= 0) {
+            pa_memblock_unref(memchunk.memblock);
+
+            if (t < 0 && errno == EINTR)
+                continue;
+
+            if (t == 0 || errno == EAGAIN)
+                break;
+
+            pa_log("Failed to read data from DSP: %s", pa_cstrerror(errno));
+            return -1;
+        }
+
+        memchunk.index = 0;
+        memchunk.length = (size_t) t;
+
+        pa_source_post(u->source, &memchunk);
+        pa_memblock_unref(memchunk.memblock);
+
+        left_to_record -= PA_MIN((size_t) t, left_to_record);
+        n -= (size_t) t;
+    }
+
+    /* Sleep until the buffer has filled up to the watermark */
+    free_usec = pa_bytes_to_usec(u->in_hwbuf_size - left_to_record, &u->source->sample_spec);
+    *sleep_usec = free_usec > u->tsched_watermark ? free_usec - u->tsched_watermark : 0;
+
+    return 0;
+}
+
 static void build_pollfd(struct userdata *u) {
     struct pollfd *pollfd;
 
@@ -520,6 +813,9 @@ static int suspend(struct userdata *u) {
         u->out_mmap = NULL;
     }
 
+    if (u->smoother)
+        pa_smoother_pause(u->smoother, pa_rtclock_now());
+
     /* Let's suspend */
     ioctl(u->fd, SNDCTL_DSP_SYNC, NULL);
     pa_close(u->fd);
@@ -622,6 +918,14 @@ static int unsuspend(struct userdata *u) {
     u->out_mmap_current = u->in_mmap_current = 0;
     u->out_mmap_saved_nfrags = u->in_mmap_saved_nfrags = 0;
 
+    u->write_count = 0;
+    u->first = true;
+    u->last_smoother_update = 0;
+    u->smoother_interval = SMOOTHER_MIN_INTERVAL;
+
+    if (u->smoother)
+        pa_smoother_reset(u->smoother, pa_rtclock_now(), true);
+
     pa_assert(!u->rtpoll_item);
 
     build_pollfd(u);
@@ -655,6 +959,8 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             if (u->fd >= 0) {
                 if (u->use_mmap)
                     r = mmap_sink_get_latency(u);
+                else if (u->use_tsched)
+                    r = tsched_sink_get_latency(u);
                 else
                     r = io_sink_get_latency(u);
             }
@@ -903,9 +1209,32 @@ static void thread_func(void *userdata) {
         if (PA_UNLIKELY(u->sink && u->sink->thread_info.rewind_requested))
             pa_sink_process_rewind(u->sink, 0);
 
+        if (u->use_tsched) {
+            pa_usec_t sleep_usec = (pa_usec_t) -1, s;
+
+            if (u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+                if (tsched_write(u, &s) < 0)
+                    goto fail;
+
+                sleep_usec = s;
+            }
+
+            if (u->source && PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+                if (tsched_read(u, &s) < 0)
+                    goto fail;
+
+                sleep_usec = PA_MIN(sleep_usec, s);
+            }
+
+            if (sleep_usec != (pa_usec_t) -1)
+                pa_rtpoll_set_timer_relative(u->rtpoll, sleep_usec);
+            else
+                pa_rtpoll_set_timer_disabled(u->rtpoll);
+        }
+
         /* Render some data and write it to the dsp */
 
-        if (u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state) && ((revents & POLLOUT) || u->use_mmap || u->use_getospace)) {
+        if (!u->use_tsched && u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state) && ((revents & POLLOUT) || u->use_mmap || u->use_getospace)) {
 
             if (u->use_mmap) {
 
@@ -1013,7 +1342,7 @@ static void thread_func(void *userdata) {
 
         /* Try to read some data and pass it on to the source driver. */
 
-        if (u->source && PA_SOURCE_IS_OPENED(u->source->thread_info.state) && ((revents & POLLIN) || u->use_mmap || u->use_getispace)) {
+        if (!u->use_tsched && u->source && PA_SOURCE_IS_OPENED(u->source->thread_info.state) && ((revents & POLLIN) || u->use_mmap || u->use_getispace)) {
 
             if (u->use_mmap) {
 
@@ -1123,7 +1452,10 @@ static void thread_func(void *userdata) {
             pa_assert(u->fd >= 0);
 
             pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
-            pollfd->events = (short)
+
+            /* In tsched mode the timer wakes us up, we only keep
+             * watching the fd for errors */
+            pollfd->events = u->use_tsched ? 0 : (short)
                 (((u->source && PA_SOURCE_IS_OPENED(u->source->thread_info.state)) ? POLLIN : 0) |
                  ((u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state)) ? POLLOUT : 0));
         }
@@ -1168,7 +1500,7 @@ int pa__init(pa_module*m) {
     int fd = -1;
     int nfrags, orig_frag_size, frag_size;
     int mode, caps;
-    bool record = true, playback = true, use_mmap = true;
+    bool record = true, playback = true, use_mmap = true, use_tsched = true;
     pa_sample_spec ss;
     pa_channel_map map;
     pa_modargs *ma = NULL;
@@ -1219,6 +1551,11 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "tsched", &use_tsched) < 0) {
+        pa_log("Failed to parse tsched argument.");
+        goto fail;
+    }
+
     if ((fd = pa_oss_open(dev = pa_modargs_get_value(ma, "device", DEFAULT_DEVICE), &mode, &caps)) < 0)
         goto fail;
 
@@ -1296,6 +1633,46 @@ int pa__init(pa_module*m) {
     u->in_hwbuf_size = u->in_nfrags * u->in_fragment_size;
     u->out_hwbuf_size = u->out_nfrags * u->out_fragment_size;
 
+    /* Timer based scheduling is done on top of read()/write(), and needs
+     * to know exactly how much is buffered in either direction */
+    if (use_tsched && use_mmap) {
+        pa_log_info("Memory mapping is enabled, disabling timer based scheduling.");
+        use_tsched = false;
+    }
+
+    if (use_tsched) {
+#ifdef SNDCTL_DSP_GETODELAY
+        int delay;
+
+        if ((mode != O_RDONLY && (ioctl(fd, SNDCTL_DSP_GETOSPACE, &info) < 0 || ioctl(fd, SNDCTL_DSP_GETODELAY, &delay) < 0)) ||
+            (mode != O_WRONLY && ioctl(fd, SNDCTL_DSP_GETISPACE, &info) < 0)) {
+            pa_log_info("Device can't tell how much is buffered, disabling timer based scheduling.");
+            use_tsched = false;
+        }
+#else
+        pa_log_info("System doesn't support SNDCTL_DSP_GETODELAY, disabling timer based scheduling.");
+        use_tsched = false;
+#endif
+    }
+
+    u->use_tsched = use_tsched;
+
+    if (use_tsched) {
+        u->tsched_watermark = DEFAULT_TSCHED_WATERMARK_USEC;
+        u->first = true;
+        u->smoother_interval = SMOOTHER_MIN_INTERVAL;
+        u->smoother = pa_smoother_new(
+                SMOOTHER_ADJUST_USEC,
+                SMOOTHER_WINDOW_USEC,
+                true,
+                true,
+                5,
+                pa_rtclock_now(),
+                true);
+
+        pa_log_info("Using timer based scheduling.");
+    }
+
     if (mode != O_WRONLY) {
         char *name_buf = NULL;
 
@@ -1462,6 +1839,9 @@ go_on:
 
     pa_assert(u->source || u->sink);
 
+    if (u->use_tsched)
+        fix_tsched_watermark(u);
+
     pa_memchunk_reset(&u->memchunk);
 
     if (!(u->thread = pa_thread_new("oss", thread_func, u))) {
@@ -1548,6 +1928,9 @@ void pa__done(pa_module*m) {
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
+    if (u->smoother)
+        pa_smoother_free(u->smoother);
+
     if (u->out_mmap_memblocks) {
         unsigned i;
         for (i = 0; i < u->out_nfrags; i++)
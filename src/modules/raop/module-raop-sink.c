@@ -39,6 +39,7 @@ PA_MODULE_USAGE(
         "sink_name=<name for the sink> "
         "sink_properties=<properties for the sink> "
         "server=<address> "
+        "group=<addresses of more receivers to play the same stream on, UDP only> "
         "protocol=<transport protocol> "
         "encryption=<encryption type> "
         "codec=<audio codec> "
@@ -53,6 +54,7 @@ static const char* const valid_modargs[] = {
     "sink_name",
     "sink_properties",
     "server",
+    "group",
     "protocol",
     "encryption",
     "codec",
@@ -0,0 +1,91 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/macro.h>
+
+#include "raop-alac.h"
+
+/* The frame starts with a 23 bit header:
+ *
+ *   channels - 1 (3 bits), unknown (16 bits), has size (1 bit),
+ *   unused (2 bits), is not compressed (1 bit)
+ *
+ * which is followed by the number of samples per channel (32 bits) and
+ * the samples themselves, 16 bit big endian, left and right
+ * interleaved. Everything after the header is thus a sequence of 32 bit
+ * big endian words, just not byte aligned. */
+#define HEADER_BITS 23
+#define HEADER 0x200012U
+#define HEADER_BYTES ((HEADER_BITS + 7) / 8)
+
+static inline void write_word(uint8_t *p, uint32_t w) {
+    p[0] = (uint8_t) (w >> 24);
+    p[1] = (uint8_t) (w >> 16);
+    p[2] = (uint8_t) (w >> 8);
+    p[3] = (uint8_t) w;
+}
+
+/* One stereo frame as it appears in the ALAC stream */
+static inline uint32_t read_frame(const uint8_t *p) {
+    return
+        (uint32_t) p[1] << 24 |
+        (uint32_t) p[0] << 16 |
+        (uint32_t) p[3] << 8 |
+        (uint32_t) p[2];
+}
+
+size_t pa_raop_alac_write_verbatim(uint8_t *packet, size_t max, const uint8_t *raw, size_t *length) {
+    uint32_t nbs, i;
+    uint8_t *p;
+
+    pa_assert(packet);
+    pa_assert(raw);
+    pa_assert(length);
+    pa_assert(max >= HEADER_BYTES + 4);
+
+    nbs = (uint32_t) PA_MIN(*length / 4, (max - HEADER_BYTES - 4) / 4);
+
+    /* The words following the header are shifted by one bit, so each
+     * output word takes the top bit of the next input word */
+    packet[0] = (uint8_t) (HEADER >> 16);
+    packet[1] = (uint8_t) (HEADER >> 8);
+    packet[2] = (uint8_t) HEADER | (uint8_t) (nbs >> 31);
+
+    p = packet + HEADER_BYTES;
+
+    if (nbs == 0)
+        write_word(p, nbs << 1);
+    else {
+        write_word(p, nbs << 1 | read_frame(raw) >> 31);
+        p += 4;
+
+        for (i = 0; i < nbs - 1; i++, p += 4)
+            write_word(p, read_frame(raw + 4 * i) << 1 | read_frame(raw + 4 * (i + 1)) >> 31);
+
+        write_word(p, read_frame(raw + 4 * i) << 1);
+    }
+
+    *length = (size_t) nbs * 4;
+
+    return HEADER_BYTES + 4 + (size_t) nbs * 4;
+}
@@ -0,0 +1,31 @@
+#ifndef fooraopalacfoo
+#define fooraopalacfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Writes an uncompressed (verbatim) ALAC frame of the little endian
+ * S16 stereo samples in raw to packet. At most *length bytes of raw
+ * are consumed, as many as fit into max bytes of output. *length is
+ * set to the number of bytes consumed, the size of the frame is
+ * returned. */
+size_t pa_raop_alac_write_verbatim(uint8_t *packet, size_t max, const uint8_t *raw, size_t *length);
+
+#endif
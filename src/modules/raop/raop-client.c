@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <math.h>
 
 #ifdef HAVE_SYS_FILIO_H
@@ -55,6 +56,7 @@
 #include <pulsecore/poll.h>
 
 #include "raop-client.h"
+#include "raop-alac.h"
 #include "raop-packet-buffer.h"
 #include "raop-crypto.h"
 #include "raop-util.h"
@@ -67,6 +69,7 @@
 #define FRAMES_PER_UDP_PACKET 352
 
 #define RTX_BUFFERING_SECONDS 4
+#define RTX_BATCH_PACKETS 32
 
 #define DEFAULT_TCP_AUDIO_PORT   6000
 #define DEFAULT_UDP_AUDIO_PORT   6000
@@ -112,6 +115,8 @@ struct pa_raop_client {
 
     uint16_t seq;
     uint32_t rtptime;
+    /* Frames in the last audio packet built */
+    uint32_t last_frames;
     bool is_recording;
     uint32_t ssrc;
 
@@ -217,96 +222,6 @@ static inline uint64_t timeval_to_ntp(struct timeval *tv) {
     return ntp;
 }
 
-/**
- * Function to write bits into a buffer.
- * @param buffer Handle to the buffer. It will be incremented if new data requires it.
- * @param bit_pos A pointer to a position buffer to keep track the current write location (0 for MSB, 7 for LSB)
- * @param size A pointer to the byte size currently written. This allows the calling function to do simple buffer overflow checks
- * @param data The data to write
- * @param data_bit_len The number of bits from data to write
- */
-static inline void bit_writer(uint8_t **buffer, uint8_t *bit_pos, size_t *size, uint8_t data, uint8_t data_bit_len) {
-    int bits_left, bit_overflow;
-    uint8_t bit_data;
-
-    if (!data_bit_len)
-        return;
-
-    /* If bit pos is zero, we will definately use at least one bit from the current byte so size increments. */
-    if (!*bit_pos)
-        *size += 1;
-
-    /* Calc the number of bits left in the current byte of buffer. */
-    bits_left = 7 - *bit_pos  + 1;
-    /* Calc the overflow of bits in relation to how much space we have left... */
-    bit_overflow = bits_left - data_bit_len;
-    if (bit_overflow >= 0) {
-        /* We can fit the new data in our current byte.
-         * As we write from MSB->LSB we need to left shift by the overflow amount. */
-        bit_data = data << bit_overflow;
-        if (*bit_pos)
-            **buffer |= bit_data;
-        else
-            **buffer = bit_data;
-        /* If our data fits exactly into the current byte, we need to increment our pointer. */
-        if (0 == bit_overflow) {
-            /* Do not increment size as it will be incremented on next call as bit_pos is zero. */
-            *buffer += 1;
-            *bit_pos = 0;
-        } else {
-            *bit_pos += data_bit_len;
-        }
-    } else {
-        /* bit_overflow is negative, there for we will need a new byte from our buffer
-         * Firstly fill up what's left in the current byte. */
-        bit_data = data >> -bit_overflow;
-        **buffer |= bit_data;
-        /* Increment our buffer pointer and size counter. */
-        *buffer += 1;
-        *size += 1;
-        **buffer = data << (8 + bit_overflow);
-        *bit_pos = -bit_overflow;
-    }
-}
-
-static size_t write_ALAC_data(uint8_t *packet, const size_t max, uint8_t *raw, size_t *length, bool compress) {
-    uint32_t nbs = (*length / 2) / 2;
-    uint8_t *ibp, *maxibp;
-    uint8_t *bp, bpos;
-    size_t size = 0;
-
-    bp = packet;
-    pa_memzero(packet, max);
-    size = bpos = 0;
-
-    bit_writer(&bp, &bpos, &size, 1, 3); /* channel=1, stereo */
-    bit_writer(&bp, &bpos, &size, 0, 4); /* Unknown */
-    bit_writer(&bp, &bpos, &size, 0, 8); /* Unknown */
-    bit_writer(&bp, &bpos, &size, 0, 4); /* Unknown */
-    bit_writer(&bp, &bpos, &size, 1, 1); /* Hassize */
-    bit_writer(&bp, &bpos, &size, 0, 2); /* Unused */
-    bit_writer(&bp, &bpos, &size, 1, 1); /* Is-not-compressed */
-    /* Size of data, integer, big endian. */
-    bit_writer(&bp, &bpos, &size, (nbs >> 24) & 0xff, 8);
-    bit_writer(&bp, &bpos, &size, (nbs >> 16) & 0xff, 8);
-    bit_writer(&bp, &bpos, &size, (nbs >> 8)  & 0xff, 8);
-    bit_writer(&bp, &bpos, &size, (nbs)       & 0xff, 8);
-
-    ibp = raw;
-    maxibp = raw + (4 * nbs) - 4;
-    while (ibp <= maxibp) {
-        /* Byte swap stereo data. */
-        bit_writer(&bp, &bpos, &size, *(ibp + 1), 8);
-        bit_writer(&bp, &bpos, &size, *(ibp + 0), 8);
-        bit_writer(&bp, &bpos, &size, *(ibp + 3), 8);
-        bit_writer(&bp, &bpos, &size, *(ibp + 2), 8);
-        ibp += 4;
-    }
-
-    *length = (ibp - raw);
-    return size;
-}
-
 static size_t build_tcp_audio_packet(pa_raop_client *c, pa_memchunk *block, pa_memchunk *packet) {
     const size_t head = sizeof(tcp_audio_header);
     uint32_t *buffer = NULL;
@@ -332,7 +247,7 @@ static size_t build_tcp_audio_packet(pa_raop_client *c, pa_memchunk *block, pa_m
     length = block->length;
     size = sizeof(tcp_audio_header);
     if (c->codec == PA_RAOP_CODEC_ALAC)
-        size += write_ALAC_data(((uint8_t *) buffer + head), packet->length - head, raw, &length, false);
+        size += pa_raop_alac_write_verbatim(((uint8_t *) buffer + head), packet->length - head, raw, &length);
     else {
         pa_log_debug("Only ALAC encoding is supported, sending zeros...");
         pa_memzero(((uint8_t *) buffer + head), packet->length - head);
@@ -420,14 +335,15 @@ static size_t build_udp_audio_packet(pa_raop_client *c, pa_memchunk *block, pa_m
     length = block->length;
     size = sizeof(udp_audio_header);
     if (c->codec == PA_RAOP_CODEC_ALAC)
-        size += write_ALAC_data(((uint8_t *) buffer + head), packet->length - head, raw, &length, false);
+        size += pa_raop_alac_write_verbatim(((uint8_t *) buffer + head), packet->length - head, raw, &length);
     else {
         pa_log_debug("Only ALAC encoding is supported, sending zeros...");
         pa_memzero(((uint8_t *) buffer + head), packet->length - head);
         size += length;
     }
 
-    c->rtptime += length / 4;
+    c->last_frames = length / 4;
+    c->rtptime += c->last_frames;
 
     /* Wrap sequence number to 0 then UINT16_MAX is reached */
     if (c->seq == UINT16_MAX)
@@ -500,18 +416,73 @@ static size_t rebuild_udp_audio_packet(pa_raop_client *c, uint16_t seq, pa_memch
     return size;
 }
 
+static ssize_t send_udp_audio_retrans_packets(pa_raop_client *c, pa_memchunk **packets, unsigned n) {
+    ssize_t total = 0;
+    unsigned i;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[RTX_BATCH_PACKETS];
+    struct iovec iov[RTX_BATCH_PACKETS];
+    int r;
+
+    pa_assert(n <= RTX_BATCH_PACKETS);
+
+    pa_zero(msgs);
+
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = pa_memblock_acquire_chunk(packets[i]);
+        iov[i].iov_len = packets[i]->length;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* The packets we don't get out are dropped, like a single packet
+     * would be */
+    if ((r = sendmmsg(c->udp_cfd, msgs, n, MSG_DONTWAIT)) < (int) n) {
+        if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            pa_log_debug("Failed to resend UDP (audio-restransmitted) packets: %s", pa_cstrerror(errno));
+        else
+            pa_log_debug("Discarding %u UDP (audio-restransmitted) packets due to EAGAIN", n - (unsigned) PA_MAX(r, 0));
+    }
+
+    for (i = 0; i < n; i++) {
+        pa_memblock_release(packets[i]->memblock);
+
+        if ((int) i < r)
+            total += msgs[i].msg_len;
+    }
+#else
+    for (i = 0; i < n; i++) {
+        ssize_t written;
+
+        written = pa_write(c->udp_cfd, pa_memblock_acquire_chunk(packets[i]), packets[i]->length, NULL);
+        pa_memblock_release(packets[i]->memblock);
+
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pa_log_debug("Discarding UDP (audio-restransmitted) packet due to EAGAIN");
+            continue;
+        }
+
+        total += written;
+    }
+#endif
+
+    return total;
+}
+
 static ssize_t resend_udp_audio_packets(pa_raop_client *c, uint16_t seq, uint16_t nbp) {
+    pa_memchunk *packets[RTX_BATCH_PACKETS];
     ssize_t total = 0;
+    unsigned n = 0;
     int i = 0;
 
     for (i = 0; i < nbp; i++) {
         pa_memchunk *packet = NULL;
-        uint8_t *buffer = NULL;
-        ssize_t written = -1;
 
         if (!(packet = pa_raop_packet_buffer_retrieve(c->pbuf, seq + i)))
             continue;
 
+        /* Packets are stored ready to go, we only have to put the
+         * retransmission header in front of them the first time */
         if (packet->index > 0) {
             if (!rebuild_udp_audio_packet(c, seq + i, packet))
                 continue;
@@ -519,22 +490,20 @@ static ssize_t resend_udp_audio_packets(pa_raop_client *c, uint16_t seq, uint16_
 
         pa_assert(packet->index == 0);
 
-        buffer = pa_memblock_acquire(packet->memblock);
+        if (packet->length <= 0)
+            continue;
 
-        pa_assert(buffer);
+        packets[n++] = packet;
 
-        if (buffer && packet->length > 0)
-            written = pa_write(c->udp_cfd, buffer, packet->length, NULL);
-        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            pa_log_debug("Discarding UDP (audio-restransmitted, seq=%d) packet due to EAGAIN", seq + i);
-            pa_memblock_release(packet->memblock);
-            continue;
+        if (n == RTX_BATCH_PACKETS) {
+            total += send_udp_audio_retrans_packets(c, packets, n);
+            n = 0;
         }
-
-        pa_memblock_release(packet->memblock);
-        total +=  written;
     }
 
+    if (n > 0)
+        total += send_udp_audio_retrans_packets(c, packets, n);
+
     return total;
 }
 
@@ -1428,6 +1397,18 @@ pa_raop_client* pa_raop_client_new(pa_core *core, const char *host, pa_raop_prot
     return c;
 }
 
+void pa_raop_client_share_secret(pa_raop_client *c, pa_raop_client *from) {
+    pa_assert(c);
+    pa_assert(from);
+    pa_assert(!c->rtsp);
+
+    if (!c->secret || !from->secret)
+        return;
+
+    pa_raop_secret_unref(c->secret);
+    c->secret = pa_raop_secret_ref(from->secret);
+}
+
 void pa_raop_client_free(pa_raop_client *c) {
     pa_assert(c);
 
@@ -1436,7 +1417,7 @@ void pa_raop_client_free(pa_raop_client *c) {
     pa_xfree(c->sid);
     pa_xfree(c->sci);
     if (c->secret)
-        pa_raop_secret_free(c->secret);
+        pa_raop_secret_unref(c->secret);
     pa_xfree(c->password);
     c->sci = c->sid = NULL;
     c->password = NULL;
@@ -1746,20 +1727,23 @@ void pa_raop_client_handle_oob_packet(pa_raop_client *c, const int fd, const uin
     }
 }
 
+/* Sync RTP & NTP timestamp if required (UDP). */
+static void sync_udp_stream(pa_raop_client *c) {
+    c->sync_count++;
+    if (c->is_first_packet || c->sync_count >= c->sync_interval) {
+        send_udp_sync_packet(c, c->rtptime);
+        c->sync_count = 0;
+    }
+}
+
 ssize_t pa_raop_client_send_audio_packet(pa_raop_client *c, pa_memchunk *block, size_t offset) {
     ssize_t written = 0;
 
     pa_assert(c);
     pa_assert(block);
 
-    /* Sync RTP & NTP timestamp if required (UDP). */
-    if (c->protocol == PA_RAOP_PROTOCOL_UDP) {
-        c->sync_count++;
-        if (c->is_first_packet || c->sync_count >= c->sync_interval) {
-            send_udp_sync_packet(c, c->rtptime);
-            c->sync_count = 0;
-        }
-    }
+    if (c->protocol == PA_RAOP_PROTOCOL_UDP)
+        sync_udp_stream(c);
 
     switch (c->protocol) {
         case PA_RAOP_PROTOCOL_TCP:
@@ -1777,6 +1761,75 @@ ssize_t pa_raop_client_send_audio_packet(pa_raop_client *c, pa_memchunk *block,
     return written;
 }
 
+ssize_t pa_raop_client_forward_audio_packet(pa_raop_client *c, pa_raop_client *from) {
+    const size_t head = sizeof(udp_audio_header);
+    pa_memchunk *last, *packet;
+    uint32_t *buffer;
+    uint8_t *raw;
+    ssize_t written;
+    size_t size;
+
+    pa_assert(c);
+    pa_assert(from);
+    pa_assert(c->protocol == PA_RAOP_PROTOCOL_UDP);
+    pa_assert(from->protocol == PA_RAOP_PROTOCOL_UDP);
+    pa_assert(c->codec == from->codec);
+    pa_assert(c->secret == from->secret);
+
+    if (!(last = pa_raop_packet_buffer_retrieve(from->pbuf, from->seq - 1)) || !last->memblock)
+        return -1;
+
+    /* The packet may already carry a retransmission header, the audio
+     * packet always starts right after it */
+    size = last->index + last->length - sizeof(udp_audio_retrans_header);
+    if (size <= head)
+        return -1;
+
+    sync_udp_stream(c);
+
+    if (!(packet = pa_raop_packet_buffer_prepare(c->pbuf, c->seq, sizeof(udp_audio_retrans_header) + size)))
+        return -1;
+
+    packet->index = sizeof(udp_audio_retrans_header);
+    packet->length = size;
+
+    raw = pa_memblock_acquire(last->memblock);
+    buffer = pa_memblock_acquire(packet->memblock);
+    buffer += packet->index / sizeof(uint32_t);
+
+    /* The payload is already framed and encrypted with the same secret,
+     * only the RTP header is ours */
+    memcpy((uint8_t *) buffer + head, raw + sizeof(udp_audio_retrans_header) + head, size - head);
+    pa_memblock_release(last->memblock);
+
+    memcpy(buffer, udp_audio_header, sizeof(udp_audio_header));
+    if (c->is_first_packet)
+        buffer[0] |= htonl((uint32_t) 0x80 << 16);
+    buffer[0] |= htonl((uint32_t) c->seq);
+    buffer[1] = htonl(c->rtptime);
+    buffer[2] = htonl(c->ssrc);
+
+    c->last_frames = from->last_frames;
+    c->rtptime += c->last_frames;
+
+    /* Wrap sequence number to 0 then UINT16_MAX is reached */
+    if (c->seq == UINT16_MAX)
+        c->seq = 0;
+    else
+        c->seq++;
+
+    written = pa_write(c->udp_sfd, buffer, size, NULL);
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        pa_log_debug("Discarding UDP (audio, seq=%d) packet due to EAGAIN (%s)", c->seq, pa_cstrerror(errno));
+        written = size;
+    }
+
+    pa_memblock_release(packet->memblock);
+
+    c->is_first_packet = false;
+    return written;
+}
+
 void pa_raop_client_set_state_callback(pa_raop_client *c, pa_raop_client_state_cb_t callback, void *userdata) {
     pa_assert(c);
 
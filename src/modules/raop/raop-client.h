@@ -60,6 +60,10 @@ pa_raop_client* pa_raop_client_new(pa_core *core, const char *host, pa_raop_prot
                                    pa_raop_encryption_t encryption, pa_raop_codec_t codec);
 void pa_raop_client_free(pa_raop_client *c);
 
+/* Makes c encrypt with the same secret as from, so that from's packets
+ * can be forwarded to c. Must be called before c connects. */
+void pa_raop_client_share_secret(pa_raop_client *c, pa_raop_client *from);
+
 int pa_raop_client_authenticate(pa_raop_client *c, const char *password);
 bool pa_raop_client_is_authenticated(pa_raop_client *c);
 
@@ -76,6 +80,9 @@ bool pa_raop_client_register_pollfd(pa_raop_client *c, pa_rtpoll *poll, pa_rtpol
 pa_volume_t pa_raop_client_adjust_volume(pa_raop_client *c, pa_volume_t volume);
 void pa_raop_client_handle_oob_packet(pa_raop_client *c, const int fd, const uint8_t packet[], ssize_t size);
 ssize_t pa_raop_client_send_audio_packet(pa_raop_client *c, pa_memchunk *block, size_t offset);
+/* Sends the audio packet from just sent to c as well, UDP only. The
+ * payload is reused as it is, so both must share their secret. */
+ssize_t pa_raop_client_forward_audio_packet(pa_raop_client *c, pa_raop_client *from);
 
 typedef void (*pa_raop_client_state_cb_t)(pa_raop_state_t state, void *userdata);
 void pa_raop_client_set_state_callback(pa_raop_client *c, pa_raop_client_state_cb_t callback, void *userdata);
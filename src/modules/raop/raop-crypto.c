@@ -28,13 +28,14 @@
 #include <string.h>
 
 #include <openssl/err.h>
-#include <openssl/aes.h>
+#include <openssl/evp.h>
 #include <openssl/rsa.h>
 
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/macro.h>
 #include <pulsecore/random.h>
+#include <pulsecore/refcnt.h>
 
 #include "raop-crypto.h"
 #include "raop-util.h"
@@ -57,9 +58,11 @@ static int RSA_set0_key(RSA *r, BIGNUM *n, BIGNUM *e, BIGNUM *d) {
 #endif
 
 struct pa_raop_secret {
+    PA_REFCNT_DECLARE;
+
     uint8_t key[AES_CHUNK_SIZE]; /* Key for aes-cbc */
     uint8_t iv[AES_CHUNK_SIZE];  /* Initialization vector for cbc */
-    AES_KEY aes;                 /* AES encryption */
+    EVP_CIPHER_CTX *aes;         /* AES encryption, keeps the expanded key */
 };
 
 static const char rsa_modulus[] =
@@ -102,16 +105,37 @@ pa_raop_secret* pa_raop_secret_new(void) {
 
     pa_assert(s);
 
+    PA_REFCNT_INIT(s);
+
     pa_random(s->key, sizeof(s->key));
-    AES_set_encrypt_key(s->key, 128, &s->aes);
     pa_random(s->iv, sizeof(s->iv));
 
+    /* Going through EVP gets us AES-NI or the ARMv8 crypto extensions,
+     * where the CPU has them */
+    pa_assert_se(s->aes = EVP_CIPHER_CTX_new());
+    pa_assert_se(EVP_EncryptInit_ex(s->aes, EVP_aes_128_cbc(), NULL, s->key, s->iv) == 1);
+    EVP_CIPHER_CTX_set_padding(s->aes, 0);
+
+    return s;
+}
+
+pa_raop_secret* pa_raop_secret_ref(pa_raop_secret *s) {
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_REFCNT_INC(s);
+
     return s;
 }
 
-void pa_raop_secret_free(pa_raop_secret *s) {
+void pa_raop_secret_unref(pa_raop_secret *s) {
     pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
 
+    if (PA_REFCNT_DEC(s) > 0)
+        return;
+
+    EVP_CIPHER_CTX_free(s->aes);
     pa_xfree(s);
 }
 
@@ -140,25 +164,20 @@ char* pa_raop_secret_get_key(pa_raop_secret *s) {
 }
 
 int pa_raop_aes_encrypt(pa_raop_secret *s, uint8_t *data, int len) {
-    static uint8_t nv[AES_CHUNK_SIZE];
-    uint8_t *buffer;
-    int i = 0, j;
+    int n, out;
 
     pa_assert(s);
     pa_assert(data);
 
-    memcpy(nv, s->iv, AES_CHUNK_SIZE);
-
-    while (i + AES_CHUNK_SIZE <= len) {
-        buffer = data + i;
-        for (j = 0; j < AES_CHUNK_SIZE; ++j)
-            buffer[j] ^= nv[j];
-
-        AES_encrypt(buffer, buffer, &s->aes);
+    /* Only whole blocks are encrypted, the rest is sent in the clear */
+    if ((n = len - len % AES_CHUNK_SIZE) <= 0)
+        return 0;
 
-        memcpy(nv, buffer, AES_CHUNK_SIZE);
-        i += AES_CHUNK_SIZE;
-    }
+    /* Every packet starts over with the initial IV; this keeps the
+     * expanded key */
+    pa_assert_se(EVP_EncryptInit_ex(s->aes, NULL, NULL, NULL, s->iv) == 1);
+    pa_assert_se(EVP_EncryptUpdate(s->aes, data, &out, data, n) == 1);
+    pa_assert(out == n);
 
-    return i;
+    return n;
 }
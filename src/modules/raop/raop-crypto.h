@@ -22,10 +22,15 @@
   USA.
 ***/
 
+#include <stdint.h>
+
 typedef struct pa_raop_secret pa_raop_secret;
 
 pa_raop_secret* pa_raop_secret_new(void);
-void pa_raop_secret_free(pa_raop_secret *s);
+/* Receivers all decrypt the key with the same RSA key pair, so a
+ * secret may be shared by several clients */
+pa_raop_secret* pa_raop_secret_ref(pa_raop_secret *s);
+void pa_raop_secret_unref(pa_raop_secret *s);
 
 char* pa_raop_secret_get_iv(pa_raop_secret *s);
 char* pa_raop_secret_get_key(pa_raop_secret *s);
@@ -112,11 +112,17 @@ pa_memchunk *pa_raop_packet_buffer_prepare(pa_raop_packet_buffer *pb, uint16_t s
 
     i = (pb->pos + 1) % pb->size;
 
-    if (pb->packets[i].memblock)
+    /* Recycle the memory of the packet we replace, unless somebody
+     * else still holds a reference to it */
+    if (pb->packets[i].memblock &&
+        (!pa_memblock_ref_is_one(pb->packets[i].memblock) || pa_memblock_get_length(pb->packets[i].memblock) < size)) {
         pa_memblock_unref(pb->packets[i].memblock);
-    pa_memchunk_reset(&pb->packets[i]);
+        pb->packets[i].memblock = NULL;
+    }
+
+    if (!pb->packets[i].memblock)
+        pb->packets[i].memblock = pa_memblock_new(pb->mempool, size);
 
-    pb->packets[i].memblock = pa_memblock_new(pb->mempool, size);
     pb->packets[i].length = size;
     pb->packets[i].index = 0;
 
@@ -34,6 +34,9 @@ void pa_raop_packet_buffer_free(pa_raop_packet_buffer *pb);
 
 void pa_raop_packet_buffer_reset(pa_raop_packet_buffer *pb, uint16_t seq);
 
+/* Returns the slot for packet seq, which replaces the oldest one. The
+ * packet is stored in its final form, so that it can be resent as it
+ * is. The memory of the old packet is reused if possible. */
 pa_memchunk *pa_raop_packet_buffer_prepare(pa_raop_packet_buffer *pb, uint16_t seq, const size_t size);
 pa_memchunk *pa_raop_packet_buffer_retrieve(pa_raop_packet_buffer *pb, uint16_t seq);
 
@@ -53,6 +53,7 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/idxset.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/thread.h>
@@ -76,6 +77,9 @@ struct userdata {
     bool oob;
 
     pa_raop_client *raop;
+    /* More receivers that get copies of the packets of raop, see
+     * pa_raop_client_forward_audio_packet() */
+    pa_idxset *followers;
     pa_raop_protocol_t protocol;
     pa_raop_encryption_t encryption;
     pa_raop_codec_t codec;
@@ -89,8 +93,15 @@ struct userdata {
     uint64_t write_count;
 };
 
+struct follower {
+    struct userdata *userdata;
+    pa_raop_client *raop;
+    pa_rtpoll_item *rtpoll_item;
+};
+
 enum {
-    PA_SINK_MESSAGE_SET_RAOP_STATE = PA_SINK_MESSAGE_MAX
+    PA_SINK_MESSAGE_SET_RAOP_STATE = PA_SINK_MESSAGE_MAX,
+    PA_SINK_MESSAGE_SET_FOLLOWER_STATE
 };
 
 static void userdata_free(struct userdata *u);
@@ -107,6 +118,34 @@ static void raop_state_cb(pa_raop_state_t state, void *userdata) {
     pa_asyncmsgq_post(u->thread_mq.inq, PA_MSGOBJECT(u->sink), PA_SINK_MESSAGE_SET_RAOP_STATE, PA_INT_TO_PTR(state), 0, NULL, NULL);
 }
 
+static void follower_state_cb(pa_raop_state_t state, void *userdata) {
+    struct follower *f = userdata;
+
+    pa_assert(f);
+
+    pa_asyncmsgq_post(f->userdata->thread_mq.inq, PA_MSGOBJECT(f->userdata->sink), PA_SINK_MESSAGE_SET_FOLLOWER_STATE, f, state, NULL, NULL);
+}
+
+static void free_rtpoll_item(pa_rtpoll_item **item) {
+    unsigned int nbfds = 0;
+    struct pollfd *pollfd;
+    unsigned int i;
+
+    if (!*item)
+        return;
+
+    pollfd = pa_rtpoll_item_get_pollfd(*item, &nbfds);
+    if (pollfd) {
+        for (i = 0; i < nbfds; i++) {
+            if (pollfd->fd >= 0)
+               pa_close(pollfd->fd);
+            pollfd++;
+        }
+    }
+    pa_rtpoll_item_free(*item);
+    *item = NULL;
+}
+
 static pa_usec_t sink_get_latency(const struct userdata *u) {
     pa_usec_t r, now;
     int64_t latency;
@@ -125,6 +164,8 @@ static pa_usec_t sink_get_latency(const struct userdata *u) {
 
 static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SINK(o)->userdata;
+    struct follower *f;
+    uint32_t idx;
 
     pa_assert(u);
     pa_assert(u->raop);
@@ -143,6 +184,10 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                         pa_raop_client_teardown(u->raop);
                     }
 
+                    PA_IDXSET_FOREACH(f, u->followers, idx)
+                        if (pa_raop_client_is_alive(f->raop))
+                            pa_raop_client_teardown(f->raop);
+
                     break;
                 }
 
@@ -153,6 +198,9 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                     if (u->sink->thread_info.state == PA_SINK_RUNNING) {
                         pa_rtpoll_set_timer_disabled(u->rtpoll);
                         pa_raop_client_flush(u->raop);
+
+                        PA_IDXSET_FOREACH(f, u->followers, idx)
+                            pa_raop_client_flush(f->raop);
                     }
 
                     break;
@@ -177,6 +225,16 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                         u->start = now;
                     }
 
+                    PA_IDXSET_FOREACH(f, u->followers, idx) {
+                        if (!pa_raop_client_is_authenticated(f->raop))
+                            continue;
+
+                        if (!pa_raop_client_is_alive(f->raop))
+                            pa_raop_client_announce(f->raop);
+                        else if (!pa_raop_client_can_stream(f->raop))
+                            pa_raop_client_stream(f->raop);
+                    }
+
                     break;
                 }
 
@@ -240,22 +298,7 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 
                 case PA_RAOP_INVALID_STATE:
                 case PA_RAOP_DISCONNECTED: {
-                    unsigned int nbfds = 0;
-                    struct pollfd *pollfd;
-                    unsigned int i;
-
-                    if (u->rtpoll_item) {
-                        pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, &nbfds);
-                        if (pollfd) {
-                            for (i = 0; i < nbfds; i++) {
-                                if (pollfd->fd >= 0)
-                                   pa_close(pollfd->fd);
-                                pollfd++;
-                            }
-                        }
-                        pa_rtpoll_item_free(u->rtpoll_item);
-                        u->rtpoll_item = NULL;
-                    }
+                    free_rtpoll_item(&u->rtpoll_item);
 
                     if (u->sink->thread_info.state == PA_SINK_SUSPENDED)
                         pa_rtpoll_set_timer_disabled(u->rtpoll);
@@ -268,6 +311,49 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 
             return 0;
         }
+
+        case PA_SINK_MESSAGE_SET_FOLLOWER_STATE: {
+            f = data;
+
+            /* Unlike the main receiver, a follower that goes away doesn't
+             * take the sink with it */
+            switch ((pa_raop_state_t) offset) {
+                case PA_RAOP_AUTHENTICATED: {
+                    if (!pa_raop_client_is_authenticated(f->raop))
+                        pa_log("Failed to authenticate a receiver of the group, leaving it out");
+                    else if (u->sink->thread_info.state == PA_SINK_RUNNING)
+                        pa_raop_client_announce(f->raop);
+
+                    return 0;
+                }
+
+                case PA_RAOP_CONNECTED: {
+                    pa_assert(!f->rtpoll_item);
+
+                    pa_raop_client_register_pollfd(f->raop, u->rtpoll, &f->rtpoll_item);
+
+                    return 0;
+                }
+
+                case PA_RAOP_RECORDING: {
+                    if (u->sink->thread_info.state == PA_SINK_SUSPENDED)
+                        pa_raop_client_flush(f->raop);
+                    else
+                        sink_set_volume_cb(u->sink);
+
+                    return 0;
+                }
+
+                case PA_RAOP_INVALID_STATE:
+                case PA_RAOP_DISCONNECTED: {
+                    free_rtpoll_item(&f->rtpoll_item);
+
+                    return 0;
+                }
+            }
+
+            return 0;
+        }
     }
 
     return pa_sink_process_msg(o, code, data, offset, chunk);
@@ -275,6 +361,8 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 
 static void sink_set_volume_cb(pa_sink *s) {
     struct userdata *u = s->userdata;
+    struct follower *f;
+    uint32_t idx;
     pa_cvolume hw;
     pa_volume_t v, v_orig;
     char t[PA_CVOLUME_SNPRINT_VERBOSE_MAX];
@@ -309,21 +397,49 @@ static void sink_set_volume_cb(pa_sink *s) {
     /* Any necessary software volume manipulation is done so set
      * our hw volume (or v as a single value) on the device. */
     pa_raop_client_set_volume(u->raop, v);
+
+    PA_IDXSET_FOREACH(f, u->followers, idx)
+        pa_raop_client_set_volume(f->raop, v);
 }
 
 static void sink_set_mute_cb(pa_sink *s) {
     struct userdata *u = s->userdata;
+    struct follower *f;
+    uint32_t idx;
 
     pa_assert(u);
     pa_assert(u->raop);
 
     if (s->muted) {
         pa_raop_client_set_volume(u->raop, PA_VOLUME_MUTED);
+
+        PA_IDXSET_FOREACH(f, u->followers, idx)
+            pa_raop_client_set_volume(f->raop, PA_VOLUME_MUTED);
     } else {
         sink_set_volume_cb(s);
     }
 }
 
+static void read_oob_packets(pa_raop_client *c, pa_rtpoll_item *item) {
+    struct pollfd *pollfd;
+    unsigned int i, nbfds = 0;
+    uint8_t packet[32];
+    ssize_t read;
+
+    if (!item || !(pollfd = pa_rtpoll_item_get_pollfd(item, &nbfds)))
+        return;
+
+    for (i = 0; i < nbfds; i++) {
+        if (pollfd->revents & pollfd->events) {
+            pollfd->revents = 0;
+            read = pa_read(pollfd->fd, packet, sizeof(packet), NULL);
+            pa_raop_client_handle_oob_packet(c, pollfd->fd, packet, read);
+        }
+
+        pollfd++;
+    }
+}
+
 static void thread_func(void *userdata) {
     struct userdata *u = userdata;
     size_t offset = 0;
@@ -339,7 +455,9 @@ static void thread_func(void *userdata) {
         struct pollfd *pollfd = NULL;
         unsigned int i, nbfds = 0;
         pa_usec_t now, estimated, intvl;
+        struct follower *f;
         uint64_t position;
+        uint32_t idx;
         size_t index;
         int ret;
 
@@ -354,6 +472,11 @@ static void thread_func(void *userdata) {
         else if (ret == 0)
             goto finish;
 
+        /* Followers only ever use their sockets for control and timing,
+         * the main receiver's timer drives the stream */
+        PA_IDXSET_FOREACH(f, u->followers, idx)
+            read_oob_packets(f->raop, f->rtpoll_item);
+
         if (u->rtpoll_item) {
             pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, &nbfds);
             /* If !oob: streaming driven by pollds (POLLOUT) */
@@ -370,19 +493,7 @@ static void thread_func(void *userdata) {
 
             /* if oob: streaming managed by timing, pollfd for oob sockets */
             if (pollfd && u->oob && !pa_rtpoll_timer_elapsed(u->rtpoll)) {
-                uint8_t packet[32];
-                ssize_t read;
-
-                for (i = 0; i < nbfds; i++) {
-                    if (pollfd->revents & pollfd->events) {
-                        pollfd->revents = 0;
-                        read = pa_read(pollfd->fd, packet, sizeof(packet), NULL);
-                        pa_raop_client_handle_oob_packet(u->raop, pollfd->fd, packet, read);
-                    }
-
-                    pollfd++;
-                }
-
+                read_oob_packets(u->raop, u->rtpoll_item);
                 continue;
             }
         }
@@ -419,6 +530,11 @@ static void thread_func(void *userdata) {
                 goto fail;
             }
         } else {
+            /* Rendered, framed and encrypted once for the whole group */
+            PA_IDXSET_FOREACH(f, u->followers, idx)
+                if (f->rtpoll_item && pa_raop_client_can_stream(f->raop))
+                    pa_raop_client_forward_audio_packet(f->raop, u->raop);
+
             u->write_count += (uint64_t) u->memchunk.index - (uint64_t) index;
             position = u->write_count - pa_usec_to_bytes(u->delay, &u->sink->sample_spec);
 
@@ -458,10 +574,12 @@ pa_sink* pa_raop_sink_new(pa_module *m, pa_modargs *ma, const char *driver) {
     struct userdata *u = NULL;
     pa_sample_spec ss;
     char *thread_name = NULL;
-    const char *server, *protocol, *encryption, *codec;
+    const char *server, *protocol, *encryption, *codec, *group;
     const char /* *username, */ *password;
     pa_sink_new_data data;
     const char *name = NULL;
+    struct follower *f;
+    uint32_t idx;
 
     pa_assert(m);
     pa_assert(ma);
@@ -488,6 +606,7 @@ pa_sink* pa_raop_sink_new(pa_module *m, pa_modargs *ma, const char *driver) {
     u->thread = NULL;
     u->rtpoll = pa_rtpoll_new();
     u->rtpoll_item = NULL;
+    u->followers = pa_idxset_new(NULL, NULL);
 
     if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
         pa_log("pa_thread_mq_init() failed.");
@@ -519,6 +638,11 @@ pa_sink* pa_raop_sink_new(pa_module *m, pa_modargs *ma, const char *driver) {
         goto fail;
     }
 
+    if ((group = pa_modargs_get_value(ma, "group", NULL)) && u->protocol != PA_RAOP_PROTOCOL_UDP) {
+        pa_log("Groups of receivers are only supported over UDP");
+        goto fail;
+    }
+
     encryption = pa_modargs_get_value(ma, "encryption", NULL);
     codec = pa_modargs_get_value(ma, "codec", NULL);
 
@@ -603,6 +727,29 @@ pa_sink* pa_raop_sink_new(pa_module *m, pa_modargs *ma, const char *driver) {
 
     pa_raop_client_set_state_callback(u->raop, raop_state_cb, u);
 
+    if (group) {
+        const char *state = NULL;
+        char *host;
+
+        while ((host = pa_split_spaces(group, &state))) {
+            f = pa_xnew0(struct follower, 1);
+            f->userdata = u;
+            pa_idxset_put(u->followers, f, NULL);
+
+            f->raop = pa_raop_client_new(u->core, host, u->protocol, u->encryption, u->codec);
+            if (!f->raop) {
+                pa_log("Failed to create RAOP client object for %s", host);
+                pa_xfree(host);
+                goto fail;
+            }
+            pa_xfree(host);
+
+            /* Same key for everyone, so that packets are only encrypted once */
+            pa_raop_client_share_secret(f->raop, u->raop);
+            pa_raop_client_set_state_callback(f->raop, follower_state_cb, f);
+        }
+    }
+
     thread_name = pa_sprintf_malloc("raop-sink-%s", server);
     if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
         pa_log("Failed to create sink thread");
@@ -617,6 +764,9 @@ pa_sink* pa_raop_sink_new(pa_module *m, pa_modargs *ma, const char *driver) {
     password = pa_modargs_get_value(ma, "password", NULL);
     pa_raop_client_authenticate(u->raop, password );
 
+    PA_IDXSET_FOREACH(f, u->followers, idx)
+        pa_raop_client_authenticate(f->raop, password);
+
     return u->sink;
 
 fail:
@@ -628,6 +778,18 @@ fail:
     return NULL;
 }
 
+static void follower_free(struct follower *f) {
+    pa_assert(f);
+
+    if (f->rtpoll_item)
+        pa_rtpoll_item_free(f->rtpoll_item);
+
+    if (f->raop)
+        pa_raop_client_free(f->raop);
+
+    pa_xfree(f);
+}
+
 static void userdata_free(struct userdata *u) {
     pa_assert(u);
 
@@ -647,6 +809,8 @@ static void userdata_free(struct userdata *u) {
 
     if (u->rtpoll_item)
         pa_rtpoll_item_free(u->rtpoll_item);
+    if (u->followers)
+        pa_idxset_free(u->followers, (pa_free_cb_t) follower_free);
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
     u->rtpoll_item = NULL;
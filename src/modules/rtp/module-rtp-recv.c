@@ -67,6 +67,7 @@ PA_MODULE_USAGE(
         "sink=<name of the sink> "
         "sap_address=<multicast address to listen on> "
         "latency_msec=<latency in ms> "
+        "adaptive_latency=<adapt the latency to the network jitter?> "
 );
 
 #define SAP_PORT 9875
@@ -76,11 +77,14 @@ PA_MODULE_USAGE(
 #define MAX_SESSIONS 16
 #define DEATH_TIMEOUT 20
 #define RATE_UPDATE_INTERVAL (5*PA_USEC_PER_SEC)
+#define CONCEAL_MAX_PACKETS 2
+#define JITTER_FACTOR 4
 
 static const char* const valid_modargs[] = {
     "sink",
     "sap_address",
     "latency_msec",
+    "adaptive_latency",
     NULL
 };
 
@@ -94,6 +98,17 @@ struct session {
     bool first_packet;
     uint32_t ssrc;
     uint32_t offset;
+    uint16_t next_sequence;
+
+    /* The last packet we queued, repeated to conceal packet loss */
+    pa_memchunk last_chunk;
+
+    /* Interarrival jitter as in RFC 3550, in timestamp units */
+    uint32_t last_transit;
+    double jitter;
+
+    uint64_t n_lost;
+    uint64_t n_late;
 
     struct pa_sdp_info sdp_info;
 
@@ -129,6 +144,7 @@ struct userdata {
     int n_sessions;
 
     pa_usec_t latency;
+    bool adaptive_latency;
 };
 
 static void session_free(struct session *s);
@@ -205,34 +221,75 @@ static void sink_input_suspend_within_thread(pa_sink_input* i, bool b) {
 }
 
 /* Called from I/O thread context */
-static int rtpoll_work_cb(pa_rtpoll_item *i) {
-    pa_memchunk chunk;
-    int64_t k, j, delta;
-    struct timeval now = { 0, 0 };
-    struct session *s;
-    struct pollfd *p;
+/* Called from I/O thread context */
+static void track_sequence(struct session *s) {
+    int16_t d;
 
-    pa_assert_se(s = pa_rtpoll_item_get_userdata(i));
+    d = (int16_t) (s->rtp_context.sequence - s->next_sequence);
 
-    p = pa_rtpoll_item_get_pollfd(i, NULL);
+    if (d < 0) {
+        s->n_late++;
+        return;
+    }
 
-    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
-        pa_log("poll() signalled bad revents.");
-        return -1;
+    s->n_lost += (uint64_t) d;
+    s->next_sequence = s->rtp_context.sequence + 1;
+}
+
+/* Called from I/O thread context */
+static void update_jitter(struct session *s, const struct timeval *now) {
+    uint32_t arrival, transit;
+    int32_t d;
+
+    /* The arrival time in timestamp units, see RFC 3550, A.8 */
+    arrival = (uint32_t) (pa_timeval_load(now) * s->sdp_info.sample_spec.rate / PA_USEC_PER_SEC);
+    transit = arrival - s->rtp_context.timestamp;
+
+    if (s->last_transit != 0) {
+        d = (int32_t) (transit - s->last_transit);
+        s->jitter += (fabs((double) d) - s->jitter) / 16;
     }
 
-    if ((p->revents & POLLIN) == 0)
-        return 0;
+    s->last_transit = transit;
+}
 
-    p->revents = 0;
+static pa_usec_t jitter_usec(struct session *s) {
+    return (pa_usec_t) (s->jitter * PA_USEC_PER_SEC / s->sdp_info.sample_spec.rate);
+}
+
+/* Called from I/O thread context. Fills a gap left by lost packets by
+ * repeating the last packet we got. Should the missing packets still
+ * arrive they are written over this. */
+static void conceal_loss(struct session *s, size_t length) {
+    while (length > 0) {
+        pa_memchunk c = s->last_chunk;
+
+        if (c.length > length)
+            c.length = length;
+
+        if (pa_memblockq_push(s->memblockq, &c) < 0) {
+            pa_memblockq_seek(s->memblockq, (int64_t) length, PA_SEEK_RELATIVE, true);
+            return;
+        }
+
+        length -= c.length;
+    }
+}
+
+/* Called from I/O thread context */
+static bool process_packet(struct session *s) {
+    pa_memchunk chunk;
+    int64_t k, j, delta, write_index;
+    struct timeval now = { 0, 0 };
+    bool late;
 
     if (pa_rtp_recv(&s->rtp_context, &chunk, s->userdata->module->core->mempool, &now) < 0)
-        return 0;
+        return false;
 
     if (s->sdp_info.payload != s->rtp_context.payload ||
         !PA_SINK_IS_OPENED(s->sink_input->sink->thread_info.state)) {
         pa_memblock_unref(chunk.memblock);
-        return 0;
+        return false;
     }
 
     if (!s->first_packet) {
@@ -240,13 +297,14 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
         s->ssrc = s->rtp_context.ssrc;
         s->offset = s->rtp_context.timestamp;
+        s->next_sequence = s->rtp_context.sequence;
 
         if (s->ssrc == s->userdata->module->core->cookie)
             pa_log_warn("Detected RTP packet loop!");
     } else {
         if (s->ssrc != s->rtp_context.ssrc) {
             pa_memblock_unref(chunk.memblock);
-            return 0;
+            return false;
         }
     }
 
@@ -259,7 +317,19 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
     else
         delta = j;
 
-    pa_memblockq_seek(s->memblockq, delta * (int64_t) s->rtp_context.frame_size, PA_SEEK_RELATIVE, true);
+    track_sequence(s);
+
+    /* Packets that are only a little late still get put into place, but
+     * don't make us go back in the stream. Anything that is further
+     * behind is most likely a restart of the sender. */
+    late = delta < 0 && (uint64_t) -delta * s->rtp_context.frame_size <= pa_usec_to_bytes(s->intended_latency, &s->sink_input->sample_spec);
+    write_index = pa_memblockq_get_write_index(s->memblockq);
+
+    if (delta > 0 && s->last_chunk.memblock &&
+        (uint64_t) delta * s->rtp_context.frame_size <= s->last_chunk.length * CONCEAL_MAX_PACKETS)
+        conceal_loss(s, (size_t) delta * s->rtp_context.frame_size);
+    else
+        pa_memblockq_seek(s->memblockq, delta * (int64_t) s->rtp_context.frame_size, PA_SEEK_RELATIVE, true);
 
     if (now.tv_sec == 0) {
         PA_ONCE_BEGIN {
@@ -269,6 +339,8 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
     } else
         pa_rtclock_from_wallclock(&now);
 
+    update_jitter(s, &now);
+
     if (pa_memblockq_push(s->memblockq, &chunk) < 0) {
         pa_log_warn("Queue overrun");
         pa_memblockq_seek(s->memblockq, (int64_t) chunk.length, PA_SEEK_RELATIVE, true);
@@ -276,10 +348,18 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
 /*     pa_log("blocks in q: %u", pa_memblockq_get_nblocks(s->memblockq)); */
 
-    pa_memblock_unref(chunk.memblock);
+    if (late && pa_memblockq_get_write_index(s->memblockq) <= write_index) {
+        /* Continue where we were before */
+        pa_memblockq_seek(s->memblockq, write_index, PA_SEEK_ABSOLUTE, true);
+        pa_memblock_unref(chunk.memblock);
+    } else {
+        if (s->last_chunk.memblock)
+            pa_memblock_unref(s->last_chunk.memblock);
+        s->last_chunk = chunk;
 
-    /* The next timestamp we expect */
-    s->offset = s->rtp_context.timestamp + (uint32_t) (chunk.length / s->rtp_context.frame_size);
+        /* The next timestamp we expect */
+        s->offset = s->rtp_context.timestamp + (uint32_t) (chunk.length / s->rtp_context.frame_size);
+    }
 
     pa_atomic_store(&s->timestamp, (int) now.tv_sec);
 
@@ -309,6 +389,18 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
         else
             latency = wi - ri;
 
+        pa_log_debug("Jitter %0.2f ms, %llu packets lost, %llu late",
+                     (double) jitter_usec(s)/PA_USEC_PER_MSEC, (unsigned long long) s->n_lost, (unsigned long long) s->n_late);
+
+        if (s->userdata->adaptive_latency) {
+            pa_usec_t target;
+
+            /* Keep enough data buffered to ride out the jitter, but no
+             * more than what we were configured for */
+            target = JITTER_FACTOR * jitter_usec(s) + pa_bytes_to_usec(s->last_chunk.length, &s->sink_input->sample_spec);
+            s->intended_latency = PA_CLAMP(target, s->sink_latency*2, PA_MAX(s->userdata->latency, s->sink_latency*2));
+        }
+
         pa_log_debug("Write index deviates by %0.2f ms, expected %0.2f ms", (double) latency/PA_USEC_PER_MSEC, (double) s->intended_latency/PA_USEC_PER_MSEC);
 
         /* The buffer is filling with some unknown rate R̂ samples/second. If the rate of reading in
@@ -374,6 +466,32 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
         s->last_rate_update = pa_timeval_load(&now);
     }
 
+    return true;
+}
+
+static int rtpoll_work_cb(pa_rtpoll_item *i) {
+    struct session *s;
+    struct pollfd *p;
+
+    pa_assert_se(s = pa_rtpoll_item_get_userdata(i));
+
+    p = pa_rtpoll_item_get_pollfd(i, NULL);
+
+    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
+        pa_log("poll() signalled bad revents.");
+        return -1;
+    }
+
+    if ((p->revents & POLLIN) == 0)
+        return 0;
+
+    p->revents = 0;
+
+    /* Go through the whole batch of packets that was read */
+    do
+        process_packet(s);
+    while (pa_rtp_recv_pending(&s->rtp_context));
+
     if (pa_memblockq_is_readable(s->memblockq) &&
         s->sink_input->thread_info.underrun_for > 0) {
         pa_log_debug("Requesting rewind due to end of underrun");
@@ -620,6 +738,9 @@ static void session_free(struct session *s) {
     pa_assert(s->userdata->n_sessions >= 1);
     s->userdata->n_sessions--;
 
+    if (s->last_chunk.memblock)
+        pa_memblock_unref(s->last_chunk.memblock);
+
     pa_memblockq_free(s->memblockq);
     pa_sdp_info_destroy(&s->sdp_info);
     pa_rtp_context_destroy(&s->rtp_context);
@@ -702,6 +823,7 @@ int pa__init(pa_module*m) {
     socklen_t salen;
     const char *sap_address;
     uint32_t latency_msec;
+    bool adaptive_latency = false;
     int fd = -1;
 
     pa_assert(m);
@@ -736,6 +858,11 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "adaptive_latency", &adaptive_latency) < 0) {
+        pa_log("Failed to parse adaptive_latency argument");
+        goto fail;
+    }
+
     if ((fd = mcast_socket(sa, salen)) < 0)
         goto fail;
 
@@ -744,6 +871,7 @@ int pa__init(pa_module*m) {
     u->core = m->core;
     u->sink_name = pa_xstrdup(pa_modargs_get_value(ma, "sink", NULL));
     u->latency = (pa_usec_t) latency_msec * PA_USEC_PER_MSEC;
+    u->adaptive_latency = adaptive_latency;
 
     u->sap_event = m->core->mainloop->io_new(m->core->mainloop, fd, PA_IO_EVENT_INPUT, sap_event_cb, u);
     pa_sap_context_init_recv(&u->sap_context, fd);
@@ -26,6 +26,7 @@
 #include <netinet/in.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -39,11 +40,13 @@
 #include <pulsecore/memblockq.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/idxset.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/socket-util.h>
+#include <pulsecore/shared.h>
 #include <pulsecore/arpa-inet.h>
 
 #include "module-rtp-send-symdef.h"
@@ -61,13 +64,15 @@ PA_MODULE_USAGE(
         "format=<sample format> "
         "channels=<number of channels> "
         "rate=<sample rate> "
-        "destination_ip=<destination IP address> "
+        "destination_ip=<destination IP address, or a comma separated list of them> "
         "source_ip=<source IP address> "
         "port=<port number> "
         "mtu=<maximum transfer unit> "
         "loop=<loopback to local host?> "
         "ttl=<ttl value> "
-        "inhibit_auto_suspend=<always|never|only_with_non_monitor_sources>"
+        "inhibit_auto_suspend=<always|never|only_with_non_monitor_sources> "
+        "aes67=<use the AES67 profile?> "
+        "group=<name of a group of instances sharing one stream>"
 );
 
 #define DEFAULT_PORT 46000
@@ -78,6 +83,8 @@ PA_MODULE_USAGE(
 #define MEMBLOCKQ_MAXLENGTH (1024*170)
 #define DEFAULT_MTU 1280
 #define SAP_INTERVAL (5*PA_USEC_PER_SEC)
+#define AES67_RATE 48000
+#define AES67_PTIME PA_USEC_PER_MSEC
 
 static const char* const valid_modargs[] = {
     "source",
@@ -92,6 +99,8 @@ static const char* const valid_modargs[] = {
     "loop",
     "ttl",
     "inhibit_auto_suspend",
+    "aes67",
+    "group",
     NULL
 };
 
@@ -104,6 +113,23 @@ enum inhibit_auto_suspend {
 struct userdata {
     pa_module *module;
 
+    /* Our destinations. Only instances that are first in their group
+     * send anything, the others just add theirs to the first one's. */
+    pa_rtp_destination *own_destinations;
+    unsigned n_own_destinations;
+
+    char *group;
+    bool is_member;
+    struct userdata *sender; /* NULL once the sender is gone */
+    pa_idxset *members;
+
+    /* What the sending thread currently uses */
+    pa_rtp_destination *destinations;
+    unsigned n_destinations;
+
+    sa_family_t af;
+    uint32_t port;
+
     pa_source_output *source_output;
     pa_memblockq *memblockq;
 
@@ -116,6 +142,10 @@ struct userdata {
     enum inhibit_auto_suspend inhibit_auto_suspend;
 };
 
+enum {
+    SOURCE_OUTPUT_MESSAGE_SET_DESTINATIONS = PA_SOURCE_OUTPUT_MESSAGE_MAX
+};
+
 /* Called from I/O thread context */
 static int source_output_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u;
@@ -128,6 +158,10 @@ static int source_output_process_msg(pa_msgobject *o, int code, void *data, int6
             /* Fall through, the default handler will add in the extra
              * latency added by the resampler */
             break;
+
+        case SOURCE_OUTPUT_MESSAGE_SET_DESTINATIONS:
+            pa_rtp_context_set_destinations(&u->rtp_context, data, (unsigned) offset);
+            return 0;
     }
 
     return pa_source_output_process_msg(o, code, data, offset, chunk);
@@ -147,6 +181,21 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     pa_rtp_send(&u->rtp_context, u->mtu, u->memblockq);
 }
 
+/* AES67 wants the RTP timestamps to be the PTP time in samples. We
+ * don't speak PTP ourselves, but rely on the system clock being
+ * synchronized to it, e.g. by phc2sys. PTP uses the TAI timescale. */
+static uint32_t ptp_timestamp(uint32_t rate) {
+#ifdef CLOCK_TAI
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_TAI, &ts) == 0)
+        return (uint32_t) ((uint64_t) ts.tv_sec * rate + (uint64_t) ts.tv_nsec * rate / PA_NSEC_PER_SEC);
+#endif
+
+    pa_log_warn("Failed to read the TAI clock, RTP timestamps are not aligned to PTP.");
+    return 0;
+}
+
 static pa_source_output_flags_t get_dont_inhibit_auto_suspend_flag(pa_source *source,
                                                                    enum inhibit_auto_suspend inhibit_auto_suspend) {
     pa_assert(source);
@@ -193,6 +242,131 @@ static void source_output_kill_cb(pa_source_output* o) {
     u->source_output = NULL;
 }
 
+/* Called from main context */
+static pa_rtp_destination* parse_destinations(const char *list, uint32_t port, sa_family_t af, unsigned *n) {
+    pa_rtp_destination *d = NULL;
+    const char *state = NULL;
+    char *a;
+
+    *n = 0;
+
+    while ((a = pa_split(list, ",", &state))) {
+        d = pa_xrenew(pa_rtp_destination, d, *n + 1);
+        pa_zero(d[*n]);
+
+        if (af == AF_INET) {
+            struct sockaddr_in *sa4 = (struct sockaddr_in*) &d[*n].sa;
+
+            if (inet_pton(AF_INET, a, &sa4->sin_addr) <= 0)
+                goto fail;
+
+            sa4->sin_family = AF_INET;
+            sa4->sin_port = htons((uint16_t) port);
+            d[*n].sa_len = sizeof(*sa4);
+#ifdef HAVE_IPV6
+        } else {
+            struct sockaddr_in6 *sa6 = (struct sockaddr_in6*) &d[*n].sa;
+
+            if (inet_pton(AF_INET6, a, &sa6->sin6_addr) <= 0)
+                goto fail;
+
+            sa6->sin6_family = AF_INET6;
+            sa6->sin6_port = htons((uint16_t) port);
+            d[*n].sa_len = sizeof(*sa6);
+#endif
+        }
+
+        pa_xfree(a);
+        (*n)++;
+    }
+
+    if (*n == 0)
+        pa_log("No destination given");
+
+    return d;
+
+fail:
+    pa_log("Invalid destination '%s'", a);
+    pa_xfree(a);
+    pa_xfree(d);
+    *n = 0;
+
+    return NULL;
+}
+
+/* Called from main context */
+static void update_destinations(struct userdata *u) {
+    struct userdata *member;
+    pa_rtp_destination *d;
+    uint32_t idx;
+    unsigned n;
+
+    pa_assert(u);
+    pa_assert(!u->is_member);
+
+    n = u->n_own_destinations;
+    PA_IDXSET_FOREACH(member, u->members, idx)
+        n += member->n_own_destinations;
+
+    d = pa_xnew(pa_rtp_destination, n);
+
+    memcpy(d, u->own_destinations, u->n_own_destinations * sizeof(pa_rtp_destination));
+    n = u->n_own_destinations;
+
+    PA_IDXSET_FOREACH(member, u->members, idx) {
+        memcpy(d + n, member->own_destinations, member->n_own_destinations * sizeof(pa_rtp_destination));
+        n += member->n_own_destinations;
+    }
+
+    /* Once the sending thread has the new list, the old one is ours */
+    if (u->source_output && PA_SOURCE_OUTPUT_IS_LINKED(pa_source_output_get_state(u->source_output)))
+        pa_assert_se(pa_asyncmsgq_send(u->source_output->source->asyncmsgq, PA_MSGOBJECT(u->source_output),
+                                       SOURCE_OUTPUT_MESSAGE_SET_DESTINATIONS, d, (int64_t) n, NULL) == 0);
+    else
+        pa_rtp_context_set_destinations(&u->rtp_context, d, n);
+
+    pa_xfree(u->destinations);
+    u->destinations = d;
+    u->n_destinations = n;
+}
+
+/* Called from main context */
+static int join_group(pa_module *m, pa_modargs *ma, struct userdata *sender) {
+    struct userdata *u;
+    const char *dst_list;
+    uint32_t port;
+
+    if (!(dst_list = pa_modargs_get_value(ma, "destination_ip", NULL))) {
+        pa_log("Joining group %s requires destination_ip=", sender->group);
+        return -1;
+    }
+
+    port = sender->port;
+    if (pa_modargs_get_value_u32(ma, "port", &port) < 0 || port < 1 || port > 0xFFFF) {
+        pa_log("port= expects a numerical argument between 1 and 65535.");
+        return -1;
+    }
+
+    u = pa_xnew0(struct userdata, 1);
+    u->module = m;
+
+    if (!(u->own_destinations = parse_destinations(dst_list, port, sender->af, &u->n_own_destinations))) {
+        pa_xfree(u);
+        return -1;
+    }
+
+    m->userdata = u;
+    u->is_member = true;
+    u->sender = sender;
+    pa_idxset_put(sender->members, u, NULL);
+
+    update_destinations(sender);
+
+    pa_log_info("Joined RTP group %s with %s:%u", sender->group, dst_list, port);
+
+    return 0;
+}
+
 static void sap_event_cb(pa_mainloop_api *m, pa_time_event *t, const struct timeval *tv, void *userdata) {
     struct userdata *u = userdata;
 
@@ -208,7 +382,8 @@ static void sap_event_cb(pa_mainloop_api *m, pa_time_event *t, const struct time
 int pa__init(pa_module*m) {
     struct userdata *u;
     pa_modargs *ma = NULL;
-    const char *dst_addr;
+    const char *dst_list, *group, *state = NULL;
+    char *dst_addr = NULL;
     const char *src_addr;
     uint32_t port = DEFAULT_PORT, mtu;
     uint32_t ttl = DEFAULT_TTL;
@@ -228,10 +403,12 @@ int pa__init(pa_module*m) {
     int r, j;
     socklen_t k;
     char hn[128], *n;
-    bool loop = false;
+    bool loop = false, aes67 = false;
     enum inhibit_auto_suspend inhibit_auto_suspend = INHIBIT_AUTO_SUSPEND_ONLY_WITH_NON_MONITOR_SOURCES;
     const char *inhibit_auto_suspend_str;
     pa_source_output_new_data data;
+    pa_rtp_destination *destinations = NULL;
+    unsigned n_destinations = 0;
 
     pa_assert(m);
 
@@ -240,6 +417,23 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    /* If the group has a sender already, all we do is tell it about our
+     * destinations */
+    if ((group = pa_modargs_get_value(ma, "group", NULL))) {
+        struct userdata *sender;
+        char *key;
+
+        key = pa_sprintf_malloc("rtp-send-group:%s", group);
+        sender = pa_shared_get(m->core, key);
+        pa_xfree(key);
+
+        if (sender) {
+            r = join_group(m, ma, sender);
+            pa_modargs_free(ma);
+            return r;
+        }
+    }
+
     if (!(s = pa_namereg_get(m->core, pa_modargs_get_value(ma, "source", NULL), PA_NAMEREG_SOURCE))) {
         pa_log("Source does not exist.");
         goto fail;
@@ -263,9 +457,20 @@ int pa__init(pa_module*m) {
         }
     }
 
+    if (pa_modargs_get_value_boolean(ma, "aes67", &aes67) < 0) {
+        pa_log("Failed to parse \"aes67\" parameter.");
+        goto fail;
+    }
+
     ss = s->sample_spec;
     pa_rtp_sample_spec_fixup(&ss);
     cm = s->channel_map;
+
+    if (aes67) {
+        ss.format = PA_SAMPLE_S24BE;
+        ss.rate = AES67_RATE;
+    }
+
     if (pa_modargs_get_sample_spec(ma, &ss) < 0) {
         pa_log("Failed to parse sample specification");
         goto fail;
@@ -281,7 +486,10 @@ int pa__init(pa_module*m) {
 
     payload = pa_rtp_payload_from_sample_spec(&ss);
 
-    mtu = (uint32_t) pa_frame_align(DEFAULT_MTU, &ss);
+    if (aes67)
+        mtu = (uint32_t) pa_usec_to_bytes(AES67_PTIME, &ss);
+    else
+        mtu = (uint32_t) pa_frame_align(DEFAULT_MTU, &ss);
 
     if (pa_modargs_get_value_u32(ma, "mtu", &mtu) < 0 || mtu < 1 || mtu % pa_frame_size(&ss) != 0) {
         pa_log("Invalid MTU.");
@@ -322,9 +530,15 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
-    dst_addr = pa_modargs_get_value(ma, "destination", NULL);
-    if (dst_addr == NULL)
-        dst_addr = pa_modargs_get_value(ma, "destination_ip", DEFAULT_DESTINATION_IP);
+    dst_list = pa_modargs_get_value(ma, "destination", NULL);
+    if (dst_list == NULL)
+        dst_list = pa_modargs_get_value(ma, "destination_ip", DEFAULT_DESTINATION_IP);
+
+    /* The first destination is the one we announce */
+    if (!(dst_addr = pa_split(dst_list, ",", &state))) {
+        pa_log("Invalid destination '%s'", dst_list);
+        goto fail;
+    }
 
     if (inet_pton(AF_INET, dst_addr, &dst_sa4.sin_addr) > 0) {
         dst_sa4.sin_family = af = AF_INET;
@@ -346,6 +560,9 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (!(destinations = parse_destinations(dst_list, port, af, &n_destinations)))
+        goto fail;
+
     if ((fd = pa_socket_cloexec(af, SOCK_DGRAM, 0)) < 0) {
         pa_log("socket() failed: %s", pa_cstrerror(errno));
         goto fail;
@@ -424,10 +641,14 @@ int pa__init(pa_module*m) {
     pa_source_output_new_data_init(&data);
     pa_proplist_sets(data.proplist, PA_PROP_MEDIA_NAME, "RTP Monitor Stream");
     pa_proplist_sets(data.proplist, "rtp.source", src_addr);
-    pa_proplist_sets(data.proplist, "rtp.destination", dst_addr);
+    pa_proplist_sets(data.proplist, "rtp.destination", dst_list);
+    if (group)
+        pa_proplist_sets(data.proplist, "rtp.group", group);
     pa_proplist_setf(data.proplist, "rtp.mtu", "%lu", (unsigned long) mtu);
     pa_proplist_setf(data.proplist, "rtp.port", "%lu", (unsigned long) port);
     pa_proplist_setf(data.proplist, "rtp.ttl", "%lu", (unsigned long) ttl);
+    if (aes67)
+        pa_proplist_sets(data.proplist, "rtp.profile", "aes67");
     data.driver = __FILE__;
     data.module = m;
     pa_source_output_new_data_set_source(&data, s, false);
@@ -451,9 +672,14 @@ int pa__init(pa_module*m) {
     pa_log_info("Configured source latency of %llu ms.",
                 (unsigned long long) pa_source_output_set_requested_latency(o, pa_bytes_to_usec(mtu, &o->sample_spec)) / PA_USEC_PER_MSEC);
 
-    m->userdata = o->userdata = u = pa_xnew(struct userdata, 1);
+    m->userdata = o->userdata = u = pa_xnew0(struct userdata, 1);
     u->module = m;
     u->source_output = o;
+    u->af = af;
+    u->port = port;
+    u->own_destinations = destinations;
+    u->n_own_destinations = n_destinations;
+    destinations = NULL;
 
     u->memblockq = pa_memblockq_new(
             "module-rtp-send memblockq",
@@ -477,21 +703,41 @@ int pa__init(pa_module*m) {
         p = pa_sdp_build(af,
                      (void*) &((struct sockaddr_in*) &sa_dst)->sin_addr,
                      (void*) &dst_sa4.sin_addr,
-                     n, (uint16_t) port, payload, &ss);
+                     n, (uint16_t) port, payload, &ss,
+                     aes67 ? pa_bytes_to_usec(mtu, &ss) : 0, aes67);
 #ifdef HAVE_IPV6
     } else {
         p = pa_sdp_build(af,
                      (void*) &((struct sockaddr_in6*) &sa_dst)->sin6_addr,
                      (void*) &dst_sa6.sin6_addr,
-                     n, (uint16_t) port, payload, &ss);
+                     n, (uint16_t) port, payload, &ss,
+                     aes67 ? pa_bytes_to_usec(mtu, &ss) : 0, aes67);
 #endif
     }
 
     pa_xfree(n);
 
     pa_rtp_context_init_send(&u->rtp_context, fd, m->core->cookie, payload, pa_frame_size(&ss));
+    if (aes67)
+        u->rtp_context.timestamp = ptp_timestamp(ss.rate);
     pa_sap_context_init_send(&u->sap_context, sap_fd, p);
 
+    /* With a single destination we just keep sending to the address the
+     * socket is connected to */
+    if (group) {
+        char *key;
+
+        u->group = pa_xstrdup(group);
+        u->members = pa_idxset_new(NULL, NULL);
+
+        key = pa_sprintf_malloc("rtp-send-group:%s", group);
+        pa_assert_se(pa_shared_set(m->core, key, u) >= 0);
+        pa_xfree(key);
+    }
+
+    if (group || u->n_own_destinations > 1)
+        update_destinations(u);
+
     pa_log_info("RTP stream initialized with mtu %u on %s:%u from %s ttl=%u, SSRC=0x%08x, payload=%u, initial sequence #%u", mtu, dst_addr, port, src_addr, ttl, u->rtp_context.ssrc, payload, u->rtp_context.sequence);
     pa_log_info("SDP-Data:\n%s\nEOF", p);
 
@@ -503,6 +749,7 @@ int pa__init(pa_module*m) {
     pa_source_output_put(u->source_output);
 
     pa_modargs_free(ma);
+    pa_xfree(dst_addr);
 
     return 0;
 
@@ -510,6 +757,9 @@ fail:
     if (ma)
         pa_modargs_free(ma);
 
+    pa_xfree(dst_addr);
+    pa_xfree(destinations);
+
     if (fd >= 0)
         pa_close(fd);
 
@@ -531,6 +781,36 @@ void pa__done(pa_module*m) {
     if (!(u = m->userdata))
         return;
 
+    if (u->is_member) {
+        if (u->sender) {
+            pa_idxset_remove_by_data(u->sender->members, u, NULL);
+            update_destinations(u->sender);
+        }
+
+        pa_xfree(u->own_destinations);
+        pa_xfree(u);
+        return;
+    }
+
+    if (u->group) {
+        struct userdata *member;
+        char *key;
+
+        /* The group can't go on without us */
+        while ((member = pa_idxset_steal_first(u->members, NULL))) {
+            member->sender = NULL;
+            pa_module_unload_request(member->module, true);
+        }
+
+        pa_idxset_free(u->members, NULL);
+
+        key = pa_sprintf_malloc("rtp-send-group:%s", u->group);
+        pa_assert_se(pa_shared_remove(m->core, key) >= 0);
+        pa_xfree(key);
+
+        pa_xfree(u->group);
+    }
+
     if (u->sap_event)
         m->core->mainloop->time_free(u->sap_event);
 
@@ -547,5 +827,7 @@ void pa__done(pa_module*m) {
     if (u->memblockq)
         pa_memblockq_free(u->memblockq);
 
+    pa_xfree(u->destinations);
+    pa_xfree(u->own_destinations);
     pa_xfree(u);
 }
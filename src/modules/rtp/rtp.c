@@ -54,8 +54,12 @@ pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssr
     c->payload = (uint8_t) (payload & 127U);
     c->frame_size = frame_size;
 
+    c->destinations = NULL;
+    c->n_destinations = 0;
+
     c->recv_buf = NULL;
     c->recv_buf_size = 0;
+    c->recv_batch = NULL;
     pa_memchunk_reset(&c->memchunk);
 
     return c;
@@ -63,127 +67,273 @@ pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssr
 
 #define MAX_IOVECS 16
 
-int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
+/* Packets handed to the kernel with one sendmmsg(), and the most
+ * messages of one when sending to several destinations */
+#ifdef HAVE_SENDMMSG
+#define MAX_PACKETS 8
+#define MAX_MESSAGES 64
+#else
+#define MAX_PACKETS 1
+#endif
+
+struct rtp_packet {
+    uint32_t header[3];
     struct iovec iov[MAX_IOVECS];
-    pa_memblock* mb[MAX_IOVECS];
-    int iov_idx = 1;
-    size_t n = 0;
+    pa_memblock *mb[MAX_IOVECS];
+    int n_iov;
+};
+
+/* Sends the same packets to every destination. Since one receiver's
+ * queue being full shouldn't hold back the others, only errors other
+ * than that are reported, by returning -1. */
+static int send_packets_to_destinations(pa_rtp_context *c, struct rtp_packet *packets, unsigned n) {
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr m[MAX_MESSAGES];
+    unsigned d, i, j = 0;
+    int r = (int) n, e = 0;
+
+    pa_zero(m);
+
+    for (d = 0; d < c->n_destinations; d++)
+        for (i = 0; i < n; i++) {
+            m[j].msg_hdr.msg_name = (void*) &c->destinations[d].sa;
+            m[j].msg_hdr.msg_namelen = c->destinations[d].sa_len;
+            m[j].msg_hdr.msg_iov = packets[i].iov;
+            m[j].msg_hdr.msg_iovlen = (size_t) packets[i].n_iov;
+
+            if (++j < MAX_MESSAGES && (d + 1 < c->n_destinations || i + 1 < n))
+                continue;
+
+            if (sendmmsg(c->fd, m, j, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                e = errno;
+                r = -1;
+            }
+
+            j = 0;
+        }
+
+    errno = e;
+    return r;
+#else
+    struct msghdr m;
+    unsigned d;
+    int r = 1, e = 0;
+
+    pa_assert(n == 1);
+
+    pa_zero(m);
+    m.msg_iov = packets[0].iov;
+    m.msg_iovlen = (size_t) packets[0].n_iov;
+
+    for (d = 0; d < c->n_destinations; d++) {
+        m.msg_name = (void*) &c->destinations[d].sa;
+        m.msg_namelen = c->destinations[d].sa_len;
+
+        if (sendmsg(c->fd, &m, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            e = errno;
+            r = -1;
+        }
+    }
+
+    errno = e;
+    return r;
+#endif
+}
+
+/* Returns the number of packets sent, or -1 if not even the first one
+ * could be sent */
+static int send_packets(pa_rtp_context *c, struct rtp_packet *packets, unsigned n) {
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr m[MAX_PACKETS];
+    unsigned i;
+
+    pa_zero(m);
+
+    for (i = 0; i < n; i++) {
+        m[i].msg_hdr.msg_iov = packets[i].iov;
+        m[i].msg_hdr.msg_iovlen = (size_t) packets[i].n_iov;
+    }
+
+    return sendmmsg(c->fd, m, n, MSG_DONTWAIT);
+#else
+    struct msghdr m;
+
+    pa_assert(n == 1);
+
+    pa_zero(m);
+    m.msg_iov = packets[0].iov;
+    m.msg_iovlen = (size_t) packets[0].n_iov;
+
+    return sendmsg(c->fd, &m, MSG_DONTWAIT) < 0 ? -1 : 1;
+#endif
+}
+
+void pa_rtp_context_set_destinations(pa_rtp_context *c, const pa_rtp_destination *d, unsigned n) {
+    struct sockaddr sa;
 
     pa_assert(c);
-    pa_assert(size > 0);
-    pa_assert(q);
+    pa_assert(d || n == 0);
 
-    if (pa_memblockq_get_length(q) < size)
-        return 0;
+    /* Connecting to an unspecified address dissolves the connection, so
+     * that we may pick the address with each packet */
+    if (n > 0 && !c->destinations) {
+        pa_zero(sa);
+        sa.sa_family = AF_UNSPEC;
+
+        if (connect(c->fd, &sa, sizeof(sa)) < 0)
+            pa_log_debug("Failed to disconnect the RTP socket: %s", pa_cstrerror(errno));
+    }
+
+    c->destinations = d;
+    c->n_destinations = n;
+}
+
+/* Fill in one packet of up to size bytes from the queue. The payload is
+ * referenced straight from the memblocks, the header goes into iov[0].
+ * Returns the number of payload bytes, *eof is set if the queue ran
+ * dry. */
+static size_t build_packet(pa_rtp_context *c, struct rtp_packet *p, size_t size, pa_memblockq *q, bool *eof) {
+    size_t n = 0;
 
-    for (;;) {
-        int r;
+    p->n_iov = 1;
+
+    while (n < size && p->n_iov < MAX_IOVECS) {
         pa_memchunk chunk;
+        size_t k;
 
         pa_memchunk_reset(&chunk);
 
-        if ((r = pa_memblockq_peek(q, &chunk)) >= 0) {
+        if (pa_memblockq_peek(q, &chunk) < 0) {
+            *eof = true;
+            break;
+        }
+
+        pa_assert(chunk.memblock);
 
-            size_t k = n + chunk.length > size ? size - n : chunk.length;
+        k = n + chunk.length > size ? size - n : chunk.length;
 
-            pa_assert(chunk.memblock);
+        p->iov[p->n_iov].iov_base = pa_memblock_acquire_chunk(&chunk);
+        p->iov[p->n_iov].iov_len = k;
+        p->mb[p->n_iov] = chunk.memblock;
+        p->n_iov++;
 
-            iov[iov_idx].iov_base = pa_memblock_acquire_chunk(&chunk);
-            iov[iov_idx].iov_len = k;
-            mb[iov_idx] = chunk.memblock;
-            iov_idx ++;
+        n += k;
+        pa_memblockq_drop(q, k);
+    }
 
-            n += k;
-            pa_memblockq_drop(q, k);
-        }
+    pa_assert(n % c->frame_size == 0);
 
-        pa_assert(n % c->frame_size == 0);
+    if (n > 0) {
+        p->header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
+        p->header[1] = htonl(c->timestamp);
+        p->header[2] = htonl(c->ssrc);
+
+        p->iov[0].iov_base = (void*) p->header;
+        p->iov[0].iov_len = sizeof(p->header);
+
+        c->sequence++;
+    }
 
-        if (r < 0 || n >= size || iov_idx >= MAX_IOVECS) {
-            uint32_t header[3];
-            struct msghdr m;
-            ssize_t k;
-            int i;
+    c->timestamp += (unsigned) (n/c->frame_size);
 
-            if (n > 0) {
-                header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
-                header[1] = htonl(c->timestamp);
-                header[2] = htonl(c->ssrc);
+    return n;
+}
 
-                iov[0].iov_base = (void*)header;
-                iov[0].iov_len = sizeof(header);
+static void free_packet(struct rtp_packet *p) {
+    int i;
 
-                m.msg_name = NULL;
-                m.msg_namelen = 0;
-                m.msg_iov = iov;
-                m.msg_iovlen = (size_t) iov_idx;
-                m.msg_control = NULL;
-                m.msg_controllen = 0;
-                m.msg_flags = 0;
+    for (i = 1; i < p->n_iov; i++) {
+        pa_memblock_release(p->mb[i]);
+        pa_memblock_unref(p->mb[i]);
+    }
+}
 
-                k = sendmsg(c->fd, &m, MSG_DONTWAIT);
+int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
+    struct rtp_packet packets[MAX_PACKETS];
+    bool eof = false;
 
-                for (i = 1; i < iov_idx; i++) {
-                    pa_memblock_release(mb[i]);
-                    pa_memblock_unref(mb[i]);
-                }
+    pa_assert(c);
+    pa_assert(size > 0);
+    pa_assert(q);
 
-                c->sequence++;
-            } else
-                k = 0;
+    while (!eof && pa_memblockq_get_length(q) >= size) {
+        unsigned n = 0, i;
+        int k = 0;
 
-            c->timestamp += (unsigned) (n/c->frame_size);
+        /* Collect as many full packets as we can send in one go */
+        while (!eof && n < MAX_PACKETS && pa_memblockq_get_length(q) >= size)
+            if (build_packet(c, &packets[n], size, q, &eof) > 0)
+                n++;
+            else
+                free_packet(&packets[n]);
 
-            if (k < 0) {
-                if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
-                    pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
-                return -1;
-            }
+        if (n > 0)
+            k = c->destinations ? send_packets_to_destinations(c, packets, n) : send_packets(c, packets, n);
 
-            if (r < 0 || pa_memblockq_get_length(q) < size)
-                break;
+        for (i = 0; i < n; i++)
+            free_packet(&packets[i]);
 
-            n = 0;
-            iov_idx = 1;
+        if (k < (int) n) {
+            /* If the queue is full, just ignore it */
+            if (k < 0 && errno != EAGAIN && errno != EINTR)
+                pa_log("sendmmsg() failed: %s", pa_cstrerror(errno));
+            return -1;
         }
     }
 
     return 0;
 }
 
+/* Packets picked up with one recvmmsg() */
+#ifdef HAVE_RECVMMSG
+#define MAX_RECV_PACKETS 8
+typedef struct mmsghdr recv_msg;
+#else
+#define MAX_RECV_PACKETS 1
+typedef struct {
+    struct msghdr msg_hdr;
+    unsigned msg_len;
+} recv_msg;
+#endif
+
+#define RECV_AUX_SIZE 1024
+
+struct pa_rtp_recv_batch {
+    recv_msg msgs[MAX_RECV_PACKETS];
+    struct iovec iov[MAX_RECV_PACKETS];
+    uint8_t aux[MAX_RECV_PACKETS][RECV_AUX_SIZE];
+
+    /* Number of packets received, and the next one to return */
+    unsigned n, next;
+};
+
 pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame_size) {
     pa_assert(c);
 
     c->fd = fd;
     c->frame_size = frame_size;
 
+    /* recv_buf holds MAX_RECV_PACKETS slots of recv_buf_size bytes each */
     c->recv_buf_size = 2000;
-    c->recv_buf = pa_xmalloc(c->recv_buf_size);
+    c->recv_buf = pa_xmalloc(c->recv_buf_size * MAX_RECV_PACKETS);
+    c->recv_batch = pa_xnew0(struct pa_rtp_recv_batch, 1);
     pa_memchunk_reset(&c->memchunk);
     return c;
 }
 
-int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
-    int size;
-    size_t audio_length;
-    size_t metadata_length;
-    struct msghdr m;
-    struct cmsghdr *cm;
-    struct iovec iov;
-    uint32_t header;
-    unsigned cc;
-    ssize_t r;
-    uint8_t aux[1024];
-    bool found_tstamp = false;
+/* Read as many packets as are queued on the socket, up to
+ * MAX_RECV_PACKETS, in one go. Returns the number of packets read, or
+ * -1 on failure. */
+static int receive_batch(pa_rtp_context *c) {
+    struct pa_rtp_recv_batch *b = c->recv_batch;
+    int size, r;
+    unsigned i;
 
-    pa_assert(c);
-    pa_assert(chunk);
-
-    pa_memchunk_reset(chunk);
+    b->n = b->next = 0;
 
     if (ioctl(c->fd, FIONREAD, &size) < 0) {
         pa_log_warn("FIONREAD failed: %s", pa_cstrerror(errno));
-        goto fail;
+        return -1;
     }
 
     if (size <= 0) {
@@ -197,57 +347,88 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
          * In the first case, the packet has to be read out, otherwise the
          * kernel will tell us again and again about it, thus preventing
          * reception of any further packets. So let's just read it out
-         * now and discard it later, when comparing the number of bytes
-         * received (0) with the number of bytes wanted (1, see below).
+         * now and discard it later, when parsing the packet.
          *
          * In the second case, recvmsg() will fail, thus allowing us to
          * return the error.
          *
-         * Just to avoid passing zero-sized memchunks and NULL pointers to
-         * recvmsg(), let's force allocation of at least one byte by setting
-         * size to 1.
+         * Just to avoid passing zero-sized buffers to recvmsg(), let's
+         * force allocation of at least one byte by setting size to 1.
          */
         size = 1;
     }
 
+    /* FIONREAD only tells us about the first packet. Slots that turn out
+     * to be too small for a later one are caught by MSG_TRUNC. */
     if (c->recv_buf_size < (size_t) size) {
         do
             c->recv_buf_size *= 2;
         while (c->recv_buf_size < (size_t) size);
 
-        c->recv_buf = pa_xrealloc(c->recv_buf, c->recv_buf_size);
+        c->recv_buf = pa_xrealloc(c->recv_buf, c->recv_buf_size * MAX_RECV_PACKETS);
     }
 
-    pa_assert(c->recv_buf_size >= (size_t) size);
+    pa_zero(b->msgs);
 
-    iov.iov_base = c->recv_buf;
-    iov.iov_len = (size_t) size;
+    for (i = 0; i < MAX_RECV_PACKETS; i++) {
+        b->iov[i].iov_base = c->recv_buf + i * c->recv_buf_size;
+        b->iov[i].iov_len = c->recv_buf_size;
 
-    m.msg_name = NULL;
-    m.msg_namelen = 0;
-    m.msg_iov = &iov;
-    m.msg_iovlen = 1;
-    m.msg_control = aux;
-    m.msg_controllen = sizeof(aux);
-    m.msg_flags = 0;
+        b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+        b->msgs[i].msg_hdr.msg_iovlen = 1;
+        b->msgs[i].msg_hdr.msg_control = b->aux[i];
+        b->msgs[i].msg_hdr.msg_controllen = RECV_AUX_SIZE;
+    }
 
-    r = recvmsg(c->fd, &m, 0);
+#ifdef HAVE_RECVMMSG
+    r = recvmmsg(c->fd, b->msgs, MAX_RECV_PACKETS, MSG_DONTWAIT, NULL);
+#else
+    {
+        ssize_t l;
+
+        if ((l = recvmsg(c->fd, &b->msgs[0].msg_hdr, MSG_DONTWAIT)) >= 0) {
+            b->msgs[0].msg_len = (unsigned) l;
+            r = 1;
+        } else
+            r = -1;
+    }
+#endif
+
+    if (r < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+            pa_log_warn("recvmsg() failed: %s", pa_cstrerror(errno));
+
+        return -1;
+    }
+
+    b->n = (unsigned) r;
+    return r;
+}
 
-    if (r != size) {
-        if (r < 0 && errno != EAGAIN && errno != EINTR)
-            pa_log_warn("recvmsg() failed: %s", r < 0 ? pa_cstrerror(errno) : "size mismatch");
+static int parse_packet(pa_rtp_context *c, recv_msg *msg, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
+    size_t size, audio_length, metadata_length;
+    struct cmsghdr *cm;
+    uint8_t *data;
+    uint32_t header;
+    unsigned cc;
+    bool found_tstamp = false;
+
+    data = msg->msg_hdr.msg_iov[0].iov_base;
+    size = msg->msg_len;
 
-        goto fail;
+    if (msg->msg_hdr.msg_flags & MSG_TRUNC) {
+        pa_log_warn("RTP packet larger than %lu bytes.", (unsigned long) c->recv_buf_size);
+        return -1;
     }
 
     if (size < 12) {
         pa_log_warn("RTP packet too short.");
-        goto fail;
+        return -1;
     }
 
-    memcpy(&header, iov.iov_base, sizeof(uint32_t));
-    memcpy(&c->timestamp, (uint8_t*) iov.iov_base + 4, sizeof(uint32_t));
-    memcpy(&c->ssrc, (uint8_t*) iov.iov_base + 8, sizeof(uint32_t));
+    memcpy(&header, data, sizeof(uint32_t));
+    memcpy(&c->timestamp, data + 4, sizeof(uint32_t));
+    memcpy(&c->ssrc, data + 8, sizeof(uint32_t));
 
     header = ntohl(header);
     c->timestamp = ntohl(c->timestamp);
@@ -255,17 +436,17 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
 
     if ((header >> 30) != 2) {
         pa_log_warn("Unsupported RTP version.");
-        goto fail;
+        return -1;
     }
 
     if ((header >> 29) & 1) {
         pa_log_warn("RTP padding not supported.");
-        goto fail;
+        return -1;
     }
 
     if ((header >> 28) & 1) {
         pa_log_warn("RTP header extensions not supported.");
-        goto fail;
+        return -1;
     }
 
     cc = (header >> 24) & 0xF;
@@ -274,16 +455,16 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
 
     metadata_length = 12 + cc * 4;
 
-    if (metadata_length > (unsigned) size) {
+    if (metadata_length > size) {
         pa_log_warn("RTP packet too short. (CSRC)");
-        goto fail;
+        return -1;
     }
 
     audio_length = size - metadata_length;
 
     if (audio_length % c->frame_size != 0) {
         pa_log_warn("Bad RTP packet size.");
-        goto fail;
+        return -1;
     }
 
     if (c->memchunk.length < (unsigned) audio_length) {
@@ -299,7 +480,7 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
         c->memchunk.length = pa_memblock_get_length(c->memchunk.memblock);
     }
 
-    memcpy(pa_memblock_acquire_chunk(&c->memchunk), c->recv_buf + metadata_length, audio_length);
+    memcpy(pa_memblock_acquire_chunk(&c->memchunk), data + metadata_length, audio_length);
     pa_memblock_release(c->memchunk.memblock);
 
     chunk->memblock = pa_memblock_ref(c->memchunk.memblock);
@@ -314,7 +495,7 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
         pa_memchunk_reset(&c->memchunk);
     }
 
-    for (cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm))
+    for (cm = CMSG_FIRSTHDR(&msg->msg_hdr); cm; cm = CMSG_NXTHDR(&msg->msg_hdr, cm))
         if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMP) {
             memcpy(tstamp, CMSG_DATA(cm), sizeof(struct timeval));
             found_tstamp = true;
@@ -327,12 +508,28 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
     }
 
     return 0;
+}
 
-fail:
-    if (chunk->memblock)
-        pa_memblock_unref(chunk->memblock);
+int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
+    struct pa_rtp_recv_batch *b;
+
+    pa_assert(c);
+    pa_assert(chunk);
+    pa_assert_se(b = c->recv_batch);
+
+    pa_memchunk_reset(chunk);
 
-    return -1;
+    if (b->next >= b->n && receive_batch(c) <= 0)
+        return -1;
+
+    return parse_packet(c, &b->msgs[b->next++], chunk, pool, tstamp);
+}
+
+bool pa_rtp_recv_pending(pa_rtp_context *c) {
+    pa_assert(c);
+    pa_assert(c->recv_batch);
+
+    return c->recv_batch->next < c->recv_batch->n;
 }
 
 uint8_t pa_rtp_payload_from_sample_spec(const pa_sample_spec *ss) {
@@ -405,7 +602,8 @@ int pa_rtp_sample_spec_valid(const pa_sample_spec *ss) {
         ss->format == PA_SAMPLE_U8 ||
         ss->format == PA_SAMPLE_ALAW ||
         ss->format == PA_SAMPLE_ULAW ||
-        ss->format == PA_SAMPLE_S16BE;
+        ss->format == PA_SAMPLE_S16BE ||
+        ss->format == PA_SAMPLE_S24BE;
 }
 
 void pa_rtp_context_destroy(pa_rtp_context *c) {
@@ -419,12 +617,17 @@ void pa_rtp_context_destroy(pa_rtp_context *c) {
     pa_xfree(c->recv_buf);
     c->recv_buf = NULL;
     c->recv_buf_size = 0;
+
+    pa_xfree(c->recv_batch);
+    c->recv_batch = NULL;
 }
 
 const char* pa_rtp_format_to_string(pa_sample_format_t f) {
     switch (f) {
         case PA_SAMPLE_S16BE:
             return "L16";
+        case PA_SAMPLE_S24BE:
+            return "L24";
         case PA_SAMPLE_U8:
             return "L8";
         case PA_SAMPLE_ALAW:
@@ -441,6 +644,8 @@ pa_sample_format_t pa_rtp_string_to_format(const char *s) {
 
     if (pa_streq(s, "L16"))
         return PA_SAMPLE_S16BE;
+    else if (pa_streq(s, "L24"))
+        return PA_SAMPLE_S24BE;
     else if (pa_streq(s, "L8"))
         return PA_SAMPLE_U8;
     else if (pa_streq(s, "PCMA"))
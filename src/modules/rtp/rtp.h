@@ -26,6 +26,11 @@
 #include <pulsecore/memblockq.h>
 #include <pulsecore/memchunk.h>
 
+typedef struct pa_rtp_destination {
+    struct sockaddr_storage sa;
+    socklen_t sa_len;
+} pa_rtp_destination;
+
 typedef struct pa_rtp_context {
     int fd;
     uint16_t sequence;
@@ -34,8 +39,12 @@ typedef struct pa_rtp_context {
     uint8_t payload;
     size_t frame_size;
 
+    const pa_rtp_destination *destinations;
+    unsigned n_destinations;
+
     uint8_t *recv_buf;
     size_t recv_buf_size;
+    struct pa_rtp_recv_batch *recv_batch;
     pa_memchunk memchunk;
 } pa_rtp_context;
 
@@ -45,9 +54,20 @@ pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssr
  * guarantee that the current read index doesn't point to a hole. */
 int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q);
 
+/* Makes pa_rtp_send() send every packet to each of the n destinations,
+ * instead of to the address the socket is connected to. The socket's
+ * connection is dissolved for that. The array isn't copied and must stay
+ * valid until it's replaced. Call from the sending thread. */
+void pa_rtp_context_set_destinations(pa_rtp_context *c, const pa_rtp_destination *d, unsigned n);
+
 pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame_size);
 int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp);
 
+/* Packets are read from the socket in batches. Returns true if
+ * pa_rtp_recv() has more packets of the last batch to return, which
+ * won't be signalled by the socket becoming readable. */
+bool pa_rtp_recv_pending(pa_rtp_context *c);
+
 void pa_rtp_context_destroy(pa_rtp_context *c);
 
 pa_sample_spec* pa_rtp_sample_spec_fixup(pa_sample_spec *ss);
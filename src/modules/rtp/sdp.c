@@ -30,6 +30,7 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
@@ -39,9 +40,10 @@
 #include "sdp.h"
 #include "rtp.h"
 
-char *pa_sdp_build(int af, const void *src, const void *dst, const char *name, uint16_t port, uint8_t payload, const pa_sample_spec *ss) {
+char *pa_sdp_build(int af, const void *src, const void *dst, const char *name, uint16_t port, uint8_t payload, const pa_sample_spec *ss,
+                   pa_usec_t ptime, bool ptp) {
     uint32_t ntp;
-    char buf_src[64], buf_dst[64], un[64];
+    char buf_src[64], buf_dst[64], un[64], ptime_attr[32] = "";
     const char *u, *f;
 
     pa_assert(src);
@@ -63,6 +65,9 @@ char *pa_sdp_build(int af, const void *src, const void *dst, const char *name, u
     pa_assert_se(inet_ntop(af, src, buf_src, sizeof(buf_src)));
     pa_assert_se(inet_ntop(af, dst, buf_dst, sizeof(buf_dst)));
 
+    if (ptime > 0)
+        pa_snprintf(ptime_attr, sizeof(ptime_attr), "a=ptime:%g\n", (double) ptime / PA_USEC_PER_MSEC);
+
     return pa_sprintf_malloc(
             PA_SDP_HEADER
             "o=%s %lu 0 IN %s %s\n"
@@ -72,13 +77,18 @@ char *pa_sdp_build(int af, const void *src, const void *dst, const char *name, u
             "a=recvonly\n"
             "m=audio %u RTP/AVP %i\n"
             "a=rtpmap:%i %s/%u/%u\n"
+            "%s"
+            "%s"
             "a=type:broadcast\n",
             u, (unsigned long) ntp, af == AF_INET ? "IP4" : "IP6", buf_src,
             name,
             af == AF_INET ? "IP4" : "IP6", buf_dst,
             (unsigned long) ntp,
             port, payload,
-            payload, f, ss->rate, ss->channels);
+            payload, f, ss->rate, ss->channels,
+            ptime_attr,
+            /* As in AES67: the timestamps are taken from the PTP clock, without an offset */
+            ptp ? "a=ts-refclk:ptp=IEEE1588-2008:traceable\na=mediaclk:direct=0\n" : "");
 }
 
 static pa_sample_spec *parse_sdp_sample_spec(pa_sample_spec *ss, char *c) {
@@ -89,6 +99,9 @@ static pa_sample_spec *parse_sdp_sample_spec(pa_sample_spec *ss, char *c) {
     if (pa_startswith(c, "L16/")) {
         ss->format = PA_SAMPLE_S16BE;
         c += 4;
+    } else if (pa_startswith(c, "L24/")) {
+        ss->format = PA_SAMPLE_S24BE;
+        c += 4;
     } else if (pa_startswith(c, "L8/")) {
         ss->format = PA_SAMPLE_U8;
         c += 3;
@@ -104,7 +117,7 @@ static pa_sample_spec *parse_sdp_sample_spec(pa_sample_spec *ss, char *c) {
     if (sscanf(c, "%u/%u", &rate, &channels) == 2) {
         ss->rate = (uint32_t) rate;
         ss->channels = (uint8_t) channels;
-    } else if (sscanf(c, "%u", &rate) == 2) {
+    } else if (sscanf(c, "%u", &rate) == 1) {
         ss->rate = (uint32_t) rate;
         ss->channels = 1;
     } else
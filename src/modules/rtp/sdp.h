@@ -25,6 +25,7 @@
 #include <sys/types.h>
 
 #include <pulse/sample.h>
+#include <pulsecore/macro.h>
 
 #define PA_SDP_HEADER "v=0\n"
 
@@ -39,7 +40,11 @@ typedef struct pa_sdp_info {
     uint8_t payload;
 } pa_sdp_info;
 
-char *pa_sdp_build(int af, const void *src, const void *dst, const char *name, uint16_t port, uint8_t payload, const pa_sample_spec *ss);
+/* If ptime is not 0, the packet time is announced. If ptp is true, the
+ * RTP timestamps are announced to be derived from the PTP clock, as
+ * AES67 requires. */
+char *pa_sdp_build(int af, const void *src, const void *dst, const char *name, uint16_t port, uint8_t payload, const pa_sample_spec *ss,
+                   pa_usec_t ptime, bool ptp);
 
 pa_sdp_info *pa_sdp_parse(const char *t, pa_sdp_info *info, int is_goodbye);
 
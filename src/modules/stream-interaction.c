@@ -23,6 +23,7 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/volume.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/macro.h>
 #include <pulsecore/hashmap.h>
@@ -40,6 +41,17 @@ struct group {
     pa_idxset *interaction_roles;
     pa_hashmap *interaction_state;
     pa_volume_t volume;
+
+    /* Index of the streams whose role makes them a trigger resp. subject
+     * to the interaction in this group, so that we don't have to match
+     * the roles of every stream on every event */
+    pa_idxset *trigger_streams;
+    pa_idxset *interaction_streams;
+
+    /* The trigger role last applied, per sink or globally. As long as it
+     * stays the same only the stream an event is about needs looking at. */
+    pa_hashmap *active_trigger;
+    const char *global_trigger;
 };
 
 struct userdata {
@@ -48,6 +60,7 @@ struct userdata {
     struct group **groups;
     bool global:1;
     bool duck:1;
+    pa_usec_t ramp_usec;
     pa_hook_slot
         *sink_input_put_slot,
         *sink_input_unlink_slot,
@@ -55,7 +68,8 @@ struct userdata {
         *sink_input_move_finish_slot,
         *sink_input_state_changed_slot,
         *sink_input_mute_changed_slot,
-        *sink_input_proplist_changed_slot;
+        *sink_input_proplist_changed_slot,
+        *sink_unlink_slot;
 };
 
 static const char *get_trigger_role(struct userdata *u, pa_sink_input *i, struct group *g) {
@@ -84,44 +98,76 @@ static const char *get_trigger_role(struct userdata *u, pa_sink_input *i, struct
     return NULL;
 }
 
-static const char *find_trigger_stream(struct userdata *u, pa_sink *s, pa_sink_input *ignore, struct group *g) {
-    pa_sink_input *j;
-    uint32_t idx;
-    const char *trigger_role;
+static bool is_interaction_stream(struct userdata *u, pa_sink_input *i, struct group *g) {
+    const char *role, *interaction_role;
+    uint32_t role_idx;
 
-    pa_assert(u);
-    pa_sink_assert_ref(s);
+    if (!(role = pa_proplist_gets(i->proplist, PA_PROP_MEDIA_ROLE)))
+        role = "no_role";
+
+    PA_IDXSET_FOREACH(interaction_role, g->interaction_roles, role_idx) {
+        if (pa_streq(role, interaction_role))
+            return true;
+        if (pa_streq(interaction_role, "any_role") && !get_trigger_role(u, i, g))
+            return true;
+    }
 
-    for (j = PA_SINK_INPUT(pa_idxset_first(s->inputs, &idx)); j; j = PA_SINK_INPUT(pa_idxset_next(s->inputs, &idx))) {
+    return false;
+}
 
-        if (j == ignore)
-            continue;
+/* Updates the role index of all groups for i, needs to be called
+ * whenever the role of i may have changed. */
+static void classify_stream(struct userdata *u, pa_sink_input *i) {
+    uint32_t j;
 
-        trigger_role = get_trigger_role(u, j, g);
-        if (trigger_role && !j->muted && pa_sink_input_get_state(j) != PA_SINK_INPUT_CORKED)
-            return trigger_role;
+    for (j = 0; j < u->n_groups; j++) {
+        struct group *g = u->groups[j];
+
+        if (get_trigger_role(u, i, g))
+            pa_idxset_put(g->trigger_streams, i, NULL);
+        else
+            pa_idxset_remove_by_data(g->trigger_streams, i, NULL);
+
+        if (is_interaction_stream(u, i, g)) {
+            /* Let the ducking fade in and out rather than jump */
+            if (pa_idxset_put(g->interaction_streams, i, NULL) >= 0 && u->ramp_usec > 0)
+                pa_sink_input_set_volume_ramp(i, u->ramp_usec);
+        } else
+            pa_idxset_remove_by_data(g->interaction_streams, i, NULL);
     }
+}
 
-    return NULL;
+static void forget_stream(struct userdata *u, pa_sink_input *i) {
+    uint32_t j;
+
+    for (j = 0; j < u->n_groups; j++) {
+        pa_idxset_remove_by_data(u->groups[j]->trigger_streams, i, NULL);
+        pa_idxset_remove_by_data(u->groups[j]->interaction_streams, i, NULL);
+    }
 }
 
 static const char *find_global_trigger_stream(struct userdata *u, pa_sink *s, pa_sink_input *ignore, struct group *g) {
-    const char *trigger_role = NULL;
+    pa_sink_input *j;
+    uint32_t idx;
 
     pa_assert(u);
 
-    if (u->global) {
-        uint32_t idx;
-        PA_IDXSET_FOREACH(s, u->core->sinks, idx)
-            if ((trigger_role = find_trigger_stream(u, s, ignore, g)))
-                break;
-    } else
-        trigger_role = find_trigger_stream(u, s, ignore, g);
-
-    return trigger_role;
+    PA_IDXSET_FOREACH(j, g->trigger_streams, idx) {
+
+        if (j == ignore || !j->sink)
+            continue;
+
+        if (!u->global && j->sink != s)
+            continue;
+
+        if (!j->muted && pa_sink_input_get_state(j) != PA_SINK_INPUT_CORKED)
+            return get_trigger_role(u, j, g);
+    }
+
+    return NULL;
 }
 
-static void cork_or_duck(struct userdata *u, pa_sink_input *i, const char *interaction_role,  const char *trigger_role, bool interaction_applied, struct group *g) {
+static void cork_or_duck(struct userdata *u, pa_sink_input *i, const char *interaction_role,  const char *trigger_role, bool interaction_applied, struct group *g, pa_idxset *sync) {
 
     if (u->duck && !interaction_applied) {
         pa_cvolume vol;
@@ -129,7 +175,9 @@ static void cork_or_duck(struct userdata *u, pa_sink_input *i, const char *inter
         vol.values[0] = g->volume;
 
         pa_log_debug("Found a '%s' stream of '%s' that ducks a '%s' stream.", trigger_role, g->name, interaction_role);
-        pa_sink_input_add_volume_factor(i, g->name, &vol);
+        pa_sink_input_add_volume_factor(i, g->name, &vol, !sync);
+        if (sync)
+            pa_idxset_put(sync, i->sink, NULL);
 
     } else if (!u->duck) {
         pa_log_debug("Found a '%s' stream that corks/mutes a '%s' stream.", trigger_role, interaction_role);
@@ -138,11 +186,13 @@ static void cork_or_duck(struct userdata *u, pa_sink_input *i, const char *inter
     }
 }
 
-static void uncork_or_unduck(struct userdata *u, pa_sink_input *i, const char *interaction_role, bool corked, struct group *g) {
+static void uncork_or_unduck(struct userdata *u, pa_sink_input *i, const char *interaction_role, bool corked, struct group *g, pa_idxset *sync) {
 
     if (u->duck) {
        pa_log_debug("In '%s', found a '%s' stream that should be unducked", g->name, interaction_role);
-       pa_sink_input_remove_volume_factor(i, g->name);
+       pa_sink_input_remove_volume_factor(i, g->name, !sync);
+       if (sync)
+           pa_idxset_put(sync, i->sink, NULL);
     }
     else if (corked || i->muted) {
        pa_log_debug("Found a '%s' stream that should be uncorked/unmuted.", interaction_role);
@@ -153,66 +203,61 @@ static void uncork_or_unduck(struct userdata *u, pa_sink_input *i, const char *i
     }
 }
 
-static inline void apply_interaction_to_sink(struct userdata *u, pa_sink *s, const char *new_trigger, pa_sink_input *ignore, bool new_stream, struct group *g) {
-    pa_sink_input *j;
-    uint32_t idx, role_idx;
-    const char *interaction_role;
-    bool trigger = false;
-
-    pa_assert(u);
-    pa_sink_assert_ref(s);
-
-    for (j = PA_SINK_INPUT(pa_idxset_first(s->inputs, &idx)); j; j = PA_SINK_INPUT(pa_idxset_next(s->inputs, &idx))) {
-        bool corked, interaction_applied;
-        const char *role;
+/* Volume factors changed without sending a message are made effective
+ * with one message per sink */
+static void sync_volumes(pa_idxset *sync) {
+    pa_sink *s;
+    uint32_t idx;
 
-        if (j == ignore)
-            continue;
+    PA_IDXSET_FOREACH(s, sync, idx)
+        pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_SYNC_VOLUMES, NULL, 0, NULL) == 0);
+}
 
-        if (!(role = pa_proplist_gets(j->proplist, PA_PROP_MEDIA_ROLE)))
-            role = "no_role";
+static void apply_interaction_to_stream(struct userdata *u, pa_sink_input *j, const char *new_trigger, bool new_stream, struct group *g, pa_idxset *sync) {
+    bool corked, interaction_applied;
+    const char *role;
 
-        PA_IDXSET_FOREACH(interaction_role, g->interaction_roles, role_idx) {
-            if ((trigger = pa_streq(role, interaction_role)))
-                break;
-            if ((trigger = (pa_streq(interaction_role, "any_role") && !get_trigger_role(u, j, g))))
-               break;
-        }
-        if (!trigger)
-            continue;
+    if (!(role = pa_proplist_gets(j->proplist, PA_PROP_MEDIA_ROLE)))
+        role = "no_role";
 
-        /* Some applications start their streams corked, so the stream is uncorked by */
-        /* the application only after sink_input_put() was called. If a new stream turns */
-        /* up, act as if it was not corked. In the case of module-role-cork this will */
-        /* only mute the stream because corking is reverted later by the application */
-        corked = (pa_sink_input_get_state(j) == PA_SINK_INPUT_CORKED);
-        if (new_stream && corked)
-            corked = false;
-        interaction_applied = !!pa_hashmap_get(g->interaction_state, j);
+    /* Some applications start their streams corked, so the stream is uncorked by */
+    /* the application only after sink_input_put() was called. If a new stream turns */
+    /* up, act as if it was not corked. In the case of module-role-cork this will */
+    /* only mute the stream because corking is reverted later by the application */
+    corked = (pa_sink_input_get_state(j) == PA_SINK_INPUT_CORKED);
+    if (new_stream && corked)
+        corked = false;
+    interaction_applied = !!pa_hashmap_get(g->interaction_state, j);
 
-        if (new_trigger && ((!corked && !j->muted) || u->duck)) {
-            if (!interaction_applied)
-                pa_hashmap_put(g->interaction_state, j, PA_INT_TO_PTR(1));
+    if (new_trigger && ((!corked && !j->muted) || u->duck)) {
+        if (!interaction_applied)
+            pa_hashmap_put(g->interaction_state, j, PA_INT_TO_PTR(1));
 
-            cork_or_duck(u, j, role, new_trigger, interaction_applied, g);
+        cork_or_duck(u, j, role, new_trigger, interaction_applied, g, sync);
 
-        } else if (!new_trigger && interaction_applied) {
-            pa_hashmap_remove(g->interaction_state, j);
+    } else if (!new_trigger && interaction_applied) {
+        pa_hashmap_remove(g->interaction_state, j);
 
-            uncork_or_unduck(u, j, role, corked, g);
-        }
+        uncork_or_unduck(u, j, role, corked, g, sync);
     }
 }
 
-static void apply_interaction(struct userdata *u, pa_sink *s, const char *trigger_role, pa_sink_input *ignore, bool new_stream, struct group *g) {
+static void apply_interaction(struct userdata *u, pa_sink *s, const char *trigger_role, pa_sink_input *ignore, bool new_stream, struct group *g, pa_idxset *sync) {
+    pa_sink_input *j;
+    uint32_t idx;
+
     pa_assert(u);
 
-    if (u->global) {
-        uint32_t idx;
-        PA_IDXSET_FOREACH(s, u->core->sinks, idx)
-            apply_interaction_to_sink(u, s, trigger_role, ignore, new_stream, g);
-    } else
-        apply_interaction_to_sink(u, s, trigger_role, ignore, new_stream, g);
+    PA_IDXSET_FOREACH(j, g->interaction_streams, idx) {
+
+        if (j == ignore || !j->sink)
+            continue;
+
+        if (!u->global && j->sink != s)
+            continue;
+
+        apply_interaction_to_stream(u, j, trigger_role, new_stream, g, sync);
+    }
 }
 
 static void remove_interactions(struct userdata *u, struct group *g) {
@@ -230,14 +275,32 @@ static void remove_interactions(struct userdata *u, struct group *g) {
                 corked = (pa_sink_input_get_state(j) == PA_SINK_INPUT_CORKED);
                 if (!(role = pa_proplist_gets(j->proplist, PA_PROP_MEDIA_ROLE)))
                    role = "no_role";
-                uncork_or_unduck(u, j, role, corked, g);
+                uncork_or_unduck(u, j, role, corked, g, NULL);
             }
         }
     }
 }
 
+/* Returns true if trigger_role differs from what was last applied to s */
+static bool update_active_trigger(struct userdata *u, pa_sink *s, const char *trigger_role, struct group *g) {
+    const char *old;
+
+    if (u->global) {
+        old = g->global_trigger;
+        g->global_trigger = trigger_role;
+    } else {
+        old = pa_hashmap_remove(g->active_trigger, s);
+
+        if (trigger_role)
+            pa_hashmap_put(g->active_trigger, s, (void *) trigger_role);
+    }
+
+    return old != trigger_role;
+}
+
 static pa_hook_result_t process(struct userdata *u, pa_sink_input *i, bool create, bool new_stream) {
     const char *trigger_role;
+    pa_idxset *sync;
     uint32_t j;
 
     pa_assert(u);
@@ -250,11 +313,23 @@ static pa_hook_result_t process(struct userdata *u, pa_sink_input *i, bool creat
     if (!i->sink)
         return PA_HOOK_OK;
 
+    sync = pa_idxset_new(NULL, NULL);
+
     for (j = 0; j < u->n_groups; j++) {
-        trigger_role = find_global_trigger_stream(u, i->sink, create ? NULL : i, u->groups[j]);
-        apply_interaction(u, i->sink, trigger_role, create ? NULL : i, new_stream, u->groups[j]);
+        struct group *g = u->groups[j];
+
+        trigger_role = find_global_trigger_stream(u, i->sink, create ? NULL : i, g);
+
+        if (update_active_trigger(u, i->sink, trigger_role, g))
+            apply_interaction(u, i->sink, trigger_role, create ? NULL : i, new_stream, g, sync);
+        else if (create && pa_idxset_get_by_data(g->interaction_streams, i, NULL))
+            /* Nothing changed for everybody else */
+            apply_interaction_to_stream(u, i, trigger_role, new_stream, g, sync);
     }
 
+    sync_volumes(sync);
+    pa_idxset_free(sync, NULL);
+
     return PA_HOOK_OK;
 }
 
@@ -262,13 +337,18 @@ static pa_hook_result_t sink_input_put_cb(pa_core *core, pa_sink_input *i, struc
     pa_core_assert_ref(core);
     pa_sink_input_assert_ref(i);
 
+    classify_stream(u, i);
+
     return process(u, i, true, true);
 }
 
 static pa_hook_result_t sink_input_unlink_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
     pa_sink_input_assert_ref(i);
 
-    return process(u, i, false, false);
+    process(u, i, false, false);
+    forget_stream(u, i);
+
+    return PA_HOOK_OK;
 }
 
 static pa_hook_result_t sink_input_move_start_cb(pa_core *core, pa_sink_input *i, struct userdata *u) {
@@ -309,8 +389,22 @@ static pa_hook_result_t sink_input_proplist_changed_cb(pa_core *core, pa_sink_in
     pa_core_assert_ref(core);
     pa_sink_input_assert_ref(i);
 
-    if (PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(i)))
+    if (PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(i))) {
+        classify_stream(u, i);
         return process(u, i, true, false);
+    }
+
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_unlink_cb(pa_core *core, pa_sink *s, struct userdata *u) {
+    uint32_t j;
+
+    pa_core_assert_ref(core);
+    pa_sink_assert_ref(s);
+
+    for (j = 0; j < u->n_groups; j++)
+        pa_hashmap_remove(u->groups[j]->active_trigger, s);
 
     return PA_HOOK_OK;
 }
@@ -321,6 +415,8 @@ int pa_stream_interaction_init(pa_module *m, const char* const v_modargs[]) {
     const char *roles;
     char *roles_in_group = NULL;
     bool global = false;
+    pa_sink_input *si;
+    uint32_t ramp_time = 0;
     uint32_t i = 0;
 
     pa_assert(m);
@@ -390,6 +486,9 @@ int pa_stream_interaction_init(pa_module *m, const char* const v_modargs[]) {
         u->groups[i]->trigger_roles = pa_idxset_new(NULL, NULL);
         u->groups[i]->interaction_roles = pa_idxset_new(NULL, NULL);
         u->groups[i]->interaction_state = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+        u->groups[i]->trigger_streams = pa_idxset_new(NULL, NULL);
+        u->groups[i]->interaction_streams = pa_idxset_new(NULL, NULL);
+        u->groups[i]->active_trigger = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
         if (u->duck)
             u->groups[i]->name = pa_sprintf_malloc("ducking_group_%u", i);
     }
@@ -481,6 +580,12 @@ int pa_stream_interaction_init(pa_module *m, const char* const v_modargs[]) {
                 pa_xfree(n);
             }
         }
+
+        if (pa_modargs_get_value_u32(ma, "ramp_time", &ramp_time) < 0) {
+            pa_log("Failed to parse ramp_time");
+            goto fail;
+        }
+        u->ramp_usec = (pa_usec_t) ramp_time * PA_USEC_PER_MSEC;
     }
 
     if (pa_modargs_get_value_boolean(ma, "global", &global) < 0) {
@@ -489,6 +594,10 @@ int pa_stream_interaction_init(pa_module *m, const char* const v_modargs[]) {
     }
     u->global = global;
 
+    PA_IDXSET_FOREACH(si, m->core->sink_inputs, i)
+        if (PA_SINK_INPUT_IS_LINKED(pa_sink_input_get_state(si)))
+            classify_stream(u, si);
+
     u->sink_input_put_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_put_cb, u);
     u->sink_input_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_unlink_cb, u);
     u->sink_input_move_start_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MOVE_START], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_move_start_cb, u);
@@ -496,6 +605,7 @@ int pa_stream_interaction_init(pa_module *m, const char* const v_modargs[]) {
     u->sink_input_state_changed_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_STATE_CHANGED], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_state_changed_cb, u);
     u->sink_input_mute_changed_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_MUTE_CHANGED], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_mute_changed_cb, u);
     u->sink_input_proplist_changed_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PROPLIST_CHANGED], PA_HOOK_LATE, (pa_hook_cb_t) sink_input_proplist_changed_cb, u);
+    u->sink_unlink_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_UNLINK], PA_HOOK_LATE, (pa_hook_cb_t) sink_unlink_cb, u);
 
     pa_modargs_free(ma);
 
@@ -528,6 +638,9 @@ void pa_stream_interaction_done(pa_module *m) {
             pa_idxset_free(u->groups[j]->trigger_roles, pa_xfree);
             pa_idxset_free(u->groups[j]->interaction_roles, pa_xfree);
             pa_hashmap_free(u->groups[j]->interaction_state);
+            pa_idxset_free(u->groups[j]->trigger_streams, NULL);
+            pa_idxset_free(u->groups[j]->interaction_streams, NULL);
+            pa_hashmap_free(u->groups[j]->active_trigger);
             if (u->duck)
                 pa_xfree(u->groups[j]->name);
             pa_xfree(u->groups[j]);
@@ -549,6 +662,8 @@ void pa_stream_interaction_done(pa_module *m) {
         pa_hook_slot_free(u->sink_input_mute_changed_slot);
     if (u->sink_input_proplist_changed_slot)
         pa_hook_slot_free(u->sink_input_proplist_changed_slot);
+    if (u->sink_unlink_slot)
+        pa_hook_slot_free(u->sink_unlink_slot);
 
     pa_xfree(u);
 
@@ -191,7 +191,8 @@ int pa__init(pa_module*m) {
 
     SmcSetProperties(u->connection, PA_ELEMENTSOF(prop_list), prop_list);
 
-    pa_log_info("Connected to session manager '%s' as '%s'.", vendor = SmcVendor(u->connection), client_id);
+    vendor = SmcVendor(u->connection);
+    pa_log_info("Connected to session manager '%s' as '%s'.", vendor, client_id);
 
     pa_client_new_data_init(&data);
     data.module = m;
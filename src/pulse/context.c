@@ -61,6 +61,7 @@
 #include <pulsecore/socket.h>
 #include <pulsecore/creds.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
 #include <pulsecore/proplist-util.h>
 
 #include "internal.h"
@@ -71,6 +72,13 @@ static void pa_command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uin
 static void pa_command_disable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 static void pa_command_register_memfd_shmid(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
 
+/* With shared-mempool enabled all contexts of the process allocate
+ * from this one pool. Each context holds its own reference, this
+ * pointer is cleared once the last of them goes away. */
+static pa_static_mutex shared_mempool_mutex = PA_STATIC_MUTEX_INIT;
+static pa_mempool *shared_mempool = NULL;
+static unsigned shared_mempool_users = 0;
+
 static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_REQUEST] = pa_command_request,
     [PA_COMMAND_OVERFLOW] = pa_command_overflow_or_underflow,
@@ -125,9 +133,63 @@ static void reset_callbacks(pa_context *c) {
     c->ext_stream_restore.userdata = NULL;
 }
 
+static pa_mempool *mempool_new(pa_client_conf *conf, bool memfd_on_local) {
+    pa_mempool *pool;
+    pa_mem_type_t type;
+
+    type = (conf->disable_shm) ? PA_MEM_TYPE_PRIVATE :
+           ((!memfd_on_local) ?
+               PA_MEM_TYPE_SHARED_POSIX : PA_MEM_TYPE_SHARED_MEMFD);
+
+    if (!(pool = pa_mempool_new(type, conf->shm_size, true))) {
+
+        if (!conf->disable_shm) {
+            pa_log_warn("Failed to allocate shared memory pool. Falling back to a normal private one.");
+            pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, conf->shm_size, true);
+        }
+    }
+
+    return pool;
+}
+
+static pa_mempool *shared_mempool_get(pa_client_conf *conf, bool memfd_on_local) {
+    pa_mutex *m;
+    pa_mempool *pool;
+
+    m = pa_static_mutex_get(&shared_mempool_mutex, false, false);
+    pa_mutex_lock(m);
+
+    if (!shared_mempool)
+        shared_mempool = mempool_new(conf, memfd_on_local);
+
+    if ((pool = shared_mempool)) {
+        pa_mempool_ref(pool);
+        shared_mempool_users++;
+    }
+
+    pa_mutex_unlock(m);
+
+    return pool;
+}
+
+static void shared_mempool_release(pa_mempool *pool) {
+    pa_mutex *m;
+
+    m = pa_static_mutex_get(&shared_mempool_mutex, false, false);
+    pa_mutex_lock(m);
+
+    if (pool == shared_mempool) {
+        pa_assert(shared_mempool_users > 0);
+
+        if (--shared_mempool_users == 0)
+            shared_mempool = NULL;
+    }
+
+    pa_mutex_unlock(m);
+}
+
 pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *name, pa_proplist *p) {
     pa_context *c;
-    pa_mem_type_t type;
 
     pa_assert(mainloop);
 
@@ -175,21 +237,14 @@ pa_context *pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *
 
     c->memfd_on_local = (!c->conf->disable_memfd && pa_memfd_is_locally_supported());
 
-    type = (c->conf->disable_shm) ? PA_MEM_TYPE_PRIVATE :
-           ((!c->memfd_on_local) ?
-               PA_MEM_TYPE_SHARED_POSIX : PA_MEM_TYPE_SHARED_MEMFD);
-
-    if (!(c->mempool = pa_mempool_new(type, c->conf->shm_size, true))) {
-
-        if (!c->conf->disable_shm) {
-            pa_log_warn("Failed to allocate shared memory pool. Falling back to a normal private one.");
-            c->mempool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, c->conf->shm_size, true);
-        }
+    if (c->conf->shared_mempool)
+        c->mempool = shared_mempool_get(c->conf, c->memfd_on_local);
+    else
+        c->mempool = mempool_new(c->conf, c->memfd_on_local);
 
-        if (!c->mempool) {
-            context_free(c);
-            return NULL;
-        }
+    if (!c->mempool) {
+        context_free(c);
+        return NULL;
     }
 
     return c;
@@ -236,6 +291,8 @@ static void context_unlink(pa_context *c) {
 }
 
 static void context_free(pa_context *c) {
+    unsigned k;
+
     pa_assert(c);
 
     context_unlink(c);
@@ -259,8 +316,13 @@ static void context_free(pa_context *c) {
     if (c->playback_streams)
         pa_hashmap_free(c->playback_streams);
 
-    if (c->mempool)
+    for (k = 0; k <= PA_SUBSCRIPTION_EVENT_FACILITY_MASK; k++)
+        pa_context_forget_proplists(c, k, PA_INVALID_INDEX);
+
+    if (c->mempool) {
+        shared_mempool_release(c->mempool);
         pa_mempool_unref(c->mempool);
+    }
 
     if (c->conf)
         pa_client_conf_free(c->conf);
@@ -372,6 +434,7 @@ static void handle_srbchannel_memblock(pa_context *c, pa_memblock *memblock) {
 
     /* Create the srbchannel */
     c->srb_template.memblock = memblock;
+    c->srb_template.split_indices = c->version >= 33;
     pa_memblock_ref(memblock);
     sr = pa_srbchannel_new_from_template(c->mainloop, &c->srb_template);
     if (!sr) {
@@ -469,6 +532,49 @@ int pa_context_handle_error(pa_context *c, uint32_t command, pa_tagstruct *t, bo
     return 0;
 }
 
+static int try_next_connection(pa_context *c);
+static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+
+/* Servers older than protocol version 13 can't parse the client name we
+ * sent along with the authentication and would drop the connection. So
+ * we connect to the same server again, this time waiting for the reply
+ * to the authentication first. */
+static void reconnect_without_pipelining(pa_context *c) {
+    pa_assert(c);
+
+    pa_log_debug("Server too old for a pipelined setup, reconnecting.");
+
+    c->pipeline_setup = false;
+
+    pa_pdispatch_unref(c->pdispatch);
+    c->pdispatch = NULL;
+
+    pa_pstream_unlink(c->pstream);
+    pa_pstream_unref(c->pstream);
+    c->pstream = NULL;
+
+    c->server_list = pa_strlist_prepend(c->server_list, c->server);
+
+    pa_context_set_state(c, PA_CONTEXT_CONNECTING);
+    try_next_connection(c);
+}
+
+static void send_client_name(pa_context *c, bool with_proplist) {
+    pa_tagstruct *t;
+    uint32_t tag;
+
+    t = pa_tagstruct_command(c, PA_COMMAND_SET_CLIENT_NAME, &tag);
+
+    if (with_proplist) {
+        pa_init_proplist(c->proplist);
+        pa_tagstruct_put_proplist(t, c->proplist);
+    } else
+        pa_tagstruct_puts(t, pa_proplist_gets(c->proplist, PA_PROP_APPLICATION_NAME));
+
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
+}
+
 static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_context *c = userdata;
 
@@ -485,7 +591,6 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
 
     switch(c->state) {
         case PA_CONTEXT_AUTHORIZING: {
-            pa_tagstruct *reply;
             bool shm_on_remote = false;
             bool memfd_on_remote = false;
 
@@ -519,6 +624,11 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
 
             pa_log_debug("Protocol version: remote %u, local %u", c->version, PA_PROTOCOL_VERSION);
 
+            if (c->pipeline_setup && c->version < 13) {
+                reconnect_without_pipelining(c);
+                goto finish;
+            }
+
             /* Enable shared memory support if possible */
             if (c->do_shm)
                 if (c->version < 10 || (c->version >= 13 && !shm_on_remote))
@@ -540,6 +650,11 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
             pa_log_debug("Negotiated SHM: %s", pa_yes_no(c->do_shm));
             pa_pstream_enable_shm(c->pstream, c->do_shm);
 
+            if (c->do_shm && c->version >= 33) {
+                pa_pstream_enable_batched_release(c->pstream);
+                pa_pstream_enable_large_export(c->pstream);
+            }
+
             c->shm_type = PA_MEM_TYPE_PRIVATE;
             if (c->do_shm) {
                 if (c->version >= 31 && memfd_on_remote && c->memfd_on_local) {
@@ -560,16 +675,9 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
             pa_log_debug("Memfd possible: %s", pa_yes_no(c->memfd_on_local));
             pa_log_debug("Negotiated SHM type: %s", pa_mem_type_to_string(c->shm_type));
 
-            reply = pa_tagstruct_command(c, PA_COMMAND_SET_CLIENT_NAME, &tag);
-
-            if (c->version >= 13) {
-                pa_init_proplist(c->proplist);
-                pa_tagstruct_put_proplist(reply, c->proplist);
-            } else
-                pa_tagstruct_puts(reply, pa_proplist_gets(c->proplist, PA_PROP_APPLICATION_NAME));
-
-            pa_pstream_send_tagstruct(c->pstream, reply);
-            pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
+            /* Unless the client name is already on its way */
+            if (!c->pipeline_setup)
+                send_client_name(c, c->version >= 13);
 
             pa_context_set_state(c, PA_CONTEXT_SETTING_NAME);
             break;
@@ -651,6 +759,14 @@ static void setup_context(pa_context *c, pa_iochannel *io) {
 
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
 
+    /* The server takes the format of the client name from the version
+     * we just sent, so we don't need to wait for its reply to send the
+     * name as well. This saves a round trip, which is a good part of the
+     * lifetime of short lived clients. The replies arrive in order, so
+     * setup_complete_callback() sees them in the right state. */
+    if (c->pipeline_setup)
+        send_client_name(c, true);
+
     pa_context_set_state(c, PA_CONTEXT_AUTHORIZING);
 
     pa_context_unref(c);
@@ -985,6 +1101,7 @@ int pa_context_connect(
 
     c->no_fail = !!(flags & PA_CONTEXT_NOFAIL);
     c->server_specified = !!server;
+    c->pipeline_setup = true;
     pa_assert(!c->server_list);
 
     if (server) {
@@ -1352,6 +1469,7 @@ pa_tagstruct *pa_tagstruct_command(pa_context *c, uint32_t command, uint32_t *ta
     pa_assert(tag);
 
     t = pa_tagstruct_new();
+    pa_tagstruct_set_compact(t, c->version >= 33);
     pa_tagstruct_putu32(t, command);
     pa_tagstruct_putu32(t, *tag = c->ctag++);
 
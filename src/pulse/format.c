@@ -304,9 +304,13 @@ pa_prop_type_t pa_format_info_get_prop_type(const pa_format_info *f, const char
     return type;
 }
 
+static bool json_finish(pa_json_tokenizer *t);
+
 int pa_format_info_get_prop_int(const pa_format_info *f, const char *key, int *v) {
     const char *str;
-    pa_json_object *o;
+    pa_json_tokenizer t;
+    pa_json_token token;
+    pa_json_token_type type;
 
     pa_assert(f);
     pa_assert(key);
@@ -316,20 +320,22 @@ int pa_format_info_get_prop_int(const pa_format_info *f, const char *key, int *v
     if (!str)
         return -PA_ERR_NOENTITY;
 
-    o = pa_json_parse(str);
-    if (!o) {
+    /* This is called for every format during negotiation, so avoid building
+     * an object tree for what is nearly always a plain number */
+    pa_json_tokenizer_init(&t, str);
+    type = pa_json_tokenizer_next(&t, &token);
+
+    if (type <= PA_JSON_TOKEN_END || !json_finish(&t)) {
         pa_log_debug("Failed to parse format info property '%s'.", key);
         return -PA_ERR_INVALID;
     }
 
-    if (pa_json_object_get_type(o) != PA_JSON_TYPE_INT) {
+    if (type != PA_JSON_TOKEN_VALUE || token.type != PA_JSON_TYPE_INT) {
         pa_log_debug("Format info property '%s' type is not int.", key);
-        pa_json_object_free(o);
         return -PA_ERR_INVALID;
     }
 
-    *v = pa_json_object_get_int(o);
-    pa_json_object_free(o);
+    *v = token.int_value;
 
     return 0;
 }
@@ -600,84 +606,100 @@ void pa_format_info_set_prop_string_array(pa_format_info *f, const char *key, co
     pa_xfree (str);
 }
 
-static bool pa_json_is_fixed_type(pa_json_object *o) {
-    switch(pa_json_object_get_type(o)) {
-        case PA_JSON_TYPE_OBJECT:
-        case PA_JSON_TYPE_ARRAY:
-            return false;
+/* Skips the rest of the value, checking that it is valid JSON */
+static bool json_finish(pa_json_tokenizer *t) {
+    pa_json_token token;
+    pa_json_token_type type;
 
-        default:
-            return true;
-    }
-}
+    while ((type = pa_json_tokenizer_next(t, &token)) > PA_JSON_TOKEN_END)
+        ;
 
-static int pa_format_info_prop_compatible(const char *one, const char *two) {
-    pa_json_object *o1 = NULL, *o2 = NULL;
-    int i, ret = 0;
+    return type == PA_JSON_TOKEN_END;
+}
 
-    o1 = pa_json_parse(one);
-    if (!o1)
-        goto out;
+/* Compares a JSON value against the fixed value in fixed. The first token of
+ * the value has already been read from t into first. */
+static int json_match_fixed(pa_json_tokenizer *t, const pa_json_token *first, pa_json_token_type first_type, const pa_json_token *fixed) {
+    pa_json_token token;
+    pa_json_token_type type;
+    bool have_min = false, have_max = false, expect_value = false, min_key = false, max_key = false;
+    int min = 0, max = 0, ret = 0;
+
+    if (first_type == PA_JSON_TOKEN_ARRAY_BEGIN) {
+        while ((type = pa_json_tokenizer_next(t, &token)) > PA_JSON_TOKEN_END) {
+            if (type == PA_JSON_TOKEN_VALUE && token.level == first->level + 1 && pa_json_token_equal(&token, fixed))
+                ret = 1;
+        }
 
-    o2 = pa_json_parse(two);
-    if (!o2)
-        goto out;
+    } else if (first_type == PA_JSON_TOKEN_OBJECT_BEGIN) {
+        /* A range type. If a key appears more than once, the first one counts. */
+        bool valid_min = false, valid_max = false;
 
-    /* We don't deal with both values being non-fixed - just because there is no immediate need (FIXME) */
-    pa_return_val_if_fail(pa_json_is_fixed_type(o1) || pa_json_is_fixed_type(o2), false);
+        while ((type = pa_json_tokenizer_next(t, &token)) > PA_JSON_TOKEN_END) {
+            if (token.level != first->level + 1)
+                continue;
 
-    if (pa_json_is_fixed_type(o1) && pa_json_is_fixed_type(o2)) {
-        ret = pa_json_object_equal(o1, o2);
-        goto out;
-    }
+            if (type == PA_JSON_TOKEN_KEY) {
+                min_key = !have_min && pa_json_token_string_equal(&token, PA_JSON_MIN_KEY);
+                max_key = !have_max && pa_json_token_string_equal(&token, PA_JSON_MAX_KEY);
+                expect_value = true;
+                continue;
+            }
 
-    if (pa_json_is_fixed_type(o1)) {
-        pa_json_object *tmp = o2;
-        o2 = o1;
-        o1 = tmp;
-    }
+            if (!expect_value || (type != PA_JSON_TOKEN_VALUE && type != PA_JSON_TOKEN_ARRAY_BEGIN && type != PA_JSON_TOKEN_OBJECT_BEGIN))
+                continue;
 
-    /* o2 is now a fixed type, and o1 is not */
+            expect_value = false;
 
-    if (pa_json_object_get_type(o1) == PA_JSON_TYPE_ARRAY) {
-        for (i = 0; i < pa_json_object_get_array_length(o1); i++) {
-            if (pa_json_object_equal(pa_json_object_get_array_member(o1, i), o2)) {
-                ret = 1;
-                break;
+            if (min_key) {
+                have_min = true;
+                if ((valid_min = type == PA_JSON_TOKEN_VALUE && token.type == PA_JSON_TYPE_INT))
+                    min = token.int_value;
+            } else if (max_key) {
+                have_max = true;
+                if ((valid_max = type == PA_JSON_TOKEN_VALUE && token.type == PA_JSON_TYPE_INT))
+                    max = token.int_value;
             }
         }
-    } else if (pa_json_object_get_type(o1) == PA_JSON_TYPE_OBJECT) {
-        /* o1 should be a range type */
-        int min, max, v;
-        const pa_json_object *o_min = NULL, *o_max = NULL;
 
-        if (pa_json_object_get_type(o2) != PA_JSON_TYPE_INT) {
-            /* We don't support non-integer ranges */
-            goto out;
-        }
+        /* We don't support non-integer ranges */
+        if (fixed->type == PA_JSON_TYPE_INT && valid_min && valid_max)
+            ret = fixed->int_value >= min && fixed->int_value <= max;
 
-        if (!(o_min = pa_json_object_get_object_member(o1, PA_JSON_MIN_KEY)) ||
-            pa_json_object_get_type(o_min) != PA_JSON_TYPE_INT)
-            goto out;
+    } else
+        pa_assert_not_reached();
 
-        if (!(o_max = pa_json_object_get_object_member(o1, PA_JSON_MAX_KEY)) ||
-            pa_json_object_get_type(o_max) != PA_JSON_TYPE_INT)
-            goto out;
+    return type == PA_JSON_TOKEN_END ? ret : 0;
+}
 
-        v = pa_json_object_get_int(o2);
-        min = pa_json_object_get_int(o_min);
-        max = pa_json_object_get_int(o_max);
+/* Uses the tokenizer rather than pa_json_parse(): format negotiation compares
+ * every property of every client format against every device format, and
+ * building object trees for that dominated the cost. */
+static int pa_format_info_prop_compatible(const char *one, const char *two) {
+    pa_json_tokenizer t1, t2;
+    pa_json_token token1, token2;
+    pa_json_token_type type1, type2;
 
-        ret = v >= min && v <= max;
-    } else {
-        pa_log_warn("Got a format type that we don't support");
-    }
+    pa_json_tokenizer_init(&t1, one);
+    pa_json_tokenizer_init(&t2, two);
 
-out:
-    if (o1)
-        pa_json_object_free(o1);
-    if (o2)
-        pa_json_object_free(o2);
+    if ((type1 = pa_json_tokenizer_next(&t1, &token1)) <= PA_JSON_TOKEN_END ||
+        (type2 = pa_json_tokenizer_next(&t2, &token2)) <= PA_JSON_TOKEN_END)
+        return 0;
 
-    return ret;
+    if (type1 == PA_JSON_TOKEN_VALUE && type2 == PA_JSON_TOKEN_VALUE)
+        return json_finish(&t1) && json_finish(&t2) && pa_json_token_equal(&token1, &token2);
+
+    if (type1 != PA_JSON_TOKEN_VALUE && type2 != PA_JSON_TOKEN_VALUE) {
+        if (!json_finish(&t1) || !json_finish(&t2))
+            return 0;
+
+        /* We don't deal with both values being non-fixed - just because there is no immediate need (FIXME) */
+        pa_return_val_if_fail(type1 == PA_JSON_TOKEN_VALUE || type2 == PA_JSON_TOKEN_VALUE, false);
+    }
+
+    if (type1 == PA_JSON_TOKEN_VALUE)
+        return json_finish(&t1) && json_match_fixed(&t2, &token2, type2, &token1);
+    else
+        return json_finish(&t2) && json_match_fixed(&t1, &token1, type1, &token2);
 }
@@ -31,12 +31,22 @@
 #include <glib.h>
 #include "glib-mainloop.h"
 
+/* Every event is a child source of the main loop's source, so that GLib
+ * itself takes care of polling and timeouts: io events poll their fd
+ * via g_source_add_unix_fd(), time and defer events are just a ready
+ * time. Enabling and disabling any of them is O(1), and there's nothing
+ * for us to scan on each iteration. Freed events are detached right
+ * away, but their destroy callbacks are called from the next prepare,
+ * as before. */
+
 struct pa_io_event {
+    GSource source;
+
     pa_glib_mainloop *mainloop;
     int dead;
 
-    GPollFD poll_fd;
-    int poll_fd_added;
+    int fd;
+    gpointer tag;
 
     pa_io_event_cb_t callback;
     void *userdata;
@@ -46,10 +56,11 @@ struct pa_io_event {
 };
 
 struct pa_time_event {
+    GSource source;
+
     pa_glib_mainloop *mainloop;
     int dead;
 
-    int enabled;
     struct timeval timeval;
 
     pa_time_event_cb_t callback;
@@ -60,11 +71,11 @@ struct pa_time_event {
 };
 
 struct pa_defer_event {
+    GSource source;
+
     pa_glib_mainloop *mainloop;
     int dead;
 
-    int enabled;
-
     pa_defer_event_cb_t callback;
     void *userdata;
     pa_defer_event_destroy_cb_t destroy_callback;
@@ -82,10 +93,7 @@ struct pa_glib_mainloop {
     PA_LLIST_HEAD(pa_time_event, time_events);
     PA_LLIST_HEAD(pa_defer_event, defer_events);
 
-    int n_enabled_defer_events, n_enabled_time_events;
     int io_events_please_scan, time_events_please_scan, defer_events_please_scan;
-
-    pa_time_event *cached_next_time_event;
 };
 
 static void cleanup_io_events(pa_glib_mainloop *g, int force) {
@@ -104,15 +112,13 @@ static void cleanup_io_events(pa_glib_mainloop *g, int force) {
             if (e->dead) {
                 g_assert(g->io_events_please_scan > 0);
                 g->io_events_please_scan--;
-            }
-
-            if (e->poll_fd_added)
-                g_source_remove_poll(&g->source, &e->poll_fd);
+            } else
+                g_source_remove_child_source(&g->source, &e->source);
 
             if (e->destroy_callback)
                 e->destroy_callback(&g->api, e, e->userdata);
 
-            pa_xfree(e);
+            g_source_unref(&e->source);
         }
 
         e = n;
@@ -137,17 +143,13 @@ static void cleanup_time_events(pa_glib_mainloop *g, int force) {
             if (e->dead) {
                 g_assert(g->time_events_please_scan > 0);
                 g->time_events_please_scan--;
-            }
-
-            if (!e->dead && e->enabled) {
-                g_assert(g->n_enabled_time_events > 0);
-                g->n_enabled_time_events--;
-            }
+            } else
+                g_source_remove_child_source(&g->source, &e->source);
 
             if (e->destroy_callback)
                 e->destroy_callback(&g->api, e, e->userdata);
 
-            pa_xfree(e);
+            g_source_unref(&e->source);
         }
 
         e = n;
@@ -172,17 +174,13 @@ static void cleanup_defer_events(pa_glib_mainloop *g, int force) {
             if (e->dead) {
                 g_assert(g->defer_events_please_scan > 0);
                 g->defer_events_please_scan--;
-            }
-
-            if (!e->dead && e->enabled) {
-                g_assert(g->n_enabled_defer_events > 0);
-                g->n_enabled_defer_events--;
-            }
+            } else
+                g_source_remove_child_source(&g->source, &e->source);
 
             if (e->destroy_callback)
                 e->destroy_callback(&g->api, e, e->userdata);
 
-            pa_xfree(e);
+            g_source_unref(&e->source);
         }
 
         e = n;
@@ -191,15 +189,15 @@ static void cleanup_defer_events(pa_glib_mainloop *g, int force) {
     g_assert(g->defer_events_please_scan == 0);
 }
 
-static gushort map_flags_to_glib(pa_io_event_flags_t flags) {
-    return (gushort)
+static GIOCondition map_flags_to_glib(pa_io_event_flags_t flags) {
+    return (GIOCondition)
         ((flags & PA_IO_EVENT_INPUT ? G_IO_IN : 0) |
          (flags & PA_IO_EVENT_OUTPUT ? G_IO_OUT : 0) |
          (flags & PA_IO_EVENT_ERROR ? G_IO_ERR : 0) |
          (flags & PA_IO_EVENT_HANGUP ? G_IO_HUP : 0));
 }
 
-static pa_io_event_flags_t map_flags_from_glib(gushort flags) {
+static pa_io_event_flags_t map_flags_from_glib(GIOCondition flags) {
     return
         (flags & G_IO_IN ? PA_IO_EVENT_INPUT : 0) |
         (flags & G_IO_OUT ? PA_IO_EVENT_OUTPUT : 0) |
@@ -207,6 +205,28 @@ static pa_io_event_flags_t map_flags_from_glib(gushort flags) {
         (flags & G_IO_HUP ? PA_IO_EVENT_HANGUP : 0);
 }
 
+static gboolean io_dispatch_func(GSource *source, GSourceFunc callback, gpointer userdata) {
+    pa_io_event *e = (pa_io_event*) source;
+    GIOCondition revents;
+
+    g_assert(e);
+    g_assert(!e->dead);
+
+    if ((revents = g_source_query_unix_fd(source, e->tag)))
+        e->callback(&e->mainloop->api, e, e->fd, map_flags_from_glib(revents), e->userdata);
+
+    return TRUE;
+}
+
+static GSourceFuncs io_source_funcs = {
+    NULL,
+    NULL,
+    io_dispatch_func,
+    NULL,
+    NULL,
+    NULL
+};
+
 static pa_io_event* glib_io_new(
         pa_mainloop_api*m,
         int fd,
@@ -224,13 +244,12 @@ static pa_io_event* glib_io_new(
 
     g = m->userdata;
 
-    e = pa_xnew(pa_io_event, 1);
+    e = (pa_io_event*) g_source_new(&io_source_funcs, sizeof(pa_io_event));
     e->mainloop = g;
     e->dead = 0;
 
-    e->poll_fd.fd = fd;
-    e->poll_fd.events = map_flags_to_glib(f);
-    e->poll_fd.revents = 0;
+    e->fd = fd;
+    e->tag = g_source_add_unix_fd(&e->source, fd, map_flags_to_glib(f));
 
     e->callback = cb;
     e->userdata = userdata;
@@ -238,8 +257,7 @@ static pa_io_event* glib_io_new(
 
     PA_LLIST_PREPEND(pa_io_event, g->io_events, e);
 
-    g_source_add_poll(&g->source, &e->poll_fd);
-    e->poll_fd_added = 1;
+    g_source_add_child_source(&g->source, &e->source);
 
     return e;
 }
@@ -248,7 +266,7 @@ static void glib_io_enable(pa_io_event*e, pa_io_event_flags_t f) {
     g_assert(e);
     g_assert(!e->dead);
 
-    e->poll_fd.events = map_flags_to_glib(f);
+    g_source_modify_unix_fd(&e->source, e->tag, map_flags_to_glib(f));
 }
 
 static void glib_io_free(pa_io_event*e) {
@@ -258,10 +276,7 @@ static void glib_io_free(pa_io_event*e) {
     e->dead = 1;
     e->mainloop->io_events_please_scan++;
 
-    if (e->poll_fd_added) {
-        g_source_remove_poll(&e->mainloop->source, &e->poll_fd);
-        e->poll_fd_added = 0;
-    }
+    g_source_remove_child_source(&e->mainloop->source, &e->source);
 }
 
 static void glib_io_set_destroy(pa_io_event*e, pa_io_event_destroy_cb_t cb) {
@@ -273,6 +288,43 @@ static void glib_io_set_destroy(pa_io_event*e, pa_io_event_destroy_cb_t cb) {
 
 /* Time sources */
 
+/* Time events are given in wall clock time, GLib's ready times are
+ * monotonic. Like pa_mainloop we convert when the event is armed. */
+static gint64 ready_time_from_timeval(const struct timeval *tv) {
+    gint64 at, now;
+
+    at = (gint64) tv->tv_sec * G_USEC_PER_SEC + (gint64) tv->tv_usec;
+    now = g_get_real_time();
+
+    if (at <= now)
+        return 0;
+
+    return g_get_monotonic_time() + (at - now);
+}
+
+static gboolean time_dispatch_func(GSource *source, GSourceFunc callback, gpointer userdata) {
+    pa_time_event *e = (pa_time_event*) source;
+
+    g_assert(e);
+    g_assert(!e->dead);
+
+    /* Disable time event */
+    g_source_set_ready_time(source, -1);
+
+    e->callback(&e->mainloop->api, e, &e->timeval, e->userdata);
+
+    return TRUE;
+}
+
+static GSourceFuncs time_source_funcs = {
+    NULL,
+    NULL,
+    time_dispatch_func,
+    NULL,
+    NULL,
+    NULL
+};
+
 static pa_time_event* glib_time_new(
         pa_mainloop_api*m,
         const struct timeval *tv,
@@ -288,21 +340,15 @@ static pa_time_event* glib_time_new(
 
     g = m->userdata;
 
-    e = pa_xnew(pa_time_event, 1);
+    e = (pa_time_event*) g_source_new(&time_source_funcs, sizeof(pa_time_event));
     e->mainloop = g;
     e->dead = 0;
 
-    if ((e->enabled = !!tv)) {
+    if (tv) {
         e->timeval = *tv;
-        g->n_enabled_time_events++;
-
-        if (g->cached_next_time_event) {
-            g_assert(g->cached_next_time_event->enabled);
-
-            if (pa_timeval_cmp(tv, &g->cached_next_time_event->timeval) < 0)
-                g->cached_next_time_event = e;
-        }
-    }
+        g_source_set_ready_time(&e->source, ready_time_from_timeval(tv));
+    } else
+        g_source_set_ready_time(&e->source, -1);
 
     e->callback = cb;
     e->userdata = userdata;
@@ -310,6 +356,8 @@ static pa_time_event* glib_time_new(
 
     PA_LLIST_PREPEND(pa_time_event, g->time_events, e);
 
+    g_source_add_child_source(&g->source, &e->source);
+
     return e;
 }
 
@@ -317,24 +365,11 @@ static void glib_time_restart(pa_time_event*e, const struct timeval *tv) {
     g_assert(e);
     g_assert(!e->dead);
 
-    if (e->enabled && !tv) {
-        g_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
-    } else if (!e->enabled && tv)
-        e->mainloop->n_enabled_time_events++;
-
-    if ((e->enabled = !!tv))
+    if (tv) {
         e->timeval = *tv;
-
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        g_assert(e->mainloop->cached_next_time_event->enabled);
-
-        if (pa_timeval_cmp(tv, &e->mainloop->cached_next_time_event->timeval) < 0)
-            e->mainloop->cached_next_time_event = e;
-    }
+        g_source_set_ready_time(&e->source, ready_time_from_timeval(tv));
+    } else
+        g_source_set_ready_time(&e->source, -1);
 }
 
 static void glib_time_free(pa_time_event *e) {
@@ -344,11 +379,7 @@ static void glib_time_free(pa_time_event *e) {
     e->dead = 1;
     e->mainloop->time_events_please_scan++;
 
-    if (e->enabled)
-        e->mainloop->n_enabled_time_events--;
-
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
+    g_source_remove_child_source(&e->mainloop->source, &e->source);
 }
 
 static void glib_time_set_destroy(pa_time_event *e, pa_time_event_destroy_cb_t cb) {
@@ -360,6 +391,28 @@ static void glib_time_set_destroy(pa_time_event *e, pa_time_event_destroy_cb_t c
 
 /* Deferred sources */
 
+static gboolean defer_dispatch_func(GSource *source, GSourceFunc callback, gpointer userdata) {
+    pa_defer_event *e = (pa_defer_event*) source;
+
+    g_assert(e);
+    g_assert(!e->dead);
+
+    /* The ready time stays where it is, so we are called again on the
+     * next iteration until disabled */
+    e->callback(&e->mainloop->api, e, e->userdata);
+
+    return TRUE;
+}
+
+static GSourceFuncs defer_source_funcs = {
+    NULL,
+    NULL,
+    defer_dispatch_func,
+    NULL,
+    NULL,
+    NULL
+};
+
 static pa_defer_event* glib_defer_new(
         pa_mainloop_api*m,
         pa_defer_event_cb_t cb,
@@ -374,18 +427,20 @@ static pa_defer_event* glib_defer_new(
 
     g = m->userdata;
 
-    e = pa_xnew(pa_defer_event, 1);
+    e = (pa_defer_event*) g_source_new(&defer_source_funcs, sizeof(pa_defer_event));
     e->mainloop = g;
     e->dead = 0;
 
-    e->enabled = 1;
-    g->n_enabled_defer_events++;
+    g_source_set_ready_time(&e->source, 0);
 
     e->callback = cb;
     e->userdata = userdata;
     e->destroy_callback = NULL;
 
     PA_LLIST_PREPEND(pa_defer_event, g->defer_events, e);
+
+    g_source_add_child_source(&g->source, &e->source);
+
     return e;
 }
 
@@ -393,13 +448,7 @@ static void glib_defer_enable(pa_defer_event *e, int b) {
     g_assert(e);
     g_assert(!e->dead);
 
-    if (e->enabled && !b) {
-        g_assert(e->mainloop->n_enabled_defer_events > 0);
-        e->mainloop->n_enabled_defer_events--;
-    } else if (!e->enabled && b)
-        e->mainloop->n_enabled_defer_events++;
-
-    e->enabled = b;
+    g_source_set_ready_time(&e->source, b ? 0 : -1);
 }
 
 static void glib_defer_free(pa_defer_event *e) {
@@ -409,10 +458,7 @@ static void glib_defer_free(pa_defer_event *e) {
     e->dead = 1;
     e->mainloop->defer_events_please_scan++;
 
-    if (e->enabled) {
-        g_assert(e->mainloop->n_enabled_defer_events > 0);
-        e->mainloop->n_enabled_defer_events--;
-    }
+    g_source_remove_child_source(&e->mainloop->source, &e->source);
 }
 
 static void glib_defer_set_destroy(pa_defer_event *e, pa_defer_event_destroy_cb_t cb) {
@@ -431,31 +477,6 @@ static void glib_quit(pa_mainloop_api*a, int retval) {
     /* NOOP */
 }
 
-static pa_time_event* find_next_time_event(pa_glib_mainloop *g) {
-    pa_time_event *t, *n = NULL;
-    g_assert(g);
-
-    if (g->cached_next_time_event)
-        return g->cached_next_time_event;
-
-    for (t = g->time_events; t; t = t->next) {
-
-        if (t->dead || !t->enabled)
-            continue;
-
-        if (!n || pa_timeval_cmp(&t->timeval, &n->timeval) < 0) {
-            n = t;
-
-            /* Shortcut for tv = { 0, 0 } */
-            if (n->timeval.tv_sec <= 0)
-                break;
-        }
-    }
-
-    g->cached_next_time_event = n;
-    return n;
-}
-
 static void scan_dead(pa_glib_mainloop *g) {
     g_assert(g);
 
@@ -469,6 +490,8 @@ static void scan_dead(pa_glib_mainloop *g) {
         cleanup_defer_events(g, 0);
 }
 
+/* The main loop's own source never fires, the events do */
+
 static gboolean prepare_func(GSource *source, gint *timeout) {
     pa_glib_mainloop *g = (pa_glib_mainloop*) source;
 
@@ -477,116 +500,16 @@ static gboolean prepare_func(GSource *source, gint *timeout) {
 
     scan_dead(g);
 
-    if (g->n_enabled_defer_events) {
-        *timeout = 0;
-        return TRUE;
-    } else if (g->n_enabled_time_events) {
-        pa_time_event *t;
-        GTimeVal now;
-        struct timeval tvnow;
-        pa_usec_t usec;
-
-        t = find_next_time_event(g);
-        g_assert(t);
-
-        g_get_current_time(&now);
-        tvnow.tv_sec = now.tv_sec;
-        tvnow.tv_usec = now.tv_usec;
-
-        if (pa_timeval_cmp(&t->timeval, &tvnow) <= 0) {
-            *timeout = 0;
-            return TRUE;
-        }
-        usec = pa_timeval_diff(&t->timeval, &tvnow);
-        *timeout = (gint) (usec / 1000);
-    } else
-        *timeout = -1;
-
+    *timeout = -1;
     return FALSE;
 }
-static gboolean check_func(GSource *source) {
-    pa_glib_mainloop *g = (pa_glib_mainloop*) source;
-    pa_io_event *e;
-
-    g_assert(g);
-
-    if (g->n_enabled_defer_events)
-        return TRUE;
-    else if (g->n_enabled_time_events) {
-        pa_time_event *t;
-        GTimeVal now;
-        struct timeval tvnow;
-
-        t = find_next_time_event(g);
-        g_assert(t);
-
-        g_get_current_time(&now);
-        tvnow.tv_sec = now.tv_sec;
-        tvnow.tv_usec = now.tv_usec;
-
-        if (pa_timeval_cmp(&t->timeval, &tvnow) <= 0)
-            return TRUE;
-    }
-
-    for (e = g->io_events; e; e = e->next)
-        if (!e->dead && e->poll_fd.revents != 0)
-            return TRUE;
 
+static gboolean check_func(GSource *source) {
     return FALSE;
 }
 
 static gboolean dispatch_func(GSource *source, GSourceFunc callback, gpointer userdata) {
-    pa_glib_mainloop *g = (pa_glib_mainloop*) source;
-    pa_io_event *e;
-
-    g_assert(g);
-
-    if (g->n_enabled_defer_events) {
-        pa_defer_event *d;
-
-        for (d = g->defer_events; d; d = d->next) {
-            if (d->dead || !d->enabled)
-                continue;
-
-            break;
-        }
-
-        g_assert(d);
-
-        d->callback(&g->api, d, d->userdata);
-        return TRUE;
-    }
-
-    if (g->n_enabled_time_events) {
-        GTimeVal now;
-        struct timeval tvnow;
-        pa_time_event *t;
-
-        t = find_next_time_event(g);
-        g_assert(t);
-
-        g_get_current_time(&now);
-        tvnow.tv_sec = now.tv_sec;
-        tvnow.tv_usec = now.tv_usec;
-
-        if (pa_timeval_cmp(&t->timeval, &tvnow) <= 0) {
-
-            /* Disable time event */
-            glib_time_restart(t, NULL);
-
-            t->callback(&g->api, t, &t->timeval, t->userdata);
-            return TRUE;
-        }
-    }
-
-    for (e = g->io_events; e; e = e->next)
-        if (!e->dead && e->poll_fd.revents != 0) {
-            e->callback(&g->api, e, e->poll_fd.fd, map_flags_from_glib(e->poll_fd.revents), e->userdata);
-            e->poll_fd.revents = 0;
-            return TRUE;
-        }
-
-    return FALSE;
+    return TRUE;
 }
 
 static const pa_mainloop_api vtable = {
@@ -632,11 +555,8 @@ pa_glib_mainloop *pa_glib_mainloop_new(GMainContext *c) {
     PA_LLIST_HEAD_INIT(pa_time_event, g->time_events);
     PA_LLIST_HEAD_INIT(pa_defer_event, g->defer_events);
 
-    g->n_enabled_defer_events = g->n_enabled_time_events = 0;
     g->io_events_please_scan = g->time_events_please_scan = g->defer_events_please_scan = 0;
 
-    g->cached_next_time_event = NULL;
-
     g_source_attach(&g->source, g->context);
     g_source_set_can_recurse(&g->source, FALSE);
 
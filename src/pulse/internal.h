@@ -26,6 +26,7 @@
 #include <pulse/stream.h>
 #include <pulse/operation.h>
 #include <pulse/subscribe.h>
+#include <pulse/introspect.h>
 #include <pulse/ext-device-manager.h>
 #include <pulse/ext-device-restore.h>
 #include <pulse/ext-stream-restore.h>
@@ -38,6 +39,7 @@
 #include <pulsecore/strlist.h>
 #include <pulsecore/mcalign.h>
 #include <pulsecore/memblockq.h>
+#include <pulsecore/shm.h>
 #include <pulsecore/hashmap.h>
 #include <pulsecore/refcnt.h>
 #include <pulsecore/time-smoother.h>
@@ -87,6 +89,17 @@ struct pa_context {
     void *state_userdata;
     pa_context_subscribe_cb_t subscribe_callback;
     void *subscribe_userdata;
+
+    /* The server is subscribed to the union of what the application
+     * and the introspection cache asked for */
+    pa_subscription_mask_t subscription_mask;
+    pa_usec_t subscription_interval;
+    pa_introspect_cache *introspect_cache;
+    pa_subscription_mask_t cache_subscription_mask;
+
+    /* Per subscription facility, index -> last known proplist */
+    pa_hashmap *proplist_mirrors[PA_SUBSCRIPTION_EVENT_FACILITY_MASK+1];
+
     pa_context_event_cb_t event_callback;
     void *event_userdata;
 
@@ -100,6 +113,9 @@ struct pa_context {
     bool do_autospawn:1;
     bool use_rtclock:1;
     bool filter_added:1;
+    /* Whether we send the client name right after the authentication,
+     * instead of waiting for the reply to it first */
+    bool pipeline_setup:1;
     pa_spawn_api spawn_api;
 
     pa_mem_type_t shm_type;
@@ -186,12 +202,19 @@ struct pa_stream {
     void *peek_data;
     pa_memblockq *record_memblockq;
 
+    /* upload, if the sample is collected in a memfd */
+    pa_shm *upload_shm;
+    size_t upload_index;
+
     /* Store latest latency info */
     pa_timing_info timing_info;
 
     /* Use to make sure that time advances monotonically */
     pa_usec_t previous_time;
 
+    /* Timestamp of the timing last taken from the srbchannel shm */
+    pa_usec_t shm_timing_timestamp;
+
     /* time updates with tags older than these are invalid */
     uint32_t write_index_not_before;
     uint32_t read_index_not_before;
@@ -248,6 +271,7 @@ struct pa_operation {
     pa_operation_notify_cb_t state_callback;
 
     void *private; /* some operations might need this */
+    pa_free_cb_t private_free; /* called on private when the operation is freed */
 };
 
 void pa_command_request(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
@@ -277,6 +301,10 @@ pa_operation* pa_context_send_simple_command(pa_context *c, uint32_t command, vo
 
 void pa_stream_set_state(pa_stream *s, pa_stream_state_t st);
 
+void pa_introspect_cache_handle_event(pa_introspect_cache *cache, pa_subscription_event_type_t e, uint32_t idx);
+void pa_context_forget_proplists(pa_context *c, unsigned facility, uint32_t idx);
+pa_operation* pa_context_update_subscription(pa_context *c, pa_context_success_cb_t cb, void *userdata);
+
 pa_tagstruct *pa_tagstruct_command(pa_context *c, uint32_t command, uint32_t *tag);
 
 #define PA_CHECK_VALIDITY(context, expression, error)         \
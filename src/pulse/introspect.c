@@ -59,6 +59,22 @@ static void context_stat_callback(pa_pdispatch *pd, uint32_t command, uint32_t t
                pa_tagstruct_getu32(t, &i.memblock_allocated) < 0 ||
                pa_tagstruct_getu32(t, &i.memblock_allocated_size) < 0 ||
                pa_tagstruct_getu32(t, &i.scache_size) < 0 ||
+               (o->context->version >= 33 &&
+                (pa_tagstruct_getu32(t, &i.memblock_total_max) < 0 ||
+                 pa_tagstruct_getu32(t, &i.memblock_total_size_max) < 0 ||
+                 pa_tagstruct_getu32(t, &i.memblock_pool_full) < 0 ||
+                 pa_tagstruct_getu32(t, &i.memblock_too_large) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_imported) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_imported_size) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_imported_max) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_imported_size_max) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_exported) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_exported_size) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_exported_max) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_exported_size_max) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_imported_failed) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_exported_failed) < 0 ||
+                 pa_tagstruct_getu32(t, &i.client_exported_copied) < 0)) ||
                !pa_tagstruct_eof(t)) {
         pa_context_fail(o->context, PA_ERR_PROTOCOL);
         goto finish;
@@ -131,164 +147,298 @@ pa_operation* pa_context_get_server_info(pa_context *c, pa_server_info_cb_t cb,
     return pa_context_send_simple_command(c, PA_COMMAND_GET_SERVER_INFO, context_get_server_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
-/*** Sink Info ***/
+/*** Proplist tracking ***/
 
-static void context_get_sink_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
-    pa_operation *o = userdata;
-    int eol = 1;
-    pa_sink_info i;
-    uint32_t j;
+/* Since v33 the proplists in sink, source, sink input, source output,
+ * client and card info replies are versioned, and the server sends only
+ * the keys changed since the version a request says we know. We keep the
+ * last proplist of each object for the facilities we are subscribed to,
+ * since only then we learn when objects go away. */
 
-    pa_assert(pd);
-    pa_assert(o);
-    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+struct proplist_mirror {
+    uint32_t version;
+    pa_proplist *proplist;
+};
 
-    /* For safety in case someone use fail: outside the while loop below */
-    pa_zero(i);
+static void proplist_mirror_free(struct proplist_mirror *m) {
+    pa_proplist_free(m->proplist);
+    pa_xfree(m);
+}
 
-    if (!o->context)
-        goto finish;
+static bool proplist_tracked(pa_context *c, unsigned facility) {
+    return !!((c->subscription_mask | c->cache_subscription_mask) & (1U << facility));
+}
 
-    if (command != PA_COMMAND_REPLY) {
-        if (pa_context_handle_error(o->context, command, t, false) < 0)
-            goto finish;
+void pa_context_forget_proplists(pa_context *c, unsigned facility, uint32_t idx) {
+    pa_assert(c);
+    pa_assert(facility <= PA_SUBSCRIPTION_EVENT_FACILITY_MASK);
 
-        eol = -1;
-    } else {
+    if (!c->proplist_mirrors[facility])
+        return;
 
-        while (!pa_tagstruct_eof(t)) {
-            bool mute;
-            uint32_t flags;
-            uint32_t state;
-            const char *ap = NULL;
+    if (idx != PA_INVALID_INDEX) {
+        pa_hashmap_remove_and_free(c->proplist_mirrors[facility], PA_UINT32_TO_PTR(idx));
+        return;
+    }
 
-            pa_zero(i);
-            i.proplist = pa_proplist_new();
-            i.base_volume = PA_VOLUME_NORM;
-            i.n_volume_steps = PA_VOLUME_NORM+1;
-            mute = false;
-            state = PA_SINK_INVALID_STATE;
-            i.card = PA_INVALID_INDEX;
+    pa_hashmap_free(c->proplist_mirrors[facility]);
+    c->proplist_mirrors[facility] = NULL;
+}
 
-            if (pa_tagstruct_getu32(t, &i.index) < 0 ||
-                pa_tagstruct_gets(t, &i.name) < 0 ||
-                pa_tagstruct_gets(t, &i.description) < 0 ||
-                pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
-                pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
-                pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
-                pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
-                pa_tagstruct_get_boolean(t, &mute) < 0 ||
-                pa_tagstruct_getu32(t, &i.monitor_source) < 0 ||
-                pa_tagstruct_gets(t, &i.monitor_source_name) < 0 ||
-                pa_tagstruct_get_usec(t, &i.latency) < 0 ||
-                pa_tagstruct_gets(t, &i.driver) < 0 ||
-                pa_tagstruct_getu32(t, &flags) < 0 ||
-                (o->context->version >= 13 &&
-                 (pa_tagstruct_get_proplist(t, i.proplist) < 0 ||
-                  pa_tagstruct_get_usec(t, &i.configured_latency) < 0)) ||
-                (o->context->version >= 15 &&
-                 (pa_tagstruct_get_volume(t, &i.base_volume) < 0 ||
-                  pa_tagstruct_getu32(t, &state) < 0 ||
-                  pa_tagstruct_getu32(t, &i.n_volume_steps) < 0 ||
-                  pa_tagstruct_getu32(t, &i.card) < 0)) ||
-                (o->context->version >= 16 &&
-                 (pa_tagstruct_getu32(t, &i.n_ports)))) {
+static uint32_t known_proplist_version(pa_context *c, unsigned facility, uint32_t idx) {
+    struct proplist_mirror *m;
 
-                goto fail;
-            }
+    if (!c->proplist_mirrors[facility] || idx == PA_INVALID_INDEX)
+        return 0;
 
-            if (o->context->version >= 16) {
-                if (i.n_ports > 0) {
-                    i.ports = pa_xnew(pa_sink_port_info*, i.n_ports+1);
-                    i.ports[0] = pa_xnew(pa_sink_port_info, i.n_ports);
+    m = pa_hashmap_get(c->proplist_mirrors[facility], PA_UINT32_TO_PTR(idx));
+    return m ? m->version : 0;
+}
 
-                    for (j = 0; j < i.n_ports; j++) {
-                        i.ports[j] = &i.ports[0][j];
+/* Appends what a GET_*_INFO request needs to get the tracked format */
+static void put_known_proplist(pa_context *c, pa_tagstruct *t, unsigned facility, uint32_t idx) {
+    if (c->version >= 33)
+        pa_tagstruct_putu32(t, known_proplist_version(c, facility, idx));
+}
 
-                        if (pa_tagstruct_gets(t, &i.ports[j]->name) < 0 ||
-                            pa_tagstruct_gets(t, &i.ports[j]->description) < 0 ||
-                            pa_tagstruct_getu32(t, &i.ports[j]->priority) < 0) {
+/* Appends what a GET_*_INFO_LIST request needs to get the tracked format */
+static void put_known_proplists(pa_context *c, pa_tagstruct *t, unsigned facility) {
+    struct proplist_mirror *m;
+    const void *idx;
+    void *state;
 
-                            goto fail;
-                        }
+    if (c->version < 33)
+        return;
 
-                        i.ports[j]->available = PA_PORT_AVAILABLE_UNKNOWN;
-                        if (o->context->version >= 24) {
-                            uint32_t av;
-                            if (pa_tagstruct_getu32(t, &av) < 0 || av > PA_PORT_AVAILABLE_YES)
-                                goto fail;
-                            i.ports[j]->available = av;
-                        }
-                    }
+    if (!c->proplist_mirrors[facility]) {
+        pa_tagstruct_putu32(t, 0);
+        return;
+    }
 
-                    i.ports[j] = NULL;
-                }
+    pa_tagstruct_putu32(t, pa_hashmap_size(c->proplist_mirrors[facility]));
+
+    PA_HASHMAP_FOREACH_KV(idx, m, c->proplist_mirrors[facility], state) {
+        pa_tagstruct_putu32(t, PA_PTR_TO_UINT32(idx));
+        pa_tagstruct_putu32(t, m->version);
+    }
+}
 
-                if (pa_tagstruct_gets(t, &ap) < 0)
-                    goto fail;
+/* Reads a proplist, in the tracked format since v33, and stores the
+ * complete list in p */
+static int get_proplist(pa_context *c, pa_tagstruct *t, unsigned facility, uint32_t idx, pa_proplist *p) {
+    struct proplist_mirror *m = NULL;
+    uint32_t version, base;
+    bool apply;
 
-                if (ap) {
-                    for (j = 0; j < i.n_ports; j++)
-                        if (pa_streq(i.ports[j]->name, ap)) {
-                            i.active_port = i.ports[j];
-                            break;
-                        }
-                }
-            }
+    if (c->version < 33)
+        return pa_tagstruct_get_proplist(t, p);
+
+    if (pa_tagstruct_getu32(t, &version) < 0 ||
+        pa_tagstruct_getu32(t, &base) < 0 ||
+        pa_tagstruct_get_proplist(t, p) < 0)
+        return -1;
+
+    if (c->proplist_mirrors[facility])
+        m = pa_hashmap_get(c->proplist_mirrors[facility], PA_UINT32_TO_PTR(idx));
+
+    /* A delta against the version we know, or an older one, brings us
+     * up to date */
+    apply = base > 0 && m && m->version >= base && m->version < version;
+
+    if (base > 0) {
+        const char *key;
+
+        do {
+            if (pa_tagstruct_gets(t, &key) < 0)
+                return -1;
+
+            if (key && apply)
+                pa_proplist_unset(m->proplist, key);
+        } while (key);
+    }
+
+    if (version == 0)
+        return 0;
+
+    if (m && m->version >= version) {
+        /* We already know this version, or a newer one */
+        pa_proplist_update(p, PA_UPDATE_SET, m->proplist);
+        return 0;
+    }
+
+    if (apply) {
+        pa_proplist_update(m->proplist, PA_UPDATE_REPLACE, p);
+        pa_proplist_update(p, PA_UPDATE_SET, m->proplist);
+        m->version = version;
+        return 0;
+    }
+
+    if (base > 0) {
+        /* We dropped what the delta is based on in the meantime, which
+         * only happens when the object went away or we unsubscribed */
+        pa_log_debug("Got a proplist delta for an unknown version, passing on the changed keys only.");
+        return 0;
+    }
+
+    if (!proplist_tracked(c, facility))
+        return 0;
+
+    if (!m) {
+        if (!c->proplist_mirrors[facility])
+            c->proplist_mirrors[facility] = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                                                NULL, (pa_free_cb_t) proplist_mirror_free);
 
-            if (o->context->version >= 21) {
-                uint8_t n_formats;
-                if (pa_tagstruct_getu8(t, &n_formats) < 0 || n_formats < 1)
-                    goto fail;
+        m = pa_xnew(struct proplist_mirror, 1);
+        m->proplist = pa_proplist_new();
+        pa_hashmap_put(c->proplist_mirrors[facility], PA_UINT32_TO_PTR(idx), m);
+    }
+
+    pa_proplist_update(m->proplist, PA_UPDATE_SET, p);
+    m->version = version;
+
+    return 0;
+}
+
+static pa_operation* send_info_list_command(pa_context *c, uint32_t command, unsigned facility, pa_pdispatch_cb_t internal_cb, pa_operation_cb_t cb, void *userdata) {
+    pa_tagstruct *t;
+    pa_operation *o;
+    uint32_t tag;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+
+    o = pa_operation_new(c, NULL, cb, userdata);
+
+    t = pa_tagstruct_command(c, command, &tag);
+    put_known_proplists(c, t, facility);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, internal_cb, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
+/*** Sink Info ***/
+
+static int parse_sink_info(pa_context *c, pa_tagstruct *t, pa_sink_info_cb_t cb, void *userdata) {
+    pa_sink_info i;
+    bool mute;
+    uint32_t flags;
+    uint32_t state;
+    const char *ap = NULL;
+    uint32_t j;
+    int r = -1;
+
+    pa_zero(i);
+    i.proplist = pa_proplist_new();
+    i.base_volume = PA_VOLUME_NORM;
+    i.n_volume_steps = PA_VOLUME_NORM+1;
+    mute = false;
+    state = PA_SINK_INVALID_STATE;
+    i.card = PA_INVALID_INDEX;
+
+    if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+        pa_tagstruct_gets(t, &i.name) < 0 ||
+        pa_tagstruct_gets(t, &i.description) < 0 ||
+        pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
+        pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
+        pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
+        pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
+        pa_tagstruct_get_boolean(t, &mute) < 0 ||
+        pa_tagstruct_getu32(t, &i.monitor_source) < 0 ||
+        pa_tagstruct_gets(t, &i.monitor_source_name) < 0 ||
+        pa_tagstruct_get_usec(t, &i.latency) < 0 ||
+        pa_tagstruct_gets(t, &i.driver) < 0 ||
+        pa_tagstruct_getu32(t, &flags) < 0 ||
+        (c->version >= 13 &&
+         (get_proplist(c, t, PA_SUBSCRIPTION_EVENT_SINK, i.index, i.proplist) < 0 ||
+          pa_tagstruct_get_usec(t, &i.configured_latency) < 0)) ||
+        (c->version >= 15 &&
+         (pa_tagstruct_get_volume(t, &i.base_volume) < 0 ||
+          pa_tagstruct_getu32(t, &state) < 0 ||
+          pa_tagstruct_getu32(t, &i.n_volume_steps) < 0 ||
+          pa_tagstruct_getu32(t, &i.card) < 0)) ||
+        (c->version >= 16 &&
+         (pa_tagstruct_getu32(t, &i.n_ports)))) {
+
+        goto finish;
+    }
 
-                i.formats = pa_xnew0(pa_format_info*, n_formats);
+    if (c->version >= 16) {
+        if (i.n_ports > 0) {
+            i.ports = pa_xnew(pa_sink_port_info*, i.n_ports+1);
+            i.ports[0] = pa_xnew(pa_sink_port_info, i.n_ports);
 
-                for (j = 0; j < n_formats; j++) {
-                    i.n_formats++;
-                    i.formats[j] = pa_format_info_new();
+            for (j = 0; j < i.n_ports; j++) {
+                i.ports[j] = &i.ports[0][j];
 
-                    if (pa_tagstruct_get_format_info(t, i.formats[j]) < 0)
-                        goto fail;
+                if (pa_tagstruct_gets(t, &i.ports[j]->name) < 0 ||
+                    pa_tagstruct_gets(t, &i.ports[j]->description) < 0 ||
+                    pa_tagstruct_getu32(t, &i.ports[j]->priority) < 0) {
+
+                    goto finish;
+                }
+
+                i.ports[j]->available = PA_PORT_AVAILABLE_UNKNOWN;
+                if (c->version >= 24) {
+                    uint32_t av;
+                    if (pa_tagstruct_getu32(t, &av) < 0 || av > PA_PORT_AVAILABLE_YES)
+                        goto finish;
+                    i.ports[j]->available = av;
                 }
             }
 
-            i.mute = (int) mute;
-            i.flags = (pa_sink_flags_t) flags;
-            i.state = (pa_sink_state_t) state;
+            i.ports[j] = NULL;
+        }
 
-            if (o->callback) {
-                pa_sink_info_cb_t cb = (pa_sink_info_cb_t) o->callback;
-                cb(o->context, &i, 0, o->userdata);
-            }
+        if (pa_tagstruct_gets(t, &ap) < 0)
+            goto finish;
 
-            if (i.formats) {
-                for (j = 0; j < i.n_formats; j++)
-                    pa_format_info_free(i.formats[j]);
-                pa_xfree(i.formats);
-            }
-            if (i.ports) {
-                pa_xfree(i.ports[0]);
-                pa_xfree(i.ports);
-            }
-            pa_proplist_free(i.proplist);
+        if (ap) {
+            for (j = 0; j < i.n_ports; j++)
+                if (pa_streq(i.ports[j]->name, ap)) {
+                    i.active_port = i.ports[j];
+                    break;
+                }
         }
     }
 
-    if (o->callback) {
-        pa_sink_info_cb_t cb = (pa_sink_info_cb_t) o->callback;
-        cb(o->context, NULL, eol, o->userdata);
+    if (c->version >= 21) {
+        uint8_t n_formats;
+        if (pa_tagstruct_getu8(t, &n_formats) < 0 || n_formats < 1)
+            goto finish;
+
+        i.formats = pa_xnew0(pa_format_info*, n_formats);
+
+        for (j = 0; j < n_formats; j++) {
+            i.n_formats++;
+            i.formats[j] = pa_format_info_new();
+
+            if (pa_tagstruct_get_format_info(t, i.formats[j]) < 0)
+                goto finish;
+        }
     }
 
-finish:
-    pa_operation_done(o);
-    pa_operation_unref(o);
-    return;
+    if (c->version >= 33 &&
+        (pa_tagstruct_getu32(t, &i.n_underruns) < 0 ||
+         pa_tagstruct_getu64(t, &i.underrun_bytes) < 0 ||
+         pa_tagstruct_getu32(t, &i.n_rewinds) < 0 ||
+         pa_tagstruct_getu64(t, &i.rewind_bytes) < 0 ||
+         pa_tagstruct_get_usec(t, &i.max_render_usec) < 0))
+        goto finish;
 
-fail:
-    pa_assert(i.proplist);
+    i.mute = (int) mute;
+    i.flags = (pa_sink_flags_t) flags;
+    i.state = (pa_sink_state_t) state;
 
-    pa_context_fail(o->context, PA_ERR_PROTOCOL);
+    if (cb)
+        cb(c, &i, 0, userdata);
 
+    r = 0;
+
+finish:
     if (i.formats) {
         for (j = 0; j < i.n_formats; j++)
             pa_format_info_free(i.formats[j]);
@@ -300,11 +450,49 @@ fail:
     }
     pa_proplist_free(i.proplist);
 
+    return r;
+}
+
+static void context_get_sink_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    int eol = 1;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
+
+        eol = -1;
+    } else {
+
+        while (!pa_tagstruct_eof(t))
+            if (parse_sink_info(o->context, t, (pa_sink_info_cb_t) o->callback, o->userdata) < 0)
+                goto fail;
+    }
+
+    if (o->callback) {
+        pa_sink_info_cb_t cb = (pa_sink_info_cb_t) o->callback;
+        cb(o->context, NULL, eol, o->userdata);
+    }
+
+finish:
+    pa_operation_done(o);
+    pa_operation_unref(o);
+    return;
+
+fail:
+    pa_context_fail(o->context, PA_ERR_PROTOCOL);
     goto finish;
 }
 
 pa_operation* pa_context_get_sink_info_list(pa_context *c, pa_sink_info_cb_t cb, void *userdata) {
-    return pa_context_send_simple_command(c, PA_COMMAND_GET_SINK_INFO_LIST, context_get_sink_info_callback, (pa_operation_cb_t) cb, userdata);
+    return send_info_list_command(c, PA_COMMAND_GET_SINK_INFO_LIST, PA_SUBSCRIPTION_EVENT_SINK, context_get_sink_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
 pa_operation* pa_context_get_sink_info_by_index(pa_context *c, uint32_t idx, pa_sink_info_cb_t cb, void *userdata) {
@@ -324,6 +512,7 @@ pa_operation* pa_context_get_sink_info_by_index(pa_context *c, uint32_t idx, pa_
     t = pa_tagstruct_command(c, PA_COMMAND_GET_SINK_INFO, &tag);
     pa_tagstruct_putu32(t, idx);
     pa_tagstruct_puts(t, NULL);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_SINK, idx);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_sink_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -348,6 +537,7 @@ pa_operation* pa_context_get_sink_info_by_name(pa_context *c, const char *name,
     t = pa_tagstruct_command(c, PA_COMMAND_GET_SINK_INFO, &tag);
     pa_tagstruct_putu32(t, PA_INVALID_INDEX);
     pa_tagstruct_puts(t, name);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_SINK, PA_INVALID_INDEX);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_sink_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -406,145 +596,150 @@ pa_operation* pa_context_set_sink_port_by_name(pa_context *c, const char *name,
 
 /*** Source info ***/
 
-static void context_get_source_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
-    pa_operation *o = userdata;
-    int eol = 1;
+static int parse_source_info(pa_context *c, pa_tagstruct *t, pa_source_info_cb_t cb, void *userdata) {
     pa_source_info i;
+    bool mute;
+    uint32_t flags;
+    uint32_t state;
+    const char *ap;
     uint32_t j;
+    int r = -1;
 
-    pa_assert(pd);
-    pa_assert(o);
-    pa_assert(PA_REFCNT_VALUE(o) >= 1);
-
-    /* For safety in case someone use fail: outside the while loop below */
     pa_zero(i);
+    i.proplist = pa_proplist_new();
+    i.base_volume = PA_VOLUME_NORM;
+    i.n_volume_steps = PA_VOLUME_NORM+1;
+    mute = false;
+    state = PA_SOURCE_INVALID_STATE;
+    i.card = PA_INVALID_INDEX;
+
+    if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+        pa_tagstruct_gets(t, &i.name) < 0 ||
+        pa_tagstruct_gets(t, &i.description) < 0 ||
+        pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
+        pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
+        pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
+        pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
+        pa_tagstruct_get_boolean(t, &mute) < 0 ||
+        pa_tagstruct_getu32(t, &i.monitor_of_sink) < 0 ||
+        pa_tagstruct_gets(t, &i.monitor_of_sink_name) < 0 ||
+        pa_tagstruct_get_usec(t, &i.latency) < 0 ||
+        pa_tagstruct_gets(t, &i.driver) < 0 ||
+        pa_tagstruct_getu32(t, &flags) < 0 ||
+        (c->version >= 13 &&
+         (get_proplist(c, t, PA_SUBSCRIPTION_EVENT_SOURCE, i.index, i.proplist) < 0 ||
+          pa_tagstruct_get_usec(t, &i.configured_latency) < 0)) ||
+        (c->version >= 15 &&
+         (pa_tagstruct_get_volume(t, &i.base_volume) < 0 ||
+          pa_tagstruct_getu32(t, &state) < 0 ||
+          pa_tagstruct_getu32(t, &i.n_volume_steps) < 0 ||
+          pa_tagstruct_getu32(t, &i.card) < 0)) ||
+        (c->version >= 16 &&
+         (pa_tagstruct_getu32(t, &i.n_ports)))) {
 
-    if (!o->context)
         goto finish;
+    }
 
-    if (command != PA_COMMAND_REPLY) {
-        if (pa_context_handle_error(o->context, command, t, false) < 0)
-            goto finish;
-
-        eol = -1;
-    } else {
+    if (c->version >= 16) {
+        if (i.n_ports > 0) {
+            i.ports = pa_xnew(pa_source_port_info*, i.n_ports+1);
+            i.ports[0] = pa_xnew(pa_source_port_info, i.n_ports);
 
-        while (!pa_tagstruct_eof(t)) {
-            bool mute;
-            uint32_t flags;
-            uint32_t state;
-            const char *ap;
+            for (j = 0; j < i.n_ports; j++) {
+                i.ports[j] = &i.ports[0][j];
 
-            pa_zero(i);
-            i.proplist = pa_proplist_new();
-            i.base_volume = PA_VOLUME_NORM;
-            i.n_volume_steps = PA_VOLUME_NORM+1;
-            mute = false;
-            state = PA_SOURCE_INVALID_STATE;
-            i.card = PA_INVALID_INDEX;
+                if (pa_tagstruct_gets(t, &i.ports[j]->name) < 0 ||
+                    pa_tagstruct_gets(t, &i.ports[j]->description) < 0 ||
+                    pa_tagstruct_getu32(t, &i.ports[j]->priority) < 0) {
 
-            if (pa_tagstruct_getu32(t, &i.index) < 0 ||
-                pa_tagstruct_gets(t, &i.name) < 0 ||
-                pa_tagstruct_gets(t, &i.description) < 0 ||
-                pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
-                pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
-                pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
-                pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
-                pa_tagstruct_get_boolean(t, &mute) < 0 ||
-                pa_tagstruct_getu32(t, &i.monitor_of_sink) < 0 ||
-                pa_tagstruct_gets(t, &i.monitor_of_sink_name) < 0 ||
-                pa_tagstruct_get_usec(t, &i.latency) < 0 ||
-                pa_tagstruct_gets(t, &i.driver) < 0 ||
-                pa_tagstruct_getu32(t, &flags) < 0 ||
-                (o->context->version >= 13 &&
-                 (pa_tagstruct_get_proplist(t, i.proplist) < 0 ||
-                  pa_tagstruct_get_usec(t, &i.configured_latency) < 0)) ||
-                (o->context->version >= 15 &&
-                 (pa_tagstruct_get_volume(t, &i.base_volume) < 0 ||
-                  pa_tagstruct_getu32(t, &state) < 0 ||
-                  pa_tagstruct_getu32(t, &i.n_volume_steps) < 0 ||
-                  pa_tagstruct_getu32(t, &i.card) < 0)) ||
-                (o->context->version >= 16 &&
-                 (pa_tagstruct_getu32(t, &i.n_ports)))) {
+                    goto finish;
+                }
 
-                goto fail;
+                i.ports[j]->available = PA_PORT_AVAILABLE_UNKNOWN;
+                if (c->version >= 24) {
+                    uint32_t av;
+                    if (pa_tagstruct_getu32(t, &av) < 0 || av > PA_PORT_AVAILABLE_YES)
+                        goto finish;
+                    i.ports[j]->available = av;
+                }
             }
 
-            if (o->context->version >= 16) {
-                if (i.n_ports > 0) {
-                    i.ports = pa_xnew(pa_source_port_info*, i.n_ports+1);
-                    i.ports[0] = pa_xnew(pa_source_port_info, i.n_ports);
+            i.ports[j] = NULL;
+        }
+
+        if (pa_tagstruct_gets(t, &ap) < 0)
+            goto finish;
+
+        if (ap) {
+            for (j = 0; j < i.n_ports; j++)
+                if (pa_streq(i.ports[j]->name, ap)) {
+                    i.active_port = i.ports[j];
+                    break;
+                }
+        }
+    }
+
+    if (c->version >= 22) {
+        uint8_t n_formats;
+        if (pa_tagstruct_getu8(t, &n_formats) < 0 || n_formats < 1)
+            goto finish;
 
-                    for (j = 0; j < i.n_ports; j++) {
-                        i.ports[j] = &i.ports[0][j];
+        i.formats = pa_xnew0(pa_format_info*, n_formats);
 
-                        if (pa_tagstruct_gets(t, &i.ports[j]->name) < 0 ||
-                            pa_tagstruct_gets(t, &i.ports[j]->description) < 0 ||
-                            pa_tagstruct_getu32(t, &i.ports[j]->priority) < 0) {
+        for (j = 0; j < n_formats; j++) {
+            i.n_formats++;
+            i.formats[j] = pa_format_info_new();
 
-                            goto fail;
-                        }
+            if (pa_tagstruct_get_format_info(t, i.formats[j]) < 0)
+                goto finish;
+        }
+    }
 
-                        i.ports[j]->available = PA_PORT_AVAILABLE_UNKNOWN;
-                        if (o->context->version >= 24) {
-                            uint32_t av;
-                            if (pa_tagstruct_getu32(t, &av) < 0 || av > PA_PORT_AVAILABLE_YES)
-                                goto fail;
-                            i.ports[j]->available = av;
-                        }
-                    }
+    i.mute = (int) mute;
+    i.flags = (pa_source_flags_t) flags;
+    i.state = (pa_source_state_t) state;
 
-                    i.ports[j] = NULL;
-                }
+    if (cb)
+        cb(c, &i, 0, userdata);
 
-                if (pa_tagstruct_gets(t, &ap) < 0)
-                    goto fail;
+    r = 0;
 
-                if (ap) {
-                    for (j = 0; j < i.n_ports; j++)
-                        if (pa_streq(i.ports[j]->name, ap)) {
-                            i.active_port = i.ports[j];
-                            break;
-                        }
-                }
-            }
+finish:
+    if (i.formats) {
+        for (j = 0; j < i.n_formats; j++)
+            pa_format_info_free(i.formats[j]);
+        pa_xfree(i.formats);
+    }
+    if (i.ports) {
+        pa_xfree(i.ports[0]);
+        pa_xfree(i.ports);
+    }
+    pa_proplist_free(i.proplist);
 
-            if (o->context->version >= 22) {
-                uint8_t n_formats;
-                if (pa_tagstruct_getu8(t, &n_formats) < 0 || n_formats < 1)
-                    goto fail;
+    return r;
+}
 
-                i.formats = pa_xnew0(pa_format_info*, n_formats);
+static void context_get_source_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    int eol = 1;
 
-                for (j = 0; j < n_formats; j++) {
-                    i.n_formats++;
-                    i.formats[j] = pa_format_info_new();
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
 
-                    if (pa_tagstruct_get_format_info(t, i.formats[j]) < 0)
-                        goto fail;
-                }
-            }
+    if (!o->context)
+        goto finish;
 
-            i.mute = (int) mute;
-            i.flags = (pa_source_flags_t) flags;
-            i.state = (pa_source_state_t) state;
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
 
-            if (o->callback) {
-                pa_source_info_cb_t cb = (pa_source_info_cb_t) o->callback;
-                cb(o->context, &i, 0, o->userdata);
-            }
+        eol = -1;
+    } else {
 
-            if (i.formats) {
-                for (j = 0; j < i.n_formats; j++)
-                    pa_format_info_free(i.formats[j]);
-                pa_xfree(i.formats);
-            }
-            if (i.ports) {
-                pa_xfree(i.ports[0]);
-                pa_xfree(i.ports);
-            }
-            pa_proplist_free(i.proplist);
-        }
+        while (!pa_tagstruct_eof(t))
+            if (parse_source_info(o->context, t, (pa_source_info_cb_t) o->callback, o->userdata) < 0)
+                goto fail;
     }
 
     if (o->callback) {
@@ -558,26 +753,12 @@ finish:
     return;
 
 fail:
-    pa_assert(i.proplist);
-
     pa_context_fail(o->context, PA_ERR_PROTOCOL);
-
-    if (i.formats) {
-        for (j = 0; j < i.n_formats; j++)
-            pa_format_info_free(i.formats[j]);
-        pa_xfree(i.formats);
-    }
-    if (i.ports) {
-        pa_xfree(i.ports[0]);
-        pa_xfree(i.ports);
-    }
-    pa_proplist_free(i.proplist);
-
     goto finish;
 }
 
 pa_operation* pa_context_get_source_info_list(pa_context *c, pa_source_info_cb_t cb, void *userdata) {
-    return pa_context_send_simple_command(c, PA_COMMAND_GET_SOURCE_INFO_LIST, context_get_source_info_callback, (pa_operation_cb_t) cb, userdata);
+    return send_info_list_command(c, PA_COMMAND_GET_SOURCE_INFO_LIST, PA_SUBSCRIPTION_EVENT_SOURCE, context_get_source_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
 pa_operation* pa_context_get_source_info_by_index(pa_context *c, uint32_t idx, pa_source_info_cb_t cb, void *userdata) {
@@ -597,6 +778,7 @@ pa_operation* pa_context_get_source_info_by_index(pa_context *c, uint32_t idx, p
     t = pa_tagstruct_command(c, PA_COMMAND_GET_SOURCE_INFO, &tag);
     pa_tagstruct_putu32(t, idx);
     pa_tagstruct_puts(t, NULL);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_SOURCE, idx);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_source_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -621,6 +803,7 @@ pa_operation* pa_context_get_source_info_by_name(pa_context *c, const char *name
     t = pa_tagstruct_command(c, PA_COMMAND_GET_SOURCE_INFO, &tag);
     pa_tagstruct_putu32(t, PA_INVALID_INDEX);
     pa_tagstruct_puts(t, name);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_SOURCE, PA_INVALID_INDEX);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_source_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -679,12 +862,39 @@ pa_operation* pa_context_set_source_port_by_name(pa_context *c, const char *name
 
 /*** Client info ***/
 
-static void context_get_client_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
-    pa_operation *o = userdata;
-    int eol = 1;
+static int parse_client_info(pa_context *c, pa_tagstruct *t, pa_client_info_cb_t cb, void *userdata) {
+    pa_client_info i;
+    int r = -1;
 
-    pa_assert(pd);
-    pa_assert(o);
+    pa_zero(i);
+    i.proplist = pa_proplist_new();
+
+    if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+        pa_tagstruct_gets(t, &i.name) < 0 ||
+        pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
+        pa_tagstruct_gets(t, &i.driver) < 0 ||
+        (c->version >= 13 && get_proplist(c, t, PA_SUBSCRIPTION_EVENT_CLIENT, i.index, i.proplist) < 0)) {
+
+        goto finish;
+    }
+
+    if (cb)
+        cb(c, &i, 0, userdata);
+
+    r = 0;
+
+finish:
+    pa_proplist_free(i.proplist);
+
+    return r;
+}
+
+static void context_get_client_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    int eol = 1;
+
+    pa_assert(pd);
+    pa_assert(o);
     pa_assert(PA_REFCNT_VALUE(o) >= 1);
 
     if (!o->context)
@@ -697,30 +907,11 @@ static void context_get_client_info_callback(pa_pdispatch *pd, uint32_t command,
         eol = -1;
     } else {
 
-        while (!pa_tagstruct_eof(t)) {
-            pa_client_info i;
-
-            pa_zero(i);
-            i.proplist = pa_proplist_new();
-
-            if (pa_tagstruct_getu32(t, &i.index) < 0 ||
-                pa_tagstruct_gets(t, &i.name) < 0 ||
-                pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
-                pa_tagstruct_gets(t, &i.driver) < 0 ||
-                (o->context->version >= 13 && pa_tagstruct_get_proplist(t, i.proplist) < 0)) {
-
+        while (!pa_tagstruct_eof(t))
+            if (parse_client_info(o->context, t, (pa_client_info_cb_t) o->callback, o->userdata) < 0) {
                 pa_context_fail(o->context, PA_ERR_PROTOCOL);
-                pa_proplist_free(i.proplist);
                 goto finish;
             }
-
-            if (o->callback) {
-                pa_client_info_cb_t cb = (pa_client_info_cb_t) o->callback;
-                cb(o->context, &i, 0, o->userdata);
-            }
-
-            pa_proplist_free(i.proplist);
-        }
     }
 
     if (o->callback) {
@@ -750,6 +941,7 @@ pa_operation* pa_context_get_client_info(pa_context *c, uint32_t idx, pa_client_
 
     t = pa_tagstruct_command(c, PA_COMMAND_GET_CLIENT_INFO, &tag);
     pa_tagstruct_putu32(t, idx);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_CLIENT, idx);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_client_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -757,7 +949,7 @@ pa_operation* pa_context_get_client_info(pa_context *c, uint32_t idx, pa_client_
 }
 
 pa_operation* pa_context_get_client_info_list(pa_context *c, pa_client_info_cb_t cb, void *userdata) {
-    return pa_context_send_simple_command(c, PA_COMMAND_GET_CLIENT_INFO_LIST, context_get_client_info_callback, (pa_operation_cb_t) cb, userdata);
+    return send_info_list_command(c, PA_COMMAND_GET_CLIENT_INFO_LIST, PA_SUBSCRIPTION_EVENT_CLIENT, context_get_client_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
 /*** Card info ***/
@@ -903,10 +1095,60 @@ static int fill_card_profile_info(pa_context *context, pa_tagstruct* t, pa_card_
     return 0;
 }
 
+static int parse_card_info(pa_context *c, pa_tagstruct *t, pa_card_info_cb_t cb, void *userdata) {
+    pa_card_info i;
+    uint32_t j;
+    const char *ap;
+    int r = -1;
+
+    pa_zero(i);
+
+    if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+        pa_tagstruct_gets(t, &i.name) < 0 ||
+        pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
+        pa_tagstruct_gets(t, &i.driver) < 0 ||
+        pa_tagstruct_getu32(t, &i.n_profiles) < 0)
+        goto finish;
+
+    if (i.n_profiles > 0) {
+        if (fill_card_profile_info(c, t, &i) < 0)
+            goto finish;
+    }
+
+    i.proplist = pa_proplist_new();
+
+    if (pa_tagstruct_gets(t, &ap) < 0 ||
+        get_proplist(c, t, PA_SUBSCRIPTION_EVENT_CARD, i.index, i.proplist) < 0)
+        goto finish;
+
+    if (ap) {
+        for (j = 0; j < i.n_profiles; j++)
+            if (pa_streq(i.profiles[j].name, ap)) {
+                i.active_profile = &i.profiles[j];
+                i.active_profile2 = i.profiles2[j];
+                break;
+            }
+    }
+
+    if (c->version >= 26) {
+        if (fill_card_port_info(c, t, &i) < 0)
+            goto finish;
+    }
+
+    if (cb)
+        cb(c, &i, 0, userdata);
+
+    r = 0;
+
+finish:
+    card_info_free(&i);
+
+    return r;
+}
+
 static void context_get_card_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     int eol = 1;
-    pa_card_info i;
 
     pa_assert(pd);
     pa_assert(o);
@@ -922,55 +1164,9 @@ static void context_get_card_info_callback(pa_pdispatch *pd, uint32_t command, u
         eol = -1;
     } else {
 
-        while (!pa_tagstruct_eof(t)) {
-            uint32_t j;
-            const char*ap;
-
-            pa_zero(i);
-
-            if (pa_tagstruct_getu32(t, &i.index) < 0 ||
-                pa_tagstruct_gets(t, &i.name) < 0 ||
-                pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
-                pa_tagstruct_gets(t, &i.driver) < 0 ||
-                pa_tagstruct_getu32(t, &i.n_profiles) < 0)
-                    goto fail;
-
-            if (i.n_profiles > 0) {
-                if (fill_card_profile_info(o->context, t, &i) < 0)
-                    goto fail;
-            }
-
-            i.proplist = pa_proplist_new();
-
-            if (pa_tagstruct_gets(t, &ap) < 0 ||
-                pa_tagstruct_get_proplist(t, i.proplist) < 0) {
-
-                pa_context_fail(o->context, PA_ERR_PROTOCOL);
-                card_info_free(&i);
-                goto finish;
-            }
-
-            if (ap) {
-                for (j = 0; j < i.n_profiles; j++)
-                    if (pa_streq(i.profiles[j].name, ap)) {
-                        i.active_profile = &i.profiles[j];
-                        i.active_profile2 = i.profiles2[j];
-                        break;
-                    }
-            }
-
-            if (o->context->version >= 26) {
-                if (fill_card_port_info(o->context, t, &i) < 0)
-                    goto fail;
-            }
-
-            if (o->callback) {
-                pa_card_info_cb_t cb = (pa_card_info_cb_t) o->callback;
-                cb(o->context, &i, 0, o->userdata);
-            }
-
-            card_info_free(&i);
-        }
+        while (!pa_tagstruct_eof(t))
+            if (parse_card_info(o->context, t, (pa_card_info_cb_t) o->callback, o->userdata) < 0)
+                goto fail;
     }
 
     if (o->callback) {
@@ -985,7 +1181,6 @@ finish:
 
 fail:
     pa_context_fail(o->context, PA_ERR_PROTOCOL);
-    card_info_free(&i);
     goto finish;
 }
 
@@ -1008,6 +1203,7 @@ pa_operation* pa_context_get_card_info_by_index(pa_context *c, uint32_t idx, pa_
     t = pa_tagstruct_command(c, PA_COMMAND_GET_CARD_INFO, &tag);
     pa_tagstruct_putu32(t, idx);
     pa_tagstruct_puts(t, NULL);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_CARD, idx);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_card_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -1033,6 +1229,7 @@ pa_operation* pa_context_get_card_info_by_name(pa_context *c, const char*name, p
     t = pa_tagstruct_command(c, PA_COMMAND_GET_CARD_INFO, &tag);
     pa_tagstruct_putu32(t, PA_INVALID_INDEX);
     pa_tagstruct_puts(t, name);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_CARD, PA_INVALID_INDEX);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_card_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -1042,7 +1239,7 @@ pa_operation* pa_context_get_card_info_by_name(pa_context *c, const char*name, p
 pa_operation* pa_context_get_card_info_list(pa_context *c, pa_card_info_cb_t cb, void *userdata) {
     PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 15, PA_ERR_NOTSUPPORTED);
 
-    return pa_context_send_simple_command(c, PA_COMMAND_GET_CARD_INFO_LIST, context_get_card_info_callback, (pa_operation_cb_t) cb, userdata);
+    return send_info_list_command(c, PA_COMMAND_GET_CARD_INFO_LIST, PA_SUBSCRIPTION_EVENT_CARD, context_get_card_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
 pa_operation* pa_context_set_card_profile_by_index(pa_context *c, uint32_t idx, const char*profile, pa_context_success_cb_t cb, void *userdata) {
@@ -1182,6 +1379,59 @@ pa_operation* pa_context_get_module_info_list(pa_context *c, pa_module_info_cb_t
 
 /*** Sink input info ***/
 
+static int parse_sink_input_info(pa_context *c, pa_tagstruct *t, pa_sink_input_info_cb_t cb, void *userdata) {
+    pa_sink_input_info i;
+    bool mute = false, corked = false, has_volume = false, volume_writable = true;
+    int r = -1;
+
+    pa_zero(i);
+    i.proplist = pa_proplist_new();
+    i.format = pa_format_info_new();
+
+    if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+        pa_tagstruct_gets(t, &i.name) < 0 ||
+        pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
+        pa_tagstruct_getu32(t, &i.client) < 0 ||
+        pa_tagstruct_getu32(t, &i.sink) < 0 ||
+        pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
+        pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
+        pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
+        pa_tagstruct_get_usec(t, &i.buffer_usec) < 0 ||
+        pa_tagstruct_get_usec(t, &i.sink_usec) < 0 ||
+        pa_tagstruct_gets(t, &i.resample_method) < 0 ||
+        pa_tagstruct_gets(t, &i.driver) < 0 ||
+        (c->version >= 11 && pa_tagstruct_get_boolean(t, &mute) < 0) ||
+        (c->version >= 13 && get_proplist(c, t, PA_SUBSCRIPTION_EVENT_SINK_INPUT, i.index, i.proplist) < 0) ||
+        (c->version >= 19 && pa_tagstruct_get_boolean(t, &corked) < 0) ||
+        (c->version >= 20 && (pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
+                              pa_tagstruct_get_boolean(t, &volume_writable) < 0)) ||
+        (c->version >= 21 && pa_tagstruct_get_format_info(t, i.format) < 0) ||
+        (c->version >= 33 && (pa_tagstruct_getu32(t, &i.n_underruns) < 0 ||
+                              pa_tagstruct_getu64(t, &i.underrun_bytes) < 0 ||
+                              pa_tagstruct_getu32(t, &i.n_rewinds) < 0 ||
+                              pa_tagstruct_getu64(t, &i.rewind_bytes) < 0 ||
+                              pa_tagstruct_get_usec(t, &i.max_render_usec) < 0))) {
+
+        goto finish;
+    }
+
+    i.mute = (int) mute;
+    i.corked = (int) corked;
+    i.has_volume = (int) has_volume;
+    i.volume_writable = (int) volume_writable;
+
+    if (cb)
+        cb(c, &i, 0, userdata);
+
+    r = 0;
+
+finish:
+    pa_proplist_free(i.proplist);
+    pa_format_info_free(i.format);
+
+    return r;
+}
+
 static void context_get_sink_input_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     int eol = 1;
@@ -1200,52 +1450,11 @@ static void context_get_sink_input_info_callback(pa_pdispatch *pd, uint32_t comm
         eol = -1;
     } else {
 
-        while (!pa_tagstruct_eof(t)) {
-            pa_sink_input_info i;
-            bool mute = false, corked = false, has_volume = false, volume_writable = true;
-
-            pa_zero(i);
-            i.proplist = pa_proplist_new();
-            i.format = pa_format_info_new();
-
-            if (pa_tagstruct_getu32(t, &i.index) < 0 ||
-                pa_tagstruct_gets(t, &i.name) < 0 ||
-                pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
-                pa_tagstruct_getu32(t, &i.client) < 0 ||
-                pa_tagstruct_getu32(t, &i.sink) < 0 ||
-                pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
-                pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
-                pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
-                pa_tagstruct_get_usec(t, &i.buffer_usec) < 0 ||
-                pa_tagstruct_get_usec(t, &i.sink_usec) < 0 ||
-                pa_tagstruct_gets(t, &i.resample_method) < 0 ||
-                pa_tagstruct_gets(t, &i.driver) < 0 ||
-                (o->context->version >= 11 && pa_tagstruct_get_boolean(t, &mute) < 0) ||
-                (o->context->version >= 13 && pa_tagstruct_get_proplist(t, i.proplist) < 0) ||
-                (o->context->version >= 19 && pa_tagstruct_get_boolean(t, &corked) < 0) ||
-                (o->context->version >= 20 && (pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
-                                               pa_tagstruct_get_boolean(t, &volume_writable) < 0)) ||
-                (o->context->version >= 21 && pa_tagstruct_get_format_info(t, i.format) < 0)) {
-
+        while (!pa_tagstruct_eof(t))
+            if (parse_sink_input_info(o->context, t, (pa_sink_input_info_cb_t) o->callback, o->userdata) < 0) {
                 pa_context_fail(o->context, PA_ERR_PROTOCOL);
-                pa_proplist_free(i.proplist);
-                pa_format_info_free(i.format);
                 goto finish;
             }
-
-            i.mute = (int) mute;
-            i.corked = (int) corked;
-            i.has_volume = (int) has_volume;
-            i.volume_writable = (int) volume_writable;
-
-            if (o->callback) {
-                pa_sink_input_info_cb_t cb = (pa_sink_input_info_cb_t) o->callback;
-                cb(o->context, &i, 0, o->userdata);
-            }
-
-            pa_proplist_free(i.proplist);
-            pa_format_info_free(i.format);
-        }
     }
 
     if (o->callback) {
@@ -1275,6 +1484,7 @@ pa_operation* pa_context_get_sink_input_info(pa_context *c, uint32_t idx, pa_sin
 
     t = pa_tagstruct_command(c, PA_COMMAND_GET_SINK_INPUT_INFO, &tag);
     pa_tagstruct_putu32(t, idx);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_SINK_INPUT, idx);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_sink_input_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -1282,11 +1492,59 @@ pa_operation* pa_context_get_sink_input_info(pa_context *c, uint32_t idx, pa_sin
 }
 
 pa_operation* pa_context_get_sink_input_info_list(pa_context *c, void (*cb)(pa_context *c, const pa_sink_input_info*i, int is_last, void *userdata), void *userdata) {
-    return pa_context_send_simple_command(c, PA_COMMAND_GET_SINK_INPUT_INFO_LIST, context_get_sink_input_info_callback, (pa_operation_cb_t) cb, userdata);
+    return send_info_list_command(c, PA_COMMAND_GET_SINK_INPUT_INFO_LIST, PA_SUBSCRIPTION_EVENT_SINK_INPUT, context_get_sink_input_info_callback, (pa_operation_cb_t) cb, userdata);
 }
 
 /*** Source output info ***/
 
+static int parse_source_output_info(pa_context *c, pa_tagstruct *t, pa_source_output_info_cb_t cb, void *userdata) {
+    pa_source_output_info i;
+    bool mute = false, corked = false, has_volume = false, volume_writable = true;
+    int r = -1;
+
+    pa_zero(i);
+    i.proplist = pa_proplist_new();
+    i.format = pa_format_info_new();
+
+    if (pa_tagstruct_getu32(t, &i.index) < 0 ||
+        pa_tagstruct_gets(t, &i.name) < 0 ||
+        pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
+        pa_tagstruct_getu32(t, &i.client) < 0 ||
+        pa_tagstruct_getu32(t, &i.source) < 0 ||
+        pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
+        pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
+        pa_tagstruct_get_usec(t, &i.buffer_usec) < 0 ||
+        pa_tagstruct_get_usec(t, &i.source_usec) < 0 ||
+        pa_tagstruct_gets(t, &i.resample_method) < 0 ||
+        pa_tagstruct_gets(t, &i.driver) < 0 ||
+        (c->version >= 13 && get_proplist(c, t, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, i.index, i.proplist) < 0) ||
+        (c->version >= 19 && pa_tagstruct_get_boolean(t, &corked) < 0) ||
+        (c->version >= 22 && (pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
+                              pa_tagstruct_get_boolean(t, &mute) < 0 ||
+                              pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
+                              pa_tagstruct_get_boolean(t, &volume_writable) < 0 ||
+                              pa_tagstruct_get_format_info(t, i.format) < 0))) {
+
+        goto finish;
+    }
+
+    i.mute = (int) mute;
+    i.corked = (int) corked;
+    i.has_volume = (int) has_volume;
+    i.volume_writable = (int) volume_writable;
+
+    if (cb)
+        cb(c, &i, 0, userdata);
+
+    r = 0;
+
+finish:
+    pa_proplist_free(i.proplist);
+    pa_format_info_free(i.format);
+
+    return r;
+}
+
 static void context_get_source_output_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     int eol = 1;
@@ -1305,52 +1563,11 @@ static void context_get_source_output_info_callback(pa_pdispatch *pd, uint32_t c
         eol = -1;
     } else {
 
-        while (!pa_tagstruct_eof(t)) {
-            pa_source_output_info i;
-            bool mute = false, corked = false, has_volume = false, volume_writable = true;
-
-            pa_zero(i);
-            i.proplist = pa_proplist_new();
-            i.format = pa_format_info_new();
-
-            if (pa_tagstruct_getu32(t, &i.index) < 0 ||
-                pa_tagstruct_gets(t, &i.name) < 0 ||
-                pa_tagstruct_getu32(t, &i.owner_module) < 0 ||
-                pa_tagstruct_getu32(t, &i.client) < 0 ||
-                pa_tagstruct_getu32(t, &i.source) < 0 ||
-                pa_tagstruct_get_sample_spec(t, &i.sample_spec) < 0 ||
-                pa_tagstruct_get_channel_map(t, &i.channel_map) < 0 ||
-                pa_tagstruct_get_usec(t, &i.buffer_usec) < 0 ||
-                pa_tagstruct_get_usec(t, &i.source_usec) < 0 ||
-                pa_tagstruct_gets(t, &i.resample_method) < 0 ||
-                pa_tagstruct_gets(t, &i.driver) < 0 ||
-                (o->context->version >= 13 && pa_tagstruct_get_proplist(t, i.proplist) < 0) ||
-                (o->context->version >= 19 && pa_tagstruct_get_boolean(t, &corked) < 0) ||
-                (o->context->version >= 22 && (pa_tagstruct_get_cvolume(t, &i.volume) < 0 ||
-                                               pa_tagstruct_get_boolean(t, &mute) < 0 ||
-                                               pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
-                                               pa_tagstruct_get_boolean(t, &volume_writable) < 0 ||
-                                               pa_tagstruct_get_format_info(t, i.format) < 0))) {
-
+        while (!pa_tagstruct_eof(t))
+            if (parse_source_output_info(o->context, t, (pa_source_output_info_cb_t) o->callback, o->userdata) < 0) {
                 pa_context_fail(o->context, PA_ERR_PROTOCOL);
-                pa_proplist_free(i.proplist);
-                pa_format_info_free(i.format);
                 goto finish;
             }
-
-            i.mute = (int) mute;
-            i.corked = (int) corked;
-            i.has_volume = (int) has_volume;
-            i.volume_writable = (int) volume_writable;
-
-            if (o->callback) {
-                pa_source_output_info_cb_t cb = (pa_source_output_info_cb_t) o->callback;
-                cb(o->context, &i, 0, o->userdata);
-            }
-
-            pa_proplist_free(i.proplist);
-            pa_format_info_free(i.format);
-        }
     }
 
     if (o->callback) {
@@ -1380,6 +1597,7 @@ pa_operation* pa_context_get_source_output_info(pa_context *c, uint32_t idx, pa_
 
     t = pa_tagstruct_command(c, PA_COMMAND_GET_SOURCE_OUTPUT_INFO, &tag);
     pa_tagstruct_putu32(t, idx);
+    put_known_proplist(c, t, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, idx);
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_source_output_info_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
@@ -1387,7 +1605,601 @@ pa_operation* pa_context_get_source_output_info(pa_context *c, uint32_t idx, pa_
 }
 
 pa_operation* pa_context_get_source_output_info_list(pa_context *c,  pa_source_output_info_cb_t cb, void *userdata) {
-    return pa_context_send_simple_command(c, PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST, context_get_source_output_info_callback, (pa_operation_cb_t) cb, userdata);
+    return send_info_list_command(c, PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, context_get_source_output_info_callback, (pa_operation_cb_t) cb, userdata);
+}
+
+/*** Snapshot ***/
+
+static void context_get_snapshot_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    pa_snapshot_callbacks *cb;
+    uint32_t n;
+    int eol = 1;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    cb = o->private;
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
+
+        eol = -1;
+        goto done;
+    }
+
+    /* The sections come in the order of the callbacks, each preceded by
+     * the number of entries, and only for the callbacks that are set */
+
+    if (cb->sink) {
+        if (pa_tagstruct_getu32(t, &n) < 0)
+            goto fail;
+
+        while (n-- > 0)
+            if (parse_sink_info(o->context, t, cb->sink, o->userdata) < 0)
+                goto fail;
+
+        cb->sink(o->context, NULL, eol, o->userdata);
+    }
+
+    if (cb->source) {
+        if (pa_tagstruct_getu32(t, &n) < 0)
+            goto fail;
+
+        while (n-- > 0)
+            if (parse_source_info(o->context, t, cb->source, o->userdata) < 0)
+                goto fail;
+
+        cb->source(o->context, NULL, eol, o->userdata);
+    }
+
+    if (cb->sink_input) {
+        if (pa_tagstruct_getu32(t, &n) < 0)
+            goto fail;
+
+        while (n-- > 0)
+            if (parse_sink_input_info(o->context, t, cb->sink_input, o->userdata) < 0)
+                goto fail;
+
+        cb->sink_input(o->context, NULL, eol, o->userdata);
+    }
+
+    if (cb->source_output) {
+        if (pa_tagstruct_getu32(t, &n) < 0)
+            goto fail;
+
+        while (n-- > 0)
+            if (parse_source_output_info(o->context, t, cb->source_output, o->userdata) < 0)
+                goto fail;
+
+        cb->source_output(o->context, NULL, eol, o->userdata);
+    }
+
+    if (cb->client) {
+        if (pa_tagstruct_getu32(t, &n) < 0)
+            goto fail;
+
+        while (n-- > 0)
+            if (parse_client_info(o->context, t, cb->client, o->userdata) < 0)
+                goto fail;
+
+        cb->client(o->context, NULL, eol, o->userdata);
+    }
+
+    if (!pa_tagstruct_eof(t))
+        goto fail;
+
+    goto finish;
+
+done:
+    if (cb->sink)
+        cb->sink(o->context, NULL, eol, o->userdata);
+    if (cb->source)
+        cb->source(o->context, NULL, eol, o->userdata);
+    if (cb->sink_input)
+        cb->sink_input(o->context, NULL, eol, o->userdata);
+    if (cb->source_output)
+        cb->source_output(o->context, NULL, eol, o->userdata);
+    if (cb->client)
+        cb->client(o->context, NULL, eol, o->userdata);
+
+finish:
+    pa_operation_done(o);
+    pa_operation_unref(o);
+    return;
+
+fail:
+    pa_context_fail(o->context, PA_ERR_PROTOCOL);
+    goto finish;
+}
+
+pa_operation* pa_context_get_snapshot(pa_context *c, pa_snapshot_flags_t flags, const pa_snapshot_callbacks *cb, void *userdata) {
+    pa_tagstruct *t;
+    pa_operation *o;
+    uint32_t tag;
+    pa_subscription_mask_t mask = PA_SUBSCRIPTION_MASK_NULL;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(cb);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 33, PA_ERR_NOTSUPPORTED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, (flags & ~PA_SNAPSHOT_NO_PROPLISTS) == 0, PA_ERR_INVALID);
+
+    if (cb->sink)
+        mask |= PA_SUBSCRIPTION_MASK_SINK;
+    if (cb->source)
+        mask |= PA_SUBSCRIPTION_MASK_SOURCE;
+    if (cb->sink_input)
+        mask |= PA_SUBSCRIPTION_MASK_SINK_INPUT;
+    if (cb->source_output)
+        mask |= PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT;
+    if (cb->client)
+        mask |= PA_SUBSCRIPTION_MASK_CLIENT;
+
+    o = pa_operation_new(c, NULL, NULL, userdata);
+    o->private = pa_xnewdup(pa_snapshot_callbacks, cb, 1);
+    o->private_free = pa_xfree;
+
+    t = pa_tagstruct_command(c, PA_COMMAND_GET_SNAPSHOT, &tag);
+    pa_tagstruct_putu32(t, mask);
+    pa_tagstruct_putu32(t, flags);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_snapshot_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
+/*** Object cache ***/
+
+enum {
+    CACHE_SINK,
+    CACHE_SOURCE,
+    CACHE_SINK_INPUT,
+    CACHE_SOURCE_OUTPUT,
+    CACHE_CLIENT,
+    CACHE_CARD,
+    CACHE_MAX
+};
+
+typedef int (*cache_parse_cb_t)(pa_context *c, pa_tagstruct *t, pa_operation_cb_t cb, void *userdata);
+
+static int cache_parse_sink(pa_context *c, pa_tagstruct *t, pa_operation_cb_t cb, void *userdata) {
+    return parse_sink_info(c, t, (pa_sink_info_cb_t) cb, userdata);
+}
+
+static int cache_parse_source(pa_context *c, pa_tagstruct *t, pa_operation_cb_t cb, void *userdata) {
+    return parse_source_info(c, t, (pa_source_info_cb_t) cb, userdata);
+}
+
+static int cache_parse_sink_input(pa_context *c, pa_tagstruct *t, pa_operation_cb_t cb, void *userdata) {
+    return parse_sink_input_info(c, t, (pa_sink_input_info_cb_t) cb, userdata);
+}
+
+static int cache_parse_source_output(pa_context *c, pa_tagstruct *t, pa_operation_cb_t cb, void *userdata) {
+    return parse_source_output_info(c, t, (pa_source_output_info_cb_t) cb, userdata);
+}
+
+static int cache_parse_client(pa_context *c, pa_tagstruct *t, pa_operation_cb_t cb, void *userdata) {
+    return parse_client_info(c, t, (pa_client_info_cb_t) cb, userdata);
+}
+
+static int cache_parse_card(pa_context *c, pa_tagstruct *t, pa_operation_cb_t cb, void *userdata) {
+    return parse_card_info(c, t, (pa_card_info_cb_t) cb, userdata);
+}
+
+static const struct {
+    pa_subscription_event_type_t facility;
+    uint32_t list_command;
+    uint32_t info_command;
+    bool info_by_name; /* The info command takes a name after the index */
+    cache_parse_cb_t parse;
+} cache_types[CACHE_MAX] = {
+    [CACHE_SINK] = { PA_SUBSCRIPTION_EVENT_SINK, PA_COMMAND_GET_SINK_INFO_LIST, PA_COMMAND_GET_SINK_INFO, true, cache_parse_sink },
+    [CACHE_SOURCE] = { PA_SUBSCRIPTION_EVENT_SOURCE, PA_COMMAND_GET_SOURCE_INFO_LIST, PA_COMMAND_GET_SOURCE_INFO, true, cache_parse_source },
+    [CACHE_SINK_INPUT] = { PA_SUBSCRIPTION_EVENT_SINK_INPUT, PA_COMMAND_GET_SINK_INPUT_INFO_LIST, PA_COMMAND_GET_SINK_INPUT_INFO, false, cache_parse_sink_input },
+    [CACHE_SOURCE_OUTPUT] = { PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST, PA_COMMAND_GET_SOURCE_OUTPUT_INFO, false, cache_parse_source_output },
+    [CACHE_CLIENT] = { PA_SUBSCRIPTION_EVENT_CLIENT, PA_COMMAND_GET_CLIENT_INFO_LIST, PA_COMMAND_GET_CLIENT_INFO, false, cache_parse_client },
+    [CACHE_CARD] = { PA_SUBSCRIPTION_EVENT_CARD, PA_COMMAND_GET_CARD_INFO_LIST, PA_COMMAND_GET_CARD_INFO, true, cache_parse_card },
+};
+
+/* An object as it was serialized by the server. It is parsed again
+ * whenever it is read, which is cheap compared to fetching it. */
+struct cache_entry {
+    uint8_t *data;
+    size_t length;
+};
+
+struct cache_table {
+    pa_introspect_cache *cache;
+    unsigned type;
+    pa_hashmap *entries;
+};
+
+struct pa_introspect_cache {
+    pa_context *context;
+    struct cache_table tables[CACHE_MAX];
+    unsigned n_lists_pending;
+
+    pa_introspect_cache_cb_t callback;
+    void *userdata;
+};
+
+static void cache_entry_free(struct cache_entry *e) {
+    pa_xfree(e->data);
+    pa_xfree(e);
+}
+
+/* Stores all objects in a reply, each of which starts with its index */
+static int cache_store(struct cache_table *table, pa_tagstruct *t) {
+    pa_introspect_cache *cache = table->cache;
+
+    while (!pa_tagstruct_eof(t)) {
+        struct cache_entry *e;
+        const uint8_t *data;
+        size_t length, start;
+        uint32_t idx;
+        pa_tagstruct *ts;
+        pa_subscription_event_type_t event;
+
+        start = pa_tagstruct_get_read_index(t);
+
+        if (cache_types[table->type].parse(cache->context, t, NULL, NULL) < 0)
+            return -1;
+
+        data = pa_tagstruct_data(t, &length);
+
+        e = pa_xnew(struct cache_entry, 1);
+        e->length = pa_tagstruct_get_read_index(t) - start;
+        e->data = pa_xmemdup(data + start, e->length);
+
+        ts = pa_tagstruct_new_fixed(e->data, e->length);
+        pa_assert_se(pa_tagstruct_getu32(ts, &idx) >= 0);
+        pa_tagstruct_free(ts);
+
+        event = cache_types[table->type].facility;
+
+        if (pa_hashmap_remove_and_free(table->entries, PA_UINT32_TO_PTR(idx)) >= 0)
+            event |= PA_SUBSCRIPTION_EVENT_CHANGE;
+        else
+            event |= PA_SUBSCRIPTION_EVENT_NEW;
+
+        pa_hashmap_put(table->entries, PA_UINT32_TO_PTR(idx), e);
+
+        if (cache->callback)
+            cache->callback(cache, event, idx, cache->userdata);
+    }
+
+    return 0;
+}
+
+static void cache_list_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    struct cache_table *table = userdata;
+    pa_introspect_cache *cache = table->cache;
+
+    pa_assert(pd);
+    pa_assert(cache->n_lists_pending > 0);
+
+    cache->n_lists_pending--;
+
+    /* Old servers don't know all object types, the table just stays
+     * empty then */
+    if (command != PA_COMMAND_REPLY)
+        return;
+
+    if (cache_store(table, t) < 0)
+        pa_context_fail(cache->context, PA_ERR_PROTOCOL);
+}
+
+static void cache_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    struct cache_table *table = userdata;
+
+    pa_assert(pd);
+
+    /* If the object is gone already, the removal event is on its way */
+    if (command != PA_COMMAND_REPLY)
+        return;
+
+    if (cache_store(table, t) < 0)
+        pa_context_fail(table->cache->context, PA_ERR_PROTOCOL);
+}
+
+void pa_introspect_cache_handle_event(pa_introspect_cache *cache, pa_subscription_event_type_t e, uint32_t idx) {
+    pa_context *c = cache->context;
+    struct cache_table *table = NULL;
+    pa_tagstruct *t;
+    uint32_t tag;
+    unsigned k;
+
+    for (k = 0; k < CACHE_MAX; k++)
+        if ((e & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == cache_types[k].facility) {
+            table = &cache->tables[k];
+            break;
+        }
+
+    if (!table || !table->entries)
+        return;
+
+    if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
+        if (pa_hashmap_remove_and_free(table->entries, PA_UINT32_TO_PTR(idx)) >= 0 && cache->callback)
+            cache->callback(cache, e, idx, cache->userdata);
+
+        return;
+    }
+
+    t = pa_tagstruct_command(c, cache_types[k].info_command, &tag);
+    pa_tagstruct_putu32(t, idx);
+    if (cache_types[k].info_by_name)
+        pa_tagstruct_puts(t, NULL);
+    put_known_proplist(c, t, cache_types[k].facility, idx);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, cache_info_callback, table, NULL);
+}
+
+pa_introspect_cache* pa_introspect_cache_new(pa_context *c, pa_subscription_mask_t mask, pa_introspect_cache_cb_t cb, void *userdata) {
+    pa_introspect_cache *cache;
+    pa_operation *o;
+    pa_subscription_mask_t all = 0;
+    unsigned k;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !c->introspect_cache, PA_ERR_EXIST);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, mask != 0, PA_ERR_INVALID);
+
+
+    for (k = 0; k < CACHE_MAX; k++)
+        all |= 1 << cache_types[k].facility;
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, (mask & ~all) == 0, PA_ERR_INVALID);
+
+    cache = pa_xnew0(pa_introspect_cache, 1);
+    cache->context = pa_context_ref(c);
+    cache->callback = cb;
+    cache->userdata = userdata;
+
+    c->introspect_cache = cache;
+    c->cache_subscription_mask = mask;
+
+    /* Subscribe before fetching the lists, so that no change made in
+     * between gets lost */
+    if ((o = pa_context_update_subscription(c, NULL, NULL)))
+        pa_operation_unref(o);
+
+    for (k = 0; k < CACHE_MAX; k++) {
+        pa_tagstruct *t;
+        uint32_t tag;
+
+        cache->tables[k].cache = cache;
+        cache->tables[k].type = k;
+
+        if (!(mask & (1 << cache_types[k].facility)))
+            continue;
+
+        cache->tables[k].entries = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                                       NULL, (pa_free_cb_t) cache_entry_free);
+
+        t = pa_tagstruct_command(c, cache_types[k].list_command, &tag);
+        put_known_proplists(c, t, cache_types[k].facility);
+        pa_pstream_send_tagstruct(c->pstream, t);
+        pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, cache_list_callback, &cache->tables[k], NULL);
+
+        cache->n_lists_pending++;
+    }
+
+    return cache;
+}
+
+void pa_introspect_cache_free(pa_introspect_cache *cache) {
+    pa_context *c;
+    unsigned k;
+
+    pa_assert(cache);
+
+    c = cache->context;
+
+    for (k = 0; k < CACHE_MAX; k++) {
+        if (c->pdispatch)
+            pa_pdispatch_unregister_reply(c->pdispatch, &cache->tables[k]);
+
+        if (cache->tables[k].entries)
+            pa_hashmap_free(cache->tables[k].entries);
+    }
+
+    c->introspect_cache = NULL;
+    c->cache_subscription_mask = 0;
+
+    if (c->state == PA_CONTEXT_READY) {
+        pa_operation *o;
+
+        if ((o = pa_context_update_subscription(c, NULL, NULL)))
+            pa_operation_unref(o);
+    }
+
+    pa_context_unref(c);
+    pa_xfree(cache);
+}
+
+int pa_introspect_cache_is_ready(pa_introspect_cache *cache) {
+    pa_assert(cache);
+
+    return cache->n_lists_pending == 0;
+}
+
+/* Passes the object with the given index, or all objects for
+ * PA_INVALID_INDEX, to the callback. The caller makes the final call. */
+static int cache_get(pa_introspect_cache *cache, unsigned type, uint32_t idx, pa_operation_cb_t cb, void *userdata) {
+    struct cache_table *table;
+    struct cache_entry *e;
+    pa_tagstruct *t;
+    void *state;
+
+    pa_assert(cache);
+    pa_assert(cb);
+
+    table = &cache->tables[type];
+
+    PA_CHECK_VALIDITY(cache->context, table->entries, PA_ERR_NOENTITY);
+
+    if (idx != PA_INVALID_INDEX) {
+        PA_CHECK_VALIDITY(cache->context, e = pa_hashmap_get(table->entries, PA_UINT32_TO_PTR(idx)), PA_ERR_NOENTITY);
+
+        t = pa_tagstruct_new_fixed(e->data, e->length);
+        pa_assert_se(cache_types[type].parse(cache->context, t, cb, userdata) >= 0);
+        pa_tagstruct_free(t);
+
+        return 0;
+    }
+
+    PA_HASHMAP_FOREACH(e, table->entries, state) {
+        t = pa_tagstruct_new_fixed(e->data, e->length);
+        pa_assert_se(cache_types[type].parse(cache->context, t, cb, userdata) >= 0);
+        pa_tagstruct_free(t);
+    }
+
+    return 0;
+}
+
+int pa_introspect_cache_get_sink_info(pa_introspect_cache *cache, uint32_t idx, pa_sink_info_cb_t cb, void *userdata) {
+    int r;
+
+    PA_CHECK_VALIDITY(cache->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    if ((r = cache_get(cache, CACHE_SINK, idx, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_sink_info_list(pa_introspect_cache *cache, pa_sink_info_cb_t cb, void *userdata) {
+    int r;
+
+    if ((r = cache_get(cache, CACHE_SINK, PA_INVALID_INDEX, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_source_info(pa_introspect_cache *cache, uint32_t idx, pa_source_info_cb_t cb, void *userdata) {
+    int r;
+
+    PA_CHECK_VALIDITY(cache->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    if ((r = cache_get(cache, CACHE_SOURCE, idx, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_source_info_list(pa_introspect_cache *cache, pa_source_info_cb_t cb, void *userdata) {
+    int r;
+
+    if ((r = cache_get(cache, CACHE_SOURCE, PA_INVALID_INDEX, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_sink_input_info(pa_introspect_cache *cache, uint32_t idx, pa_sink_input_info_cb_t cb, void *userdata) {
+    int r;
+
+    PA_CHECK_VALIDITY(cache->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    if ((r = cache_get(cache, CACHE_SINK_INPUT, idx, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_sink_input_info_list(pa_introspect_cache *cache, pa_sink_input_info_cb_t cb, void *userdata) {
+    int r;
+
+    if ((r = cache_get(cache, CACHE_SINK_INPUT, PA_INVALID_INDEX, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_source_output_info(pa_introspect_cache *cache, uint32_t idx, pa_source_output_info_cb_t cb, void *userdata) {
+    int r;
+
+    PA_CHECK_VALIDITY(cache->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    if ((r = cache_get(cache, CACHE_SOURCE_OUTPUT, idx, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_source_output_info_list(pa_introspect_cache *cache, pa_source_output_info_cb_t cb, void *userdata) {
+    int r;
+
+    if ((r = cache_get(cache, CACHE_SOURCE_OUTPUT, PA_INVALID_INDEX, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_client_info(pa_introspect_cache *cache, uint32_t idx, pa_client_info_cb_t cb, void *userdata) {
+    int r;
+
+    PA_CHECK_VALIDITY(cache->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    if ((r = cache_get(cache, CACHE_CLIENT, idx, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_client_info_list(pa_introspect_cache *cache, pa_client_info_cb_t cb, void *userdata) {
+    int r;
+
+    if ((r = cache_get(cache, CACHE_CLIENT, PA_INVALID_INDEX, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_card_info(pa_introspect_cache *cache, uint32_t idx, pa_card_info_cb_t cb, void *userdata) {
+    int r;
+
+    PA_CHECK_VALIDITY(cache->context, idx != PA_INVALID_INDEX, PA_ERR_INVALID);
+
+    if ((r = cache_get(cache, CACHE_CARD, idx, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
+}
+
+int pa_introspect_cache_get_card_info_list(pa_introspect_cache *cache, pa_card_info_cb_t cb, void *userdata) {
+    int r;
+
+    if ((r = cache_get(cache, CACHE_CARD, PA_INVALID_INDEX, (pa_operation_cb_t) cb, userdata)) < 0)
+        return r;
+
+    cb(cache->context, NULL, 1, userdata);
+    return 0;
 }
 
 /*** Volume manipulation ***/
@@ -134,6 +134,24 @@
  * either pa_context_get_client_info() or pa_context_get_client_info_list().
  * The information structure is called pa_client_info.
  *
+ * \subsection snapshot_subsec Snapshots
+ *
+ * pa_context_get_snapshot() fetches the lists of sinks, sources, sink
+ * inputs, source outputs and clients in a single round trip. All lists
+ * are taken at the same point in time, so they are consistent with each
+ * other, e.g. every sink input refers to a sink in the list of sinks.
+ * The objects are passed to the same callbacks as used by the
+ * *_info_list() functions.
+ *
+ * \subsection cache_subsec Object Cache
+ *
+ * Applications that show the state of the server, like volume applets,
+ * usually fetch the affected list again for every subscription event.
+ * A pa_introspect_cache created with pa_introspect_cache_new() keeps a
+ * copy of the objects in the client instead and refetches only the
+ * object an event is about. The copy can then be read any time without
+ * a round trip, e.g. with pa_introspect_cache_get_sink_info_list().
+ *
  * \section ctrl_sec Control
  *
  * Some parts of the server are only possible to read, but most can also be
@@ -259,6 +277,11 @@ typedef struct pa_sink_info {
     pa_sink_port_info* active_port;    /**< Pointer to active port in the array, or NULL. \since 0.9.16 */
     uint8_t n_formats;                 /**< Number of formats supported by the sink. \since 1.0 */
     pa_format_info **formats;          /**< Array of formats supported by the sink. \since 1.0 */
+    uint32_t n_underruns;              /**< Number of times one of the sink's streams ran out of data while playing. \since 11.0 */
+    uint64_t underrun_bytes;           /**< Amount of silence played because of that, in bytes of the sink's sample spec. \since 11.0 */
+    uint32_t n_rewinds;                /**< Number of rewinds processed by the sink. \since 11.0 */
+    uint64_t rewind_bytes;             /**< Amount of data rewound, in bytes of the sink's sample spec. \since 11.0 */
+    pa_usec_t max_render_usec;         /**< Longest time the sink spent rendering a block of audio. \since 11.0 */
 } pa_sink_info;
 
 /** Callback prototype for pa_context_get_sink_info_by_name() and friends */
@@ -576,6 +599,11 @@ typedef struct pa_sink_input_info {
     int has_volume;                      /**< Stream has volume. If not set, then the meaning of this struct's volume member is unspecified. \since 1.0 */
     int volume_writable;                 /**< The volume can be set. If not set, the volume can still change even though clients can't control the volume. \since 1.0 */
     pa_format_info *format;              /**< Stream format information. \since 1.0 */
+    uint32_t n_underruns;                /**< Number of times the stream ran out of data while playing. \since 11.0 */
+    uint64_t underrun_bytes;             /**< Amount of silence played because of that, in bytes of the sink's sample spec. \since 11.0 */
+    uint32_t n_rewinds;                  /**< Number of times the stream was rewound. \since 11.0 */
+    uint64_t rewind_bytes;               /**< Amount of data rewound, in bytes of the sink's sample spec. \since 11.0 */
+    pa_usec_t max_render_usec;           /**< Longest time spent getting a block of data from the stream, including resampling. \since 11.0 */
 } pa_sink_input_info;
 
 /** Callback prototype for pa_context_get_sink_input_info() and friends */
@@ -656,6 +684,110 @@ pa_operation* pa_context_kill_source_output(pa_context *c, uint32_t idx, pa_cont
 
 /** @} */
 
+/** @{ \name Snapshots */
+
+/** Flags for pa_context_get_snapshot(). \since 11.0 */
+typedef enum pa_snapshot_flags {
+    PA_SNAPSHOT_NOFLAGS = 0x0000U,
+    /**< Flag to pass when no specific options are needed */
+
+    PA_SNAPSHOT_NO_PROPLISTS = 0x0001U
+    /**< Don't transfer the property lists of the objects, they are
+     * empty in the information structures passed to the callbacks. */
+} pa_snapshot_flags_t;
+
+/** \cond fulldocs */
+#define PA_SNAPSHOT_NOFLAGS PA_SNAPSHOT_NOFLAGS
+#define PA_SNAPSHOT_NO_PROPLISTS PA_SNAPSHOT_NO_PROPLISTS
+/** \endcond */
+
+/** The callbacks for pa_context_get_snapshot(). Objects of a type
+ * whose callback is NULL are not requested. \since 11.0 */
+typedef struct pa_snapshot_callbacks {
+    pa_sink_info_cb_t sink;
+    pa_source_info_cb_t source;
+    pa_sink_input_info_cb_t sink_input;
+    pa_source_output_info_cb_t source_output;
+    pa_client_info_cb_t client;
+} pa_snapshot_callbacks;
+
+/** Get the lists of sinks, sources, sink inputs, source outputs and
+ * clients at once. The callbacks are called in this order, each just
+ * like for the corresponding *_info_list() function, including the
+ * terminating call with eol set. The callbacks structure is copied and
+ * need not be kept around. \since 11.0 */
+pa_operation* pa_context_get_snapshot(pa_context *c, pa_snapshot_flags_t flags, const pa_snapshot_callbacks *cb, void *userdata);
+
+/** @} */
+
+/** @{ \name Object Cache */
+
+/** An opaque client-side copy of server objects. \since 11.0 */
+typedef struct pa_introspect_cache pa_introspect_cache;
+
+/** Called whenever the cache added, updated or removed an object. \a t
+ * and \a idx are the same as for subscription events. \since 11.0 */
+typedef void (*pa_introspect_cache_cb_t)(pa_introspect_cache *cache, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
+
+/** Create a cache of the objects of the types in \a mask, which may
+ * contain sinks, sources, sink inputs, source outputs, clients and
+ * cards. The cache fetches all of them once and then follows the
+ * subscription events of the server, fetching only the objects that
+ * changed. The context is subscribed to these events in addition to
+ * what the application subscribed to. Only one cache may exist per
+ * context. Returns NULL on failure. \since 11.0 */
+pa_introspect_cache* pa_introspect_cache_new(pa_context *c, pa_subscription_mask_t mask, pa_introspect_cache_cb_t cb, void *userdata);
+
+/** Free the cache. \since 11.0 */
+void pa_introspect_cache_free(pa_introspect_cache *cache);
+
+/** Return non-zero once the initial contents of the cache have been
+ * fetched. Objects are reported as new through the callback as they
+ * come in. \since 11.0 */
+int pa_introspect_cache_is_ready(pa_introspect_cache *cache);
+
+/** The following functions work like their pa_context_get_*_info()
+ * counterparts, but read from the cache. The callback is called right
+ * away, including the terminating call with eol set. A negative error
+ * code is returned, and the callback not called, if the object or its
+ * type is not in the cache. \since 11.0 */
+int pa_introspect_cache_get_sink_info(pa_introspect_cache *cache, uint32_t idx, pa_sink_info_cb_t cb, void *userdata);
+
+/** Get all cached sinks. \since 11.0 */
+int pa_introspect_cache_get_sink_info_list(pa_introspect_cache *cache, pa_sink_info_cb_t cb, void *userdata);
+
+/** Get a cached source. \since 11.0 */
+int pa_introspect_cache_get_source_info(pa_introspect_cache *cache, uint32_t idx, pa_source_info_cb_t cb, void *userdata);
+
+/** Get all cached sources. \since 11.0 */
+int pa_introspect_cache_get_source_info_list(pa_introspect_cache *cache, pa_source_info_cb_t cb, void *userdata);
+
+/** Get a cached sink input. \since 11.0 */
+int pa_introspect_cache_get_sink_input_info(pa_introspect_cache *cache, uint32_t idx, pa_sink_input_info_cb_t cb, void *userdata);
+
+/** Get all cached sink inputs. \since 11.0 */
+int pa_introspect_cache_get_sink_input_info_list(pa_introspect_cache *cache, pa_sink_input_info_cb_t cb, void *userdata);
+
+/** Get a cached source output. \since 11.0 */
+int pa_introspect_cache_get_source_output_info(pa_introspect_cache *cache, uint32_t idx, pa_source_output_info_cb_t cb, void *userdata);
+
+/** Get all cached source outputs. \since 11.0 */
+int pa_introspect_cache_get_source_output_info_list(pa_introspect_cache *cache, pa_source_output_info_cb_t cb, void *userdata);
+
+/** Get a cached client. \since 11.0 */
+int pa_introspect_cache_get_client_info(pa_introspect_cache *cache, uint32_t idx, pa_client_info_cb_t cb, void *userdata);
+
+/** Get all cached clients. \since 11.0 */
+int pa_introspect_cache_get_client_info_list(pa_introspect_cache *cache, pa_client_info_cb_t cb, void *userdata);
+
+/** Get a cached card. \since 11.0 */
+int pa_introspect_cache_get_card_info(pa_introspect_cache *cache, uint32_t idx, pa_card_info_cb_t cb, void *userdata);
+
+/** Get all cached cards. \since 11.0 */
+int pa_introspect_cache_get_card_info_list(pa_introspect_cache *cache, pa_card_info_cb_t cb, void *userdata);
+
+/** @} */
+
 /** @{ \name Statistics */
 
 /** Memory block statistics. Please note that this structure
@@ -667,6 +799,21 @@ typedef struct pa_stat_info {
     uint32_t memblock_allocated;       /**< Allocated memory blocks during the whole lifetime of the daemon. */
     uint32_t memblock_allocated_size;  /**< Total size of all memory blocks allocated during the whole lifetime of the daemon. */
     uint32_t scache_size;              /**< Total size of all sample cache entries. */
+    uint32_t memblock_total_max;       /**< Highest number of memory blocks allocated at the same time. \since 11.0 */
+    uint32_t memblock_total_size_max;  /**< Highest total size of memory blocks allocated at the same time. \since 11.0 */
+    uint32_t memblock_pool_full;       /**< Allocations that could not be served from the memory pool because it was full. \since 11.0 */
+    uint32_t memblock_too_large;       /**< Allocations that could not be served from the memory pool because they were too large. \since 11.0 */
+    uint32_t client_imported;          /**< Shared memory blocks of this client currently held by the daemon. \since 11.0 */
+    uint32_t client_imported_size;     /**< Total size of the blocks in client_imported. \since 11.0 */
+    uint32_t client_imported_max;      /**< High-water mark of client_imported. \since 11.0 */
+    uint32_t client_imported_size_max; /**< High-water mark of client_imported_size. \since 11.0 */
+    uint32_t client_exported;          /**< Shared memory blocks of the daemon currently handed out to this client. \since 11.0 */
+    uint32_t client_exported_size;     /**< Total size of the blocks in client_exported. \since 11.0 */
+    uint32_t client_exported_max;      /**< High-water mark of client_exported. \since 11.0 */
+    uint32_t client_exported_size_max; /**< High-water mark of client_exported_size. \since 11.0 */
+    uint32_t client_imported_failed;   /**< Blocks of this client the daemon failed to import, their data was lost. \since 11.0 */
+    uint32_t client_exported_failed;   /**< Blocks of the daemon that could not be shared with this client and were copied over the socket instead. \since 11.0 */
+    uint32_t client_exported_copied;   /**< Blocks of the daemon that were not in its memory pool and had to be copied into it before sharing them with this client. \since 11.0 */
 } pa_stat_info;
 
 /** Callback prototype for pa_context_stat() */
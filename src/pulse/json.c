@@ -193,6 +193,56 @@ error:
     return NULL;
 }
 
+/* Checks a string the way parse_string() does, without copying it. Expects
+ * str to point at the leading '"' and returns the position after the trailing
+ * one. */
+static const char* scan_string(const char *str, const char **start, size_t *length) {
+    str++; /* Consume leading '"' */
+    *start = str;
+
+    while (*str && *str != '"') {
+        if (*str != '\\') {
+            if (*str < 0x20 || *str > 0x7E) {
+                pa_log("Invalid non-ASCII character: 0x%x", (unsigned int) *str);
+                return NULL;
+            }
+        } else {
+            str++;
+
+            switch (*str) {
+                case '"':
+                case '\\':
+                case '/':
+                case 'b':
+                case 'f':
+                case 'n':
+                case 'r':
+                case 't':
+                    break;
+
+                case 'u':
+                    pa_log("Unicode code points are currently unsupported");
+                    return NULL;
+
+                default:
+                    pa_log("Unexepcted escape value: %c", *str);
+                    return NULL;
+            }
+        }
+
+        str++;
+    }
+
+    if (*str != '"') {
+        pa_log("Failed to parse remainder of string: %s", str);
+        return NULL;
+    }
+
+    *length = str - *start;
+
+    return str + 1;
+}
+
 static const char* parse_number(const char *str, pa_json_object *obj) {
     bool negative = false, has_fraction = false, has_exponent = false, valid = false;
     unsigned int integer = 0;
@@ -557,6 +607,270 @@ const pa_json_object* pa_json_object_get_array_member(const pa_json_object *o, i
     return pa_idxset_get_by_index(o->array_values, index);
 }
 
+enum {
+    TOKENIZER_EXPECT_VALUE,
+    TOKENIZER_EXPECT_VALUE_OR_ARRAY_END,
+    TOKENIZER_EXPECT_KEY,
+    TOKENIZER_EXPECT_KEY_OR_OBJECT_END,
+    TOKENIZER_EXPECT_SEPARATOR,
+    TOKENIZER_DONE,
+    TOKENIZER_FAILED,
+};
+
+void pa_json_tokenizer_init(pa_json_tokenizer *t, const char *str) {
+    pa_assert(t);
+    pa_assert(str);
+
+    t->str = str;
+    t->depth = 0;
+    t->in_object = 0;
+    t->expect = TOKENIZER_EXPECT_VALUE;
+}
+
+static bool tokenizer_in_object(pa_json_tokenizer *t) {
+    return t->depth > 0 && (t->in_object & (1U << (t->depth - 1)));
+}
+
+static pa_json_token_type tokenizer_close(pa_json_tokenizer *t, pa_json_token *token) {
+    bool object = tokenizer_in_object(t);
+
+    t->str++;
+    t->depth--;
+    t->expect = TOKENIZER_EXPECT_SEPARATOR;
+    token->level = t->depth;
+
+    return object ? PA_JSON_TOKEN_OBJECT_END : PA_JSON_TOKEN_ARRAY_END;
+}
+
+pa_json_token_type pa_json_tokenizer_next(pa_json_tokenizer *t, pa_json_token *token) {
+    const char *str;
+    pa_json_object o;
+
+    pa_assert(t);
+    pa_assert(token);
+
+    while (is_whitespace(*t->str))
+        t->str++;
+
+    switch (t->expect) {
+        case TOKENIZER_DONE:
+            return PA_JSON_TOKEN_END;
+
+        case TOKENIZER_FAILED:
+            return PA_JSON_TOKEN_ERROR;
+
+        case TOKENIZER_EXPECT_SEPARATOR:
+            if (t->depth == 0) {
+                if (*t->str != '\0')
+                    goto fail;
+
+                t->expect = TOKENIZER_DONE;
+                return PA_JSON_TOKEN_END;
+            }
+
+            if (*t->str == (tokenizer_in_object(t) ? '}' : ']'))
+                return tokenizer_close(t, token);
+
+            if (*t->str != ',')
+                goto fail;
+
+            t->str++;
+            while (is_whitespace(*t->str))
+                t->str++;
+
+            t->expect = tokenizer_in_object(t) ? TOKENIZER_EXPECT_KEY : TOKENIZER_EXPECT_VALUE;
+            break;
+
+        case TOKENIZER_EXPECT_VALUE_OR_ARRAY_END:
+            if (*t->str == ']')
+                return tokenizer_close(t, token);
+
+            t->expect = TOKENIZER_EXPECT_VALUE;
+            break;
+
+        case TOKENIZER_EXPECT_KEY_OR_OBJECT_END:
+            if (*t->str == '}')
+                return tokenizer_close(t, token);
+
+            t->expect = TOKENIZER_EXPECT_KEY;
+            break;
+    }
+
+    if (t->depth > MAX_NESTING_DEPTH) {
+        pa_log("Exceeded maximum permitted nesting depth of objects (%u)", MAX_NESTING_DEPTH);
+        goto fail;
+    }
+
+    token->level = t->depth;
+
+    if (t->expect == TOKENIZER_EXPECT_KEY) {
+        if (*t->str != '"' ||
+            !(str = scan_string(t->str, &token->string_value.start, &token->string_value.length))) {
+            pa_log("Could not parse key for object");
+            goto fail;
+        }
+
+        while (is_whitespace(*str))
+            str++;
+
+        if (*str != ':')
+            goto fail;
+
+        t->str = str + 1;
+        t->expect = TOKENIZER_EXPECT_VALUE;
+        token->type = PA_JSON_TYPE_STRING;
+
+        return PA_JSON_TOKEN_KEY;
+    }
+
+    pa_assert(t->expect == TOKENIZER_EXPECT_VALUE);
+
+    if (*t->str == '[' || *t->str == '{') {
+        bool object = *t->str == '{';
+
+        if (object)
+            t->in_object |= 1U << t->depth;
+        else
+            t->in_object &= ~(1U << t->depth);
+
+        t->str++;
+        t->depth++;
+        t->expect = object ? TOKENIZER_EXPECT_KEY_OR_OBJECT_END : TOKENIZER_EXPECT_VALUE_OR_ARRAY_END;
+
+        return object ? PA_JSON_TOKEN_OBJECT_BEGIN : PA_JSON_TOKEN_ARRAY_BEGIN;
+    }
+
+    o.type = PA_JSON_TYPE_INIT;
+
+    if (*t->str == '"') {
+        str = scan_string(t->str, &token->string_value.start, &token->string_value.length);
+        o.type = PA_JSON_TYPE_STRING;
+    } else if (*t->str == 'n')
+        str = parse_null(t->str, &o);
+    else if (*t->str == 't' || *t->str == 'f')
+        str = parse_boolean(t->str, &o);
+    else if (is_digit(*t->str) || *t->str == '-')
+        str = parse_number(t->str, &o);
+    else {
+        pa_log("Invalid JSON string: %s", t->str);
+        goto fail;
+    }
+
+    if (!str)
+        goto fail;
+
+    token->type = o.type;
+
+    switch (o.type) {
+        case PA_JSON_TYPE_INT:
+            token->int_value = o.int_value;
+            break;
+
+        case PA_JSON_TYPE_DOUBLE:
+            token->double_value = o.double_value;
+            break;
+
+        case PA_JSON_TYPE_BOOL:
+            token->bool_value = o.bool_value;
+            break;
+
+        default:
+            break;
+    }
+
+    t->str = str;
+    t->expect = TOKENIZER_EXPECT_SEPARATOR;
+
+    return PA_JSON_TOKEN_VALUE;
+
+fail:
+    t->expect = TOKENIZER_FAILED;
+    return PA_JSON_TOKEN_ERROR;
+}
+
+/* Returns the next unescaped character of a string token, or -1 at its end */
+static int token_string_next(const char **p, const char *end) {
+    char c;
+
+    if (*p >= end)
+        return -1;
+
+    if ((c = *(*p)++) != '\\')
+        return (unsigned char) c;
+
+    /* scan_string() already rejected anything else */
+    switch ((c = *(*p)++)) {
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        default: return (unsigned char) c;
+    }
+}
+
+bool pa_json_token_string_equal(const pa_json_token *t, const char *str) {
+    const char *p, *end;
+    int c;
+
+    pa_assert(t);
+    pa_assert(t->type == PA_JSON_TYPE_STRING);
+    pa_assert(str);
+
+    p = t->string_value.start;
+    end = p + t->string_value.length;
+
+    while ((c = token_string_next(&p, end)) >= 0) {
+        if (c != (unsigned char) *str)
+            return false;
+
+        str++;
+    }
+
+    return *str == '\0';
+}
+
+bool pa_json_token_equal(const pa_json_token *t1, const pa_json_token *t2) {
+    const char *p1, *p2, *end1, *end2;
+    int c;
+
+    pa_assert(t1);
+    pa_assert(t2);
+
+    if (t1->type != t2->type)
+        return false;
+
+    switch (t1->type) {
+        case PA_JSON_TYPE_NULL:
+            return true;
+
+        case PA_JSON_TYPE_BOOL:
+            return t1->bool_value == t2->bool_value;
+
+        case PA_JSON_TYPE_INT:
+            return t1->int_value == t2->int_value;
+
+        case PA_JSON_TYPE_DOUBLE:
+            return PA_DOUBLE_IS_EQUAL(t1->double_value, t2->double_value);
+
+        case PA_JSON_TYPE_STRING:
+            p1 = t1->string_value.start;
+            end1 = p1 + t1->string_value.length;
+            p2 = t2->string_value.start;
+            end2 = p2 + t2->string_value.length;
+
+            do {
+                if ((c = token_string_next(&p1, end1)) != token_string_next(&p2, end2))
+                    return false;
+            } while (c >= 0);
+
+            return true;
+
+        default:
+            pa_assert_not_reached();
+    }
+}
+
 bool pa_json_object_equal(const pa_json_object *o1, const pa_json_object *o2) {
     int i;
 
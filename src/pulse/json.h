@@ -18,6 +18,8 @@
 ***/
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define PA_DOUBLE_IS_EQUAL(x, y) (((x) - (y)) < 0.000001 && ((x) - (y)) > -0.000001)
 
@@ -51,3 +53,47 @@ int pa_json_object_get_array_length(const pa_json_object *o);
 const pa_json_object* pa_json_object_get_array_member(const pa_json_object *o, int index);
 
 bool pa_json_object_equal(const pa_json_object *o1, const pa_json_object *o2);
+
+/* Tokenizer for when building the whole object tree is too expensive. It
+ * accepts the same input as pa_json_parse(), doesn't allocate memory, and
+ * returns strings still escaped, pointing into the parsed string. */
+
+typedef enum {
+    PA_JSON_TOKEN_ERROR = -1,
+    PA_JSON_TOKEN_END = 0,
+    PA_JSON_TOKEN_VALUE, /* A value that is neither an array nor an object */
+    PA_JSON_TOKEN_KEY, /* The name of an object member, always a string */
+    PA_JSON_TOKEN_ARRAY_BEGIN,
+    PA_JSON_TOKEN_ARRAY_END,
+    PA_JSON_TOKEN_OBJECT_BEGIN,
+    PA_JSON_TOKEN_OBJECT_END,
+} pa_json_token_type;
+
+typedef struct pa_json_token {
+    pa_json_type type; /* For values and keys */
+    unsigned level; /* Nesting level: 0 for the outermost value */
+
+    union {
+        int int_value;
+        double double_value;
+        bool bool_value;
+        struct {
+            const char *start; /* Escaped, not NUL terminated */
+            size_t length;
+        } string_value;
+    };
+} pa_json_token;
+
+typedef struct pa_json_tokenizer {
+    const char *str;
+    unsigned depth;
+    uint32_t in_object; /* Bit n set if the container at depth n + 1 is an object */
+    int expect;
+} pa_json_tokenizer;
+
+void pa_json_tokenizer_init(pa_json_tokenizer *t, const char *str);
+pa_json_token_type pa_json_tokenizer_next(pa_json_tokenizer *t, pa_json_token *token);
+
+/* Same semantics as pa_json_object_equal() for two PA_JSON_TOKEN_VALUE tokens */
+bool pa_json_token_equal(const pa_json_token *t1, const pa_json_token *t2);
+bool pa_json_token_string_equal(const pa_json_token *t, const char *str);
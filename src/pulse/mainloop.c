@@ -72,6 +72,10 @@ struct pa_time_event {
     bool use_rtclock:1;
     pa_usec_t time;
 
+    /* Position in the mainloop's heap, if enabled */
+    unsigned heap_index;
+    unsigned dispatch_round;
+
     pa_time_event_cb_t callback;
     void *userdata;
     pa_time_event_destroy_cb_t destroy_callback;
@@ -105,7 +109,12 @@ struct pa_mainloop {
     unsigned max_pollfds, n_pollfds;
 
     pa_usec_t prepared_timeout;
-    pa_time_event *cached_next_time_event;
+
+    /* The enabled time events, as a binary min-heap ordered by time. Its
+     * size is n_enabled_time_events. */
+    pa_time_event **time_heap;
+    unsigned max_time_heap;
+    unsigned dispatch_round;
 
     pa_mainloop_api api;
 
@@ -286,6 +295,76 @@ static void mainloop_defer_set_destroy(pa_defer_event *e, pa_defer_event_destroy
 }
 
 /* Time events */
+/* Time event heap */
+
+static void heap_set(pa_mainloop *m, unsigned i, pa_time_event *e) {
+    m->time_heap[i] = e;
+    e->heap_index = i;
+}
+
+static void heap_sift_up(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+
+        if (m->time_heap[parent]->time <= e->time)
+            break;
+
+        heap_set(m, i, m->time_heap[parent]);
+        i = parent;
+    }
+
+    heap_set(m, i, e);
+}
+
+static void heap_sift_down(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+    unsigned n = m->n_enabled_time_events;
+
+    for (;;) {
+        unsigned child = 2 * i + 1;
+
+        if (child >= n)
+            break;
+
+        if (child + 1 < n && m->time_heap[child + 1]->time < m->time_heap[child]->time)
+            child++;
+
+        if (e->time <= m->time_heap[child]->time)
+            break;
+
+        heap_set(m, i, m->time_heap[child]);
+        i = child;
+    }
+
+    heap_set(m, i, e);
+}
+
+static void heap_insert(pa_mainloop *m, pa_time_event *e) {
+    if (m->n_enabled_time_events >= m->max_time_heap) {
+        m->max_time_heap = PA_MAX(16U, m->max_time_heap * 2);
+        m->time_heap = pa_xrenew(pa_time_event*, m->time_heap, m->max_time_heap);
+    }
+
+    heap_set(m, m->n_enabled_time_events++, e);
+    heap_sift_up(m, e->heap_index);
+}
+
+static void heap_remove(pa_mainloop *m, pa_time_event *e) {
+    unsigned i = e->heap_index;
+
+    pa_assert(m->n_enabled_time_events > 0);
+    pa_assert(m->time_heap[i] == e);
+
+    if (i == --m->n_enabled_time_events)
+        return;
+
+    heap_set(m, i, m->time_heap[m->n_enabled_time_events]);
+    heap_sift_up(m, i);
+    heap_sift_down(m, m->time_heap[i]->heap_index);
+}
+
 static pa_usec_t make_rt(const struct timeval *tv, bool *use_rtclock) {
     struct timeval ttv;
 
@@ -332,14 +411,7 @@ static pa_time_event* mainloop_time_new(
         e->time = t;
         e->use_rtclock = use_rtclock;
 
-        m->n_enabled_time_events++;
-
-        if (m->cached_next_time_event) {
-            pa_assert(m->cached_next_time_event->enabled);
-
-            if (t < m->cached_next_time_event->time)
-                m->cached_next_time_event = e;
-        }
+        heap_insert(m, e);
     }
 
     e->callback = callback;
@@ -364,27 +436,23 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
     t = make_rt(tv, &use_rtclock);
 
     valid = (t != PA_USEC_INVALID);
-    if (e->enabled && !valid) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
-    } else if (!e->enabled && valid)
-        e->mainloop->n_enabled_time_events++;
+    if (e->enabled && !valid)
+        heap_remove(e->mainloop, e);
 
-    if ((e->enabled = valid)) {
+    if (valid) {
         e->time = t;
         e->use_rtclock = use_rtclock;
-        pa_mainloop_wakeup(e->mainloop);
-    }
-
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
 
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        pa_assert(e->mainloop->cached_next_time_event->enabled);
+        if (e->enabled) {
+            heap_sift_up(e->mainloop, e->heap_index);
+            heap_sift_down(e->mainloop, e->heap_index);
+        } else
+            heap_insert(e->mainloop, e);
 
-        if (t < e->mainloop->cached_next_time_event->time)
-            e->mainloop->cached_next_time_event = e;
+        pa_mainloop_wakeup(e->mainloop);
     }
+
+    e->enabled = valid;
 }
 
 static void mainloop_time_free(pa_time_event *e) {
@@ -395,14 +463,10 @@ static void mainloop_time_free(pa_time_event *e) {
     e->mainloop->time_events_please_scan ++;
 
     if (e->enabled) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
+        heap_remove(e->mainloop, e);
         e->enabled = false;
     }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
     /* no wakeup needed here. Think about it! */
 }
 
@@ -520,8 +584,7 @@ static void cleanup_time_events(pa_mainloop *m, bool force) {
             }
 
             if (!e->dead && e->enabled) {
-                pa_assert(m->n_enabled_time_events > 0);
-                m->n_enabled_time_events--;
+                heap_remove(m, e);
                 e->enabled = false;
             }
 
@@ -575,6 +638,7 @@ void pa_mainloop_free(pa_mainloop *m) {
     cleanup_time_events(m, true);
 
     pa_xfree(m->pollfds);
+    pa_xfree(m->time_heap);
 
     pa_close_pipe(m->wakeup_pipe);
 
@@ -685,28 +749,9 @@ static unsigned dispatch_defer(pa_mainloop *m) {
 }
 
 static pa_time_event* find_next_time_event(pa_mainloop *m) {
-    pa_time_event *t, *n = NULL;
     pa_assert(m);
 
-    if (m->cached_next_time_event)
-        return m->cached_next_time_event;
-
-    PA_LLIST_FOREACH(t, m->time_events) {
-
-        if (t->dead || !t->enabled)
-            continue;
-
-        if (!n || t->time < n->time) {
-            n = t;
-
-            /* Shortcut for time == 0 */
-            if (n->time == 0)
-                break;
-        }
-    }
-
-    m->cached_next_time_event = n;
-    return n;
+    return m->n_enabled_time_events > 0 ? m->time_heap[0] : NULL;
 }
 
 static pa_usec_t calc_next_timeout(pa_mainloop *m) {
@@ -740,25 +785,23 @@ static unsigned dispatch_timeout(pa_mainloop *m) {
 
     now = pa_rtclock_now();
 
-    PA_LLIST_FOREACH(e, m->time_events) {
-
-        if (m->quit)
-            break;
+    /* Events that are restarted for a time that has already passed by
+     * their own callback are dispatched again only on the next
+     * iteration, as they used to be */
+    m->dispatch_round++;
 
-        if (e->dead || !e->enabled)
-            continue;
+    while (!m->quit && (e = find_next_time_event(m)) && e->time <= now && e->dispatch_round != m->dispatch_round) {
+        struct timeval tv;
+        pa_assert(e->callback);
 
-        if (e->time <= now) {
-            struct timeval tv;
-            pa_assert(e->callback);
+        e->dispatch_round = m->dispatch_round;
 
-            /* Disable time event */
-            mainloop_time_restart(e, NULL);
+        /* Disable time event */
+        mainloop_time_restart(e, NULL);
 
-            e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+        e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
 
-            r++;
-        }
+        r++;
     }
 
     return r;
@@ -71,6 +71,9 @@ void pa_operation_unref(pa_operation *o) {
         pa_assert(!o->context);
         pa_assert(!o->stream);
 
+        if (o->private_free)
+            o->private_free(o->private);
+
         if (pa_flist_push(PA_STATIC_FLIST_GET(operations), o) < 0)
             pa_xfree(o);
     }
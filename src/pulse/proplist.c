@@ -28,13 +28,19 @@
 #include <pulse/utf8.h>
 
 #include <pulsecore/hashmap.h>
+#include <pulsecore/once.h>
+#include <pulsecore/refcnt.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
 
 #include "proplist.h"
 
+/* Properties are shared between proplists by pa_proplist_copy() and
+ * pa_proplist_update(), and are only ever modified while not shared. */
 struct property {
+    PA_REFCNT_DECLARE;
     char *key;
+    bool key_interned;
     void *value;
     size_t nbytes;
 };
@@ -42,6 +48,115 @@ struct property {
 #define MAKE_HASHMAP(p) ((pa_hashmap*) (p))
 #define MAKE_PROPLIST(p) ((pa_proplist*) (p))
 
+/* The well-known keys are interned, so that properties using them
+ * need no copy of the key */
+static const char * const well_known_keys[] = {
+    PA_PROP_MEDIA_NAME,
+    PA_PROP_MEDIA_TITLE,
+    PA_PROP_MEDIA_ARTIST,
+    PA_PROP_MEDIA_COPYRIGHT,
+    PA_PROP_MEDIA_SOFTWARE,
+    PA_PROP_MEDIA_LANGUAGE,
+    PA_PROP_MEDIA_FILENAME,
+    PA_PROP_MEDIA_ICON,
+    PA_PROP_MEDIA_ICON_NAME,
+    PA_PROP_MEDIA_ROLE,
+    PA_PROP_FILTER_WANT,
+    PA_PROP_FILTER_APPLY,
+    PA_PROP_FILTER_SUPPRESS,
+    PA_PROP_EVENT_ID,
+    PA_PROP_EVENT_DESCRIPTION,
+    PA_PROP_EVENT_MOUSE_X,
+    PA_PROP_EVENT_MOUSE_Y,
+    PA_PROP_EVENT_MOUSE_HPOS,
+    PA_PROP_EVENT_MOUSE_VPOS,
+    PA_PROP_EVENT_MOUSE_BUTTON,
+    PA_PROP_WINDOW_NAME,
+    PA_PROP_WINDOW_ID,
+    PA_PROP_WINDOW_ICON,
+    PA_PROP_WINDOW_ICON_NAME,
+    PA_PROP_WINDOW_X,
+    PA_PROP_WINDOW_Y,
+    PA_PROP_WINDOW_WIDTH,
+    PA_PROP_WINDOW_HEIGHT,
+    PA_PROP_WINDOW_HPOS,
+    PA_PROP_WINDOW_VPOS,
+    PA_PROP_WINDOW_DESKTOP,
+    PA_PROP_WINDOW_X11_DISPLAY,
+    PA_PROP_WINDOW_X11_SCREEN,
+    PA_PROP_WINDOW_X11_MONITOR,
+    PA_PROP_WINDOW_X11_XID,
+    PA_PROP_APPLICATION_NAME,
+    PA_PROP_APPLICATION_ID,
+    PA_PROP_APPLICATION_VERSION,
+    PA_PROP_APPLICATION_ICON,
+    PA_PROP_APPLICATION_ICON_NAME,
+    PA_PROP_APPLICATION_LANGUAGE,
+    PA_PROP_APPLICATION_PROCESS_ID,
+    PA_PROP_APPLICATION_PROCESS_BINARY,
+    PA_PROP_APPLICATION_PROCESS_USER,
+    PA_PROP_APPLICATION_PROCESS_HOST,
+    PA_PROP_APPLICATION_PROCESS_MACHINE_ID,
+    PA_PROP_APPLICATION_PROCESS_SESSION_ID,
+    PA_PROP_DEVICE_STRING,
+    PA_PROP_DEVICE_API,
+    PA_PROP_DEVICE_DESCRIPTION,
+    PA_PROP_DEVICE_BUS_PATH,
+    PA_PROP_DEVICE_SERIAL,
+    PA_PROP_DEVICE_VENDOR_ID,
+    PA_PROP_DEVICE_VENDOR_NAME,
+    PA_PROP_DEVICE_PRODUCT_ID,
+    PA_PROP_DEVICE_PRODUCT_NAME,
+    PA_PROP_DEVICE_CLASS,
+    PA_PROP_DEVICE_FORM_FACTOR,
+    PA_PROP_DEVICE_BUS,
+    PA_PROP_DEVICE_ICON,
+    PA_PROP_DEVICE_ICON_NAME,
+    PA_PROP_DEVICE_ACCESS_MODE,
+    PA_PROP_DEVICE_MASTER_DEVICE,
+    PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE,
+    PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE,
+    PA_PROP_DEVICE_PROFILE_NAME,
+    PA_PROP_DEVICE_INTENDED_ROLES,
+    PA_PROP_DEVICE_PROFILE_DESCRIPTION,
+    PA_PROP_MODULE_AUTHOR,
+    PA_PROP_MODULE_DESCRIPTION,
+    PA_PROP_MODULE_USAGE,
+    PA_PROP_MODULE_VERSION,
+    PA_PROP_FORMAT_SAMPLE_FORMAT,
+    PA_PROP_FORMAT_RATE,
+    PA_PROP_FORMAT_CHANNELS,
+    PA_PROP_FORMAT_CHANNEL_MAP,
+};
+
+static pa_hashmap *interned_keys = NULL;
+
+static void interned_keys_init(void) {
+    unsigned i;
+
+    interned_keys = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    for (i = 0; i < PA_ELEMENTSOF(well_known_keys); i++)
+        pa_hashmap_put(interned_keys, (void*) well_known_keys[i], (void*) well_known_keys[i]);
+}
+
+static const char *intern_key(const char *key) {
+    static pa_once once = PA_ONCE_INIT;
+
+    pa_run_once(&once, interned_keys_init);
+
+    return pa_hashmap_get(interned_keys, key);
+}
+
+/* Interned keys and the keys of shared properties often are the very
+ * same pointer */
+static int key_compare_func(const void *a, const void *b) {
+    if (a == b)
+        return 0;
+
+    return strcmp(a, b);
+}
+
 int pa_proplist_key_valid(const char *key) {
 
     if (!pa_ascii_valid(key))
@@ -53,16 +168,66 @@ int pa_proplist_key_valid(const char *key) {
     return 1;
 }
 
-static void property_free(struct property *prop) {
+static struct property *property_new(const char *key) {
+    struct property *prop;
+    const char *k;
+
+    prop = pa_xnew(struct property, 1);
+    PA_REFCNT_INIT(prop);
+
+    if ((k = intern_key(key))) {
+        prop->key = (char*) k;
+        prop->key_interned = true;
+    } else {
+        prop->key = pa_xstrdup(key);
+        prop->key_interned = false;
+    }
+
+    prop->value = NULL;
+    prop->nbytes = 0;
+
+    return prop;
+}
+
+static void property_unref(struct property *prop) {
     pa_assert(prop);
+    pa_assert(PA_REFCNT_VALUE(prop) >= 1);
+
+    if (PA_REFCNT_DEC(prop) > 0)
+        return;
+
+    if (!prop->key_interned)
+        pa_xfree(prop->key);
 
-    pa_xfree(prop->key);
     pa_xfree(prop->value);
     pa_xfree(prop);
 }
 
+/* Returns the property for key with its old value freed, ready for a
+ * new one. A property that is shared with another proplist is replaced
+ * by a private one first. */
+static struct property *property_for_write(pa_proplist *p, const char *key) {
+    struct property *prop;
+
+    if ((prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
+
+        if (PA_REFCNT_VALUE(prop) == 1) {
+            pa_xfree(prop->value);
+            prop->value = NULL;
+            return prop;
+        }
+
+        pa_hashmap_remove_and_free(MAKE_HASHMAP(p), prop->key);
+    }
+
+    prop = property_new(key);
+    pa_assert_se(pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop) == 0);
+
+    return prop;
+}
+
 pa_proplist* pa_proplist_new(void) {
-    return MAKE_PROPLIST(pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) property_free));
+    return MAKE_PROPLIST(pa_hashmap_new_full(pa_idxset_string_hash_func, key_compare_func, NULL, (pa_free_cb_t) property_unref));
 }
 
 void pa_proplist_free(pa_proplist* p) {
@@ -74,7 +239,6 @@ void pa_proplist_free(pa_proplist* p) {
 /** Will accept only valid UTF-8 */
 int pa_proplist_sets(pa_proplist *p, const char *key, const char *value) {
     struct property *prop;
-    bool add = false;
 
     pa_assert(p);
     pa_assert(key);
@@ -83,26 +247,16 @@ int pa_proplist_sets(pa_proplist *p, const char *key, const char *value) {
     if (!pa_proplist_key_valid(key) || !pa_utf8_valid(value))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
+    prop = property_for_write(p, key);
     prop->value = pa_xstrdup(value);
     prop->nbytes = strlen(value)+1;
 
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
-
     return 0;
 }
 
 /** Will accept only valid UTF-8 */
 static int proplist_setn(pa_proplist *p, const char *key, size_t key_length, const char *value, size_t value_length) {
     struct property *prop;
-    bool add = false;
     char *k, *v;
 
     pa_assert(p);
@@ -118,20 +272,11 @@ static int proplist_setn(pa_proplist *p, const char *key, size_t key_length, con
         return -1;
     }
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), k))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = k;
-        add = true;
-    } else {
-        pa_xfree(prop->value);
-        pa_xfree(k);
-    }
-
+    prop = property_for_write(p, k);
     prop->value = v;
     prop->nbytes = strlen(v)+1;
 
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    pa_xfree(k);
 
     return 0;
 }
@@ -153,7 +298,6 @@ int pa_proplist_setp(pa_proplist *p, const char *pair) {
 
 static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, const char *value, size_t value_length) {
     struct property *prop;
-    bool add = false;
     char *k, *v;
     uint8_t *d;
     size_t dn;
@@ -181,21 +325,13 @@ static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, c
 
     pa_xfree(v);
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), k))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = k;
-        add = true;
-    } else {
-        pa_xfree(prop->value);
-        pa_xfree(k);
-    }
+    prop = property_for_write(p, k);
 
     d[dn] = 0;
     prop->value = d;
     prop->nbytes = dn;
 
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
+    pa_xfree(k);
 
     return 0;
 }
@@ -203,7 +339,6 @@ static int proplist_sethex(pa_proplist *p, const char *key, size_t key_length, c
 /** Will accept only valid UTF-8 */
 int pa_proplist_setf(pa_proplist *p, const char *key, const char *format, ...) {
     struct property *prop;
-    bool add = false;
     va_list ap;
     char *v;
 
@@ -221,19 +356,10 @@ int pa_proplist_setf(pa_proplist *p, const char *key, const char *format, ...) {
     if (!pa_utf8_valid(v))
         goto fail;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
+    prop = property_for_write(p, key);
     prop->value = v;
     prop->nbytes = strlen(v)+1;
 
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
-
     return 0;
 
 fail:
@@ -243,7 +369,6 @@ fail:
 
 int pa_proplist_set(pa_proplist *p, const char *key, const void *data, size_t nbytes) {
     struct property *prop;
-    bool add = false;
 
     pa_assert(p);
     pa_assert(key);
@@ -252,22 +377,13 @@ int pa_proplist_set(pa_proplist *p, const char *key, const void *data, size_t nb
     if (!pa_proplist_key_valid(key))
         return -1;
 
-    if (!(prop = pa_hashmap_get(MAKE_HASHMAP(p), key))) {
-        prop = pa_xnew(struct property, 1);
-        prop->key = pa_xstrdup(key);
-        add = true;
-    } else
-        pa_xfree(prop->value);
-
+    prop = property_for_write(p, key);
     prop->value = pa_xmalloc(nbytes+1);
     if (nbytes > 0)
         memcpy(prop->value, data, nbytes);
     ((char*) prop->value)[nbytes] = 0;
     prop->nbytes = nbytes;
 
-    if (add)
-        pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop);
-
     return 0;
 }
 
@@ -330,13 +446,21 @@ void pa_proplist_update(pa_proplist *p, pa_update_mode_t mode, const pa_proplist
         pa_proplist_clear(p);
 
     /* MAKE_HASHMAP turns the const pointer into a non-const pointer, but
-     * that's ok, because we don't modify the hashmap contents. */
+     * that's ok, because we don't modify the hashmap contents. The
+     * properties themselves are shared rather than copied, see
+     * property_for_write(). */
     while ((prop = pa_hashmap_iterate(MAKE_HASHMAP(other), &state, NULL))) {
+        struct property *old;
 
-        if (mode == PA_UPDATE_MERGE && pa_proplist_contains(p, prop->key))
-            continue;
+        if ((old = pa_hashmap_get(MAKE_HASHMAP(p), prop->key))) {
+            if (mode == PA_UPDATE_MERGE || old == prop)
+                continue;
 
-        pa_assert_se(pa_proplist_set(p, prop->key, prop->value, prop->nbytes) == 0);
+            pa_hashmap_remove_and_free(MAKE_HASHMAP(p), prop->key);
+        }
+
+        PA_REFCNT_INC(prop);
+        pa_assert_se(pa_hashmap_put(MAKE_HASHMAP(p), prop->key, prop) == 0);
     }
 }
 
@@ -694,6 +818,9 @@ int pa_proplist_equal(pa_proplist *a, pa_proplist *b) {
         if (!(b_prop = pa_hashmap_get(MAKE_HASHMAP(b), key)))
             return 0;
 
+        if (a_prop == b_prop)
+            continue;
+
         if (a_prop->nbytes != b_prop->nbytes)
             return 0;
 
@@ -69,6 +69,9 @@ PA_C_DECL_BEGIN
 /** For streams: the name of a filter that is desired, e.g.\ "echo-cancel" or "equalizer-sink". Differs from PA_PROP_FILTER_WANT in that it forces PulseAudio to apply the filter, regardless of whether PulseAudio thinks it makes sense to do so or not. If this is set, PA_PROP_FILTER_WANT is ignored. In other words, you almost certainly do not want to use this. \since 1.0 */
 #define PA_PROP_FILTER_APPLY                   "filter.apply"
 
+/** For streams: module arguments for the filter named in PA_PROP_FILTER_APPLY, with %s replaced by the filter name, e.g.\ "filter.apply.equalizer-sink.parameters". Streams asking for the same filter with the same parameters on the same device share one instance of it. \since 11.0 */
+#define PA_PROP_FILTER_APPLY_PARAMETERS        "filter.apply.%s.parameters"
+
 /** For streams: the name of a filter that should specifically suppressed (i.e.\ overrides PA_PROP_FILTER_WANT). Useful for the times that PA_PROP_FILTER_WANT is automatically added (e.g. echo-cancellation for phone streams when $VOIP_APP does its own, internal AEC) \since 1.0 */
 #define PA_PROP_FILTER_SUPPRESS                "filter.suppress"
 
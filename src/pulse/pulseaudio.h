@@ -28,6 +28,7 @@
 #include <pulse/def.h>
 #include <pulse/context.h>
 #include <pulse/stream.h>
+#include <pulse/submix.h>
 #include <pulse/introspect.h>
 #include <pulse/subscribe.h>
 #include <pulse/scache.h>
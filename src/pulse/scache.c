@@ -90,9 +90,30 @@ int pa_stream_finish_upload(pa_stream *s) {
 
     pa_stream_ref(s);
 
-    t = pa_tagstruct_command(s->context, PA_COMMAND_FINISH_UPLOAD_STREAM, &tag);
-    pa_tagstruct_putu32(t, s->channel);
-    pa_pstream_send_tagstruct(s->context->pstream, t);
+    if (s->upload_shm) {
+        int fd;
+
+        /* Once sealed, the server can keep the memfd as the sample
+         * without copying it */
+        fd = pa_shm_seal(s->upload_shm);
+        pa_xfree(s->upload_shm);
+        s->upload_shm = NULL;
+
+        if (fd < 0) {
+            pa_stream_set_state(s, PA_STREAM_FAILED);
+            pa_stream_unref(s);
+            return -pa_context_set_error(s->context, PA_ERR_INTERNAL);
+        }
+
+        t = pa_tagstruct_command(s->context, PA_COMMAND_FINISH_UPLOAD_STREAM_MEMFD, &tag);
+        pa_tagstruct_putu32(t, s->channel);
+        pa_pstream_send_tagstruct_with_fds(s->context->pstream, t, 1, &fd, true);
+    } else {
+        t = pa_tagstruct_command(s->context, PA_COMMAND_FINISH_UPLOAD_STREAM, &tag);
+        pa_tagstruct_putu32(t, s->channel);
+        pa_pstream_send_tagstruct(s->context->pstream, t);
+    }
+
     pa_pdispatch_register_reply(s->context->pdispatch, tag, DEFAULT_TIMEOUT, pa_stream_disconnect_callback, s, NULL);
 
     pa_stream_unref(s);
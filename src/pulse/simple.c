@@ -44,6 +44,9 @@ struct pa_simple {
     const void *read_data;
     size_t read_index, read_length;
 
+    void *write_data;
+    size_t write_length;
+
     int operation_success;
 };
 
@@ -275,6 +278,7 @@ int pa_simple_write(pa_simple *p, const void*data, size_t length, int *rerror) {
     CHECK_VALIDITY_RETURN_ANY(rerror, p->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE, -1);
     CHECK_VALIDITY_RETURN_ANY(rerror, data, PA_ERR_INVALID, -1);
     CHECK_VALIDITY_RETURN_ANY(rerror, length > 0, PA_ERR_INVALID, -1);
+    CHECK_VALIDITY_RETURN_ANY(rerror, !p->write_data, PA_ERR_BADSTATE, -1);
 
     pa_threaded_mainloop_lock(p->mainloop);
 
@@ -309,6 +313,105 @@ unlock_and_fail:
     return -1;
 }
 
+int pa_simple_begin_write(pa_simple *p, void **data, size_t *nbytes, int *rerror) {
+    size_t l;
+    int r;
+
+    pa_assert(p);
+
+    CHECK_VALIDITY_RETURN_ANY(rerror, p->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE, -1);
+    CHECK_VALIDITY_RETURN_ANY(rerror, data, PA_ERR_INVALID, -1);
+    CHECK_VALIDITY_RETURN_ANY(rerror, nbytes && *nbytes > 0, PA_ERR_INVALID, -1);
+    CHECK_VALIDITY_RETURN_ANY(rerror, !p->write_data, PA_ERR_BADSTATE, -1);
+
+    pa_threaded_mainloop_lock(p->mainloop);
+
+    CHECK_DEAD_GOTO(p, rerror, unlock_and_fail);
+
+    while (!(l = pa_stream_writable_size(p->stream))) {
+        pa_threaded_mainloop_wait(p->mainloop);
+        CHECK_DEAD_GOTO(p, rerror, unlock_and_fail);
+    }
+
+    CHECK_SUCCESS_GOTO(p, rerror, l != (size_t) -1, unlock_and_fail);
+
+    if (l > *nbytes)
+        l = *nbytes;
+
+    /* The buffer comes straight from the memory pool, which is
+     * usually shared with the server, so pa_simple_end_write() can
+     * pass it on without copying */
+    r = pa_stream_begin_write(p->stream, &p->write_data, &l);
+    CHECK_SUCCESS_GOTO(p, rerror, r >= 0, unlock_and_fail);
+
+    p->write_length = l;
+
+    *data = p->write_data;
+    *nbytes = l;
+
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return 0;
+
+unlock_and_fail:
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return -1;
+}
+
+int pa_simple_end_write(pa_simple *p, size_t length, int *rerror) {
+    void *data;
+    int r;
+
+    pa_assert(p);
+
+    CHECK_VALIDITY_RETURN_ANY(rerror, p->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE, -1);
+    CHECK_VALIDITY_RETURN_ANY(rerror, p->write_data, PA_ERR_BADSTATE, -1);
+    CHECK_VALIDITY_RETURN_ANY(rerror, length <= p->write_length, PA_ERR_INVALID, -1);
+
+    pa_threaded_mainloop_lock(p->mainloop);
+
+    data = p->write_data;
+    p->write_data = NULL;
+    p->write_length = 0;
+
+    CHECK_DEAD_GOTO(p, rerror, unlock_and_fail);
+
+    if (length > 0)
+        r = pa_stream_write(p->stream, data, length, NULL, 0LL, PA_SEEK_RELATIVE);
+    else
+        r = pa_stream_cancel_write(p->stream);
+
+    CHECK_SUCCESS_GOTO(p, rerror, r >= 0, unlock_and_fail);
+
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return 0;
+
+unlock_and_fail:
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return -1;
+}
+
+size_t pa_simple_get_writable_size(pa_simple *p, int *rerror) {
+    size_t l;
+
+    pa_assert(p);
+
+    CHECK_VALIDITY_RETURN_ANY(rerror, p->direction == PA_STREAM_PLAYBACK, PA_ERR_BADSTATE, (size_t) -1);
+
+    pa_threaded_mainloop_lock(p->mainloop);
+
+    CHECK_DEAD_GOTO(p, rerror, unlock_and_fail);
+
+    l = pa_stream_writable_size(p->stream);
+    CHECK_SUCCESS_GOTO(p, rerror, l != (size_t) -1, unlock_and_fail);
+
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return l;
+
+unlock_and_fail:
+    pa_threaded_mainloop_unlock(p->mainloop);
+    return (size_t) -1;
+}
+
 int pa_simple_read(pa_simple *p, void*data, size_t length, int *rerror) {
     pa_assert(p);
 
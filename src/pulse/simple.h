@@ -74,6 +74,11 @@
  * system calls. The main difference is that they're called pa_simple_read()
  * and pa_simple_write(). Note that these operations always block.
  *
+ * Playback data can also be written in place, into buffers obtained with
+ * pa_simple_begin_write() and handed over with pa_simple_end_write().
+ * Use pa_simple_get_writable_size() to find out how much can be written
+ * without blocking.
+ *
  * \section ctrl_sec Buffer control
  *
  * \li pa_simple_get_latency() - Will return the total latency of
@@ -133,6 +138,23 @@ void pa_simple_free(pa_simple *s);
 /** Write some data to the server. */
 int pa_simple_write(pa_simple *s, const void *data, size_t bytes, int *error);
 
+/** Get a buffer to write data to, so that the copy pa_simple_write()
+ * makes can be saved. Blocks until the server accepts more data. On
+ * input \a nbytes is the most the caller wants to write, on return it
+ * is the size of the buffer in \a data, which may be smaller. Pass
+ * the data on with pa_simple_end_write() before calling any other
+ * write function. Returns a negative value on failure. \since 11.0 */
+int pa_simple_begin_write(pa_simple *s, void **data, size_t *nbytes, int *error);
+
+/** Write the first \a bytes of the buffer from pa_simple_begin_write()
+ * to the server, or drop the buffer if \a bytes is 0. Returns a
+ * negative value on failure. \since 11.0 */
+int pa_simple_end_write(pa_simple *s, size_t bytes, int *error);
+
+/** Return the number of bytes that can be written without blocking,
+ * or (size_t) -1 on failure. \since 11.0 */
+size_t pa_simple_get_writable_size(pa_simple *s, int *error);
+
 /** Wait until all data already written is played by the daemon. */
 int pa_simple_drain(pa_simple *s, int *error);
 
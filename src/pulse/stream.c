@@ -52,6 +52,9 @@
 #define SMOOTHER_HISTORY_TIME (5000*PA_USEC_PER_MSEC)
 #define SMOOTHER_MIN_HISTORY (4)
 
+/* The server doesn't cache larger samples anyway */
+#define UPLOAD_MEMFD_SIZE_MAX (16*1024*1024)
+
 pa_stream *pa_stream_new(pa_context *c, const char *name, const pa_sample_spec *ss, const pa_channel_map *map) {
     return pa_stream_new_with_proplist(c, name, ss, map, NULL);
 }
@@ -177,6 +180,9 @@ static pa_stream *pa_stream_new_with_proplist_internal(
     s->peek_data = NULL;
     s->record_memblockq = NULL;
 
+    s->upload_shm = NULL;
+    s->upload_index = 0;
+
     memset(&s->timing_info, 0, sizeof(s->timing_info));
     s->timing_info_valid = false;
 
@@ -299,6 +305,11 @@ static void stream_free(pa_stream *s) {
     if (s->record_memblockq)
         pa_memblockq_free(s->record_memblockq);
 
+    if (s->upload_shm) {
+        pa_shm_free(s->upload_shm);
+        pa_xfree(s->upload_shm);
+    }
+
     if (s->proplist)
         pa_proplist_free(s->proplist);
 
@@ -1038,35 +1049,40 @@ static void patch_buffer_attr(pa_stream *s, pa_buffer_attr *attr, pa_stream_flag
         attr->fragsize = attr->tlength; /* Pass data to the app only when the buffer is filled up once */
 }
 
-void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
-    pa_stream *s = userdata;
+/* Parses the reply to a stream creation request and makes s ready */
+static void create_stream_reply(pa_stream *s, pa_tagstruct *t) {
     uint32_t requested_bytes = 0;
 
-    pa_assert(pd);
     pa_assert(s);
-    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+    pa_assert(t);
     pa_assert(s->state == PA_STREAM_CREATING);
 
-    pa_stream_ref(s);
-
-    if (command != PA_COMMAND_REPLY) {
-        if (pa_context_handle_error(s->context, command, t, false) < 0)
-            goto finish;
-
-        pa_stream_set_state(s, PA_STREAM_FAILED);
-        goto finish;
-    }
-
     if (pa_tagstruct_getu32(t, &s->channel) < 0 ||
         s->channel == PA_INVALID_INDEX ||
         ((s->direction != PA_STREAM_UPLOAD) && (pa_tagstruct_getu32(t, &s->stream_index) < 0 || s->stream_index == PA_INVALID_INDEX)) ||
         ((s->direction != PA_STREAM_RECORD) && pa_tagstruct_getu32(t, &requested_bytes) < 0)) {
         pa_context_fail(s->context, PA_ERR_PROTOCOL);
-        goto finish;
+        return;
     }
 
     s->requested_bytes = (int64_t) requested_bytes;
 
+    /* Since protocol version 33 the sample of an upload stream may be
+     * passed as one memfd, which the server keeps as it is. So we
+     * collect it in one right away instead of sending memblocks. */
+    if (s->direction == PA_STREAM_UPLOAD &&
+        s->context->version >= 33 &&
+        s->context->shm_type == PA_MEM_TYPE_SHARED_MEMFD &&
+        requested_bytes > 0 && requested_bytes <= UPLOAD_MEMFD_SIZE_MAX) {
+
+        s->upload_shm = pa_xnew(pa_shm, 1);
+
+        if (pa_shm_create_rw(s->upload_shm, PA_MEM_TYPE_SHARED_MEMFD, requested_bytes, 0600) < 0) {
+            pa_xfree(s->upload_shm);
+            s->upload_shm = NULL;
+        }
+    }
+
     if (s->context->version >= 9) {
         if (s->direction == PA_STREAM_PLAYBACK) {
             if (pa_tagstruct_getu32(t, &s->buffer_attr.maxlength) < 0 ||
@@ -1074,13 +1090,13 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
                 pa_tagstruct_getu32(t, &s->buffer_attr.prebuf) < 0 ||
                 pa_tagstruct_getu32(t, &s->buffer_attr.minreq) < 0) {
                 pa_context_fail(s->context, PA_ERR_PROTOCOL);
-                goto finish;
+                return;
             }
         } else if (s->direction == PA_STREAM_RECORD) {
             if (pa_tagstruct_getu32(t, &s->buffer_attr.maxlength) < 0 ||
                 pa_tagstruct_getu32(t, &s->buffer_attr.fragsize) < 0) {
                 pa_context_fail(s->context, PA_ERR_PROTOCOL);
-                goto finish;
+                return;
             }
         }
     }
@@ -1097,7 +1113,7 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
             pa_tagstruct_gets(t, &dn) < 0 ||
             pa_tagstruct_get_boolean(t, &suspended) < 0) {
             pa_context_fail(s->context, PA_ERR_PROTOCOL);
-            goto finish;
+            return;
         }
 
         if (!dn || s->device_index == PA_INVALID_INDEX ||
@@ -1109,7 +1125,7 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
                 (!(s->flags & PA_STREAM_FIX_RATE) && ss.rate != s->sample_spec.rate) ||
                 (!(s->flags & PA_STREAM_FIX_CHANNELS) && !pa_channel_map_equal(&cm, &s->channel_map))))) {
             pa_context_fail(s->context, PA_ERR_PROTOCOL);
-            goto finish;
+            return;
         }
 
         pa_xfree(s->device_name);
@@ -1125,7 +1141,7 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
 
         if (pa_tagstruct_get_usec(t, &usec) < 0) {
             pa_context_fail(s->context, PA_ERR_PROTOCOL);
-            goto finish;
+            return;
         }
 
         if (s->direction == PA_STREAM_RECORD)
@@ -1144,7 +1160,7 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
             if (s->n_formats > 0) {
                 /* We used the extended API, so we should have got back a proper format */
                 pa_context_fail(s->context, PA_ERR_PROTOCOL);
-                goto finish;
+                return;
             }
         } else
             s->format = f;
@@ -1152,7 +1168,7 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
 
     if (!pa_tagstruct_eof(t)) {
         pa_context_fail(s->context, PA_ERR_PROTOCOL);
-        goto finish;
+        return;
     }
 
     if (s->direction == PA_STREAM_RECORD) {
@@ -1174,26 +1190,39 @@ void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag,
     pa_hashmap_put((s->direction == PA_STREAM_RECORD) ? s->context->record_streams : s->context->playback_streams, PA_UINT32_TO_PTR(s->channel), s);
 
     create_stream_complete(s);
+}
+
+void pa_create_stream_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_stream *s = userdata;
+
+    pa_assert(pd);
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+    pa_assert(s->state == PA_STREAM_CREATING);
+
+    pa_stream_ref(s);
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(s->context, command, t, false) < 0)
+            goto finish;
+
+        pa_stream_set_state(s, PA_STREAM_FAILED);
+        goto finish;
+    }
+
+    create_stream_reply(s, t);
 
 finish:
     pa_stream_unref(s);
 }
 
-static int create_stream(
+/* Checks whether s may be connected with the given parameters */
+static int create_stream_check(
         pa_stream_direction_t direction,
         pa_stream *s,
-        const char *dev,
-        const pa_buffer_attr *attr,
         pa_stream_flags_t flags,
-        const pa_cvolume *volume,
         pa_stream *sync_stream) {
 
-    pa_tagstruct *t;
-    uint32_t tag;
-    bool volume_set = !!volume;
-    pa_cvolume cv;
-    uint32_t i;
-
     pa_assert(s);
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
     pa_assert(direction == PA_STREAM_PLAYBACK || direction == PA_STREAM_RECORD);
@@ -1234,7 +1263,15 @@ static int create_stream(
     PA_CHECK_VALIDITY(s->context, !sync_stream || (direction == PA_STREAM_PLAYBACK && sync_stream->direction == PA_STREAM_PLAYBACK), PA_ERR_INVALID);
     PA_CHECK_VALIDITY(s->context, (flags & (PA_STREAM_ADJUST_LATENCY|PA_STREAM_EARLY_REQUESTS)) != (PA_STREAM_ADJUST_LATENCY|PA_STREAM_EARLY_REQUESTS), PA_ERR_INVALID);
 
-    pa_stream_ref(s);
+    return 0;
+}
+
+static void create_stream_setup(
+        pa_stream_direction_t direction,
+        pa_stream *s,
+        const pa_buffer_attr *attr,
+        pa_stream_flags_t flags,
+        pa_stream *sync_stream) {
 
     s->direction = direction;
 
@@ -1263,14 +1300,13 @@ static int create_stream(
                 x,
                 true);
     }
+}
 
-    if (!dev)
-        dev = s->direction == PA_STREAM_PLAYBACK ? s->context->conf->default_sink : s->context->conf->default_source;
-
-    t = pa_tagstruct_command(
-            s->context,
-            (uint32_t) (s->direction == PA_STREAM_PLAYBACK ? PA_COMMAND_CREATE_PLAYBACK_STREAM : PA_COMMAND_CREATE_RECORD_STREAM),
-            &tag);
+/* Appends the parameters of a stream creation request for s to t */
+static void create_stream_put(pa_stream *s, pa_tagstruct *t, const char *dev, const pa_cvolume *volume) {
+    bool volume_set = !!volume;
+    pa_cvolume cv;
+    uint32_t i;
 
     if (s->context->version < 13)
         pa_tagstruct_puts(t, pa_proplist_gets(s->proplist, PA_PROP_MEDIA_NAME));
@@ -1312,26 +1348,26 @@ static int create_stream(
     if (s->context->version >= 12) {
         pa_tagstruct_put(
                 t,
-                PA_TAG_BOOLEAN, flags & PA_STREAM_NO_REMAP_CHANNELS,
-                PA_TAG_BOOLEAN, flags & PA_STREAM_NO_REMIX_CHANNELS,
-                PA_TAG_BOOLEAN, flags & PA_STREAM_FIX_FORMAT,
-                PA_TAG_BOOLEAN, flags & PA_STREAM_FIX_RATE,
-                PA_TAG_BOOLEAN, flags & PA_STREAM_FIX_CHANNELS,
-                PA_TAG_BOOLEAN, flags & PA_STREAM_DONT_MOVE,
-                PA_TAG_BOOLEAN, flags & PA_STREAM_VARIABLE_RATE,
+                PA_TAG_BOOLEAN, s->flags & PA_STREAM_NO_REMAP_CHANNELS,
+                PA_TAG_BOOLEAN, s->flags & PA_STREAM_NO_REMIX_CHANNELS,
+                PA_TAG_BOOLEAN, s->flags & PA_STREAM_FIX_FORMAT,
+                PA_TAG_BOOLEAN, s->flags & PA_STREAM_FIX_RATE,
+                PA_TAG_BOOLEAN, s->flags & PA_STREAM_FIX_CHANNELS,
+                PA_TAG_BOOLEAN, s->flags & PA_STREAM_DONT_MOVE,
+                PA_TAG_BOOLEAN, s->flags & PA_STREAM_VARIABLE_RATE,
                 PA_TAG_INVALID);
     }
 
     if (s->context->version >= 13) {
 
         if (s->direction == PA_STREAM_PLAYBACK)
-            pa_tagstruct_put_boolean(t, flags & PA_STREAM_START_MUTED);
+            pa_tagstruct_put_boolean(t, s->flags & PA_STREAM_START_MUTED);
         else
-            pa_tagstruct_put_boolean(t, flags & PA_STREAM_PEAK_DETECT);
+            pa_tagstruct_put_boolean(t, s->flags & PA_STREAM_PEAK_DETECT);
 
         pa_tagstruct_put(
                 t,
-                PA_TAG_BOOLEAN, flags & PA_STREAM_ADJUST_LATENCY,
+                PA_TAG_BOOLEAN, s->flags & PA_STREAM_ADJUST_LATENCY,
                 PA_TAG_PROPLIST, s->proplist,
                 PA_TAG_INVALID);
 
@@ -1344,23 +1380,23 @@ static int create_stream(
         if (s->direction == PA_STREAM_PLAYBACK)
             pa_tagstruct_put_boolean(t, volume_set);
 
-        pa_tagstruct_put_boolean(t, flags & PA_STREAM_EARLY_REQUESTS);
+        pa_tagstruct_put_boolean(t, s->flags & PA_STREAM_EARLY_REQUESTS);
     }
 
     if (s->context->version >= 15) {
 
         if (s->direction == PA_STREAM_PLAYBACK)
-            pa_tagstruct_put_boolean(t, flags & (PA_STREAM_START_MUTED|PA_STREAM_START_UNMUTED));
+            pa_tagstruct_put_boolean(t, s->flags & (PA_STREAM_START_MUTED|PA_STREAM_START_UNMUTED));
 
-        pa_tagstruct_put_boolean(t, flags & PA_STREAM_DONT_INHIBIT_AUTO_SUSPEND);
-        pa_tagstruct_put_boolean(t, flags & PA_STREAM_FAIL_ON_SUSPEND);
+        pa_tagstruct_put_boolean(t, s->flags & PA_STREAM_DONT_INHIBIT_AUTO_SUSPEND);
+        pa_tagstruct_put_boolean(t, s->flags & PA_STREAM_FAIL_ON_SUSPEND);
     }
 
     if (s->context->version >= 17 && s->direction == PA_STREAM_PLAYBACK)
-        pa_tagstruct_put_boolean(t, flags & PA_STREAM_RELATIVE_VOLUME);
+        pa_tagstruct_put_boolean(t, s->flags & PA_STREAM_RELATIVE_VOLUME);
 
     if (s->context->version >= 18 && s->direction == PA_STREAM_PLAYBACK)
-        pa_tagstruct_put_boolean(t, flags & (PA_STREAM_PASSTHROUGH));
+        pa_tagstruct_put_boolean(t, s->flags & (PA_STREAM_PASSTHROUGH));
 
     if ((s->context->version >= 21 && s->direction == PA_STREAM_PLAYBACK)
         || s->context->version >= 22) {
@@ -1372,12 +1408,43 @@ static int create_stream(
 
     if (s->context->version >= 22 && s->direction == PA_STREAM_RECORD) {
         pa_tagstruct_put_cvolume(t, volume);
-        pa_tagstruct_put_boolean(t, flags & PA_STREAM_START_MUTED);
+        pa_tagstruct_put_boolean(t, s->flags & PA_STREAM_START_MUTED);
         pa_tagstruct_put_boolean(t, volume_set);
-        pa_tagstruct_put_boolean(t, flags & (PA_STREAM_START_MUTED|PA_STREAM_START_UNMUTED));
-        pa_tagstruct_put_boolean(t, flags & PA_STREAM_RELATIVE_VOLUME);
-        pa_tagstruct_put_boolean(t, flags & (PA_STREAM_PASSTHROUGH));
+        pa_tagstruct_put_boolean(t, s->flags & (PA_STREAM_START_MUTED|PA_STREAM_START_UNMUTED));
+        pa_tagstruct_put_boolean(t, s->flags & PA_STREAM_RELATIVE_VOLUME);
+        pa_tagstruct_put_boolean(t, s->flags & (PA_STREAM_PASSTHROUGH));
     }
+}
+
+static int create_stream(
+        pa_stream_direction_t direction,
+        pa_stream *s,
+        const char *dev,
+        const pa_buffer_attr *attr,
+        pa_stream_flags_t flags,
+        const pa_cvolume *volume,
+        pa_stream *sync_stream) {
+
+    pa_tagstruct *t;
+    uint32_t tag;
+    int r;
+
+    if ((r = create_stream_check(direction, s, flags, sync_stream)) < 0)
+        return r;
+
+    pa_stream_ref(s);
+
+    create_stream_setup(direction, s, attr, flags, sync_stream);
+
+    if (!dev)
+        dev = s->direction == PA_STREAM_PLAYBACK ? s->context->conf->default_sink : s->context->conf->default_source;
+
+    t = pa_tagstruct_command(
+            s->context,
+            (uint32_t) (s->direction == PA_STREAM_PLAYBACK ? PA_COMMAND_CREATE_PLAYBACK_STREAM : PA_COMMAND_CREATE_RECORD_STREAM),
+            &tag);
+
+    create_stream_put(s, t, dev, volume);
 
     pa_pstream_send_tagstruct(s->context->pstream, t);
     pa_pdispatch_register_reply(s->context->pdispatch, tag, DEFAULT_TIMEOUT, pa_create_stream_callback, s, NULL);
@@ -1402,6 +1469,169 @@ int pa_stream_connect_playback(
     return create_stream(PA_STREAM_PLAYBACK, s, dev, attr, flags, volume, sync_stream);
 }
 
+struct create_streams_data {
+    unsigned n;
+    pa_stream **streams;
+};
+
+static void create_streams_data_free(void *userdata) {
+    struct create_streams_data *d = userdata;
+    unsigned i;
+
+    pa_assert(d);
+
+    for (i = 0; i < d->n; i++)
+        pa_stream_unref(d->streams[i]);
+
+    pa_xfree(d->streams);
+    pa_xfree(d);
+}
+
+static void create_streams_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    struct create_streams_data *d = userdata;
+    pa_context *c;
+    uint32_t n;
+    unsigned i;
+
+    pa_assert(pd);
+    pa_assert(d);
+    pa_assert(d->n > 0);
+
+    c = d->streams[0]->context;
+    pa_context_ref(c);
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(c, command, t, false) < 0)
+            goto finish;
+
+        for (i = 0; i < d->n; i++)
+            if (d->streams[i]->state == PA_STREAM_CREATING)
+                pa_stream_set_state(d->streams[i], PA_STREAM_FAILED);
+
+        goto finish;
+    }
+
+    if (pa_tagstruct_getu32(t, &n) < 0 || n != d->n) {
+        pa_context_fail(c, PA_ERR_PROTOCOL);
+        goto finish;
+    }
+
+    for (i = 0; i < d->n; i++) {
+        pa_stream *s = d->streams[i];
+        uint32_t length;
+        const void *data;
+        pa_tagstruct *reply;
+
+        /* Each stream's section is the reply to a single
+         * PA_COMMAND_CREATE_PLAYBACK_STREAM, so that it can be parsed
+         * the same way */
+        if (pa_tagstruct_getu32(t, &length) < 0 ||
+            pa_tagstruct_get_arbitrary(t, &data, length) < 0) {
+            pa_context_fail(c, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        if (s->state != PA_STREAM_CREATING)
+            continue;
+
+        reply = pa_tagstruct_new_fixed(data, length);
+        create_stream_reply(s, reply);
+        pa_tagstruct_free(reply);
+
+        if (c->state != PA_CONTEXT_READY)
+            goto finish;
+    }
+
+    if (!pa_tagstruct_eof(t))
+        pa_context_fail(c, PA_ERR_PROTOCOL);
+
+finish:
+    create_streams_data_free(d);
+    pa_context_unref(c);
+}
+
+int pa_stream_connect_playback_multiple(
+        pa_stream *const *streams,
+        unsigned n,
+        const char *dev,
+        const pa_buffer_attr *attr,
+        pa_stream_flags_t flags,
+        const pa_cvolume *volume) {
+
+    struct create_streams_data *d;
+    pa_context *c;
+    pa_tagstruct *t;
+    uint32_t tag;
+    unsigned i, j;
+    int r;
+
+    pa_assert(streams);
+    pa_assert(n > 0);
+    pa_assert(streams[0]);
+
+    c = streams[0]->context;
+
+    PA_CHECK_VALIDITY(c, n <= PA_NATIVE_CREATE_STREAMS_MAX, PA_ERR_TOOLARGE);
+
+    /* Check everything first, so that either all or none of the streams
+     * are connected */
+    for (i = 0; i < n; i++) {
+        pa_assert(streams[i]);
+        pa_assert(PA_REFCNT_VALUE(streams[i]) >= 1);
+
+        PA_CHECK_VALIDITY(c, streams[i]->context == c, PA_ERR_INVALID);
+
+        for (j = 0; j < i; j++)
+            PA_CHECK_VALIDITY(c, streams[j] != streams[i], PA_ERR_INVALID);
+
+        if ((r = create_stream_check(PA_STREAM_PLAYBACK, streams[i], flags, NULL)) < 0)
+            return r;
+    }
+
+    if (!dev)
+        dev = c->conf->default_sink;
+
+    if (c->version < 33) {
+        for (i = 0; i < n; i++)
+            pa_assert_se(create_stream(PA_STREAM_PLAYBACK, streams[i], dev, attr, flags, volume, NULL) == 0);
+
+        return 0;
+    }
+
+    d = pa_xnew(struct create_streams_data, 1);
+    d->n = n;
+    d->streams = pa_xnew(pa_stream *, n);
+
+    t = pa_tagstruct_command(c, PA_COMMAND_CREATE_PLAYBACK_STREAMS, &tag);
+    pa_tagstruct_putu32(t, n);
+
+    for (i = 0; i < n; i++) {
+        pa_stream *s = streams[i];
+        pa_tagstruct *request;
+        const uint8_t *data;
+        size_t length;
+
+        d->streams[i] = pa_stream_ref(s);
+
+        create_stream_setup(PA_STREAM_PLAYBACK, s, attr, flags, NULL);
+
+        request = pa_tagstruct_new();
+        create_stream_put(s, request, dev, volume);
+        data = pa_tagstruct_data(request, &length);
+        pa_tagstruct_putu32(t, (uint32_t) length);
+        pa_tagstruct_put_arbitrary(t, data, length);
+        pa_tagstruct_free(request);
+    }
+
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, create_streams_callback, d, create_streams_data_free);
+
+    for (i = 0; i < n; i++)
+        pa_stream_set_state(streams[i], PA_STREAM_CREATING);
+
+    return 0;
+}
+
 int pa_stream_connect_record(
         pa_stream *s,
         const char *dev,
@@ -1498,7 +1728,24 @@ int pa_stream_write_ext_free(
     PA_CHECK_VALIDITY(s->context, length % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
     PA_CHECK_VALIDITY(s->context, !free_cb || !s->write_memblock, PA_ERR_INVALID);
 
-    if (s->write_memblock) {
+    if (s->upload_shm) {
+        size_t n;
+
+        /* Whatever doesn't fit is beyond the length of the sample and
+         * would be dropped by the server anyway */
+        n = PA_MIN(length, s->upload_shm->size - s->upload_index);
+        memcpy((uint8_t*) s->upload_shm->ptr + s->upload_index, data, n);
+        s->upload_index += n;
+
+        if (s->write_memblock) {
+            pa_memblock_release(s->write_memblock);
+            pa_memblock_unref(s->write_memblock);
+            s->write_memblock = NULL;
+            s->write_data = NULL;
+        } else if (free_cb)
+            free_cb(free_cb_data);
+
+    } else if (s->write_memblock) {
         pa_memchunk chunk;
 
         /* pa_stream_write_begin() was called before */
@@ -1792,6 +2039,91 @@ static pa_usec_t calc_time(pa_stream *s, bool ignore_transport) {
     return usec;
 }
 
+static void update_smoother(pa_stream *s) {
+    pa_timing_info *i = &s->timing_info;
+    pa_usec_t u, x;
+
+    /* Update smoother if we're not corked */
+    if (!s->smoother || s->corked)
+        return;
+
+    u = x = pa_rtclock_now() - i->transport_usec;
+
+    if (s->direction == PA_STREAM_PLAYBACK && s->context->version >= 13) {
+        pa_usec_t su;
+
+        /* If we weren't playing then it will take some time
+         * until the audio will actually come out through the
+         * speakers. Since we follow that timing here, we need
+         * to try to fix this up */
+
+        su = pa_bytes_to_usec((uint64_t) i->since_underrun, &s->sample_spec);
+
+        if (su < i->sink_usec)
+            x += i->sink_usec - su;
+    }
+
+    if (!i->playing)
+        pa_smoother_pause(s->smoother, x);
+
+    /* Update the smoother */
+    if ((s->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
+        (s->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
+        pa_smoother_put(s->smoother, u, calc_time(s, true));
+
+    if (i->playing)
+        pa_smoother_resume(s->smoother, x, true);
+}
+
+/* Refreshes the timing of a playback stream from what the server
+ * published into the shm of the srbchannel, so that latency queries
+ * don't need a round trip. The write index is ours anyway. */
+static void update_timing_info_from_shm(pa_stream *s) {
+    pa_srbchannel_timing_slot *slot;
+    pa_srbchannel_timing t;
+    pa_timing_info *i = &s->timing_info;
+    pa_usec_t now;
+
+    if (s->direction != PA_STREAM_PLAYBACK ||
+        s->context->version < 33 ||
+        !s->context->srb_template.memblock)
+        return;
+
+    /* After the read index got invalidated we need to wait for the reply
+     * to the query that was sent then, what the server published might
+     * still predate the invalidation */
+    if (!s->timing_info_valid || i->read_index_corrupt)
+        return;
+
+    if (!(slot = pa_srbchannel_get_timing_slot(s->context->srb_template.memblock, s->channel)))
+        return;
+
+    if (!pa_srbchannel_timing_read(slot, &t) || t.channel != s->channel)
+        return;
+
+    /* Nothing new since the last time */
+    if (t.timestamp == s->shm_timing_timestamp)
+        return;
+
+    s->shm_timing_timestamp = t.timestamp;
+
+    /* The age of the data takes the place of the transport latency */
+    now = pa_rtclock_now();
+
+    i->read_index = t.read_index;
+    i->sink_usec = t.sink_usec;
+    i->source_usec = 0;
+    i->playing = (int) t.playing;
+    i->since_underrun = (int64_t) t.since_underrun;
+    i->transport_usec = now > t.timestamp ? now - t.timestamp : 0;
+    i->synchronized_clocks = true;
+
+    pa_gettimeofday(&i->timestamp);
+    pa_timeval_sub(&i->timestamp, i->transport_usec);
+
+    update_smoother(s);
+}
+
 static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     struct timeval local, remote, now;
@@ -1929,37 +2261,7 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
                 i->read_index -= (int64_t) pa_memblockq_get_length(o->stream->record_memblockq);
         }
 
-        /* Update smoother if we're not corked */
-        if (o->stream->smoother && !o->stream->corked) {
-            pa_usec_t u, x;
-
-            u = x = pa_rtclock_now() - i->transport_usec;
-
-            if (o->stream->direction == PA_STREAM_PLAYBACK && o->context->version >= 13) {
-                pa_usec_t su;
-
-                /* If we weren't playing then it will take some time
-                 * until the audio will actually come out through the
-                 * speakers. Since we follow that timing here, we need
-                 * to try to fix this up */
-
-                su = pa_bytes_to_usec((uint64_t) i->since_underrun, &o->stream->sample_spec);
-
-                if (su < i->sink_usec)
-                    x += i->sink_usec - su;
-            }
-
-            if (!i->playing)
-                pa_smoother_pause(o->stream->smoother, x);
-
-            /* Update the smoother */
-            if ((o->stream->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
-                (o->stream->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
-                pa_smoother_put(o->stream->smoother, u, calc_time(o->stream, true));
-
-            if (i->playing)
-                pa_smoother_resume(o->stream->smoother, x, true);
-        }
+        update_smoother(o->stream);
     }
 
     o->stream->auto_timing_update_requested = false;
@@ -2466,6 +2768,8 @@ int pa_stream_get_time(pa_stream *s, pa_usec_t *r_usec) {
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_PLAYBACK || !s->timing_info.read_index_corrupt, PA_ERR_NODATA);
     PA_CHECK_VALIDITY(s->context, s->direction != PA_STREAM_RECORD || !s->timing_info.write_index_corrupt, PA_ERR_NODATA);
 
+    update_timing_info_from_shm(s);
+
     if (s->smoother)
         usec = pa_smoother_get(s->smoother, pa_rtclock_now());
     else
@@ -2549,6 +2853,8 @@ const pa_timing_info* pa_stream_get_timing_info(pa_stream *s) {
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->direction != PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->timing_info_valid, PA_ERR_NODATA);
 
+    update_timing_info_from_shm(s);
+
     return &s->timing_info;
 }
 
@@ -463,6 +463,25 @@ int pa_stream_connect_playback(
         const pa_cvolume *volume      /**< Initial volume, or NULL for default */,
         pa_stream *sync_stream        /**< Synchronize this stream with the specified one, or NULL for a standalone stream */);
 
+/** Connect several streams to the same sink at once. This is equivalent
+ * to calling pa_stream_connect_playback() with the same parameters on each
+ * of the \a n streams, without a sync stream, but sends only one request
+ * to the server, which answers for all streams in one reply. This makes
+ * starting many short streams at once, as games tend to do, a lot cheaper.
+ * All streams need to belong to the same context, and no more than 256
+ * may be passed in one call. If a negative error code is returned none
+ * of the streams is connected. Otherwise the server either creates all
+ * of them and they reach PA_STREAM_READY, or none and they all go to
+ * PA_STREAM_FAILED. With servers older than 11.0 the streams are
+ * connected one by one instead, and may fail individually. \since 11.0 */
+int pa_stream_connect_playback_multiple(
+        pa_stream *const *streams     /**< The streams to connect */,
+        unsigned n                    /**< The number of streams */,
+        const char *dev               /**< Name of the sink to connect to, or NULL for default */,
+        const pa_buffer_attr *attr    /**< Buffering attributes, or NULL for default */,
+        pa_stream_flags_t flags       /**< Additional flags, or 0 for default */,
+        const pa_cvolume *volume      /**< Initial volume, or NULL for default */);
+
 /** Connect the stream to a source. */
 int pa_stream_connect_record(
         pa_stream *s                  /**< The stream to connect to a source */ ,
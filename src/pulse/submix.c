@@ -0,0 +1,311 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+#include <pulse/fork-detect.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/mix.h>
+
+#include "internal.h"
+#include "submix.h"
+
+#define MEMBLOCKQ_MAXLENGTH (4*1024*1024) /* 4MB */
+
+struct pa_submix_input {
+    pa_submix *submix;
+    pa_memblockq *memblockq;
+    pa_cvolume volume;
+
+    pa_submix_input_request_cb_t request_callback;
+    void *request_userdata;
+
+    PA_LLIST_FIELDS(pa_submix_input);
+};
+
+struct pa_submix {
+    pa_stream *stream;
+
+    /* Mixes what was written outside of the write callback once we
+     * are back in the main loop */
+    pa_defer_event *defer_event;
+
+    PA_LLIST_HEAD(pa_submix_input, inputs);
+    unsigned n_inputs;
+
+    /* One entry per input, grown along with the list */
+    pa_mix_info *mix_info;
+    unsigned n_mix_info;
+};
+
+/* Mixes at most length bytes of what all inputs have queued into the
+ * stream. Returns how much was written, 0 if nothing is queued. */
+static size_t mix_into_stream(pa_submix *m, size_t length) {
+    pa_submix_input *i;
+    unsigned n = 0, k;
+    void *data;
+
+    for (i = m->inputs; i; i = i->next) {
+        pa_mix_info *info = &m->mix_info[n];
+
+        if (pa_memblockq_peek(i->memblockq, &info->chunk) < 0)
+            continue;
+
+        pa_assert(info->chunk.memblock);
+
+        if (info->chunk.length < length)
+            length = info->chunk.length;
+
+        info->volume = i->volume;
+        info->ramp_length = 0;
+        info->userdata = i;
+        n++;
+    }
+
+    if (n == 0)
+        return 0;
+
+    if (pa_stream_begin_write(m->stream, &data, &length) < 0)
+        length = 0;
+    else {
+        length = pa_mix(m->mix_info, n, data, length, &m->stream->sample_spec, NULL, false);
+
+        if (pa_stream_write(m->stream, data, length, NULL, 0, PA_SEEK_RELATIVE) < 0)
+            length = 0;
+    }
+
+    for (k = 0; k < n; k++) {
+        pa_submix_input *j = m->mix_info[k].userdata;
+
+        if (length > 0)
+            pa_memblockq_drop(j->memblockq, length);
+
+        pa_memblock_unref(m->mix_info[k].chunk.memblock);
+    }
+
+    return length;
+}
+
+static void defer_cb(pa_mainloop_api *api, pa_defer_event *e, void *userdata) {
+    pa_submix *m = userdata;
+    size_t nbytes, l;
+
+    pa_assert(m);
+
+    api->defer_enable(e, 0);
+
+    if (pa_stream_get_state(m->stream) != PA_STREAM_READY)
+        return;
+
+    nbytes = pa_stream_writable_size(m->stream);
+    if (nbytes == (size_t) -1)
+        return;
+
+    while (nbytes > 0) {
+        if ((l = mix_into_stream(m, nbytes)) == 0)
+            break;
+
+        nbytes -= l;
+    }
+}
+
+static void stream_write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    pa_submix *m = userdata;
+    pa_submix_input *i, *n;
+    size_t l;
+
+    pa_assert(m);
+    pa_assert(m->stream == s);
+
+    for (i = m->inputs; i; i = n) {
+        n = i->next;
+
+        if (!i->request_callback)
+            continue;
+
+        if ((l = pa_memblockq_get_length(i->memblockq)) < nbytes)
+            i->request_callback(i, nbytes - l, i->request_userdata);
+    }
+
+    while (nbytes > 0) {
+        if ((l = mix_into_stream(m, nbytes)) == 0)
+            break;
+
+        nbytes -= l;
+    }
+}
+
+pa_submix* pa_submix_new(pa_stream *s) {
+    pa_submix *m;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, s->state == PA_STREAM_UNCONNECTED, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(s->context, pa_sample_spec_valid(&s->sample_spec), PA_ERR_NOTSUPPORTED);
+
+    m = pa_xnew0(pa_submix, 1);
+    m->stream = pa_stream_ref(s);
+    PA_LLIST_HEAD_INIT(pa_submix_input, m->inputs);
+
+    m->defer_event = s->context->mainloop->defer_new(s->context->mainloop, defer_cb, m);
+    s->context->mainloop->defer_enable(m->defer_event, 0);
+
+    pa_stream_set_write_callback(s, stream_write_cb, m);
+
+    return m;
+}
+
+void pa_submix_free(pa_submix *m) {
+    pa_assert(m);
+
+    while (m->inputs)
+        pa_submix_input_free(m->inputs);
+
+    m->stream->context->mainloop->defer_free(m->defer_event);
+
+    pa_stream_set_write_callback(m->stream, NULL, NULL);
+    pa_stream_unref(m->stream);
+
+    pa_xfree(m->mix_info);
+    pa_xfree(m);
+}
+
+pa_stream* pa_submix_get_stream(pa_submix *m) {
+    pa_assert(m);
+
+    return m->stream;
+}
+
+pa_submix_input* pa_submix_input_new(pa_submix *m) {
+    pa_submix_input *i;
+
+    pa_assert(m);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(m->stream->context, !pa_detect_fork(), PA_ERR_FORKED);
+
+    i = pa_xnew0(pa_submix_input, 1);
+    i->submix = m;
+    i->memblockq = pa_memblockq_new("submix input memblockq", 0, MEMBLOCKQ_MAXLENGTH, 0,
+                                    &m->stream->sample_spec, 0, 0, 0, NULL);
+    pa_cvolume_reset(&i->volume, m->stream->sample_spec.channels);
+
+    PA_LLIST_PREPEND(pa_submix_input, m->inputs, i);
+    m->n_inputs++;
+
+    if (m->n_inputs > m->n_mix_info) {
+        m->n_mix_info = PA_MAX(m->n_mix_info * 2, 8U);
+        m->mix_info = pa_xrenew(pa_mix_info, m->mix_info, m->n_mix_info);
+    }
+
+    return i;
+}
+
+void pa_submix_input_free(pa_submix_input *i) {
+    pa_assert(i);
+
+    PA_LLIST_REMOVE(pa_submix_input, i->submix->inputs, i);
+    i->submix->n_inputs--;
+
+    pa_memblockq_free(i->memblockq);
+    pa_xfree(i);
+}
+
+int pa_submix_input_write(pa_submix_input *i, const void *data, size_t nbytes) {
+    pa_context *c;
+    pa_mempool *pool;
+    size_t fs, max;
+
+    pa_assert(i);
+
+    c = i->submix->stream->context;
+    pool = c->mempool;
+    fs = pa_frame_size(&i->submix->stream->sample_spec);
+
+    PA_CHECK_VALIDITY(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(c, data, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(c, nbytes % fs == 0, PA_ERR_INVALID);
+
+    max = (pa_mempool_block_size_max(pool) / fs) * fs;
+
+    while (nbytes > 0) {
+        pa_memchunk chunk;
+        void *d;
+
+        chunk.index = 0;
+        chunk.length = PA_MIN(nbytes, max);
+        chunk.memblock = pa_memblock_new(pool, chunk.length);
+
+        d = pa_memblock_acquire(chunk.memblock);
+        memcpy(d, data, chunk.length);
+        pa_memblock_release(chunk.memblock);
+
+        if (pa_memblockq_push(i->memblockq, &chunk) < 0) {
+            pa_memblock_unref(chunk.memblock);
+            PA_FAIL(c, PA_ERR_TOOLARGE);
+        }
+
+        pa_memblock_unref(chunk.memblock);
+
+        data = (const uint8_t*) data + chunk.length;
+        nbytes -= chunk.length;
+    }
+
+    c->mainloop->defer_enable(i->submix->defer_event, 1);
+
+    return 0;
+}
+
+size_t pa_submix_input_get_queued_size(pa_submix_input *i) {
+    pa_assert(i);
+
+    return pa_memblockq_get_length(i->memblockq);
+}
+
+int pa_submix_input_set_volume(pa_submix_input *i, const pa_cvolume *volume) {
+    pa_context *c;
+
+    pa_assert(i);
+
+    c = i->submix->stream->context;
+
+    PA_CHECK_VALIDITY(c, volume && pa_cvolume_valid(volume), PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(c, volume->channels == 1 || pa_cvolume_compatible(volume, &i->submix->stream->sample_spec), PA_ERR_INVALID);
+
+    if (volume->channels == 1)
+        pa_cvolume_set(&i->volume, i->submix->stream->sample_spec.channels, volume->values[0]);
+    else
+        i->volume = *volume;
+
+    return 0;
+}
+
+void pa_submix_input_set_request_callback(pa_submix_input *i, pa_submix_input_request_cb_t cb, void *userdata) {
+    pa_assert(i);
+
+    i->request_callback = cb;
+    i->request_userdata = userdata;
+}
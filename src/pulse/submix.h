@@ -0,0 +1,113 @@
+#ifndef foosubmixhfoo
+#define foosubmixhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/types.h>
+
+#include <pulse/stream.h>
+#include <pulse/volume.h>
+#include <pulse/cdecl.h>
+
+/** \page submix Client-side Mixing
+ *
+ * \section overview_sec Overview
+ *
+ * Applications that play many sounds at the same time on the same sink,
+ * like games or audio workstations, can mix them in the client and send
+ * them to the server as a single stream. This saves the server a sink
+ * input, a resampler and the network traffic for each of them.
+ *
+ * \section usage_sec Usage
+ *
+ * Create a playback stream with pa_stream_new() as usual and hand it to
+ * pa_submix_new() before connecting it. The submix takes over the write
+ * callback of the stream, so the application must neither set its own nor
+ * write to the stream directly.
+ *
+ * For every sound create an input with pa_submix_input_new(). Inputs can
+ * be fed ahead of time with pa_submix_input_write(), or on demand from the
+ * callback set with pa_submix_input_set_request_callback(), which is
+ * called whenever the stream asks for more data. Data written outside of
+ * that callback is mixed the next time the main loop runs and the stream
+ * has room, so writes to several inputs made together stay in sync.
+ * Inputs that have no data queued when the stream is written to are
+ * silent. Each input has its own volume, which is applied in the client.
+ *
+ * All inputs share the sample spec of the stream. Position, latency and
+ * everything else that is queried from the stream applies to the mix as a
+ * whole. */
+
+/** \file
+ * Client-side mixing of several sources into one playback stream.
+ * \since 11.0
+ *
+ * See also \subpage submix
+ */
+
+PA_C_DECL_BEGIN
+
+/** An opaque client-side mixer. \since 11.0 */
+typedef struct pa_submix pa_submix;
+
+/** An opaque input of a client-side mixer. \since 11.0 */
+typedef struct pa_submix_input pa_submix_input;
+
+/** A callback that is called when the stream of a submix wants more
+ * data. \a nbytes is how much more the input should queue to not be
+ * left out of the next mix. \since 11.0 */
+typedef void (*pa_submix_input_request_cb_t)(pa_submix_input *i, size_t nbytes, void *userdata);
+
+/** Create a mixer feeding the specified playback stream, which must not
+ * be connected yet and must have a PCM sample spec. Returns NULL on
+ * failure. \since 11.0 */
+pa_submix* pa_submix_new(pa_stream *s);
+
+/** Free the mixer and all of its inputs. The stream is left alone and
+ * has to be disconnected and unreferenced by the caller. \since 11.0 */
+void pa_submix_free(pa_submix *m);
+
+/** Return the stream the mixer writes to. \since 11.0 */
+pa_stream* pa_submix_get_stream(pa_submix *m);
+
+/** Add a new input to the mixer, initially at full volume. \since 11.0 */
+pa_submix_input* pa_submix_input_new(pa_submix *m);
+
+/** Remove the input from its mixer and free it. Data still queued in it
+ * is dropped. \since 11.0 */
+void pa_submix_input_free(pa_submix_input *i);
+
+/** Queue data in the sample spec of the stream on the input. Only whole
+ * frames may be written. The data is copied. Returns a negative error
+ * code on failure. \since 11.0 */
+int pa_submix_input_write(pa_submix_input *i, const void *data, size_t nbytes);
+
+/** Return how many bytes are queued on the input. \since 11.0 */
+size_t pa_submix_input_get_queued_size(pa_submix_input *i);
+
+/** Set the volume the input is mixed at. Returns a negative error code
+ * on failure. \since 11.0 */
+int pa_submix_input_set_volume(pa_submix_input *i, const pa_cvolume *volume);
+
+/** Set the callback that is called when the stream needs more data. The
+ * callback may free its own input, but not any other. \since 11.0 */
+void pa_submix_input_set_request_callback(pa_submix_input *i, pa_submix_input_request_cb_t cb, void *userdata);
+
+PA_C_DECL_END
+
+#endif
@@ -42,34 +42,70 @@ void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag
 
     pa_context_ref(c);
 
-    if (pa_tagstruct_getu32(t, &e) < 0 ||
-        pa_tagstruct_getu32(t, &idx) < 0 ||
-        !pa_tagstruct_eof(t)) {
-        pa_context_fail(c, PA_ERR_PROTOCOL);
-        goto finish;
-    }
+    /* Since protocol v33 the server may send several events at once */
+    do {
+        if (pa_tagstruct_getu32(t, &e) < 0 ||
+            pa_tagstruct_getu32(t, &idx) < 0) {
+            pa_context_fail(c, PA_ERR_PROTOCOL);
+            goto finish;
+        }
 
-    if (c->subscribe_callback)
-        c->subscribe_callback(c, e, idx, c->subscribe_userdata);
+        if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE)
+            pa_context_forget_proplists(c, e & PA_SUBSCRIPTION_EVENT_FACILITY_MASK, idx);
+
+        if (c->introspect_cache)
+            pa_introspect_cache_handle_event(c->introspect_cache, e, idx);
+
+        /* The cache may have subscribed to more than the application */
+        if (c->subscribe_callback && pa_subscription_match_flags(c->subscription_mask, e))
+            c->subscribe_callback(c, e, idx, c->subscribe_userdata);
+    } while (c->state == PA_CONTEXT_READY && !pa_tagstruct_eof(t));
 
 finish:
     pa_context_unref(c);
 }
 
 pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+    return pa_context_subscribe_with_interval(c, m, 0, cb, userdata);
+}
+
+pa_operation* pa_context_subscribe_with_interval(pa_context *c, pa_subscription_mask_t m, pa_usec_t interval, pa_context_success_cb_t cb, void *userdata) {
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, interval == 0 || c->version >= 33, PA_ERR_NOTSUPPORTED);
+
+    c->subscription_mask = m;
+    c->subscription_interval = interval;
+
+    return pa_context_update_subscription(c, cb, userdata);
+}
+
+/* Sends the combined subscription of the application and the cache */
+pa_operation* pa_context_update_subscription(pa_context *c, pa_context_success_cb_t cb, void *userdata) {
     pa_operation *o;
     pa_tagstruct *t;
     uint32_t tag;
+    unsigned k;
 
     pa_assert(c);
-    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(c->state == PA_CONTEXT_READY);
 
-    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    /* Without the removal events we can't tell when to drop the
+     * proplists we keep */
+    for (k = 0; k <= PA_SUBSCRIPTION_EVENT_FACILITY_MASK; k++)
+        if (!((c->subscription_mask | c->cache_subscription_mask) & (1U << k)))
+            pa_context_forget_proplists(c, k, PA_INVALID_INDEX);
 
     o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
 
     t = pa_tagstruct_command(c, PA_COMMAND_SUBSCRIBE, &tag);
-    pa_tagstruct_putu32(t, m);
+    pa_tagstruct_putu32(t, c->subscription_mask | c->cache_subscription_mask);
+
+    if (c->version >= 33)
+        pa_tagstruct_put_usec(t, c->subscription_interval);
+
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, pa_context_simple_ack_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
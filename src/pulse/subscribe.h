@@ -59,6 +59,16 @@ void my_subscription_callback(pa_context *c, pa_subscription_event_type_t t,
     }
 }
 @endverbatim
+ *
+ * \section batch_sec Batched Notification
+ *
+ * Applications that only need to keep a model of the server up to date
+ * and don't care about every intermediate change can use
+ * pa_context_subscribe_with_interval() instead. The server then
+ * collects the events for up to the given interval and sends them in
+ * one go. Consecutive change events for the same object are merged into
+ * one, and objects that were created and removed again within the
+ * interval are not reported at all.
  */
 
 /** \file
@@ -75,6 +85,12 @@ typedef void (*pa_context_subscribe_cb_t)(pa_context *c, pa_subscription_event_t
 /** Enable event notification */
 pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata);
 
+/** Enable event notification, delivering the events in batches at
+ * most every \a interval microseconds. An interval of 0 is the same
+ * as pa_context_subscribe(). The server limits the interval to 10s.
+ * \since 11.0 */
+pa_operation* pa_context_subscribe_with_interval(pa_context *c, pa_subscription_mask_t m, pa_usec_t interval, pa_context_success_cb_t cb, void *userdata);
+
 /** Set the context specific call back function that is called whenever the state of the daemon changes */
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata);
 
@@ -32,6 +32,9 @@
 #include <pulse/xmalloc.h>
 #include <pulse/mainloop.h>
 
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/flist.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/log.h>
 #include <pulsecore/thread.h>
@@ -41,6 +44,14 @@
 
 #include "thread-mainloop.h"
 
+struct post_item {
+    pa_threaded_mainloop_post_cb_t callback;
+    void *userdata;
+    struct post_item *next;
+};
+
+PA_STATIC_FLIST_DECLARE(post_items, 0, pa_xfree);
+
 struct pa_threaded_mainloop {
     pa_mainloop *real_mainloop;
     volatile int n_waiting, n_waiting_for_accept;
@@ -50,6 +61,13 @@ struct pa_threaded_mainloop {
     pa_cond* cond, *accept_cond;
 
     char *name;
+
+    /* Callbacks from pa_threaded_mainloop_post(), newest first. Posting
+     * threads only ever push, the event loop thread takes all of them
+     * at once, so a simple compare-and-swap stack will do. */
+    pa_atomic_ptr_t posted;
+    pa_fdsem *post_fdsem;
+    pa_io_event *post_event;
 };
 
 static inline int in_worker(pa_threaded_mainloop *m) {
@@ -102,6 +120,54 @@ static void thread(void *userdata) {
     pa_mutex_unlock(m->mutex);
 }
 
+static struct post_item *take_posted(pa_threaded_mainloop *m) {
+    struct post_item *items, *fifo = NULL;
+
+    do {
+        items = pa_atomic_ptr_load(&m->posted);
+    } while (!pa_atomic_ptr_cmpxchg(&m->posted, items, NULL));
+
+    /* Reverse into the order they were posted in */
+    while (items) {
+        struct post_item *next = items->next;
+
+        items->next = fifo;
+        fifo = items;
+        items = next;
+    }
+
+    return fifo;
+}
+
+static void free_post_item(struct post_item *item) {
+    if (pa_flist_push(PA_STATIC_FLIST_GET(post_items), item) < 0)
+        pa_xfree(item);
+}
+
+/* Called from the event loop thread, with the lock taken */
+static void post_cb(pa_mainloop_api *api, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_threaded_mainloop *m = userdata;
+
+    pa_assert(m);
+
+    pa_fdsem_after_poll(m->post_fdsem);
+
+    do {
+        struct post_item *item;
+
+        while ((item = take_posted(m))) {
+            do {
+                struct post_item *next = item->next;
+
+                item->callback(m, item->userdata);
+                free_post_item(item);
+                item = next;
+            } while (item);
+        }
+
+    } while (pa_fdsem_before_poll(m->post_fdsem) < 0);
+}
+
 pa_threaded_mainloop *pa_threaded_mainloop_new(void) {
     pa_threaded_mainloop *m;
 
@@ -120,10 +186,21 @@ pa_threaded_mainloop *pa_threaded_mainloop_new(void) {
 
     pa_mainloop_set_poll_func(m->real_mainloop, poll_func, m->mutex);
 
+    if (!(m->post_fdsem = pa_fdsem_new())) {
+        pa_threaded_mainloop_free(m);
+        return NULL;
+    }
+
+    pa_fdsem_before_poll(m->post_fdsem);
+    m->post_event = pa_mainloop_get_api(m->real_mainloop)->io_new(pa_mainloop_get_api(m->real_mainloop),
+                                                                  pa_fdsem_get(m->post_fdsem), PA_IO_EVENT_INPUT, post_cb, m);
+
     return m;
 }
 
 void pa_threaded_mainloop_free(pa_threaded_mainloop* m) {
+    struct post_item *item, *next;
+
     pa_assert(m);
 
     /* Make sure that this function is not called from the helper thread */
@@ -134,8 +211,20 @@ void pa_threaded_mainloop_free(pa_threaded_mainloop* m) {
     if (m->thread)
         pa_thread_free(m->thread);
 
+    /* Whatever is still posted is dropped without running it */
+    for (item = take_posted(m); item; item = next) {
+        next = item->next;
+        free_post_item(item);
+    }
+
+    if (m->post_event)
+        pa_mainloop_get_api(m->real_mainloop)->io_free(m->post_event);
+
     pa_mainloop_free(m->real_mainloop);
 
+    if (m->post_fdsem)
+        pa_fdsem_free(m->post_fdsem);
+
     pa_mutex_free(m->mutex);
     pa_cond_free(m->cond);
     pa_cond_free(m->accept_cond);
@@ -231,6 +320,25 @@ void pa_threaded_mainloop_accept(pa_threaded_mainloop *m) {
     pa_cond_signal(m->accept_cond, 0);
 }
 
+void pa_threaded_mainloop_post(pa_threaded_mainloop *m, pa_threaded_mainloop_post_cb_t callback, void *userdata) {
+    struct post_item *item;
+
+    pa_assert(m);
+    pa_assert(callback);
+
+    if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(post_items))))
+        item = pa_xnew(struct post_item, 1);
+
+    item->callback = callback;
+    item->userdata = userdata;
+
+    do {
+        item->next = pa_atomic_ptr_load(&m->posted);
+    } while (!pa_atomic_ptr_cmpxchg(&m->posted, item->next, item));
+
+    pa_fdsem_post(m->post_fdsem);
+}
+
 int pa_threaded_mainloop_get_retval(pa_threaded_mainloop *m) {
     pa_assert(m);
 
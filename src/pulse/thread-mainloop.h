@@ -297,6 +297,19 @@ void pa_threaded_mainloop_signal(pa_threaded_mainloop *m, int wait_for_accept);
  * wait_for_accept value.  */
 void pa_threaded_mainloop_accept(pa_threaded_mainloop *m);
 
+/** A callback for pa_threaded_mainloop_post(). \since 11.0 */
+typedef void (*pa_threaded_mainloop_post_cb_t)(pa_threaded_mainloop *m, void *userdata);
+
+/** Have \a callback run from the event loop thread, as soon as
+ * possible, with the event loop object locked like for any other event
+ * loop callback. Unlike most other functions this may be called
+ * without holding the lock, and it never waits for it, so a thread with
+ * tight deadlines can e.g. hand buffers over to pa_stream_write()
+ * without contending with the event loop thread. The callbacks run in the
+ * order they were posted in. Callbacks still pending when the event
+ * loop object is freed are dropped without being run. \since 11.0 */
+void pa_threaded_mainloop_post(pa_threaded_mainloop *m, pa_threaded_mainloop_post_cb_t callback, void *userdata);
+
 /** Return the return value as specified with the main loop's
  * pa_mainloop_quit() routine. */
 int pa_threaded_mainloop_get_retval(pa_threaded_mainloop *m);
@@ -219,20 +219,18 @@ pa_volume_t pa_sw_volume_divide(pa_volume_t a, pa_volume_t b) {
     return (pa_volume_t) (((uint64_t) a * (uint64_t) PA_VOLUME_NORM + (uint64_t) b / 2ULL) / (uint64_t) b);
 }
 
-/* Amplitude, not power */
-static double linear_to_dB(double v) {
-    return 20.0 * log10(v);
-}
-
-static double dB_to_linear(double v) {
-    return pow(10.0, v / 20.0);
-}
+#define LOG2_10 3.32192809488736234787
 
 pa_volume_t pa_sw_volume_from_dB(double dB) {
     if (isinf(dB) < 0 || dB <= PA_DECIBEL_MININFTY)
         return PA_VOLUME_MUTED;
 
-    return pa_sw_volume_from_linear(dB_to_linear(dB));
+    /* The dB value is for the amplitude, not the power, and our
+     * volumes are cubic: cbrt(10^(dB/20)) = 10^(dB/60) =
+     * 2^(dB*log2(10)/60), a single exp2() instead of pow() followed
+     * by cbrt() */
+
+    return (pa_volume_t) PA_CLAMP_VOLUME((uint64_t) lround(exp2(dB * (LOG2_10 / 60.0)) * PA_VOLUME_NORM));
 }
 
 double pa_sw_volume_to_dB(pa_volume_t v) {
@@ -242,7 +240,9 @@ double pa_sw_volume_to_dB(pa_volume_t v) {
     if (v <= PA_VOLUME_MUTED)
         return PA_DECIBEL_MININFTY;
 
-    return linear_to_dB(pa_sw_volume_to_linear(v));
+    /* 20 * log10((v/PA_VOLUME_NORM)^3), without cubing first */
+
+    return 60.0 * log10((double) v / PA_VOLUME_NORM);
 }
 
 pa_volume_t pa_sw_volume_from_linear(double v) {
@@ -130,11 +130,16 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
     if (chunk) {
         pa_assert(chunk->memblock);
         i->memchunk = *chunk;
+        pa_memblock_clear_thread_local(i->memchunk.memblock);
         pa_memblock_ref(i->memchunk.memblock);
     } else
         pa_memchunk_reset(&i->memchunk);
     i->semaphore = NULL;
 
+    /* Unless the queue overran, writers can go ahead without locking */
+    if (pa_asyncq_try_push(a->asyncq, i) >= 0)
+        return;
+
     /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
     pa_mutex_lock(a->mutex);
     pa_asyncq_post(a->asyncq, i);
@@ -154,16 +159,19 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     if (chunk) {
         pa_assert(chunk->memblock);
         i.memchunk = *chunk;
+        pa_memblock_clear_thread_local(i.memchunk.memblock);
     } else
         pa_memchunk_reset(&i.memchunk);
 
     if (!(i.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
         i.semaphore = pa_semaphore_new(0);
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_assert_se(pa_asyncq_push(a->asyncq, &i, true) == 0);
-    pa_mutex_unlock(a->mutex);
+    if (pa_asyncq_try_push(a->asyncq, &i) < 0) {
+        /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
+        pa_mutex_lock(a->mutex);
+        pa_assert_se(pa_asyncq_push(a->asyncq, &i, true) == 0);
+        pa_mutex_unlock(a->mutex);
+    }
 
     pa_semaphore_wait(i.semaphore);
 
@@ -30,9 +30,12 @@
  * contrast to pa_asyncq this one is multiple-writer safe, though
  * still not multiple-reader safe. This queue is intended to be used
  * for controlling real-time threads from normal-priority
- * threads. Multiple-writer-safety is accomplished by using a mutex on
- * the writer side. This queue is thus not useful for communication
- * between several real-time threads.
+ * threads. Writers don't take any locks unless the queue is full, in
+ * which case multiple-writer-safety is accomplished by using a mutex
+ * on the writer side. Messages are allocated from a lock-free free
+ * list, so after startup posting doesn't allocate memory either. Since
+ * writers may still block on overrun, this queue is not ideal for
+ * communication between several real-time threads.
  *
  * The queue takes messages consisting of:
  *    "Object" for which this messages is intended (may be NULL)
@@ -58,11 +58,12 @@ struct localq {
 struct pa_asyncq {
     unsigned size;
     unsigned read_idx;
-    unsigned write_idx;
+    pa_atomic_t write_idx; /* Claimed by writers with cmpxchg */
     pa_fdsem *read_fdsem, *write_fdsem;
 
     PA_LLIST_HEAD(struct localq, localq);
     struct localq *last_localq;
+    pa_atomic_t n_localq;
     bool waiting_for_post;
 };
 
@@ -88,6 +89,7 @@ pa_asyncq *pa_asyncq_new(unsigned size) {
 
     PA_LLIST_HEAD_INIT(struct localq, l->localq);
     l->last_localq = NULL;
+    pa_atomic_store(&l->n_localq, 0);
     l->waiting_for_post = false;
 
     if (!(l->read_fdsem = pa_fdsem_new())) {
@@ -139,23 +141,35 @@ static int push(pa_asyncq*l, void *p, bool wait_op) {
 
     cells = PA_ASYNCQ_CELLS(l);
 
-    _Y;
-    idx = reduce(l, l->write_idx);
+    /* Claim the next cell. Doing this with cmpxchg on the index allows
+     * several writers to push at the same time. */
+    for (;;) {
+        _Y;
+        idx = (unsigned) pa_atomic_load(&l->write_idx);
 
-    if (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p)) {
+        if (pa_atomic_ptr_load(&cells[reduce(l, idx)])) {
 
-        if (!wait_op)
-            return -1;
+            if (!wait_op)
+                return -1;
 
-/*         pa_log("sleeping on push"); */
+/*             pa_log("sleeping on push"); */
 
-        do {
             pa_fdsem_wait(l->read_fdsem);
-        } while (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p));
+            continue;
+        }
+
+        if (pa_atomic_cmpxchg(&l->write_idx, (int) idx, (int) (idx + 1)))
+            break;
     }
 
+    /* If the queue was just full, a writer that claimed the same cell
+     * one round earlier might not have filled it in yet. In that rare
+     * case we wait for the reader to pass it. We don't sleep on the
+     * fdsem here, since lock-free writers may be doing this
+     * concurrently. */
     _Y;
-    l->write_idx++;
+    while (!pa_atomic_ptr_cmpxchg(&cells[reduce(l, idx)], NULL, p))
+        pa_thread_yield();
 
     pa_fdsem_post(l->write_fdsem);
 
@@ -175,6 +189,7 @@ static bool flush_postq(pa_asyncq *l, bool wait_op) {
         l->last_localq = q->prev;
 
         PA_LLIST_REMOVE(struct localq, l->localq, q);
+        pa_atomic_dec(&l->n_localq);
 
         if (pa_flist_push(PA_STATIC_FLIST_GET(localq), q) < 0)
             pa_xfree(q);
@@ -192,6 +207,16 @@ int pa_asyncq_push(pa_asyncq*l, void *p, bool wait_op) {
     return push(l, p, wait_op);
 }
 
+int pa_asyncq_try_push(pa_asyncq *l, void *p) {
+    pa_assert(l);
+
+    /* Items queued locally need to go first */
+    if (pa_atomic_load(&l->n_localq) > 0)
+        return -1;
+
+    return push(l, p, false);
+}
+
 void pa_asyncq_post(pa_asyncq*l, void *p) {
     struct localq *q;
 
@@ -213,6 +238,7 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
 
     q->data = p;
     PA_LLIST_PREPEND(struct localq, l->localq, q);
+    pa_atomic_inc(&l->n_localq);
 
     if (!l->last_localq)
         l->last_localq = q;
@@ -25,8 +25,9 @@
 #include <pulsecore/macro.h>
 
 /* A simple, asynchronous, lock-free (if requested also wait-free)
- * queue. Not multiple-reader/multiple-writer safe. If that is
- * required both sides can be protected by a mutex each. --- Which is
+ * queue. Not multiple-reader/multiple-writer safe, except for
+ * pa_asyncq_try_push(). If that is required both sides can be
+ * protected by a mutex each. --- Which is
  * not a bad thing in most cases, since this queue is intended for
  * communication between a normal thread and a single real-time
  * thread. Only the real-time side needs to be lock-free/wait-free.
@@ -46,6 +47,13 @@ void pa_asyncq_free(pa_asyncq* q, pa_free_cb_t free_cb);
 void* pa_asyncq_pop(pa_asyncq *q, bool wait);
 int pa_asyncq_push(pa_asyncq *q, void *p, bool wait);
 
+/* Like pa_asyncq_push() without waiting, but may be called by several
+ * writers concurrently without any locking. Fails if the queue is
+ * full, or if there are items left over from pa_asyncq_post() that
+ * need to go first. The other writer side functions still need to be
+ * serialized among themselves. */
+int pa_asyncq_try_push(pa_asyncq *q, void *p);
+
 /* Similar to pa_asyncq_push(), but if the queue is full, postpone the
  * appending of the item locally and delay until
  * pa_asyncq_before_poll_post() is called. */
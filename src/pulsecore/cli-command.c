@@ -56,6 +56,8 @@
 #include <pulsecore/core-error.h>
 #include <pulsecore/modinfo.h>
 #include <pulsecore/dynarray.h>
+#include <pulsecore/trace.h>
+#include <pulsecore/rtmem.h>
 
 #include "cli-command.h"
 
@@ -126,6 +128,8 @@ static int pa_cli_command_log_level(pa_core *c, pa_tokenizer *t, pa_strbuf *buf,
 static int pa_cli_command_log_meta(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_log_time(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_log_backtrace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_dump_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_update_sink_proplist(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_update_source_proplist(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_update_sink_input_proplist(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
@@ -145,8 +149,8 @@ static const struct command commands[] = {
     { "list-sinks",              pa_cli_command_sinks,              "List loaded sinks",            1 },
     { "list-sources",            pa_cli_command_sources,            "List loaded sources",          1 },
     { "list-clients",            pa_cli_command_clients,            "List loaded clients",          1 },
-    { "list-sink-inputs",        pa_cli_command_sink_inputs,        "List sink inputs",             1 },
-    { "list-source-outputs",     pa_cli_command_source_outputs,     "List source outputs",          1 },
+    { "list-sink-inputs",        pa_cli_command_sink_inputs,        "List sink inputs (args: [json] [fields=FIELD,...])", 3 },
+    { "list-source-outputs",     pa_cli_command_source_outputs,     "List source outputs (args: [json] [fields=FIELD,...])", 3 },
     { "stat",                    pa_cli_command_stat,               "Show memory block statistics", 1 },
     { "info",                    pa_cli_command_info,               "Show comprehensive status",    1 },
     { "ls",                      pa_cli_command_info,               NULL,                           1 },
@@ -191,9 +195,11 @@ static const struct command commands[] = {
     { "set-log-meta",            pa_cli_command_log_meta,           "Show source code location in log messages (args: bool)", 2},
     { "set-log-time",            pa_cli_command_log_time,           "Show timestamps in log messages (args: bool)", 2},
     { "set-log-backtrace",       pa_cli_command_log_backtrace,      "Show backtrace in log messages (args: frames)", 2},
+    { "set-trace",               pa_cli_command_trace,              "Record trace events in the I/O threads (args: bool)", 2},
     { "play-file",               pa_cli_command_play_file,          "Play a sound file (args: filename, sink|index)", 3},
     { "dump",                    pa_cli_command_dump,               "Dump daemon configuration", 1},
     { "dump-volumes",            pa_cli_command_dump_volumes,       "Debug: Show the state of all volumes", 1 },
+    { "dump-trace",              pa_cli_command_dump_trace,         "Debug: Show the recorded trace events in Chrome trace format", 1 },
     { "shared",                  pa_cli_command_list_shared_props,  "Debug: Show shared properties", 1},
     { "exit",                    pa_cli_command_exit,               "Terminate the daemon",         1 },
     { "vacuum",                  pa_cli_command_vacuum,             NULL, 1},
@@ -310,32 +316,60 @@ static int pa_cli_command_sources(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, b
     return 0;
 }
 
-static int pa_cli_command_sink_inputs(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
+/* Parses the optional "json" and "fields=..." arguments of the stream
+ * listing commands */
+static pa_cli_text_list *stream_list_new(pa_core *c, pa_tokenizer *t, pa_cli_text_list_type type, pa_strbuf *buf) {
+    pa_cli_text_format format = PA_CLI_TEXT_PLAIN;
+    const char *fields = NULL, *a;
+    pa_cli_text_list *l;
+    unsigned i;
+
+    for (i = 1; (a = pa_tokenizer_get(t, i)); i++) {
+        if (pa_streq(a, "json"))
+            format = PA_CLI_TEXT_JSON;
+        else if (pa_startswith(a, "fields="))
+            fields = a + 7;
+        else {
+            pa_strbuf_printf(buf, "Invalid argument: %s\n", a);
+            return NULL;
+        }
+    }
+
+    if (!(l = pa_cli_text_list_new(c, type, format, fields)))
+        pa_strbuf_puts(buf, "Invalid field list, known fields are index, driver, state, device, device_name, volume, muted, "
+                       "latency_usec, requested_latency_usec, sample_spec, channel_map, resample_method, module, client "
+                       "and properties.\n");
+
+    return l;
+}
+
+static int stream_list(pa_core *c, pa_tokenizer *t, pa_cli_text_list_type type, pa_strbuf *buf) {
+    pa_cli_text_list *l;
 
+    if (!(l = stream_list_new(c, t, type, buf)))
+        return -1;
+
+    pa_cli_text_list_next(l, buf, 0);
+    pa_cli_text_list_free(l);
+    return 0;
+}
+
+static int pa_cli_command_sink_inputs(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     pa_core_assert_ref(c);
     pa_assert(t);
     pa_assert(buf);
     pa_assert(fail);
 
-    pa_assert_se(s = pa_sink_input_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-    return 0;
+    return stream_list(c, t, PA_CLI_TEXT_SINK_INPUTS, buf);
 }
 
 static int pa_cli_command_source_outputs(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
-    char *s;
-
     pa_core_assert_ref(c);
     pa_assert(t);
     pa_assert(buf);
     pa_assert(fail);
 
-    pa_assert_se(s = pa_source_output_list_to_string(c));
-    pa_strbuf_puts(buf, s);
-    pa_xfree(s);
-    return 0;
+    return stream_list(c, t, PA_CLI_TEXT_SOURCE_OUTPUTS, buf);
 }
 
 static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
@@ -367,6 +401,14 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
                      (unsigned) pa_atomic_load(&mstat->n_allocated),
                      pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_atomic_load(&mstat->allocated_size)));
 
+    pa_strbuf_printf(buf, "Memory blocks allocated at peak: %u, size: %s.\n",
+                     (unsigned) pa_atomic_load(&mstat->n_allocated_max),
+                     pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_atomic_load(&mstat->allocated_size_max)));
+
+    pa_strbuf_printf(buf, "Memory blocks not allocated from the pool: %u because it was full, %u because they were too large.\n",
+                     (unsigned) pa_atomic_load(&mstat->n_pool_full),
+                     (unsigned) pa_atomic_load(&mstat->n_too_large_for_pool));
+
     pa_strbuf_printf(buf, "Memory blocks allocated during the whole lifetime: %u, size: %s.\n",
                      (unsigned) pa_atomic_load(&mstat->n_accumulated),
                      pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_atomic_load(&mstat->accumulated_size)));
@@ -402,6 +444,9 @@ static int pa_cli_command_stat(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool
                          (unsigned) pa_atomic_load(&mstat->n_allocated_by_type[k]),
                          (unsigned) pa_atomic_load(&mstat->n_accumulated_by_type[k]));
 
+    pa_memblock_dump_accounts(buf);
+    pa_rtmem_dump(buf);
+
     return 0;
 }
 
@@ -1629,6 +1674,41 @@ static int pa_cli_command_log_backtrace(pa_core *c, pa_tokenizer *t, pa_strbuf *
     return 0;
 }
 
+static int pa_cli_command_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *m;
+    int b;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(m = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify a boolean.\n");
+        return -1;
+    }
+
+    if ((b = pa_parse_boolean(m)) < 0) {
+        pa_strbuf_puts(buf, "Failed to parse trace switch.\n");
+        return -1;
+    }
+
+    pa_trace_set_enabled(b);
+
+    return 0;
+}
+
+static int pa_cli_command_dump_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    pa_trace_dump(buf);
+
+    return 0;
+}
+
 static int pa_cli_command_card_profile(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     const char *n, *p;
     pa_card *card;
@@ -2155,6 +2235,39 @@ int pa_cli_command_execute_line(pa_core *c, const char *s, pa_strbuf *buf, bool
     return pa_cli_command_execute_line_stateful(c, s, buf, fail, NULL);
 }
 
+pa_cli_text_list *pa_cli_command_list_new(pa_core *c, const char *s, pa_strbuf *buf, bool *is_list) {
+    pa_cli_text_list_type type;
+    pa_cli_text_list *l;
+    pa_tokenizer *t;
+    const char *cs;
+    size_t n;
+
+    pa_assert(c);
+    pa_assert(s);
+    pa_assert(buf);
+    pa_assert(is_list);
+
+    cs = s+strspn(s, whitespace);
+    n = strcspn(cs, whitespace);
+
+    if (n == sizeof("list-sink-inputs")-1 && !strncmp(cs, "list-sink-inputs", n))
+        type = PA_CLI_TEXT_SINK_INPUTS;
+    else if (n == sizeof("list-source-outputs")-1 && !strncmp(cs, "list-source-outputs", n))
+        type = PA_CLI_TEXT_SOURCE_OUTPUTS;
+    else {
+        *is_list = false;
+        return NULL;
+    }
+
+    *is_list = true;
+
+    pa_assert_se(t = pa_tokenizer_new(cs, 3));
+    l = stream_list_new(c, t, type, buf);
+    pa_tokenizer_free(t);
+
+    return l;
+}
+
 int pa_cli_command_execute_file_stream(pa_core *c, FILE *f, pa_strbuf *buf, bool *fail) {
     char line[2048];
     int ifstate = IFSTATE_NONE;
@@ -22,6 +22,7 @@
 
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core.h>
+#include <pulsecore/cli-text.h>
 
 /* Execute a single CLI command. Write the results to the string
  * buffer *buf. If *fail is non-zero the function will return -1 when
@@ -41,4 +42,9 @@ int pa_cli_command_execute(pa_core *c, const char *s, pa_strbuf *buf, bool *fail
 /* Same as pa_cli_command_execute_line() but also take ifstate var. */
 int pa_cli_command_execute_line_stateful(pa_core *c, const char *s, pa_strbuf *buf, bool *fail, int *ifstate);
 
+/* If s is a stream listing command, set *is_list and return a listing that
+ * the caller can produce at its own pace. Returns NULL with *is_list set if
+ * the arguments are invalid, in which case an error is written to buf. */
+pa_cli_text_list *pa_cli_command_list_new(pa_core *c, const char *s, pa_strbuf *buf, bool *is_list);
+
 #endif
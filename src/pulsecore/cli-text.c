@@ -327,6 +327,15 @@ char *pa_sink_list_to_string(pa_core *c) {
                     "\tfixed latency: %0.2f ms\n",
                     (double) pa_sink_get_fixed_latency(sink) / PA_USEC_PER_MSEC);
 
+        if (sink->update_rate && sink->alternate_sample_rate)
+            pa_strbuf_printf(
+                    s,
+                    "\tresampling cost: %llu at %u Hz (default), %llu at %u Hz (alternate)\n",
+                    (unsigned long long) pa_sink_get_resample_cost(sink, sink->default_sample_rate),
+                    sink->default_sample_rate,
+                    (unsigned long long) pa_sink_get_resample_cost(sink, sink->alternate_sample_rate),
+                    sink->alternate_sample_rate);
+
         if (sink->card)
             pa_strbuf_printf(s, "\tcard: %u <%s>\n", sink->card->index, sink->card->name);
         if (sink->module)
@@ -463,199 +472,622 @@ char *pa_source_list_to_string(pa_core *c) {
     return pa_strbuf_to_string_free(s);
 }
 
+static const char* const source_output_state_table[] = {
+    [PA_SOURCE_OUTPUT_INIT] = "INIT",
+    [PA_SOURCE_OUTPUT_RUNNING] = "RUNNING",
+    [PA_SOURCE_OUTPUT_CORKED] = "CORKED",
+    [PA_SOURCE_OUTPUT_UNLINKED] = "UNLINKED"
+};
+
+static void source_output_to_strbuf(pa_strbuf *s, pa_source_output *o) {
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t, clt[28];
+    pa_usec_t cl;
+    const char *cmn;
+    pa_cvolume v;
+    char *volume_str = NULL;
+
+    cmn = pa_channel_map_to_pretty_name(&o->channel_map);
+
+    if ((cl = pa_source_output_get_requested_latency(o)) == (pa_usec_t) -1)
+        pa_snprintf(clt, sizeof(clt), "n/a");
+    else
+        pa_snprintf(clt, sizeof(clt), "%0.2f ms", (double) cl / PA_USEC_PER_MSEC);
+
+    pa_assert(o->source);
+
+    if (pa_source_output_is_volume_readable(o)) {
+        pa_source_output_get_volume(o, &v, true);
+        volume_str = pa_sprintf_malloc("%s\n\t        balance %0.2f",
+                                       pa_cvolume_snprint_verbose(cv, sizeof(cv), &v, &o->channel_map, true),
+                                       pa_cvolume_get_balance(&v, &o->channel_map));
+    } else
+        volume_str = pa_xstrdup("n/a");
+
+    pa_strbuf_printf(
+        s,
+        "    index: %u\n"
+        "\tdriver: <%s>\n"
+        "\tflags: %s%s%s%s%s%s%s%s%s%s%s%s\n"
+        "\tstate: %s\n"
+        "\tsource: %u <%s>\n"
+        "\tvolume: %s\n"
+        "\tmuted: %s\n"
+        "\tcurrent latency: %0.2f ms\n"
+        "\trequested latency: %s\n"
+        "\tsample spec: %s\n"
+        "\tchannel map: %s%s%s\n"
+        "\tresample method: %s\n",
+        o->index,
+        o->driver,
+        o->flags & PA_SOURCE_OUTPUT_VARIABLE_RATE ? "VARIABLE_RATE " : "",
+        o->flags & PA_SOURCE_OUTPUT_DONT_MOVE ? "DONT_MOVE " : "",
+        o->flags & PA_SOURCE_OUTPUT_START_CORKED ? "START_CORKED " : "",
+        o->flags & PA_SOURCE_OUTPUT_NO_REMAP ? "NO_REMAP " : "",
+        o->flags & PA_SOURCE_OUTPUT_NO_REMIX ? "NO_REMIX " : "",
+        o->flags & PA_SOURCE_OUTPUT_FIX_FORMAT ? "FIX_FORMAT " : "",
+        o->flags & PA_SOURCE_OUTPUT_FIX_RATE ? "FIX_RATE " : "",
+        o->flags & PA_SOURCE_OUTPUT_FIX_CHANNELS ? "FIX_CHANNELS " : "",
+        o->flags & PA_SOURCE_OUTPUT_DONT_INHIBIT_AUTO_SUSPEND ? "DONT_INHIBIT_AUTO_SUSPEND " : "",
+        o->flags & PA_SOURCE_OUTPUT_NO_CREATE_ON_SUSPEND ? "NO_CREATE_ON_SUSPEND " : "",
+        o->flags & PA_SOURCE_OUTPUT_KILL_ON_SUSPEND ? "KILL_ON_SUSPEND " : "",
+        o->flags & PA_SOURCE_OUTPUT_PASSTHROUGH ? "PASSTHROUGH " : "",
+        source_output_state_table[pa_source_output_get_state(o)],
+        o->source->index, o->source->name,
+        volume_str,
+        pa_yes_no(o->muted),
+        (double) pa_source_output_get_latency(o, NULL) / PA_USEC_PER_MSEC,
+        clt,
+        pa_sample_spec_snprint(ss, sizeof(ss), &o->sample_spec),
+        pa_channel_map_snprint(cm, sizeof(cm), &o->channel_map),
+        cmn ? "\n\t             " : "",
+        cmn ? cmn : "",
+        pa_resample_method_to_string(pa_source_output_get_resample_method(o)));
+
+    pa_xfree(volume_str);
+
+    if (o->module)
+        pa_strbuf_printf(s, "\towner module: %u\n", o->module->index);
+    if (o->client)
+        pa_strbuf_printf(s, "\tclient: %u <%s>\n", o->client->index, pa_strnull(pa_proplist_gets(o->client->proplist, PA_PROP_APPLICATION_NAME)));
+    if (o->direct_on_input)
+        pa_strbuf_printf(s, "\tdirect on input: %u\n", o->direct_on_input->index);
+
+    t = pa_proplist_to_string_sep(o->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
+}
+
 char *pa_source_output_list_to_string(pa_core *c) {
+    pa_cli_text_list *l;
     pa_strbuf *s;
-    pa_source_output *o;
-    uint32_t idx = PA_IDXSET_INVALID;
-    static const char* const state_table[] = {
-        [PA_SOURCE_OUTPUT_INIT] = "INIT",
-        [PA_SOURCE_OUTPUT_RUNNING] = "RUNNING",
-        [PA_SOURCE_OUTPUT_CORKED] = "CORKED",
-        [PA_SOURCE_OUTPUT_UNLINKED] = "UNLINKED"
-    };
+
     pa_assert(c);
 
     s = pa_strbuf_new();
 
-    pa_strbuf_printf(s, "%u source output(s) available.\n", pa_idxset_size(c->source_outputs));
+    pa_assert_se(l = pa_cli_text_list_new(c, PA_CLI_TEXT_SOURCE_OUTPUTS, PA_CLI_TEXT_PLAIN, NULL));
+    pa_cli_text_list_next(l, s, 0);
+    pa_cli_text_list_free(l);
 
-    PA_IDXSET_FOREACH(o, c->source_outputs, idx) {
-        char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t, clt[28];
-        pa_usec_t cl;
-        const char *cmn;
-        pa_cvolume v;
-        char *volume_str = NULL;
+    return pa_strbuf_to_string_free(s);
+}
 
-        cmn = pa_channel_map_to_pretty_name(&o->channel_map);
+static const char* const sink_input_state_table[] = {
+    [PA_SINK_INPUT_INIT] = "INIT",
+    [PA_SINK_INPUT_RUNNING] = "RUNNING",
+    [PA_SINK_INPUT_DRAINED] = "DRAINED",
+    [PA_SINK_INPUT_CORKED] = "CORKED",
+    [PA_SINK_INPUT_UNLINKED] = "UNLINKED"
+};
+
+static void sink_input_to_strbuf(pa_strbuf *s, pa_sink_input *i) {
+    char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t, clt[28];
+    pa_usec_t cl;
+    const char *cmn;
+    pa_cvolume v;
+    char *volume_str = NULL;
+
+    cmn = pa_channel_map_to_pretty_name(&i->channel_map);
+
+    if ((cl = pa_sink_input_get_requested_latency(i)) == (pa_usec_t) -1)
+        pa_snprintf(clt, sizeof(clt), "n/a");
+    else
+        pa_snprintf(clt, sizeof(clt), "%0.2f ms", (double) cl / PA_USEC_PER_MSEC);
+
+    pa_assert(i->sink);
+
+    if (pa_sink_input_is_volume_readable(i)) {
+        pa_sink_input_get_volume(i, &v, true);
+        volume_str = pa_sprintf_malloc("%s\n\t        balance %0.2f",
+                                       pa_cvolume_snprint_verbose(cv, sizeof(cv), &v, &i->channel_map, true),
+                                       pa_cvolume_get_balance(&v, &i->channel_map));
+    } else
+        volume_str = pa_xstrdup("n/a");
+
+    pa_strbuf_printf(
+        s,
+        "    index: %u\n"
+        "\tdriver: <%s>\n"
+        "\tflags: %s%s%s%s%s%s%s%s%s%s%s%s\n"
+        "\tstate: %s\n"
+        "\tsink: %u <%s>\n"
+        "\tvolume: %s\n"
+        "\tmuted: %s\n"
+        "\tcurrent latency: %0.2f ms\n"
+        "\trequested latency: %s\n"
+        "\tsample spec: %s\n"
+        "\tchannel map: %s%s%s\n"
+        "\tresample method: %s\n",
+        i->index,
+        i->driver,
+        i->flags & PA_SINK_INPUT_VARIABLE_RATE ? "VARIABLE_RATE " : "",
+        i->flags & PA_SINK_INPUT_DONT_MOVE ? "DONT_MOVE " : "",
+        i->flags & PA_SINK_INPUT_START_CORKED ? "START_CORKED " : "",
+        i->flags & PA_SINK_INPUT_NO_REMAP ? "NO_REMAP " : "",
+        i->flags & PA_SINK_INPUT_NO_REMIX ? "NO_REMIX " : "",
+        i->flags & PA_SINK_INPUT_FIX_FORMAT ? "FIX_FORMAT " : "",
+        i->flags & PA_SINK_INPUT_FIX_RATE ? "FIX_RATE " : "",
+        i->flags & PA_SINK_INPUT_FIX_CHANNELS ? "FIX_CHANNELS " : "",
+        i->flags & PA_SINK_INPUT_DONT_INHIBIT_AUTO_SUSPEND ? "DONT_INHIBIT_AUTO_SUSPEND " : "",
+        i->flags & PA_SINK_INPUT_NO_CREATE_ON_SUSPEND ? "NO_CREATE_SUSPEND " : "",
+        i->flags & PA_SINK_INPUT_KILL_ON_SUSPEND ? "KILL_ON_SUSPEND " : "",
+        i->flags & PA_SINK_INPUT_PASSTHROUGH ? "PASSTHROUGH " : "",
+        sink_input_state_table[pa_sink_input_get_state(i)],
+        i->sink->index, i->sink->name,
+        volume_str,
+        pa_yes_no(i->muted),
+        (double) pa_sink_input_get_latency(i, NULL) / PA_USEC_PER_MSEC,
+        clt,
+        pa_sample_spec_snprint(ss, sizeof(ss), &i->sample_spec),
+        pa_channel_map_snprint(cm, sizeof(cm), &i->channel_map),
+        cmn ? "\n\t             " : "",
+        cmn ? cmn : "",
+        pa_resample_method_to_string(pa_sink_input_get_resample_method(i)));
+
+    pa_xfree(volume_str);
+
+    if (i->module)
+        pa_strbuf_printf(s, "\tmodule: %u\n", i->module->index);
+    if (i->client)
+        pa_strbuf_printf(s, "\tclient: %u <%s>\n", i->client->index, pa_strnull(pa_proplist_gets(i->client->proplist, PA_PROP_APPLICATION_NAME)));
+
+    t = pa_proplist_to_string_sep(i->proplist, "\n\t\t");
+    pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
+    pa_xfree(t);
+}
 
-        if ((cl = pa_source_output_get_requested_latency(o)) == (pa_usec_t) -1)
-            pa_snprintf(clt, sizeof(clt), "n/a");
-        else
-            pa_snprintf(clt, sizeof(clt), "%0.2f ms", (double) cl / PA_USEC_PER_MSEC);
+char *pa_sink_input_list_to_string(pa_core *c) {
+    pa_cli_text_list *l;
+    pa_strbuf *s;
 
-        pa_assert(o->source);
+    pa_assert(c);
 
-        if (pa_source_output_is_volume_readable(o)) {
-            pa_source_output_get_volume(o, &v, true);
-            volume_str = pa_sprintf_malloc("%s\n\t        balance %0.2f",
-                                           pa_cvolume_snprint_verbose(cv, sizeof(cv), &v, &o->channel_map, true),
-                                           pa_cvolume_get_balance(&v, &o->channel_map));
-        } else
-            volume_str = pa_xstrdup("n/a");
+    s = pa_strbuf_new();
 
-        pa_strbuf_printf(
-            s,
-            "    index: %u\n"
-            "\tdriver: <%s>\n"
-            "\tflags: %s%s%s%s%s%s%s%s%s%s%s%s\n"
-            "\tstate: %s\n"
-            "\tsource: %u <%s>\n"
-            "\tvolume: %s\n"
-            "\tmuted: %s\n"
-            "\tcurrent latency: %0.2f ms\n"
-            "\trequested latency: %s\n"
-            "\tsample spec: %s\n"
-            "\tchannel map: %s%s%s\n"
-            "\tresample method: %s\n",
-            o->index,
-            o->driver,
-            o->flags & PA_SOURCE_OUTPUT_VARIABLE_RATE ? "VARIABLE_RATE " : "",
-            o->flags & PA_SOURCE_OUTPUT_DONT_MOVE ? "DONT_MOVE " : "",
-            o->flags & PA_SOURCE_OUTPUT_START_CORKED ? "START_CORKED " : "",
-            o->flags & PA_SOURCE_OUTPUT_NO_REMAP ? "NO_REMAP " : "",
-            o->flags & PA_SOURCE_OUTPUT_NO_REMIX ? "NO_REMIX " : "",
-            o->flags & PA_SOURCE_OUTPUT_FIX_FORMAT ? "FIX_FORMAT " : "",
-            o->flags & PA_SOURCE_OUTPUT_FIX_RATE ? "FIX_RATE " : "",
-            o->flags & PA_SOURCE_OUTPUT_FIX_CHANNELS ? "FIX_CHANNELS " : "",
-            o->flags & PA_SOURCE_OUTPUT_DONT_INHIBIT_AUTO_SUSPEND ? "DONT_INHIBIT_AUTO_SUSPEND " : "",
-            o->flags & PA_SOURCE_OUTPUT_NO_CREATE_ON_SUSPEND ? "NO_CREATE_ON_SUSPEND " : "",
-            o->flags & PA_SOURCE_OUTPUT_KILL_ON_SUSPEND ? "KILL_ON_SUSPEND " : "",
-            o->flags & PA_SOURCE_OUTPUT_PASSTHROUGH ? "PASSTHROUGH " : "",
-            state_table[pa_source_output_get_state(o)],
-            o->source->index, o->source->name,
-            volume_str,
-            pa_yes_no(o->muted),
-            (double) pa_source_output_get_latency(o, NULL) / PA_USEC_PER_MSEC,
-            clt,
-            pa_sample_spec_snprint(ss, sizeof(ss), &o->sample_spec),
-            pa_channel_map_snprint(cm, sizeof(cm), &o->channel_map),
-            cmn ? "\n\t             " : "",
-            cmn ? cmn : "",
-            pa_resample_method_to_string(pa_source_output_get_resample_method(o)));
+    pa_assert_se(l = pa_cli_text_list_new(c, PA_CLI_TEXT_SINK_INPUTS, PA_CLI_TEXT_PLAIN, NULL));
+    pa_cli_text_list_next(l, s, 0);
+    pa_cli_text_list_free(l);
 
-        pa_xfree(volume_str);
+    return pa_strbuf_to_string_free(s);
+}
 
-        if (o->module)
-            pa_strbuf_printf(s, "\towner module: %u\n", o->module->index);
-        if (o->client)
-            pa_strbuf_printf(s, "\tclient: %u <%s>\n", o->client->index, pa_strnull(pa_proplist_gets(o->client->proplist, PA_PROP_APPLICATION_NAME)));
-        if (o->direct_on_input)
-            pa_strbuf_printf(s, "\tdirect on input: %u\n", o->direct_on_input->index);
+/* Fields of sink inputs and source outputs that can be selected. The order is
+ * the order of output. */
+enum {
+    FIELD_INDEX,
+    FIELD_DRIVER,
+    FIELD_STATE,
+    FIELD_DEVICE,
+    FIELD_DEVICE_NAME,
+    FIELD_VOLUME,
+    FIELD_MUTED,
+    FIELD_LATENCY,
+    FIELD_REQUESTED_LATENCY,
+    FIELD_SAMPLE_SPEC,
+    FIELD_CHANNEL_MAP,
+    FIELD_RESAMPLE_METHOD,
+    FIELD_MODULE,
+    FIELD_CLIENT,
+    FIELD_PROPERTIES,
+    FIELD_MAX
+};
+
+static const char* const field_names[FIELD_MAX] = {
+    [FIELD_INDEX] = "index",
+    [FIELD_DRIVER] = "driver",
+    [FIELD_STATE] = "state",
+    [FIELD_DEVICE] = "device",
+    [FIELD_DEVICE_NAME] = "device_name",
+    [FIELD_VOLUME] = "volume",
+    [FIELD_MUTED] = "muted",
+    [FIELD_LATENCY] = "latency_usec",
+    [FIELD_REQUESTED_LATENCY] = "requested_latency_usec",
+    [FIELD_SAMPLE_SPEC] = "sample_spec",
+    [FIELD_CHANNEL_MAP] = "channel_map",
+    [FIELD_RESAMPLE_METHOD] = "resample_method",
+    [FIELD_MODULE] = "module",
+    [FIELD_CLIENT] = "client",
+    [FIELD_PROPERTIES] = "properties",
+};
+
+#define FIELDS_ALL ((1U << FIELD_MAX) - 1)
+
+struct pa_cli_text_list {
+    pa_core *core;
+    pa_cli_text_list_type type;
+    pa_cli_text_format format;
+    unsigned fields; /* Bitmask, 0 selects the classic plain text listing */
+
+    uint32_t idx;
+    bool started;
+    unsigned n_entries;
+};
+
+/* What both sink inputs and source outputs have. Pointers point into the
+ * stream. */
+struct stream_data {
+    uint32_t index;
+    const char *driver;
+    const char *state;
+    uint32_t device_index;
+    const char *device_name;
+    bool volume_readable;
+    pa_cvolume volume;
+    bool muted;
+    pa_usec_t latency;
+    pa_usec_t requested_latency;
+    const pa_sample_spec *sample_spec;
+    const pa_channel_map *channel_map;
+    pa_resample_method_t resample_method;
+    pa_module *module;
+    pa_client *client;
+    pa_proplist *proplist;
+};
+
+static void sink_input_data(pa_sink_input *i, unsigned fields, struct stream_data *d) {
+    d->index = i->index;
+    d->driver = i->driver;
+    d->state = sink_input_state_table[pa_sink_input_get_state(i)];
+    d->device_index = i->sink->index;
+    d->device_name = i->sink->name;
+    if ((d->volume_readable = pa_sink_input_is_volume_readable(i)))
+        pa_sink_input_get_volume(i, &d->volume, true);
+    d->muted = i->muted;
+    /* Asks the IO thread, so only do it when needed */
+    d->latency = (fields & (1U << FIELD_LATENCY)) ? pa_sink_input_get_latency(i, NULL) : 0;
+    d->requested_latency = pa_sink_input_get_requested_latency(i);
+    d->sample_spec = &i->sample_spec;
+    d->channel_map = &i->channel_map;
+    d->resample_method = pa_sink_input_get_resample_method(i);
+    d->module = i->module;
+    d->client = i->client;
+    d->proplist = i->proplist;
+}
 
-        t = pa_proplist_to_string_sep(o->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
+static void source_output_data(pa_source_output *o, unsigned fields, struct stream_data *d) {
+    d->index = o->index;
+    d->driver = o->driver;
+    d->state = source_output_state_table[pa_source_output_get_state(o)];
+    d->device_index = o->source->index;
+    d->device_name = o->source->name;
+    if ((d->volume_readable = pa_source_output_is_volume_readable(o)))
+        pa_source_output_get_volume(o, &d->volume, true);
+    d->muted = o->muted;
+    d->latency = (fields & (1U << FIELD_LATENCY)) ? pa_source_output_get_latency(o, NULL) : 0;
+    d->requested_latency = pa_source_output_get_requested_latency(o);
+    d->sample_spec = &o->sample_spec;
+    d->channel_map = &o->channel_map;
+    d->resample_method = pa_source_output_get_resample_method(o);
+    d->module = o->module;
+    d->client = o->client;
+    d->proplist = o->proplist;
+}
+
+static void json_put_string(pa_strbuf *s, const char *str) {
+    if (!str) {
+        pa_strbuf_puts(s, "null");
+        return;
     }
 
-    return pa_strbuf_to_string_free(s);
+    pa_strbuf_putc(s, '"');
+
+    for (; *str; str++) {
+        switch (*str) {
+            case '"':
+            case '\\':
+                pa_strbuf_putc(s, '\\');
+                pa_strbuf_putc(s, *str);
+                break;
+
+            case '\n':
+                pa_strbuf_puts(s, "\\n");
+                break;
+
+            case '\t':
+                pa_strbuf_puts(s, "\\t");
+                break;
+
+            default:
+                if ((unsigned char) *str < 0x20)
+                    pa_strbuf_printf(s, "\\u%04x", (unsigned char) *str);
+                else
+                    pa_strbuf_putc(s, *str);
+        }
+    }
+
+    pa_strbuf_putc(s, '"');
 }
 
-char *pa_sink_input_list_to_string(pa_core *c) {
-    pa_strbuf *s;
-    pa_sink_input *i;
-    uint32_t idx = PA_IDXSET_INVALID;
-    static const char* const state_table[] = {
-        [PA_SINK_INPUT_INIT] = "INIT",
-        [PA_SINK_INPUT_RUNNING] = "RUNNING",
-        [PA_SINK_INPUT_DRAINED] = "DRAINED",
-        [PA_SINK_INPUT_CORKED] = "CORKED",
-        [PA_SINK_INPUT_UNLINKED] = "UNLINKED"
-    };
+static void json_put_proplist(pa_strbuf *s, pa_proplist *p) {
+    const char *key, *value;
+    void *state = NULL;
+    bool first = true;
 
-    pa_assert(c);
-    s = pa_strbuf_new();
+    pa_strbuf_putc(s, '{');
 
-    pa_strbuf_printf(s, "%u sink input(s) available.\n", pa_idxset_size(c->sink_inputs));
+    while ((key = pa_proplist_iterate(p, &state))) {
+        /* Binary properties aren't representable */
+        if (!(value = pa_proplist_gets(p, key)))
+            continue;
 
-    PA_IDXSET_FOREACH(i, c->sink_inputs, idx) {
-        char ss[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], *t, clt[28];
-        pa_usec_t cl;
-        const char *cmn;
-        pa_cvolume v;
-        char *volume_str = NULL;
+        if (!first)
+            pa_strbuf_puts(s, ", ");
+        first = false;
+
+        json_put_string(s, key);
+        pa_strbuf_puts(s, ": ");
+        json_put_string(s, value);
+    }
+
+    pa_strbuf_putc(s, '}');
+}
+
+static void json_put_field(pa_strbuf *s, const struct stream_data *d, unsigned field) {
+    char buf[PA_MAX(PA_SAMPLE_SPEC_SNPRINT_MAX, PA_CHANNEL_MAP_SNPRINT_MAX)];
+    unsigned c;
+
+    switch (field) {
+        case FIELD_INDEX:
+            pa_strbuf_printf(s, "%u", d->index);
+            break;
+        case FIELD_DRIVER:
+            json_put_string(s, d->driver);
+            break;
+        case FIELD_STATE:
+            json_put_string(s, d->state);
+            break;
+        case FIELD_DEVICE:
+            pa_strbuf_printf(s, "%u", d->device_index);
+            break;
+        case FIELD_DEVICE_NAME:
+            json_put_string(s, d->device_name);
+            break;
+        case FIELD_VOLUME:
+            if (!d->volume_readable) {
+                pa_strbuf_puts(s, "null");
+                break;
+            }
+            pa_strbuf_putc(s, '[');
+            for (c = 0; c < d->volume.channels; c++)
+                pa_strbuf_printf(s, c ? ", %u" : "%u", d->volume.values[c]);
+            pa_strbuf_putc(s, ']');
+            break;
+        case FIELD_MUTED:
+            pa_strbuf_puts(s, d->muted ? "true" : "false");
+            break;
+        case FIELD_LATENCY:
+            pa_strbuf_printf(s, "%llu", (unsigned long long) d->latency);
+            break;
+        case FIELD_REQUESTED_LATENCY:
+            if (d->requested_latency == (pa_usec_t) -1)
+                pa_strbuf_puts(s, "null");
+            else
+                pa_strbuf_printf(s, "%llu", (unsigned long long) d->requested_latency);
+            break;
+        case FIELD_SAMPLE_SPEC:
+            json_put_string(s, pa_sample_spec_snprint(buf, sizeof(buf), d->sample_spec));
+            break;
+        case FIELD_CHANNEL_MAP:
+            json_put_string(s, pa_channel_map_snprint(buf, sizeof(buf), d->channel_map));
+            break;
+        case FIELD_RESAMPLE_METHOD:
+            json_put_string(s, pa_resample_method_to_string(d->resample_method));
+            break;
+        case FIELD_MODULE:
+            if (d->module)
+                pa_strbuf_printf(s, "%u", d->module->index);
+            else
+                pa_strbuf_puts(s, "null");
+            break;
+        case FIELD_CLIENT:
+            if (d->client)
+                pa_strbuf_printf(s, "%u", d->client->index);
+            else
+                pa_strbuf_puts(s, "null");
+            break;
+        case FIELD_PROPERTIES:
+            json_put_proplist(s, d->proplist);
+            break;
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+static void plain_put_field(pa_strbuf *s, const struct stream_data *d, unsigned field) {
+    char buf[PA_MAX(PA_CVOLUME_SNPRINT_VERBOSE_MAX, PA_MAX(PA_SAMPLE_SPEC_SNPRINT_MAX, PA_CHANNEL_MAP_SNPRINT_MAX))];
+    char *t;
+
+    pa_strbuf_printf(s, "\t%s: ", field_names[field]);
+
+    switch (field) {
+        case FIELD_VOLUME:
+            pa_strbuf_puts(s, d->volume_readable ? pa_cvolume_snprint_verbose(buf, sizeof(buf), &d->volume, d->channel_map, true) : "n/a");
+            break;
+        case FIELD_DRIVER:
+            pa_strbuf_puts(s, pa_strnull(d->driver));
+            break;
+        case FIELD_STATE:
+            pa_strbuf_puts(s, d->state);
+            break;
+        case FIELD_DEVICE_NAME:
+            pa_strbuf_puts(s, d->device_name);
+            break;
+        case FIELD_RESAMPLE_METHOD:
+            pa_strbuf_puts(s, pa_resample_method_to_string(d->resample_method));
+            break;
+        case FIELD_SAMPLE_SPEC:
+            pa_strbuf_puts(s, pa_sample_spec_snprint(buf, sizeof(buf), d->sample_spec));
+            break;
+        case FIELD_CHANNEL_MAP:
+            pa_strbuf_puts(s, pa_channel_map_snprint(buf, sizeof(buf), d->channel_map));
+            break;
+        case FIELD_MUTED:
+            pa_strbuf_puts(s, pa_yes_no(d->muted));
+            break;
+        case FIELD_PROPERTIES:
+            t = pa_proplist_to_string_sep(d->proplist, "\n\t\t");
+            pa_strbuf_printf(s, "\n\t\t%s", t);
+            pa_xfree(t);
+            break;
+        default:
+            /* Numbers and the rest look the same in both formats */
+            json_put_field(s, d, field);
+    }
+
+    pa_strbuf_putc(s, '\n');
+}
 
-        cmn = pa_channel_map_to_pretty_name(&i->channel_map);
+static void stream_to_strbuf(pa_cli_text_list *l, pa_strbuf *s, void *stream) {
+    struct stream_data d;
+    unsigned field;
+    bool first = true;
 
-        if ((cl = pa_sink_input_get_requested_latency(i)) == (pa_usec_t) -1)
-            pa_snprintf(clt, sizeof(clt), "n/a");
+    if (l->fields == 0) {
+        if (l->type == PA_CLI_TEXT_SINK_INPUTS)
+            sink_input_to_strbuf(s, stream);
         else
-            pa_snprintf(clt, sizeof(clt), "%0.2f ms", (double) cl / PA_USEC_PER_MSEC);
+            source_output_to_strbuf(s, stream);
+        return;
+    }
 
-        pa_assert(i->sink);
+    if (l->type == PA_CLI_TEXT_SINK_INPUTS)
+        sink_input_data(stream, l->fields, &d);
+    else
+        source_output_data(stream, l->fields, &d);
 
-        if (pa_sink_input_is_volume_readable(i)) {
-            pa_sink_input_get_volume(i, &v, true);
-            volume_str = pa_sprintf_malloc("%s\n\t        balance %0.2f",
-                                           pa_cvolume_snprint_verbose(cv, sizeof(cv), &v, &i->channel_map, true),
-                                           pa_cvolume_get_balance(&v, &i->channel_map));
-        } else
-            volume_str = pa_xstrdup("n/a");
+    if (l->format == PA_CLI_TEXT_JSON)
+        pa_strbuf_puts(s, l->n_entries > 0 ? ",\n{" : "{");
 
-        pa_strbuf_printf(
-            s,
-            "    index: %u\n"
-            "\tdriver: <%s>\n"
-            "\tflags: %s%s%s%s%s%s%s%s%s%s%s%s\n"
-            "\tstate: %s\n"
-            "\tsink: %u <%s>\n"
-            "\tvolume: %s\n"
-            "\tmuted: %s\n"
-            "\tcurrent latency: %0.2f ms\n"
-            "\trequested latency: %s\n"
-            "\tsample spec: %s\n"
-            "\tchannel map: %s%s%s\n"
-            "\tresample method: %s\n",
-            i->index,
-            i->driver,
-            i->flags & PA_SINK_INPUT_VARIABLE_RATE ? "VARIABLE_RATE " : "",
-            i->flags & PA_SINK_INPUT_DONT_MOVE ? "DONT_MOVE " : "",
-            i->flags & PA_SINK_INPUT_START_CORKED ? "START_CORKED " : "",
-            i->flags & PA_SINK_INPUT_NO_REMAP ? "NO_REMAP " : "",
-            i->flags & PA_SINK_INPUT_NO_REMIX ? "NO_REMIX " : "",
-            i->flags & PA_SINK_INPUT_FIX_FORMAT ? "FIX_FORMAT " : "",
-            i->flags & PA_SINK_INPUT_FIX_RATE ? "FIX_RATE " : "",
-            i->flags & PA_SINK_INPUT_FIX_CHANNELS ? "FIX_CHANNELS " : "",
-            i->flags & PA_SINK_INPUT_DONT_INHIBIT_AUTO_SUSPEND ? "DONT_INHIBIT_AUTO_SUSPEND " : "",
-            i->flags & PA_SINK_INPUT_NO_CREATE_ON_SUSPEND ? "NO_CREATE_SUSPEND " : "",
-            i->flags & PA_SINK_INPUT_KILL_ON_SUSPEND ? "KILL_ON_SUSPEND " : "",
-            i->flags & PA_SINK_INPUT_PASSTHROUGH ? "PASSTHROUGH " : "",
-            state_table[pa_sink_input_get_state(i)],
-            i->sink->index, i->sink->name,
-            volume_str,
-            pa_yes_no(i->muted),
-            (double) pa_sink_input_get_latency(i, NULL) / PA_USEC_PER_MSEC,
-            clt,
-            pa_sample_spec_snprint(ss, sizeof(ss), &i->sample_spec),
-            pa_channel_map_snprint(cm, sizeof(cm), &i->channel_map),
-            cmn ? "\n\t             " : "",
-            cmn ? cmn : "",
-            pa_resample_method_to_string(pa_sink_input_get_resample_method(i)));
+    for (field = 0; field < FIELD_MAX; field++) {
+        if (!(l->fields & (1U << field)))
+            continue;
 
-        pa_xfree(volume_str);
+        if (l->format == PA_CLI_TEXT_JSON) {
+            pa_strbuf_printf(s, "%s\"%s\": ", first ? "" : ", ", field_names[field]);
+            json_put_field(s, &d, field);
+        } else if (field == FIELD_INDEX)
+            pa_strbuf_printf(s, "    index: %u\n", d.index);
+        else
+            plain_put_field(s, &d, field);
 
-        if (i->module)
-            pa_strbuf_printf(s, "\tmodule: %u\n", i->module->index);
-        if (i->client)
-            pa_strbuf_printf(s, "\tclient: %u <%s>\n", i->client->index, pa_strnull(pa_proplist_gets(i->client->proplist, PA_PROP_APPLICATION_NAME)));
+        first = false;
+    }
 
-        t = pa_proplist_to_string_sep(i->proplist, "\n\t\t");
-        pa_strbuf_printf(s, "\tproperties:\n\t\t%s\n", t);
-        pa_xfree(t);
+    if (l->format == PA_CLI_TEXT_JSON)
+        pa_strbuf_putc(s, '}');
+}
+
+static int parse_fields(const char *fields, unsigned *mask) {
+    const char *state = NULL;
+    char *f;
+
+    *mask = 0;
+
+    while ((f = pa_split(fields, ",", &state))) {
+        unsigned i;
+
+        for (i = 0; i < FIELD_MAX; i++)
+            if (pa_streq(f, field_names[i]))
+                break;
+
+        pa_xfree(f);
+
+        if (i >= FIELD_MAX)
+            return -1;
+
+        *mask |= 1U << i;
     }
 
-    return pa_strbuf_to_string_free(s);
+    return *mask ? 0 : -1;
+}
+
+pa_cli_text_list *pa_cli_text_list_new(pa_core *c, pa_cli_text_list_type type, pa_cli_text_format format, const char *fields) {
+    pa_cli_text_list *l;
+    unsigned mask = 0;
+
+    pa_assert(c);
+
+    if (fields && parse_fields(fields, &mask) < 0)
+        return NULL;
+
+    if (format == PA_CLI_TEXT_JSON && mask == 0)
+        mask = FIELDS_ALL;
+
+    l = pa_xnew0(pa_cli_text_list, 1);
+    l->core = c;
+    l->type = type;
+    l->format = format;
+    l->fields = mask;
+    l->idx = PA_IDXSET_INVALID;
+
+    return l;
+}
+
+void pa_cli_text_list_free(pa_cli_text_list *l) {
+    pa_assert(l);
+
+    pa_xfree(l);
 }
 
+bool pa_cli_text_list_next(pa_cli_text_list *l, pa_strbuf *s, unsigned n) {
+    pa_idxset *set;
+    void *stream;
+    unsigned i;
+
+    pa_assert(l);
+    pa_assert(s);
+
+    set = l->type == PA_CLI_TEXT_SINK_INPUTS ? l->core->sink_inputs : l->core->source_outputs;
+
+    if (!l->started) {
+        l->started = true;
+
+        if (l->format == PA_CLI_TEXT_JSON)
+            pa_strbuf_puts(s, "[\n");
+        else
+            pa_strbuf_printf(s, l->type == PA_CLI_TEXT_SINK_INPUTS ? "%u sink input(s) available.\n" : "%u source output(s) available.\n",
+                             pa_idxset_size(set));
+
+        stream = pa_idxset_first(set, &l->idx);
+    } else
+        /* Copes with the stream at idx having gone away in the meantime */
+        stream = pa_idxset_next(set, &l->idx);
+
+    for (i = 0; stream; i++) {
+        stream_to_strbuf(l, s, stream);
+        l->n_entries++;
+
+        if (n > 0 && i + 1 >= n)
+            return false;
+
+        stream = pa_idxset_next(set, &l->idx);
+    }
+
+    if (l->format == PA_CLI_TEXT_JSON)
+        pa_strbuf_puts(s, l->n_entries > 0 ? "\n]\n" : "]\n");
+
+    return true;
+}
 char *pa_scache_list_to_string(pa_core *c) {
     pa_strbuf *s;
     pa_assert(c);
@@ -675,7 +1107,7 @@ char *pa_scache_list_to_string(pa_core *c) {
 
             cmn = pa_channel_map_to_pretty_name(&e->channel_map);
 
-            if (e->memchunk.memblock) {
+            if (pa_scache_entry_is_loaded(e)) {
                 pa_sample_spec_snprint(ss, sizeof(ss), &e->sample_spec);
                 pa_channel_map_snprint(cm, sizeof(cm), &e->channel_map);
                 l = (double) e->memchunk.length / (double) pa_bytes_per_second(&e->sample_spec);
@@ -699,10 +1131,10 @@ char *pa_scache_list_to_string(pa_core *c) {
                 cm,
                 cmn ? "\n\t             " : "",
                 cmn ? cmn : "",
-                (long unsigned)(e->memchunk.memblock ? e->memchunk.length : 0),
+                (long unsigned)(pa_scache_entry_is_loaded(e) ? e->memchunk.length : 0),
                 l,
                 e->volume_is_set ? pa_cvolume_snprint_verbose(cv, sizeof(cv), &e->volume, &e->channel_map, true) : "n/a",
-                (e->memchunk.memblock && e->volume_is_set) ? pa_cvolume_get_balance(&e->volume, &e->channel_map) : 0.0f,
+                (pa_scache_entry_is_loaded(e) && e->volume_is_set) ? pa_cvolume_get_balance(&e->volume, &e->channel_map) : 0.0f,
                 pa_yes_no(e->lazy),
                 e->filename ? e->filename : "n/a");
 
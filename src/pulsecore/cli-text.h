@@ -21,6 +21,7 @@
 ***/
 
 #include <pulsecore/core.h>
+#include <pulsecore/strbuf.h>
 
 /* Some functions to generate pretty formatted listings of
  * entities. The returned strings have to be freed manually. */
@@ -36,4 +37,29 @@ char *pa_scache_list_to_string(pa_core *c);
 
 char *pa_full_status_string(pa_core *c);
 
+/* Listing of streams that can be produced a few entries at a time, so that a
+ * long list doesn't block the main loop. Entries that are added or removed
+ * while the listing is in progress may or may not show up. */
+
+typedef enum pa_cli_text_list_type {
+    PA_CLI_TEXT_SINK_INPUTS,
+    PA_CLI_TEXT_SOURCE_OUTPUTS,
+} pa_cli_text_list_type;
+
+typedef enum pa_cli_text_format {
+    PA_CLI_TEXT_PLAIN,
+    PA_CLI_TEXT_JSON,
+} pa_cli_text_format;
+
+typedef struct pa_cli_text_list pa_cli_text_list;
+
+/* fields is a comma separated list of field names or NULL for all of them.
+ * Returns NULL if it contains an unknown field. */
+pa_cli_text_list *pa_cli_text_list_new(pa_core *c, pa_cli_text_list_type type, pa_cli_text_format format, const char *fields);
+void pa_cli_text_list_free(pa_cli_text_list *l);
+
+/* Appends up to n entries (0 for all remaining) to s. Returns true once the
+ * listing is complete. */
+bool pa_cli_text_list_next(pa_cli_text_list *l, pa_strbuf *s, unsigned n);
+
 #endif
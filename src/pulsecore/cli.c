@@ -36,11 +36,15 @@
 #include <pulsecore/cli-command.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/queue.h>
 
 #include "cli.h"
 
 #define PROMPT ">>> "
 
+/* How many entries of a stream listing to produce per main loop iteration */
+#define LIST_CHUNK 16
+
 struct pa_cli {
     pa_core *core;
     pa_ioline *line;
@@ -55,9 +59,17 @@ struct pa_cli {
 
     bool interactive;
     char *last_line;
+
+    /* A stream listing in progress. Lines that arrive in the meantime are
+     * queued and processed once it is complete. */
+    pa_cli_text_list *list;
+    pa_defer_event *list_event;
+    pa_queue *pending_lines;
+    bool eof_pending;
 };
 
 static void line_callback(pa_ioline *line, const char *s, void *userdata);
+static void list_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata);
 static void client_kill(pa_client *c);
 
 pa_cli* pa_cli_new(pa_core *core, pa_iochannel *io, pa_module *m) {
@@ -90,12 +102,21 @@ pa_cli* pa_cli_new(pa_core *core, pa_iochannel *io, pa_module *m) {
 
     pa_ioline_set_callback(c->line, line_callback, c);
 
+    c->list_event = core->mainloop->defer_new(core->mainloop, list_cb, c);
+    core->mainloop->defer_enable(c->list_event, 0);
+    c->pending_lines = pa_queue_new();
+
     return c;
 }
 
 void pa_cli_free(pa_cli *c) {
     pa_assert(c);
 
+    c->core->mainloop->defer_free(c->list_event);
+    if (c->list)
+        pa_cli_text_list_free(c->list);
+    pa_queue_free(c->pending_lines, pa_xfree);
+
     pa_ioline_close(c->line);
     pa_ioline_unref(c->line);
     pa_client_free(c->client);
@@ -117,21 +138,33 @@ static void client_kill(pa_client *client) {
         c->eof_callback(c, c->userdata);
 }
 
-static void line_callback(pa_ioline *line, const char *s, void *userdata) {
+/* Returns false if c has been freed */
+static bool finish_line(pa_cli *c) {
+    if (c->kill_requested) {
+        if (c->eof_callback)
+            c->eof_callback(c, c->userdata);
+        return false;
+    }
+
+    if (c->interactive)
+        pa_ioline_puts(c->line, PROMPT);
+
+    return true;
+}
+
+/* Returns false if c has been freed */
+static bool process_line(pa_cli *c, const char *s) {
     pa_strbuf *buf;
-    pa_cli *c = userdata;
+    bool is_list;
     char *p;
 
-    pa_assert(line);
-    pa_assert(c);
-
     if (!s) {
         pa_log_debug("CLI got EOF from user.");
 
         if (c->eof_callback)
             c->eof_callback(c, c->userdata);
 
-        return;
+        return false;
     }
 
     /* Magic command, like they had in AT Hayes Modems! Those were the good days! */
@@ -148,18 +181,75 @@ static void line_callback(pa_ioline *line, const char *s, void *userdata) {
         pa_strbuf_printf(buf, "Welcome to PulseAudio %s! "
             "Use \"help\" for usage information.\n", PACKAGE_VERSION);
         c->interactive = true;
-    }
-    else
+    } else if ((c->list = pa_cli_command_list_new(c->core, s, buf, &is_list))) {
+        /* Long listings are written a chunk at a time from list_cb() so that
+         * the main loop keeps running */
+        c->core->mainloop->defer_enable(c->list_event, 1);
+    } else if (!is_list)
         pa_cli_command_execute_line(c->core, s, buf, &c->fail);
     c->defer_kill--;
-    pa_ioline_puts(line, p = pa_strbuf_to_string_free(buf));
+    pa_ioline_puts(c->line, p = pa_strbuf_to_string_free(buf));
     pa_xfree(p);
 
-    if (c->kill_requested) {
-        if (c->eof_callback)
-            c->eof_callback(c, c->userdata);
-    } else if (c->interactive)
-        pa_ioline_puts(line, PROMPT);
+    if (c->list)
+        return true;
+
+    return finish_line(c);
+}
+
+static void line_callback(pa_ioline *line, const char *s, void *userdata) {
+    pa_cli *c = userdata;
+
+    pa_assert(line);
+    pa_assert(c);
+
+    if (c->list) {
+        if (s)
+            pa_queue_push(c->pending_lines, pa_xstrdup(s));
+        else
+            c->eof_pending = true;
+        return;
+    }
+
+    process_line(c, s);
+}
+
+static void list_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    pa_cli *c = userdata;
+    pa_strbuf *buf;
+    bool done;
+    char *p;
+
+    pa_assert(c);
+    pa_assert(c->list);
+
+    pa_assert_se(buf = pa_strbuf_new());
+    done = pa_cli_text_list_next(c->list, buf, LIST_CHUNK);
+    pa_ioline_puts(c->line, p = pa_strbuf_to_string_free(buf));
+    pa_xfree(p);
+
+    if (!done)
+        return;
+
+    pa_cli_text_list_free(c->list);
+    c->list = NULL;
+    a->defer_enable(e, 0);
+
+    if (!finish_line(c))
+        return;
+
+    /* Replay what came in while we were busy, until the next listing */
+    while (!c->list && (p = pa_queue_pop(c->pending_lines))) {
+        bool alive = process_line(c, p);
+
+        pa_xfree(p);
+
+        if (!alive)
+            return;
+    }
+
+    if (!c->list && c->eof_pending)
+        process_line(c, NULL);
 }
 
 void pa_cli_set_eof_callback(pa_cli *c, pa_cli_eof_cb_t cb, void *userdata) {
@@ -46,9 +46,17 @@
 #include <windows.h>
 #endif
 
+#if defined(__x86_64__) && defined(__GNUC__) && defined(SUPPORT_TLS___THREAD) && defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#define HAVE_RTCLOCK_TSC 1
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 #include <pulse/timeval.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
 
 #include "core-rtclock.h"
 
@@ -56,6 +64,121 @@
 static int64_t counter_freq = 0;
 #endif
 
+/* Only changed by pa_rtclock_set_source(), before any threads run */
+static pa_rtclock_source_t clock_source = PA_RTCLOCK_SOURCE_PRECISE;
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+static clockid_t monotonic_clock = CLOCK_MONOTONIC;
+#endif
+
+#ifdef HAVE_RTCLOCK_TSC
+/* Each thread anchors the TSC to CLOCK_MONOTONIC at least every
+ * TSC_RESYNC_USEC, so that the error of the calibration can't add up to
+ * more than a few usec, and refines the slope from the time passed since
+ * its first anchor. The clock is only used if the TSC is invariant, i.e.
+ * ticks at a constant rate in all power states. */
+#define TSC_CALIBRATE_USEC (20 * PA_USEC_PER_MSEC)
+#define TSC_RESYNC_USEC (100 * PA_USEC_PER_MSEC)
+
+struct tsc_anchor {
+    uint64_t first_tsc, first_nsec;
+    uint64_t tsc, nsec;
+    /* Nanoseconds per tick, 32.32 fixed point */
+    uint64_t mult;
+    uint64_t last_nsec;
+};
+
+static uint64_t tsc_mult = 0;
+static __thread struct tsc_anchor tsc_anchor;
+
+static uint64_t monotonic_nsec(void) {
+    struct timespec ts;
+
+    pa_assert_se(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+    return (uint64_t) ts.tv_sec * PA_NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t tsc_slope(uint64_t nsec, uint64_t ticks) {
+    return (uint64_t) (((unsigned __int128) nsec << 32) / ticks);
+}
+
+static bool tsc_calibrate(void) {
+    unsigned a, b, c, d;
+    uint64_t tsc0, nsec0, tsc1, nsec1;
+    struct timespec ts;
+
+    if (!__get_cpuid(0x80000000, &a, &b, &c, &d) || a < 0x80000007)
+        return false;
+
+    __get_cpuid(0x80000007, &a, &b, &c, &d);
+
+    if (!(d & (1U << 8))) {
+        pa_log_info("The TSC is not invariant.");
+        return false;
+    }
+
+    tsc0 = __rdtsc();
+    nsec0 = monotonic_nsec();
+    nanosleep(pa_timespec_store(&ts, TSC_CALIBRATE_USEC), NULL);
+    tsc1 = __rdtsc();
+    nsec1 = monotonic_nsec();
+
+    /* Anything slower than 100 MHz is not a TSC we want to use */
+    if (tsc1 <= tsc0 || (tsc1 - tsc0) < (nsec1 - nsec0) / 10) {
+        pa_log_info("The TSC doesn't seem to tick properly.");
+        return false;
+    }
+
+    tsc_mult = tsc_slope(nsec1 - nsec0, tsc1 - tsc0);
+
+    pa_log_debug("TSC runs at %llu kHz.",
+                 (unsigned long long) ((tsc1 - tsc0) * PA_USEC_PER_MSEC / ((nsec1 - nsec0) / PA_NSEC_PER_USEC)));
+
+    return true;
+}
+
+static void tsc_resync(struct tsc_anchor *t) {
+    t->tsc = __rdtsc();
+    t->nsec = monotonic_nsec();
+
+    if (t->mult == 0) {
+        t->first_tsc = t->tsc;
+        t->first_nsec = t->nsec;
+        t->mult = tsc_mult;
+    } else if (t->tsc > t->first_tsc && t->nsec > t->first_nsec)
+        t->mult = tsc_slope(t->nsec - t->first_nsec, t->tsc - t->first_tsc);
+}
+
+static pa_usec_t tsc_now(void) {
+    struct tsc_anchor *t = &tsc_anchor;
+    uint64_t tsc, nsec;
+
+    tsc = __rdtsc();
+
+    /* The TSC going backwards means we were moved to a CPU whose TSC is
+     * not in sync, start over */
+    if (PA_UNLIKELY(t->mult == 0 || tsc < t->tsc)) {
+        tsc_resync(t);
+        nsec = t->nsec;
+    } else {
+        nsec = t->nsec + (uint64_t) (((unsigned __int128) (tsc - t->tsc) * t->mult) >> 32);
+
+        if (PA_UNLIKELY(nsec - t->nsec >= TSC_RESYNC_USEC * PA_NSEC_PER_USEC)) {
+            tsc_resync(t);
+            nsec = t->nsec;
+        }
+    }
+
+    /* A resync may step back by the error accumulated since the last one */
+    if (nsec < t->last_nsec)
+        nsec = t->last_nsec;
+
+    t->last_nsec = nsec;
+
+    return nsec / PA_NSEC_PER_USEC;
+}
+#endif /* HAVE_RTCLOCK_TSC */
+
 pa_usec_t pa_rtclock_age(const struct timeval *tv) {
     struct timeval now;
     pa_assert(tv);
@@ -84,8 +207,13 @@ struct timeval *pa_rtclock_get(struct timeval *tv) {
     /* No locking or atomic ops for no_monotonic here */
     static bool no_monotonic = false;
 
+#ifdef HAVE_RTCLOCK_TSC
+    if (clock_source == PA_RTCLOCK_SOURCE_TSC)
+        return pa_timeval_store(tv, tsc_now());
+#endif
+
     if (!no_monotonic)
-        if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        if (clock_gettime(monotonic_clock, &ts) < 0)
             no_monotonic = true;
 
     if (no_monotonic)
@@ -114,6 +242,83 @@ struct timeval *pa_rtclock_get(struct timeval *tv) {
     return pa_gettimeofday(tv);
 }
 
+static const char* const source_table[PA_RTCLOCK_SOURCE_MAX] = {
+    [PA_RTCLOCK_SOURCE_PRECISE] = "precise",
+    [PA_RTCLOCK_SOURCE_COARSE] = "coarse",
+    [PA_RTCLOCK_SOURCE_TSC] = "tsc"
+};
+
+const char *pa_rtclock_source_to_string(pa_rtclock_source_t source) {
+    if (source < 0 || source >= PA_RTCLOCK_SOURCE_MAX)
+        return NULL;
+
+    return source_table[source];
+}
+
+pa_rtclock_source_t pa_rtclock_source_from_string(const char *s) {
+    pa_rtclock_source_t source;
+
+    pa_assert(s);
+
+    for (source = 0; source < PA_RTCLOCK_SOURCE_MAX; source++)
+        if (pa_streq(s, source_table[source]))
+            return source;
+
+    return PA_RTCLOCK_SOURCE_INVALID;
+}
+
+int pa_rtclock_set_source(pa_rtclock_source_t source) {
+    pa_assert(source >= 0 && source < PA_RTCLOCK_SOURCE_MAX);
+
+    switch (source) {
+        case PA_RTCLOCK_SOURCE_PRECISE:
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+            monotonic_clock = CLOCK_MONOTONIC;
+#endif
+            break;
+
+        case PA_RTCLOCK_SOURCE_COARSE: {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_COARSE)
+            struct timespec ts;
+
+            if (clock_getres(CLOCK_MONOTONIC_COARSE, &ts) < 0 ||
+                pa_timespec_load(&ts) > PA_RTCLOCK_COARSE_MAX_USEC) {
+                pa_log_info("CLOCK_MONOTONIC_COARSE is not available or too coarse.");
+                return -1;
+            }
+
+            monotonic_clock = CLOCK_MONOTONIC_COARSE;
+            break;
+#else
+            return -1;
+#endif
+        }
+
+        case PA_RTCLOCK_SOURCE_TSC:
+#ifdef HAVE_RTCLOCK_TSC
+            if (tsc_mult == 0 && !tsc_calibrate())
+                return -1;
+
+            monotonic_clock = CLOCK_MONOTONIC;
+            break;
+#else
+            return -1;
+#endif
+
+        default:
+            pa_assert_not_reached();
+    }
+
+    clock_source = source;
+    pa_log_debug("Using the %s clock source.", pa_rtclock_source_to_string(source));
+
+    return 0;
+}
+
+pa_rtclock_source_t pa_rtclock_get_source(void) {
+    return clock_source;
+}
+
 bool pa_rtclock_hrtimer(void) {
 
 #if defined (OS_IS_DARWIN)
@@ -183,6 +388,15 @@ void pa_rtclock_hrtimer_enable(void) {
 #endif
 }
 
+void pa_rtclock_set_timer_slack(pa_usec_t slack) {
+
+#ifdef PR_SET_TIMERSLACK
+    /* Zero resets the thread's slack to the value it started with */
+    if (prctl(PR_SET_TIMERSLACK, (unsigned long) (slack * PA_NSEC_PER_USEC), 0, 0, 0) < 0)
+        pa_log_debug("PR_SET_TIMERSLACK failed: %s", pa_cstrerror(errno));
+#endif
+}
+
 struct timeval* pa_rtclock_from_wallclock(struct timeval *tv) {
     struct timeval wc_now, rt_now;
 
@@ -33,6 +33,35 @@ pa_usec_t pa_rtclock_age(const struct timeval *tv);
 bool pa_rtclock_hrtimer(void);
 void pa_rtclock_hrtimer_enable(void);
 
+/* Sets how late the timers of the calling thread may fire, so that the
+ * kernel can batch wakeups. 0 restores the default. Ignored for
+ * realtime threads. */
+void pa_rtclock_set_timer_slack(pa_usec_t slack);
+
+/* Where pa_rtclock_get() takes the time from */
+typedef enum pa_rtclock_source {
+    PA_RTCLOCK_SOURCE_INVALID = -1,
+    /* CLOCK_MONOTONIC, the default */
+    PA_RTCLOCK_SOURCE_PRECISE,
+    /* CLOCK_MONOTONIC_COARSE, which never needs a syscall */
+    PA_RTCLOCK_SOURCE_COARSE,
+    /* The invariant TSC of x86-64 CPUs, calibrated against CLOCK_MONOTONIC */
+    PA_RTCLOCK_SOURCE_TSC,
+    PA_RTCLOCK_SOURCE_MAX
+} pa_rtclock_source_t;
+
+/* The coarse clock is only used if its resolution is at least this */
+#define PA_RTCLOCK_COARSE_MAX_USEC 1000
+
+/* Must be called before any other threads are started. Returns a negative
+ * value and keeps the current source if the requested one is not
+ * available. */
+int pa_rtclock_set_source(pa_rtclock_source_t source);
+pa_rtclock_source_t pa_rtclock_get_source(void);
+
+const char *pa_rtclock_source_to_string(pa_rtclock_source_t source);
+pa_rtclock_source_t pa_rtclock_source_from_string(const char *s);
+
 /* timer with a resolution better than this are considered high-resolution */
 #define PA_HRTIMER_THRESHOLD_USEC 10
 
@@ -28,6 +28,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <time.h>
 
@@ -57,11 +58,20 @@
 #include <pulsecore/log.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/tagstruct.h>
 
 #include "core-scache.h"
 
 #define UNLOAD_POLL_TIME (60 * PA_USEC_PER_SEC)
 
+/* Lazily loaded samples are stored decoded in the state directory,
+ * so that loading them again after they have been unloaded doesn't
+ * need to run the decoder. A cache file is a header length, a header
+ * and the raw samples. The header identifies the source file by name,
+ * modification time and size, so a changed file is decoded again. */
+#define SAMPLE_CACHE_VERSION 1
+#define SAMPLE_CACHE_HEADER_MAX (64*1024)
+
 static void timeout_callback(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
     pa_core *c = userdata;
 
@@ -84,6 +94,7 @@ static void free_entry(pa_scache_entry *e) {
     pa_xfree(e->filename);
     if (e->memchunk.memblock)
         pa_memblock_unref(e->memchunk.memblock);
+    pa_xfree(e->compressed);
     if (e->proplist)
         pa_proplist_free(e->proplist);
     pa_xfree(e);
@@ -100,6 +111,7 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
         if (e->memchunk.memblock)
             pa_memblock_unref(e->memchunk.memblock);
 
+        pa_xfree(e->compressed);
         pa_xfree(e->filename);
         pa_proplist_clear(e->proplist);
 
@@ -127,6 +139,9 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
 
     e->last_used_time = 0;
     pa_memchunk_reset(&e->memchunk);
+    e->compressed = NULL;
+    e->compressed_length = 0;
+    e->decoded_used = 0;
     e->filename = NULL;
     e->lazy = false;
     e->last_used_time = 0;
@@ -141,6 +156,62 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name, bool *new_
     return e;
 }
 
+/* Replaces the samples of the entry by their compressed form, if the
+ * core wants that and it pays off. If keep_decoded is set the decoded
+ * samples stay around, as if they had just been played. */
+static void compress_entry(pa_scache_entry *e, bool keep_decoded) {
+    pa_assert(e);
+
+    if (!e->core->scache_compress || e->compressed || !e->memchunk.memblock)
+        return;
+
+    if (pa_sound_file_compress(&e->sample_spec, &e->memchunk, &e->compressed, &e->compressed_length) < 0)
+        return;
+
+    pa_log_debug("Compressed sample \"%s\" from %lu to %lu bytes.",
+                 e->name, (unsigned long) e->memchunk.length, (unsigned long) e->compressed_length);
+
+    if (keep_decoded) {
+        e->decoded_used = pa_rtclock_now();
+        return;
+    }
+
+    /* The length stays, it's the length of the sample after all */
+    pa_memblock_unref(e->memchunk.memblock);
+    e->memchunk.memblock = NULL;
+    e->memchunk.index = 0;
+}
+
+/* Drops the decoded copies of compressed samples, the ones played least
+ * recently first, until no more than max bytes of them are left. Those
+ * still being played keep their copy until they are done. */
+static void trim_decoded(pa_core *c, size_t max) {
+    pa_assert(c);
+
+    for (;;) {
+        pa_scache_entry *e, *lru = NULL;
+        uint32_t idx;
+        size_t total = 0;
+
+        PA_IDXSET_FOREACH(e, c->scache, idx) {
+            if (!e->compressed || !e->memchunk.memblock)
+                continue;
+
+            total += e->memchunk.length;
+
+            if (!lru || e->decoded_used < lru->decoded_used)
+                lru = e;
+        }
+
+        if (total <= max)
+            return;
+
+        pa_memblock_unref(lru->memchunk.memblock);
+        lru->memchunk.memblock = NULL;
+        lru->memchunk.index = 0;
+    }
+}
+
 int pa_scache_add_item(
         pa_core *c,
         const char *name,
@@ -187,6 +258,7 @@ int pa_scache_add_item(
     if (chunk) {
         e->memchunk = *chunk;
         pa_memblock_ref(e->memchunk.memblock);
+        compress_entry(e, false);
     }
 
     if (p)
@@ -300,6 +372,183 @@ void pa_scache_free_all(pa_core *c) {
     }
 }
 
+static char *sample_cache_path(const char *filename) {
+    char *dir, *fn;
+
+    if (!(dir = pa_state_path("sample-cache", true)))
+        return NULL;
+
+    if (pa_make_secure_dir(dir, 0700, (uid_t) -1, (gid_t) -1, false) < 0) {
+        pa_log_warn("Failed to create sample cache directory %s: %s", dir, pa_cstrerror(errno));
+        pa_xfree(dir);
+        return NULL;
+    }
+
+    /* Collisions are caught by the file name in the header */
+    fn = pa_sprintf_malloc("%s" PA_PATH_SEP "%08x", dir, pa_idxset_string_hash_func(filename));
+    pa_xfree(dir);
+
+    return fn;
+}
+
+static int sample_cache_load(pa_core *c, const char *filename, const struct stat *st, pa_sample_spec *ss, pa_channel_map *map, pa_memchunk *chunk, pa_proplist *p) {
+    char *fn;
+    int fd = -1, ret = -1;
+    uint32_t header_length, version, length;
+    uint8_t *header = NULL;
+    pa_tagstruct *t = NULL;
+    const char *source;
+    uint64_t mtime, size;
+    void *ptr;
+
+    pa_memchunk_reset(chunk);
+
+    if (!(fn = sample_cache_path(filename)))
+        return -1;
+
+    if ((fd = pa_open_cloexec(fn, O_RDONLY, 0)) < 0)
+        goto finish;
+
+    if (pa_loop_read(fd, &header_length, sizeof(header_length), NULL) != sizeof(header_length) ||
+        header_length > SAMPLE_CACHE_HEADER_MAX)
+        goto finish;
+
+    header = pa_xmalloc(PA_MAX(header_length, 1U));
+
+    if (pa_loop_read(fd, header, header_length, NULL) != (ssize_t) header_length)
+        goto finish;
+
+    t = pa_tagstruct_new_fixed(header, header_length);
+
+    if (pa_tagstruct_getu32(t, &version) < 0 ||
+        version != SAMPLE_CACHE_VERSION ||
+        pa_tagstruct_gets(t, &source) < 0 ||
+        !source ||
+        !pa_streq(source, filename) ||
+        pa_tagstruct_getu64(t, &mtime) < 0 ||
+        pa_tagstruct_getu64(t, &size) < 0 ||
+        mtime != (uint64_t) st->st_mtime ||
+        size != (uint64_t) st->st_size ||
+        pa_tagstruct_get_sample_spec(t, ss) < 0 ||
+        pa_tagstruct_get_channel_map(t, map) < 0 ||
+        !pa_channel_map_compatible(map, ss) ||
+        pa_tagstruct_get_proplist(t, p) < 0 ||
+        pa_tagstruct_getu32(t, &length) < 0 ||
+        length == 0 ||
+        length > PA_SCACHE_ENTRY_SIZE_MAX ||
+        !pa_frame_aligned(length, ss) ||
+        !pa_tagstruct_eof(t))
+        goto finish;
+
+    chunk->memblock = pa_memblock_new(c->mempool, length);
+    chunk->index = 0;
+    chunk->length = length;
+
+    ptr = pa_memblock_acquire(chunk->memblock);
+
+    if (pa_loop_read(fd, ptr, length, NULL) == (ssize_t) length)
+        ret = 0;
+
+    pa_memblock_release(chunk->memblock);
+
+finish:
+    if (ret < 0 && chunk->memblock) {
+        pa_memblock_unref(chunk->memblock);
+        pa_memchunk_reset(chunk);
+    }
+
+    if (t)
+        pa_tagstruct_free(t);
+
+    if (fd >= 0)
+        pa_close(fd);
+
+    pa_xfree(header);
+    pa_xfree(fn);
+
+    return ret;
+}
+
+static void sample_cache_save(const char *filename, const struct stat *st, const pa_sample_spec *ss, const pa_channel_map *map, const pa_memchunk *chunk, pa_proplist *p) {
+    char *fn, *tmp;
+    int fd;
+    pa_tagstruct *t;
+    const uint8_t *header;
+    size_t header_length;
+    uint32_t l;
+    void *ptr;
+    bool ok;
+
+    if (!(fn = sample_cache_path(filename)))
+        return;
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu32(t, SAMPLE_CACHE_VERSION);
+    pa_tagstruct_puts(t, filename);
+    pa_tagstruct_putu64(t, (uint64_t) st->st_mtime);
+    pa_tagstruct_putu64(t, (uint64_t) st->st_size);
+    pa_tagstruct_put_sample_spec(t, ss);
+    pa_tagstruct_put_channel_map(t, map);
+    pa_tagstruct_put_proplist(t, p);
+    pa_tagstruct_putu32(t, (uint32_t) chunk->length);
+    header = pa_tagstruct_data(t, &header_length);
+    l = (uint32_t) header_length;
+
+    tmp = pa_sprintf_malloc("%s.tmp", fn);
+
+    if ((fd = pa_open_cloexec(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0600)) < 0) {
+        pa_log_debug("Failed to create %s: %s", tmp, pa_cstrerror(errno));
+        goto finish;
+    }
+
+    ptr = pa_memblock_acquire_chunk(chunk);
+    ok = pa_loop_write(fd, &l, sizeof(l), NULL) == sizeof(l) &&
+        pa_loop_write(fd, header, header_length, NULL) == (ssize_t) header_length &&
+        pa_loop_write(fd, ptr, chunk->length, NULL) == (ssize_t) chunk->length;
+    pa_memblock_release(chunk->memblock);
+
+    pa_close(fd);
+
+    if (!ok || rename(tmp, fn) < 0) {
+        pa_log_debug("Failed to write %s: %s", fn, pa_cstrerror(errno));
+        unlink(tmp);
+    }
+
+finish:
+    pa_tagstruct_free(t);
+    pa_xfree(tmp);
+    pa_xfree(fn);
+}
+
+/* Like pa_sound_file_load(), but goes through the sample cache */
+static int load_lazy(pa_core *c, const char *filename, pa_sample_spec *ss, pa_channel_map *map, pa_memchunk *chunk, pa_proplist *p) {
+    struct stat st;
+    pa_proplist *tags;
+    int r = 0;
+
+    if (stat(filename, &st) < 0)
+        return pa_sound_file_load(c->mempool, filename, ss, map, chunk, p);
+
+    /* Only the properties of the file itself are cached */
+    tags = pa_proplist_new();
+
+    if (sample_cache_load(c, filename, &st, ss, map, chunk, tags) >= 0)
+        pa_log_debug("Loaded %s from the sample cache.", filename);
+    else {
+        pa_proplist_clear(tags);
+
+        if ((r = pa_sound_file_load(c->mempool, filename, ss, map, chunk, tags)) >= 0)
+            sample_cache_save(filename, &st, ss, map, chunk, tags);
+    }
+
+    if (r >= 0)
+        pa_proplist_update(p, PA_UPDATE_REPLACE, tags);
+
+    pa_proplist_free(tags);
+
+    return r;
+}
+
 int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t volume, pa_proplist *p, uint32_t *sink_input_idx) {
     pa_scache_entry *e;
     pa_cvolume r;
@@ -317,12 +566,14 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
     pa_proplist_sets(merged, PA_PROP_MEDIA_NAME, name);
     pa_proplist_sets(merged, PA_PROP_EVENT_ID, name);
 
-    if (e->lazy && !e->memchunk.memblock) {
+    if (e->lazy && !pa_scache_entry_is_loaded(e)) {
         pa_channel_map old_channel_map = e->channel_map;
 
-        if (pa_sound_file_load(c->mempool, e->filename, &e->sample_spec, &e->channel_map, &e->memchunk, merged) < 0)
+        if (load_lazy(c, e->filename, &e->sample_spec, &e->channel_map, &e->memchunk, merged) < 0)
             goto fail;
 
+        compress_entry(e, true);
+
         pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_CHANGE, e->index);
 
         if (e->volume_is_set) {
@@ -333,6 +584,15 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
         }
     }
 
+    if (e->compressed) {
+        if (!e->memchunk.memblock &&
+            pa_sound_file_decompress(c->mempool, &e->sample_spec, e->compressed, e->compressed_length,
+                                     e->memchunk.length, &e->memchunk) < 0)
+            goto fail;
+
+        e->decoded_used = pa_rtclock_now();
+    }
+
     if (!e->memchunk.memblock)
         goto fail;
 
@@ -368,6 +628,9 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
     if (e->lazy)
         time(&e->last_used_time);
 
+    if (e->compressed)
+        trim_decoded(c, c->scache_decoded_max);
+
     return 0;
 
 fail:
@@ -421,10 +684,13 @@ size_t pa_scache_total_size(pa_core *c) {
     if (!c->scache || !pa_idxset_size(c->scache))
         return 0;
 
-    PA_IDXSET_FOREACH(e, c->scache, idx)
+    PA_IDXSET_FOREACH(e, c->scache, idx) {
         if (e->memchunk.memblock)
             sum += e->memchunk.length;
 
+        sum += e->compressed_length;
+    }
+
     return sum;
 }
 
@@ -442,15 +708,20 @@ void pa_scache_unload_unused(pa_core *c) {
 
     PA_IDXSET_FOREACH(e, c->scache, idx) {
 
-        if (!e->lazy || !e->memchunk.memblock)
+        if (!e->lazy || !pa_scache_entry_is_loaded(e))
             continue;
 
         if (e->last_used_time + c->scache_idle_time > now)
             continue;
 
-        pa_memblock_unref(e->memchunk.memblock);
+        if (e->memchunk.memblock)
+            pa_memblock_unref(e->memchunk.memblock);
         pa_memchunk_reset(&e->memchunk);
 
+        pa_xfree(e->compressed);
+        e->compressed = NULL;
+        e->compressed_length = 0;
+
         pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_CHANGE, e->index);
     }
 }
@@ -39,6 +39,13 @@ typedef struct pa_scache_entry {
     pa_channel_map channel_map;
     pa_memchunk memchunk;
 
+    /* If the core stores samples compressed, this holds the sample.
+     * memchunk then only has a decoded copy while the sample is played
+     * often enough, but its length is kept either way. */
+    void *compressed;
+    size_t compressed_length;
+    pa_usec_t decoded_used;
+
     char *filename;
 
     bool lazy;
@@ -47,6 +54,11 @@ typedef struct pa_scache_entry {
     pa_proplist *proplist;
 } pa_scache_entry;
 
+/* Whether the sample data is there, decoded or not */
+static inline bool pa_scache_entry_is_loaded(const pa_scache_entry *e) {
+    return e->memchunk.memblock || e->compressed;
+}
+
 int pa_scache_add_item(pa_core *c, const char *name, const pa_sample_spec *ss, const pa_channel_map *map, const pa_memchunk *chunk, pa_proplist *p, uint32_t *idx);
 int pa_scache_add_file(pa_core *c, const char *name, const char *filename, uint32_t *idx);
 int pa_scache_add_file_lazy(pa_core *c, const char *name, const char *filename, uint32_t *idx);
@@ -23,8 +23,10 @@
 
 #include <stdio.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
@@ -35,16 +37,28 @@
  * register a callback function that is called whenever an event
  * matching a subscription mask happens. The execution of the callback
  * function is postponed to the next main loop iteration, i.e. is not
- * called from within the stack frame the entity was created in. */
+ * called from within the stack frame the entity was created in.
+ *
+ * Batched subscriptions collect the events for a while and pass them
+ * to their callback at most once per interval, collapsing redundant
+ * events for the same entity. */
 
 struct pa_subscription {
     pa_core *core;
     bool dead;
 
     pa_subscription_cb_t callback;
+    pa_subscription_flush_cb_t flush_callback;
     void *userdata;
     pa_subscription_mask_t mask;
 
+    /* Batched subscriptions only */
+    pa_usec_t interval;
+    pa_time_event *time_event;
+    bool timer_armed;
+    PA_LLIST_HEAD(pa_subscription_event, pending);
+    pa_subscription_event *pending_last;
+
     PA_LLIST_FIELDS(pa_subscription);
 };
 
@@ -61,18 +75,25 @@ static void sched_event(pa_core *c);
 
 /* Allocate a new subscription object for the given subscription mask. Use the specified callback function and user data */
 pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m, pa_subscription_cb_t callback, void *userdata) {
+    return pa_subscription_new_batched(c, m, 0, callback, NULL, userdata);
+}
+
+pa_subscription* pa_subscription_new_batched(pa_core *c, pa_subscription_mask_t m, pa_usec_t interval,
+                                             pa_subscription_cb_t callback, pa_subscription_flush_cb_t flush_callback, void *userdata) {
     pa_subscription *s;
 
     pa_assert(c);
     pa_assert(m);
     pa_assert(callback);
 
-    s = pa_xnew(pa_subscription, 1);
+    s = pa_xnew0(pa_subscription, 1);
     s->core = c;
     s->dead = false;
     s->callback = callback;
+    s->flush_callback = flush_callback;
     s->userdata = userdata;
     s->mask = m;
+    s->interval = interval;
 
     PA_LLIST_PREPEND(pa_subscription, c->subscriptions, s);
     return s;
@@ -87,10 +108,27 @@ void pa_subscription_free(pa_subscription*s) {
     sched_event(s->core);
 }
 
+static void free_pending(pa_subscription *s, pa_subscription_event *e) {
+    pa_assert(s);
+    pa_assert(e);
+
+    if (!e->next)
+        s->pending_last = e->prev;
+
+    PA_LLIST_REMOVE(pa_subscription_event, s->pending, e);
+    pa_xfree(e);
+}
+
 static void free_subscription(pa_subscription *s) {
     pa_assert(s);
     pa_assert(s->core);
 
+    while (s->pending)
+        free_pending(s, s->pending);
+
+    if (s->time_event)
+        s->core->mainloop->time_free(s->time_event);
+
     PA_LLIST_REMOVE(pa_subscription, s->core->subscriptions, s);
     pa_xfree(s);
 }
@@ -150,6 +188,83 @@ static void dump_event(const char * prefix, pa_subscription_event*e) {
 }
 #endif
 
+static void flush_pending(pa_subscription *s) {
+    pa_subscription_event *e;
+
+    pa_assert(s);
+
+    while (!s->dead && (e = s->pending)) {
+        s->callback(s->core, e->type, e->index, s->userdata);
+        free_pending(s, e);
+    }
+
+    if (!s->dead && s->flush_callback)
+        s->flush_callback(s->core, s->userdata);
+}
+
+static void timer_cb(pa_mainloop_api *m, pa_time_event *te, const struct timeval *tv, void *userdata) {
+    pa_subscription *s = userdata;
+
+    pa_assert(s);
+    pa_assert(s->time_event == te);
+
+    m->time_restart(te, NULL);
+    s->timer_armed = false;
+
+    flush_pending(s);
+}
+
+/* Queue an event on a batched subscription. The rules are the same as
+ * for the core's queue in pa_subscription_post(), with the addition
+ * that an entity which comes and goes within one interval is not
+ * reported at all. */
+static void queue_pending(pa_subscription *s, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_subscription_event *i, *e;
+
+    pa_assert(s);
+
+    for (i = s->pending_last; i; i = i->prev) {
+        pa_subscription_event_type_t type = i->type & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+
+        if (((t ^ i->type) & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) || i->index != idx)
+            continue;
+
+        /* Only the latest event for this entity matters */
+        if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_CHANGE) {
+            if (type != PA_SUBSCRIPTION_EVENT_REMOVE)
+                return;
+        } else if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
+            if (type == PA_SUBSCRIPTION_EVENT_NEW) {
+                free_pending(s, i);
+                return;
+            }
+
+            if (type == PA_SUBSCRIPTION_EVENT_CHANGE)
+                free_pending(s, i);
+        }
+
+        break;
+    }
+
+    e = pa_xnew(pa_subscription_event, 1);
+    e->core = s->core;
+    e->type = t;
+    e->index = idx;
+
+    PA_LLIST_INSERT_AFTER(pa_subscription_event, s->pending, s->pending_last, e);
+    s->pending_last = e;
+
+    if (s->timer_armed)
+        return;
+
+    if (s->time_event)
+        pa_core_rttime_restart(s->core, s->time_event, pa_rtclock_now() + s->interval);
+    else
+        s->time_event = pa_core_rttime_new(s->core, pa_rtclock_now() + s->interval, timer_cb, s);
+
+    s->timer_armed = true;
+}
+
 /* Deferred callback for dispatching subscription events */
 static void defer_cb(pa_mainloop_api *m, pa_defer_event *de, void *userdata) {
     pa_core *c = userdata;
@@ -168,8 +283,17 @@ static void defer_cb(pa_mainloop_api *m, pa_defer_event *de, void *userdata) {
 
         for (s = c->subscriptions; s; s = s->next) {
 
-            if (!s->dead && pa_subscription_match_flags(s->mask, e->type))
+            if (s->dead || !pa_subscription_match_flags(s->mask, e->type))
+                continue;
+
+            if (s->interval > 0)
+                queue_pending(s, e->type, e->index);
+            else {
                 s->callback(c, e->type, e->index, s->userdata);
+
+                if (s->flush_callback)
+                    s->flush_callback(c, s->userdata);
+            }
         }
 
 #ifdef DEBUG
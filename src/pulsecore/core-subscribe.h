@@ -27,8 +27,17 @@ typedef struct pa_subscription_event pa_subscription_event;
 #include <pulsecore/native-common.h>
 
 typedef void (*pa_subscription_cb_t)(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
+typedef void (*pa_subscription_flush_cb_t)(pa_core *c, void *userdata);
 
 pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m,  pa_subscription_cb_t cb, void *userdata);
+
+/* Collect the events for up to interval usec and then call cb for each
+ * of them, followed by a single call to flush_cb. With an interval of 0
+ * each event is delivered right away and followed by flush_cb. flush_cb
+ * may be NULL. */
+pa_subscription* pa_subscription_new_batched(pa_core *c, pa_subscription_mask_t m, pa_usec_t interval,
+                                             pa_subscription_cb_t cb, pa_subscription_flush_cb_t flush_cb, void *userdata);
+
 void pa_subscription_free(pa_subscription*s);
 void pa_subscription_free_all(pa_core *c);
 
@@ -69,6 +69,18 @@
 #endif
 #endif
 
+#ifdef __linux__
+#include <sys/syscall.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+
+#ifndef SCHED_FLAG_RESET_ON_FORK
+#define SCHED_FLAG_RESET_ON_FORK 0x01
+#endif
+#endif
+
 #ifdef HAVE_SYS_RESOURCE_H
 #include <sys/resource.h>
 #endif
@@ -124,14 +136,20 @@
 #include <sys/personality.h>
 #endif
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
 #include <pulse/utf8.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-error.h>
 #include <pulsecore/socket.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/usergroup.h>
@@ -139,6 +157,7 @@
 #include <pulsecore/cpu-x86.h>
 #include <pulsecore/pipe.h>
 #include <pulsecore/once.h>
+#include <pulsecore/rtmem.h>
 
 #include "core-util.h"
 
@@ -694,20 +713,63 @@ char *pa_strlcpy(char *b, const char *s, size_t l) {
     return b;
 }
 
+#ifdef HAVE_DBUS
+/* One connection to the system bus for talking to RealtimeKit, kept for
+ * the lifetime of the process. Every IO thread asks for realtime
+ * scheduling when it starts, and connecting and authenticating for each
+ * of them, and again for each priority tried, made the threads of a new
+ * card queue up behind the bus. Protected by rtkit_mutex, which also
+ * serializes the calls. */
+static pa_static_mutex rtkit_mutex = PA_STATIC_MUTEX_INIT;
+static DBusConnection *rtkit_bus = NULL;
+
+/* The limits RealtimeKit hands out don't change, so we only ask once */
+static bool rtkit_limits_known = false;
+static long long rtkit_rttime_max = -1;
+static int rtkit_max_rtprio = -1;
+
+static DBusConnection *rtkit_bus_get(void) {
+    DBusError error;
+
+    if (rtkit_bus) {
+        if (dbus_connection_get_is_connected(rtkit_bus))
+            return rtkit_bus;
+
+        /* The bus went away, probably restarted */
+        dbus_connection_close(rtkit_bus);
+        dbus_connection_unref(rtkit_bus);
+        rtkit_bus = NULL;
+        rtkit_limits_known = false;
+    }
+
+    dbus_error_init(&error);
+
+    if (!(rtkit_bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, &error))) {
+        pa_log("Failed to connect to system bus: %s", error.message);
+        dbus_error_free(&error);
+        return NULL;
+    }
+
+    /* We need to disable exit on disconnect because otherwise
+     * dbus_shutdown will kill us. See
+     * https://bugs.freedesktop.org/show_bug.cgi?id=16924 */
+    dbus_connection_set_exit_on_disconnect(rtkit_bus, FALSE);
+
+    return rtkit_bus;
+}
+#endif
+
 #ifdef _POSIX_PRIORITY_SCHEDULING
 static int set_scheduler(int rtprio) {
 #ifdef HAVE_SCHED_H
     struct sched_param sp;
 #ifdef HAVE_DBUS
     int r;
-    long long rttime;
 #ifdef RLIMIT_RTTIME
     struct rlimit rl;
 #endif
-    DBusError error;
     DBusConnection *bus;
-
-    dbus_error_init(&error);
+    pa_mutex *m;
 #endif
 
     pa_zero(sp);
@@ -729,48 +791,57 @@ static int set_scheduler(int rtprio) {
 #ifdef HAVE_DBUS
     /* Try to talk to RealtimeKit */
 
-    if (!(bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, &error))) {
-        pa_log("Failed to connect to system bus: %s", error.message);
-        dbus_error_free(&error);
+    m = pa_static_mutex_get(&rtkit_mutex, false, false);
+    pa_mutex_lock(m);
+
+    if (!(bus = rtkit_bus_get())) {
+        pa_mutex_unlock(m);
         errno = -EIO;
         return -1;
     }
 
-    /* We need to disable exit on disconnect because otherwise
-     * dbus_shutdown will kill us. See
-     * https://bugs.freedesktop.org/show_bug.cgi?id=16924 */
-    dbus_connection_set_exit_on_disconnect(bus, FALSE);
+    if (!rtkit_limits_known) {
+        rtkit_rttime_max = rtkit_get_rttime_usec_max(bus);
+        rtkit_max_rtprio = rtkit_get_max_realtime_priority(bus);
+        rtkit_limits_known = rtkit_rttime_max >= 0;
+    }
+
+    if (rtkit_rttime_max < 0) {
+        errno = (int) -rtkit_rttime_max;
+        rtkit_limits_known = false;
+        pa_mutex_unlock(m);
+        return -1;
+    }
+
+    /* Don't bother asking for more than we would get anyway */
+    if (rtkit_max_rtprio >= 0 && rtprio > rtkit_max_rtprio) {
+        pa_mutex_unlock(m);
+        errno = EPERM;
+        return -1;
+    }
 
-    rttime = rtkit_get_rttime_usec_max(bus);
-    if (rttime >= 0) {
 #ifdef RLIMIT_RTTIME
-        r = getrlimit(RLIMIT_RTTIME, &rl);
+    r = getrlimit(RLIMIT_RTTIME, &rl);
 
-        if (r >= 0 && (long long) rl.rlim_max > rttime) {
-            pa_log_info("Clamping rlimit-rttime to %lld for RealtimeKit", rttime);
-            rl.rlim_cur = rl.rlim_max = rttime;
-            r = setrlimit(RLIMIT_RTTIME, &rl);
+    if (r >= 0 && (long long) rl.rlim_max > rtkit_rttime_max) {
+        pa_log_info("Clamping rlimit-rttime to %lld for RealtimeKit", rtkit_rttime_max);
+        rl.rlim_cur = rl.rlim_max = rtkit_rttime_max;
+        r = setrlimit(RLIMIT_RTTIME, &rl);
 
-            if (r < 0)
-                pa_log("setrlimit() failed: %s", pa_cstrerror(errno));
-        }
+        if (r < 0)
+            pa_log("setrlimit() failed: %s", pa_cstrerror(errno));
+    }
 #endif
-        r = rtkit_make_realtime(bus, 0, rtprio);
-        dbus_connection_close(bus);
-        dbus_connection_unref(bus);
 
-        if (r >= 0) {
-            pa_log_debug("RealtimeKit worked.");
-            return 0;
-        }
+    r = rtkit_make_realtime(bus, 0, rtprio);
+    pa_mutex_unlock(m);
 
-        errno = -r;
-    } else {
-        dbus_connection_close(bus);
-        dbus_connection_unref(bus);
-        errno = -rttime;
+    if (r >= 0) {
+        pa_log_debug("RealtimeKit worked.");
+        return 0;
     }
 
+    errno = -r;
 #else
     errno = 0;
 #endif
@@ -781,7 +852,10 @@ static int set_scheduler(int rtprio) {
 
 /* Make the current thread a realtime thread, and acquire the highest
  * rtprio we can get that is less or equal the specified parameter. If
- * the thread is already realtime, don't do anything. */
+ * the thread is already realtime, don't do anything. On success the
+ * thread's log messages are handed to a background thread from now on,
+ * see pa_log_use_ring(), and its stack is faulted in, see
+ * pa_rtmem_enter(). */
 int pa_make_realtime(int rtprio) {
 
 #if defined(OS_IS_DARWIN)
@@ -814,6 +888,8 @@ int pa_make_realtime(int rtprio) {
     }
 
     pa_log_info("Successfully acquired real-time thread priority.");
+    pa_log_use_ring();
+    pa_rtmem_enter();
     return 0;
 
 #elif defined(_POSIX_PRIORITY_SCHEDULING)
@@ -821,12 +897,16 @@ int pa_make_realtime(int rtprio) {
 
     if (set_scheduler(rtprio) >= 0) {
         pa_log_info("Successfully enabled SCHED_RR scheduling for thread, with priority %i.", rtprio);
+        pa_log_use_ring();
+        pa_rtmem_enter();
         return 0;
     }
 
     for (p = rtprio-1; p >= 1; p--)
         if (set_scheduler(p) >= 0) {
             pa_log_info("Successfully enabled SCHED_RR scheduling for thread, with priority %i, which is lower than the requested %i.", p, rtprio);
+            pa_log_use_ring();
+            pa_rtmem_enter();
             return 0;
         }
 #elif defined(OS_IS_WIN32)
@@ -834,6 +914,8 @@ int pa_make_realtime(int rtprio) {
      * Therefore, instead of making the thread realtime, just give it the highest non-realtime priority. */
     if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
         pa_log_info("Successfully enabled THREAD_PRIORITY_TIME_CRITICAL scheduling for thread.");
+        pa_log_use_ring();
+        pa_rtmem_enter();
         return 0;
     }
 
@@ -846,14 +928,168 @@ int pa_make_realtime(int rtprio) {
     return -1;
 }
 
+#if defined(__linux__) && defined(SYS_sched_setattr)
+/* Not exported by all C libraries */
+struct deadline_sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+#endif
+
+/* Switch the current thread to SCHED_DEADLINE: it is guaranteed
+ * runtime of CPU time in every period, but is also throttled by the
+ * kernel when it asks for more, instead of starving everything with a
+ * lower priority. This needs CAP_SYS_NICE, RealtimeKit can't hand it
+ * out. Same side effects as pa_make_realtime() on success. */
+int pa_make_deadline(pa_usec_t runtime, pa_usec_t period) {
+
+#if defined(__linux__) && defined(SYS_sched_setattr)
+    struct deadline_sched_attr attr;
+
+    pa_assert(runtime > 0);
+    pa_assert(runtime <= period);
+
+    pa_zero(attr);
+    attr.size = sizeof(attr);
+    attr.sched_policy = SCHED_DEADLINE;
+    attr.sched_flags = SCHED_FLAG_RESET_ON_FORK;
+    attr.sched_runtime = runtime * PA_NSEC_PER_USEC;
+    attr.sched_deadline = attr.sched_period = period * PA_NSEC_PER_USEC;
+
+    if (syscall(SYS_sched_setattr, 0, &attr, 0) >= 0) {
+        pa_log_info("Successfully enabled SCHED_DEADLINE scheduling for thread, with %llu us runtime every %llu us.",
+                    (unsigned long long) runtime, (unsigned long long) period);
+        pa_log_use_ring();
+        pa_rtmem_enter();
+        return 0;
+    }
+#else
+    errno = ENOTSUP;
+#endif
+
+    pa_log_info("Failed to enable deadline scheduling: %s", pa_cstrerror(errno));
+    return -1;
+}
+
+static int add_cpus(const char *cpus, int **list, unsigned *n, unsigned depth) {
+    const char *state = NULL;
+    char *k;
+
+    while ((k = pa_split(cpus, ",", &state))) {
+        uint32_t first, last;
+        char *dash;
+
+        if (pa_streq(k, "isolated") && depth == 0) {
+            char *isolated;
+            int r;
+
+            /* The CPUs taken out of scheduling with the isolcpus= kernel
+             * parameter. Nothing else runs there unless pinned. */
+            if (!(isolated = pa_read_line_from_file("/sys/devices/system/cpu/isolated"))) {
+                pa_log("Failed to read the list of isolated CPUs.");
+                pa_xfree(k);
+                return -1;
+            }
+
+            if (!*isolated)
+                pa_log_warn("No CPUs are isolated.");
+
+            r = add_cpus(isolated, list, n, depth + 1);
+            pa_xfree(isolated);
+            pa_xfree(k);
+
+            if (r < 0)
+                return -1;
+
+            continue;
+        }
+
+        if ((dash = strchr(k, '-')))
+            *(dash++) = 0;
+
+        if (pa_atou(k, &first) < 0)
+            goto invalid;
+
+        last = first;
+
+        if ((dash && pa_atou(dash, &last) < 0) || last < first || last >= 1024)
+            goto invalid;
+
+        pa_xfree(k);
+
+        for (; first <= last; first++) {
+            *list = pa_xrenew(int, *list, *n + 1);
+            (*list)[(*n)++] = (int) first;
+        }
+    }
+
+    return 0;
+
+invalid:
+    pa_log("Invalid CPU list '%s'.", cpus);
+    pa_xfree(k);
+    return -1;
+}
+
+/* Parses a comma separated list of CPU numbers and ranges, like
+ * "0,2-3". The word "isolated" stands for the CPUs isolated with the
+ * isolcpus= kernel parameter. */
+int pa_parse_cpu_list(const char *cpus, int **ret, unsigned *n_ret) {
+    int *list = NULL;
+    unsigned n = 0;
+
+    pa_assert(cpus);
+    pa_assert(ret);
+    pa_assert(n_ret);
+
+    if (add_cpus(cpus, &list, &n, 0) < 0) {
+        pa_xfree(list);
+        return -1;
+    }
+
+    *ret = list;
+    *n_ret = n;
+
+    return 0;
+}
+
+/* Restrict the current thread to run on the given CPUs only */
+int pa_set_thread_cpus(const int *cpus, unsigned n_cpus) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    cpu_set_t mask;
+    unsigned i;
+    int r;
+
+    pa_assert(cpus);
+    pa_assert(n_cpus > 0);
+
+    CPU_ZERO(&mask);
+    for (i = 0; i < n_cpus; i++)
+        CPU_SET((size_t) cpus[i], &mask);
+
+    if ((r = pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask)) == 0)
+        return 0;
+
+    errno = r;
+#else
+    errno = ENOTSUP;
+#endif
+
+    return -1;
+}
+
 #ifdef HAVE_SYS_RESOURCE_H
 static int set_nice(int nice_level) {
 #ifdef HAVE_DBUS
-    DBusError error;
     DBusConnection *bus;
+    pa_mutex *m;
     int r;
-
-    dbus_error_init(&error);
 #endif
 
 #ifdef HAVE_SYS_RESOURCE_H
@@ -866,21 +1102,17 @@ static int set_nice(int nice_level) {
 #ifdef HAVE_DBUS
     /* Try to talk to RealtimeKit */
 
-    if (!(bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, &error))) {
-        pa_log("Failed to connect to system bus: %s", error.message);
-        dbus_error_free(&error);
+    m = pa_static_mutex_get(&rtkit_mutex, false, false);
+    pa_mutex_lock(m);
+
+    if (!(bus = rtkit_bus_get())) {
+        pa_mutex_unlock(m);
         errno = -EIO;
         return -1;
     }
 
-    /* We need to disable exit on disconnect because otherwise
-     * dbus_shutdown will kill us. See
-     * https://bugs.freedesktop.org/show_bug.cgi?id=16924 */
-    dbus_connection_set_exit_on_disconnect(bus, FALSE);
-
     r = rtkit_make_high_priority(bus, 0, nice_level);
-    dbus_connection_close(bus);
-    dbus_connection_unref(bus);
+    pa_mutex_unlock(m);
 
     if (r >= 0) {
         pa_log_debug("RealtimeKit worked.");
@@ -931,6 +1163,32 @@ int pa_raise_priority(int nice_level) {
     return 0;
 }
 
+/* Make the FPU of the current thread flush denormal floats to zero,
+ * both when they come out of an operation and when they go in. Filter
+ * states decaying after the input went quiet would otherwise end up in
+ * denormals, which take a slow path on many CPUs. Returns -1 if the
+ * CPU or the build doesn't allow that. */
+int pa_flush_denormals(void) {
+#if defined(__SSE2__) || defined(__x86_64__)
+    /* FTZ and DAZ */
+    _mm_setcsr(_mm_getcsr() | 0x8040);
+    return 0;
+#elif defined(__SSE__)
+    /* DAZ is not available on all CPUs with SSE only */
+    _mm_setcsr(_mm_getcsr() | 0x8000);
+    return 0;
+#elif defined(__aarch64__)
+    uint64_t fpcr;
+
+    /* FZ */
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (fpcr));
+    __asm__ __volatile__ ("msr fpcr, %0" : : "r" (fpcr | (1 << 24)));
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 /* Reset the priority to normal, inverting the changes made by
  * pa_raise_priority() and pa_make_realtime()*/
 void pa_reset_priority(void) {
@@ -3423,6 +3681,35 @@ size_t pa_pipe_buf(int fd) {
 #endif
 }
 
+/* Try to resize the kernel buffer of the pipe fd to at least size
+ * bytes. Returns the resulting buffer size, or 0 if the pipe cannot
+ * be resized on this system. */
+size_t pa_pipe_set_size(int fd, size_t size) {
+
+#ifdef F_SETPIPE_SZ
+    int r;
+
+    pa_assert(fd >= 0);
+    pa_assert(size > 0);
+
+    if (size > INT_MAX)
+        size = INT_MAX;
+
+    if ((r = fcntl(fd, F_SETPIPE_SZ, (int) size)) < 0) {
+        pa_log_debug("F_SETPIPE_SZ(%zu) failed: %s", size, pa_cstrerror(errno));
+
+        /* Unprivileged processes are capped by
+         * /proc/sys/fs/pipe-max-size, so report what we have */
+        if ((r = fcntl(fd, F_GETPIPE_SZ)) < 0)
+            return 0;
+    }
+
+    return (size_t) r;
+#else
+    return 0;
+#endif
+}
+
 void pa_reset_personality(void) {
 
 #if defined(__linux__) && !defined(__ANDROID__)
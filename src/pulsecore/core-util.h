@@ -82,6 +82,10 @@ char *pa_strlcpy(char *b, const char *s, size_t l);
 char *pa_parent_dir(const char *fn);
 
 int pa_make_realtime(int rtprio);
+int pa_make_deadline(pa_usec_t runtime, pa_usec_t period);
+int pa_parse_cpu_list(const char *cpus, int **ret, unsigned *n_ret);
+int pa_set_thread_cpus(const int *cpus, unsigned n_cpus);
+int pa_flush_denormals(void);
 int pa_raise_priority(int nice_level);
 void pa_reset_priority(void);
 
@@ -283,6 +287,7 @@ char* pa_maybe_prefix_path(const char *path, const char *prefix);
 
 /* Returns size of the specified pipe or 4096 on failure */
 size_t pa_pipe_buf(int fd);
+size_t pa_pipe_set_size(int fd, size_t size);
 
 void pa_reset_personality(void);
 
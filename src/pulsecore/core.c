@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <signal.h>
+#include <errno.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -33,8 +34,11 @@
 #include <pulsecore/module.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/core-error.h>
 #include <pulsecore/core-scache.h>
 #include <pulsecore/core-subscribe.h>
+#include <pulsecore/io-pool.h>
+#include <pulsecore/metrics.h>
 #include <pulsecore/random.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -104,6 +108,8 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
     c->namereg = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
     c->shared = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
 
+    c->metrics = pa_metrics_new();
+
     c->default_source = NULL;
     c->default_sink = NULL;
 
@@ -134,12 +140,15 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
 
     c->exit_idle_time = -1;
     c->scache_idle_time = 20;
+    c->scache_compress = false;
+    c->scache_decoded_max = 4 * 1024 * 1024;
 
     c->flat_volumes = true;
     c->disallow_module_loading = false;
     c->disallow_exit = false;
     c->running_as_daemon = false;
     c->realtime_scheduling = false;
+    c->realtime_deadline = false;
     c->realtime_priority = 5;
     c->disable_remixing = false;
     c->remixing_use_all_sink_channels = true;
@@ -204,6 +213,8 @@ static void core_free(pa_object *o) {
     pa_assert(pa_hashmap_isempty(c->shared));
     pa_hashmap_free(c->shared);
 
+    pa_metrics_free(c->metrics);
+
     pa_assert(pa_hashmap_isempty(c->modules_pending_unload));
     pa_hashmap_free(c->modules_pending_unload);
 
@@ -215,12 +226,16 @@ static void core_free(pa_object *o) {
     pa_assert(!c->default_source);
     pa_assert(!c->default_sink);
 
+    if (c->io_pool)
+        pa_io_pool_free(c->io_pool);
+
     pa_silence_cache_done(&c->silence_cache);
     pa_mempool_unref(c->mempool);
 
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
         pa_hook_done(&c->hooks[j]);
 
+    pa_xfree(c->device_thread_cpus);
     pa_xfree(c);
 }
 
@@ -300,3 +315,19 @@ void pa_core_rttime_restart(pa_core *c, pa_time_event *e, pa_usec_t usec) {
 
     c->mainloop->time_restart(e, pa_timeval_rtstore(&tv, usec, true));
 }
+
+/* Called from IO thread */
+void pa_core_set_io_thread_cpus(pa_core *c, const int *cpus, unsigned n_cpus) {
+    pa_assert(c);
+
+    if (n_cpus == 0) {
+        cpus = c->device_thread_cpus;
+        n_cpus = c->n_device_thread_cpus;
+    }
+
+    if (n_cpus == 0)
+        return;
+
+    if (pa_set_thread_cpus(cpus, n_cpus) < 0)
+        pa_log_warn("Failed to restrict IO thread to the configured CPUs: %s", pa_cstrerror(errno));
+}
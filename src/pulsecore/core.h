@@ -49,6 +49,7 @@ typedef enum pa_suspend_cause {
 #include <pulsecore/source.h>
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/msgobject.h>
+#include <pulsecore/metrics.h>
 
 typedef enum pa_server_type {
     PA_SERVER_TYPE_UNSET,
@@ -160,6 +161,9 @@ struct pa_core {
     /* Some hashmaps for all sorts of entities */
     pa_hashmap *namereg, *shared;
 
+    /* Counters the IO threads maintain, exported by protocol-http */
+    pa_metrics *metrics;
+
     /* The default sink/source */
     pa_source *default_source;
     pa_sink *default_sink;
@@ -189,25 +193,39 @@ struct pa_core {
 
     pa_silence_cache silence_cache;
 
+    /* Shared IO threads, if configured */
+    pa_io_pool *io_pool;
+
     pa_time_event *exit_event;
     pa_time_event *scache_auto_unload_event;
 
     int exit_idle_time, scache_idle_time;
 
+    /* Compressed sample cache entries are decoded when played, and up to
+     * this many bytes of them are kept decoded, see core-scache.c */
+    size_t scache_decoded_max;
+
     bool flat_volumes:1;
     bool disallow_module_loading:1;
     bool disallow_exit:1;
     bool running_as_daemon:1;
     bool realtime_scheduling:1;
+    bool realtime_deadline:1;
     bool avoid_resampling:1;
     bool disable_remixing:1;
     bool remixing_use_all_sink_channels:1;
     bool disable_lfe_remixing:1;
     bool deferred_volume:1;
+    bool scache_compress:1;
 
     pa_resample_method_t resample_method;
     int realtime_priority;
 
+    /* CPUs the IO threads of devices are restricted to, if not overridden
+     * per device. Not used by shared IO threads. */
+    int *device_thread_cpus;
+    unsigned n_device_thread_cpus;
+
     pa_server_type_t server_type;
     pa_cpu_info cpu_info;
 
@@ -236,4 +254,8 @@ void pa_core_maybe_vacuum(pa_core *c);
 pa_time_event* pa_core_rttime_new(pa_core *c, pa_usec_t usec, pa_time_event_cb_t cb, void *userdata);
 void pa_core_rttime_restart(pa_core *c, pa_time_event *e, pa_usec_t usec);
 
+/* Restrict the calling IO thread to the given CPUs, or to the
+ * device-thread-cpus from daemon.conf if n_cpus is 0 */
+void pa_core_set_io_thread_cpus(pa_core *c, const int *cpus, unsigned n_cpus);
+
 #endif
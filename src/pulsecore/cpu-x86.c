@@ -30,6 +30,7 @@
 
 #if defined (__i386__) || defined (__amd64__)
 static void get_cpuid(uint32_t op, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    /* The sub-leaf in ecx is always 0, which is what leaf 7 needs */
     __asm__ __volatile__ (
         "  push %%"PA_REG_b"   \n\t"
         "  cpuid               \n\t"
@@ -37,9 +38,23 @@ static void get_cpuid(uint32_t op, uint32_t *a, uint32_t *b, uint32_t *c, uint32
         "  pop %%"PA_REG_b"    \n\t"
 
         : "=a" (*a), "=S" (*b), "=c" (*c), "=d" (*d)
-        : "0" (op)
+        : "0" (op), "2" (0)
     );
 }
+
+static uint64_t get_xcr0(void) {
+    uint32_t lo, hi;
+
+    /* xgetbv, spelled out for assemblers that don't know it */
+    __asm__ __volatile__ (
+        "  .byte 0x0f, 0x01, 0xd0 \n\t"
+
+        : "=a" (lo), "=d" (hi)
+        : "c" (0)
+    );
+
+    return ((uint64_t) hi << 32) | lo;
+}
 #endif
 
 void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
@@ -77,6 +92,21 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
 
         if (ecx & (1<<20))
           *flags |= PA_CPU_X86_SSE4_2;
+
+        /* AVX needs the OS to save the YMM state (OSXSAVE + XCR0) */
+        if ((ecx & (1<<27)) && (ecx & (1<<28)) && (get_xcr0() & 0x6) == 0x6)
+          *flags |= PA_CPU_X86_AVX;
+    }
+
+    if (level >= 7 && (*flags & PA_CPU_X86_AVX)) {
+        get_cpuid(0x00000007, &eax, &ebx, &ecx, &edx);
+
+        if (ebx & (1<<5))
+          *flags |= PA_CPU_X86_AVX2;
+
+        /* The OS also needs to save the opmask and ZMM state */
+        if ((ebx & (1<<16)) && (get_xcr0() & 0xe0) == 0xe0)
+          *flags |= PA_CPU_X86_AVX512F;
     }
 
     /* get extended level */
@@ -97,7 +127,7 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
           *flags |= PA_CPU_X86_3DNOW;
     }
 
-    pa_log_info("CPU flags: %s%s%s%s%s%s%s%s%s%s%s",
+    pa_log_info("CPU flags: %s%s%s%s%s%s%s%s%s%s%s%s%s%s",
     (*flags & PA_CPU_X86_CMOV) ? "CMOV " : "",
     (*flags & PA_CPU_X86_MMX) ? "MMX " : "",
     (*flags & PA_CPU_X86_SSE) ? "SSE " : "",
@@ -106,6 +136,9 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
     (*flags & PA_CPU_X86_SSSE3) ? "SSSE3 " : "",
     (*flags & PA_CPU_X86_SSE4_1) ? "SSE4_1 " : "",
     (*flags & PA_CPU_X86_SSE4_2) ? "SSE4_2 " : "",
+    (*flags & PA_CPU_X86_AVX) ? "AVX " : "",
+    (*flags & PA_CPU_X86_AVX2) ? "AVX2 " : "",
+    (*flags & PA_CPU_X86_AVX512F) ? "AVX512F " : "",
     (*flags & PA_CPU_X86_MMXEXT) ? "MMXEXT " : "",
     (*flags & PA_CPU_X86_3DNOW) ? "3DNOW " : "",
     (*flags & PA_CPU_X86_3DNOWEXT) ? "3DNOWEXT " : "");
@@ -126,8 +159,15 @@ bool pa_cpu_init_x86(pa_cpu_x86_flag_t *flags) {
         pa_volume_func_init_sse(*flags);
         pa_remap_func_init_sse(*flags);
         pa_convert_func_init_sse(*flags);
+        pa_mix_func_init_sse(*flags);
+        pa_peaks_func_init_sse(*flags);
+        pa_polyphase_func_init_sse(*flags);
+        pa_sample_util_func_init_sse(*flags);
     }
 
+    if (*flags & (PA_CPU_X86_AVX2 | PA_CPU_X86_AVX512F))
+        pa_volume_func_init_avx(*flags);
+
     return true;
 #else /* defined (__i386__) || defined (__amd64__) */
     return false;
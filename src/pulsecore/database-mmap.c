@@ -0,0 +1,740 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/log.h>
+
+#include "database.h"
+
+/* The database consists of an immutable table and a delta log next to
+ * it. The table is mapped into memory as it is, with an index of all
+ * entries sorted by key, so that opening it doesn't need to parse
+ * anything and lookups are a binary search. Changes are kept in
+ * memory and appended to the log right away. The log is replayed on
+ * open, and a sync merges the changes into a new table and removes
+ * the log. The files are in host byte order, like the gdbm ones, which
+ * is why the host identifier is part of the file name. */
+
+#define TABLE_MAGIC "PADBMMAP"
+
+typedef struct table_header {
+    char magic[8];
+    uint32_t n_entries;
+    uint32_t reserved;
+} table_header;
+
+/* Offsets are from the start of the file */
+typedef struct table_entry {
+    uint32_t key_offset;
+    uint32_t key_size;
+    uint32_t data_offset;
+    uint32_t data_size;
+} table_entry;
+
+/* Log records are a log_record followed by the key and the data. A
+ * removed entry has data_size LOG_REMOVED, a clear has key_size
+ * LOG_CLEAR and nothing after it. */
+typedef struct log_record {
+    uint32_t key_size;
+    uint32_t data_size;
+} log_record;
+
+#define LOG_REMOVED ((uint32_t) -1)
+#define LOG_CLEAR ((uint32_t) -1)
+
+typedef struct delta {
+    pa_datum key;
+    pa_datum data;
+    bool removed;
+} delta;
+
+typedef struct mmap_data {
+    char *filename;
+    char *tmp_filename;
+    char *log_filename;
+    bool read_only;
+
+    uint8_t *map;
+    size_t map_size;
+    const table_entry *index;
+    uint32_t n_entries;
+
+    /* pa_datum key -> delta, all changes since the table was written */
+    pa_hashmap *changes;
+    /* Whether the table is hidden entirely because of a clear */
+    bool cleared;
+
+    int log_fd;
+} mmap_data;
+
+void pa_datum_free(pa_datum *d) {
+    pa_assert(d);
+
+    pa_xfree(d->data);
+    d->data = NULL;
+    d->size = 0;
+}
+
+static int compare_func(const void *a, const void *b) {
+    const pa_datum *aa, *bb;
+    int r;
+
+    aa = (const pa_datum*)a;
+    bb = (const pa_datum*)b;
+
+    if ((r = memcmp(aa->data, bb->data, PA_MIN(aa->size, bb->size))) != 0)
+        return r;
+
+    if (aa->size != bb->size)
+        return aa->size > bb->size ? 1 : -1;
+
+    return 0;
+}
+
+/* pa_idxset_string_hash_func modified for our use */
+static unsigned hash_func(const void *p) {
+    const pa_datum *d;
+    unsigned hash = 0;
+    const char *c;
+    unsigned i;
+
+    d = (const pa_datum*)p;
+    c = d->data;
+
+    for (i = 0; i < d->size; i++) {
+        hash = 31 * hash + (unsigned) *c;
+        c++;
+    }
+
+    return hash;
+}
+
+static void delta_free(delta *d) {
+    pa_assert(d);
+
+    pa_xfree(d->key.data);
+    pa_xfree(d->data.data);
+    pa_xfree(d);
+}
+
+static void datum_copy(pa_datum *to, const pa_datum *from) {
+    to->data = from->size > 0 ? pa_xmemdup(from->data, from->size) : NULL;
+    to->size = from->size;
+}
+
+/* Entries that don't fit into the file are treated as missing, so a
+ * corrupt table can't make us read outside of the mapping */
+static bool table_get(mmap_data *db, uint32_t i, pa_datum *key, pa_datum *data) {
+    const table_entry *e;
+
+    pa_assert(i < db->n_entries);
+
+    e = db->index + i;
+
+    if ((size_t) e->key_offset + e->key_size > db->map_size ||
+        (size_t) e->data_offset + e->data_size > db->map_size)
+        return false;
+
+    key->data = db->map + e->key_offset;
+    key->size = e->key_size;
+
+    if (data) {
+        data->data = db->map + e->data_offset;
+        data->size = e->data_size;
+    }
+
+    return true;
+}
+
+/* Returns the index of the first entry with a key greater than (or
+ * equal to, if inclusive) the given one */
+static uint32_t table_bound(mmap_data *db, const pa_datum *key, bool inclusive) {
+    uint32_t l = 0, r = db->n_entries;
+
+    while (l < r) {
+        uint32_t m = l + (r - l) / 2;
+        pa_datum k;
+        int c;
+
+        if (!table_get(db, m, &k, NULL))
+            c = -1;
+        else
+            c = compare_func(&k, key);
+
+        if (c < 0 || (c == 0 && !inclusive))
+            l = m + 1;
+        else
+            r = m;
+    }
+
+    return l;
+}
+
+static bool table_lookup(mmap_data *db, const pa_datum *key, pa_datum *data) {
+    uint32_t i;
+    pa_datum k;
+
+    if (db->cleared)
+        return false;
+
+    i = table_bound(db, key, true);
+
+    if (i >= db->n_entries || !table_get(db, i, &k, data))
+        return false;
+
+    return compare_func(&k, key) == 0;
+}
+
+static void table_unmap(mmap_data *db) {
+    if (db->map)
+        munmap(db->map, db->map_size);
+
+    db->map = NULL;
+    db->map_size = 0;
+    db->index = NULL;
+    db->n_entries = 0;
+}
+
+static int table_map(mmap_data *db) {
+    struct stat st;
+    const table_header *h;
+    int fd;
+
+    pa_assert(!db->map);
+
+    if ((fd = pa_open_cloexec(db->filename, O_RDONLY, 0)) < 0)
+        return errno == ENOENT ? 0 : -1;
+
+    if (fstat(fd, &st) < 0)
+        goto fail;
+
+    if (st.st_size == 0) {
+        pa_close(fd);
+        return 0;
+    }
+
+    if ((size_t) st.st_size < sizeof(table_header) || (uint64_t) st.st_size > UINT32_MAX) {
+        pa_log_warn("Database file '%s' has an invalid size.", db->filename);
+        errno = EINVAL;
+        goto fail;
+    }
+
+    if ((db->map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        db->map = NULL;
+        goto fail;
+    }
+
+    pa_close(fd);
+    db->map_size = (size_t) st.st_size;
+
+    h = (const table_header*) db->map;
+
+    if (memcmp(h->magic, TABLE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->n_entries > (db->map_size - sizeof(table_header)) / sizeof(table_entry)) {
+        pa_log_warn("Database file '%s' is corrupt.", db->filename);
+        table_unmap(db);
+        errno = EINVAL;
+        return -1;
+    }
+
+    db->index = (const table_entry*) (db->map + sizeof(table_header));
+    db->n_entries = h->n_entries;
+
+    return 0;
+
+fail:
+    pa_close(fd);
+    return -1;
+}
+
+static delta* change(mmap_data *db, const pa_datum *key, const pa_datum *data) {
+    delta *d;
+
+    if (!(d = pa_hashmap_get(db->changes, key))) {
+        d = pa_xnew0(delta, 1);
+        datum_copy(&d->key, key);
+        pa_assert_se(pa_hashmap_put(db->changes, &d->key, d) == 0);
+    }
+
+    pa_datum_free(&d->data);
+
+    if (data) {
+        datum_copy(&d->data, data);
+        d->removed = false;
+    } else
+        d->removed = true;
+
+    return d;
+}
+
+static void replay_log(mmap_data *db) {
+    struct stat st;
+    uint8_t *log, *p, *end;
+    int fd;
+
+    if ((fd = pa_open_cloexec(db->log_filename, O_RDONLY, 0)) < 0)
+        return;
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0 ||
+        (log = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        pa_close(fd);
+        return;
+    }
+
+    pa_close(fd);
+
+    p = log;
+    end = log + st.st_size;
+
+    while ((size_t) (end - p) >= sizeof(log_record)) {
+        log_record r;
+        pa_datum key, data;
+
+        memcpy(&r, p, sizeof(r));
+        p += sizeof(r);
+
+        if (r.key_size == LOG_CLEAR) {
+            pa_hashmap_remove_all(db->changes);
+            db->cleared = true;
+            continue;
+        }
+
+        /* A record that was cut short by a crash ends the log */
+        if (r.key_size > (size_t) (end - p) ||
+            (r.data_size != LOG_REMOVED && r.data_size > (size_t) (end - p) - r.key_size))
+            break;
+
+        key.data = p;
+        key.size = r.key_size;
+        p += r.key_size;
+
+        if (r.data_size == LOG_REMOVED)
+            change(db, &key, NULL);
+        else {
+            data.data = p;
+            data.size = r.data_size;
+            p += r.data_size;
+
+            change(db, &key, &data);
+        }
+    }
+
+    munmap(log, (size_t) st.st_size);
+
+    pa_log_debug("Replayed %u changes from '%s'.", pa_hashmap_size(db->changes), db->log_filename);
+}
+
+static int append_log(mmap_data *db, uint32_t key_size, const void *key, uint32_t data_size, const void *data) {
+    log_record r;
+
+    if (db->log_fd < 0 &&
+        (db->log_fd = pa_open_cloexec(db->log_filename, O_WRONLY|O_CREAT|O_APPEND, 0644)) < 0) {
+        pa_log_warn("Failed to open database log '%s': %s", db->log_filename, pa_cstrerror(errno));
+        return -1;
+    }
+
+    r.key_size = key_size;
+    r.data_size = data_size;
+
+    if (pa_loop_write(db->log_fd, &r, sizeof(r), NULL) != sizeof(r) ||
+        (key_size != LOG_CLEAR && key_size > 0 && pa_loop_write(db->log_fd, key, key_size, NULL) != (ssize_t) key_size) ||
+        (data_size != LOG_REMOVED && data_size > 0 && pa_loop_write(db->log_fd, data, data_size, NULL) != (ssize_t) data_size)) {
+        pa_log_warn("Failed to write to database log '%s': %s", db->log_filename, pa_cstrerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+pa_database* pa_database_open(const char *fn, bool for_write) {
+    mmap_data *db;
+
+    pa_assert(fn);
+
+    db = pa_xnew0(mmap_data, 1);
+    db->filename = pa_sprintf_malloc("%s."CANONICAL_HOST".mmap", fn);
+    db->tmp_filename = pa_sprintf_malloc("%s.tmp", db->filename);
+    db->log_filename = pa_sprintf_malloc("%s.log", db->filename);
+    db->read_only = !for_write;
+    db->changes = pa_hashmap_new_full(hash_func, compare_func, NULL, (pa_free_cb_t) delta_free);
+    db->log_fd = -1;
+
+    errno = 0;
+
+    if (table_map(db) < 0) {
+        int saved_errno = errno ? errno : EIO;
+
+        pa_database_close((pa_database*) db);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    replay_log(db);
+
+    pa_log_debug("Opened mmap database '%s' with %u entries.", db->filename, db->n_entries);
+
+    return (pa_database*) db;
+}
+
+void pa_database_close(pa_database *database) {
+    mmap_data *db = (mmap_data*)database;
+
+    pa_assert(db);
+
+    /* The log is replayed on the next open if this fails */
+    pa_database_sync(database);
+
+    if (db->log_fd >= 0)
+        pa_close(db->log_fd);
+
+    table_unmap(db);
+    pa_hashmap_free(db->changes);
+    pa_xfree(db->filename);
+    pa_xfree(db->tmp_filename);
+    pa_xfree(db->log_filename);
+    pa_xfree(db);
+}
+
+pa_datum* pa_database_get(pa_database *database, const pa_datum *key, pa_datum* data) {
+    mmap_data *db = (mmap_data*)database;
+    pa_datum d;
+    delta *c;
+
+    pa_assert(db);
+    pa_assert(key);
+    pa_assert(data);
+
+    if ((c = pa_hashmap_get(db->changes, key))) {
+        if (c->removed)
+            return NULL;
+
+        datum_copy(data, &c->data);
+        return data;
+    }
+
+    if (!table_lookup(db, key, &d))
+        return NULL;
+
+    datum_copy(data, &d);
+    return data;
+}
+
+int pa_database_set(pa_database *database, const pa_datum *key, const pa_datum* data, bool overwrite) {
+    mmap_data *db = (mmap_data*)database;
+
+    pa_assert(db);
+    pa_assert(key);
+    pa_assert(data);
+
+    if (db->read_only || key->size >= LOG_CLEAR || data->size >= LOG_REMOVED)
+        return -1;
+
+    if (!overwrite) {
+        pa_datum old;
+
+        if (pa_database_get(database, key, &old)) {
+            pa_datum_free(&old);
+            return -1;
+        }
+    }
+
+    if (append_log(db, (uint32_t) key->size, key->data, (uint32_t) data->size, data->data) < 0)
+        return -1;
+
+    change(db, key, data);
+
+    return 0;
+}
+
+int pa_database_unset(pa_database *database, const pa_datum *key) {
+    mmap_data *db = (mmap_data*)database;
+    pa_datum old;
+
+    pa_assert(db);
+    pa_assert(key);
+
+    if (db->read_only || !pa_database_get(database, key, &old))
+        return -1;
+
+    pa_datum_free(&old);
+
+    if (append_log(db, (uint32_t) key->size, key->data, LOG_REMOVED, NULL) < 0)
+        return -1;
+
+    change(db, key, NULL);
+
+    return 0;
+}
+
+int pa_database_clear(pa_database *database) {
+    mmap_data *db = (mmap_data*)database;
+
+    pa_assert(db);
+
+    if (db->read_only)
+        return -1;
+
+    if (append_log(db, LOG_CLEAR, NULL, 0, NULL) < 0)
+        return -1;
+
+    pa_hashmap_remove_all(db->changes);
+    db->cleared = true;
+
+    return 0;
+}
+
+signed pa_database_size(pa_database *database) {
+    mmap_data *db = (mmap_data*)database;
+    signed n;
+    delta *c;
+    void *state;
+
+    pa_assert(db);
+
+    n = db->cleared ? 0 : (signed) db->n_entries;
+
+    PA_HASHMAP_FOREACH(c, db->changes, state) {
+        bool in_table = table_lookup(db, &c->key, NULL);
+
+        if (c->removed && in_table)
+            n--;
+        else if (!c->removed && !in_table)
+            n++;
+    }
+
+    return n;
+}
+
+/* Iteration goes through the table and the changes merged in key
+ * order, so the next entry is the smallest key greater than the
+ * current one, or the smallest one at all if there is none */
+static pa_datum* find_next(mmap_data *db, const pa_datum *key, pa_datum *next, pa_datum *data) {
+    pa_datum best_key, best_data, k, d;
+    bool found = false;
+    delta *c;
+    void *state;
+
+    if (!db->cleared) {
+        uint32_t i;
+
+        for (i = key ? table_bound(db, key, false) : 0; i < db->n_entries; i++) {
+            if (!table_get(db, i, &k, &d))
+                continue;
+
+            /* Changed entries are picked up below */
+            if (pa_hashmap_get(db->changes, &k))
+                continue;
+
+            best_key = k;
+            best_data = d;
+            found = true;
+            break;
+        }
+    }
+
+    PA_HASHMAP_FOREACH(c, db->changes, state) {
+        if (c->removed)
+            continue;
+
+        if (key && compare_func(&c->key, key) <= 0)
+            continue;
+
+        if (found && compare_func(&c->key, &best_key) >= 0)
+            continue;
+
+        best_key = c->key;
+        best_data = c->data;
+        found = true;
+    }
+
+    if (!found)
+        return NULL;
+
+    datum_copy(next, &best_key);
+
+    if (data)
+        datum_copy(data, &best_data);
+
+    return next;
+}
+
+pa_datum* pa_database_first(pa_database *database, pa_datum *key, pa_datum *data) {
+    mmap_data *db = (mmap_data*)database;
+
+    pa_assert(db);
+    pa_assert(key);
+
+    return find_next(db, NULL, key, data);
+}
+
+pa_datum* pa_database_next(pa_database *database, const pa_datum *key, pa_datum *next, pa_datum *data) {
+    mmap_data *db = (mmap_data*)database;
+
+    pa_assert(db);
+    pa_assert(next);
+
+    if (!key)
+        return pa_database_first(database, next, data);
+
+    return find_next(db, key, next, data);
+}
+
+typedef struct merged {
+    pa_datum key;
+    pa_datum data;
+} merged;
+
+static int merged_compare(const void *a, const void *b) {
+    return compare_func(&((const merged*) a)->key, &((const merged*) b)->key);
+}
+
+static int write_table(mmap_data *db, const char *fn) {
+    merged *entries;
+    table_header h;
+    table_entry *index;
+    unsigned n = 0, i;
+    uint32_t offset;
+    delta *c;
+    void *state;
+    int fd, r = -1;
+
+    entries = pa_xnew(merged, PA_MAX((db->cleared ? 0 : db->n_entries) + pa_hashmap_size(db->changes), 1U));
+
+    if (!db->cleared) {
+        for (i = 0; i < db->n_entries; i++) {
+            if (!table_get(db, i, &entries[n].key, &entries[n].data))
+                continue;
+
+            if (pa_hashmap_get(db->changes, &entries[n].key))
+                continue;
+
+            n++;
+        }
+    }
+
+    PA_HASHMAP_FOREACH(c, db->changes, state) {
+        if (c->removed)
+            continue;
+
+        entries[n].key = c->key;
+        entries[n].data = c->data;
+        n++;
+    }
+
+    qsort(entries, n, sizeof(merged), merged_compare);
+
+    memcpy(h.magic, TABLE_MAGIC, sizeof(h.magic));
+    h.n_entries = n;
+    h.reserved = 0;
+
+    index = pa_xnew(table_entry, PA_MAX(n, 1U));
+    offset = sizeof(table_header) + n * sizeof(table_entry);
+
+    for (i = 0; i < n; i++) {
+        index[i].key_offset = offset;
+        index[i].key_size = entries[i].key.size;
+        offset += entries[i].key.size;
+        index[i].data_offset = offset;
+        index[i].data_size = entries[i].data.size;
+        offset += entries[i].data.size;
+    }
+
+    if ((fd = pa_open_cloexec(fn, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+        goto finish;
+
+    if (pa_loop_write(fd, &h, sizeof(h), NULL) != sizeof(h) ||
+        (n > 0 && pa_loop_write(fd, index, n * sizeof(table_entry), NULL) != (ssize_t) (n * sizeof(table_entry))))
+        goto finish;
+
+    for (i = 0; i < n; i++)
+        if ((entries[i].key.size > 0 && pa_loop_write(fd, entries[i].key.data, entries[i].key.size, NULL) != (ssize_t) entries[i].key.size) ||
+            (entries[i].data.size > 0 && pa_loop_write(fd, entries[i].data.data, entries[i].data.size, NULL) != (ssize_t) entries[i].data.size))
+            goto finish;
+
+    if (fsync(fd) < 0)
+        goto finish;
+
+    r = 0;
+
+finish:
+    if (fd >= 0)
+        pa_close(fd);
+
+    pa_xfree(index);
+    pa_xfree(entries);
+
+    return r;
+}
+
+int pa_database_sync(pa_database *database) {
+    mmap_data *db = (mmap_data*)database;
+
+    pa_assert(db);
+
+    if (db->read_only || (pa_hashmap_size(db->changes) == 0 && !db->cleared))
+        return 0;
+
+    errno = 0;
+
+    if (write_table(db, db->tmp_filename) < 0) {
+        pa_log_warn("Failed to write database file '%s': %s", db->tmp_filename, pa_cstrerror(errno));
+        unlink(db->tmp_filename);
+        return -1;
+    }
+
+    if (rename(db->tmp_filename, db->filename) < 0) {
+        pa_log_warn("Failed to rename database file: %s", pa_cstrerror(errno));
+        unlink(db->tmp_filename);
+        return -1;
+    }
+
+    /* Everything in the log is in the table now. If we crash before
+     * the log is gone, replaying it again does no harm. */
+    if (db->log_fd >= 0) {
+        pa_close(db->log_fd);
+        db->log_fd = -1;
+    }
+
+    unlink(db->log_filename);
+
+    table_unmap(db);
+    pa_hashmap_remove_all(db->changes);
+    db->cleared = false;
+
+    if (table_map(db) < 0) {
+        pa_log_warn("Failed to map database file '%s': %s", db->filename, pa_cstrerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "database.h"
+
+struct pa_database_cache {
+    pa_database *database;
+
+    /* pa_datum key -> struct pending, the most recent value of every
+     * key that has been set but not yet written to the database */
+    pa_hashmap *pending;
+};
+
+struct pending {
+    pa_datum key;
+    pa_datum data;
+};
+
+static int compare_func(const void *a, const void *b) {
+    const pa_datum *aa, *bb;
+
+    aa = (const pa_datum*)a;
+    bb = (const pa_datum*)b;
+
+    if (aa->size != bb->size)
+        return aa->size > bb->size ? 1 : -1;
+
+    return memcmp(aa->data, bb->data, aa->size);
+}
+
+static unsigned hash_func(const void *p) {
+    const pa_datum *d;
+    unsigned hash = 0;
+    const char *c;
+    unsigned i;
+
+    d = (const pa_datum*)p;
+    c = d->data;
+
+    for (i = 0; i < d->size; i++) {
+        hash = 31 * hash + (unsigned) *c;
+        c++;
+    }
+
+    return hash;
+}
+
+static void pending_free(struct pending *p) {
+    pa_assert(p);
+
+    pa_xfree(p->key.data);
+    pa_xfree(p->data.data);
+    pa_xfree(p);
+}
+
+pa_database_cache* pa_database_cache_new(pa_database *db) {
+    pa_database_cache *c;
+
+    pa_assert(db);
+
+    c = pa_xnew0(pa_database_cache, 1);
+    c->database = db;
+    c->pending = pa_hashmap_new_full(hash_func, compare_func, NULL, (pa_free_cb_t) pending_free);
+
+    return c;
+}
+
+void pa_database_cache_free(pa_database_cache *c) {
+    pa_assert(c);
+
+    pa_database_cache_flush(c);
+
+    pa_hashmap_free(c->pending);
+    pa_xfree(c);
+}
+
+pa_datum* pa_database_cache_get(pa_database_cache *c, const pa_datum *key, pa_datum* data) {
+    struct pending *p;
+
+    pa_assert(c);
+    pa_assert(key);
+    pa_assert(data);
+
+    if (!(p = pa_hashmap_get(c->pending, key)))
+        return pa_database_get(c->database, key, data);
+
+    /* pa_datum_free() of all backends is fine with memory from
+     * pa_xmalloc() */
+    data->data = p->data.size > 0 ? pa_xmemdup(p->data.data, p->data.size) : NULL;
+    data->size = p->data.size;
+
+    return data;
+}
+
+int pa_database_cache_set(pa_database_cache *c, const pa_datum *key, const pa_datum* data, bool overwrite) {
+    struct pending *p;
+
+    pa_assert(c);
+    pa_assert(key);
+    pa_assert(data);
+
+    if ((p = pa_hashmap_get(c->pending, key))) {
+        if (!overwrite)
+            return -1;
+
+        pa_xfree(p->data.data);
+        p->data.data = data->size > 0 ? pa_xmemdup(data->data, data->size) : NULL;
+        p->data.size = data->size;
+
+        return 0;
+    }
+
+    if (!overwrite) {
+        pa_datum old;
+
+        if (pa_database_get(c->database, key, &old)) {
+            pa_datum_free(&old);
+            return -1;
+        }
+    }
+
+    p = pa_xnew0(struct pending, 1);
+    p->key.data = key->size > 0 ? pa_xmemdup(key->data, key->size) : NULL;
+    p->key.size = key->size;
+    p->data.data = data->size > 0 ? pa_xmemdup(data->data, data->size) : NULL;
+    p->data.size = data->size;
+
+    pa_assert_se(pa_hashmap_put(c->pending, &p->key, p) == 0);
+
+    return 0;
+}
+
+int pa_database_cache_unset(pa_database_cache *c, const pa_datum *key) {
+    bool was_pending;
+
+    pa_assert(c);
+    pa_assert(key);
+
+    was_pending = pa_hashmap_remove_and_free(c->pending, key) >= 0;
+
+    /* A key that was only ever set through the cache is not in the
+     * database yet */
+    if (pa_database_unset(c->database, key) < 0 && !was_pending)
+        return -1;
+
+    return 0;
+}
+
+int pa_database_cache_clear(pa_database_cache *c) {
+    pa_assert(c);
+
+    pa_hashmap_remove_all(c->pending);
+
+    return pa_database_clear(c->database);
+}
+
+int pa_database_cache_flush(pa_database_cache *c) {
+    struct pending *p;
+    int r = 0;
+
+    pa_assert(c);
+
+    while ((p = pa_hashmap_steal_first(c->pending))) {
+        if (pa_database_set(c->database, &p->key, &p->data, true) < 0) {
+            pa_log_warn("Failed to write database entry.");
+            r = -1;
+        }
+
+        pending_free(p);
+    }
+
+    return r;
+}
+
+int pa_database_cache_sync(pa_database_cache *c) {
+    int r;
+
+    pa_assert(c);
+
+    r = pa_database_cache_flush(c);
+
+    if (pa_database_sync(c->database) < 0)
+        r = -1;
+
+    return r;
+}
+
+pa_datum* pa_database_cache_first(pa_database_cache *c, pa_datum *key, pa_datum *data) {
+    pa_assert(c);
+    pa_assert(key);
+
+    /* The backends can't merge our pending entries into their
+     * iteration, so write them out before it starts */
+    pa_database_cache_flush(c);
+
+    return pa_database_first(c->database, key, data);
+}
+
+pa_datum* pa_database_cache_next(pa_database_cache *c, const pa_datum *key, pa_datum *next, pa_datum *data) {
+    pa_assert(c);
+
+    return pa_database_next(c->database, key, next, data);
+}
@@ -56,4 +56,33 @@ pa_datum* pa_database_next(pa_database *db, const pa_datum *key, pa_datum *next,
 
 int pa_database_sync(pa_database *db);
 
+/* A write-back cache on top of a database. Sets are kept in memory,
+ * and repeated sets of the same key replace each other, until the
+ * cache is flushed. Syncing flushes and then syncs the database, so
+ * a burst of changes between two syncs costs one write per key and
+ * one sync in total. Reads see the pending values. The cache doesn't
+ * own the database, but it must be freed before the database is
+ * closed. Freeing it flushes, but doesn't sync. */
+typedef struct pa_database_cache pa_database_cache;
+
+pa_database_cache* pa_database_cache_new(pa_database *db);
+void pa_database_cache_free(pa_database_cache *c);
+
+pa_datum* pa_database_cache_get(pa_database_cache *c, const pa_datum *key, pa_datum* data);
+
+int pa_database_cache_set(pa_database_cache *c, const pa_datum *key, const pa_datum* data, bool overwrite);
+int pa_database_cache_unset(pa_database_cache *c, const pa_datum *key);
+
+int pa_database_cache_clear(pa_database_cache *c);
+
+/* Iterating flushes first */
+pa_datum* pa_database_cache_first(pa_database_cache *c, pa_datum *key, pa_datum *data /* may be NULL */);
+pa_datum* pa_database_cache_next(pa_database_cache *c, const pa_datum *key, pa_datum *next, pa_datum *data /* may be NULL */);
+
+/* Writes all pending entries to the database */
+int pa_database_cache_flush(pa_database_cache *c);
+
+/* Flushes and syncs the database */
+int pa_database_cache_sync(pa_database_cache *c);
+
 #endif
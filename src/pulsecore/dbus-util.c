@@ -282,9 +282,10 @@ pa_dbus_wrap_connection* pa_dbus_wrap_connection_new(pa_mainloop_api *m, bool us
 
     pconn->dispatch_event = pconn->mainloop->defer_new(pconn->mainloop, dispatch_cb, conn);
 
+    id = dbus_connection_get_server_id(conn);
     pa_log_debug("Successfully connected to D-Bus %s bus %s as %s",
                  type == DBUS_BUS_SYSTEM ? "system" : (type == DBUS_BUS_SESSION ? "session" : "starter"),
-                 pa_strnull((id = dbus_connection_get_server_id(conn))),
+                 pa_strnull(id),
                  pa_strnull(dbus_bus_get_unique_name(conn)));
 
     dbus_free(id);
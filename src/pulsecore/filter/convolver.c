@@ -0,0 +1,328 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#include "convolver.h"
+
+/* Each block of B new input frames is transformed together with the
+ * previous block, i.e. with real FFTs of size 2B, which are done as
+ * complex FFTs of size B. A spectrum consists of B + 1 complex values,
+ * stored as interleaved real and imaginary parts. */
+
+struct pa_convolver {
+    unsigned block_size;
+    unsigned n_in, n_out;
+    unsigned n_partitions;
+
+    /* Frames of the current block processed so far */
+    unsigned pos;
+
+    /* Slot of the newest input spectrum in the delay line */
+    unsigned fdl_pos;
+
+    unsigned *bitrev;
+    float *twiddle;        /* exp(-2 pi i k / B) for k < B/2 */
+    float *twiddle_real;   /* exp(-pi i k / B) for k <= B */
+
+    float *input;          /* n_in * 2B, previous and current block */
+    float *fdl;            /* n_in * n_partitions spectra */
+    float *response;       /* n_out * n_in * n_partitions spectra */
+    bool *active;          /* n_out * n_in */
+    float *accum;          /* one spectrum */
+    float *output;         /* n_out * B, the output of the last block */
+};
+
+static inline size_t spectrum_size(pa_convolver *c) {
+    return 2 * (c->block_size + 1);
+}
+
+/* In place radix-2 complex FFT of size B, without normalization */
+static void fft(pa_convolver *c, float *data, bool inverse) {
+    const unsigned n = c->block_size;
+    const float sign = inverse ? -1.0f : 1.0f;
+    unsigned i, j, len;
+
+    for (i = 0; i < n; i++) {
+        j = c->bitrev[i];
+
+        if (i < j) {
+            float t;
+
+            t = data[2 * i]; data[2 * i] = data[2 * j]; data[2 * j] = t;
+            t = data[2 * i + 1]; data[2 * i + 1] = data[2 * j + 1]; data[2 * j + 1] = t;
+        }
+    }
+
+    for (len = 2; len <= n; len <<= 1) {
+        const unsigned half = len / 2, step = n / len;
+
+        for (i = 0; i < n; i += len) {
+            for (j = 0; j < half; j++) {
+                float *a = data + 2 * (i + j);
+                float *b = data + 2 * (i + j + half);
+                const float wr = c->twiddle[2 * j * step];
+                const float wi = sign * c->twiddle[2 * j * step + 1];
+                const float vr = b[0] * wr - b[1] * wi;
+                const float vi = b[0] * wi + b[1] * wr;
+
+                b[0] = a[0] - vr;
+                b[1] = a[1] - vi;
+                a[0] += vr;
+                a[1] += vi;
+            }
+        }
+    }
+}
+
+/* Real FFT of the 2B samples in data, which has to have room for the
+ * B + 1 complex values of the result. */
+static void rfft(pa_convolver *c, float *data) {
+    const unsigned n = c->block_size;
+    unsigned k;
+
+    /* Even samples in the real, odd samples in the imaginary parts */
+    fft(c, data, false);
+
+    for (k = 0; k <= n / 2; k++) {
+        const unsigned mk = k == 0 ? 0 : n - k;
+        const float zr = data[2 * k], zi = data[2 * k + 1];
+        const float mr = data[2 * mk], mi = data[2 * mk + 1];
+        /* E = (Z[k] + conj(Z[n-k])) / 2, O = (Z[k] - conj(Z[n-k])) / 2i */
+        const float er = 0.5f * (zr + mr), ei = 0.5f * (zi - mi);
+        const float or = 0.5f * (zi + mi), oi = -0.5f * (zr - mr);
+        const float *w = c->twiddle_real + 2 * k;
+        const float *wm = c->twiddle_real + 2 * (n - k);
+
+        /* X[k] = E + W^k O, X[n-k] = conj(E) + W^(n-k) conj(O) */
+        data[2 * k] = er + w[0] * or - w[1] * oi;
+        data[2 * k + 1] = ei + w[0] * oi + w[1] * or;
+        data[2 * (n - k)] = er + wm[0] * or + wm[1] * oi;
+        data[2 * (n - k) + 1] = -ei - wm[0] * oi + wm[1] * or;
+    }
+}
+
+/* Inverse of rfft(), scaled by B */
+static void irfft(pa_convolver *c, float *data) {
+    const unsigned n = c->block_size;
+    unsigned k;
+
+    for (k = 0; k <= n / 2; k++) {
+        const float xr = data[2 * k], xi = data[2 * k + 1];
+        const float mr = data[2 * (n - k)], mi = data[2 * (n - k) + 1];
+        const float *w = c->twiddle_real + 2 * k;
+        /* E = (X[k] + conj(X[n-k])) / 2, O = (X[k] - conj(X[n-k])) / 2W^k */
+        const float er = 0.5f * (xr + mr), ei = 0.5f * (xi - mi);
+        const float dr = 0.5f * (xr - mr), di = 0.5f * (xi + mi);
+        const float or = dr * w[0] + di * w[1], oi = di * w[0] - dr * w[1];
+
+        /* Z[k] = E + i O, Z[n-k] = conj(E) + i conj(O) */
+        data[2 * k] = er - oi;
+        data[2 * k + 1] = ei + or;
+
+        if (k > 0) {
+            data[2 * (n - k)] = er + oi;
+            data[2 * (n - k) + 1] = -ei + or;
+        }
+    }
+
+    fft(c, data, true);
+}
+
+pa_convolver *pa_convolver_new(unsigned block_size, unsigned n_in, unsigned n_out, unsigned max_taps) {
+    pa_convolver *c;
+    unsigned i, bits;
+
+    pa_assert(block_size >= 2);
+    pa_assert(block_size == pa_make_power_of_two(block_size));
+    pa_assert(n_in > 0);
+    pa_assert(n_out > 0);
+    pa_assert(max_taps > 0);
+
+    c = pa_xnew0(pa_convolver, 1);
+    c->block_size = block_size;
+    c->n_in = n_in;
+    c->n_out = n_out;
+    c->n_partitions = (max_taps + block_size - 1) / block_size;
+
+    for (bits = 0; (1U << bits) < block_size; bits++)
+        ;
+
+    c->bitrev = pa_xnew(unsigned, block_size);
+    for (i = 0; i < block_size; i++) {
+        unsigned b, r = 0;
+
+        for (b = 0; b < bits; b++)
+            if (i & (1U << b))
+                r |= 1U << (bits - 1 - b);
+
+        c->bitrev[i] = r;
+    }
+
+    c->twiddle = pa_xnew(float, block_size);
+    for (i = 0; i < block_size / 2; i++) {
+        c->twiddle[2 * i] = (float) cos(2 * M_PI * i / block_size);
+        c->twiddle[2 * i + 1] = (float) -sin(2 * M_PI * i / block_size);
+    }
+
+    c->twiddle_real = pa_xnew(float, 2 * (block_size + 1));
+    for (i = 0; i <= block_size; i++) {
+        c->twiddle_real[2 * i] = (float) cos(M_PI * i / block_size);
+        c->twiddle_real[2 * i + 1] = (float) -sin(M_PI * i / block_size);
+    }
+
+    c->input = pa_xnew0(float, n_in * 2 * block_size);
+    c->fdl = pa_xnew0(float, n_in * c->n_partitions * spectrum_size(c));
+    c->response = pa_xnew0(float, n_out * n_in * c->n_partitions * spectrum_size(c));
+    c->active = pa_xnew0(bool, n_out * n_in);
+    c->accum = pa_xnew0(float, spectrum_size(c));
+    c->output = pa_xnew0(float, n_out * block_size);
+
+    return c;
+}
+
+void pa_convolver_free(pa_convolver *c) {
+    pa_assert(c);
+
+    pa_xfree(c->bitrev);
+    pa_xfree(c->twiddle);
+    pa_xfree(c->twiddle_real);
+    pa_xfree(c->input);
+    pa_xfree(c->fdl);
+    pa_xfree(c->response);
+    pa_xfree(c->active);
+    pa_xfree(c->accum);
+    pa_xfree(c->output);
+    pa_xfree(c);
+}
+
+void pa_convolver_set_response(pa_convolver *c, unsigned in, unsigned out, const float *ir, unsigned n_taps) {
+    const unsigned b = c->block_size;
+    unsigned p, i;
+
+    pa_assert(c);
+    pa_assert(in < c->n_in);
+    pa_assert(out < c->n_out);
+    pa_assert(ir);
+    pa_assert(n_taps <= c->n_partitions * b);
+
+    for (p = 0; p < c->n_partitions; p++) {
+        float *h = c->response + ((out * c->n_in + in) * c->n_partitions + p) * spectrum_size(c);
+
+        memset(h, 0, spectrum_size(c) * sizeof(float));
+
+        /* Zero padded to 2B, with the scaling of irfft() folded in */
+        for (i = 0; i < b && p * b + i < n_taps; i++)
+            h[i] = ir[p * b + i] / (float) b;
+
+        rfft(c, h);
+    }
+
+    c->active[out * c->n_in + in] = true;
+}
+
+void pa_convolver_reset(pa_convolver *c) {
+    pa_assert(c);
+
+    memset(c->input, 0, c->n_in * 2 * c->block_size * sizeof(float));
+    memset(c->fdl, 0, c->n_in * c->n_partitions * spectrum_size(c) * sizeof(float));
+    memset(c->output, 0, c->n_out * c->block_size * sizeof(float));
+    c->pos = 0;
+    c->fdl_pos = 0;
+}
+
+static void process_block(pa_convolver *c) {
+    const unsigned b = c->block_size;
+    const size_t ss = spectrum_size(c);
+    unsigned in, out, p;
+    size_t k;
+
+    c->fdl_pos = (c->fdl_pos + c->n_partitions - 1) % c->n_partitions;
+
+    for (in = 0; in < c->n_in; in++) {
+        float *x = c->input + in * 2 * b;
+        float *X = c->fdl + (in * c->n_partitions + c->fdl_pos) * ss;
+
+        memcpy(X, x, 2 * b * sizeof(float));
+        rfft(c, X);
+
+        /* The current block is the previous one for the next round */
+        memcpy(x, x + b, b * sizeof(float));
+    }
+
+    for (out = 0; out < c->n_out; out++) {
+        memset(c->accum, 0, ss * sizeof(float));
+
+        for (in = 0; in < c->n_in; in++) {
+            if (!c->active[out * c->n_in + in])
+                continue;
+
+            for (p = 0; p < c->n_partitions; p++) {
+                const float *X = c->fdl + (in * c->n_partitions + (c->fdl_pos + p) % c->n_partitions) * ss;
+                const float *H = c->response + ((out * c->n_in + in) * c->n_partitions + p) * ss;
+
+                for (k = 0; k < ss; k += 2) {
+                    c->accum[k] += X[k] * H[k] - X[k + 1] * H[k + 1];
+                    c->accum[k + 1] += X[k] * H[k + 1] + X[k + 1] * H[k];
+                }
+            }
+        }
+
+        irfft(c, c->accum);
+
+        /* Overlap-save: the first half is wrapped around, drop it */
+        memcpy(c->output + out * b, c->accum + b, b * sizeof(float));
+    }
+}
+
+void pa_convolver_process(pa_convolver *c, const float *src, float *dst, unsigned n) {
+    const unsigned b = c->block_size;
+
+    pa_assert(c);
+    pa_assert(src);
+    pa_assert(dst);
+
+    while (n > 0) {
+        unsigned k = PA_MIN(n, b - c->pos), i, ch;
+
+        for (i = 0; i < k; i++) {
+            for (ch = 0; ch < c->n_in; ch++)
+                c->input[ch * 2 * b + b + c->pos + i] = *src++;
+
+            for (ch = 0; ch < c->n_out; ch++)
+                *dst++ = c->output[ch * b + c->pos + i];
+        }
+
+        c->pos += k;
+        n -= k;
+
+        if (c->pos >= b) {
+            process_block(c);
+            c->pos = 0;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef fooconvolverhfoo
+#define fooconvolverhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* A uniformly partitioned overlap-save FFT convolver for float samples.
+ *
+ * The impulse responses are split into partitions of block_size taps,
+ * so the cost per sample grows with the logarithm of the block size and
+ * linearly with the number of partitions, rather than with the number
+ * of taps. Every output channel is the sum of all input channels, each
+ * convolved with the impulse response set for that pair of channels.
+ *
+ * The output lags behind the input by exactly block_size frames. */
+
+typedef struct pa_convolver pa_convolver;
+
+/* block_size has to be a power of two, max_taps is the length of the
+ * longest impulse response that will be set. */
+pa_convolver *pa_convolver_new(unsigned block_size, unsigned n_in, unsigned n_out, unsigned max_taps);
+void pa_convolver_free(pa_convolver *c);
+
+/* Set the impulse response from input channel in to output channel out.
+ * Pairs that never get one set don't contribute to the output. */
+void pa_convolver_set_response(pa_convolver *c, unsigned in, unsigned out, const float *ir, unsigned n_taps);
+
+/* Forget all past input, e.g. after a rewind */
+void pa_convolver_reset(pa_convolver *c);
+
+/* Process n frames of interleaved input into n frames of interleaved
+ * output. src and dst may not overlap. */
+void pa_convolver_process(pa_convolver *c, const float *src, float *dst, unsigned n);
+
+#endif
@@ -7,10 +7,24 @@
 #include <config.h>
 #endif
 
+#include <math.h>
+#include <string.h>
+
 #include <pulsecore/macro.h>
 
 #include "crossover.h"
 
+/* Once the input goes quiet the history decays towards zero and would
+ * end up in denormals, which are very slow on some CPUs unless the
+ * thread flushes them itself. Values this small are cut off at the end
+ * of each block, long before they get there. */
+#define LR4_TINY 1e-15f
+
+static inline float flush_tiny(float v)
+{
+	return fabsf(v) < LR4_TINY ? 0.0f : v;
+}
+
 void lr4_set(struct lr4 *lr4, enum biquad_type type, float freq)
 {
 	biquad_set(&lr4->bq, type, freq);
@@ -51,12 +65,12 @@ void lr4_process_float32(struct lr4 *lr4, int samples, int channels, float *src,
 		dest[i] = z;
 	}
 
-	lr4->x1 = lx1;
-	lr4->x2 = lx2;
-	lr4->y1 = ly1;
-	lr4->y2 = ly2;
-	lr4->z1 = lz1;
-	lr4->z2 = lz2;
+	lr4->x1 = flush_tiny(lx1);
+	lr4->x2 = flush_tiny(lx2);
+	lr4->y1 = flush_tiny(ly1);
+	lr4->y2 = flush_tiny(ly2);
+	lr4->z1 = flush_tiny(lz1);
+	lr4->z2 = flush_tiny(lz2);
 }
 
 void lr4_process_s16(struct lr4 *lr4, int samples, int channels, short *src, short *dest)
@@ -88,10 +102,296 @@ void lr4_process_s16(struct lr4 *lr4, int samples, int channels, short *src, sho
 		dest[i] = PA_CLAMP_UNLIKELY((int) z, -0x8000, 0x7fff);
 	}
 
-	lr4->x1 = lx1;
-	lr4->x2 = lx2;
-	lr4->y1 = ly1;
-	lr4->y2 = ly2;
-	lr4->z1 = lz1;
-	lr4->z2 = lz2;
+	lr4->x1 = flush_tiny(lx1);
+	lr4->x2 = flush_tiny(lx2);
+	lr4->y1 = flush_tiny(ly1);
+	lr4->y2 = flush_tiny(ly2);
+	lr4->z1 = flush_tiny(lz1);
+	lr4->z2 = flush_tiny(lz2);
+}
+
+/* lr4_multi keeps its history in plain float arrays, so that it can be
+ * copied around like struct lr4. The processing functions load LR4_LANES
+ * channels at a time into vectors, which the compiler maps to SSE or NEON
+ * registers. The arithmetic is the same as in lr4_process_float32().
+ *
+ * If the channel count isn't a multiple of LR4_LANES, the last vector
+ * overlaps with the one before, e.g. for 6 channels the vectors cover the
+ * channels 0-3 and 2-5. The overlapping lanes start out with the same
+ * state and see the same input, so they compute the same values. Only
+ * less than LR4_LANES channels need to be loaded one by one. */
+typedef float v4sf __attribute__((vector_size(16)));
+
+#define LR4_VECS (LR4_MAX_CHANNELS / LR4_LANES)
+
+struct lr4_vec {
+	v4sf b0, b1, b2, a1, a2;
+	v4sf x1, x2, y1, y2, z1, z2;
+};
+
+void lr4_multi_init(struct lr4_multi *lr4, int channels)
+{
+	pa_assert(channels > 0 && channels <= PA_CHANNELS_MAX);
+
+	memset(lr4, 0, sizeof(*lr4));
+	lr4->channels = channels;
+}
+
+void lr4_multi_set(struct lr4_multi *lr4, int channel, enum biquad_type type, float freq)
+{
+	struct biquad bq;
+
+	pa_assert(channel >= 0 && channel < lr4->channels);
+
+	biquad_set(&bq, type, freq);
+	lr4->b0[channel] = bq.b0;
+	lr4->b1[channel] = bq.b1;
+	lr4->b2[channel] = bq.b2;
+	lr4->a1[channel] = bq.a1;
+	lr4->a2[channel] = bq.a2;
+	lr4->x1[channel] = 0;
+	lr4->x2[channel] = 0;
+	lr4->y1[channel] = 0;
+	lr4->y2[channel] = 0;
+	lr4->z1[channel] = 0;
+	lr4->z2[channel] = 0;
+
+	lr4->fixed.b0[channel] = lrintf(bq.b0 * (1 << LR4_FIXED_COEF_SHIFT));
+	lr4->fixed.b1[channel] = lrintf(bq.b1 * (1 << LR4_FIXED_COEF_SHIFT));
+	lr4->fixed.b2[channel] = lrintf(bq.b2 * (1 << LR4_FIXED_COEF_SHIFT));
+	lr4->fixed.a1[channel] = lrintf(bq.a1 * (1 << LR4_FIXED_COEF_SHIFT));
+	lr4->fixed.a2[channel] = lrintf(bq.a2 * (1 << LR4_FIXED_COEF_SHIFT));
+	lr4->fixed.x1[channel] = 0;
+	lr4->fixed.x2[channel] = 0;
+	lr4->fixed.y1[channel] = 0;
+	lr4->fixed.y2[channel] = 0;
+	lr4->fixed.z1[channel] = 0;
+	lr4->fixed.z2[channel] = 0;
+}
+
+static inline int vec_count(int channels)
+{
+	return (channels + LR4_LANES - 1) / LR4_LANES;
+}
+
+/* The first channel of vector j */
+static inline int vec_offset(int channels, int j)
+{
+	if (channels < LR4_LANES)
+		return 0;
+
+	return PA_MIN(j * LR4_LANES, channels - LR4_LANES);
+}
+
+#define LOAD_LANES(field) memcpy(&v[j].field, &lr4->field[o], sizeof(v4sf))
+#define STORE_LANES(field) memcpy(&lr4->field[o], &v[j].field, sizeof(v4sf))
+
+static void lr4_multi_load(const struct lr4_multi *lr4, struct lr4_vec *v)
+{
+	int j, vecs = vec_count(lr4->channels);
+
+	for (j = 0; j < vecs; j++) {
+		int o = vec_offset(lr4->channels, j);
+
+		LOAD_LANES(b0);
+		LOAD_LANES(b1);
+		LOAD_LANES(b2);
+		LOAD_LANES(a1);
+		LOAD_LANES(a2);
+		LOAD_LANES(x1);
+		LOAD_LANES(x2);
+		LOAD_LANES(y1);
+		LOAD_LANES(y2);
+		LOAD_LANES(z1);
+		LOAD_LANES(z2);
+	}
+}
+
+static void lr4_multi_store(struct lr4_multi *lr4, const struct lr4_vec *v)
+{
+	int i, j, vecs = vec_count(lr4->channels);
+
+	/* For less than LR4_LANES channels, the unused lanes only ever see
+	 * zeros, so they can be written back as well */
+	for (j = 0; j < vecs; j++) {
+		int o = vec_offset(lr4->channels, j);
+
+		STORE_LANES(x1);
+		STORE_LANES(x2);
+		STORE_LANES(y1);
+		STORE_LANES(y2);
+		STORE_LANES(z1);
+		STORE_LANES(z2);
+	}
+
+	for (i = 0; i < lr4->channels; i++) {
+		lr4->x1[i] = flush_tiny(lr4->x1[i]);
+		lr4->x2[i] = flush_tiny(lr4->x2[i]);
+		lr4->y1[i] = flush_tiny(lr4->y1[i]);
+		lr4->y2[i] = flush_tiny(lr4->y2[i]);
+		lr4->z1[i] = flush_tiny(lr4->z1[i]);
+		lr4->z2[i] = flush_tiny(lr4->z2[i]);
+	}
+}
+
+static inline v4sf lr4_vec_process(struct lr4_vec *v, v4sf x)
+{
+	v4sf y, z;
+
+	y = v->b0*x + v->b1*v->x1 + v->b2*v->x2 - v->a1*v->y1 - v->a2*v->y2;
+	z = v->b0*y + v->b1*v->y1 + v->b2*v->y2 - v->a1*v->z1 - v->a2*v->z2;
+	v->x2 = v->x1;
+	v->x1 = x;
+	v->y2 = v->y1;
+	v->y1 = y;
+	v->z2 = v->z1;
+	v->z1 = z;
+
+	return z;
+}
+
+/* With less than LR4_LANES channels the remaining lanes are filled with
+ * zeros and never written out, as src and dest may extend into the next
+ * frame. The lanes are spelled out, since a loop here tends to end up as
+ * a call to memcpy() per frame. */
+static inline v4sf load_float32(const float *src, int channels)
+{
+	v4sf x = { 0, 0, 0, 0 };
+
+	if (channels >= LR4_LANES) {
+		memcpy(&x, src, sizeof(x));
+		return x;
+	}
+
+	x[0] = src[0];
+	if (channels > 1)
+		x[1] = src[1];
+	if (channels > 2)
+		x[2] = src[2];
+
+	return x;
+}
+
+static inline void store_float32(float *dest, v4sf z, int channels)
+{
+	if (channels >= LR4_LANES) {
+		memcpy(dest, &z, sizeof(z));
+		return;
+	}
+
+	dest[0] = z[0];
+	if (channels > 1)
+		dest[1] = z[1];
+	if (channels > 2)
+		dest[2] = z[2];
+}
+
+/* This is inlined with a constant number of vectors for the common
+ * channel counts, which lets the compiler keep the whole history in
+ * registers. Otherwise it would go through the stack on every frame,
+ * which puts a store and a load on the critical path of the recursion.
+ * All vectors of a frame are loaded before any is stored, because they
+ * may overlap and src may be the same as dest. */
+#define DEFINE_PROCESS_FRAMES(name, type)					\
+static inline __attribute__((always_inline)) void process_frames_##name(	\
+	struct lr4_vec *state, int vecs, int channels,				\
+	int samples, const type *src, type *dest)				\
+{										\
+	struct lr4_vec v[LR4_VECS];						\
+	int i, j;								\
+										\
+	for (j = 0; j < vecs; j++)						\
+		v[j] = state[j];						\
+										\
+	for (i = 0; i < samples; i++) {						\
+		v4sf x[LR4_VECS];						\
+										\
+		for (j = 0; j < vecs; j++)					\
+			x[j] = load_##name(&src[vec_offset(channels, j)], channels);	\
+		for (j = 0; j < vecs; j++)					\
+			store_##name(&dest[vec_offset(channels, j)],		\
+				     lr4_vec_process(&v[j], x[j]), channels);	\
+										\
+		src += channels;						\
+		dest += channels;						\
+	}									\
+										\
+	for (j = 0; j < vecs; j++)						\
+		state[j] = v[j];						\
+}
+
+DEFINE_PROCESS_FRAMES(float32, float)
+
+void lr4_multi_process_float32(struct lr4_multi *lr4, int samples, const float *src, float *dest)
+{
+	struct lr4_vec v[LR4_VECS];
+	int vecs = vec_count(lr4->channels);
+
+	lr4_multi_load(lr4, v);
+
+	switch (vecs) {
+	case 1:
+		process_frames_float32(v, 1, lr4->channels, samples, src, dest);
+		break;
+	case 2:
+		process_frames_float32(v, 2, lr4->channels, samples, src, dest);
+		break;
+	default:
+		process_frames_float32(v, vecs, lr4->channels, samples, src, dest);
+		break;
+	}
+
+	lr4_multi_store(lr4, v);
+}
+
+/* One biquad in fixed point, the coefficients have LR4_FIXED_COEF_SHIFT
+ * and the samples LR4_FIXED_STATE_SHIFT fractional bits. With |x| < 2^28
+ * and the coefficients of a stable biquad adding up to less than 8 the
+ * sum fits into 64 bits. The result is rounded, since truncating would
+ * add a DC offset that the lowpass amplifies. */
+#define BIQUAD_FIXED(b0, b1, b2, a1, a2, x, x1, x2, y1, y2)			\
+	((int32_t) (((int64_t) (b0) * (x) + (int64_t) (b1) * (x1) +		\
+		     (int64_t) (b2) * (x2) - (int64_t) (a1) * (y1) -		\
+		     (int64_t) (a2) * (y2) +					\
+		     (INT64_C(1) << (LR4_FIXED_COEF_SHIFT - 1))) >> LR4_FIXED_COEF_SHIFT))
+
+void lr4_multi_process_s16(struct lr4_multi *lr4, int samples, const short *src, short *dest)
+{
+	struct lr4_fixed *q = &lr4->fixed;
+	int n = lr4->channels, c, i;
+
+	/* The channels are independent, so they are done one after another,
+	 * which keeps each one's history in registers. Every sample is read
+	 * before it is written, hence src may be the same as dest. */
+	for (c = 0; c < n; c++) {
+		int32_t b0 = q->b0[c], b1 = q->b1[c], b2 = q->b2[c];
+		int32_t a1 = q->a1[c], a2 = q->a2[c];
+		int32_t x1 = q->x1[c], x2 = q->x2[c];
+		int32_t y1 = q->y1[c], y2 = q->y2[c];
+		int32_t z1 = q->z1[c], z2 = q->z2[c];
+
+		for (i = c; i < samples * n; i += n) {
+			int32_t x, y, z;
+
+			x = src[i] * (1 << LR4_FIXED_STATE_SHIFT);
+			y = BIQUAD_FIXED(b0, b1, b2, a1, a2, x, x1, x2, y1, y2);
+			z = BIQUAD_FIXED(b0, b1, b2, a1, a2, y, y1, y2, z1, z2);
+			x2 = x1;
+			x1 = x;
+			y2 = y1;
+			y1 = y;
+			z2 = z1;
+			z1 = z;
+
+			/* Truncates like the conversion from float does */
+			dest[i] = PA_CLAMP_UNLIKELY(z / (1 << LR4_FIXED_STATE_SHIFT), -0x8000, 0x7fff);
+		}
+
+		q->x1[c] = x1;
+		q->x2[c] = x2;
+		q->y1[c] = y1;
+		q->y2[c] = y2;
+		q->z1[c] = z1;
+		q->z2[c] = z2;
+	}
 }
@@ -6,6 +6,8 @@
 #ifndef CROSSOVER_H_
 #define CROSSOVER_H_
 
+#include <pulse/sample.h>
+
 #include "biquad.h"
 /* An LR4 filter is two biquads with the same parameters connected in series:
  *
@@ -26,4 +28,46 @@ void lr4_set(struct lr4 *lr4, enum biquad_type type, float freq);
 void lr4_process_float32(struct lr4 *lr4, int samples, int channels, float *src, float *dest);
 void lr4_process_s16(struct lr4 *lr4, int samples, int channels, short *src, short *dest);
 
+/* The LR4 filters of all channels of an interleaved stream, stored as a
+ * structure of arrays. The channels of a frame are processed in parallel,
+ * LR4_LANES at a time, so this is a lot faster than calling
+ * lr4_process_float32() once per channel. Every channel has its own
+ * coefficients. The float output matches that of struct lr4 for each
+ * channel, the s16 output is within one LSB of it.
+ */
+#define LR4_LANES 4
+#define LR4_MAX_CHANNELS ((PA_CHANNELS_MAX + LR4_LANES - 1) / LR4_LANES * LR4_LANES)
+
+/* S16 streams are filtered in fixed point instead, so that the s16 work
+ * format of the resampler stays free of float arithmetic. The history
+ * keeps LR4_FIXED_STATE_SHIFT bits below the sample resolution. */
+#define LR4_FIXED_COEF_SHIFT 29
+#define LR4_FIXED_STATE_SHIFT 12
+
+struct lr4_fixed {
+	int32_t b0[PA_CHANNELS_MAX], b1[PA_CHANNELS_MAX], b2[PA_CHANNELS_MAX];
+	int32_t a1[PA_CHANNELS_MAX], a2[PA_CHANNELS_MAX];
+	int32_t x1[PA_CHANNELS_MAX], x2[PA_CHANNELS_MAX];
+	int32_t y1[PA_CHANNELS_MAX], y2[PA_CHANNELS_MAX];
+	int32_t z1[PA_CHANNELS_MAX], z2[PA_CHANNELS_MAX];
+};
+
+struct lr4_multi {
+	int channels;
+	float b0[LR4_MAX_CHANNELS], b1[LR4_MAX_CHANNELS], b2[LR4_MAX_CHANNELS];
+	float a1[LR4_MAX_CHANNELS], a2[LR4_MAX_CHANNELS];
+	float x1[LR4_MAX_CHANNELS], x2[LR4_MAX_CHANNELS];
+	float y1[LR4_MAX_CHANNELS], y2[LR4_MAX_CHANNELS];
+	float z1[LR4_MAX_CHANNELS], z2[LR4_MAX_CHANNELS];
+	struct lr4_fixed fixed;
+};
+
+void lr4_multi_init(struct lr4_multi *lr4, int channels);
+void lr4_multi_set(struct lr4_multi *lr4, int channel, enum biquad_type type, float freq);
+
+/* Process samples frames of interleaved audio with lr4->channels channels.
+ * src and dest may be the same. */
+void lr4_multi_process_float32(struct lr4_multi *lr4, int samples, const float *src, float *dest);
+void lr4_multi_process_s16(struct lr4_multi *lr4, int samples, const short *src, short *dest);
+
 #endif /* CROSSOVER_H_ */
@@ -23,20 +23,22 @@
 
 #include "lfe-filter.h"
 #include <pulse/xmalloc.h>
-#include <pulsecore/flist.h>
-#include <pulsecore/llist.h>
 #include <pulsecore/filter/biquad.h>
 #include <pulsecore/filter/crossover.h>
 
-struct saved_state {
-    PA_LLIST_FIELDS(struct saved_state);
-    pa_memchunk chunk;
+/* For rewinding, we keep the unfiltered input of the last history_frames
+   frames in a ring buffer, and a snapshot of the filter state every
+   CHECKPOINT_FRAMES frames. A rewind restores the closest checkpoint before
+   the new position and filters the history from there on, which takes
+   less than CHECKPOINT_FRAMES frames. Everything is allocated up front, so
+   neither processing nor rewinding allocates memory. */
+#define CHECKPOINT_FRAMES 2048
+
+struct checkpoint {
     int64_t index;
-    struct lr4 lr4[PA_CHANNELS_MAX];
+    struct lr4_multi lr4;
 };
 
-PA_STATIC_FLIST_DECLARE(lfe_state, 0, pa_xfree);
-
 /* An LR4 filter, implemented as a chain of two Butterworth filters.
 
    Currently the channel map is fixed so that a highpass filter is applied to all
@@ -47,36 +49,47 @@ PA_STATIC_FLIST_DECLARE(lfe_state, 0, pa_xfree);
 
 struct pa_lfe_filter {
     int64_t index;
-    PA_LLIST_HEAD(struct saved_state, saved);
     float crossover;
     pa_channel_map cm;
     pa_sample_spec ss;
     size_t maxrewind;
     bool active;
-    struct lr4 lr4[PA_CHANNELS_MAX];
-};
+    struct lr4_multi lr4;
 
-static void remove_state(pa_lfe_filter_t *f, struct saved_state *s) {
-    PA_LLIST_REMOVE(struct saved_state, f->saved, s);
-    pa_memblock_unref(s->chunk.memblock);
-    pa_xfree(s);
-}
+    uint8_t *history;
+    size_t history_frames;
+    struct checkpoint *checkpoints;
+    unsigned n_checkpoints;
+    void *scratch;
+};
 
 pa_lfe_filter_t * pa_lfe_filter_new(const pa_sample_spec* ss, const pa_channel_map* cm, float crossover_freq, size_t maxrewind) {
 
     pa_lfe_filter_t *f = pa_xnew0(struct pa_lfe_filter, 1);
+    size_t fs = pa_frame_size(ss);
+
     f->crossover = crossover_freq;
     f->cm = *cm;
     f->ss = *ss;
     f->maxrewind = maxrewind;
+
+    /* One extra checkpoint for the one we rewind to, which may be up to
+       CHECKPOINT_FRAMES before maxrewind, and one for the block that is
+       currently being filled */
+    f->n_checkpoints = maxrewind / CHECKPOINT_FRAMES + 2;
+    f->checkpoints = pa_xnew(struct checkpoint, f->n_checkpoints);
+    f->history_frames = (size_t) f->n_checkpoints * CHECKPOINT_FRAMES;
+    f->history = pa_xmalloc(f->history_frames * fs);
+    f->scratch = pa_xmalloc(CHECKPOINT_FRAMES * fs);
+
     pa_lfe_filter_update_rate(f, ss->rate);
     return f;
 }
 
 void pa_lfe_filter_free(pa_lfe_filter_t *f) {
-    while (f->saved)
-        remove_state(f, f->saved);
-
+    pa_xfree(f->scratch);
+    pa_xfree(f->history);
+    pa_xfree(f->checkpoints);
     pa_xfree(f);
 }
 
@@ -84,73 +97,62 @@ void pa_lfe_filter_reset(pa_lfe_filter_t *f) {
     pa_lfe_filter_update_rate(f, f->ss.rate);
 }
 
-static void process_block(pa_lfe_filter_t *f, pa_memchunk *buf, bool store_result) {
-    int samples = buf->length / pa_frame_size(&f->ss);
+static void save_checkpoint(pa_lfe_filter_t *f) {
+    struct checkpoint *c = NULL;
 
-    void *garbage = store_result ? NULL : pa_xmalloc(buf->length);
+    pa_assert(f->index % CHECKPOINT_FRAMES == 0);
 
-    if (f->ss.format == PA_SAMPLE_FLOAT32NE) {
-        int i;
-        float *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_float32(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
-        pa_memblock_release(buf->memblock);
-    }
-    else if (f->ss.format == PA_SAMPLE_S16NE) {
-        int i;
-        short *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_s16(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
-        pa_memblock_release(buf->memblock);
-    }
-    else pa_assert_not_reached();
+    c = &f->checkpoints[(f->index / CHECKPOINT_FRAMES) % f->n_checkpoints];
+    c->index = f->index;
+    c->lr4 = f->lr4;
+}
 
-    pa_xfree(garbage);
-    f->index += samples;
+static void filter(pa_lfe_filter_t *f, const void *src, void *dest, int samples) {
+    if (f->ss.format == PA_SAMPLE_FLOAT32NE)
+        lr4_multi_process_float32(&f->lr4, samples, src, dest);
+    else if (f->ss.format == PA_SAMPLE_S16NE)
+        lr4_multi_process_s16(&f->lr4, samples, src, dest);
+    else pa_assert_not_reached();
 }
 
 pa_memchunk * pa_lfe_filter_process(pa_lfe_filter_t *f, pa_memchunk *buf) {
-    pa_mempool *pool;
-    struct saved_state *s, *s2;
-    void *data;
+    size_t fs = pa_frame_size(&f->ss);
+    size_t samples, done = 0;
+    uint8_t *data;
 
     if (!f->active || !buf->length)
         return buf;
 
-    /* Remove old states (FIXME: we could do better than searching the entire array here?) */
-    PA_LLIST_FOREACH_SAFE(s, s2, f->saved)
-        if (s->index + (int64_t) (s->chunk.length / pa_frame_size(&f->ss) + f->maxrewind) < f->index)
-            remove_state(f, s);
+    samples = buf->length / fs;
+    data = pa_memblock_acquire_chunk(buf);
 
-    /* Insert our existing state into the flist */
-    if ((s = pa_flist_pop(PA_STATIC_FLIST_GET(lfe_state))) == NULL)
-        s = pa_xnew(struct saved_state, 1);
-    PA_LLIST_INIT(struct saved_state, s);
+    /* Stop at every checkpoint. Since history_frames is a multiple of
+       CHECKPOINT_FRAMES, the history never wraps within one piece. */
+    while (done < samples) {
+        size_t n = PA_MIN(samples - done, CHECKPOINT_FRAMES - (size_t) (f->index % CHECKPOINT_FRAMES));
+        size_t h = (size_t) (f->index % (int64_t) f->history_frames);
 
-    /* TODO: This actually memcpys the entire chunk into a new allocation, because we need to retain the original
-       in case of rewinding. Investigate whether this can be avoided. */
-    data = pa_memblock_acquire_chunk(buf);
-    pool = pa_memblock_get_pool(buf->memblock);
-    s->chunk.memblock = pa_memblock_new_malloced(pool, pa_xmemdup(data, buf->length), buf->length);
-    s->chunk.length = buf->length;
-    s->chunk.index = 0;
-    pa_memblock_release(buf->memblock);
-    pa_mempool_unref(pool), pool = NULL;
+        memcpy(f->history + h * fs, data + done * fs, n * fs);
+        filter(f, data + done * fs, data + done * fs, n);
 
-    s->index = f->index;
-    memcpy(s->lr4, f->lr4, sizeof(struct lr4) * f->cm.channels);
-    PA_LLIST_PREPEND(struct saved_state, f->saved, s);
+        f->index += n;
+        done += n;
 
-    process_block(f, buf, true);
+        if (f->index % CHECKPOINT_FRAMES == 0)
+            save_checkpoint(f);
+    }
+
+    pa_memblock_release(buf->memblock);
     return buf;
 }
 
 void pa_lfe_filter_update_rate(pa_lfe_filter_t *f, uint32_t new_rate) {
     int i;
+    unsigned j;
     float biquad_freq = f->crossover / (new_rate / 2);
 
-    while (f->saved)
-        remove_state(f, f->saved);
+    for (j = 0; j < f->n_checkpoints; j++)
+        f->checkpoints[j].index = -1;
 
     f->index = 0;
     f->ss.rate = new_rate;
@@ -160,42 +162,39 @@ void pa_lfe_filter_update_rate(pa_lfe_filter_t *f, uint32_t new_rate) {
         return;
     }
 
+    lr4_multi_init(&f->lr4, f->cm.channels);
     for (i = 0; i < f->cm.channels; i++)
-        lr4_set(&f->lr4[i], f->cm.map[i] == PA_CHANNEL_POSITION_LFE ? BQ_LOWPASS : BQ_HIGHPASS, biquad_freq);
+        lr4_multi_set(&f->lr4, i, f->cm.map[i] == PA_CHANNEL_POSITION_LFE ? BQ_LOWPASS : BQ_HIGHPASS, biquad_freq);
+
+    save_checkpoint(f);
 
     f->active = true;
 }
 
 void pa_lfe_filter_rewind(pa_lfe_filter_t *f, size_t amount) {
-    struct saved_state *i, *s = NULL;
-    size_t samples = amount / pa_frame_size(&f->ss);
-    f->index -= samples;
-
-    /* Find the closest saved position */
-    PA_LLIST_FOREACH(i, f->saved) {
-        if (i->index > f->index)
-            continue;
-        if (s == NULL || i->index > s->index)
-            s = i;
+    struct checkpoint *c = NULL;
+    size_t fs = pa_frame_size(&f->ss);
+    size_t samples = amount / fs;
+    int64_t index = f->index - (int64_t) samples, start = 0;
+
+    /* Find the closest saved position. If it was overwritten since, so
+       was the history after it. */
+    if (index >= 0) {
+        start = index - index % CHECKPOINT_FRAMES;
+        c = &f->checkpoints[(start / CHECKPOINT_FRAMES) % f->n_checkpoints];
     }
-    if (s == NULL) {
-        pa_log_debug("Rewinding LFE filter %zu samples to position %lli. No saved state found", samples, (long long) f->index);
+
+    if (index < 0 || c->index != start) {
+        pa_log_debug("Rewinding LFE filter %zu samples to position %lli. No saved state found", samples, (long long) index);
         pa_lfe_filter_update_rate(f, f->ss.rate);
         return;
     }
     pa_log_debug("Rewinding LFE filter %zu samples to position %lli. Found saved state at position %lli",
-        samples, (long long) f->index, (long long) s->index);
-    memcpy(f->lr4, s->lr4, sizeof(struct lr4) * f->cm.channels);
+        samples, (long long) index, (long long) start);
+    f->lr4 = c->lr4;
+    f->index = index;
 
     /* now fast forward to the actual position */
-    if (f->index > s->index) {
-        pa_memchunk x = s->chunk;
-        x.length = (f->index - s->index) * pa_frame_size(&f->ss);
-        if (x.length > s->chunk.length) {
-            pa_log_error("Hole in stream, cannot fast forward LFE filter");
-            return;
-        }
-        f->index = s->index;
-        process_block(f, &x, false);
-    }
+    if (index > start)
+        filter(f, f->history + (size_t) (start % (int64_t) f->history_frames) * fs, f->scratch, index - start);
 }
@@ -32,11 +32,17 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
 
 #include "flist.h"
 
 #define FLIST_SIZE 256
 
+/* Size of the per-thread caches, and how many entries are moved between
+ * a cache and the shared stacks at once when it runs empty or full */
+#define MAGAZINE_SIZE 32
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+
 /* Atomic table indices contain
    sign bit = if set, indicates empty/NULL value
    tag bits (to avoid the ABA problem)
@@ -51,10 +57,22 @@ struct pa_flist_elem {
 
 typedef struct pa_flist_elem pa_flist_elem;
 
+/* Per-thread cache in front of the shared stacks. Only the owning thread
+ * ever touches it, so it is a plain array. */
+typedef struct pa_flist_magazine {
+    pa_flist *flist;
+    unsigned n;
+    void *items[MAGAZINE_SIZE];
+} pa_flist_magazine;
+
 struct pa_flist {
     char *name;
     unsigned size;
 
+    /* Only set for flists created with pa_flist_new_with_cache() */
+    pa_tls *magazines;
+    pa_free_cb_t free_cb;
+
     pa_atomic_t current_tag;
     int index_mask;
     int tag_shift;
@@ -99,6 +117,73 @@ static void stack_push(pa_flist *flist, pa_atomic_t *list, pa_flist_elem *new_el
     } while (!pa_atomic_cmpxchg(list, next, newindex));
 }
 
+static int shared_push(pa_flist *l, void *p) {
+    pa_flist_elem *elem;
+
+    elem = stack_pop(l, &l->empty);
+    if (elem == NULL) {
+        if (pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("%s flist is full (don't worry)", l->name);
+        return -1;
+    }
+    pa_atomic_ptr_store(&elem->ptr, p);
+    stack_push(l, &l->stored, elem);
+
+    return 0;
+}
+
+static void* shared_pop(pa_flist *l) {
+    pa_flist_elem *elem;
+    void *ptr;
+
+    elem = stack_pop(l, &l->stored);
+    if (elem == NULL)
+        return NULL;
+
+    ptr = pa_atomic_ptr_load(&elem->ptr);
+
+    stack_push(l, &l->empty, elem);
+
+    return ptr;
+}
+
+/* Moves the topmost n entries of the cache to the shared stacks. What
+ * doesn't fit there any more is freed, just like the callers of
+ * pa_flist_push() do when it fails. */
+static void magazine_drain(pa_flist_magazine *m, unsigned n) {
+    pa_assert(n <= m->n);
+
+    for (; n > 0; n--) {
+        void *p = m->items[--m->n];
+
+        if (shared_push(m->flist, p) < 0)
+            m->flist->free_cb(p);
+    }
+}
+
+/* Called when a thread exits. This must not end up in pa_flist_push(),
+ * which would set up a new cache for the exiting thread. */
+static void magazine_free(void *userdata) {
+    pa_flist_magazine *m = userdata;
+
+    magazine_drain(m, m->n);
+    pa_xfree(m);
+}
+
+static pa_flist_magazine *magazine_get(pa_flist *l) {
+    pa_flist_magazine *m;
+
+    if ((m = pa_tls_get(l->magazines)))
+        return m;
+
+    m = pa_xnew(pa_flist_magazine, 1);
+    m->flist = l;
+    m->n = 0;
+    pa_tls_set(l->magazines, m);
+
+    return m;
+}
+
 pa_flist *pa_flist_new_with_name(unsigned size, const char *name) {
     pa_flist *l;
     unsigned i;
@@ -129,10 +214,40 @@ pa_flist *pa_flist_new(unsigned size) {
     return pa_flist_new_with_name(size, "unknown");
 }
 
+pa_flist *pa_flist_new_with_cache(unsigned size, const char *name, pa_free_cb_t free_cb) {
+    pa_flist *l;
+
+    pa_assert(free_cb);
+
+    l = pa_flist_new_with_name(size, name);
+    l->free_cb = free_cb;
+    l->magazines = pa_tls_new(magazine_free);
+
+    return l;
+}
+
 void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb) {
     pa_assert(l);
     pa_assert(l->name);
 
+    if (l->magazines) {
+        pa_flist_magazine *m;
+
+        /* The caches of threads that are still running are lost, as
+         * their destructors can't run any more once the key is gone */
+        if ((m = pa_tls_get(l->magazines))) {
+            pa_tls_set(l->magazines, NULL);
+
+            for (; m->n > 0; m->n--)
+                if (free_cb)
+                    free_cb(m->items[m->n - 1]);
+
+            pa_xfree(m);
+        }
+
+        pa_tls_free(l->magazines);
+    }
+
     if (free_cb) {
         pa_flist_elem *elem;
         while((elem = stack_pop(l, &l->stored)))
@@ -144,34 +259,51 @@ void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb) {
 }
 
 int pa_flist_push(pa_flist *l, void *p) {
-    pa_flist_elem *elem;
+    pa_flist_magazine *m;
+
     pa_assert(l);
     pa_assert(p);
 
-    elem = stack_pop(l, &l->empty);
-    if (elem == NULL) {
-        if (pa_log_ratelimit(PA_LOG_DEBUG))
-            pa_log_debug("%s flist is full (don't worry)", l->name);
-        return -1;
-    }
-    pa_atomic_ptr_store(&elem->ptr, p);
-    stack_push(l, &l->stored, elem);
+    if (!l->magazines)
+        return shared_push(l, p);
+
+    m = magazine_get(l);
+
+    if (m->n >= MAGAZINE_SIZE)
+        magazine_drain(m, MAGAZINE_BATCH);
+
+    m->items[m->n++] = p;
 
     return 0;
 }
 
 void* pa_flist_pop(pa_flist *l) {
-    pa_flist_elem *elem;
-    void *ptr;
+    pa_flist_magazine *m;
+    void *p;
+
     pa_assert(l);
 
-    elem = stack_pop(l, &l->stored);
-    if (elem == NULL)
+    if (!l->magazines)
+        return shared_pop(l);
+
+    m = magazine_get(l);
+
+    if (m->n > 0)
+        return m->items[--m->n];
+
+    /* Refill, so that the next few pops don't have to touch the shared
+     * stacks either */
+    if (!(p = shared_pop(l)))
         return NULL;
 
-    ptr = pa_atomic_ptr_load(&elem->ptr);
+    while (m->n < MAGAZINE_BATCH) {
+        void *q;
 
-    stack_push(l, &l->empty, elem);
+        if (!(q = shared_pop(l)))
+            break;
 
-    return ptr;
+        m->items[m->n++] = q;
+    }
+
+    return p;
 }
@@ -34,6 +34,14 @@ pa_flist * pa_flist_new(unsigned size);
 /* Name string is copied and added to flist structure. The original is
  * responsibility of the caller. The name is only used for debug printing. */
 pa_flist * pa_flist_new_with_name(unsigned size, const char *name);
+/* Like pa_flist_new_with_name(), but every thread pushes to and pops
+ * from a small cache of its own, which only goes to the shared list in
+ * batches when it runs full or empty. This takes the contention off the
+ * shared list when many threads use it, at the price of entries sitting
+ * in the caches of threads that don't need them. free_cb is used to free
+ * what doesn't fit into the shared list when a cache is drained, e.g. on
+ * thread exit. pa_flist_push() never fails on such a list. */
+pa_flist * pa_flist_new_with_cache(unsigned size, const char *name, pa_free_cb_t free_cb);
 void pa_flist_free(pa_flist *l, pa_free_cb_t free_cb);
 
 /* Please note that this routine might fail! */
@@ -50,7 +58,8 @@ void* pa_flist_pop(pa_flist*l);
     } name##_flist = { NULL, PA_ONCE_INIT };                            \
     static void name##_flist_init(void) {                               \
         name##_flist.flist =                                            \
-            pa_flist_new_with_name(size, __FILE__ ": " #name);          \
+            pa_flist_new_with_cache(size, __FILE__ ": " #name,          \
+                                    (free_cb));                         \
     }                                                                   \
     static inline pa_flist* name##_flist_get(void) {                    \
         pa_run_once(&name##_flist.once, name##_flist_init);             \
@@ -17,11 +17,17 @@
 
 #include <inttypes.h>
 
+/* The lookup tables take 24 KiB and are used by the mixing, volume and
+ * sample conversion loops, where the bit twiddling versions cost a
+ * branchy segment search per sample */
+#define FAST_ALAW_CONVERSION
+#define FAST_ULAW_CONVERSION
+
 #ifdef FAST_ALAW_CONVERSION
 extern uint8_t _st_13linear2alaw[0x2000];
 extern int16_t _st_alaw2linear16[256];
-#define st_13linear2alaw(sw) (_st_13linear2alaw[(sw + 0x1000)])
-#define st_alaw2linear16(uc) (_st_alaw2linear16[uc])
+#define st_13linear2alaw(sw) (_st_13linear2alaw[(sw) + 0x1000])
+#define st_alaw2linear16(uc) (_st_alaw2linear16[(uc)])
 #else
 unsigned char st_13linear2alaw(int16_t pcm_val);
 int16_t st_alaw2linear16(unsigned char);
@@ -30,8 +36,8 @@ int16_t st_alaw2linear16(unsigned char);
 #ifdef FAST_ULAW_CONVERSION
 extern uint8_t _st_14linear2ulaw[0x4000];
 extern int16_t _st_ulaw2linear16[256];
-#define st_14linear2ulaw(sw) (_st_14linear2ulaw[(sw + 0x2000)])
-#define st_ulaw2linear16(uc) (_st_ulaw2linear16[uc])
+#define st_14linear2ulaw(sw) (_st_14linear2ulaw[(sw) + 0x2000])
+#define st_ulaw2linear16(uc) (_st_ulaw2linear16[(uc)])
 #else
 unsigned char st_14linear2ulaw(int16_t pcm_val);
 int16_t st_ulaw2linear16(unsigned char);
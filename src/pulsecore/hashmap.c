@@ -22,22 +22,27 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <pulse/xmalloc.h>
 #include <pulsecore/idxset.h>
-#include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
 
 #include "hashmap.h"
 
-#define NBUCKETS 127
+/* Entries to allocate at first, there are always twice as many slots */
+#define INITIAL_ENTRIES 8
+
+/* An open addressing hash table with robin hood probing. The entries
+ * themselves live in an array in insertion order, which is what we
+ * iterate over. The slots only refer to the entries by index, so that
+ * probing touches a single small array. */
 
 struct hashmap_entry {
     void *key;
     void *value;
-
-    struct hashmap_entry *bucket_next, *bucket_previous;
-    struct hashmap_entry *iterate_next, *iterate_previous;
+    unsigned hash;
+    bool dead;
 };
 
 struct pa_hashmap {
@@ -47,18 +52,43 @@ struct pa_hashmap {
     pa_free_cb_t key_free_func;
     pa_free_cb_t value_free_func;
 
-    struct hashmap_entry *iterate_list_head, *iterate_list_tail;
-    unsigned n_entries;
+    /* Removed entries are only marked dead, so that indices, and with
+     * them iteration state, stay valid. They are squeezed out when the
+     * array is full. */
+    struct hashmap_entry *entries;
+    unsigned n_allocated, n_used, n_entries;
+
+    /* There is no live entry before this one */
+    unsigned first;
+
+    /* Index of the entry plus one, or 0 for an empty slot */
+    unsigned *slots;
+    unsigned slot_mask;
 };
 
-#define BY_HASH(h) ((struct hashmap_entry**) ((uint8_t*) (h) + PA_ALIGN(sizeof(pa_hashmap))))
+/* Many hash functions just return the pointer or a small integer, so
+ * mix the bits before using the low ones (this is murmur3's finalizer) */
+static inline unsigned mix_hash(unsigned hash) {
+    uint32_t h = (uint32_t) hash;
 
-PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/* How far the entry in slot i is away from where it would like to be */
+static inline unsigned probe_distance(pa_hashmap *h, unsigned i) {
+    return (i - h->entries[h->slots[i] - 1].hash) & h->slot_mask;
+}
 
 pa_hashmap *pa_hashmap_new_full(pa_hash_func_t hash_func, pa_compare_func_t compare_func, pa_free_cb_t key_free_func, pa_free_cb_t value_free_func) {
     pa_hashmap *h;
 
-    h = pa_xmalloc0(PA_ALIGN(sizeof(pa_hashmap)) + NBUCKETS*sizeof(struct hashmap_entry*));
+    h = pa_xnew0(pa_hashmap, 1);
 
     h->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     h->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
@@ -66,8 +96,8 @@ pa_hashmap *pa_hashmap_new_full(pa_hash_func_t hash_func, pa_compare_func_t comp
     h->key_free_func = key_free_func;
     h->value_free_func = value_free_func;
 
-    h->n_entries = 0;
-    h->iterate_list_head = h->iterate_list_tail = NULL;
+    /* The arrays are only allocated with the first entry, a lot of
+     * hashmaps never see one */
 
     return h;
 }
@@ -76,97 +106,181 @@ pa_hashmap *pa_hashmap_new(pa_hash_func_t hash_func, pa_compare_func_t compare_f
     return pa_hashmap_new_full(hash_func, compare_func, NULL, NULL);
 }
 
-static void remove_entry(pa_hashmap *h, struct hashmap_entry *e) {
-    pa_assert(h);
-    pa_assert(e);
-
-    /* Remove from iteration list */
-    if (e->iterate_next)
-        e->iterate_next->iterate_previous = e->iterate_previous;
-    else
-        h->iterate_list_tail = e->iterate_previous;
-
-    if (e->iterate_previous)
-        e->iterate_previous->iterate_next = e->iterate_next;
-    else
-        h->iterate_list_head = e->iterate_next;
-
-    /* Remove from hash table bucket list */
-    if (e->bucket_next)
-        e->bucket_next->bucket_previous = e->bucket_previous;
-
-    if (e->bucket_previous)
-        e->bucket_previous->bucket_next = e->bucket_next;
-    else {
-        unsigned hash = h->hash_func(e->key) % NBUCKETS;
-        BY_HASH(h)[hash] = e->bucket_next;
+static void slot_insert(pa_hashmap *h, unsigned idx) {
+    unsigned i, d, s;
+
+    s = idx + 1;
+
+    for (i = h->entries[idx].hash & h->slot_mask, d = 0;; i = (i + 1) & h->slot_mask, d++) {
+        unsigned d2;
+
+        if (!h->slots[i]) {
+            h->slots[i] = s;
+            return;
+        }
+
+        /* Take the slot from entries that are closer to home than we
+         * are, and carry on with them instead */
+        if ((d2 = probe_distance(h, i)) < d) {
+            unsigned t = h->slots[i];
+
+            h->slots[i] = s;
+            s = t;
+            d = d2;
+        }
+    }
+}
+
+static void slot_remove(pa_hashmap *h, unsigned i) {
+
+    /* Shift the following entries back, so that no tombstones are
+     * needed in the slots */
+    for (;;) {
+        unsigned j = (i + 1) & h->slot_mask;
+
+        if (!h->slots[j] || probe_distance(h, j) == 0) {
+            h->slots[i] = 0;
+            return;
+        }
+
+        h->slots[i] = h->slots[j];
+        i = j;
+    }
+}
+
+static bool find_slot(pa_hashmap *h, unsigned hash, const void *key, unsigned *slot) {
+    unsigned i, d;
+
+    if (h->n_entries == 0)
+        return false;
+
+    for (i = hash & h->slot_mask, d = 0;; i = (i + 1) & h->slot_mask, d++) {
+        struct hashmap_entry *e;
+
+        if (!h->slots[i])
+            return false;
+
+        /* If the key were here, it would have taken this slot */
+        if (probe_distance(h, i) < d)
+            return false;
+
+        e = &h->entries[h->slots[i] - 1];
+
+        if (e->hash == hash && h->compare_func(e->key, key) == 0) {
+            *slot = i;
+            return true;
+        }
+    }
+}
+
+static unsigned find_slot_of_entry(pa_hashmap *h, unsigned idx) {
+    unsigned i;
+
+    for (i = h->entries[idx].hash & h->slot_mask; h->slots[i] != idx + 1; i = (i + 1) & h->slot_mask)
+        pa_assert(h->slots[i]);
+
+    return i;
+}
+
+/* Squeezes out the dead entries and resizes the arrays. This moves
+ * entries, so it must not happen during iteration, i.e. only on
+ * pa_hashmap_put(). */
+static void rebuild(pa_hashmap *h, unsigned n_allocated) {
+    unsigned i, j;
+
+    pa_assert(n_allocated >= h->n_entries);
+
+    for (i = 0, j = 0; i < h->n_used; i++)
+        if (!h->entries[i].dead)
+            h->entries[j++] = h->entries[i];
+
+    pa_assert(j == h->n_entries);
+    h->n_used = j;
+    h->first = 0;
+
+    if (n_allocated != h->n_allocated) {
+        h->entries = pa_xrenew(struct hashmap_entry, h->entries, n_allocated);
+        h->n_allocated = n_allocated;
+
+        pa_xfree(h->slots);
+        h->slots = pa_xnew(unsigned, 2 * n_allocated);
+        h->slot_mask = 2 * n_allocated - 1;
     }
 
+    memset(h->slots, 0, sizeof(unsigned) * (h->slot_mask + 1));
+
+    for (i = 0; i < h->n_used; i++)
+        slot_insert(h, i);
+}
+
+static void remove_entry(pa_hashmap *h, unsigned slot) {
+    struct hashmap_entry *e;
+    unsigned idx;
+
+    pa_assert(h);
+
+    idx = h->slots[slot] - 1;
+    e = &h->entries[idx];
+
+    slot_remove(h, slot);
+    e->dead = true;
+
     if (h->key_free_func)
         h->key_free_func(e->key);
 
-    if (pa_flist_push(PA_STATIC_FLIST_GET(entries), e) < 0)
-        pa_xfree(e);
-
     pa_assert(h->n_entries >= 1);
     h->n_entries--;
+
+    /* Dead entries at either end can be skipped right away */
+    while (h->n_used > 0 && h->entries[h->n_used - 1].dead)
+        h->n_used--;
+
+    if (idx == h->first)
+        while (h->first < h->n_used && h->entries[h->first].dead)
+            h->first++;
+
+    if (h->first > h->n_used)
+        h->first = h->n_used;
 }
 
 void pa_hashmap_free(pa_hashmap *h) {
     pa_assert(h);
 
     pa_hashmap_remove_all(h);
+    pa_xfree(h->entries);
+    pa_xfree(h->slots);
     pa_xfree(h);
 }
 
-static struct hashmap_entry *hash_scan(pa_hashmap *h, unsigned hash, const void *key) {
-    struct hashmap_entry *e;
-    pa_assert(h);
-    pa_assert(hash < NBUCKETS);
-
-    for (e = BY_HASH(h)[hash]; e; e = e->bucket_next)
-        if (h->compare_func(e->key, key) == 0)
-            return e;
-
-    return NULL;
-}
-
 int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
     struct hashmap_entry *e;
-    unsigned hash;
+    unsigned hash, slot;
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = mix_hash(h->hash_func(key));
 
-    if (hash_scan(h, hash, key))
+    if (find_slot(h, hash, key, &slot))
         return -1;
 
-    if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(entries))))
-        e = pa_xnew(struct hashmap_entry, 1);
+    if (h->n_used >= h->n_allocated) {
+        /* Only grow if squeezing out the dead entries wouldn't leave
+         * enough room */
+        if (h->n_entries > h->n_allocated / 2 || h->n_allocated == 0)
+            rebuild(h, h->n_allocated > 0 ? h->n_allocated * 2 : INITIAL_ENTRIES);
+        else
+            rebuild(h, h->n_allocated);
+    }
 
+    e = &h->entries[h->n_used];
     e->key = key;
     e->value = value;
+    e->hash = hash;
+    e->dead = false;
 
-    /* Insert into hash table */
-    e->bucket_next = BY_HASH(h)[hash];
-    e->bucket_previous = NULL;
-    if (BY_HASH(h)[hash])
-        BY_HASH(h)[hash]->bucket_previous = e;
-    BY_HASH(h)[hash] = e;
-
-    /* Insert into iteration list */
-    e->iterate_previous = h->iterate_list_tail;
-    e->iterate_next = NULL;
-    if (h->iterate_list_tail) {
-        pa_assert(h->iterate_list_head);
-        h->iterate_list_tail->iterate_next = e;
-    } else {
-        pa_assert(!h->iterate_list_head);
-        h->iterate_list_head = e;
-    }
-    h->iterate_list_tail = e;
+    slot_insert(h, h->n_used);
 
+    h->n_used++;
     h->n_entries++;
     pa_assert(h->n_entries >= 1);
 
@@ -174,33 +288,27 @@ int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
 }
 
 void* pa_hashmap_get(pa_hashmap *h, const void *key) {
-    unsigned hash;
-    struct hashmap_entry *e;
+    unsigned slot;
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
-
-    if (!(e = hash_scan(h, hash, key)))
+    if (!find_slot(h, mix_hash(h->hash_func(key)), key, &slot))
         return NULL;
 
-    return e->value;
+    return h->entries[h->slots[slot] - 1].value;
 }
 
 void* pa_hashmap_remove(pa_hashmap *h, const void *key) {
-    struct hashmap_entry *e;
-    unsigned hash;
+    unsigned slot;
     void *data;
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
-
-    if (!(e = hash_scan(h, hash, key)))
+    if (!find_slot(h, mix_hash(h->hash_func(key)), key, &slot))
         return NULL;
 
-    data = e->value;
-    remove_entry(h, e);
+    data = h->entries[h->slots[slot] - 1].value;
+    remove_entry(h, slot);
 
     return data;
 }
@@ -221,18 +329,22 @@ int pa_hashmap_remove_and_free(pa_hashmap *h, const void *key) {
 void pa_hashmap_remove_all(pa_hashmap *h) {
     pa_assert(h);
 
-    while (h->iterate_list_head) {
+    while (h->n_entries > 0) {
         void *data;
-        data = h->iterate_list_head->value;
-        remove_entry(h, h->iterate_list_head);
+
+        data = h->entries[h->first].value;
+        remove_entry(h, find_slot_of_entry(h, h->first));
 
         if (h->value_free_func)
             h->value_free_func(data);
     }
 }
 
+/* The iteration state is the index of the next entry to look at plus
+ * one, or -1 at the end */
 void *pa_hashmap_iterate(pa_hashmap *h, void **state, const void **key) {
     struct hashmap_entry *e;
+    unsigned idx;
 
     pa_assert(h);
     pa_assert(state);
@@ -240,15 +352,16 @@ void *pa_hashmap_iterate(pa_hashmap *h, void **state, const void **key) {
     if (*state == (void*) -1)
         goto at_end;
 
-    if (!*state && !h->iterate_list_head)
-        goto at_end;
+    idx = *state ? PA_PTR_TO_UINT(*state) - 1 : h->first;
 
-    e = *state ? *state : h->iterate_list_head;
+    while (idx < h->n_used && h->entries[idx].dead)
+        idx++;
 
-    if (e->iterate_next)
-        *state = e->iterate_next;
-    else
-        *state = (void*) -1;
+    if (idx >= h->n_used)
+        goto at_end;
+
+    e = &h->entries[idx];
+    *state = PA_UINT_TO_PTR(idx + 2);
 
     if (key)
         *key = e->key;
@@ -264,8 +377,11 @@ at_end:
     return NULL;
 }
 
+/* Here the state is the index of the last entry returned, or -1 at the
+ * beginning */
 void *pa_hashmap_iterate_backwards(pa_hashmap *h, void **state, const void **key) {
     struct hashmap_entry *e;
+    unsigned idx;
 
     pa_assert(h);
     pa_assert(state);
@@ -273,15 +389,17 @@ void *pa_hashmap_iterate_backwards(pa_hashmap *h, void **state, const void **key
     if (*state == (void*) -1)
         goto at_beginning;
 
-    if (!*state && !h->iterate_list_tail)
-        goto at_beginning;
+    idx = *state ? PA_MIN(PA_PTR_TO_UINT(*state), h->n_used) : h->n_used;
 
-    e = *state ? *state : h->iterate_list_tail;
+    while (idx > 0 && h->entries[idx - 1].dead)
+        idx--;
+
+    if (idx == 0)
+        goto at_beginning;
 
-    if (e->iterate_previous)
-        *state = e->iterate_previous;
-    else
-        *state = (void*) -1;
+    idx--;
+    e = &h->entries[idx];
+    *state = idx > 0 ? PA_UINT_TO_PTR(idx) : (void*) -1;
 
     if (key)
         *key = e->key;
@@ -300,19 +418,19 @@ at_beginning:
 void* pa_hashmap_first(pa_hashmap *h) {
     pa_assert(h);
 
-    if (!h->iterate_list_head)
+    if (h->n_entries == 0)
         return NULL;
 
-    return h->iterate_list_head->value;
+    return h->entries[h->first].value;
 }
 
 void* pa_hashmap_last(pa_hashmap *h) {
     pa_assert(h);
 
-    if (!h->iterate_list_tail)
+    if (h->n_entries == 0)
         return NULL;
 
-    return h->iterate_list_tail->value;
+    return h->entries[h->n_used - 1].value;
 }
 
 void* pa_hashmap_steal_first(pa_hashmap *h) {
@@ -320,11 +438,11 @@ void* pa_hashmap_steal_first(pa_hashmap *h) {
 
     pa_assert(h);
 
-    if (!h->iterate_list_head)
+    if (h->n_entries == 0)
         return NULL;
 
-    data = h->iterate_list_head->value;
-    remove_entry(h, h->iterate_list_head);
+    data = h->entries[h->first].value;
+    remove_entry(h, find_slot_of_entry(h, h->first));
 
     return data;
 }
@@ -32,6 +32,9 @@ void pa_hook_init(pa_hook *hook, void *data) {
 
     PA_LLIST_HEAD_INIT(pa_hook_slot, hook->slots);
     hook->n_dead = hook->n_firing = 0;
+    hook->dispatch = NULL;
+    hook->n_dispatch = hook->n_dispatch_allocated = 0;
+    hook->dispatch_valid = false;
     hook->data = data;
 }
 
@@ -40,6 +43,7 @@ static void slot_free(pa_hook *hook, pa_hook_slot *slot) {
     pa_assert(slot);
 
     PA_LLIST_REMOVE(pa_hook_slot, hook->slots, slot);
+    hook->dispatch_valid = false;
 
     pa_xfree(slot);
 }
@@ -51,6 +55,8 @@ void pa_hook_done(pa_hook *hook) {
     while (hook->slots)
         slot_free(hook, hook->slots);
 
+    pa_xfree(hook->dispatch);
+
     pa_hook_init(hook, NULL);
 }
 
@@ -74,6 +80,7 @@ pa_hook_slot* pa_hook_connect(pa_hook *hook, pa_hook_priority_t prio, pa_hook_cb
     }
 
     PA_LLIST_INSERT_AFTER(pa_hook_slot, hook->slots, prev, slot);
+    hook->dispatch_valid = false;
 
     return slot;
 }
@@ -89,25 +96,79 @@ void pa_hook_slot_free(pa_hook_slot *slot) {
         slot_free(slot->hook, slot);
 }
 
+static void rebuild_dispatch(pa_hook *hook) {
+    pa_hook_slot *slot;
+    unsigned n = 0;
+
+    pa_assert(hook->n_firing == 0);
+    pa_assert(hook->n_dead == 0);
+
+    PA_LLIST_FOREACH(slot, hook->slots)
+        n++;
+
+    if (n > hook->n_dispatch_allocated) {
+        pa_xfree(hook->dispatch);
+        hook->n_dispatch_allocated = PA_MAX(n, 2 * hook->n_dispatch_allocated);
+        hook->dispatch = pa_xnew(pa_hook_slot*, hook->n_dispatch_allocated);
+    }
+
+    n = 0;
+    PA_LLIST_FOREACH(slot, hook->slots)
+        hook->dispatch[n++] = slot;
+
+    hook->n_dispatch = n;
+    hook->dispatch_valid = true;
+}
+
 pa_hook_result_t pa_hook_fire(pa_hook *hook, void *data) {
     pa_hook_slot *slot, *next;
     pa_hook_result_t result = PA_HOOK_OK;
 
     pa_assert(hook);
 
+    if (!hook->slots)
+        return PA_HOOK_OK;
+
+    if (!hook->dispatch_valid && hook->n_firing == 0)
+        rebuild_dispatch(hook);
+
     hook->n_firing ++;
 
-    PA_LLIST_FOREACH(slot, hook->slots) {
-        if (slot->dead)
-            continue;
+    if (hook->dispatch_valid) {
+        unsigned i;
 
-        if ((result = slot->callback(hook->data, data, slot->data)) != PA_HOOK_OK)
-            break;
+        /* Slots freed meanwhile are only marked dead and slots connected
+         * meanwhile are only seen by later firings, so the array stays
+         * as it is until we're done */
+        for (i = 0; i < hook->n_dispatch; i++) {
+            slot = hook->dispatch[i];
+
+            if (slot->dead)
+                continue;
+
+            if ((result = slot->callback(hook->data, data, slot->data)) != PA_HOOK_OK)
+                break;
+        }
+    } else {
+
+        /* A callback of an outer firing changed the slots, and the outer
+         * firing still walks the array, so walk the list instead */
+        PA_LLIST_FOREACH(slot, hook->slots) {
+            if (slot->dead)
+                continue;
+
+            if ((result = slot->callback(hook->data, data, slot->data)) != PA_HOOK_OK)
+                break;
+        }
     }
 
     hook->n_firing --;
     pa_assert(hook->n_firing >= 0);
 
+    /* Outer firings might still be looking at the dead slots */
+    if (hook->n_firing > 0)
+        return result;
+
     for (slot = hook->slots; hook->n_dead > 0 && slot; slot = next) {
         next = slot->next;
 
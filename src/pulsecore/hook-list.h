@@ -55,6 +55,13 @@ struct pa_hook {
     PA_LLIST_HEAD(pa_hook_slot, slots);
     int n_firing, n_dead;
 
+    /* The live slots in order of priority, which is what we walk when
+     * firing. Rebuilt on the next firing after slots were connected or
+     * freed, but never while the hook is firing. */
+    pa_hook_slot **dispatch;
+    unsigned n_dispatch, n_dispatch_allocated;
+    bool dispatch_valid;
+
     void *data;
 };
 
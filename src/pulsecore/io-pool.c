@@ -0,0 +1,330 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+#include "io-pool.h"
+
+typedef struct io_worker {
+    pa_msgobject parent;
+
+    pa_io_pool *pool;
+    unsigned index;
+    int cpu;
+
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+
+    /* Main thread */
+    pa_idxset *tasks;
+    bool failed;
+
+    /* IO thread */
+    PA_LLIST_HEAD(pa_io_task, thread_tasks);
+} io_worker;
+
+PA_DEFINE_PRIVATE_CLASS(io_worker, pa_msgobject);
+#define IO_WORKER(o) (io_worker_cast(o))
+
+enum {
+    IO_WORKER_MESSAGE_ADD_TASK,
+    IO_WORKER_MESSAGE_REMOVE_TASK,
+    IO_WORKER_MESSAGE_FAILED,
+    IO_WORKER_MESSAGE_MAX
+};
+
+struct pa_io_task {
+    io_worker *worker;
+    pa_module *module;
+
+    pa_io_task_cb_t cb;
+    void *userdata;
+
+    PA_LLIST_FIELDS(pa_io_task);
+};
+
+struct pa_io_pool {
+    pa_core *core;
+
+    io_worker **workers;
+    unsigned n_workers;
+};
+
+/* Called from IO context, except for IO_WORKER_MESSAGE_FAILED */
+static int worker_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    io_worker *w = IO_WORKER(o);
+    pa_io_task *t = data;
+
+    io_worker_assert_ref(w);
+
+    switch (code) {
+
+        case IO_WORKER_MESSAGE_ADD_TASK:
+            PA_LLIST_PREPEND(pa_io_task, w->thread_tasks, t);
+            return 0;
+
+        case IO_WORKER_MESSAGE_REMOVE_TASK:
+            PA_LLIST_REMOVE(pa_io_task, w->thread_tasks, t);
+            return 0;
+
+        case IO_WORKER_MESSAGE_FAILED: {
+            uint32_t idx;
+
+            /* We don't unload directly, since unloading one module may
+             * take others with it */
+            w->failed = true;
+
+            PA_IDXSET_FOREACH(t, w->tasks, idx)
+                pa_module_unload_request(t->module, true);
+
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static void worker_free(pa_object *o) {
+    io_worker *w = IO_WORKER(o);
+
+    pa_assert(pa_idxset_isempty(w->tasks));
+    pa_idxset_free(w->tasks, NULL);
+
+    pa_xfree(w);
+}
+
+static void set_affinity(io_worker *w) {
+    if (w->cpu < 0)
+        return;
+
+    if (pa_set_thread_cpus(&w->cpu, 1) < 0)
+        pa_log_warn("Failed to pin IO worker %u to CPU %i: %s", w->index, w->cpu, pa_cstrerror(errno));
+}
+
+static void thread_func(void *userdata) {
+    io_worker *w = userdata;
+
+    pa_assert(w);
+
+    pa_log_debug("IO worker %u starting up", w->index);
+
+    set_affinity(w);
+
+    if (w->pool->core->realtime_scheduling)
+        pa_make_realtime(w->pool->core->realtime_priority);
+
+    pa_thread_mq_install(&w->thread_mq);
+
+    for (;;) {
+        pa_usec_t next = 0;
+        pa_io_task *t;
+        int ret;
+
+        /* Every task gets to run on every iteration, just like the body
+         * of its own loop would, so that it notices rewind requests and
+         * state changes right away */
+        PA_LLIST_FOREACH(t, w->thread_tasks) {
+            pa_usec_t n;
+
+            if ((n = t->cb(t, t->userdata)) > 0 && (next <= 0 || n < next))
+                next = n;
+        }
+
+        if (next > 0)
+            pa_rtpoll_set_timer_absolute(w->rtpoll, next);
+        else
+            pa_rtpoll_set_timer_disabled(w->rtpoll);
+
+        if ((ret = pa_rtpoll_run(w->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+    }
+
+fail:
+    /* If this was no regular exit from the loop we have to continue
+     * processing messages until we received PA_MESSAGE_SHUTDOWN */
+    pa_asyncmsgq_post(w->thread_mq.outq, PA_MSGOBJECT(w), IO_WORKER_MESSAGE_FAILED, NULL, 0, NULL, NULL);
+    pa_asyncmsgq_wait_for(w->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+
+finish:
+    pa_log_debug("IO worker %u shutting down", w->index);
+}
+
+pa_io_pool *pa_io_pool_new(pa_core *core, unsigned n_threads, const char *cpus) {
+    pa_io_pool *p;
+    int *cpu_list = NULL;
+    unsigned n_cpus = 0, i;
+
+    pa_assert(core);
+    pa_assert(n_threads > 0);
+
+    if (cpus && pa_parse_cpu_list(cpus, &cpu_list, &n_cpus) < 0)
+        return NULL;
+
+#ifndef HAVE_PTHREAD_SETAFFINITY_NP
+    if (n_cpus > 0)
+        pa_log_warn("Pinning threads to CPUs is not supported on this platform.");
+#endif
+
+    p = pa_xnew0(pa_io_pool, 1);
+    p->core = core;
+    p->workers = pa_xnew0(io_worker*, n_threads);
+
+    for (i = 0; i < n_threads; i++) {
+        io_worker *w;
+        char name[16];
+
+        w = pa_msgobject_new(io_worker);
+        w->parent.parent.free = worker_free;
+        w->parent.process_msg = worker_process_msg;
+        w->pool = p;
+        w->index = i;
+        w->cpu = n_cpus > 0 ? cpu_list[i % n_cpus] : -1;
+        w->tasks = pa_idxset_new(NULL, NULL);
+        PA_LLIST_HEAD_INIT(pa_io_task, w->thread_tasks);
+
+        p->workers[p->n_workers++] = w;
+
+        w->rtpoll = pa_rtpoll_new();
+
+        if (pa_thread_mq_init(&w->thread_mq, core->mainloop, w->rtpoll) < 0) {
+            pa_log("pa_thread_mq_init() failed.");
+            goto fail;
+        }
+
+        pa_snprintf(name, sizeof(name), "io-worker-%u", i);
+
+        if (!(w->thread = pa_thread_new(name, thread_func, w))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
+    }
+
+    pa_xfree(cpu_list);
+
+    pa_log_info("Started %u shared IO threads.", n_threads);
+
+    return p;
+
+fail:
+    pa_xfree(cpu_list);
+    pa_io_pool_free(p);
+
+    return NULL;
+}
+
+void pa_io_pool_free(pa_io_pool *p) {
+    unsigned i;
+
+    pa_assert(p);
+
+    for (i = 0; i < p->n_workers; i++) {
+        io_worker *w = p->workers[i];
+
+        if (w->thread) {
+            pa_asyncmsgq_send(w->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+            pa_thread_free(w->thread);
+        }
+
+        pa_thread_mq_done(&w->thread_mq);
+
+        if (w->rtpoll)
+            pa_rtpoll_free(w->rtpoll);
+
+        io_worker_unref(w);
+    }
+
+    pa_xfree(p->workers);
+    pa_xfree(p);
+}
+
+pa_io_task *pa_io_task_new(pa_io_pool *p, pa_module *m, pa_io_task_cb_t cb, void *userdata) {
+    io_worker *w = NULL;
+    pa_io_task *t;
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(m);
+    pa_assert(cb);
+
+    for (i = 0; i < p->n_workers; i++) {
+        if (p->workers[i]->failed)
+            continue;
+
+        if (!w || pa_idxset_size(p->workers[i]->tasks) < pa_idxset_size(w->tasks))
+            w = p->workers[i];
+    }
+
+    if (!w) {
+        pa_log_warn("No IO worker available.");
+        return NULL;
+    }
+
+    t = pa_xnew0(pa_io_task, 1);
+    t->worker = w;
+    t->module = m;
+    t->cb = cb;
+    t->userdata = userdata;
+
+    pa_idxset_put(w->tasks, t, NULL);
+    pa_assert_se(pa_asyncmsgq_send(w->thread_mq.inq, PA_MSGOBJECT(w), IO_WORKER_MESSAGE_ADD_TASK, t, 0, NULL) == 0);
+
+    pa_log_debug("Scheduled IO task for module %s on IO worker %u.", m->name, w->index);
+
+    return t;
+}
+
+void pa_io_task_free(pa_io_task *t) {
+    pa_assert(t);
+
+    pa_assert_se(pa_asyncmsgq_send(t->worker->thread_mq.inq, PA_MSGOBJECT(t->worker), IO_WORKER_MESSAGE_REMOVE_TASK, t, 0, NULL) == 0);
+    pa_assert_se(pa_idxset_remove_by_data(t->worker->tasks, t, NULL));
+
+    pa_xfree(t);
+}
+
+pa_asyncmsgq *pa_io_task_get_asyncmsgq(pa_io_task *t) {
+    pa_assert(t);
+
+    return t->worker->thread_mq.inq;
+}
+
+pa_rtpoll *pa_io_task_get_rtpoll(pa_io_task *t) {
+    pa_assert(t);
+
+    return t->worker->rtpoll;
+}
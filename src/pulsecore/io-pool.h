@@ -0,0 +1,61 @@
+#ifndef foopulseiopoolhfoo
+#define foopulseiopoolhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/typedefs.h>
+#include <pulsecore/module.h>
+#include <pulsecore/asyncmsgq.h>
+#include <pulsecore/rtpoll.h>
+
+/* A bounded set of IO threads that sinks and sources can share instead
+ * of each running a thread of its own. Every thread has one rtpoll and
+ * one pa_thread_mq, which are shared by all the tasks scheduled on
+ * it. Filter sinks and sources attached to a master run in the
+ * master's IO thread anyway, so a master and everything stacked on top
+ * of it always stay on the same worker.
+ *
+ * Opt-in via the io-threads setting in daemon.conf. */
+
+typedef struct pa_io_task pa_io_task;
+
+/* Called from the worker thread on each iteration of its loop, i.e.
+ * whenever it woke up because of a timer, a message or some other
+ * event on the rtpoll. This takes the place of the body of the loop in
+ * a thread_func(). Returns the absolute time when the task wants to be
+ * called again, or 0 if it doesn't need a timer. */
+typedef pa_usec_t (*pa_io_task_cb_t)(pa_io_task *t, void *userdata);
+
+/* cpus is an optional comma separated list of CPU numbers the worker
+ * threads are pinned to, in order. If there are more threads than CPUs
+ * the list is reused from the start. */
+pa_io_pool *pa_io_pool_new(pa_core *core, unsigned n_threads, const char *cpus);
+void pa_io_pool_free(pa_io_pool *p);
+
+/* Schedule a new task on the least busy worker. The task shall pass the
+ * asyncmsgq and rtpoll returned below to its sink or source. The
+ * module is unloaded if the worker thread fails. */
+pa_io_task *pa_io_task_new(pa_io_pool *p, pa_module *m, pa_io_task_cb_t cb, void *userdata);
+void pa_io_task_free(pa_io_task *t);
+
+pa_asyncmsgq *pa_io_task_get_asyncmsgq(pa_io_task *t);
+pa_rtpoll *pa_io_task_get_rtpoll(pa_io_task *t);
+
+#endif
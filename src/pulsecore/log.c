@@ -67,6 +67,11 @@
 #include <pulsecore/ratelimit.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/i18n.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/semaphore.h>
+#include <pulsecore/ringbuffer.h>
 
 #include "log.h"
 
@@ -83,6 +88,10 @@
 #define ENV_LOG_NO_RATELIMIT "PULSE_LOG_NO_RATE_LIMIT"
 #define LOG_MAX_SUFFIX_NUMBER 99
 
+/* Records a ring holds, and how much of a message fits into one */
+#define LOG_RING_RECORDS 64
+#define LOG_RECORD_TEXT_MAX 1024
+
 static char *ident = NULL; /* in local charset format */
 static pa_log_target target = { PA_LOG_STDERR, NULL };
 static pa_log_target_type_t target_override;
@@ -94,6 +103,48 @@ static bool no_rate_limit = false;
 static int log_fd = -1;
 static int write_type = 0;
 
+/* Start out verbose, so that the first message gets to call
+ * init_defaults(), which narrows this down */
+pa_log_level_t pa_log_level_cutoff = PA_LOG_LEVEL_MAX-1;
+
+/* A message as passed from a thread's ring to the drain thread. The
+ * strings are copied, since the code that logged them may be gone
+ * (e.g. an unloaded module) by the time they are written out. */
+struct log_record {
+    pa_log_level_t level;
+    int line;
+    pa_usec_t time;
+    char file[128];
+    char func[64];
+    char text[LOG_RECORD_TEXT_MAX];
+};
+
+struct log_ring {
+    pa_ringbuffer *ringbuffer;
+    char thread_name[32];
+
+    /* Records that didn't fit into the ring */
+    pa_atomic_t dropped;
+
+    /* Set when the thread is gone, the drain thread frees the ring
+     * once it is empty */
+    pa_atomic_t dead;
+
+    PA_LLIST_FIELDS(struct log_ring);
+};
+
+static void ring_release(void *p);
+
+PA_STATIC_TLS_DECLARE(log_ring, ring_release);
+
+/* Protects the list of rings and the drain thread */
+static pa_static_mutex rings_mutex = PA_STATIC_MUTEX_INIT;
+static pa_static_semaphore drain_semaphore = PA_STATIC_SEMAPHORE_INIT;
+static PA_LLIST_HEAD(struct log_ring, rings) = NULL;
+static pa_thread *drain_thread = NULL;
+static pid_t drain_pid = 0;
+static pa_atomic_t drain_quit = PA_ATOMIC_INIT(0);
+
 #ifdef HAVE_SYSLOG_H
 static const int level_to_syslog[] = {
     [PA_LOG_ERROR] = LOG_ERR,
@@ -140,10 +191,21 @@ static void ident_destructor(void) {
     pa_xfree(ident);
 }
 
+static void init_defaults(void);
+
+static void update_cutoff(void) {
+    pa_log_level_cutoff = PA_MAX(maximum_level, maximum_level_override);
+}
+
 void pa_log_set_level(pa_log_level_t l) {
     pa_assert(l < PA_LOG_LEVEL_MAX);
 
+    /* Make sure the environment gets looked at before messages start
+     * being filtered in the header */
+    init_defaults();
+
     maximum_level = l;
+    update_cutoff();
 }
 
 int pa_log_set_target(pa_log_target *t) {
@@ -351,6 +413,8 @@ static void init_defaults(void) {
         if (getenv(ENV_LOG_NO_RATELIMIT))
             no_rate_limit = true;
 
+        update_cutoff();
+
     } PA_ONCE_END;
 }
 
@@ -368,49 +432,35 @@ static void log_syslog(pa_log_level_t level, char *t, char *timestamp, char *loc
 }
 #endif
 
-void pa_log_levelv_meta(
+/* Writes out a message that has already been formatted. Called from
+ * the logging thread itself, or from the drain thread for messages
+ * that went through a ring. */
+static void log_emit(
         pa_log_level_t level,
-        const char*file,
+        const char *file,
         int line,
         const char *func,
-        const char *format,
-        va_list ap) {
+        const char *thread_name,
+        pa_usec_t time,
+        char *text,
+        char *bt) {
 
     char *t, *n;
     int saved_errno = errno;
-    char *bt = NULL;
     pa_log_target_type_t _target;
-    pa_log_level_t _maximum_level;
-    unsigned _show_backtrace;
     pa_log_flags_t _flags;
 
-    /* We don't use dynamic memory allocation here to minimize the hit
-     * in RT threads */
-    char text[16*1024], location[128], timestamp[32];
-
-    pa_assert(level < PA_LOG_LEVEL_MAX);
-    pa_assert(format);
-
-    init_defaults();
+    char location[128], timestamp[32];
 
     _target = target_override_set ? target_override : target.type;
-    _maximum_level = PA_MAX(maximum_level, maximum_level_override);
-    _show_backtrace = PA_MAX(show_backtrace, show_backtrace_override);
     _flags = flags | flags_override;
 
-    if (PA_LIKELY(level > _maximum_level)) {
-        errno = saved_errno;
-        return;
-    }
-
-    pa_vsnprintf(text, sizeof(text), format, ap);
-
     if ((_flags & PA_LOG_PRINT_META) && file && line > 0 && func)
         pa_snprintf(location, sizeof(location), "[%s][%s:%i %s()] ",
-                    pa_strnull(pa_thread_get_name(pa_thread_self())), file, line, func);
+                    pa_strnull(thread_name), file, line, func);
     else if ((_flags & (PA_LOG_PRINT_META|PA_LOG_PRINT_FILE)) && file)
         pa_snprintf(location, sizeof(location), "[%s] %s: ",
-                    pa_strnull(pa_thread_get_name(pa_thread_self())), pa_path_get_filename(file));
+                    pa_strnull(thread_name), pa_path_get_filename(file));
     else
         location[0] = 0;
 
@@ -418,15 +468,17 @@ void pa_log_levelv_meta(
         static pa_usec_t start, last;
         pa_usec_t u, a, r;
 
-        u = pa_rtclock_now();
+        u = time;
 
         PA_ONCE_BEGIN {
             start = u;
             last = u;
         } PA_ONCE_END;
 
-        r = u - last;
-        a = u - start;
+        /* Messages from a ring may be written out after later ones
+         * that were logged directly */
+        r = u > last ? u - last : 0;
+        a = u > start ? u - start : 0;
 
         /* This is not thread safe, but this is a debugging tool only
          * anyway. */
@@ -441,11 +493,6 @@ void pa_log_levelv_meta(
     } else
         timestamp[0] = 0;
 
-#ifdef HAVE_EXECINFO_H
-    if (_show_backtrace > 0)
-        bt = get_backtrace(_show_backtrace);
-#endif
-
     if (!pa_utf8_valid(text))
         pa_logl(level, "Invalid UTF-8 string following below:");
 
@@ -569,6 +616,212 @@ void pa_log_levelv_meta(
         }
     }
 
+    errno = saved_errno;
+}
+
+/* Called from the drain thread, with rings_mutex held */
+static void ring_drain(struct log_ring *ring) {
+    struct log_record *r;
+    int count, dropped;
+
+    while ((r = pa_ringbuffer_peek(ring->ringbuffer, &count)) && count > 0) {
+        for (; count >= (int) sizeof(struct log_record); count -= (int) sizeof(struct log_record), r++) {
+            log_emit(r->level, r->file[0] ? r->file : NULL, r->line, r->func[0] ? r->func : NULL,
+                     ring->thread_name, r->time, r->text, NULL);
+            pa_ringbuffer_drop(ring->ringbuffer, (int) sizeof(struct log_record));
+        }
+
+        pa_ringbuffer_commit_read(ring->ringbuffer);
+    }
+
+    if ((dropped = pa_atomic_load(&ring->dropped)) > 0) {
+        char text[64];
+
+        pa_atomic_sub(&ring->dropped, dropped);
+        pa_snprintf(text, sizeof(text), "%i log messages dropped, the ring was full.", dropped);
+        log_emit(PA_LOG_WARN, NULL, 0, NULL, ring->thread_name, pa_rtclock_now(), text, NULL);
+    }
+}
+
+/* Called from the drain thread, or at exit */
+static void drain_rings(void) {
+    pa_mutex *m;
+    struct log_ring *ring, *next;
+
+    m = pa_static_mutex_get(&rings_mutex, false, false);
+    pa_mutex_lock(m);
+
+    for (ring = rings; ring; ring = next) {
+        bool dead;
+
+        next = ring->next;
+
+        /* Look at this before draining, so that nothing the thread
+         * logged last gets lost */
+        dead = pa_atomic_load(&ring->dead);
+
+        ring_drain(ring);
+
+        if (dead) {
+            PA_LLIST_REMOVE(struct log_ring, rings, ring);
+            pa_ringbuffer_free(ring->ringbuffer);
+            pa_xfree(ring);
+        }
+    }
+
+    pa_mutex_unlock(m);
+}
+
+static void drain_thread_func(void *userdata) {
+    pa_semaphore *s = pa_static_semaphore_get(&drain_semaphore, 0);
+
+    while (!pa_atomic_load(&drain_quit)) {
+        pa_semaphore_wait(s);
+        drain_rings();
+    }
+}
+
+/* Called when a thread with a ring exits */
+static void ring_release(void *p) {
+    struct log_ring *ring = p;
+
+    pa_atomic_store(&ring->dead, 1);
+    pa_semaphore_post(pa_static_semaphore_get(&drain_semaphore, 0));
+}
+
+/* Write out whatever is left in the rings when the process exits */
+static void drain_thread_destructor(void) PA_GCC_DESTRUCTOR;
+static void drain_thread_destructor(void) {
+    /* A forked child doesn't have the thread */
+    if (!drain_thread || drain_pid != getpid())
+        return;
+
+    pa_atomic_store(&drain_quit, 1);
+    pa_semaphore_post(pa_static_semaphore_get(&drain_semaphore, 0));
+    pa_thread_free(drain_thread);
+    drain_thread = NULL;
+
+    drain_rings();
+}
+
+void pa_log_use_ring(void) {
+    struct log_ring *ring;
+    pa_mutex *m;
+
+    if (PA_STATIC_TLS_GET(log_ring))
+        return;
+
+    ring = pa_xnew0(struct log_ring, 1);
+    ring->ringbuffer = pa_ringbuffer_new(LOG_RING_RECORDS * (int) sizeof(struct log_record));
+    pa_strlcpy(ring->thread_name, pa_strnull(pa_thread_get_name(pa_thread_self())), sizeof(ring->thread_name));
+    PA_LLIST_INIT(struct log_ring, ring);
+
+    m = pa_static_mutex_get(&rings_mutex, false, false);
+    pa_mutex_lock(m);
+
+    PA_LLIST_PREPEND(struct log_ring, rings, ring);
+
+    if (!drain_thread && !(drain_thread = pa_thread_new("log-drain", drain_thread_func, NULL))) {
+        PA_LLIST_REMOVE(struct log_ring, rings, ring);
+        pa_mutex_unlock(m);
+
+        pa_ringbuffer_free(ring->ringbuffer);
+        pa_xfree(ring);
+
+        pa_log_warn("Failed to start the log drain thread, logging synchronously.");
+        return;
+    }
+
+    drain_pid = getpid();
+
+    pa_mutex_unlock(m);
+
+    PA_STATIC_TLS_SET(log_ring, ring);
+}
+
+/* Hands a message to the drain thread. This must neither block nor
+ * allocate memory. */
+static void ring_push(
+        struct log_ring *ring,
+        pa_log_level_t level,
+        const char *file,
+        int line,
+        const char *func,
+        const char *format,
+        va_list ap) {
+
+    struct log_record *r;
+    int count;
+
+    r = pa_ringbuffer_begin_write(ring->ringbuffer, &count);
+
+    if (count < (int) sizeof(struct log_record)) {
+        pa_atomic_inc(&ring->dropped);
+        return;
+    }
+
+    r->level = level;
+    r->line = line;
+    r->time = (flags | flags_override) & PA_LOG_PRINT_TIME ? pa_rtclock_now() : 0;
+    pa_strlcpy(r->file, pa_strempty(file), sizeof(r->file));
+    pa_strlcpy(r->func, pa_strempty(func), sizeof(r->func));
+    pa_vsnprintf(r->text, sizeof(r->text), format, ap);
+
+    pa_ringbuffer_end_write(ring->ringbuffer, (int) sizeof(struct log_record));
+    pa_ringbuffer_commit_write(ring->ringbuffer);
+
+    pa_semaphore_post(pa_static_semaphore_get(&drain_semaphore, 0));
+}
+
+void pa_log_levelv_meta(
+        pa_log_level_t level,
+        const char*file,
+        int line,
+        const char *func,
+        const char *format,
+        va_list ap) {
+
+    int saved_errno = errno;
+    char *bt = NULL;
+    struct log_ring *ring;
+    pa_log_level_t _maximum_level;
+    unsigned _show_backtrace;
+
+    /* We don't use dynamic memory allocation here to minimize the hit
+     * in RT threads */
+    char text[16*1024];
+
+    pa_assert(level < PA_LOG_LEVEL_MAX);
+    pa_assert(format);
+
+    init_defaults();
+
+    _maximum_level = PA_MAX(maximum_level, maximum_level_override);
+    _show_backtrace = PA_MAX(show_backtrace, show_backtrace_override);
+
+    if (PA_LIKELY(level > _maximum_level)) {
+        errno = saved_errno;
+        return;
+    }
+
+    /* Backtraces have to be taken right here, so these messages
+     * don't go through the ring */
+    if ((ring = PA_STATIC_TLS_GET(log_ring)) && _show_backtrace == 0) {
+        ring_push(ring, level, file, line, func, format, ap);
+        errno = saved_errno;
+        return;
+    }
+
+    pa_vsnprintf(text, sizeof(text), format, ap);
+
+#ifdef HAVE_EXECINFO_H
+    if (_show_backtrace > 0)
+        bt = get_backtrace(_show_backtrace);
+#endif
+
+    log_emit(level, file, line, func, pa_thread_get_name(pa_thread_self()),
+             (flags | flags_override) & PA_LOG_PRINT_TIME ? pa_rtclock_now() : 0, text, bt);
+
     pa_xfree(bt);
     errno = saved_errno;
 }
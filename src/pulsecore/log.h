@@ -87,6 +87,20 @@ void pa_log_set_show_backtrace(unsigned nlevels);
 /* Skip the first backtrace frames */
 void pa_log_set_skip_backtrace(unsigned nlevels);
 
+/* Route the messages of the calling thread through a lock-free ring
+ * that a background thread drains, so that logging never blocks the
+ * caller on the log target. Called by pa_make_realtime(). */
+void pa_log_use_ring(void);
+
+/* The most verbose level that currently gets logged. Only here for
+ * pa_log_level_enabled(), use pa_log_set_level() to change it. */
+extern pa_log_level_t pa_log_level_cutoff;
+
+/* Cheap check whether messages of this level get logged at all */
+static inline bool pa_log_level_enabled(pa_log_level_t level) {
+    return level <= pa_log_level_cutoff;
+}
+
 void pa_log_level_meta(
         pa_log_level_t level,
         const char*file,
@@ -123,12 +137,15 @@ char *pa_log_target_to_string(const pa_log_target *t);
 
 /* ISO varargs available */
 
-#define pa_log_debug(...)  pa_log_level_meta(PA_LOG_DEBUG,  __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define pa_log_info(...)   pa_log_level_meta(PA_LOG_INFO,   __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define pa_log_notice(...) pa_log_level_meta(PA_LOG_NOTICE, __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define pa_log_warn(...)   pa_log_level_meta(PA_LOG_WARN,   __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define pa_log_error(...)  pa_log_level_meta(PA_LOG_ERROR,  __FILE__, __LINE__, __func__, __VA_ARGS__)
-#define pa_logl(level, ...)  pa_log_level_meta(level,  __FILE__, __LINE__, __func__, __VA_ARGS__)
+/* The arguments are not evaluated at all if the level is disabled */
+#define pa_logl(level, ...) \
+    (pa_log_level_enabled(level) ? pa_log_level_meta(level, __FILE__, __LINE__, __func__, __VA_ARGS__) : (void) 0)
+
+#define pa_log_debug(...)  pa_logl(PA_LOG_DEBUG,  __VA_ARGS__)
+#define pa_log_info(...)   pa_logl(PA_LOG_INFO,   __VA_ARGS__)
+#define pa_log_notice(...) pa_logl(PA_LOG_NOTICE, __VA_ARGS__)
+#define pa_log_warn(...)   pa_logl(PA_LOG_WARN,   __VA_ARGS__)
+#define pa_log_error(...)  pa_logl(PA_LOG_ERROR,  __VA_ARGS__)
 
 #else
 
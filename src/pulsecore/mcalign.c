@@ -69,6 +69,10 @@ void pa_mcalign_push(pa_mcalign *m, const pa_memchunk *c) {
 
     pa_assert(!m->current.memblock);
 
+    /* We might hold on to the block, and whoever frees us might not be
+     * the thread that pushed it */
+    pa_memblock_clear_thread_local(c->memblock);
+
     /* Append to the leftover memory block */
     if (m->leftover.memblock) {
 
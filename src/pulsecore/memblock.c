@@ -47,6 +47,7 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/memtrap.h>
+#include <pulsecore/thread.h>
 
 #include "memblock.h"
 
@@ -57,15 +58,32 @@
 #define PA_MEMPOOL_SLOTS_MAX 1024
 #define PA_MEMPOOL_SLOT_SIZE (64*1024)
 
-#define PA_MEMEXPORT_SLOTS_MAX 128
-
-#define PA_MEMIMPORT_SLOTS_MAX 160
+/* Smaller blocks are carved out of whole slots, so that e.g. a 5ms
+ * chunk doesn't tie up 64K of the pool. Each size class may take at
+ * most 1/PA_MEMPOOL_CLASS_SLOTS_DIV of the slots. Once a slot has been
+ * carved up it stays with its class for the lifetime of the pool. */
+#define PA_MEMPOOL_CLASSES 3
+#define PA_MEMPOOL_CLASS_SLOTS_DIV 16
+static const size_t mempool_class_size[PA_MEMPOOL_CLASSES] = { 1024, 4*1024, 16*1024 };
+
+/* Peers older than protocol version 33 can only import 160 blocks, so
+ * unless told otherwise with pa_memexport_set_max_blocks() we don't export
+ * more than this at a time. Once all slots are in use blocks are copied
+ * over the socket instead. */
+#define PA_MEMEXPORT_SLOTS_COMPAT 128
+
+/* A bit more than PA_MEMEXPORT_SLOTS_MAX, since releases may still be in
+ * flight when the other side exports the next blocks */
+#define PA_MEMIMPORT_SLOTS_MAX 1280
 #define PA_MEMIMPORT_SEGMENTS_MAX 16
 
 struct pa_memblock {
     PA_REFCNT_DECLARE; /* the reference counter */
     pa_mempool *pool;
 
+    /* The account of the thread that allocated the block */
+    struct memblock_account *account;
+
     pa_memblock_type_t type;
 
     bool read_only:1;
@@ -77,6 +95,14 @@ struct pa_memblock {
     pa_atomic_t n_acquired;
     pa_atomic_t please_signal;
 
+    /* While the block is thread-local these take the place of the
+     * reference counter and n_acquired, see
+     * pa_memblock_set_thread_local() */
+    bool local;
+    int n_ref_local;
+    int n_acquired_local;
+    pa_thread *owner;
+
     union {
         struct {
             /* If type == PA_MEMBLOCK_USER this points to a function for freeing this memory block */
@@ -135,6 +161,8 @@ struct pa_memimport {
     pa_memimport_release_cb_t release_cb;
     void *userdata;
 
+    pa_memtransfer_stat stat;
+
     PA_LLIST_FIELDS(pa_memimport);
 };
 
@@ -152,6 +180,7 @@ struct pa_memexport {
     PA_LLIST_HEAD(struct memexport_slot, free_slots);
     PA_LLIST_HEAD(struct memexport_slot, used_slots);
     unsigned n_init;
+    unsigned max_blocks;
     unsigned baseidx;
 
     /* Called whenever a client from which we imported a memory block
@@ -160,9 +189,20 @@ struct pa_memexport {
     pa_memexport_revoke_cb_t revoke_cb;
     void *userdata;
 
+    pa_memtransfer_stat stat;
+
     PA_LLIST_FIELDS(pa_memexport);
 };
 
+struct mempool_class {
+    size_t chunk_size;
+    unsigned max_slots;
+    pa_atomic_t n_slots;
+
+    /* A list of free chunks of chunk_size bytes */
+    pa_flist *free_chunks;
+};
+
 struct pa_mempool {
     /* Reference count the mempool
      *
@@ -200,20 +240,121 @@ struct pa_mempool {
     /* A list of free slots that may be reused */
     pa_flist *free_slots;
 
+    struct mempool_class classes[PA_MEMPOOL_CLASSES];
+
+    /* For each slot 0 if it is used as a whole, or the index of the
+     * class it was carved up for plus one. */
+    uint8_t *slot_class;
+
     pa_mempool_stat stat;
 };
 
 static void segment_detach(pa_memimport_segment *seg);
 
+/* Needs the lock of the memimport/memexport the stat belongs to */
+static void transfer_stat_add(pa_memtransfer_stat *s, size_t length) {
+    s->n_blocks++;
+    s->size += length;
+
+    s->n_blocks_max = PA_MAX(s->n_blocks_max, s->n_blocks);
+    s->size_max = PA_MAX(s->size_max, s->size);
+}
+
+/* Needs the lock of the memimport/memexport the stat belongs to */
+static void transfer_stat_remove(pa_memtransfer_stat *s, size_t length) {
+    pa_assert(s->n_blocks >= 1);
+    pa_assert(s->size >= length);
+
+    s->n_blocks--;
+    s->size -= length;
+}
+
 PA_STATIC_FLIST_DECLARE(unused_memblocks, 0, pa_xfree);
 
+/* No lock necessary */
+static void stat_raise_max(pa_atomic_t *max, int v) {
+    int m;
+
+    while ((m = pa_atomic_load(max)) < v)
+        if (pa_atomic_cmpxchg(max, m, v))
+            break;
+}
+
+/* Blocks that are currently allocated, broken down by the thread that
+ * allocated them. Since IO threads are named after the device they
+ * serve this tells which module holds on to the memory. The accounts
+ * of threads that are gone are kept as long as they still have blocks
+ * allocated, and are reused afterwards. */
+struct memblock_account {
+    pa_atomic_t n_allocated;
+    pa_atomic_t allocated_size;
+    pa_atomic_t allocated_size_max;
+
+    /* Set when the thread is gone */
+    pa_atomic_t dead;
+
+    char thread_name[32];
+
+    PA_LLIST_FIELDS(struct memblock_account);
+};
+
+static void account_release(void *p);
+
+PA_STATIC_TLS_DECLARE(memblock_account, account_release);
+
+/* Protects the list of accounts */
+static pa_static_mutex accounts_mutex = PA_STATIC_MUTEX_INIT;
+static PA_LLIST_HEAD(struct memblock_account, accounts) = NULL;
+
+/* Called when a thread with an account exits */
+static void account_release(void *p) {
+    struct memblock_account *a = p;
+
+    pa_atomic_store(&a->dead, 1);
+}
+
+static struct memblock_account *account_get(void) {
+    struct memblock_account *a;
+    pa_mutex *m;
+
+    if ((a = PA_STATIC_TLS_GET(memblock_account)))
+        return a;
+
+    m = pa_static_mutex_get(&accounts_mutex, false, false);
+    pa_mutex_lock(m);
+
+    for (a = accounts; a; a = a->next)
+        if (pa_atomic_load(&a->dead) && pa_atomic_load(&a->n_allocated) == 0)
+            break;
+
+    if (a) {
+        pa_atomic_store(&a->allocated_size_max, 0);
+        pa_atomic_store(&a->dead, 0);
+    } else {
+        a = pa_xnew0(struct memblock_account, 1);
+        PA_LLIST_PREPEND(struct memblock_account, accounts, a);
+    }
+
+    pa_strlcpy(a->thread_name, pa_strnull(pa_thread_get_name(pa_thread_self())), sizeof(a->thread_name));
+
+    pa_mutex_unlock(m);
+
+    PA_STATIC_TLS_SET(memblock_account, a);
+
+    return a;
+}
+
 /* No lock necessary */
 static void stat_add(pa_memblock*b) {
     pa_assert(b);
     pa_assert(b->pool);
 
-    pa_atomic_inc(&b->pool->stat.n_allocated);
-    pa_atomic_add(&b->pool->stat.allocated_size, (int) b->length);
+    b->account = account_get();
+    pa_atomic_inc(&b->account->n_allocated);
+    stat_raise_max(&b->account->allocated_size_max, pa_atomic_add(&b->account->allocated_size, (int) b->length) + (int) b->length);
+
+    stat_raise_max(&b->pool->stat.n_allocated_max, pa_atomic_inc(&b->pool->stat.n_allocated) + 1);
+    stat_raise_max(&b->pool->stat.allocated_size_max, pa_atomic_add(&b->pool->stat.allocated_size, (int) b->length) + (int) b->length);
 
     pa_atomic_inc(&b->pool->stat.n_accumulated);
     pa_atomic_add(&b->pool->stat.accumulated_size, (int) b->length);
@@ -238,6 +379,11 @@ static void stat_remove(pa_memblock *b) {
     pa_atomic_dec(&b->pool->stat.n_allocated);
     pa_atomic_sub(&b->pool->stat.allocated_size, (int) b->length);
 
+    pa_assert(b->account);
+    pa_atomic_sub(&b->account->allocated_size, (int) b->length);
+    pa_atomic_dec(&b->account->n_allocated);
+    b->account = NULL;
+
     if (b->type == PA_MEMBLOCK_IMPORTED) {
         pa_assert(pa_atomic_load(&b->pool->stat.n_imported) > 0);
         pa_assert(pa_atomic_load(&b->pool->stat.imported_size) >= (int) b->length);
@@ -249,6 +395,14 @@ static void stat_remove(pa_memblock *b) {
     pa_atomic_dec(&b->pool->stat.n_allocated_by_type[b->type]);
 }
 
+static inline int memblock_refcnt(pa_memblock *b) {
+    return b->local ? b->n_ref_local : PA_REFCNT_VALUE(b);
+}
+
+static inline int memblock_acquired(pa_memblock *b) {
+    return b->local ? b->n_acquired_local : pa_atomic_load(&b->n_acquired);
+}
+
 static pa_memblock *memblock_new_appended(pa_mempool *p, size_t length);
 
 /* No lock necessary */
@@ -286,6 +440,7 @@ static pa_memblock *memblock_new_appended(pa_mempool *p, size_t length) {
     b->length = length;
     pa_atomic_store(&b->n_acquired, 0);
     pa_atomic_store(&b->please_signal, 0);
+    b->local = false;
 
     stat_add(b);
     return b;
@@ -306,12 +461,8 @@ static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
         else
             slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) idx));
 
-        if (!slot) {
-            if (pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Pool full");
-            pa_atomic_inc(&p->stat.n_pool_full);
+        if (!slot)
             return NULL;
-        }
     }
 
 /* #ifdef HAVE_VALGRIND_MEMCHECK_H */
@@ -339,13 +490,95 @@ static unsigned mempool_slot_idx(pa_mempool *p, void *ptr) {
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr) {
-    unsigned idx;
+static struct mempool_slot* mempool_carve_slot(pa_mempool *p, unsigned i) {
+    struct mempool_class *c = &p->classes[i];
+    struct mempool_slot *slot;
+    size_t k;
+
+    if ((unsigned) pa_atomic_inc(&c->n_slots) >= c->max_slots) {
+        pa_atomic_dec(&c->n_slots);
+        return NULL;
+    }
 
-    if ((idx = mempool_slot_idx(p, ptr)) == (unsigned) -1)
+    if (!(slot = mempool_allocate_slot(p))) {
+        pa_atomic_dec(&c->n_slots);
         return NULL;
+    }
+
+    /* This is published to whoever frees one of the chunks by the
+     * barrier in pa_flist_push() */
+    p->slot_class[mempool_slot_idx(p, slot)] = (uint8_t) (i + 1);
+
+    /* We keep the first chunk for ourselves */
+    for (k = c->chunk_size; k < p->block_size; k += c->chunk_size)
+        while (pa_flist_push(c->free_chunks, (uint8_t*) slot + k) < 0)
+            ;
+
+    return slot;
+}
+
+/* No lock necessary. Returns a piece of pool memory of at least size
+ * bytes: a chunk of the smallest class that fits and isn't exhausted,
+ * or a whole slot. */
+static struct mempool_slot* mempool_allocate_chunk(pa_mempool *p, size_t size) {
+    struct mempool_slot *slot;
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(size <= p->block_size);
+
+    for (i = 0; i < PA_MEMPOOL_CLASSES; i++) {
+        struct mempool_class *c = &p->classes[i];
+
+        if (c->chunk_size < size || c->max_slots <= 0)
+            continue;
+
+        if ((slot = pa_flist_pop(c->free_chunks)))
+            return slot;
+
+        if ((slot = mempool_carve_slot(p, i)))
+            return slot;
+    }
+
+    if (!(slot = mempool_allocate_slot(p))) {
+        if (pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Pool full");
+        pa_atomic_inc(&p->stat.n_pool_full);
+    }
+
+    return slot;
+}
+
+/* No lock necessary */
+static void mempool_free_chunk(pa_mempool *p, void *ptr) {
+    struct mempool_slot *slot;
+    unsigned idx, class;
+    pa_flist *list;
+    size_t size;
+
+    idx = mempool_slot_idx(p, ptr);
+
+    if ((class = p->slot_class[idx]) > 0) {
+        size = p->classes[class - 1].chunk_size;
+        list = p->classes[class - 1].free_chunks;
+    } else {
+        size = p->block_size;
+        list = p->free_slots;
+    }
+
+    slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) / size) * size);
+
+/* #ifdef HAVE_VALGRIND_MEMCHECK_H */
+/*     if (PA_UNLIKELY(pa_in_valgrind())) { */
+/*         VALGRIND_FREELIKE_BLOCK(slot, size); */
+/*     } */
+/* #endif */
 
-    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (idx * p->block_size));
+    /* The free list dimensions should easily allow all slots
+     * to fit in, hence try harder if pushing this slot into
+     * the free list fails */
+    while (pa_flist_push(list, slot) < 0)
+        ;
 }
 
 /* No lock necessary */
@@ -384,7 +617,7 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
 
     if (p->block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(slot = mempool_allocate_chunk(p, PA_ALIGN(sizeof(pa_memblock)) + length)))
             return NULL;
 
         b = mempool_slot_data(slot);
@@ -393,7 +626,7 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
 
     } else if (p->block_size >= length) {
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(slot = mempool_allocate_chunk(p, length)))
             return NULL;
 
         if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
@@ -415,6 +648,7 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     b->length = length;
     pa_atomic_store(&b->n_acquired, 0);
     pa_atomic_store(&b->please_signal, 0);
+    b->local = false;
 
     stat_add(b);
     return b;
@@ -442,6 +676,7 @@ pa_memblock *pa_memblock_new_fixed(pa_mempool *p, void *d, size_t length, bool r
     b->length = length;
     pa_atomic_store(&b->n_acquired, 0);
     pa_atomic_store(&b->please_signal, 0);
+    b->local = false;
 
     stat_add(b);
     return b;
@@ -476,6 +711,7 @@ pa_memblock *pa_memblock_new_user(
     b->length = length;
     pa_atomic_store(&b->n_acquired, 0);
     pa_atomic_store(&b->please_signal, 0);
+    b->local = false;
 
     b->per_type.user.free_cb = free_cb;
     b->per_type.user.free_cb_data = free_cb_data;
@@ -484,10 +720,41 @@ pa_memblock *pa_memblock_new_user(
     return b;
 }
 
+static void sealed_memfd_free_cb(void *p) {
+    pa_shm *m = p;
+
+    pa_shm_free(m);
+    pa_xfree(m);
+}
+
+/* No lock necessary */
+pa_memblock *pa_memblock_new_sealed_memfd(pa_mempool *p, int memfd_fd, size_t length) {
+    pa_shm *m;
+
+    pa_assert(p);
+    pa_assert(memfd_fd >= 0);
+    pa_assert(length > 0);
+
+    m = pa_xnew(pa_shm, 1);
+
+    if (pa_shm_attach_sealed(m, memfd_fd) < 0) {
+        pa_xfree(m);
+        return NULL;
+    }
+
+    if (m->size < length) {
+        pa_log("memfd of %lu bytes is too small for %lu bytes of data.", (unsigned long) m->size, (unsigned long) length);
+        sealed_memfd_free_cb(m);
+        return NULL;
+    }
+
+    return pa_memblock_new_user(p, m->ptr, length, sealed_memfd_free_cb, m, true);
+}
+
 /* No lock necessary */
 bool pa_memblock_is_ours(pa_memblock *b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
 
     return b->type != PA_MEMBLOCK_IMPORTED;
 }
@@ -495,15 +762,15 @@ bool pa_memblock_is_ours(pa_memblock *b) {
 /* No lock necessary */
 bool pa_memblock_is_read_only(pa_memblock *b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
 
-    return b->read_only || PA_REFCNT_VALUE(b) > 1;
+    return b->read_only || memblock_refcnt(b) > 1;
 }
 
 /* No lock necessary */
 bool pa_memblock_is_silence(pa_memblock *b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
 
     return b->is_silence;
 }
@@ -511,7 +778,7 @@ bool pa_memblock_is_silence(pa_memblock *b) {
 /* No lock necessary */
 void pa_memblock_set_is_silence(pa_memblock *b, bool v) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
 
     b->is_silence = v;
 }
@@ -521,7 +788,7 @@ bool pa_memblock_ref_is_one(pa_memblock *b) {
     int r;
     pa_assert(b);
 
-    pa_assert_se((r = PA_REFCNT_VALUE(b)) > 0);
+    pa_assert_se((r = memblock_refcnt(b)) > 0);
 
     return r == 1;
 }
@@ -529,9 +796,13 @@ bool pa_memblock_ref_is_one(pa_memblock *b) {
 /* No lock necessary */
 void* pa_memblock_acquire(pa_memblock *b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
 
-    pa_atomic_inc(&b->n_acquired);
+    if (b->local) {
+        pa_assert_fp(b->owner == pa_thread_self());
+        b->n_acquired_local++;
+    } else
+        pa_atomic_inc(&b->n_acquired);
 
     return pa_atomic_ptr_load(&b->data);
 }
@@ -547,7 +818,13 @@ void *pa_memblock_acquire_chunk(const pa_memchunk *c) {
 void pa_memblock_release(pa_memblock *b) {
     int r;
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
+
+    if (b->local) {
+        pa_assert_fp(b->n_acquired_local >= 1);
+        b->n_acquired_local--;
+        return;
+    }
 
     r = pa_atomic_dec(&b->n_acquired);
     pa_assert(r >= 1);
@@ -559,7 +836,7 @@ void pa_memblock_release(pa_memblock *b) {
 
 size_t pa_memblock_get_length(pa_memblock *b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
 
     return b->length;
 }
@@ -567,7 +844,7 @@ size_t pa_memblock_get_length(pa_memblock *b) {
 /* Note! Always unref the returned pool after use */
 pa_mempool* pa_memblock_get_pool(pa_memblock *b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
     pa_assert(b->pool);
 
     pa_mempool_ref(b->pool);
@@ -577,18 +854,62 @@ pa_mempool* pa_memblock_get_pool(pa_memblock *b) {
 /* No lock necessary */
 pa_memblock* pa_memblock_ref(pa_memblock*b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
+
+    if (b->local) {
+        pa_assert_fp(b->owner == pa_thread_self());
+        b->n_ref_local++;
+    } else
+        PA_REFCNT_INC(b);
 
-    PA_REFCNT_INC(b);
     return b;
 }
 
+bool pa_memblock_set_thread_local(pa_memblock *b) {
+    pa_assert(b);
+    pa_assert(memblock_refcnt(b) > 0);
+
+    /* The data of fixed and imported blocks may be replaced from
+     * another thread, which waits for n_acquired to drop */
+    if (b->type != PA_MEMBLOCK_POOL &&
+        b->type != PA_MEMBLOCK_POOL_EXTERNAL &&
+        b->type != PA_MEMBLOCK_APPENDED)
+        return false;
+
+    /* Holding the only reference means nobody else can touch the
+     * counters while we switch them over */
+    if (memblock_refcnt(b) != 1 || memblock_acquired(b) != 0)
+        return false;
+
+    if (!b->local) {
+        b->n_ref_local = 1;
+        b->n_acquired_local = 0;
+        b->local = true;
+    }
+
+    b->owner = pa_thread_self();
+    return true;
+}
+
+void pa_memblock_clear_thread_local(pa_memblock *b) {
+    pa_assert(b);
+    pa_assert(memblock_refcnt(b) > 0);
+
+    if (!b->local)
+        return;
+
+    PA_REFCNT_SET(b, b->n_ref_local);
+    pa_atomic_store(&b->n_acquired, b->n_acquired_local);
+    b->local = false;
+    b->owner = NULL;
+}
+
 static void memblock_free(pa_memblock *b) {
     pa_mempool *pool;
 
     pa_assert(b);
     pa_assert(b->pool);
-    pa_assert(pa_atomic_load(&b->n_acquired) == 0);
+    pa_assert(memblock_acquired(b) == 0);
 
     pool = b->pool;
     stat_remove(b);
@@ -625,6 +946,7 @@ static void memblock_free(pa_memblock *b) {
             pa_mutex_lock(import->mutex);
 
             pa_assert_se(pa_hashmap_remove(import->blocks, PA_UINT32_TO_PTR(b->per_type.imported.id)));
+            transfer_stat_remove(&import->stat, b->length);
 
             pa_assert(segment->n_blocks >= 1);
             if (-- segment->n_blocks <= 0)
@@ -642,24 +964,11 @@ static void memblock_free(pa_memblock *b) {
 
         case PA_MEMBLOCK_POOL_EXTERNAL:
         case PA_MEMBLOCK_POOL: {
-            struct mempool_slot *slot;
             bool call_free;
 
-            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data)));
-
             call_free = b->type == PA_MEMBLOCK_POOL_EXTERNAL;
 
-/* #ifdef HAVE_VALGRIND_MEMCHECK_H */
-/*             if (PA_UNLIKELY(pa_in_valgrind())) { */
-/*                 VALGRIND_FREELIKE_BLOCK(slot, b->pool->block_size); */
-/*             } */
-/* #endif */
-
-            /* The free list dimensions should easily allow all slots
-             * to fit in, hence try harder if pushing this slot into
-             * the free list fails */
-            while (pa_flist_push(b->pool->free_slots, slot) < 0)
-                ;
+            mempool_free_chunk(b->pool, pa_atomic_ptr_load(&b->data));
 
             if (call_free)
                 if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
@@ -679,9 +988,15 @@ static void memblock_free(pa_memblock *b) {
 /* No lock necessary */
 void pa_memblock_unref(pa_memblock*b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
-
-    if (PA_REFCNT_DEC(b) > 0)
+    pa_assert(memblock_refcnt(b) > 0);
+
+    /* No owner check here, whoever frees a sink or source after its IO
+     * thread is gone drops thread-local references from the main
+     * thread */
+    if (b->local) {
+        if (--b->n_ref_local > 0)
+            return;
+    } else if (PA_REFCNT_DEC(b) > 0)
         return;
 
     memblock_free(b);
@@ -714,7 +1029,7 @@ static void memblock_make_local(pa_memblock *b) {
     if (b->length <= b->pool->block_size) {
         struct mempool_slot *slot;
 
-        if ((slot = mempool_allocate_slot(b->pool))) {
+        if ((slot = mempool_allocate_chunk(b->pool, b->length))) {
             void *new_data;
             /* We can move it into a local pool, perfect! */
 
@@ -746,10 +1061,10 @@ finish:
 /* No lock necessary. This function is not multiple caller safe */
 void pa_memblock_unref_fixed(pa_memblock *b) {
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
     pa_assert(b->type == PA_MEMBLOCK_FIXED);
 
-    if (PA_REFCNT_VALUE(b) > 1)
+    if (memblock_refcnt(b) > 1)
         memblock_make_local(b);
 
     pa_memblock_unref(b);
@@ -760,7 +1075,7 @@ pa_memblock *pa_memblock_will_need(pa_memblock *b) {
     void *p;
 
     pa_assert(b);
-    pa_assert(PA_REFCNT_VALUE(b) > 0);
+    pa_assert(memblock_refcnt(b) > 0);
 
     p = pa_memblock_acquire(b);
     pa_will_need(p, b->length);
@@ -788,6 +1103,7 @@ static void memblock_replace_import(pa_memblock *b) {
     pa_mutex_lock(import->mutex);
 
     pa_assert_se(pa_hashmap_remove(import->blocks, PA_UINT32_TO_PTR(b->per_type.imported.id)));
+    transfer_stat_remove(&import->stat, b->length);
 
     memblock_make_local(b);
 
@@ -829,6 +1145,7 @@ pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client) {
     pa_mempool *p;
     char t1[PA_BYTES_SNPRINT_MAX], t2[PA_BYTES_SNPRINT_MAX];
     const size_t page_size = pa_page_size();
+    unsigned i;
 
     p = pa_xnew0(pa_mempool, 1);
     PA_REFCNT_INIT(p);
@@ -870,10 +1187,27 @@ pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client) {
 
     p->free_slots = pa_flist_new(p->n_blocks);
 
+    p->slot_class = pa_xnew0(uint8_t, p->n_blocks);
+
+    for (i = 0; i < PA_MEMPOOL_CLASSES; i++) {
+        struct mempool_class *c = &p->classes[i];
+
+        c->chunk_size = mempool_class_size[i];
+        pa_assert(p->block_size % c->chunk_size == 0);
+
+        c->max_slots = p->n_blocks / PA_MEMPOOL_CLASS_SLOTS_DIV;
+        pa_atomic_store(&c->n_slots, 0);
+
+        if (c->max_slots > 0)
+            c->free_chunks = pa_flist_new((unsigned) (c->max_slots * (p->block_size / c->chunk_size)));
+    }
+
     return p;
 }
 
 static void mempool_free(pa_mempool *p) {
+    unsigned i;
+
     pa_assert(p);
 
     pa_mutex_lock(p->mutex);
@@ -888,12 +1222,15 @@ static void mempool_free(pa_mempool *p) {
 
     pa_flist_free(p->free_slots, NULL);
 
+    for (i = 0; i < PA_MEMPOOL_CLASSES; i++)
+        if (p->classes[i].free_chunks)
+            pa_flist_free(p->classes[i].free_chunks, NULL);
+
     if (pa_atomic_load(&p->stat.n_allocated) > 0) {
 
         /* Ouch, somebody is retaining a memory block reference! */
 
 #ifdef DEBUG_REF
-        unsigned i;
         pa_flist *list;
 
         /* Let's try to find at least one of those leaked memory blocks */
@@ -904,6 +1241,10 @@ static void mempool_free(pa_mempool *p) {
             struct mempool_slot *slot;
             pa_memblock *b, *k;
 
+            /* We don't bother looking into carved up slots */
+            if (p->slot_class[i])
+                continue;
+
             slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) i));
             b = mempool_slot_data(slot);
 
@@ -937,9 +1278,38 @@ static void mempool_free(pa_mempool *p) {
     pa_mutex_free(p->mutex);
     pa_semaphore_free(p->semaphore);
 
+    pa_xfree(p->slot_class);
     pa_xfree(p);
 }
 
+/* Takes the accounts lock */
+void pa_memblock_dump_accounts(pa_strbuf *buf) {
+    struct memblock_account *a;
+    pa_mutex *m;
+
+    pa_assert(buf);
+
+    m = pa_static_mutex_get(&accounts_mutex, false, false);
+    pa_mutex_lock(m);
+
+    for (a = accounts; a; a = a->next) {
+        char bytes[PA_BYTES_SNPRINT_MAX], bytes_max[PA_BYTES_SNPRINT_MAX];
+        unsigned n;
+
+        if (!(n = (unsigned) pa_atomic_load(&a->n_allocated)) && pa_atomic_load(&a->dead))
+            continue;
+
+        pa_strbuf_printf(buf, "Memory blocks allocated by thread %s%s: %u, size: %s, peak size: %s.\n",
+                         a->thread_name,
+                         pa_atomic_load(&a->dead) ? " (exited)" : "",
+                         n,
+                         pa_bytes_snprint(bytes, sizeof(bytes), (unsigned) pa_atomic_load(&a->allocated_size)),
+                         pa_bytes_snprint(bytes_max, sizeof(bytes_max), (unsigned) pa_atomic_load(&a->allocated_size_max)));
+    }
+
+    pa_mutex_unlock(m);
+}
+
 /* No lock necessary */
 const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p) {
     pa_assert(p);
@@ -955,28 +1325,47 @@ size_t pa_mempool_block_size_max(pa_mempool *p) {
 }
 
 /* No lock necessary */
-void pa_mempool_vacuum(pa_mempool *p) {
-    struct mempool_slot *slot;
+static void vacuum_free_list(pa_mempool *p, pa_flist *free_list, unsigned n_max, size_t size) {
+    void *e;
     pa_flist *list;
 
-    pa_assert(p);
-
-    list = pa_flist_new(p->n_blocks);
+    list = pa_flist_new(n_max);
 
-    while ((slot = pa_flist_pop(p->free_slots)))
-        while (pa_flist_push(list, slot) < 0)
+    while ((e = pa_flist_pop(free_list)))
+        while (pa_flist_push(list, e) < 0)
             ;
 
-    while ((slot = pa_flist_pop(list))) {
-        pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), p->block_size);
+    while ((e = pa_flist_pop(list))) {
+        pa_shm_punch(&p->memory, (size_t) ((uint8_t*) e - (uint8_t*) p->memory.ptr), size);
 
-        while (pa_flist_push(p->free_slots, slot))
+        while (pa_flist_push(free_list, e))
             ;
     }
 
     pa_flist_free(list, NULL);
 }
 
+/* No lock necessary */
+void pa_mempool_vacuum(pa_mempool *p) {
+    unsigned i;
+
+    pa_assert(p);
+
+    vacuum_free_list(p, p->free_slots, p->n_blocks, p->block_size);
+
+    /* Carved up slots stay with their class, but the pages of their free
+     * chunks can be given back just as well. pa_shm_punch() only punches
+     * whole pages, so don't bother with chunks that are smaller. */
+    for (i = 0; i < PA_MEMPOOL_CLASSES; i++) {
+        struct mempool_class *c = &p->classes[i];
+
+        if (!c->free_chunks || c->chunk_size < pa_page_size())
+            continue;
+
+        vacuum_free_list(p, c->free_chunks, (unsigned) (c->max_slots * (p->block_size / c->chunk_size)), c->chunk_size);
+    }
+}
+
 /* No lock necessary */
 bool pa_mempool_is_shared(pa_mempool *p) {
     pa_assert(p);
@@ -1098,6 +1487,7 @@ pa_memimport* pa_memimport_new(pa_mempool *p, pa_memimport_release_cb_t cb, void
     i->blocks = pa_hashmap_new(NULL, NULL);
     i->release_cb = cb;
     i->userdata = userdata;
+    pa_zero(i->stat);
 
     pa_mutex_lock(p->mutex);
     PA_LLIST_PREPEND(pa_memimport, p->imports, i);
@@ -1278,16 +1668,21 @@ pa_memblock* pa_memimport_get(pa_memimport *i, pa_mem_type_t type, uint32_t bloc
     b->length = size;
     pa_atomic_store(&b->n_acquired, 0);
     pa_atomic_store(&b->please_signal, 0);
+    b->local = false;
     b->per_type.imported.id = block_id;
     b->per_type.imported.segment = seg;
 
     pa_hashmap_put(i->blocks, PA_UINT32_TO_PTR(block_id), b);
+    transfer_stat_add(&i->stat, size);
 
     seg->n_blocks++;
 
     stat_add(b);
 
 finish:
+    if (!b)
+        i->stat.n_failed++;
+
     pa_mutex_unlock(i->mutex);
 
     return b;
@@ -1313,6 +1708,16 @@ finish:
     return ret;
 }
 
+/* Self-locked */
+void pa_memimport_get_stat(pa_memimport *i, pa_memtransfer_stat *stat) {
+    pa_assert(i);
+    pa_assert(stat);
+
+    pa_mutex_lock(i->mutex);
+    *stat = i->stat;
+    pa_mutex_unlock(i->mutex);
+}
+
 /* For sending blocks to other nodes */
 pa_memexport* pa_memexport_new(pa_mempool *p, pa_memexport_revoke_cb_t cb, void *userdata) {
     pa_memexport *e;
@@ -1332,8 +1737,10 @@ pa_memexport* pa_memexport_new(pa_mempool *p, pa_memexport_revoke_cb_t cb, void
     PA_LLIST_HEAD_INIT(struct memexport_slot, e->free_slots);
     PA_LLIST_HEAD_INIT(struct memexport_slot, e->used_slots);
     e->n_init = 0;
+    e->max_blocks = PA_MEMEXPORT_SLOTS_COMPAT;
     e->revoke_cb = cb;
     e->userdata = userdata;
+    pa_zero(e->stat);
 
     pa_mutex_lock(p->mutex);
 
@@ -1361,6 +1768,18 @@ void pa_memexport_free(pa_memexport *e) {
     pa_xfree(e);
 }
 
+/* Self-locked */
+void pa_memexport_set_max_blocks(pa_memexport *e, unsigned n) {
+    pa_assert(e);
+    pa_assert(n <= PA_MEMEXPORT_SLOTS_MAX);
+
+    pa_mutex_lock(e->mutex);
+    /* Slots above the limit may be in use already */
+    pa_assert(n >= e->max_blocks);
+    e->max_blocks = n;
+    pa_mutex_unlock(e->mutex);
+}
+
 /* Self-locked */
 int pa_memexport_process_release(pa_memexport *e, uint32_t id) {
     pa_memblock *b;
@@ -1384,6 +1803,7 @@ int pa_memexport_process_release(pa_memexport *e, uint32_t id) {
 
     PA_LLIST_REMOVE(struct memexport_slot, e->used_slots, &e->slots[id]);
     PA_LLIST_PREPEND(struct memexport_slot, e->free_slots, &e->slots[id]);
+    transfer_stat_remove(&e->stat, b->length);
 
     pa_mutex_unlock(e->mutex);
 
@@ -1405,6 +1825,16 @@ fail:
     return -1;
 }
 
+/* Self-locked */
+void pa_memexport_get_stat(pa_memexport *e, pa_memtransfer_stat *stat) {
+    pa_assert(e);
+    pa_assert(stat);
+
+    pa_mutex_lock(e->mutex);
+    *stat = e->stat;
+    pa_mutex_unlock(e->mutex);
+}
+
 /* Self-locked */
 static void memexport_revoke_blocks(pa_memexport *e, pa_memimport *i) {
     struct memexport_slot *slot, *next;
@@ -1455,6 +1885,7 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, pa_mem_type_t *type, uint3
                      uint32_t *shm_id, size_t *offset, size_t * size) {
     pa_shm  *memory;
     struct memexport_slot *slot;
+    pa_memblock *copy;
     void *data;
 
     pa_assert(e);
@@ -1466,17 +1897,27 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, pa_mem_type_t *type, uint3
     pa_assert(size);
     pa_assert(b->pool == e->pool);
 
-    if (!(b = memblock_shared_copy(e->pool, b)))
-        return -1;
+    copy = memblock_shared_copy(e->pool, b);
 
     pa_mutex_lock(e->mutex);
 
+    if (!copy) {
+        e->stat.n_failed++;
+        pa_mutex_unlock(e->mutex);
+        return -1;
+    }
+
+    if (copy != b)
+        e->stat.n_copied++;
+    b = copy;
+
     if (e->free_slots) {
         slot = e->free_slots;
         PA_LLIST_REMOVE(struct memexport_slot, e->free_slots, slot);
-    } else if (e->n_init < PA_MEMEXPORT_SLOTS_MAX)
+    } else if (e->n_init < e->max_blocks)
         slot = &e->slots[e->n_init++];
     else {
+        e->stat.n_failed++;
         pa_mutex_unlock(e->mutex);
         pa_memblock_unref(b);
         return -1;
@@ -1485,6 +1926,7 @@ int pa_memexport_put(pa_memexport *e, pa_memblock *b, pa_mem_type_t *type, uint3
     PA_LLIST_PREPEND(struct memexport_slot, e->used_slots, slot);
     slot->block = b;
     *block_id = (uint32_t) (slot - e->slots + e->baseidx);
+    transfer_stat_add(&e->stat, b->length);
 
     pa_mutex_unlock(e->mutex);
 /*     pa_log("Got block id %u", *block_id); */
@@ -31,6 +31,7 @@ typedef struct pa_memblock pa_memblock;
 #include <pulsecore/atomic.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/mem.h>
+#include <pulsecore/strbuf.h>
 
 /* A pa_memblock is a reference counted memory block. PulseAudio
  * passes references to pa_memblocks around instead of copying
@@ -50,10 +51,14 @@ typedef enum pa_memblock_type {
 
 typedef struct pa_mempool pa_mempool;
 typedef struct pa_mempool_stat pa_mempool_stat;
+typedef struct pa_memtransfer_stat pa_memtransfer_stat;
 typedef struct pa_memimport_segment pa_memimport_segment;
 typedef struct pa_memimport pa_memimport;
 typedef struct pa_memexport pa_memexport;
 
+/* The most blocks a memexport can have exported at a time */
+#define PA_MEMEXPORT_SLOTS_MAX 1024
+
 typedef void (*pa_memimport_release_cb_t)(pa_memimport *i, uint32_t block_id, void *userdata);
 typedef void (*pa_memexport_revoke_cb_t)(pa_memexport *e, uint32_t block_id, void *userdata);
 
@@ -74,10 +79,28 @@ struct pa_mempool_stat {
     pa_atomic_t n_too_large_for_pool;
     pa_atomic_t n_pool_full;
 
+    /* High-water marks of n_allocated and allocated_size */
+    pa_atomic_t n_allocated_max;
+    pa_atomic_t allocated_size_max;
+
     pa_atomic_t n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
     pa_atomic_t n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
 };
 
+/* Blocks currently imported through a single memimport or exported
+ * through a single memexport, i.e. usually those of one connection,
+ * plus the respective high-water marks.
+ *
+ * n_failed counts the blocks that could not be imported or exported, for
+ * example because all slots were in use. A failed export is sent as a
+ * copy instead, a failed import is lost. n_copied counts the exported
+ * blocks that were not in the pool and had to be copied into it first. */
+struct pa_memtransfer_stat {
+    unsigned n_blocks, n_blocks_max;
+    size_t size, size_max;
+    unsigned n_failed, n_copied;
+};
+
 /* Allocate a new memory block of type PA_MEMBLOCK_MEMPOOL or PA_MEMBLOCK_APPENDED, depending on the size */
 pa_memblock *pa_memblock_new(pa_mempool *, size_t length);
 
@@ -87,6 +110,12 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *, size_t length);
 /* Allocate a new memory block of type PA_MEMBLOCK_USER */
 pa_memblock *pa_memblock_new_user(pa_mempool *, void *data, size_t length, pa_free_cb_t free_cb, void *free_cb_data, bool read_only);
 
+/* A special case of pa_memblock_new_user: map a memfd sealed with
+ * pa_shm_seal() read-only. The caller keeps ownership of the fd, which
+ * may be closed right away. Returns NULL if the memfd is not sealed or
+ * smaller than length. */
+pa_memblock *pa_memblock_new_sealed_memfd(pa_mempool *p, int memfd_fd, size_t length);
+
 /* A special case of pa_memblock_new_user: take a memory buffer previously allocated with pa_xmalloc()  */
 static inline pa_memblock *pa_memblock_new_malloced(pa_mempool *p, void *data, size_t length) {
     return pa_memblock_new_user(p, data, length, pa_xfree, data, 0);
@@ -106,6 +135,16 @@ function is not multiple caller safe, i.e. needs to be locked
 manually if called from more than one thread at the same time. */
 void pa_memblock_unref_fixed(pa_memblock*b);
 
+/* A thread-local block skips the atomic operations in ref, unref,
+ * acquire and release. This is meant for blocks that don't leave the
+ * thread that uses them, like a sink's render buffer. Only whoever holds
+ * the sole reference may make a block thread-local, which fails
+ * otherwise. The block goes back to atomic reference counting when it
+ * is passed through a pa_asyncmsgq or stored in a pa_memblockq, or by
+ * calling pa_memblock_clear_thread_local(). */
+bool pa_memblock_set_thread_local(pa_memblock *b);
+void pa_memblock_clear_thread_local(pa_memblock *b);
+
 bool pa_memblock_is_ours(pa_memblock *b);
 bool pa_memblock_is_read_only(pa_memblock *b);
 bool pa_memblock_is_silence(pa_memblock *b);
@@ -123,6 +162,10 @@ pa_mempool * pa_memblock_get_pool(pa_memblock *b);
 
 pa_memblock *pa_memblock_will_need(pa_memblock *b);
 
+/* Writes the blocks currently allocated, broken down by the thread
+ * that allocated them */
+void pa_memblock_dump_accounts(pa_strbuf *buf);
+
 /* The memory block manager */
 pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client);
 void pa_mempool_unref(pa_mempool *p);
@@ -148,6 +191,7 @@ int pa_memimport_attach_memfd(pa_memimport *i, uint32_t shm_id, int memfd_fd, bo
 pa_memblock* pa_memimport_get(pa_memimport *i, pa_mem_type_t type, uint32_t block_id,
                               uint32_t shm_id, size_t offset, size_t size, bool writable);
 int pa_memimport_process_revoke(pa_memimport *i, uint32_t block_id);
+void pa_memimport_get_stat(pa_memimport *i, pa_memtransfer_stat *stat);
 
 /* For sending blocks to other nodes */
 pa_memexport* pa_memexport_new(pa_mempool *p, pa_memexport_revoke_cb_t cb, void *userdata);
@@ -155,5 +199,10 @@ void pa_memexport_free(pa_memexport *e);
 int pa_memexport_put(pa_memexport *e, pa_memblock *b, pa_mem_type_t *type, uint32_t *block_id,
                      uint32_t *shm_id, size_t *offset, size_t * size);
 int pa_memexport_process_release(pa_memexport *e, uint32_t id);
+/* Allow up to n blocks, at most PA_MEMEXPORT_SLOTS_MAX, to be exported at
+ * once instead of the 128 older peers can take. n can't be lowered
+ * again. */
+void pa_memexport_set_max_blocks(pa_memexport *e, unsigned n);
+void pa_memexport_get_stat(pa_memexport *e, pa_memtransfer_stat *stat);
 
 #endif
@@ -31,6 +31,8 @@
 #include <pulsecore/mcalign.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/trace.h>
+#include <pulsecore/vring.h>
 
 #include "memblockq.h"
 
@@ -44,15 +46,22 @@ struct list_item {
 
 PA_STATIC_FLIST_DECLARE(list_items, 0, pa_xfree);
 
+/* How many unused list items each queue keeps for itself before handing
+ * them back to the global flist. Most queues see a steady stream of
+ * push/drop cycles, which this way never leave the queue. */
+#define MAX_FREE_ITEMS 16
+
 struct pa_memblockq {
     struct list_item *blocks, *blocks_tail;
     struct list_item *current_read, *current_write;
-    unsigned n_blocks;
+    struct list_item *free_items;
+    unsigned n_blocks, n_free_items;
     size_t maxlength, tlength, base, prebuf, minreq, maxrewind;
     int64_t read_index, write_index;
     bool in_prebuf;
     pa_memchunk silence;
     pa_mcalign *mcalign;
+    pa_vring *ring;
     int64_t missing, requested;
     char *name;
     pa_sample_spec sample_spec;
@@ -105,17 +114,56 @@ pa_memblockq* pa_memblockq_new(
     return bq;
 }
 
+static struct list_item *list_item_new(pa_memblockq *bq) {
+    struct list_item *q;
+
+    if ((q = bq->free_items)) {
+        bq->free_items = q->next;
+        bq->n_free_items--;
+        return q;
+    }
+
+    if (!(q = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
+        q = pa_xnew(struct list_item, 1);
+
+    return q;
+}
+
+static void list_item_free(pa_memblockq *bq, struct list_item *q) {
+    if (bq->n_free_items < MAX_FREE_ITEMS) {
+        q->next = bq->free_items;
+        bq->free_items = q;
+        bq->n_free_items++;
+        return;
+    }
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(list_items), q) < 0)
+        pa_xfree(q);
+}
+
 void pa_memblockq_free(pa_memblockq* bq) {
+    struct list_item *q;
+
     pa_assert(bq);
 
     pa_memblockq_silence(bq);
 
+    while ((q = bq->free_items)) {
+        bq->free_items = q->next;
+
+        if (pa_flist_push(PA_STATIC_FLIST_GET(list_items), q) < 0)
+            pa_xfree(q);
+    }
+
     if (bq->silence.memblock)
         pa_memblock_unref(bq->silence.memblock);
 
     if (bq->mcalign)
         pa_mcalign_free(bq->mcalign);
 
+    if (bq->ring)
+        pa_vring_free(bq->ring);
+
     pa_xfree(bq->name);
     pa_xfree(bq);
 }
@@ -203,9 +251,7 @@ static void drop_block(pa_memblockq *bq, struct list_item *q) {
         bq->current_read = q->next;
 
     pa_memblock_unref(q->chunk.memblock);
-
-    if (pa_flist_push(PA_STATIC_FLIST_GET(list_items), q) < 0)
-        pa_xfree(q);
+    list_item_free(bq, q);
 
     bq->n_blocks--;
 }
@@ -291,6 +337,8 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     if (!can_push(bq, uchunk->length))
         return -1;
 
+    pa_trace_instant(PA_TRACE_MEMBLOCKQ_PUSH, (int64_t) uchunk->length);
+
     old = bq->write_index;
     chunk = *uchunk;
 
@@ -342,8 +390,7 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
                 size_t d;
 
                 /* Create a new list entry for the end of the memchunk */
-                if (!(p = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
-                    p = pa_xnew(struct list_item, 1);
+                p = list_item_new(bq);
 
                 p->chunk = q->chunk;
                 pa_memblock_ref(p->chunk.memblock);
@@ -395,6 +442,14 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
         }
     }
 
+    /* Silence doesn't need to be stored: a hole reads back as our
+     * silence block anyway, and takes no memory while it sits in the
+     * queue or in the rewind history */
+    if (bq->silence.memblock && pa_memblock_is_silence(chunk.memblock)) {
+        bq->write_index += (int64_t) chunk.length;
+        goto finish;
+    }
+
     if (q) {
         pa_assert(bq->write_index >=  q->index + (int64_t)q->chunk.length);
         pa_assert(!q->next || (bq->write_index + (int64_t)chunk.length <= q->next->index));
@@ -412,11 +467,21 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     } else
         pa_assert(!bq->blocks || (bq->write_index + (int64_t)chunk.length <= bq->blocks->index));
 
-    if (!(n = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
-        n = pa_xnew(struct list_item, 1);
+    n = list_item_new(bq);
 
     n->chunk = chunk;
-    pa_memblock_ref(n->chunk.memblock);
+
+    /* If there's room in the ring we copy the data there, so that it
+     * can be peeked in any size later on without copying again */
+    if (bq->ring && (n->chunk.memblock = pa_vring_push(bq->ring, &chunk)))
+        n->chunk.index = 0;
+    else {
+        n->chunk.memblock = chunk.memblock;
+
+        /* Queues are usually freed from the main thread */
+        pa_memblock_clear_thread_local(n->chunk.memblock);
+        pa_memblock_ref(n->chunk.memblock);
+    }
     n->index = bq->write_index;
     bq->write_index += (int64_t) n->chunk.length;
 
@@ -529,6 +594,46 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
     return 0;
 }
 
+/* Returns a block of block_size bytes starting at first, which is
+ * what pa_memblockq_peek() returned, if all of it is back to back in
+ * the ring. */
+static pa_memblock *peek_ring_window(pa_memblockq *bq, const pa_memchunk *first, size_t block_size) {
+    pa_memchunk chunks[PA_VRING_WINDOW_MAX];
+    struct list_item *item;
+    size_t covered;
+    unsigned n = 1;
+    int64_t ri;
+
+    chunks[0] = *first;
+    covered = first->length;
+    item = bq->current_read;
+    ri = bq->read_index + first->length;
+
+    while (covered < block_size) {
+        int64_t d;
+
+        /* Holes are filled with silence, which isn't in the ring */
+        if (!item || item->index > ri || n >= PA_VRING_WINDOW_MAX)
+            return NULL;
+
+        d = ri - item->index;
+
+        if (d < (int64_t) item->chunk.length) {
+            chunks[n] = item->chunk;
+            chunks[n].index += (size_t) d;
+            chunks[n].length -= (size_t) d;
+
+            covered += chunks[n].length;
+            ri += chunks[n].length;
+            n++;
+        }
+
+        item = item->next;
+    }
+
+    return pa_vring_window(bq->ring, chunks, n, block_size);
+}
+
 int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchunk *chunk) {
     pa_mempool *pool;
     pa_memchunk tchunk, rchunk;
@@ -549,6 +654,15 @@ int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchun
         return 0;
     }
 
+    if (bq->ring && (rchunk.memblock = peek_ring_window(bq, &tchunk, block_size))) {
+        pa_memblock_unref(tchunk.memblock);
+
+        chunk->memblock = rchunk.memblock;
+        chunk->index = 0;
+        chunk->length = block_size;
+        return 0;
+    }
+
     pool = pa_memblock_get_pool(tchunk.memblock);
     rchunk.memblock = pa_memblock_new(pool, block_size);
     rchunk.index = 0;
@@ -602,6 +716,24 @@ int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchun
     return 0;
 }
 
+int pa_memblockq_enable_ring(pa_memblockq *bq, size_t size) {
+    pa_mempool *pool;
+
+    pa_assert(bq);
+    pa_assert(bq->silence.memblock);
+    pa_assert(!bq->ring);
+
+    pool = pa_memblock_get_pool(bq->silence.memblock);
+    bq->ring = pa_vring_new(pool, size);
+    pa_mempool_unref(pool);
+
+    if (!bq->ring)
+        return -1;
+
+    pa_log_debug("Memblockq %s uses a ring of %lu bytes.", bq->name, (unsigned long) pa_vring_get_size(bq->ring));
+    return 0;
+}
+
 void pa_memblockq_drop(pa_memblockq *bq, size_t length) {
     int64_t old;
     pa_assert(bq);
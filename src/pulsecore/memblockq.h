@@ -61,7 +61,9 @@ typedef struct pa_memblockq pa_memblockq;
 
    - maxrewind: how many bytes of history to keep in the queue
 
-   - silence:   return this memchunk when reading uninitialized data
+   - silence:   return this memchunk when reading uninitialized data.
+                Blocks marked as silence that are pushed into the queue
+                aren't stored, they read back as this memchunk, too.
 */
 pa_memblockq* pa_memblockq_new(
         const char *name,
@@ -100,6 +102,14 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk);
  * silence memchunk for this memblockq if you use this call. */
 int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchunk *chunk);
 
+/* Copy pushed data into a ring of the given size that is mapped twice
+ * in a row, so that pa_memblockq_peek_fixed_size() can hand out any
+ * window of it without copying. Useful for queues that are consumed in
+ * blocks that don't line up with how they are filled. Once the ring is
+ * full, or on systems without memfd, data is queued as usual. The queue
+ * needs a silence block. Returns -1 if the ring can't be set up. */
+int pa_memblockq_enable_ring(pa_memblockq *bq, size_t size);
+
 /* Drop the specified bytes from the queue. */
 void pa_memblockq_drop(pa_memblockq *bq, size_t length);
 
@@ -0,0 +1,282 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/seqlock.h>
+
+#include "metrics.h"
+
+/* Upper bounds of the histogram buckets, in usec. Everything above the
+ * last one only shows up in the +Inf bucket. */
+static const pa_usec_t bucket_bounds[] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000
+};
+
+#define N_BUCKETS PA_ELEMENTSOF(bucket_bounds)
+
+struct family {
+    pa_metrics *metrics;
+    char *name;
+    char *help;
+    pa_metric_type_t type;
+
+    PA_LLIST_HEAD(pa_metric, items);
+};
+
+struct pa_metric {
+    struct family *family;
+    char *labels;
+
+    pa_seqlock lock;
+    uint64_t value; /* Gauges store an int64_t here */
+    uint64_t count, sum;
+    uint64_t buckets[N_BUCKETS];
+
+    PA_LLIST_FIELDS(pa_metric);
+};
+
+struct pa_metrics {
+    pa_hashmap *families;
+};
+
+static void family_free(struct family *f) {
+    pa_assert(!f->items);
+
+    pa_xfree(f->name);
+    pa_xfree(f->help);
+    pa_xfree(f);
+}
+
+pa_metrics *pa_metrics_new(void) {
+    pa_metrics *m;
+
+    m = pa_xnew(pa_metrics, 1);
+    m->families = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                      NULL, (pa_free_cb_t) family_free);
+
+    return m;
+}
+
+void pa_metrics_free(pa_metrics *m) {
+    pa_assert(m);
+
+    /* Everything should have been unregistered by now */
+    pa_assert(pa_hashmap_isempty(m->families));
+
+    pa_hashmap_free(m->families);
+    pa_xfree(m);
+}
+
+static char *format_labels(const char *name, const char *value) {
+    pa_strbuf *s;
+
+    if (!name)
+        return pa_xstrdup("");
+
+    s = pa_strbuf_new();
+    pa_strbuf_printf(s, "%s=\"", name);
+
+    for (; *value; value++) {
+        if (*value == '\\' || *value == '"') {
+            pa_strbuf_putc(s, '\\');
+            pa_strbuf_putc(s, *value);
+        } else if (*value == '\n')
+            pa_strbuf_puts(s, "\\n");
+        else
+            pa_strbuf_putc(s, *value);
+    }
+
+    pa_strbuf_putc(s, '"');
+
+    return pa_strbuf_to_string_free(s);
+}
+
+pa_metric *pa_metrics_register(pa_metrics *m, const char *name, pa_metric_type_t type, const char *help,
+                               const char *label_name, const char *label_value) {
+    struct family *f;
+    pa_metric *metric;
+
+    pa_assert(m);
+    pa_assert(name);
+    pa_assert(help);
+    pa_assert(!label_name == !label_value);
+
+    if ((f = pa_hashmap_get(m->families, name)))
+        pa_assert(f->type == type);
+    else {
+        f = pa_xnew0(struct family, 1);
+        f->metrics = m;
+        f->name = pa_xstrdup(name);
+        f->help = pa_xstrdup(help);
+        f->type = type;
+        pa_hashmap_put(m->families, f->name, f);
+    }
+
+    metric = pa_xnew0(pa_metric, 1);
+    metric->family = f;
+    metric->labels = format_labels(label_name, label_value);
+    pa_atomic_store(&metric->lock.seq, 0);
+
+    PA_LLIST_PREPEND(pa_metric, f->items, metric);
+
+    return metric;
+}
+
+void pa_metric_free(pa_metric *metric) {
+    struct family *f;
+
+    pa_assert(metric);
+
+    f = metric->family;
+    PA_LLIST_REMOVE(pa_metric, f->items, metric);
+
+    if (!f->items)
+        pa_hashmap_remove_and_free(f->metrics->families, f->name);
+
+    pa_xfree(metric->labels);
+    pa_xfree(metric);
+}
+
+void pa_metric_add(pa_metric *metric, uint64_t n) {
+    if (!metric)
+        return;
+
+    pa_seqlock_write_begin(&metric->lock);
+    metric->value += n;
+    pa_seqlock_write_end(&metric->lock);
+}
+
+void pa_metric_set(pa_metric *metric, int64_t value) {
+    if (!metric)
+        return;
+
+    pa_seqlock_write_begin(&metric->lock);
+    metric->value = (uint64_t) value;
+    pa_seqlock_write_end(&metric->lock);
+}
+
+void pa_metric_observe(pa_metric *metric, pa_usec_t usec) {
+    unsigned b;
+
+    if (!metric)
+        return;
+
+    for (b = 0; b < N_BUCKETS; b++)
+        if (usec <= bucket_bounds[b])
+            break;
+
+    pa_seqlock_write_begin(&metric->lock);
+    if (b < N_BUCKETS)
+        metric->buckets[b]++;
+    metric->count++;
+    metric->sum += usec;
+    pa_seqlock_write_end(&metric->lock);
+}
+
+/* Copies the values out of a metric that might be updated concurrently */
+static void metric_snapshot(pa_metric *metric, pa_metric *copy) {
+    unsigned seq;
+
+    do {
+        seq = pa_seqlock_read_begin(&metric->lock);
+        copy->value = metric->value;
+        copy->count = metric->count;
+        copy->sum = metric->sum;
+        memcpy(copy->buckets, metric->buckets, sizeof(copy->buckets));
+    } while (pa_seqlock_read_retry(&metric->lock, seq));
+}
+
+static void histogram_to_strbuf(pa_strbuf *s, const char *name, const char *labels, const pa_metric *v) {
+    uint64_t cumulative = 0;
+    unsigned b;
+
+    for (b = 0; b < N_BUCKETS; b++) {
+        cumulative += v->buckets[b];
+        pa_strbuf_printf(s, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, *labels ? "," : "",
+                         (double) bucket_bounds[b] / PA_USEC_PER_SEC, (unsigned long long) cumulative);
+    }
+
+    pa_strbuf_printf(s, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, *labels ? "," : "",
+                     (unsigned long long) v->count);
+    pa_strbuf_printf(s, "%s_sum%s%s%s %.6f\n", name, *labels ? "{" : "", labels, *labels ? "}" : "",
+                     (double) v->sum / PA_USEC_PER_SEC);
+    pa_strbuf_printf(s, "%s_count%s%s%s %llu\n", name, *labels ? "{" : "", labels, *labels ? "}" : "",
+                     (unsigned long long) v->count);
+}
+
+void pa_metrics_to_strbuf(pa_metrics *m, pa_strbuf *s) {
+    static const char * const type_names[] = {
+        [PA_METRIC_COUNTER] = "counter",
+        [PA_METRIC_GAUGE] = "gauge",
+        [PA_METRIC_HISTOGRAM] = "histogram"
+    };
+    struct family *f;
+    void *state;
+
+    pa_assert(m);
+    pa_assert(s);
+
+    PA_HASHMAP_FOREACH(f, m->families, state) {
+        pa_metric *metric;
+
+        pa_strbuf_printf(s, "# HELP %s %s\n", f->name, f->help);
+        pa_strbuf_printf(s, "# TYPE %s %s\n", f->name, type_names[f->type]);
+
+        PA_LLIST_FOREACH(metric, f->items) {
+            pa_metric v;
+            const char *open = *metric->labels ? "{" : "", *close = *metric->labels ? "}" : "";
+
+            metric_snapshot(metric, &v);
+
+            switch (f->type) {
+                case PA_METRIC_COUNTER:
+                    pa_strbuf_printf(s, "%s%s%s%s %llu\n", f->name, open, metric->labels, close,
+                                     (unsigned long long) v.value);
+                    break;
+
+                case PA_METRIC_GAUGE:
+                    pa_strbuf_printf(s, "%s%s%s%s %lli\n", f->name, open, metric->labels, close,
+                                     (long long) (int64_t) v.value);
+                    break;
+
+                case PA_METRIC_HISTOGRAM:
+                    histogram_to_strbuf(s, f->name, metric->labels, &v);
+                    break;
+            }
+        }
+    }
+}
+
+void pa_metrics_put_gauge(pa_strbuf *s, const char *name, const char *help, int64_t value) {
+    pa_assert(s);
+    pa_assert(name);
+    pa_assert(help);
+
+    pa_strbuf_printf(s, "# HELP %s %s\n# TYPE %s gauge\n%s %lli\n", name, help, name, name, (long long) value);
+}
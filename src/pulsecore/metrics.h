@@ -0,0 +1,73 @@
+#ifndef foopulsecoremetricshfoo
+#define foopulsecoremetricshfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+
+#include <pulsecore/strbuf.h>
+
+/* A registry of counters that the IO threads keep up to date cheaply
+ * and that can be exported in the Prometheus text format.
+ *
+ * Metrics are registered and freed from the main thread. Updating one
+ * never blocks or allocates: each metric must only be updated by one
+ * thread at a time (usually the IO thread of the object it belongs
+ * to), which publishes the value through a sequence lock. Readers on
+ * the main thread retry if they catch an update in progress.
+ *
+ * All update functions accept NULL, so that objects that aren't
+ * registered don't need to be special cased. */
+
+typedef enum pa_metric_type {
+    PA_METRIC_COUNTER,
+    PA_METRIC_GAUGE,
+    PA_METRIC_HISTOGRAM
+} pa_metric_type_t;
+
+typedef struct pa_metrics pa_metrics;
+typedef struct pa_metric pa_metric;
+
+pa_metrics *pa_metrics_new(void);
+void pa_metrics_free(pa_metrics *m);
+
+/* Metrics with the same name form a family and must agree on type and
+ * help text. They are told apart by a single label, e.g. sink="foo".
+ * Histograms measure durations and are exported in seconds. */
+pa_metric *pa_metrics_register(pa_metrics *m, const char *name, pa_metric_type_t type, const char *help,
+                               const char *label_name, const char *label_value);
+void pa_metric_free(pa_metric *metric);
+
+void pa_metric_add(pa_metric *metric, uint64_t n);
+void pa_metric_set(pa_metric *metric, int64_t value);
+void pa_metric_observe(pa_metric *metric, pa_usec_t usec);
+
+static inline void pa_metric_inc(pa_metric *metric) {
+    pa_metric_add(metric, 1);
+}
+
+/* Exports everything in the Prometheus text exposition format */
+void pa_metrics_to_strbuf(pa_metrics *m, pa_strbuf *s);
+
+/* Writes a single gauge family with one unlabelled value, for values
+ * that are cheap to compute when exporting */
+void pa_metrics_put_gauge(pa_strbuf *s, const char *name, const char *help, int64_t value);
+
+#endif
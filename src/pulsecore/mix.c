@@ -35,6 +35,11 @@
 
 #define VOLUME_PADDING 32
 
+/* Number of frames a volume ramp holds the same gain for. Short enough
+ * for the steps not to be audible, long enough for the mixing
+ * functions to still run on full vectors. */
+#define RAMP_BLOCK_FRAMES 32
+
 static void calc_linear_integer_volume(int32_t linear[], const pa_cvolume *volume) {
     unsigned channel, nchannels, padding;
 
@@ -612,6 +617,65 @@ void pa_mix_func_init(const pa_cpu_info *cpu_info) {
         do_mix_table[PA_SAMPLE_S16NE] = (pa_do_mix_func_t) pa_mix_s16ne_c;
 }
 
+/* Sets the linear volumes of a ramping stream to where its ramp is
+ * after pos bytes */
+static void calc_ramp_volumes(pa_mix_info *m, size_t pos, const float sink_linear[], const pa_sample_spec *spec) {
+    unsigned channel;
+
+    for (channel = 0; channel < spec->channels; channel++) {
+        double v;
+
+        v = pa_sw_volume_to_linear(m->volume.values[channel]);
+
+        if (pos < m->ramp_length) {
+            double from = pa_sw_volume_to_linear(m->ramp_volume.values[channel]);
+
+            v = from + (v - from) * (double) pos / (double) m->ramp_length;
+        }
+
+        if (spec->format == PA_SAMPLE_FLOAT32LE || spec->format == PA_SAMPLE_FLOAT32BE)
+            m->linear[channel].f = (float) (v * sink_linear[channel]);
+        else
+            m->linear[channel].i = (int32_t) lrint(v * sink_linear[channel] * 0x10000);
+    }
+}
+
+/* Mixes in blocks of RAMP_BLOCK_FRAMES while any stream is ramping,
+ * with the gain of the ramp in the middle of each block, and the rest
+ * in one go. The ramp thus costs no pass over the data of its own, and
+ * the mixing itself stays with the (possibly vectorized) functions of
+ * do_mix_table. */
+static void mix_ramped(pa_mix_info streams[], unsigned nstreams, void *data, size_t length, const pa_sample_spec *spec, const pa_cvolume *volume) {
+    float sink_linear[PA_CHANNELS_MAX + VOLUME_PADDING];
+    size_t block, ramp_end = 0, pos, n;
+    void *ptr;
+    unsigned k;
+
+    calc_linear_float_volume(sink_linear, volume);
+
+    for (k = 0; k < nstreams; k++)
+        ramp_end = PA_MAX(ramp_end, streams[k].ramp_length);
+
+    block = RAMP_BLOCK_FRAMES * pa_frame_size(spec);
+
+    for (pos = 0; pos < length; pos += n) {
+        n = pos < ramp_end ? PA_MIN(block, length - pos) : length - pos;
+
+        for (k = 0; k < nstreams; k++)
+            if (streams[k].ramp_length > 0)
+                calc_ramp_volumes(streams + k, pos + n / 2, sink_linear, spec);
+
+        ptr = streams[0].ptr;
+        do_mix_table[spec->format](streams, nstreams, spec->channels, (uint8_t *) data + pos, (unsigned) n);
+
+        /* Some of the mixing functions move the pointers on as they go,
+         * the others leave that to us */
+        if (streams[0].ptr == ptr)
+            for (k = 0; k < nstreams; k++)
+                streams[k].ptr = (uint8_t *) streams[k].ptr + n;
+    }
+}
+
 size_t pa_mix(
         pa_mix_info streams[],
         unsigned nstreams,
@@ -622,13 +686,14 @@ size_t pa_mix(
         bool mute) {
 
     pa_cvolume full_volume;
+    bool ramping = false;
     unsigned k;
 
     pa_assert(streams);
     pa_assert(data);
     pa_assert(length);
     pa_assert(spec);
-    pa_assert(nstreams > 1);
+    pa_assert(nstreams > 0);
 
     if (!volume)
         volume = pa_cvolume_reset(&full_volume, spec->channels);
@@ -641,10 +706,17 @@ size_t pa_mix(
     for (k = 0; k < nstreams; k++) {
         pa_assert(length <= streams[k].chunk.length);
         streams[k].ptr = pa_memblock_acquire_chunk(&streams[k].chunk);
+
+        if (streams[k].ramp_length > 0)
+            ramping = true;
     }
 
     calc_stream_volumes_table[spec->format](streams, nstreams, volume, spec);
-    do_mix_table[spec->format](streams, nstreams, spec->channels, data, length);
+
+    if (ramping)
+        mix_ramped(streams, nstreams, data, length, spec, volume);
+    else
+        do_mix_table[spec->format](streams, nstreams, spec->channels, data, length);
 
     for (k = 0; k < nstreams; k++)
         pa_memblock_release(streams[k].chunk.memblock);
@@ -687,29 +759,26 @@ static const pa_calc_volume_func_t calc_volume_table[] = {
   [PA_SAMPLE_S24_32BE]  = (pa_calc_volume_func_t) calc_linear_integer_volume
 };
 
-void pa_volume_memchunk(
-        pa_memchunk*c,
+void pa_volume_memory(
+        void *p,
+        size_t length,
         const pa_sample_spec *spec,
         const pa_cvolume *volume) {
 
-    void *ptr;
     volume_val linear[PA_CHANNELS_MAX + VOLUME_PADDING];
     pa_do_volume_func_t do_volume;
 
-    pa_assert(c);
+    pa_assert(p);
     pa_assert(spec);
     pa_assert(pa_sample_spec_valid(spec));
-    pa_assert(pa_frame_aligned(c->length, spec));
+    pa_assert(pa_frame_aligned(length, spec));
     pa_assert(volume);
 
-    if (pa_memblock_is_silence(c->memblock))
-        return;
-
     if (pa_cvolume_is_norm(volume))
         return;
 
     if (pa_cvolume_is_muted(volume)) {
-        pa_silence_memchunk(c, spec);
+        pa_silence_memory(p, length, spec);
         return;
     }
 
@@ -718,9 +787,74 @@ void pa_volume_memchunk(
 
     calc_volume_table[spec->format] ((void *)linear, volume);
 
-    ptr = pa_memblock_acquire_chunk(c);
+    do_volume(p, (void *)linear, spec->channels, length);
+}
+
+void pa_volume_memchunk(
+        pa_memchunk*c,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume) {
+
+    pa_assert(c);
+    pa_assert(spec);
+    pa_assert(volume);
 
-    do_volume(ptr, (void *)linear, spec->channels, c->length);
+    if (pa_memblock_is_silence(c->memblock))
+        return;
 
+    if (pa_cvolume_is_norm(volume))
+        return;
+
+    if (pa_cvolume_is_muted(volume)) {
+        pa_silence_memchunk(c, spec);
+        return;
+    }
+
+    pa_volume_memory(pa_memblock_acquire_chunk(c), c->length, spec, volume);
     pa_memblock_release(c->memblock);
 }
+
+void pa_volume_memchunk_copy(
+        pa_memchunk *dst,
+        const pa_memchunk *src,
+        const pa_sample_spec *spec,
+        const pa_cvolume *volume) {
+
+    pa_mempool *pool;
+    pa_mix_info info;
+
+    pa_assert(dst);
+    pa_assert(src);
+    pa_assert(src->memblock);
+    pa_assert(spec);
+    pa_assert(volume);
+
+    if (pa_memblock_is_silence(src->memblock) || pa_cvolume_is_norm(volume)) {
+        *dst = *src;
+        pa_memblock_ref(dst->memblock);
+        return;
+    }
+
+    pool = pa_memblock_get_pool(src->memblock);
+    dst->memblock = pa_memblock_new(pool, src->length);
+    pa_mempool_unref(pool);
+
+    dst->index = 0;
+    dst->length = src->length;
+
+    if (pa_cvolume_is_muted(volume)) {
+        pa_silence_memchunk(dst, spec);
+        return;
+    }
+
+    /* Mixing a single stream reads the source once and writes the
+     * scaled samples to the destination, so there's no separate
+     * copy pass */
+    info.chunk = *src;
+    info.volume = *volume;
+    info.userdata = NULL;
+    info.ramp_length = 0;
+
+    pa_mix(&info, 1, pa_memblock_acquire(dst->memblock), dst->length, spec, NULL, false);
+    pa_memblock_release(dst->memblock);
+}
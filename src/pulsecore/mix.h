@@ -31,6 +31,13 @@ typedef struct pa_mix_info {
     pa_cvolume volume;
     void *userdata;
 
+    /* If ramp_length is not 0, the volume of the stream moves linearly
+     * from ramp_volume to volume over the first ramp_length bytes
+     * instead of being applied right away. Set it to 0 if the stream
+     * doesn't ramp. */
+    pa_cvolume ramp_volume;
+    size_t ramp_length;
+
     /* The following fields are used internally by pa_mix(), should
      * not be initialised by the caller of pa_mix(). */
     void *ptr;
@@ -59,4 +66,21 @@ void pa_volume_memchunk(
     const pa_sample_spec *spec,
     const pa_cvolume *volume);
 
+/* Like pa_volume_memchunk(), but leaves src alone and returns the
+ * scaled data in a new reference in dst. Copying and scaling happen in
+ * a single pass. If there is nothing to scale dst simply references
+ * src's block. */
+void pa_volume_memchunk_copy(
+    pa_memchunk *dst,
+    const pa_memchunk *src,
+    const pa_sample_spec *spec,
+    const pa_cvolume *volume);
+
+/* Like pa_volume_memchunk(), but on plain memory */
+void pa_volume_memory(
+    void *p,
+    size_t length,
+    const pa_sample_spec *spec,
+    const pa_cvolume *volume);
+
 #endif
@@ -0,0 +1,961 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+#include <pulsecore/endianmacros.h>
+
+#include "cpu-x86.h"
+#include "mix.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+/* The functions below are built with per-function target attributes, so
+ * this file does not need any special compiler flags and the CPU flags
+ * decide at runtime which variant gets used. */
+#include <immintrin.h>
+
+#define SSE2_FUNC __attribute__((target("sse2")))
+#define AVX2_FUNC __attribute__((target("avx2")))
+
+/* Streams beyond this are mixed through the block accumulator, which only
+ * keeps the volumes of one stream around at a time. */
+#define MAX_REG_STREAMS 32
+
+/* Number of output vectors accumulated at once by the block mixers. */
+#define BLOCK_VECS 128
+
+static pa_do_mix_func_t fallback_s16ne;
+static pa_do_mix_func_t fallback_s32ne;
+static pa_do_mix_func_t fallback_s24ne;
+static pa_do_mix_func_t fallback_s24_32ne;
+static pa_do_mix_func_t fallback_float32ne;
+
+/* Number of vectors after which the per-lane channel layout repeats.
+ * lanes is a power of two, so we just strip the common power of two. */
+static unsigned pattern_period(unsigned channels, unsigned lanes) {
+    while (lanes > 1 && !(channels & 1)) {
+        channels >>= 1;
+        lanes >>= 1;
+    }
+
+    return channels;
+}
+
+/* The SIMD kernels use unsigned multiplies for the volume factor, so they
+ * can't handle the (overflowed) negative factors the C code skips. */
+static bool integer_volumes_ok(pa_mix_info streams[], unsigned nstreams, unsigned channels) {
+    unsigned i, c;
+
+    for (i = 0; i < nstreams; i++)
+        for (c = 0; c < channels; c++)
+            if (streams[i].linear[c].i < 0)
+                return false;
+
+    return true;
+}
+
+static void advance_streams(pa_mix_info streams[], unsigned nstreams, size_t bytes) {
+    unsigned i;
+
+    for (i = 0; i < nstreams; i++)
+        streams[i].ptr = (uint8_t*) streams[i].ptr + bytes;
+}
+
+static void build_volumes_s16(int16_t lo[], int16_t hi[], const pa_mix_info *m, unsigned channels, unsigned n) {
+    unsigned k, c = 0;
+
+    for (k = 0; k < n; k++) {
+        lo[k] = (int16_t) (m->linear[c].i & 0xFFFF);
+        hi[k] = (int16_t) (m->linear[c].i >> 16);
+
+        if (++c >= channels)
+            c = 0;
+    }
+}
+
+static void build_volumes_s32(int32_t v[], const pa_mix_info *m, unsigned channels, unsigned n) {
+    unsigned k, c = 0;
+
+    for (k = 0; k < n; k++) {
+        v[k] = m->linear[c].i;
+
+        if (++c >= channels)
+            c = 0;
+    }
+}
+
+static void build_volumes_float(float v[], const pa_mix_info *m, unsigned channels, unsigned n) {
+    unsigned k, c = 0;
+
+    for (k = 0; k < n; k++) {
+        /* The C code skips factors <= 0, multiplying by 0 is the same */
+        v[k] = m->linear[c].f > 0 ? m->linear[c].f : 0;
+
+        if (++c >= channels)
+            c = 0;
+    }
+}
+
+/*
+ * s16ne
+ *
+ * pa_mult_s16_volume() computes (v * cv) >> 16 with a 48 bit product. We
+ * split cv into hi and lo 16 bit halves: (v * lo) >> 16 is a signed by
+ * unsigned high multiply, and pmaddwd then adds v * hi to it in one go by
+ * pairing (v, (v * lo) >> 16) with (hi, 1). The result is bit exact.
+ */
+
+typedef struct s16_vol_sse2 {
+    __m128i lo, ml, mh;
+} s16_vol_sse2;
+
+static SSE2_FUNC void s16_vol_load_sse2(s16_vol_sse2 *v, const int16_t lo[], const int16_t hi[]) {
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i h = _mm_loadu_si128((const __m128i*) hi);
+
+    v->lo = _mm_loadu_si128((const __m128i*) lo);
+    v->ml = _mm_unpacklo_epi16(h, ones);
+    v->mh = _mm_unpackhi_epi16(h, ones);
+}
+
+static inline SSE2_FUNC void s16_mult_sse2(__m128i s, const s16_vol_sse2 *v, __m128i *l, __m128i *h) {
+    __m128i p;
+
+    p = _mm_sub_epi16(_mm_mulhi_epu16(s, v->lo), _mm_and_si128(v->lo, _mm_srai_epi16(s, 15)));
+    *l = _mm_madd_epi16(_mm_unpacklo_epi16(s, p), v->ml);
+    *h = _mm_madd_epi16(_mm_unpackhi_epi16(s, p), v->mh);
+}
+
+/* special case: mix 2 s16ne streams, channel layout repeating every vector */
+static SSE2_FUNC void mix2_s16ne_sse2(pa_mix_info streams[], unsigned channels, int16_t *data, unsigned n) {
+    const int16_t *ptr0 = streams[0].ptr;
+    const int16_t *ptr1 = streams[1].ptr;
+    int16_t lo[8], hi[8];
+    s16_vol_sse2 v0, v1;
+
+    build_volumes_s16(lo, hi, &streams[0], channels, 8);
+    s16_vol_load_sse2(&v0, lo, hi);
+    build_volumes_s16(lo, hi, &streams[1], channels, 8);
+    s16_vol_load_sse2(&v1, lo, hi);
+
+    for (; n > 0; n -= 8, ptr0 += 8, ptr1 += 8, data += 8) {
+        __m128i l0, h0, l1, h1;
+
+        s16_mult_sse2(_mm_loadu_si128((const __m128i*) ptr0), &v0, &l0, &h0);
+        s16_mult_sse2(_mm_loadu_si128((const __m128i*) ptr1), &v1, &l1, &h1);
+
+        _mm_storeu_si128((__m128i*) data, _mm_packs_epi32(_mm_add_epi32(l0, l1), _mm_add_epi32(h0, h1)));
+    }
+}
+
+/* special case: channel layout repeating every vector (mono, stereo, 4 and
+ * 8 channels), sums are kept in registers */
+static SSE2_FUNC void mix_vec_s16ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned n) {
+    s16_vol_sse2 v[MAX_REG_STREAMS];
+    unsigned i, k;
+
+    for (i = 0; i < nstreams; i++) {
+        int16_t lo[8], hi[8];
+
+        build_volumes_s16(lo, hi, &streams[i], channels, 8);
+        s16_vol_load_sse2(&v[i], lo, hi);
+    }
+
+    for (k = 0; k < n; k += 8, data += 8) {
+        __m128i suml = _mm_setzero_si128(), sumh = _mm_setzero_si128();
+
+        for (i = 0; i < nstreams; i++) {
+            __m128i l, h;
+
+            s16_mult_sse2(_mm_loadu_si128((const __m128i*) ((const int16_t*) streams[i].ptr + k)), &v[i], &l, &h);
+            suml = _mm_add_epi32(suml, l);
+            sumh = _mm_add_epi32(sumh, h);
+        }
+
+        _mm_storeu_si128((__m128i*) data, _mm_packs_epi32(suml, sumh));
+    }
+}
+
+/* any channel count: accumulate one stream at a time into a small block */
+static SSE2_FUNC void mix_block_s16ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, unsigned period, int16_t *data, unsigned n) {
+    __m128i acc[BLOCK_VECS * 2];
+    int16_t lo[8 * PA_CHANNELS_MAX], hi[8 * PA_CHANNELS_MAX];
+    s16_vol_sse2 v[PA_CHANNELS_MAX];
+    const unsigned block = (BLOCK_VECS / period) * period;
+    unsigned done, i, j;
+
+    for (done = 0; done < n; ) {
+        unsigned nvec = PA_MIN(block, (n - done) / 8);
+
+        memset(acc, 0, sizeof(__m128i) * 2 * nvec);
+
+        for (i = 0; i < nstreams; i++) {
+            const int16_t *ptr = (const int16_t*) streams[i].ptr + done;
+
+            build_volumes_s16(lo, hi, &streams[i], channels, 8 * period);
+            for (j = 0; j < period; j++)
+                s16_vol_load_sse2(&v[j], lo + 8 * j, hi + 8 * j);
+
+            for (j = 0; j < nvec; j++) {
+                __m128i l, h;
+
+                s16_mult_sse2(_mm_loadu_si128((const __m128i*) (ptr + 8 * j)), &v[j % period], &l, &h);
+                acc[2 * j] = _mm_add_epi32(acc[2 * j], l);
+                acc[2 * j + 1] = _mm_add_epi32(acc[2 * j + 1], h);
+            }
+        }
+
+        for (j = 0; j < nvec; j++)
+            _mm_storeu_si128((__m128i*) (data + done + 8 * j), _mm_packs_epi32(acc[2 * j], acc[2 * j + 1]));
+
+        done += 8 * nvec;
+    }
+}
+
+static void pa_mix_s16ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned length) {
+    unsigned period = pattern_period(channels, 8);
+    unsigned n = length / sizeof(int16_t);
+
+    /* Only do whole layout periods, so that the rest starts on channel 0 */
+    n -= n % (8 * period);
+
+    if (n == 0 || !integer_volumes_ok(streams, nstreams, channels)) {
+        fallback_s16ne(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    if (period == 1 && nstreams == 2)
+        mix2_s16ne_sse2(streams, channels, data, n);
+    else if (period == 1 && nstreams <= MAX_REG_STREAMS)
+        mix_vec_s16ne_sse2(streams, nstreams, channels, data, n);
+    else
+        mix_block_s16ne_sse2(streams, nstreams, channels, period, data, n);
+
+    advance_streams(streams, nstreams, n * sizeof(int16_t));
+
+    if (length > n * sizeof(int16_t))
+        fallback_s16ne(streams, nstreams, channels, data + n, length - n * sizeof(int16_t));
+}
+
+typedef struct s16_vol_avx2 {
+    __m256i lo, ml, mh;
+} s16_vol_avx2;
+
+static AVX2_FUNC void s16_vol_load_avx2(s16_vol_avx2 *v, const int16_t lo[], const int16_t hi[]) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i h = _mm256_loadu_si256((const __m256i*) hi);
+
+    v->lo = _mm256_loadu_si256((const __m256i*) lo);
+    v->ml = _mm256_unpacklo_epi16(h, ones);
+    v->mh = _mm256_unpackhi_epi16(h, ones);
+}
+
+/* unpack and pack both work within 128 bit lanes, so the sample order
+ * comes out right after _mm256_packs_epi32() */
+static inline AVX2_FUNC void s16_mult_avx2(__m256i s, const s16_vol_avx2 *v, __m256i *l, __m256i *h) {
+    __m256i p;
+
+    p = _mm256_sub_epi16(_mm256_mulhi_epu16(s, v->lo), _mm256_and_si256(v->lo, _mm256_srai_epi16(s, 15)));
+    *l = _mm256_madd_epi16(_mm256_unpacklo_epi16(s, p), v->ml);
+    *h = _mm256_madd_epi16(_mm256_unpackhi_epi16(s, p), v->mh);
+}
+
+static AVX2_FUNC void mix2_s16ne_avx2(pa_mix_info streams[], unsigned channels, int16_t *data, unsigned n) {
+    const int16_t *ptr0 = streams[0].ptr;
+    const int16_t *ptr1 = streams[1].ptr;
+    int16_t lo[16], hi[16];
+    s16_vol_avx2 v0, v1;
+
+    build_volumes_s16(lo, hi, &streams[0], channels, 16);
+    s16_vol_load_avx2(&v0, lo, hi);
+    build_volumes_s16(lo, hi, &streams[1], channels, 16);
+    s16_vol_load_avx2(&v1, lo, hi);
+
+    for (; n > 0; n -= 16, ptr0 += 16, ptr1 += 16, data += 16) {
+        __m256i l0, h0, l1, h1;
+
+        s16_mult_avx2(_mm256_loadu_si256((const __m256i*) ptr0), &v0, &l0, &h0);
+        s16_mult_avx2(_mm256_loadu_si256((const __m256i*) ptr1), &v1, &l1, &h1);
+
+        _mm256_storeu_si256((__m256i*) data, _mm256_packs_epi32(_mm256_add_epi32(l0, l1), _mm256_add_epi32(h0, h1)));
+    }
+}
+
+static AVX2_FUNC void mix_vec_s16ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned n) {
+    s16_vol_avx2 v[MAX_REG_STREAMS];
+    unsigned i, k;
+
+    for (i = 0; i < nstreams; i++) {
+        int16_t lo[16], hi[16];
+
+        build_volumes_s16(lo, hi, &streams[i], channels, 16);
+        s16_vol_load_avx2(&v[i], lo, hi);
+    }
+
+    for (k = 0; k < n; k += 16, data += 16) {
+        __m256i suml = _mm256_setzero_si256(), sumh = _mm256_setzero_si256();
+
+        for (i = 0; i < nstreams; i++) {
+            __m256i l, h;
+
+            s16_mult_avx2(_mm256_loadu_si256((const __m256i*) ((const int16_t*) streams[i].ptr + k)), &v[i], &l, &h);
+            suml = _mm256_add_epi32(suml, l);
+            sumh = _mm256_add_epi32(sumh, h);
+        }
+
+        _mm256_storeu_si256((__m256i*) data, _mm256_packs_epi32(suml, sumh));
+    }
+}
+
+static AVX2_FUNC void mix_block_s16ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, unsigned period, int16_t *data, unsigned n) {
+    __m256i acc[BLOCK_VECS];
+    int16_t lo[16 * PA_CHANNELS_MAX], hi[16 * PA_CHANNELS_MAX];
+    s16_vol_avx2 v[PA_CHANNELS_MAX];
+    const unsigned block = (BLOCK_VECS / 2 / period) * period;
+    unsigned done, i, j;
+
+    for (done = 0; done < n; ) {
+        unsigned nvec = PA_MIN(block, (n - done) / 16);
+
+        memset(acc, 0, sizeof(__m256i) * 2 * nvec);
+
+        for (i = 0; i < nstreams; i++) {
+            const int16_t *ptr = (const int16_t*) streams[i].ptr + done;
+
+            build_volumes_s16(lo, hi, &streams[i], channels, 16 * period);
+            for (j = 0; j < period; j++)
+                s16_vol_load_avx2(&v[j], lo + 16 * j, hi + 16 * j);
+
+            for (j = 0; j < nvec; j++) {
+                __m256i l, h;
+
+                s16_mult_avx2(_mm256_loadu_si256((const __m256i*) (ptr + 16 * j)), &v[j % period], &l, &h);
+                acc[2 * j] = _mm256_add_epi32(acc[2 * j], l);
+                acc[2 * j + 1] = _mm256_add_epi32(acc[2 * j + 1], h);
+            }
+        }
+
+        for (j = 0; j < nvec; j++)
+            _mm256_storeu_si256((__m256i*) (data + done + 16 * j), _mm256_packs_epi32(acc[2 * j], acc[2 * j + 1]));
+
+        done += 16 * nvec;
+    }
+}
+
+static void pa_mix_s16ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned length) {
+    unsigned period = pattern_period(channels, 16);
+    unsigned n = length / sizeof(int16_t);
+
+    n -= n % (16 * period);
+
+    if (n == 0 || !integer_volumes_ok(streams, nstreams, channels)) {
+        pa_mix_s16ne_sse2(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    if (period == 1 && nstreams == 2)
+        mix2_s16ne_avx2(streams, channels, data, n);
+    else if (period == 1 && nstreams <= MAX_REG_STREAMS)
+        mix_vec_s16ne_avx2(streams, nstreams, channels, data, n);
+    else
+        mix_block_s16ne_avx2(streams, nstreams, channels, period, data, n);
+
+    advance_streams(streams, nstreams, n * sizeof(int16_t));
+
+    if (length > n * sizeof(int16_t))
+        pa_mix_s16ne_sse2(streams, nstreams, channels, data + n, length - n * sizeof(int16_t));
+}
+
+/*
+ * s32ne
+ *
+ * The C code does ((int64_t) v * cv) >> 16 and sums in 64 bit before
+ * clamping. SSE2 has neither a signed 32x32->64 multiply nor a 64 bit
+ * arithmetic shift or compare, so these are built from what is there.
+ * Even and odd samples go through separate 64 bit lanes.
+ */
+
+/* signed v * non-negative cv, using the even 32 bit lanes */
+static inline SSE2_FUNC __m128i s32_mul_even_sse2(__m128i s, __m128i cv) {
+    __m128i fix = _mm_slli_epi64(_mm_and_si128(cv, _mm_srai_epi32(s, 31)), 32);
+
+    return _mm_sub_epi64(_mm_mul_epu32(s, cv), fix);
+}
+
+static inline SSE2_FUNC __m128i s64_sra16_sse2(__m128i x) {
+    __m128i sign = _mm_srai_epi32(_mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 1, 1)), 31);
+
+    return _mm_or_si128(_mm_srli_epi64(x, 16), _mm_slli_epi64(sign, 48));
+}
+
+/* clamp 64 bit sums to 32 bit, the result is in the even 32 bit lanes */
+static inline SSE2_FUNC __m128i s64_clamp_sse2(__m128i x) {
+    __m128i hi = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 1, 1));
+    __m128i ok = _mm_cmpeq_epi32(hi, _mm_srai_epi32(x, 31));
+    __m128i sat = _mm_xor_si128(_mm_srai_epi32(hi, 31), _mm_set1_epi32(0x7FFFFFFF));
+
+    return _mm_or_si128(_mm_and_si128(ok, x), _mm_andnot_si128(ok, sat));
+}
+
+static inline SSE2_FUNC __m128i s32_combine_sse2(__m128i even, __m128i odd) {
+    const __m128i mask = _mm_set_epi32(0, -1, 0, -1);
+
+    return _mm_or_si128(_mm_and_si128(s64_clamp_sse2(even), mask), _mm_slli_epi64(s64_clamp_sse2(odd), 32));
+}
+
+static inline SSE2_FUNC void s32_mult_add_sse2(__m128i s, __m128i cv, __m128i *even, __m128i *odd) {
+    __m128i so = _mm_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 1, 1));
+    __m128i co = _mm_shuffle_epi32(cv, _MM_SHUFFLE(3, 3, 1, 1));
+
+    *even = _mm_add_epi64(*even, s64_sra16_sse2(s32_mul_even_sse2(s, cv)));
+    *odd = _mm_add_epi64(*odd, s64_sra16_sse2(s32_mul_even_sse2(so, co)));
+}
+
+static SSE2_FUNC void mix_vec_s32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned n, unsigned shift) {
+    const __m128i sh = _mm_cvtsi32_si128((int) shift);
+    __m128i v[MAX_REG_STREAMS];
+    unsigned i, k;
+
+    for (i = 0; i < nstreams; i++) {
+        int32_t cv[4];
+
+        build_volumes_s32(cv, &streams[i], channels, 4);
+        v[i] = _mm_loadu_si128((const __m128i*) cv);
+    }
+
+    for (k = 0; k < n; k += 4, data += 4) {
+        __m128i even = _mm_setzero_si128(), odd = _mm_setzero_si128();
+
+        for (i = 0; i < nstreams; i++)
+            s32_mult_add_sse2(_mm_sll_epi32(_mm_loadu_si128((const __m128i*) ((const int32_t*) streams[i].ptr + k)), sh), v[i], &even, &odd);
+
+        _mm_storeu_si128((__m128i*) data, _mm_srl_epi32(s32_combine_sse2(even, odd), sh));
+    }
+}
+
+static SSE2_FUNC void mix_block_s32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, unsigned period, int32_t *data, unsigned n, unsigned shift) {
+    const __m128i sh = _mm_cvtsi32_si128((int) shift);
+    __m128i acc[BLOCK_VECS * 2];
+    int32_t cv[4 * PA_CHANNELS_MAX];
+    const unsigned block = (BLOCK_VECS / period) * period;
+    unsigned done, i, j;
+
+    for (done = 0; done < n; ) {
+        unsigned nvec = PA_MIN(block, (n - done) / 4);
+
+        memset(acc, 0, sizeof(__m128i) * 2 * nvec);
+
+        for (i = 0; i < nstreams; i++) {
+            const int32_t *ptr = (const int32_t*) streams[i].ptr + done;
+
+            build_volumes_s32(cv, &streams[i], channels, 4 * period);
+
+            for (j = 0; j < nvec; j++)
+                s32_mult_add_sse2(_mm_sll_epi32(_mm_loadu_si128((const __m128i*) (ptr + 4 * j)), sh),
+                                  _mm_loadu_si128((const __m128i*) (cv + 4 * (j % period))),
+                                  &acc[2 * j], &acc[2 * j + 1]);
+        }
+
+        for (j = 0; j < nvec; j++)
+            _mm_storeu_si128((__m128i*) (data + done + 4 * j), _mm_srl_epi32(s32_combine_sse2(acc[2 * j], acc[2 * j + 1]), sh));
+
+        done += 4 * nvec;
+    }
+}
+
+/* shift is 0 for s32ne and 8 for s24_32ne, whose samples are s32
+ * shifted down by 8 bits, the top 8 bits being ignored on input and
+ * zero on output */
+static void mix_s32_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned length,
+                         unsigned shift, pa_do_mix_func_t fallback) {
+    unsigned period = pattern_period(channels, 4);
+    unsigned n = length / sizeof(int32_t);
+
+    n -= n % (4 * period);
+
+    if (n == 0 || !integer_volumes_ok(streams, nstreams, channels)) {
+        fallback(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    if (period == 1 && nstreams <= MAX_REG_STREAMS)
+        mix_vec_s32ne_sse2(streams, nstreams, channels, data, n, shift);
+    else
+        mix_block_s32ne_sse2(streams, nstreams, channels, period, data, n, shift);
+
+    advance_streams(streams, nstreams, n * sizeof(int32_t));
+
+    if (length > n * sizeof(int32_t))
+        fallback(streams, nstreams, channels, data + n, length - n * sizeof(int32_t));
+}
+
+static void pa_mix_s32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned length) {
+    mix_s32_sse2(streams, nstreams, channels, data, length, 0, fallback_s32ne);
+}
+
+static void pa_mix_s24_32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, uint32_t *data, unsigned length) {
+    mix_s32_sse2(streams, nstreams, channels, (int32_t*) data, length, 8, fallback_s24_32ne);
+}
+
+/* AVX2 has the signed multiply and the 64 bit compare, only the shift
+ * still needs to be emulated */
+static inline AVX2_FUNC __m256i s64_sra16_avx2(__m256i x) {
+    __m256i sign = _mm256_srai_epi32(_mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 1, 1)), 31);
+
+    return _mm256_or_si256(_mm256_srli_epi64(x, 16), _mm256_slli_epi64(sign, 48));
+}
+
+static inline AVX2_FUNC __m256i s64_clamp_avx2(__m256i x) {
+    const __m256i max = _mm256_set1_epi64x(0x7FFFFFFFLL);
+    const __m256i min = _mm256_set1_epi64x(-0x80000000LL);
+
+    x = _mm256_blendv_epi8(x, max, _mm256_cmpgt_epi64(x, max));
+    return _mm256_blendv_epi8(x, min, _mm256_cmpgt_epi64(min, x));
+}
+
+static inline AVX2_FUNC __m256i s32_combine_avx2(__m256i even, __m256i odd) {
+    return _mm256_blend_epi32(s64_clamp_avx2(even), _mm256_slli_epi64(s64_clamp_avx2(odd), 32), 0xAA);
+}
+
+static inline AVX2_FUNC void s32_mult_add_avx2(__m256i s, __m256i cv, __m256i *even, __m256i *odd) {
+    __m256i so = _mm256_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 1, 1));
+    __m256i co = _mm256_shuffle_epi32(cv, _MM_SHUFFLE(3, 3, 1, 1));
+
+    *even = _mm256_add_epi64(*even, s64_sra16_avx2(_mm256_mul_epi32(s, cv)));
+    *odd = _mm256_add_epi64(*odd, s64_sra16_avx2(_mm256_mul_epi32(so, co)));
+}
+
+static AVX2_FUNC void mix_vec_s32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned n, unsigned shift) {
+    const __m128i sh = _mm_cvtsi32_si128((int) shift);
+    __m256i v[MAX_REG_STREAMS];
+    unsigned i, k;
+
+    for (i = 0; i < nstreams; i++) {
+        int32_t cv[8];
+
+        build_volumes_s32(cv, &streams[i], channels, 8);
+        v[i] = _mm256_loadu_si256((const __m256i*) cv);
+    }
+
+    for (k = 0; k < n; k += 8, data += 8) {
+        __m256i even = _mm256_setzero_si256(), odd = _mm256_setzero_si256();
+
+        for (i = 0; i < nstreams; i++)
+            s32_mult_add_avx2(_mm256_sll_epi32(_mm256_loadu_si256((const __m256i*) ((const int32_t*) streams[i].ptr + k)), sh), v[i], &even, &odd);
+
+        _mm256_storeu_si256((__m256i*) data, _mm256_srl_epi32(s32_combine_avx2(even, odd), sh));
+    }
+}
+
+static AVX2_FUNC void mix_block_s32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, unsigned period, int32_t *data, unsigned n, unsigned shift) {
+    const __m128i sh = _mm_cvtsi32_si128((int) shift);
+    __m256i acc[BLOCK_VECS];
+    int32_t cv[8 * PA_CHANNELS_MAX];
+    const unsigned block = (BLOCK_VECS / 2 / period) * period;
+    unsigned done, i, j;
+
+    for (done = 0; done < n; ) {
+        unsigned nvec = PA_MIN(block, (n - done) / 8);
+
+        memset(acc, 0, sizeof(__m256i) * 2 * nvec);
+
+        for (i = 0; i < nstreams; i++) {
+            const int32_t *ptr = (const int32_t*) streams[i].ptr + done;
+
+            build_volumes_s32(cv, &streams[i], channels, 8 * period);
+
+            for (j = 0; j < nvec; j++)
+                s32_mult_add_avx2(_mm256_sll_epi32(_mm256_loadu_si256((const __m256i*) (ptr + 8 * j)), sh),
+                                  _mm256_loadu_si256((const __m256i*) (cv + 8 * (j % period))),
+                                  &acc[2 * j], &acc[2 * j + 1]);
+        }
+
+        for (j = 0; j < nvec; j++)
+            _mm256_storeu_si256((__m256i*) (data + done + 8 * j), _mm256_srl_epi32(s32_combine_avx2(acc[2 * j], acc[2 * j + 1]), sh));
+
+        done += 8 * nvec;
+    }
+}
+
+static void mix_s32_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned length,
+                         unsigned shift, pa_do_mix_func_t fallback) {
+    unsigned period = pattern_period(channels, 8);
+    unsigned n = length / sizeof(int32_t);
+
+    n -= n % (8 * period);
+
+    if (n == 0 || !integer_volumes_ok(streams, nstreams, channels)) {
+        mix_s32_sse2(streams, nstreams, channels, data, length, shift, fallback);
+        return;
+    }
+
+    if (period == 1 && nstreams <= MAX_REG_STREAMS)
+        mix_vec_s32ne_avx2(streams, nstreams, channels, data, n, shift);
+    else
+        mix_block_s32ne_avx2(streams, nstreams, channels, period, data, n, shift);
+
+    advance_streams(streams, nstreams, n * sizeof(int32_t));
+
+    if (length > n * sizeof(int32_t))
+        mix_s32_sse2(streams, nstreams, channels, data + n, length - n * sizeof(int32_t), shift, fallback);
+}
+
+static void pa_mix_s32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned length) {
+    mix_s32_avx2(streams, nstreams, channels, data, length, 0, fallback_s32ne);
+}
+
+static void pa_mix_s24_32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, uint32_t *data, unsigned length) {
+    mix_s32_avx2(streams, nstreams, channels, (int32_t*) data, length, 8, fallback_s24_32ne);
+}
+
+/*
+ * s24ne
+ *
+ * Packed 24 bit samples don't fit vector lanes. Each stream is unpacked
+ * tile by tile into s24_32ne words, those are mixed by the s24_32ne
+ * kernel, and the result is packed again. This is bit exact with the C
+ * code, which does the same per sample. With AVX2 the unpacking and
+ * packing is done with byte shuffles, too.
+ */
+
+#define S24_TILE_SAMPLES 256
+
+typedef void (*s24_unpack_func_t)(uint32_t *dst, const uint8_t *src, unsigned n);
+typedef void (*s24_pack_func_t)(uint8_t *dst, const uint32_t *src, unsigned n);
+
+static void s24_unpack_c(uint32_t *dst, const uint8_t *src, unsigned n) {
+    for (; n > 0; n--, src += 3)
+        *(dst++) = PA_READ24NE(src);
+}
+
+static void s24_pack_c(uint8_t *dst, const uint32_t *src, unsigned n) {
+    for (; n > 0; n--, dst += 3)
+        PA_WRITE24NE(dst, *(src++));
+}
+
+/* x86 is little endian, so the 3 bytes of a sample go to the low 3
+ * bytes of its word and back */
+static AVX2_FUNC void s24_unpack_avx2(uint32_t *dst, const uint8_t *src, unsigned n) {
+    /* the low lane gets input bytes 0..15, the high one bytes 12..27 */
+    const __m256i perm = _mm256_setr_epi32(0, 1, 2, 3, 3, 4, 5, 6);
+    const __m256i shuf = _mm256_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+    /* Each step reads 32 bytes but consumes only 24 */
+    for (; n >= 11; n -= 8, src += 24, dst += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) src);
+
+        v = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, perm), shuf);
+        _mm256_storeu_si256((__m256i*) dst, v);
+    }
+
+    s24_unpack_c(dst, src, n);
+}
+
+static AVX2_FUNC void s24_pack_avx2(uint8_t *dst, const uint32_t *src, unsigned n) {
+    const __m256i shuf = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+    for (; n >= 8; n -= 8, src += 8, dst += 24) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) src);
+
+        v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, shuf), perm);
+        _mm_storeu_si128((__m128i*) dst, _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i*) (dst + 16), _mm256_extracti128_si256(v, 1));
+    }
+
+    s24_pack_c(dst, src, n);
+}
+
+static void mix_s24ne_tiled(pa_mix_info streams[], unsigned nstreams, unsigned channels, uint8_t *data, unsigned length,
+                            pa_do_mix_func_t mix_s24_32ne, s24_unpack_func_t unpack, s24_pack_func_t pack) {
+    uint32_t in[MAX_REG_STREAMS][S24_TILE_SAMPLES];
+    uint32_t out[S24_TILE_SAMPLES];
+    uint8_t *ptrs[MAX_REG_STREAMS];
+    /* Tiles have to start on a frame boundary for the volumes to line up */
+    const unsigned tile = (S24_TILE_SAMPLES / channels) * channels;
+    unsigned n = length / 3, i;
+
+    if (nstreams > MAX_REG_STREAMS) {
+        fallback_s24ne(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    for (i = 0; i < nstreams; i++)
+        ptrs[i] = streams[i].ptr;
+
+    while (n > 0) {
+        unsigned t = PA_MIN(tile, n);
+
+        for (i = 0; i < nstreams; i++) {
+            unpack(in[i], ptrs[i], t);
+            ptrs[i] += 3 * t;
+            streams[i].ptr = in[i];
+        }
+
+        mix_s24_32ne(streams, nstreams, channels, out, t * sizeof(uint32_t));
+
+        pack(data, out, t);
+        data += 3 * t;
+        n -= t;
+    }
+
+    for (i = 0; i < nstreams; i++)
+        streams[i].ptr = ptrs[i];
+}
+
+static void pa_mix_s24ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, uint8_t *data, unsigned length) {
+    mix_s24ne_tiled(streams, nstreams, channels, data, length, (pa_do_mix_func_t) pa_mix_s24_32ne_sse2, s24_unpack_c, s24_pack_c);
+}
+
+static void pa_mix_s24ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, uint8_t *data, unsigned length) {
+    mix_s24ne_tiled(streams, nstreams, channels, data, length, (pa_do_mix_func_t) pa_mix_s24_32ne_avx2, s24_unpack_avx2, s24_pack_avx2);
+}
+
+/*
+ * float32ne
+ *
+ * Streams are summed in the same order as in the C code, so the results
+ * are identical as long as the compiler doesn't contract into FMA.
+ */
+
+static SSE2_FUNC void mix2_float32ne_sse2(pa_mix_info streams[], unsigned channels, float *data, unsigned n) {
+    const float *ptr0 = streams[0].ptr;
+    const float *ptr1 = streams[1].ptr;
+    float cv[4];
+    __m128 v0, v1;
+
+    build_volumes_float(cv, &streams[0], channels, 4);
+    v0 = _mm_loadu_ps(cv);
+    build_volumes_float(cv, &streams[1], channels, 4);
+    v1 = _mm_loadu_ps(cv);
+
+    for (; n > 0; n -= 4, ptr0 += 4, ptr1 += 4, data += 4) {
+        __m128 sum = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_loadu_ps(ptr0), v0));
+
+        _mm_storeu_ps(data, _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(ptr1), v1)));
+    }
+}
+
+static SSE2_FUNC void mix_vec_float32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned n) {
+    __m128 v[MAX_REG_STREAMS];
+    unsigned i, k;
+
+    for (i = 0; i < nstreams; i++) {
+        float cv[4];
+
+        build_volumes_float(cv, &streams[i], channels, 4);
+        v[i] = _mm_loadu_ps(cv);
+    }
+
+    for (k = 0; k < n; k += 4, data += 4) {
+        __m128 sum = _mm_setzero_ps();
+
+        for (i = 0; i < nstreams; i++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps((const float*) streams[i].ptr + k), v[i]));
+
+        _mm_storeu_ps(data, sum);
+    }
+}
+
+static SSE2_FUNC void mix_block_float32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, unsigned period, float *data, unsigned n) {
+    __m128 acc[BLOCK_VECS];
+    float cv[4 * PA_CHANNELS_MAX];
+    const unsigned block = (BLOCK_VECS / period) * period;
+    unsigned done, i, j;
+
+    for (done = 0; done < n; ) {
+        unsigned nvec = PA_MIN(block, (n - done) / 4);
+
+        for (j = 0; j < nvec; j++)
+            acc[j] = _mm_setzero_ps();
+
+        for (i = 0; i < nstreams; i++) {
+            const float *ptr = (const float*) streams[i].ptr + done;
+
+            build_volumes_float(cv, &streams[i], channels, 4 * period);
+
+            for (j = 0; j < nvec; j++)
+                acc[j] = _mm_add_ps(acc[j], _mm_mul_ps(_mm_loadu_ps(ptr + 4 * j), _mm_loadu_ps(cv + 4 * (j % period))));
+        }
+
+        for (j = 0; j < nvec; j++)
+            _mm_storeu_ps(data + done + 4 * j, acc[j]);
+
+        done += 4 * nvec;
+    }
+}
+
+static void pa_mix_float32ne_sse2(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
+    unsigned period = pattern_period(channels, 4);
+    unsigned n = length / sizeof(float);
+
+    n -= n % (4 * period);
+
+    if (n == 0) {
+        fallback_float32ne(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    if (period == 1 && nstreams == 2)
+        mix2_float32ne_sse2(streams, channels, data, n);
+    else if (period == 1 && nstreams <= MAX_REG_STREAMS)
+        mix_vec_float32ne_sse2(streams, nstreams, channels, data, n);
+    else
+        mix_block_float32ne_sse2(streams, nstreams, channels, period, data, n);
+
+    advance_streams(streams, nstreams, n * sizeof(float));
+
+    if (length > n * sizeof(float))
+        fallback_float32ne(streams, nstreams, channels, data + n, length - n * sizeof(float));
+}
+
+static AVX2_FUNC void mix2_float32ne_avx2(pa_mix_info streams[], unsigned channels, float *data, unsigned n) {
+    const float *ptr0 = streams[0].ptr;
+    const float *ptr1 = streams[1].ptr;
+    float cv[8];
+    __m256 v0, v1;
+
+    build_volumes_float(cv, &streams[0], channels, 8);
+    v0 = _mm256_loadu_ps(cv);
+    build_volumes_float(cv, &streams[1], channels, 8);
+    v1 = _mm256_loadu_ps(cv);
+
+    for (; n > 0; n -= 8, ptr0 += 8, ptr1 += 8, data += 8) {
+        __m256 sum = _mm256_add_ps(_mm256_setzero_ps(), _mm256_mul_ps(_mm256_loadu_ps(ptr0), v0));
+
+        _mm256_storeu_ps(data, _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(ptr1), v1)));
+    }
+}
+
+static AVX2_FUNC void mix_vec_float32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned n) {
+    __m256 v[MAX_REG_STREAMS];
+    unsigned i, k;
+
+    for (i = 0; i < nstreams; i++) {
+        float cv[8];
+
+        build_volumes_float(cv, &streams[i], channels, 8);
+        v[i] = _mm256_loadu_ps(cv);
+    }
+
+    for (k = 0; k < n; k += 8, data += 8) {
+        __m256 sum = _mm256_setzero_ps();
+
+        for (i = 0; i < nstreams; i++)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps((const float*) streams[i].ptr + k), v[i]));
+
+        _mm256_storeu_ps(data, sum);
+    }
+}
+
+static AVX2_FUNC void mix_block_float32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, unsigned period, float *data, unsigned n) {
+    __m256 acc[BLOCK_VECS / 2];
+    float cv[8 * PA_CHANNELS_MAX];
+    const unsigned block = (BLOCK_VECS / 2 / period) * period;
+    unsigned done, i, j;
+
+    for (done = 0; done < n; ) {
+        unsigned nvec = PA_MIN(block, (n - done) / 8);
+
+        for (j = 0; j < nvec; j++)
+            acc[j] = _mm256_setzero_ps();
+
+        for (i = 0; i < nstreams; i++) {
+            const float *ptr = (const float*) streams[i].ptr + done;
+
+            build_volumes_float(cv, &streams[i], channels, 8 * period);
+
+            for (j = 0; j < nvec; j++)
+                acc[j] = _mm256_add_ps(acc[j], _mm256_mul_ps(_mm256_loadu_ps(ptr + 8 * j), _mm256_loadu_ps(cv + 8 * (j % period))));
+        }
+
+        for (j = 0; j < nvec; j++)
+            _mm256_storeu_ps(data + done + 8 * j, acc[j]);
+
+        done += 8 * nvec;
+    }
+}
+
+static void pa_mix_float32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
+    unsigned period = pattern_period(channels, 8);
+    unsigned n = length / sizeof(float);
+
+    n -= n % (8 * period);
+
+    if (n == 0) {
+        pa_mix_float32ne_sse2(streams, nstreams, channels, data, length);
+        return;
+    }
+
+    if (period == 1 && nstreams == 2)
+        mix2_float32ne_avx2(streams, channels, data, n);
+    else if (period == 1 && nstreams <= MAX_REG_STREAMS)
+        mix_vec_float32ne_avx2(streams, nstreams, channels, data, n);
+    else
+        mix_block_float32ne_avx2(streams, nstreams, channels, period, data, n);
+
+    advance_streams(streams, nstreams, n * sizeof(float));
+
+    if (length > n * sizeof(float))
+        pa_mix_float32ne_sse2(streams, nstreams, channels, data + n, length - n * sizeof(float));
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && ... */
+
+void pa_mix_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+    if (!(flags & PA_CPU_X86_SSE2))
+        return;
+
+    fallback_s16ne = pa_get_mix_func(PA_SAMPLE_S16NE);
+    fallback_s32ne = pa_get_mix_func(PA_SAMPLE_S32NE);
+    fallback_s24ne = pa_get_mix_func(PA_SAMPLE_S24NE);
+    fallback_s24_32ne = pa_get_mix_func(PA_SAMPLE_S24_32NE);
+    fallback_float32ne = pa_get_mix_func(PA_SAMPLE_FLOAT32NE);
+
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized mixing functions.");
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S24NE, (pa_do_mix_func_t) pa_mix_s24ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S24_32NE, (pa_do_mix_func_t) pa_mix_s24_32ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_avx2);
+    } else {
+        pa_log_info("Initialising SSE2 optimized mixing functions.");
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_sse2);
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_sse2);
+        pa_set_mix_func(PA_SAMPLE_S24NE, (pa_do_mix_func_t) pa_mix_s24ne_sse2);
+        pa_set_mix_func(PA_SAMPLE_S24_32NE, (pa_do_mix_func_t) pa_mix_s24_32ne_sse2);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_sse2);
+    }
+#endif
+}
@@ -187,9 +187,18 @@ enum {
      * BOTH DIRECTIONS */
     PA_COMMAND_REGISTER_MEMFD_SHMID,
 
+    /* Supported since protocol v33 (11.0) */
+    PA_COMMAND_GET_SNAPSHOT,
+    PA_COMMAND_FINISH_UPLOAD_STREAM_MEMFD,
+    PA_COMMAND_CREATE_PLAYBACK_STREAMS,
+
     PA_COMMAND_MAX
 };
 
+/* The maximum number of streams PA_COMMAND_CREATE_PLAYBACK_STREAMS
+ * creates at once */
+#define PA_NATIVE_CREATE_STREAMS_MAX 256
+
 #define PA_NATIVE_COOKIE_LENGTH 256
 #define PA_NATIVE_COOKIE_FILE "cookie"
 #define PA_NATIVE_COOKIE_FILE_FALLBACK ".pulse-cookie"
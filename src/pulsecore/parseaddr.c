@@ -119,6 +119,9 @@ int pa_parse_address(const char *name, pa_parsed_address *ret_p) {
     } else if (pa_startswith(p, "tcp6:")) {
         ret_p->type = PA_PARSED_ADDRESS_TCP6;
         p += sizeof("tcp6:")-1;
+    } else if (pa_startswith(p, "vsock:")) {
+        ret_p->type = PA_PARSED_ADDRESS_VSOCK;
+        p += sizeof("vsock:")-1;
     }
 
     if (ret_p->type == PA_PARSED_ADDRESS_UNIX)
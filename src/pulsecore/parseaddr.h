@@ -28,7 +28,9 @@ typedef enum pa_parsed_address_type {
     PA_PARSED_ADDRESS_UNIX,
     PA_PARSED_ADDRESS_TCP4,
     PA_PARSED_ADDRESS_TCP6,
-    PA_PARSED_ADDRESS_TCP_AUTO
+    PA_PARSED_ADDRESS_TCP_AUTO,
+    /* path_or_host holds the context ID, or "host" */
+    PA_PARSED_ADDRESS_VSOCK
 } pa_parsed_address_type_t;
 
 typedef struct pa_parsed_address {
@@ -37,6 +37,8 @@
 #include <pulsecore/refcnt.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/core-rtclock.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
 
 #include "pdispatch.h"
 
@@ -199,6 +201,11 @@ static const char *command_names[PA_COMMAND_MAX] = {
     /* Supported since protocol v31 (9.0) */
     /* BOTH DIRECTIONS */
     [PA_COMMAND_REGISTER_MEMFD_SHMID] = "REGISTER_MEMFD_SHMID",
+
+    /* Supported since protocol v33 (11.0) */
+    [PA_COMMAND_GET_SNAPSHOT] = "GET_SNAPSHOT",
+    [PA_COMMAND_FINISH_UPLOAD_STREAM_MEMFD] = "FINISH_UPLOAD_STREAM_MEMFD",
+    [PA_COMMAND_CREATE_PLAYBACK_STREAMS] = "CREATE_PLAYBACK_STREAMS",
 };
 
 #endif
@@ -212,7 +219,7 @@ struct reply_info {
     void *userdata;
     pa_free_cb_t free_cb;
     uint32_t tag;
-    pa_time_event *time_event;
+    pa_usec_t timeout;
 };
 
 struct pa_pdispatch {
@@ -220,7 +227,14 @@ struct pa_pdispatch {
     pa_mainloop_api *mainloop;
     const pa_pdispatch_cb_t *callback_table;
     unsigned n_commands;
+    /* Pending replies, in the order they were registered, and by tag */
     PA_LLIST_HEAD(struct reply_info, replies);
+    struct reply_info *replies_tail;
+    pa_hashmap *replies_by_tag;
+    /* One timer for the timeouts of all pending replies. It is only
+     * moved forward when it fires, not every time a reply arrives. */
+    pa_time_event *time_event;
+    pa_usec_t next_timeout;
     pa_pdispatch_drain_cb_t drain_callback;
     void *drain_userdata;
     pa_cmsg_ancil_data *ancil_data;
@@ -230,12 +244,12 @@ struct pa_pdispatch {
 static void reply_info_free(struct reply_info *r) {
     pa_assert(r);
     pa_assert(r->pdispatch);
-    pa_assert(r->pdispatch->mainloop);
 
-    if (r->time_event)
-        r->pdispatch->mainloop->time_free(r->time_event);
+    if (r->pdispatch->replies_tail == r)
+        r->pdispatch->replies_tail = r->prev;
 
     PA_LLIST_REMOVE(struct reply_info, r->pdispatch->replies, r);
+    pa_assert_se(pa_hashmap_remove(r->pdispatch->replies_by_tag, PA_UINT32_TO_PTR(r->tag)) == r);
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(reply_infos), r) < 0)
         pa_xfree(r);
@@ -253,6 +267,7 @@ pa_pdispatch* pa_pdispatch_new(pa_mainloop_api *mainloop, bool use_rtclock, cons
     pd->callback_table = table;
     pd->n_commands = entries;
     PA_LLIST_HEAD_INIT(struct reply_info, pd->replies);
+    pd->replies_by_tag = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     pd->use_rtclock = use_rtclock;
 
     return pd;
@@ -268,6 +283,11 @@ static void pdispatch_free(pa_pdispatch *pd) {
         reply_info_free(pd->replies);
     }
 
+    if (pd->time_event)
+        pd->mainloop->time_free(pd->time_event);
+
+    pa_hashmap_free(pd->replies_by_tag);
+
     pa_xfree(pd);
 }
 
@@ -333,11 +353,7 @@ int pa_pdispatch_run(pa_pdispatch *pd, pa_packet *packet, pa_cmsg_ancil_data *an
     if (command == PA_COMMAND_ERROR || command == PA_COMMAND_REPLY) {
         struct reply_info *r;
 
-        PA_LLIST_FOREACH(r, pd->replies)
-            if (r->tag == tag)
-                break;
-
-        if (r)
+        if ((r = pa_hashmap_get(pd->replies_by_tag, PA_UINT32_TO_PTR(tag))))
             run_action(pd, r, command, ts);
 
     } else if (pd->callback_table && (command < pd->n_commands) && pd->callback_table[command]) {
@@ -362,21 +378,70 @@ finish:
     return ret;
 }
 
+static void timeout_callback(pa_mainloop_api*m, pa_time_event*e, const struct timeval *t, void *userdata);
+
+static void restart_timer(pa_pdispatch *pd, pa_usec_t timeout) {
+    struct timeval tv;
+
+    pa_timeval_rtstore(&tv, timeout, pd->use_rtclock);
+
+    if (pd->time_event)
+        pd->mainloop->time_restart(pd->time_event, &tv);
+    else
+        pa_assert_se(pd->time_event = pd->mainloop->time_new(pd->mainloop, &tv, timeout_callback, pd));
+
+    pd->next_timeout = timeout;
+}
+
+/* Returns the first reply that timed out at now. Replies usually all
+ * have the same timeout, so any such reply is found right at the start
+ * of the list. */
+static struct reply_info *find_timed_out(pa_pdispatch *pd, pa_usec_t now, pa_usec_t *next) {
+    struct reply_info *r;
+
+    *next = 0;
+
+    PA_LLIST_FOREACH(r, pd->replies) {
+        if (r->timeout <= now)
+            return r;
+
+        if (*next == 0 || r->timeout < *next)
+            *next = r->timeout;
+    }
+
+    return NULL;
+}
+
 static void timeout_callback(pa_mainloop_api*m, pa_time_event*e, const struct timeval *t, void *userdata) {
-    struct reply_info*r = userdata;
+    pa_pdispatch *pd = userdata;
+    struct reply_info *r;
+    pa_usec_t now, next;
 
-    pa_assert(r);
-    pa_assert(r->time_event == e);
-    pa_assert(r->pdispatch);
-    pa_assert(r->pdispatch->mainloop == m);
-    pa_assert(r->callback);
+    pa_assert(pd);
+    pa_assert(pd->time_event == e);
+    pa_assert(pd->mainloop == m);
 
-    run_action(r->pdispatch, r, PA_COMMAND_TIMEOUT, NULL);
+    pa_pdispatch_ref(pd);
+
+    now = pa_rtclock_now();
+
+    /* The callback may free any of the other replies, hence we start
+     * over after each one */
+    while ((r = find_timed_out(pd, now, &next)))
+        run_action(pd, r, PA_COMMAND_TIMEOUT, NULL);
+
+    if (next > 0)
+        restart_timer(pd, next);
+    else {
+        pd->mainloop->time_restart(pd->time_event, NULL);
+        pd->next_timeout = 0;
+    }
+
+    pa_pdispatch_unref(pd);
 }
 
 void pa_pdispatch_register_reply(pa_pdispatch *pd, uint32_t tag, int timeout, pa_pdispatch_cb_t cb, void *userdata, pa_free_cb_t free_cb) {
     struct reply_info *r;
-    struct timeval tv;
 
     pa_assert(pd);
     pa_assert(PA_REFCNT_VALUE(pd) >= 1);
@@ -390,12 +455,15 @@ void pa_pdispatch_register_reply(pa_pdispatch *pd, uint32_t tag, int timeout, pa
     r->userdata = userdata;
     r->free_cb = free_cb;
     r->tag = tag;
+    r->timeout = pa_rtclock_now() + timeout * PA_USEC_PER_SEC;
+
+    pa_assert_se(pa_hashmap_put(pd->replies_by_tag, PA_UINT32_TO_PTR(tag), r) == 0);
 
-    pa_assert_se(r->time_event = pd->mainloop->time_new(pd->mainloop,
-                                                        pa_timeval_rtstore(&tv, pa_rtclock_now() + timeout * PA_USEC_PER_SEC, pd->use_rtclock),
-                                                        timeout_callback, r));
+    PA_LLIST_INSERT_AFTER(struct reply_info, pd->replies, pd->replies_tail, r);
+    pd->replies_tail = r;
 
-    PA_LLIST_PREPEND(struct reply_info, pd->replies, r);
+    if (pd->next_timeout == 0 || r->timeout < pd->next_timeout)
+        restart_timer(pd, r->timeout);
 }
 
 int pa_pdispatch_is_pending(pa_pdispatch *pd) {
@@ -24,11 +24,142 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include <pulse/xmalloc.h>
+
 #include <pulsecore/sink-input.h>
-#include <pulsecore/play-memblockq.h>
+#include <pulsecore/thread-mq.h>
 
 #include "play-memchunk.h"
 
+/* Plays a memchunk through a read index into it, instead of a memblockq
+ * of its own. Playing the same sample several times at once thus
+ * shares its memblock without any per play queue. */
+typedef struct memchunk_stream {
+    pa_msgobject parent;
+    pa_core *core;
+    pa_sink_input *sink_input;
+    pa_memchunk memchunk;
+
+    /* IO thread */
+    size_t index;
+    bool finished;
+} memchunk_stream;
+
+enum {
+    MEMCHUNK_STREAM_MESSAGE_UNLINK,
+};
+
+PA_DEFINE_PRIVATE_CLASS(memchunk_stream, pa_msgobject);
+#define MEMCHUNK_STREAM(o) (memchunk_stream_cast(o))
+
+static void memchunk_stream_unlink(memchunk_stream *u) {
+    pa_assert(u);
+
+    if (!u->sink_input)
+        return;
+
+    pa_sink_input_unlink(u->sink_input);
+    pa_sink_input_unref(u->sink_input);
+    u->sink_input = NULL;
+
+    memchunk_stream_unref(u);
+}
+
+static void memchunk_stream_free(pa_object *o) {
+    memchunk_stream *u = MEMCHUNK_STREAM(o);
+    pa_assert(u);
+
+    if (u->memchunk.memblock)
+        pa_memblock_unref(u->memchunk.memblock);
+
+    pa_xfree(u);
+}
+
+static int memchunk_stream_process_msg(pa_msgobject *o, int code, void*userdata, int64_t offset, pa_memchunk *chunk) {
+    memchunk_stream *u = MEMCHUNK_STREAM(o);
+    memchunk_stream_assert_ref(u);
+
+    switch (code) {
+        case MEMCHUNK_STREAM_MESSAGE_UNLINK:
+            memchunk_stream_unlink(u);
+            break;
+    }
+
+    return 0;
+}
+
+static void sink_input_kill_cb(pa_sink_input *i) {
+    memchunk_stream *u;
+
+    pa_sink_input_assert_ref(i);
+    u = MEMCHUNK_STREAM(i->userdata);
+    memchunk_stream_assert_ref(u);
+
+    memchunk_stream_unlink(u);
+}
+
+/* Called from IO thread context */
+static void sink_input_state_change_cb(pa_sink_input *i, pa_sink_input_state_t state) {
+    memchunk_stream *u;
+
+    pa_sink_input_assert_ref(i);
+    u = MEMCHUNK_STREAM(i->userdata);
+    memchunk_stream_assert_ref(u);
+
+    /* If we are added for the first time, ask for a rewinding so that
+     * we are heard right-away. */
+    if (PA_SINK_INPUT_IS_LINKED(state) &&
+        i->thread_info.state == PA_SINK_INPUT_INIT && i->sink)
+        pa_sink_input_request_rewind(i, 0, false, true, true);
+}
+
+/* Called from IO thread context */
+static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    memchunk_stream *u;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert(chunk);
+    u = MEMCHUNK_STREAM(i->userdata);
+    memchunk_stream_assert_ref(u);
+
+    if (u->finished)
+        return -1;
+
+    if (u->index >= u->memchunk.length) {
+
+        if (pa_sink_input_safe_to_remove(i)) {
+            u->finished = true;
+            pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u), MEMCHUNK_STREAM_MESSAGE_UNLINK, NULL, 0, NULL, NULL);
+        }
+
+        return -1;
+    }
+
+    chunk->memblock = pa_memblock_ref(u->memchunk.memblock);
+    chunk->index = u->memchunk.index + u->index;
+    chunk->length = PA_MIN(u->memchunk.length - u->index, nbytes);
+
+    u->index += chunk->length;
+
+    return 0;
+}
+
+/* Called from IO thread context */
+static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
+    memchunk_stream *u;
+
+    pa_sink_input_assert_ref(i);
+    u = MEMCHUNK_STREAM(i->userdata);
+    memchunk_stream_assert_ref(u);
+
+    if (u->finished)
+        return;
+
+    /* All of the chunk stays around, so we can go back as far as the
+     * sink wants, up to where we started */
+    u->index -= PA_MIN(u->index, nbytes);
+}
+
 int pa_play_memchunk(
         pa_sink *sink,
         const pa_sample_spec *ss,
@@ -39,24 +170,58 @@ int pa_play_memchunk(
         pa_sink_input_flags_t flags,
         uint32_t *sink_input_index) {
 
-    pa_memblockq *q;
-    int r;
-    pa_memchunk silence;
+    memchunk_stream *u;
+    pa_sink_input_new_data data;
+    pa_sink_input *i;
 
     pa_assert(sink);
     pa_assert(ss);
     pa_assert(chunk);
+    pa_assert(chunk->memblock);
 
-    pa_silence_memchunk_get(&sink->core->silence_cache, sink->core->mempool, &silence, ss, 0);
-    q = pa_memblockq_new("pa_play_memchunk() q", 0, chunk->length, 0, ss, 1, 1, 0, &silence);
-    pa_memblock_unref(silence.memblock);
+    u = pa_msgobject_new(memchunk_stream);
+    u->parent.parent.free = memchunk_stream_free;
+    u->parent.process_msg = memchunk_stream_process_msg;
+    u->core = sink->core;
+    u->sink_input = NULL;
+    u->memchunk = *chunk;
+    pa_memblock_ref(u->memchunk.memblock);
+    u->index = 0;
+    u->finished = false;
 
-    pa_assert_se(pa_memblockq_push(q, chunk) >= 0);
+    pa_sink_input_new_data_init(&data);
+    pa_sink_input_new_data_set_sink(&data, sink, false);
+    data.driver = __FILE__;
+    pa_sink_input_new_data_set_sample_spec(&data, ss);
+    pa_sink_input_new_data_set_channel_map(&data, map);
+    pa_sink_input_new_data_set_volume(&data, volume);
+    pa_proplist_update(data.proplist, PA_UPDATE_REPLACE, p);
+    data.flags |= flags;
 
-    if ((r = pa_play_memblockq(sink, ss, map, q, volume, p, flags, sink_input_index)) < 0) {
-        pa_memblockq_free(q);
-        return r;
+    pa_sink_input_new(&u->sink_input, sink->core, &data);
+    pa_sink_input_new_data_done(&data);
+
+    if (!u->sink_input) {
+        memchunk_stream_unref(u);
+        return -1;
     }
 
+    u->sink_input->pop = sink_input_pop_cb;
+    u->sink_input->process_rewind = sink_input_process_rewind_cb;
+    u->sink_input->kill = sink_input_kill_cb;
+    u->sink_input->state_change = sink_input_state_change_cb;
+    u->sink_input->userdata = u;
+
+    /* The reference to u is dangling here, because we want
+     * to keep this stream around until it is fully played. */
+
+    i = pa_sink_input_ref(u->sink_input);
+    pa_sink_input_put(i);
+
+    if (sink_input_index)
+        *sink_input_index = i->index;
+
+    pa_sink_input_unref(i);
+
     return 0;
 }
@@ -49,6 +49,13 @@ struct object_entry {
     char *path;
     pa_hashmap *interfaces; /* Interface name -> struct interface_entry */
     char *introspection;
+
+    /* Dispatch tables for calls that don't name an interface, flattened over
+     * all interfaces of the object. If several interfaces define the same
+     * member, the one registered first wins. The entries are owned by the
+     * interface entries. Rebuilt together with the introspection data. */
+    pa_hashmap *methods; /* Method name -> struct method_entry */
+    pa_hashmap *properties; /* Property name -> struct property_entry */
 };
 
 struct connection_entry {
@@ -73,11 +80,23 @@ struct signal_paths_entry {
     pa_idxset *paths;
 };
 
+/* A compiled method handler: a single lookup yields the callback, the
+ * interface it belongs to and the expected signature of the call. */
+struct method_entry {
+    pa_dbus_method_handler handler;
+    char *signature; /* Contains only "in" arguments. */
+    struct interface_entry *iface_entry;
+};
+
+struct property_entry {
+    pa_dbus_property_handler handler;
+    struct interface_entry *iface_entry;
+};
+
 struct interface_entry {
     char *name;
-    pa_hashmap *method_handlers;
-    pa_hashmap *method_signatures; /* Derived from method_handlers. Contains only "in" arguments. */
-    pa_hashmap *property_handlers;
+    pa_hashmap *method_handlers; /* Method name -> struct method_entry */
+    pa_hashmap *property_handlers; /* Property name -> struct property_entry */
     pa_dbus_receive_cb_t get_all_properties_cb;
     pa_dbus_signal_info *signals;
     unsigned n_signals;
@@ -179,6 +198,31 @@ void pa_dbus_protocol_unref(pa_dbus_protocol *p) {
     pa_xfree(p);
 }
 
+static void update_dispatch_tables(struct object_entry *oe) {
+    void *interfaces_state = NULL;
+    struct interface_entry *iface_entry = NULL;
+
+    pa_assert(oe);
+
+    pa_hashmap_remove_all(oe->methods);
+    pa_hashmap_remove_all(oe->properties);
+
+    PA_HASHMAP_FOREACH(iface_entry, oe->interfaces, interfaces_state) {
+        struct method_entry *method_entry;
+        struct property_entry *property_entry;
+        void *handlers_state = NULL;
+
+        /* pa_hashmap_put() refuses duplicates, so earlier interfaces win. */
+        PA_HASHMAP_FOREACH(method_entry, iface_entry->method_handlers, handlers_state)
+            pa_hashmap_put(oe->methods, (char *) method_entry->handler.method_name, method_entry);
+
+        handlers_state = NULL;
+
+        PA_HASHMAP_FOREACH(property_entry, iface_entry->property_handlers, handlers_state)
+            pa_hashmap_put(oe->properties, (char *) property_entry->handler.property_name, property_entry);
+    }
+}
+
 static void update_introspection(struct object_entry *oe) {
     pa_strbuf *buf;
     void *interfaces_state = NULL;
@@ -191,15 +235,17 @@ static void update_introspection(struct object_entry *oe) {
     pa_strbuf_puts(buf, "<node>\n");
 
     PA_HASHMAP_FOREACH(iface_entry, oe->interfaces, interfaces_state) {
-        pa_dbus_method_handler *method_handler;
-        pa_dbus_property_handler *property_handler;
+        struct method_entry *method_entry;
+        struct property_entry *property_entry;
         void *handlers_state = NULL;
         unsigned i;
         unsigned j;
 
         pa_strbuf_printf(buf, " <interface name=\"%s\">\n", iface_entry->name);
 
-        PA_HASHMAP_FOREACH(method_handler, iface_entry->method_handlers, handlers_state) {
+        PA_HASHMAP_FOREACH(method_entry, iface_entry->method_handlers, handlers_state) {
+            const pa_dbus_method_handler *method_handler = &method_entry->handler;
+
             pa_strbuf_printf(buf, "  <method name=\"%s\">\n", method_handler->method_name);
 
             for (i = 0; i < method_handler->n_arguments; ++i)
@@ -213,11 +259,11 @@ static void update_introspection(struct object_entry *oe) {
 
         handlers_state = NULL;
 
-        PA_HASHMAP_FOREACH(property_handler, iface_entry->property_handlers, handlers_state)
+        PA_HASHMAP_FOREACH(property_entry, iface_entry->property_handlers, handlers_state)
             pa_strbuf_printf(buf, "  <property name=\"%s\" type=\"%s\" access=\"%s\"/>\n",
-                             property_handler->property_name,
-                             property_handler->type,
-                             property_handler->get_cb ? (property_handler->set_cb ? "readwrite" : "read") : "write");
+                             property_entry->handler.property_name,
+                             property_entry->handler.type,
+                             property_entry->handler.get_cb ? (property_entry->handler.set_cb ? "readwrite" : "read") : "write");
 
         for (i = 0; i < iface_entry->n_signals; ++i) {
             pa_strbuf_printf(buf, "  <signal name=\"%s\">\n", iface_entry->signals[i].name);
@@ -326,48 +372,56 @@ struct call_info {
  * not been given. In case of a Set call, call_info->property_sig is also set,
  * which is checked against the expected value in this function. */
 static enum find_result_t find_handler_by_property(struct call_info *call_info) {
-    void *state = NULL;
+    struct property_entry *e;
 
     pa_assert(call_info);
 
-    PA_HASHMAP_FOREACH(call_info->iface_entry, call_info->obj_entry->interfaces, state) {
-        if ((call_info->property_handler = pa_hashmap_get(call_info->iface_entry->property_handlers, call_info->property))) {
-            if (pa_streq(call_info->method, "Get"))
-                return call_info->property_handler->get_cb ? FOUND_GET_PROPERTY : PROPERTY_ACCESS_DENIED;
+    if (!(e = pa_hashmap_get(call_info->obj_entry->properties, call_info->property)))
+        return NO_SUCH_PROPERTY;
 
-            else if (pa_streq(call_info->method, "Set")) {
-                call_info->expected_property_sig = call_info->property_handler->type;
+    call_info->iface_entry = e->iface_entry;
+    call_info->property_handler = &e->handler;
 
-                if (pa_streq(call_info->property_sig, call_info->expected_property_sig))
-                    return call_info->property_handler->set_cb ? FOUND_SET_PROPERTY : PROPERTY_ACCESS_DENIED;
-                else
-                    return INVALID_PROPERTY_SIG;
+    if (pa_streq(call_info->method, "Get"))
+        return call_info->property_handler->get_cb ? FOUND_GET_PROPERTY : PROPERTY_ACCESS_DENIED;
 
-            } else
-                pa_assert_not_reached();
-        }
-    }
+    else if (pa_streq(call_info->method, "Set")) {
+        call_info->expected_property_sig = call_info->property_handler->type;
+
+        if (pa_streq(call_info->property_sig, call_info->expected_property_sig))
+            return call_info->property_handler->set_cb ? FOUND_SET_PROPERTY : PROPERTY_ACCESS_DENIED;
+        else
+            return INVALID_PROPERTY_SIG;
+
+    } else
+        pa_assert_not_reached();
+}
+
+/* Fills in the method handler, its interface and the expected signature from
+ * a compiled method entry and checks the signature of the call. */
+static enum find_result_t found_method(struct call_info *call_info, struct method_entry *e) {
+    pa_assert(call_info);
+    pa_assert(e);
 
-    return NO_SUCH_PROPERTY;
+    call_info->iface_entry = e->iface_entry;
+    call_info->method_handler = &e->handler;
+    call_info->expected_method_sig = e->signature;
+
+    if (pa_streq(call_info->method_sig, call_info->expected_method_sig))
+        return FOUND_METHOD;
+    else
+        return INVALID_METHOD_SIG;
 }
 
 static enum find_result_t find_handler_by_method(struct call_info *call_info) {
-    void *state = NULL;
+    struct method_entry *e;
 
     pa_assert(call_info);
 
-    PA_HASHMAP_FOREACH(call_info->iface_entry, call_info->obj_entry->interfaces, state) {
-        if ((call_info->method_handler = pa_hashmap_get(call_info->iface_entry->method_handlers, call_info->method))) {
-            pa_assert_se(call_info->expected_method_sig = pa_hashmap_get(call_info->iface_entry->method_signatures, call_info->method));
+    if (!(e = pa_hashmap_get(call_info->obj_entry->methods, call_info->method)))
+        return NO_SUCH_METHOD;
 
-            if (pa_streq(call_info->method_sig, call_info->expected_method_sig))
-                return FOUND_METHOD;
-            else
-                return INVALID_METHOD_SIG;
-        }
-    }
-
-    return NO_SUCH_METHOD;
+    return found_method(call_info, e);
 }
 
 static enum find_result_t find_handler_from_properties_call(struct call_info *call_info) {
@@ -404,12 +458,14 @@ static enum find_result_t find_handler_from_properties_call(struct call_info *ca
                                            DBUS_TYPE_INVALID));
 
         if (*call_info->property_interface) {
+            struct property_entry *e;
+
             if (!(call_info->iface_entry = pa_hashmap_get(call_info->obj_entry->interfaces, call_info->property_interface)))
                 return NO_SUCH_PROPERTY_INTERFACE;
-            else if ((call_info->property_handler =
-                        pa_hashmap_get(call_info->iface_entry->property_handlers, call_info->property)))
+            else if ((e = pa_hashmap_get(call_info->iface_entry->property_handlers, call_info->property))) {
+                call_info->property_handler = &e->handler;
                 return call_info->property_handler->get_cb ? FOUND_GET_PROPERTY : PROPERTY_ACCESS_DENIED;
-            else
+            } else
                 return NO_SUCH_PROPERTY;
 
         } else
@@ -434,11 +490,13 @@ static enum find_result_t find_handler_from_properties_call(struct call_info *ca
         call_info->property_sig = dbus_message_iter_get_signature(&call_info->variant_iter);
 
         if (*call_info->property_interface) {
+            struct property_entry *e;
+
             if (!(call_info->iface_entry = pa_hashmap_get(call_info->obj_entry->interfaces, call_info->property_interface)))
                 return NO_SUCH_PROPERTY_INTERFACE;
 
-            else if ((call_info->property_handler =
-                        pa_hashmap_get(call_info->iface_entry->property_handlers, call_info->property))) {
+            else if ((e = pa_hashmap_get(call_info->iface_entry->property_handlers, call_info->property))) {
+                call_info->property_handler = &e->handler;
                 call_info->expected_property_sig = call_info->property_handler->type;
 
                 if (pa_streq(call_info->property_sig, call_info->expected_property_sig))
@@ -460,21 +518,18 @@ static enum find_result_t find_handler(struct call_info *call_info) {
     pa_assert(call_info);
 
     if (call_info->interface) {
+        struct method_entry *e;
+
         if (pa_streq(call_info->interface, DBUS_INTERFACE_PROPERTIES))
             return find_handler_from_properties_call(call_info);
 
         else if (!(call_info->iface_entry = pa_hashmap_get(call_info->obj_entry->interfaces, call_info->interface)))
             return NO_SUCH_INTERFACE;
 
-        else if ((call_info->method_handler = pa_hashmap_get(call_info->iface_entry->method_handlers, call_info->method))) {
-            pa_assert_se(call_info->expected_method_sig = pa_hashmap_get(call_info->iface_entry->method_signatures, call_info->method));
-
-            if (!pa_streq(call_info->method_sig, call_info->expected_method_sig))
-                return INVALID_METHOD_SIG;
-
-            return FOUND_METHOD;
+        else if ((e = pa_hashmap_get(call_info->iface_entry->method_handlers, call_info->method)))
+            return found_method(call_info, e);
 
-        } else
+        else
             return NO_SUCH_METHOD;
 
     } else { /* The method call doesn't contain an interface. */
@@ -631,11 +686,13 @@ static pa_dbus_arg_info *copy_args(const pa_dbus_arg_info *src, unsigned n) {
     return dst;
 }
 
-static void method_handler_free(pa_dbus_method_handler *h) {
+static void method_entry_free(struct method_entry *e) {
+    pa_dbus_method_handler *h;
     unsigned i;
 
-    pa_assert(h);
+    pa_assert(e);
 
+    h = &e->handler;
     pa_xfree((char *) h->method_name);
 
     for (i = 0; i < h->n_arguments; ++i) {
@@ -645,82 +702,80 @@ static void method_handler_free(pa_dbus_method_handler *h) {
     }
 
     pa_xfree((pa_dbus_arg_info *) h->arguments);
-    pa_xfree(h);
+    pa_xfree(e->signature);
+    pa_xfree(e);
 }
 
-static pa_hashmap *create_method_handlers(const pa_dbus_interface_info *info) {
-    pa_hashmap *handlers;
+/* Concatenates the types of the "in" arguments. */
+static char *extract_method_signature(const pa_dbus_method_handler *h) {
+    pa_strbuf *sig_buf;
     unsigned i;
 
-    pa_assert(info);
-    pa_assert(info->method_handlers || info->n_method_handlers == 0);
-
-    handlers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) method_handler_free);
+    pa_assert(h);
 
-    for (i = 0; i < info->n_method_handlers; ++i) {
-        pa_dbus_method_handler *h = pa_xnew(pa_dbus_method_handler, 1);
-        h->method_name = pa_xstrdup(info->method_handlers[i].method_name);
-        h->arguments = copy_args(info->method_handlers[i].arguments, info->method_handlers[i].n_arguments);
-        h->n_arguments = info->method_handlers[i].n_arguments;
-        h->receive_cb = info->method_handlers[i].receive_cb;
+    sig_buf = pa_strbuf_new();
 
-        pa_hashmap_put(handlers, (char *) h->method_name, h);
+    for (i = 0; i < h->n_arguments; ++i) {
+        if (pa_streq(h->arguments[i].direction, "in"))
+            pa_strbuf_puts(sig_buf, h->arguments[i].type);
     }
 
-    return handlers;
+    return pa_strbuf_to_string_free(sig_buf);
 }
 
-static pa_hashmap *extract_method_signatures(pa_hashmap *method_handlers) {
-    pa_hashmap *signatures = NULL;
-    pa_dbus_method_handler *handler = NULL;
-    void *state = NULL;
-    pa_strbuf *sig_buf = NULL;
-    unsigned i = 0;
-
-    pa_assert(method_handlers);
-
-    signatures = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, pa_xfree);
+static pa_hashmap *create_method_handlers(const pa_dbus_interface_info *info, struct interface_entry *iface_entry) {
+    pa_hashmap *handlers;
+    unsigned i;
 
-    PA_HASHMAP_FOREACH(handler, method_handlers, state) {
-        sig_buf = pa_strbuf_new();
+    pa_assert(info);
+    pa_assert(info->method_handlers || info->n_method_handlers == 0);
+    pa_assert(iface_entry);
 
-        for (i = 0; i < handler->n_arguments; ++i) {
-            if (pa_streq(handler->arguments[i].direction, "in"))
-                pa_strbuf_puts(sig_buf, handler->arguments[i].type);
-        }
+    handlers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) method_entry_free);
 
-        pa_hashmap_put(signatures, (char *) handler->method_name, pa_strbuf_to_string_free(sig_buf));
+    for (i = 0; i < info->n_method_handlers; ++i) {
+        struct method_entry *e = pa_xnew(struct method_entry, 1);
+        e->handler.method_name = pa_xstrdup(info->method_handlers[i].method_name);
+        e->handler.arguments = copy_args(info->method_handlers[i].arguments, info->method_handlers[i].n_arguments);
+        e->handler.n_arguments = info->method_handlers[i].n_arguments;
+        e->handler.receive_cb = info->method_handlers[i].receive_cb;
+        e->signature = extract_method_signature(&e->handler);
+        e->iface_entry = iface_entry;
+
+        pa_hashmap_put(handlers, (char *) e->handler.method_name, e);
     }
 
-    return signatures;
+    return handlers;
 }
 
-static void property_handler_free(pa_dbus_property_handler *h) {
-    pa_assert(h);
+static void property_entry_free(struct property_entry *e) {
+    pa_assert(e);
 
-    pa_xfree((char *) h->property_name);
-    pa_xfree((char *) h->type);
+    pa_xfree((char *) e->handler.property_name);
+    pa_xfree((char *) e->handler.type);
 
-    pa_xfree(h);
+    pa_xfree(e);
 }
 
-static pa_hashmap *create_property_handlers(const pa_dbus_interface_info *info) {
+static pa_hashmap *create_property_handlers(const pa_dbus_interface_info *info, struct interface_entry *iface_entry) {
     pa_hashmap *handlers;
     unsigned i = 0;
 
     pa_assert(info);
     pa_assert(info->property_handlers || info->n_property_handlers == 0);
+    pa_assert(iface_entry);
 
-    handlers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) property_handler_free);
+    handlers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) property_entry_free);
 
     for (i = 0; i < info->n_property_handlers; ++i) {
-        pa_dbus_property_handler *h = pa_xnew(pa_dbus_property_handler, 1);
-        h->property_name = pa_xstrdup(info->property_handlers[i].property_name);
-        h->type = pa_xstrdup(info->property_handlers[i].type);
-        h->get_cb = info->property_handlers[i].get_cb;
-        h->set_cb = info->property_handlers[i].set_cb;
-
-        pa_hashmap_put(handlers, (char *) h->property_name, h);
+        struct property_entry *e = pa_xnew(struct property_entry, 1);
+        e->handler.property_name = pa_xstrdup(info->property_handlers[i].property_name);
+        e->handler.type = pa_xstrdup(info->property_handlers[i].type);
+        e->handler.get_cb = info->property_handlers[i].get_cb;
+        e->handler.set_cb = info->property_handlers[i].set_cb;
+        e->iface_entry = iface_entry;
+
+        pa_hashmap_put(handlers, (char *) e->handler.property_name, e);
     }
 
     return handlers;
@@ -770,6 +825,8 @@ int pa_dbus_protocol_add_interface(pa_dbus_protocol *p,
         obj_entry->path = pa_xstrdup(path);
         obj_entry->interfaces = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
         obj_entry->introspection = NULL;
+        obj_entry->methods = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+        obj_entry->properties = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
 
         pa_hashmap_put(p->objects, obj_entry->path, obj_entry);
         obj_entry_created = true;
@@ -780,15 +837,15 @@ int pa_dbus_protocol_add_interface(pa_dbus_protocol *p,
 
     iface_entry = pa_xnew(struct interface_entry, 1);
     iface_entry->name = pa_xstrdup(info->name);
-    iface_entry->method_handlers = create_method_handlers(info);
-    iface_entry->method_signatures = extract_method_signatures(iface_entry->method_handlers);
-    iface_entry->property_handlers = create_property_handlers(info);
+    iface_entry->method_handlers = create_method_handlers(info, iface_entry);
+    iface_entry->property_handlers = create_property_handlers(info, iface_entry);
     iface_entry->get_all_properties_cb = info->get_all_properties_cb;
     iface_entry->signals = copy_signals(info);
     iface_entry->n_signals = info->n_signals;
     iface_entry->userdata = userdata;
     pa_hashmap_put(obj_entry->interfaces, iface_entry->name, iface_entry);
 
+    update_dispatch_tables(obj_entry);
     update_introspection(obj_entry);
 
     if (obj_entry_created)
@@ -828,12 +885,12 @@ int pa_dbus_protocol_remove_interface(pa_dbus_protocol *p, const char* path, con
     if (!(iface_entry = pa_hashmap_remove(obj_entry->interfaces, interface)))
         return -1;
 
+    update_dispatch_tables(obj_entry);
     update_introspection(obj_entry);
 
     pa_log_debug("Interface %s removed from object %s", iface_entry->name, obj_entry->path);
 
     pa_xfree(iface_entry->name);
-    pa_hashmap_free(iface_entry->method_signatures);
     pa_hashmap_free(iface_entry->method_handlers);
     pa_hashmap_free(iface_entry->property_handlers);
 
@@ -860,6 +917,8 @@ int pa_dbus_protocol_remove_interface(pa_dbus_protocol *p, const char* path, con
         pa_hashmap_remove(p->objects, path);
         pa_xfree(obj_entry->path);
         pa_hashmap_free(obj_entry->interfaces);
+        pa_hashmap_free(obj_entry->methods);
+        pa_hashmap_free(obj_entry->properties);
         pa_xfree(obj_entry->introspection);
         pa_xfree(obj_entry);
     }
@@ -704,7 +704,7 @@ static int esd_proto_all_info(connection *c, esd_proto_t request, const void *da
             } else
                 pa_cvolume_reset(&volume, 2);
 
-            if (ce->memchunk.memblock)
+            if (pa_scache_entry_is_loaded(ce))
                 ss = ce->sample_spec;
             else {
                 ss.format = PA_SAMPLE_S16NE;
@@ -996,6 +996,16 @@ static void client_kill_cb(pa_client *c) {
 
 /*** pa_iochannel callbacks ***/
 
+static void post_data(connection *c, pa_memchunk *chunk) {
+    if (!chunk->memblock)
+        return;
+
+    pa_atomic_sub(&c->playback.missing, (int) chunk->length);
+    pa_asyncmsgq_post(c->sink_input->sink->asyncmsgq, PA_MSGOBJECT(c->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
+
+    pa_memchunk_reset(chunk);
+}
+
 static int do_read(connection *c) {
     connection_assert_ref(c);
 
@@ -1127,9 +1137,9 @@ static int do_read(connection *c) {
     } else if (c->state == ESD_STREAMING_DATA && c->sink_input) {
         pa_memchunk chunk;
         ssize_t r;
-        size_t l;
+        size_t l, n;
         void *p;
-        size_t space = 0;
+        size_t space;
 
         pa_assert(c->input_memblockq);
 
@@ -1138,47 +1148,56 @@ static int do_read(connection *c) {
         if ((l = (size_t) pa_atomic_load(&c->playback.missing)) <= 0)
             return 0;
 
-        if (c->playback.current_memblock) {
+        /* Read as much as the client sent, as long as the sink input
+         * wants it, and pass it on to the IO thread in one go */
+        pa_memchunk_reset(&chunk);
 
-            space = pa_memblock_get_length(c->playback.current_memblock) - c->playback.memblock_index;
+        for (;;) {
+            space = c->playback.current_memblock ? pa_memblock_get_length(c->playback.current_memblock) - c->playback.memblock_index : 0;
 
             if (space <= 0) {
-                pa_memblock_unref(c->playback.current_memblock);
-                c->playback.current_memblock = NULL;
-            }
-        }
+                post_data(c, &chunk);
 
-        if (!c->playback.current_memblock) {
-            pa_assert_se(c->playback.current_memblock = pa_memblock_new(c->protocol->core->mempool, (size_t) -1));
-            c->playback.memblock_index = 0;
+                if (c->playback.current_memblock)
+                    pa_memblock_unref(c->playback.current_memblock);
 
-            space = pa_memblock_get_length(c->playback.current_memblock);
-        }
+                pa_assert_se(c->playback.current_memblock = pa_memblock_new(c->protocol->core->mempool, (size_t) -1));
+                c->playback.memblock_index = 0;
 
-        if (l > space)
-            l = space;
+                space = pa_memblock_get_length(c->playback.current_memblock);
+            }
 
-        p = pa_memblock_acquire(c->playback.current_memblock);
-        r = pa_iochannel_read(c->io, (uint8_t*) p+c->playback.memblock_index, l);
-        pa_memblock_release(c->playback.current_memblock);
+            n = PA_MIN(l, space);
 
-        if (r <= 0) {
+            p = pa_memblock_acquire(c->playback.current_memblock);
+            r = pa_iochannel_read(c->io, (uint8_t*) p+c->playback.memblock_index, n);
+            pa_memblock_release(c->playback.current_memblock);
 
-            if (r < 0 && (errno == EINTR || errno == EAGAIN))
-                return 0;
+            if (r <= 0) {
 
-            pa_log_debug("read(): %s", r < 0 ? pa_cstrerror(errno) : "EOF");
-            return -1;
-        }
+                if (r < 0 && (errno == EINTR || errno == EAGAIN))
+                    break;
+
+                pa_log_debug("read(): %s", r < 0 ? pa_cstrerror(errno) : "EOF");
+                post_data(c, &chunk);
+                return -1;
+            }
 
-        chunk.memblock = c->playback.current_memblock;
-        chunk.index = c->playback.memblock_index;
-        chunk.length = (size_t) r;
+            if (!chunk.memblock) {
+                chunk.memblock = c->playback.current_memblock;
+                chunk.index = c->playback.memblock_index;
+            }
 
-        c->playback.memblock_index += (size_t) r;
+            chunk.length += (size_t) r;
+            c->playback.memblock_index += (size_t) r;
+            l -= (size_t) r;
+
+            /* A short read means there is nothing more right now */
+            if (l <= 0 || (size_t) r < n)
+                break;
+        }
 
-        pa_atomic_sub(&c->playback.missing, (int) r);
-        pa_asyncmsgq_post(c->sink_input->sink->asyncmsgq, PA_MSGOBJECT(c->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, &chunk, NULL);
+        post_data(c, &chunk);
     }
 
     return 0;
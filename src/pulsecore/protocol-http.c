@@ -40,6 +40,7 @@
 #include <pulsecore/shared.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/mime-type.h>
+#include <pulsecore/metrics.h>
 
 #include "protocol-http.h"
 
@@ -49,12 +50,14 @@
 #define URL_ROOT "/"
 #define URL_CSS "/style"
 #define URL_STATUS "/status"
+#define URL_METRICS "/metrics"
 #define URL_LISTEN "/listen"
 #define URL_LISTEN_SOURCE "/listen/source/"
 
 #define MIME_HTML "text/html; charset=utf-8"
 #define MIME_TEXT "text/plain; charset=utf-8"
 #define MIME_CSS "text/css"
+#define MIME_METRICS "text/plain; version=0.0.4; charset=utf-8"
 
 #define HTML_HEADER(t)                                                  \
     "<?xml version=\"1.0\"?>\n"                                         \
@@ -84,12 +87,25 @@ enum method {
     METHOD_HEAD
 };
 
+/* All listeners of a source share one source output, so that every
+ * additional listener only costs a queue of references to the same
+ * memblocks instead of another record stream with its own resampler */
+struct listen_feed {
+    pa_http_protocol *protocol;
+    pa_module *module;
+    pa_source_output *source_output;
+    pa_idxset *connections;
+
+    /* Set while we walk the connections, which may unlink themselves */
+    bool dispatching;
+};
+
 struct connection {
     pa_http_protocol *protocol;
     pa_iochannel *io;
     pa_ioline *line;
     pa_memblockq *output_memblockq;
-    pa_source_output *source_output;
+    struct listen_feed *feed;
     pa_client *client;
     enum state state;
     char *url;
@@ -102,6 +118,7 @@ struct pa_http_protocol {
 
     pa_core *core;
     pa_idxset *connections;
+    pa_idxset *feeds;
 
     pa_strlist *servers;
 };
@@ -110,14 +127,32 @@ enum {
     SOURCE_OUTPUT_MESSAGE_POST_DATA = PA_SOURCE_OUTPUT_MESSAGE_MAX
 };
 
+/* Called from main context */
+static void feed_free(struct listen_feed *f) {
+    pa_assert(f);
+    pa_assert(pa_idxset_isempty(f->connections));
+
+    if (f->source_output) {
+        pa_source_output_unlink(f->source_output);
+        f->source_output->userdata = NULL;
+        pa_source_output_unref(f->source_output);
+    }
+
+    pa_idxset_free(f->connections, NULL);
+    pa_idxset_remove_by_data(f->protocol->feeds, f, NULL);
+
+    pa_xfree(f);
+}
+
 /* Called from main context */
 static void connection_unlink(struct connection *c) {
     pa_assert(c);
 
-    if (c->source_output) {
-        pa_source_output_unlink(c->source_output);
-        c->source_output->userdata = NULL;
-        pa_source_output_unref(c->source_output);
+    if (c->feed) {
+        pa_idxset_remove_by_data(c->feed->connections, c, NULL);
+
+        if (!c->feed->dispatching && pa_idxset_isempty(c->feed->connections))
+            feed_free(c->feed);
     }
 
     if (c->client)
@@ -193,11 +228,13 @@ fail:
 /* Called from thread context, except when it is not */
 static int source_output_process_msg(pa_msgobject *m, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_source_output *o = PA_SOURCE_OUTPUT(m);
+    struct listen_feed *f;
     struct connection *c;
+    uint32_t idx;
 
     pa_source_output_assert_ref(o);
 
-    if (!(c = o->userdata))
+    if (!(f = o->userdata))
         return -1;
 
     switch (code) {
@@ -205,8 +242,20 @@ static int source_output_process_msg(pa_msgobject *m, int code, void *userdata,
         case SOURCE_OUTPUT_MESSAGE_POST_DATA:
             /* While this function is usually called from IO thread
              * context, this specific command is not! */
-            pa_memblockq_push_align(c->output_memblockq, chunk);
-            do_work(c);
+            f->dispatching = true;
+
+            PA_IDXSET_FOREACH(c, f->connections, idx) {
+                pa_memblockq_push_align(c->output_memblockq, chunk);
+
+                /* The response header might still be on its way */
+                if (c->io)
+                    do_work(c);
+            }
+
+            f->dispatching = false;
+
+            if (pa_idxset_isempty(f->connections))
+                feed_free(f);
             break;
 
         default:
@@ -218,10 +267,8 @@ static int source_output_process_msg(pa_msgobject *m, int code, void *userdata,
 
 /* Called from thread context */
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk) {
-    struct connection *c;
-
     pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
+    pa_assert(o->userdata);
     pa_assert(chunk);
 
     pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(o), SOURCE_OUTPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
@@ -229,22 +276,37 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
 
 /* Called from main context */
 static void source_output_kill_cb(pa_source_output *o) {
-    struct connection*c;
+    struct listen_feed *f;
+    struct connection *c;
 
     pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
+    pa_assert_se(f = o->userdata);
 
-    connection_unlink(c);
+    f->dispatching = true;
+
+    while ((c = pa_idxset_first(f->connections, NULL)))
+        connection_unlink(c);
+
+    f->dispatching = false;
+
+    feed_free(f);
 }
 
 /* Called from main context */
 static pa_usec_t source_output_get_latency_cb(pa_source_output *o) {
-    struct connection*c;
+    struct listen_feed *f;
+    struct connection *c;
+    uint32_t idx;
+    size_t length = 0;
 
     pa_source_output_assert_ref(o);
-    pa_assert_se(c = o->userdata);
+    pa_assert_se(f = o->userdata);
 
-    return pa_bytes_to_usec(pa_memblockq_get_length(c->output_memblockq), &c->source_output->sample_spec);
+    /* Report the listener that lags behind the most */
+    PA_IDXSET_FOREACH(c, f->connections, idx)
+        length = PA_MAX(length, pa_memblockq_get_length(c->output_memblockq));
+
+    return pa_bytes_to_usec(length, &o->sample_spec);
 }
 
 /*** client callbacks ***/
@@ -406,6 +468,7 @@ static void handle_root(struct connection *c) {
     pa_ioline_puts(c->line,
                    "</table>\n"
                    "<p><a href=\"" URL_STATUS "\">Show an extensive server status report</a></p>\n"
+                   "<p><a href=\"" URL_METRICS "\">Show metrics for monitoring systems</a></p>\n"
                    "<p><a href=\"" URL_LISTEN "\">Monitor sinks and sources</a></p>\n"
                    HTML_FOOTER);
 
@@ -453,6 +516,47 @@ static void handle_status(struct connection *c) {
     pa_ioline_defer_close(c->line);
 }
 
+/* Unlike the status report this only reads counters, without asking
+ * any IO thread, so it is cheap enough to be scraped regularly */
+static void handle_metrics(struct connection *c) {
+    const pa_mempool_stat *stat;
+    pa_core *core;
+    pa_strbuf *s;
+    char *r;
+
+    pa_assert(c);
+
+    http_response(c, 200, "OK", MIME_METRICS);
+
+    if (c->method == METHOD_HEAD) {
+        pa_ioline_defer_close(c->line);
+        return;
+    }
+
+    core = c->protocol->core;
+    stat = pa_mempool_get_stat(core->mempool);
+    s = pa_strbuf_new();
+
+    pa_metrics_put_gauge(s, "pulseaudio_clients", "Number of connected clients.",
+                         pa_idxset_size(core->clients));
+    pa_metrics_put_gauge(s, "pulseaudio_sink_inputs", "Number of sink inputs.",
+                         pa_idxset_size(core->sink_inputs));
+    pa_metrics_put_gauge(s, "pulseaudio_source_outputs", "Number of source outputs.",
+                         pa_idxset_size(core->source_outputs));
+    pa_metrics_put_gauge(s, "pulseaudio_mempool_blocks", "Memory blocks currently allocated.",
+                         pa_atomic_load(&stat->n_allocated));
+    pa_metrics_put_gauge(s, "pulseaudio_mempool_bytes", "Size of the memory blocks currently allocated.",
+                         pa_atomic_load(&stat->allocated_size));
+
+    pa_metrics_to_strbuf(core->metrics, s);
+
+    r = pa_strbuf_to_string_free(s);
+    pa_ioline_puts(c->line, r);
+    pa_xfree(r);
+
+    pa_ioline_defer_close(c->line);
+}
+
 static void handle_listen(struct connection *c) {
     pa_source *source;
     pa_sink *sink;
@@ -531,70 +635,105 @@ static void line_drain_callback(pa_ioline *l, void *userdata) {
     c->line = NULL;
 }
 
-static void handle_listen_prefix(struct connection *c, const char *source_name) {
-    pa_source *source;
+static struct listen_feed *feed_get(struct connection *c, pa_source *source) {
+    struct listen_feed *f;
     pa_source_output_new_data data;
     pa_sample_spec ss;
     pa_channel_map cm;
-    char *t;
-    size_t l;
+    uint32_t idx;
 
     pa_assert(c);
-    pa_assert(source_name);
-
-    pa_assert(c->line);
-    pa_assert(!c->io);
+    pa_assert(source);
 
-    if (!(source = pa_namereg_get(c->protocol->core, source_name, PA_NAMEREG_SOURCE))) {
-        html_response(c, 404, "Source not found", NULL);
-        return;
-    }
+    PA_IDXSET_FOREACH(f, c->protocol->feeds, idx)
+        if (f->module == c->module && f->source_output->source == source)
+            return f;
 
     ss = source->sample_spec;
     cm = source->channel_map;
 
     pa_sample_spec_mimefy(&ss, &cm);
 
+    f = pa_xnew0(struct listen_feed, 1);
+    f->protocol = c->protocol;
+    f->module = c->module;
+    f->connections = pa_idxset_new(NULL, NULL);
+
+    /* The stream outlives the client that asked for it first, so it
+     * doesn't belong to any of them */
     pa_source_output_new_data_init(&data);
     data.driver = __FILE__;
     data.module = c->module;
-    data.client = c->client;
     pa_source_output_new_data_set_source(&data, source, false);
-    pa_proplist_update(data.proplist, PA_UPDATE_MERGE, c->client->proplist);
+    pa_proplist_sets(data.proplist, PA_PROP_MEDIA_NAME, "HTTP stream");
     pa_source_output_new_data_set_sample_spec(&data, &ss);
     pa_source_output_new_data_set_channel_map(&data, &cm);
 
-    pa_source_output_new(&c->source_output, c->protocol->core, &data);
+    pa_source_output_new(&f->source_output, c->protocol->core, &data);
     pa_source_output_new_data_done(&data);
 
-    if (!c->source_output) {
-        html_response(c, 403, "Cannot create source output", NULL);
+    if (!f->source_output) {
+        pa_idxset_free(f->connections, NULL);
+        pa_xfree(f);
+        return NULL;
+    }
+
+    f->source_output->parent.process_msg = source_output_process_msg;
+    f->source_output->push = source_output_push_cb;
+    f->source_output->kill = source_output_kill_cb;
+    f->source_output->get_latency = source_output_get_latency_cb;
+    f->source_output->userdata = f;
+
+    pa_source_output_set_requested_latency(f->source_output, DEFAULT_SOURCE_LATENCY);
+
+    pa_idxset_put(c->protocol->feeds, f, NULL);
+
+    pa_source_output_put(f->source_output);
+
+    return f;
+}
+
+static void handle_listen_prefix(struct connection *c, const char *source_name) {
+    pa_source *source;
+    struct listen_feed *f;
+    const pa_sample_spec *ss;
+    char *t;
+    size_t l;
+
+    pa_assert(c);
+    pa_assert(source_name);
+
+    pa_assert(c->line);
+    pa_assert(!c->io);
+
+    if (!(source = pa_namereg_get(c->protocol->core, source_name, PA_NAMEREG_SOURCE))) {
+        html_response(c, 404, "Source not found", NULL);
         return;
     }
 
-    c->source_output->parent.process_msg = source_output_process_msg;
-    c->source_output->push = source_output_push_cb;
-    c->source_output->kill = source_output_kill_cb;
-    c->source_output->get_latency = source_output_get_latency_cb;
-    c->source_output->userdata = c;
+    if (!(f = feed_get(c, source))) {
+        html_response(c, 403, "Cannot create source output", NULL);
+        return;
+    }
 
-    pa_source_output_set_requested_latency(c->source_output, DEFAULT_SOURCE_LATENCY);
+    ss = &f->source_output->sample_spec;
 
-    l = (size_t) (pa_bytes_per_second(&ss)*RECORD_BUFFER_SECONDS);
+    l = (size_t) (pa_bytes_per_second(ss)*RECORD_BUFFER_SECONDS);
     c->output_memblockq = pa_memblockq_new(
             "http protocol connection output_memblockq",
             0,
             l,
             0,
-            &ss,
+            ss,
             1,
             0,
             0,
             NULL);
 
-    pa_source_output_put(c->source_output);
+    c->feed = f;
+    pa_idxset_put(f->connections, c, NULL);
 
-    t = pa_sample_spec_to_mime_type(&ss, &cm);
+    t = pa_sample_spec_to_mime_type(ss, &f->source_output->channel_map);
     http_response(c, 200, "OK", t);
     pa_xfree(t);
 
@@ -621,6 +760,8 @@ static void handle_url(struct connection *c) {
         handle_css(c);
     else if (pa_streq(c->url, URL_STATUS))
         handle_status(c);
+    else if (pa_streq(c->url, URL_METRICS))
+        handle_metrics(c);
     else if (pa_streq(c->url, URL_LISTEN))
         handle_listen(c);
     else if (pa_startswith(c->url, URL_LISTEN_SOURCE))
@@ -748,6 +889,7 @@ static pa_http_protocol* http_protocol_new(pa_core *c) {
     PA_REFCNT_INIT(p);
     p->core = c;
     p->connections = pa_idxset_new(NULL, NULL);
+    p->feeds = pa_idxset_new(NULL, NULL);
 
     pa_assert_se(pa_shared_set(c, "http-protocol", p) >= 0);
 
@@ -786,6 +928,9 @@ void pa_http_protocol_unref(pa_http_protocol *p) {
 
     pa_idxset_free(p->connections, NULL);
 
+    pa_assert(pa_idxset_isempty(p->feeds));
+    pa_idxset_free(p->feeds, NULL);
+
     pa_strlist_free(p->servers);
 
     pa_assert_se(pa_shared_remove(p->core, "http-protocol") >= 0);
@@ -34,6 +34,7 @@
 #include <pulse/util.h>
 #include <pulse/xmalloc.h>
 #include <pulse/internal.h>
+#include <pulse/introspect.h>
 
 #include <pulsecore/native-common.h>
 #include <pulsecore/packet.h>
@@ -73,6 +74,13 @@
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
 #define DEFAULT_FRAGSIZE_MSEC DEFAULT_TLENGTH_MSEC
 
+/* With automatic buffer sizing, how long a stream has to play without
+ * underruns before its tlength is lowered again */
+#define AUTO_BUFFER_SHRINK_USEC (10*PA_USEC_PER_SEC)
+
+/* Don't let clients delay their subscription events for longer than this */
+#define MAX_SUBSCRIPTION_INTERVAL (10 * PA_USEC_PER_SEC)
+
 struct pa_native_protocol;
 
 typedef struct record_stream {
@@ -140,11 +148,22 @@ typedef struct playback_stream {
     /* Fixed-up and adjusted buffer attributes */
     pa_buffer_attr buffer_attr;
 
+    /* Automatic buffer sizing: the tlength limits are set together with
+     * buffer_attr, the rest is only touched from the IO thread */
+    bool auto_buffer_attr:1;
+    size_t auto_tlength_min, auto_tlength_max;
+    size_t auto_fill_min;
+    uint64_t auto_played_mark;
+
     /* Only updated after SINK_INPUT_MESSAGE_UPDATE_LATENCY */
     int64_t read_index, write_index;
     size_t render_memblockq_length;
     pa_usec_t current_sink_latency;
     uint64_t playing_for, underrun_for;
+
+    /* Where the IO thread publishes the timing for the client, or NULL */
+    pa_memblock *timing_memblock;
+    pa_srbchannel_timing_slot *timing_slot;
 } playback_stream;
 
 #define PLAYBACK_STREAM(o) (playback_stream_cast(o))
@@ -167,6 +186,18 @@ typedef struct upload_stream {
 #define UPLOAD_STREAM(o) (upload_stream_cast(o))
 PA_DEFINE_PRIVATE_CLASS(upload_stream, output_stream);
 
+enum {
+    INFO_LIST_SINK,
+    INFO_LIST_SOURCE,
+    INFO_LIST_CLIENT,
+    INFO_LIST_CARD,
+    INFO_LIST_MODULE,
+    INFO_LIST_SINK_INPUT,
+    INFO_LIST_SOURCE_OUTPUT,
+    INFO_LIST_SAMPLE,
+    INFO_LIST_MAX
+};
+
 struct pa_native_connection {
     pa_msgobject parent;
     pa_native_protocol *protocol;
@@ -186,8 +217,18 @@ struct pa_native_connection {
     pa_idxset *record_streams, *output_streams;
     uint32_t rrobin_index;
     pa_subscription *subscription;
+    pa_tagstruct *subscription_events;
     pa_time_event *auth_timeout_event;
     pa_srbchannel *srbpending;
+
+    /* The shm block of an enabled srbchannel that carries timing slots,
+     * and a bitmask of the slots that belong to a playback stream */
+    pa_memblock *srb_memblock;
+    uint32_t timing_slots_used;
+
+    /* Bytes per entry of the last reply to each of the
+     * GET_*_INFO_LIST commands, to size the next one up front */
+    size_t info_list_entry_size[INFO_LIST_MAX];
 };
 
 #define PA_NATIVE_CONNECTION(o) (pa_native_connection_cast(o))
@@ -203,8 +244,39 @@ struct pa_native_protocol {
     pa_hook hooks[PA_NATIVE_HOOK_MAX];
 
     pa_hashmap *extensions;
+
+    /* Per subscription facility, index -> struct proplist_tracker */
+    pa_hashmap *proplist_trackers[PA_SUBSCRIPTION_EVENT_FACILITY_MASK+1];
+    pa_subscription *proplist_subscription;
 };
 
+/* Remembers how the proplist of an object changed over time, so that
+ * clients that already know an older version can be sent only the keys
+ * that were set or removed since. Versions are bumped whenever the
+ * proplist is found changed while writing an info reply. */
+struct proplist_tracker {
+    uint32_t version;
+    /* The oldest version deltas can be computed from */
+    uint32_t floor;
+    pa_proplist *proplist;
+    /* Key -> version it was last set or removed in */
+    pa_hashmap *set;
+    pa_hashmap *unset;
+};
+
+#define PROPLIST_TRACKER_UNSET_MAX 32
+
+/* How proplists are written into info replies */
+typedef struct proplist_request {
+    bool with_proplist;
+    /* Use the versioned format of protocol 33, see put_proplist() */
+    bool tracked;
+    /* Index -> version of the proplist the client knows, or NULL if it
+     * sent a single version for the one object asked for */
+    pa_hashmap *known;
+    uint32_t known_version;
+} proplist_request;
+
 enum {
     SOURCE_OUTPUT_MESSAGE_UPDATE_LATENCY = PA_SOURCE_OUTPUT_MESSAGE_MAX
 };
@@ -637,6 +709,21 @@ static void playback_stream_unlink(playback_stream *s) {
         s->sink_input = NULL;
     }
 
+    if (s->timing_slot) {
+        pa_srbchannel_timing t;
+
+        /* The IO thread is done with the slot now */
+        pa_zero(t);
+        t.channel = PA_INVALID_INDEX;
+        pa_srbchannel_timing_publish(s->timing_slot, &t);
+
+        s->connection->timing_slots_used &= ~(1U << (s->index % PA_SRBCHANNEL_TIMING_SLOTS));
+        s->timing_slot = NULL;
+
+        pa_memblock_unref(s->timing_memblock);
+        s->timing_memblock = NULL;
+    }
+
     if (s->drain_request)
         pa_pstream_send_error(s->connection->pstream, s->drain_tag, PA_ERR_NOENTITY);
 
@@ -931,6 +1018,23 @@ static void fix_playback_buffer_attr(playback_stream *s) {
         s->buffer_attr.prebuf > max_prebuf)
         s->buffer_attr.prebuf = max_prebuf;
 
+    /* The server may move tlength between the lowest value that works
+     * with the sink latency we got and the client's maxlength. It never
+     * goes below what prebuf needs, so that only tlength ever changes,
+     * and we only do it for clients that asked us to adjust the latency
+     * and that can be told about the change. */
+    s->auto_buffer_attr =
+        s->connection->options->auto_buffer_attr &&
+        s->adjust_latency &&
+        !s->early_requests &&
+        s->connection->version >= 15;
+
+    if (s->auto_buffer_attr) {
+        s->auto_tlength_min = pa_usec_to_bytes_round_up(s->configured_sink_latency + 2*minreq_usec, &s->sink_input->sample_spec);
+        s->auto_tlength_min = PA_MAX(s->auto_tlength_min, (size_t) s->buffer_attr.prebuf + s->buffer_attr.minreq);
+        s->auto_tlength_max = PA_MAX((size_t) s->buffer_attr.maxlength, s->auto_tlength_min);
+    }
+
 #ifdef PROTOCOL_NATIVE_DEBUG
     pa_log("Client accepted: maxlength=%lu ms tlength=%lu ms minreq=%lu ms prebuf=%lu ms",
            (unsigned long) (pa_bytes_to_usec(s->buffer_attr.maxlength, &s->sink_input->sample_spec) / PA_USEC_PER_MSEC),
@@ -1083,6 +1187,9 @@ static playback_stream* playback_stream_new(
 
     pa_memblockq_get_attr(s->memblockq, &s->buffer_attr);
 
+    s->auto_fill_min = (size_t) -1;
+    s->auto_played_mark = 0;
+
     *missing = (uint32_t) pa_memblockq_pop_missing(s->memblockq);
 
 #ifdef PROTOCOL_NATIVE_DEBUG
@@ -1094,6 +1201,20 @@ static playback_stream* playback_stream_new(
 
     pa_idxset_put(c->output_streams, s, &s->index);
 
+    if (c->srb_memblock && !(c->timing_slots_used & (1U << (s->index % PA_SRBCHANNEL_TIMING_SLOTS)))) {
+        pa_srbchannel_timing t;
+
+        s->timing_memblock = pa_memblock_ref(c->srb_memblock);
+        s->timing_slot = pa_srbchannel_get_timing_slot(s->timing_memblock, s->index);
+        c->timing_slots_used |= 1U << (s->index % PA_SRBCHANNEL_TIMING_SLOTS);
+
+        pa_zero(t);
+        t.channel = s->index;
+        t.read_index = start_index;
+        t.timestamp = pa_rtclock_now();
+        pa_srbchannel_timing_publish(s->timing_slot, &t);
+    }
+
     pa_log_info("Final latency %0.2f ms = %0.2f ms + 2*%0.2f ms + %0.2f ms",
                 ((double) pa_bytes_to_usec(s->buffer_attr.tlength, &sink_input->sample_spec) + (double) s->configured_sink_latency) / PA_USEC_PER_MSEC,
                 (double) pa_bytes_to_usec(s->buffer_attr.tlength-s->buffer_attr.minreq*2, &sink_input->sample_spec) / PA_USEC_PER_MSEC,
@@ -1199,6 +1320,11 @@ static void native_connection_unlink(pa_native_connection *c) {
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
+    if (c->subscription_events) {
+        pa_tagstruct_free(c->subscription_events);
+        c->subscription_events = NULL;
+    }
+
     if (c->pstream)
         pa_pstream_unlink(c->pstream);
 
@@ -1225,6 +1351,8 @@ static void native_connection_free(pa_object *o) {
 
     pa_pdispatch_unref(c->pdispatch);
     pa_pstream_unref(c->pstream);
+    if (c->srb_memblock)
+        pa_memblock_unref(c->srb_memblock);
     if (c->rw_mempool)
         pa_mempool_unref(c->rw_mempool);
 
@@ -1311,6 +1439,28 @@ static void flush_write_no_account(pa_memblockq *q) {
     pa_memblockq_flush_write(q, false);
 }
 
+/* Called from thread context. pending is what was just popped from
+ * the queue but has not made it into the render queue yet. */
+static void playback_stream_publish_timing(playback_stream *s, size_t pending, bool playing) {
+    pa_sink_input *i = s->sink_input;
+    pa_srbchannel_timing t;
+
+    if (!s->timing_slot)
+        return;
+
+    t.channel = s->index;
+    t.playing = playing;
+    t.read_index = pa_memblockq_get_read_index(s->memblockq);
+    t.sink_usec =
+        pa_sink_get_latency_within_thread(i->sink) +
+        pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec) +
+        pa_bytes_to_usec(pending, &i->sample_spec);
+    t.timestamp = pa_rtclock_now();
+    t.since_underrun = playing ? i->thread_info.playing_for : i->thread_info.underrun_for;
+
+    pa_srbchannel_timing_publish(s->timing_slot, &t);
+}
+
 /* Called from thread context */
 static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_sink_input *i = PA_SINK_INPUT(o);
@@ -1438,6 +1588,9 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
 
             handle_seek(s, windex);
 
+            if (PA_PTR_TO_UINT(userdata) != PA_SINK_INPUT_RUNNING)
+                playback_stream_publish_timing(s, 0, false);
+
             /* Fall through to the default handler */
             break;
         }
@@ -1455,6 +1608,9 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
         case SINK_INPUT_MESSAGE_UPDATE_BUFFER_ATTR: {
             pa_memblockq_apply_attr(s->memblockq, &s->buffer_attr);
             pa_memblockq_get_attr(s->memblockq, &s->buffer_attr);
+
+            s->auto_fill_min = (size_t) -1;
+            s->auto_played_mark = i->thread_info.playing_for;
             return 0;
         }
     }
@@ -1462,6 +1618,50 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
     return pa_sink_input_process_msg(o, code, userdata, offset, chunk);
 }
 
+/* Called from thread context */
+static void auto_buffer_attr_set_tlength(playback_stream *s, size_t tlength) {
+    size_t old_tlength;
+
+    s->auto_fill_min = (size_t) -1;
+    s->auto_played_mark = s->sink_input->thread_info.playing_for;
+
+    old_tlength = pa_memblockq_get_tlength(s->memblockq);
+    pa_memblockq_set_tlength(s->memblockq, PA_CLAMP(tlength, s->auto_tlength_min, s->auto_tlength_max));
+    tlength = pa_memblockq_get_tlength(s->memblockq);
+
+    if (tlength == old_tlength)
+        return;
+
+    pa_log_debug("Automatically changing tlength of '%s' from %0.2f ms to %0.2f ms",
+                 pa_strnull(pa_proplist_gets(s->sink_input->proplist, PA_PROP_MEDIA_NAME)),
+                 (double) pa_bytes_to_usec(old_tlength, &s->sink_input->sample_spec) / PA_USEC_PER_MSEC,
+                 (double) pa_bytes_to_usec(tlength, &s->sink_input->sample_spec) / PA_USEC_PER_MSEC);
+
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_UPDATE_TLENGTH, NULL, tlength, NULL, NULL);
+}
+
+/* Called from thread context, after data has been taken from the
+ * queue. The lowest fill level seen between two adjustments is how
+ * much earlier than necessary the client answers our requests. After
+ * playing long enough without underruns we give half of that back. */
+static void auto_buffer_attr_update(playback_stream *s) {
+    uint64_t played;
+    size_t tlength;
+
+    s->auto_fill_min = PA_MIN(s->auto_fill_min, pa_memblockq_get_length(s->memblockq));
+
+    played = s->sink_input->thread_info.playing_for;
+
+    if (played < s->auto_played_mark)
+        s->auto_played_mark = played;
+
+    if (played - s->auto_played_mark < pa_usec_to_bytes(AUTO_BUFFER_SHRINK_USEC, &s->sink_input->sample_spec))
+        return;
+
+    tlength = pa_memblockq_get_tlength(s->memblockq);
+    auto_buffer_attr_set_tlength(s, tlength - PA_MIN(s->auto_fill_min, tlength) / 2);
+}
+
 static bool handle_input_underrun(playback_stream *s, bool force) {
     bool send_drain;
 
@@ -1480,6 +1680,10 @@ static bool handle_input_underrun(playback_stream *s, bool force) {
          pa_log_debug("Drain acknowledged of '%s'", pa_strnull(pa_proplist_gets(s->sink_input->proplist, PA_PROP_MEDIA_NAME)));
     } else if (!s->is_underrun) {
          pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_UNDERFLOW, NULL, pa_memblockq_get_read_index(s->memblockq), NULL, NULL);
+
+         /* The client didn't keep up, give it more room */
+         if (s->auto_buffer_attr)
+             auto_buffer_attr_set_tlength(s, pa_memblockq_get_tlength(s->memblockq) * 3 / 2);
     }
     s->is_underrun = true;
     playback_stream_request_bytes(s);
@@ -1515,8 +1719,10 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     /* This call will not fail with prebuf=0, hence we check for
        underrun explicitly in handle_input_underrun */
-    if (pa_memblockq_peek(s->memblockq, chunk) < 0)
+    if (pa_memblockq_peek(s->memblockq, chunk) < 0) {
+        playback_stream_publish_timing(s, 0, false);
         return -1;
+    }
 
     chunk->length = PA_MIN(nbytes, chunk->length);
 
@@ -1524,8 +1730,14 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
         pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PLAYBACK_STREAM_MESSAGE_STARTED, NULL, 0, NULL, NULL);
 
     pa_memblockq_drop(s->memblockq, chunk->length);
+
+    if (s->auto_buffer_attr)
+        auto_buffer_attr_update(s);
+
     playback_stream_request_bytes(s);
 
+    playback_stream_publish_timing(s, chunk->length, true);
+
     return 0;
 }
 
@@ -1542,6 +1754,8 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
         return;
 
     pa_memblockq_rewind(s->memblockq, nbytes);
+
+    playback_stream_publish_timing(s, 0, true);
 }
 
 /* Called from thread context */
@@ -1830,24 +2044,35 @@ if (!(expression)) { \
 } \
 } while(0);
 
-static pa_tagstruct *reply_new(uint32_t tag) {
+#define CHECK_VALIDITY_SET_GOTO(expression, var, error, label) do { \
+if (!(expression)) { \
+    (var) = (error); \
+    goto label; \
+} \
+} while(0);
+
+static pa_tagstruct *reply_new(pa_native_connection *c, uint32_t tag) {
     pa_tagstruct *reply;
 
     reply = pa_tagstruct_new();
+    pa_tagstruct_set_compact(reply, c->version >= 33);
     pa_tagstruct_putu32(reply, PA_COMMAND_REPLY);
     pa_tagstruct_putu32(reply, tag);
     return reply;
 }
 
-static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
-    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+/* Creates a playback stream from the parameters of one
+ * PA_COMMAND_CREATE_PLAYBACK_STREAM request in t, and appends the reply
+ * body for it to reply. Returns 0 on success, a PA_ERR_XXX code if the
+ * stream could not be created, or -1 if the client was kicked for a
+ * protocol error. */
+static int create_playback_stream(pa_native_connection *c, pa_tagstruct *t, pa_tagstruct *reply, playback_stream **ret_s) {
     playback_stream *s;
     uint32_t sink_index, syncid, missing = 0;
     pa_buffer_attr attr;
     const char *name = NULL, *sink_name;
     pa_sample_spec ss;
     pa_channel_map map;
-    pa_tagstruct *reply;
     pa_sink *sink = NULL;
     pa_cvolume volume;
     bool
@@ -1879,6 +2104,8 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
+    pa_assert(reply);
+    pa_assert(ret_s);
     memset(&attr, 0, sizeof(attr));
 
     if ((c->version < 13 && (pa_tagstruct_gets(t, &name) < 0 || !name)) ||
@@ -1898,14 +2125,15 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
                 PA_TAG_INVALID) < 0) {
 
         protocol_error(c);
+        ret = -1;
         goto finish;
     }
 
-    CHECK_VALIDITY_GOTO(c->pstream, c->authorized, tag, PA_ERR_ACCESS, finish);
-    CHECK_VALIDITY_GOTO(c->pstream, !sink_name || pa_namereg_is_valid_name_or_wildcard(sink_name, PA_NAMEREG_SINK), tag, PA_ERR_INVALID, finish);
-    CHECK_VALIDITY_GOTO(c->pstream, sink_index == PA_INVALID_INDEX || !sink_name, tag, PA_ERR_INVALID, finish);
-    CHECK_VALIDITY_GOTO(c->pstream, !sink_name || sink_index == PA_INVALID_INDEX, tag, PA_ERR_INVALID, finish);
-    CHECK_VALIDITY_GOTO(c->pstream, pa_cvolume_valid(&volume), tag, PA_ERR_INVALID, finish);
+    CHECK_VALIDITY_SET_GOTO(c->authorized, ret, PA_ERR_ACCESS, finish);
+    CHECK_VALIDITY_SET_GOTO(!sink_name || pa_namereg_is_valid_name_or_wildcard(sink_name, PA_NAMEREG_SINK), ret, PA_ERR_INVALID, finish);
+    CHECK_VALIDITY_SET_GOTO(sink_index == PA_INVALID_INDEX || !sink_name, ret, PA_ERR_INVALID, finish);
+    CHECK_VALIDITY_SET_GOTO(!sink_name || sink_index == PA_INVALID_INDEX, ret, PA_ERR_INVALID, finish);
+    CHECK_VALIDITY_SET_GOTO(pa_cvolume_valid(&volume), ret, PA_ERR_INVALID, finish);
 
     p = pa_proplist_new();
 
@@ -1924,6 +2152,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
             pa_tagstruct_get_boolean(t, &variable_rate) < 0) {
 
             protocol_error(c);
+            ret = -1;
             goto finish;
         }
     }
@@ -1935,6 +2164,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
             pa_tagstruct_get_proplist(t, p) < 0) {
 
             protocol_error(c);
+            ret = -1;
             goto finish;
         }
     }
@@ -1945,6 +2175,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
             pa_tagstruct_get_boolean(t, &early_requests) < 0) {
 
             protocol_error(c);
+            ret = -1;
             goto finish;
         }
     }
@@ -1956,6 +2187,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
             pa_tagstruct_get_boolean(t, &fail_on_suspend) < 0) {
 
             protocol_error(c);
+            ret = -1;
             goto finish;
         }
     }
@@ -1965,6 +2197,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         if (pa_tagstruct_get_boolean(t, &relative_volume) < 0) {
 
             protocol_error(c);
+            ret = -1;
             goto finish;
         }
     }
@@ -1973,6 +2206,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
 
         if (pa_tagstruct_get_boolean(t, &passthrough) < 0 ) {
             protocol_error(c);
+            ret = -1;
             goto finish;
         }
     }
@@ -1981,6 +2215,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
 
         if (pa_tagstruct_getu8(t, &n_formats) < 0) {
             protocol_error(c);
+            ret = -1;
             goto finish;
         }
 
@@ -1991,6 +2226,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
             format = pa_format_info_new();
             if (pa_tagstruct_get_format_info(t, format) < 0) {
                 protocol_error(c);
+                ret = -1;
                 goto finish;
             }
             pa_idxset_put(formats, format, NULL);
@@ -1998,31 +2234,32 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
     }
 
     if (n_formats == 0) {
-        CHECK_VALIDITY_GOTO(c->pstream, pa_sample_spec_valid(&ss), tag, PA_ERR_INVALID, finish);
-        CHECK_VALIDITY_GOTO(c->pstream, map.channels == ss.channels && volume.channels == ss.channels, tag, PA_ERR_INVALID, finish);
-        CHECK_VALIDITY_GOTO(c->pstream, pa_channel_map_valid(&map), tag, PA_ERR_INVALID, finish);
+        CHECK_VALIDITY_SET_GOTO(pa_sample_spec_valid(&ss), ret, PA_ERR_INVALID, finish);
+        CHECK_VALIDITY_SET_GOTO(map.channels == ss.channels && volume.channels == ss.channels, ret, PA_ERR_INVALID, finish);
+        CHECK_VALIDITY_SET_GOTO(pa_channel_map_valid(&map), ret, PA_ERR_INVALID, finish);
     } else {
         PA_IDXSET_FOREACH(format, formats, i) {
-            CHECK_VALIDITY_GOTO(c->pstream, pa_format_info_valid(format), tag, PA_ERR_INVALID, finish);
+            CHECK_VALIDITY_SET_GOTO(pa_format_info_valid(format), ret, PA_ERR_INVALID, finish);
         }
     }
 
     if (!pa_tagstruct_eof(t)) {
         protocol_error(c);
+        ret = -1;
         goto finish;
     }
 
     if (sink_index != PA_INVALID_INDEX) {
 
         if (!(sink = pa_idxset_get_by_index(c->protocol->core->sinks, sink_index))) {
-            pa_pstream_send_error(c->pstream, tag, PA_ERR_NOENTITY);
+            ret = PA_ERR_NOENTITY;
             goto finish;
         }
 
     } else if (sink_name) {
 
         if (!(sink = pa_namereg_get(c->protocol->core, sink_name, PA_NAMEREG_SINK))) {
-            pa_pstream_send_error(c->pstream, tag, PA_ERR_NOENTITY);
+            ret = PA_ERR_NOENTITY;
             goto finish;
         }
     }
@@ -2048,9 +2285,9 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
     /* We no longer own the formats idxset */
     formats = NULL;
 
-    CHECK_VALIDITY_GOTO(c->pstream, s, tag, ret, finish);
+    if (!s)
+        goto finish;
 
-    reply = reply_new(tag);
     pa_tagstruct_putu32(reply, s->index);
     pa_assert(s->sink_input);
     pa_tagstruct_putu32(reply, s->sink_input->index);
@@ -2097,13 +2334,124 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         }
     }
 
-    pa_pstream_send_tagstruct(c->pstream, reply);
+    *ret_s = s;
+    ret = 0;
 
 finish:
     if (p)
         pa_proplist_free(p);
     if (formats)
         pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
+
+    return ret;
+}
+
+static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    playback_stream *s;
+    pa_tagstruct *reply;
+    int r;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    reply = reply_new(c, tag);
+
+    if ((r = create_playback_stream(c, t, reply, &s)) != 0) {
+        pa_tagstruct_free(reply);
+
+        if (r > 0)
+            pa_pstream_send_error(c->pstream, tag, r);
+
+        return;
+    }
+
+    pa_pstream_send_tagstruct(c->pstream, reply);
+}
+
+static void command_create_playback_streams(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    playback_stream **streams;
+    pa_tagstruct **bodies;
+    pa_tagstruct *reply;
+    uint32_t n, i, k;
+    int r = 0;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &n) < 0) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    CHECK_VALIDITY(c->pstream, n > 0 && n <= PA_NATIVE_CREATE_STREAMS_MAX, tag, PA_ERR_INVALID);
+
+    streams = pa_xnew0(playback_stream *, n);
+    bodies = pa_xnew0(pa_tagstruct *, n);
+
+    /* Each stream is created exactly like with
+     * PA_COMMAND_CREATE_PLAYBACK_STREAM, so that policy modules see every
+     * single one of them. Either all streams are kept, or none. */
+    for (i = 0; i < n; i++) {
+        uint32_t length;
+        const void *data;
+        pa_tagstruct *request;
+
+        if (pa_tagstruct_getu32(t, &length) < 0 ||
+            pa_tagstruct_get_arbitrary(t, &data, length) < 0) {
+            protocol_error(c);
+            r = -1;
+            break;
+        }
+
+        request = pa_tagstruct_new_fixed(data, length);
+        bodies[i] = pa_tagstruct_new();
+        pa_tagstruct_set_compact(bodies[i], true);
+        r = create_playback_stream(c, request, bodies[i], &streams[i]);
+        pa_tagstruct_free(request);
+
+        if (r != 0)
+            break;
+    }
+
+    if (r == 0 && !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        r = -1;
+    }
+
+    if (r == 0) {
+        reply = reply_new(c, tag);
+        pa_tagstruct_putu32(reply, n);
+
+        for (i = 0; i < n; i++) {
+            const uint8_t *data;
+            size_t length;
+
+            data = pa_tagstruct_data(bodies[i], &length);
+            pa_tagstruct_putu32(reply, (uint32_t) length);
+            pa_tagstruct_put_arbitrary(reply, data, length);
+        }
+
+        pa_pstream_send_tagstruct(c->pstream, reply);
+    } else {
+        /* A kicked client took its streams with it */
+        if (r > 0) {
+            for (k = 0; k < n; k++)
+                if (streams[k])
+                    playback_stream_unlink(streams[k]);
+
+            pa_pstream_send_error(c->pstream, tag, r);
+        }
+    }
+
+    for (i = 0; i < n; i++)
+        if (bodies[i])
+            pa_tagstruct_free(bodies[i]);
+
+    pa_xfree(bodies);
+    pa_xfree(streams);
 }
 
 static void command_delete_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -2371,7 +2719,7 @@ static void command_create_record_stream(pa_pdispatch *pd, uint32_t command, uin
 
     CHECK_VALIDITY_GOTO(c->pstream, s, tag, ret, finish);
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     pa_tagstruct_putu32(reply, s->index);
     pa_assert(s->source_output);
     pa_tagstruct_putu32(reply, s->source_output->index);
@@ -2474,7 +2822,10 @@ static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
         return;
     }
 
-    if (!(c->rw_mempool = pa_mempool_new(shm_type, c->protocol->core->shm_size, true))) {
+    /* The pool only ever holds the srbchannel's ring buffers, a single
+     * block. Sizing it like the core's pool would have both sides map
+     * another 64 MiB for every client. */
+    if (!(c->rw_mempool = pa_mempool_new(shm_type, 2 * pa_mempool_block_size_max(c->protocol->core->mempool), true))) {
         pa_log_warn("Disabling srbchannel, reason: Failed to allocate shared "
                     "writable memory pool.");
         return;
@@ -2489,7 +2840,7 @@ static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
     }
     pa_mempool_set_is_remote_writable(c->rw_mempool, true);
 
-    srb = pa_srbchannel_new(c->protocol->core->mainloop, c->rw_mempool);
+    srb = pa_srbchannel_new(c->protocol->core->mainloop, c->rw_mempool, c->version >= 33);
     if (!srb) {
         pa_log_debug("Failed to create srbchannel");
         goto fail;
@@ -2530,6 +2881,14 @@ static void command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32
     }
 
     pa_log_debug("Client enabled srbchannel.");
+
+    if (c->version >= 33 && !c->srb_memblock) {
+        pa_srbchannel_template srbt;
+
+        pa_srbchannel_export(c->srbpending, &srbt);
+        c->srb_memblock = pa_memblock_ref(srbt.memblock);
+    }
+
     pa_pstream_set_srbchannel(c->pstream, c->srbpending);
     c->srbpending = NULL;
 }
@@ -2658,6 +3017,11 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_log_debug("Negotiated SHM: %s", pa_yes_no(do_shm));
     pa_pstream_enable_shm(c->pstream, do_shm);
 
+    if (do_shm && c->version >= 33) {
+        pa_pstream_enable_batched_release(c->pstream);
+        pa_pstream_enable_large_export(c->pstream);
+    }
+
     /* Do not declare memfd support for 9.0 client libraries (protocol v31).
      *
      * Although they support memfd transport, such 9.0 clients has an iochannel
@@ -2679,7 +3043,7 @@ static void command_auth(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
         pa_log_debug("Negotiated SHM type: %s", pa_mem_type_to_string(shm_type));
     }
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     pa_tagstruct_putu32(reply, PA_PROTOCOL_VERSION | (do_shm ? 0x80000000 : 0) |
                         (do_memfd ? 0x40000000 : 0));
 
@@ -2753,7 +3117,7 @@ static void command_set_client_name(pa_pdispatch *pd, uint32_t command, uint32_t
     pa_client_update_proplist(c->client, PA_UPDATE_REPLACE, p);
     pa_proplist_free(p);
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
 
     if (c->version >= 13)
         pa_tagstruct_putu32(reply, c->client->index);
@@ -2793,7 +3157,7 @@ static void command_lookup(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_
         pa_pstream_send_error(c->pstream, tag, PA_ERR_NOENTITY);
     else {
         pa_tagstruct *reply;
-        reply = reply_new(tag);
+        reply = reply_new(c, tag);
         pa_tagstruct_putu32(reply, idx);
         pa_pstream_send_tagstruct(c->pstream, reply);
     }
@@ -2838,12 +3202,37 @@ static void command_stat(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
 
     stat = pa_mempool_get_stat(c->protocol->core->mempool);
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     pa_tagstruct_putu32(reply, (uint32_t) pa_atomic_load(&stat->n_allocated));
     pa_tagstruct_putu32(reply, (uint32_t) pa_atomic_load(&stat->allocated_size));
     pa_tagstruct_putu32(reply, (uint32_t) pa_atomic_load(&stat->n_accumulated));
     pa_tagstruct_putu32(reply, (uint32_t) pa_atomic_load(&stat->accumulated_size));
     pa_tagstruct_putu32(reply, (uint32_t) pa_scache_total_size(c->protocol->core));
+
+    if (c->version >= 33) {
+        /* From the daemon's point of view the client's blocks are
+         * imported and ours are exported */
+        pa_memtransfer_stat imported, exported;
+
+        pa_pstream_get_memtransfer_stat(c->pstream, &imported, &exported);
+
+        pa_tagstruct_putu32(reply, (uint32_t) pa_atomic_load(&stat->n_allocated_max));
+        pa_tagstruct_putu32(reply, (uint32_t) pa_atomic_load(&stat->allocated_size_max));
+        pa_tagstruct_putu32(reply, (uint32_t) pa_atomic_load(&stat->n_pool_full));
+        pa_tagstruct_putu32(reply, (uint32_t) pa_atomic_load(&stat->n_too_large_for_pool));
+        pa_tagstruct_putu32(reply, (uint32_t) imported.n_blocks);
+        pa_tagstruct_putu32(reply, (uint32_t) imported.size);
+        pa_tagstruct_putu32(reply, (uint32_t) imported.n_blocks_max);
+        pa_tagstruct_putu32(reply, (uint32_t) imported.size_max);
+        pa_tagstruct_putu32(reply, (uint32_t) exported.n_blocks);
+        pa_tagstruct_putu32(reply, (uint32_t) exported.size);
+        pa_tagstruct_putu32(reply, (uint32_t) exported.n_blocks_max);
+        pa_tagstruct_putu32(reply, (uint32_t) exported.size_max);
+        pa_tagstruct_putu32(reply, (uint32_t) imported.n_failed);
+        pa_tagstruct_putu32(reply, (uint32_t) exported.n_failed);
+        pa_tagstruct_putu32(reply, (uint32_t) exported.n_copied);
+    }
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
@@ -2872,7 +3261,7 @@ static void command_get_playback_latency(pa_pdispatch *pd, uint32_t command, uin
     /* Get an atomic snapshot of all timing parameters */
     pa_assert_se(pa_asyncmsgq_send(s->sink_input->sink->asyncmsgq, PA_MSGOBJECT(s->sink_input), SINK_INPUT_MESSAGE_UPDATE_LATENCY, s, 0, NULL) == 0);
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     pa_tagstruct_put_usec(reply,
                           s->current_sink_latency +
                           pa_bytes_to_usec(s->render_memblockq_length, &s->sink_input->sink->sample_spec));
@@ -2918,7 +3307,7 @@ static void command_get_record_latency(pa_pdispatch *pd, uint32_t command, uint3
     /* Get an atomic snapshot of all timing parameters */
     pa_assert_se(pa_asyncmsgq_send(s->source_output->source->asyncmsgq, PA_MSGOBJECT(s->source_output), SOURCE_OUTPUT_MESSAGE_UPDATE_LATENCY, s, 0, NULL) == 0);
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     pa_tagstruct_put_usec(reply, s->current_monitor_latency);
     pa_tagstruct_put_usec(reply,
                           s->current_source_latency +
@@ -2987,7 +3376,7 @@ static void command_create_upload_stream(pa_pdispatch *pd, uint32_t command, uin
 
     CHECK_VALIDITY(c->pstream, s, tag, PA_ERR_INVALID);
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     pa_tagstruct_putu32(reply, s->index);
     pa_tagstruct_putu32(reply, length);
     pa_pstream_send_tagstruct(c->pstream, reply);
@@ -3024,6 +3413,71 @@ static void command_finish_upload_stream(pa_pdispatch *pd, uint32_t command, uin
     upload_stream_unlink(s);
 }
 
+static void command_finish_upload_stream_memfd(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+#if defined(HAVE_CREDS) && defined(HAVE_MEMFD)
+    pa_cmsg_ancil_data *ancil;
+    pa_memchunk chunk;
+    uint32_t channel;
+    upload_stream *s;
+    uint32_t idx;
+    int error = 0;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    /* Whatever happens, we are the ones to close the passed fd */
+    ancil = pa_pdispatch_take_ancil_data(pd);
+
+    if (c->version < 33 ||
+        pa_tagstruct_getu32(t, &channel) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        pa_cmsg_ancil_data_close_fds(ancil);
+        protocol_error(c);
+        return;
+    }
+
+    if (!c->authorized)
+        error = PA_ERR_ACCESS;
+    else if (!pa_pstream_get_memfd(c->pstream))
+        error = PA_ERR_NOTSUPPORTED;
+    else if (!ancil || ancil->nfd != 1 || ancil->fds[0] < 0)
+        error = PA_ERR_INVALID;
+    else if (!(s = pa_idxset_get_by_index(c->output_streams, channel)) || !upload_stream_isinstance(s))
+        error = PA_ERR_NOENTITY;
+
+    if (error) {
+        pa_cmsg_ancil_data_close_fds(ancil);
+        pa_pstream_send_error(c->pstream, tag, error);
+        return;
+    }
+
+    /* The memfd holds the whole sample, so it becomes the cache entry
+     * as it is. Anything received as memblocks before is dropped. */
+    chunk.memblock = pa_memblock_new_sealed_memfd(c->protocol->core->mempool, ancil->fds[0], s->length);
+    pa_cmsg_ancil_data_close_fds(ancil);
+
+    if (!chunk.memblock)
+        pa_pstream_send_error(c->pstream, tag, PA_ERR_INVALID);
+    else {
+        chunk.index = 0;
+        chunk.length = s->length;
+
+        if (pa_scache_add_item(c->protocol->core, s->name, &s->sample_spec, &s->channel_map, &chunk, s->proplist, &idx) < 0)
+            pa_pstream_send_error(c->pstream, tag, PA_ERR_INTERNAL);
+        else
+            pa_pstream_send_simple_ack(c->pstream, tag);
+
+        pa_memblock_unref(chunk.memblock);
+    }
+
+    upload_stream_unlink(s);
+#else
+    /* We never negotiate memfd support, so nobody may send this */
+    protocol_error(c);
+#endif
+}
+
 static void command_play_sample(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     uint32_t sink_index;
@@ -3078,7 +3532,7 @@ static void command_play_sample(pa_pdispatch *pd, uint32_t command, uint32_t tag
 
     pa_proplist_free(p);
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
 
     if (c->version >= 13)
         pa_tagstruct_putu32(reply, idx);
@@ -3135,7 +3589,183 @@ static void fixup_sample_spec(pa_native_connection *c, pa_sample_spec *fixed, co
     }
 }
 
-static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink *sink) {
+static void proplist_tracker_free(struct proplist_tracker *tr) {
+    pa_proplist_free(tr->proplist);
+    pa_hashmap_free(tr->set);
+    pa_hashmap_free(tr->unset);
+    pa_xfree(tr);
+}
+
+static void proplist_subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint32_t idx, void *userdata) {
+    pa_native_protocol *p = userdata;
+    pa_hashmap *h;
+
+    if ((e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_REMOVE)
+        return;
+
+    if ((h = p->proplist_trackers[e & PA_SUBSCRIPTION_EVENT_FACILITY_MASK]))
+        pa_hashmap_remove_and_free(h, PA_UINT32_TO_PTR(idx));
+}
+
+static void proplist_stamp(pa_hashmap *h, const char *key, uint32_t version) {
+    pa_hashmap_remove_and_free(h, key);
+    pa_hashmap_put(h, pa_xstrdup(key), PA_UINT32_TO_PTR(version));
+}
+
+static bool proplist_value_equal(pa_proplist *a, pa_proplist *b, const char *key) {
+    const void *da, *db;
+    size_t na, nb;
+
+    if (pa_proplist_get(a, key, &da, &na) < 0 ||
+        pa_proplist_get(b, key, &db, &nb) < 0)
+        return false;
+
+    return na == nb && memcmp(da, db, na) == 0;
+}
+
+/* Returns the tracker of the given object, after bringing it up to date
+ * with its current proplist */
+static struct proplist_tracker *proplist_tracker_update(pa_native_protocol *p, unsigned facility, uint32_t idx, pa_proplist *pl) {
+    struct proplist_tracker *tr;
+    const char *key;
+    void *state = NULL;
+    bool changed = false;
+
+    if (!p->proplist_trackers[facility]) {
+        p->proplist_trackers[facility] = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                                             NULL, (pa_free_cb_t) proplist_tracker_free);
+
+        if (!p->proplist_subscription)
+            p->proplist_subscription = pa_subscription_new(p->core,
+                                                           PA_SUBSCRIPTION_MASK_SINK|PA_SUBSCRIPTION_MASK_SOURCE|
+                                                           PA_SUBSCRIPTION_MASK_SINK_INPUT|PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT|
+                                                           PA_SUBSCRIPTION_MASK_CLIENT|PA_SUBSCRIPTION_MASK_CARD,
+                                                           proplist_subscription_cb, p);
+    }
+
+    if (!(tr = pa_hashmap_get(p->proplist_trackers[facility], PA_UINT32_TO_PTR(idx)))) {
+        tr = pa_xnew(struct proplist_tracker, 1);
+        tr->version = tr->floor = 1;
+        tr->proplist = pa_proplist_copy(pl);
+        tr->set = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, NULL);
+        tr->unset = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, NULL);
+
+        while ((key = pa_proplist_iterate(pl, &state)))
+            proplist_stamp(tr->set, key, tr->version);
+
+        pa_hashmap_put(p->proplist_trackers[facility], PA_UINT32_TO_PTR(idx), tr);
+        return tr;
+    }
+
+    while ((key = pa_proplist_iterate(pl, &state))) {
+        if (proplist_value_equal(pl, tr->proplist, key))
+            continue;
+
+        if (!changed) {
+            tr->version++;
+            changed = true;
+        }
+
+        proplist_stamp(tr->set, key, tr->version);
+        pa_hashmap_remove_and_free(tr->unset, key);
+    }
+
+    state = NULL;
+    while ((key = pa_proplist_iterate(tr->proplist, &state))) {
+        if (pa_proplist_contains(pl, key))
+            continue;
+
+        if (!changed) {
+            tr->version++;
+            changed = true;
+        }
+
+        proplist_stamp(tr->unset, key, tr->version);
+        pa_hashmap_remove_and_free(tr->set, key);
+    }
+
+    if (!changed)
+        return tr;
+
+    pa_proplist_update(tr->proplist, PA_UPDATE_SET, pl);
+
+    /* Forget removals made long ago, clients that know only the versions
+     * before will be sent the whole list */
+    if (pa_hashmap_size(tr->unset) > PROPLIST_TRACKER_UNSET_MAX) {
+        pa_hashmap_remove_all(tr->unset);
+        tr->floor = tr->version;
+    }
+
+    return tr;
+}
+
+/* With the tracked format the proplist is preceded by its version and
+ * the version a delta is based on, 0 if the whole list follows. A delta
+ * holds the keys set since the base version, followed by the keys removed
+ * since, terminated by a NULL string. Version 0 means the proplist is not
+ * tracked. */
+static void put_proplist(pa_native_connection *c, pa_tagstruct *t, const proplist_request *pr,
+                         unsigned facility, uint32_t idx, pa_proplist *pl) {
+    struct proplist_tracker *tr;
+    pa_proplist *delta;
+    const char *key;
+    void *state, *v;
+    uint32_t known;
+
+    if (!pr->tracked) {
+        pa_tagstruct_put_proplist(t, pr->with_proplist ? pl : NULL);
+        return;
+    }
+
+    if (!pr->with_proplist) {
+        pa_tagstruct_putu32(t, 0);
+        pa_tagstruct_putu32(t, 0);
+        pa_tagstruct_put_proplist(t, NULL);
+        return;
+    }
+
+    tr = proplist_tracker_update(c->protocol, facility, idx, pl);
+    known = pr->known ? PA_PTR_TO_UINT32(pa_hashmap_get(pr->known, PA_UINT32_TO_PTR(idx))) : pr->known_version;
+
+    pa_tagstruct_putu32(t, tr->version);
+
+    if (known < tr->floor || known > tr->version) {
+        pa_tagstruct_putu32(t, 0);
+        pa_tagstruct_put_proplist(t, pl);
+        return;
+    }
+
+    pa_tagstruct_putu32(t, known);
+
+    delta = pa_proplist_new();
+    PA_HASHMAP_FOREACH_KV(key, v, tr->set, state)
+        if (PA_PTR_TO_UINT32(v) > known) {
+            const void *data;
+            size_t nbytes;
+
+            pa_assert_se(pa_proplist_get(pl, key, &data, &nbytes) >= 0);
+            pa_proplist_set(delta, key, data, nbytes);
+        }
+
+    pa_tagstruct_put_proplist(t, delta);
+    pa_proplist_free(delta);
+
+    PA_HASHMAP_FOREACH_KV(key, v, tr->unset, state)
+        if (PA_PTR_TO_UINT32(v) > known)
+            pa_tagstruct_puts(t, key);
+
+    pa_tagstruct_puts(t, NULL);
+}
+
+static void put_sink_stats(pa_tagstruct *t, const pa_sink_stats *stats) {
+    pa_tagstruct_putu32(t, stats->underruns);
+    pa_tagstruct_putu64(t, stats->underrun_bytes);
+    pa_tagstruct_putu32(t, stats->rewinds);
+    pa_tagstruct_putu64(t, stats->rewind_bytes);
+    pa_tagstruct_put_usec(t, stats->max_render_usec);
+}
+
+static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink *sink, const proplist_request *pr) {
     pa_sample_spec fixed_ss;
 
     pa_assert(t);
@@ -3161,7 +3791,7 @@ static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sin
         PA_TAG_INVALID);
 
     if (c->version >= 13) {
-        pa_tagstruct_put_proplist(t, sink->proplist);
+        put_proplist(c, t, pr, PA_SUBSCRIPTION_EVENT_SINK, sink->index, sink->proplist);
         pa_tagstruct_put_usec(t, pa_sink_get_requested_latency(sink));
     }
 
@@ -3203,9 +3833,16 @@ static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sin
 
         pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
     }
+
+    if (c->version >= 33) {
+        pa_sink_stats stats;
+
+        pa_sink_get_stats(sink, &stats);
+        put_sink_stats(t, &stats);
+    }
 }
 
-static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source *source) {
+static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source *source, const proplist_request *pr) {
     pa_sample_spec fixed_ss;
 
     pa_assert(t);
@@ -3231,7 +3868,7 @@ static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
         PA_TAG_INVALID);
 
     if (c->version >= 13) {
-        pa_tagstruct_put_proplist(t, source->proplist);
+        put_proplist(c, t, pr, PA_SUBSCRIPTION_EVENT_SOURCE, source->index, source->proplist);
         pa_tagstruct_put_usec(t, pa_source_get_requested_latency(source));
     }
 
@@ -3275,7 +3912,7 @@ static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
     }
 }
 
-static void client_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_client *client) {
+static void client_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_client *client, const proplist_request *pr) {
     pa_assert(t);
     pa_assert(client);
 
@@ -3285,10 +3922,10 @@ static void client_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_c
     pa_tagstruct_puts(t, client->driver);
 
     if (c->version >= 13)
-        pa_tagstruct_put_proplist(t, client->proplist);
+        put_proplist(c, t, pr, PA_SUBSCRIPTION_EVENT_CLIENT, client->index, client->proplist);
 }
 
-static void card_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_card *card) {
+static void card_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_card *card, const proplist_request *pr) {
     void *state = NULL;
     pa_card_profile *p;
     pa_device_port *port;
@@ -3315,7 +3952,7 @@ static void card_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_car
     }
 
     pa_tagstruct_puts(t, card->active_profile->name);
-    pa_tagstruct_put_proplist(t, card->proplist);
+    put_proplist(c, t, pr, PA_SUBSCRIPTION_EVENT_CARD, card->index, card->proplist);
 
     if (c->version < 26)
         return;
@@ -3358,7 +3995,7 @@ static void module_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_m
         pa_tagstruct_put_proplist(t, module->proplist);
 }
 
-static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s) {
+static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s, const proplist_request *pr) {
     pa_sample_spec fixed_ss;
     pa_usec_t sink_latency;
     pa_cvolume v;
@@ -3390,7 +4027,7 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
     if (c->version >= 11)
         pa_tagstruct_put_boolean(t, s->muted);
     if (c->version >= 13)
-        pa_tagstruct_put_proplist(t, s->proplist);
+        put_proplist(c, t, pr, PA_SUBSCRIPTION_EVENT_SINK_INPUT, s->index, s->proplist);
     if (c->version >= 19)
         pa_tagstruct_put_boolean(t, (pa_sink_input_get_state(s) == PA_SINK_INPUT_CORKED));
     if (c->version >= 20) {
@@ -3399,9 +4036,15 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
     }
     if (c->version >= 21)
         pa_tagstruct_put_format_info(t, s->format);
+    if (c->version >= 33) {
+        pa_sink_stats stats;
+
+        pa_sink_input_get_stats(s, &stats);
+        put_sink_stats(t, &stats);
+    }
 }
 
-static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source_output *s) {
+static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source_output *s, const proplist_request *pr) {
     pa_sample_spec fixed_ss;
     pa_usec_t source_latency;
     pa_cvolume v;
@@ -3430,7 +4073,7 @@ static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *
     pa_tagstruct_puts(t, pa_resample_method_to_string(pa_source_output_get_resample_method(s)));
     pa_tagstruct_puts(t, s->driver);
     if (c->version >= 13)
-        pa_tagstruct_put_proplist(t, s->proplist);
+        put_proplist(c, t, pr, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, s->index, s->proplist);
     if (c->version >= 19)
         pa_tagstruct_put_boolean(t, (pa_source_output_get_state(s) == PA_SOURCE_OUTPUT_CORKED));
     if (c->version >= 22) {
@@ -3449,7 +4092,7 @@ static void scache_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
     pa_assert(t);
     pa_assert(e);
 
-    if (e->memchunk.memblock)
+    if (pa_scache_entry_is_loaded(e))
         fixup_sample_spec(c, &fixed_ss, &e->sample_spec);
     else
         memset(&fixed_ss, 0, sizeof(fixed_ss));
@@ -3463,7 +4106,7 @@ static void scache_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
         pa_cvolume_init(&v);
 
     pa_tagstruct_put_cvolume(t, &v);
-    pa_tagstruct_put_usec(t, e->memchunk.memblock ? pa_bytes_to_usec(e->memchunk.length, &e->sample_spec) : 0);
+    pa_tagstruct_put_usec(t, pa_scache_entry_is_loaded(e) ? pa_bytes_to_usec(e->memchunk.length, &e->sample_spec) : 0);
     pa_tagstruct_put_sample_spec(t, &fixed_ss);
     pa_tagstruct_put_channel_map(t, &e->channel_map);
     pa_tagstruct_putu32(t, (uint32_t) e->memchunk.length);
@@ -3487,6 +4130,7 @@ static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, p
     pa_scache_entry *sce = NULL;
     const char *name = NULL;
     pa_tagstruct *reply;
+    proplist_request pr = { .with_proplist = true };
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
@@ -3496,8 +4140,27 @@ static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, p
          command != PA_COMMAND_GET_MODULE_INFO &&
          command != PA_COMMAND_GET_SINK_INPUT_INFO &&
          command != PA_COMMAND_GET_SOURCE_OUTPUT_INFO &&
-         pa_tagstruct_gets(t, &name) < 0) ||
+         pa_tagstruct_gets(t, &name) < 0)) {
+        protocol_error(c);
+        return;
+    }
+
+    /* Since v33 the client may send the version of the proplist it
+     * already knows, and then gets the tracked format */
+    if (c->version >= 33 &&
+        command != PA_COMMAND_GET_MODULE_INFO &&
+        command != PA_COMMAND_GET_SAMPLE_INFO &&
         !pa_tagstruct_eof(t)) {
+
+        if (pa_tagstruct_getu32(t, &pr.known_version) < 0) {
+            protocol_error(c);
+            return;
+        }
+
+        pr.tracked = true;
+    }
+
+    if (!pa_tagstruct_eof(t)) {
         protocol_error(c);
         return;
     }
@@ -3550,21 +4213,21 @@ static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, p
         return;
     }
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     if (sink)
-        sink_fill_tagstruct(c, reply, sink);
+        sink_fill_tagstruct(c, reply, sink, &pr);
     else if (source)
-        source_fill_tagstruct(c, reply, source);
+        source_fill_tagstruct(c, reply, source, &pr);
     else if (client)
-        client_fill_tagstruct(c, reply, client);
+        client_fill_tagstruct(c, reply, client, &pr);
     else if (card)
-        card_fill_tagstruct(c, reply, card);
+        card_fill_tagstruct(c, reply, card, &pr);
     else if (module)
         module_fill_tagstruct(c, reply, module);
     else if (si)
-        sink_input_fill_tagstruct(c, reply, si);
+        sink_input_fill_tagstruct(c, reply, si, &pr);
     else if (so)
-        source_output_fill_tagstruct(c, reply, so);
+        source_output_fill_tagstruct(c, reply, so, &pr);
     else
         scache_fill_tagstruct(c, reply, sce);
     pa_pstream_send_tagstruct(c->pstream, reply);
@@ -3576,61 +4239,181 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
     uint32_t idx;
     void *p;
     pa_tagstruct *reply;
+    unsigned list, n = 0;
+    size_t header, length;
+    proplist_request pr = { .with_proplist = true };
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
 
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+
+    /* Since v33 the client may send the indexes and versions of the
+     * proplists it already knows, and then gets the tracked format */
+    if (c->version >= 33 &&
+        command != PA_COMMAND_GET_MODULE_INFO_LIST &&
+        command != PA_COMMAND_GET_SAMPLE_INFO_LIST &&
+        !pa_tagstruct_eof(t)) {
+        uint32_t n_known, k;
+
+        if (pa_tagstruct_getu32(t, &n_known) < 0) {
+            protocol_error(c);
+            return;
+        }
+
+        pr.tracked = true;
+        pr.known = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+        for (k = 0; k < n_known; k++) {
+            uint32_t known_idx, version;
+
+            if (pa_tagstruct_getu32(t, &known_idx) < 0 ||
+                pa_tagstruct_getu32(t, &version) < 0) {
+                pa_hashmap_free(pr.known);
+                protocol_error(c);
+                return;
+            }
+
+            pa_hashmap_put(pr.known, PA_UINT32_TO_PTR(known_idx), PA_UINT32_TO_PTR(version));
+        }
+    }
+
     if (!pa_tagstruct_eof(t)) {
+        if (pr.known)
+            pa_hashmap_free(pr.known);
         protocol_error(c);
         return;
     }
 
-    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
-
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
 
-    if (command == PA_COMMAND_GET_SINK_INFO_LIST)
+    if (command == PA_COMMAND_GET_SINK_INFO_LIST) {
         i = c->protocol->core->sinks;
-    else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
+        list = INFO_LIST_SINK;
+    } else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST) {
         i = c->protocol->core->sources;
-    else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST)
+        list = INFO_LIST_SOURCE;
+    } else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST) {
         i = c->protocol->core->clients;
-    else if (command == PA_COMMAND_GET_CARD_INFO_LIST)
+        list = INFO_LIST_CLIENT;
+    } else if (command == PA_COMMAND_GET_CARD_INFO_LIST) {
         i = c->protocol->core->cards;
-    else if (command == PA_COMMAND_GET_MODULE_INFO_LIST)
+        list = INFO_LIST_CARD;
+    } else if (command == PA_COMMAND_GET_MODULE_INFO_LIST) {
         i = c->protocol->core->modules;
-    else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST)
+        list = INFO_LIST_MODULE;
+    } else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST) {
         i = c->protocol->core->sink_inputs;
-    else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST)
+        list = INFO_LIST_SINK_INPUT;
+    } else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST) {
         i = c->protocol->core->source_outputs;
-    else {
+        list = INFO_LIST_SOURCE_OUTPUT;
+    } else {
         pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
         i = c->protocol->core->scache;
+        list = INFO_LIST_SAMPLE;
     }
 
+    pa_tagstruct_data(reply, &header);
+
     if (i) {
+        pa_tagstruct_reserve(reply, pa_idxset_size(i) * c->info_list_entry_size[list]);
+
         PA_IDXSET_FOREACH(p, i, idx) {
             if (command == PA_COMMAND_GET_SINK_INFO_LIST)
-                sink_fill_tagstruct(c, reply, p);
+                sink_fill_tagstruct(c, reply, p, &pr);
             else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
-                source_fill_tagstruct(c, reply, p);
+                source_fill_tagstruct(c, reply, p, &pr);
             else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST)
-                client_fill_tagstruct(c, reply, p);
+                client_fill_tagstruct(c, reply, p, &pr);
             else if (command == PA_COMMAND_GET_CARD_INFO_LIST)
-                card_fill_tagstruct(c, reply, p);
+                card_fill_tagstruct(c, reply, p, &pr);
             else if (command == PA_COMMAND_GET_MODULE_INFO_LIST)
                 module_fill_tagstruct(c, reply, p);
             else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST)
-                sink_input_fill_tagstruct(c, reply, p);
+                sink_input_fill_tagstruct(c, reply, p, &pr);
             else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST)
-                source_output_fill_tagstruct(c, reply, p);
+                source_output_fill_tagstruct(c, reply, p, &pr);
             else {
                 pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
                 scache_fill_tagstruct(c, reply, p);
             }
+
+            n++;
         }
     }
 
+    pa_tagstruct_data(reply, &length);
+
+    if (n > 0)
+        c->info_list_entry_size[list] = (length - header) / n;
+
+    if (pr.known)
+        pa_hashmap_free(pr.known);
+
+    pa_pstream_send_tagstruct(c->pstream, reply);
+}
+
+static void command_get_snapshot(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pa_core *core = c->protocol->core;
+    uint32_t mask, flags, idx;
+    proplist_request pr = { .tracked = true };
+    void *p;
+    pa_tagstruct *reply;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &mask) < 0 ||
+        pa_tagstruct_getu32(t, &flags) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    CHECK_VALIDITY(c->pstream, (mask & ~(PA_SUBSCRIPTION_MASK_SINK|PA_SUBSCRIPTION_MASK_SOURCE|PA_SUBSCRIPTION_MASK_SINK_INPUT|
+                                         PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT|PA_SUBSCRIPTION_MASK_CLIENT)) == 0, tag, PA_ERR_INVALID);
+    CHECK_VALIDITY(c->pstream, (flags & ~PA_SNAPSHOT_NO_PROPLISTS) == 0, tag, PA_ERR_INVALID);
+
+    pr.with_proplist = !(flags & PA_SNAPSHOT_NO_PROPLISTS);
+
+    reply = reply_new(c, tag);
+
+    /* Everything is taken from the main thread in one go, so the lists
+     * are consistent with each other */
+
+    if (mask & PA_SUBSCRIPTION_MASK_SINK) {
+        pa_tagstruct_putu32(reply, pa_idxset_size(core->sinks));
+        PA_IDXSET_FOREACH(p, core->sinks, idx)
+            sink_fill_tagstruct(c, reply, p, &pr);
+    }
+
+    if (mask & PA_SUBSCRIPTION_MASK_SOURCE) {
+        pa_tagstruct_putu32(reply, pa_idxset_size(core->sources));
+        PA_IDXSET_FOREACH(p, core->sources, idx)
+            source_fill_tagstruct(c, reply, p, &pr);
+    }
+
+    if (mask & PA_SUBSCRIPTION_MASK_SINK_INPUT) {
+        pa_tagstruct_putu32(reply, pa_idxset_size(core->sink_inputs));
+        PA_IDXSET_FOREACH(p, core->sink_inputs, idx)
+            sink_input_fill_tagstruct(c, reply, p, &pr);
+    }
+
+    if (mask & PA_SUBSCRIPTION_MASK_SOURCE_OUTPUT) {
+        pa_tagstruct_putu32(reply, pa_idxset_size(core->source_outputs));
+        PA_IDXSET_FOREACH(p, core->source_outputs, idx)
+            source_output_fill_tagstruct(c, reply, p, &pr);
+    }
+
+    if (mask & PA_SUBSCRIPTION_MASK_CLIENT) {
+        pa_tagstruct_putu32(reply, pa_idxset_size(core->clients));
+        PA_IDXSET_FOREACH(p, core->clients, idx)
+            client_fill_tagstruct(c, reply, p, &pr);
+    }
+
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
@@ -3652,7 +4435,7 @@ static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t
 
     CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     pa_tagstruct_puts(reply, PACKAGE_NAME);
     pa_tagstruct_puts(reply, PACKAGE_VERSION);
 
@@ -3680,28 +4463,47 @@ static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+/* Events are collected in one SUBSCRIBE_EVENT packet until the
+ * subscription flushes. Unbatched subscriptions flush after every
+ * event, so clients before v33 still get one event per packet. */
 static void subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint32_t idx, void *userdata) {
-    pa_tagstruct *t;
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
 
     pa_native_connection_assert_ref(c);
 
-    t = pa_tagstruct_new();
-    pa_tagstruct_putu32(t, PA_COMMAND_SUBSCRIBE_EVENT);
-    pa_tagstruct_putu32(t, (uint32_t) -1);
-    pa_tagstruct_putu32(t, e);
-    pa_tagstruct_putu32(t, idx);
-    pa_pstream_send_tagstruct(c->pstream, t);
+    if (!c->subscription_events) {
+        c->subscription_events = pa_tagstruct_new();
+        pa_tagstruct_set_compact(c->subscription_events, c->version >= 33);
+        pa_tagstruct_putu32(c->subscription_events, PA_COMMAND_SUBSCRIBE_EVENT);
+        pa_tagstruct_putu32(c->subscription_events, (uint32_t) -1);
+    }
+
+    pa_tagstruct_putu32(c->subscription_events, e);
+    pa_tagstruct_putu32(c->subscription_events, idx);
+}
+
+static void subscription_flush_cb(pa_core *core, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_native_connection_assert_ref(c);
+
+    if (!c->subscription_events)
+        return;
+
+    pa_pstream_send_tagstruct(c->pstream, c->subscription_events);
+    c->subscription_events = NULL;
 }
 
 static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_subscription_mask_t m;
+    pa_usec_t interval = 0;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
 
     if (pa_tagstruct_getu32(t, &m) < 0 ||
+        (c->version >= 33 && pa_tagstruct_get_usec(t, &interval) < 0) ||
         !pa_tagstruct_eof(t)) {
         protocol_error(c);
         return;
@@ -3709,12 +4511,19 @@ static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag,
 
     CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
     CHECK_VALIDITY(c->pstream, (m & ~PA_SUBSCRIPTION_MASK_ALL) == 0, tag, PA_ERR_INVALID);
+    CHECK_VALIDITY(c->pstream, interval <= MAX_SUBSCRIPTION_INTERVAL, tag, PA_ERR_INVALID);
 
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
+    /* Events collected by the old subscription are dropped with it */
+    if (c->subscription_events) {
+        pa_tagstruct_free(c->subscription_events);
+        c->subscription_events = NULL;
+    }
+
     if (m != 0) {
-        c->subscription = pa_subscription_new(c->protocol->core, m, subscription_cb, c);
+        c->subscription = pa_subscription_new_batched(c->protocol->core, m, interval, subscription_cb, subscription_flush_cb, c);
         pa_assert(c->subscription);
     } else
         c->subscription = NULL;
@@ -4070,7 +4879,7 @@ static void command_set_stream_buffer_attr(pa_pdispatch *pd, uint32_t command, u
         fix_playback_buffer_attr(s);
         pa_assert_se(pa_asyncmsgq_send(s->sink_input->sink->asyncmsgq, PA_MSGOBJECT(s->sink_input), SINK_INPUT_MESSAGE_UPDATE_BUFFER_ATTR, NULL, 0, NULL) == 0);
 
-        reply = reply_new(tag);
+        reply = reply_new(c, tag);
         pa_tagstruct_putu32(reply, s->buffer_attr.maxlength);
         pa_tagstruct_putu32(reply, s->buffer_attr.tlength);
         pa_tagstruct_putu32(reply, s->buffer_attr.prebuf);
@@ -4108,7 +4917,7 @@ static void command_set_stream_buffer_attr(pa_pdispatch *pd, uint32_t command, u
         pa_memblockq_get_attr(s->memblockq, &s->buffer_attr);
         fix_record_buffer_attr_post(s);
 
-        reply = reply_new(tag);
+        reply = reply_new(c, tag);
         pa_tagstruct_putu32(reply, s->buffer_attr.maxlength);
         pa_tagstruct_putu32(reply, s->buffer_attr.fragsize);
 
@@ -4474,7 +5283,7 @@ static void command_load_module(pa_pdispatch *pd, uint32_t command, uint32_t tag
         return;
     }
 
-    reply = reply_new(tag);
+    reply = reply_new(c, tag);
     pa_tagstruct_putu32(reply, m->index);
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
@@ -4937,6 +5746,10 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
 
     [PA_COMMAND_REGISTER_MEMFD_SHMID] = command_register_memfd_shmid,
 
+    [PA_COMMAND_GET_SNAPSHOT] = command_get_snapshot,
+    [PA_COMMAND_FINISH_UPLOAD_STREAM_MEMFD] = command_finish_upload_stream_memfd,
+    [PA_COMMAND_CREATE_PLAYBACK_STREAMS] = command_create_playback_streams,
+
     [PA_COMMAND_EXTENSION] = command_extension
 };
 
@@ -5195,6 +6008,7 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
 
     c->rrobin_index = PA_IDXSET_INVALID;
     c->subscription = NULL;
+    c->subscription_events = NULL;
 
     pa_idxset_put(p->connections, c, NULL);
 
@@ -5233,6 +6047,9 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
 
     p->extensions = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
 
+    memset(p->proplist_trackers, 0, sizeof(p->proplist_trackers));
+    p->proplist_subscription = NULL;
+
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
         pa_hook_init(&p->hooks[h], p);
 
@@ -5262,6 +6079,7 @@ pa_native_protocol* pa_native_protocol_ref(pa_native_protocol *p) {
 void pa_native_protocol_unref(pa_native_protocol *p) {
     pa_native_connection *c;
     pa_native_hook_t h;
+    unsigned k;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
@@ -5281,6 +6099,13 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_hashmap_free(p->extensions);
 
+    if (p->proplist_subscription)
+        pa_subscription_free(p->proplist_subscription);
+
+    for (k = 0; k <= PA_SUBSCRIPTION_EVENT_FACILITY_MASK; k++)
+        if (p->proplist_trackers[k])
+            pa_hashmap_free(p->proplist_trackers[k]);
+
     pa_assert_se(pa_shared_remove(p->core, "native-protocol") >= 0);
 
     pa_xfree(p);
@@ -5389,6 +6214,11 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "auto-buffer-attr", &o->auto_buffer_attr) < 0) {
+        pa_log("auto-buffer-attr= expects a boolean argument.");
+        return -1;
+    }
+
     if (pa_modargs_get_value_boolean(ma, "auth-anonymous", &o->auth_anonymous) < 0) {
         pa_log("auth-anonymous= expects a boolean argument.");
         return -1;
@@ -43,6 +43,7 @@ typedef struct pa_native_options {
 
     bool auth_anonymous;
     bool srbchannel;
+    bool auto_buffer_attr;
     char *auth_group;
     pa_ip_acl *auth_ip_acl;
     pa_auth_cookie *auth_cookie;
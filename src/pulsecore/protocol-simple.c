@@ -145,61 +145,82 @@ static void connection_free(pa_object *o) {
     pa_xfree(c);
 }
 
+static void post_data(connection *c, pa_memchunk *chunk) {
+    if (!chunk->memblock)
+        return;
+
+    pa_asyncmsgq_post(c->sink_input->sink->asyncmsgq, PA_MSGOBJECT(c->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
+    pa_atomic_sub(&c->playback.missing, (int) chunk->length);
+
+    pa_memchunk_reset(chunk);
+}
+
 static int do_read(connection *c) {
     pa_memchunk chunk;
     ssize_t r;
-    size_t l;
+    size_t l, n;
     void *p;
-    size_t space = 0;
+    size_t space;
+    int ret = 0;
 
     connection_assert_ref(c);
 
     if (!c->sink_input || (l = (size_t) pa_atomic_load(&c->playback.missing)) <= 0)
         return 0;
 
-    if (c->playback.current_memblock) {
+    /* Read as much as the client sent, as long as the sink input wants
+     * it, and pass it on to the IO thread in one go. Only when the
+     * block is full does it take more than one message. */
+    pa_memchunk_reset(&chunk);
 
-        space = pa_memblock_get_length(c->playback.current_memblock) - c->playback.memblock_index;
+    for (;;) {
+        space = c->playback.current_memblock ? pa_memblock_get_length(c->playback.current_memblock) - c->playback.memblock_index : 0;
 
         if (space <= 0) {
-            pa_memblock_unref(c->playback.current_memblock);
-            c->playback.current_memblock = NULL;
-        }
-    }
+            post_data(c, &chunk);
 
-    if (!c->playback.current_memblock) {
-        pa_assert_se(c->playback.current_memblock = pa_memblock_new(c->protocol->core->mempool, (size_t) -1));
-        c->playback.memblock_index = 0;
+            if (c->playback.current_memblock)
+                pa_memblock_unref(c->playback.current_memblock);
 
-        space = pa_memblock_get_length(c->playback.current_memblock);
-    }
+            pa_assert_se(c->playback.current_memblock = pa_memblock_new(c->protocol->core->mempool, (size_t) -1));
+            c->playback.memblock_index = 0;
 
-    if (l > space)
-        l = space;
+            space = pa_memblock_get_length(c->playback.current_memblock);
+        }
 
-    p = pa_memblock_acquire(c->playback.current_memblock);
-    r = pa_iochannel_read(c->io, (uint8_t*) p + c->playback.memblock_index, l);
-    pa_memblock_release(c->playback.current_memblock);
+        n = PA_MIN(l, space);
 
-    if (r <= 0) {
+        p = pa_memblock_acquire(c->playback.current_memblock);
+        r = pa_iochannel_read(c->io, (uint8_t*) p + c->playback.memblock_index, n);
+        pa_memblock_release(c->playback.current_memblock);
 
-        if (r < 0 && (errno == EINTR || errno == EAGAIN))
-            return 0;
+        if (r <= 0) {
 
-        pa_log_debug("read(): %s", r == 0 ? "EOF" : pa_cstrerror(errno));
-        return -1;
-    }
+            if (r < 0 && (errno == EINTR || errno == EAGAIN))
+                break;
+
+            pa_log_debug("read(): %s", r == 0 ? "EOF" : pa_cstrerror(errno));
+            ret = -1;
+            break;
+        }
 
-    chunk.memblock = c->playback.current_memblock;
-    chunk.index = c->playback.memblock_index;
-    chunk.length = (size_t) r;
+        if (!chunk.memblock) {
+            chunk.memblock = c->playback.current_memblock;
+            chunk.index = c->playback.memblock_index;
+        }
 
-    c->playback.memblock_index += (size_t) r;
+        chunk.length += (size_t) r;
+        c->playback.memblock_index += (size_t) r;
+        l -= (size_t) r;
 
-    pa_asyncmsgq_post(c->sink_input->sink->asyncmsgq, PA_MSGOBJECT(c->sink_input), SINK_INPUT_MESSAGE_POST_DATA, NULL, 0, &chunk, NULL);
-    pa_atomic_sub(&c->playback.missing, (int) r);
+        /* A short read means there is nothing more right now */
+        if (l <= 0 || (size_t) r < n)
+            break;
+    }
 
-    return 0;
+    post_data(c, &chunk);
+
+    return ret;
 }
 
 static int do_write(connection *c) {
@@ -32,14 +32,23 @@
 
 static void pa_pstream_send_tagstruct_with_ancil_data(pa_pstream *p, pa_tagstruct *t, pa_cmsg_ancil_data *ancil_data) {
     size_t length;
-    const uint8_t *data;
+    uint8_t *buffer;
     pa_packet *packet;
 
     pa_assert(p);
     pa_assert(t);
 
-    pa_assert_se(data = pa_tagstruct_data(t, &length));
-    pa_assert_se(packet = pa_packet_new_data(data, length));
+    /* Large tagstructs hand their buffer over to the packet, sparing us
+     * an allocation and a copy of the whole thing */
+    if ((buffer = pa_tagstruct_steal_data(t, &length)))
+        pa_assert_se(packet = pa_packet_new_dynamic(buffer, length));
+    else {
+        const uint8_t *data;
+
+        pa_assert_se(data = pa_tagstruct_data(t, &length));
+        pa_assert_se(packet = pa_packet_new_data(data, length));
+    }
+
     pa_tagstruct_free(t);
 
     pa_pstream_send_packet(p, packet, ancil_data);
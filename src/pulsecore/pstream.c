@@ -30,6 +30,10 @@
 #include <netinet/in.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/idxset.h>
@@ -52,6 +56,11 @@
 #define PA_FLAG_SEEKMASK    0x000000FFLU
 #define PA_FLAG_SHMWRITABLE 0x00800000LU
 
+/* A release frame carrying more than one block id, the number of ids is
+ * stored in the seek mode bits. Only sent to peers that know about it, see
+ * pa_pstream_enable_batched_release(). */
+#define PA_FLAG_SHMBATCH    0x10000000LU
+
 /* The sequence descriptor header consists of 5 32bit integers: */
 enum {
     PA_PSTREAM_DESCRIPTOR_LENGTH,
@@ -82,6 +91,21 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
  */
 #define FRAME_SIZE_MAX_ALLOW (1024*1024*16)
 
+/* How many queued items beyond the current one we gather into a single
+ * write on a plain socket. Each takes up to two iovecs, one for the
+ * descriptor and one for the payload. */
+#define WRITE_AHEAD_MAX 7
+
+/* How many reads from the srbchannel we do in one go. Whatever is left
+ * is read on the next main loop iteration, so that a client flooding
+ * us with requests doesn't hold up timers and other clients. */
+#define SRB_READS_MAX 32
+
+/* How many block ids fit into a batched release frame, one per
+ * descriptor field other than the flags and the length, which must stay 0
+ * since the frame has no payload */
+#define RELEASE_BATCH_MAX 3
+
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
 struct item_info {
@@ -105,8 +129,9 @@ struct item_info {
     int64_t offset;
     pa_seek_mode_t seek_mode;
 
-    /* release/revoke info */
-    uint32_t block_id;
+    /* release/revoke info, more than one id only for batched releases */
+    uint32_t block_ids[RELEASE_BATCH_MAX];
+    unsigned n_block_ids;
 };
 
 struct pstream_read {
@@ -118,6 +143,18 @@ struct pstream_read {
     size_t index;
 };
 
+struct pstream_write {
+    union {
+        uint8_t minibuf[MINIBUF_SIZE];
+        pa_pstream_descriptor descriptor;
+    };
+    struct item_info* current;
+    void *data;
+    size_t index;
+    int minibuf_validsize;
+    pa_memchunk memchunk;
+};
+
 struct pa_pstream {
     PA_REFCNT_DECLARE;
 
@@ -131,17 +168,12 @@ struct pa_pstream {
 
     bool dead;
 
-    struct {
-        union {
-            uint8_t minibuf[MINIBUF_SIZE];
-            pa_pstream_descriptor descriptor;
-        };
-        struct item_info* current;
-        void *data;
-        size_t index;
-        int minibuf_validsize;
-        pa_memchunk memchunk;
-    } write;
+    struct pstream_write write;
+
+    /* Items already popped off send_queue and prepared for a gathered
+     * write behind the current one, in order */
+    struct pstream_write write_ahead[WRITE_AHEAD_MAX];
+    unsigned n_write_ahead;
 
     struct pstream_read readio, readsrb;
 
@@ -156,6 +188,15 @@ struct pa_pstream {
     bool use_shm, use_memfd;
     pa_idxset *registered_memfd_ids;
 
+    /* @batch_release: the other side accepts release frames with more
+     * than one block id.
+     *
+     * @release_item: the most recently queued release item, as long as it
+     * hasn't been picked up for writing yet, so that further releases can
+     * be added to it. */
+    bool batch_release;
+    struct item_info *release_item;
+
     pa_memimport *import;
     pa_memexport *export;
 
@@ -244,8 +285,16 @@ static void do_pstream_read_write(pa_pstream *p) {
     p->mainloop->defer_enable(p->defer_event, 0);
 
     if (!p->dead && p->srb) {
-         do_write(p);
-         while (!p->dead && do_read(p, &p->readsrb) == 0);
+        unsigned n = 0;
+
+        do_write(p);
+
+        while (!p->dead && do_read(p, &p->readsrb) == 0)
+            if (++n >= SRB_READS_MAX) {
+                if (!p->dead)
+                    p->mainloop->defer_enable(p->defer_event, 1);
+                break;
+            }
     }
 
     if (!p->dead && pa_iochannel_is_readable(p->io)) {
@@ -401,6 +450,8 @@ static void item_free(void *item) {
 }
 
 static void pstream_free(pa_pstream *p) {
+    unsigned i;
+
     pa_assert(p);
 
     pa_pstream_unlink(p);
@@ -413,6 +464,13 @@ static void pstream_free(pa_pstream *p) {
     if (p->write.memchunk.memblock)
         pa_memblock_unref(p->write.memchunk.memblock);
 
+    for (i = 0; i < p->n_write_ahead; i++) {
+        item_free(p->write_ahead[i].current);
+
+        if (p->write_ahead[i].memchunk.memblock)
+            pa_memblock_unref(p->write_ahead[i].memchunk.memblock);
+    }
+
     if (p->readsrb.memblock)
         pa_memblock_unref(p->readsrb.memblock);
 
@@ -522,14 +580,26 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
 
 /*     pa_log("Releasing block %u", block_id); */
 
+    /* A client streaming audio releases a block for every one it sent
+     * us. When several of them pile up before we get to write, there is
+     * no need to spend a frame on each. */
+    if (p->release_item && p->release_item->n_block_ids < RELEASE_BATCH_MAX) {
+        p->release_item->block_ids[p->release_item->n_block_ids++] = block_id;
+        return;
+    }
+
     if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
         item = pa_xnew(struct item_info, 1);
     item->type = PA_PSTREAM_ITEM_SHMRELEASE;
-    item->block_id = block_id;
+    item->block_ids[0] = block_id;
+    item->n_block_ids = 1;
 #ifdef HAVE_CREDS
     item->with_ancil_data = false;
 #endif
 
+    if (p->batch_release)
+        p->release_item = item;
+
     pa_queue_push(p->send_queue, item);
     p->mainloop->defer_enable(p->defer_event, 1);
 }
@@ -562,7 +632,8 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
     if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
         item = pa_xnew(struct item_info, 1);
     item->type = PA_PSTREAM_ITEM_SHMREVOKE;
-    item->block_id = block_id;
+    item->block_ids[0] = block_id;
+    item->n_block_ids = 1;
 #ifdef HAVE_CREDS
     item->with_ancil_data = false;
 #endif
@@ -584,68 +655,78 @@ static void memexport_revoke_cb(pa_memexport *e, uint32_t block_id, void *userda
         pa_pstream_send_revoke(p, block_id);
 }
 
-static void prepare_next_write_item(pa_pstream *p) {
+static void prepare_write_item(pa_pstream *p, struct pstream_write *w, struct item_info *item) {
     pa_assert(p);
-    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(w);
+    pa_assert(item);
 
-    p->write.current = pa_queue_pop(p->send_queue);
+    if (item == p->release_item)
+        p->release_item = NULL;
 
-    if (!p->write.current)
-        return;
-    p->write.index = 0;
-    p->write.data = NULL;
-    p->write.minibuf_validsize = 0;
-    pa_memchunk_reset(&p->write.memchunk);
+    w->current = item;
+    w->index = 0;
+    w->data = NULL;
+    w->minibuf_validsize = 0;
+    pa_memchunk_reset(&w->memchunk);
 
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
 
-    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET) {
+    if (w->current->type == PA_PSTREAM_ITEM_PACKET) {
         size_t plen;
 
-        pa_assert(p->write.current->packet);
+        pa_assert(w->current->packet);
 
-        p->write.data = (void *) pa_packet_data(p->write.current->packet, &plen);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
+        w->data = (void *) pa_packet_data(w->current->packet, &plen);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
 
         if (plen <= MINIBUF_SIZE - PA_PSTREAM_DESCRIPTOR_SIZE) {
-            memcpy(&p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], p->write.data, plen);
-            p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
+            memcpy(&w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], w->data, plen);
+            w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
         }
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE && w->current->n_block_ids > 1) {
+
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE | PA_FLAG_SHMBATCH | w->current->n_block_ids);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_ids[0]);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl(w->current->block_ids[1]);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        if (w->current->n_block_ids > 2)
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(w->current->block_ids[2]);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_ids[0]);
+
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_ids[0]);
 
     } else {
         uint32_t flags;
         bool send_payload = true;
 
-        pa_assert(p->write.current->type == PA_PSTREAM_ITEM_MEMBLOCK);
-        pa_assert(p->write.current->chunk.memblock);
+        pa_assert(w->current->type == PA_PSTREAM_ITEM_MEMBLOCK);
+        pa_assert(w->current->chunk.memblock);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(p->write.current->channel);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) p->write.current->offset) >> 32));
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) p->write.current->offset));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(w->current->channel);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) w->current->offset) >> 32));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) w->current->offset));
 
-        flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
+        flags = (uint32_t) (w->current->seek_mode & PA_FLAG_SEEKMASK);
 
         if (p->use_shm) {
             pa_mem_type_t type;
             uint32_t block_id, shm_id;
             size_t offset, length;
-            uint32_t *shm_info = (uint32_t *) &p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
+            uint32_t *shm_info = (uint32_t *) &w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
             size_t shm_size = sizeof(uint32_t) * PA_PSTREAM_SHM_MAX;
-            pa_mempool *current_pool = pa_memblock_get_pool(p->write.current->chunk.memblock);
+            pa_mempool *current_pool = pa_memblock_get_pool(w->current->chunk.memblock);
             pa_memexport *current_export;
 
             if (p->mempool == current_pool)
@@ -654,7 +735,7 @@ static void prepare_next_write_item(pa_pstream *p) {
                 pa_assert_se(current_export = pa_memexport_new(current_pool, memexport_revoke_cb, p));
 
             if (pa_memexport_put(current_export,
-                                 p->write.current->chunk.memblock,
+                                 w->current->chunk.memblock,
                                  &type,
                                  &block_id,
                                  &shm_id,
@@ -685,11 +766,11 @@ static void prepare_next_write_item(pa_pstream *p) {
 
                     shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
                     shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
-                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + p->write.current->chunk.index));
-                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
+                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + w->current->chunk.index));
+                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) w->current->chunk.length);
 
-                    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
-                    p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
+                    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
+                    w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
                 }
             }
 /*             else */
@@ -702,12 +783,30 @@ static void prepare_next_write_item(pa_pstream *p) {
         }
 
         if (send_payload) {
-            p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
-            p->write.memchunk = p->write.current->chunk;
-            pa_memblock_ref(p->write.memchunk.memblock);
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) w->current->chunk.length);
+            w->memchunk = w->current->chunk;
+            pa_memblock_ref(w->memchunk.memblock);
         }
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+    }
+}
+
+static void prepare_next_write_item(pa_pstream *p) {
+    struct item_info *item;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    if (p->n_write_ahead > 0) {
+        p->write = p->write_ahead[0];
+        p->n_write_ahead--;
+        memmove(p->write_ahead, p->write_ahead + 1, p->n_write_ahead * sizeof(struct pstream_write));
+    } else if ((item = pa_queue_pop(p->send_queue)))
+        prepare_write_item(p, &p->write, item);
+    else {
+        p->write.current = NULL;
+        return;
     }
 
 #ifdef HAVE_CREDS
@@ -730,6 +829,132 @@ static void check_srbpending(pa_pstream *p) {
         pa_srbchannel_set_callback(p->srb, srb_callback, p);
 }
 
+static void finish_write_item(pa_pstream *p) {
+    pa_assert(p->write.current);
+
+    item_free(p->write.current);
+    p->write.current = NULL;
+
+    if (p->write.memchunk.memblock)
+        pa_memblock_unref(p->write.memchunk.memblock);
+
+    pa_memchunk_reset(&p->write.memchunk);
+}
+
+#ifdef HAVE_SYS_UIO_H
+static size_t write_item_length(struct pstream_write *w) {
+    return PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+}
+
+/* Appends the iovecs for whatever is left of the item, acquiring its
+ * memblock if the payload is to be written straight from it */
+static void add_write_iovecs(struct pstream_write *w, struct iovec *iov, int *n_iov, pa_memblock **acquired, unsigned *n_acquired) {
+    size_t index, length;
+    void *d;
+
+    if (w->minibuf_validsize > 0) {
+        iov[*n_iov].iov_base = w->minibuf + w->index;
+        iov[(*n_iov)++].iov_len = w->minibuf_validsize - w->index;
+        return;
+    }
+
+    if (w->index < PA_PSTREAM_DESCRIPTOR_SIZE) {
+        iov[*n_iov].iov_base = (uint8_t*) w->descriptor + w->index;
+        iov[(*n_iov)++].iov_len = PA_PSTREAM_DESCRIPTOR_SIZE - w->index;
+    }
+
+    index = PA_MAX(w->index, PA_PSTREAM_DESCRIPTOR_SIZE);
+    length = write_item_length(w);
+
+    if (index >= length)
+        return;
+
+    pa_assert(w->data || w->memchunk.memblock);
+
+    if (w->data)
+        d = w->data;
+    else {
+        d = pa_memblock_acquire_chunk(&w->memchunk);
+        acquired[(*n_acquired)++] = w->memchunk.memblock;
+    }
+
+    iov[*n_iov].iov_base = (uint8_t*) d + index - PA_PSTREAM_DESCRIPTOR_SIZE;
+    iov[(*n_iov)++].iov_len = length - index;
+}
+
+/* On a plain socket we gather the current item and the items queued
+ * behind it into a single sendmsg(), so that a descriptor and its
+ * payload, and a burst of small packets, don't each take a syscall of
+ * their own. The payload is written straight out of the memblocks. */
+static int do_writev(pa_pstream *p) {
+    struct iovec iov[2 * (WRITE_AHEAD_MAX + 1)];
+    pa_memblock *acquired[WRITE_AHEAD_MAX + 1];
+    int n_iov = 0;
+    unsigned n_acquired = 0, i;
+    size_t l = 0, left;
+    ssize_t r;
+    bool completed = false;
+
+    add_write_iovecs(&p->write, iov, &n_iov, acquired, &n_acquired);
+
+    for (i = 0; i < WRITE_AHEAD_MAX; i++) {
+        struct item_info *item;
+
+        if (i >= p->n_write_ahead) {
+            if (!(item = pa_queue_pop(p->send_queue)))
+                break;
+
+            prepare_write_item(p, &p->write_ahead[p->n_write_ahead++], item);
+        }
+
+#ifdef HAVE_CREDS
+        /* Ancillary data has to go out with the first byte of its item,
+         * so that item starts a write of its own */
+        if (p->write_ahead[i].current->with_ancil_data)
+            break;
+#endif
+
+        add_write_iovecs(&p->write_ahead[i], iov, &n_iov, acquired, &n_acquired);
+    }
+
+    for (i = 0; i < (unsigned) n_iov; i++)
+        l += iov[i].iov_len;
+
+    pa_assert(l > 0);
+
+    r = pa_iochannel_writev(p->io, iov, n_iov);
+
+    for (i = 0; i < n_acquired; i++)
+        pa_memblock_release(acquired[i]);
+
+    if (r < 0)
+        return -1;
+
+    for (left = (size_t) r;;) {
+        size_t n = PA_MIN(left, write_item_length(&p->write) - p->write.index);
+
+        p->write.index += n;
+        left -= n;
+
+        if (p->write.index < write_item_length(&p->write))
+            break;
+
+        finish_write_item(p);
+        completed = true;
+
+        if (left == 0)
+            break;
+
+        prepare_next_write_item(p);
+    }
+
+    if (completed && p->drain_callback && !pa_pstream_is_pending(p))
+        p->drain_callback(p, p->drain_callback_userdata);
+
+    return (size_t) r == l ? 1 : 0;
+}
+#endif
+
 static int do_write(pa_pstream *p) {
     void *d;
     size_t l;
@@ -748,6 +973,15 @@ static int do_write(pa_pstream *p) {
         return 0;
     }
 
+#ifdef HAVE_SYS_UIO_H
+    if (!p->srb
+#ifdef HAVE_CREDS
+        && !p->send_ancil_data_now
+#endif
+        )
+        return do_writev(p);
+#endif
+
     if (p->write.minibuf_validsize > 0) {
         d = p->write.minibuf + p->write.index;
         l = p->write.minibuf_validsize - p->write.index;
@@ -796,14 +1030,7 @@ static int do_write(pa_pstream *p) {
     p->write.index += (size_t) r;
 
     if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
-        pa_assert(p->write.current);
-        item_free(p->write.current);
-        p->write.current = NULL;
-
-        if (p->write.memchunk.memblock)
-            pa_memblock_unref(p->write.memchunk.memblock);
-
-        pa_memchunk_reset(&p->write.memchunk);
+        finish_write_item(p);
 
         if (p->drain_callback && !pa_pstream_is_pending(p))
             p->drain_callback(p, p->drain_callback_userdata);
@@ -931,6 +1158,27 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
 
             goto frame_done;
 
+        } else if ((flags & ~PA_FLAG_SEEKMASK) == (PA_FLAG_SHMRELEASE | PA_FLAG_SHMBATCH)) {
+            static const unsigned fields[RELEASE_BATCH_MAX] = {
+                PA_PSTREAM_DESCRIPTOR_OFFSET_HI,
+                PA_PSTREAM_DESCRIPTOR_OFFSET_LO,
+                PA_PSTREAM_DESCRIPTOR_CHANNEL
+            };
+            unsigned i, n = flags & PA_FLAG_SEEKMASK;
+
+            /* The same with up to three block ids */
+
+            if (n < 2 || n > RELEASE_BATCH_MAX) {
+                pa_log_warn("Received invalid batched release frame.");
+                return -1;
+            }
+
+            pa_assert(p->export);
+            for (i = 0; i < n; i++)
+                pa_memexport_process_release(p->export, ntohl(re->descriptor[fields[i]]));
+
+            goto frame_done;
+
         } else if (flags == PA_FLAG_SHMREVOKE) {
 
             /* This is a SHM memblock revoke frame with no payload */
@@ -1157,7 +1405,7 @@ bool pa_pstream_is_pending(pa_pstream *p) {
     if (p->dead)
         b = false;
     else
-        b = p->write.current || !pa_queue_isempty(p->send_queue);
+        b = p->write.current || p->n_write_ahead > 0 || !pa_queue_isempty(p->send_queue);
 
     return b;
 }
@@ -1185,6 +1433,7 @@ void pa_pstream_unlink(pa_pstream *p) {
         return;
 
     p->dead = true;
+    p->release_item = NULL;
 
     while (p->srb || p->is_srbpending) /* In theory there could be one active and one pending */
         pa_pstream_set_srbchannel(p, NULL);
@@ -1235,6 +1484,25 @@ void pa_pstream_enable_shm(pa_pstream *p, bool enable) {
     }
 }
 
+void pa_pstream_enable_batched_release(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->use_shm);
+
+    p->batch_release = true;
+}
+
+void pa_pstream_enable_large_export(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->use_shm);
+
+    /* Not set for the exports of other pools in prepare_write_item(),
+     * they never hold more than one block */
+    if (p->export)
+        pa_memexport_set_max_blocks(p->export, PA_MEMEXPORT_SLOTS_MAX);
+}
+
 void pa_pstream_enable_memfd(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
@@ -1261,6 +1529,22 @@ bool pa_pstream_get_memfd(pa_pstream *p) {
     return p->use_memfd;
 }
 
+void pa_pstream_get_memtransfer_stat(pa_pstream *p, pa_memtransfer_stat *imported, pa_memtransfer_stat *exported) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(imported);
+    pa_assert(exported);
+
+    pa_zero(*imported);
+    pa_zero(*exported);
+
+    if (p->import)
+        pa_memimport_get_stat(p->import, imported);
+
+    if (p->export)
+        pa_memexport_get_stat(p->export, exported);
+}
+
 void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0 || srb == NULL);
@@ -66,9 +66,20 @@ bool pa_pstream_is_pending(pa_pstream *p);
 
 void pa_pstream_enable_shm(pa_pstream *p, bool enable);
 void pa_pstream_enable_memfd(pa_pstream *p);
+/* Merge SHM block releases that are queued at the same time into one
+ * frame. Only for peers that speak protocol version 33 or newer. */
+void pa_pstream_enable_batched_release(pa_pstream *p);
+/* Have up to PA_MEMEXPORT_SLOTS_MAX blocks exported at a time. Only for
+ * peers that speak protocol version 33 or newer, older ones can't import
+ * that many. */
+void pa_pstream_enable_large_export(pa_pstream *p);
 bool pa_pstream_get_shm(pa_pstream *p);
 bool pa_pstream_get_memfd(pa_pstream *p);
 
+/* Statistics of the SHM blocks we received from and sent to the other
+ * side through our own pool */
+void pa_pstream_get_memtransfer_stat(pa_pstream *p, pa_memtransfer_stat *imported, pa_memtransfer_stat *exported);
+
 /* Enables shared ringbuffer channel. Note that the srbchannel is now owned by the pstream.
    Setting srb to NULL will free any existing srbchannel. */
 void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb);
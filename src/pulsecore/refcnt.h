@@ -35,6 +35,9 @@
 #define PA_REFCNT_INIT_ZERO(p) \
     pa_atomic_store(&(p)->_ref, 0)
 
+#define PA_REFCNT_SET(p, n) \
+    pa_atomic_store(&(p)->_ref, (n))
+
 #ifndef DEBUG_REF
 
 #define PA_REFCNT_INIT(p) \
@@ -22,8 +22,11 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <pulse/sample.h>
 #include <pulse/volume.h>
+#include <pulse/xmalloc.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
@@ -121,9 +124,328 @@ static void remap_mono_to_stereo_float32ne_sse2(pa_remap_t *m, float *dst, const
     );
 }
 
+static pa_cpu_x86_flag_t x86_flags;
+
+#if defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+
+/* The remappers below are built with per-function target attributes, so
+ * this file does not need any special compiler flags and the CPU flags
+ * decide at runtime which variant gets used. */
+#include <immintrin.h>
+
+#define SSE2_FUNC __attribute__((target("sse2")))
+#define SSSE3_FUNC __attribute__((target("ssse3")))
+#define AVX_FUNC __attribute__((target("avx")))
+#define AVX2_FUNC __attribute__((target("avx2")))
+
+#define HAVE_REMAP_INTRINSICS 1
+
+/* The generic remappers work one frame at a time: the whole output frame
+ * is computed in registers, each input channel being broadcast and added
+ * with its column of the matrix. Only input channels that contribute to
+ * any output channel are looked at. */
+typedef struct remap_matrix_state {
+    unsigned n_used;
+    uint8_t used[PA_CHANNELS_MAX];
+
+    /* Columns of the matrix, i.e. indexed by input channel first, with
+     * the same clamping as the C version applies */
+    float f[PA_CHANNELS_MAX][PA_CHANNELS_MAX];
+
+    /* The fractional part as unsigned 16 bit, and a mask for unity gain */
+    int16_t lo[PA_CHANNELS_MAX][PA_CHANNELS_MAX];
+    int16_t hi[PA_CHANNELS_MAX][PA_CHANNELS_MAX];
+} remap_matrix_state;
+
+typedef struct remap_arrange_state {
+    int8_t arrange[PA_CHANNELS_MAX];
+
+    /* Byte shuffle of a whole frame for pshufb, 0x80 clears the byte */
+    uint8_t shuffle[16];
+
+    /* Sample permutation of a whole frame for vpermps, and a mask of
+     * the output channels that are not cleared */
+    int32_t perm[8];
+    int32_t keep[8];
+} remap_arrange_state;
+
+/* Number of leading frames for which accessing a full vector of lanes
+ * samples at the start of the frame does not exceed the buffer. */
+static unsigned whole_vector_frames(unsigned n, unsigned channels, unsigned lanes) {
+    if (n * channels < lanes)
+        return 0;
+
+    return (n * channels - lanes) / channels + 1;
+}
+
+SSE2_FUNC static void remap_channels_matrix_s16ne_sse2(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n) {
+    const remap_matrix_state *st = m->state;
+    const unsigned n_ic = m->i_ss.channels;
+    const unsigned n_oc = m->o_ss.channels;
+    const unsigned n_vec = (n_oc + 7) / 8;
+    unsigned n_fast, b, k;
+    int16_t tmp[PA_CHANNELS_MAX];
+
+    /* The output vectors of a frame may spill over into the next one,
+     * which gets overwritten in turn, only the last frames go through a
+     * temporary buffer */
+    n_fast = whole_vector_frames(n, n_oc, n_vec * 8);
+
+    for (; n > 0; n--, src += n_ic, dst += n_oc) {
+        int16_t *d = n_fast > 0 ? dst : tmp;
+
+        for (b = 0; b < n_vec; b++) {
+            __m128i acc = _mm_setzero_si128();
+
+            for (k = 0; k < st->n_used; k++) {
+                const unsigned ic = st->used[k];
+                const __m128i s = _mm_set1_epi16(src[ic]);
+                const __m128i lo = _mm_loadu_si128((const __m128i *) &st->lo[ic][b * 8]);
+                const __m128i hi = _mm_loadu_si128((const __m128i *) &st->hi[ic][b * 8]);
+                __m128i t;
+
+                /* signed * unsigned high half: (s * lo) >> 16 */
+                t = _mm_sub_epi16(_mm_mulhi_epu16(s, lo), _mm_and_si128(lo, _mm_srai_epi16(s, 15)));
+                t = _mm_add_epi16(t, _mm_and_si128(s, hi));
+
+                acc = _mm_add_epi16(acc, t);
+            }
+
+            _mm_storeu_si128((__m128i *) (d + b * 8), acc);
+        }
+
+        if (n_fast > 0)
+            n_fast--;
+        else
+            memcpy(dst, tmp, n_oc * sizeof(int16_t));
+    }
+}
+
+SSE2_FUNC static void remap_channels_matrix_float32ne_sse2(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const remap_matrix_state *st = m->state;
+    const unsigned n_ic = m->i_ss.channels;
+    const unsigned n_oc = m->o_ss.channels;
+    const unsigned n_vec = (n_oc + 3) / 4;
+    unsigned n_fast, b, k;
+    float tmp[PA_CHANNELS_MAX];
+
+    n_fast = whole_vector_frames(n, n_oc, n_vec * 4);
+
+    for (; n > 0; n--, src += n_ic, dst += n_oc) {
+        float *d = n_fast > 0 ? dst : tmp;
+
+        for (b = 0; b < n_vec; b++) {
+            __m128 acc = _mm_setzero_ps();
+
+            for (k = 0; k < st->n_used; k++) {
+                const unsigned ic = st->used[k];
+
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(src[ic]), _mm_loadu_ps(&st->f[ic][b * 4])));
+            }
+
+            _mm_storeu_ps(d + b * 4, acc);
+        }
+
+        if (n_fast > 0)
+            n_fast--;
+        else
+            memcpy(dst, tmp, n_oc * sizeof(float));
+    }
+}
+
+AVX_FUNC static void remap_channels_matrix_float32ne_avx(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const remap_matrix_state *st = m->state;
+    const unsigned n_ic = m->i_ss.channels;
+    const unsigned n_oc = m->o_ss.channels;
+    const unsigned n_vec = (n_oc + 7) / 8;
+    unsigned n_fast, b, k;
+    float tmp[PA_CHANNELS_MAX];
+
+    n_fast = whole_vector_frames(n, n_oc, n_vec * 8);
+
+    for (; n > 0; n--, src += n_ic, dst += n_oc) {
+        float *d = n_fast > 0 ? dst : tmp;
+
+        for (b = 0; b < n_vec; b++) {
+            __m256 acc = _mm256_setzero_ps();
+
+            for (k = 0; k < st->n_used; k++) {
+                const unsigned ic = st->used[k];
+
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(src[ic]), _mm256_loadu_ps(&st->f[ic][b * 8])));
+            }
+
+            _mm256_storeu_ps(d + b * 8, acc);
+        }
+
+        if (n_fast > 0)
+            n_fast--;
+        else
+            memcpy(dst, tmp, n_oc * sizeof(float));
+    }
+}
+
+static void remap_arrange_frames(const int8_t *arrange, uint8_t *dst, const uint8_t *src,
+        unsigned n, unsigned n_ic, unsigned n_oc, size_t ss) {
+    unsigned oc;
+
+    for (; n > 0; n--, src += n_ic * ss, dst += n_oc * ss) {
+        for (oc = 0; oc < n_oc; oc++) {
+            if (arrange[oc] >= 0)
+                memcpy(dst + oc * ss, src + arrange[oc] * ss, ss);
+            else
+                memset(dst + oc * ss, 0, ss);
+        }
+    }
+}
+
+/* Shuffles whole frames of up to 16 bytes, for both sample formats */
+SSSE3_FUNC static void remap_arrange_ssse3(pa_remap_t *m, uint8_t *dst, const uint8_t *src, unsigned n) {
+    const remap_arrange_state *st = m->state;
+    const unsigned n_ic = m->i_ss.channels;
+    const unsigned n_oc = m->o_ss.channels;
+    const size_t ss = m->format == PA_SAMPLE_S16NE ? sizeof(int16_t) : sizeof(float);
+    const __m128i shuffle = _mm_loadu_si128((const __m128i *) st->shuffle);
+    unsigned n_fast;
+
+    n_fast = PA_MIN(whole_vector_frames(n, n_ic, 16 / ss), whole_vector_frames(n, n_oc, 16 / ss));
+    n -= n_fast;
+
+    for (; n_fast > 0; n_fast--, src += n_ic * ss, dst += n_oc * ss)
+        _mm_storeu_si128((__m128i *) dst, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) src), shuffle));
+
+    remap_arrange_frames(st->arrange, dst, src, n, n_ic, n_oc, ss);
+}
+
+AVX2_FUNC static void remap_arrange_float32ne_avx2(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const remap_arrange_state *st = m->state;
+    const unsigned n_ic = m->i_ss.channels;
+    const unsigned n_oc = m->o_ss.channels;
+    const __m256i perm = _mm256_loadu_si256((const __m256i *) st->perm);
+    const __m256 keep = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *) st->keep));
+    unsigned n_fast;
+
+    n_fast = PA_MIN(whole_vector_frames(n, n_ic, 8), whole_vector_frames(n, n_oc, 8));
+    n -= n_fast;
+
+    for (; n_fast > 0; n_fast--, src += n_ic, dst += n_oc)
+        _mm256_storeu_ps(dst, _mm256_and_ps(_mm256_permutevar8x32_ps(_mm256_loadu_ps(src), perm), keep));
+
+    remap_arrange_frames(st->arrange, (uint8_t *) dst, (const uint8_t *) src, n, n_ic, n_oc, sizeof(float));
+}
+
+static bool setup_arrange_sse(pa_remap_t *m, const int8_t arrange[PA_CHANNELS_MAX]) {
+    const unsigned n_ic = m->i_ss.channels;
+    const unsigned n_oc = m->o_ss.channels;
+    const size_t ss = m->format == PA_SAMPLE_S16NE ? sizeof(int16_t) : sizeof(float);
+    remap_arrange_state *st;
+    unsigned oc, i;
+
+    if ((x86_flags & PA_CPU_X86_SSSE3) && n_ic * ss <= 16 && n_oc * ss <= 16) {
+        st = pa_xnew0(remap_arrange_state, 1);
+        memset(st->shuffle, 0x80, sizeof(st->shuffle));
+
+        for (oc = 0; oc < n_oc; oc++)
+            if (arrange[oc] >= 0)
+                for (i = 0; i < ss; i++)
+                    st->shuffle[oc * ss + i] = (uint8_t) (arrange[oc] * ss + i);
+
+        pa_log_info("Using SSSE3 arrange remapping");
+        pa_set_remap_func(m, (pa_do_remap_func_t) remap_arrange_ssse3,
+            (pa_do_remap_func_t) remap_arrange_ssse3);
+    } else if ((x86_flags & PA_CPU_X86_AVX2) && m->format == PA_SAMPLE_FLOAT32NE && n_ic <= 8 && n_oc <= 8) {
+        st = pa_xnew0(remap_arrange_state, 1);
+
+        for (oc = 0; oc < n_oc; oc++) {
+            st->perm[oc] = PA_MAX(arrange[oc], 0);
+            st->keep[oc] = arrange[oc] >= 0 ? -1 : 0;
+        }
+
+        pa_log_info("Using AVX2 arrange remapping");
+        m->do_remap = (pa_do_remap_func_t) remap_arrange_float32ne_avx2;
+    } else
+        return false;
+
+    memcpy(st->arrange, arrange, sizeof(st->arrange));
+    m->state = st;
+
+    return true;
+}
+
+static void setup_matrix_sse(pa_remap_t *m) {
+    const unsigned n_ic = m->i_ss.channels;
+    const unsigned n_oc = m->o_ss.channels;
+    remap_matrix_state *st;
+    unsigned oc, ic;
+
+    st = m->state = pa_xnew0(remap_matrix_state, 1);
+
+    for (ic = 0; ic < n_ic; ic++) {
+        bool used = false;
+
+        for (oc = 0; oc < n_oc; oc++) {
+            float f = m->map_table_f[oc][ic];
+            int32_t vol = m->map_table_i[oc][ic];
+
+            if (f > 0.0f) {
+                st->f[ic][oc] = PA_MIN(f, 1.0f);
+                used = true;
+            }
+
+            if (vol >= 0x10000)
+                st->hi[ic][oc] = -1;
+            else if (vol > 0)
+                st->lo[ic][oc] = (int16_t) (uint16_t) vol;
+
+            if (vol > 0)
+                used = true;
+        }
+
+        if (used)
+            st->used[st->n_used++] = (uint8_t) ic;
+    }
+
+    if (m->format == PA_SAMPLE_FLOAT32NE && n_oc > 4 && (x86_flags & PA_CPU_X86_AVX)) {
+        pa_log_info("Using AVX generic matrix remapping");
+        m->do_remap = (pa_do_remap_func_t) remap_channels_matrix_float32ne_avx;
+    } else {
+        pa_log_info("Using SSE2 generic matrix remapping");
+        pa_set_remap_func(m, (pa_do_remap_func_t) remap_channels_matrix_s16ne_sse2,
+            (pa_do_remap_func_t) remap_channels_matrix_float32ne_sse2);
+    }
+}
+
+/* Remappings that have a dedicated C function which is at least as fast
+ * as the generic code here, and which does its own rounding */
+static bool has_special_c(pa_remap_t *m) {
+    const unsigned n_ic = m->i_ss.channels;
+    const unsigned n_oc = m->o_ss.channels;
+
+    if (n_ic == 2 && n_oc == 1 &&
+            m->map_table_i[0][0] == 0x8000 && m->map_table_i[0][1] == 0x8000)
+        return true;
+
+    if (n_ic == 1 && n_oc == 4 &&
+            m->map_table_i[0][0] == 0x10000 && m->map_table_i[1][0] == 0x10000 &&
+            m->map_table_i[2][0] == 0x10000 && m->map_table_i[3][0] == 0x10000)
+        return true;
+
+    if (n_ic == 4 && n_oc == 1 &&
+            m->map_table_i[0][0] == 0x4000 && m->map_table_i[0][1] == 0x4000 &&
+            m->map_table_i[0][2] == 0x4000 && m->map_table_i[0][3] == 0x4000)
+        return true;
+
+    return false;
+}
+
+#endif /* defined (__clang__) || __GNUC__ > 4 || ... */
+
 /* set the function that will execute the remapping based on the matrices */
 static void init_remap_sse2(pa_remap_t *m) {
     unsigned n_oc, n_ic;
+#ifdef HAVE_REMAP_INTRINSICS
+    int8_t arrange[PA_CHANNELS_MAX];
+#endif
 
     n_oc = m->o_ss.channels;
     n_ic = m->i_ss.channels;
@@ -136,6 +458,18 @@ static void init_remap_sse2(pa_remap_t *m) {
         pa_set_remap_func(m, (pa_do_remap_func_t) remap_mono_to_stereo_s16ne_sse2,
             (pa_do_remap_func_t) remap_mono_to_stereo_float32ne_sse2);
     }
+#ifdef HAVE_REMAP_INTRINSICS
+    else if (has_special_c(m)) {
+        /* leave it to the C code */
+    } else if (pa_setup_remap_arrange(m, arrange)) {
+
+        /* The C code has dedicated arrange functions for these, anything
+         * else would end up in its generic matrix remapping */
+        if (!setup_arrange_sse(m, arrange) && n_oc != 1 && n_oc != 2 && n_oc != 4)
+            setup_matrix_sse(m);
+    } else
+        setup_matrix_sse(m);
+#endif
 }
 #endif /* defined (__i386__) || defined (__amd64__) */
 
@@ -144,6 +478,7 @@ void pa_remap_func_init_sse(pa_cpu_x86_flag_t flags) {
 
     if (flags & PA_CPU_X86_SSE2) {
         pa_log_info("Initialising SSE2 optimized remappers.");
+        x86_flags = flags;
         pa_set_init_remap_func ((pa_init_remap_func_t) init_remap_sse2);
     }
 
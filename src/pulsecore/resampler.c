@@ -28,21 +28,41 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/sample-util.h>
+#include <pulsecore/thread.h>
 
+#include "mix.h"
 #include "resampler.h"
 
 /* Number of samples of extra space we allow the resamplers to return */
 #define EXTRA_FRAMES 128
 
+/* Size of one tile in the scratch buffer. Small enough that the tile
+ * stays in the L1 cache while it passes through all stages. */
+#define TILE_SIZE 4096
+
+/* All resamplers that run in one thread share that thread's tile
+ * scratch space, instead of every stream bringing its own */
+struct tile_scratch {
+    void *data;
+    size_t size;
+};
+
+static void tile_scratch_free(void *p) {
+    struct tile_scratch *t = p;
+
+    pa_xfree(t->data);
+    pa_xfree(t);
+}
+
+PA_STATIC_TLS_DECLARE(tile_scratch, tile_scratch_free);
+
 struct ffmpeg_data { /* data specific to ffmpeg */
     struct AVResampleContext *state;
 };
 
 static int copy_init(pa_resampler *r);
 
-static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed);
-static void free_remap(pa_remap_t *m);
-
 static int (* const init_table[])(pa_resampler *r) = {
 #ifdef HAVE_LIBSAMPLERATE
     [PA_RESAMPLER_SRC_SINC_BEST_QUALITY]   = pa_resampler_libsamplerate_init,
@@ -118,6 +138,7 @@ static int (* const init_table[])(pa_resampler *r) = {
     [PA_RESAMPLER_SOXR_HQ]                 = NULL,
     [PA_RESAMPLER_SOXR_VHQ]                = NULL,
 #endif
+    [PA_RESAMPLER_POLYPHASE]               = pa_resampler_polyphase_init,
 };
 
 static pa_resample_method_t choose_auto_resampler(pa_resample_flags_t flags) {
@@ -125,10 +146,8 @@ static pa_resample_method_t choose_auto_resampler(pa_resample_flags_t flags) {
 
     if (pa_resample_method_supported(PA_RESAMPLER_SPEEX_FLOAT_BASE + 1))
         method = PA_RESAMPLER_SPEEX_FLOAT_BASE + 1;
-    else if (flags & PA_RESAMPLER_VARIABLE_RATE)
-        method = PA_RESAMPLER_TRIVIAL;
     else
-        method = PA_RESAMPLER_FFMPEG;
+        method = PA_RESAMPLER_POLYPHASE;
 
     return method;
 }
@@ -163,9 +182,6 @@ static pa_resample_method_t fix_method(
             }
                                      /* Else fall through */
         case PA_RESAMPLER_FFMPEG:
-        case PA_RESAMPLER_SOXR_MQ:
-        case PA_RESAMPLER_SOXR_HQ:
-        case PA_RESAMPLER_SOXR_VHQ:
             if (flags & PA_RESAMPLER_VARIABLE_RATE) {
                 pa_log_info("Resampler '%s' cannot do variable rate, reverting to resampler 'auto'.", pa_resample_method_to_string(method));
                 method = PA_RESAMPLER_AUTO;
@@ -406,6 +422,10 @@ pa_resampler* pa_resampler_new(
     }
     r->w_fz = pa_sample_size_of_format(r->work_format) * r->work_channels;
 
+    pa_cvolume_reset(&r->volume, r->i_ss.channels);
+
+    r->tile_frames = PA_MAX((unsigned) (TILE_SIZE / (r->w_sz * PA_MAX(r->i_ss.channels, r->o_ss.channels))), 1U);
+
     pa_log_debug("Resampler:");
     pa_log_debug("  rate %d -> %d (method %s)", a->rate, b->rate, pa_resample_method_to_string(r->method));
     pa_log_debug("  format %s -> %s (intermediate %s)", pa_sample_format_to_string(a->format),
@@ -414,7 +434,8 @@ pa_resampler* pa_resampler_new(
 
     /* set up the remap structure */
     if (r->map_required)
-        setup_remap(r, &r->remap, &lfe_remixed);
+        pa_resampler_setup_remap(&r->remap, r->work_format, &r->i_ss, &r->i_cm, &r->o_ss, &r->o_cm,
+                                 r->flags, &lfe_remixed);
 
     if (lfe_remixed && crossover_freq > 0) {
         pa_sample_spec wss = r->o_ss;
@@ -457,8 +478,10 @@ void pa_resampler_free(pa_resampler *r) {
         pa_memblock_unref(r->resample_buf.memblock);
     if (r->from_work_format_buf.memblock)
         pa_memblock_unref(r->from_work_format_buf.memblock);
+    if (r->silence_block)
+        pa_memblock_unref(r->silence_block);
 
-    free_remap(&r->remap);
+    pa_resampler_free_remap(&r->remap);
 
     pa_xfree(r);
 }
@@ -571,6 +594,8 @@ size_t pa_resampler_max_block_size(pa_resampler *r) {
 void pa_resampler_reset(pa_resampler *r) {
     pa_assert(r);
 
+    r->silent = false;
+
     if (r->impl.reset)
         r->impl.reset(r);
 
@@ -583,6 +608,8 @@ void pa_resampler_reset(pa_resampler *r) {
 void pa_resampler_rewind(pa_resampler *r, size_t out_frames) {
     pa_assert(r);
 
+    r->silent = false;
+
     /* For now, we don't have any rewindable resamplers, so we just
        reset the resampler instead (and hope that nobody hears the difference). */
     if (r->impl.reset)
@@ -624,6 +651,28 @@ const pa_sample_spec* pa_resampler_output_sample_spec(pa_resampler *r) {
     return &r->o_ss;
 }
 
+bool pa_resampler_equal(pa_resampler *a, pa_resampler *b) {
+    pa_assert(a);
+    pa_assert(b);
+
+    if (a == b)
+        return true;
+
+    if (a->method != b->method || a->flags != b->flags)
+        return false;
+
+    if (!pa_sample_spec_equal(&a->i_ss, &b->i_ss) || !pa_sample_spec_equal(&a->o_ss, &b->o_ss))
+        return false;
+
+    if (!pa_channel_map_equal(&a->i_cm, &b->i_cm) || !pa_channel_map_equal(&a->o_cm, &b->o_cm))
+        return false;
+
+    if (a->volume_required != b->volume_required)
+        return false;
+
+    return !a->volume_required || pa_cvolume_equal(&a->volume, &b->volume);
+}
+
 static const char * const resample_methods[] = {
     "src-sinc-best-quality",
     "src-sinc-medium-quality",
@@ -659,7 +708,8 @@ static const char * const resample_methods[] = {
     "peaks",
     "soxr-mq",
     "soxr-hq",
-    "soxr-vhq"
+    "soxr-vhq",
+    "polyphase"
 };
 
 const char *pa_resample_method_to_string(pa_resample_method_t m) {
@@ -799,20 +849,21 @@ static int front_rear_side(pa_channel_position_t p) {
 /* Fill a map of which output channels should get mono from input, not including
  * LFE output channels. (The LFE output channels are mapped separately.)
  */
-static void setup_oc_mono_map(const pa_resampler *r, float *oc_mono_map) {
+static void setup_oc_mono_map(const pa_sample_spec *o_ss, const pa_channel_map *o_cm, pa_resample_flags_t flags, float *oc_mono_map) {
     unsigned oc;
     unsigned n_oc;
     bool found_oc_for_mono = false;
 
-    pa_assert(r);
+    pa_assert(o_ss);
+    pa_assert(o_cm);
     pa_assert(oc_mono_map);
 
-    n_oc = r->o_ss.channels;
+    n_oc = o_ss->channels;
 
-    if (!(r->flags & PA_RESAMPLER_NO_FILL_SINK)) {
+    if (!(flags & PA_RESAMPLER_NO_FILL_SINK)) {
         /* Mono goes to all non-LFE output channels and we're done. */
         for (oc = 0; oc < n_oc; oc++)
-            oc_mono_map[oc] = on_lfe(r->o_cm.map[oc]) ? 0.0f : 1.0f;
+            oc_mono_map[oc] = on_lfe(o_cm->map[oc]) ? 0.0f : 1.0f;
         return;
     } else {
         /* Initialize to all zero so we can select individual channels below. */
@@ -821,7 +872,7 @@ static void setup_oc_mono_map(const pa_resampler *r, float *oc_mono_map) {
     }
 
     for (oc = 0; oc < n_oc; oc++) {
-        if (r->o_cm.map[oc] == PA_CHANNEL_POSITION_MONO) {
+        if (o_cm->map[oc] == PA_CHANNEL_POSITION_MONO) {
             oc_mono_map[oc] = 1.0f;
             found_oc_for_mono = true;
         }
@@ -830,7 +881,7 @@ static void setup_oc_mono_map(const pa_resampler *r, float *oc_mono_map) {
         return;
 
     for (oc = 0; oc < n_oc; oc++) {
-        if (r->o_cm.map[oc] == PA_CHANNEL_POSITION_FRONT_CENTER) {
+        if (o_cm->map[oc] == PA_CHANNEL_POSITION_FRONT_CENTER) {
             oc_mono_map[oc] = 1.0f;
             found_oc_for_mono = true;
         }
@@ -839,7 +890,7 @@ static void setup_oc_mono_map(const pa_resampler *r, float *oc_mono_map) {
         return;
 
     for (oc = 0; oc < n_oc; oc++) {
-        if (r->o_cm.map[oc] == PA_CHANNEL_POSITION_FRONT_LEFT || r->o_cm.map[oc] == PA_CHANNEL_POSITION_FRONT_RIGHT) {
+        if (o_cm->map[oc] == PA_CHANNEL_POSITION_FRONT_LEFT || o_cm->map[oc] == PA_CHANNEL_POSITION_FRONT_RIGHT) {
             oc_mono_map[oc] = 1.0f;
             found_oc_for_mono = true;
         }
@@ -851,26 +902,38 @@ static void setup_oc_mono_map(const pa_resampler *r, float *oc_mono_map) {
      * non-LFE output channels.
      */
     for (oc = 0; oc < n_oc; oc++)
-        oc_mono_map[oc] = on_lfe(r->o_cm.map[oc]) ? 0.0f : 1.0f;
+        oc_mono_map[oc] = on_lfe(o_cm->map[oc]) ? 0.0f : 1.0f;
 }
 
-static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed) {
+void pa_resampler_setup_remap(
+        pa_remap_t *m,
+        pa_sample_format_t format,
+        const pa_sample_spec *i_ss,
+        const pa_channel_map *i_cm,
+        const pa_sample_spec *o_ss,
+        const pa_channel_map *o_cm,
+        pa_resample_flags_t flags,
+        bool *lfe_remixed) {
+
     unsigned oc, ic;
     unsigned n_oc, n_ic;
     bool ic_connected[PA_CHANNELS_MAX];
     pa_strbuf *s;
     char *t;
 
-    pa_assert(r);
     pa_assert(m);
+    pa_assert(i_ss);
+    pa_assert(i_cm);
+    pa_assert(o_ss);
+    pa_assert(o_cm);
     pa_assert(lfe_remixed);
 
-    n_oc = r->o_ss.channels;
-    n_ic = r->i_ss.channels;
+    n_oc = o_ss->channels;
+    n_ic = i_ss->channels;
 
-    m->format = r->work_format;
-    m->i_ss = r->i_ss;
-    m->o_ss = r->o_ss;
+    m->format = format;
+    m->i_ss = *i_ss;
+    m->o_ss = *o_ss;
 
     memset(m->map_table_f, 0, sizeof(m->map_table_f));
     memset(m->map_table_i, 0, sizeof(m->map_table_i));
@@ -878,16 +941,16 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
     memset(ic_connected, 0, sizeof(ic_connected));
     *lfe_remixed = false;
 
-    if (r->flags & PA_RESAMPLER_NO_REMAP) {
+    if (flags & PA_RESAMPLER_NO_REMAP) {
         for (oc = 0; oc < PA_MIN(n_ic, n_oc); oc++)
             m->map_table_f[oc][oc] = 1.0f;
 
-    } else if (r->flags & PA_RESAMPLER_NO_REMIX) {
+    } else if (flags & PA_RESAMPLER_NO_REMIX) {
         for (oc = 0; oc < n_oc; oc++) {
-            pa_channel_position_t b = r->o_cm.map[oc];
+            pa_channel_position_t b = o_cm->map[oc];
 
             for (ic = 0; ic < n_ic; ic++) {
-                pa_channel_position_t a = r->i_cm.map[ic];
+                pa_channel_position_t a = i_cm->map[ic];
 
                 /* We shall not do any remixing. Hence, just check by name */
                 if (a == b)
@@ -969,22 +1032,22 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
         float oc_mono_map[PA_CHANNELS_MAX];
 
         for (ic = 0; ic < n_ic; ic++) {
-            if (on_left(r->i_cm.map[ic]))
+            if (on_left(i_cm->map[ic]))
                 ic_left++;
-            if (on_right(r->i_cm.map[ic]))
+            if (on_right(i_cm->map[ic]))
                 ic_right++;
-            if (on_center(r->i_cm.map[ic]))
+            if (on_center(i_cm->map[ic]))
                 ic_center++;
         }
 
-        setup_oc_mono_map(r, oc_mono_map);
+        setup_oc_mono_map(o_ss, o_cm, flags, oc_mono_map);
 
         for (oc = 0; oc < n_oc; oc++) {
             bool oc_connected = false;
-            pa_channel_position_t b = r->o_cm.map[oc];
+            pa_channel_position_t b = o_cm->map[oc];
 
             for (ic = 0; ic < n_ic; ic++) {
-                pa_channel_position_t a = r->i_cm.map[ic];
+                pa_channel_position_t a = i_cm->map[ic];
 
                 if (a == b) {
                     m->map_table_f[oc][ic] = 1.0f;
@@ -1009,14 +1072,14 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
             if (!oc_connected) {
                 /* Try to find matching input ports for this output port */
 
-                if (on_left(b) && !(r->flags & PA_RESAMPLER_NO_FILL_SINK)) {
+                if (on_left(b) && !(flags & PA_RESAMPLER_NO_FILL_SINK)) {
 
                     /* We are not connected and on the left side, let's
                      * average all left side input channels. */
 
                     if (ic_left > 0)
                         for (ic = 0; ic < n_ic; ic++)
-                            if (on_left(r->i_cm.map[ic])) {
+                            if (on_left(i_cm->map[ic])) {
                                 m->map_table_f[oc][ic] = 1.0f / (float) ic_left;
                                 ic_connected[ic] = true;
                             }
@@ -1024,14 +1087,14 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
                     /* We ignore the case where there is no left input channel.
                      * Something is really wrong in this case anyway. */
 
-                } else if (on_right(b) && !(r->flags & PA_RESAMPLER_NO_FILL_SINK)) {
+                } else if (on_right(b) && !(flags & PA_RESAMPLER_NO_FILL_SINK)) {
 
                     /* We are not connected and on the right side, let's
                      * average all right side input channels. */
 
                     if (ic_right > 0)
                         for (ic = 0; ic < n_ic; ic++)
-                            if (on_right(r->i_cm.map[ic])) {
+                            if (on_right(i_cm->map[ic])) {
                                 m->map_table_f[oc][ic] = 1.0f / (float) ic_right;
                                 ic_connected[ic] = true;
                             }
@@ -1040,7 +1103,7 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
                      * channel. Something is really wrong in this case anyway.
                      * */
 
-                } else if (on_center(b) && !(r->flags & PA_RESAMPLER_NO_FILL_SINK)) {
+                } else if (on_center(b) && !(flags & PA_RESAMPLER_NO_FILL_SINK)) {
 
                     if (ic_center > 0) {
 
@@ -1048,7 +1111,7 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
                          * all center input channels. */
 
                         for (ic = 0; ic < n_ic; ic++)
-                            if (on_center(r->i_cm.map[ic])) {
+                            if (on_center(i_cm->map[ic])) {
                                 m->map_table_f[oc][ic] = 1.0f / (float) ic_center;
                                 ic_connected[ic] = true;
                             }
@@ -1059,7 +1122,7 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
                          * by mixing L and R.*/
 
                         for (ic = 0; ic < n_ic; ic++)
-                            if (on_left(r->i_cm.map[ic]) || on_right(r->i_cm.map[ic])) {
+                            if (on_left(i_cm->map[ic]) || on_right(i_cm->map[ic])) {
                                 m->map_table_f[oc][ic] = 1.0f / (float) (ic_left + ic_right);
                                 ic_connected[ic] = true;
                             }
@@ -1069,7 +1132,7 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
                      * right input channel. Something is really wrong in this
                      * case anyway. */
 
-                } else if (on_lfe(b) && !(r->flags & PA_RESAMPLER_NO_LFE)) {
+                } else if (on_lfe(b) && !(flags & PA_RESAMPLER_NO_LFE)) {
 
                     /* We are not connected and an LFE. Let's average all
                      * channels for LFE. */
@@ -1086,7 +1149,7 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
         }
 
         for (ic = 0; ic < n_ic; ic++) {
-            pa_channel_position_t a = r->i_cm.map[ic];
+            pa_channel_position_t a = i_cm->map[ic];
 
             if (ic_connected[ic])
                 continue;
@@ -1102,13 +1165,13 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
         }
 
         for (ic = 0; ic < n_ic; ic++) {
-            pa_channel_position_t a = r->i_cm.map[ic];
+            pa_channel_position_t a = i_cm->map[ic];
 
             if (ic_connected[ic])
                 continue;
 
             for (oc = 0; oc < n_oc; oc++) {
-                pa_channel_position_t b = r->o_cm.map[oc];
+                pa_channel_position_t b = o_cm->map[oc];
 
                 if (on_left(a) && on_left(b))
                     m->map_table_f[oc][ic] = (1.f/9.f) / (float) ic_unconnected_left;
@@ -1120,7 +1183,7 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
                     m->map_table_f[oc][ic] = (1.f/9.f) / (float) ic_unconnected_center;
                     ic_unconnected_center_mixed_in = true;
 
-                } else if (on_lfe(a) && !(r->flags & PA_RESAMPLER_NO_LFE))
+                } else if (on_lfe(a) && !(flags & PA_RESAMPLER_NO_LFE))
                     m->map_table_f[oc][ic] = .375f / (float) ic_unconnected_lfe;
             }
         }
@@ -1141,15 +1204,15 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
                 if (ic_connected[ic])
                     continue;
 
-                if (!on_center(r->i_cm.map[ic]))
+                if (!on_center(i_cm->map[ic]))
                     continue;
 
                 for (oc = 0; oc < n_oc; oc++) {
 
-                    if (!on_left(r->o_cm.map[oc]) && !on_right(r->o_cm.map[oc]))
+                    if (!on_left(o_cm->map[oc]) && !on_right(o_cm->map[oc]))
                         continue;
 
-                    if (front_rear_side(r->i_cm.map[ic]) == front_rear_side(r->o_cm.map[oc])) {
+                    if (front_rear_side(i_cm->map[ic]) == front_rear_side(o_cm->map[oc])) {
                         found_frs[ic] = true;
                         break;
                     }
@@ -1157,17 +1220,17 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
 
                 for (oc = 0; oc < n_oc; oc++) {
 
-                    if (!on_left(r->o_cm.map[oc]) && !on_right(r->o_cm.map[oc]))
+                    if (!on_left(o_cm->map[oc]) && !on_right(o_cm->map[oc]))
                         continue;
 
-                    if (!found_frs[ic] || front_rear_side(r->i_cm.map[ic]) == front_rear_side(r->o_cm.map[oc]))
+                    if (!found_frs[ic] || front_rear_side(i_cm->map[ic]) == front_rear_side(o_cm->map[oc]))
                         ncenter[oc]++;
                 }
             }
 
             for (oc = 0; oc < n_oc; oc++) {
 
-                if (!on_left(r->o_cm.map[oc]) && !on_right(r->o_cm.map[oc]))
+                if (!on_left(o_cm->map[oc]) && !on_right(o_cm->map[oc]))
                     continue;
 
                 if (ncenter[oc] <= 0)
@@ -1175,10 +1238,10 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
 
                 for (ic = 0; ic < n_ic; ic++) {
 
-                    if (!on_center(r->i_cm.map[ic]))
+                    if (!on_center(i_cm->map[ic]))
                         continue;
 
-                    if (!found_frs[ic] || front_rear_side(r->i_cm.map[ic]) == front_rear_side(r->o_cm.map[oc]))
+                    if (!found_frs[ic] || front_rear_side(i_cm->map[ic]) == front_rear_side(o_cm->map[oc]))
                         m->map_table_f[oc][ic] = .5f / (float) ncenter[oc];
                 }
             }
@@ -1220,14 +1283,15 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
         pa_strbuf_puts(s, "\n");
     }
 
-    pa_log_debug("Channel matrix:\n%s", t = pa_strbuf_to_string_free(s));
+    t = pa_strbuf_to_string_free(s);
+    pa_log_debug("Channel matrix:\n%s", t);
     pa_xfree(t);
 
     /* initialize the remapping function */
     pa_init_remap_func(m);
 }
 
-static void free_remap(pa_remap_t *m) {
+void pa_resampler_free_remap(pa_remap_t *m) {
     pa_assert(m);
 
     pa_xfree(m->state);
@@ -1261,100 +1325,135 @@ static void fit_buf(pa_resampler *r, pa_memchunk *buf, size_t len, size_t *size,
     buf->length = len;
 }
 
-static pa_memchunk* convert_to_work_format(pa_resampler *r, pa_memchunk *input) {
-    unsigned in_n_samples, out_n_samples;
-    void *src, *dst;
-    bool have_leftover;
-    size_t leftover_length = 0;
+/* The per-sample stages of the pipeline. Any subset of them can be run
+ * in one go by process_stages(), in this order. */
+#define STAGE_TO_WORK   0x1U
+#define STAGE_VOLUME    0x2U
+#define STAGE_REMAP     0x4U
+#define STAGE_FROM_WORK 0x8U
 
-    pa_assert(r);
-    pa_assert(input);
-    pa_assert(input->memblock);
+static void *get_tile_scratch(pa_resampler *r) {
+    struct tile_scratch *t;
+    size_t size;
 
-    /* Convert the incoming sample into the work sample format and place them
-     * in to_work_format_buf. The leftover data is already converted, so it's
-     * part of the output buffer. */
+    size = 2 * r->tile_frames * r->w_sz * PA_MAX(r->i_ss.channels, r->o_ss.channels);
 
-    have_leftover = r->leftover_in_to_work;
-    r->leftover_in_to_work = false;
+    if (!(t = PA_STATIC_TLS_GET(tile_scratch))) {
+        t = pa_xnew0(struct tile_scratch, 1);
+        PA_STATIC_TLS_SET(tile_scratch, t);
+    }
 
-    if (!have_leftover && (!r->to_work_format_func || !input->length))
-        return input;
-    else if (input->length <= 0)
-        return &r->to_work_format_buf;
+    if (t->size < size) {
+        pa_xfree(t->data);
+        t->data = pa_xmalloc(size);
+        t->size = size;
+    }
 
-    in_n_samples = out_n_samples = (unsigned) ((input->length / r->i_fz) * r->i_ss.channels);
+    return t->data;
+}
+
+static void process_tile(pa_resampler *r, unsigned stages, void *tile_buf, const void *src, void *dst, unsigned n_frames) {
+    const void *cur = src;
+    uint8_t *scratch[2];
+    unsigned k = 0;
+
+    scratch[0] = tile_buf;
+    scratch[1] = (uint8_t *) tile_buf + r->tile_frames * r->w_sz * PA_MAX(r->i_ss.channels, r->o_ss.channels);
+
+    /* Each stage writes to the next scratch buffer, except for the last
+     * one which writes to dst directly. The volume is applied in place. */
+#define NEXT_BUF(later) ((stages & (later)) ? (void *) scratch[k++ & 1] : dst)
 
-    if (have_leftover) {
-        leftover_length = r->to_work_format_buf.length;
-        out_n_samples += (unsigned) (leftover_length / r->w_sz);
+    if (stages & STAGE_TO_WORK) {
+        void *t = NEXT_BUF(STAGE_REMAP | STAGE_FROM_WORK);
+        r->to_work_format_func(n_frames * r->i_ss.channels, cur, t);
+        cur = t;
     }
 
-    fit_buf(r, &r->to_work_format_buf, r->w_sz * out_n_samples, &r->to_work_format_buf_size, leftover_length);
+    if (stages & STAGE_VOLUME) {
+        pa_sample_spec wss = r->i_ss;
+        size_t length = n_frames * r->w_sz * r->i_ss.channels;
 
-    src = pa_memblock_acquire_chunk(input);
-    dst = (uint8_t *) pa_memblock_acquire(r->to_work_format_buf.memblock) + leftover_length;
+        if (cur == src) {
+            void *t = NEXT_BUF(STAGE_REMAP | STAGE_FROM_WORK);
+            memcpy(t, cur, length);
+            cur = t;
+        }
 
-    if (r->to_work_format_func)
-        r->to_work_format_func(in_n_samples, src, dst);
-    else
-        memcpy(dst, src, input->length);
+        wss.format = r->work_format;
+        pa_volume_memory((void *) cur, length, &wss, &r->volume);
+    }
 
-    pa_memblock_release(input->memblock);
-    pa_memblock_release(r->to_work_format_buf.memblock);
+    if (stages & STAGE_REMAP) {
+        void *t = NEXT_BUF(STAGE_FROM_WORK);
+        pa_assert(r->remap.do_remap);
+        r->remap.do_remap(&r->remap, t, cur, n_frames);
+        cur = t;
+    }
+
+    if (stages & STAGE_FROM_WORK)
+        r->from_work_format_func(n_frames * r->o_ss.channels, cur, dst);
 
-    return &r->to_work_format_buf;
+#undef NEXT_BUF
 }
 
-static pa_memchunk *remap_channels(pa_resampler *r, pa_memchunk *input) {
-    unsigned in_n_samples, out_n_samples, in_n_frames, out_n_frames;
-    void *src, *dst;
-    size_t leftover_length = 0;
-    bool have_leftover;
+static pa_memchunk *process_stages(pa_resampler *r, pa_memchunk *input, unsigned stages,
+                                   pa_memchunk *output, size_t *output_size, bool *have_leftover) {
+    size_t in_fz, out_fz, leftover_length = 0;
+    unsigned n_frames, tile_frames, i;
+    uint8_t *src, *dst;
 
     pa_assert(r);
     pa_assert(input);
     pa_assert(input->memblock);
 
-    /* Remap channels and place the result in remap_buf. There may be leftover
-     * data in the beginning of remap_buf. The leftover data is already
-     * remapped, so it's not part of the input, it's part of the output. */
+    /* Run the given stages on input and place the result in output. If
+     * have_leftover is set, output may already contain leftover data in
+     * the beginning, which is part of the output, not of the input. */
 
-    have_leftover = r->leftover_in_remap;
-    r->leftover_in_remap = false;
-
-    if (!have_leftover && (!r->map_required || input->length <= 0))
+    if (have_leftover && *have_leftover) {
+        leftover_length = output->length;
+        *have_leftover = false;
+    } else if (!stages || !input->length)
         return input;
-    else if (input->length <= 0)
-        return &r->remap_buf;
 
-    in_n_samples = (unsigned) (input->length / r->w_sz);
-    in_n_frames = out_n_frames = in_n_samples / r->i_ss.channels;
+    if (input->length <= 0)
+        return output;
 
-    if (have_leftover) {
-        leftover_length = r->remap_buf.length;
-        out_n_frames += leftover_length / r->w_fz;
-    }
+    if (stages) {
+        in_fz = (stages & STAGE_TO_WORK ? pa_sample_size(&r->i_ss) : r->w_sz) *
+            (stages & (STAGE_TO_WORK | STAGE_VOLUME | STAGE_REMAP) ? r->i_ss.channels : r->o_ss.channels);
+        out_fz = (stages & STAGE_FROM_WORK ? pa_sample_size(&r->o_ss) : r->w_sz) *
+            (stages & (STAGE_REMAP | STAGE_FROM_WORK) ? r->o_ss.channels : r->i_ss.channels);
+    } else
+        /* We are only appending the input to the leftover data, which is
+         * what the resampler works on */
+        in_fz = out_fz = r->w_fz;
 
-    out_n_samples = out_n_frames * r->o_ss.channels;
-    fit_buf(r, &r->remap_buf, out_n_samples * r->w_sz, &r->remap_buf_size, leftover_length);
+    n_frames = (unsigned) (input->length / in_fz);
+    fit_buf(r, output, leftover_length + n_frames * out_fz, output_size, leftover_length);
 
     src = pa_memblock_acquire_chunk(input);
-    dst = (uint8_t *) pa_memblock_acquire(r->remap_buf.memblock) + leftover_length;
-
-    if (r->map_required) {
-        pa_remap_t *remap = &r->remap;
-
-        pa_assert(remap->do_remap);
-        remap->do_remap(remap, dst, src, in_n_frames);
+    dst = (uint8_t *) pa_memblock_acquire(output->memblock) + leftover_length;
 
-    } else
+    if (!stages)
         memcpy(dst, src, input->length);
+    else if (!(stages & (stages - 1)) && !(stages & STAGE_VOLUME))
+        /* Nothing to fuse, a single pass over everything is cheapest */
+        process_tile(r, stages, get_tile_scratch(r), src, dst, n_frames);
+    else {
+        void *tile_buf = get_tile_scratch(r);
+
+        for (i = 0; i < n_frames; i += tile_frames) {
+            tile_frames = PA_MIN(r->tile_frames, n_frames - i);
+            process_tile(r, stages, tile_buf, src + i * in_fz, dst + i * out_fz, tile_frames);
+        }
+    }
 
     pa_memblock_release(input->memblock);
-    pa_memblock_release(r->remap_buf.memblock);
+    pa_memblock_release(output->memblock);
 
-    return &r->remap_buf;
+    return output;
 }
 
 static void save_leftover(pa_resampler *r, void *buf, size_t len) {
@@ -1402,34 +1501,89 @@ static pa_memchunk *resample(pa_resampler *r, pa_memchunk *input) {
     return &r->resample_buf;
 }
 
-static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input) {
-    unsigned n_samples, n_frames;
-    void *src, *dst;
+static void release_buf(pa_resampler *r, pa_memchunk *buf, size_t *size) {
+    if (!buf->memblock)
+        return;
+
+    /* The leftover data is input for the next run */
+    if (buf == r->leftover_buf && *r->have_leftover)
+        return;
+
+    pa_memblock_unref(buf->memblock);
+    pa_memchunk_reset(buf);
+    *size = 0;
+}
 
+static void release_bufs(pa_resampler *r) {
     pa_assert(r);
-    pa_assert(input);
 
-    /* Convert the data into the correct sample type and place the result in
-     * from_work_format_buf. */
+    /* Hand the intermediate buffers back to the pool once a run is
+     * done. A sink easily has dozens of inputs with a resampler each,
+     * this way they take turns on the few blocks that were freed last
+     * (and are likely still in the cache), instead of every idle stream
+     * pinning several blocks of its own. */
+    release_buf(r, &r->to_work_format_buf, &r->to_work_format_buf_size);
+    release_buf(r, &r->remap_buf, &r->remap_buf_size);
+    release_buf(r, &r->resample_buf, &r->resample_buf_size);
+    release_buf(r, &r->from_work_format_buf, &r->from_work_format_buf_size);
+}
 
-    if (!r->from_work_format_func || !input->length)
-        return input;
+void pa_resampler_set_volume(pa_resampler *r, const pa_cvolume *volume) {
+    pa_assert(r);
 
-    n_samples = (unsigned) (input->length / r->w_sz);
-    n_frames = n_samples / r->o_ss.channels;
-    fit_buf(r, &r->from_work_format_buf, r->o_fz * n_frames, &r->from_work_format_buf_size, 0);
+    if (!volume || pa_cvolume_is_norm(volume)) {
+        r->volume_required = false;
+        return;
+    }
 
-    src = pa_memblock_acquire_chunk(input);
-    dst = pa_memblock_acquire(r->from_work_format_buf.memblock);
-    r->from_work_format_func(n_samples, src, dst);
-    pa_memblock_release(input->memblock);
-    pa_memblock_release(r->from_work_format_buf.memblock);
+    pa_assert(pa_cvolume_compatible(volume, &r->i_ss));
+
+    r->volume = *volume;
+    r->volume_required = true;
+}
+
+/* Hands out silence for silent input without running any stage.
+ * Returns false if the output doesn't fit into our silence block. */
+static bool run_silence(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    uint64_t frames;
+    size_t length;
+
+    frames = in->length / r->i_fz;
+
+    if (r->impl.resample) {
+        uint64_t t = r->silence_phase + frames * r->o_ss.rate;
+
+        frames = t / r->i_ss.rate;
+        r->silence_phase = t % r->i_ss.rate;
+    }
+
+    length = (size_t) frames * r->o_fz;
+
+    if (!r->silence_block) {
+        r->silence_block = pa_silence_memblock(pa_memblock_new(r->mempool, (size_t) -1), &r->o_ss);
+        pa_memblock_set_is_silence(r->silence_block, true);
+    }
+
+    if (length > pa_memblock_get_length(r->silence_block))
+        return false;
 
-    return &r->from_work_format_buf;
+    /* Whatever was left over is silence, too */
+    *r->have_leftover = false;
+
+    if (length > 0) {
+        out->memblock = pa_memblock_ref(r->silence_block);
+        out->index = 0;
+        out->length = length;
+    } else
+        pa_memchunk_reset(out);
+
+    return true;
 }
 
 void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
     pa_memchunk *buf;
+    unsigned pre = 0, post = 0;
+    bool silent;
 
     pa_assert(r);
     pa_assert(in);
@@ -1438,24 +1592,59 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
     pa_assert(in->memblock);
     pa_assert(in->length % r->i_fz == 0);
 
-    buf = (pa_memchunk*) in;
-    buf = convert_to_work_format(r, buf);
+    /* Silence stays silence through all stages. The first silent block
+     * still goes through them to flush out what the filters hold,
+     * after that there's nothing left to do. */
+    if ((silent = pa_memblock_is_silence(in->memblock)) && r->silent && run_silence(r, in, out))
+        return;
+
+    if (r->to_work_format_func)
+        pre |= STAGE_TO_WORK;
+    if (r->volume_required)
+        pre |= STAGE_VOLUME;
+    if (r->from_work_format_func)
+        post |= STAGE_FROM_WORK;
 
     /* Try to save resampling effort: if we have more output channels than
      * input channels, do resampling first, then remapping. */
-    if (r->o_ss.channels <= r->i_ss.channels) {
-        buf = remap_channels(r, buf);
-        buf = resample(r, buf);
-    } else {
-        buf = resample(r, buf);
-        buf = remap_channels(r, buf);
+    if (r->map_required) {
+        if (r->o_ss.channels <= r->i_ss.channels)
+            pre |= STAGE_REMAP;
+        else
+            post |= STAGE_REMAP;
     }
 
-    if (r->lfe_filter)
+    /* Without rate conversion all that is left works on single samples,
+     * so we can do it all in one pass. The LFE filter needs to go between
+     * remapping and the final format conversion, though. */
+    if (!r->impl.resample) {
+        pre |= post & (r->lfe_filter ? STAGE_REMAP : ~0U);
+        post &= ~pre;
+    }
+
+    buf = (pa_memchunk*) in;
+
+    if (pre & STAGE_FROM_WORK)
+        buf = process_stages(r, buf, pre, &r->from_work_format_buf, &r->from_work_format_buf_size, NULL);
+    else
+        buf = process_stages(r, buf, pre, r->leftover_buf, r->leftover_buf_size, r->have_leftover);
+
+    buf = resample(r, buf);
+
+    if (r->lfe_filter) {
+        if (post & STAGE_REMAP)
+            buf = process_stages(r, buf, STAGE_REMAP, &r->remap_buf, &r->remap_buf_size, NULL);
+
         buf = pa_lfe_filter_process(r->lfe_filter, buf);
+        post &= ~STAGE_REMAP;
+    }
 
     if (buf->length) {
-        buf = convert_from_work_format(r, buf);
+        if (post & STAGE_FROM_WORK)
+            buf = process_stages(r, buf, post, &r->from_work_format_buf, &r->from_work_format_buf_size, NULL);
+        else
+            buf = process_stages(r, buf, post, &r->remap_buf, &r->remap_buf_size, NULL);
+
         *out = *buf;
 
         if (buf == in)
@@ -1464,6 +1653,11 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
             pa_memchunk_reset(buf);
     } else
         pa_memchunk_reset(out);
+
+    release_bufs(r);
+
+    if ((r->silent = silent))
+        r->silence_phase = 0;
 }
 
 /*** copy (noop) implementation ***/
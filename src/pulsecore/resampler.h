@@ -22,6 +22,7 @@
 
 #include <pulse/sample.h>
 #include <pulse/channelmap.h>
+#include <pulse/volume.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/sconv.h>
@@ -61,6 +62,7 @@ typedef enum pa_resample_method {
     PA_RESAMPLER_SOXR_MQ,
     PA_RESAMPLER_SOXR_HQ,
     PA_RESAMPLER_SOXR_VHQ,
+    PA_RESAMPLER_POLYPHASE,
     PA_RESAMPLER_MAX
 } pa_resample_method_t;
 
@@ -108,8 +110,24 @@ struct pa_resampler {
     pa_remap_t remap;
     bool map_required;
 
+    /* Software volume applied to the input, see pa_resampler_set_volume() */
+    pa_cvolume volume;
+    bool volume_required;
+
+    /* Frames per tile when running the per-sample stages tile by tile,
+     * the scratch space for that is shared per thread */
+    unsigned tile_frames;
+
     pa_lfe_filter_t *lfe_filter;
 
+    /* Set once silence has gone through all stages, so that their state
+     * has settled. Further silence is then passed on as is, see
+     * pa_resampler_run(). silence_phase keeps the fraction of an output
+     * frame we owe when skipping the rate conversion. */
+    bool silent;
+    uint64_t silence_phase;
+    pa_memblock *silence_block;
+
     pa_resampler_impl impl;
 };
 
@@ -125,6 +143,23 @@ pa_resampler* pa_resampler_new(
 
 void pa_resampler_free(pa_resampler *r);
 
+/* Fill in the channel matrix of m for remapping from i_ss/i_cm to
+ * o_ss/o_cm in the given format, following the same rules the
+ * resampler uses internally. This lets callers that only need to
+ * remap channels drive the pa_remap_t kernels directly. Free the
+ * result with pa_resampler_free_remap(). */
+void pa_resampler_setup_remap(
+        pa_remap_t *m,
+        pa_sample_format_t format,
+        const pa_sample_spec *i_ss,
+        const pa_channel_map *i_cm,
+        const pa_sample_spec *o_ss,
+        const pa_channel_map *o_cm,
+        pa_resample_flags_t flags,
+        bool *lfe_remixed);
+
+void pa_resampler_free_remap(pa_remap_t *m);
+
 /* Returns the size of an input memory block which is required to return the specified amount of output data */
 size_t pa_resampler_request(pa_resampler *r, size_t out_length);
 
@@ -134,6 +169,12 @@ size_t pa_resampler_result(pa_resampler *r, size_t in_length);
 /* Returns the maximum size of input blocks we can process without needing bounce buffers larger than the mempool tile size. */
 size_t pa_resampler_max_block_size(pa_resampler *r);
 
+/* Set a software volume that gets applied to the input data as part of
+ * pa_resampler_run(), so that it does not need a separate pass over the
+ * data. The volume is in terms of the input channel map. Pass NULL to
+ * disable it again. */
+void pa_resampler_set_volume(pa_resampler *r, const pa_cvolume *volume);
+
 /* Pass the specified memory chunk to the resampler and return the newly resampled data */
 void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out);
 
@@ -166,14 +207,36 @@ const pa_sample_spec* pa_resampler_input_sample_spec(pa_resampler *r);
 const pa_channel_map* pa_resampler_output_channel_map(pa_resampler *r);
 const pa_sample_spec* pa_resampler_output_sample_spec(pa_resampler *r);
 
+/* Returns true if both resamplers turn the same input into the same
+ * output, i.e. the output of one may be used in place of the
+ * other's. Internal filter state is not compared. */
+bool pa_resampler_equal(pa_resampler *a, pa_resampler *b);
+
 /* Implementation specific init functions */
 int pa_resampler_ffmpeg_init(pa_resampler *r);
 int pa_resampler_libsamplerate_init(pa_resampler *r);
 int pa_resampler_peaks_init(pa_resampler *r);
+int pa_resampler_polyphase_init(pa_resampler *r);
 int pa_resampler_speex_init(pa_resampler *r);
 int pa_resampler_trivial_init(pa_resampler*r);
 int pa_resampler_soxr_init(pa_resampler *r);
 
+/* Used by the peaks resampler. Raises max[c] to the largest absolute
+ * sample value of channel c in the n_frames interleaved frames at src.
+ * max is int16_t[] for PA_SAMPLE_S16NE and float[] for
+ * PA_SAMPLE_FLOAT32NE, the only two formats supported. */
+typedef void (*pa_find_peaks_func_t) (const void *src, unsigned channels, unsigned n_frames, void *max);
+
+pa_find_peaks_func_t pa_get_find_peaks_func(pa_sample_format_t f);
+void pa_set_find_peaks_func(pa_sample_format_t f, pa_find_peaks_func_t func);
+
+/* Used by the polyphase resampler. Returns the dot product of the n
+ * floats at x and h. n is a multiple of 4 and h is 16 byte aligned. */
+typedef float (*pa_polyphase_dot_func_t) (const float *x, const float *h, unsigned n);
+
+pa_polyphase_dot_func_t pa_get_polyphase_dot_func(void);
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func);
+
 /* Resampler-specific quirks */
 bool pa_speex_is_fixed_point(void);
 
@@ -28,12 +28,18 @@
 
 struct ffmpeg_data { /* data specific to ffmpeg */
     struct AVResampleContext *state;
+
+    /* One channel's worth of input and output, reused across channels
+     * and calls */
+    int16_t *in_buf, *out_buf;
+    unsigned in_frames, out_frames;
 };
 
 static unsigned ffmpeg_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
-    unsigned used_frames = 0, c;
+    unsigned used_frames = 0, c, u;
     int previous_consumed_frames = -1;
     struct ffmpeg_data *ffmpeg_data;
+    int16_t *src, *dst;
 
     pa_assert(r);
     pa_assert(input);
@@ -42,56 +48,55 @@ static unsigned ffmpeg_resample(pa_resampler *r, const pa_memchunk *input, unsig
 
     ffmpeg_data = r->impl.data;
 
+    if (ffmpeg_data->in_frames < in_n_frames) {
+        ffmpeg_data->in_buf = pa_xrealloc(ffmpeg_data->in_buf, in_n_frames * sizeof(int16_t));
+        ffmpeg_data->in_frames = in_n_frames;
+    }
+
+    if (ffmpeg_data->out_frames < *out_n_frames) {
+        ffmpeg_data->out_buf = pa_xrealloc(ffmpeg_data->out_buf, *out_n_frames * sizeof(int16_t));
+        ffmpeg_data->out_frames = *out_n_frames;
+    }
+
+    src = pa_memblock_acquire_chunk(input);
+    dst = pa_memblock_acquire_chunk(output);
+
     for (c = 0; c < r->work_channels; c++) {
-        unsigned u;
-        pa_memblock *b, *w;
-        int16_t *p, *t, *k, *q, *s;
+        int16_t *t, *k;
         int consumed_frames;
 
-        /* Allocate a new block */
-        b = pa_memblock_new(r->mempool, in_n_frames * sizeof(int16_t));
-        p = pa_memblock_acquire(b);
-
-        /* Now copy the input data, splitting up channels */
-        t = (int16_t*) pa_memblock_acquire_chunk(input) + c;
-        k = p;
+        /* Copy the input data, splitting up channels. The filter wants
+         * each channel's samples next to each other. */
+        t = src + c;
+        k = ffmpeg_data->in_buf;
         for (u = 0; u < in_n_frames; u++) {
-            *k = *t;
+            *(k++) = *t;
             t += r->work_channels;
-            k ++;
         }
-        pa_memblock_release(input->memblock);
-
-        /* Allocate buffer for the result */
-        w = pa_memblock_new(r->mempool, *out_n_frames * sizeof(int16_t));
-        q = pa_memblock_acquire(w);
 
         /* Now, resample */
         used_frames = (unsigned) av_resample(ffmpeg_data->state,
-                                             q, p,
+                                             ffmpeg_data->out_buf, ffmpeg_data->in_buf,
                                              &consumed_frames,
                                              (int) in_n_frames, (int) *out_n_frames,
                                              c >= (unsigned) (r->work_channels-1));
 
-        pa_memblock_release(b);
-        pa_memblock_unref(b);
-
         pa_assert(consumed_frames <= (int) in_n_frames);
         pa_assert(previous_consumed_frames == -1 || consumed_frames == previous_consumed_frames);
         previous_consumed_frames = consumed_frames;
 
         /* And place the results in the output buffer */
-        s = (int16_t *) pa_memblock_acquire_chunk(output) + c;
+        t = ffmpeg_data->out_buf;
+        k = dst + c;
         for (u = 0; u < used_frames; u++) {
-            *s = *q;
-            q++;
-            s += r->work_channels;
+            *k = *(t++);
+            k += r->work_channels;
         }
-        pa_memblock_release(output->memblock);
-        pa_memblock_release(w);
-        pa_memblock_unref(w);
     }
 
+    pa_memblock_release(output->memblock);
+    pa_memblock_release(input->memblock);
+
     *out_n_frames = used_frames;
 
     return in_n_frames - previous_consumed_frames;
@@ -105,6 +110,9 @@ static void ffmpeg_free(pa_resampler *r) {
     ffmpeg_data = r->impl.data;
     if (ffmpeg_data->state)
         av_resample_close(ffmpeg_data->state);
+
+    pa_xfree(ffmpeg_data->in_buf);
+    pa_xfree(ffmpeg_data->out_buf);
 }
 
 int pa_resampler_ffmpeg_init(pa_resampler *r) {
@@ -112,7 +120,7 @@ int pa_resampler_ffmpeg_init(pa_resampler *r) {
 
     pa_assert(r);
 
-    ffmpeg_data = pa_xnew(struct ffmpeg_data, 1);
+    ffmpeg_data = pa_xnew0(struct ffmpeg_data, 1);
 
     /* We could probably implement different quality levels by
      * adjusting the filter parameters here. However, ffmpeg
@@ -34,11 +34,72 @@ struct peaks_data { /* data specific to the peak finder pseudo resampler */
     int16_t max_i[PA_CHANNELS_MAX];
 };
 
+static void find_peaks_s16ne_c(const void *src, unsigned channels, unsigned n_frames, void *max) {
+    const int16_t *s = src;
+    int16_t *m = max;
+    unsigned i, c;
+
+    for (i = 0; i < n_frames; i++)
+        for (c = 0; c < channels; c++) {
+            /* abs(-0x8000) doesn't fit, saturate it */
+            int16_t n = (int16_t) PA_MIN(abs(*s++), 0x7FFF);
+
+            if (n > m[c])
+                m[c] = n;
+        }
+}
+
+static void find_peaks_float32ne_c(const void *src, unsigned channels, unsigned n_frames, void *max) {
+    const float *s = src;
+    float *m = max;
+    unsigned i, c;
+
+    /* 1ch is treated separately, because that is the common case */
+    if (channels == 1) {
+        for (i = 0; i < n_frames; i++) {
+            float n = fabsf(*s++);
+
+            if (n > m[0])
+                m[0] = n;
+        }
+
+        return;
+    }
+
+    for (i = 0; i < n_frames; i++)
+        for (c = 0; c < channels; c++) {
+            float n = fabsf(*s++);
+
+            if (n > m[c])
+                m[c] = n;
+        }
+}
+
+static pa_find_peaks_func_t find_peaks_table[] = {
+    [PA_SAMPLE_S16NE] = find_peaks_s16ne_c,
+    [PA_SAMPLE_FLOAT32NE] = find_peaks_float32ne_c,
+};
+
+pa_find_peaks_func_t pa_get_find_peaks_func(pa_sample_format_t f) {
+    pa_assert(f == PA_SAMPLE_S16NE || f == PA_SAMPLE_FLOAT32NE);
+
+    return find_peaks_table[f];
+}
+
+void pa_set_find_peaks_func(pa_sample_format_t f, pa_find_peaks_func_t func) {
+    pa_assert(f == PA_SAMPLE_S16NE || f == PA_SAMPLE_FLOAT32NE);
+    pa_assert(func);
+
+    find_peaks_table[f] = func;
+}
+
 static unsigned peaks_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
     unsigned c, o_index = 0;
     unsigned i, i_end = 0;
-    void *src, *dst;
+    uint8_t *src, *dst;
     struct peaks_data *peaks_data;
+    pa_find_peaks_func_t find_peaks;
+    void *max;
 
     pa_assert(r);
     pa_assert(input);
@@ -49,6 +110,9 @@ static unsigned peaks_resample(pa_resampler *r, const pa_memchunk *input, unsign
     src = pa_memblock_acquire_chunk(input);
     dst = pa_memblock_acquire_chunk(output);
 
+    find_peaks = pa_get_find_peaks_func(r->work_format);
+    max = r->work_format == PA_SAMPLE_S16NE ? (void *) peaks_data->max_i : (void *) peaks_data->max_f;
+
     i = ((uint64_t) peaks_data->o_counter * r->i_ss.rate) / r->o_ss.rate;
     i = i > peaks_data->i_counter ? i - peaks_data->i_counter : 0;
 
@@ -58,61 +122,31 @@ static unsigned peaks_resample(pa_resampler *r, const pa_memchunk *input, unsign
 
         pa_assert_fp(o_index * r->w_fz < pa_memblock_get_length(output->memblock));
 
-        /* 1ch float is treated separately, because that is the common case */
-        if (r->work_channels == 1 && r->work_format == PA_SAMPLE_FLOAT32NE) {
-            float *s = (float*) src + i;
-            float *d = (float*) dst + o_index;
+        if (i < i_end && i < in_n_frames) {
+            unsigned n = PA_MIN(i_end, in_n_frames) - i;
 
-            for (; i < i_end && i < in_n_frames; i++) {
-                float n = fabsf(*s++);
-
-                if (n > peaks_data->max_f[0])
-                    peaks_data->max_f[0] = n;
-            }
+            find_peaks(src + i * r->w_fz, r->work_channels, n, max);
+            i += n;
+        }
 
-            if (i == i_end) {
-                *d = peaks_data->max_f[0];
-                peaks_data->max_f[0] = 0;
-                o_index++, peaks_data->o_counter++;
-            }
-        } else if (r->work_format == PA_SAMPLE_S16NE) {
-            int16_t *s = (int16_t*) src + r->work_channels * i;
-            int16_t *d = (int16_t*) dst + r->work_channels * o_index;
+        if (i == i_end) {
+            if (r->work_format == PA_SAMPLE_S16NE) {
+                int16_t *d = (int16_t*) (dst + o_index * r->w_fz);
 
-            for (; i < i_end && i < in_n_frames; i++)
                 for (c = 0; c < r->work_channels; c++) {
-                    int16_t n = abs(*s++);
-
-                    if (n > peaks_data->max_i[c])
-                        peaks_data->max_i[c] = n;
-                }
-
-            if (i == i_end) {
-                for (c = 0; c < r->work_channels; c++, d++) {
-                    *d = peaks_data->max_i[c];
+                    d[c] = peaks_data->max_i[c];
                     peaks_data->max_i[c] = 0;
                 }
-                o_index++, peaks_data->o_counter++;
-            }
-        } else {
-            float *s = (float*) src + r->work_channels * i;
-            float *d = (float*) dst + r->work_channels * o_index;
+            } else {
+                float *d = (float*) (dst + o_index * r->w_fz);
 
-            for (; i < i_end && i < in_n_frames; i++)
                 for (c = 0; c < r->work_channels; c++) {
-                    float n = fabsf(*s++);
-
-                    if (n > peaks_data->max_f[c])
-                        peaks_data->max_f[c] = n;
-                }
-
-            if (i == i_end) {
-                for (c = 0; c < r->work_channels; c++, d++) {
-                    *d = peaks_data->max_f[c];
+                    d[c] = peaks_data->max_f[c];
                     peaks_data->max_f[c] = 0;
                 }
-                o_index++, peaks_data->o_counter++;
             }
+
+            o_index++, peaks_data->o_counter++;
         }
     }
 
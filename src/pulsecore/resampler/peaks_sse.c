@@ -0,0 +1,127 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/resampler.h>
+
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+/* Like mix_sse.c, built with per-function target attributes */
+#include <immintrin.h>
+
+#define SSE2_FUNC __attribute__((target("sse2")))
+
+static pa_find_peaks_func_t fallback_s16ne;
+static pa_find_peaks_func_t fallback_float32ne;
+
+/* The vector loops below keep one maximum per lane. As long as the
+ * number of channels divides the number of samples we take per
+ * iteration, every lane always sees the same channel, so the lanes
+ * can simply be folded into the channels at the end. Other channel
+ * counts, and what is left over at the end, take the C version. */
+
+static SSE2_FUNC void find_peaks_s16ne_sse2(const void *src, unsigned channels, unsigned n_frames, void *max) {
+    const int16_t *s = src;
+    int16_t *m = max;
+    unsigned n, k, done = 0;
+
+    if (8 % channels == 0 && (n = n_frames * channels / 16) > 0) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc0 = zero, acc1 = zero;
+        PA_DECLARE_ALIGNED(16, int16_t, lanes[8]);
+
+        for (k = 0; k < n; k++, s += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *) s);
+            __m128i b = _mm_loadu_si128((const __m128i *) s + 1);
+
+            /* The saturating subtraction turns -0x8000 into 0x7FFF,
+             * just like the C version does */
+            acc0 = _mm_max_epi16(acc0, _mm_max_epi16(a, _mm_subs_epi16(zero, a)));
+            acc1 = _mm_max_epi16(acc1, _mm_max_epi16(b, _mm_subs_epi16(zero, b)));
+        }
+
+        _mm_store_si128((__m128i *) lanes, _mm_max_epi16(acc0, acc1));
+
+        for (k = 0; k < 8; k++)
+            if (lanes[k] > m[k % channels])
+                m[k % channels] = lanes[k];
+
+        done = n * 16 / channels;
+    }
+
+    if (done < n_frames)
+        fallback_s16ne(s, channels, n_frames - done, max);
+}
+
+static SSE2_FUNC void find_peaks_float32ne_sse2(const void *src, unsigned channels, unsigned n_frames, void *max) {
+    const float *s = src;
+    float *m = max;
+    unsigned n, k, done = 0;
+
+    if (8 % channels == 0 && (n = n_frames * channels / 8) > 0) {
+        const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        PA_DECLARE_ALIGNED(16, float, lanes[8]);
+
+        for (k = 0; k < n; k++, s += 8) {
+            __m128 a = _mm_and_ps(_mm_loadu_ps(s), abs_mask);
+            __m128 b = _mm_and_ps(_mm_loadu_ps(s + 4), abs_mask);
+
+            /* maxps returns the second operand if either is NaN, so
+             * NaNs are skipped like in the C version */
+            acc0 = _mm_max_ps(a, acc0);
+            acc1 = _mm_max_ps(b, acc1);
+        }
+
+        _mm_store_ps(lanes, acc0);
+        _mm_store_ps(lanes + 4, acc1);
+
+        for (k = 0; k < 8; k++)
+            if (lanes[k] > m[k % channels])
+                m[k % channels] = lanes[k];
+
+        done = n * 8 / channels;
+    }
+
+    if (done < n_frames)
+        fallback_float32ne(s, channels, n_frames - done, max);
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && ... */
+
+void pa_peaks_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+    if (!(flags & PA_CPU_X86_SSE2))
+        return;
+
+    pa_log_info("Initialising SSE2 optimized peak finding functions.");
+
+    fallback_s16ne = pa_get_find_peaks_func(PA_SAMPLE_S16NE);
+    fallback_float32ne = pa_get_find_peaks_func(PA_SAMPLE_FLOAT32NE);
+
+    pa_set_find_peaks_func(PA_SAMPLE_S16NE, find_peaks_s16ne_sse2);
+    pa_set_find_peaks_func(PA_SAMPLE_FLOAT32NE, find_peaks_float32ne_sse2);
+#endif
+}
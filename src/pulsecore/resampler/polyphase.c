@@ -0,0 +1,427 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/resampler.h>
+
+/* A windowed sinc filter, split into one set of coefficients ("row")
+ * per output phase. For ratios like 44.1 <-> 48 kHz (147/160) or
+ * 48 <-> 96 kHz (1/2) there are few enough phases to precompute every
+ * row, anything else (including variable rates) interpolates linearly
+ * between POLYPHASE_INTERP_PHASES rows. */
+
+/* Filter length in input frames when upsampling. When downsampling the
+ * filter gets longer by the ratio, up to POLYPHASE_MAX_TAPS. */
+#define POLYPHASE_TAPS 32
+#define POLYPHASE_MAX_TAPS 256
+
+/* Relative to the lower of the two Nyquist frequencies */
+#define POLYPHASE_CUTOFF 0.91
+
+#define POLYPHASE_KAISER_BETA 8.0
+
+#define POLYPHASE_MAX_EXACT_PHASES 512
+#define POLYPHASE_MAX_EXACT_SIZE (32 * 1024)
+#define POLYPHASE_INTERP_PHASES 256
+
+/* Input frames that are kept in front of the filter, so that a rate
+ * change that makes the filter longer still finds real history */
+#define POLYPHASE_MARGIN 16
+
+struct polyphase_table {
+    /* Row k is for an offset of k / divisor input frames */
+    unsigned divisor;
+    unsigned n_rows;
+    unsigned taps;
+    double cutoff;
+
+    /* 64 byte aligned, rows are taps floats apart */
+    float *rows;
+    void *mem;
+
+    unsigned ref;
+    PA_LLIST_FIELDS(struct polyphase_table);
+};
+
+struct polyphase_data { /* data specific to the polyphase resampler */
+    struct polyphase_table *table;
+    bool interpolate;
+
+    /* Each output frame advances by in_step / out_step input frames.
+     * phase is the fraction of the current position in 1/out_step. */
+    unsigned in_step, out_step;
+    unsigned phase;
+
+    /* Input history, one run of buf_frames floats per channel */
+    float *buf;
+    unsigned buf_frames;
+    unsigned n_frames;
+
+    /* First input frame under the filter */
+    unsigned pos;
+};
+
+/* All resamplers with the same ratio share one table, the tables are
+ * never changed once they are set up */
+static pa_static_mutex tables_mutex = PA_STATIC_MUTEX_INIT;
+static PA_LLIST_HEAD(struct polyphase_table, tables) = NULL;
+
+static float dot_c(const float *x, const float *h, unsigned n) {
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+    unsigned i;
+
+    for (i = 0; i < n; i += 4) {
+        s0 += x[i] * h[i];
+        s1 += x[i + 1] * h[i + 1];
+        s2 += x[i + 2] * h[i + 2];
+        s3 += x[i + 3] * h[i + 3];
+    }
+
+    return (s0 + s1) + (s2 + s3);
+}
+
+static pa_polyphase_dot_func_t dot_func = dot_c;
+
+pa_polyphase_dot_func_t pa_get_polyphase_dot_func(void) {
+    return dot_func;
+}
+
+void pa_set_polyphase_dot_func(pa_polyphase_dot_func_t func) {
+    pa_assert(func);
+
+    dot_func = func;
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0, y = x * x / 4.0;
+    unsigned k;
+
+    for (k = 1; k < 64 && term > sum * 1e-12; k++) {
+        term *= y / ((double) k * k);
+        sum += term;
+    }
+
+    return sum;
+}
+
+static void fill_row(float *row, unsigned taps, double cutoff, double offset) {
+    double sum = 0.0, half = taps / 2.0, i0_beta = bessel_i0(POLYPHASE_KAISER_BETA);
+    unsigned j;
+
+    /* The filter is centered between taps/2 - 1 and taps/2, offset
+     * frames after the former */
+    for (j = 0; j < taps; j++) {
+        double t = (double) j - (double) (taps / 2 - 1) - offset;
+        double x = t / half, w, s;
+
+        w = fabs(x) >= 1.0 ? 0.0 : bessel_i0(POLYPHASE_KAISER_BETA * sqrt(1.0 - x * x)) / i0_beta;
+        s = t == 0.0 ? cutoff : sin(M_PI * cutoff * t) / (M_PI * t);
+
+        row[j] = (float) (w * s);
+        sum += row[j];
+    }
+
+    /* Every phase passes DC unchanged */
+    for (j = 0; j < taps; j++)
+        row[j] = (float) (row[j] / sum);
+}
+
+static struct polyphase_table *table_get(unsigned divisor, unsigned n_rows, unsigned taps, double cutoff) {
+    struct polyphase_table *t;
+    pa_mutex *m;
+    unsigned k;
+
+    m = pa_static_mutex_get(&tables_mutex, false, false);
+    pa_mutex_lock(m);
+
+    for (t = tables; t; t = t->next)
+        if (t->divisor == divisor && t->n_rows == n_rows && t->taps == taps && t->cutoff == cutoff)
+            break;
+
+    if (t)
+        t->ref++;
+    else {
+        t = pa_xnew0(struct polyphase_table, 1);
+        t->divisor = divisor;
+        t->n_rows = n_rows;
+        t->taps = taps;
+        t->cutoff = cutoff;
+        t->ref = 1;
+
+        t->mem = pa_xmalloc(n_rows * taps * sizeof(float) + 63);
+        t->rows = (float *) (((uintptr_t) t->mem + 63) & ~(uintptr_t) 63);
+
+        for (k = 0; k < n_rows; k++)
+            fill_row(t->rows + k * taps, taps, cutoff, (double) k / divisor);
+
+        PA_LLIST_PREPEND(struct polyphase_table, tables, t);
+    }
+
+    pa_mutex_unlock(m);
+
+    return t;
+}
+
+static void table_unref(struct polyphase_table *t) {
+    pa_mutex *m;
+
+    m = pa_static_mutex_get(&tables_mutex, false, false);
+    pa_mutex_lock(m);
+
+    if (--t->ref == 0) {
+        PA_LLIST_REMOVE(struct polyphase_table, tables, t);
+        pa_xfree(t->mem);
+        pa_xfree(t);
+    }
+
+    pa_mutex_unlock(m);
+}
+
+/* Makes sure there is room for n more frames of history */
+static void make_room(pa_resampler *r, struct polyphase_data *d, unsigned n) {
+    unsigned c, buf_frames;
+    float *buf;
+
+    if (d->n_frames + n <= d->buf_frames)
+        return;
+
+    buf_frames = PA_MAX(d->n_frames + n, 2 * d->buf_frames);
+    buf = pa_xnew(float, buf_frames * r->work_channels);
+
+    for (c = 0; c < r->work_channels; c++)
+        memcpy(buf + c * buf_frames, d->buf + c * d->buf_frames, d->n_frames * sizeof(float));
+
+    pa_xfree(d->buf);
+    d->buf = buf;
+    d->buf_frames = buf_frames;
+}
+
+/* Sets up the filter for the current rates. If there was a filter
+ * before, the position in the input is carried over, so that rate
+ * changes don't cause a discontinuity. */
+static void setup_filter(pa_resampler *r, struct polyphase_data *d) {
+    struct polyphase_table *old_table;
+    unsigned g, in_step, out_step, taps, old_taps = 0;
+    double ratio, cutoff;
+
+    g = pa_gcd(r->i_ss.rate, r->o_ss.rate);
+    in_step = r->i_ss.rate / g;
+    out_step = r->o_ss.rate / g;
+
+    ratio = PA_MIN(1.0, (double) r->o_ss.rate / r->i_ss.rate);
+    cutoff = POLYPHASE_CUTOFF * ratio;
+    taps = PA_MIN(PA_ROUND_UP((unsigned) ceil(POLYPHASE_TAPS / ratio), 4U), POLYPHASE_MAX_TAPS);
+
+    if ((old_table = d->table))
+        old_taps = old_table->taps;
+
+    d->interpolate = out_step > POLYPHASE_MAX_EXACT_PHASES || out_step * taps > POLYPHASE_MAX_EXACT_SIZE;
+
+    if (d->interpolate)
+        d->table = table_get(POLYPHASE_INTERP_PHASES, POLYPHASE_INTERP_PHASES + 1, taps, cutoff);
+    else
+        d->table = table_get(out_step, out_step, taps, cutoff);
+
+    /* Only now, the table may not have changed */
+    if (old_table)
+        table_unref(old_table);
+
+    if (old_taps) {
+        unsigned c, n;
+
+        d->phase = (unsigned) ((uint64_t) d->phase * out_step / d->out_step);
+
+        /* Keep the center of the filter where it was */
+        if (d->pos + old_taps / 2 >= taps / 2)
+            d->pos = d->pos + old_taps / 2 - taps / 2;
+        else {
+            n = taps / 2 - old_taps / 2 - d->pos;
+            make_room(r, d, n);
+
+            for (c = 0; c < r->work_channels; c++) {
+                float *b = d->buf + c * d->buf_frames;
+
+                memmove(b + n, b, d->n_frames * sizeof(float));
+                memset(b, 0, n * sizeof(float));
+            }
+
+            d->n_frames += n;
+            d->pos = 0;
+        }
+    }
+
+    d->in_step = in_step;
+    d->out_step = out_step;
+}
+
+static unsigned polyphase_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
+    struct polyphase_data *d;
+    const struct polyphase_table *t;
+    pa_polyphase_dot_func_t dot;
+    unsigned channels, c, i, o_index = 0, drop;
+    const float *src;
+    float *dst;
+
+    pa_assert(r);
+    pa_assert(input);
+    pa_assert(output);
+    pa_assert(out_n_frames);
+
+    d = r->impl.data;
+    t = d->table;
+    dot = dot_func;
+    channels = r->work_channels;
+
+    /* All input goes into the history, split up by channel so that the
+     * filter runs over consecutive samples */
+    make_room(r, d, in_n_frames);
+
+    src = pa_memblock_acquire_chunk(input);
+
+    for (c = 0; c < channels; c++) {
+        float *b = d->buf + c * d->buf_frames + d->n_frames;
+
+        for (i = 0; i < in_n_frames; i++)
+            b[i] = src[i * channels + c];
+    }
+
+    pa_memblock_release(input->memblock);
+    d->n_frames += in_n_frames;
+
+    dst = pa_memblock_acquire_chunk(output);
+
+    while (d->pos + t->taps <= d->n_frames && o_index < *out_n_frames) {
+        float *o = dst + o_index * channels;
+
+        if (!d->interpolate) {
+            const float *h = t->rows + d->phase * t->taps;
+
+            for (c = 0; c < channels; c++)
+                o[c] = dot(d->buf + c * d->buf_frames + d->pos, h, t->taps);
+        } else {
+            uint64_t x = (uint64_t) d->phase * POLYPHASE_INTERP_PHASES;
+            const float *h = t->rows + (unsigned) (x / d->out_step) * t->taps;
+            float a = (float) (x % d->out_step) / (float) d->out_step;
+
+            for (c = 0; c < channels; c++) {
+                const float *b = d->buf + c * d->buf_frames + d->pos;
+                float y0 = dot(b, h, t->taps);
+                float y1 = dot(b, h + t->taps, t->taps);
+
+                o[c] = y0 + a * (y1 - y0);
+            }
+        }
+
+        o_index++;
+
+        d->phase += d->in_step;
+        d->pos += d->phase / d->out_step;
+        d->phase %= d->out_step;
+    }
+
+    pa_memblock_release(output->memblock);
+
+    *out_n_frames = o_index;
+
+    /* Forget what the filter has moved past */
+    drop = PA_MIN(d->pos > POLYPHASE_MARGIN ? d->pos - POLYPHASE_MARGIN : 0, d->n_frames);
+
+    if (drop > 0) {
+        for (c = 0; c < channels; c++) {
+            float *b = d->buf + c * d->buf_frames;
+
+            memmove(b, b + drop, (d->n_frames - drop) * sizeof(float));
+        }
+
+        d->pos -= drop;
+        d->n_frames -= drop;
+    }
+
+    return 0;
+}
+
+static void polyphase_reset(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+
+    d = r->impl.data;
+
+    /* Start out with silence in front of the filter, so that the first
+     * output frame is centered on the first input frame */
+    d->n_frames = 0;
+    make_room(r, d, POLYPHASE_MARGIN + d->table->taps / 2 - 1);
+    d->n_frames = POLYPHASE_MARGIN + d->table->taps / 2 - 1;
+
+    memset(d->buf, 0, d->buf_frames * r->work_channels * sizeof(float));
+
+    d->pos = POLYPHASE_MARGIN;
+    d->phase = 0;
+}
+
+static void polyphase_update_rates(pa_resampler *r) {
+    pa_assert(r);
+
+    setup_filter(r, r->impl.data);
+}
+
+static void polyphase_free(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+
+    d = r->impl.data;
+
+    table_unref(d->table);
+    pa_xfree(d->buf);
+    pa_xfree(d);
+}
+
+int pa_resampler_polyphase_init(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+    pa_assert(r->work_format == PA_SAMPLE_FLOAT32NE);
+
+    d = pa_xnew0(struct polyphase_data, 1);
+    setup_filter(r, d);
+
+    r->impl.free = polyphase_free;
+    r->impl.update_rates = polyphase_update_rates;
+    r->impl.resample = polyphase_resample;
+    r->impl.reset = polyphase_reset;
+    r->impl.data = d;
+
+    polyphase_reset(r);
+
+    pa_log_debug("Polyphase filter with %u taps, %u phases%s.", d->table->taps, d->out_step,
+                 d->interpolate ? " (interpolated)" : "");
+
+    return 0;
+}
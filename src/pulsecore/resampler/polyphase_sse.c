@@ -0,0 +1,67 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/resampler.h>
+
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+/* Like mix_sse.c, built with per-function target attributes */
+#include <immintrin.h>
+
+#define SSE_FUNC __attribute__((target("sse")))
+
+static SSE_FUNC float polyphase_dot_sse(const float *x, const float *h, unsigned n) {
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    unsigned i = 0;
+
+    /* The filter rows are aligned, the input history isn't */
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_load_ps(h + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_load_ps(h + i + 4)));
+    }
+
+    if (i < n)
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_load_ps(h + i)));
+
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+
+    return _mm_cvtss_f32(acc0);
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && ... */
+
+void pa_polyphase_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+    if (!(flags & PA_CPU_X86_SSE))
+        return;
+
+    pa_log_info("Initialising SSE optimized polyphase filter.");
+
+    pa_set_polyphase_dot_func(polyphase_dot_sse);
+#endif
+}
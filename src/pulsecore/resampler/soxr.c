@@ -24,11 +24,30 @@
 #include <stddef.h>
 #include <soxr.h>
 
+#include <pulse/xmalloc.h>
+
 #include <pulsecore/resampler.h>
 
+/* In variable rate mode the context is created for the largest io ratio
+ * we expect, and the actual ratio is slewed to within that, so that
+ * drift compensation never has to start over. Past that, we re-create
+ * the context. */
+#define VR_RATIO_HEADROOM 1.25
+#define VR_SLEW_MSEC 50
+
+struct soxr_data {
+    soxr_t state;
+    bool variable_rate;
+    double max_io_ratio;
+};
+
+static double io_ratio(pa_resampler *r) {
+    return (double) r->i_ss.rate / (double) r->o_ss.rate;
+}
+
 static unsigned resampler_soxr_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames,
                                         pa_memchunk *output, unsigned *out_n_frames) {
-    soxr_t state;
+    struct soxr_data *soxr_data;
     void *in, *out;
     size_t consumed = 0, produced = 0;
 
@@ -37,13 +56,13 @@ static unsigned resampler_soxr_resample(pa_resampler *r, const pa_memchunk *inpu
     pa_assert(output);
     pa_assert(out_n_frames);
 
-    state = r->impl.data;
-    pa_assert(state);
+    soxr_data = r->impl.data;
+    pa_assert(soxr_data->state);
 
     in = pa_memblock_acquire_chunk(input);
     out = pa_memblock_acquire_chunk(output);
 
-    pa_assert_se(soxr_process(state, in, in_n_frames, &consumed, out, *out_n_frames, &produced) == 0);
+    pa_assert_se(soxr_process(soxr_data->state, in, in_n_frames, &consumed, out, *out_n_frames, &produced) == 0);
 
     pa_memblock_release(input->memblock);
     pa_memblock_release(output->memblock);
@@ -53,62 +72,7 @@ static unsigned resampler_soxr_resample(pa_resampler *r, const pa_memchunk *inpu
     return in_n_frames - consumed;
 }
 
-static void resampler_soxr_free(pa_resampler *r) {
-    pa_assert(r);
-
-    if (!r->impl.data)
-        return;
-
-    soxr_delete(r->impl.data);
-    r->impl.data = NULL;
-}
-
-static void resampler_soxr_reset(pa_resampler *r) {
-#if SOXR_THIS_VERSION >= SOXR_VERSION(0, 1, 2)
-    pa_assert(r);
-
-    soxr_clear(r->impl.data);
-#else
-    /* With libsoxr prior to 0.1.2 soxr_clear() makes soxr_process() crash afterwards,
-     * so don't use this function and re-create the context instead. */
-    soxr_t old_state;
-
-    pa_assert(r);
-
-    old_state = r->impl.data;
-    r->impl.data = NULL;
-
-    if (pa_resampler_soxr_init(r) == 0) {
-        if (old_state)
-            soxr_delete(old_state);
-    } else {
-        r->impl.data = old_state;
-        pa_log_error("Failed to reset libsoxr context");
-    }
-#endif
-}
-
-static void resampler_soxr_update_rates(pa_resampler *r) {
-    soxr_t old_state;
-
-    pa_assert(r);
-
-    /* There is no update method in libsoxr,
-     * so just re-create the resampler context */
-
-    old_state = r->impl.data;
-    r->impl.data = NULL;
-
-    if (pa_resampler_soxr_init(r) == 0) {
-        if (old_state)
-            soxr_delete(old_state);
-    } else {
-        r->impl.data = old_state;
-        pa_log_error("Failed to update libsoxr sample rates");
-    }
-}
-
-int pa_resampler_soxr_init(pa_resampler *r) {
+static soxr_t create_state(pa_resampler *r, double max_io_ratio) {
     soxr_t state;
     soxr_datatype_t io_format;
     soxr_io_spec_t io_spec;
@@ -117,8 +81,6 @@ int pa_resampler_soxr_init(pa_resampler *r) {
     soxr_quality_spec_t quality;
     soxr_error_t err = NULL;
 
-    pa_assert(r);
-
     switch (r->work_format) {
         case PA_SAMPLE_S16NE:
             io_format = SOXR_INT16_I;
@@ -150,11 +112,123 @@ int pa_resampler_soxr_init(pa_resampler *r) {
             pa_assert_not_reached();
     }
 
-    quality = soxr_quality_spec(quality_recipe, 0);
+    if (max_io_ratio > 0) {
+        /* For variable rate, soxr wants the largest io ratio in place of
+         * the rates, and the actual ratio set separately */
+        quality = soxr_quality_spec(quality_recipe, SOXR_VR);
+        state = soxr_create(max_io_ratio, 1, r->work_channels, &err, &io_spec, &quality, &runtime_spec);
+
+        /* Not every libsoxr has its variable rate engine for every
+         * quality, HQ is the one that is always there */
+        if (!state && (quality_recipe & ~SOXR_LINEAR_PHASE) != SOXR_HQ) {
+            pa_log_info("libsoxr can't do variable rate at this quality (%s), using HQ.", (err ? err : "[unknown error]"));
+            err = NULL;
+            quality = soxr_quality_spec(SOXR_HQ | SOXR_LINEAR_PHASE, SOXR_VR);
+            state = soxr_create(max_io_ratio, 1, r->work_channels, &err, &io_spec, &quality, &runtime_spec);
+        }
+
+        if (state)
+            soxr_set_io_ratio(state, io_ratio(r), 0);
+    } else {
+        quality = soxr_quality_spec(quality_recipe, 0);
+        state = soxr_create(r->i_ss.rate, r->o_ss.rate, r->work_channels, &err, &io_spec, &quality, &runtime_spec);
+    }
 
-    state = soxr_create(r->i_ss.rate, r->o_ss.rate, r->work_channels, &err, &io_spec, &quality, &runtime_spec);
-    if (!state) {
+    if (!state)
         pa_log_error("Failed to create libsoxr resampler context: %s.", (err ? err : "[unknown error]"));
+
+    return state;
+}
+
+static void resampler_soxr_free(pa_resampler *r) {
+    struct soxr_data *soxr_data;
+
+    pa_assert(r);
+
+    if (!(soxr_data = r->impl.data))
+        return;
+
+    if (soxr_data->state)
+        soxr_delete(soxr_data->state);
+
+    pa_xfree(soxr_data);
+    r->impl.data = NULL;
+}
+
+/* Replaces the context with a new one for the current rates, keeps the
+ * old one on failure */
+static int recreate_state(pa_resampler *r) {
+    struct soxr_data *soxr_data = r->impl.data;
+    double max_io_ratio = 0;
+    soxr_t state;
+
+    if (soxr_data->variable_rate)
+        max_io_ratio = io_ratio(r) * VR_RATIO_HEADROOM;
+
+    if (!(state = create_state(r, max_io_ratio)))
+        return -1;
+
+    if (soxr_data->state)
+        soxr_delete(soxr_data->state);
+
+    soxr_data->state = state;
+    soxr_data->max_io_ratio = max_io_ratio;
+
+    return 0;
+}
+
+static void resampler_soxr_reset(pa_resampler *r) {
+    struct soxr_data *soxr_data;
+
+    pa_assert(r);
+
+    soxr_data = r->impl.data;
+
+#if SOXR_THIS_VERSION >= SOXR_VERSION(0, 1, 2)
+    soxr_clear(soxr_data->state);
+
+    if (soxr_data->variable_rate)
+        soxr_set_io_ratio(soxr_data->state, io_ratio(r), 0);
+#else
+    /* With libsoxr prior to 0.1.2 soxr_clear() makes soxr_process() crash afterwards,
+     * so don't use this function and re-create the context instead. */
+    if (recreate_state(r) < 0)
+        pa_log_error("Failed to reset libsoxr context");
+#endif
+}
+
+static void resampler_soxr_update_rates(pa_resampler *r) {
+    struct soxr_data *soxr_data;
+    double ratio;
+
+    pa_assert(r);
+
+    soxr_data = r->impl.data;
+    ratio = io_ratio(r);
+
+    /* Within the ratio the context was made for, glide over to the new
+     * one, without dropping what is buffered */
+    if (soxr_data->variable_rate && ratio <= soxr_data->max_io_ratio) {
+        soxr_set_io_ratio(soxr_data->state, ratio, (size_t) r->o_ss.rate * VR_SLEW_MSEC / 1000);
+        return;
+    }
+
+    if (recreate_state(r) < 0)
+        pa_log_error("Failed to update libsoxr sample rates");
+}
+
+int pa_resampler_soxr_init(pa_resampler *r) {
+    struct soxr_data *soxr_data;
+
+    pa_assert(r);
+
+    soxr_data = pa_xnew0(struct soxr_data, 1);
+    soxr_data->variable_rate = !!(r->flags & PA_RESAMPLER_VARIABLE_RATE);
+    r->impl.data = soxr_data;
+
+    if (recreate_state(r) < 0) {
+        pa_xfree(soxr_data);
+        r->impl.data = NULL;
         return -1;
     }
 
@@ -162,7 +236,6 @@ int pa_resampler_soxr_init(pa_resampler *r) {
     r->impl.reset = resampler_soxr_reset;
     r->impl.update_rates = resampler_soxr_update_rates;
     r->impl.resample = resampler_soxr_resample;
-    r->impl.data = state;
 
     return 0;
 }
@@ -0,0 +1,211 @@
+/***
+  This file is part of PulseAudio.
+
+  Copyright 2014 David Henningsson, Canonical Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include "ringbuffer.h"
+
+/* The cursors run from 0 to 2 * capacity - 1, so that a full buffer
+ * can be told apart from an empty one without sacrificing a byte. */
+
+static inline int wrap(const pa_ringbuffer *r, int i) {
+    return i >= 2 * r->capacity ? i - 2 * r->capacity : i;
+}
+
+static inline int offset(const pa_ringbuffer *r, int i) {
+    return i >= r->capacity ? i - r->capacity : i;
+}
+
+static inline int distance(const pa_ringbuffer *r, int from, int to) {
+    return to >= from ? to - from : to - from + 2 * r->capacity;
+}
+
+/* The indices are only ever written by a single side, so this can't
+ * fail. We use cmpxchg rather than a plain store for the full memory
+ * barrier, which makes sure the data itself is visible before the
+ * index that covers it. */
+static void publish(pa_atomic_t *a, int old_i, int new_i) {
+    pa_assert_se(pa_atomic_cmpxchg(a, old_i, new_i));
+}
+
+void pa_ringbuffer_init(pa_ringbuffer *r, pa_atomic_t *count, pa_ringbuffer_indices *indices, uint8_t *memory, int capacity) {
+    pa_assert(r);
+    pa_assert(!count != !indices);
+    pa_assert(memory);
+    pa_assert(capacity > 0);
+
+    pa_zero(*r);
+    r->count = count;
+    r->indices = indices;
+    r->memory = memory;
+    r->capacity = capacity;
+
+    if (indices) {
+        r->reader.index = r->writer.peer = pa_atomic_load(&indices->read_index);
+        r->writer.index = r->reader.peer = pa_atomic_load(&indices->write_index);
+
+        pa_assert(r->reader.index < 2 * capacity);
+        pa_assert(r->writer.index < 2 * capacity);
+    }
+}
+
+pa_ringbuffer *pa_ringbuffer_new(int capacity) {
+    pa_ringbuffer *r;
+    pa_ringbuffer_indices *indices;
+
+    pa_assert(capacity > 0);
+
+    r = pa_xnew(pa_ringbuffer, 1);
+    indices = pa_xmalloc(PA_ALIGN(sizeof(pa_ringbuffer_indices)) + (size_t) capacity);
+    pa_zero(*indices);
+
+    pa_ringbuffer_init(r, NULL, indices, (uint8_t*) indices + PA_ALIGN(sizeof(pa_ringbuffer_indices)), capacity);
+
+    return r;
+}
+
+void pa_ringbuffer_free(pa_ringbuffer *r) {
+    pa_assert(r);
+
+    /* Only ringbuffers from pa_ringbuffer_new() own their memory */
+    pa_assert(r->indices);
+    pa_assert(r->memory == (uint8_t*) r->indices + PA_ALIGN(sizeof(pa_ringbuffer_indices)));
+
+    pa_xfree(r->indices);
+    pa_xfree(r);
+}
+
+void *pa_ringbuffer_peek(pa_ringbuffer *r, int *count) {
+    int c, o;
+
+    pa_assert(r);
+    pa_assert(count);
+
+    if (r->count)
+        c = pa_atomic_load(r->count) - r->reader.pending;
+    else {
+        c = distance(r, r->reader.index, r->reader.peer);
+
+        /* Only look at the writer's cache line once we have consumed
+         * everything we knew about. */
+        if (c == 0) {
+            r->reader.peer = pa_atomic_load(&r->indices->write_index);
+            c = distance(r, r->reader.index, r->reader.peer);
+        }
+    }
+
+    o = offset(r, r->reader.index);
+    *count = PA_MIN(c, r->capacity - o);
+
+    return r->memory + o;
+}
+
+void pa_ringbuffer_drop(pa_ringbuffer *r, int count) {
+    pa_assert(r);
+    pa_assert(count >= 0);
+    pa_assert(r->reader.pending + count <= r->capacity);
+
+    r->reader.index = wrap(r, r->reader.index + count);
+    r->reader.pending += count;
+}
+
+bool pa_ringbuffer_commit_read(pa_ringbuffer *r) {
+    int n;
+
+    pa_assert(r);
+
+    if ((n = r->reader.pending) == 0)
+        return false;
+
+    r->reader.pending = 0;
+
+    if (r->count)
+        return pa_atomic_sub(r->count, n) >= r->capacity;
+
+    publish(&r->indices->read_index, wrap(r, r->reader.index - n + 2 * r->capacity), r->reader.index);
+
+    /* This load has to come after publishing our index: either the
+     * writer sees the space we just freed, or we see that it filled
+     * up the buffer and needs to be woken up. */
+    r->reader.peer = pa_atomic_load(&r->indices->write_index);
+
+    return distance(r, r->reader.index, r->reader.peer) + n >= r->capacity;
+}
+
+void *pa_ringbuffer_begin_write(pa_ringbuffer *r, int *count) {
+    int c, o;
+
+    pa_assert(r);
+    pa_assert(count);
+
+    if (r->count) {
+        c = r->capacity - pa_atomic_load(r->count) - r->writer.pending;
+
+        if (c == 0 && r->writer.pending > 0) {
+            pa_ringbuffer_commit_write(r);
+            c = r->capacity - pa_atomic_load(r->count);
+        }
+    } else {
+        c = r->capacity - distance(r, r->writer.peer, r->writer.index);
+
+        /* Before concluding that the buffer is full, publish what we
+         * have, so that the reader is guaranteed to notice that it is
+         * full when it frees space next (see
+         * pa_ringbuffer_commit_read()). */
+        if (c == 0) {
+            pa_ringbuffer_commit_write(r);
+            r->writer.peer = pa_atomic_load(&r->indices->read_index);
+            c = r->capacity - distance(r, r->writer.peer, r->writer.index);
+        }
+    }
+
+    o = offset(r, r->writer.index);
+    *count = PA_MIN(c, r->capacity - o);
+
+    return r->memory + o;
+}
+
+void pa_ringbuffer_end_write(pa_ringbuffer *r, int count) {
+    pa_assert(r);
+    pa_assert(count >= 0);
+    pa_assert(r->writer.pending + count <= r->capacity);
+
+    r->writer.index = wrap(r, r->writer.index + count);
+    r->writer.pending += count;
+}
+
+void pa_ringbuffer_commit_write(pa_ringbuffer *r) {
+    int n;
+
+    pa_assert(r);
+
+    if ((n = r->writer.pending) == 0)
+        return;
+
+    r->writer.pending = 0;
+
+    if (r->count)
+        pa_atomic_add(r->count, n);
+    else
+        publish(&r->indices->write_index, wrap(r, r->writer.index - n + 2 * r->capacity), r->writer.index);
+}
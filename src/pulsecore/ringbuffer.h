@@ -0,0 +1,105 @@
+#ifndef foopulseringbufferhfoo
+#define foopulseringbufferhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  Copyright 2014 David Henningsson, Canonical Ltd.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+/* A lock-free single-reader/single-writer byte ringbuffer. The
+ * control data and the buffer memory may live in shared memory, so
+ * that the two sides can be in different processes.
+ *
+ * Both sides work on private cursors and only publish them to the
+ * other side on pa_ringbuffer_commit_read()/_commit_write(), so a
+ * batch of drops or writes costs a single atomic operation.
+ *
+ * Two layouts of the shared control data are supported: the split
+ * one, where the read and the write index live in separate cache
+ * lines and are each only ever written by one side, and the legacy
+ * one, where both sides update a single shared byte count. The
+ * latter is what srbchannel peers speaking protocol < 33 expect. */
+
+#define PA_RINGBUFFER_CACHELINE 64
+
+/* Shared control data for the split layout. The padding keeps each
+ * index in a cache line of its own, regardless of how the structure
+ * itself is aligned. Don't change its layout, it is part of the
+ * native protocol. */
+typedef struct pa_ringbuffer_indices {
+    uint8_t _pad0[PA_RINGBUFFER_CACHELINE];
+    pa_atomic_t write_index;
+    uint8_t _pad1[PA_RINGBUFFER_CACHELINE - sizeof(pa_atomic_t)];
+    pa_atomic_t read_index;
+    uint8_t _pad2[PA_RINGBUFFER_CACHELINE - sizeof(pa_atomic_t)];
+} pa_ringbuffer_indices;
+
+typedef struct pa_ringbuffer_cursor {
+    int index;   /* Our own position, in [0, 2 * capacity) */
+    int peer;    /* Last seen position of the other side */
+    int pending; /* Bytes consumed/produced but not yet committed */
+    uint8_t _pad[PA_RINGBUFFER_CACHELINE - 3 * sizeof(int)];
+} pa_ringbuffer_cursor;
+
+typedef struct pa_ringbuffer {
+    pa_atomic_t *count;             /* Legacy layout, or NULL */
+    pa_ringbuffer_indices *indices; /* Split layout, or NULL */
+    int capacity;
+    uint8_t *memory;
+
+    /* Each cursor is only touched by its own side, so that a
+     * ringbuffer struct may be shared by two threads as well. */
+    pa_ringbuffer_cursor reader;
+    pa_ringbuffer_cursor writer;
+} pa_ringbuffer;
+
+/* Set up a ringbuffer on top of existing memory, using either a
+ * shared count or shared indices. Exactly one of them must be
+ * non-NULL. When attaching to a ringbuffer that is already in use the
+ * cursors are picked up from the shared control data. */
+void pa_ringbuffer_init(pa_ringbuffer *r, pa_atomic_t *count, pa_ringbuffer_indices *indices, uint8_t *memory, int capacity);
+
+/* Allocate a private, split layout ringbuffer, e.g. for use between
+ * two threads of the same process. */
+pa_ringbuffer *pa_ringbuffer_new(int capacity);
+void pa_ringbuffer_free(pa_ringbuffer *r);
+
+/* For the reading side. pa_ringbuffer_peek() returns a pointer
+ * to the contiguous readable data and stores its length in
+ * *count. pa_ringbuffer_drop() gives back the first count bytes of
+ * it, but the other side will only see that space after
+ * pa_ringbuffer_commit_read(). That returns true if the buffer was
+ * completely full before the commit, i.e. when the writer might be
+ * waiting for space. */
+void *pa_ringbuffer_peek(pa_ringbuffer *r, int *count);
+void pa_ringbuffer_drop(pa_ringbuffer *r, int count);
+bool pa_ringbuffer_commit_read(pa_ringbuffer *r);
+
+/* For the writing side. pa_ringbuffer_begin_write() returns a
+ * pointer to contiguous free space and stores its length in
+ * *count. Data passed to pa_ringbuffer_end_write() becomes visible to
+ * the reader on pa_ringbuffer_commit_write(). */
+void *pa_ringbuffer_begin_write(pa_ringbuffer *r, int *count);
+void pa_ringbuffer_end_write(pa_ringbuffer *r, int count);
+void pa_ringbuffer_commit_write(pa_ringbuffer *r);
+
+#endif
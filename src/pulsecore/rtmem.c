@@ -0,0 +1,195 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/thread.h>
+
+#include "rtmem.h"
+
+/* How much of the stack to fault in. The IO threads don't recurse and
+ * keep their buffers on the heap, this is plenty for them. */
+#define RTMEM_STACK_SIZE (64 * 1024)
+
+struct rtmem_thread {
+    pid_t tid;
+    char thread_name[32];
+
+    /* The thread's fault counters when it became real-time */
+    unsigned long minflt, majflt;
+
+    /* Set when the thread is gone */
+    pa_atomic_t dead;
+
+    PA_LLIST_FIELDS(struct rtmem_thread);
+};
+
+static void thread_release(void *p);
+
+PA_STATIC_TLS_DECLARE(rtmem_thread, thread_release);
+
+/* Protects the list of threads */
+static pa_static_mutex threads_mutex = PA_STATIC_MUTEX_INIT;
+static PA_LLIST_HEAD(struct rtmem_thread, threads) = NULL;
+
+/* Called when a real-time thread exits */
+static void thread_release(void *p) {
+    struct rtmem_thread *t = p;
+
+    pa_atomic_store(&t->dead, 1);
+}
+
+/* The kernel counts faults per thread, but getrusage() only tells the
+ * calling thread about its own. /proc can be read from any thread. */
+static int read_faults(pid_t tid, unsigned long *minflt, unsigned long *majflt) {
+#ifdef __linux__
+    char fn[64], line[512], *p;
+    FILE *f;
+    bool good;
+
+    pa_snprintf(fn, sizeof(fn), "/proc/self/task/%lu/stat", (unsigned long) tid);
+
+    if (!(f = pa_fopen_cloexec(fn, "r")))
+        return -1;
+
+    good = fgets(line, sizeof(line), f) != NULL;
+    fclose(f);
+
+    /* The thread name is in parentheses and may contain spaces, the
+     * fields we want come after it */
+    if (!good || !(p = strrchr(line, ')')))
+        return -1;
+
+    if (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %lu %*u %lu", minflt, majflt) != 2)
+        return -1;
+
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static void prefault_stack(void) {
+    volatile uint8_t stack[RTMEM_STACK_SIZE];
+    const size_t page_size = pa_page_size();
+    size_t i;
+
+    for (i = 0; i < sizeof(stack); i += page_size)
+        stack[i] = 0;
+
+#if defined(HAVE_SYS_MMAN_H) && !defined(__ANDROID__)
+    /* Locked pages stay in memory even with lock-memory off. The memlock
+     * limit is often too low for this, that's fine, we still faulted
+     * them in. */
+    if (mlock(PA_PAGE_ALIGN_PTR((const uint8_t *) stack + page_size - 1), sizeof(stack) - page_size) < 0)
+        pa_log_debug("Failed to lock real-time thread stack: %s", pa_cstrerror(errno));
+#endif
+}
+
+/* Called with threads_mutex held */
+static void remove_dead(void) {
+    struct rtmem_thread *t, *n;
+
+    /* The threads don't touch their entries anymore once they are
+     * marked dead */
+    for (t = threads; t; t = n) {
+        n = t->next;
+
+        if (pa_atomic_load(&t->dead)) {
+            PA_LLIST_REMOVE(struct rtmem_thread, threads, t);
+            pa_xfree(t);
+        }
+    }
+}
+
+void pa_rtmem_enter(void) {
+    struct rtmem_thread *t;
+    pa_mutex *m;
+
+    prefault_stack();
+
+    if (PA_STATIC_TLS_GET(rtmem_thread))
+        return;
+
+    t = pa_xnew0(struct rtmem_thread, 1);
+
+#ifdef __linux__
+    t->tid = (pid_t) syscall(SYS_gettid);
+#endif
+
+    if (read_faults(t->tid, &t->minflt, &t->majflt) < 0) {
+        pa_xfree(t);
+        return;
+    }
+
+    pa_strlcpy(t->thread_name, pa_strnull(pa_thread_get_name(pa_thread_self())), sizeof(t->thread_name));
+
+    m = pa_static_mutex_get(&threads_mutex, false, false);
+    pa_mutex_lock(m);
+    remove_dead();
+    PA_LLIST_PREPEND(struct rtmem_thread, threads, t);
+    pa_mutex_unlock(m);
+
+    PA_STATIC_TLS_SET(rtmem_thread, t);
+}
+
+void pa_rtmem_dump(pa_strbuf *buf) {
+    struct rtmem_thread *t;
+    pa_mutex *m;
+
+    pa_assert(buf);
+
+    m = pa_static_mutex_get(&threads_mutex, false, false);
+    pa_mutex_lock(m);
+
+    remove_dead();
+
+    for (t = threads; t; t = t->next) {
+        unsigned long minflt, majflt;
+
+        if (read_faults(t->tid, &minflt, &majflt) < 0)
+            continue;
+
+        pa_strbuf_printf(buf, "Page faults in real-time thread %s: %lu minor, %lu major.\n",
+                         t->thread_name, minflt - t->minflt, majflt - t->majflt);
+    }
+
+    pa_mutex_unlock(m);
+}
@@ -0,0 +1,38 @@
+#ifndef foopulsecorertmemhfoo
+#define foopulsecorertmemhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulsecore/macro.h>
+#include <pulsecore/strbuf.h>
+
+/* Keeps page faults out of the real-time threads, and counts the ones
+ * that happen anyway. The memory pools are taken care of by the
+ * shm-prefault and lock-memory options, this covers the threads'
+ * stacks and gives a way to check that it all worked. */
+
+/* Faults in (and locks, if the memlock limit allows it) the top of the
+ * calling thread's stack, and starts counting its page faults. Called
+ * by pa_make_realtime(). */
+void pa_rtmem_enter(void);
+
+/* Writes the page faults each real-time thread took since it became
+ * real-time */
+void pa_rtmem_dump(pa_strbuf *buf);
+
+#endif
@@ -26,6 +26,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H) && defined(HAVE_CLOCK_GETTIME)
+#define USE_EPOLL 1
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 
 #include <pulse/xmalloc.h>
 #include <pulse/timeval.h>
@@ -37,13 +45,41 @@
 #include <pulsecore/llist.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/trace.h>
 #include <pulsecore/ratelimit.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/seqlock.h>
 #include <pulse/rtclock.h>
 
 #include "rtpoll.h"
 
 /* #define DEBUG_TIMING */
 
+/* How many messages to dispatch from an asyncmsgq at most before
+ * returning to the thread loop, so that a flood of them doesn't delay
+ * rendering for too long */
+#define ASYNCMSGQ_READ_BATCH_MAX 16
+
+#ifdef USE_EPOLL
+/* What we told epoll about a single pollfd of an item. The pollfd arrays
+ * stay the interface to the users, before sleeping they are compared with
+ * this and epoll is only updated for the entries that changed. */
+struct rtpoll_epoll_fd {
+    pa_rtpoll_item *item;
+    unsigned idx;
+
+    int fd;
+    short events;
+
+    /* 0 if not registered, otherwise unique for each registration, so that
+     * we can detect events for registrations we don't know anymore */
+    uint32_t tag;
+};
+
+#define EPOLL_TIMER_DATA UINT64_MAX
+#endif
+
 struct pa_rtpoll {
     struct pollfd *pollfd, *pollfd2;
     unsigned n_pollfd_alloc, n_pollfd_used;
@@ -57,11 +93,32 @@ struct pa_rtpoll {
     bool quit:1;
     bool timer_elapsed:1;
 
+#ifdef USE_EPOLL
+    /* -1 if we use ppoll() */
+    int epoll_fd;
+    int timer_fd;
+
+    struct epoll_event *epoll_events;
+    unsigned n_epoll_events_alloc;
+
+    /* fd + 1 -> struct rtpoll_epoll_fd */
+    pa_hashmap *epoll_fds;
+    uint32_t epoll_tag;
+
+    struct timeval timer_armed;
+    bool timer_is_armed:1;
+#endif
+
 #ifdef DEBUG_TIMING
     pa_usec_t timestamp;
     pa_usec_t slept, awake;
 #endif
 
+    /* Written by the thread running the loop, read by anyone */
+    pa_seqlock stats_lock;
+    pa_rtpoll_stats stats;
+    pa_usec_t stats_last_cpu, stats_last_wall;
+
     PA_LLIST_HEAD(pa_rtpoll_item, items);
 };
 
@@ -79,11 +136,66 @@ struct pa_rtpoll_item {
     void (*after_cb)(pa_rtpoll_item *i);
     void *userdata;
 
+#ifdef USE_EPOLL
+    struct rtpoll_epoll_fd *epoll_fds;
+#endif
+
     PA_LLIST_FIELDS(pa_rtpoll_item);
 };
 
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
+#ifdef USE_EPOLL
+static void epoll_init(pa_rtpoll *p) {
+    struct epoll_event ev;
+
+    /* We pass poll events to epoll and back unchanged */
+    pa_assert_cc(EPOLLIN == POLLIN && EPOLLOUT == POLLOUT && EPOLLPRI == POLLPRI &&
+                 EPOLLERR == POLLERR && EPOLLHUP == POLLHUP);
+
+    p->epoll_fd = p->timer_fd = -1;
+
+    if (getenv("PULSE_RTPOLL_NO_EPOLL"))
+        return;
+
+    if ((p->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        pa_log_warn("epoll_create1() failed, falling back to ppoll(): %s", pa_cstrerror(errno));
+        return;
+    }
+
+    if ((p->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0) {
+        pa_log_warn("timerfd_create() failed, falling back to ppoll(): %s", pa_cstrerror(errno));
+        pa_close(p->epoll_fd);
+        p->epoll_fd = -1;
+        return;
+    }
+
+    pa_zero(ev);
+    ev.events = EPOLLIN;
+    ev.data.u64 = EPOLL_TIMER_DATA;
+    pa_assert_se(epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->timer_fd, &ev) == 0);
+
+    p->epoll_fds = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    p->n_epoll_events_alloc = 32;
+    p->epoll_events = pa_xnew(struct epoll_event, p->n_epoll_events_alloc);
+}
+
+static void epoll_done(pa_rtpoll *p) {
+    if (p->epoll_fd < 0)
+        return;
+
+    pa_close(p->timer_fd);
+    pa_close(p->epoll_fd);
+    p->timer_fd = p->epoll_fd = -1;
+
+    pa_hashmap_free(p->epoll_fds);
+    p->epoll_fds = NULL;
+
+    pa_xfree(p->epoll_events);
+    p->epoll_events = NULL;
+}
+#endif
+
 pa_rtpoll *pa_rtpoll_new(void) {
     pa_rtpoll *p;
 
@@ -93,6 +205,10 @@ pa_rtpoll *pa_rtpoll_new(void) {
     p->pollfd = pa_xnew(struct pollfd, p->n_pollfd_alloc);
     p->pollfd2 = pa_xnew(struct pollfd, p->n_pollfd_alloc);
 
+#ifdef USE_EPOLL
+    epoll_init(p);
+#endif
+
 #ifdef DEBUG_TIMING
     p->timestamp = pa_rtclock_now();
 #endif
@@ -100,6 +216,56 @@ pa_rtpoll *pa_rtpoll_new(void) {
     return p;
 }
 
+/* Returns 0 if the CPU time of the calling thread can't be read */
+static pa_usec_t thread_cpu_now(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return pa_timespec_load(&ts);
+#endif
+
+    return 0;
+}
+
+/* Accounts the CPU time the thread used since the previous iteration:
+ * that is the work done by the callbacks and by whoever runs the loop. */
+static void update_stats(pa_rtpoll *p) {
+    pa_usec_t cpu, wall, used;
+
+    if ((cpu = thread_cpu_now()) == 0)
+        return;
+
+    wall = pa_rtclock_now();
+
+    if (p->stats_last_wall > 0) {
+        used = cpu - p->stats_last_cpu;
+
+        pa_seqlock_write_begin(&p->stats_lock);
+        p->stats.iterations++;
+        p->stats.cpu_usec += used;
+        p->stats.wall_usec += wall - p->stats_last_wall;
+        if (used > p->stats.max_cpu_usec)
+            p->stats.max_cpu_usec = used;
+        pa_seqlock_write_end(&p->stats_lock);
+    }
+
+    p->stats_last_cpu = cpu;
+    p->stats_last_wall = wall;
+}
+
+void pa_rtpoll_get_stats(pa_rtpoll *p, pa_rtpoll_stats *stats) {
+    unsigned seq;
+
+    pa_assert(p);
+    pa_assert(stats);
+
+    do {
+        seq = pa_seqlock_read_begin(&p->stats_lock);
+        *stats = p->stats;
+    } while (pa_seqlock_read_retry(&p->stats_lock, seq));
+}
+
 static void rtpoll_rebuild(pa_rtpoll *p) {
 
     struct pollfd *e, *t;
@@ -145,6 +311,33 @@ static void rtpoll_rebuild(pa_rtpoll *p) {
         p->pollfd2 = pa_xrealloc(p->pollfd2, p->n_pollfd_alloc * sizeof(struct pollfd));
 }
 
+#ifdef USE_EPOLL
+static void epoll_fd_unregister(pa_rtpoll *p, struct rtpoll_epoll_fd *e) {
+    if (!e->tag)
+        return;
+
+    /* The fd might have been closed already, in which case the kernel
+     * dropped it for us */
+    (void) epoll_ctl(p->epoll_fd, EPOLL_CTL_DEL, e->fd, NULL);
+    pa_hashmap_remove(p->epoll_fds, PA_INT_TO_PTR(e->fd + 1));
+    e->tag = 0;
+}
+
+static void epoll_item_free(pa_rtpoll_item *i) {
+    unsigned k;
+
+    if (!i->epoll_fds)
+        return;
+
+    if (i->rtpoll->epoll_fd >= 0)
+        for (k = 0; k < i->n_pollfd; k++)
+            epoll_fd_unregister(i->rtpoll, &i->epoll_fds[k]);
+
+    pa_xfree(i->epoll_fds);
+    i->epoll_fds = NULL;
+}
+#endif
+
 static void rtpoll_item_destroy(pa_rtpoll_item *i) {
     pa_rtpoll *p;
 
@@ -154,6 +347,10 @@ static void rtpoll_item_destroy(pa_rtpoll_item *i) {
 
     PA_LLIST_REMOVE(pa_rtpoll_item, p->items, i);
 
+#ifdef USE_EPOLL
+    epoll_item_free(i);
+#endif
+
     p->n_pollfd_used -= i->n_pollfd;
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(items), i) < 0)
@@ -168,6 +365,10 @@ void pa_rtpoll_free(pa_rtpoll *p) {
     while (p->items)
         rtpoll_item_destroy(p->items);
 
+#ifdef USE_EPOLL
+    epoll_done(p);
+#endif
+
     pa_xfree(p->pollfd);
     pa_xfree(p->pollfd2);
 
@@ -201,6 +402,232 @@ static void reset_all_revents(pa_rtpoll *p) {
     }
 }
 
+#ifdef USE_EPOLL
+/* Throw away all registrations and start over with a fresh epoll set on
+ * the next iteration. Used when we get events we can't map back anymore,
+ * which happens if an fd was closed and reused while still registered. */
+static void epoll_reset(pa_rtpoll *p) {
+    pa_rtpoll_item *i;
+    unsigned k;
+    struct epoll_event ev;
+    int fd;
+
+    pa_log_debug("Resetting epoll set.");
+
+    for (i = p->items; i; i = i->next)
+        if (i->epoll_fds)
+            for (k = 0; k < i->n_pollfd; k++)
+                i->epoll_fds[k].tag = 0;
+
+    pa_hashmap_remove_all(p->epoll_fds);
+
+    if ((fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        pa_log_warn("epoll_create1() failed, falling back to ppoll(): %s", pa_cstrerror(errno));
+        epoll_done(p);
+        return;
+    }
+
+    pa_close(p->epoll_fd);
+    p->epoll_fd = fd;
+
+    pa_zero(ev);
+    ev.events = EPOLLIN;
+    ev.data.u64 = EPOLL_TIMER_DATA;
+    pa_assert_se(epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, p->timer_fd, &ev) == 0);
+}
+
+/* Bring the epoll set in line with the pollfd arrays. Returns the number of
+ * pollfds that ended up with revents set right away, -1 if epoll can't
+ * handle this set of fds and ppoll() needs to be used for this iteration,
+ * or -2 if we shouldn't bother with epoll anymore at all. */
+static int epoll_sync(pa_rtpoll *p) {
+    pa_rtpoll_item *i;
+    int ready = 0;
+    bool fallback = false;
+
+    for (i = p->items; i; i = i->next) {
+        unsigned k;
+
+        if (i->n_pollfd <= 0)
+            continue;
+
+        if (!i->epoll_fds) {
+            i->epoll_fds = pa_xnew0(struct rtpoll_epoll_fd, i->n_pollfd);
+
+            for (k = 0; k < i->n_pollfd; k++) {
+                i->epoll_fds[k].item = i;
+                i->epoll_fds[k].idx = k;
+            }
+        }
+
+        for (k = 0; k < i->n_pollfd; k++) {
+            struct pollfd *f = &i->pollfd[k];
+            struct rtpoll_epoll_fd *e = &i->epoll_fds[k];
+            struct rtpoll_epoll_fd *other;
+            struct epoll_event ev;
+
+            f->revents = 0;
+
+            if (e->tag && e->fd == f->fd && e->events == f->events)
+                continue;
+
+            if (e->tag && e->fd == f->fd) {
+                pa_zero(ev);
+                ev.events = (uint32_t) f->events;
+                ev.data.u64 = ((uint64_t) e->tag << 32) | (uint32_t) f->fd;
+
+                if (epoll_ctl(p->epoll_fd, EPOLL_CTL_MOD, f->fd, &ev) == 0) {
+                    e->events = f->events;
+                    continue;
+                }
+
+                /* Might have been closed and replaced in the meantime,
+                 * start from scratch */
+                pa_hashmap_remove(p->epoll_fds, PA_INT_TO_PTR(e->fd + 1));
+                e->tag = 0;
+            }
+
+            epoll_fd_unregister(p, e);
+
+            /* poll() ignores negative fds */
+            if (f->fd < 0)
+                continue;
+
+            /* epoll can only register every fd once, so if it shows up
+             * more than once, we fall back to ppoll() for now */
+            if ((other = pa_hashmap_get(p->epoll_fds, PA_INT_TO_PTR(f->fd + 1))) && other != e) {
+                fallback = true;
+                continue;
+            }
+
+            if (++p->epoll_tag == 0)
+                p->epoll_tag = 1;
+
+            pa_zero(ev);
+            ev.events = (uint32_t) f->events;
+            ev.data.u64 = ((uint64_t) p->epoll_tag << 32) | (uint32_t) f->fd;
+
+            if (epoll_ctl(p->epoll_fd, EPOLL_CTL_ADD, f->fd, &ev) < 0) {
+
+                if (errno == EBADF) {
+                    /* That's what poll() would tell us */
+                    f->revents = POLLNVAL;
+                    ready++;
+                    continue;
+                }
+
+                /* EPERM: something epoll can't watch, like a regular
+                 * file. Not worth the trouble, use ppoll() from now on. */
+                pa_log_debug("epoll_ctl() failed for fd %d, falling back to ppoll(): %s", f->fd, pa_cstrerror(errno));
+                return -2;
+            }
+
+            e->fd = f->fd;
+            e->events = f->events;
+            e->tag = p->epoll_tag;
+            pa_hashmap_put(p->epoll_fds, PA_INT_TO_PTR(e->fd + 1), e);
+        }
+    }
+
+    return fallback ? -1 : ready;
+}
+
+/* ready is the number of pollfds epoll_sync() already found to be ready,
+ * if there are any we don't sleep but still collect the others. */
+static int rtpoll_sleep_epoll(pa_rtpoll *p, const struct timeval *timeout, int ready) {
+    struct itimerspec its;
+    int r, n, k, timeout_ms;
+    bool timer_fired = false;
+
+    if (p->n_epoll_events_alloc < p->n_pollfd_used + 1) {
+        p->n_epoll_events_alloc = (p->n_pollfd_used + 1) * 2;
+        p->epoll_events = pa_xrealloc(p->epoll_events, p->n_epoll_events_alloc * sizeof(struct epoll_event));
+    }
+
+    /* The timer is absolute, so it fires right away if the time already
+     * passed. Only touch it if something changed. */
+    if (p->timer_enabled && !p->quit) {
+        if (!p->timer_is_armed || pa_timeval_cmp(&p->timer_armed, &p->next_elapse) != 0) {
+            pa_zero(its);
+            its.it_value.tv_sec = p->next_elapse.tv_sec;
+            its.it_value.tv_nsec = p->next_elapse.tv_usec * 1000;
+
+            /* A zero it_value would disarm the timer */
+            if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+                its.it_value.tv_nsec = 1;
+
+            pa_assert_se(timerfd_settime(p->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0);
+            p->timer_armed = p->next_elapse;
+            p->timer_is_armed = true;
+        }
+    } else if (p->timer_is_armed) {
+        pa_zero(its);
+        pa_assert_se(timerfd_settime(p->timer_fd, 0, &its, NULL) == 0);
+        p->timer_is_armed = false;
+    }
+
+    /* The timeout already passed, no need to wait for the timer */
+    if (ready > 0 || p->quit || (p->timer_enabled && timeout->tv_sec == 0 && timeout->tv_usec == 0))
+        timeout_ms = 0;
+    else
+        timeout_ms = -1;
+
+    if ((n = epoll_wait(p->epoll_fd, p->epoll_events, (int) p->n_epoll_events_alloc, timeout_ms)) < 0)
+        return ready > 0 ? ready : n;
+
+    r = ready;
+    for (k = 0; k < n; k++) {
+        struct epoll_event *ev = &p->epoll_events[k];
+        struct rtpoll_epoll_fd *e;
+        int fd;
+
+        if (ev->data.u64 == EPOLL_TIMER_DATA) {
+            uint64_t expirations;
+
+            (void) pa_read(p->timer_fd, &expirations, sizeof(expirations), NULL);
+            p->timer_is_armed = false;
+            timer_fired = true;
+            continue;
+        }
+
+        fd = (int) (uint32_t) ev->data.u64;
+
+        if (!(e = pa_hashmap_get(p->epoll_fds, PA_INT_TO_PTR(fd + 1))) ||
+            e->tag != (uint32_t) (ev->data.u64 >> 32)) {
+            epoll_reset(p);
+
+            /* Make this a spurious wakeup, everybody checks their state
+             * again and we sync up on the next iteration */
+            return r > 0 ? r : 1;
+        }
+
+        e->item->pollfd[e->idx].revents = (short) ev->events;
+        r++;
+    }
+
+    /* Like poll(), 0 means that the timeout elapsed and no fd is ready */
+    pa_assert(r > 0 || timer_fired || n == 0);
+    return r;
+}
+#endif
+
+static int rtpoll_sleep_poll(pa_rtpoll *p, const struct timeval *timeout) {
+    int r;
+
+#ifdef HAVE_PPOLL
+    {
+        struct timespec ts;
+        ts.tv_sec = timeout->tv_sec;
+        ts.tv_nsec = timeout->tv_usec * 1000;
+        r = ppoll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? &ts : NULL, NULL);
+    }
+#else
+    r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout->tv_sec*1000) + (timeout->tv_usec / 1000)) : -1);
+#endif
+
+    return r;
+}
+
 int pa_rtpoll_run(pa_rtpoll *p) {
     pa_rtpoll_item *i;
     int r = 0;
@@ -209,10 +636,14 @@ int pa_rtpoll_run(pa_rtpoll *p) {
     pa_assert(p);
     pa_assert(!p->running);
 
+    pa_trace_begin(PA_TRACE_RTPOLL_RUN, 0);
+
 #ifdef DEBUG_TIMING
     pa_log("rtpoll_run");
 #endif
 
+    update_stats(p);
+
     p->running = true;
     p->timer_elapsed = false;
 
@@ -306,19 +737,26 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #endif
 
     /* OK, now let's sleep */
-#ifdef HAVE_PPOLL
-    {
-        struct timespec ts;
-        ts.tv_sec = timeout.tv_sec;
-        ts.tv_nsec = timeout.tv_usec * 1000;
-        r = ppoll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? &ts : NULL, NULL);
-    }
-#else
-    r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout.tv_sec*1000) + (timeout.tv_usec / 1000)) : -1);
+    pa_trace_begin(PA_TRACE_RTPOLL_SLEEP, (int64_t) pa_timeval_load(&timeout));
+
+#ifdef USE_EPOLL
+    if (p->epoll_fd >= 0) {
+        if ((r = epoll_sync(p)) >= 0)
+            r = rtpoll_sleep_epoll(p, &timeout, r);
+        else {
+            if (r == -2)
+                epoll_done(p);
+
+            r = rtpoll_sleep_poll(p, &timeout);
+        }
+    } else
 #endif
+        r = rtpoll_sleep_poll(p, &timeout);
 
     p->timer_elapsed = r == 0;
 
+    pa_trace_end(PA_TRACE_RTPOLL_SLEEP, r);
+
 #ifdef DEBUG_TIMING
     {
         pa_usec_t now = pa_rtclock_now();
@@ -356,6 +794,8 @@ finish:
 
     p->running = false;
 
+    pa_trace_end(PA_TRACE_RTPOLL_RUN, r);
+
     if (p->scan_for_dead) {
         pa_rtpoll_item *n;
 
@@ -544,17 +984,24 @@ static void asyncmsgq_read_after(pa_rtpoll_item *i) {
 }
 
 static int asyncmsgq_read_work(pa_rtpoll_item *i) {
-    pa_msgobject *object;
-    int code;
-    void *data;
-    pa_memchunk chunk;
-    int64_t offset;
+    unsigned n;
 
     pa_assert(i);
 
-    if (pa_asyncmsgq_get(i->userdata, &object, &code, &data, &offset, &chunk, 0) == 0) {
+    /* Handle a bounded batch of messages at once, instead of going
+     * through a complete iteration of the thread loop for each of
+     * them. If a message handler removed us, stop right away. */
+    for (n = 0; n < ASYNCMSGQ_READ_BATCH_MAX && !i->dead; n++) {
+        pa_msgobject *object;
+        int code;
+        void *data;
+        pa_memchunk chunk;
+        int64_t offset;
         int ret;
 
+        if (pa_asyncmsgq_get(i->userdata, &object, &code, &data, &offset, &chunk, 0) < 0)
+            break;
+
         if (!object && code == PA_MESSAGE_SHUTDOWN) {
             pa_asyncmsgq_done(i->userdata, 0);
             /* Requests the loop to exit. Will cause the next iteration of
@@ -565,10 +1012,9 @@ static int asyncmsgq_read_work(pa_rtpoll_item *i) {
 
         ret = pa_asyncmsgq_dispatch(object, code, data, offset, &chunk);
         pa_asyncmsgq_done(i->userdata, ret);
-        return 1;
     }
 
-    return 0;
+    return n > 0;
 }
 
 pa_rtpoll_item *pa_rtpoll_item_new_asyncmsgq_read(pa_rtpoll *p, pa_rtpoll_priority_t prio, pa_asyncmsgq *q) {
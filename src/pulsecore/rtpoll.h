@@ -39,7 +39,15 @@
  * 3) It allows arbitrary functions to be run before entering the
  * actual poll() and after it.
  *
- * Only a single interval timer is supported. */
+ * Only a single interval timer is supported.
+ *
+ * On Linux the pollfds are kept registered with an epoll instance
+ * between iterations and the timer is a timerfd, so that an iteration
+ * only costs syscalls for the pollfds that actually changed. Changes
+ * are detected by comparing fd and events with what was registered
+ * last time, hence closing an fd and reopening another one under the
+ * same number in place is not noticed; clear pollfd->fd or free the
+ * item instead. Set $PULSE_RTPOLL_NO_EPOLL to force plain ppoll(). */
 
 typedef struct pa_rtpoll pa_rtpoll;
 typedef struct pa_rtpoll_item pa_rtpoll_item;
@@ -51,6 +59,15 @@ typedef enum pa_rtpoll_priority {
     PA_RTPOLL_NEVER  = INT_MAX,       /* For stuff that doesn't register any callbacks, but only fds to listen on */
 } pa_rtpoll_priority_t;
 
+/* CPU time used by the thread that runs the loop, sampled once per
+ * iteration. All zero where the thread CPU clock is not available. */
+typedef struct pa_rtpoll_stats {
+    uint64_t iterations;
+    pa_usec_t cpu_usec;       /* CPU time used */
+    pa_usec_t wall_usec;      /* Wall clock time over which cpu_usec was used */
+    pa_usec_t max_cpu_usec;   /* Most CPU time used in a single iteration */
+} pa_rtpoll_stats;
+
 pa_rtpoll *pa_rtpoll_new(void);
 void pa_rtpoll_free(pa_rtpoll *p);
 
@@ -68,6 +85,9 @@ void pa_rtpoll_set_timer_disabled(pa_rtpoll *p);
  * the last pa_rtpoll_run() invocation to finish */
 bool pa_rtpoll_timer_elapsed(pa_rtpoll *p);
 
+/* May be called from any thread */
+void pa_rtpoll_get_stats(pa_rtpoll *p, pa_rtpoll_stats *stats);
+
 /* A new fd wakeup item for pa_rtpoll */
 pa_rtpoll_item *pa_rtpoll_item_new(pa_rtpoll *p, pa_rtpoll_priority_t prio, unsigned n_fds);
 void pa_rtpoll_item_free(pa_rtpoll_item *i);
@@ -121,6 +121,91 @@ bool pa_frame_aligned(size_t l, const pa_sample_spec *ss) {
     return l % fs == 0;
 }
 
+/* Most callers deal with 16 or 32 bit samples. For these a typed loop,
+ * which the compiler can unroll, beats a memcpy() per sample by far. */
+#define INTERLEAVE_TYPED(type) \
+    do { \
+        for (c = 0; c < channels; c++) { \
+            const type *s = src[c]; \
+            type *d = (type *) dst + c; \
+            unsigned j; \
+            for (j = 0; j < n; j++, d += channels) \
+                *d = s[j]; \
+        } \
+    } while (0)
+
+#define DEINTERLEAVE_TYPED(type) \
+    do { \
+        for (c = 0; c < channels; c++) { \
+            const type *s = (const type *) src + c; \
+            type *d = dst[c]; \
+            unsigned j; \
+            for (j = 0; j < n; j++, s += channels) \
+                d[j] = *s; \
+        } \
+    } while (0)
+
+static void interleave_16(const void *src[], unsigned channels, void *dst, unsigned n) {
+    unsigned c;
+
+    INTERLEAVE_TYPED(uint16_t);
+}
+
+static void interleave_32(const void *src[], unsigned channels, void *dst, unsigned n) {
+    unsigned c;
+
+    INTERLEAVE_TYPED(uint32_t);
+}
+
+static void deinterleave_16(const void *src, void *dst[], unsigned channels, unsigned n) {
+    unsigned c;
+
+    DEINTERLEAVE_TYPED(uint16_t);
+}
+
+static void deinterleave_32(const void *src, void *dst[], unsigned channels, unsigned n) {
+    unsigned c;
+
+    DEINTERLEAVE_TYPED(uint32_t);
+}
+
+/* Indexed by sample size / 4, i.e. 0 for 16 bit and 1 for 32 bit samples */
+static pa_interleave_func_t interleave_table[2] = {
+    interleave_16,
+    interleave_32
+};
+
+static pa_deinterleave_func_t deinterleave_table[2] = {
+    deinterleave_16,
+    deinterleave_32
+};
+
+pa_interleave_func_t pa_get_interleave_func(size_t ss) {
+    pa_assert(ss == 2 || ss == 4);
+
+    return interleave_table[ss / 4];
+}
+
+void pa_set_interleave_func(size_t ss, pa_interleave_func_t func) {
+    pa_assert(ss == 2 || ss == 4);
+    pa_assert(func);
+
+    interleave_table[ss / 4] = func;
+}
+
+pa_deinterleave_func_t pa_get_deinterleave_func(size_t ss) {
+    pa_assert(ss == 2 || ss == 4);
+
+    return deinterleave_table[ss / 4];
+}
+
+void pa_set_deinterleave_func(size_t ss, pa_deinterleave_func_t func) {
+    pa_assert(ss == 2 || ss == 4);
+    pa_assert(func);
+
+    deinterleave_table[ss / 4] = func;
+}
+
 void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n) {
     unsigned c;
     size_t fs;
@@ -131,6 +216,16 @@ void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, u
     pa_assert(ss > 0);
     pa_assert(n > 0);
 
+    if (channels == 1) {
+        memcpy(dst, src[0], ss * n);
+        return;
+    }
+
+    if (ss == 2 || ss == 4) {
+        interleave_table[ss / 4](src, channels, dst, n);
+        return;
+    }
+
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -159,6 +254,16 @@ void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss,
     pa_assert(ss > 0);
     pa_assert(n > 0);
 
+    if (channels == 1) {
+        memcpy(dst[0], src, ss * n);
+        return;
+    }
+
+    if (ss == 2 || ss == 4) {
+        deinterleave_table[ss / 4](src, dst, channels, n);
+        return;
+    }
+
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -272,35 +377,57 @@ pa_memchunk* pa_silence_memchunk_get(pa_silence_cache *cache, pa_mempool *pool,
     return ret;
 }
 
-void pa_sample_clamp(pa_sample_format_t format, void *dst, size_t dstr, const void *src, size_t sstr, unsigned n) {
+static void sample_clamp_float32ne(void *dst, size_t dstr, const void *src, size_t sstr, unsigned n) {
     const float *s;
     float *d;
 
     s = src; d = dst;
 
+    for (; n > 0; n--) {
+        float f;
+
+        f = *s;
+        *d = PA_CLAMP_UNLIKELY(f, -1.0f, 1.0f);
+
+        s = (const float*) ((const uint8_t*) s + sstr);
+        d = (float*) ((uint8_t*) d + dstr);
+    }
+}
+
+static pa_sample_clamp_func_t sample_clamp_func = sample_clamp_float32ne;
+
+pa_sample_clamp_func_t pa_get_sample_clamp_func(void) {
+    return sample_clamp_func;
+}
+
+void pa_set_sample_clamp_func(pa_sample_clamp_func_t func) {
+    pa_assert(func);
+
+    sample_clamp_func = func;
+}
+
+void pa_sample_clamp(pa_sample_format_t format, void *dst, size_t dstr, const void *src, size_t sstr, unsigned n) {
+    const float *s;
+    float *d;
+
     if (format == PA_SAMPLE_FLOAT32NE) {
-        for (; n > 0; n--) {
-            float f;
+        sample_clamp_func(dst, dstr, src, sstr, n);
+        return;
+    }
 
-            f = *s;
-            *d = PA_CLAMP_UNLIKELY(f, -1.0f, 1.0f);
+    pa_assert(format == PA_SAMPLE_FLOAT32RE);
 
-            s = (const float*) ((const uint8_t*) s + sstr);
-            d = (float*) ((uint8_t*) d + dstr);
-        }
-    } else {
-        pa_assert(format == PA_SAMPLE_FLOAT32RE);
+    s = src; d = dst;
 
-        for (; n > 0; n--) {
-            float f;
+    for (; n > 0; n--) {
+        float f;
 
-            f = PA_READ_FLOAT32RE(s);
-            f = PA_CLAMP_UNLIKELY(f, -1.0f, 1.0f);
-            PA_WRITE_FLOAT32RE(d, f);
+        f = PA_READ_FLOAT32RE(s);
+        f = PA_CLAMP_UNLIKELY(f, -1.0f, 1.0f);
+        PA_WRITE_FLOAT32RE(d, f);
 
-            s = (const float*) ((const uint8_t*) s + sstr);
-            d = (float*) ((uint8_t*) d + dstr);
-        }
+        s = (const float*) ((const uint8_t*) s + sstr);
+        d = (float*) ((uint8_t*) d + dstr);
     }
 }
 
@@ -54,6 +54,23 @@ void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss,
 
 void pa_sample_clamp(pa_sample_format_t format, void *dst, size_t dstr, const void *src, size_t sstr, unsigned n);
 
+/* The implementations used by the above for 16 and 32 bit samples and for
+ * PA_SAMPLE_FLOAT32NE respectively, so that they can be replaced by
+ * optimized versions. These are called for any channel count > 1 and
+ * n > 0, and for any strides in case of the clamp function. */
+typedef void (*pa_interleave_func_t)(const void *src[], unsigned channels, void *dst, unsigned n);
+typedef void (*pa_deinterleave_func_t)(const void *src, void *dst[], unsigned channels, unsigned n);
+typedef void (*pa_sample_clamp_func_t)(void *dst, size_t dstr, const void *src, size_t sstr, unsigned n);
+
+pa_interleave_func_t pa_get_interleave_func(size_t ss);
+void pa_set_interleave_func(size_t ss, pa_interleave_func_t func);
+
+pa_deinterleave_func_t pa_get_deinterleave_func(size_t ss);
+void pa_set_deinterleave_func(size_t ss, pa_deinterleave_func_t func);
+
+pa_sample_clamp_func_t pa_get_sample_clamp_func(void);
+void pa_set_sample_clamp_func(pa_sample_clamp_func_t func);
+
 static inline int32_t pa_mult_s16_volume(int16_t v, int32_t cv) {
 #ifdef HAVE_FAST_64BIT_OPERATIONS
     /* Multiply with 64 bit integers on 64 bit platforms */
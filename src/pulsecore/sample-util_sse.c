@@ -0,0 +1,353 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+#include "sample-util.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+/* Like mix_sse.c, built with per-function target attributes */
+#include <immintrin.h>
+
+#define SSE2_FUNC __attribute__((target("sse2")))
+
+static pa_interleave_func_t fallback_interleave_16;
+static pa_interleave_func_t fallback_interleave_32;
+static pa_deinterleave_func_t fallback_deinterleave_16;
+static pa_deinterleave_func_t fallback_deinterleave_32;
+static pa_sample_clamp_func_t fallback_clamp;
+
+/* The vector loops below handle the common channel counts by working on
+ * groups of 4 or 2 channels, whose samples are transposed in registers.
+ * Frames are moved as a whole when a group makes up the entire frame,
+ * and with 64 bit loads and stores otherwise. Other channel counts
+ * (and 6 channel 16 bit samples, where a pair of channels is only 32 bit
+ * wide) and the frames left over at the end take the C version. Only
+ * shuffles are involved, so the results are bit exact for any data. */
+
+static void interleave_tail(pa_interleave_func_t fallback, size_t ss, const void *src[], unsigned channels, void *dst, unsigned done, unsigned n) {
+    const void *s[PA_CHANNELS_MAX];
+    unsigned c;
+
+    if (done == 0) {
+        fallback(src, channels, dst, n);
+        return;
+    } else if (done == n)
+        return;
+
+    pa_assert(channels <= PA_CHANNELS_MAX);
+
+    for (c = 0; c < channels; c++)
+        s[c] = (const uint8_t *) src[c] + done * ss;
+
+    fallback(s, channels, (uint8_t *) dst + done * channels * ss, n - done);
+}
+
+static void deinterleave_tail(pa_deinterleave_func_t fallback, size_t ss, const void *src, void *dst[], unsigned channels, unsigned done, unsigned n) {
+    void *d[PA_CHANNELS_MAX];
+    unsigned c;
+
+    if (done == 0) {
+        fallback(src, dst, channels, n);
+        return;
+    } else if (done == n)
+        return;
+
+    pa_assert(channels <= PA_CHANNELS_MAX);
+
+    for (c = 0; c < channels; c++)
+        d[c] = (uint8_t *) dst[c] + done * ss;
+
+    fallback((const uint8_t *) src + done * channels * ss, d, channels, n - done);
+}
+
+static SSE2_FUNC void interleave_32_sse2(const void *src[], unsigned channels, void *dst, unsigned n) {
+    unsigned c, j, done = 0;
+
+    if (channels % 4 == 0) {
+        done = n & ~3U;
+
+        for (c = 0; c < channels; c += 4) {
+            const float *s0 = src[c], *s1 = src[c + 1], *s2 = src[c + 2], *s3 = src[c + 3];
+            float *d = (float *) dst + c;
+
+            for (j = 0; j < done; j += 4, d += 4 * channels) {
+                __m128 a = _mm_loadu_ps(s0 + j);
+                __m128 b = _mm_loadu_ps(s1 + j);
+                __m128 e = _mm_loadu_ps(s2 + j);
+                __m128 f = _mm_loadu_ps(s3 + j);
+
+                _MM_TRANSPOSE4_PS(a, b, e, f);
+
+                _mm_storeu_ps(d, a);
+                _mm_storeu_ps(d + channels, b);
+                _mm_storeu_ps(d + 2 * channels, e);
+                _mm_storeu_ps(d + 3 * channels, f);
+            }
+        }
+    } else if (channels % 2 == 0) {
+        done = n & ~3U;
+
+        for (c = 0; c < channels; c += 2) {
+            const float *s0 = src[c], *s1 = src[c + 1];
+            float *d = (float *) dst + c;
+
+            for (j = 0; j < done; j += 4, d += 4 * channels) {
+                __m128 a = _mm_loadu_ps(s0 + j);
+                __m128 b = _mm_loadu_ps(s1 + j);
+                __m128 lo = _mm_unpacklo_ps(a, b);
+                __m128 hi = _mm_unpackhi_ps(a, b);
+
+                if (channels == 2) {
+                    _mm_storeu_ps(d, lo);
+                    _mm_storeu_ps(d + 4, hi);
+                } else {
+                    _mm_storel_pi((__m64 *) d, lo);
+                    _mm_storeh_pi((__m64 *) (d + channels), lo);
+                    _mm_storel_pi((__m64 *) (d + 2 * channels), hi);
+                    _mm_storeh_pi((__m64 *) (d + 3 * channels), hi);
+                }
+            }
+        }
+    }
+
+    interleave_tail(fallback_interleave_32, 4, src, channels, dst, done, n);
+}
+
+static SSE2_FUNC void deinterleave_32_sse2(const void *src, void *dst[], unsigned channels, unsigned n) {
+    unsigned c, j, done = 0;
+
+    if (channels % 4 == 0) {
+        done = n & ~3U;
+
+        for (c = 0; c < channels; c += 4) {
+            const float *s = (const float *) src + c;
+            float *d0 = dst[c], *d1 = dst[c + 1], *d2 = dst[c + 2], *d3 = dst[c + 3];
+
+            for (j = 0; j < done; j += 4, s += 4 * channels) {
+                __m128 a = _mm_loadu_ps(s);
+                __m128 b = _mm_loadu_ps(s + channels);
+                __m128 e = _mm_loadu_ps(s + 2 * channels);
+                __m128 f = _mm_loadu_ps(s + 3 * channels);
+
+                _MM_TRANSPOSE4_PS(a, b, e, f);
+
+                _mm_storeu_ps(d0 + j, a);
+                _mm_storeu_ps(d1 + j, b);
+                _mm_storeu_ps(d2 + j, e);
+                _mm_storeu_ps(d3 + j, f);
+            }
+        }
+    } else if (channels % 2 == 0) {
+        done = n & ~3U;
+
+        for (c = 0; c < channels; c += 2) {
+            const float *s = (const float *) src + c;
+            float *d0 = dst[c], *d1 = dst[c + 1];
+
+            for (j = 0; j < done; j += 4, s += 4 * channels) {
+                __m128 a, b;
+
+                if (channels == 2) {
+                    a = _mm_loadu_ps(s);
+                    b = _mm_loadu_ps(s + 4);
+                } else {
+                    a = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) s), (const __m64 *) (s + channels));
+                    b = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) (s + 2 * channels)), (const __m64 *) (s + 3 * channels));
+                }
+
+                _mm_storeu_ps(d0 + j, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+                _mm_storeu_ps(d1 + j, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+            }
+        }
+    }
+
+    deinterleave_tail(fallback_deinterleave_32, 4, src, dst, channels, done, n);
+}
+
+static SSE2_FUNC void interleave_16_sse2(const void *src[], unsigned channels, void *dst, unsigned n) {
+    unsigned c, j, done = 0;
+
+    if (channels == 2) {
+        const int16_t *s0 = src[0], *s1 = src[1];
+        int16_t *d = dst;
+
+        done = n & ~7U;
+
+        for (j = 0; j < done; j += 8, d += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (s0 + j));
+            __m128i b = _mm_loadu_si128((const __m128i *) (s1 + j));
+
+            _mm_storeu_si128((__m128i *) d, _mm_unpacklo_epi16(a, b));
+            _mm_storeu_si128((__m128i *) (d + 8), _mm_unpackhi_epi16(a, b));
+        }
+    } else if (channels % 4 == 0) {
+        done = n & ~7U;
+
+        for (c = 0; c < channels; c += 4) {
+            const int16_t *s0 = src[c], *s1 = src[c + 1], *s2 = src[c + 2], *s3 = src[c + 3];
+            int16_t *d = (int16_t *) dst + c;
+
+            for (j = 0; j < done; j += 8, d += 8 * channels) {
+                __m128i a = _mm_loadu_si128((const __m128i *) (s0 + j));
+                __m128i b = _mm_loadu_si128((const __m128i *) (s1 + j));
+                __m128i e = _mm_loadu_si128((const __m128i *) (s2 + j));
+                __m128i f = _mm_loadu_si128((const __m128i *) (s3 + j));
+                __m128i ab_lo = _mm_unpacklo_epi16(a, b), ab_hi = _mm_unpackhi_epi16(a, b);
+                __m128i ef_lo = _mm_unpacklo_epi16(e, f), ef_hi = _mm_unpackhi_epi16(e, f);
+                __m128i o[4];
+                unsigned k;
+
+                /* Two frames of the group each */
+                o[0] = _mm_unpacklo_epi32(ab_lo, ef_lo);
+                o[1] = _mm_unpackhi_epi32(ab_lo, ef_lo);
+                o[2] = _mm_unpacklo_epi32(ab_hi, ef_hi);
+                o[3] = _mm_unpackhi_epi32(ab_hi, ef_hi);
+
+                if (channels == 4) {
+                    for (k = 0; k < 4; k++)
+                        _mm_storeu_si128((__m128i *) (d + 8 * k), o[k]);
+                } else {
+                    for (k = 0; k < 4; k++) {
+                        _mm_storel_epi64((__m128i *) (d + 2 * k * channels), o[k]);
+                        _mm_storel_epi64((__m128i *) (d + (2 * k + 1) * channels), _mm_unpackhi_epi64(o[k], o[k]));
+                    }
+                }
+            }
+        }
+    }
+
+    interleave_tail(fallback_interleave_16, 2, src, channels, dst, done, n);
+}
+
+static SSE2_FUNC void deinterleave_16_sse2(const void *src, void *dst[], unsigned channels, unsigned n) {
+    unsigned c, j, done = 0;
+
+    if (channels == 2) {
+        const int16_t *s = src;
+        int16_t *d0 = dst[0], *d1 = dst[1];
+
+        done = n & ~7U;
+
+        for (j = 0; j < done; j += 8, s += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i *) s);
+            __m128i b = _mm_loadu_si128((const __m128i *) (s + 8));
+
+            /* Sign extend each half of the 32 bit frames, so that the
+             * saturating pack leaves them alone */
+            _mm_storeu_si128((__m128i *) (d0 + j),
+                             _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                             _mm_srai_epi32(_mm_slli_epi32(b, 16), 16)));
+            _mm_storeu_si128((__m128i *) (d1 + j),
+                             _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+        }
+    } else if (channels % 4 == 0) {
+        done = n & ~7U;
+
+        for (c = 0; c < channels; c += 4) {
+            const int16_t *s = (const int16_t *) src + c;
+            int16_t *d0 = dst[c], *d1 = dst[c + 1], *d2 = dst[c + 2], *d3 = dst[c + 3];
+
+            for (j = 0; j < done; j += 8, s += 8 * channels) {
+                __m128i v[4], t0, t1, t2, t3, u0, u1, u2, u3;
+                unsigned k;
+
+                /* Two frames of the group each */
+                if (channels == 4) {
+                    for (k = 0; k < 4; k++)
+                        v[k] = _mm_loadu_si128((const __m128i *) (s + 8 * k));
+                } else {
+                    for (k = 0; k < 4; k++)
+                        v[k] = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) (s + 2 * k * channels)),
+                                                  _mm_loadl_epi64((const __m128i *) (s + (2 * k + 1) * channels)));
+                }
+
+                t0 = _mm_unpacklo_epi16(v[0], v[1]);
+                t1 = _mm_unpackhi_epi16(v[0], v[1]);
+                t2 = _mm_unpacklo_epi16(v[2], v[3]);
+                t3 = _mm_unpackhi_epi16(v[2], v[3]);
+
+                /* Channels 0 and 1, and 2 and 3, of four frames each */
+                u0 = _mm_unpacklo_epi16(t0, t1);
+                u1 = _mm_unpackhi_epi16(t0, t1);
+                u2 = _mm_unpacklo_epi16(t2, t3);
+                u3 = _mm_unpackhi_epi16(t2, t3);
+
+                _mm_storeu_si128((__m128i *) (d0 + j), _mm_unpacklo_epi64(u0, u2));
+                _mm_storeu_si128((__m128i *) (d1 + j), _mm_unpackhi_epi64(u0, u2));
+                _mm_storeu_si128((__m128i *) (d2 + j), _mm_unpacklo_epi64(u1, u3));
+                _mm_storeu_si128((__m128i *) (d3 + j), _mm_unpackhi_epi64(u1, u3));
+            }
+        }
+    }
+
+    deinterleave_tail(fallback_deinterleave_16, 2, src, dst, channels, done, n);
+}
+
+static SSE2_FUNC void sample_clamp_float32ne_sse2(void *dst, size_t dstr, const void *src, size_t sstr, unsigned n) {
+    const float *s = src;
+    float *d = dst;
+    unsigned j, done = 0;
+
+    if (dstr == sizeof(float) && sstr == sizeof(float)) {
+        const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f);
+
+        done = n & ~7U;
+
+        /* maxps and minps return the second operand if either is NaN, so
+         * NaNs are passed through like in the C version */
+        for (j = 0; j < done; j += 8) {
+            _mm_storeu_ps(d + j, _mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(s + j))));
+            _mm_storeu_ps(d + j + 4, _mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(s + j + 4))));
+        }
+    }
+
+    if (done < n)
+        fallback_clamp((uint8_t *) dst + done * dstr, dstr, (const uint8_t *) src + done * sstr, sstr, n - done);
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && ... */
+
+void pa_sample_util_func_init_sse(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+    if (!(flags & PA_CPU_X86_SSE2))
+        return;
+
+    pa_log_info("Initialising SSE2 optimized interleaving and clamping functions.");
+
+    fallback_interleave_16 = pa_get_interleave_func(2);
+    fallback_interleave_32 = pa_get_interleave_func(4);
+    fallback_deinterleave_16 = pa_get_deinterleave_func(2);
+    fallback_deinterleave_32 = pa_get_deinterleave_func(4);
+    fallback_clamp = pa_get_sample_clamp_func();
+
+    pa_set_interleave_func(2, interleave_16_sse2);
+    pa_set_interleave_func(4, interleave_32_sse2);
+    pa_set_deinterleave_func(2, deinterleave_16_sse2);
+    pa_set_deinterleave_func(4, deinterleave_32_sse2);
+    pa_set_sample_clamp_func(sample_clamp_float32ne_sse2);
+#endif
+}
@@ -30,6 +30,7 @@
 
 #include "cpu-x86.h"
 #include "sconv.h"
+#include "sconv-s16le.h"
 
 #if (!defined(__APPLE__) && !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && defined (__i386__)) || defined (__amd64__)
 
@@ -160,6 +161,216 @@ static void pa_sconv_s16le_from_f32ne_sse2(unsigned n, const float *a, int16_t *
 
 #endif /* defined (__i386__) || defined (__amd64__) */
 
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+/* The 24 and 32 bit conversions are written with intrinsics and
+ * per-function target attributes, like the mixers in mix_sse.c. They
+ * produce exactly the same output as the generic versions in
+ * sconv-s16le.c, which also take care of the leftover samples. */
+#include <immintrin.h>
+
+#define SSE2_FUNC __attribute__((target("sse2")))
+#define SSSE3_FUNC __attribute__((target("ssse3")))
+#define AVX2_FUNC __attribute__((target("avx2")))
+
+#define SCALE_S32 (1.0f / (1U << 31))
+
+/* cvtps2dq returns 0x80000000 for anything out of range, which is only
+ * right for negative overflows. Flip it to 0x7fffffff for positive ones,
+ * to match the clamping of the generic code. */
+static inline SSE2_FUNC __m128i s32_from_float_sse2(__m128 f) {
+    __m128 v = _mm_mul_ps(f, _mm_set1_ps((float) (1U << 31)));
+    __m128i over = _mm_castps_si128(_mm_cmpge_ps(v, _mm_set1_ps((float) (1U << 31))));
+
+    return _mm_xor_si128(_mm_cvtps_epi32(v), over);
+}
+
+static inline SSE2_FUNC __m128 s32_to_float_sse2(__m128i s) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(SCALE_S32));
+}
+
+static SSE2_FUNC void pa_sconv_s32le_to_f32ne_sse2(unsigned n, const int32_t *a, float *b) {
+    for (; n >= 4; n -= 4, a += 4, b += 4)
+        _mm_storeu_ps(b, s32_to_float_sse2(_mm_loadu_si128((const __m128i *) a)));
+
+    pa_sconv_s32le_to_float32ne(n, a, b);
+}
+
+static SSE2_FUNC void pa_sconv_s32le_from_f32ne_sse2(unsigned n, const float *a, int32_t *b) {
+    for (; n >= 4; n -= 4, a += 4, b += 4)
+        _mm_storeu_si128((__m128i *) b, s32_from_float_sse2(_mm_loadu_ps(a)));
+
+    pa_sconv_s32le_from_float32ne(n, a, b);
+}
+
+static SSE2_FUNC void pa_sconv_s24_32le_to_f32ne_sse2(unsigned n, const uint32_t *a, float *b) {
+    for (; n >= 4; n -= 4, a += 4, b += 4) {
+        __m128i s = _mm_slli_epi32(_mm_loadu_si128((const __m128i *) a), 8);
+        _mm_storeu_ps(b, s32_to_float_sse2(s));
+    }
+
+    pa_sconv_s24_32le_to_float32ne(n, a, b);
+}
+
+static SSE2_FUNC void pa_sconv_s24_32le_from_f32ne_sse2(unsigned n, const float *a, uint32_t *b) {
+    for (; n >= 4; n -= 4, a += 4, b += 4) {
+        __m128i s = _mm_srli_epi32(s32_from_float_sse2(_mm_loadu_ps(a)), 8);
+        _mm_storeu_si128((__m128i *) b, s);
+    }
+
+    pa_sconv_s24_32le_from_float32ne(n, a, b);
+}
+
+static SSE2_FUNC void pa_sconv_s32le_to_s16ne_sse2(unsigned n, const int32_t *a, int16_t *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i lo = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) a), 16);
+        __m128i hi = _mm_srai_epi32(_mm_loadu_si128((const __m128i *) (a + 4)), 16);
+        _mm_storeu_si128((__m128i *) b, _mm_packs_epi32(lo, hi));
+    }
+
+    pa_sconv_s32le_to_s16ne(n, a, b);
+}
+
+static SSE2_FUNC void pa_sconv_s32le_from_s16ne_sse2(unsigned n, const int16_t *a, int32_t *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *) a);
+        _mm_storeu_si128((__m128i *) b, _mm_unpacklo_epi16(_mm_setzero_si128(), s));
+        _mm_storeu_si128((__m128i *) (b + 4), _mm_unpackhi_epi16(_mm_setzero_si128(), s));
+    }
+
+    pa_sconv_s32le_from_s16ne(n, a, b);
+}
+
+static SSE2_FUNC void pa_sconv_s24_32le_to_s16ne_sse2(unsigned n, const uint32_t *a, int16_t *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i lo = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((const __m128i *) a), 8), 16);
+        __m128i hi = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((const __m128i *) (a + 4)), 8), 16);
+        _mm_storeu_si128((__m128i *) b, _mm_packs_epi32(lo, hi));
+    }
+
+    pa_sconv_s24_32le_to_s16ne(n, a, b);
+}
+
+static SSE2_FUNC void pa_sconv_s24_32le_from_s16ne_sse2(unsigned n, const int16_t *a, uint32_t *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *) a);
+        _mm_storeu_si128((__m128i *) b, _mm_srli_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), s), 8));
+        _mm_storeu_si128((__m128i *) (b + 4), _mm_srli_epi32(_mm_unpackhi_epi16(_mm_setzero_si128(), s), 8));
+    }
+
+    pa_sconv_s24_32le_from_s16ne(n, a, b);
+}
+
+/* Packed 24 bit samples are handled eight at a time, i.e. in 24 byte
+ * chunks. They are read with two overlapping 16 byte loads at offsets 0
+ * and 8 and written as 16 + 8 bytes, so we never touch memory outside
+ * of the buffers. The 0x80 entries of the shuffle masks clear a byte. */
+
+/* Samples 0-3 from the first load, 4-7 from the second, each ending up
+ * in the upper three bytes of a 32 bit word */
+#define S24_UNPACK_LO _mm_setr_epi8(0x80, 0, 1, 2, 0x80, 3, 4, 5, 0x80, 6, 7, 8, 0x80, 9, 10, 11)
+#define S24_UNPACK_HI _mm_setr_epi8(0x80, 4, 5, 6, 0x80, 7, 8, 9, 0x80, 10, 11, 12, 0x80, 13, 14, 15)
+
+/* The reverse: bytes 0-15 of the output from the two 32 bit vectors,
+ * then the remaining 8 bytes from the second one */
+#define S24_PACK_A0 _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, 0x80, 0x80, 0x80, 0x80)
+#define S24_PACK_A1 _mm_setr_epi8(0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 1, 2, 3, 5)
+#define S24_PACK_B1 _mm_setr_epi8(6, 7, 9, 10, 11, 13, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80)
+
+static SSSE3_FUNC void pa_sconv_s24le_to_f32ne_ssse3(unsigned n, const uint8_t *a, float *b) {
+    for (; n >= 8; n -= 8, a += 24, b += 8) {
+        __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) a), S24_UNPACK_LO);
+        __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (a + 8)), S24_UNPACK_HI);
+        _mm_storeu_ps(b, s32_to_float_sse2(lo));
+        _mm_storeu_ps(b + 4, s32_to_float_sse2(hi));
+    }
+
+    pa_sconv_s24le_to_float32ne(n, a, b);
+}
+
+static SSSE3_FUNC void pa_sconv_s24le_from_f32ne_ssse3(unsigned n, const float *a, uint8_t *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 24) {
+        __m128i lo = s32_from_float_sse2(_mm_loadu_ps(a));
+        __m128i hi = s32_from_float_sse2(_mm_loadu_ps(a + 4));
+        _mm_storeu_si128((__m128i *) b, _mm_or_si128(_mm_shuffle_epi8(lo, S24_PACK_A0), _mm_shuffle_epi8(hi, S24_PACK_A1)));
+        _mm_storel_epi64((__m128i *) (b + 16), _mm_shuffle_epi8(hi, S24_PACK_B1));
+    }
+
+    pa_sconv_s24le_from_float32ne(n, a, b);
+}
+
+static SSSE3_FUNC void pa_sconv_s24le_to_s16ne_ssse3(unsigned n, const uint8_t *a, int16_t *b) {
+    const __m128i lo_mask = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80);
+    const __m128i hi_mask = _mm_setr_epi8(0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 5, 6, 8, 9, 11, 12, 14, 15);
+
+    for (; n >= 8; n -= 8, a += 24, b += 8) {
+        __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) a), lo_mask);
+        __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (a + 8)), hi_mask);
+        _mm_storeu_si128((__m128i *) b, _mm_or_si128(lo, hi));
+    }
+
+    pa_sconv_s24le_to_s16ne(n, a, b);
+}
+
+static SSSE3_FUNC void pa_sconv_s24le_from_s16ne_ssse3(unsigned n, const int16_t *a, uint8_t *b) {
+    const __m128i a_mask = _mm_setr_epi8(0x80, 0, 1, 0x80, 2, 3, 0x80, 4, 5, 0x80, 6, 7, 0x80, 8, 9, 0x80);
+    const __m128i b_mask = _mm_setr_epi8(10, 11, 0x80, 12, 13, 0x80, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80);
+
+    for (; n >= 8; n -= 8, a += 8, b += 24) {
+        __m128i s = _mm_loadu_si128((const __m128i *) a);
+        _mm_storeu_si128((__m128i *) b, _mm_shuffle_epi8(s, a_mask));
+        _mm_storel_epi64((__m128i *) (b + 16), _mm_shuffle_epi8(s, b_mask));
+    }
+
+    pa_sconv_s24le_from_s16ne(n, a, b);
+}
+
+static inline AVX2_FUNC __m256i s32_from_float_avx2(__m256 f) {
+    __m256 v = _mm256_mul_ps(f, _mm256_set1_ps((float) (1U << 31)));
+    __m256i over = _mm256_castps_si256(_mm256_cmp_ps(v, _mm256_set1_ps((float) (1U << 31)), _CMP_GE_OQ));
+
+    return _mm256_xor_si256(_mm256_cvtps_epi32(v), over);
+}
+
+static inline AVX2_FUNC __m256 s32_to_float_avx2(__m256i s) {
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(s), _mm256_set1_ps(SCALE_S32));
+}
+
+static AVX2_FUNC void pa_sconv_s32le_to_f32ne_avx2(unsigned n, const int32_t *a, float *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8)
+        _mm256_storeu_ps(b, s32_to_float_avx2(_mm256_loadu_si256((const __m256i *) a)));
+
+    pa_sconv_s32le_to_float32ne(n, a, b);
+}
+
+static AVX2_FUNC void pa_sconv_s32le_from_f32ne_avx2(unsigned n, const float *a, int32_t *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8)
+        _mm256_storeu_si256((__m256i *) b, s32_from_float_avx2(_mm256_loadu_ps(a)));
+
+    pa_sconv_s32le_from_float32ne(n, a, b);
+}
+
+static AVX2_FUNC void pa_sconv_s24_32le_to_f32ne_avx2(unsigned n, const uint32_t *a, float *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m256i s = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i *) a), 8);
+        _mm256_storeu_ps(b, s32_to_float_avx2(s));
+    }
+
+    pa_sconv_s24_32le_to_float32ne(n, a, b);
+}
+
+static AVX2_FUNC void pa_sconv_s24_32le_from_f32ne_avx2(unsigned n, const float *a, uint32_t *b) {
+    for (; n >= 8; n -= 8, a += 8, b += 8) {
+        __m256i s = _mm256_srli_epi32(s32_from_float_avx2(_mm256_loadu_ps(a)), 8);
+        _mm256_storeu_si256((__m256i *) b, s);
+    }
+
+    pa_sconv_s24_32le_from_float32ne(n, a, b);
+}
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && ... */
+
 void pa_convert_func_init_sse(pa_cpu_x86_flag_t flags) {
 #if (!defined(__APPLE__) && !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && defined (__i386__)) || defined (__amd64__)
 
@@ -174,4 +385,39 @@ void pa_convert_func_init_sse(pa_cpu_x86_flag_t flags) {
     }
 
 #endif /* defined (__i386__) || defined (__amd64__) */
+
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+    if (!(flags & PA_CPU_X86_SSE2))
+        return;
+
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized 24/32 bit conversions.");
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_to_f32ne_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_from_f32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_to_f32ne_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_from_f32ne_avx2);
+    } else {
+        pa_log_info("Initialising SSE2 optimized 24/32 bit conversions.");
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_to_f32ne_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_from_f32ne_sse2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_to_f32ne_sse2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_from_f32ne_sse2);
+    }
+
+    /* These are bound by memory bandwidth, wider vectors don't buy us
+     * anything here */
+    pa_set_convert_to_s16ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_to_s16ne_sse2);
+    pa_set_convert_from_s16ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_from_s16ne_sse2);
+    pa_set_convert_to_s16ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_to_s16ne_sse2);
+    pa_set_convert_from_s16ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_from_s16ne_sse2);
+
+    if (flags & PA_CPU_X86_SSSE3) {
+        pa_log_info("Initialising SSSE3 optimized 24 bit conversions.");
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_to_f32ne_ssse3);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_from_f32ne_ssse3);
+        pa_set_convert_to_s16ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_to_s16ne_ssse3);
+        pa_set_convert_from_s16ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_from_s16ne_ssse3);
+    }
+#endif
 }
@@ -0,0 +1,78 @@
+#ifndef foopulsecoreseqlockhfoo
+#define foopulsecoreseqlockhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulsecore/atomic.h>
+
+/*
+ * A sequence lock, for small pieces of data with a single writer that
+ * must never block, like an IO thread publishing its state for the main
+ * thread. Unlike with pa_aupdate the writer never waits for readers;
+ * instead readers retry (or give up) when the data changed while they
+ * were copying it.
+ *
+ * The counter is odd while a write is in progress. pa_atomic_inc() and
+ * pa_atomic_load() are full memory barriers, which is all that is needed
+ * to order the data accesses against the counter.
+ *
+ * Usage is like this:
+ *
+ * writer() {
+ *     pa_seqlock_write_begin(&l);
+ *     ... modify data ...
+ *     pa_seqlock_write_end(&l);
+ * }
+ *
+ * reader() {
+ *     unsigned seq;
+ *
+ *     do {
+ *         seq = pa_seqlock_read_begin(&l);
+ *         ... copy data ...
+ *     } while (pa_seqlock_read_retry(&l, seq));
+ * }
+ *
+ * There must be only one writer at a time.
+ */
+
+typedef struct pa_seqlock {
+    pa_atomic_t seq;
+} pa_seqlock;
+
+#define PA_SEQLOCK_INIT { PA_ATOMIC_INIT(0) }
+
+static inline void pa_seqlock_write_begin(pa_seqlock *l) {
+    pa_atomic_inc(&l->seq);
+}
+
+static inline void pa_seqlock_write_end(pa_seqlock *l) {
+    pa_atomic_inc(&l->seq);
+}
+
+static inline unsigned pa_seqlock_read_begin(pa_seqlock *l) {
+    return (unsigned) pa_atomic_load(&l->seq);
+}
+
+/* Returns true if the data copied since pa_seqlock_read_begin() might be
+ * inconsistent and needs to be read again */
+static inline bool pa_seqlock_read_retry(pa_seqlock *l, unsigned seq) {
+    return (seq & 1) || (unsigned) pa_atomic_load(&l->seq) != seq;
+}
+
+#endif
@@ -44,6 +44,7 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/gccmacro.h>
+#include <pulse/sample.h>
 
 #include <pulsecore/memfd-wrappers.h>
 #include <pulsecore/core-error.h>
@@ -79,6 +80,10 @@
 
 #define SHM_MARKER ((int) 0xbeefcafe)
 
+/* See pa_shm_set_backing() */
+static bool use_huge_pages = false;
+static bool use_prefault = false;
+
 /* We now put this SHM marker at the end of each segment. It's
  * optional, to not require a reboot when upgrading, though. Note that
  * on multiarch systems 32bit and 64bit processes might access this
@@ -107,6 +112,37 @@ static char *segment_name(char *fn, size_t l, unsigned id) {
 }
 #endif
 
+void pa_shm_set_backing(bool huge_pages, bool prefault) {
+    use_huge_pages = huge_pages;
+    use_prefault = prefault;
+}
+
+/* Applies the options of pa_shm_set_backing() to a fresh mapping */
+static void setup_backing(pa_shm *m, size_t size) {
+    pa_assert(m);
+
+#ifdef MADV_HUGEPAGE
+    /* Needs to happen before the pages are faulted in */
+    if (use_huge_pages && !m->huge_pages && madvise(m->ptr, size, MADV_HUGEPAGE) < 0)
+        pa_log_debug("madvise(MADV_HUGEPAGE) failed: %s", pa_cstrerror(errno));
+#endif
+
+    if (use_prefault) {
+        const size_t page_size = pa_page_size();
+        size_t o;
+
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(m->ptr, size, MADV_POPULATE_WRITE) < 0)
+#endif
+            /* The memory is still all zeros, so writing zeros doesn't
+             * change it, but gets every page faulted in */
+            for (o = 0; o < size; o += page_size)
+                ((volatile uint8_t *) m->ptr)[o] = 0;
+
+        m->prefaulted = true;
+    }
+}
+
 static int privatemem_create(pa_shm *m, size_t size) {
     pa_assert(m);
     pa_assert(size > 0);
@@ -115,6 +151,8 @@ static int privatemem_create(pa_shm *m, size_t size) {
     m->id = 0;
     m->size = size;
     m->do_unlink = false;
+    m->huge_pages = false;
+    m->prefaulted = false;
     m->fd = -1;
 
 #ifdef MAP_ANONYMOUS
@@ -122,6 +160,8 @@ static int privatemem_create(pa_shm *m, size_t size) {
         pa_log("mmap() failed: %s", pa_cstrerror(errno));
         return -1;
     }
+
+    setup_backing(m, m->size);
 #elif defined(HAVE_POSIX_MEMALIGN)
     {
         int r;
@@ -138,6 +178,50 @@ static int privatemem_create(pa_shm *m, size_t size) {
     return 0;
 }
 
+#ifdef HAVE_MEMFD
+/* Tries to back m with a memfd on hugetlbfs. This only works if huge
+ * pages have been reserved on the system, so failing here is fine,
+ * the caller falls back to a normal memfd. Returns the fd. */
+static int hugetlb_memfd_create(pa_shm *m, size_t size) {
+    char t[PA_BYTES_SNPRINT_MAX];
+    struct stat st;
+    int fd;
+
+    if ((fd = memfd_create("pulseaudio", MFD_ALLOW_SEALING|MFD_HUGETLB)) < 0) {
+        pa_log_debug("Failed to create huge page memfd: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    /* On hugetlbfs the block size is the huge page size, and the file
+     * size needs to be a multiple of it */
+    if (fstat(fd, &st) < 0 || st.st_blksize <= 0)
+        goto fail;
+
+    size = PA_ROUND_UP(size, (size_t) st.st_blksize);
+
+    if (size > MAX_SHM_SIZE || ftruncate(fd, (off_t) size) < 0)
+        goto fail;
+
+    /* No MAP_NORESERVE here: the huge pages are reserved right away,
+     * instead of getting SIGBUS later on when there are too few */
+    if ((m->ptr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, (off_t) 0)) == MAP_FAILED)
+        goto fail;
+
+    m->size = size;
+    m->huge_pages = true;
+
+    pa_log_debug("Using huge pages of %s for shared memory.", pa_bytes_snprint(t, sizeof(t), (unsigned) st.st_blksize));
+
+    return fd;
+
+fail:
+    pa_log_debug("Failed to set up huge page memfd: %s", pa_cstrerror(errno));
+    pa_close(fd);
+
+    return -1;
+}
+#endif
+
 static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode) {
 #if defined(HAVE_SHM_OPEN) || defined(HAVE_MEMFD)
     char fn[32];
@@ -145,15 +229,19 @@ static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t m
     struct shm_marker *marker;
     bool do_unlink = false;
 
-    /* Each time we create a new SHM area, let's first drop all stale
-     * ones */
-    pa_shm_cleanup();
-
     pa_random(&m->id, sizeof(m->id));
 
+    m->huge_pages = false;
+    m->prefaulted = false;
+
     switch (type) {
 #ifdef HAVE_SHM_OPEN
     case PA_MEM_TYPE_SHARED_POSIX:
+        /* Each time we create a new SHM area, let's first drop all stale
+         * ones. Only POSIX segments can go stale, memfds vanish with
+         * their last user. */
+        pa_shm_cleanup();
+
         segment_name(fn, sizeof(fn), m->id);
         fd = shm_open(fn, O_RDWR|O_CREAT|O_EXCL, mode);
         do_unlink = true;
@@ -161,6 +249,9 @@ static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t m
 #endif
 #ifdef HAVE_MEMFD
     case PA_MEM_TYPE_SHARED_MEMFD:
+        if (use_huge_pages && (fd = hugetlb_memfd_create(m, size)) >= 0)
+            break;
+
         fd = memfd_create("pulseaudio", MFD_ALLOW_SEALING);
         break;
 #endif
@@ -174,23 +265,28 @@ static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t m
     }
 
     m->type = type;
-    m->size = size + shm_marker_size(type);
     m->do_unlink = do_unlink;
 
-    if (ftruncate(fd, (off_t) m->size) < 0) {
-        pa_log("ftruncate() failed: %s", pa_cstrerror(errno));
-        goto fail;
-    }
+    if (!m->huge_pages) {
+        m->size = size + shm_marker_size(type);
+
+        if (ftruncate(fd, (off_t) m->size) < 0) {
+            pa_log("ftruncate() failed: %s", pa_cstrerror(errno));
+            goto fail;
+        }
 
 #ifndef MAP_NORESERVE
 #define MAP_NORESERVE 0
 #endif
 
-    if ((m->ptr = mmap(NULL, PA_PAGE_ALIGN(m->size), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_NORESERVE, fd, (off_t) 0)) == MAP_FAILED) {
-        pa_log("mmap() failed: %s", pa_cstrerror(errno));
-        goto fail;
+        if ((m->ptr = mmap(NULL, PA_PAGE_ALIGN(m->size), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_NORESERVE, fd, (off_t) 0)) == MAP_FAILED) {
+            pa_log("mmap() failed: %s", pa_cstrerror(errno));
+            goto fail;
+        }
     }
 
+    setup_backing(m, PA_PAGE_ALIGN(m->size));
+
     if (type == PA_MEM_TYPE_SHARED_POSIX) {
         /* We store our PID at the end of the shm block, so that we
          * can check for dead shm segments later */
@@ -314,6 +410,12 @@ void pa_shm_punch(pa_shm *m, size_t offset, size_t size) {
     /* You're welcome to implement this as NOOP on systems that don't
      * support it */
 
+    /* Pages that were faulted in on purpose stay, giving them back
+     * would only mean faulting them in again in the IO threads. Huge
+     * pages can't be given back piecewise anyway. */
+    if (m->prefaulted || m->huge_pages)
+        return;
+
     /* Align the pointer up to multiples of the page size */
     ptr = (uint8_t*) m->ptr + offset;
     o = (size_t) ((uint8_t*) ptr - (uint8_t*) PA_PAGE_ALIGN_PTR(ptr));
@@ -405,6 +507,8 @@ static int shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd,
     m->id = id;
     m->size = (size_t) st.st_size;
     m->do_unlink = false;
+    m->huge_pages = false;
+    m->prefaulted = false;
     m->fd = -1;
 
     return 0;
@@ -424,6 +528,59 @@ int pa_shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd, bool
     return shm_attach(m, type, id, memfd_fd, writable, false);
 }
 
+#define SEALS_READ_ONLY (F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_WRITE)
+
+int pa_shm_seal(pa_shm *m) {
+#ifdef HAVE_MEMFD
+    int fd;
+
+    pa_assert(m);
+    pa_assert(m->type == PA_MEM_TYPE_SHARED_MEMFD);
+    pa_assert(m->fd >= 0);
+
+    fd = m->fd;
+    m->fd = -1;
+
+    /* F_SEAL_WRITE is refused as long as there is a writable mapping */
+    pa_shm_free(m);
+
+    if (fcntl(fd, F_ADD_SEALS, SEALS_READ_ONLY|F_SEAL_SEAL) < 0) {
+        pa_log("fcntl(F_ADD_SEALS) failed: %s", pa_cstrerror(errno));
+        pa_assert_se(pa_close(fd) == 0);
+        return -1;
+    }
+
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+int pa_shm_attach_sealed(pa_shm *m, int memfd_fd) {
+#ifdef HAVE_MEMFD
+    int seals;
+
+    pa_assert(m);
+    pa_assert(memfd_fd >= 0);
+
+    /* The peer may still hold the fd. Without these seals it could
+     * truncate the segment under our feet or change the data. */
+    if ((seals = fcntl(memfd_fd, F_GET_SEALS)) < 0) {
+        pa_log("fcntl(F_GET_SEALS) failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    if ((seals & SEALS_READ_ONLY) != SEALS_READ_ONLY) {
+        pa_log("memfd is not sealed read-only");
+        return -1;
+    }
+
+    return shm_attach(m, PA_MEM_TYPE_SHARED_MEMFD, 0, memfd_fd, false, false);
+#else
+    return -1;
+#endif
+}
+
 int pa_shm_cleanup(void) {
 
 #ifdef HAVE_SHM_OPEN
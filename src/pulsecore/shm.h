@@ -34,6 +34,12 @@ typedef struct pa_shm {
     /* Only for type = PA_MEM_TYPE_SHARED_POSIX */
     bool do_unlink:1;
 
+    /* Set up by pa_shm_create_rw() as asked for by pa_shm_set_backing().
+     * huge_pages is only set for memfds on hugetlbfs, transparent huge
+     * pages are up to the kernel. */
+    bool huge_pages:1;
+    bool prefaulted:1;
+
     /* Only for type = PA_MEM_TYPE_SHARED_MEMFD
      *
      * To avoid fd leaks, we keep this fd open only until we pass it
@@ -49,9 +55,25 @@ typedef struct pa_shm {
     int fd;
 } pa_shm;
 
+/* Affects the memory of all pa_shm_create_rw() calls that follow. With
+ * huge_pages, memfds are backed by huge pages if the system has any
+ * reserved, all other memory is marked for transparent huge pages.
+ * With prefault, all pages are faulted in right away and are never
+ * given back by pa_shm_punch(). */
+void pa_shm_set_backing(bool huge_pages, bool prefault);
+
 int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode);
 int pa_shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd, bool writable);
 
+/* Unmaps a memfd segment created with pa_shm_create_rw() and seals it
+ * against any further change. Returns the fd, which is then owned by
+ * the caller, or -1 on failure. m is freed in either case. */
+int pa_shm_seal(pa_shm *m);
+
+/* Like pa_shm_attach() for memfds, read-only, but fails unless the
+ * memfd has been sealed by pa_shm_seal() */
+int pa_shm_attach_sealed(pa_shm *m, int memfd_fd);
+
 void pa_shm_punch(pa_shm *m, size_t offset, size_t size);
 
 void pa_shm_free(pa_shm *m);
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/utf8.h>
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
@@ -83,6 +84,44 @@ static void volume_factor_from_hashmap(pa_cvolume *v, pa_hashmap *items, uint8_t
         pa_sw_cvolume_multiply(v, v, &entry->volume);
 }
 
+/* Called from main context before the sink input is linked or moved,
+ * otherwise from thread context. If the sink input has the sink's
+ * channel map, the sink applies the soft volume while mixing, and the
+ * sink volume factor is folded into that instead of getting a pass of
+ * its own. */
+static void update_mix_volume(pa_sink_input *i) {
+    if (i->sink &&
+        !pa_cvolume_is_norm(&i->volume_factor_sink) &&
+        pa_channel_map_equal(&i->channel_map, &i->sink->channel_map))
+        pa_sw_cvolume_multiply(&i->thread_info.mix_volume, &i->thread_info.soft_volume, &i->volume_factor_sink);
+    else
+        i->thread_info.mix_volume = i->thread_info.soft_volume;
+}
+
+/* Called from thread context. Stores the volume the stream is at
+ * right now, in the middle of a ramp or not, in v. The ramp is linear
+ * in amplitude, as pa_mix() does it. */
+static void get_current_mix_volume(pa_sink_input *i, pa_cvolume *v) {
+    double t;
+    unsigned c;
+
+    if (i->thread_info.ramp_length == 0) {
+        *v = i->thread_info.mix_volume;
+        return;
+    }
+
+    t = (double) i->thread_info.ramp_done / (double) i->thread_info.ramp_length;
+
+    v->channels = i->thread_info.mix_volume.channels;
+    for (c = 0; c < v->channels; c++) {
+        double from, to;
+
+        from = pa_sw_volume_to_linear(i->thread_info.ramp_volume.values[c]);
+        to = pa_sw_volume_to_linear(i->thread_info.mix_volume.values[c]);
+        v->values[c] = pa_sw_volume_from_linear(from + (to - from) * t);
+    }
+}
+
 static void sink_input_free(pa_object *o);
 static void set_real_ratio(pa_sink_input *i, const pa_cvolume *v);
 
@@ -256,6 +295,7 @@ static void reset_callbacks(pa_sink_input *i) {
     pa_assert(i);
 
     i->pop = NULL;
+    i->pop_into = NULL;
     i->process_underrun = NULL;
     i->process_rewind = NULL;
     i->update_max_rewind = NULL;
@@ -534,6 +574,9 @@ int pa_sink_input_new(
     i->thread_info.resampler = resampler;
     i->thread_info.soft_volume = i->soft_volume;
     i->thread_info.muted = i->muted;
+    update_mix_volume(i);
+    i->thread_info.volume_ramp_usec = 0;
+    i->thread_info.ramp_length = i->thread_info.ramp_done = 0;
     i->thread_info.requested_sink_latency = (pa_usec_t) -1;
     i->thread_info.rewrite_nbytes = 0;
     i->thread_info.rewrite_flush = false;
@@ -751,6 +794,9 @@ static void sink_input_free(pa_object *o) {
     if (i->thread_info.resampler)
         pa_resampler_free(i->thread_info.resampler);
 
+    if (i->queue_bytes_metric)
+        pa_metric_free(i->queue_bytes_metric);
+
     if (i->format)
         pa_format_info_free(i->format);
 
@@ -776,6 +822,7 @@ static void sink_input_free(pa_object *o) {
 /* Called from main context */
 void pa_sink_input_put(pa_sink_input *i) {
     pa_sink_input_state_t state;
+    char *index_str;
 
     pa_sink_input_assert_ref(i);
     pa_assert_ctl_context();
@@ -809,6 +856,12 @@ void pa_sink_input_put(pa_sink_input *i) {
 
     i->thread_info.soft_volume = i->soft_volume;
     i->thread_info.muted = i->muted;
+    update_mix_volume(i);
+
+    index_str = pa_sprintf_malloc("%u", i->index);
+    i->queue_bytes_metric = pa_metrics_register(i->core->metrics, "pulseaudio_sink_input_queue_bytes", PA_METRIC_GAUGE,
+                                                "Bytes queued for rendering by a sink input.", "sink_input", index_str);
+    pa_xfree(index_str);
 
     pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_ADD_INPUT, i, 0, NULL) == 0);
 
@@ -846,6 +899,14 @@ pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency) {
     return r[0];
 }
 
+/* Called from main context */
+void pa_sink_input_get_stats(pa_sink_input *i, pa_sink_stats *stats) {
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+
+    pa_sink_stats_read(&i->stats_lock, &i->stats, stats);
+}
+
 /* Called from thread context */
 void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa_memchunk *chunk, pa_cvolume *volume) {
     bool do_volume_adj_here, need_volume_factor_sink;
@@ -853,6 +914,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     size_t block_size_max_sink, block_size_max_sink_input;
     size_t ilength;
     size_t ilength_full;
+    pa_usec_t start = 0;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
@@ -899,7 +961,10 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
 
     do_volume_adj_here = !pa_channel_map_equal(&i->channel_map, &i->sink->channel_map);
     volume_is_norm = pa_cvolume_is_norm(&i->thread_info.soft_volume) && !i->thread_info.muted;
-    need_volume_factor_sink = !pa_cvolume_is_norm(&i->volume_factor_sink);
+
+    /* Otherwise the sink volume factor is part of the volume the sink
+     * applies while mixing */
+    need_volume_factor_sink = do_volume_adj_here && !pa_cvolume_is_norm(&i->volume_factor_sink);
 
     while (!pa_memblockq_is_readable(i->thread_info.render_memblockq)) {
         pa_memchunk tchunk;
@@ -907,6 +972,9 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
         /* There's nothing in our render queue. We need to fill it up
          * with data from the implementor. */
 
+        if (start == 0)
+            start = pa_rtclock_now();
+
         if (i->thread_info.state == PA_SINK_INPUT_CORKED ||
             i->pop(i, ilength, &tchunk) < 0) {
 
@@ -915,6 +983,19 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
             pa_atomic_store(&i->thread_info.drained, 1);
 
             pa_memblockq_seek(i->thread_info.render_memblockq, (int64_t) slength, PA_SEEK_RELATIVE, true);
+
+            /* Only count running dry while playing, not being corked or
+             * not having started yet */
+            if (i->thread_info.state != PA_SINK_INPUT_CORKED && i->thread_info.underrun_for != (uint64_t) -1) {
+                bool started = i->thread_info.playing_for > 0;
+
+                if (started)
+                    pa_metric_inc(i->sink->metrics.underruns);
+
+                pa_sink_stats_add_underrun(&i->stats_lock, &i->stats, started, slength);
+                pa_sink_stats_add_underrun(&i->sink->stats_lock, &i->sink->stats, started, slength);
+            }
+
             i->thread_info.playing_for = 0;
             if (i->thread_info.underrun_for != (uint64_t) -1) {
                 i->thread_info.underrun_for += ilength_full;
@@ -935,6 +1016,8 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
         while (tchunk.length > 0) {
             pa_memchunk wchunk;
             bool nvfs = need_volume_factor_sink;
+            bool resampler_volume = false;
+            bool silent;
 
             wchunk = tchunk;
             pa_memblock_ref(wchunk.memblock);
@@ -942,31 +1025,44 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
             if (wchunk.length > block_size_max_sink_input)
                 wchunk.length = block_size_max_sink_input;
 
+            /* No volume changes silence, and the resampler passes it on
+             * as is, so that the sink can skip it when mixing */
+            silent = pa_memblock_is_silence(wchunk.memblock);
+
             /* It might be necessary to adjust the volume here */
-            if (do_volume_adj_here && !volume_is_norm) {
-                pa_memchunk_make_writable(&wchunk, 0);
+            if (do_volume_adj_here && !volume_is_norm && !silent) {
 
                 if (i->thread_info.muted) {
+                    pa_memchunk_make_writable(&wchunk, 0);
                     pa_silence_memchunk(&wchunk, &i->thread_info.sample_spec);
                     nvfs = false;
 
-                } else if (!i->thread_info.resampler && nvfs) {
+                } else if (i->thread_info.resampler) {
+
+                    /* The resampler goes over the data anyway, so let
+                     * it apply the volume on the way */
+                    resampler_volume = true;
+
+                } else if (nvfs) {
                     pa_cvolume v;
 
                     /* If we don't need a resampler we can merge the
                      * post and the pre volume adjustment into one */
 
+                    pa_memchunk_make_writable(&wchunk, 0);
                     pa_sw_cvolume_multiply(&v, &i->thread_info.soft_volume, &i->volume_factor_sink);
                     pa_volume_memchunk(&wchunk, &i->thread_info.sample_spec, &v);
                     nvfs = false;
 
-                } else
+                } else {
+                    pa_memchunk_make_writable(&wchunk, 0);
                     pa_volume_memchunk(&wchunk, &i->thread_info.sample_spec, &i->thread_info.soft_volume);
+                }
             }
 
             if (!i->thread_info.resampler) {
 
-                if (nvfs) {
+                if (nvfs && !silent) {
                     pa_memchunk_make_writable(&wchunk, 0);
                     pa_volume_memchunk(&wchunk, &i->sink->sample_spec, &i->volume_factor_sink);
                 }
@@ -974,7 +1070,11 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
                 pa_memblockq_push_align(i->thread_info.render_memblockq, &wchunk);
             } else {
                 pa_memchunk rchunk;
+                pa_usec_t start;
+                pa_resampler_set_volume(i->thread_info.resampler, resampler_volume ? &i->thread_info.soft_volume : NULL);
+                start = pa_rtclock_now();
                 pa_resampler_run(i->thread_info.resampler, &wchunk, &rchunk);
+                pa_metric_add(i->sink->metrics.resampler_usec, pa_rtclock_now() - start);
 
 #ifdef SINK_INPUT_DEBUG
                 pa_log_debug("pushing %lu", (unsigned long) rchunk.length);
@@ -982,7 +1082,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
 
                 if (rchunk.memblock) {
 
-                    if (nvfs) {
+                    if (nvfs && !pa_memblock_is_silence(rchunk.memblock)) {
                         pa_memchunk_make_writable(&rchunk, 0);
                         pa_volume_memchunk(&rchunk, &i->sink->sample_spec, &i->volume_factor_sink);
                     }
@@ -1001,11 +1101,16 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
         pa_memblock_unref(tchunk.memblock);
     }
 
+    if (start > 0)
+        pa_sink_stats_add_render_time(&i->stats_lock, &i->stats, pa_rtclock_now() - start);
+
     pa_assert_se(pa_memblockq_peek(i->thread_info.render_memblockq, chunk) >= 0);
 
     pa_assert(chunk->length > 0);
     pa_assert(chunk->memblock);
 
+    pa_metric_set(i->queue_bytes_metric, (int64_t) pa_memblockq_get_length(i->thread_info.render_memblockq));
+
 #ifdef SINK_INPUT_DEBUG
     pa_log_debug("peeking %lu", (unsigned long) chunk->length);
 #endif
@@ -1023,7 +1128,67 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
         /* We've both the same channel map, so let's have the sink do the adjustment for us*/
         pa_cvolume_mute(volume, i->sink->sample_spec.channels);
     else
-        *volume = i->thread_info.soft_volume;
+        *volume = i->thread_info.mix_volume;
+}
+
+/* Called from thread context. Like pa_sink_input_peek(), but lets
+ * the implementor write directly into target. Returns -1 without
+ * touching anything if that is not possible, e.g. because the data
+ * needs to be resampled or there is still data queued up from a
+ * rewind, in which case pa_sink_input_peek() has to be used
+ * instead. */
+int pa_sink_input_peek_into(pa_sink_input *i, pa_memchunk *target, pa_cvolume *volume) {
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+    pa_assert(PA_SINK_INPUT_IS_LINKED(i->thread_info.state));
+    pa_assert(target);
+    pa_assert(target->memblock);
+    pa_assert(target->length > 0);
+    pa_assert(pa_frame_aligned(target->length, &i->sink->sample_spec));
+    pa_assert(volume);
+
+    if (!i->pop_into)
+        return -1;
+
+    if (i->thread_info.state == PA_SINK_INPUT_CORKED)
+        return -1;
+
+    /* The data ends up in the sink's buffer as is, so there's no
+     * room for any conversion or volume adjustment in between */
+    if (i->thread_info.resampler ||
+        !pa_channel_map_equal(&i->channel_map, &i->sink->channel_map) ||
+        !pa_cvolume_is_norm(&i->volume_factor_sink) ||
+        !pa_cvolume_is_norm(&i->thread_info.soft_volume) ||
+        i->thread_info.ramp_length > 0 ||
+        i->thread_info.muted)
+        return -1;
+
+    /* Anything that is left in the render queue, e.g. after a
+     * rewind, has to be played first */
+    if (pa_memblockq_get_read_index(i->thread_info.render_memblockq) !=
+        pa_memblockq_get_write_index(i->thread_info.render_memblockq))
+        return -1;
+
+    if (i->pop_into(i, target) < 0)
+        return -1;
+
+    pa_assert(target->length > 0);
+    pa_assert(pa_frame_aligned(target->length, &i->sink->sample_spec));
+
+    pa_atomic_store(&i->thread_info.drained, 0);
+
+    i->thread_info.underrun_for = 0;
+    i->thread_info.underrun_for_sink = 0;
+    i->thread_info.playing_for += target->length;
+
+    /* Keep the data around for rewinding, just like
+     * pa_sink_input_peek() does. The block must hence not be modified
+     * anymore by the caller. */
+    pa_memblockq_push(i->thread_info.render_memblockq, target);
+
+    pa_cvolume_reset(volume, i->sink->sample_spec.channels);
+
+    return 0;
 }
 
 /* Called from thread context */
@@ -1040,6 +1205,13 @@ void pa_sink_input_drop(pa_sink_input *i, size_t nbytes /* in sink sample spec *
 #endif
 
     pa_memblockq_drop(i->thread_info.render_memblockq, nbytes);
+
+    if (i->thread_info.ramp_length > 0) {
+        i->thread_info.ramp_done += nbytes;
+
+        if (i->thread_info.ramp_done >= i->thread_info.ramp_length)
+            i->thread_info.ramp_length = i->thread_info.ramp_done = 0;
+    }
 }
 
 /* Called from thread context */
@@ -1074,9 +1246,16 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
 
     lbq = pa_memblockq_get_length(i->thread_info.render_memblockq);
 
+    if (nbytes > 0)
+        pa_sink_stats_add_rewind(&i->stats_lock, &i->stats, nbytes);
+
     if (nbytes > 0 && !i->thread_info.dont_rewind_render) {
         pa_log_debug("Have to rewind %lu bytes on render memblockq.", (unsigned long) nbytes);
         pa_memblockq_rewind(i->thread_info.render_memblockq, nbytes);
+
+        /* The ramp is replayed along with the data */
+        if (i->thread_info.ramp_length > 0)
+            i->thread_info.ramp_done -= PA_MIN(nbytes, i->thread_info.ramp_done);
     }
 
     if (i->thread_info.rewrite_nbytes == (size_t) -1) {
@@ -1291,7 +1470,7 @@ void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool s
     }
 }
 
-void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa_cvolume *volume_factor) {
+void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa_cvolume *volume_factor, bool send_msg) {
     struct volume_factor_entry *v;
 
     pa_sink_input_assert_ref(i);
@@ -1315,12 +1494,13 @@ void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa
     pa_sw_cvolume_multiply(&i->soft_volume, &i->real_ratio, &i->volume_factor);
 
     /* Copy the new soft_volume to the thread_info struct */
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
+    if (send_msg)
+        pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
 }
 
 /* Returns 0 if an entry was removed and -1 if no entry for the given key was
  * found. */
-int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key) {
+int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key, bool send_msg) {
     struct volume_factor_entry *v;
 
     pa_sink_input_assert_ref(i);
@@ -1346,11 +1526,23 @@ int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key) {
     pa_sw_cvolume_multiply(&i->soft_volume, &i->real_ratio, &i->volume_factor);
 
     /* Copy the new soft_volume to the thread_info struct */
-    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
+    if (send_msg)
+        pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME, NULL, 0, NULL) == 0);
 
     return 0;
 }
 
+/* Called from main context */
+void pa_sink_input_set_volume_ramp(pa_sink_input *i, pa_usec_t usec) {
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+
+    if (PA_SINK_INPUT_IS_LINKED(i->state) && i->sink)
+        pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_VOLUME_RAMP, &usec, 0, NULL) == 0);
+    else
+        i->thread_info.volume_ramp_usec = usec;
+}
+
 /* Called from main context */
 static void set_real_ratio(pa_sink_input *i, const pa_cvolume *v) {
     pa_sink_input_assert_ref(i);
@@ -1902,6 +2094,10 @@ int pa_sink_input_finish_move(pa_sink_input *i, pa_sink *dest, bool save) {
     if (pa_sink_input_is_passthrough(i))
         pa_sink_enter_passthrough(i->sink);
 
+    /* A ramp in progress is counted in bytes of the old sink, just let
+     * the new volume take effect */
+    i->thread_info.ramp_length = i->thread_info.ramp_done = 0;
+
     pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_FINISH_MOVE, i, 0, NULL) == 0);
 
     pa_log_debug("Successfully moved sink input %i to %s.", i->index, dest->name);
@@ -2016,6 +2212,54 @@ void pa_sink_input_set_state_within_thread(pa_sink_input *i, pa_sink_input_state
         i->thread_info.state = state;
 }
 
+/* Called from thread context */
+void pa_sink_input_set_soft_volume_within_thread(pa_sink_input *i, const pa_cvolume *soft_volume) {
+    pa_cvolume current;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert(soft_volume);
+
+    get_current_mix_volume(i, &current);
+
+    i->thread_info.soft_volume = *soft_volume;
+    update_mix_volume(i);
+
+    /* The ramp starts wherever the stream is now, which may be the
+     * middle of the previous one. Streams that don't have the sink's
+     * channel map get their volume applied before resampling, and
+     * can't ramp. */
+    if (i->thread_info.volume_ramp_usec > 0 &&
+        i->sink &&
+        pa_channel_map_equal(&i->channel_map, &i->sink->channel_map) &&
+        pa_cvolume_compatible(&current, &i->sink->sample_spec) &&
+        !pa_cvolume_equal(&current, &i->thread_info.mix_volume)) {
+
+        i->thread_info.ramp_volume = current;
+        i->thread_info.ramp_length = pa_usec_to_bytes(i->thread_info.volume_ramp_usec, &i->sink->sample_spec);
+        i->thread_info.ramp_done = 0;
+    } else
+        i->thread_info.ramp_length = i->thread_info.ramp_done = 0;
+
+    pa_sink_input_request_rewind(i, 0, true, false, false);
+}
+
+/* Called from thread context. Returns how many bytes (in sink sample
+ * spec) of a volume ramp are left from the read index on, and stores
+ * the volume the ramp is at there in volume, for pa_mix(). Returns 0 if
+ * there is no ramp in progress. */
+size_t pa_sink_input_get_volume_ramp(pa_sink_input *i, pa_cvolume *volume) {
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+    pa_assert(volume);
+
+    if (i->thread_info.ramp_length == 0 || i->thread_info.muted)
+        return 0;
+
+    get_current_mix_volume(i, volume);
+
+    return i->thread_info.ramp_length - i->thread_info.ramp_done;
+}
+
 /* Called from thread context, except when it is not. */
 int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_sink_input *i = PA_SINK_INPUT(o);
@@ -2024,10 +2268,8 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
     switch (code) {
 
         case PA_SINK_INPUT_MESSAGE_SET_SOFT_VOLUME:
-            if (!pa_cvolume_equal(&i->thread_info.soft_volume, &i->soft_volume)) {
-                i->thread_info.soft_volume = i->soft_volume;
-                pa_sink_input_request_rewind(i, 0, true, false, false);
-            }
+            if (!pa_cvolume_equal(&i->thread_info.soft_volume, &i->soft_volume))
+                pa_sink_input_set_soft_volume_within_thread(i, &i->soft_volume);
             return 0;
 
         case PA_SINK_INPUT_MESSAGE_SET_SOFT_MUTE:
@@ -2080,6 +2322,14 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
             *r = i->thread_info.requested_sink_latency;
             return 0;
         }
+
+        case PA_SINK_INPUT_MESSAGE_SET_VOLUME_RAMP:
+            i->thread_info.volume_ramp_usec = *(pa_usec_t *) userdata;
+
+            if (i->thread_info.volume_ramp_usec == 0)
+                i->thread_info.ramp_length = i->thread_info.ramp_done = 0;
+
+            return 0;
     }
 
     return -PA_ERR_NOTIMPLEMENTED;
@@ -2321,6 +2571,9 @@ void pa_sink_input_attach(pa_sink_input *i) {
 
     i->thread_info.attached = true;
 
+    /* The sink, and with it the volume factor, may have changed */
+    update_mix_volume(i);
+
     if (i->attach)
         i->attach(i);
 }
@@ -31,6 +31,7 @@
 #include <pulsecore/module.h>
 #include <pulsecore/client.h>
 #include <pulsecore/sink.h>
+#include <pulsecore/sink-stats.h>
 #include <pulsecore/core.h>
 
 typedef enum pa_sink_input_state {
@@ -123,6 +124,14 @@ struct pa_sink_input {
 
     pa_resample_method_t requested_resample_method, actual_resample_method;
 
+    /* Fill level of the render queue, updated from the IO thread */
+    pa_metric *queue_bytes_metric;
+
+    /* Only written by the IO thread, read them with
+     * pa_sink_input_get_stats() */
+    pa_seqlock stats_lock;
+    pa_sink_stats stats;
+
     /* Returns the chunk of audio data and drops it from the
      * queue. Returns -1 on failure. Called from IO thread context. If
      * data needs to be generated from scratch then please in the
@@ -132,6 +141,17 @@ struct pa_sink_input {
      * the full block. */
     int (*pop) (pa_sink_input *i, size_t request_nbytes, pa_memchunk *chunk); /* may NOT be NULL */
 
+    /* Like pop(), but writes the data directly into the writable
+     * chunk target, which is already in the sink's sample spec, and
+     * shortens target->length if less data is available. This lets
+     * filter sinks process into their master's buffer directly
+     * instead of handing out a block of their own. Only used while
+     * the stream needs no resampling or volume adjustment, see
+     * pa_sink_input_peek_into(). Returns -1 if the data can't be
+     * generated that way right now, in which case pop() is called
+     * instead. Called from IO thread context. */
+    int (*pop_into) (pa_sink_input *i, pa_memchunk *target); /* may be NULL */
+
     /* This is called when the playback buffer has actually played back
        all available data. Return true unless there is more data to play back.
        Called from IO context. */
@@ -228,6 +248,18 @@ struct pa_sink_input {
         pa_cvolume soft_volume;
         bool muted:1;
 
+        /* soft_volume combined with volume_factor_sink, handed to the
+         * sink to apply while mixing. See pa_sink_input_peek(). */
+        pa_cvolume mix_volume;
+
+        /* How long changes of mix_volume take, and the ramp currently
+         * in progress: it started at ramp_volume and reaches mix_volume
+         * after ramp_length bytes (in sink sample spec), ramp_done of
+         * which have been played. ramp_length is 0 if there is none. */
+        pa_usec_t volume_ramp_usec;
+        pa_cvolume ramp_volume;
+        size_t ramp_length, ramp_done;
+
         bool attached:1; /* True only between ->attach() and ->detach() calls */
 
         /* rewrite_nbytes: 0: rewrite nothing, (size_t) -1: rewrite everything, otherwise how many bytes to rewrite */
@@ -265,6 +297,7 @@ enum {
     PA_SINK_INPUT_MESSAGE_SET_STATE,
     PA_SINK_INPUT_MESSAGE_SET_REQUESTED_LATENCY,
     PA_SINK_INPUT_MESSAGE_GET_REQUESTED_LATENCY,
+    PA_SINK_INPUT_MESSAGE_SET_VOLUME_RAMP,
     PA_SINK_INPUT_MESSAGE_MAX
 };
 
@@ -361,12 +394,20 @@ size_t pa_sink_input_get_max_request(pa_sink_input *i);
 void pa_sink_input_kill(pa_sink_input*i);
 
 pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency);
+void pa_sink_input_get_stats(pa_sink_input *i, pa_sink_stats *stats);
 
 bool pa_sink_input_is_passthrough(pa_sink_input *i);
 bool pa_sink_input_is_volume_readable(pa_sink_input *i);
 void pa_sink_input_set_volume(pa_sink_input *i, const pa_cvolume *volume, bool save, bool absolute);
-void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa_cvolume *volume_factor);
-int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key);
+/* If send_msg is false the new soft volume only takes effect in the IO
+ * thread once PA_SINK_MESSAGE_SYNC_VOLUMES is sent to the sink, which
+ * lets callers changing many streams at once do so with one message */
+void pa_sink_input_add_volume_factor(pa_sink_input *i, const char *key, const pa_cvolume *volume_factor, bool send_msg);
+int pa_sink_input_remove_volume_factor(pa_sink_input *i, const char *key, bool send_msg);
+/* Makes all later changes of the soft volume ramp linearly over usec
+ * while mixing instead of taking effect at once. 0 turns ramping off.
+ * Only streams that have the sink's channel map can ramp. */
+void pa_sink_input_set_volume_ramp(pa_sink_input *i, pa_usec_t usec);
 pa_cvolume *pa_sink_input_get_volume(pa_sink_input *i, pa_cvolume *volume, bool absolute);
 
 void pa_sink_input_set_mute(pa_sink_input *i, bool mute, bool save);
@@ -397,12 +438,15 @@ pa_usec_t pa_sink_input_get_requested_latency(pa_sink_input *i);
 /* To be used exclusively by the sink driver IO thread */
 
 void pa_sink_input_peek(pa_sink_input *i, size_t length, pa_memchunk *chunk, pa_cvolume *volume);
+int pa_sink_input_peek_into(pa_sink_input *i, pa_memchunk *target, pa_cvolume *volume);
 void pa_sink_input_drop(pa_sink_input *i, size_t length);
 void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in the sink's sample spec */);
 void pa_sink_input_update_max_rewind(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */);
 void pa_sink_input_update_max_request(pa_sink_input *i, size_t nbytes  /* in the sink's sample spec */);
 
 void pa_sink_input_set_state_within_thread(pa_sink_input *i, pa_sink_input_state_t state);
+void pa_sink_input_set_soft_volume_within_thread(pa_sink_input *i, const pa_cvolume *soft_volume);
+size_t pa_sink_input_get_volume_ramp(pa_sink_input *i, pa_cvolume *volume);
 
 int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk);
 
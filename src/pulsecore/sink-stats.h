@@ -0,0 +1,75 @@
+#ifndef foopulsecoresinkstatshfoo
+#define foopulsecoresinkstatshfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/seqlock.h>
+
+/* Counters for attributing glitches to a sink or to one of its inputs.
+ * They are only modified by the IO thread, with the functions below, and
+ * read from the main thread with pa_sink_stats_read(). Sizes are in
+ * bytes of the sink's sample spec. */
+typedef struct pa_sink_stats {
+    uint32_t underruns;        /* Times a playing stream ran out of data */
+    uint64_t underrun_bytes;   /* Silence played instead */
+    uint32_t rewinds;
+    uint64_t rewind_bytes;
+    pa_usec_t max_render_usec; /* Longest time spent producing a block */
+} pa_sink_stats;
+
+/* started is true for the first block of silence of an underrun */
+static inline void pa_sink_stats_add_underrun(pa_seqlock *lock, pa_sink_stats *stats, bool started, size_t nbytes) {
+    pa_seqlock_write_begin(lock);
+    if (started)
+        stats->underruns++;
+    stats->underrun_bytes += nbytes;
+    pa_seqlock_write_end(lock);
+}
+
+static inline void pa_sink_stats_add_rewind(pa_seqlock *lock, pa_sink_stats *stats, size_t nbytes) {
+    pa_seqlock_write_begin(lock);
+    stats->rewinds++;
+    stats->rewind_bytes += nbytes;
+    pa_seqlock_write_end(lock);
+}
+
+static inline void pa_sink_stats_add_render_time(pa_seqlock *lock, pa_sink_stats *stats, pa_usec_t usec) {
+    /* We are the only writer, so reading without the lock is fine */
+    if (usec <= stats->max_render_usec)
+        return;
+
+    pa_seqlock_write_begin(lock);
+    stats->max_render_usec = usec;
+    pa_seqlock_write_end(lock);
+}
+
+static inline void pa_sink_stats_read(pa_seqlock *lock, const pa_sink_stats *stats, pa_sink_stats *copy) {
+    unsigned seq;
+
+    do {
+        seq = pa_seqlock_read_begin(lock);
+        *copy = *stats;
+    } while (pa_seqlock_read_retry(lock, seq));
+}
+
+#endif
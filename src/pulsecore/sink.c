@@ -46,9 +46,11 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/play-memblockq.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/trace.h>
 
 #include "sink.h"
 
+/* The number of inputs we can mix without allocating anything */
 #define MAX_MIX_CHANNELS 32
 #define MIX_BUFFER_LENGTH (pa_page_size())
 #define ABSOLUTE_MIN_LATENCY (500)
@@ -74,6 +76,8 @@ static void sink_free(pa_object *s);
 static void pa_sink_volume_change_push(pa_sink *s);
 static void pa_sink_volume_change_flush(pa_sink *s);
 static void pa_sink_volume_change_rewind(pa_sink *s, size_t nbytes);
+static void invalidate_latency_snapshot(pa_sink *s);
+static void reconsider_rate(pa_sink *s);
 
 pa_sink_new_data* pa_sink_new_data_init(pa_sink_new_data *data) {
     pa_assert(data);
@@ -164,6 +168,39 @@ static void reset_callbacks(pa_sink *s) {
     s->update_rate = NULL;
 }
 
+/* Called from IO thread context */
+static void render_done(pa_sink *s, pa_usec_t start) {
+    pa_usec_t usec = pa_rtclock_now() - start;
+
+    pa_metric_observe(s->metrics.render_time, usec);
+    pa_sink_stats_add_render_time(&s->stats_lock, &s->stats, usec);
+}
+
+/* Called from main context */
+static void register_metrics(pa_sink *s) {
+    pa_metrics *m = s->core->metrics;
+
+    s->metrics.render_time = pa_metrics_register(m, "pulseaudio_sink_render_seconds", PA_METRIC_HISTOGRAM,
+                                                 "Time spent rendering a block of audio.", "sink", s->name);
+    s->metrics.underruns = pa_metrics_register(m, "pulseaudio_sink_underruns_total", PA_METRIC_COUNTER,
+                                               "Number of times a playing stream ran out of data.", "sink", s->name);
+    s->metrics.rewinds = pa_metrics_register(m, "pulseaudio_sink_rewinds_total", PA_METRIC_COUNTER,
+                                             "Number of rewinds processed.", "sink", s->name);
+    s->metrics.rewound_bytes = pa_metrics_register(m, "pulseaudio_sink_rewound_bytes_total", PA_METRIC_COUNTER,
+                                                   "Number of bytes rewound.", "sink", s->name);
+    s->metrics.resampler_usec = pa_metrics_register(m, "pulseaudio_sink_resampler_usec_total", PA_METRIC_COUNTER,
+                                                    "Time spent resampling the streams of this sink, in usec.", "sink", s->name);
+}
+
+/* Called from main context */
+static void unregister_metrics(pa_sink *s) {
+    pa_metric_free(s->metrics.render_time);
+    pa_metric_free(s->metrics.underruns);
+    pa_metric_free(s->metrics.rewinds);
+    pa_metric_free(s->metrics.rewound_bytes);
+    pa_metric_free(s->metrics.resampler_usec);
+}
+
 /* Called from main context */
 pa_sink* pa_sink_new(
         pa_core *core,
@@ -255,6 +292,7 @@ pa_sink* pa_sink_new(
     s->suspend_cause = data->suspend_cause;
     pa_sink_set_mixer_dirty(s, false);
     s->name = pa_xstrdup(name);
+    register_metrics(s);
     s->proplist = pa_proplist_copy(data->proplist);
     s->driver = pa_xstrdup(pa_path_get_filename(data->driver));
     s->module = data->module;
@@ -329,10 +367,17 @@ pa_sink* pa_sink_new(
                                                 (pa_free_cb_t) pa_sink_input_unref);
     s->thread_info.soft_volume =  s->soft_volume;
     s->thread_info.soft_muted = s->muted;
+    s->thread_info.passthrough = false;
     s->thread_info.state = s->state;
     s->thread_info.rewind_nbytes = 0;
     s->thread_info.rewind_requested = false;
+    s->thread_info.move_batch = 0;
+    s->thread_info.move_rewind_nbytes = 0;
+    s->thread_info.move_rewind_requested = false;
+    s->thread_info.move_started = false;
+    s->thread_info.move_finished = false;
     s->thread_info.max_rewind = 0;
+    s->thread_info.rewind_horizon = (size_t) -1;
     s->thread_info.max_request = 0;
     s->thread_info.requested_latency_valid = false;
     s->thread_info.requested_latency = 0;
@@ -342,6 +387,9 @@ pa_sink* pa_sink_new(
 
     PA_LLIST_HEAD_INIT(pa_sink_volume_change, s->thread_info.volume_changes);
     s->thread_info.volume_changes_tail = NULL;
+    s->thread_info.render_buffer = NULL;
+    s->thread_info.mix_info = NULL;
+    s->thread_info.n_mix_info = 0;
     pa_sw_cvolume_multiply(&s->thread_info.current_hw_volume, &s->soft_volume, &s->real_volume);
     s->thread_info.volume_change_safety_margin = core->deferred_volume_safety_margin_usec;
     s->thread_info.volume_change_extra_delay = core->deferred_volume_extra_delay_usec;
@@ -739,6 +787,13 @@ static void sink_free(pa_object *o) {
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
+    if (s->thread_info.render_buffer)
+        pa_memblock_unref(s->thread_info.render_buffer);
+
+    pa_xfree(s->thread_info.mix_info);
+
+    unregister_metrics(s);
+
     pa_xfree(s->name);
     pa_xfree(s->driver);
 
@@ -816,14 +871,24 @@ void pa_sink_set_rtpoll(pa_sink *s, pa_rtpoll *p) {
 
 /* Called from main context */
 int pa_sink_update_status(pa_sink*s) {
+    bool was_running;
+    int r;
+
     pa_sink_assert_ref(s);
     pa_assert_ctl_context();
     pa_assert(PA_SINK_IS_LINKED(s->state));
 
+    was_running = s->state == PA_SINK_RUNNING;
+
     if (s->state == PA_SINK_SUSPENDED)
         return 0;
 
-    return sink_set_state(s, pa_sink_used_by(s) ? PA_SINK_RUNNING : PA_SINK_IDLE);
+    r = sink_set_state(s, pa_sink_used_by(s) ? PA_SINK_RUNNING : PA_SINK_IDLE);
+
+    if (r >= 0 && was_running && s->state == PA_SINK_IDLE)
+        reconsider_rate(s);
+
+    return r;
 }
 
 /* Called from any context - must be threadsafe */
@@ -890,6 +955,8 @@ pa_queue *pa_sink_move_all_start(pa_sink *s, pa_queue *q) {
     if (!q)
         q = pa_queue_new();
 
+    pa_sink_move_batch_begin(s);
+
     for (i = PA_SINK_INPUT(pa_idxset_first(s->inputs, &idx)); i; i = n) {
         n = PA_SINK_INPUT(pa_idxset_next(s->inputs, &idx));
 
@@ -901,6 +968,8 @@ pa_queue *pa_sink_move_all_start(pa_sink *s, pa_queue *q) {
             pa_sink_input_unref(i);
     }
 
+    pa_sink_move_batch_end(s);
+
     return q;
 }
 
@@ -913,6 +982,8 @@ void pa_sink_move_all_finish(pa_sink *s, pa_queue *q, bool save) {
     pa_assert(PA_SINK_IS_LINKED(s->state));
     pa_assert(q);
 
+    pa_sink_move_batch_begin(s);
+
     while ((i = PA_SINK_INPUT(pa_queue_pop(q)))) {
         if (pa_sink_input_finish_move(i, s, save) < 0)
             pa_sink_input_fail_move(i);
@@ -920,9 +991,29 @@ void pa_sink_move_all_finish(pa_sink *s, pa_queue *q, bool save) {
         pa_sink_input_unref(i);
     }
 
+    pa_sink_move_batch_end(s);
+
     pa_queue_free(q, NULL);
 }
 
+/* Called from main context */
+void pa_sink_move_batch_begin(pa_sink *s) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(PA_SINK_IS_LINKED(s->state));
+
+    pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_BEGIN_MOVE_BATCH, NULL, 0, NULL) == 0);
+}
+
+/* Called from main context */
+void pa_sink_move_batch_end(pa_sink *s) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(PA_SINK_IS_LINKED(s->state));
+
+    pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_END_MOVE_BATCH, NULL, 0, NULL) == 0);
+}
+
 /* Called from main context */
 void pa_sink_move_all_fail(pa_queue *q) {
     pa_sink_input *i;
@@ -1004,10 +1095,18 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     if (!s->thread_info.rewind_requested && nbytes <= 0)
         return;
 
+    pa_trace_instant(PA_TRACE_SINK_PROCESS_REWIND, (int64_t) nbytes);
+
+    pa_metric_inc(s->metrics.rewinds);
+    pa_metric_add(s->metrics.rewound_bytes, nbytes);
+    pa_sink_stats_add_rewind(&s->stats_lock, &s->stats, nbytes);
+
     s->thread_info.rewind_nbytes = 0;
     s->thread_info.rewind_requested = false;
 
     if (nbytes > 0) {
+        invalidate_latency_snapshot(s);
+
         pa_log_debug("Processing rewind...");
         if (s->flags & PA_SINK_DEFERRED_VOLUME)
             pa_sink_volume_change_rewind(s, nbytes);
@@ -1024,6 +1123,13 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     }
 }
 
+/* Called from IO thread context. Returns false if nothing attached to
+ * our monitor source would consume the mix right now, e.g. when only
+ * corked level meters are connected. */
+static bool monitor_needs_data(pa_sink *s) {
+    return s->monitor_source && pa_source_needs_post(s->monitor_source);
+}
+
 /* Called from IO thread context */
 static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, unsigned maxinfo) {
     pa_sink_input *i;
@@ -1039,6 +1145,7 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
         pa_sink_input_assert_ref(i);
 
         pa_sink_input_peek(i, *length, &info->chunk, &info->volume);
+        info->ramp_length = pa_sink_input_get_volume_ramp(i, &info->ramp_volume);
 
         if (mixlength == 0 || info->chunk.length < mixlength)
             mixlength = info->chunk.length;
@@ -1064,6 +1171,36 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
     return n;
 }
 
+/* Called from IO thread context. Returns an array that takes the mix
+ * info of all our inputs, which is stack_info unless there are more
+ * than MAX_MIX_CHANNELS of them. pa_mix() sums up any number of
+ * streams in one pass, so this is all it takes to mix them all. */
+static pa_mix_info *get_mix_info(pa_sink *s, pa_mix_info *stack_info, unsigned *maxinfo) {
+    unsigned n;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    n = pa_hashmap_size(s->thread_info.inputs);
+
+    if (n <= MAX_MIX_CHANNELS) {
+        *maxinfo = MAX_MIX_CHANNELS;
+        return stack_info;
+    }
+
+    if (n > s->thread_info.n_mix_info) {
+        /* Leave some room, so that we don't reallocate for every new
+         * input */
+        s->thread_info.n_mix_info = PA_MAX(n, s->thread_info.n_mix_info * 2);
+
+        pa_xfree(s->thread_info.mix_info);
+        s->thread_info.mix_info = pa_xnew(pa_mix_info, s->thread_info.n_mix_info);
+    }
+
+    *maxinfo = s->thread_info.n_mix_info;
+    return s->thread_info.mix_info;
+}
+
 /* Called from IO thread context */
 static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *result) {
     pa_sink_input *i;
@@ -1109,13 +1246,12 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
                 pa_memchunk c;
 
                 if (m && m->chunk.memblock) {
-                    c = m->chunk;
-                    pa_memblock_ref(c.memblock);
-                    pa_assert(result->length <= c.length);
-                    c.length = result->length;
+                    pa_memchunk t = m->chunk;
+
+                    pa_assert(result->length <= t.length);
+                    t.length = result->length;
 
-                    pa_memchunk_make_writable(&c, 0);
-                    pa_volume_memchunk(&c, &s->sample_spec, &m->volume);
+                    pa_volume_memchunk_copy(&c, &t, &s->sample_spec, &m->volume);
                 } else {
                     c = s->silence;
                     pa_memblock_ref(c.memblock);
@@ -1158,15 +1294,136 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
         }
     }
 
-    if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state))
+    if (monitor_needs_data(s))
         pa_source_post(s->monitor_source, result);
 }
 
+/* Called from IO thread context. If the sink has only one input and
+ * that one can write directly into our buffer (which is typically the
+ * case for filter sinks stacked on top of us), returns it. */
+static pa_sink_input *get_direct_input(pa_sink *s) {
+    pa_sink_input *i;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    if (pa_hashmap_size(s->thread_info.inputs) != 1)
+        return NULL;
+
+    /* The data is kept around for rewinding by the sink input, so we
+     * must not apply any volume on it afterwards */
+    if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume))
+        return NULL;
+
+    pa_assert_se(i = pa_hashmap_first(s->thread_info.inputs));
+    pa_sink_input_assert_ref(i);
+
+    return i->pop_into ? i : NULL;
+}
+
+/* Called from IO thread context. Lets i write into target, instead of
+ * having it hand us a block of its own that we'd have to copy. Fills in
+ * info just like fill_mix_info() would, so that the result can be
+ * passed on to inputs_drop(). */
+static bool render_direct(pa_sink *s, pa_sink_input *i, pa_memchunk *target, pa_mix_info *info) {
+    pa_sink_assert_ref(s);
+    pa_sink_input_assert_ref(i);
+
+    if (pa_sink_input_peek_into(i, target, &info->volume) < 0)
+        return false;
+
+    info->chunk = *target;
+    pa_memblock_ref(info->chunk.memblock);
+    info->ramp_length = 0;
+    info->userdata = pa_sink_input_ref(i);
+
+    return true;
+}
+
+/* Called from IO thread context */
+static void update_passthrough_within_thread(pa_sink *s) {
+    pa_sink_input *i;
+
+    s->thread_info.passthrough =
+        pa_hashmap_size(s->thread_info.inputs) == 1 &&
+        (i = pa_hashmap_first(s->thread_info.inputs)) &&
+        pa_sink_input_is_passthrough(i);
+}
+
+/* Called from IO thread context. A passthrough stream carries
+ * compressed data that has to reach the device bit exact, so there is
+ * nothing to mix and no volume to apply: hand out the stream's own
+ * block, without going through the mixing machinery at all. */
+static void render_passthrough(pa_sink *s, size_t length, pa_memchunk *result) {
+    pa_sink_input *i;
+    pa_cvolume volume;
+
+    pa_assert_se(i = pa_hashmap_first(s->thread_info.inputs));
+    pa_sink_input_assert_ref(i);
+
+    pa_sink_input_peek(i, length, result, &volume);
+
+    if (result->length > length)
+        result->length = length;
+
+    pa_sink_input_drop(i, result->length);
+}
+
+/* Called from IO thread context */
+static bool is_norm_volume(pa_sink *s, const pa_cvolume *stream_volume) {
+    pa_cvolume volume;
+
+    if (s->thread_info.soft_muted)
+        return false;
+
+    pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, stream_volume);
+    return pa_cvolume_is_norm(&volume);
+}
+
+/* Called from IO thread context */
+static bool is_muted_volume(pa_sink *s, const pa_cvolume *stream_volume) {
+    pa_cvolume volume;
+
+    if (s->thread_info.soft_muted)
+        return true;
+
+    pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, stream_volume);
+    return pa_cvolume_is_muted(&volume);
+}
+
+/* Called from IO thread context. Returns a new reference to a block of
+ * at least length bytes to render into. Whoever we gave the render
+ * buffer to last time has usually dropped it by now, in which case we
+ * don't need to allocate anything. */
+static pa_memblock *get_render_buffer(pa_sink *s, size_t length) {
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    if (s->thread_info.render_buffer &&
+        (pa_memblock_is_read_only(s->thread_info.render_buffer) ||
+         pa_memblock_get_length(s->thread_info.render_buffer) < length)) {
+        pa_memblock_unref(s->thread_info.render_buffer);
+        s->thread_info.render_buffer = NULL;
+    }
+
+    if (!s->thread_info.render_buffer)
+        s->thread_info.render_buffer = pa_memblock_new(s->core->mempool, PA_MAX(length, pa_mempool_block_size_max(s->core->mempool)));
+
+    /* Nobody else holds on to the buffer at this point. Rendering and
+     * writing it out to the device takes quite a few refs and acquires,
+     * which don't need to be atomic until the buffer is passed on. */
+    pa_memblock_set_thread_local(s->thread_info.render_buffer);
+
+    return pa_memblock_ref(s->thread_info.render_buffer);
+}
+
 /* Called from IO thread context */
 void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
-    unsigned n;
+    pa_mix_info stack_info[MAX_MIX_CHANNELS], *info = stack_info;
+    pa_sink_input *i;
+    unsigned n, maxinfo;
     size_t block_size_max;
+    pa_usec_t start;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1186,6 +1443,9 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_sink_ref(s);
 
+    pa_trace_begin(PA_TRACE_SINK_RENDER, (int64_t) length);
+    start = pa_rtclock_now();
+
     if (length <= 0)
         length = pa_frame_align(MIX_BUFFER_LENGTH, &s->sample_spec);
 
@@ -1195,7 +1455,33 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    if (s->thread_info.passthrough) {
+        render_passthrough(s, length, result);
+        render_done(s, start);
+        pa_trace_end(PA_TRACE_SINK_RENDER, (int64_t) result->length);
+        pa_sink_unref(s);
+        return;
+    }
+
+    if ((i = get_direct_input(s))) {
+        result->memblock = get_render_buffer(s, length);
+        result->index = 0;
+        result->length = length;
+
+        if (render_direct(s, i, result, info)) {
+            inputs_drop(s, info, 1, result);
+            render_done(s, start);
+        pa_trace_end(PA_TRACE_SINK_RENDER, (int64_t) result->length);
+            pa_sink_unref(s);
+            return;
+        }
+
+        pa_memblock_unref(result->memblock);
+        pa_memchunk_reset(result);
+    }
+
+    info = get_mix_info(s, stack_info, &maxinfo);
+    n = fill_mix_info(s, &length, info, maxinfo);
 
     if (n == 0) {
 
@@ -1205,31 +1491,29 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
         if (result->length > length)
             result->length = length;
 
-    } else if (n == 1) {
-        pa_cvolume volume;
+    } else if (n == 1 && info[0].ramp_length == 0 && is_norm_volume(s, &info[0].volume)) {
 
+        /* Nothing to do, just pass the stream's data on */
         *result = info[0].chunk;
         pa_memblock_ref(result->memblock);
 
         if (result->length > length)
             result->length = length;
 
-        pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
-
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume)) {
-            pa_memblock_unref(result->memblock);
-            pa_silence_memchunk_get(&s->core->silence_cache,
-                                    s->core->mempool,
-                                    result,
-                                    &s->sample_spec,
-                                    result->length);
-        } else if (!pa_cvolume_is_norm(&volume)) {
-            pa_memchunk_make_writable(result, 0);
-            pa_volume_memchunk(result, &s->sample_spec, &volume);
-        }
+    } else if (n == 1 && info[0].ramp_length == 0 && is_muted_volume(s, &info[0].volume)) {
+
+        pa_silence_memchunk_get(&s->core->silence_cache,
+                                s->core->mempool,
+                                result,
+                                &s->sample_spec,
+                                length);
     } else {
         void *ptr;
-        result->memblock = pa_memblock_new(s->core->mempool, length);
+
+        /* With a single stream this also covers applying the volume,
+         * which we then do while copying the data over, rather than
+         * on a copy of it */
+        result->memblock = get_render_buffer(s, length);
 
         ptr = pa_memblock_acquire(result->memblock);
         result->length = pa_mix(info, n,
@@ -1244,14 +1528,19 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     inputs_drop(s, info, n, result);
 
+    render_done(s, start);
+    pa_trace_end(PA_TRACE_SINK_RENDER, (int64_t) result->length);
+
     pa_sink_unref(s);
 }
 
 /* Called from IO thread context */
 void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
-    unsigned n;
+    pa_mix_info stack_info[MAX_MIX_CHANNELS], *info = stack_info;
+    pa_sink_input *i;
+    unsigned n, maxinfo;
     size_t length, block_size_max;
+    pa_usec_t start;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1270,6 +1559,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
     }
 
     pa_sink_ref(s);
+    start = pa_rtclock_now();
 
     length = target->length;
     block_size_max = pa_mempool_block_size_max(s->core->mempool);
@@ -1278,40 +1568,57 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    if (s->thread_info.passthrough) {
+        pa_memchunk chunk;
 
-    if (n == 0) {
+        /* Copied just once, straight into the target, which usually
+         * is the device's DMA buffer */
+        render_passthrough(s, length, &chunk);
+
+        target->length = chunk.length;
+
+        pa_memchunk_memcpy(target, &chunk);
+        pa_memblock_unref(chunk.memblock);
+
+        render_done(s, start);
+        pa_sink_unref(s);
+        return;
+    }
+
+    if ((i = get_direct_input(s))) {
         if (target->length > length)
             target->length = length;
 
-        pa_silence_memchunk(target, &s->sample_spec);
-    } else if (n == 1) {
-        pa_cvolume volume;
+        if (render_direct(s, i, target, info)) {
+            inputs_drop(s, info, 1, target);
+            render_done(s, start);
+            pa_sink_unref(s);
+            return;
+        }
+    }
+
+    info = get_mix_info(s, stack_info, &maxinfo);
+    n = fill_mix_info(s, &length, info, maxinfo);
 
+    if (n == 0) {
         if (target->length > length)
             target->length = length;
 
-        pa_sw_cvolume_multiply(&volume, &s->thread_info.soft_volume, &info[0].volume);
-
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&volume))
-            pa_silence_memchunk(target, &s->sample_spec);
-        else {
-            pa_memchunk vchunk;
+        pa_silence_memchunk(target, &s->sample_spec);
+    } else if (n == 1 && info[0].ramp_length == 0 && is_norm_volume(s, &info[0].volume)) {
+        pa_memchunk vchunk;
 
-            vchunk = info[0].chunk;
-            pa_memblock_ref(vchunk.memblock);
+        if (target->length > length)
+            target->length = length;
 
-            if (vchunk.length > length)
-                vchunk.length = length;
+        vchunk = info[0].chunk;
+        pa_memblock_ref(vchunk.memblock);
 
-            if (!pa_cvolume_is_norm(&volume)) {
-                pa_memchunk_make_writable(&vchunk, 0);
-                pa_volume_memchunk(&vchunk, &s->sample_spec, &volume);
-            }
+        if (vchunk.length > length)
+            vchunk.length = length;
 
-            pa_memchunk_memcpy(target, &vchunk);
-            pa_memblock_unref(vchunk.memblock);
-        }
+        pa_memchunk_memcpy(target, &vchunk);
+        pa_memblock_unref(vchunk.memblock);
 
     } else {
         void *ptr;
@@ -1329,6 +1636,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     inputs_drop(s, info, n, target);
 
+    render_done(s, start);
     pa_sink_unref(s);
 }
 
@@ -1357,6 +1665,32 @@ void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
 
     l = target->length;
     d = 0;
+
+    /* The monitor source holds on to what we rendered, after our caller
+     * is done with the target already. If the target is device memory
+     * that would mean reading it back, which is slow, so render into
+     * blocks of our own in that case and write the target just once. */
+    if (monitor_needs_data(s)) {
+        while (l > 0) {
+            pa_memchunk rchunk;
+
+            pa_sink_render(s, l, &rchunk);
+
+            chunk = *target;
+            chunk.index += d;
+            chunk.length = rchunk.length;
+
+            pa_memchunk_memcpy(&chunk, &rchunk);
+            pa_memblock_unref(rchunk.memblock);
+
+            d += chunk.length;
+            l -= chunk.length;
+        }
+
+        pa_sink_unref(s);
+        return;
+    }
+
     while (l > 0) {
         chunk = *target;
         chunk.index += d;
@@ -1404,16 +1738,119 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
     pa_sink_unref(s);
 }
 
+/* Rough estimate of the work needed to resample a stream of the given
+ * rate to the sink rate: proportional to the number of samples touched,
+ * and twice that if the rates don't share a base, i.e. one is from the
+ * 44.1 kHz family and the other from the 48 kHz one */
+static uint64_t resample_cost(uint32_t rate, uint8_t channels, uint32_t sink_rate) {
+    uint64_t cost;
+
+    if (rate == sink_rate)
+        return 0;
+
+    cost = (uint64_t) PA_MAX(rate, sink_rate) * channels;
+
+    if (!((rate % 11025 == 0 && sink_rate % 11025 == 0) ||
+          (rate % 4000 == 0 && sink_rate % 4000 == 0)))
+        cost *= 2;
+
+    return cost;
+}
+
 /* Called from main thread */
-int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough) {
+uint64_t pa_sink_get_resample_cost(pa_sink *s, uint32_t rate) {
+    pa_sink_input *i;
+    uint32_t idx;
+    uint64_t cost = 0;
+
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+
+    PA_IDXSET_FOREACH(i, s->inputs, idx) {
+        if (pa_sink_input_is_passthrough(i))
+            continue;
+
+        cost += resample_cost(i->sample_spec.rate, i->sample_spec.channels, rate);
+    }
+
+    return cost;
+}
+
+/* Picks whichever of the default and alternate rate needs the least
+ * resampling for the current inputs plus an optional new stream of
+ * extra_rate. Only moves away from the current rate if that saves at
+ * least a quarter of the work, so that streams coming and going don't
+ * make the sink flip back and forth. */
+static uint32_t pick_rate(pa_sink *s, uint32_t extra_rate, uint8_t extra_channels) {
+    uint32_t rates[2] = { s->default_sample_rate, s->alternate_sample_rate };
+    uint64_t current_cost, best_cost = 0;
+    uint32_t best_rate = s->sample_spec.rate;
+    unsigned n;
+
+    current_cost = pa_sink_get_resample_cost(s, s->sample_spec.rate);
+    if (extra_rate)
+        current_cost += resample_cost(extra_rate, extra_channels, s->sample_spec.rate);
+
+    for (n = 0; n < PA_ELEMENTSOF(rates); n++) {
+        uint64_t cost;
+
+        if (!rates[n] || rates[n] == s->sample_spec.rate)
+            continue;
+
+        cost = pa_sink_get_resample_cost(s, rates[n]);
+        if (extra_rate)
+            cost += resample_cost(extra_rate, extra_channels, rates[n]);
+
+        if (cost * 4 > current_cost * 3)
+            continue;
+
+        if (best_rate == s->sample_spec.rate || cost < best_cost) {
+            best_rate = rates[n];
+            best_cost = cost;
+        }
+    }
+
+    if (best_rate != s->sample_spec.rate)
+        pa_log_debug("Resampling cost on sink %s is %llu at %u Hz, %llu at %u Hz",
+                     s->name, (unsigned long long) current_cost, s->sample_spec.rate,
+                     (unsigned long long) best_cost, best_rate);
+
+    return best_rate;
+}
+
+/* Called from main thread */
+static int switch_rate(pa_sink *s, uint32_t desired_rate, bool passthrough) {
+    pa_sink_input *i;
+    uint32_t idx;
     int ret = -1;
+
+    pa_log_debug("Suspending sink %s due to changing the sample rate.", s->name);
+    pa_sink_suspend(s, true, PA_SUSPEND_INTERNAL);
+
+    if (s->update_rate(s, desired_rate) >= 0) {
+        /* update monitor source as well */
+        if (s->monitor_source && !passthrough)
+            pa_source_update_rate(s->monitor_source, desired_rate, false);
+        pa_log_info("Changed sampling rate successfully");
+
+        PA_IDXSET_FOREACH(i, s->inputs, idx) {
+            if (i->state == PA_SINK_INPUT_CORKED)
+                pa_sink_input_update_rate(i);
+        }
+
+        ret = 0;
+    }
+
+    pa_sink_suspend(s, false, PA_SUSPEND_INTERNAL);
+
+    return ret;
+}
+
+/* Called from main thread */
+int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough) {
     uint32_t desired_rate;
     uint32_t default_rate = s->default_sample_rate;
     uint32_t alternate_rate = s->alternate_sample_rate;
-    uint32_t idx;
-    pa_sink_input *i;
-    bool default_rate_is_usable = false;
-    bool alternate_rate_is_usable = false;
     bool avoid_resampling = s->core->avoid_resampling;
 
     if (rate == s->sample_spec.rate)
@@ -1451,25 +1888,13 @@ int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough) {
         /* We just try to set the sink input's sample rate if it's not too low */
         desired_rate = rate;
 
-    } else if (default_rate == rate || alternate_rate == rate) {
-        /* We can directly try to use this rate */
-        desired_rate = rate;
-
     } else {
-        /* See if we can pick a rate that results in less resampling effort */
-        if (default_rate % 11025 == 0 && rate % 11025 == 0)
-            default_rate_is_usable = true;
-        if (default_rate % 4000 == 0 && rate % 4000 == 0)
-            default_rate_is_usable = true;
-        if (alternate_rate && alternate_rate % 11025 == 0 && rate % 11025 == 0)
-            alternate_rate_is_usable = true;
-        if (alternate_rate && alternate_rate % 4000 == 0 && rate % 4000 == 0)
-            alternate_rate_is_usable = true;
-
-        if (alternate_rate_is_usable && !default_rate_is_usable)
-            desired_rate = alternate_rate;
-        else
-            desired_rate = default_rate;
+        /* Pick the rate that results in the least resampling effort over
+         * all streams, counting the new one on top of those already
+         * connected. A corked stream is expected to play again. We don't
+         * know the channel count of the new stream, so assume it matches
+         * the sink. */
+        desired_rate = pick_rate(s, rate, s->sample_spec.channels);
     }
 
     if (desired_rate == s->sample_spec.rate)
@@ -1478,26 +1903,110 @@ int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough) {
     if (!passthrough && pa_sink_used_by(s) > 0)
         return -1;
 
-    pa_log_debug("Suspending sink %s due to changing the sample rate.", s->name);
-    pa_sink_suspend(s, true, PA_SUSPEND_INTERNAL);
+    return switch_rate(s, desired_rate, passthrough);
+}
 
-    if (s->update_rate(s, desired_rate) >= 0) {
-        /* update monitor source as well */
-        if (s->monitor_source && !passthrough)
-            pa_source_update_rate(s->monitor_source, desired_rate, false);
-        pa_log_info("Changed sampling rate successfully");
+/* Called from main thread. When the last stream stops playing the sink
+ * may switch to the rate that suits the remaining, corked streams best
+ * before any of them starts again. */
+static void reconsider_rate(pa_sink *s) {
+    uint32_t desired_rate;
 
-        PA_IDXSET_FOREACH(i, s->inputs, idx) {
-            if (i->state == PA_SINK_INPUT_CORKED)
-                pa_sink_input_update_rate(i);
-        }
+    if (!s->update_rate || !s->alternate_sample_rate || s->core->avoid_resampling)
+        return;
 
-        ret = 0;
-    }
+    if (pa_idxset_isempty(s->inputs) || pa_sink_is_passthrough(s))
+        return;
 
-    pa_sink_suspend(s, false, PA_SUSPEND_INTERNAL);
+    if (s->monitor_source && PA_SOURCE_IS_RUNNING(s->monitor_source->state))
+        return;
 
-    return ret;
+    desired_rate = pick_rate(s, 0, 0);
+    if (desired_rate == s->sample_spec.rate)
+        return;
+
+    pa_log_info("Switching sink %s to %u Hz to reduce resampling", s->name, desired_rate);
+    switch_rate(s, desired_rate, false);
+}
+
+/* Called from main thread. Returns false if there is no usable snapshot,
+ * or the IO thread kept updating it while we tried to read it. */
+static bool get_latency_snapshot(pa_sink *s, pa_usec_t *usec) {
+    pa_usec_t latency, timestamp, valid_for, now;
+    unsigned seq, tries = 0;
+    bool valid;
+
+    do {
+        if (tries++ >= 3)
+            return false;
+
+        seq = pa_seqlock_read_begin(&s->latency_lock);
+
+        valid = s->latency_snapshot.valid;
+        latency = s->latency_snapshot.latency;
+        timestamp = s->latency_snapshot.timestamp;
+        valid_for = s->latency_snapshot.valid_for;
+    } while (pa_seqlock_read_retry(&s->latency_lock, seq));
+
+    if (!valid)
+        return false;
+
+    /* Once everything that was buffered at the time of the snapshot
+     * has been played, the IO thread must have written again, or there
+     * was an underrun. Either way the snapshot is of no use any more. */
+    now = pa_rtclock_now();
+    if (now < timestamp || now - timestamp >= valid_for)
+        return false;
+
+    *usec = latency - (now - timestamp);
+    return true;
+}
+
+/* Called from IO thread */
+static void invalidate_latency_snapshot(pa_sink *s) {
+    if (!s->latency_snapshot.valid)
+        return;
+
+    pa_seqlock_write_begin(&s->latency_lock);
+    s->latency_snapshot.valid = false;
+    pa_seqlock_write_end(&s->latency_lock);
+}
+
+/* Called from main thread */
+void pa_sink_get_stats(pa_sink *s, pa_sink_stats *stats) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+
+    pa_sink_stats_read(&s->stats_lock, &s->stats, stats);
+}
+
+/* Called from IO thread */
+void pa_sink_update_latency_snapshot(pa_sink *s, bool playing) {
+    pa_usec_t usec = 0;
+    pa_msgobject *o;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+    pa_assert(PA_SINK_IS_LINKED(s->thread_info.state));
+
+    if (!(s->flags & PA_SINK_LATENCY))
+        return;
+
+    o = PA_MSGOBJECT(s);
+
+    if (!playing || !PA_SINK_IS_OPENED(s->thread_info.state) ||
+        o->process_msg(o, PA_SINK_MESSAGE_GET_LATENCY, &usec, 0, NULL) < 0) {
+        invalidate_latency_snapshot(s);
+        return;
+    }
+
+    pa_seqlock_write_begin(&s->latency_lock);
+    s->latency_snapshot.latency = usec;
+    s->latency_snapshot.timestamp = pa_rtclock_now();
+    /* See get_latency_snapshot() */
+    s->latency_snapshot.valid_for = usec;
+    s->latency_snapshot.valid = true;
+    pa_seqlock_write_end(&s->latency_lock);
 }
 
 /* Called from main thread */
@@ -1516,7 +2025,8 @@ pa_usec_t pa_sink_get_latency(pa_sink *s) {
     if (!(s->flags & PA_SINK_LATENCY))
         return 0;
 
-    pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_GET_LATENCY, &usec, 0, NULL) == 0);
+    if (!get_latency_snapshot(s, &usec))
+        pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_GET_LATENCY, &usec, 0, NULL) == 0);
 
     /* usec is unsigned, so check that the offset can be added to usec without
      * underflowing. */
@@ -2009,6 +2519,105 @@ static bool update_reference_volume(pa_sink *s, const pa_cvolume *v, const pa_ch
     return true;
 }
 
+/* A copy of the soft volumes of all sinks and sink inputs in a volume
+ * sharing tree, so that the IO thread can apply them without the main
+ * thread waiting for it. input is NULL for the sink's own volume. */
+struct soft_volume_entry {
+    pa_sink *sink;
+    pa_sink_input *input;
+    pa_cvolume soft_volume;
+};
+
+struct soft_volumes {
+    unsigned n_entries;
+    struct soft_volume_entry entries[];
+};
+
+/* Called from main thread */
+static unsigned count_soft_volumes(pa_sink *s) {
+    pa_sink_input *i;
+    uint32_t idx;
+    unsigned n = 1;
+
+    PA_IDXSET_FOREACH(i, s->inputs, idx) {
+        n++;
+
+        if (i->origin_sink && (i->origin_sink->flags & PA_SINK_SHARE_VOLUME_WITH_MASTER))
+            n += count_soft_volumes(i->origin_sink);
+    }
+
+    return n;
+}
+
+/* Called from main thread */
+static void collect_soft_volumes(pa_sink *s, struct soft_volumes *v) {
+    pa_sink_input *i;
+    uint32_t idx;
+    struct soft_volume_entry *e;
+
+    e = &v->entries[v->n_entries++];
+    e->sink = s;
+    e->input = NULL;
+    e->soft_volume = s->soft_volume;
+
+    PA_IDXSET_FOREACH(i, s->inputs, idx) {
+        e = &v->entries[v->n_entries++];
+        e->sink = s;
+        e->input = i;
+        e->soft_volume = i->soft_volume;
+
+        if (i->origin_sink && (i->origin_sink->flags & PA_SINK_SHARE_VOLUME_WITH_MASTER))
+            collect_soft_volumes(i->origin_sink, v);
+    }
+}
+
+/* Called from main thread. Hands the soft volumes of the whole volume
+ * sharing tree to the IO thread in one asynchronous message. Only
+ * valid for root sinks without deferred volume, where applying the
+ * volumes doesn't involve the implementor. */
+static void post_soft_volumes(pa_sink *root_sink) {
+    struct soft_volumes *v;
+    unsigned n;
+
+    pa_assert(!(root_sink->flags & PA_SINK_DEFERRED_VOLUME));
+
+    n = count_soft_volumes(root_sink);
+    v = pa_xmalloc(sizeof(struct soft_volumes) + n * sizeof(struct soft_volume_entry));
+    v->n_entries = 0;
+
+    collect_soft_volumes(root_sink, v);
+    pa_assert(v->n_entries == n);
+
+    pa_asyncmsgq_post(root_sink->asyncmsgq, PA_MSGOBJECT(root_sink), PA_SINK_MESSAGE_APPLY_SOFT_VOLUMES, v, 0, NULL, pa_xfree);
+}
+
+/* Called from IO thread */
+static void apply_soft_volumes_within_thread(struct soft_volumes *v) {
+    unsigned k;
+
+    for (k = 0; k < v->n_entries; k++) {
+        struct soft_volume_entry *e = &v->entries[k];
+
+        if (!e->input) {
+            if (!pa_cvolume_equal(&e->sink->thread_info.soft_volume, &e->soft_volume)) {
+                e->sink->thread_info.soft_volume = e->soft_volume;
+                pa_sink_request_rewind(e->sink, (size_t) -1);
+            }
+
+            continue;
+        }
+
+        /* Messages are processed in order, so an input that is unlinked
+         * or moved after we were posted is still here, but one that
+         * wasn't attached yet when we were posted may not be */
+        if (!pa_hashmap_get(e->sink->thread_info.inputs, PA_UINT32_TO_PTR(e->input->index)))
+            continue;
+
+        if (!pa_cvolume_equal(&e->input->thread_info.soft_volume, &e->soft_volume))
+            pa_sink_input_set_soft_volume_within_thread(e->input, &e->soft_volume);
+    }
+}
+
 /* Called from main thread */
 void pa_sink_set_volume(
         pa_sink *s,
@@ -2100,8 +2709,14 @@ void pa_sink_set_volume(
         root_sink->soft_volume = root_sink->real_volume;
 
     /* This tells the sink that soft volume and/or real volume changed */
-    if (send_msg)
-        pa_assert_se(pa_asyncmsgq_send(root_sink->asyncmsgq, PA_MSGOBJECT(root_sink), PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL) == 0);
+    if (send_msg) {
+        if (root_sink->flags & PA_SINK_DEFERRED_VOLUME)
+            /* The IO thread will call set_volume(), which looks at our
+             * volumes, so we have to wait for it */
+            pa_assert_se(pa_asyncmsgq_send(root_sink->asyncmsgq, PA_MSGOBJECT(root_sink), PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL) == 0);
+        else
+            post_soft_volumes(root_sink);
+    }
 }
 
 /* Called from the io thread if sync volume is used, otherwise from the main thread.
@@ -2451,8 +3066,7 @@ static void sync_input_volumes_within_thread(pa_sink *s) {
         if (pa_cvolume_equal(&i->thread_info.soft_volume, &i->soft_volume))
             continue;
 
-        i->thread_info.soft_volume = i->soft_volume;
-        pa_sink_input_request_rewind(i, 0, true, false, false);
+        pa_sink_input_set_soft_volume_within_thread(i, &i->soft_volume);
     }
 }
 
@@ -2472,6 +3086,17 @@ static void set_shared_volume_within_thread(pa_sink *s) {
     }
 }
 
+/* Called from IO thread, while a move batch is open */
+static void move_batch_request_rewind(pa_sink *s, size_t nbytes) {
+    if (nbytes == (size_t) -1)
+        nbytes = s->thread_info.max_rewind;
+
+    if (!s->thread_info.move_rewind_requested || nbytes > s->thread_info.move_rewind_nbytes)
+        s->thread_info.move_rewind_nbytes = nbytes;
+
+    s->thread_info.move_rewind_requested = true;
+}
+
 /* Called from IO thread, except when it is not */
 int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_sink *s = PA_SINK(o);
@@ -2487,6 +3112,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
              * PA_SINK_MESSAGE_FINISH_MOVE, too. */
 
             pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
+            update_passthrough_within_thread(s);
 
             /* Since the caller sleeps in pa_sink_input_put(), we can
              * safely access data outside of thread_info even though
@@ -2568,6 +3194,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             }
 
             pa_hashmap_remove_and_free(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index));
+            update_passthrough_within_thread(s);
             pa_sink_invalidate_requested_latency(s, true);
             pa_sink_request_rewind(s, (size_t) -1);
 
@@ -2645,6 +3272,13 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
 
             /* Let's remove the sink input ...*/
             pa_hashmap_remove_and_free(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index));
+            update_passthrough_within_thread(s);
+
+            if (s->thread_info.move_batch > 0) {
+                move_batch_request_rewind(s, (size_t) -1);
+                s->thread_info.move_started = true;
+                return 0;
+            }
 
             pa_sink_invalidate_requested_latency(s, true);
 
@@ -2666,6 +3300,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             pa_assert(!i->thread_info.sync_prev);
 
             pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
+            update_passthrough_within_thread(s);
 
             pa_sink_input_attach(i);
 
@@ -2698,8 +3333,21 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
                 if (nbytes > 0)
                     pa_sink_input_drop(i, nbytes);
 
-                pa_log_debug("Requesting rewind due to finished move");
-                pa_sink_request_rewind(s, nbytes);
+                if (s->thread_info.move_batch > 0)
+                    move_batch_request_rewind(s, nbytes);
+                else {
+                    pa_log_debug("Requesting rewind due to finished move");
+                    pa_sink_request_rewind(s, nbytes);
+                }
+            }
+
+            pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
+            pa_sink_input_update_max_request(i, s->thread_info.max_request);
+
+            /* The requested latency is updated when the batch ends */
+            if (s->thread_info.move_batch > 0) {
+                s->thread_info.move_finished = true;
+                return 0;
             }
 
             /* Updating the requested sink latency has to be done
@@ -2710,9 +3358,6 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             if (i->thread_info.requested_sink_latency != (pa_usec_t) -1)
                 pa_sink_input_set_requested_latency_within_thread(i, i->thread_info.requested_sink_latency);
 
-            pa_sink_input_update_max_rewind(i, s->thread_info.max_rewind);
-            pa_sink_input_update_max_request(i, s->thread_info.max_request);
-
             return o->process_msg(o, PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL);
         }
 
@@ -2725,6 +3370,10 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             return 0;
         }
 
+        case PA_SINK_MESSAGE_APPLY_SOFT_VOLUMES:
+            apply_soft_volumes_within_thread(userdata);
+            return 0;
+
         case PA_SINK_MESSAGE_SET_VOLUME_SYNCED:
 
             if (s->flags & PA_SINK_DEFERRED_VOLUME) {
@@ -2789,6 +3438,8 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
 
             s->thread_info.state = PA_PTR_TO_UINT(userdata);
 
+            invalidate_latency_snapshot(s);
+
             if (s->thread_info.state == PA_SINK_SUSPENDED) {
                 s->thread_info.rewind_nbytes = 0;
                 s->thread_info.rewind_requested = false;
@@ -2892,6 +3543,49 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             s->thread_info.port_latency_offset = offset;
             return 0;
 
+        case PA_SINK_MESSAGE_BEGIN_MOVE_BATCH:
+            s->thread_info.move_batch++;
+            return 0;
+
+        case PA_SINK_MESSAGE_END_MOVE_BATCH: {
+            pa_sink_input *i;
+            void *state = NULL;
+            bool update_volume;
+
+            pa_assert(s->thread_info.move_batch > 0);
+
+            if (--s->thread_info.move_batch > 0)
+                return 0;
+
+            if (s->thread_info.move_rewind_requested) {
+                pa_log_debug("Requesting rewind due to moved streams");
+                pa_sink_request_rewind(s, s->thread_info.move_rewind_nbytes);
+            }
+
+            /* Like for a single move, the requested latency is updated
+             * only after the rewind has been requested */
+            if (s->thread_info.move_finished) {
+                PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state)
+                    if (i->thread_info.requested_sink_latency != (pa_usec_t) -1)
+                        pa_sink_input_set_requested_latency_within_thread(i, i->thread_info.requested_sink_latency);
+            }
+
+            if (s->thread_info.move_started)
+                pa_sink_invalidate_requested_latency(s, true);
+
+            update_volume = s->thread_info.move_started || s->thread_info.move_finished;
+
+            s->thread_info.move_rewind_nbytes = 0;
+            s->thread_info.move_rewind_requested = false;
+            s->thread_info.move_started = false;
+            s->thread_info.move_finished = false;
+
+            if (update_volume)
+                return o->process_msg(o, PA_SINK_MESSAGE_SET_SHARED_VOLUME, NULL, 0, NULL);
+
+            return 0;
+        }
+
         case PA_SINK_MESSAGE_GET_LATENCY:
         case PA_SINK_MESSAGE_MAX:
             ;
@@ -3037,6 +3731,8 @@ void pa_sink_set_max_rewind_within_thread(pa_sink *s, size_t max_rewind) {
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
 
+    max_rewind = PA_MIN(max_rewind, s->thread_info.rewind_horizon);
+
     if (max_rewind == s->thread_info.max_rewind)
         return;
 
@@ -3061,6 +3757,25 @@ void pa_sink_set_max_rewind(pa_sink *s, size_t max_rewind) {
         pa_sink_set_max_rewind_within_thread(s, max_rewind);
 }
 
+/* Called from main thread, before the sink is put. Filter sinks whose
+ * processing is expensive to redo or can't be undone at all (e.g. FFT
+ * based ones) declare here how much they may be rewound. Since the
+ * max_rewind of a filter sink is derived from the one of its sink input,
+ * everything stacked on top of it is held to the same horizon, and a
+ * rewind on the master never re-renders more than that through it. */
+void pa_sink_set_rewind_horizon(pa_sink *s, pa_usec_t horizon) {
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+    pa_assert(!PA_SINK_IS_LINKED(s->state));
+
+    if (horizon == (pa_usec_t) -1)
+        s->thread_info.rewind_horizon = (size_t) -1;
+    else
+        s->thread_info.rewind_horizon = pa_usec_to_bytes(horizon, &s->sample_spec);
+
+    s->thread_info.max_rewind = PA_MIN(s->thread_info.max_rewind, s->thread_info.rewind_horizon);
+}
+
 /* Called from IO as well as the main thread -- the latter only before the IO thread started up */
 void pa_sink_set_max_request_within_thread(pa_sink *s, size_t max_request) {
     void *state = NULL;
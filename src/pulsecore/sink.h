@@ -37,6 +37,9 @@
 #include <pulsecore/module.h>
 #include <pulsecore/asyncmsgq.h>
 #include <pulsecore/msgobject.h>
+#include <pulsecore/seqlock.h>
+#include <pulsecore/metrics.h>
+#include <pulsecore/sink-stats.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/device-port.h>
 #include <pulsecore/card.h>
@@ -120,6 +123,30 @@ struct pa_sink {
     /* The latency offset is inherited from the currently active port */
     int64_t port_latency_offset;
 
+    /* The latency as last published by the IO thread, so that the main
+     * thread can read it without a round trip to the IO thread. See
+     * pa_sink_update_latency_snapshot(). */
+    pa_seqlock latency_lock;
+    struct {
+        pa_usec_t latency;
+        pa_usec_t timestamp;
+        pa_usec_t valid_for;
+        bool valid;
+    } latency_snapshot;
+
+    /* Updated from the IO thread only, see metrics.h */
+    struct {
+        pa_metric *render_time;
+        pa_metric *underruns;
+        pa_metric *rewinds;
+        pa_metric *rewound_bytes;
+        pa_metric *resampler_usec;
+    } metrics;
+
+    /* Only written by the IO thread, read them with pa_sink_get_stats() */
+    pa_seqlock stats_lock;
+    pa_sink_stats stats;
+
     unsigned priority;
 
     bool set_mute_in_progress;
@@ -259,6 +286,9 @@ struct pa_sink {
         pa_cvolume soft_volume;
         bool soft_muted:1;
 
+        /* Set while the only input is a passthrough stream */
+        bool passthrough:1;
+
         /* The requested latency is used for dynamic latency
          * sinks. For fixed latency sinks it is always identical to
          * the fixed_latency. See below. */
@@ -269,6 +299,12 @@ struct pa_sink {
          * be able to satisfy every DMA buffer rewrite */
         size_t max_rewind;
 
+        /* How far back this sink may be rewound at all, (size_t) -1 if
+         * there's no limit. Caps max_rewind, and through that the
+         * rewinds of every stream and filter sink below this one. See
+         * pa_sink_set_rewind_horizon(). */
+        size_t rewind_horizon;
+
         /* The number of bytes streams need to keep around to satisfy
          * every DMA write request */
         size_t max_request;
@@ -277,6 +313,15 @@ struct pa_sink {
         size_t rewind_nbytes;
         bool rewind_requested;
 
+        /* While a move batch is open, the rewind and the updates that
+         * moving streams in and out would trigger are collected here and
+         * done once the batch ends. See pa_sink_move_batch_begin(). */
+        unsigned move_batch;
+        size_t move_rewind_nbytes;
+        bool move_rewind_requested:1;
+        bool move_started:1;
+        bool move_finished:1;
+
         /* Both dynamic and fixed latencies will be clamped to this
          * range. */
         pa_usec_t min_latency; /* we won't go below this latency */
@@ -304,6 +349,16 @@ struct pa_sink {
         uint32_t volume_change_safety_margin;
         /* Usec delay added to all volume change events, may be negative. */
         int32_t volume_change_extra_delay;
+
+        /* Mixing happens into this block, which is reused for every
+         * render cycle as long as nobody else holds a reference to
+         * it */
+        pa_memblock *render_buffer;
+
+        /* Mix info for when there are more inputs than fit into the
+         * array on the stack, grown as needed */
+        struct pa_mix_info *mix_info;
+        unsigned n_mix_info;
     } thread_info;
 
     void *userdata;
@@ -338,6 +393,9 @@ typedef enum pa_sink_message {
     PA_SINK_MESSAGE_SET_PORT,
     PA_SINK_MESSAGE_UPDATE_VOLUME_AND_MUTE,
     PA_SINK_MESSAGE_SET_PORT_LATENCY_OFFSET,
+    PA_SINK_MESSAGE_BEGIN_MOVE_BATCH,
+    PA_SINK_MESSAGE_END_MOVE_BATCH,
+    PA_SINK_MESSAGE_APPLY_SOFT_VOLUMES,
     PA_SINK_MESSAGE_MAX
 } pa_sink_message_t;
 
@@ -406,6 +464,7 @@ void pa_sink_set_rtpoll(pa_sink *s, pa_rtpoll *p);
 
 void pa_sink_set_max_rewind(pa_sink *s, size_t max_rewind);
 void pa_sink_set_max_request(pa_sink *s, size_t max_request);
+void pa_sink_set_rewind_horizon(pa_sink *s, pa_usec_t horizon);
 void pa_sink_set_latency_range(pa_sink *s, pa_usec_t min_latency, pa_usec_t max_latency);
 void pa_sink_set_fixed_latency(pa_sink *s, pa_usec_t latency);
 
@@ -423,10 +482,13 @@ unsigned pa_device_init_priority(pa_proplist *p);
 /**** May be called by everyone, from main context */
 
 int pa_sink_update_rate(pa_sink *s, uint32_t rate, bool passthrough);
+/* Estimated resampling work for all current inputs if the sink ran at the given rate */
+uint64_t pa_sink_get_resample_cost(pa_sink *s, uint32_t rate);
 void pa_sink_set_port_latency_offset(pa_sink *s, int64_t offset);
 
 /* The returned value is supposed to be in the time domain of the sound card! */
 pa_usec_t pa_sink_get_latency(pa_sink *s);
+void pa_sink_get_stats(pa_sink *s, pa_sink_stats *stats);
 pa_usec_t pa_sink_get_requested_latency(pa_sink *s);
 void pa_sink_get_latency_range(pa_sink *s, pa_usec_t *min_latency, pa_usec_t *max_latency);
 pa_usec_t pa_sink_get_fixed_latency(pa_sink *s);
@@ -481,6 +543,12 @@ pa_queue *pa_sink_move_all_start(pa_sink *s, pa_queue *q);
 void pa_sink_move_all_finish(pa_sink *s, pa_queue *q, bool save);
 void pa_sink_move_all_fail(pa_queue *q);
 
+/* Moving a stream in or out makes the sink rewind. When moving many
+ * streams at once, bracket the moves with these, so that the sink
+ * rewinds only once at the end. Calls may be nested. */
+void pa_sink_move_batch_begin(pa_sink *s);
+void pa_sink_move_batch_end(pa_sink *s);
+
 /* Returns a copy of the sink formats. TODO: Get rid of this function (or at
  * least get rid of the copying). There's no good reason to copy the formats
  * every time someone wants to know what formats the sink supports. The formats
@@ -520,6 +588,16 @@ bool pa_sink_volume_change_apply(pa_sink *s, pa_usec_t *usec_to_next);
 
 size_t pa_sink_process_input_underruns(pa_sink *s, size_t left_to_play);
 
+/* Publishes the current latency for pa_sink_get_latency(), which then
+ * extrapolates it instead of asking the IO thread. Drivers that call this
+ * must do so every time after they wrote to the device, with playing
+ * set to false while the device isn't actually playing yet, e.g. before
+ * it was started or after an underrun. Until the data that was buffered
+ * at that time has been played, the published value is taken to be
+ * current minus the time passed. Rewinds and state changes invalidate
+ * it. */
+void pa_sink_update_latency_snapshot(pa_sink *s, bool playing);
+
 /*** To be called exclusively by sink input drivers, from IO context */
 
 void pa_sink_request_rewind(pa_sink*s, size_t nbytes);
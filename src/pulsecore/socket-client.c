@@ -39,6 +39,10 @@
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+#include <sys/socket.h>
+#include <linux/vm_sockets.h>
+#endif
 
 #ifdef HAVE_LIBASYNCNS
 #include <asyncns.h>
@@ -242,6 +246,27 @@ pa_socket_client* pa_socket_client_new_unix(pa_mainloop_api *m, const char *file
 #endif /* HAVE_SYS_UN_H */
 }
 
+/* Connects to a virtual machine, or from one to its host, via
+ * AF_VSOCK */
+pa_socket_client* pa_socket_client_new_vsock(pa_mainloop_api *m, uint32_t cid, uint32_t port) {
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+    struct sockaddr_vm sa;
+
+    pa_assert(m);
+    pa_assert(port > 0);
+
+    pa_zero(sa);
+    sa.svm_family = AF_VSOCK;
+    sa.svm_cid = cid;
+    sa.svm_port = port;
+
+    return pa_socket_client_new_sockaddr(m, (struct sockaddr*) &sa, sizeof(sa));
+#else /* HAVE_LINUX_VM_SOCKETS_H */
+
+    return NULL;
+#endif /* HAVE_LINUX_VM_SOCKETS_H */
+}
+
 static int sockaddr_prepare(pa_socket_client *c, const struct sockaddr *sa, size_t salen) {
     pa_assert(c);
     pa_assert(sa);
@@ -460,6 +485,20 @@ pa_socket_client* pa_socket_client_new_string(pa_mainloop_api *m, bool use_rtclo
                 start_timeout(c, use_rtclock);
             break;
 
+        case PA_PARSED_ADDRESS_VSOCK: {
+            uint32_t cid;
+
+            /* The host always has context ID 2, VMADDR_CID_HOST */
+            if (pa_streq(a.path_or_host, "host"))
+                cid = 2;
+            else if (pa_atou(a.path_or_host, &cid) < 0)
+                break;
+
+            if ((c = pa_socket_client_new_vsock(m, cid, a.port)))
+                start_timeout(c, use_rtclock);
+            break;
+        }
+
         case PA_PARSED_ADDRESS_TCP4:  /* Fallthrough */
         case PA_PARSED_ADDRESS_TCP6:  /* Fallthrough */
         case PA_PARSED_ADDRESS_TCP_AUTO: {
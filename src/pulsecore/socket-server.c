@@ -40,6 +40,11 @@
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <linux/vm_sockets.h>
+#endif
 
 #ifdef HAVE_LIBWRAP
 #include <tcpd.h>
@@ -87,7 +92,8 @@ struct pa_socket_server {
     enum {
         SOCKET_SERVER_IPV4,
         SOCKET_SERVER_UNIX,
-        SOCKET_SERVER_IPV6
+        SOCKET_SERVER_IPV6,
+        SOCKET_SERVER_VSOCK
     } type;
 };
 
@@ -478,6 +484,50 @@ pa_socket_server* pa_socket_server_new_ipv6_string(pa_mainloop_api *m, const cha
 }
 #endif
 
+/* Listens for connections from virtual machines, or from the host if we
+ * run in one, on any context ID */
+pa_socket_server* pa_socket_server_new_vsock(pa_mainloop_api *m, uint32_t port) {
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+    pa_socket_server *ss;
+    int fd;
+    struct sockaddr_vm sa;
+
+    pa_assert(m);
+    pa_assert(port > 0);
+
+    if ((fd = pa_socket_cloexec(AF_VSOCK, SOCK_STREAM, 0)) < 0) {
+        pa_log("socket(AF_VSOCK): %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    pa_zero(sa);
+    sa.svm_family = AF_VSOCK;
+    sa.svm_cid = VMADDR_CID_ANY;
+    sa.svm_port = port;
+
+    if (bind(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+        pa_log("bind(): %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if (listen(fd, 5) < 0) {
+        pa_log("listen(): %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    pa_assert_se(ss = socket_server_new(m, fd));
+    ss->type = SOCKET_SERVER_VSOCK;
+
+    return ss;
+
+fail:
+    if (fd >= 0)
+        pa_close(fd);
+#endif /* HAVE_LINUX_VM_SOCKETS_H */
+
+    return NULL;
+}
+
 static void socket_server_free(pa_socket_server*s) {
     pa_assert(s);
 
@@ -607,6 +657,34 @@ char *pa_socket_server_get_address(pa_socket_server *s, char *c, size_t l) {
             return c;
         }
 
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+        case SOCKET_SERVER_VSOCK: {
+            struct sockaddr_vm sa;
+            socklen_t sa_len = sizeof(sa);
+            unsigned cid;
+            int fd;
+
+            if (getsockname(s->fd, (struct sockaddr*) &sa, &sa_len) < 0) {
+                pa_log("getsockname(): %s", pa_cstrerror(errno));
+                return NULL;
+            }
+
+            /* We are bound to any context ID, so ask for our own */
+            if ((fd = pa_open_cloexec("/dev/vsock", O_RDONLY, 0)) < 0)
+                return NULL;
+
+            if (ioctl(fd, IOCTL_VM_SOCKETS_GET_LOCAL_CID, &cid) < 0) {
+                pa_close(fd);
+                return NULL;
+            }
+
+            pa_close(fd);
+
+            pa_snprintf(c, l, "vsock:%u:%u", cid, (unsigned) sa.svm_port);
+            return c;
+        }
+#endif
+
         default:
             return NULL;
     }
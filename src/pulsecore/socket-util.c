@@ -50,6 +50,10 @@
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+#include <sys/socket.h>
+#include <linux/vm_sockets.h>
+#endif
 #ifdef HAVE_SYSTEMD_DAEMON
 #include <systemd/sd-daemon.h>
 #endif
@@ -87,6 +91,9 @@ void pa_socket_peer_to_string(int fd, char *c, size_t l) {
 #endif
 #ifdef HAVE_SYS_UN_H
             struct sockaddr_un un;
+#endif
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+            struct sockaddr_vm vm;
 #endif
         } sa;
         socklen_t sa_len = sizeof(sa);
@@ -118,6 +125,11 @@ void pa_socket_peer_to_string(int fd, char *c, size_t l) {
             } else if (sa.sa.sa_family == AF_UNIX) {
                 pa_snprintf(c, l, "UNIX socket client");
                 return;
+#endif
+#ifdef HAVE_LINUX_VM_SOCKETS_H
+            } else if (sa.sa.sa_family == AF_VSOCK) {
+                pa_snprintf(c, l, "VSOCK client from context %u", (unsigned) sa.vm.svm_cid);
+                return;
 #endif
             }
         }
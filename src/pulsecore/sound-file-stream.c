@@ -31,6 +31,7 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-error.h>
 #include <pulsecore/sink-input.h>
@@ -39,18 +40,42 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/mix.h>
 #include <pulsecore/sndfile-util.h>
+#include <pulsecore/asyncq.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/atomic.h>
 
 #include "sound-file-stream.h"
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+/* The decoder thread stays up to PREFETCH_USEC ahead of playback, in
+ * blocks of BLOCK_USEC, so that a slow disk or network file system
+ * stalls the decoder and not the sink's IO thread. */
+#define PREFETCH_USEC (2*PA_USEC_PER_SEC)
+#define BLOCK_USEC (50*PA_USEC_PER_MSEC)
+
+/* Must be a power of two not smaller than PREFETCH_USEC/BLOCK_USEC */
+#define PREFETCH_QUEUE_SIZE 64
+
 typedef struct file_stream {
     pa_msgobject parent;
     pa_core *core;
     pa_sink_input *sink_input;
 
+    /* Only touched by the decoder thread while it is running */
     SNDFILE *sndfile;
     sf_count_t (*readf_function)(SNDFILE *sndfile, void *ptr, sf_count_t frames);
+    size_t frame_size, block_size;
+
+    /* Decoded memblocks on their way from the decoder thread to the IO
+     * thread. The decoder sleeps on 'space' once 'queued' reaches
+     * 'prefetch_blocks' and is woken when it drops to half of that. */
+    pa_thread *thread;
+    pa_asyncq *prefetch;
+    pa_fdsem *space;
+    pa_atomic_t queued, eof, quit;
+    unsigned prefetch_blocks;
 
     /* We need this memblockq here to easily fulfill rewind requests
      * (even beyond the file start!) */
@@ -84,6 +109,19 @@ static void file_stream_free(pa_object *o) {
     file_stream *u = FILE_STREAM(o);
     pa_assert(u);
 
+    if (u->thread) {
+        pa_atomic_store(&u->quit, 1);
+        pa_fdsem_post(u->space);
+        pa_thread_free(u->thread);
+    }
+
+    /* The sink input is gone, so nobody else reads the queue anymore */
+    if (u->prefetch)
+        pa_asyncq_free(u->prefetch, (pa_free_cb_t) pa_memblock_unref);
+
+    if (u->space)
+        pa_fdsem_free(u->space);
+
     if (u->memblockq)
         pa_memblockq_free(u->memblockq);
 
@@ -118,6 +156,86 @@ static void sink_input_kill_cb(pa_sink_input *i) {
     file_stream_unlink(u);
 }
 
+/* Called from decoder thread context */
+static void decoder_thread_func(void *userdata) {
+    file_stream *u = userdata;
+
+    pa_assert(u);
+
+    for (;;) {
+        pa_memblock *b;
+        void *p;
+        sf_count_t n;
+        size_t length;
+
+        if (pa_atomic_load(&u->quit))
+            break;
+
+        if ((unsigned) pa_atomic_load(&u->queued) >= u->prefetch_blocks) {
+            pa_fdsem_wait(u->space);
+            continue;
+        }
+
+        b = pa_memblock_new(u->core->mempool, u->block_size);
+        p = pa_memblock_acquire(b);
+
+        if (u->readf_function)
+            n = u->readf_function(u->sndfile, p, (sf_count_t) (u->block_size / u->frame_size));
+        else
+            n = sf_read_raw(u->sndfile, p, (sf_count_t) u->block_size);
+
+        length = n > 0 ? (size_t) n * u->frame_size : 0;
+
+        /* Only the last block comes up short, copy it so that the
+         * block length tells the IO thread how much was read */
+        if (length > 0 && length < u->block_size) {
+            pa_memblock *t;
+
+            t = pa_memblock_new(u->core->mempool, length);
+            memcpy(pa_memblock_acquire(t), p, length);
+            pa_memblock_release(t);
+
+            pa_memblock_release(b);
+            pa_memblock_unref(b);
+            b = t;
+        } else
+            pa_memblock_release(b);
+
+        if (length <= 0) {
+            pa_memblock_unref(b);
+            break;
+        }
+
+        /* queued < prefetch_blocks <= PREFETCH_QUEUE_SIZE, so there
+         * is always room */
+        pa_assert_se(pa_asyncq_push(u->prefetch, b, false) == 0);
+        pa_atomic_inc(&u->queued);
+    }
+
+    pa_atomic_store(&u->eof, 1);
+}
+
+/* Called from IO thread context */
+static pa_memblock *prefetch_pop(file_stream *u) {
+    pa_memblock *b;
+
+    if (!(b = pa_asyncq_pop(u->prefetch, false))) {
+
+        if (!pa_atomic_load(&u->eof))
+            return NULL;
+
+        /* The decoder might have pushed its last block right before
+         * setting eof */
+        if (!(b = pa_asyncq_pop(u->prefetch, false)))
+            return NULL;
+    }
+
+    if ((unsigned) pa_atomic_dec(&u->queued) == u->prefetch_blocks / 2 + 1)
+        pa_fdsem_post(u->space);
+
+    return b;
+}
+
 /* Called from IO thread context */
 static void sink_input_state_change_cb(pa_sink_input *i, pa_sink_input_state_t state) {
     file_stream *u;
@@ -147,9 +265,6 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk
 
     for (;;) {
         pa_memchunk tchunk;
-        size_t fs;
-        void *p;
-        sf_count_t n;
 
         if (pa_memblockq_peek(u->memblockq, chunk) >= 0) {
             chunk->length = PA_MIN(chunk->length, length);
@@ -157,38 +272,21 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk
             return 0;
         }
 
-        if (!u->sndfile)
+        if (!(tchunk.memblock = prefetch_pop(u)))
             break;
 
-        tchunk.memblock = pa_memblock_new(i->sink->core->mempool, length);
         tchunk.index = 0;
-
-        p = pa_memblock_acquire(tchunk.memblock);
-
-        if (u->readf_function) {
-            fs = pa_frame_size(&i->sample_spec);
-            n = u->readf_function(u->sndfile, p, (sf_count_t) (length/fs));
-        } else {
-            fs = 1;
-            n = sf_read_raw(u->sndfile, p, (sf_count_t) length);
-        }
-
-        pa_memblock_release(tchunk.memblock);
-
-        if (n <= 0) {
-            pa_memblock_unref(tchunk.memblock);
-
-            sf_close(u->sndfile);
-            u->sndfile = NULL;
-            break;
-        }
-
-        tchunk.length = (size_t) n * fs;
+        tchunk.length = pa_memblock_get_length(tchunk.memblock);
 
         pa_memblockq_push(u->memblockq, &tchunk);
         pa_memblock_unref(tchunk.memblock);
     }
 
+    /* The decoder is merely behind, don't take that for the end of
+     * the file */
+    if (!pa_atomic_load(&u->eof))
+        return -1;
+
     if (pa_sink_input_safe_to_remove(i)) {
         pa_memblockq_free(u->memblockq);
         u->memblockq = NULL;
@@ -248,6 +346,12 @@ int pa_play_file(
     u->sink_input = NULL;
     u->sndfile = NULL;
     u->readf_function = NULL;
+    u->thread = NULL;
+    u->prefetch = NULL;
+    u->space = NULL;
+    pa_atomic_store(&u->queued, 0);
+    pa_atomic_store(&u->eof, 0);
+    pa_atomic_store(&u->quit, 0);
     u->memblockq = NULL;
 
     if ((fd = pa_open_cloexec(fname, O_RDONLY, 0)) < 0) {
@@ -255,10 +359,8 @@ int pa_play_file(
         goto fail;
     }
 
-    /* FIXME: For now we just use posix_fadvise to avoid page faults
-     * when accessing the file data. Eventually we should move the
-     * file reader into the main event loop and pass the data over the
-     * asyncmsgq. */
+    /* The file is read by a decoder thread of its own, this just
+     * helps it keep ahead of playback. */
 
 #ifdef HAVE_POSIX_FADVISE
     if (posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL) < 0) {
@@ -294,6 +396,22 @@ int pa_play_file(
     }
 
     u->readf_function = pa_sndfile_readf_function(&ss);
+    u->frame_size = u->readf_function ? pa_frame_size(&ss) : 1;
+
+    u->block_size = pa_usec_to_bytes(BLOCK_USEC, &ss);
+    u->block_size = PA_MIN(u->block_size, pa_mempool_block_size_max(sink->core->mempool));
+    u->block_size = PA_MAX(pa_frame_align(u->block_size, &ss), pa_frame_size(&ss));
+    u->prefetch_blocks = (unsigned) PA_CLAMP(pa_usec_to_bytes(PREFETCH_USEC, &ss) / u->block_size, 2, PREFETCH_QUEUE_SIZE);
+
+    /* Start decoding right away, so that there's something to play
+     * once the stream is put */
+    u->prefetch = pa_asyncq_new(PREFETCH_QUEUE_SIZE);
+    u->space = pa_fdsem_new();
+
+    if (!(u->thread = pa_thread_new("file-decoder", decoder_thread_func, u))) {
+        pa_log("Failed to create decoder thread.");
+        goto fail;
+    }
 
     pa_sink_input_new_data_init(&data);
     pa_sink_input_new_data_set_sink(&data, sink, false);
@@ -24,10 +24,13 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <sndfile.h>
 
 #include <pulse/sample.h>
+#include <pulse/xmalloc.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/core-error.h>
@@ -161,3 +164,208 @@ int pa_sound_file_too_big_to_cache(const char *fname) {
 
     return 0;
 }
+
+/* A growable in-memory file for libsndfile's virtual IO */
+struct membuf {
+    uint8_t *data;
+    sf_count_t length, size, pos;
+};
+
+static sf_count_t membuf_get_filelen(void *userdata) {
+    struct membuf *b = userdata;
+
+    return b->length;
+}
+
+static sf_count_t membuf_seek(sf_count_t offset, int whence, void *userdata) {
+    struct membuf *b = userdata;
+    sf_count_t pos;
+
+    switch (whence) {
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = b->pos + offset;
+            break;
+        case SEEK_END:
+            pos = b->length + offset;
+            break;
+        default:
+            return -1;
+    }
+
+    if (pos < 0)
+        return -1;
+
+    return b->pos = pos;
+}
+
+static sf_count_t membuf_read(void *ptr, sf_count_t count, void *userdata) {
+    struct membuf *b = userdata;
+    sf_count_t n;
+
+    if (b->pos >= b->length)
+        return 0;
+
+    n = PA_MIN(count, b->length - b->pos);
+    memcpy(ptr, b->data + b->pos, (size_t) n);
+    b->pos += n;
+
+    return n;
+}
+
+static sf_count_t membuf_write(const void *ptr, sf_count_t count, void *userdata) {
+    struct membuf *b = userdata;
+
+    if (b->pos + count > b->size) {
+        b->size = PA_MAX(PA_MAX(b->size * 2, b->pos + count), 4096);
+        b->data = pa_xrealloc(b->data, (size_t) b->size);
+    }
+
+    /* Seeking past the end leaves a gap */
+    if (b->pos > b->length)
+        memset(b->data + b->length, 0, (size_t) (b->pos - b->length));
+
+    memcpy(b->data + b->pos, ptr, (size_t) count);
+    b->pos += count;
+
+    if (b->pos > b->length)
+        b->length = b->pos;
+
+    return count;
+}
+
+static sf_count_t membuf_tell(void *userdata) {
+    struct membuf *b = userdata;
+
+    return b->pos;
+}
+
+static SF_VIRTUAL_IO membuf_io = {
+    .get_filelen = membuf_get_filelen,
+    .seek = membuf_seek,
+    .read = membuf_read,
+    .write = membuf_write,
+    .tell = membuf_tell
+};
+
+int pa_sound_file_compress(const pa_sample_spec *ss, const pa_memchunk *chunk, void **data, size_t *length) {
+    SNDFILE *sf;
+    SF_INFO sfi;
+    struct membuf b;
+    sf_count_t frames, written;
+    void *ptr;
+
+    pa_assert(ss);
+    pa_assert(chunk);
+    pa_assert(chunk->memblock);
+    pa_assert(data);
+    pa_assert(length);
+
+    pa_zero(sfi);
+    sfi.samplerate = (int) ss->rate;
+    sfi.channels = ss->channels;
+
+    switch (ss->format) {
+        case PA_SAMPLE_S16NE:
+            sfi.format = SF_FORMAT_FLAC|SF_FORMAT_PCM_16;
+            break;
+        case PA_SAMPLE_FLOAT32NE:
+            sfi.format = SF_FORMAT_FLAC|SF_FORMAT_PCM_24;
+            break;
+        default:
+            return -1;
+    }
+
+    if (!sf_format_check(&sfi))
+        return -1;
+
+    pa_zero(b);
+
+    if (!(sf = sf_open_virtual(&membuf_io, SFM_WRITE, &sfi, &b))) {
+        pa_log_debug("Failed to open FLAC encoder: %s", sf_strerror(NULL));
+        pa_xfree(b.data);
+        return -1;
+    }
+
+    /* Decoded samples may overshoot a little */
+    sf_command(sf, SFC_SET_CLIPPING, NULL, SF_TRUE);
+
+    frames = (sf_count_t) (chunk->length / pa_frame_size(ss));
+
+    ptr = pa_memblock_acquire_chunk(chunk);
+
+    if (ss->format == PA_SAMPLE_S16NE)
+        written = sf_writef_short(sf, ptr, frames);
+    else
+        written = sf_writef_float(sf, ptr, frames);
+
+    pa_memblock_release(chunk->memblock);
+
+    if (sf_close(sf) != 0 || written != frames) {
+        pa_xfree(b.data);
+        return -1;
+    }
+
+    /* Decoding costs something, so it has to be worth it */
+    if ((size_t) b.length > chunk->length / 4 * 3) {
+        pa_xfree(b.data);
+        return -1;
+    }
+
+    *data = b.data;
+    *length = (size_t) b.length;
+
+    return 0;
+}
+
+int pa_sound_file_decompress(pa_mempool *pool, const pa_sample_spec *ss, const void *data, size_t length, size_t pcm_length, pa_memchunk *chunk) {
+    SNDFILE *sf;
+    SF_INFO sfi;
+    struct membuf b;
+    sf_count_t frames, r;
+    void *ptr;
+
+    pa_assert(pool);
+    pa_assert(ss);
+    pa_assert(ss->format == PA_SAMPLE_S16NE || ss->format == PA_SAMPLE_FLOAT32NE);
+    pa_assert(data);
+    pa_assert(chunk);
+    pa_assert(pa_frame_aligned(pcm_length, ss));
+
+    pa_zero(b);
+    b.data = (uint8_t*) data;
+    b.length = b.size = (sf_count_t) length;
+
+    pa_zero(sfi);
+    if (!(sf = sf_open_virtual(&membuf_io, SFM_READ, &sfi, &b))) {
+        pa_log("Failed to open FLAC decoder: %s", sf_strerror(NULL));
+        return -1;
+    }
+
+    frames = (sf_count_t) (pcm_length / pa_frame_size(ss));
+
+    chunk->memblock = pa_memblock_new(pool, pcm_length);
+    chunk->index = 0;
+    chunk->length = pcm_length;
+
+    ptr = pa_memblock_acquire(chunk->memblock);
+
+    if (ss->format == PA_SAMPLE_S16NE)
+        r = sf_readf_short(sf, ptr, frames);
+    else
+        r = sf_readf_float(sf, ptr, frames);
+
+    pa_memblock_release(chunk->memblock);
+    sf_close(sf);
+
+    if (r != frames) {
+        pa_log("Compressed sample is truncated.");
+        pa_memblock_unref(chunk->memblock);
+        pa_memchunk_reset(chunk);
+        return -1;
+    }
+
+    return 0;
+}
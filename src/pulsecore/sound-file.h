@@ -28,4 +28,14 @@ int pa_sound_file_load(pa_mempool *pool, const char *fname, pa_sample_spec *ss,
 
 int pa_sound_file_too_big_to_cache(const char *fname);
 
+/* Encodes the chunk as FLAC into a new buffer, which is returned in
+ * *data and has to be freed with pa_xfree(). Only S16NE and FLOAT32NE
+ * are supported; floats are stored with 24 bits. Returns -1 if the
+ * format isn't supported or compressing doesn't pay off. */
+int pa_sound_file_compress(const pa_sample_spec *ss, const pa_memchunk *chunk, void **data, size_t *length);
+
+/* Decodes what pa_sound_file_compress() returned into a new block of
+ * pcm_length bytes. */
+int pa_sound_file_decompress(pa_mempool *pool, const pa_sample_spec *ss, const void *data, size_t length, size_t pcm_length, pa_memchunk *chunk);
+
 #endif
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <pulse/rtclock.h>
 #include <pulse/utf8.h>
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
@@ -715,6 +716,33 @@ pa_usec_t pa_source_output_get_latency(pa_source_output *o, pa_usec_t *source_la
 }
 
 /* Called from thread context */
+/* Called from thread context. Returns true if pa_source_output_push()
+ * would hand the source's data to the resampler unmodified, so that
+ * the resampled data may be shared with other outputs converting to
+ * the same format. */
+bool pa_source_output_can_share_resampler(pa_source_output *o) {
+    pa_source_output_assert_ref(o);
+    pa_source_output_assert_io_context(o);
+
+    if (!o->push || !o->thread_info.resampler || o->thread_info.direct_on_input)
+        return false;
+
+    if (o->thread_info.state != PA_SOURCE_OUTPUT_RUNNING)
+        return false;
+
+    if (!pa_cvolume_is_norm(&o->thread_info.soft_volume) || o->thread_info.muted)
+        return false;
+
+    if (!pa_cvolume_is_norm(&o->volume_factor_source))
+        return false;
+
+    /* Data has to pass the delay queue right away */
+    if (!o->process_rewind && o->source->thread_info.max_rewind > 0)
+        return false;
+
+    return pa_memblockq_get_length(o->thread_info.delay_memblockq) == 0;
+}
+
 void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
     bool need_volume_factor_source;
     bool volume_is_norm;
@@ -806,6 +834,15 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
             o->push(o, &qchunk);
         else {
             pa_memchunk rchunk;
+            pa_usec_t start;
+            pa_source_output *p;
+
+            if (o->thread_info.resampler_stale) {
+                /* Another output did the conversion for us for a
+                 * while, our filter history is out of date */
+                pa_resampler_reset(o->thread_info.resampler);
+                o->thread_info.resampler_stale = false;
+            }
 
             if (mbs == 0)
                 mbs = pa_resampler_max_block_size(o->thread_info.resampler);
@@ -813,11 +850,17 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
             if (qchunk.length > mbs)
                 qchunk.length = mbs;
 
+            start = pa_rtclock_now();
             pa_resampler_run(o->thread_info.resampler, &qchunk, &rchunk);
+            pa_metric_add(o->source->metrics.resampler_usec, pa_rtclock_now() - start);
 
-            if (rchunk.length > 0)
+            if (rchunk.length > 0) {
                 o->push(o, &rchunk);
 
+                for (p = o->thread_info.share_next; p; p = p->thread_info.share_next)
+                    p->push(p, &rchunk);
+            }
+
             if (rchunk.memblock)
                 pa_memblock_unref(rchunk.memblock);
         }
@@ -207,6 +207,16 @@ struct pa_source_output {
         pa_usec_t requested_source_latency;
 
         pa_sink_input *direct_on_input;       /* may be NULL */
+
+        /* Outputs that convert to the same format as this one get
+         * this one's resampler output during pa_source_post() instead
+         * of running their own resampler. share_next chains the group
+         * for the current post, share_taken marks members other than
+         * the first, and resampler_stale is set on an output whose
+         * resampler missed data because of that. */
+        pa_source_output *share_next;
+        bool share_taken:1;
+        bool resampler_stale:1;
     } thread_info;
 
     void *userdata;
@@ -340,6 +350,7 @@ pa_usec_t pa_source_output_get_requested_latency(pa_source_output *o);
 /* To be used exclusively by the source driver thread */
 
 void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk);
+bool pa_source_output_can_share_resampler(pa_source_output *o);
 void pa_source_output_process_rewind(pa_source_output *o, size_t nbytes);
 void pa_source_output_update_max_rewind(pa_source_output *o, size_t nbytes);
 
@@ -153,6 +153,28 @@ static void reset_callbacks(pa_source *s) {
     s->update_rate = NULL;
 }
 
+/* Called from main context */
+static void register_metrics(pa_source *s) {
+    pa_metrics *m = s->core->metrics;
+
+    s->metrics.post_time = pa_metrics_register(m, "pulseaudio_source_post_seconds", PA_METRIC_HISTOGRAM,
+                                               "Time spent handing a block of audio to the source outputs.", "source", s->name);
+    s->metrics.rewinds = pa_metrics_register(m, "pulseaudio_source_rewinds_total", PA_METRIC_COUNTER,
+                                             "Number of rewinds processed.", "source", s->name);
+    s->metrics.rewound_bytes = pa_metrics_register(m, "pulseaudio_source_rewound_bytes_total", PA_METRIC_COUNTER,
+                                                   "Number of bytes rewound.", "source", s->name);
+    s->metrics.resampler_usec = pa_metrics_register(m, "pulseaudio_source_resampler_usec_total", PA_METRIC_COUNTER,
+                                                    "Time spent resampling the streams of this source, in usec.", "source", s->name);
+}
+
+/* Called from main context */
+static void unregister_metrics(pa_source *s) {
+    pa_metric_free(s->metrics.post_time);
+    pa_metric_free(s->metrics.rewinds);
+    pa_metric_free(s->metrics.rewound_bytes);
+    pa_metric_free(s->metrics.resampler_usec);
+}
+
 /* Called from main context */
 pa_source* pa_source_new(
         pa_core *core,
@@ -242,6 +264,7 @@ pa_source* pa_source_new(
     s->suspend_cause = data->suspend_cause;
     pa_source_set_mixer_dirty(s, false);
     s->name = pa_xstrdup(name);
+    register_metrics(s);
     s->proplist = pa_proplist_copy(data->proplist);
     s->driver = pa_xstrdup(pa_path_get_filename(data->driver));
     s->module = data->module;
@@ -673,6 +696,8 @@ static void source_free(pa_object *o) {
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
+    unregister_metrics(s);
+
     pa_xfree(s->name);
     pa_xfree(s->driver);
 
@@ -895,6 +920,9 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
 
     pa_log_debug("Processing rewind...");
 
+    pa_metric_inc(s->metrics.rewinds);
+    pa_metric_add(s->metrics.rewound_bytes, nbytes);
+
     PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state) {
         pa_source_output_assert_ref(o);
         pa_source_output_process_rewind(o, nbytes);
@@ -902,46 +930,113 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
 }
 
 /* Called from IO thread context */
-void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
+/* Called from IO thread context. Returns chunk scaled by the soft
+ * volume in a new block, see pa_volume_memchunk_copy() */
+static void apply_soft_volume(pa_source *s, const pa_memchunk *chunk, pa_memchunk *result) {
+    pa_cvolume muted;
+
+    if (s->thread_info.soft_muted)
+        pa_volume_memchunk_copy(result, chunk, &s->sample_spec, pa_cvolume_mute(&muted, s->sample_spec.channels));
+    else
+        pa_volume_memchunk_copy(result, chunk, &s->sample_spec, &s->thread_info.soft_volume);
+}
+
+/* Called from IO thread context */
+static bool output_needs_data(pa_source_output *o) {
+    return o->push && o->thread_info.state == PA_SOURCE_OUTPUT_RUNNING;
+}
+
+/* Called from IO thread context. Returns true if pa_source_post()
+ * would hand the data to at least one output, i.e. if it is worth
+ * rendering for us at all. Corked and direct outputs don't count. */
+bool pa_source_needs_post(pa_source *s) {
     pa_source_output *o;
-    void *state = NULL;
+    void *state;
+
+    pa_source_assert_ref(s);
+    pa_source_assert_io_context(s);
+
+    if (!PA_SOURCE_IS_LINKED(s->thread_info.state) || s->thread_info.state == PA_SOURCE_SUSPENDED)
+        return false;
+
+    PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state)
+        if (!o->thread_info.direct_on_input && output_needs_data(o))
+            return true;
+
+    return false;
+}
+
+/* Called from IO thread context. Outputs that resample to the same
+ * format are grouped, so that the conversion runs only once per group
+ * and the converted block is handed to every member. */
+static void push_to_outputs(pa_source *s, const pa_memchunk *chunk) {
+    pa_source_output *o, *p;
+    void *state, *pstate;
+
+    PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state) {
+        o->thread_info.share_next = NULL;
+        o->thread_info.share_taken = false;
+    }
+
+    PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state) {
+        pa_source_output *last = o;
+
+        pa_source_output_assert_ref(o);
+
+        if (o->thread_info.direct_on_input || o->thread_info.share_taken)
+            continue;
+
+        if (pa_source_output_can_share_resampler(o)) {
+            /* Only outputs after this one can still be ungrouped */
+            pstate = state;
+
+            while ((p = pa_hashmap_iterate(s->thread_info.outputs, &pstate, NULL))) {
+                if (p->thread_info.share_taken || !pa_source_output_can_share_resampler(p))
+                    continue;
+
+                if (!pa_resampler_equal(o->thread_info.resampler, p->thread_info.resampler))
+                    continue;
+
+                p->thread_info.share_taken = true;
+                p->thread_info.resampler_stale = true;
+                last->thread_info.share_next = p;
+                last = p;
+            }
+        }
+
+        pa_source_output_push(o, chunk);
+    }
+}
+
+void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
+    pa_usec_t start;
 
     pa_source_assert_ref(s);
     pa_source_assert_io_context(s);
     pa_assert(PA_SOURCE_IS_LINKED(s->thread_info.state));
     pa_assert(chunk);
 
-    if (s->thread_info.state == PA_SOURCE_SUSPENDED)
+    /* Nobody listening, e.g. only paused level meters on a monitor
+     * source, so don't bother applying the volume either */
+    if (!pa_source_needs_post(s))
         return;
 
-    if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
-        pa_memchunk vchunk = *chunk;
-
-        pa_memblock_ref(vchunk.memblock);
-        pa_memchunk_make_writable(&vchunk, 0);
+    start = pa_rtclock_now();
 
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&s->thread_info.soft_volume))
-            pa_silence_memchunk(&vchunk, &s->sample_spec);
-        else
-            pa_volume_memchunk(&vchunk, &s->sample_spec, &s->thread_info.soft_volume);
+    if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
+        pa_memchunk vchunk;
 
-        while ((o = pa_hashmap_iterate(s->thread_info.outputs, &state, NULL))) {
-            pa_source_output_assert_ref(o);
+        apply_soft_volume(s, chunk, &vchunk);
 
-            if (!o->thread_info.direct_on_input)
-                pa_source_output_push(o, &vchunk);
-        }
+        push_to_outputs(s, &vchunk);
 
         pa_memblock_unref(vchunk.memblock);
     } else {
 
-        while ((o = pa_hashmap_iterate(s->thread_info.outputs, &state, NULL))) {
-            pa_source_output_assert_ref(o);
-
-            if (!o->thread_info.direct_on_input)
-                pa_source_output_push(o, chunk);
-        }
+        push_to_outputs(s, chunk);
     }
+
+    pa_metric_observe(s->metrics.post_time, pa_rtclock_now() - start);
 }
 
 /* Called from IO thread context */
@@ -953,19 +1048,13 @@ void pa_source_post_direct(pa_source*s, pa_source_output *o, const pa_memchunk *
     pa_assert(o->thread_info.direct_on_input);
     pa_assert(chunk);
 
-    if (s->thread_info.state == PA_SOURCE_SUSPENDED)
+    if (s->thread_info.state == PA_SOURCE_SUSPENDED || !output_needs_data(o))
         return;
 
     if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
-        pa_memchunk vchunk = *chunk;
-
-        pa_memblock_ref(vchunk.memblock);
-        pa_memchunk_make_writable(&vchunk, 0);
+        pa_memchunk vchunk;
 
-        if (s->thread_info.soft_muted || pa_cvolume_is_muted(&s->thread_info.soft_volume))
-            pa_silence_memchunk(&vchunk, &s->sample_spec);
-        else
-            pa_volume_memchunk(&vchunk, &s->sample_spec, &s->thread_info.soft_volume);
+        apply_soft_volume(s, chunk, &vchunk);
 
         pa_source_output_push(o, &vchunk);
 
@@ -1097,6 +1186,78 @@ int pa_source_update_rate(pa_source *s, uint32_t rate, bool passthrough) {
     return ret;
 }
 
+/* Called from main thread. Returns false if there is no usable snapshot,
+ * or the IO thread kept updating it while we tried to read it. */
+static bool get_latency_snapshot(pa_source *s, pa_usec_t *usec) {
+    pa_usec_t latency, timestamp, valid_for, now;
+    unsigned seq, tries = 0;
+    bool valid;
+
+    do {
+        if (tries++ >= 3)
+            return false;
+
+        seq = pa_seqlock_read_begin(&s->latency_lock);
+
+        valid = s->latency_snapshot.valid;
+        latency = s->latency_snapshot.latency;
+        timestamp = s->latency_snapshot.timestamp;
+        valid_for = s->latency_snapshot.valid_for;
+    } while (pa_seqlock_read_retry(&s->latency_lock, seq));
+
+    if (!valid)
+        return false;
+
+    /* The IO thread should have read from the device long before the
+     * maximum latency is reached, so something is off in that case */
+    now = pa_rtclock_now();
+    if (now < timestamp || now - timestamp >= valid_for)
+        return false;
+
+    *usec = latency + (now - timestamp);
+    return true;
+}
+
+/* Called from IO thread */
+static void invalidate_latency_snapshot(pa_source *s) {
+    if (!s->latency_snapshot.valid)
+        return;
+
+    pa_seqlock_write_begin(&s->latency_lock);
+    s->latency_snapshot.valid = false;
+    pa_seqlock_write_end(&s->latency_lock);
+}
+
+/* Called from IO thread */
+void pa_source_update_latency_snapshot(pa_source *s, bool recording) {
+    pa_usec_t usec = 0, valid_for;
+    pa_msgobject *o;
+
+    pa_source_assert_ref(s);
+    pa_source_assert_io_context(s);
+    pa_assert(PA_SOURCE_IS_LINKED(s->thread_info.state));
+
+    if (!(s->flags & PA_SOURCE_LATENCY))
+        return;
+
+    o = PA_MSGOBJECT(s);
+
+    if (!recording || !PA_SOURCE_IS_OPENED(s->thread_info.state) ||
+        o->process_msg(o, PA_SOURCE_MESSAGE_GET_LATENCY, &usec, 0, NULL) < 0) {
+        invalidate_latency_snapshot(s);
+        return;
+    }
+
+    valid_for = s->thread_info.max_latency;
+
+    pa_seqlock_write_begin(&s->latency_lock);
+    s->latency_snapshot.latency = usec;
+    s->latency_snapshot.timestamp = pa_rtclock_now();
+    s->latency_snapshot.valid_for = valid_for;
+    s->latency_snapshot.valid = true;
+    pa_seqlock_write_end(&s->latency_lock);
+}
+
 /* Called from main thread */
 pa_usec_t pa_source_get_latency(pa_source *s) {
     pa_usec_t usec;
@@ -1111,7 +1272,8 @@ pa_usec_t pa_source_get_latency(pa_source *s) {
     if (!(s->flags & PA_SOURCE_LATENCY))
         return 0;
 
-    pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SOURCE_MESSAGE_GET_LATENCY, &usec, 0, NULL) == 0);
+    if (!get_latency_snapshot(s, &usec))
+        pa_assert_se(pa_asyncmsgq_send(s->asyncmsgq, PA_MSGOBJECT(s), PA_SOURCE_MESSAGE_GET_LATENCY, &usec, 0, NULL) == 0);
 
     /* usec is unsigned, so check that the offset can be added to usec without
      * underflowing. */
@@ -2157,6 +2319,8 @@ int pa_source_process_msg(pa_msgobject *object, int code, void *userdata, int64_
 
             s->thread_info.state = PA_PTR_TO_UINT(userdata);
 
+            invalidate_latency_snapshot(s);
+
             if (suspend_change) {
                 pa_source_output *o;
                 void *state = NULL;
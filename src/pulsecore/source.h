@@ -38,6 +38,8 @@
 #include <pulsecore/module.h>
 #include <pulsecore/asyncmsgq.h>
 #include <pulsecore/msgobject.h>
+#include <pulsecore/seqlock.h>
+#include <pulsecore/metrics.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/card.h>
 #include <pulsecore/device-port.h>
@@ -121,6 +123,25 @@ struct pa_source {
     /* The latency offset is inherited from the currently active port */
     int64_t port_latency_offset;
 
+    /* The latency as last published by the IO thread, so that the main
+     * thread can read it without a round trip to the IO thread. See
+     * pa_source_update_latency_snapshot(). */
+    pa_seqlock latency_lock;
+    struct {
+        pa_usec_t latency;
+        pa_usec_t timestamp;
+        pa_usec_t valid_for;
+        bool valid;
+    } latency_snapshot;
+
+    /* Updated from the IO thread only, see metrics.h */
+    struct {
+        pa_metric *post_time;
+        pa_metric *rewinds;
+        pa_metric *rewound_bytes;
+        pa_metric *resampler_usec;
+    } metrics;
+
     unsigned priority;
 
     bool set_mute_in_progress;
@@ -425,6 +446,7 @@ pa_idxset* pa_source_check_formats(pa_source *s, pa_idxset *in_formats);
 /*** To be called exclusively by the source driver, from IO context */
 
 void pa_source_post(pa_source*s, const pa_memchunk *chunk);
+bool pa_source_needs_post(pa_source *s);
 void pa_source_post_direct(pa_source*s, pa_source_output *o, const pa_memchunk *chunk);
 void pa_source_process_rewind(pa_source *s, size_t nbytes);
 
@@ -444,6 +466,14 @@ void pa_source_update_volume_and_mute(pa_source *s);
 
 bool pa_source_volume_change_apply(pa_source *s, pa_usec_t *usec_to_next);
 
+/* Publishes the current latency for pa_source_get_latency(), which then
+ * extrapolates it instead of asking the IO thread. Drivers that call this
+ * must do so every time after they read from the device, with recording
+ * set to false while the device isn't actually recording. The published
+ * value is taken to be current plus the time passed, for up to the
+ * maximum latency of the source. State changes invalidate it. */
+void pa_source_update_latency_snapshot(pa_source *s, bool recording);
+
 /*** To be called exclusively by source output drivers, from IO context */
 
 void pa_source_invalidate_requested_latency(pa_source *s, bool dynamic);
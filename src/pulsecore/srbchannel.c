@@ -24,61 +24,16 @@
 #include "srbchannel.h"
 
 #include <pulsecore/atomic.h>
+#include <pulsecore/ringbuffer.h>
 #include <pulse/xmalloc.h>
 
 /* #define DEBUG_SRBCHANNEL */
 
-/* This ringbuffer might be useful in other contexts too, but
- * right now it's only used inside the srbchannel, so let's keep it here
- * for the time being. */
-typedef struct pa_ringbuffer pa_ringbuffer;
-
-struct pa_ringbuffer {
-    pa_atomic_t *count; /* amount of data in the buffer */
-    int capacity;
-    uint8_t *memory;
-    int readindex, writeindex;
-};
-
-static void *pa_ringbuffer_peek(pa_ringbuffer *r, int *count) {
-    int c = pa_atomic_load(r->count);
-
-    if (r->readindex + c > r->capacity)
-        *count = r->capacity - r->readindex;
-    else
-        *count = c;
-
-    return r->memory + r->readindex;
-}
-
-/* Returns true only if the buffer was completely full before the drop. */
-static bool pa_ringbuffer_drop(pa_ringbuffer *r, int count) {
-    bool b = pa_atomic_sub(r->count, count) >= r->capacity;
-
-    r->readindex += count;
-    r->readindex %= r->capacity;
-
-    return b;
-}
-
-static void *pa_ringbuffer_begin_write(pa_ringbuffer *r, int *count) {
-    int c = pa_atomic_load(r->count);
-
-    *count = PA_MIN(r->capacity - r->writeindex, r->capacity - c);
-
-    return r->memory + r->writeindex;
-}
-
-static void pa_ringbuffer_end_write(pa_ringbuffer *r, int count) {
-    pa_atomic_add(r->count, count);
-    r->writeindex += count;
-    r->writeindex %= r->capacity;
-}
-
 struct pa_srbchannel {
     pa_ringbuffer rb_read, rb_write;
     pa_fdsem *sem_read, *sem_write;
     pa_memblock *memblock;
+    bool split_indices;
 
     void *cb_userdata;
     pa_srbchannel_cb_t callback;
@@ -120,6 +75,7 @@ size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l) {
         data = (uint8_t*) data + towrite;
         l -= towrite;
     }
+    pa_ringbuffer_commit_write(&sr->rb_write);
 #ifdef DEBUG_SRBCHANNEL
     pa_log("Wrote %d bytes to srbchannel, signalling fdsem", (int) written);
 #endif
@@ -142,19 +98,20 @@ size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l) {
             break;
 
         memcpy(data, ptr, toread);
-
-        if (pa_ringbuffer_drop(&sr->rb_read, toread)) {
-#ifdef DEBUG_SRBCHANNEL
-            pa_log("Read from full output buffer, signalling fdsem");
-#endif
-            pa_fdsem_post(sr->sem_write);
-        }
+        pa_ringbuffer_drop(&sr->rb_read, toread);
 
         isread += toread;
         data = (uint8_t*) data + toread;
         l -= toread;
     }
 
+    if (pa_ringbuffer_commit_read(&sr->rb_read)) {
+#ifdef DEBUG_SRBCHANNEL
+        pa_log("Read from full output buffer, signalling fdsem");
+#endif
+        pa_fdsem_post(sr->sem_write);
+    }
+
 #ifdef DEBUG_SRBCHANNEL
     pa_log("Read %d bytes from srbchannel", (int) isread);
 #endif
@@ -163,7 +120,11 @@ size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l) {
 }
 
 /* This is the memory layout of the ringbuffer shm block. It is followed by
-   read and write ringbuffer memory. */
+   read and write ringbuffer memory, and with split indices by the timing
+   slots.
+
+   Peers speaking protocol < 33 only know the fields up to writebuf_offset
+   and synchronize through the counts; newer ones use the split indices. */
 struct srbheader {
     pa_atomic_t read_count;
     pa_atomic_t write_count;
@@ -175,9 +136,33 @@ struct srbheader {
     int readbuf_offset;
     int writebuf_offset;
 
+    pa_ringbuffer_indices read_indices;
+    pa_ringbuffer_indices write_indices;
+
+    int timing_offset;
+
     /* TODO: Maybe a marker here to make sure we talk to a server with equally sized struct */
 };
 
+struct pa_srbchannel_timing_slot {
+    pa_atomic_t seq;
+    pa_srbchannel_timing timing;
+    /* Streams of different sinks write from different threads */
+    uint8_t _pad[PA_RINGBUFFER_CACHELINE - (sizeof(pa_atomic_t) + sizeof(pa_srbchannel_timing)) % PA_RINGBUFFER_CACHELINE];
+};
+
+static void srbchannel_init_ringbuffers(pa_srbchannel *sr, struct srbheader *srh) {
+    uint8_t *base = (uint8_t*) srh;
+
+    if (sr->split_indices) {
+        pa_ringbuffer_init(&sr->rb_read, NULL, &srh->read_indices, base + srh->readbuf_offset, srh->capacity);
+        pa_ringbuffer_init(&sr->rb_write, NULL, &srh->write_indices, base + srh->writebuf_offset, srh->capacity);
+    } else {
+        pa_ringbuffer_init(&sr->rb_read, &srh->read_count, NULL, base + srh->readbuf_offset, srh->capacity);
+        pa_ringbuffer_init(&sr->rb_write, &srh->write_count, NULL, base + srh->writebuf_offset, srh->capacity);
+    }
+}
+
 static void srbchannel_rwloop(pa_srbchannel* sr) {
     do {
 #ifdef DEBUG_SRBCHANNEL
@@ -221,13 +206,15 @@ static void defer_cb(pa_mainloop_api *m, pa_defer_event *e, void *userdata) {
     srbchannel_rwloop(sr);
 }
 
-pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p) {
+pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p, bool split_indices) {
     int capacity;
     int readfd;
     struct srbheader *srh;
+    uint8_t *readbuf, *writebuf;
 
     pa_srbchannel* sr = pa_xmalloc0(sizeof(pa_srbchannel));
     sr->mainloop = m;
+    sr->split_indices = split_indices;
     sr->memblock = pa_memblock_new_pool(p, -1);
     if (!sr->memblock)
         goto fail;
@@ -235,23 +222,40 @@ pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p) {
     srh = pa_memblock_acquire(sr->memblock);
     pa_zero(*srh);
 
-    sr->rb_read.memory = (uint8_t*) srh + PA_ALIGN(sizeof(*srh));
-    srh->readbuf_offset = sr->rb_read.memory - (uint8_t*) srh;
+    readbuf = (uint8_t*) srh + PA_ALIGN(sizeof(*srh));
+    srh->readbuf_offset = readbuf - (uint8_t*) srh;
 
-    capacity = (pa_memblock_get_length(sr->memblock) - srh->readbuf_offset) / 2;
+    capacity = pa_memblock_get_length(sr->memblock) - srh->readbuf_offset;
 
-    sr->rb_write.memory = PA_ALIGN_PTR(sr->rb_read.memory + capacity);
-    srh->writebuf_offset = sr->rb_write.memory - (uint8_t*) srh;
+    if (split_indices) {
+        pa_srbchannel_timing_slot *slots;
+        unsigned i;
 
-    capacity = PA_MIN(capacity, srh->writebuf_offset - srh->readbuf_offset);
+        /* The timing slots go to the end of the block, leave room for
+         * aligning the write buffer in front of them */
+        srh->timing_offset = pa_memblock_get_length(sr->memblock) - PA_SRBCHANNEL_TIMING_SLOTS * sizeof(pa_srbchannel_timing_slot);
+        srh->timing_offset = srh->timing_offset / PA_RINGBUFFER_CACHELINE * PA_RINGBUFFER_CACHELINE;
+        capacity = srh->timing_offset - srh->readbuf_offset - PA_ALIGN(1);
+
+        slots = (pa_srbchannel_timing_slot*) ((uint8_t*) srh + srh->timing_offset);
+        for (i = 0; i < PA_SRBCHANNEL_TIMING_SLOTS; i++) {
+            memset(&slots[i], 0, sizeof(slots[i]));
+            slots[i].timing.channel = PA_INVALID_INDEX;
+        }
+    }
+
+    capacity /= 2;
 
-    pa_log_debug("SHM block is %d bytes, ringbuffer capacity is 2 * %d bytes",
-        (int) pa_memblock_get_length(sr->memblock), capacity);
+    writebuf = PA_ALIGN_PTR(readbuf + capacity);
+    srh->writebuf_offset = writebuf - (uint8_t*) srh;
 
-    srh->capacity = sr->rb_read.capacity = sr->rb_write.capacity = capacity;
+    capacity = PA_MIN(capacity, srh->writebuf_offset - srh->readbuf_offset);
+
+    pa_log_debug("SHM block is %d bytes, ringbuffer capacity is 2 * %d bytes, %s indices",
+        (int) pa_memblock_get_length(sr->memblock), capacity, split_indices ? "split" : "shared");
 
-    sr->rb_read.count = &srh->read_count;
-    sr->rb_write.count = &srh->write_count;
+    srh->capacity = capacity;
+    srbchannel_init_ringbuffers(sr, srh);
 
     sr->sem_read = pa_fdsem_new_shm(&srh->read_semdata);
     if (!sr->sem_read)
@@ -295,15 +299,11 @@ pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel
 
     sr->mainloop = m;
     sr->memblock = t->memblock;
+    sr->split_indices = t->split_indices;
     pa_memblock_ref(sr->memblock);
     srh = pa_memblock_acquire(sr->memblock);
 
-    sr->rb_read.capacity = sr->rb_write.capacity = srh->capacity;
-    sr->rb_read.count = &srh->read_count;
-    sr->rb_write.count = &srh->write_count;
-
-    sr->rb_read.memory = (uint8_t*) srh + srh->readbuf_offset;
-    sr->rb_write.memory = (uint8_t*) srh + srh->writebuf_offset;
+    srbchannel_init_ringbuffers(sr, srh);
 
     sr->sem_read = pa_fdsem_open_shm(&srh->read_semdata, t->readfd);
     if (!sr->sem_read)
@@ -335,6 +335,7 @@ void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t) {
     t->memblock = sr->memblock;
     t->readfd = pa_fdsem_get(sr->sem_read);
     t->writefd = pa_fdsem_get(sr->sem_write);
+    t->split_indices = sr->split_indices;
 }
 
 void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata) {
@@ -353,6 +354,56 @@ void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback,
     }
 }
 
+pa_srbchannel_timing_slot* pa_srbchannel_get_timing_slot(pa_memblock *memblock, uint32_t channel) {
+    struct srbheader *srh;
+    pa_srbchannel_timing_slot *slot = NULL;
+
+    pa_assert(memblock);
+
+    srh = pa_memblock_acquire(memblock);
+
+    /* Both sides can write to the block, so don't trust the offset */
+    if (srh->timing_offset >= (int) sizeof(*srh) &&
+        (size_t) srh->timing_offset + PA_SRBCHANNEL_TIMING_SLOTS * sizeof(pa_srbchannel_timing_slot) <= pa_memblock_get_length(memblock))
+        slot = (pa_srbchannel_timing_slot*) ((uint8_t*) srh + srh->timing_offset) + channel % PA_SRBCHANNEL_TIMING_SLOTS;
+
+    pa_memblock_release(memblock);
+
+    return slot;
+}
+
+void pa_srbchannel_timing_publish(pa_srbchannel_timing_slot *slot, const pa_srbchannel_timing *t) {
+    pa_assert(slot);
+    pa_assert(t);
+
+    /* An odd sequence number marks an update in progress. The atomic
+     * operations imply full barriers. */
+    pa_atomic_inc(&slot->seq);
+    slot->timing = *t;
+    pa_atomic_inc(&slot->seq);
+}
+
+bool pa_srbchannel_timing_read(pa_srbchannel_timing_slot *slot, pa_srbchannel_timing *t) {
+    unsigned tries;
+
+    pa_assert(slot);
+    pa_assert(t);
+
+    for (tries = 0; tries < 16; tries++) {
+        int seq = pa_atomic_load(&slot->seq);
+
+        if (seq & 1)
+            continue;
+
+        *t = slot->timing;
+
+        if (pa_atomic_load(&slot->seq) == seq)
+            return true;
+    }
+
+    return false;
+}
+
 void pa_srbchannel_free(pa_srbchannel *sr)
 {
 #ifdef DEBUG_SRBCHANNEL
@@ -21,6 +21,7 @@
 ***/
 
 #include <pulse/mainloop-api.h>
+#include <pulse/sample.h>
 #include <pulsecore/fdsem.h>
 #include <pulsecore/memblock.h>
 
@@ -32,9 +33,12 @@ typedef struct pa_srbchannel pa_srbchannel;
 typedef struct pa_srbchannel_template {
     int readfd, writefd;
     pa_memblock *memblock;
+    bool split_indices;
 } pa_srbchannel_template;
 
-pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p);
+/* split_indices selects the ringbuffer synchronization. It must only be
+ * set if the other side speaks protocol version 33 or newer. */
+pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p, bool split_indices);
 /* Note: this creates a srbchannel with swapped read and write. */
 pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel_template *t);
 
@@ -54,4 +58,32 @@ size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
 typedef bool (*pa_srbchannel_cb_t)(pa_srbchannel *sr, void *userdata);
 void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata);
 
+/* With split indices the shm block also carries a table of timing slots,
+ * into which the server publishes the timing of playback streams, so that
+ * clients can look it up without a round trip. Each slot has one writer
+ * at a time and is protected by a sequence lock. There are no more than
+ * 32 slots, the server keeps track of them in a bitmask. */
+#define PA_SRBCHANNEL_TIMING_SLOTS 32
+
+typedef struct pa_srbchannel_timing {
+    uint32_t channel;        /* PA_INVALID_INDEX if the slot is unused */
+    uint32_t playing;
+    int64_t read_index;
+    pa_usec_t sink_usec;
+    pa_usec_t timestamp;     /* pa_rtclock_now() of the writer */
+    uint64_t since_underrun;
+} pa_srbchannel_timing;
+
+typedef struct pa_srbchannel_timing_slot pa_srbchannel_timing_slot;
+
+/* Returns the slot for the stream with the given channel, or NULL if the
+ * block carries no timing slots. The slot stays valid for as long as the
+ * memblock is referenced. */
+pa_srbchannel_timing_slot* pa_srbchannel_get_timing_slot(pa_memblock *memblock, uint32_t channel);
+
+void pa_srbchannel_timing_publish(pa_srbchannel_timing_slot *slot, const pa_srbchannel_timing *t);
+
+/* Returns false if the writer kept interfering, t is undefined then */
+bool pa_srbchannel_timing_read(pa_srbchannel_timing_slot *slot, pa_srbchannel_timing *t);
+
 #endif
@@ -0,0 +1,364 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+#include <pulsecore/log.h>
+
+#include "cpu-x86.h"
+#include "sample-util.h"
+
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+
+/* Like mix_sse.c, this is built with per-function target attributes, so
+ * no special compiler flags are needed. */
+#include <immintrin.h>
+
+#define AVX2_FUNC __attribute__((target("avx2")))
+#define AVX512_FUNC __attribute__((target("avx512f")))
+
+static pa_do_volume_func_t fallback_s16ne;
+static pa_do_volume_func_t fallback_s16re;
+static pa_do_volume_func_t fallback_float32ne;
+static pa_do_volume_func_t fallback_s32ne;
+
+/* Number of vectors after which the per-lane channel layout repeats.
+ * lanes is a power of two, so we just strip the common power of two. */
+static unsigned pattern_period(unsigned channels, unsigned lanes) {
+    while (lanes > 1 && !(channels & 1)) {
+        channels >>= 1;
+        lanes >>= 1;
+    }
+
+    return channels;
+}
+
+/* Number of samples we do in SIMD: whole layout periods only, so that
+ * the rest starts on channel 0 again and can be left to the fallback. */
+static unsigned simd_samples(unsigned n, unsigned channels, unsigned lanes) {
+    return n - n % (lanes * pattern_period(channels, lanes));
+}
+
+/* Lay out the volumes for n consecutive samples, starting at channel 0.
+ * This way we don't depend on how much padding the caller's volume
+ * array has. */
+static void build_volumes_s16(int16_t lo[], int16_t hi[], const int32_t *volumes, unsigned channels, unsigned n) {
+    unsigned k, c = 0;
+
+    for (k = 0; k < n; k++) {
+        lo[k] = (int16_t) (volumes[c] & 0xFFFF);
+        hi[k] = (int16_t) (volumes[c] >> 16);
+
+        if (++c >= channels)
+            c = 0;
+    }
+}
+
+static void build_volumes_32(uint32_t v[], const uint32_t *volumes, unsigned channels, unsigned n) {
+    unsigned k, c = 0;
+
+    for (k = 0; k < n; k++) {
+        v[k] = volumes[c];
+
+        if (++c >= channels)
+            c = 0;
+    }
+}
+
+/*
+ * AVX2
+ *
+ * s16 uses the same trick as mix_sse.c: pa_mult_s16_volume() computes
+ * (v * cv) >> 16 with a 48 bit product, so we split cv into its 16 bit
+ * halves. (v * lo) >> 16 is a signed by unsigned high multiply, and
+ * pmaddwd adds v * hi to it by pairing (v, (v * lo) >> 16) with
+ * (hi, 1). The result is bit exact.
+ */
+
+typedef struct s16_vol_avx2 {
+    __m256i lo, ml, mh;
+} s16_vol_avx2;
+
+static AVX2_FUNC void s16_vol_load_avx2(s16_vol_avx2 *v, const int16_t lo[], const int16_t hi[]) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i h = _mm256_loadu_si256((const __m256i*) hi);
+
+    v->lo = _mm256_loadu_si256((const __m256i*) lo);
+    v->ml = _mm256_unpacklo_epi16(h, ones);
+    v->mh = _mm256_unpackhi_epi16(h, ones);
+}
+
+/* unpack and pack both work within 128 bit lanes, so the sample order
+ * comes out right after _mm256_packs_epi32() */
+static inline AVX2_FUNC __m256i s16_volume_avx2(__m256i s, const s16_vol_avx2 *v) {
+    __m256i p;
+
+    p = _mm256_sub_epi16(_mm256_mulhi_epu16(s, v->lo), _mm256_and_si256(v->lo, _mm256_srai_epi16(s, 15)));
+
+    return _mm256_packs_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(s, p), v->ml),
+                              _mm256_madd_epi16(_mm256_unpackhi_epi16(s, p), v->mh));
+}
+
+static inline AVX2_FUNC __m256i swap16_avx2(__m256i s) {
+    const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    return _mm256_shuffle_epi8(s, mask);
+}
+
+static AVX2_FUNC void volume_s16_avx2(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned n, bool swap) {
+    int16_t lo[16 * PA_CHANNELS_MAX], hi[16 * PA_CHANNELS_MAX];
+    s16_vol_avx2 v[PA_CHANNELS_MAX];
+    unsigned period = pattern_period(channels, 16);
+    unsigned j, k;
+
+    build_volumes_s16(lo, hi, volumes, channels, 16 * period);
+    for (j = 0; j < period; j++)
+        s16_vol_load_avx2(&v[j], lo + 16 * j, hi + 16 * j);
+
+    for (k = 0, j = 0; k < n; k += 16, samples += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i*) samples);
+
+        if (swap)
+            s = swap16_avx2(s);
+
+        s = s16_volume_avx2(s, &v[j]);
+
+        if (swap)
+            s = swap16_avx2(s);
+
+        _mm256_storeu_si256((__m256i*) samples, s);
+
+        if (++j >= period)
+            j = 0;
+    }
+}
+
+static AVX2_FUNC void volume_float32ne_avx2(float *samples, const float *volumes, unsigned channels, unsigned n) {
+    uint32_t vol[8 * PA_CHANNELS_MAX];
+    __m256 v[PA_CHANNELS_MAX];
+    unsigned period = pattern_period(channels, 8);
+    unsigned j, k;
+
+    build_volumes_32(vol, (const uint32_t*) volumes, channels, 8 * period);
+    for (j = 0; j < period; j++)
+        v[j] = _mm256_loadu_ps((const float*) vol + 8 * j);
+
+    for (k = 0, j = 0; k < n; k += 8, samples += 8) {
+        _mm256_storeu_ps(samples, _mm256_mul_ps(_mm256_loadu_ps(samples), v[j]));
+
+        if (++j >= period)
+            j = 0;
+    }
+}
+
+/* s32: (v * cv) >> 16 needs the full 64 bit product, which we only get
+ * for the even lanes. Instead of a 64 bit arithmetic shift, which AVX2
+ * lacks, we clamp the product first: after that the low 32 bits of a
+ * logical shift are the result. */
+static inline AVX2_FUNC __m256i s32_mult_avx2(__m256i s, __m256i v) {
+    const __m256i max = _mm256_set1_epi64x(((int64_t) 0x7FFFFFFF << 16) | 0xFFFF);
+    const __m256i min = _mm256_set1_epi64x(-((int64_t) 0x80000000 << 16));
+    __m256i p;
+
+    p = _mm256_mul_epi32(s, v);
+    p = _mm256_blendv_epi8(p, max, _mm256_cmpgt_epi64(p, max));
+    p = _mm256_blendv_epi8(p, min, _mm256_cmpgt_epi64(min, p));
+
+    return _mm256_srli_epi64(p, 16);
+}
+
+static AVX2_FUNC void volume_s32ne_avx2(int32_t *samples, const int32_t *volumes, unsigned channels, unsigned n) {
+    uint32_t vol[8 * PA_CHANNELS_MAX];
+    __m256i v[PA_CHANNELS_MAX];
+    unsigned period = pattern_period(channels, 8);
+    unsigned j, k;
+
+    build_volumes_32(vol, (const uint32_t*) volumes, channels, 8 * period);
+    for (j = 0; j < period; j++)
+        v[j] = _mm256_loadu_si256((const __m256i*) (vol + 8 * j));
+
+    for (k = 0, j = 0; k < n; k += 8, samples += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*) samples);
+        __m256i even, odd;
+
+        even = s32_mult_avx2(s, v[j]);
+        odd = s32_mult_avx2(_mm256_srli_epi64(s, 32), _mm256_srli_epi64(v[j], 32));
+
+        _mm256_storeu_si256((__m256i*) samples, _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA));
+
+        if (++j >= period)
+            j = 0;
+    }
+}
+
+/*
+ * AVX-512
+ *
+ * We stick to AVX512F, which every AVX-512 CPU has. For s16 we widen to
+ * 32 bit instead of relying on AVX512BW: v * lo and v * hi both fit into
+ * 32 bits, and vpmovsdw does the clamping on the way back.
+ */
+
+static inline AVX512_FUNC __m256i s16_volume_avx512(__m256i s, __m512i lo, __m512i hi) {
+    __m512i w = _mm512_cvtepi16_epi32(s);
+
+    w = _mm512_add_epi32(_mm512_mullo_epi32(w, hi), _mm512_srai_epi32(_mm512_mullo_epi32(w, lo), 16));
+
+    return _mm512_cvtsepi32_epi16(w);
+}
+
+static AVX512_FUNC void volume_s16_avx512(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned n, bool swap) {
+    uint32_t vol[16 * PA_CHANNELS_MAX];
+    __m512i lo[PA_CHANNELS_MAX], hi[PA_CHANNELS_MAX];
+    unsigned period = pattern_period(channels, 16);
+    unsigned j, k;
+
+    build_volumes_32(vol, (const uint32_t*) volumes, channels, 16 * period);
+    for (j = 0; j < period; j++) {
+        __m512i v = _mm512_loadu_si512(vol + 16 * j);
+
+        lo[j] = _mm512_and_si512(v, _mm512_set1_epi32(0xFFFF));
+        hi[j] = _mm512_srai_epi32(v, 16);
+    }
+
+    for (k = 0, j = 0; k < n; k += 16, samples += 16) {
+        __m256i s = _mm256_loadu_si256((const __m256i*) samples);
+
+        if (swap)
+            s = swap16_avx2(s);
+
+        s = s16_volume_avx512(s, lo[j], hi[j]);
+
+        if (swap)
+            s = swap16_avx2(s);
+
+        _mm256_storeu_si256((__m256i*) samples, s);
+
+        if (++j >= period)
+            j = 0;
+    }
+}
+
+static AVX512_FUNC void volume_float32ne_avx512(float *samples, const float *volumes, unsigned channels, unsigned n) {
+    uint32_t vol[16 * PA_CHANNELS_MAX];
+    __m512 v[PA_CHANNELS_MAX];
+    unsigned period = pattern_period(channels, 16);
+    unsigned j, k;
+
+    build_volumes_32(vol, (const uint32_t*) volumes, channels, 16 * period);
+    for (j = 0; j < period; j++)
+        v[j] = _mm512_loadu_ps((const float*) vol + 16 * j);
+
+    for (k = 0, j = 0; k < n; k += 16, samples += 16) {
+        _mm512_storeu_ps(samples, _mm512_mul_ps(_mm512_loadu_ps(samples), v[j]));
+
+        if (++j >= period)
+            j = 0;
+    }
+}
+
+static inline AVX512_FUNC __m512i s32_mult_avx512(__m512i s, __m512i v) {
+    const __m512i max = _mm512_set1_epi64(0x7FFFFFFF);
+    const __m512i min = _mm512_set1_epi64(-(int64_t) 0x80000000);
+
+    return _mm512_max_epi64(_mm512_min_epi64(_mm512_srai_epi64(_mm512_mul_epi32(s, v), 16), max), min);
+}
+
+static AVX512_FUNC void volume_s32ne_avx512(int32_t *samples, const int32_t *volumes, unsigned channels, unsigned n) {
+    uint32_t vol[16 * PA_CHANNELS_MAX];
+    __m512i v[PA_CHANNELS_MAX];
+    unsigned period = pattern_period(channels, 16);
+    unsigned j, k;
+
+    build_volumes_32(vol, (const uint32_t*) volumes, channels, 16 * period);
+    for (j = 0; j < period; j++)
+        v[j] = _mm512_loadu_si512(vol + 16 * j);
+
+    for (k = 0, j = 0; k < n; k += 16, samples += 16) {
+        __m512i s = _mm512_loadu_si512(samples);
+        __m512i even, odd;
+
+        even = s32_mult_avx512(s, v[j]);
+        odd = s32_mult_avx512(_mm512_srli_epi64(s, 32), _mm512_srli_epi64(v[j], 32));
+
+        _mm512_storeu_si512(samples, _mm512_mask_blend_epi32(0xAAAA, even, _mm512_slli_epi64(odd, 32)));
+
+        if (++j >= period)
+            j = 0;
+    }
+}
+
+/* Entry points, for both AVX2 and AVX-512 */
+
+#define DEFINE_VOLUME_FUNC(name, type, format, lanes, body)                                     \
+    static void pa_volume_##format##_##name(type *samples, const void *volumes, unsigned channels, unsigned length) { \
+        unsigned n = simd_samples(length / sizeof(type), channels, lanes);                      \
+                                                                                                \
+        if (n > 0)                                                                              \
+            body;                                                                               \
+                                                                                                \
+        if (length > n * sizeof(type))                                                          \
+            fallback_##format(samples + n, volumes, channels, length - n * sizeof(type));      \
+    }
+
+DEFINE_VOLUME_FUNC(avx2, int16_t, s16ne, 16, volume_s16_avx2(samples, volumes, channels, n, false))
+DEFINE_VOLUME_FUNC(avx2, int16_t, s16re, 16, volume_s16_avx2(samples, volumes, channels, n, true))
+DEFINE_VOLUME_FUNC(avx2, float, float32ne, 8, volume_float32ne_avx2(samples, volumes, channels, n))
+DEFINE_VOLUME_FUNC(avx2, int32_t, s32ne, 8, volume_s32ne_avx2(samples, volumes, channels, n))
+
+DEFINE_VOLUME_FUNC(avx512, int16_t, s16ne, 16, volume_s16_avx512(samples, volumes, channels, n, false))
+DEFINE_VOLUME_FUNC(avx512, int16_t, s16re, 16, volume_s16_avx512(samples, volumes, channels, n, true))
+DEFINE_VOLUME_FUNC(avx512, float, float32ne, 16, volume_float32ne_avx512(samples, volumes, channels, n))
+DEFINE_VOLUME_FUNC(avx512, int32_t, s32ne, 16, volume_s32ne_avx512(samples, volumes, channels, n))
+
+#endif /* (defined (__i386__) || defined (__amd64__)) && compiler support */
+
+void pa_volume_func_init_avx(pa_cpu_x86_flag_t flags) {
+#if (defined (__i386__) || defined (__amd64__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+    if (!(flags & (PA_CPU_X86_AVX2 | PA_CPU_X86_AVX512F)))
+        return;
+
+    /* Whatever was there before takes care of the samples that don't
+     * fill a whole vector */
+    fallback_s16ne = pa_get_volume_func(PA_SAMPLE_S16NE);
+    fallback_s16re = pa_get_volume_func(PA_SAMPLE_S16RE);
+    fallback_float32ne = pa_get_volume_func(PA_SAMPLE_FLOAT32NE);
+    fallback_s32ne = pa_get_volume_func(PA_SAMPLE_S32NE);
+
+    if (flags & PA_CPU_X86_AVX512F) {
+        pa_log_info("Initialising AVX-512 optimized volume functions.");
+
+        pa_set_volume_func(PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_avx512);
+        pa_set_volume_func(PA_SAMPLE_S16RE, (pa_do_volume_func_t) pa_volume_s16re_avx512);
+        pa_set_volume_func(PA_SAMPLE_FLOAT32NE, (pa_do_volume_func_t) pa_volume_float32ne_avx512);
+        pa_set_volume_func(PA_SAMPLE_S32NE, (pa_do_volume_func_t) pa_volume_s32ne_avx512);
+    } else {
+        pa_log_info("Initialising AVX2 optimized volume functions.");
+
+        pa_set_volume_func(PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_avx2);
+        pa_set_volume_func(PA_SAMPLE_S16RE, (pa_do_volume_func_t) pa_volume_s16re_avx2);
+        pa_set_volume_func(PA_SAMPLE_FLOAT32NE, (pa_do_volume_func_t) pa_volume_float32ne_avx2);
+        pa_set_volume_func(PA_SAMPLE_S32NE, (pa_do_volume_func_t) pa_volume_s32ne_avx2);
+    }
+#endif
+}
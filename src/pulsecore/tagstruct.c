@@ -47,6 +47,7 @@ struct pa_tagstruct {
     uint8_t *data;
     size_t length, allocated;
     size_t rindex;
+    bool compact;
 
     enum {
         PA_TAGSTRUCT_FIXED, /* The tagstruct does not own the data, buffer was provided by caller. */
@@ -69,6 +70,7 @@ pa_tagstruct *pa_tagstruct_new(void) {
     t->allocated = MAX_APPENDED_SIZE;
     t->length = t->rindex = 0;
     t->type = PA_TAGSTRUCT_APPENDED;
+    t->compact = false;
 
     return t;
 }
@@ -84,6 +86,7 @@ pa_tagstruct *pa_tagstruct_new_fixed(const uint8_t* data, size_t length) {
     t->allocated = t->length = length;
     t->rindex = 0;
     t->type = PA_TAGSTRUCT_FIXED;
+    t->compact = false;
 
     return t;
 }
@@ -104,8 +107,10 @@ static inline void extend(pa_tagstruct*t, size_t l) {
     if (t->length+l <= t->allocated)
         return;
 
+    /* Grow geometrically, so that building a large reply entry by entry
+     * doesn't realloc() and copy the whole buffer every few entries */
     if (t->type == PA_TAGSTRUCT_DYNAMIC)
-        t->data = pa_xrealloc(t->data, t->allocated = t->length + l + GROW_TAG_SIZE);
+        t->data = pa_xrealloc(t->data, t->allocated = PA_MAX(t->length + l + GROW_TAG_SIZE, t->allocated * 2));
     else if (t->type == PA_TAGSTRUCT_APPENDED) {
         t->type = PA_TAGSTRUCT_DYNAMIC;
         t->data = pa_xmalloc(t->allocated = t->length + l + GROW_TAG_SIZE);
@@ -113,6 +118,32 @@ static inline void extend(pa_tagstruct*t, size_t l) {
     }
 }
 
+void pa_tagstruct_reserve(pa_tagstruct *t, size_t l) {
+    pa_assert(t);
+
+    extend(t, l);
+}
+
+uint8_t* pa_tagstruct_steal_data(pa_tagstruct *t, size_t *l) {
+    uint8_t *p;
+
+    pa_assert(t);
+    pa_assert(l);
+
+    if (t->type != PA_TAGSTRUCT_DYNAMIC)
+        return NULL;
+
+    p = t->data;
+    *l = t->length;
+
+    t->data = t->per_type.appended;
+    t->allocated = MAX_APPENDED_SIZE;
+    t->length = t->rindex = 0;
+    t->type = PA_TAGSTRUCT_APPENDED;
+
+    return p;
+}
+
 static void write_u8(pa_tagstruct *t, uint8_t u) {
     extend(t, 1);
     t->data[t->length++] = u;
@@ -179,6 +210,83 @@ static int read_s64(pa_tagstruct *t, int64_t *u) {
     return 0;
 }
 
+/* LEB128: seven bits per byte, least significant first, the high bit
+ * is set on all bytes but the last */
+static unsigned varint_size(uint64_t u) {
+    unsigned n = 1;
+
+    while (u >= 0x80) {
+        u >>= 7;
+        n++;
+    }
+
+    return n;
+}
+
+static void write_varint(pa_tagstruct *t, uint64_t u) {
+    extend(t, varint_size(u));
+
+    while (u >= 0x80) {
+        t->data[t->length++] = (uint8_t) (u | 0x80);
+        u >>= 7;
+    }
+
+    t->data[t->length++] = (uint8_t) u;
+}
+
+static int read_varint(pa_tagstruct *t, uint64_t *u) {
+    uint64_t v = 0;
+    unsigned shift;
+
+    for (shift = 0; shift < 64; shift += 7) {
+        uint8_t b;
+
+        if (read_u8(t, &b) < 0)
+            return -1;
+
+        v |= (uint64_t) (b & 0x7F) << shift;
+
+        if (!(b & 0x80)) {
+            *u = v;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int read_varint_u32(pa_tagstruct *t, uint32_t *u) {
+    uint64_t v;
+
+    if (read_varint(t, &v) < 0 || v > UINT32_MAX)
+        return -1;
+
+    *u = (uint32_t) v;
+    return 0;
+}
+
+/* Writes a 32 bit value in the form with tag fixed_tag, or as varint
+ * with tag compact_tag if that is shorter */
+static void write_tagged_u32(pa_tagstruct *t, uint8_t fixed_tag, uint8_t compact_tag, uint32_t u) {
+    if (t->compact && varint_size(u) < 4) {
+        write_u8(t, compact_tag);
+        write_varint(t, u);
+    } else {
+        write_u8(t, fixed_tag);
+        write_u32(t, u);
+    }
+}
+
+static void write_tagged_u64(pa_tagstruct *t, uint8_t fixed_tag, uint8_t compact_tag, uint64_t u) {
+    if (t->compact && varint_size(u) < 8) {
+        write_u8(t, compact_tag);
+        write_varint(t, u);
+    } else {
+        write_u8(t, fixed_tag);
+        write_u64(t, u);
+    }
+}
+
 static void write_arbitrary(pa_tagstruct *t, const void *p, size_t len) {
     extend(t, len);
 
@@ -212,8 +320,7 @@ void pa_tagstruct_puts(pa_tagstruct*t, const char *s) {
 void pa_tagstruct_putu32(pa_tagstruct*t, uint32_t i) {
     pa_assert(t);
 
-    write_u8(t, PA_TAG_U32);
-    write_u32(t, i);
+    write_tagged_u32(t, PA_TAG_U32, PA_TAG_U32_COMPACT, i);
 }
 
 void pa_tagstruct_putu8(pa_tagstruct*t, uint8_t c) {
@@ -237,8 +344,7 @@ void pa_tagstruct_put_arbitrary(pa_tagstruct *t, const void *p, size_t length) {
     pa_assert(t);
     pa_assert(p);
 
-    write_u8(t, PA_TAG_ARBITRARY);
-    write_u32(t, length);
+    write_tagged_u32(t, PA_TAG_ARBITRARY, PA_TAG_ARBITRARY_COMPACT, length);
     write_arbitrary(t, p, length);
 }
 
@@ -259,15 +365,13 @@ void pa_tagstruct_put_timeval(pa_tagstruct*t, const struct timeval *tv) {
 void pa_tagstruct_put_usec(pa_tagstruct*t, pa_usec_t u) {
     pa_assert(t);
 
-    write_u8(t, PA_TAG_USEC);
-    write_u64(t, u);
+    write_tagged_u64(t, PA_TAG_USEC, PA_TAG_USEC_COMPACT, u);
 }
 
 void pa_tagstruct_putu64(pa_tagstruct*t, uint64_t u) {
     pa_assert(t);
 
-    write_u8(t, PA_TAG_U64);
-    write_u64(t, u);
+    write_tagged_u64(t, PA_TAG_U64, PA_TAG_U64_COMPACT, u);
 }
 
 void pa_tagstruct_puts64(pa_tagstruct*t, int64_t u) {
@@ -296,6 +400,26 @@ void pa_tagstruct_put_cvolume(pa_tagstruct *t, const pa_cvolume *cvolume) {
     pa_assert(t);
     pa_assert(cvolume);
 
+    if (t->compact && cvolume->channels > 0) {
+        size_t l = 0;
+        bool uniform = pa_cvolume_channels_equal_to(cvolume, cvolume->values[0]);
+
+        /* All channels at the same volume, as they mostly are, are sent
+         * only once, with the top bit of the channel count set */
+        for (i = 0; i < (uniform ? 1U : cvolume->channels); i++)
+            l += varint_size(cvolume->values[i]);
+
+        if (l < 4U * cvolume->channels) {
+            write_u8(t, PA_TAG_CVOLUME_COMPACT);
+            write_u8(t, cvolume->channels | (uniform ? 0x80 : 0));
+
+            for (i = 0; i < (uniform ? 1U : cvolume->channels); i++)
+                write_varint(t, cvolume->values[i]);
+
+            return;
+        }
+    }
+
     write_u8(t, PA_TAG_CVOLUME);
     write_u8(t, cvolume->channels);
 
@@ -306,18 +430,16 @@ void pa_tagstruct_put_cvolume(pa_tagstruct *t, const pa_cvolume *cvolume) {
 void pa_tagstruct_put_volume(pa_tagstruct *t, pa_volume_t vol) {
     pa_assert(t);
 
-    write_u8(t, PA_TAG_VOLUME);
-    write_u32(t, vol);
+    write_tagged_u32(t, PA_TAG_VOLUME, PA_TAG_VOLUME_COMPACT, vol);
 }
 
 void pa_tagstruct_put_proplist(pa_tagstruct *t, pa_proplist *p) {
     void *state = NULL;
     pa_assert(t);
-    pa_assert(p);
 
     write_u8(t, PA_TAG_PROPLIST);
 
-    for (;;) {
+    while (p) {
         const char *k;
         const void *d;
         size_t l;
@@ -398,6 +520,9 @@ int pa_tagstruct_getu32(pa_tagstruct*t, uint32_t *i) {
     pa_assert(t);
     pa_assert(i);
 
+    if (read_tag(t, PA_TAG_U32_COMPACT) >= 0)
+        return read_varint_u32(t, i);
+
     if (read_tag(t, PA_TAG_U32) < 0)
         return -1;
 
@@ -440,11 +565,16 @@ int pa_tagstruct_get_arbitrary(pa_tagstruct *t, const void **p, size_t length) {
     pa_assert(t);
     pa_assert(p);
 
-    if (read_tag(t, PA_TAG_ARBITRARY) < 0)
-        return -1;
+    if (read_tag(t, PA_TAG_ARBITRARY_COMPACT) >= 0) {
+        if (read_varint_u32(t, &len) < 0 || len != length)
+            return -1;
+    } else {
+        if (read_tag(t, PA_TAG_ARBITRARY) < 0)
+            return -1;
 
-    if (read_u32(t, &len) < 0 || len != length)
-        return -1;
+        if (read_u32(t, &len) < 0 || len != length)
+            return -1;
+    }
 
     return read_arbitrary(t, p, length);
 }
@@ -463,6 +593,18 @@ const uint8_t* pa_tagstruct_data(pa_tagstruct*t, size_t *l) {
     return t->data;
 }
 
+void pa_tagstruct_set_compact(pa_tagstruct *t, bool compact) {
+    pa_assert(t);
+
+    t->compact = compact;
+}
+
+size_t pa_tagstruct_get_read_index(pa_tagstruct *t) {
+    pa_assert(t);
+
+    return t->rindex;
+}
+
 int pa_tagstruct_get_boolean(pa_tagstruct*t, bool *b) {
     pa_assert(t);
     pa_assert(b);
@@ -507,6 +649,9 @@ int pa_tagstruct_get_usec(pa_tagstruct*t, pa_usec_t *u) {
     pa_assert(t);
     pa_assert(u);
 
+    if (read_tag(t, PA_TAG_USEC_COMPACT) >= 0)
+        return read_varint(t, u);
+
     if (read_tag(t, PA_TAG_USEC) < 0)
         return -1;
 
@@ -517,6 +662,9 @@ int pa_tagstruct_getu64(pa_tagstruct*t, uint64_t *u) {
     pa_assert(t);
     pa_assert(u);
 
+    if (read_tag(t, PA_TAG_U64_COMPACT) >= 0)
+        return read_varint(t, u);
+
     if (read_tag(t, PA_TAG_U64) < 0)
         return -1;
 
@@ -563,6 +711,29 @@ int pa_tagstruct_get_cvolume(pa_tagstruct *t, pa_cvolume *cvolume) {
     pa_assert(t);
     pa_assert(cvolume);
 
+    if (read_tag(t, PA_TAG_CVOLUME_COMPACT) >= 0) {
+        uint8_t c;
+        unsigned n;
+
+        if (read_u8(t, &c) < 0 || (c & 0x7F) > PA_CHANNELS_MAX)
+            return -1;
+
+        cvolume->channels = c & 0x7F;
+        n = (c & 0x80) ? 1 : cvolume->channels;
+
+        if (n > cvolume->channels)
+            return -1;
+
+        for (i = 0; i < n; i++)
+            if (read_varint_u32(t, &cvolume->values[i]) < 0)
+                return -1;
+
+        for (; i < cvolume->channels; i++)
+            cvolume->values[i] = cvolume->values[0];
+
+        return 0;
+    }
+
     if (read_tag(t, PA_TAG_CVOLUME) < 0)
         return -1;
 
@@ -581,6 +752,9 @@ int pa_tagstruct_get_volume(pa_tagstruct*t, pa_volume_t *vol) {
     pa_assert(t);
     pa_assert(vol);
 
+    if (read_tag(t, PA_TAG_VOLUME_COMPACT) >= 0)
+        return read_varint_u32(t, vol);
+
     if (read_tag(t, PA_TAG_VOLUME) < 0)
         return -1;
 
@@ -58,6 +58,15 @@ enum {
     PA_TAG_PROPLIST = 'P',
     PA_TAG_VOLUME = 'V',
     PA_TAG_FORMAT_INFO = 'f',
+
+    /* Variable length alternatives, written instead of the fixed size
+     * form by tagstructs in compact mode when they are shorter */
+    PA_TAG_U32_COMPACT = 'l',
+    PA_TAG_U64_COMPACT = 'q',
+    PA_TAG_USEC_COMPACT = 'u',
+    PA_TAG_VOLUME_COMPACT = 'w',
+    PA_TAG_CVOLUME_COMPACT = 'c',
+    PA_TAG_ARBITRARY_COMPACT = 'y',
 };
 
 pa_tagstruct *pa_tagstruct_new(void);
@@ -67,6 +76,23 @@ void pa_tagstruct_free(pa_tagstruct*t);
 int pa_tagstruct_eof(pa_tagstruct*t);
 const uint8_t* pa_tagstruct_data(pa_tagstruct*t, size_t *l);
 
+/* In compact mode integers, volumes and the lengths of arbitrary data
+ * are written as varints where that saves space. Readers always accept
+ * both forms, so only enable this if the other end knows them, i.e.
+ * speaks protocol version 33 or newer. */
+void pa_tagstruct_set_compact(pa_tagstruct *t, bool compact);
+
+/* Return how many bytes have been read so far */
+size_t pa_tagstruct_get_read_index(pa_tagstruct *t);
+
+/* Make sure l more bytes can be written without growing the buffer */
+void pa_tagstruct_reserve(pa_tagstruct *t, size_t l);
+
+/* If the data lives in a heap buffer of its own, hand that buffer over
+ * to the caller (to be freed with pa_xfree()) and leave the tagstruct
+ * empty. Returns NULL for small and fixed tagstructs. */
+uint8_t* pa_tagstruct_steal_data(pa_tagstruct *t, size_t *l);
+
 void pa_tagstruct_put(pa_tagstruct *t, ...);
 
 void pa_tagstruct_puts(pa_tagstruct*t, const char *s);
@@ -81,6 +107,7 @@ void pa_tagstruct_put_timeval(pa_tagstruct*t, const struct timeval *tv);
 void pa_tagstruct_put_usec(pa_tagstruct*t, pa_usec_t u);
 void pa_tagstruct_put_channel_map(pa_tagstruct *t, const pa_channel_map *map);
 void pa_tagstruct_put_cvolume(pa_tagstruct *t, const pa_cvolume *cvolume);
+/* p may be NULL, which puts an empty proplist */
 void pa_tagstruct_put_proplist(pa_tagstruct *t, pa_proplist *p);
 void pa_tagstruct_put_volume(pa_tagstruct *t, pa_volume_t volume);
 void pa_tagstruct_put_format_info(pa_tagstruct *t, pa_format_info *f);
@@ -63,6 +63,8 @@ static void thread_free_cb(void *p) {
 
 PA_STATIC_TLS_DECLARE(current_thread, thread_free_cb);
 
+static bool flush_denormals = false;
+
 static void* internal_thread_func(void *userdata) {
     pa_thread *t = userdata;
     pa_assert(t);
@@ -77,6 +79,9 @@ static void* internal_thread_func(void *userdata) {
 
     PA_STATIC_TLS_SET(current_thread, t);
 
+    if (flush_denormals)
+        pa_flush_denormals();
+
     pa_atomic_inc(&t->running);
     t->thread_func(t->userdata);
     pa_atomic_sub(&t->running, 2);
@@ -84,6 +89,10 @@ static void* internal_thread_func(void *userdata) {
     return NULL;
 }
 
+void pa_thread_set_flush_denormals(bool b) {
+    flush_denormals = b;
+}
+
 pa_thread* pa_thread_new(const char *name, pa_thread_func_t thread_func, void *userdata) {
     pa_thread *t;
 
@@ -56,6 +56,8 @@ static void thread_tls_once_func(void) {
     assert(thread_tls);
 }
 
+static bool flush_denormals = false;
+
 static DWORD WINAPI internal_thread_func(LPVOID param) {
     pa_thread *t = param;
     assert(t);
@@ -63,11 +65,18 @@ static DWORD WINAPI internal_thread_func(LPVOID param) {
     pa_run_once(&thread_tls_once, thread_tls_once_func);
     pa_tls_set(thread_tls, t);
 
+    if (flush_denormals)
+        pa_flush_denormals();
+
     t->thread_func(t->userdata);
 
     return 0;
 }
 
+void pa_thread_set_flush_denormals(bool b) {
+    flush_denormals = b;
+}
+
 pa_thread* pa_thread_new(const char *name, pa_thread_func_t thread_func, void *userdata) {
     pa_thread *t;
     DWORD thread_id;
@@ -49,6 +49,11 @@ void pa_thread_set_data(pa_thread *t, void *userdata);
 const char *pa_thread_get_name(pa_thread *t);
 void pa_thread_set_name(pa_thread *t, const char *name);
 
+/* Threads started after this flush denormal floats to zero, see
+ * pa_flush_denormals(). Meant for the daemon, whose threads are there
+ * to process audio. */
+void pa_thread_set_flush_denormals(bool b);
+
 typedef struct pa_tls pa_tls;
 
 pa_tls* pa_tls_new(pa_free_cb_t free_cb);
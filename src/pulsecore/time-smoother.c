@@ -72,6 +72,15 @@ struct pa_smoother {
     pa_usec_t history_x[HISTORY_MAX], history_y[HISTORY_MAX];
     unsigned history_idx, n_history;
 
+    /* Running sums over the history for the linear regression, so
+     * that it doesn't need to go through the whole history for every
+     * new measurement. They are taken relative to the base point,
+     * which is kept at the oldest entry to keep the sums small. The
+     * arithmetic is modulo 2^64, which keeps them exact through the
+     * intermediate steps of updating them. */
+    pa_usec_t base_x, base_y;
+    uint64_t sum_x, sum_y, sum_xx, sum_xy;
+
     /* To even out for monotonicity */
     pa_usec_t last_y, last_x;
 
@@ -132,6 +141,60 @@ void pa_smoother_free(pa_smoother* s) {
         x = ((x)+1) % HISTORY_MAX;              \
     } while(false)
 
+/* Moves the base point of the running sums to the entry at i */
+static void rebase(pa_smoother *s, unsigned i) {
+    uint64_t a, b, n;
+
+    a = (uint64_t) s->history_x[i] - (uint64_t) s->base_x;
+    b = (uint64_t) s->history_y[i] - (uint64_t) s->base_y;
+    n = s->n_history;
+
+    /* Expand sum((x-a)*(y-b)) and sum((x-a)^2) */
+    s->sum_xy = s->sum_xy - a * s->sum_y - b * s->sum_x + n * a * b;
+    s->sum_xx = s->sum_xx - 2 * a * s->sum_x + n * a * a;
+    s->sum_x -= n * a;
+    s->sum_y -= n * b;
+
+    s->base_x = s->history_x[i];
+    s->base_y = s->history_y[i];
+}
+
+static void sums_add(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
+    uint64_t dx, dy;
+
+    dx = (uint64_t) x - (uint64_t) s->base_x;
+    dy = (uint64_t) y - (uint64_t) s->base_y;
+
+    s->sum_x += dx;
+    s->sum_y += dy;
+    s->sum_xx += dx * dx;
+    s->sum_xy += dx * dy;
+}
+
+static void sums_remove(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
+    uint64_t dx, dy;
+
+    dx = (uint64_t) x - (uint64_t) s->base_x;
+    dy = (uint64_t) y - (uint64_t) s->base_y;
+
+    s->sum_x -= dx;
+    s->sum_y -= dy;
+    s->sum_xx -= dx * dx;
+    s->sum_xy -= dx * dy;
+}
+
+static void drop_oldest(pa_smoother *s) {
+    pa_assert(s->n_history > 0);
+
+    sums_remove(s, s->history_x[s->history_idx], s->history_y[s->history_idx]);
+
+    REDUCE_INC(s->history_idx);
+    s->n_history --;
+
+    if (s->n_history > 0)
+        rebase(s, s->history_idx);
+}
+
 static void drop_old(pa_smoother *s, pa_usec_t x) {
 
     /* Drop items from history which are too old, but make sure to
@@ -145,9 +208,7 @@ static void drop_old(pa_smoother *s, pa_usec_t x) {
             break;
 
         /* Item is too old, let's drop it */
-        REDUCE_INC(s->history_idx);
-
-        s->n_history --;
+        drop_oldest(s);
     }
 }
 
@@ -155,21 +216,46 @@ static void add_to_history(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
     unsigned j, i;
     pa_assert(s);
 
-    /* First try to update an existing history entry */
-    i = s->history_idx;
-    for (j = s->n_history; j > 0; j--) {
-
-        if (s->history_x[i] == x) {
-            s->history_y[i] = y;
-            return;
+    /* First try to update an existing history entry. Measurements
+     * usually come in order, in which case only the newest entry can
+     * have the same x. */
+    if (s->n_history > 0) {
+        i = s->history_idx + s->n_history - 1;
+        REDUCE(i);
+
+        if (x >= s->history_x[i])
+            j = 1;
+        else {
+            i = s->history_idx;
+            j = s->n_history;
         }
 
-        REDUCE_INC(i);
+        for (; j > 0; j--) {
+
+            if (s->history_x[i] == x) {
+                sums_remove(s, x, s->history_y[i]);
+                sums_add(s, x, y);
+                s->history_y[i] = y;
+                return;
+            }
+
+            REDUCE_INC(i);
+        }
     }
 
     /* Drop old entries */
     drop_old(s, x);
 
+    /* And make sure we don't store more entries than fit in */
+    if (s->n_history >= HISTORY_MAX)
+        drop_oldest(s);
+
+    if (s->n_history == 0) {
+        s->base_x = x;
+        s->base_y = y;
+        s->sum_x = s->sum_y = s->sum_xx = s->sum_xy = 0;
+    }
+
     /* Calculate position for new entry */
     j = s->history_idx + s->n_history;
     REDUCE(j);
@@ -181,62 +267,30 @@ static void add_to_history(pa_smoother *s, pa_usec_t x, pa_usec_t y) {
     /* Adjust counter */
     s->n_history ++;
 
-    /* And make sure we don't store more entries than fit in */
-    if (s->n_history > HISTORY_MAX) {
-        s->history_idx += s->n_history - HISTORY_MAX;
-        REDUCE(s->history_idx);
-        s->n_history = HISTORY_MAX;
-    }
+    sums_add(s, x, y);
 }
 
 static double avg_gradient(pa_smoother *s, pa_usec_t x) {
-    unsigned i, j, c = 0;
-    int64_t ax = 0, ay = 0, k, t;
-    double r;
-
-    /* FIXME: Optimization: Jason Newton suggested that instead of
-     * going through the history on each iteration we could calculated
-     * avg_gradient() as we go.
-     *
-     * Second idea: it might make sense to weight history entries:
-     * more recent entries should matter more than old ones. */
+    double n, k, t, r;
 
     /* Too few measurements, assume gradient of 1 */
     if (s->n_history < s->min_history)
         return 1;
 
-    /* First, calculate average of all measurements */
-    i = s->history_idx;
-    for (j = s->n_history; j > 0; j--) {
+    /* Linear regression from the running sums. The sums themselves
+     * are exact, and relative to the oldest entry they are small
+     * enough that the double products don't lose anything that
+     * matters. */
+    n = (double) s->n_history;
 
-        ax += (int64_t) s->history_x[i];
-        ay += (int64_t) s->history_y[i];
-        c++;
+    k = n * (double) (int64_t) s->sum_xy - (double) (int64_t) s->sum_x * (double) (int64_t) s->sum_y;
+    t = n * (double) (int64_t) s->sum_xx - (double) (int64_t) s->sum_x * (double) (int64_t) s->sum_x;
 
-        REDUCE_INC(i);
-    }
-
-    pa_assert(c >= s->min_history);
-    ax /= c;
-    ay /= c;
-
-    /* Now, do linear regression */
-    k = t = 0;
-
-    i = s->history_idx;
-    for (j = s->n_history; j > 0; j--) {
-        int64_t dx, dy;
-
-        dx = (int64_t) s->history_x[i] - ax;
-        dy = (int64_t) s->history_y[i] - ay;
-
-        k += dx*dy;
-        t += dx*dx;
-
-        REDUCE_INC(i);
-    }
+    /* All measurements at the same x, we can't tell */
+    if (t <= 0)
+        return 1;
 
-    r = (double) k / (double) t;
+    r = k / t;
 
     return (s->monotonic && r < 0) ? 0 : r;
 }
@@ -511,6 +565,9 @@ void pa_smoother_reset(pa_smoother *s, pa_usec_t time_offset, bool paused) {
     s->history_idx = 0;
     s->n_history = 0;
 
+    s->base_x = s->base_y = 0;
+    s->sum_x = s->sum_y = s->sum_xx = s->sum_xy = 0;
+
     s->last_y = s->last_x = 0;
 
     s->abc_valid = false;
@@ -0,0 +1,223 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+/* This is deprecated on glibc but is still used by FreeBSD */
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/thread.h>
+
+#include "trace.h"
+
+/* Events a thread's ring holds, must be a power of two */
+#define TRACE_RING_EVENTS 16384
+
+struct trace_event {
+    pa_usec_t time;
+    int64_t arg;
+    uint32_t seq;
+    uint16_t point;
+    uint8_t phase;
+};
+
+struct trace_ring {
+    struct trace_event *events;
+
+    /* Total number of events ever recorded, only written by the
+     * owning thread */
+    pa_atomic_t write_index;
+
+    unsigned tid;
+    char thread_name[32];
+
+    /* Set when the thread is gone, so that the ring can be reused */
+    pa_atomic_t dead;
+
+    PA_LLIST_FIELDS(struct trace_ring);
+};
+
+static const char * const point_names[PA_TRACE_POINT_MAX] = {
+    [PA_TRACE_RTPOLL_RUN] = "rtpoll-run",
+    [PA_TRACE_RTPOLL_SLEEP] = "rtpoll-sleep",
+    [PA_TRACE_SINK_RENDER] = "sink-render",
+    [PA_TRACE_SINK_PROCESS_REWIND] = "sink-process-rewind",
+    [PA_TRACE_ALSA_SINK_WRITE] = "alsa-sink-write",
+    [PA_TRACE_MEMBLOCKQ_PUSH] = "memblockq-push",
+};
+
+bool pa_trace_enabled = false;
+
+static void ring_release(void *p);
+
+PA_STATIC_TLS_DECLARE(trace_ring, ring_release);
+
+/* Protects the list of rings */
+static pa_static_mutex rings_mutex = PA_STATIC_MUTEX_INIT;
+static PA_LLIST_HEAD(struct trace_ring, rings) = NULL;
+static unsigned n_rings = 0;
+
+void pa_trace_set_enabled(bool enabled) {
+    pa_trace_enabled = enabled;
+}
+
+/* Called when a thread with a ring exits */
+static void ring_release(void *p) {
+    struct trace_ring *ring = p;
+
+    pa_atomic_store(&ring->dead, 1);
+}
+
+static struct trace_ring *ring_get(void) {
+    struct trace_ring *ring;
+    pa_mutex *m;
+
+    if ((ring = PA_STATIC_TLS_GET(trace_ring)))
+        return ring;
+
+    m = pa_static_mutex_get(&rings_mutex, false, false);
+    pa_mutex_lock(m);
+
+    /* Threads come and go with the sinks and sources, so take over the
+     * ring of one that is gone if we can */
+    for (ring = rings; ring; ring = ring->next)
+        if (pa_atomic_load(&ring->dead))
+            break;
+
+    if (ring) {
+        pa_atomic_store(&ring->write_index, 0);
+        pa_atomic_store(&ring->dead, 0);
+    } else {
+        size_t size = TRACE_RING_EVENTS * sizeof(struct trace_event);
+
+        ring = pa_xnew0(struct trace_ring, 1);
+
+        /* Anonymous memory is only backed by pages once it is actually
+         * written to, and doesn't add to the heap's fragmentation. Rings
+         * are never freed, only reused. */
+#ifdef MAP_ANONYMOUS
+        if ((ring->events = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, (off_t) 0)) == MAP_FAILED)
+#endif
+            ring->events = pa_xmalloc0(size);
+
+        ring->tid = ++n_rings;
+        PA_LLIST_PREPEND(struct trace_ring, rings, ring);
+    }
+
+    pa_strlcpy(ring->thread_name, pa_strnull(pa_thread_get_name(pa_thread_self())), sizeof(ring->thread_name));
+
+    pa_mutex_unlock(m);
+
+    PA_STATIC_TLS_SET(trace_ring, ring);
+
+    return ring;
+}
+
+void pa_trace_record(pa_trace_point_t point, pa_trace_phase_t phase, int64_t arg) {
+    struct trace_ring *ring;
+    struct trace_event *e;
+    unsigned idx;
+
+    pa_assert(point < PA_TRACE_POINT_MAX);
+
+    ring = ring_get();
+
+    idx = (unsigned) pa_atomic_load(&ring->write_index);
+    e = &ring->events[idx & (TRACE_RING_EVENTS - 1)];
+
+    e->time = pa_rtclock_now();
+    e->arg = arg;
+    e->seq = idx;
+    e->point = (uint16_t) point;
+    e->phase = (uint8_t) phase;
+
+    /* Publishes the event to pa_trace_dump() */
+    pa_atomic_store(&ring->write_index, (int) (idx + 1));
+}
+
+static void dump_ring(struct trace_ring *ring, pa_strbuf *buf, pid_t pid, bool *first) {
+    unsigned idx, end;
+    char *name;
+
+    end = (unsigned) pa_atomic_load(&ring->write_index);
+    idx = end > TRACE_RING_EVENTS ? end - TRACE_RING_EVENTS : 0;
+
+    name = pa_escape(ring->thread_name, "\"\\");
+    pa_strbuf_printf(buf, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                     *first ? "" : ",", (unsigned long) pid, ring->tid, name);
+    pa_xfree(name);
+    *first = false;
+
+    for (; idx < end; idx++) {
+        struct trace_event e;
+
+        /* The thread keeps recording while we read, so copy the event
+         * first and drop it if it has been overwritten meanwhile */
+        e = ring->events[idx & (TRACE_RING_EVENTS - 1)];
+
+        if (e.seq != idx || (unsigned) pa_atomic_load(&ring->write_index) - idx >= TRACE_RING_EVENTS)
+            continue;
+
+        if (e.point >= PA_TRACE_POINT_MAX)
+            continue;
+
+        pa_strbuf_printf(buf, ",\n{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%llu,\"pid\":%lu,\"tid\":%u,\"args\":{\"arg\":%lli}}",
+                         point_names[e.point], e.phase, e.phase == PA_TRACE_INSTANT ? "\"s\":\"t\"," : "",
+                         (unsigned long long) e.time, (unsigned long) pid, ring->tid, (long long) e.arg);
+    }
+}
+
+void pa_trace_dump(pa_strbuf *buf) {
+    struct trace_ring *ring;
+    pa_mutex *m;
+    bool first = true;
+    pid_t pid = getpid();
+
+    pa_assert(buf);
+
+    pa_strbuf_puts(buf, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    m = pa_static_mutex_get(&rings_mutex, false, false);
+    pa_mutex_lock(m);
+
+    /* Rings of threads that are gone are included, unless another
+     * thread took them over already */
+    for (ring = rings; ring; ring = ring->next)
+        dump_ring(ring, buf, pid, &first);
+
+    pa_mutex_unlock(m);
+
+    pa_strbuf_puts(buf, "\n]}\n");
+}
@@ -0,0 +1,76 @@
+#ifndef foopulsecoretracehfoo
+#define foopulsecoretracehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/strbuf.h>
+
+/* Lightweight tracing of the RT paths, for diagnosing glitches
+ * without rebuilding with the various DEBUG_* defines.
+ *
+ * Each thread records fixed size events into a ring of its own, which
+ * keeps the most recent ones and is never waited on. While tracing is
+ * disabled a trace point costs a single load and branch. */
+
+typedef enum pa_trace_point {
+    PA_TRACE_RTPOLL_RUN,
+    PA_TRACE_RTPOLL_SLEEP,
+    PA_TRACE_SINK_RENDER,
+    PA_TRACE_SINK_PROCESS_REWIND,
+    PA_TRACE_ALSA_SINK_WRITE,
+    PA_TRACE_MEMBLOCKQ_PUSH,
+    PA_TRACE_POINT_MAX
+} pa_trace_point_t;
+
+/* These match the Chrome trace event phases */
+typedef enum pa_trace_phase {
+    PA_TRACE_BEGIN = 'B',
+    PA_TRACE_END = 'E',
+    PA_TRACE_INSTANT = 'i'
+} pa_trace_phase_t;
+
+/* Only here for the inline functions below, use pa_trace_set_enabled() */
+extern bool pa_trace_enabled;
+
+void pa_trace_set_enabled(bool enabled);
+
+void pa_trace_record(pa_trace_point_t point, pa_trace_phase_t phase, int64_t arg);
+
+static inline void pa_trace_begin(pa_trace_point_t point, int64_t arg) {
+    if (PA_UNLIKELY(pa_trace_enabled))
+        pa_trace_record(point, PA_TRACE_BEGIN, arg);
+}
+
+static inline void pa_trace_end(pa_trace_point_t point, int64_t arg) {
+    if (PA_UNLIKELY(pa_trace_enabled))
+        pa_trace_record(point, PA_TRACE_END, arg);
+}
+
+static inline void pa_trace_instant(pa_trace_point_t point, int64_t arg) {
+    if (PA_UNLIKELY(pa_trace_enabled))
+        pa_trace_record(point, PA_TRACE_INSTANT, arg);
+}
+
+/* Writes the events recorded so far as a Chrome trace (JSON), which
+ * chrome://tracing and Perfetto can load */
+void pa_trace_dump(pa_strbuf *buf);
+
+#endif
@@ -26,6 +26,7 @@ typedef struct pa_card_profile pa_card_profile;
 typedef struct pa_client pa_client;
 typedef struct pa_core pa_core;
 typedef struct pa_device_port pa_device_port;
+typedef struct pa_io_pool pa_io_pool;
 typedef struct pa_sink pa_sink;
 typedef struct pa_sink_volume_change pa_sink_volume_change;
 typedef struct pa_sink_input pa_sink_input;
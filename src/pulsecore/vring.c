@@ -0,0 +1,270 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memfd-wrappers.h>
+#include <pulsecore/refcnt.h>
+
+#include "vring.h"
+
+struct piece {
+    pa_vring *ring;
+    pa_atomic_t busy;
+    size_t length;
+};
+
+struct window {
+    pa_memblock *blocks[PA_VRING_WINDOW_MAX];
+    unsigned n;
+};
+
+struct pa_vring {
+    /* One reference for the owner and one for each piece in use */
+    PA_REFCNT_DECLARE;
+
+    pa_mempool *pool;
+
+    int fd;
+    uint8_t *base;
+    size_t size;
+
+    /* Filling thread only */
+    size_t write_pos, used;
+    unsigned head, tail, n_pieces;
+
+    struct piece pieces[PA_VRING_PIECES_MAX];
+};
+
+#if defined(HAVE_MEMFD) && defined(HAVE_SYS_MMAN_H)
+
+pa_vring* pa_vring_new(pa_mempool *pool, size_t size) {
+    pa_vring *r;
+    uint8_t *base;
+    int fd;
+
+    pa_assert(pool);
+    pa_assert(size > 0);
+
+    size = PA_PAGE_ALIGN(size);
+
+    if ((fd = memfd_create("pulseaudio-vring", MFD_CLOEXEC)) < 0) {
+        pa_log_debug("memfd_create() failed: %s", pa_cstrerror(errno));
+        return NULL;
+    }
+
+    if (ftruncate(fd, (off_t) size) < 0) {
+        pa_log_debug("ftruncate() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    /* Reserve the address space for both halves, then map the same pages
+     * into each of them */
+    if ((base = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        pa_log_debug("mmap() failed: %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    if (mmap(base, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + size, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED) {
+        pa_log_debug("mmap() failed: %s", pa_cstrerror(errno));
+        munmap(base, 2 * size);
+        goto fail;
+    }
+
+    r = pa_xnew0(pa_vring, 1);
+    PA_REFCNT_INIT(r);
+    r->pool = pa_mempool_ref(pool);
+    r->fd = fd;
+    r->base = base;
+    r->size = size;
+
+    return r;
+
+fail:
+    pa_close(fd);
+    return NULL;
+}
+
+static void vring_unref(pa_vring *r) {
+    pa_assert(r);
+    pa_assert(PA_REFCNT_VALUE(r) >= 1);
+
+    if (PA_REFCNT_DEC(r) > 0)
+        return;
+
+    munmap(r->base, 2 * r->size);
+    pa_close(r->fd);
+    pa_mempool_unref(r->pool);
+    pa_xfree(r);
+}
+
+#else
+
+pa_vring* pa_vring_new(pa_mempool *pool, size_t size) {
+    return NULL;
+}
+
+static void vring_unref(pa_vring *r) {
+    pa_assert_not_reached();
+}
+
+#endif
+
+void pa_vring_free(pa_vring *r) {
+    pa_assert(r);
+
+    vring_unref(r);
+}
+
+size_t pa_vring_get_size(pa_vring *r) {
+    pa_assert(r);
+
+    return r->size;
+}
+
+static void piece_free_cb(void *p) {
+    struct piece *piece = p;
+    pa_vring *r = piece->ring;
+
+    pa_atomic_store(&piece->busy, 0);
+    vring_unref(r);
+}
+
+/* Give the space of the oldest pieces back, as far as they are no
+ * longer in use */
+static void reclaim(pa_vring *r) {
+    while (r->n_pieces > 0 && !pa_atomic_load(&r->pieces[r->tail].busy)) {
+        r->used -= r->pieces[r->tail].length;
+        r->tail = (r->tail + 1) % PA_VRING_PIECES_MAX;
+        r->n_pieces--;
+    }
+}
+
+pa_memblock* pa_vring_push(pa_vring *r, const pa_memchunk *chunk) {
+    struct piece *piece;
+    uint8_t *d;
+    void *s;
+
+    pa_assert(r);
+    pa_assert(chunk);
+    pa_assert(chunk->memblock);
+    pa_assert(chunk->length > 0);
+
+    reclaim(r);
+
+    if (r->n_pieces >= PA_VRING_PIECES_MAX || chunk->length > r->size - r->used)
+        return NULL;
+
+    /* Thanks to the second mapping this may run past the end */
+    d = r->base + r->write_pos;
+
+    s = pa_memblock_acquire_chunk(chunk);
+    memcpy(d, s, chunk->length);
+    pa_memblock_release(chunk->memblock);
+
+    piece = &r->pieces[r->head];
+    piece->ring = r;
+    piece->length = chunk->length;
+    pa_atomic_store(&piece->busy, 1);
+    PA_REFCNT_INC(r);
+
+    r->head = (r->head + 1) % PA_VRING_PIECES_MAX;
+    r->n_pieces++;
+    r->used += chunk->length;
+    r->write_pos = (r->write_pos + chunk->length) % r->size;
+
+    return pa_memblock_new_user(r->pool, d, chunk->length, piece_free_cb, piece, true);
+}
+
+static void window_free_cb(void *p) {
+    struct window *w = p;
+    unsigned i;
+
+    for (i = 0; i < w->n; i++)
+        pa_memblock_unref(w->blocks[i]);
+
+    pa_xfree(w);
+}
+
+/* Returns the offset of the chunk's data into the ring, or (size_t) -1
+ * if it isn't ours */
+static size_t chunk_offset(pa_vring *r, const pa_memchunk *c) {
+    uint8_t *d;
+
+    d = pa_memblock_acquire_chunk(c);
+    pa_memblock_release(c->memblock);
+
+    if (d < r->base || d >= r->base + 2 * r->size)
+        return (size_t) -1;
+
+    return (size_t) (d - r->base) % r->size;
+}
+
+pa_memblock* pa_vring_window(pa_vring *r, const pa_memchunk *chunks, unsigned n, size_t length) {
+    struct window *w;
+    size_t start, next, covered = 0;
+    unsigned i;
+
+    pa_assert(r);
+    pa_assert(chunks);
+    pa_assert(length > 0);
+
+    if (n == 0 || n > PA_VRING_WINDOW_MAX || length > r->size)
+        return NULL;
+
+    if ((start = chunk_offset(r, &chunks[0])) == (size_t) -1)
+        return NULL;
+
+    next = start;
+
+    for (i = 0; i < n; i++) {
+        if (i > 0 && chunk_offset(r, &chunks[i]) != next)
+            return NULL;
+
+        next = (next + chunks[i].length) % r->size;
+        covered += chunks[i].length;
+    }
+
+    if (covered < length)
+        return NULL;
+
+    w = pa_xnew(struct window, 1);
+    w->n = n;
+
+    for (i = 0; i < n; i++)
+        w->blocks[i] = pa_memblock_ref(chunks[i].memblock);
+
+    return pa_memblock_new_user(r->pool, r->base + start, length, window_free_cb, w, true);
+}
@@ -0,0 +1,59 @@
+#ifndef foopulsevringhfoo
+#define foopulsevringhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulsecore/memblock.h>
+#include <pulsecore/memchunk.h>
+
+/* A ring buffer whose memory is mapped twice in a row, so that any
+ * window of up to its size is contiguous, even across the wrap-around.
+ * Data is copied into the ring in pieces, each of which is handed out
+ * as a read-only memblock. Space is reused in order once the blocks of
+ * the oldest pieces are gone, and a piece that is still referenced
+ * anywhere, e.g. by a window, is never overwritten.
+ *
+ * Filling the ring is for one thread only, the blocks may be dropped
+ * from any thread. */
+
+/* The most pieces the ring keeps track of at a time */
+#define PA_VRING_PIECES_MAX 64
+
+/* The most pieces a window may span */
+#define PA_VRING_WINDOW_MAX 8
+
+typedef struct pa_vring pa_vring;
+
+/* Returns NULL if the system doesn't allow mapping memory twice. size is
+ * rounded up to whole pages. */
+pa_vring* pa_vring_new(pa_mempool *pool, size_t size);
+void pa_vring_free(pa_vring *r);
+
+size_t pa_vring_get_size(pa_vring *r);
+
+/* Copies the chunk into the ring. Returns a new reference to a block
+ * holding the copy, or NULL if the ring is full. */
+pa_memblock* pa_vring_push(pa_vring *r, const pa_memchunk *chunk);
+
+/* If the n chunks all live in the ring back to back, returns a new
+ * read-only block of the first length bytes starting at the first
+ * chunk, without copying. It keeps the chunks' blocks alive. Returns
+ * NULL otherwise. */
+pa_memblock* pa_vring_window(pa_vring *r, const pa_memchunk *chunks, unsigned n, size_t length);
+
+#endif
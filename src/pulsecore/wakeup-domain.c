@@ -0,0 +1,172 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+
+#include "wakeup-domain.h"
+
+struct pa_wakeup_domain {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+    char *shared_name;
+
+    /* Main thread */
+    bool used[PA_WAKEUP_DOMAIN_MAX_MEMBERS];
+
+    /* The planned wakeup of each member, as the lower 32 bits of its
+     * absolute time in usec, or 0 if it has no timer armed. 32 bits
+     * wrap after more than an hour, which is plenty since we only ever
+     * compare times that are close to now. */
+    pa_atomic_t wakeup[PA_WAKEUP_DOMAIN_MAX_MEMBERS];
+};
+
+pa_wakeup_domain* pa_wakeup_domain_get(pa_core *c, const char *name) {
+    pa_wakeup_domain *d;
+    char *shared_name;
+
+    pa_assert(c);
+    pa_assert(name);
+
+    shared_name = pa_sprintf_malloc("wakeup-domain:%s", name);
+
+    if ((d = pa_shared_get(c, shared_name))) {
+        pa_xfree(shared_name);
+        return pa_wakeup_domain_ref(d);
+    }
+
+    d = pa_xnew0(pa_wakeup_domain, 1);
+    PA_REFCNT_INIT(d);
+    d->core = c;
+    d->shared_name = shared_name;
+
+    pa_assert_se(pa_shared_set(c, d->shared_name, d) >= 0);
+
+    return d;
+}
+
+pa_wakeup_domain* pa_wakeup_domain_ref(pa_wakeup_domain *d) {
+    pa_assert(d);
+    pa_assert(PA_REFCNT_VALUE(d) >= 1);
+
+    PA_REFCNT_INC(d);
+
+    return d;
+}
+
+void pa_wakeup_domain_unref(pa_wakeup_domain *d) {
+    pa_assert(d);
+    pa_assert(PA_REFCNT_VALUE(d) >= 1);
+
+    if (PA_REFCNT_DEC(d) > 0)
+        return;
+
+    pa_assert_se(pa_shared_remove(d->core, d->shared_name) >= 0);
+
+    pa_xfree(d->shared_name);
+    pa_xfree(d);
+}
+
+int pa_wakeup_domain_join(pa_wakeup_domain *d) {
+    int i;
+
+    pa_assert(d);
+
+    for (i = 0; i < PA_WAKEUP_DOMAIN_MAX_MEMBERS; i++)
+        if (!d->used[i]) {
+            d->used[i] = true;
+            pa_atomic_store(&d->wakeup[i], 0);
+            return i;
+        }
+
+    pa_log_debug("Wakeup domain %s is full.", d->shared_name);
+    return -1;
+}
+
+void pa_wakeup_domain_leave(pa_wakeup_domain *d, int slot) {
+    pa_assert(d);
+    pa_assert(slot >= 0 && slot < PA_WAKEUP_DOMAIN_MAX_MEMBERS);
+    pa_assert(d->used[slot]);
+
+    pa_atomic_store(&d->wakeup[slot], 0);
+    d->used[slot] = false;
+}
+
+pa_usec_t pa_wakeup_domain_align(pa_wakeup_domain *d, int slot, pa_usec_t now, pa_usec_t sleep_usec, pa_usec_t slack_usec) {
+    pa_usec_t deadline, earliest, at = 0;
+    uint32_t stored;
+    int i;
+
+    pa_assert(d);
+    pa_assert(slot >= 0 && slot < PA_WAKEUP_DOMAIN_MAX_MEMBERS);
+    pa_assert(sleep_usec > 0);
+
+    /* Never wake up right away because of a peer */
+    slack_usec = PA_MIN(slack_usec, sleep_usec - 1);
+
+    deadline = now + sleep_usec;
+    earliest = deadline - slack_usec;
+
+    /* Pick the latest peer wakeup within our slack, so that we give up
+     * as little sleep as possible */
+    for (i = 0; i < PA_WAKEUP_DOMAIN_MAX_MEMBERS; i++) {
+        int32_t delta;
+        pa_usec_t w;
+
+        if (i == slot)
+            continue;
+
+        if ((stored = (uint32_t) pa_atomic_load(&d->wakeup[i])) == 0)
+            continue;
+
+        if ((delta = (int32_t) (stored - (uint32_t) now)) <= 0)
+            continue;
+
+        w = now + (pa_usec_t) delta;
+
+        if (w >= earliest && w <= deadline && w > at)
+            at = w;
+    }
+
+    if (at == 0)
+        at = deadline;
+
+    if ((stored = (uint32_t) at) == 0)
+        stored = 1;
+
+    pa_atomic_store(&d->wakeup[slot], (int) stored);
+
+    return at - now;
+}
+
+void pa_wakeup_domain_clear(pa_wakeup_domain *d, int slot) {
+    pa_assert(d);
+    pa_assert(slot >= 0 && slot < PA_WAKEUP_DOMAIN_MAX_MEMBERS);
+
+    pa_atomic_store(&d->wakeup[slot], 0);
+}
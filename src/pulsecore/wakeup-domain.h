@@ -0,0 +1,60 @@
+#ifndef foopulsewakeupdomainhfoo
+#define foopulsewakeupdomainhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/core.h>
+
+/* A wakeup domain is a set of IO threads, usually the sinks and sources
+ * of one card, which time their wakeups off clocks that run at the same
+ * rate. Each member publishes when it plans to wake up next, and before
+ * arming its own timer a member moves its wakeup earlier to coincide
+ * with another member's if that is within the slack it can afford. The
+ * threads still wake up separately, but the CPU only leaves its idle
+ * state once for all of them.
+ *
+ * Domains are looked up by name and shared between modules. Joining and
+ * leaving happens in the main thread, everything else is lock-free and
+ * meant for the IO threads. */
+
+#define PA_WAKEUP_DOMAIN_MAX_MEMBERS 16
+
+typedef struct pa_wakeup_domain pa_wakeup_domain;
+
+pa_wakeup_domain* pa_wakeup_domain_get(pa_core *c, const char *name);
+pa_wakeup_domain* pa_wakeup_domain_ref(pa_wakeup_domain *d);
+void pa_wakeup_domain_unref(pa_wakeup_domain *d);
+
+/* Returns the slot to pass to the functions below, or -1 if the domain
+ * is full. */
+int pa_wakeup_domain_join(pa_wakeup_domain *d);
+void pa_wakeup_domain_leave(pa_wakeup_domain *d, int slot);
+
+/* Called from the IO thread right before arming the timer. sleep_usec is
+ * how long the member wants to sleep from now, slack_usec how much
+ * earlier it could wake up without harm. Returns the sleep time to
+ * actually use, which is between sleep_usec - slack_usec and
+ * sleep_usec. */
+pa_usec_t pa_wakeup_domain_align(pa_wakeup_domain *d, int slot, pa_usec_t now, pa_usec_t sleep_usec, pa_usec_t slack_usec);
+
+/* Called from the IO thread when the member disables its timer. */
+void pa_wakeup_domain_clear(pa_wakeup_domain *d, int slot);
+
+#endif
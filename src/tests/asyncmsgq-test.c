@@ -25,7 +25,10 @@
 
 #include <check.h>
 
+#include <pulse/util.h>
+
 #include <pulsecore/asyncmsgq.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -105,6 +108,68 @@ START_TEST (asyncmsgq_test) {
 }
 END_TEST
 
+#define N_WRITERS 4
+#define N_MESSAGES 10000
+
+static void writer(void *_q) {
+    pa_asyncmsgq *q = _q;
+    static pa_atomic_t next_id = PA_ATOMIC_INIT(0);
+    int id = pa_atomic_inc(&next_id);
+    int64_t k;
+
+    /* Mix posts and sends, so that the queue overruns now and then */
+    for (k = 0; k < N_MESSAGES; k++) {
+        if (k % 100 == 99)
+            pa_asyncmsgq_send(q, NULL, id, NULL, k, NULL);
+        else
+            pa_asyncmsgq_post(q, NULL, id, NULL, k, NULL, NULL);
+    }
+}
+
+START_TEST (asyncmsgq_writers_test) {
+    pa_asyncmsgq *q;
+    pa_thread *t[N_WRITERS];
+    int64_t next[N_WRITERS];
+    unsigned i, n;
+
+    q = pa_asyncmsgq_new(0);
+    fail_unless(q != NULL);
+
+    for (i = 0; i < N_WRITERS; i++) {
+        next[i] = 0;
+        t[i] = pa_thread_new("writer", writer, q);
+        fail_unless(t[i] != NULL);
+    }
+
+    /* Let the writers overrun the queue */
+    pa_msleep(100);
+
+    /* Messages of each writer need to arrive in order */
+    for (n = 0; n < N_WRITERS * N_MESSAGES; n++) {
+        int code;
+        int64_t offset;
+
+        pa_assert_se(pa_asyncmsgq_get(q, NULL, &code, NULL, &offset, NULL, true) == 0);
+
+        fail_unless(code >= 0 && code < N_WRITERS);
+        fail_unless(offset == next[code]);
+        next[code]++;
+
+        pa_asyncmsgq_done(q, 0);
+
+        if (n % 1000 == 0)
+            pa_thread_yield();
+    }
+
+    for (i = 0; i < N_WRITERS; i++)
+        pa_thread_free(t[i]);
+
+    fail_unless(pa_asyncmsgq_get(q, NULL, NULL, NULL, NULL, NULL, false) < 0);
+
+    pa_asyncmsgq_unref(q);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -114,6 +179,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Message Queue");
     tc = tcase_create("asyncmsgq");
     tcase_add_test(tc, asyncmsgq_test);
+    tcase_add_test(tc, asyncmsgq_writers_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
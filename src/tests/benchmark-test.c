@@ -0,0 +1,422 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Runs a few load scenarios against the daemon and compares the results
+ * with a baseline. Needs a running daemon that allows loading modules,
+ * see check-daemon.
+ *
+ * The render statistics come from module-null-sink with benchmark=1,
+ * which the sink publishes on its proplist when it is suspended. The
+ * glitches are the underflows of streams on a clocked null sink. The
+ * context switches are those of this process.
+ *
+ * BENCHMARK_OUTPUT=<file>     write the results to file
+ * BENCHMARK_BASELINE=<file>   fail if a result is worse than in file, as
+ *                             written by BENCHMARK_OUTPUT before
+ * BENCHMARK_THRESHOLD=<n>     by more than n percent, 25 by default */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/resource.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <pulsecore/macro.h>
+
+#define SINK_NAME "benchmark"
+#define SINK_RATE 48000
+#define WARMUP_USEC (PA_USEC_PER_SEC)
+#define MEASURE_USEC (5 * PA_USEC_PER_SEC)
+#define MAX_STREAMS 32
+#define MAX_FILTERS 8
+#define MAX_RESULTS 64
+#define DEFAULT_THRESHOLD 25
+
+typedef struct scenario {
+    const char *name;
+    unsigned n_streams;
+    uint32_t rate;
+    unsigned n_filters;
+    bool shm;
+    /* Free running sink, otherwise a clocked one at this latency */
+    bool free_running;
+    pa_usec_t latency;
+} scenario;
+
+static const scenario scenarios[] = {
+    { "clients",    16, SINK_RATE, 0, true,  true,  0 },
+    { "no-shm",     16, SINK_RATE, 0, false, true,  0 },
+    { "resampling", 16, 44100,     0, true,  true,  0 },
+    { "filters",     4, SINK_RATE, 4, true,  true,  0 },
+    { "glitches",    8, SINK_RATE, 0, true,  false, 20 * PA_USEC_PER_MSEC },
+};
+
+typedef struct result {
+    char name[64];
+    double value;
+    bool lower_is_better;
+} result;
+
+static result results[MAX_RESULTS];
+static unsigned n_results = 0;
+
+static pa_threaded_mainloop *mainloop = NULL;
+static pa_context *context = NULL;
+static pa_stream *streams[MAX_STREAMS];
+static unsigned n_ready = 0;
+static unsigned n_underflows = 0;
+static const char *bname = NULL;
+
+static float data[SINK_RATE * 2 / 10]; /* 100ms of stereo */
+
+static void add_result(const scenario *sc, const char *metric, double value, bool lower_is_better) {
+    fail_unless(n_results < MAX_RESULTS);
+
+    snprintf(results[n_results].name, sizeof(results[n_results].name), "%s.%s", sc->name, metric);
+    results[n_results].value = value;
+    results[n_results].lower_is_better = lower_is_better;
+    n_results++;
+
+    fprintf(stderr, "%s.%s = %0.2f\n", sc->name, metric, value);
+}
+
+static void context_state_cb(pa_context *c, void *userdata) {
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void success_cb(pa_context *c, int success, void *userdata) {
+    fail_unless(success);
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void index_cb(pa_context *c, uint32_t idx, void *userdata) {
+    *(uint32_t *) userdata = idx;
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void sink_info_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    if (i)
+        pa_proplist_update(userdata, PA_UPDATE_REPLACE, i->proplist);
+
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+/* All of the following are called with the mainloop locked */
+static void wait_for_operation(pa_operation *o) {
+    fail_unless(o != NULL);
+
+    while (pa_operation_get_state(o) == PA_OPERATION_RUNNING)
+        pa_threaded_mainloop_wait(mainloop);
+
+    pa_operation_unref(o);
+}
+
+static uint32_t load_module(const char *name, const char *argument) {
+    uint32_t idx = PA_INVALID_INDEX;
+
+    wait_for_operation(pa_context_load_module(context, name, argument, index_cb, &idx));
+    fail_unless(idx != PA_INVALID_INDEX, "Failed to load %s", name);
+
+    return idx;
+}
+
+static void suspend_sink(bool suspend) {
+    wait_for_operation(pa_context_suspend_sink_by_name(context, SINK_NAME, suspend, success_cb, NULL));
+}
+
+/* Without SHM means a context that reads a client.conf saying so */
+static void connect_context(bool shm) {
+    char fn[] = "/tmp/benchmark-test-XXXXXX";
+    int fd = -1;
+
+    if (!shm) {
+        fail_unless((fd = mkstemp(fn)) >= 0);
+        fail_unless(write(fd, "enable-shm = no\n", 16) == 16);
+        close(fd);
+        setenv("PULSE_CLIENTCONFIG", fn, 1);
+    }
+
+    context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), bname);
+    fail_unless(context != NULL);
+
+    if (!shm) {
+        unsetenv("PULSE_CLIENTCONFIG");
+        unlink(fn);
+    }
+
+    pa_context_set_state_callback(context, context_state_cb, NULL);
+    fail_unless(pa_context_connect(context, NULL, PA_CONTEXT_NOFLAGS, NULL) >= 0);
+
+    while (pa_context_get_state(context) != PA_CONTEXT_READY) {
+        fail_unless(PA_CONTEXT_IS_GOOD(pa_context_get_state(context)));
+        pa_threaded_mainloop_wait(mainloop);
+    }
+}
+
+static void stream_state_cb(pa_stream *s, void *userdata) {
+    fail_unless(pa_stream_get_state(s) != PA_STREAM_FAILED);
+
+    if (pa_stream_get_state(s) == PA_STREAM_READY)
+        n_ready++;
+
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void stream_write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    while (nbytes > 0) {
+        size_t n = PA_MIN(nbytes, sizeof(data));
+
+        fail_unless(pa_stream_write(s, data, n, NULL, 0, PA_SEEK_RELATIVE) == 0);
+        nbytes -= n;
+    }
+}
+
+static void stream_underflow_cb(pa_stream *s, void *userdata) {
+    n_underflows++;
+}
+
+static void connect_streams(const scenario *sc, const char *dev) {
+    pa_sample_spec ss;
+    pa_buffer_attr attr;
+    unsigned i;
+
+    ss.format = PA_SAMPLE_FLOAT32NE;
+    ss.rate = sc->rate;
+    ss.channels = 2;
+
+    attr.maxlength = (uint32_t) -1;
+    attr.tlength = sc->latency ? (uint32_t) pa_usec_to_bytes(sc->latency, &ss) : (uint32_t) -1;
+    attr.prebuf = (uint32_t) -1;
+    attr.minreq = (uint32_t) -1;
+    attr.fragsize = (uint32_t) -1;
+
+    n_ready = 0;
+
+    for (i = 0; i < sc->n_streams; i++) {
+        streams[i] = pa_stream_new(context, "benchmark", &ss, NULL);
+        fail_unless(streams[i] != NULL);
+
+        pa_stream_set_state_callback(streams[i], stream_state_cb, NULL);
+        pa_stream_set_write_callback(streams[i], stream_write_cb, NULL);
+        pa_stream_set_underflow_callback(streams[i], stream_underflow_cb, NULL);
+
+        fail_unless(pa_stream_connect_playback(streams[i], dev, &attr,
+                                               sc->latency ? PA_STREAM_ADJUST_LATENCY : PA_STREAM_NOFLAGS,
+                                               NULL, NULL) >= 0);
+    }
+
+    while (n_ready < sc->n_streams)
+        pa_threaded_mainloop_wait(mainloop);
+}
+
+static uint64_t context_switches(void) {
+    struct rusage ru;
+
+    fail_unless(getrusage(RUSAGE_SELF, &ru) == 0);
+    return (uint64_t) ru.ru_nvcsw + (uint64_t) ru.ru_nivcsw;
+}
+
+static double get_double(pa_proplist *p, const char *key) {
+    const char *v;
+
+    fail_unless((v = pa_proplist_gets(p, key)) != NULL, "Sink has no %s", key);
+    return atof(v);
+}
+
+static void run_scenario(const scenario *sc) {
+    uint32_t filters[MAX_FILTERS];
+    char args[256], dev[64];
+    uint32_t sink;
+    uint64_t csw;
+    unsigned i;
+
+    fprintf(stderr, "Running scenario %s\n", sc->name);
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    connect_context(sc->shm);
+
+    snprintf(args, sizeof(args), "sink_name=" SINK_NAME " format=float32ne rate=%u channels=2 benchmark=%s",
+             SINK_RATE, sc->free_running ? "yes" : "no");
+    sink = load_module("module-null-sink", args);
+
+    /* Each filter swaps the channels, so that it has something to do */
+    snprintf(dev, sizeof(dev), SINK_NAME);
+    for (i = 0; i < sc->n_filters; i++) {
+        snprintf(args, sizeof(args), "sink_name=" SINK_NAME "-filter-%u master=%s "
+                 "channel_map=front-left,front-right master_channel_map=front-right,front-left remix=no", i, dev);
+        filters[i] = load_module("module-remap-sink", args);
+        snprintf(dev, sizeof(dev), SINK_NAME "-filter-%u", i);
+    }
+
+    connect_streams(sc, dev);
+
+    pa_threaded_mainloop_unlock(mainloop);
+    usleep(WARMUP_USEC);
+    pa_threaded_mainloop_lock(mainloop);
+
+    /* Suspending resets the render statistics */
+    if (sc->free_running) {
+        suspend_sink(true);
+        suspend_sink(false);
+    }
+
+    n_underflows = 0;
+    csw = context_switches();
+
+    pa_threaded_mainloop_unlock(mainloop);
+    usleep(MEASURE_USEC);
+    pa_threaded_mainloop_lock(mainloop);
+
+    add_result(sc, "context_switches_per_second", (double) (context_switches() - csw) * PA_USEC_PER_SEC / MEASURE_USEC, true);
+
+    if (sc->free_running) {
+        pa_proplist *p = pa_proplist_new();
+
+        suspend_sink(true);
+        wait_for_operation(pa_context_get_sink_info_by_name(context, SINK_NAME, sink_info_cb, p));
+
+        add_result(sc, "blocks_per_second", get_double(p, "benchmark.blocks_per_second"), false);
+        add_result(sc, "render_usec_p50", get_double(p, "benchmark.render_usec.p50"), true);
+        add_result(sc, "render_usec_p99", get_double(p, "benchmark.render_usec.p99"), true);
+        add_result(sc, "allocations_per_block", get_double(p, "benchmark.allocations_per_block"), true);
+
+        pa_proplist_free(p);
+    } else
+        add_result(sc, "glitches", n_underflows, true);
+
+    for (i = 0; i < sc->n_streams; i++) {
+        pa_stream_disconnect(streams[i]);
+        pa_stream_unref(streams[i]);
+        streams[i] = NULL;
+    }
+
+    for (i = sc->n_filters; i > 0; i--)
+        wait_for_operation(pa_context_unload_module(context, filters[i - 1], success_cb, NULL));
+    wait_for_operation(pa_context_unload_module(context, sink, success_cb, NULL));
+
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+    context = NULL;
+
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+static void write_results(const char *fn) {
+    FILE *f;
+    unsigned i;
+
+    fail_unless((f = fopen(fn, "w")) != NULL);
+
+    for (i = 0; i < n_results; i++)
+        fprintf(f, "%s %f\n", results[i].name, results[i].value);
+
+    fclose(f);
+}
+
+/* Returns the number of results that are worse than in the baseline */
+static unsigned compare_results(const char *fn, double threshold) {
+    char name[64];
+    double base;
+    unsigned i, n_worse = 0;
+    FILE *f;
+
+    fail_unless((f = fopen(fn, "r")) != NULL, "Can't open baseline %s", fn);
+
+    while (fscanf(f, "%63s %lf", name, &base) == 2) {
+        for (i = 0; i < n_results; i++)
+            if (strcmp(results[i].name, name) == 0)
+                break;
+
+        if (i >= n_results) {
+            fprintf(stderr, "%s is in the baseline, but wasn't measured\n", name);
+            continue;
+        }
+
+        if (results[i].lower_is_better ?
+            results[i].value > base * (1 + threshold / 100) :
+            results[i].value < base * (1 - threshold / 100)) {
+
+            fprintf(stderr, "REGRESSION: %s is %0.2f, baseline %0.2f\n", name, results[i].value, base);
+            n_worse++;
+        }
+    }
+
+    fclose(f);
+
+    return n_worse;
+}
+
+START_TEST (benchmark_test) {
+    const char *baseline, *output, *e;
+    double threshold = DEFAULT_THRESHOLD;
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(data); i++)
+        data[i] = (float) sin(((double) (i / 2) / SINK_RATE) * 2 * M_PI * 440) / 2;
+
+    mainloop = pa_threaded_mainloop_new();
+    fail_unless(mainloop != NULL);
+    fail_unless(pa_threaded_mainloop_start(mainloop) >= 0);
+
+    for (i = 0; i < PA_ELEMENTSOF(scenarios); i++)
+        run_scenario(&scenarios[i]);
+
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+
+    if ((output = getenv("BENCHMARK_OUTPUT")))
+        write_results(output);
+
+    if ((e = getenv("BENCHMARK_THRESHOLD")))
+        threshold = atof(e);
+
+    if ((baseline = getenv("BENCHMARK_BASELINE")))
+        fail_unless(compare_results(baseline, threshold) == 0);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv[0];
+
+    s = suite_create("Benchmark");
+    tc = tcase_create("benchmark");
+    tcase_add_test(tc, benchmark_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
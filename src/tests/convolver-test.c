@@ -0,0 +1,138 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/filter/convolver.h>
+
+#define N_IN 3
+#define N_OUT 2
+#define N_FRAMES 4000
+
+static float random_sample(void) {
+    return 2.0f * (rand() / (float) RAND_MAX - 0.5f);
+}
+
+/* Compare against a direct convolution, delayed by one block. Input
+ * channel 1 has no response for output channel 0. */
+static void run_convolver_test(unsigned block_size, unsigned n_taps) {
+    pa_convolver *c;
+    float *ir[N_IN][N_OUT] = {{ NULL }};
+    float *src, *dst;
+    unsigned in, out, i, j, done, chunk;
+
+    pa_log_debug("Checking convolver with %u taps and block size %u", n_taps, block_size);
+
+    pa_assert_se(c = pa_convolver_new(block_size, N_IN, N_OUT, n_taps));
+
+    for (in = 0; in < N_IN; in++) {
+        for (out = 0; out < N_OUT; out++) {
+            if (in == 1 && out == 0)
+                continue;
+
+            ir[in][out] = pa_xnew(float, n_taps);
+            for (i = 0; i < n_taps; i++)
+                ir[in][out][i] = random_sample() / n_taps;
+
+            pa_convolver_set_response(c, in, out, ir[in][out], n_taps);
+        }
+    }
+
+    src = pa_xnew(float, N_FRAMES * N_IN);
+    dst = pa_xnew(float, N_FRAMES * N_OUT);
+
+    for (i = 0; i < N_FRAMES * N_IN; i++)
+        src[i] = random_sample();
+
+    /* Feed chunks of odd sizes, so that they don't line up with blocks */
+    for (done = 0, chunk = 1; done < N_FRAMES; done += chunk, chunk = chunk * 3 % 127 + 1) {
+        chunk = PA_MIN(chunk, N_FRAMES - done);
+        pa_convolver_process(c, src + done * N_IN, dst + done * N_OUT, chunk);
+    }
+
+    for (i = 0; i < N_FRAMES; i++) {
+        for (out = 0; out < N_OUT; out++) {
+            float ref = 0.0f;
+
+            if (i >= block_size)
+                for (in = 0; in < N_IN; in++)
+                    for (j = 0; ir[in][out] && j < n_taps && j <= i - block_size; j++)
+                        ref += src[(i - block_size - j) * N_IN + in] * ir[in][out][j];
+
+            if (fabsf(dst[i * N_OUT + out] - ref) > 0.0001f) {
+                pa_log_debug("Frame %u, channel %u: %.9f != %.9f", i, out, dst[i * N_OUT + out], ref);
+                ck_abort();
+            }
+        }
+    }
+
+    /* After a reset the output only depends on new input */
+    pa_convolver_reset(c);
+    pa_convolver_process(c, src, dst, N_FRAMES);
+    for (i = 0; i < block_size * N_OUT; i++)
+        fail_unless(dst[i] == 0.0f);
+
+    pa_xfree(src);
+    pa_xfree(dst);
+
+    for (in = 0; in < N_IN; in++)
+        for (out = 0; out < N_OUT; out++)
+            pa_xfree(ir[in][out]);
+
+    pa_convolver_free(c);
+}
+
+START_TEST (convolver_test) {
+    run_convolver_test(2, 1);
+    run_convolver_test(16, 16);
+    run_convolver_test(64, 20);
+    run_convolver_test(64, 300);
+    run_convolver_test(256, 1024);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("convolver");
+    tc = tcase_create("convolver");
+    tcase_add_test(tc, convolver_test);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,241 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/random.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "runtime-test-util.h"
+
+#define FRAMES 1027
+#define TIMES 1000
+#define TIMES2 100
+
+static void run_interleave_test(
+        pa_interleave_func_t interleave,
+        pa_deinterleave_func_t deinterleave,
+        size_t ss,
+        unsigned align,
+        unsigned channels,
+        bool perf) {
+
+    uint8_t *in, *out, *out_ref, *planar[PA_CHANNELS_MAX], *planar_ref[PA_CHANNELS_MAX];
+    const void *in_planar[PA_CHANNELS_MAX];
+    unsigned c, n_frames;
+
+    n_frames = FRAMES - align;
+
+    /* The interleaved data is misaligned by align samples, the planar
+     * data by as many frames */
+    in = pa_xmalloc(FRAMES * channels * ss);
+    out = pa_xmalloc0(FRAMES * channels * ss);
+    out_ref = pa_xmalloc0(FRAMES * channels * ss);
+
+    pa_random(in, FRAMES * channels * ss);
+
+    for (c = 0; c < channels; c++) {
+        planar[c] = pa_xmalloc0(FRAMES * ss);
+        planar_ref[c] = pa_xmalloc0(FRAMES * ss);
+    }
+
+    deinterleave(in + align * ss, (void **) planar, channels, n_frames);
+    pa_get_deinterleave_func(ss)(in + align * ss, (void **) planar_ref, channels, n_frames);
+
+    for (c = 0; c < channels; c++) {
+        if (memcmp(planar[c], planar_ref[c], FRAMES * ss) != 0) {
+            pa_log_debug("Deinterleave correctness test failed: ss=%u, align=%u, channels=%u, channel %u",
+                         (unsigned) ss, align, channels, c);
+            ck_abort();
+        }
+
+        in_planar[c] = planar[c] + align * ss;
+    }
+
+    interleave(in_planar, channels, out, n_frames - align);
+    pa_get_interleave_func(ss)(in_planar, channels, out_ref, n_frames - align);
+
+    if (memcmp(out, out_ref, FRAMES * channels * ss) != 0) {
+        pa_log_debug("Interleave correctness test failed: ss=%u, align=%u, channels=%u",
+                     (unsigned) ss, align, channels);
+        ck_abort();
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %u-channel (de)interleaving performance with %u byte samples", channels, (unsigned) ss);
+
+        PA_RUNTIME_TEST_RUN_START("deinterleave func", TIMES, TIMES2) {
+            deinterleave(in, (void **) planar, channels, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("deinterleave orig", TIMES, TIMES2) {
+            pa_get_deinterleave_func(ss)(in, (void **) planar_ref, channels, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("interleave func", TIMES, TIMES2) {
+            interleave((const void **) planar, channels, out, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("interleave orig", TIMES, TIMES2) {
+            pa_get_interleave_func(ss)((const void **) planar, channels, out_ref, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    for (c = 0; c < channels; c++) {
+        pa_xfree(planar[c]);
+        pa_xfree(planar_ref[c]);
+    }
+
+    pa_xfree(in);
+    pa_xfree(out);
+    pa_xfree(out_ref);
+}
+
+static void run_clamp_test(pa_sample_clamp_func_t func, unsigned align, unsigned stride, bool perf) {
+    float *in, *out, *out_ref;
+    unsigned i, n;
+
+    n = FRAMES - align;
+
+    in = pa_xnew(float, FRAMES * stride);
+    out = pa_xnew0(float, FRAMES * stride);
+    out_ref = pa_xnew0(float, FRAMES * stride);
+
+    for (i = 0; i < FRAMES * stride; i++)
+        in[i] = ((int) (rand() % 4001) - 2000) / 1000.0f;
+
+    in[FRAMES / 2] = NAN;
+
+    func(out + align, stride * sizeof(float), in + align, stride * sizeof(float), n);
+    pa_get_sample_clamp_func()(out_ref + align, stride * sizeof(float), in + align, stride * sizeof(float), n);
+
+    if (memcmp(out, out_ref, FRAMES * stride * sizeof(float)) != 0) {
+        pa_log_debug("Clamp correctness test failed: align=%u, stride=%u", align, stride);
+        ck_abort();
+    }
+
+    if (perf) {
+        pa_log_debug("Testing clamping performance");
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(out, sizeof(float), in, sizeof(float), FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            pa_get_sample_clamp_func()(out_ref, sizeof(float), in, sizeof(float), FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_xfree(in);
+    pa_xfree(out);
+    pa_xfree(out_ref);
+}
+
+#if defined (__i386__) || defined (__amd64__)
+START_TEST (interleave_sse2_test) {
+    static const unsigned channels[] = { 2, 3, 4, 6, 8 };
+    pa_interleave_func_t orig_interleave[2], interleave[2];
+    pa_deinterleave_func_t orig_deinterleave[2], deinterleave[2];
+    pa_sample_clamp_func_t orig_clamp, clamp;
+    pa_cpu_x86_flag_t flags = 0;
+    unsigned i, j, k;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    for (i = 0; i < 2; i++) {
+        orig_interleave[i] = pa_get_interleave_func(2 << i);
+        orig_deinterleave[i] = pa_get_deinterleave_func(2 << i);
+    }
+    orig_clamp = pa_get_sample_clamp_func();
+
+    pa_sample_util_func_init_sse(flags);
+
+    for (i = 0; i < 2; i++) {
+        interleave[i] = pa_get_interleave_func(2 << i);
+        deinterleave[i] = pa_get_deinterleave_func(2 << i);
+        fail_unless(interleave[i] != orig_interleave[i]);
+        fail_unless(deinterleave[i] != orig_deinterleave[i]);
+
+        pa_set_interleave_func(2 << i, orig_interleave[i]);
+        pa_set_deinterleave_func(2 << i, orig_deinterleave[i]);
+    }
+
+    clamp = pa_get_sample_clamp_func();
+    fail_unless(clamp != orig_clamp);
+    pa_set_sample_clamp_func(orig_clamp);
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < PA_ELEMENTSOF(channels); j++)
+            for (k = 0; k < 8; k++)
+                run_interleave_test(interleave[i], deinterleave[i], 2 << i, k, channels[j], false);
+
+        for (j = 0; j < PA_ELEMENTSOF(channels); j++)
+            if (channels[j] != 3)
+                run_interleave_test(interleave[i], deinterleave[i], 2 << i, 0, channels[j], true);
+    }
+
+    for (k = 0; k < 8; k++) {
+        run_clamp_test(clamp, k, 1, false);
+        run_clamp_test(clamp, k, 2, false);
+    }
+
+    run_clamp_test(clamp, 0, 1, true);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("CPU");
+
+    tc = tcase_create("interleave");
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, interleave_sse2_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -21,8 +21,11 @@
 
 #include <check.h>
 
+#include <pulse/xmalloc.h>
+
 #include <pulsecore/cpu.h>
 #include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
 #include <pulsecore/random.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/mix.h>
@@ -32,6 +35,7 @@
 #define SAMPLES 1028
 #define TIMES 1000
 #define TIMES2 100
+#define MAX_STREAMS 8
 
 static void acquire_mix_streams(pa_mix_info streams[], unsigned nstreams) {
     unsigned i;
@@ -145,6 +149,146 @@ static void run_mix_test(
     pa_mempool_unref(pool);
 }
 
+/* Like run_mix_test(), but for any of the s16ne, s32ne and float32ne mixers
+ * and any number of streams and channels */
+static void run_mix_format_test(
+        pa_do_mix_func_t func,
+        pa_do_mix_func_t orig_func,
+        pa_sample_format_t format,
+        int align,
+        int nstreams,
+        int channels,
+        bool correct,
+        bool perf) {
+
+    pa_sample_spec ss;
+    pa_mempool *pool;
+    pa_mix_info m[MAX_STREAMS];
+    uint8_t *in[MAX_STREAMS];
+    uint8_t *out, *out_ref;
+    size_t ssize, size;
+    int i, j, nsamples;
+
+    pa_assert(nstreams >= 2 && nstreams <= MAX_STREAMS);
+    pa_assert(channels >= 1 && channels <= PA_CHANNELS_MAX);
+
+    ss.format = format;
+    ss.channels = channels;
+    ss.rate = 44100;
+    ssize = pa_sample_size(&ss);
+
+    /* Misalign everything by the same number of samples */
+    nsamples = channels * (SAMPLES - (8 - align));
+    size = nsamples * ssize;
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL, NULL);
+
+    out = pa_xmalloc(size + 8 * ssize);
+    out_ref = pa_xmalloc(size + 8 * ssize);
+
+    for (i = 0; i < nstreams; i++) {
+        in[i] = pa_xmalloc(size + 8 * ssize);
+
+        if (format == PA_SAMPLE_FLOAT32NE) {
+            float *f = (float *) (in[i] + (8 - align) * ssize);
+
+            for (j = 0; j < nsamples; j++)
+                f[j] = ((int) (rand() % 2001) - 1000) / 1000.0f;
+        } else
+            pa_random(in[i] + (8 - align) * ssize, size);
+
+        m[i].chunk.memblock = pa_memblock_new_fixed(pool, in[i] + (8 - align) * ssize, size, false);
+        m[i].chunk.length = size;
+        m[i].chunk.index = 0;
+        m[i].volume.channels = channels;
+
+        /* Cover attenuation, amplification and muted channels */
+        for (j = 0; j < channels; j++) {
+            m[i].volume.values[j] = PA_VOLUME_NORM;
+
+            if (format == PA_SAMPLE_FLOAT32NE)
+                m[i].linear[j].f = (j == i) ? 0.0f : 0.25f + 0.375f * ((i + j) % 5);
+            else
+                m[i].linear[j].i = (j == i) ? 0 : 0x4000 + 0x6000 * ((i + j) % 5);
+        }
+    }
+
+    if (correct) {
+        acquire_mix_streams(m, nstreams);
+        orig_func(m, nstreams, channels, out_ref + (8 - align) * ssize, size);
+        release_mix_streams(m, nstreams);
+
+        acquire_mix_streams(m, nstreams);
+        func(m, nstreams, channels, out + (8 - align) * ssize, size);
+        release_mix_streams(m, nstreams);
+
+        for (i = 0; i < nsamples; i++) {
+            bool ok;
+
+            if (format == PA_SAMPLE_FLOAT32NE) {
+                float a = ((float *) (out + (8 - align) * ssize))[i];
+                float b = ((float *) (out_ref + (8 - align) * ssize))[i];
+
+                ok = fabsf(a - b) <= 0.00001f;
+                if (!ok)
+                    pa_log_debug("%d: %.9f != %.9f", i, a, b);
+            } else {
+                ok = memcmp(out + (8 - align) * ssize + i * ssize, out_ref + (8 - align) * ssize + i * ssize, ssize) == 0;
+                if (!ok)
+                    pa_log_debug("%d: sample differs", i);
+            }
+
+            if (!ok) {
+                pa_log_debug("Correctness test failed: format=%s, align=%d, streams=%d, channels=%d",
+                             pa_sample_format_to_string(format), align, nstreams, channels);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %s %d-stream %d-channel mixing performance with %d sample alignment",
+                     pa_sample_format_to_string(format), nstreams, channels, align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            acquire_mix_streams(m, nstreams);
+            func(m, nstreams, channels, out + (8 - align) * ssize, size);
+            release_mix_streams(m, nstreams);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            acquire_mix_streams(m, nstreams);
+            orig_func(m, nstreams, channels, out_ref + (8 - align) * ssize, size);
+            release_mix_streams(m, nstreams);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    for (i = 0; i < nstreams; i++) {
+        pa_memblock_unref(m[i].chunk.memblock);
+        pa_xfree(in[i]);
+    }
+
+    pa_xfree(out);
+    pa_xfree(out_ref);
+
+    pa_mempool_unref(pool);
+}
+
+static void run_mix_format_tests(pa_do_mix_func_t func, pa_do_mix_func_t orig_func, pa_sample_format_t format) {
+    static const int channels[] = { 1, 2, 3, 4, 6, 8, 11 };
+    unsigned i;
+    int j, k;
+
+    for (i = 0; i < PA_ELEMENTSOF(channels); i++)
+        for (j = 2; j <= 5; j++)
+            for (k = 0; k < 8; k++)
+                run_mix_format_test(func, orig_func, format, k, j, channels[i], true, false);
+
+    run_mix_format_test(func, orig_func, format, 7, 2, 2, true, true);
+    run_mix_format_test(func, orig_func, format, 7, 3, 6, true, true);
+    run_mix_format_test(func, orig_func, format, 7, 8, 8, true, false);
+}
+
 START_TEST (mix_special_test) {
     pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, false };
     pa_do_mix_func_t orig_func, special_func;
@@ -168,6 +312,65 @@ START_TEST (mix_special_test) {
 }
 END_TEST
 
+#if defined (__i386__) || defined (__amd64__)
+static void run_mix_x86_tests(pa_cpu_x86_flag_t flags) {
+    pa_do_mix_func_t orig_func[3], func[3];
+    const pa_sample_format_t formats[3] = { PA_SAMPLE_S16NE, PA_SAMPLE_S32NE, PA_SAMPLE_FLOAT32NE };
+    int i;
+
+    for (i = 0; i < 3; i++)
+        orig_func[i] = pa_get_mix_func(formats[i]);
+
+    pa_mix_func_init_sse(flags);
+
+    for (i = 0; i < 3; i++) {
+        func[i] = pa_get_mix_func(formats[i]);
+        fail_unless(func[i] != orig_func[i]);
+
+        /* restore, so that the next run picks up the same fallbacks */
+        pa_set_mix_func(formats[i], orig_func[i]);
+    }
+
+    for (i = 0; i < 3; i++) {
+        pa_log_debug("Checking %s mix (%s)", (flags & PA_CPU_X86_AVX2) ? "AVX2" : "SSE2", pa_sample_format_to_string(formats[i]));
+        run_mix_format_tests(func[i], orig_func[i], formats[i]);
+    }
+
+    /* The previous special mix tests, against the C special cases */
+    run_mix_test(func[0], orig_func[0], 7, 2, true, true);
+    run_mix_test(func[0], orig_func[0], 7, 4, true, true);
+    run_mix_test(func[0], orig_func[0], 7, 1, true, true);
+}
+
+START_TEST (mix_sse2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    run_mix_x86_tests(flags & ~PA_CPU_X86_AVX2);
+}
+END_TEST
+
+START_TEST (mix_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    run_mix_x86_tests(flags);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (mix_neon_test) {
     pa_do_mix_func_t orig_func, neon_func;
@@ -209,6 +412,10 @@ int main(int argc, char *argv[]) {
 
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_special_test);
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, mix_sse2_test);
+    tcase_add_test(tc, mix_avx2_test);
+#endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, mix_neon_test);
 #endif
@@ -0,0 +1,173 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/random.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/resampler.h>
+
+#include "runtime-test-util.h"
+
+#define SAMPLES 1028
+#define TIMES 1000
+#define TIMES2 100
+
+static void run_peaks_test(
+        pa_find_peaks_func_t func,
+        pa_find_peaks_func_t orig_func,
+        pa_sample_format_t format,
+        unsigned align,
+        unsigned channels,
+        bool perf) {
+
+    uint8_t *in, *samples;
+    size_t ssize;
+    unsigned n_frames, c;
+    int16_t max_i[PA_CHANNELS_MAX], max_i_ref[PA_CHANNELS_MAX];
+    float max_f[PA_CHANNELS_MAX], max_f_ref[PA_CHANNELS_MAX];
+    void *max, *max_ref;
+
+    ssize = format == PA_SAMPLE_S16NE ? sizeof(int16_t) : sizeof(float);
+    n_frames = SAMPLES - align;
+
+    in = pa_xmalloc((SAMPLES + 8) * channels * ssize);
+    samples = in + align * ssize;
+
+    if (format == PA_SAMPLE_FLOAT32NE) {
+        float *f = (float *) samples;
+        unsigned i;
+
+        for (i = 0; i < n_frames * channels; i++)
+            f[i] = ((int) (rand() % 2001) - 1000) / 1000.0f;
+    } else {
+        int16_t *s = (int16_t *) samples;
+
+        pa_random(s, n_frames * channels * ssize);
+
+        /* Make sure the one value that needs saturating shows up */
+        s[n_frames * channels / 2] = -0x8000;
+    }
+
+    memset(max_i, 0, sizeof(max_i));
+    memset(max_i_ref, 0, sizeof(max_i_ref));
+    memset(max_f, 0, sizeof(max_f));
+    memset(max_f_ref, 0, sizeof(max_f_ref));
+
+    max = format == PA_SAMPLE_S16NE ? (void *) max_i : (void *) max_f;
+    max_ref = format == PA_SAMPLE_S16NE ? (void *) max_i_ref : (void *) max_f_ref;
+
+    orig_func(samples, channels, n_frames, max_ref);
+    func(samples, channels, n_frames, max);
+
+    for (c = 0; c < channels; c++) {
+        if (format == PA_SAMPLE_S16NE ? max_i[c] != max_i_ref[c] : max_f[c] != max_f_ref[c]) {
+            pa_log_debug("Correctness test failed: format=%s, align=%u, channels=%u, channel %u",
+                         pa_sample_format_to_string(format), align, channels, c);
+            ck_abort();
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %s %u-channel peak finding performance with %u sample alignment",
+                     pa_sample_format_to_string(format), channels, align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(samples, channels, n_frames, max);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(samples, channels, n_frames, max_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_xfree(in);
+}
+
+#if defined (__i386__) || defined (__amd64__)
+START_TEST (peaks_sse2_test) {
+    static const unsigned channels[] = { 1, 2, 3, 4, 6, 8 };
+    const pa_sample_format_t formats[2] = { PA_SAMPLE_S16NE, PA_SAMPLE_FLOAT32NE };
+    pa_find_peaks_func_t orig_func[2], func[2];
+    pa_cpu_x86_flag_t flags = 0;
+    unsigned i, j, k;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    for (i = 0; i < 2; i++)
+        orig_func[i] = pa_get_find_peaks_func(formats[i]);
+
+    pa_peaks_func_init_sse(flags);
+
+    for (i = 0; i < 2; i++) {
+        func[i] = pa_get_find_peaks_func(formats[i]);
+        fail_unless(func[i] != orig_func[i]);
+
+        pa_set_find_peaks_func(formats[i], orig_func[i]);
+    }
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < PA_ELEMENTSOF(channels); j++)
+            for (k = 0; k < 8; k++)
+                run_peaks_test(func[i], orig_func[i], formats[i], k, channels[j], false);
+
+        run_peaks_test(func[i], orig_func[i], formats[i], 7, 1, true);
+        run_peaks_test(func[i], orig_func[i], formats[i], 7, 2, true);
+    }
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("CPU");
+
+    tc = tcase_create("peaks");
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, peaks_sse2_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
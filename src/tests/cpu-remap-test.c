@@ -321,6 +321,60 @@ START_TEST (remap_sse2_test) {
 
     pa_log_debug("Checking SSE2 remap (s16, mono->stereo)");
     remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 1, 2, false);
+
+    pa_log_debug("Checking SSE2 remap (float, 6-channel->stereo)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 6, 2, false);
+    pa_log_debug("Checking SSE2 remap (float, stereo->6-channel)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 2, 6, false);
+    pa_log_debug("Checking SSE2 remap (float, 3-channel->5-channel)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 3, 5, false);
+    pa_log_debug("Checking SSE2 remap (float, 8-channel->6-channel)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 8, 6, false);
+
+    pa_log_debug("Checking SSE2 remap (s16, 6-channel->stereo)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 6, 2, false);
+    pa_log_debug("Checking SSE2 remap (s16, stereo->6-channel)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 2, 6, false);
+    pa_log_debug("Checking SSE2 remap (s16, 3-channel->5-channel)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 3, 5, false);
+    pa_log_debug("Checking SSE2 remap (s16, 8-channel->6-channel)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 8, 6, false);
+}
+END_TEST
+
+START_TEST (rearrange_sse2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_init_remap_func_t init_func, orig_init_func;
+
+    pa_cpu_get_x86_flags(&flags);
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    orig_init_func = pa_get_init_remap_func();
+    pa_remap_func_init_sse(flags);
+    init_func = pa_get_init_remap_func();
+
+    pa_log_debug("Checking SSE remap (float, stereo rearrange)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 2, 2, true);
+    pa_log_debug("Checking SSE remap (s16, stereo rearrange)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 2, 2, true);
+
+    pa_log_debug("Checking SSE remap (float, 4-channel rearrange)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 4, 4, true);
+    pa_log_debug("Checking SSE remap (s16, 4-channel rearrange)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 4, 4, true);
+
+    pa_log_debug("Checking SSE remap (float, 6-channel rearrange)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 6, 6, true);
+    pa_log_debug("Checking SSE remap (s16, 6-channel rearrange)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 6, 6, true);
+
+    pa_log_debug("Checking SSE remap (float, 3-channel->8-channel rearrange)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_FLOAT32NE, 3, 8, true);
+    pa_log_debug("Checking SSE remap (s16, 8-channel->3-channel rearrange)");
+    remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 8, 3, true);
 }
 END_TEST
 #endif /* defined (__i386__) || defined (__amd64__) */
@@ -419,6 +473,9 @@ int main(int argc, char *argv[]) {
 
     tc = tcase_create("rearrange");
     tcase_add_test(tc, rearrange_special_test);
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, rearrange_sse2_test);
+#endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, rearrange_neon_test);
 #endif
@@ -20,12 +20,15 @@
 #endif
 
 #include <check.h>
+#include <math.h>
+#include <string.h>
 
 #include <pulsecore/cpu-arm.h>
 #include <pulsecore/cpu-x86.h>
 #include <pulsecore/random.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/sconv.h>
+#include <pulsecore/endianmacros.h>
 
 #include "runtime-test-util.h"
 
@@ -83,6 +86,233 @@ static void run_conv_test_float_to_s16(
     }
 }
 
+/* Decode a single integer sample, so that results of any width can be
+ * compared with some tolerance */
+static int32_t read_sample(pa_sample_format_t f, const uint8_t *p, int i) {
+    switch (f) {
+        case PA_SAMPLE_S16LE:
+            return ((const int16_t *) p)[i];
+        case PA_SAMPLE_S32LE:
+            return ((const int32_t *) p)[i];
+        case PA_SAMPLE_S24_32LE:
+            return (int32_t) (((const uint32_t *) p)[i] << 8) >> 8;
+        case PA_SAMPLE_S24LE:
+            return (int32_t) ((uint32_t) PA_READ24LE(p + 3 * i) << 8) >> 8;
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+/* Convert float32ne to format f and compare with the reference, allowing
+ * a rounding difference of one LSB */
+static void run_conv_test_from_float(
+        pa_convert_func_t func,
+        pa_convert_func_t orig_func,
+        pa_sample_format_t f,
+        int align,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint8_t, s[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, s_ref[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, float, fl[SAMPLES]);
+    size_t ss = pa_sample_size_of_format(f);
+    uint8_t *samples, *samples_ref;
+    float *floats;
+    int i, nsamples;
+
+    /* Force sample alignment as requested */
+    samples = s + (8 - align) * ss;
+    samples_ref = s_ref + (8 - align) * ss;
+    floats = fl + (8 - align);
+    nsamples = SAMPLES - (8 - align);
+
+    for (i = 0; i < nsamples; i++)
+        floats[i] = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+
+    /* Make sure clamping gets exercised at the boundaries, too */
+    floats[0] = 1.0f;
+    floats[1] = -1.0f;
+
+    if (correct) {
+        orig_func(nsamples, floats, samples_ref);
+        func(nsamples, floats, samples);
+
+        for (i = 0; i < nsamples; i++) {
+            int32_t a = read_sample(f, samples, i), b = read_sample(f, samples_ref, i);
+
+            if (llabs((long long) a - b) > 1) {
+                pa_log_debug("Correctness test failed: align=%d", align);
+                pa_log_debug("%d: %08x != %08x (%.24f)\n", i, a, b, floats[i]);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %s from float sconv performance with %d sample alignment", pa_sample_format_to_string(f), align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(nsamples, floats, samples);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(nsamples, floats, samples_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+/* Convert random samples of format f to float32ne */
+static void run_conv_test_to_float(
+        pa_convert_func_t func,
+        pa_convert_func_t orig_func,
+        pa_sample_format_t f,
+        int align,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, float, fl[SAMPLES]) = { 0.0f };
+    PA_DECLARE_ALIGNED(8, float, fl_ref[SAMPLES]) = { 0.0f };
+    PA_DECLARE_ALIGNED(8, uint8_t, s[SAMPLES * 4]);
+    size_t ss = pa_sample_size_of_format(f);
+    float *floats, *floats_ref;
+    uint8_t *samples;
+    int i, nsamples;
+
+    /* Force sample alignment as requested */
+    floats = fl + (8 - align);
+    floats_ref = fl_ref + (8 - align);
+    samples = s + (8 - align) * ss;
+    nsamples = SAMPLES - (8 - align);
+
+    pa_random(samples, nsamples * ss);
+
+    if (correct) {
+        orig_func(nsamples, samples, floats_ref);
+        func(nsamples, samples, floats);
+
+        for (i = 0; i < nsamples; i++) {
+            if (fabsf(floats[i] - floats_ref[i]) > 0.0001f) {
+                pa_log_debug("Correctness test failed: align=%d", align);
+                pa_log_debug("%d: %.24f != %.24f (%08x)\n", i, floats[i], floats_ref[i], read_sample(f, samples, i));
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %s to float sconv performance with %d sample alignment", pa_sample_format_to_string(f), align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(nsamples, samples, floats);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(nsamples, samples, floats_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+/* Convert random samples between format f and s16ne in the given
+ * direction. Integer conversions have to be bit exact. */
+static void run_conv_test_s16(
+        pa_convert_func_t func,
+        pa_convert_func_t orig_func,
+        pa_sample_format_t f,
+        bool to_s16,
+        int align,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint8_t, in[SAMPLES * 4]);
+    PA_DECLARE_ALIGNED(8, uint8_t, out[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, out_ref[SAMPLES * 4]) = { 0 };
+    size_t in_ss = to_s16 ? pa_sample_size_of_format(f) : sizeof(int16_t);
+    size_t out_ss = to_s16 ? sizeof(int16_t) : pa_sample_size_of_format(f);
+    uint8_t *samples, *results, *results_ref;
+    int nsamples;
+
+    /* Force sample alignment as requested */
+    samples = in + (8 - align) * in_ss;
+    results = out + (8 - align) * out_ss;
+    results_ref = out_ref + (8 - align) * out_ss;
+    nsamples = SAMPLES - (8 - align);
+
+    pa_random(samples, nsamples * in_ss);
+
+    if (correct) {
+        orig_func(nsamples, samples, results_ref);
+        func(nsamples, samples, results);
+
+        if (memcmp(results, results_ref, nsamples * out_ss) != 0) {
+            pa_log_debug("Correctness test failed: align=%d", align);
+            ck_abort();
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %s %s s16 sconv performance with %d sample alignment",
+                     pa_sample_format_to_string(f), to_s16 ? "to" : "from", align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            func(nsamples, samples, results);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_func(nsamples, samples, results_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+/* The converters for the given formats, as currently set up */
+typedef struct conv_funcs {
+    pa_convert_func_t to_float[PA_SAMPLE_MAX];
+    pa_convert_func_t from_float[PA_SAMPLE_MAX];
+    pa_convert_func_t to_s16[PA_SAMPLE_MAX];
+    pa_convert_func_t from_s16[PA_SAMPLE_MAX];
+} conv_funcs;
+
+static const pa_sample_format_t wide_formats[] = { PA_SAMPLE_S32LE, PA_SAMPLE_S24_32LE, PA_SAMPLE_S24LE };
+
+static void get_conv_funcs(conv_funcs *c) {
+    unsigned i;
+
+    for (i = 0; i < PA_ELEMENTSOF(wide_formats); i++) {
+        pa_sample_format_t f = wide_formats[i];
+
+        c->to_float[f] = pa_get_convert_to_float32ne_function(f);
+        c->from_float[f] = pa_get_convert_from_float32ne_function(f);
+        c->to_s16[f] = pa_get_convert_to_s16ne_function(f);
+        c->from_s16[f] = pa_get_convert_from_s16ne_function(f);
+    }
+}
+
+/* Check all the 24/32 bit converters, and benchmark those which
+ * differ from the generic ones */
+static void run_wide_conv_tests(const conv_funcs *func, const conv_funcs *orig) {
+    unsigned i;
+    int align;
+
+    for (i = 0; i < PA_ELEMENTSOF(wide_formats); i++) {
+        pa_sample_format_t f = wide_formats[i];
+
+        pa_log_debug("Checking %s sconv", pa_sample_format_to_string(f));
+
+        for (align = 0; align < 8; align++) {
+            bool last = align == 7;
+
+            run_conv_test_to_float(func->to_float[f], orig->to_float[f], f, align, true,
+                                   last && func->to_float[f] != orig->to_float[f]);
+            run_conv_test_from_float(func->from_float[f], orig->from_float[f], f, align, true,
+                                     last && func->from_float[f] != orig->from_float[f]);
+            run_conv_test_s16(func->to_s16[f], orig->to_s16[f], f, true, align, true,
+                              last && func->to_s16[f] != orig->to_s16[f]);
+            run_conv_test_s16(func->from_s16[f], orig->from_s16[f], f, false, align, true,
+                              last && func->from_s16[f] != orig->from_s16[f]);
+        }
+    }
+}
+
 /* This test is currently only run under NEON */
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 static void run_conv_test_s16_to_float(
@@ -188,6 +418,66 @@ START_TEST (sconv_sse_test) {
     run_conv_test_float_to_s16(sse_func, orig_func, 7, true, true);
 }
 END_TEST
+
+START_TEST (sconv_wide_sse2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    conv_funcs orig, sse2;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    get_conv_funcs(&orig);
+    pa_convert_func_init_sse(PA_CPU_X86_SSE2);
+    get_conv_funcs(&sse2);
+
+    pa_log_debug("Checking SSE2 sconv (24/32 bit)");
+    run_wide_conv_tests(&sse2, &orig);
+}
+END_TEST
+
+START_TEST (sconv_wide_ssse3_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    conv_funcs orig, ssse3;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSSE3)) {
+        pa_log_info("SSSE3 not supported. Skipping");
+        return;
+    }
+
+    get_conv_funcs(&orig);
+    pa_convert_func_init_sse(PA_CPU_X86_SSE2 | PA_CPU_X86_SSSE3);
+    get_conv_funcs(&ssse3);
+
+    pa_log_debug("Checking SSSE3 sconv (24/32 bit)");
+    run_wide_conv_tests(&ssse3, &orig);
+}
+END_TEST
+
+START_TEST (sconv_wide_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    conv_funcs orig, avx2;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    get_conv_funcs(&orig);
+    pa_convert_func_init_sse(PA_CPU_X86_SSE2 | PA_CPU_X86_AVX2);
+    get_conv_funcs(&avx2);
+
+    pa_log_debug("Checking AVX2 sconv (24/32 bit)");
+    run_wide_conv_tests(&avx2, &orig);
+}
+END_TEST
 #endif /* defined (__i386__) || defined (__amd64__) */
 
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
@@ -230,6 +520,26 @@ START_TEST (sconv_neon_test) {
     run_conv_test_s16_to_float(neon_to_func, orig_to_func, 7, true, true);
 }
 END_TEST
+
+START_TEST (sconv_wide_neon_test) {
+    pa_cpu_arm_flag_t flags = 0;
+    conv_funcs orig, neon;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    get_conv_funcs(&orig);
+    pa_convert_func_init_neon(flags);
+    get_conv_funcs(&neon);
+
+    pa_log_debug("Checking NEON sconv (24/32 bit)");
+    run_wide_conv_tests(&neon, &orig);
+}
+END_TEST
 #endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
 
 int main(int argc, char *argv[]) {
@@ -247,9 +557,13 @@ int main(int argc, char *argv[]) {
 #if defined (__i386__) || defined (__amd64__)
     tcase_add_test(tc, sconv_sse2_test);
     tcase_add_test(tc, sconv_sse_test);
+    tcase_add_test(tc, sconv_wide_sse2_test);
+    tcase_add_test(tc, sconv_wide_ssse3_test);
+    tcase_add_test(tc, sconv_wide_avx2_test);
 #endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, sconv_neon_test);
+    tcase_add_test(tc, sconv_wide_neon_test);
 #endif
     tcase_set_timeout(tc, 120);
     suite_add_tcase(s, tc);
@@ -20,6 +20,7 @@
 #endif
 
 #include <check.h>
+#include <math.h>
 
 #include <pulsecore/cpu-arm.h>
 #include <pulsecore/cpu-x86.h>
@@ -100,6 +101,95 @@ static void run_volume_test(
     }
 }
 
+/* Same as run_volume_test(), for float32ne and s32ne. The volumes go up
+ * to 2.0 here, so that s32 clamping gets some testing as well. */
+static void run_volume_test_32(
+        pa_do_volume_func_t func,
+        pa_do_volume_func_t orig_func,
+        pa_sample_format_t format,
+        int align,
+        int channels,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint32_t, s[SAMPLES]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint32_t, s_ref[SAMPLES]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint32_t, s_orig[SAMPLES]) = { 0 };
+    union {
+        int32_t i;
+        float f;
+    } volumes[channels + PADDING];
+    uint32_t *samples, *samples_ref, *samples_orig;
+    int i, padding, nsamples, size;
+
+    pa_assert(format == PA_SAMPLE_FLOAT32NE || format == PA_SAMPLE_S32NE);
+
+    /* Force sample alignment as requested */
+    samples = s + (8 - align);
+    samples_ref = s_ref + (8 - align);
+    samples_orig = s_orig + (8 - align);
+    nsamples = SAMPLES - (8 - align);
+    if (nsamples % channels)
+        nsamples -= nsamples % channels;
+    size = nsamples * sizeof(uint32_t);
+
+    if (format == PA_SAMPLE_FLOAT32NE) {
+        for (i = 0; i < nsamples; i++)
+            ((float*) samples)[i] = 2.0f * rand() / (float) RAND_MAX - 1.0f;
+    } else
+        pa_random(samples, size);
+
+    memcpy(samples_ref, samples, size);
+    memcpy(samples_orig, samples, size);
+
+    for (i = 0; i < channels; i++) {
+        if (format == PA_SAMPLE_FLOAT32NE)
+            volumes[i].f = 2.0f * rand() / (float) RAND_MAX;
+        else
+            volumes[i].i = rand() >> 14;
+    }
+    for (padding = 0; padding < PADDING; padding++, i++)
+        volumes[i] = volumes[padding];
+
+    if (correct) {
+        orig_func(samples_ref, volumes, channels, size);
+        func(samples, volumes, channels, size);
+
+        for (i = 0; i < nsamples; i++) {
+            if (format == PA_SAMPLE_FLOAT32NE) {
+                float a = ((float*) samples)[i], b = ((float*) samples_ref)[i];
+
+                if (fabsf(a - b) > 1e-6f) {
+                    pa_log_debug("Correctness test failed: align=%d, channels=%d", align, channels);
+                    pa_log_debug("%d: %.9f != %.9f (%.9f * %.9f)", i, a, b,
+                            ((float*) samples_orig)[i], volumes[i % channels].f);
+                    ck_abort();
+                }
+            } else if (samples[i] != samples_ref[i]) {
+                pa_log_debug("Correctness test failed: align=%d, channels=%d", align, channels);
+                pa_log_debug("%d: %08x != %08x (%08x * %08x)", i, samples[i], samples_ref[i],
+                        samples_orig[i], volumes[i % channels].i);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing svolume %s %dch performance with %d sample alignment",
+                pa_sample_format_to_string(format), channels, align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            memcpy(samples, samples_orig, size);
+            func(samples, volumes, channels, size);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            memcpy(samples_ref, samples_orig, size);
+            orig_func(samples_ref, volumes, channels, size);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
 #if defined (__i386__) || defined (__amd64__)
 START_TEST (svolume_mmx_test) {
     pa_do_volume_func_t orig_func, mmx_func;
@@ -154,6 +244,57 @@ START_TEST (svolume_sse_test) {
     run_volume_test(sse_func, orig_func, 7, 3, true, true);
 }
 END_TEST
+
+/* Checks the AVX functions for flags against whatever was there before
+ * and restores those afterwards */
+static void run_avx_tests(pa_cpu_x86_flag_t flags, const char *name) {
+    pa_do_volume_func_t orig_funcs[4], avx_funcs[4];
+    const pa_sample_format_t formats[4] = { PA_SAMPLE_S16NE, PA_SAMPLE_S16RE, PA_SAMPLE_FLOAT32NE, PA_SAMPLE_S32NE };
+    int f, i, j;
+
+    for (f = 0; f < 4; f++)
+        orig_funcs[f] = pa_get_volume_func(formats[f]);
+
+    pa_volume_func_init_avx(flags);
+
+    for (f = 0; f < 4; f++)
+        avx_funcs[f] = pa_get_volume_func(formats[f]);
+
+    pa_log_debug("Checking %s svolume", name);
+    for (i = 1; i <= 8; i++) {
+        for (j = 0; j < 7; j++) {
+            run_volume_test(avx_funcs[0], orig_funcs[0], j, i, true, false);
+            run_volume_test(avx_funcs[1], orig_funcs[1], j, i, true, false);
+            run_volume_test_32(avx_funcs[2], orig_funcs[2], formats[2], j, i, true, false);
+            run_volume_test_32(avx_funcs[3], orig_funcs[3], formats[3], j, i, true, false);
+        }
+    }
+    run_volume_test(avx_funcs[0], orig_funcs[0], 7, 2, true, true);
+    run_volume_test_32(avx_funcs[2], orig_funcs[2], formats[2], 7, 2, true, true);
+    run_volume_test_32(avx_funcs[2], orig_funcs[2], formats[2], 7, 6, true, true);
+    run_volume_test_32(avx_funcs[3], orig_funcs[3], formats[3], 7, 2, true, true);
+
+    for (f = 0; f < 4; f++)
+        pa_set_volume_func(formats[f], orig_funcs[f]);
+}
+
+START_TEST (svolume_avx_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & (PA_CPU_X86_AVX2 | PA_CPU_X86_AVX512F))) {
+        pa_log_info("AVX2/AVX-512 not supported. Skipping");
+        return;
+    }
+
+    if (flags & PA_CPU_X86_AVX2)
+        run_avx_tests(flags & ~PA_CPU_X86_AVX512F, "AVX2");
+
+    if (flags & PA_CPU_X86_AVX512F)
+        run_avx_tests(flags, "AVX-512");
+}
+END_TEST
 #endif /* defined (__i386__) || defined (__amd64__) */
 
 #if defined (__arm__) && defined (__linux__)
@@ -194,6 +335,9 @@ START_TEST (svolume_orc_test) {
     pa_zero(cpu_info);
     cpu_info.cpu_type = PA_CPU_X86;
     pa_cpu_get_x86_flags(&cpu_info.flags.x86);
+
+    /* Orc steps aside for the AVX functions */
+    cpu_info.flags.x86 &= ~(PA_CPU_X86_AVX2 | PA_CPU_X86_AVX512F);
 #endif
 
     orig_func = pa_get_volume_func(PA_SAMPLE_S16NE);
@@ -230,6 +374,7 @@ int main(int argc, char *argv[]) {
 #if defined (__i386__) || defined (__amd64__)
     tcase_add_test(tc, svolume_mmx_test);
     tcase_add_test(tc, svolume_sse_test);
+    tcase_add_test(tc, svolume_avx_test);
 #endif
 #if defined (__arm__) && defined (__linux__)
     tcase_add_test(tc, svolume_arm_test);
@@ -0,0 +1,163 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+static void datum_set(pa_datum *d, const char *s) {
+    d->data = (char*) s;
+    d->size = strlen(s);
+}
+
+static bool datum_equal(const pa_datum *d, const char *s) {
+    return d->size == strlen(s) && memcmp(d->data, s, d->size) == 0;
+}
+
+/* Whether the key has made it to the database itself */
+static bool in_database(pa_database *db, const char *k, const char *v) {
+    pa_datum key, data;
+    bool r;
+
+    datum_set(&key, k);
+
+    if (!pa_database_get(db, &key, &data))
+        return false;
+
+    r = !v || datum_equal(&data, v);
+    pa_datum_free(&data);
+
+    return r;
+}
+
+START_TEST (database_cache_test) {
+    pa_database *db;
+    pa_database_cache *c;
+    pa_datum key, data, value;
+    unsigned n;
+    char *fn;
+
+    fn = pa_sprintf_malloc("%s" PA_PATH_SEP "database-cache-test-%lu", pa_get_temp_dir(), (unsigned long) getpid());
+
+    fail_unless((db = pa_database_open(fn, true)) != NULL);
+    c = pa_database_cache_new(db);
+
+    /* Repeated sets only keep the last value, which reads see */
+    datum_set(&key, "a");
+    datum_set(&data, "1");
+    fail_unless(pa_database_cache_set(c, &key, &data, true) == 0);
+    datum_set(&data, "2");
+    fail_unless(pa_database_cache_set(c, &key, &data, true) == 0);
+
+    fail_unless(!in_database(db, "a", NULL));
+    fail_unless(pa_database_cache_get(c, &key, &value) != NULL);
+    fail_unless(datum_equal(&value, "2"));
+    pa_datum_free(&value);
+
+    /* No overwriting of pending entries either */
+    fail_unless(pa_database_cache_set(c, &key, &data, false) < 0);
+
+    fail_unless(pa_database_cache_flush(c) == 0);
+    fail_unless(in_database(db, "a", "2"));
+
+    /* Nor of entries already in the database */
+    fail_unless(pa_database_cache_set(c, &key, &data, false) < 0);
+
+    /* Unsetting drops what was pending and what was written */
+    datum_set(&key, "b");
+    fail_unless(pa_database_cache_set(c, &key, &data, true) == 0);
+    fail_unless(pa_database_cache_unset(c, &key) == 0);
+    fail_unless(pa_database_cache_get(c, &key, &value) == NULL);
+    fail_unless(pa_database_cache_unset(c, &key) < 0);
+
+    datum_set(&key, "a");
+    fail_unless(pa_database_cache_unset(c, &key) == 0);
+    fail_unless(!in_database(db, "a", NULL));
+
+    /* Iterating sees pending entries */
+    datum_set(&key, "c");
+    fail_unless(pa_database_cache_set(c, &key, &data, true) == 0);
+    datum_set(&key, "d");
+    fail_unless(pa_database_cache_set(c, &key, &data, true) == 0);
+
+    n = 0;
+    if (pa_database_cache_first(c, &key, NULL)) {
+        pa_datum next;
+        bool done;
+
+        do {
+            n++;
+            done = !pa_database_cache_next(c, &key, &next, NULL);
+            pa_datum_free(&key);
+            key = next;
+        } while (!done);
+    }
+    fail_unless(n == 2);
+
+    /* Freeing flushes */
+    datum_set(&key, "e");
+    fail_unless(pa_database_cache_set(c, &key, &data, true) == 0);
+    pa_database_cache_free(c);
+    fail_unless(in_database(db, "e", "2"));
+
+    c = pa_database_cache_new(db);
+    datum_set(&key, "f");
+    fail_unless(pa_database_cache_set(c, &key, &data, true) == 0);
+    fail_unless(pa_database_cache_clear(c) == 0);
+    fail_unless(pa_database_cache_get(c, &key, &value) == NULL);
+    fail_unless(pa_database_size(db) == 0);
+
+    pa_database_cache_free(c);
+    pa_database_close(db);
+
+    pa_xfree(fn);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Database cache");
+    tc = tcase_create("database-cache");
+    tcase_add_test(tc, database_cache_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -32,7 +32,7 @@
 
 #define THREADS_MAX 20
 
-static pa_flist *flist;
+static pa_flist *flist, *cached_flist;
 static int quit = 0;
 
 static void spin(void) {
@@ -48,12 +48,17 @@ static void thread_func(void *data) {
     char *s = data;
     int n = 0;
     int b = 1;
+    unsigned k = 0;
 
     while (!quit) {
+        pa_flist *l;
         char *text;
 
+        /* Take turns between the plain and the cached flist */
+        l = (k++ / 16) % 2 ? cached_flist : flist;
+
         /* Allocate some memory, if possible take it from the flist */
-        if (b && (text = pa_flist_pop(flist)))
+        if (b && (text = pa_flist_pop(l)))
             pa_log("%s: popped '%s'", s, text);
         else {
             text = pa_sprintf_malloc("Block %i, allocated by %s", n++, s);
@@ -65,7 +70,7 @@ static void thread_func(void *data) {
         spin();
 
         /* Give it back to the flist if possible */
-        if (pa_flist_push(flist, text) < 0) {
+        if (pa_flist_push(l, text) < 0) {
             pa_log("%s: failed to push back '%s'", s, text);
             pa_xfree(text);
         } else
@@ -83,6 +88,7 @@ int main(int argc, char* argv[]) {
     int i;
 
     flist = pa_flist_new(0);
+    cached_flist = pa_flist_new_with_cache(0, "cached", pa_xfree);
 
     for (i = 0; i < THREADS_MAX; i++) {
         threads[i] = pa_thread_new("test", thread_func, pa_sprintf_malloc("Thread #%i", i+1));
@@ -96,6 +102,7 @@ int main(int argc, char* argv[]) {
         pa_thread_free(threads[i]);
 
     pa_flist_free(flist, pa_xfree);
+    pa_flist_free(cached_flist, pa_xfree);
 
     return 0;
 }
@@ -0,0 +1,191 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#include "runtime-test-util.h"
+
+#define N_KEYS 1000
+#define TIMES 100
+#define TIMES2 10
+
+START_TEST (hashmap_basic_test) {
+    pa_hashmap *h;
+    void *state = NULL;
+    const void *key;
+    unsigned i, n;
+
+    h = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    fail_unless(pa_hashmap_isempty(h));
+    fail_unless(pa_hashmap_first(h) == NULL);
+
+    for (i = 1; i <= N_KEYS; i++)
+        fail_unless(pa_hashmap_put(h, PA_UINT_TO_PTR(i), PA_UINT_TO_PTR(i * 2)) == 0);
+
+    fail_unless(pa_hashmap_put(h, PA_UINT_TO_PTR(1), NULL) < 0);
+    fail_unless(pa_hashmap_size(h) == N_KEYS);
+
+    for (i = 1; i <= N_KEYS; i++)
+        fail_unless(pa_hashmap_get(h, PA_UINT_TO_PTR(i)) == PA_UINT_TO_PTR(i * 2));
+
+    fail_unless(pa_hashmap_get(h, PA_UINT_TO_PTR(N_KEYS + 1)) == NULL);
+
+    /* Remove every other entry while iterating, the iteration must
+     * still see every entry exactly once, in insertion order */
+    n = 0;
+    while (pa_hashmap_iterate(h, &state, &key)) {
+        n++;
+        fail_unless(PA_PTR_TO_UINT(key) == n);
+
+        if (n % 2 == 0)
+            fail_unless(pa_hashmap_remove(h, key) == PA_UINT_TO_PTR(n * 2));
+    }
+
+    fail_unless(n == N_KEYS);
+    fail_unless(pa_hashmap_size(h) == N_KEYS / 2);
+
+    for (i = 1; i <= N_KEYS; i++)
+        fail_unless(pa_hashmap_get(h, PA_UINT_TO_PTR(i)) == (i % 2 ? PA_UINT_TO_PTR(i * 2) : NULL));
+
+    /* Backwards, too */
+    state = NULL;
+    n = N_KEYS - 1;
+    while (pa_hashmap_iterate_backwards(h, &state, &key)) {
+        fail_unless(PA_PTR_TO_UINT(key) == n);
+        n -= 2;
+    }
+
+    fail_unless(pa_hashmap_first(h) == PA_UINT_TO_PTR(2));
+    fail_unless(pa_hashmap_last(h) == PA_UINT_TO_PTR((N_KEYS - 1) * 2));
+
+    /* Reinserting reuses the room of the removed entries */
+    for (i = 2; i <= N_KEYS; i += 2)
+        fail_unless(pa_hashmap_put(h, PA_UINT_TO_PTR(i), PA_UINT_TO_PTR(i * 2)) == 0);
+
+    for (i = 1; i <= N_KEYS; i++)
+        fail_unless(pa_hashmap_get(h, PA_UINT_TO_PTR(i)) == PA_UINT_TO_PTR(i * 2));
+
+    for (i = 1; i <= N_KEYS; i += 2)
+        fail_unless(pa_hashmap_steal_first(h) == PA_UINT_TO_PTR(i * 2));
+
+    fail_unless(pa_hashmap_size(h) == N_KEYS / 2);
+    fail_unless(pa_hashmap_first(h) == PA_UINT_TO_PTR(4));
+
+    pa_hashmap_free(h);
+}
+END_TEST
+
+START_TEST (hashmap_string_test) {
+    pa_hashmap *h;
+    char *keys[N_KEYS];
+    unsigned i;
+
+    h = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, pa_xfree, pa_xfree);
+
+    for (i = 0; i < N_KEYS; i++) {
+        keys[i] = pa_sprintf_malloc("key-%u", i);
+        fail_unless(pa_hashmap_put(h, pa_xstrdup(keys[i]), pa_sprintf_malloc("value-%u", i)) == 0);
+    }
+
+    for (i = 0; i < N_KEYS; i++) {
+        char *v = pa_sprintf_malloc("value-%u", i);
+
+        fail_unless(pa_streq(pa_hashmap_get(h, keys[i]), v));
+        pa_xfree(v);
+
+        if (i % 3 == 0)
+            fail_unless(pa_hashmap_remove_and_free(h, keys[i]) == 0);
+    }
+
+    for (i = 0; i < N_KEYS; i++) {
+        fail_unless((pa_hashmap_get(h, keys[i]) == NULL) == (i % 3 == 0));
+        pa_xfree(keys[i]);
+    }
+
+    pa_hashmap_remove_all(h);
+    fail_unless(pa_hashmap_isempty(h));
+
+    pa_hashmap_free(h);
+}
+END_TEST
+
+START_TEST (hashmap_perf_test) {
+    pa_hashmap *h;
+    unsigned i, found = 0;
+
+    h = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    /* Small hashmaps with pointer keys are by far the common case */
+    for (i = 1; i <= 32; i++)
+        pa_hashmap_put(h, PA_UINT_TO_PTR(i * 64), PA_UINT_TO_PTR(i));
+
+    PA_RUNTIME_TEST_RUN_START("lookup", TIMES, TIMES2) {
+        for (i = 1; i <= N_KEYS; i++)
+            if (pa_hashmap_get(h, PA_UINT_TO_PTR((i & 63) * 64)))
+                found++;
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("put/remove", TIMES, TIMES2) {
+        for (i = 1; i <= N_KEYS; i++) {
+            pa_hashmap_put(h, PA_UINT_TO_PTR(i * 64 + 1), PA_UINT_TO_PTR(i));
+            pa_hashmap_remove(h, PA_UINT_TO_PTR(i * 64 + 1));
+        }
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    fail_unless(found > 0);
+    fail_unless(pa_hashmap_size(h) == 32);
+
+    pa_hashmap_free(h);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Hashmap");
+    tc = tcase_create("hashmap");
+    tcase_add_test(tc, hashmap_basic_test);
+    tcase_add_test(tc, hashmap_string_test);
+    tcase_add_test(tc, hashmap_perf_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
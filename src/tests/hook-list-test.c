@@ -6,6 +6,7 @@
 
 #include <pulsecore/hook-list.h>
 #include <pulsecore/log.h>
+#include <pulsecore/core-util.h>
 
 static pa_hook_result_t func1(const char *hook_data, const char *call_data, const char *slot_data) {
     pa_log("(func1) hook=%s call=%s slot=%s", hook_data, call_data, slot_data);
@@ -41,6 +42,57 @@ START_TEST (hooklist_test) {
 }
 END_TEST
 
+static char order[16];
+static unsigned n_order;
+static pa_hook_slot *victim;
+
+static pa_hook_result_t record(void *hook_data, void *call_data, void *slot_data) {
+    order[n_order++] = *(const char *) slot_data;
+    return PA_HOOK_OK;
+}
+
+/* Frees another slot, connects a new one and fires the hook again */
+static pa_hook_result_t meddle(pa_hook *hook, void *call_data, void *slot_data) {
+    order[n_order++] = *(const char *) slot_data;
+
+    if (victim) {
+        pa_hook_slot_free(victim);
+        victim = NULL;
+
+        pa_hook_connect(hook, PA_HOOK_EARLY, record, (void*) "n");
+        pa_hook_fire(hook, NULL);
+    }
+
+    return PA_HOOK_OK;
+}
+
+START_TEST (hooklist_order_test) {
+    pa_hook hook;
+
+    pa_hook_init(&hook, &hook);
+    fail_unless(pa_hook_fire(&hook, NULL) == PA_HOOK_OK);
+
+    pa_hook_connect(&hook, PA_HOOK_LATE, record, (void*) "c");
+    pa_hook_connect(&hook, PA_HOOK_NORMAL, (pa_hook_cb_t) meddle, (void*) "b");
+    victim = pa_hook_connect(&hook, PA_HOOK_LATE, record, (void*) "d");
+    pa_hook_connect(&hook, PA_HOOK_EARLY, record, (void*) "a");
+
+    /* The nested firing sees the new slot but not the freed one, the
+     * outer one keeps its snapshot but skips the freed slot */
+    n_order = 0;
+    pa_hook_fire(&hook, NULL);
+    order[n_order] = 0;
+    fail_unless(pa_streq(order, "abanbcc"), "got %s", order);
+
+    n_order = 0;
+    pa_hook_fire(&hook, NULL);
+    order[n_order] = 0;
+    fail_unless(pa_streq(order, "anbc"), "got %s", order);
+
+    pa_hook_done(&hook);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -50,6 +102,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Hook List");
     tc = tcase_create("hooklist");
     tcase_add_test(tc, hooklist_test);
+    tcase_add_test(tc, hooklist_order_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,114 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/random.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "runtime-test-util.h"
+
+#define FRAMES 1024
+#define TIMES 1000
+#define TIMES2 100
+
+static void run_interleave_test(size_t ss, unsigned channels, bool perf) {
+    uint8_t *in, *out, *planar[PA_CHANNELS_MAX];
+    unsigned c, j;
+
+    in = pa_xmalloc(FRAMES * channels * ss);
+    out = pa_xmalloc0(FRAMES * channels * ss);
+
+    pa_random(in, FRAMES * channels * ss);
+
+    for (c = 0; c < channels; c++)
+        planar[c] = pa_xmalloc(FRAMES * ss);
+
+    pa_deinterleave(in, (void **) planar, channels, ss, FRAMES);
+
+    for (c = 0; c < channels; c++)
+        for (j = 0; j < FRAMES; j++)
+            fail_unless(memcmp(planar[c] + j * ss, in + (j * channels + c) * ss, ss) == 0);
+
+    pa_interleave((const void **) planar, channels, out, ss, FRAMES);
+
+    fail_unless(memcmp(in, out, FRAMES * channels * ss) == 0);
+
+    if (perf) {
+        pa_log_debug("Testing %u-channel (de)interleaving performance with %u byte samples", channels, (unsigned) ss);
+
+        PA_RUNTIME_TEST_RUN_START("deinterleave", TIMES, TIMES2) {
+            pa_deinterleave(in, (void **) planar, channels, ss, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("interleave", TIMES, TIMES2) {
+            pa_interleave((const void **) planar, channels, out, ss, FRAMES);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    for (c = 0; c < channels; c++)
+        pa_xfree(planar[c]);
+
+    pa_xfree(in);
+    pa_xfree(out);
+}
+
+START_TEST (interleave_test) {
+    static const size_t sizes[] = { 1, 2, 3, 4, 8 };
+    static const unsigned channels[] = { 1, 2, 3, 6, 8 };
+    unsigned i, j;
+
+    for (i = 0; i < PA_ELEMENTSOF(sizes); i++)
+        for (j = 0; j < PA_ELEMENTSOF(channels); j++)
+            run_interleave_test(sizes[i], channels[j], false);
+
+    run_interleave_test(2, 2, true);
+    run_interleave_test(4, 6, true);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Interleave");
+    tc = tcase_create("interleave");
+    tcase_add_test(tc, interleave_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
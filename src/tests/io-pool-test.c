@@ -0,0 +1,121 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core.h>
+#include <pulsecore/io-pool.h>
+#include <pulsecore/log.h>
+#include <pulsecore/module.h>
+#include <pulsecore/thread-mq.h>
+
+#define N_TASKS 3
+#define RUN_USEC (300 * PA_USEC_PER_MSEC)
+
+static pa_atomic_t calls[N_TASKS];
+
+/* Task i asks to be woken up every (i + 1) * 10ms */
+static pa_usec_t task_cb(pa_io_task *t, void *userdata) {
+    unsigned i = PA_PTR_TO_UINT(userdata);
+
+    /* We are supposed to be in IO context */
+    fail_unless(pa_thread_mq_get() != NULL);
+
+    pa_atomic_inc(&calls[i]);
+
+    return pa_rtclock_now() + (i + 1) * 10 * PA_USEC_PER_MSEC;
+}
+
+START_TEST (io_pool_test) {
+    pa_mainloop *ml;
+    pa_core *c;
+    pa_module m;
+    pa_io_task *t[N_TASKS];
+    pa_usec_t end;
+    unsigned i;
+
+    pa_assert_se(ml = pa_mainloop_new());
+    pa_assert_se(c = pa_core_new(pa_mainloop_get_api(ml), false, false, 0));
+    c->realtime_scheduling = false;
+
+    pa_zero(m);
+    m.name = (char *) "io-pool-test";
+    m.core = c;
+
+    c->io_pool = pa_io_pool_new(c, 2, NULL);
+    fail_unless(c->io_pool != NULL);
+
+    for (i = 0; i < N_TASKS; i++) {
+        t[i] = pa_io_task_new(c->io_pool, &m, task_cb, PA_UINT_TO_PTR(i));
+        fail_unless(t[i] != NULL);
+    }
+
+    /* Tasks are spread over the workers */
+    fail_unless(pa_io_task_get_rtpoll(t[0]) != pa_io_task_get_rtpoll(t[1]));
+    fail_unless(pa_io_task_get_rtpoll(t[0]) == pa_io_task_get_rtpoll(t[2]));
+    fail_unless(pa_io_task_get_asyncmsgq(t[0]) == pa_io_task_get_asyncmsgq(t[2]));
+
+    end = pa_rtclock_now() + RUN_USEC;
+    while (pa_rtclock_now() < end)
+        pa_mainloop_iterate(ml, 0, NULL);
+
+    for (i = 0; i < N_TASKS; i++) {
+        pa_log_debug("Task %u was run %i times", i, pa_atomic_load(&calls[i]));
+        pa_io_task_free(t[i]);
+    }
+
+    /* Task 1 has a worker of its own and sleeps twice as long as the
+     * others, which get woken up by task 0 */
+    fail_unless(pa_atomic_load(&calls[0]) >= 10);
+    fail_unless(pa_atomic_load(&calls[2]) >= pa_atomic_load(&calls[0]) - 1);
+    fail_unless(pa_atomic_load(&calls[1]) < pa_atomic_load(&calls[0]));
+
+    pa_core_unref(c);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("IO Pool");
+    tc = tcase_create("io-pool");
+    tcase_add_test(tc, io_pool_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
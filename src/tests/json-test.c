@@ -248,8 +248,88 @@ START_TEST(bad_test) {
     };
 
     for (i = 0; i < PA_ELEMENTSOF(bad_parse); i++) {
+        pa_json_tokenizer t;
+        pa_json_token token;
+        pa_json_token_type type;
+
         fail_unless(pa_json_parse(bad_parse[i]) == NULL);
+
+        pa_json_tokenizer_init(&t, bad_parse[i]);
+        while ((type = pa_json_tokenizer_next(&t, &token)) > PA_JSON_TOKEN_END)
+            ;
+        fail_unless(type == PA_JSON_TOKEN_ERROR);
+    }
+}
+END_TEST
+
+START_TEST(tokenizer_test) {
+    pa_json_tokenizer t;
+    pa_json_token token, token2;
+    unsigned int i;
+    const char *str = "{ \"a\": [ 1, \"x\\ty\", null ], \"b\" : { }, \"c\": -2.5, \"d\": true }";
+    const struct {
+        pa_json_token_type type;
+        unsigned level;
+    } expected[] = {
+        { PA_JSON_TOKEN_OBJECT_BEGIN, 0 },
+        { PA_JSON_TOKEN_KEY, 1 },
+        { PA_JSON_TOKEN_ARRAY_BEGIN, 1 },
+        { PA_JSON_TOKEN_VALUE, 2 },
+        { PA_JSON_TOKEN_VALUE, 2 },
+        { PA_JSON_TOKEN_VALUE, 2 },
+        { PA_JSON_TOKEN_ARRAY_END, 1 },
+        { PA_JSON_TOKEN_KEY, 1 },
+        { PA_JSON_TOKEN_OBJECT_BEGIN, 1 },
+        { PA_JSON_TOKEN_OBJECT_END, 1 },
+        { PA_JSON_TOKEN_KEY, 1 },
+        { PA_JSON_TOKEN_VALUE, 1 },
+        { PA_JSON_TOKEN_KEY, 1 },
+        { PA_JSON_TOKEN_VALUE, 1 },
+        { PA_JSON_TOKEN_OBJECT_END, 0 },
+    };
+
+    pa_json_tokenizer_init(&t, str);
+
+    for (i = 0; i < PA_ELEMENTSOF(expected); i++) {
+        fail_unless(pa_json_tokenizer_next(&t, &token) == expected[i].type);
+        fail_unless(token.level == expected[i].level);
+
+        switch (i) {
+            case 1:
+                fail_unless(pa_json_token_string_equal(&token, "a"));
+                break;
+            case 3:
+                fail_unless(token.type == PA_JSON_TYPE_INT && token.int_value == 1);
+                break;
+            case 4:
+                fail_unless(pa_json_token_string_equal(&token, "x\ty"));
+                fail_unless(!pa_json_token_string_equal(&token, "x\t"));
+                break;
+            case 5:
+                fail_unless(token.type == PA_JSON_TYPE_NULL);
+                break;
+            case 11:
+                fail_unless(token.type == PA_JSON_TYPE_DOUBLE && PA_DOUBLE_IS_EQUAL(token.double_value, -2.5));
+                break;
+            case 13:
+                fail_unless(token.type == PA_JSON_TYPE_BOOL && token.bool_value);
+                break;
+        }
     }
+
+    fail_unless(pa_json_tokenizer_next(&t, &token) == PA_JSON_TOKEN_END);
+
+    /* Escaped and plain forms of the same string compare equal */
+    pa_json_tokenizer_init(&t, "\"a\\/b\"");
+    fail_unless(pa_json_tokenizer_next(&t, &token) == PA_JSON_TOKEN_VALUE);
+    pa_json_tokenizer_init(&t, "\"a/b\"");
+    fail_unless(pa_json_tokenizer_next(&t, &token2) == PA_JSON_TOKEN_VALUE);
+    fail_unless(pa_json_token_equal(&token, &token2));
+
+    /* Trailing garbage is an error */
+    pa_json_tokenizer_init(&t, "1 2");
+    fail_unless(pa_json_tokenizer_next(&t, &token) == PA_JSON_TOKEN_VALUE);
+    fail_unless(pa_json_tokenizer_next(&t, &token) == PA_JSON_TOKEN_ERROR);
 }
 END_TEST
 
@@ -269,6 +349,7 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, object_test);
     tcase_add_test(tc, array_test);
     tcase_add_test(tc, bad_test);
+    tcase_add_test(tc, tokenizer_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -20,12 +20,14 @@
 #endif
 
 #include <check.h>
+#include <math.h>
 
 #include <pulse/pulseaudio.h>
 #include <pulse/sample.h>
 #include <pulsecore/memblock.h>
 
 #include <pulsecore/filter/lfe-filter.h>
+#include <pulsecore/filter/crossover.h>
 
 struct lfe_filter_test {
     pa_lfe_filter_t *lf;
@@ -158,6 +160,15 @@ START_TEST (lfe_filter_test) {
     ret = lfe_filter_rewind_test(&lft, ONE_BLOCK_SAMPLES + ONE_BLOCK_SAMPLES / 2);
     if (ret)
         pa_log_error("lfe-filer-test: rewind to middle of block test failed!!!");
+    fail_unless(ret == 0);
+    pa_lfe_filter_free(lft.lf);
+
+    /* we create a lfe-filter with cutoff frequency 120Hz and max rewind time 10 seconds */
+    pa_assert_se(lft.lf = pa_lfe_filter_new(&a, &chmapmono, crossover_freq, a.rate * 10));
+    /* rewind to a position between two saved states */
+    ret = lfe_filter_rewind_test(&lft, ONE_BLOCK_SAMPLES + 1000);
+    if (ret)
+        pa_log_error("lfe-filer-test: rewind between saved states test failed!!!");
 
     pa_xfree(ori_sample_ptr);
 
@@ -172,6 +183,180 @@ START_TEST (lfe_filter_test) {
 }
 END_TEST
 
+/* The multichannel LR4 kernel has to give the same results as filtering
+   each channel on its own, including for channel counts that don't fill
+   the last vector */
+START_TEST (lr4_multi_test) {
+    unsigned channels[] = { 1, 3, 4, 6, 8 };
+    unsigned c, i, j, n_frames = 1000;
+    float *f_in, *f_ref, *f_out;
+    short *s_in, *s_ref, *s_out;
+
+    f_in = pa_xnew(float, n_frames * 8);
+    f_ref = pa_xnew(float, n_frames * 8);
+    f_out = pa_xnew(float, n_frames * 8);
+    s_in = pa_xnew(short, n_frames * 8);
+    s_ref = pa_xnew(short, n_frames * 8);
+    s_out = pa_xnew(short, n_frames * 8);
+
+    for (i = 0; i < n_frames * 8; i++) {
+        s_in[i] = random();
+        f_in[i] = s_in[i] / (float) 0x8000;
+    }
+
+    for (c = 0; c < PA_ELEMENTSOF(channels); c++) {
+        struct lr4 lr4[8];
+        struct lr4_multi multi;
+        unsigned n = channels[c], chunk = 0;
+
+        for (j = 0; j < n; j++)
+            lr4_set(&lr4[j], j == 0 ? BQ_LOWPASS : BQ_HIGHPASS, 0.1f + j * 0.05f);
+        for (j = 0; j < n; j++)
+            lr4_process_float32(&lr4[j], n_frames, n, &f_in[j], &f_ref[j]);
+        for (j = 0; j < n; j++)
+            lr4_set(&lr4[j], j == 0 ? BQ_LOWPASS : BQ_HIGHPASS, 0.1f + j * 0.05f);
+        for (j = 0; j < n; j++)
+            lr4_process_s16(&lr4[j], n_frames, n, &s_in[j], &s_ref[j]);
+
+        lr4_multi_init(&multi, n);
+        for (j = 0; j < n; j++)
+            lr4_multi_set(&multi, j, j == 0 ? BQ_LOWPASS : BQ_HIGHPASS, 0.1f + j * 0.05f);
+
+        /* Process in place, in odd chunks */
+        memcpy(f_out, f_in, n_frames * n * sizeof(float));
+        for (i = 0; i < n_frames; i += chunk) {
+            chunk = PA_MIN(n_frames - i, 1 + i % 37);
+            lr4_multi_process_float32(&multi, chunk, &f_out[i * n], &f_out[i * n]);
+        }
+
+        for (i = 0; i < n_frames * n; i++)
+            fail_unless(fabsf(f_out[i] - f_ref[i]) <= 1e-5f,
+                        "%u channels: float sample %u is %f, expected %f", n, i, f_out[i], f_ref[i]);
+
+        lr4_multi_init(&multi, n);
+        for (j = 0; j < n; j++)
+            lr4_multi_set(&multi, j, j == 0 ? BQ_LOWPASS : BQ_HIGHPASS, 0.1f + j * 0.05f);
+
+        lr4_multi_process_s16(&multi, n_frames, s_in, s_out);
+
+        for (i = 0; i < n_frames * n; i++)
+            fail_unless(abs(s_out[i] - s_ref[i]) <= TOLERANT_VARIATION,
+                        "%u channels: s16 sample %u is %i, expected %i", n, i, s_out[i], s_ref[i]);
+    }
+
+    pa_xfree(f_in);
+    pa_xfree(f_ref);
+    pa_xfree(f_out);
+    pa_xfree(s_in);
+    pa_xfree(s_ref);
+    pa_xfree(s_out);
+}
+END_TEST
+
+/* Down at the crossover frequencies actually used the s16 kernel, which
+   works in fixed point, has to stay within one LSB of the exact result */
+START_TEST (lr4_fixed_test) {
+    unsigned i, j, n_frames = 44100;
+    short *s_in, *s_out;
+    double *ref;
+    struct lr4_multi multi;
+    struct biquad bq[2];
+    double freq = 120.0 / 22050;
+
+    s_in = pa_xnew(short, n_frames * 2);
+    s_out = pa_xnew(short, n_frames * 2);
+    ref = pa_xnew(double, n_frames * 2);
+
+    /* Keep the input low enough for the output not to clip */
+    for (i = 0; i < n_frames * 2; i++)
+        s_in[i] = (short) (random() % 0x4000 - 0x2000);
+
+    lr4_multi_init(&multi, 2);
+
+    for (j = 0; j < 2; j++) {
+        double x1 = 0, x2 = 0, y1 = 0, y2 = 0, z1 = 0, z2 = 0;
+
+        biquad_set(&bq[j], j == 0 ? BQ_LOWPASS : BQ_HIGHPASS, freq);
+        lr4_multi_set(&multi, j, j == 0 ? BQ_LOWPASS : BQ_HIGHPASS, freq);
+
+        for (i = j; i < n_frames * 2; i += 2) {
+            double x = s_in[i], y, z;
+
+            y = bq[j].b0*x + bq[j].b1*x1 + bq[j].b2*x2 - bq[j].a1*y1 - bq[j].a2*y2;
+            z = bq[j].b0*y + bq[j].b1*y1 + bq[j].b2*y2 - bq[j].a1*z1 - bq[j].a2*z2;
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            z2 = z1;
+            z1 = z;
+            ref[i] = trunc(z);
+        }
+    }
+
+    lr4_multi_process_s16(&multi, n_frames, s_in, s_out);
+
+    for (i = 0; i < n_frames * 2; i++)
+        fail_unless(fabs(s_out[i] - ref[i]) <= TOLERANT_VARIATION,
+                    "s16 sample %u is %i, expected %f", i, s_out[i], ref[i]);
+
+    pa_xfree(s_in);
+    pa_xfree(s_out);
+    pa_xfree(ref);
+}
+END_TEST
+
+/* After the input goes quiet the filter history has to be cut off before
+   it decays into denormals, which would make every following block of
+   silence many times more expensive to process. No denormal may show up
+   in the output, and the history has to end up exactly zero. */
+START_TEST (lr4_denormal_test) {
+    unsigned i, j, b, n_frames = 480;
+    float *in, *out;
+    struct lr4_multi multi;
+    struct lr4 lr4[2];
+    double freq = 120.0 / 22050;
+
+    in = pa_xnew0(float, n_frames * 2);
+    out = pa_xnew(float, n_frames * 2);
+
+    lr4_multi_init(&multi, 2);
+
+    for (j = 0; j < 2; j++) {
+        lr4_set(&lr4[j], j == 0 ? BQ_LOWPASS : BQ_HIGHPASS, freq);
+        lr4_multi_set(&multi, j, j == 0 ? BQ_LOWPASS : BQ_HIGHPASS, freq);
+    }
+
+    /* An impulse, followed by ten seconds of silence */
+    in[0] = in[1] = 1.0f;
+
+    for (b = 0; b < 1000; b++) {
+        lr4_multi_process_float32(&multi, n_frames, in, out);
+
+        for (i = 0; i < n_frames * 2; i++)
+            fail_unless(fpclassify(out[i]) != FP_SUBNORMAL, "block %u: sample %u is denormal", b, i);
+
+        for (j = 0; j < 2; j++)
+            lr4_process_float32(&lr4[j], n_frames, 2, &in[j], &out[j]);
+
+        for (i = 0; i < n_frames * 2; i++)
+            fail_unless(fpclassify(out[i]) != FP_SUBNORMAL, "block %u: sample %u is denormal", b, i);
+
+        in[0] = in[1] = 0.0f;
+    }
+
+    for (j = 0; j < 2; j++) {
+        fail_unless(multi.x1[j] == 0 && multi.x2[j] == 0 && multi.y1[j] == 0 &&
+                    multi.y2[j] == 0 && multi.z1[j] == 0 && multi.z2[j] == 0);
+        fail_unless(lr4[j].x1 == 0 && lr4[j].x2 == 0 && lr4[j].y1 == 0 &&
+                    lr4[j].y2 == 0 && lr4[j].z1 == 0 && lr4[j].z2 == 0);
+    }
+
+    pa_xfree(in);
+    pa_xfree(out);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -184,6 +369,9 @@ int main(int argc, char *argv[]) {
     s = suite_create("lfe-filter");
     tc = tcase_create("lfe-filter");
     tcase_add_test(tc, lfe_filter_test);
+    tcase_add_test(tc, lr4_multi_test);
+    tcase_add_test(tc, lr4_fixed_test);
+    tcase_add_test(tc, lr4_denormal_test);
     tcase_set_timeout(tc, 10);
     suite_add_tcase(s, tc);
 
@@ -0,0 +1,180 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulsecore/macro.h>
+
+#include "lo-test-util.h"
+
+/* Plays a timecode through TEST_SINK and checks it as it comes back through
+ * TEST_SOURCE, e.g. the sink's monitor, for TEST_DURATION seconds (default
+ * 10). Any dropped, repeated or corrupted frame fails the test. */
+
+#define SAMPLE_HZ 44100
+#define CHANNELS 2
+#define TIMECODE_CHANNEL (CHANNELS - 1)
+#define DEFAULT_DURATION 10
+
+pa_lo_test_context test_ctx;
+static const char *context_name = NULL;
+
+static pa_lo_timecode tc_out, tc_in;
+static uint64_t n_check;
+
+static void write_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    pa_lo_test_context *ctx = (pa_lo_test_context *) userdata;
+    void *data;
+
+    nbytes = pa_stream_writable_size(s);
+    fail_unless(pa_stream_begin_write(s, &data, &nbytes) == 0);
+    nbytes -= nbytes % ctx->fs;
+
+    memset(data, 0, nbytes);
+    pa_lo_timecode_write(&tc_out, data, nbytes / ctx->fs, CHANNELS, TIMECODE_CHANNEL);
+
+    fail_unless(pa_stream_write(s, data, nbytes, NULL, 0, PA_SEEK_RELATIVE) == 0);
+}
+
+static void read_cb(pa_stream *s, size_t nbytes, void *userdata) {
+    pa_lo_test_context *ctx = (pa_lo_test_context *) userdata;
+    const void *in;
+    size_t l;
+
+    fail_unless(pa_stream_peek(s, &in, &l) == 0);
+
+    if (l == 0)
+        return;
+
+    if (in)
+        pa_lo_timecode_check(&tc_in, in, l / ctx->fs, CHANNELS, TIMECODE_CHANNEL);
+    else {
+        /* A hole, the timecode will notice the gap as well */
+        pa_log_warn("Hole of %lu bytes in the capture stream", (unsigned long) l);
+        tc_in.frame += l / ctx->fs;
+    }
+
+    pa_stream_drop(s);
+
+    if (tc_in.frame >= n_check)
+        pa_mainloop_quit(ctx->mainloop, 0);
+}
+
+START_TEST (timecode_test) {
+    static float buf[4096][CHANNELS];
+    pa_lo_timecode out, in;
+    unsigned i;
+
+    pa_zero(out);
+    pa_zero(in);
+    pa_zero(buf);
+
+    /* Some silence first, then a clean timecode */
+    pa_lo_timecode_write(&out, &buf[100][0], 1000, CHANNELS, TIMECODE_CHANNEL);
+    fail_unless(pa_lo_timecode_check(&in, &buf[0][0], 1100, CHANNELS, TIMECODE_CHANNEL) == 0);
+    fail_unless(in.locked);
+
+    /* Drop three frames */
+    pa_lo_timecode_write(&out, &buf[0][0], 100, CHANNELS, TIMECODE_CHANNEL);
+    fail_unless(pa_lo_timecode_check(&in, &buf[0][0], 50, CHANNELS, TIMECODE_CHANNEL) == 0);
+    fail_unless(pa_lo_timecode_check(&in, &buf[53][0], 47, CHANNELS, TIMECODE_CHANNEL) == 1);
+
+    /* It takes a few frames to relock, then repeat two frames */
+    pa_lo_timecode_write(&out, &buf[0][0], 100, CHANNELS, TIMECODE_CHANNEL);
+    fail_unless(pa_lo_timecode_check(&in, &buf[0][0], 50, CHANNELS, TIMECODE_CHANNEL) == 0);
+    fail_unless(in.locked);
+    fail_unless(pa_lo_timecode_check(&in, &buf[48][0], 52, CHANNELS, TIMECODE_CHANNEL) == 1);
+
+    /* Corrupt a sample, a following run of silence counts only once */
+    pa_lo_timecode_write(&out, &buf[0][0], 100, CHANNELS, TIMECODE_CHANNEL);
+    buf[30][TIMECODE_CHANNEL] = 0.123456f;
+    for (i = 60; i < 100; i++)
+        buf[i][TIMECODE_CHANNEL] = 0.0f;
+    fail_unless(pa_lo_timecode_check(&in, &buf[0][0], 29, CHANNELS, TIMECODE_CHANNEL) == 0);
+    fail_unless(in.locked);
+    fail_unless(pa_lo_timecode_check(&in, &buf[29][0], 71, CHANNELS, TIMECODE_CHANNEL) == 2);
+
+    fail_unless(in.glitches == 4);
+}
+END_TEST
+
+START_TEST (loopback_test) {
+    const char *e;
+    unsigned duration = DEFAULT_DURATION;
+
+    if ((e = getenv("TEST_DURATION")))
+        duration = (unsigned) atoi(e);
+
+    n_check = (uint64_t) duration * SAMPLE_HZ;
+
+    test_ctx.context_name = context_name;
+
+    test_ctx.sample_spec.format = PA_SAMPLE_FLOAT32,
+    test_ctx.sample_spec.rate = SAMPLE_HZ,
+    test_ctx.sample_spec.channels = CHANNELS,
+
+    test_ctx.play_latency = 25;
+    test_ctx.rec_latency = 5;
+    test_ctx.no_calibration = true;
+
+    test_ctx.read_cb = read_cb;
+    test_ctx.write_cb = write_cb;
+
+    fail_unless(pa_lo_test_init(&test_ctx) == 0);
+    fail_unless(pa_lo_test_run(&test_ctx) == 0);
+    pa_lo_test_deinit(&test_ctx);
+
+    fprintf(stderr, "Checked %llu frames, %u glitches\n", (unsigned long long) tc_in.frame, tc_in.glitches);
+
+    fail_unless(tc_in.locked || tc_in.glitches > 0, "Never locked to the timecode, is the path bit exact?");
+    fail_unless(tc_in.glitches == 0);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    context_name = argv[0];
+
+    s = suite_create("Loopback glitches");
+    tc = tcase_create("timecode");
+    tcase_add_test(tc, timecode_test);
+    suite_add_tcase(s, tc);
+    tc = tcase_create("loopback glitches");
+    tcase_add_test(tc, loopback_test);
+    tcase_set_timeout(tc, 24 * 60 * 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_set_fork_status(sr, CK_NOFORK);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
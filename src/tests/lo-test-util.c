@@ -34,6 +34,10 @@
  * high as well */
 #define TONE_HZ 4410
 
+/* How many consecutive frames of the timecode we need to see before we
+ * consider ourselves locked to it */
+#define TIMECODE_LOCK_FRAMES 16
+
 static void nop_free_cb(void *p) {
 }
 
@@ -170,7 +174,7 @@ static void stream_state_callback(pa_stream *s, void *userdata) {
             pa_operation *o;
 
             /* Set volumes for calibration */
-            if (s == ctx->play_stream) {
+            if (s == ctx->play_stream || ctx->no_calibration) {
                 pa_cvolume_set(&vol, ctx->sample_spec.channels, PA_VOLUME_NORM);
                 o = pa_context_set_sink_input_volume(ctx->context, pa_stream_get_index(s), &vol, NULL, NULL);
             } else {
@@ -220,7 +224,7 @@ static void context_state_callback(pa_context *c, void *userdata) {
             ctx->play_stream = pa_stream_new(c, "loopback: play", &ctx->sample_spec, NULL);
             pa_assert(ctx->play_stream != NULL);
             pa_stream_set_state_callback(ctx->play_stream, stream_state_callback, ctx);
-            pa_stream_set_write_callback(ctx->play_stream, calibrate_write_cb, ctx);
+            pa_stream_set_write_callback(ctx->play_stream, ctx->no_calibration ? ctx->write_cb : calibrate_write_cb, ctx);
             pa_stream_set_underflow_callback(ctx->play_stream, underflow_cb, userdata);
 
             pa_stream_connect_playback(ctx->play_stream, getenv("TEST_SINK"), &buffer_attr,
@@ -236,7 +240,7 @@ static void context_state_callback(pa_context *c, void *userdata) {
             ctx->rec_stream = pa_stream_new(c, "loopback: rec", &ctx->sample_spec, NULL);
             pa_assert(ctx->rec_stream != NULL);
             pa_stream_set_state_callback(ctx->rec_stream, stream_state_callback, ctx);
-            pa_stream_set_read_callback(ctx->rec_stream, calibrate_read_cb, ctx);
+            pa_stream_set_read_callback(ctx->rec_stream, ctx->no_calibration ? ctx->read_cb : calibrate_read_cb, ctx);
             pa_stream_set_overflow_callback(ctx->rec_stream, overflow_cb, userdata);
 
             pa_stream_connect_record(ctx->rec_stream, getenv("TEST_SOURCE"), &buffer_attr,
@@ -322,3 +326,83 @@ float pa_rms(const float *s, int n) {
 
     return sqrtf(sq / n);
 }
+
+static float timecode_encode(uint16_t v) {
+    return ((int) v - 32768) / 32768.0f;
+}
+
+static bool timecode_decode(float f, uint16_t *v) {
+    float s = f * 32768.0f;
+    long r = lrintf(s);
+
+    if (fabsf(s - (float) r) > 0.01f || r < -32768 || r > 32767)
+        return false;
+
+    *v = (uint16_t) (r + 32768);
+    return true;
+}
+
+void pa_lo_timecode_write(pa_lo_timecode *t, float *data, unsigned n_frames, unsigned channels, unsigned channel) {
+    unsigned i;
+
+    pa_assert(channel < channels);
+
+    for (i = 0; i < n_frames; i++)
+        data[i * channels + channel] = timecode_encode((uint16_t) t->frame++);
+}
+
+unsigned pa_lo_timecode_check(pa_lo_timecode *t, const float *data, unsigned n_frames, unsigned channels, unsigned channel) {
+    unsigned i, glitches = 0;
+
+    pa_assert(channel < channels);
+
+    for (i = 0; i < n_frames; i++) {
+        uint64_t pos = t->frame++;
+        uint16_t v;
+
+        if (!timecode_decode(data[i * channels + channel], &v)) {
+            if (t->locked) {
+                pa_log_warn("Glitch at frame %" PRIu64 ": corrupted sample %g", pos, data[i * channels + channel]);
+                t->locked = false;
+                glitches++;
+            }
+
+            t->run = 0;
+            continue;
+        }
+
+        if (!t->locked) {
+            /* Silence and the like are valid codes too, so wait for the
+             * counter to actually run before locking */
+            t->run = (t->run > 0 && v == t->expected) ? t->run + 1 : 1;
+            t->expected = v + 1;
+
+            if (t->run >= TIMECODE_LOCK_FRAMES) {
+                pa_log_debug("Timecode locked at frame %" PRIu64, pos);
+                t->locked = true;
+            }
+
+            continue;
+        }
+
+        if (v != t->expected) {
+            int16_t d = (int16_t) (v - t->expected);
+
+            if (d > 0)
+                pa_log_warn("Glitch at frame %" PRIu64 ": %d frames dropped", pos, d);
+            else
+                pa_log_warn("Glitch at frame %" PRIu64 ": %d frames repeated", pos, -d);
+
+            /* Relock rather than reporting every frame of e.g. an
+             * underrun's silence */
+            t->locked = false;
+            t->run = 1;
+            glitches++;
+        }
+
+        t->expected = v + 1;
+    }
+
+    t->glitches += glitches;
+    return glitches;
+}
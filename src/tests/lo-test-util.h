@@ -22,6 +22,9 @@
 #include <config.h>
 #endif
 
+#include <stdbool.h>
+#include <inttypes.h>
+
 #include <pulse/pulseaudio.h>
 
 typedef struct pa_lo_test_context {
@@ -34,6 +37,10 @@ typedef struct pa_lo_test_context {
 
     pa_stream_request_cb_t write_cb, read_cb;
 
+    /* Skip the volume calibration and keep both streams at 100%, for
+     * tests that need a bit exact path */
+    bool no_calibration;
+
     /* These are set by lo_test_init() */
     pa_mainloop *mainloop;
     pa_context *context;
@@ -53,3 +60,26 @@ void pa_lo_test_deinit(pa_lo_test_context *ctx);
 /* Return RMS for the given signal. Assumes the data is a single channel for
  * simplicity */
 float pa_rms(const float *s, int n);
+
+/* A timecode for sample accurate glitch detection: a running 16 bit frame
+ * counter on one channel. It is exactly representable in all the sample
+ * formats we support, so it survives any bit exact path, e.g. a null sink's
+ * monitor or a digital loopback, but not volume changes or resampling. */
+typedef struct pa_lo_timecode {
+    uint64_t frame; /* frames written or checked so far */
+
+    /* Checking only */
+    bool locked;
+    unsigned run;
+    uint16_t expected;
+    unsigned glitches;
+} pa_lo_timecode;
+
+/* Put the timecode on the given channel of n_frames interleaved frames,
+ * leaving the other channels alone */
+void pa_lo_timecode_write(pa_lo_timecode *t, float *data, unsigned n_frames, unsigned channels, unsigned channel);
+
+/* Follow the timecode on the given channel of captured frames, logging where
+ * frames went missing, were repeated or got corrupted. Returns the number of
+ * glitches found in this call. */
+unsigned pa_lo_timecode_check(pa_lo_timecode *t, const float *data, unsigned n_frames, unsigned channels, unsigned channel);
@@ -20,14 +20,18 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <check.h>
 
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/shm.h>
 #include <pulsecore/macro.h>
 
 static void release_cb(pa_memimport *i, uint32_t block_id, void *userdata) {
@@ -176,6 +180,252 @@ START_TEST (memblock_test) {
 }
 END_TEST
 
+START_TEST (memblock_small_test) {
+    pa_mempool *pool;
+    pa_memblock *blocks[150], *large[32];
+    unsigned i, n_slots;
+
+    /* 32 slots, that wouldn't be enough for 150 blocks without
+     * carving some of them up */
+    pool = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 32 * 64 * 1024, true);
+    fail_unless(pool != NULL);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+        blocks[i] = pa_memblock_new_pool(pool, 480);
+        fail_unless(blocks[i] != NULL);
+
+        memset(pa_memblock_acquire(blocks[i]), (int) i, 480);
+        pa_memblock_release(blocks[i]);
+    }
+
+    /* No two blocks may overlap */
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+        uint8_t *d = pa_memblock_acquire(blocks[i]);
+        unsigned j;
+
+        for (j = 0; j < 480; j++)
+            fail_unless(d[j] == (uint8_t) i);
+
+        pa_memblock_release(blocks[i]);
+    }
+
+    print_stats(pool, "small");
+
+    /* The slots that weren't carved up are still available as a
+     * whole, and freed chunks are reused */
+    for (n_slots = 0; n_slots < PA_ELEMENTSOF(large); n_slots++)
+        if (!(large[n_slots] = pa_memblock_new_pool(pool, (size_t) -1)))
+            break;
+    fail_unless(n_slots > 0 && n_slots < 32);
+
+    for (i = 0; i < n_slots; i++)
+        pa_memblock_unref(large[i]);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        pa_memblock_unref(blocks[i]);
+
+    /* Giving the memory of the free slots and chunks back to the OS
+     * doesn't take them out of the pool */
+    pa_mempool_vacuum(pool);
+
+    for (i = 0; i < 40; i++) {
+        fail_unless((blocks[i] = pa_memblock_new_pool(pool, 4000)) != NULL);
+
+        memset(pa_memblock_acquire(blocks[i]), (int) i, 4000);
+        pa_memblock_release(blocks[i]);
+    }
+
+    for (i = 0; i < 40; i++)
+        pa_memblock_unref(blocks[i]);
+
+    pa_mempool_vacuum(pool);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        fail_unless((blocks[i] = pa_memblock_new_pool(pool, 480)) != NULL);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        pa_memblock_unref(blocks[i]);
+
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_allocated) == 0);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_allocated_max) == (int) (PA_ELEMENTSOF(blocks) + n_slots));
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+START_TEST (memblock_thread_local_test) {
+    pa_mempool *pool;
+    pa_memblock *b, *f;
+    pa_memblockq *q;
+    pa_memchunk c;
+    pa_sample_spec ss = { .format = PA_SAMPLE_S16LE, .rate = 48000, .channels = 2 };
+    static char fixed[64];
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    fail_unless(pool != NULL);
+
+    b = pa_memblock_new(pool, 480);
+    fail_unless(pa_memblock_set_thread_local(b));
+
+    /* Counting works as usual */
+    pa_memblock_ref(b);
+    fail_unless(pa_memblock_is_read_only(b));
+    fail_unless(!pa_memblock_ref_is_one(b));
+    pa_memblock_unref(b);
+    fail_unless(!pa_memblock_is_read_only(b));
+
+    /* Only the sole holder may make a block thread-local */
+    pa_memblock_acquire(b);
+    fail_unless(!pa_memblock_set_thread_local(b));
+    pa_memblock_release(b);
+    pa_memblock_ref(b);
+    fail_unless(!pa_memblock_set_thread_local(b));
+
+    /* Queueing the block turns it back into a normal one */
+    q = pa_memblockq_new("test memblockq", 0, 4096, 4096, &ss, 0, 0, 0, NULL);
+    c.memblock = b;
+    c.index = 0;
+    c.length = 480;
+    fail_unless(pa_memblockq_push(q, &c) == 0);
+    pa_memblock_unref(b);
+    fail_unless(pa_memblock_is_read_only(b));
+    pa_memblockq_free(q);
+    fail_unless(pa_memblock_ref_is_one(b));
+
+    /* Once we are the sole holder again it may go back */
+    fail_unless(pa_memblock_set_thread_local(b));
+    pa_memblock_clear_thread_local(b);
+    fail_unless(pa_memblock_ref_is_one(b));
+    pa_memblock_unref(b);
+
+    /* Fixed blocks never are thread-local */
+    f = pa_memblock_new_fixed(pool, fixed, sizeof(fixed), false);
+    fail_unless(!pa_memblock_set_thread_local(f));
+    pa_memblock_unref_fixed(f);
+
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(pool)->n_allocated) == 0);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+START_TEST (memblock_export_slots_test) {
+    pa_mempool *pool_a, *pool_b;
+    pa_memexport *export_a;
+    pa_memimport *import_b;
+    pa_memblock *blocks[200], *imported[200], *fixed;
+    uint32_t ids[200], id, shm_id;
+    pa_mem_type_t mem_type;
+    size_t offsets[200], offset, size;
+    pa_memtransfer_stat stat;
+    unsigned i;
+
+    const char txt[] = "This is a test!";
+
+    pool_a = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    fail_unless(pool_a != NULL);
+    pool_b = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    fail_unless(pool_b != NULL);
+
+    export_a = pa_memexport_new(pool_a, revoke_cb, (void*) "A");
+    fail_unless(export_a != NULL);
+    import_b = pa_memimport_new(pool_b, release_cb, (void*) "B");
+    fail_unless(import_b != NULL);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++)
+        fail_unless((blocks[i] = pa_memblock_new_pool(pool_a, 480)) != NULL);
+
+    /* By default no more than older peers can import */
+    for (i = 0; i < 128; i++)
+        fail_unless(pa_memexport_put(export_a, blocks[i], &mem_type, &ids[i], &shm_id, &offsets[i], &size) >= 0);
+    fail_unless(pa_memexport_put(export_a, blocks[i], &mem_type, &ids[i], &shm_id, &offsets[i], &size) < 0);
+
+    pa_memexport_get_stat(export_a, &stat);
+    fail_unless(stat.n_blocks == 128);
+    fail_unless(stat.n_failed == 1);
+
+    pa_memexport_set_max_blocks(export_a, PA_MEMEXPORT_SLOTS_MAX);
+
+    for (; i < PA_ELEMENTSOF(blocks); i++)
+        fail_unless(pa_memexport_put(export_a, blocks[i], &mem_type, &ids[i], &shm_id, &offsets[i], &size) >= 0);
+
+    /* The importer must take all of them */
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+        imported[i] = pa_memimport_get(import_b, mem_type, ids[i], shm_id, offsets[i], size, false);
+        fail_unless(imported[i] != NULL);
+    }
+
+    pa_memimport_get_stat(import_b, &stat);
+    fail_unless(stat.n_blocks == PA_ELEMENTSOF(blocks));
+    fail_unless(stat.n_failed == 0);
+
+    /* Blocks outside of the pool are copied into it first */
+    fixed = pa_memblock_new_fixed(pool_a, (void*) txt, sizeof(txt), 1);
+    fail_unless(pa_memexport_put(export_a, fixed, &mem_type, &id, &shm_id, &offset, &size) >= 0);
+    fail_unless(pa_memexport_process_release(export_a, id) == 0);
+    pa_memblock_unref(fixed);
+
+    pa_memexport_get_stat(export_a, &stat);
+    fail_unless(stat.n_copied == 1);
+
+    for (i = 0; i < PA_ELEMENTSOF(blocks); i++) {
+        pa_memblock_unref(imported[i]);
+        fail_unless(pa_memexport_process_release(export_a, ids[i]) == 0);
+        pa_memblock_unref(blocks[i]);
+    }
+
+    pa_memexport_get_stat(export_a, &stat);
+    fail_unless(stat.n_blocks == 0);
+    fail_unless(stat.n_blocks_max == PA_ELEMENTSOF(blocks) + 1);
+
+    pa_memimport_free(import_b);
+    pa_memexport_free(export_a);
+
+    pa_mempool_unref(pool_a);
+    pa_mempool_unref(pool_b);
+}
+END_TEST
+
+#ifdef HAVE_MEMFD
+START_TEST (memblock_sealed_memfd_test) {
+    pa_mempool *pool;
+    pa_memblock *b;
+    pa_shm m;
+    uint8_t *d;
+    int fd;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    fail_unless(pool != NULL);
+
+    fail_unless(pa_shm_create_rw(&m, PA_MEM_TYPE_SHARED_MEMFD, 10000, 0600) == 0);
+    memset(m.ptr, 'x', 10000);
+
+    /* The writer could still change or truncate an unsealed memfd */
+    fail_unless(pa_memblock_new_sealed_memfd(pool, m.fd, 10000) == NULL);
+
+    fd = pa_shm_seal(&m);
+    fail_unless(fd >= 0);
+    fail_unless(ftruncate(fd, 0) < 0);
+
+    fail_unless(pa_memblock_new_sealed_memfd(pool, fd, 1024 * 1024) == NULL);
+
+    b = pa_memblock_new_sealed_memfd(pool, fd, 9998);
+    fail_unless(b != NULL);
+    pa_assert_se(pa_close(fd) == 0);
+
+    fail_unless(pa_memblock_get_length(b) == 9998);
+    fail_unless(pa_memblock_is_read_only(b));
+
+    d = pa_memblock_acquire(b);
+    fail_unless(d[0] == 'x' && d[9997] == 'x');
+    pa_memblock_release(b);
+
+    pa_memblock_unref(b);
+    pa_mempool_unref(pool);
+}
+END_TEST
+#endif
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -188,6 +438,12 @@ int main(int argc, char *argv[]) {
     s = suite_create("Memblock");
     tc = tcase_create("memblock");
     tcase_add_test(tc, memblock_test);
+    tcase_add_test(tc, memblock_small_test);
+    tcase_add_test(tc, memblock_thread_local_test);
+    tcase_add_test(tc, memblock_export_slots_test);
+#ifdef HAVE_MEMFD
+    tcase_add_test(tc, memblock_sealed_memfd_test);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -26,6 +26,7 @@
 #include <check.h>
 
 #include <pulsecore/memblockq.h>
+#include <pulsecore/sample-util.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
@@ -632,6 +633,177 @@ START_TEST (memblockq_test_tlength_change) {
 }
 END_TEST
 
+START_TEST (memblockq_test_ring) {
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk silence, chunk, pinned;
+    uint8_t w = 0, r = 0;
+    unsigned i, n_windows = 0;
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 2
+    };
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    ck_assert_ptr_ne(p, NULL);
+
+    silence.memblock = pa_memblock_new(p, 4096);
+    silence.index = 0;
+    silence.length = 4096;
+    pa_silence_memchunk(&silence, &ss);
+
+    bq = pa_memblockq_new("test memblockq", 0, 65536, 0, &ss, 0, 4, 0, &silence);
+    ck_assert_ptr_ne(bq, NULL);
+
+    if (pa_memblockq_enable_ring(bq, 8192) < 0) {
+        pa_log_info("No ring support, skipping.");
+        goto finish;
+    }
+
+    pa_memchunk_reset(&pinned);
+
+    /* Push in 480 byte pieces, take out 1000 byte blocks, so that most
+     * blocks span a few pieces and the ring wraps around a lot */
+    for (i = 0; i < 2000; i++) {
+        uint8_t *d;
+        unsigned j;
+
+        chunk.memblock = pa_memblock_new(p, 480);
+        chunk.index = 0;
+        chunk.length = 480;
+
+        d = pa_memblock_acquire(chunk.memblock);
+        for (j = 0; j < 480; j++)
+            d[j] = w++;
+        pa_memblock_release(chunk.memblock);
+
+        ck_assert_int_eq(pa_memblockq_push(bq, &chunk), 0);
+        pa_memblock_unref(chunk.memblock);
+
+        while (pa_memblockq_get_length(bq) >= 1000) {
+            ck_assert_int_eq(pa_memblockq_peek_fixed_size(bq, 1000, &chunk), 0);
+            ck_assert_int_eq(chunk.length, 1000);
+
+            /* Windows into the ring are read-only, copies aren't */
+            if (pa_memblock_is_read_only(chunk.memblock))
+                n_windows++;
+
+            d = pa_memblock_acquire_chunk(&chunk);
+            for (j = 0; j < 1000; j++)
+                ck_assert_int_eq(d[j], r++);
+            pa_memblock_release(chunk.memblock);
+
+            pa_memblockq_drop(bq, 1000);
+
+            /* Hold on to a block now and then. The ring must not reuse
+             * its memory until we let go. */
+            if (i % 100 == 0) {
+                if (pinned.memblock)
+                    pa_memblock_unref(pinned.memblock);
+                pinned = chunk;
+            } else
+                pa_memblock_unref(chunk.memblock);
+        }
+
+        check_queue_invariants(bq);
+    }
+
+    if (pinned.memblock)
+        pa_memblock_unref(pinned.memblock);
+
+    ck_assert_int_gt(n_windows, 0);
+
+finish:
+    pa_memblockq_free(bq);
+    pa_memblock_unref(silence.memblock);
+
+    ck_assert_int_eq(pa_atomic_load(&pa_mempool_get_stat(p)->n_allocated), 0);
+    pa_mempool_unref(p);
+}
+END_TEST
+
+START_TEST (memblockq_test_silence) {
+    pa_mempool *p;
+    pa_memblockq *bq;
+    pa_memchunk silence, chunk, data;
+    unsigned i;
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16LE,
+        .rate = 48000,
+        .channels = 1
+    };
+
+    pa_log_set_level(PA_LOG_DEBUG);
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    ck_assert_ptr_ne(p, NULL);
+
+    silence.memblock = pa_memblock_new(p, 4096);
+    silence.index = 0;
+    silence.length = 4096;
+    pa_silence_memchunk(&silence, &ss);
+    pa_memblock_set_is_silence(silence.memblock, true);
+
+    bq = pa_memblockq_new("test memblockq", 0, 1 << 20, 0, &ss, 0, 4, 1 << 20, &silence);
+    ck_assert_ptr_ne(bq, NULL);
+
+    /* Silence only moves the write index */
+    for (i = 0; i < 100; i++)
+        ck_assert_int_eq(pa_memblockq_push(bq, &silence), 0);
+
+    ck_assert_int_eq(pa_memblockq_get_length(bq), 100 * 4096);
+    ck_assert_int_eq(pa_memblockq_get_nblocks(bq), 0);
+
+    ck_assert_int_eq(pa_memblockq_peek(bq, &chunk), 0);
+    ck_assert_ptr_eq(chunk.memblock, silence.memblock);
+    ck_assert_int_eq(chunk.length, 4096);
+    pa_memblock_unref(chunk.memblock);
+
+    /* Silence pushed over data punches a hole into it */
+    data = memchunk_from_str(p, "11112222");
+    ck_assert_int_eq(pa_memblockq_push(bq, &data), 0);
+    pa_memblockq_seek(bq, -6, PA_SEEK_RELATIVE, true);
+
+    chunk = silence;
+    chunk.length = 4;
+    ck_assert_int_eq(pa_memblockq_push(bq, &chunk), 0);
+    ck_assert_int_eq(pa_memblockq_get_nblocks(bq), 2);
+    check_queue_invariants(bq);
+
+    pa_memblockq_drop(bq, 100 * 4096);
+
+    ck_assert_int_eq(pa_memblockq_peek(bq, &chunk), 0);
+    ck_assert_ptr_eq(chunk.memblock, data.memblock);
+    ck_assert_int_eq(chunk.length, 2);
+    pa_memblock_unref(chunk.memblock);
+    pa_memblockq_drop(bq, 2);
+
+    ck_assert_int_eq(pa_memblockq_peek(bq, &chunk), 0);
+    ck_assert_ptr_eq(chunk.memblock, silence.memblock);
+    ck_assert_int_eq(chunk.length, 4);
+    pa_memblock_unref(chunk.memblock);
+    pa_memblockq_drop(bq, 4);
+
+    ck_assert_int_eq(pa_memblockq_peek(bq, &chunk), 0);
+    ck_assert_ptr_eq(chunk.memblock, data.memblock);
+    ck_assert_int_eq(chunk.length, 2);
+    pa_memblock_unref(chunk.memblock);
+
+    /* The history reads back as silence, too */
+    pa_memblockq_rewind(bq, 4096 + 6);
+    ck_assert_int_eq(pa_memblockq_peek(bq, &chunk), 0);
+    ck_assert_ptr_eq(chunk.memblock, silence.memblock);
+    pa_memblock_unref(chunk.memblock);
+
+    pa_memblockq_free(bq);
+    pa_memblock_unref(data.memblock);
+    pa_memblock_unref(silence.memblock);
+
+    ck_assert_int_eq(pa_atomic_load(&pa_mempool_get_stat(p)->n_allocated), 0);
+    pa_mempool_unref(p);
+}
+END_TEST
 
 int main(int argc, char *argv[]) {
     int failed = 0;
@@ -650,6 +822,8 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, memblockq_test_length_changes);
     tcase_add_test(tc, memblockq_test_pop_missing);
     tcase_add_test(tc, memblockq_test_tlength_change);
+    tcase_add_test(tc, memblockq_test_ring);
+    tcase_add_test(tc, memblockq_test_silence);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,117 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/metrics.h>
+
+static char *render(pa_metrics *m) {
+    pa_strbuf *s = pa_strbuf_new();
+
+    pa_metrics_to_strbuf(m, s);
+    return pa_strbuf_to_string_free(s);
+}
+
+START_TEST (counter_test) {
+    pa_metrics *m;
+    pa_metric *a, *b, *g;
+    char *t;
+
+    m = pa_metrics_new();
+    a = pa_metrics_register(m, "pa_test_total", PA_METRIC_COUNTER, "A counter.", "sink", "a");
+    b = pa_metrics_register(m, "pa_test_total", PA_METRIC_COUNTER, "A counter.", "sink", "q\"uote");
+    g = pa_metrics_register(m, "pa_test_level", PA_METRIC_GAUGE, "A gauge.", NULL, NULL);
+
+    pa_metric_inc(a);
+    pa_metric_add(a, 41);
+    pa_metric_add(b, 7);
+    pa_metric_set(g, -3);
+    pa_metric_inc(NULL);
+
+    t = render(m);
+    fail_unless(strstr(t, "# HELP pa_test_total A counter.\n# TYPE pa_test_total counter\n") != NULL);
+    fail_unless(strstr(t, "pa_test_total{sink=\"a\"} 42\n") != NULL);
+    fail_unless(strstr(t, "pa_test_total{sink=\"q\\\"uote\"} 7\n") != NULL);
+    fail_unless(strstr(t, "# TYPE pa_test_level gauge\npa_test_level -3\n") != NULL);
+    pa_xfree(t);
+
+    /* The family goes away with its last member */
+    pa_metric_free(a);
+    pa_metric_free(b);
+    t = render(m);
+    fail_unless(strstr(t, "pa_test_total") == NULL);
+    pa_xfree(t);
+
+    pa_metric_free(g);
+    pa_metrics_free(m);
+}
+END_TEST
+
+START_TEST (histogram_test) {
+    pa_metrics *m;
+    pa_metric *h;
+    char *t;
+
+    m = pa_metrics_new();
+    h = pa_metrics_register(m, "pa_test_seconds", PA_METRIC_HISTOGRAM, "A histogram.", "sink", "a");
+
+    pa_metric_observe(h, 10);
+    pa_metric_observe(h, 300);
+    pa_metric_observe(h, 10 * PA_USEC_PER_SEC);
+
+    t = render(m);
+    fail_unless(strstr(t, "pa_test_seconds_bucket{sink=\"a\",le=\"5e-05\"} 1\n") != NULL);
+    fail_unless(strstr(t, "pa_test_seconds_bucket{sink=\"a\",le=\"0.00025\"} 1\n") != NULL);
+    fail_unless(strstr(t, "pa_test_seconds_bucket{sink=\"a\",le=\"0.0005\"} 2\n") != NULL);
+    fail_unless(strstr(t, "pa_test_seconds_bucket{sink=\"a\",le=\"0.05\"} 2\n") != NULL);
+    fail_unless(strstr(t, "pa_test_seconds_bucket{sink=\"a\",le=\"+Inf\"} 3\n") != NULL);
+    fail_unless(strstr(t, "pa_test_seconds_sum{sink=\"a\"} 10.000310\n") != NULL);
+    fail_unless(strstr(t, "pa_test_seconds_count{sink=\"a\"} 3\n") != NULL);
+    pa_xfree(t);
+
+    pa_metric_free(h);
+    pa_metrics_free(m);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Metrics");
+    tc = tcase_create("metrics");
+    tcase_add_test(tc, counter_test);
+    tcase_add_test(tc, histogram_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
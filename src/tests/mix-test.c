@@ -26,6 +26,7 @@
 
 #include <pulse/sample.h>
 #include <pulse/volume.h>
+#include <pulse/xmalloc.h>
 
 #include <pulsecore/macro.h>
 #include <pulsecore/endianmacros.h>
@@ -322,6 +323,7 @@ START_TEST (mix_test) {
         m[1].chunk = j;
         m[1].volume.values[0] = PA_VOLUME_NORM;
         m[1].volume.channels = a.channels;
+        m[0].ramp_length = m[1].ramp_length = 0;
 
         k.memblock = pa_memblock_new(pool, i.length);
         k.length = i.length;
@@ -333,6 +335,15 @@ START_TEST (mix_test) {
 
         compare_block(&a, &k, 2);
 
+        /* Mixing a single stream is the same as adjusting its volume */
+        m[0].volume = v;
+
+        ptr = pa_memblock_acquire_chunk(&k);
+        pa_mix(m, 1, ptr, k.length, &a, NULL, false);
+        pa_memblock_release(k.memblock);
+
+        compare_block(&a, &k, 1);
+
         pa_memblock_unref(i.memblock);
         pa_memblock_unref(j.memblock);
         pa_memblock_unref(k.memblock);
@@ -342,6 +353,189 @@ START_TEST (mix_test) {
 }
 END_TEST
 
+/* A stream ramping from silence to full volume comes out of pa_mix()
+ * silent at the start, growing, and unchanged after the ramp */
+START_TEST (mix_ramp_test) {
+    pa_mempool *pool;
+    pa_sample_spec a;
+    pa_memchunk i, k;
+    pa_mix_info m;
+    int16_t *d;
+    const int16_t *s;
+    unsigned n, frames;
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL, NULL);
+
+    a.format = PA_SAMPLE_S16NE;
+    a.channels = 2;
+    a.rate = 44100;
+
+    frames = 1024;
+
+    i.memblock = pa_memblock_new(pool, frames * pa_frame_size(&a));
+    i.length = pa_memblock_get_length(i.memblock);
+    i.index = 0;
+
+    d = pa_memblock_acquire(i.memblock);
+    for (n = 0; n < frames * a.channels; n++)
+        d[n] = 0x4000;
+    pa_memblock_release(i.memblock);
+
+    m.chunk = i;
+    pa_cvolume_reset(&m.volume, a.channels);
+    pa_cvolume_mute(&m.ramp_volume, a.channels);
+    m.ramp_length = i.length / 2;
+
+    k.memblock = pa_memblock_new(pool, i.length);
+    k.length = i.length;
+    k.index = 0;
+
+    d = pa_memblock_acquire_chunk(&k);
+    pa_mix(&m, 1, d, k.length, &a, NULL, false);
+
+    s = d;
+    fail_unless(s[0] >= 0 && s[0] < 0x4000 / 16);
+
+    for (n = 1; n < frames; n++) {
+        fail_unless(s[n * 2] == s[n * 2 + 1]);
+        fail_unless(s[n * 2] >= s[(n - 1) * 2]);
+    }
+
+    for (n = frames / 2; n < frames; n++)
+        fail_unless(s[n * 2] == 0x4000);
+
+    pa_memblock_release(k.memblock);
+
+    pa_memblock_unref(i.memblock);
+    pa_memblock_unref(k.memblock);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+/* Sinks mix more than 32 streams, which pa_mix() adds up in one
+ * go, saturating only the final sum */
+START_TEST (mix_many_test) {
+    pa_mempool *pool;
+    pa_sample_spec a;
+    pa_memchunk i, k;
+    pa_mix_info *m;
+    int16_t *d;
+    unsigned n, frames, nstreams;
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL, NULL);
+
+    a.format = PA_SAMPLE_S16NE;
+    a.channels = 2;
+    a.rate = 44100;
+
+    frames = 256;
+    nstreams = 100;
+
+    i.memblock = pa_memblock_new(pool, frames * pa_frame_size(&a));
+    i.length = pa_memblock_get_length(i.memblock);
+    i.index = 0;
+
+    d = pa_memblock_acquire(i.memblock);
+    for (n = 0; n < frames * a.channels; n++)
+        d[n] = n % 2 ? -100 : 0x1000;
+    pa_memblock_release(i.memblock);
+
+    m = pa_xnew0(pa_mix_info, nstreams);
+    for (n = 0; n < nstreams; n++) {
+        m[n].chunk = i;
+        pa_cvolume_reset(&m[n].volume, a.channels);
+    }
+
+    k.memblock = pa_memblock_new(pool, i.length);
+    k.length = i.length;
+    k.index = 0;
+
+    d = pa_memblock_acquire_chunk(&k);
+    pa_mix(m, nstreams, d, k.length, &a, NULL, false);
+
+    for (n = 0; n < frames; n++) {
+        fail_unless(d[n * 2] == 0x7FFF);
+        fail_unless(d[n * 2 + 1] == -10000);
+    }
+
+    pa_memblock_release(k.memblock);
+
+    pa_xfree(m);
+    pa_memblock_unref(i.memblock);
+    pa_memblock_unref(k.memblock);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+START_TEST (volume_copy_test) {
+    pa_mempool *pool;
+    pa_sample_spec a;
+    pa_cvolume v;
+    pa_memchunk i, j, k;
+    int16_t *d;
+    const int16_t *s, *t;
+    unsigned n, samples;
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL, NULL);
+
+    a.format = PA_SAMPLE_S16NE;
+    a.channels = 2;
+    a.rate = 44100;
+
+    samples = 1024 * a.channels;
+
+    i.memblock = pa_memblock_new(pool, samples * sizeof(int16_t));
+    i.length = pa_memblock_get_length(i.memblock);
+    i.index = 0;
+
+    d = pa_memblock_acquire(i.memblock);
+    for (n = 0; n < samples; n++)
+        d[n] = (int16_t) ((n * 997) % 0x8000 - 0x4000);
+    pa_memblock_release(i.memblock);
+
+    pa_cvolume_set(&v, a.channels, PA_VOLUME_NORM / 2);
+    v.values[1] = PA_VOLUME_NORM / 3;
+
+    /* The reference: copy first, then scale in place */
+    j = i;
+    pa_memblock_ref(j.memblock);
+    pa_memchunk_make_writable(&j, 0);
+    pa_volume_memchunk(&j, &a, &v);
+
+    pa_volume_memchunk_copy(&k, &i, &a, &v);
+    fail_unless(k.memblock != i.memblock);
+    fail_unless(k.length == i.length);
+
+    s = pa_memblock_acquire_chunk(&k);
+    t = pa_memblock_acquire_chunk(&j);
+    d = pa_memblock_acquire_chunk(&i);
+
+    for (n = 0; n < samples; n++) {
+        fail_unless(s[n] == t[n]);
+        fail_unless(d[n] == (int16_t) ((n * 997) % 0x8000 - 0x4000));
+    }
+
+    pa_memblock_release(i.memblock);
+    pa_memblock_release(j.memblock);
+    pa_memblock_release(k.memblock);
+
+    pa_memblock_unref(k.memblock);
+
+    /* Nothing to scale, we just get another reference */
+    pa_cvolume_reset(&v, a.channels);
+    pa_volume_memchunk_copy(&k, &i, &a, &v);
+    fail_unless(k.memblock == i.memblock);
+    pa_memblock_unref(k.memblock);
+
+    pa_memblock_unref(i.memblock);
+    pa_memblock_unref(j.memblock);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -351,6 +545,9 @@ int main(int argc, char *argv[]) {
     s = suite_create("Mix");
     tc = tcase_create("mix");
     tcase_add_test(tc, mix_test);
+    tcase_add_test(tc, mix_ramp_test);
+    tcase_add_test(tc, mix_many_test);
+    tcase_add_test(tc, volume_copy_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
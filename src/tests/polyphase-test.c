@@ -0,0 +1,206 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/resampler.h>
+
+#include "runtime-test-util.h"
+
+#define BLOCK_FRAMES 441
+#define N_BLOCKS 100
+#define FREQ 1000.0
+#define TIMES 1000
+#define TIMES2 100
+
+/* Resamples a sine and compares the output with the sine at the output
+ * rate. Halfway through the input rate is changed to in_rate2, if
+ * that is not 0. The filter is centered on the input, so there is no
+ * delay to account for. Returns the largest difference. */
+static float run_sine(pa_mempool *pool, uint32_t in_rate, uint32_t out_rate, uint32_t in_rate2) {
+    pa_sample_spec a, b;
+    pa_resampler *r;
+    double in_phase = 0.0, out_phase = 0.0;
+    float max_diff = 0.0f;
+    unsigned k, n, out_frames = 0;
+
+    a.format = b.format = PA_SAMPLE_FLOAT32NE;
+    a.channels = b.channels = 1;
+    a.rate = in_rate;
+    b.rate = out_rate;
+
+    fail_unless((r = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, PA_RESAMPLER_POLYPHASE,
+                                      PA_RESAMPLER_NO_LFE | (in_rate2 ? PA_RESAMPLER_VARIABLE_RATE : 0))) != NULL);
+    fail_unless(pa_resampler_get_method(r) == PA_RESAMPLER_POLYPHASE);
+
+    for (k = 0; k < N_BLOCKS; k++) {
+        pa_memchunk i, j;
+        float *d;
+
+        if (k == N_BLOCKS / 2 && in_rate2) {
+            pa_resampler_set_input_rate(r, in_rate2);
+            a.rate = in_rate2;
+        }
+
+        i.memblock = pa_memblock_new(pool, BLOCK_FRAMES * sizeof(float));
+        i.index = 0;
+        i.length = BLOCK_FRAMES * sizeof(float);
+
+        d = pa_memblock_acquire(i.memblock);
+        for (n = 0; n < BLOCK_FRAMES; n++) {
+            d[n] = (float) (0.5 * sin(in_phase));
+            in_phase += 2.0 * M_PI * FREQ / a.rate;
+        }
+        pa_memblock_release(i.memblock);
+
+        pa_resampler_run(r, &i, &j);
+        pa_memblock_unref(i.memblock);
+
+        if (!j.memblock)
+            continue;
+
+        d = pa_memblock_acquire_chunk(&j);
+        for (n = 0; n < j.length / sizeof(float); n++, out_frames++) {
+            /* Skip the start, where the filter still sees silence */
+            if (out_frames > 100)
+                max_diff = PA_MAX(max_diff, fabsf(d[n] - (float) (0.5 * sin(out_phase))));
+
+            out_phase += 2.0 * M_PI * FREQ / out_rate;
+        }
+        pa_memblock_release(j.memblock);
+        pa_memblock_unref(j.memblock);
+    }
+
+    pa_resampler_free(r);
+
+    /* We did see all of the input, except for what is in the filter */
+    fail_unless(out_frames > (unsigned) ((uint64_t) N_BLOCKS * BLOCK_FRAMES * out_rate / PA_MAX(in_rate, in_rate2)) - 100);
+
+    return max_diff;
+}
+
+START_TEST (polyphase_sine_test) {
+    pa_mempool *pool;
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL);
+
+    /* Better than -70 dB relative to the signal */
+    fail_unless(run_sine(pool, 44100, 48000, 0) < 2e-4f);
+    fail_unless(run_sine(pool, 48000, 44100, 0) < 2e-4f);
+    fail_unless(run_sine(pool, 48000, 96000, 0) < 2e-4f);
+    fail_unless(run_sine(pool, 96000, 48000, 0) < 2e-4f);
+
+    /* Rates without a precomputed table */
+    fail_unless(run_sine(pool, 48000, 48010, 0) < 2e-4f);
+
+    /* Changing the rate must not cause a jump in the output. The
+     * signal doesn't change exactly where the resampler's rate does,
+     * so allow for a bit more. */
+    fail_unless(run_sine(pool, 44100, 48000, 44150) < 5e-3f);
+    fail_unless(run_sine(pool, 48000, 48000, 47900) < 5e-3f);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+#if defined (__i386__) || defined (__amd64__)
+START_TEST (polyphase_sse_test) {
+    pa_polyphase_dot_func_t orig_func, func;
+    pa_cpu_x86_flag_t flags = 0;
+    float *x, *h, result = 0.0f;
+    unsigned n, i;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE)) {
+        pa_log_info("SSE not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_polyphase_dot_func();
+    pa_polyphase_func_init_sse(flags);
+    func = pa_get_polyphase_dot_func();
+    pa_set_polyphase_dot_func(orig_func);
+
+    fail_unless(func != orig_func);
+
+    x = pa_xnew(float, 257);
+    h = pa_xnew(float, 256);
+
+    for (i = 0; i < 257; i++)
+        x[i] = ((int) (rand() % 2001) - 1000) / 1000.0f;
+    for (i = 0; i < 256; i++)
+        h[i] = ((int) (rand() % 2001) - 1000) / 64000.0f;
+
+    /* The history doesn't need to be aligned */
+    for (n = 4; n <= 256; n += 4)
+        for (i = 0; i < 2; i++)
+            fail_unless(fabsf(func(x + i, h, n) - orig_func(x + i, h, n)) < 1e-5f);
+
+    PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+        result += func(x + 1, h, 32);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+        result += orig_func(x + 1, h, 32);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_log_debug("Sum: %f", result);
+
+    pa_xfree(x);
+    pa_xfree(h);
+}
+END_TEST
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Polyphase");
+
+    tc = tcase_create("polyphase");
+    tcase_add_test(tc, polyphase_sine_test);
+#if defined (__i386__) || defined (__amd64__)
+    tcase_add_test(tc, polyphase_sse_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
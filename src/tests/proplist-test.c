@@ -88,7 +88,8 @@ START_TEST (proplist_test) {
 
     fail_unless(pa_modargs_get_proplist(ma, "foo", a, PA_UPDATE_REPLACE) >= 0);
 
-    pa_log_debug("%s", v = pa_proplist_to_string(a));
+    v = pa_proplist_to_string(a);
+    pa_log_debug("%s", v);
     pa_xfree(v);
 
     pa_proplist_free(a);
@@ -0,0 +1,196 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <check.h>
+
+#include <pulsecore/random.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "modules/raop/raop-alac.h"
+
+#include "runtime-test-util.h"
+
+#define FRAMES 352
+#define TIMES 1000
+#define TIMES2 100
+
+/* The bit-at-a-time writer raop-client.c used to have, as reference */
+static void bit_writer(uint8_t **buffer, uint8_t *bit_pos, size_t *size, uint8_t data, uint8_t data_bit_len) {
+    int bits_left, bit_overflow;
+
+    if (!*bit_pos)
+        *size += 1;
+
+    bits_left = 8 - *bit_pos;
+    bit_overflow = bits_left - data_bit_len;
+
+    if (bit_overflow >= 0) {
+        if (*bit_pos)
+            **buffer |= data << bit_overflow;
+        else
+            **buffer = data << bit_overflow;
+
+        if (bit_overflow == 0) {
+            *buffer += 1;
+            *bit_pos = 0;
+        } else
+            *bit_pos += data_bit_len;
+    } else {
+        **buffer |= data >> -bit_overflow;
+        *buffer += 1;
+        *size += 1;
+        **buffer = data << (8 + bit_overflow);
+        *bit_pos = -bit_overflow;
+    }
+}
+
+static size_t write_reference(uint8_t *packet, const uint8_t *raw, size_t length) {
+    uint32_t nbs = length / 4, i;
+    uint8_t *bp = packet, bpos = 0;
+    size_t size = 0;
+
+    bit_writer(&bp, &bpos, &size, 1, 3);
+    bit_writer(&bp, &bpos, &size, 0, 4);
+    bit_writer(&bp, &bpos, &size, 0, 8);
+    bit_writer(&bp, &bpos, &size, 0, 4);
+    bit_writer(&bp, &bpos, &size, 1, 1);
+    bit_writer(&bp, &bpos, &size, 0, 2);
+    bit_writer(&bp, &bpos, &size, 1, 1);
+    bit_writer(&bp, &bpos, &size, (nbs >> 24) & 0xff, 8);
+    bit_writer(&bp, &bpos, &size, (nbs >> 16) & 0xff, 8);
+    bit_writer(&bp, &bpos, &size, (nbs >> 8) & 0xff, 8);
+    bit_writer(&bp, &bpos, &size, nbs & 0xff, 8);
+
+    for (i = 0; i < nbs; i++) {
+        bit_writer(&bp, &bpos, &size, raw[4 * i + 1], 8);
+        bit_writer(&bp, &bpos, &size, raw[4 * i + 0], 8);
+        bit_writer(&bp, &bpos, &size, raw[4 * i + 3], 8);
+        bit_writer(&bp, &bpos, &size, raw[4 * i + 2], 8);
+    }
+
+    return size;
+}
+
+/* Reads the samples back from a frame, returns the number of frames */
+static uint32_t read_verbatim(const uint8_t *packet, uint8_t *raw) {
+    uint32_t nbs = 0, i;
+    unsigned bit = 23;
+
+#define READ_BYTE() \
+    ((uint8_t) ((packet[bit / 8] << (bit % 8) | packet[bit / 8 + 1] >> (8 - bit % 8)) & 0xff))
+
+    for (i = 0; i < 4; i++, bit += 8)
+        nbs = nbs << 8 | READ_BYTE();
+
+    for (i = 0; i < nbs; i++) {
+        raw[4 * i + 1] = READ_BYTE(); bit += 8;
+        raw[4 * i + 0] = READ_BYTE(); bit += 8;
+        raw[4 * i + 3] = READ_BYTE(); bit += 8;
+        raw[4 * i + 2] = READ_BYTE(); bit += 8;
+    }
+
+#undef READ_BYTE
+
+    return nbs;
+}
+
+START_TEST (alac_verbatim_test) {
+    uint8_t raw[FRAMES * 4], back[FRAMES * 4];
+    uint8_t packet[FRAMES * 4 + 8], ref[FRAMES * 4 + 8];
+    unsigned frames;
+
+    pa_random(raw, sizeof(raw));
+
+    for (frames = 0; frames <= FRAMES; frames++) {
+        size_t length = frames * 4, size, ref_size;
+
+        memset(packet, 0xaa, sizeof(packet));
+        size = pa_raop_alac_write_verbatim(packet, sizeof(packet), raw, &length);
+        ref_size = write_reference(ref, raw, frames * 4);
+
+        fail_unless(length == frames * 4);
+        fail_unless(size == ref_size);
+        fail_unless(memcmp(packet, ref, size) == 0);
+
+        /* Round trip */
+        fail_unless(read_verbatim(packet, back) == frames);
+        fail_unless(memcmp(raw, back, frames * 4) == 0);
+    }
+}
+END_TEST
+
+START_TEST (alac_verbatim_max_test) {
+    uint8_t raw[FRAMES * 4], packet[FRAMES * 4 + 8];
+    size_t length = sizeof(raw), size;
+
+    pa_random(raw, sizeof(raw));
+
+    /* Only as many frames as fit are consumed */
+    size = pa_raop_alac_write_verbatim(packet, 7 + 10 * 4 + 3, raw, &length);
+
+    fail_unless(length == 10 * 4);
+    fail_unless(size == 7 + 10 * 4);
+}
+END_TEST
+
+START_TEST (alac_verbatim_perf_test) {
+    uint8_t raw[FRAMES * 4], packet[FRAMES * 4 + 8];
+
+    pa_random(raw, sizeof(raw));
+
+    PA_RUNTIME_TEST_RUN_START("bit writer", TIMES, TIMES2) {
+        write_reference(packet, raw, sizeof(raw));
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("word writer", TIMES, TIMES2) {
+        size_t length = sizeof(raw);
+        pa_raop_alac_write_verbatim(packet, sizeof(packet), raw, &length);
+    } PA_RUNTIME_TEST_RUN_STOP
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("RAOP ALAC");
+    tc = tcase_create("raop-alac");
+    tcase_add_test(tc, alac_verbatim_test);
+    tcase_add_test(tc, alac_verbatim_max_test);
+    tcase_add_test(tc, alac_verbatim_perf_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
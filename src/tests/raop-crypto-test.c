@@ -0,0 +1,105 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <check.h>
+
+#include <pulsecore/random.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "modules/raop/raop-crypto.h"
+
+#include "runtime-test-util.h"
+
+/* The ALAC payload of a UDP audio packet */
+#define PACKET_SIZE (7 + 352 * 4)
+#define TIMES 1000
+#define TIMES2 100
+
+START_TEST (raop_aes_test) {
+    pa_raop_secret *s;
+    uint8_t plain[PACKET_SIZE], a[PACKET_SIZE], b[PACKET_SIZE];
+    const int blocks = PACKET_SIZE / 16 * 16;
+
+    pa_random(plain, sizeof(plain));
+
+    s = pa_raop_secret_new();
+
+    memcpy(a, plain, sizeof(plain));
+    fail_unless(pa_raop_aes_encrypt(s, a, PACKET_SIZE) == blocks);
+
+    /* Every packet is encrypted on its own, starting with the same IV */
+    memcpy(b, plain, sizeof(plain));
+    fail_unless(pa_raop_aes_encrypt(s, b, PACKET_SIZE) == blocks);
+
+    fail_unless(memcmp(a, b, sizeof(a)) == 0);
+    fail_unless(memcmp(a, plain, 16) != 0);
+
+    /* An incomplete block at the end stays as it is */
+    fail_unless(memcmp(a + blocks, plain + blocks, PACKET_SIZE - blocks) == 0);
+
+    fail_unless(pa_raop_aes_encrypt(s, a, 15) == 0);
+
+    pa_raop_secret_free(s);
+}
+END_TEST
+
+START_TEST (raop_aes_perf_test) {
+    pa_raop_secret *s;
+    uint8_t packet[PACKET_SIZE];
+
+    pa_random(packet, sizeof(packet));
+
+    s = pa_raop_secret_new();
+
+    PA_RUNTIME_TEST_RUN_START("aes-cbc encrypt", TIMES, TIMES2) {
+        pa_raop_aes_encrypt(s, packet, PACKET_SIZE);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_raop_secret_free(s);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("RAOP crypto");
+    tc = tcase_create("raop-crypto");
+    tcase_add_test(tc, raop_aes_test);
+    tcase_add_test(tc, raop_aes_perf_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,6 +20,9 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <getopt.h>
 #include <locale.h>
 
@@ -37,6 +40,7 @@
 #include <pulsecore/memblock.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/random.h>
 
 static void dump_block(const char *label, const pa_sample_spec *ss, const pa_memchunk *chunk) {
     void *d;
@@ -251,6 +255,226 @@ static pa_memblock* generate_block(pa_mempool *pool, const pa_sample_spec *ss) {
     return r;
 }
 
+static pa_memblock* generate_noise(pa_mempool *pool, const pa_sample_spec *ss, size_t length) {
+    pa_memblock *r;
+    void *d;
+
+    pa_assert_se(r = pa_memblock_new(pool, length));
+    d = pa_memblock_acquire(r);
+
+    if (ss->format == PA_SAMPLE_FLOAT32NE) {
+        float *f = d;
+        size_t i;
+
+        for (i = 0; i < length / sizeof(float); i++)
+            f[i] = 2.0f * (rand() / (float) RAND_MAX) - 1.0f;
+    } else
+        pa_random(d, length);
+
+    pa_memblock_release(r);
+
+    return r;
+}
+
+/* Rate conversions swept in benchmark mode */
+static const struct {
+    uint32_t from, to;
+} bench_rates[] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 48000, 96000 },
+    { 96000, 48000 },
+    { 8000, 48000 },
+};
+
+static const pa_sample_format_t bench_formats[] = {
+    PA_SAMPLE_S16NE,
+    PA_SAMPLE_S24NE,
+    PA_SAMPLE_S32NE,
+    PA_SAMPLE_FLOAT32NE,
+};
+
+static const uint8_t bench_channels[] = { 1, 2, 6 };
+
+/* Length of the input blocks in benchmark mode, like a typical sink
+ * input would pass them */
+#define BENCH_BLOCK_USEC (20 * PA_USEC_PER_MSEC)
+
+/* Determine the delay of the resampler by passing an impulse through
+ * it and looking for the output sample with the largest magnitude.
+ * Returns (pa_usec_t) -1 if we never saw it. */
+static pa_usec_t measure_delay(pa_mempool *pool, pa_resample_method_t method, uint32_t from, uint32_t to) {
+    pa_sample_spec a, b;
+    pa_resampler *r;
+    pa_memchunk i, j;
+    size_t n_frames, peak_frame = 0, out_frames = 0;
+    float peak = 0.0f;
+    unsigned k;
+
+    a.format = b.format = PA_SAMPLE_FLOAT32NE;
+    a.channels = b.channels = 1;
+    a.rate = from;
+    b.rate = to;
+
+    if (!(r = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, method, PA_RESAMPLER_NO_LFE)))
+        return (pa_usec_t) -1;
+
+    n_frames = pa_usec_to_bytes(BENCH_BLOCK_USEC, &a) / pa_frame_size(&a);
+
+    /* 200ms should be plenty for any of the filters we have */
+    for (k = 0; k < 10; k++) {
+        float *d;
+        size_t n;
+
+        i.memblock = pa_memblock_new(pool, n_frames * sizeof(float));
+        i.index = 0;
+        i.length = n_frames * sizeof(float);
+
+        d = pa_memblock_acquire(i.memblock);
+        memset(d, 0, i.length);
+        if (k == 0)
+            d[0] = 0.5f;
+        pa_memblock_release(i.memblock);
+
+        pa_resampler_run(r, &i, &j);
+        pa_memblock_unref(i.memblock);
+
+        if (!j.memblock)
+            continue;
+
+        d = pa_memblock_acquire_chunk(&j);
+        for (n = 0; n < j.length / sizeof(float); n++) {
+            if (fabsf(d[n]) > peak) {
+                peak = fabsf(d[n]);
+                peak_frame = out_frames + n;
+            }
+        }
+        pa_memblock_release(j.memblock);
+
+        out_frames += j.length / sizeof(float);
+        pa_memblock_unref(j.memblock);
+    }
+
+    pa_resampler_free(r);
+
+    if (peak <= 0.0f)
+        return (pa_usec_t) -1;
+
+    return (pa_usec_t) peak_frame * PA_USEC_PER_SEC / to;
+}
+
+/* Run one configuration for the given amount of input audio and print
+ * a line of results. Returns false if the resampler couldn't be set
+ * up, or fell back to another method. */
+static bool run_benchmark_one(pa_resample_method_t method, const pa_sample_spec *a, const pa_sample_spec *b,
+                              int seconds, pa_usec_t delay) {
+    pa_mempool *pool;
+    pa_resampler *r;
+    pa_memchunk i, j;
+    pa_usec_t ts, elapsed;
+    uint64_t frames = 0, total;
+    bool ret = false;
+
+    pa_assert_se(pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true));
+
+    if (!(r = pa_resampler_new(pool, a, NULL, b, NULL, 0, method, PA_RESAMPLER_NO_LFE)))
+        goto finish;
+
+    if (pa_resampler_get_method(r) != method) {
+        pa_resampler_free(r);
+        goto finish;
+    }
+
+    i.memblock = generate_noise(pool, a, pa_usec_to_bytes(BENCH_BLOCK_USEC, a));
+    i.index = 0;
+    i.length = pa_memblock_get_length(i.memblock);
+
+    total = (uint64_t) seconds * a->rate;
+
+    /* Warm up caches and let the resampler allocate its buffers */
+    pa_resampler_run(r, &i, &j);
+    if (j.memblock)
+        pa_memblock_unref(j.memblock);
+
+    ts = pa_rtclock_now();
+    while (frames < total) {
+        pa_resampler_run(r, &i, &j);
+        if (j.memblock)
+            pa_memblock_unref(j.memblock);
+
+        frames += i.length / pa_frame_size(a);
+    }
+    elapsed = pa_rtclock_now() - ts;
+
+    pa_memblock_unref(i.memblock);
+    pa_resampler_free(r);
+
+    printf("%s,%s,%u,%u,%u,%.2f,", pa_resample_method_to_string(method), pa_sample_format_to_string(a->format),
+           a->channels, a->rate, b->rate, (double) elapsed * 1000.0 / (double) frames);
+
+    if (delay != (pa_usec_t) -1)
+        printf("%llu,", (unsigned long long) delay);
+    else
+        printf(",");
+
+    printf("%u\n", (unsigned) pa_atomic_load(&pa_mempool_get_stat(pool)->allocated_size_max));
+    fflush(stdout);
+
+    ret = true;
+
+finish:
+    pa_mempool_unref(pool);
+
+    return ret;
+}
+
+/* Sweep all supported resampling methods, sample formats, channel counts
+ * and rate conversions, and print the results as CSV on stdout */
+/* Benchmarks all methods, or just the given one unless it's 'auto' */
+static void run_benchmark(int seconds, pa_resample_method_t only) {
+    pa_mempool *pool;
+    pa_resample_method_t method;
+    unsigned i, j, k;
+
+    pa_assert_se(pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true));
+
+    printf("method,format,channels,from_rate,to_rate,ns_per_frame,delay_usec,mempool_peak_bytes\n");
+
+    for (method = 0; method < PA_RESAMPLER_MAX; method++) {
+
+        /* 'copy' can't convert rates, 'auto' is just one of the others */
+        if (!pa_resample_method_supported(method) || method == PA_RESAMPLER_COPY || method == PA_RESAMPLER_AUTO)
+            continue;
+
+        if (only != PA_RESAMPLER_AUTO && method != only)
+            continue;
+
+        for (k = 0; k < PA_ELEMENTSOF(bench_rates); k++) {
+            pa_usec_t delay = measure_delay(pool, method, bench_rates[k].from, bench_rates[k].to);
+
+            for (i = 0; i < PA_ELEMENTSOF(bench_formats); i++)
+                for (j = 0; j < PA_ELEMENTSOF(bench_channels); j++) {
+                    pa_sample_spec a, b;
+
+                    a.format = b.format = bench_formats[i];
+                    a.channels = b.channels = bench_channels[j];
+                    a.rate = bench_rates[k].from;
+                    b.rate = bench_rates[k].to;
+
+                    if (!run_benchmark_one(method, &a, &b, seconds, delay)) {
+                        pa_log_info("Skipping %s for %u -> %u Hz", pa_resample_method_to_string(method), a.rate, b.rate);
+                        goto next_rate;
+                    }
+                }
+
+        next_rate:
+            ;
+        }
+    }
+
+    pa_mempool_unref(pool);
+}
+
 static void help(const char *argv0) {
     printf("%s [options]\n\n"
            "-h, --help                            Show this help\n"
@@ -262,7 +486,12 @@ static void help(const char *argv0) {
            "      --to-format=SAMPLEFORMAT        To sample type (defaults to s16le)\n"
            "      --to-channels=CHANNELS          To number of channels (defaults to 1)\n"
            "      --resample-method=METHOD        Resample method (defaults to auto)\n"
-           "      --seconds=SECONDS               From stream duration (defaults to 60)\n"
+           "      --seconds=SECONDS               From stream duration (defaults to 60, or 1 per\n"
+           "                                      configuration with --benchmark)\n"
+           "      --benchmark                     Benchmark all resample methods, sample formats,\n"
+           "                                      channel counts and a set of rate conversions, and\n"
+           "                                      print the results as CSV. With --resample-method,\n"
+           "                                      only that method is benchmarked\n"
            "\n"
            "If the formats are not specified, the test performs all formats combinations,\n"
            "back and forth.\n"
@@ -284,7 +513,8 @@ enum {
     ARG_TO_CHANNELS,
     ARG_SECONDS,
     ARG_RESAMPLE_METHOD,
-    ARG_DUMP_RESAMPLE_METHODS
+    ARG_DUMP_RESAMPLE_METHODS,
+    ARG_BENCHMARK
 };
 
 static void dump_resample_methods(void) {
@@ -300,7 +530,7 @@ int main(int argc, char *argv[]) {
     pa_mempool *pool = NULL;
     pa_sample_spec a, b;
     int ret = 1, c;
-    bool all_formats = true;
+    bool all_formats = true, benchmark = false;
     pa_resample_method_t method;
     int seconds;
     unsigned crossover_freq = 120;
@@ -318,6 +548,7 @@ int main(int argc, char *argv[]) {
         {"seconds",               1, NULL, ARG_SECONDS},
         {"resample-method",       1, NULL, ARG_RESAMPLE_METHOD},
         {"dump-resample-methods", 0, NULL, ARG_DUMP_RESAMPLE_METHODS},
+        {"benchmark",             0, NULL, ARG_BENCHMARK},
         {NULL,                    0, NULL, 0}
     };
 
@@ -335,7 +566,7 @@ int main(int argc, char *argv[]) {
     a.format = b.format = PA_SAMPLE_S16LE;
 
     method = PA_RESAMPLER_AUTO;
-    seconds = 60;
+    seconds = -1;
 
     while ((c = getopt_long(argc, argv, "hv", long_options, NULL)) != -1) {
 
@@ -359,6 +590,10 @@ int main(int argc, char *argv[]) {
                 ret = 0;
                 goto quit;
 
+            case ARG_BENCHMARK:
+                benchmark = true;
+                break;
+
             case ARG_FROM_CHANNELS:
                 a.channels = (uint8_t) atoi(optarg);
                 break;
@@ -404,6 +639,15 @@ int main(int argc, char *argv[]) {
     }
 
     ret = 0;
+
+    if (benchmark) {
+        run_benchmark(seconds > 0 ? seconds : 1, method);
+        goto quit;
+    }
+
+    if (seconds < 0)
+        seconds = 60;
+
     pa_assert_se(pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true));
 
     if (!all_formats) {
@@ -0,0 +1,183 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulsecore/ringbuffer.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#define CAPACITY 1000
+#define TOTAL (10 * 1000 * 1000)
+
+/* Writes an ever increasing byte sequence in odd-sized batches */
+static void producer(void *_r) {
+    pa_ringbuffer *r = _r;
+    unsigned n = 0, batch = 1;
+
+    while (n < TOTAL) {
+        unsigned left = PA_MIN(batch, TOTAL - n);
+
+        while (left > 0) {
+            int c, i;
+            uint8_t *p = pa_ringbuffer_begin_write(r, &c);
+
+            if (c == 0) {
+                pa_thread_yield();
+                continue;
+            }
+
+            c = PA_MIN((unsigned) c, left);
+            for (i = 0; i < c; i++)
+                p[i] = (uint8_t) n++;
+
+            pa_ringbuffer_end_write(r, c);
+            left -= c;
+        }
+
+        pa_ringbuffer_commit_write(r);
+        batch = batch % 97 + 13;
+    }
+}
+
+static void consumer(void *_r) {
+    pa_ringbuffer *r = _r;
+    unsigned n = 0;
+
+    while (n < TOTAL) {
+        int c, i;
+        uint8_t *p = pa_ringbuffer_peek(r, &c);
+
+        if (c == 0) {
+            pa_ringbuffer_commit_read(r);
+            pa_thread_yield();
+            continue;
+        }
+
+        for (i = 0; i < c; i++)
+            fail_unless(p[i] == (uint8_t) n++);
+
+        pa_ringbuffer_drop(r, c);
+
+        if (n % 7 == 0)
+            pa_ringbuffer_commit_read(r);
+    }
+
+    pa_ringbuffer_commit_read(r);
+}
+
+static void run_threads(pa_ringbuffer *r) {
+    pa_thread *t1, *t2;
+
+    t1 = pa_thread_new("producer", producer, r);
+    fail_unless(t1 != NULL);
+    t2 = pa_thread_new("consumer", consumer, r);
+    fail_unless(t2 != NULL);
+
+    pa_thread_free(t1);
+    pa_thread_free(t2);
+}
+
+START_TEST (ringbuffer_split_test) {
+    pa_ringbuffer *r;
+
+    r = pa_ringbuffer_new(CAPACITY);
+    fail_unless(r != NULL);
+
+    run_threads(r);
+
+    pa_ringbuffer_free(r);
+}
+END_TEST
+
+START_TEST (ringbuffer_count_test) {
+    pa_ringbuffer r;
+    pa_atomic_t count = PA_ATOMIC_INIT(0);
+    uint8_t memory[CAPACITY];
+
+    pa_ringbuffer_init(&r, &count, NULL, memory, CAPACITY);
+
+    run_threads(&r);
+
+    fail_unless(pa_atomic_load(&count) == 0);
+}
+END_TEST
+
+START_TEST (ringbuffer_full_test) {
+    pa_ringbuffer *r;
+    int c;
+
+    r = pa_ringbuffer_new(CAPACITY);
+
+    /* Nothing is visible to the reader before the commit */
+    pa_ringbuffer_begin_write(r, &c);
+    fail_unless(c == CAPACITY);
+    pa_ringbuffer_end_write(r, CAPACITY);
+    pa_ringbuffer_peek(r, &c);
+    fail_unless(c == 0);
+
+    /* Asking for more space commits the pending data */
+    pa_ringbuffer_begin_write(r, &c);
+    fail_unless(c == 0);
+    pa_ringbuffer_peek(r, &c);
+    fail_unless(c == CAPACITY);
+
+    /* Freeing space in a full buffer must be reported */
+    pa_ringbuffer_drop(r, 10);
+    fail_unless(pa_ringbuffer_commit_read(r));
+    pa_ringbuffer_drop(r, 10);
+    fail_unless(!pa_ringbuffer_commit_read(r));
+
+    pa_ringbuffer_begin_write(r, &c);
+    fail_unless(c == 20);
+
+    pa_ringbuffer_free(r);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Ringbuffer");
+    tc = tcase_create("ringbuffer");
+    tcase_add_test(tc, ringbuffer_split_test);
+    tcase_add_test(tc, ringbuffer_count_test);
+    tcase_add_test(tc, ringbuffer_full_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,137 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <time.h>
+
+#include <check.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/util.h>
+
+#include <pulsecore/core-rtclock.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+
+#include "runtime-test-util.h"
+
+#define TIMES 1000
+#define TIMES2 100
+
+static pa_usec_t monotonic_now(void) {
+    struct timespec ts;
+
+    fail_unless(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+    return pa_timespec_load(&ts);
+}
+
+static void run_source(pa_rtclock_source_t source) {
+    pa_usec_t last, now, rt0, mono0, rt1, mono1;
+    char label[64];
+    int i;
+
+    if (pa_rtclock_set_source(source) < 0) {
+        pa_log_info("The %s clock source is not available here.", pa_rtclock_source_to_string(source));
+        return;
+    }
+
+    fail_unless(pa_rtclock_get_source() == source);
+
+    /* Never goes backwards */
+    last = pa_rtclock_now();
+    for (i = 0; i < 1000000; i++) {
+        now = pa_rtclock_now();
+        fail_unless(now >= last);
+        last = now;
+    }
+
+    /* Keeps pace with CLOCK_MONOTONIC, which timers and ALSA timestamps
+     * are based on */
+    rt0 = pa_rtclock_now();
+    mono0 = monotonic_now();
+    pa_msleep(300);
+    rt1 = pa_rtclock_now();
+    mono1 = monotonic_now();
+
+    pa_log_debug("%s: %llu usec passed, CLOCK_MONOTONIC says %llu usec.", pa_rtclock_source_to_string(source),
+                 (unsigned long long) (rt1 - rt0), (unsigned long long) (mono1 - mono0));
+
+    fail_unless(rt1 - rt0 + 2 * PA_RTCLOCK_COARSE_MAX_USEC >= mono1 - mono0);
+    fail_unless(rt1 - rt0 <= mono1 - mono0 + 2 * PA_RTCLOCK_COARSE_MAX_USEC);
+
+    pa_snprintf(label, sizeof(label), "%s: %d reads", pa_rtclock_source_to_string(source), TIMES);
+    PA_RUNTIME_TEST_RUN_START(label, TIMES, TIMES2) {
+        pa_rtclock_now();
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_assert_se(pa_rtclock_set_source(PA_RTCLOCK_SOURCE_PRECISE) == 0);
+}
+
+START_TEST (precise_test) {
+    run_source(PA_RTCLOCK_SOURCE_PRECISE);
+}
+END_TEST
+
+START_TEST (coarse_test) {
+    run_source(PA_RTCLOCK_SOURCE_COARSE);
+}
+END_TEST
+
+START_TEST (tsc_test) {
+    run_source(PA_RTCLOCK_SOURCE_TSC);
+}
+END_TEST
+
+START_TEST (string_test) {
+    pa_rtclock_source_t s;
+
+    for (s = 0; s < PA_RTCLOCK_SOURCE_MAX; s++)
+        fail_unless(pa_rtclock_source_from_string(pa_rtclock_source_to_string(s)) == s);
+
+    fail_unless(pa_rtclock_source_from_string("sundial") == PA_RTCLOCK_SOURCE_INVALID);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Rtclock");
+    tc = tcase_create("rtclock");
+    tcase_add_test(tc, precise_test);
+    tcase_add_test(tc, coarse_test);
+    tcase_add_test(tc, tsc_test);
+    tcase_add_test(tc, string_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
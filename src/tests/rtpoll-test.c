@@ -21,10 +21,12 @@
 
 #include <check.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <pulsecore/poll.h>
 #include <pulsecore/log.h>
 #include <pulsecore/rtpoll.h>
+#include <pulsecore/core-util.h>
 
 static int before(pa_rtpoll_item *i) {
     pa_log("before");
@@ -82,6 +84,52 @@ START_TEST (rtpoll_test) {
 }
 END_TEST
 
+START_TEST (rtpoll_fd_test) {
+    pa_rtpoll *p;
+    pa_rtpoll_item *i;
+    struct pollfd *pollfd;
+    int fds[2];
+    char c = 'x';
+
+    fail_unless(pipe(fds) == 0);
+
+    p = pa_rtpoll_new();
+
+    i = pa_rtpoll_item_new(p, PA_RTPOLL_NORMAL, 1);
+    pollfd = pa_rtpoll_item_get_pollfd(i, NULL);
+    pollfd->fd = fds[0];
+    pollfd->events = POLLIN;
+
+    /* Nothing to read, so only the timer can wake us up */
+    pa_rtpoll_set_timer_relative(p, 10000); /* 10 ms */
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pa_rtpoll_timer_elapsed(p));
+    fail_unless(pollfd->revents == 0);
+
+    /* Now the pipe becomes readable well before the timer */
+    fail_unless(write(fds[1], &c, 1) == 1);
+    pa_rtpoll_set_timer_relative(p, 10000000); /* 10 s */
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(!pa_rtpoll_timer_elapsed(p));
+    fail_unless(pollfd->revents & POLLIN);
+
+    fail_unless(read(fds[0], &c, 1) == 1);
+
+    /* Changing the watched events in place must be honoured */
+    pollfd->events = POLLOUT;
+    pollfd->fd = fds[1];
+    pa_rtpoll_set_timer_relative(p, 10000000); /* 10 s */
+    fail_unless(pa_rtpoll_run(p) >= 0);
+    fail_unless(pollfd->revents & POLLOUT);
+
+    pa_rtpoll_item_free(i);
+    pa_rtpoll_free(p);
+
+    pa_close(fds[0]);
+    pa_close(fds[1]);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -91,6 +139,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("RT Poll");
     tc = tcase_create("rtpoll");
     tcase_add_test(tc, rtpoll_test);
+    tcase_add_test(tc, rtpoll_fd_test);
     /* the default timeout is too small,
      * set it to a reasonable large one.
      */
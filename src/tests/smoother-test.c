@@ -29,6 +29,8 @@
 #include <pulsecore/log.h>
 #include <pulsecore/time-smoother.h>
 
+#include "runtime-test-util.h"
+
 START_TEST (smoother_test) {
     pa_usec_t x;
     unsigned u = 0;
@@ -84,6 +86,60 @@ START_TEST (smoother_test) {
 }
 END_TEST
 
+/* A remote clock running 5% fast, reported with some jitter, has to be
+ * tracked closely once the smoother had time to adjust */
+START_TEST (smoother_skew_test) {
+    pa_smoother *s;
+    pa_usec_t x;
+
+    srand(0);
+
+    s = pa_smoother_new(200*PA_USEC_PER_MSEC, 2000*PA_USEC_PER_MSEC, true, true, 4, 0, false);
+
+    for (x = 0; x < PA_USEC_PER_SEC * 60; x += 10*PA_USEC_PER_MSEC) {
+        pa_usec_t y, e;
+
+        y = x + x / 20 + (pa_usec_t) (rand() % 1000);
+        pa_smoother_put(s, x, y);
+
+        if (x < PA_USEC_PER_SEC * 5)
+            continue;
+
+        /* Estimate a bit into the future */
+        e = pa_smoother_get(s, x + 5*PA_USEC_PER_MSEC);
+        y = x + 5*PA_USEC_PER_MSEC + (x + 5*PA_USEC_PER_MSEC) / 20 + 500;
+
+        if (llabs((long long) e - (long long) y) > 2*PA_USEC_PER_MSEC) {
+            pa_log_debug("At %llu: estimated %llu, expected %llu", (unsigned long long) x, (unsigned long long) e, (unsigned long long) y);
+            ck_abort();
+        }
+    }
+
+    pa_smoother_free(s);
+}
+END_TEST
+
+START_TEST (smoother_perf_test) {
+    pa_smoother *s;
+    pa_usec_t x = 0, sum = 0;
+
+    s = pa_smoother_new(1000*PA_USEC_PER_MSEC, 5000*PA_USEC_PER_MSEC, true, true, 4, 0, false);
+
+    PA_RUNTIME_TEST_RUN_START("put", 1000, 100) {
+        x += 10*PA_USEC_PER_MSEC;
+        pa_smoother_put(s, x, x + (pa_usec_t) (_j % 7) * 100);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("get", 1000, 100) {
+        sum += pa_smoother_get(s, x + (pa_usec_t) _j);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    fail_unless(sum > 0);
+
+    pa_smoother_free(s);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -93,6 +149,8 @@ int main(int argc, char *argv[]) {
     s = suite_create("Smoother");
     tc = tcase_create("smoother");
     tcase_add_test(tc, smoother_test);
+    tcase_add_test(tc, smoother_skew_test);
+    tcase_add_test(tc, smoother_perf_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
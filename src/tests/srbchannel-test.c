@@ -29,6 +29,7 @@
 #include <pulsecore/pstream.h>
 #include <pulsecore/iochannel.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/socket.h>
 
 static unsigned packets_received;
 static unsigned packets_checksum;
@@ -47,7 +48,7 @@ static void packet_received(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data
         packets_checksum += pdata[i];
 }
 
-static void packet_test(unsigned npackets, size_t plength, pa_mainloop *ml, pa_pstream *p1, pa_pstream *p2) {
+static void packet_test(unsigned npackets, size_t plength, bool burst, pa_mainloop *ml, pa_pstream *p1, pa_pstream *p2) {
     pa_packet *packet = pa_packet_new(plength);
     unsigned i;
     unsigned psum = 0, totalsum = 0;
@@ -69,7 +70,10 @@ static void packet_test(unsigned npackets, size_t plength, pa_mainloop *ml, pa_p
     for (i = 0; i < npackets; i++) {
         pa_pstream_send_packet(p1, packet, NULL);
         totalsum += psum;
-        pa_mainloop_iterate(ml, 0, NULL);
+
+        /* Otherwise everything is queued up before the first write */
+        if (!burst)
+            pa_mainloop_iterate(ml, 0, NULL);
     }
 
     while (packets_received < npackets)
@@ -80,6 +84,56 @@ static void packet_test(unsigned npackets, size_t plength, pa_mainloop *ml, pa_p
     pa_packet_unref(packet);
 }
 
+#define N_BLOCKS 50
+
+static pa_memchunk blocks_received[N_BLOCKS];
+static unsigned n_blocks_received;
+
+static void memblock_received(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    fail_unless(n_blocks_received < N_BLOCKS);
+
+    blocks_received[n_blocks_received] = *chunk;
+    pa_memblock_ref(chunk->memblock);
+    n_blocks_received++;
+}
+
+/* Sends blocks from p1's pool by reference, and checks that all of them are
+ * released again once p2 lets go of them at once */
+static void release_test(pa_mainloop *ml, pa_mempool *mp, pa_pstream *p1, pa_pstream *p2) {
+    pa_memtransfer_stat imported, exported;
+    unsigned i;
+
+    n_blocks_received = 0;
+    pa_pstream_set_receive_memblock_callback(p2, memblock_received, NULL);
+
+    for (i = 0; i < N_BLOCKS; i++) {
+        pa_memchunk chunk;
+
+        chunk.memblock = pa_memblock_new(mp, 64);
+        chunk.index = 0;
+        chunk.length = 64;
+
+        pa_pstream_send_memblock(p1, 0, 0, PA_SEEK_RELATIVE, &chunk);
+        pa_memblock_unref(chunk.memblock);
+    }
+
+    while (n_blocks_received < N_BLOCKS)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    pa_pstream_get_memtransfer_stat(p1, &imported, &exported);
+    fail_unless(exported.n_blocks == N_BLOCKS);
+
+    for (i = 0; i < N_BLOCKS; i++)
+        pa_memblock_unref(blocks_received[i].memblock);
+
+    while (exported.n_blocks > 0) {
+        pa_mainloop_iterate(ml, 1, NULL);
+        pa_pstream_get_memtransfer_stat(p1, &imported, &exported);
+    }
+
+    pa_pstream_set_receive_memblock_callback(p2, NULL, NULL);
+}
+
 START_TEST (srbchannel_test) {
 
     int pipefd[4];
@@ -100,19 +154,44 @@ START_TEST (srbchannel_test) {
 
     pa_log_debug("Pipes: fd %d -> %d, %d -> %d", pipefd[1], pipefd[0], pipefd[3], pipefd[2]);
 
-    packet_test(250, 5, ml, p1, p2);
-    packet_test(10, 1234567, ml, p1, p2);
+    packet_test(250, 5, false, ml, p1, p2);
+    packet_test(10, 1234567, false, ml, p1, p2);
+
+    packet_test(250, 5, true, ml, p1, p2);
+    packet_test(10, 123456, true, ml, p1, p2);
 
     pa_log_debug("And now the same thing with srbchannel...");
 
-    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp);
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp, false);
+    pa_srbchannel_export(sr1, &srt);
+    pa_pstream_set_srbchannel(p1, sr1);
+    sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
+    pa_pstream_set_srbchannel(p2, sr2);
+
+    packet_test(250, 5, false, ml, p1, p2);
+    packet_test(10, 1234567, false, ml, p1, p2);
+
+    pa_log_debug("And now with split ringbuffer indices...");
+
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp, true);
     pa_srbchannel_export(sr1, &srt);
     pa_pstream_set_srbchannel(p1, sr1);
     sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
     pa_pstream_set_srbchannel(p2, sr2);
 
-    packet_test(250, 5, ml, p1, p2);
-    packet_test(10, 1234567, ml, p1, p2);
+    packet_test(250, 5, false, ml, p1, p2);
+    packet_test(10, 1234567, false, ml, p1, p2);
+
+    pa_log_debug("And now sending blocks by reference...");
+
+    pa_pstream_enable_shm(p1, true);
+    pa_pstream_enable_shm(p2, true);
+    release_test(ml, mp, p1, p2);
+
+    pa_log_debug("And now with batched releases...");
+
+    pa_pstream_enable_batched_release(p2);
+    release_test(ml, mp, p1, p2);
 
     pa_pstream_unref(p1);
     pa_pstream_unref(p2);
@@ -121,6 +200,33 @@ START_TEST (srbchannel_test) {
 }
 END_TEST
 
+START_TEST (socket_test) {
+
+    int fds[2];
+
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    pa_iochannel *io1, *io2;
+    pa_pstream *p1, *p2;
+
+    /* On a socket the pstream gathers queued items into one sendmsg() */
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    io1 = pa_iochannel_new(pa_mainloop_get_api(ml), fds[0], fds[0]);
+    io2 = pa_iochannel_new(pa_mainloop_get_api(ml), fds[1], fds[1]);
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), io1, mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), io2, mp);
+
+    packet_test(250, 5, false, ml, p1, p2);
+    packet_test(250, 5, true, ml, p1, p2);
+    packet_test(100, 1000, true, ml, p1, p2);
+    packet_test(10, 1234567, true, ml, p1, p2);
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
 
 int main(int argc, char *argv[]) {
     int failed = 0;
@@ -134,6 +240,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("srbchannel");
     tc = tcase_create("srbchannel");
     tcase_add_test(tc, srbchannel_test);
+    tcase_add_test(tc, socket_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
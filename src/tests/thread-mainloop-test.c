@@ -75,6 +75,53 @@ START_TEST (thread_mainloop_test) {
 }
 END_TEST
 
+#define N_POSTS 1000
+
+static unsigned n_posted;
+
+static void post_cb(pa_threaded_mainloop *m, void *userdata) {
+    pa_assert_se(pa_threaded_mainloop_in_thread(m));
+
+    /* Callbacks must run in the order they were posted in */
+    fail_unless(PA_PTR_TO_UINT(userdata) == n_posted);
+
+    if (++n_posted == N_POSTS)
+        pa_threaded_mainloop_signal(m, 0);
+}
+
+START_TEST (thread_mainloop_post_test) {
+    pa_threaded_mainloop *m;
+    unsigned i;
+
+    m = pa_threaded_mainloop_new();
+    fail_unless(m != NULL);
+
+    fail_unless(pa_threaded_mainloop_start(m) >= 0);
+
+    n_posted = 0;
+
+    /* Posting doesn't need the lock */
+    for (i = 0; i < N_POSTS; i++)
+        pa_threaded_mainloop_post(m, post_cb, PA_UINT_TO_PTR(i));
+
+    pa_threaded_mainloop_lock(m);
+
+    while (n_posted < N_POSTS)
+        pa_threaded_mainloop_wait(m);
+
+    pa_threaded_mainloop_unlock(m);
+
+    pa_threaded_mainloop_stop(m);
+
+    /* Dropped without being run */
+    pa_threaded_mainloop_post(m, post_cb, PA_UINT_TO_PTR(0));
+
+    pa_threaded_mainloop_free(m);
+
+    fail_unless(n_posted == N_POSTS);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -84,6 +131,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Thread MainLoop");
     tc = tcase_create("threadmainloop");
     tcase_add_test(tc, thread_mainloop_test);
+    tcase_add_test(tc, thread_mainloop_post_test);
     /* the default timeout is too small,
      * set it to a reasonable large one.
      */
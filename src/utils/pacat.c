@@ -115,6 +115,12 @@ static uint32_t monitor_stream = PA_INVALID_INDEX;
 
 static uint32_t cork_requests = 0;
 
+/* --stats */
+static bool stats = false;
+static pa_usec_t stats_start = 0;
+static uint64_t stats_bytes = 0;
+static unsigned stats_underruns = 0, stats_overruns = 0;
+
 /* A shortcut for terminating the application */
 static void quit(int ret) {
     pa_assert(mainloop_api);
@@ -205,9 +211,10 @@ static void stream_write_callback(pa_stream *s, size_t length, void *userdata) {
             } else
                 bytes = sf_read_raw(sndfile, data, (sf_count_t) data_length);
 
-            if (bytes > 0)
+            if (bytes > 0) {
                 pa_stream_write(s, data, (size_t) bytes, NULL, 0, PA_SEEK_RELATIVE);
-            else
+                stats_bytes += (uint64_t) bytes;
+            } else
                 pa_stream_cancel_write(s);
 
             /* EOF? */
@@ -248,6 +255,30 @@ static void stream_read_callback(pa_stream *s, size_t length, void *userdata) {
 
             pa_assert(length > 0);
 
+            if (data || !(flags & PA_STREAM_PASSTHROUGH))
+                stats_bytes += length;
+
+            /* If nothing is queued yet, hand the data to stdout straight
+             * from the stream's (usually shared memory) buffer, and only
+             * copy what it didn't take. */
+            if (data && !buffer && stdio_event) {
+                ssize_t r;
+
+                if ((r = pa_write(STDOUT_FILENO, data, length, userdata)) < 0) {
+                    pa_log(_("write() failed: %s"), strerror(errno));
+                    quit(1);
+                    return;
+                }
+
+                data = (const uint8_t *) data + r;
+                length -= (size_t) r;
+
+                if (length == 0) {
+                    pa_stream_drop(s);
+                    continue;
+                }
+            }
+
             /* If there is a hole in the stream, we generate silence, except
              * if it's a passthrough stream in which case we skip the hole. */
             if (data || !(flags & PA_STREAM_PASSTHROUGH)) {
@@ -301,6 +332,7 @@ static void stream_read_callback(pa_stream *s, size_t length, void *userdata) {
             if (bytes < (sf_count_t) length)
                 quit(1);
 
+            stats_bytes += length;
             pa_stream_drop(s);
         }
     }
@@ -317,6 +349,8 @@ static void stream_state_callback(pa_stream *s, void *userdata) {
 
         case PA_STREAM_READY:
 
+            stats_start = pa_rtclock_now();
+
             if (verbose) {
                 const pa_buffer_attr *a;
                 char cmt[PA_CHANNEL_MAP_SNPRINT_MAX], sst[PA_SAMPLE_SPEC_SNPRINT_MAX];
@@ -368,6 +402,8 @@ static void stream_suspended_callback(pa_stream *s, void *userdata) {
 static void stream_underflow_callback(pa_stream *s, void *userdata) {
     pa_assert(s);
 
+    stats_underruns++;
+
     if (verbose)
         pa_log(_("Stream underrun.%s"),  CLEAR_LINE);
 }
@@ -375,6 +411,8 @@ static void stream_underflow_callback(pa_stream *s, void *userdata) {
 static void stream_overflow_callback(pa_stream *s, void *userdata) {
     pa_assert(s);
 
+    stats_overruns++;
+
     if (verbose)
         pa_log(_("Stream overrun.%s"), CLEAR_LINE);
 }
@@ -582,6 +620,8 @@ static void stdin_callback(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_even
             quit(1);
             return;
         }
+
+        stats_bytes += towrite;
     } else
         pa_stream_cancel_write(stream);
 }
@@ -620,6 +660,25 @@ static void stdout_callback(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_eve
     }
 }
 
+static void print_stats(void) {
+    double secs;
+
+    if (stats_start == 0) {
+        pa_log(_("Stream never became ready, no statistics."));
+        return;
+    }
+
+    secs = (double) (pa_rtclock_now() - stats_start) / PA_USEC_PER_SEC;
+
+    pa_log(_("%s %llu bytes in %0.1f s (%0.1f KiB/s), %u underruns, %u overruns."),
+           mode == RECORD ? _("Recorded") : _("Played"),
+           (unsigned long long) stats_bytes,
+           secs,
+           secs > 0 ? (double) stats_bytes / 1024 / secs : 0.0,
+           stats_underruns,
+           stats_overruns);
+}
+
 /* UNIX signal to quit received */
 static void exit_signal_callback(pa_mainloop_api*m, pa_signal_event *e, int sig, void *userdata) {
     if (verbose)
@@ -709,7 +768,8 @@ static void help(const char *argv0) {
              "      --passthrough                     Passthrough data.\n"
              "      --file-format[=FFORMAT]           Record/play formatted PCM data.\n"
              "      --list-file-formats               List available file formats.\n"
-             "      --monitor-stream=INDEX            Record from the sink input with index INDEX.\n")
+             "      --monitor-stream=INDEX            Record from the sink input with index INDEX.\n"
+             "      --stats                           Print throughput, underruns and overruns on exit.\n")
            , argv0, purpose);
 }
 
@@ -736,6 +796,7 @@ enum {
     ARG_LATENCY_MSEC,
     ARG_PROCESS_TIME_MSEC,
     ARG_MONITOR_STREAM,
+    ARG_STATS,
 };
 
 int main(int argc, char *argv[]) {
@@ -777,6 +838,7 @@ int main(int argc, char *argv[]) {
         {"latency-msec", 1, NULL, ARG_LATENCY_MSEC},
         {"process-time-msec", 1, NULL, ARG_PROCESS_TIME_MSEC},
         {"monitor-stream", 1, NULL, ARG_MONITOR_STREAM},
+        {"stats",        0, NULL, ARG_STATS},
         {NULL,           0, NULL, 0}
     };
 
@@ -1002,6 +1064,10 @@ int main(int argc, char *argv[]) {
                 }
                 break;
 
+            case ARG_STATS:
+                stats = true;
+                break;
+
             default:
                 goto quit;
         }
@@ -1212,6 +1278,9 @@ int main(int argc, char *argv[]) {
         goto quit;
     }
 
+    if (stats)
+        print_stats();
+
 quit:
     if (stream)
         pa_stream_unref(stream);
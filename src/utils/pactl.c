@@ -175,6 +175,28 @@ static void stat_callback(pa_context *c, const pa_stat_info *i, void *userdata)
     pa_bytes_snprint(s, sizeof(s), i->scache_size);
     printf(_("Sample cache size: %s\n"), s);
 
+    if (pa_context_get_server_protocol_version(c) >= 33) {
+        pa_bytes_snprint(s, sizeof(s), i->memblock_total_size_max);
+        printf(_("Peak usage: %u blocks, %s bytes total.\n"), i->memblock_total_max, s);
+
+        printf(_("Pool allocation failures: %u because the pool was full, %u because the block was too large.\n"),
+               i->memblock_pool_full, i->memblock_too_large);
+
+        pa_bytes_snprint(s, sizeof(s), i->client_imported_size);
+        printf(_("Blocks of this client held by the server: %u containing %s bytes total"), i->client_imported, s);
+        pa_bytes_snprint(s, sizeof(s), i->client_imported_size_max);
+        printf(_(", peak %u containing %s bytes.\n"), i->client_imported_max, s);
+
+        pa_bytes_snprint(s, sizeof(s), i->client_exported_size);
+        printf(_("Blocks of the server held by this client: %u containing %s bytes total"), i->client_exported, s);
+        pa_bytes_snprint(s, sizeof(s), i->client_exported_size_max);
+        printf(_(", peak %u containing %s bytes.\n"), i->client_exported_max, s);
+
+        printf(_("Blocks of this client the server failed to import: %u\n"), i->client_imported_failed);
+        printf(_("Blocks of the server sent by copy: %u because no slot was free, %u more copied into the pool first.\n"),
+               i->client_exported_failed, i->client_exported_copied);
+    }
+
     complete_action();
 }
 
@@ -292,6 +314,7 @@ static void get_sink_info_callback(pa_context *c, const pa_sink_info *i, int is_
              "\tBase Volume: %s\n"
              "\tMonitor Source: %s\n"
              "\tLatency: %0.0f usec, configured %0.0f usec\n"
+             "\tUnderruns: %u (%llu bytes), rewinds: %u (%llu bytes), longest render: %0.0f usec\n"
              "\tFlags: %s%s%s%s%s%s%s\n"
              "\tProperties:\n\t\t%s\n"),
            i->index,
@@ -308,6 +331,9 @@ static void get_sink_info_callback(pa_context *c, const pa_sink_info *i, int is_
            pa_volume_snprint_verbose(v, sizeof(v), i->base_volume, i->flags & PA_SINK_DECIBEL_VOLUME),
            pa_strnull(i->monitor_source_name),
            (double) i->latency, (double) i->configured_latency,
+           i->n_underruns, (unsigned long long) i->underrun_bytes,
+           i->n_rewinds, (unsigned long long) i->rewind_bytes,
+           (double) i->max_render_usec,
            i->flags & PA_SINK_HARDWARE ? "HARDWARE " : "",
            i->flags & PA_SINK_NETWORK ? "NETWORK " : "",
            i->flags & PA_SINK_HW_MUTE_CTRL ? "HW_MUTE_CTRL " : "",
@@ -663,6 +689,7 @@ static void get_sink_input_info_callback(pa_context *c, const pa_sink_input_info
              "\tBuffer Latency: %0.0f usec\n"
              "\tSink Latency: %0.0f usec\n"
              "\tResample method: %s\n"
+             "\tUnderruns: %u (%llu bytes), rewinds: %u (%llu bytes), longest render: %0.0f usec\n"
              "\tProperties:\n\t\t%s\n"),
            i->index,
            pa_strnull(i->driver),
@@ -679,6 +706,9 @@ static void get_sink_input_info_callback(pa_context *c, const pa_sink_input_info
            (double) i->buffer_usec,
            (double) i->sink_usec,
            i->resample_method ? i->resample_method : _("n/a"),
+           i->n_underruns, (unsigned long long) i->underrun_bytes,
+           i->n_rewinds, (unsigned long long) i->rewind_bytes,
+           (double) i->max_render_usec,
            pl = pa_proplist_to_string_sep(i->proplist, "\n\t\t"));
 
     pa_xfree(pl);
@@ -36,6 +36,7 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -52,6 +53,7 @@
 #include <pulse/gccmacro.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/sample-util.h>
 
 /* On some systems SIOCINQ isn't defined, but FIONREAD is just an alias */
 #if !defined(SIOCINQ) && defined(FIONREAD)
@@ -102,6 +104,13 @@ struct fd_info {
 
     int optr_n_blocks;
 
+    /* OSS mmap() playback: the app writes into this ring directly, and
+     * the play stream reads it from mmap_pos on, see fd_info_copy_mmap() */
+    void *mmap_buf;
+    size_t mmap_size;
+    size_t mmap_pos;
+    uint64_t mmap_bytes;
+
     PA_LLIST_FIELDS(fd_info);
 };
 
@@ -133,6 +142,11 @@ static int (*___xstat64)(int, const char *, struct stat64 *) = NULL;
 #endif
 static int (*_fclose)(FILE *f) = NULL;
 static int (*_access)(const char *, int) = NULL;
+static void* (*_mmap)(void *, size_t, int, int, int, off_t) = NULL;
+#ifdef HAVE_OPEN64
+static void* (*_mmap64)(void *, size_t, int, int, int, off64_t) = NULL;
+#endif
+static int (*_munmap)(void *, size_t) = NULL;
 
 /* dlsym() violates ISO C, so confide the breakage into this function to
  * avoid warnings. */
@@ -253,6 +267,30 @@ do { \
     pthread_mutex_unlock(&func_mutex); \
 } while(0)
 
+#define LOAD_MMAP_FUNC() \
+do { \
+    pthread_mutex_lock(&func_mutex); \
+    if (!_mmap) \
+        _mmap = (void* (*)(void *, size_t, int, int, int, off_t)) dlsym_fn(RTLD_NEXT, "mmap"); \
+    pthread_mutex_unlock(&func_mutex); \
+} while(0)
+
+#define LOAD_MMAP64_FUNC() \
+do { \
+    pthread_mutex_lock(&func_mutex); \
+    if (!_mmap64) \
+        _mmap64 = (void* (*)(void *, size_t, int, int, int, off64_t)) dlsym_fn(RTLD_NEXT, "mmap64"); \
+    pthread_mutex_unlock(&func_mutex); \
+} while(0)
+
+#define LOAD_MUNMAP_FUNC() \
+do { \
+    pthread_mutex_lock(&func_mutex); \
+    if (!_munmap) \
+        _munmap = (int (*)(void *, size_t)) dlsym_fn(RTLD_NEXT, "munmap"); \
+    pthread_mutex_unlock(&func_mutex); \
+} while(0)
+
 #define CONTEXT_CHECK_DEAD_GOTO(i, label) do { \
 if (!(i)->context || pa_context_get_state((i)->context) != PA_CONTEXT_READY) { \
     debug(DEBUG_LEVEL_NORMAL, __FILE__": Not connected: %s\n", (i)->context ? pa_strerror(pa_context_errno((i)->context)) : "NULL"); \
@@ -750,6 +788,22 @@ static fd_info* fd_info_find(int fd) {
     return i;
 }
 
+static fd_info* fd_info_find_mmap(void *addr) {
+    fd_info *i;
+
+    pthread_mutex_lock(&fd_infos_mutex);
+
+    for (i = fd_infos; i; i = i->next)
+        if (i->mmap_buf == addr && !i->unusable) {
+            fd_info_ref(i);
+            break;
+        }
+
+    pthread_mutex_unlock(&fd_infos_mutex);
+
+    return i;
+}
+
 static void fix_metrics(fd_info *i) {
     size_t fs;
     char t[PA_SAMPLE_SPEC_SNPRINT_MAX];
@@ -785,10 +839,66 @@ static void fix_metrics(fd_info *i) {
     debug(DEBUG_LEVEL_NORMAL, __FILE__": fixated metrics to %i fragments, %li bytes each.\n", i->n_fragments, (long)i->fragment_size);
 }
 
+/* Hands as much of the mmap()ed ring to the play stream as it takes,
+ * with one copy straight into the stream's buffer. The app sees the
+ * ring position advance through SNDCTL_DSP_GETOPTR. Called with the
+ * mainloop lock held. */
+static int fd_info_copy_mmap(fd_info *i) {
+    size_t n, fs;
+
+    if (!i->mmap_buf || !i->play_stream || i->play_precork ||
+        pa_stream_get_state(i->play_stream) != PA_STREAM_READY)
+        return 0;
+
+    if ((n = pa_stream_writable_size(i->play_stream)) == (size_t) -1) {
+        debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_writable_size(): %s\n",
+            pa_strerror(pa_context_errno(i->context)));
+        return -1;
+    }
+
+    fs = pa_frame_size(&i->sample_spec);
+
+    while (n >= fs) {
+        void *data;
+        size_t len = n;
+
+        if (pa_stream_begin_write(i->play_stream, &data, &len) < 0) {
+            debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_begin_write(): %s\n", pa_strerror(pa_context_errno(i->context)));
+            return -1;
+        }
+
+        len = PA_MIN(PA_MIN(len, n), i->mmap_size - i->mmap_pos);
+        len -= len % fs;
+
+        if (len == 0) {
+            pa_stream_cancel_write(i->play_stream);
+            break;
+        }
+
+        memcpy(data, (uint8_t*) i->mmap_buf + i->mmap_pos, len);
+
+        if (pa_stream_write(i->play_stream, data, len, NULL, 0LL, PA_SEEK_RELATIVE) < 0) {
+            debug(DEBUG_LEVEL_NORMAL, __FILE__": pa_stream_write(): %s\n", pa_strerror(pa_context_errno(i->context)));
+            return -1;
+        }
+
+        i->mmap_pos = (i->mmap_pos + len) % i->mmap_size;
+        i->mmap_bytes += len;
+        n -= len;
+    }
+
+    return 0;
+}
+
 static void stream_request_cb(pa_stream *s, size_t length, void *userdata) {
     fd_info *i = userdata;
     assert(s);
 
+    if (s == i->play_stream && i->mmap_buf) {
+        fd_info_copy_mmap(i);
+        return;
+    }
+
     if (i->io_event) {
         pa_mainloop_api *api;
         size_t n;
@@ -1901,6 +2011,9 @@ static int dsp_trigger(fd_info *i) {
     if (dsp_empty_socket(i) < 0)
         goto fail;
 
+    if (fd_info_copy_mmap(i) < 0)
+        goto fail;
+
     debug(DEBUG_LEVEL_NORMAL, __FILE__": Triggering.\n");
 
     if (!(o = pa_stream_trigger(i->play_stream, stream_success_cb, i))) {
@@ -2099,7 +2212,7 @@ static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno)
         case SNDCTL_DSP_GETCAPS:
             debug(DEBUG_LEVEL_NORMAL, __FILE__": SNDCTL_DSP_CAPS\n");
 
-            *(int*) argp = DSP_CAP_DUPLEX | DSP_CAP_TRIGGER
+            *(int*) argp = DSP_CAP_DUPLEX | DSP_CAP_TRIGGER | DSP_CAP_MMAP
 #ifdef DSP_CAP_MULTI
               | DSP_CAP_MULTI
 #endif
@@ -2325,6 +2438,18 @@ static int dsp_ioctl(fd_info *i, unsigned long request, void*argp, int *_errno)
 
             pa_threaded_mainloop_lock(i->mainloop);
 
+            if (i->mmap_buf) {
+                /* How far the stream got in the ring */
+                int m = (int) (i->mmap_bytes / i->fragment_size);
+
+                info->bytes = (int) i->mmap_bytes;
+                info->blocks = m - i->optr_n_blocks;
+                info->ptr = (int) i->mmap_pos;
+                i->optr_n_blocks = m;
+
+                goto exit_loop2;
+            }
+
             for (;;) {
                 pa_usec_t usec;
 
@@ -2450,6 +2575,118 @@ int close(int fd) {
     return 0;
 }
 
+/* Sets up an mmap()ed ring for OSS mmap playback on the dsp fd. Called
+ * with the real mmap function to use for the anonymous mapping. */
+static void *dsp_mmap(fd_info *i, void *start, size_t length, int prot, void *(*real_mmap)(void *, size_t, int, int, int, off_t)) {
+    void *ring;
+    size_t fs;
+
+    if (i->type != FD_INFO_STREAM || !(prot & PROT_WRITE)) {
+        /* Recording through mmap() isn't supported */
+        debug(DEBUG_LEVEL_NORMAL, __FILE__": mmap() only supported for playback\n");
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    pa_threaded_mainloop_lock(i->mainloop);
+
+    fix_metrics(i);
+    fs = pa_frame_size(&i->sample_spec);
+
+    if (i->mmap_buf || length < fs) {
+        pa_threaded_mainloop_unlock(i->mainloop);
+        errno = i->mmap_buf ? EBUSY : EINVAL;
+        return MAP_FAILED;
+    }
+
+    if ((ring = real_mmap(start, length, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        pa_threaded_mainloop_unlock(i->mainloop);
+        return MAP_FAILED;
+    }
+
+    pa_silence_memory(ring, length, &i->sample_spec);
+
+    i->mmap_buf = ring;
+    i->mmap_size = length - length % fs;
+    i->mmap_pos = 0;
+    i->mmap_bytes = 0;
+    i->optr_n_blocks = 0;
+
+    /* The app won't write() anything, so create the stream right away.
+     * It starts pulling data when it is ready and not corked. */
+    if (!i->play_stream) {
+        if (create_playback_stream(i) < 0) {
+            i->mmap_buf = NULL;
+            pa_threaded_mainloop_unlock(i->mainloop);
+
+            LOAD_MUNMAP_FUNC();
+            _munmap(ring, length);
+            errno = EIO;
+            return MAP_FAILED;
+        }
+    } else
+        fd_info_copy_mmap(i);
+
+    pa_threaded_mainloop_unlock(i->mainloop);
+
+    debug(DEBUG_LEVEL_NORMAL, __FILE__": mmap() ring of %lu bytes\n", (unsigned long) length);
+
+    return ring;
+}
+
+static void *mmap_ring(void *start, size_t length, int prot, int flags, int fd, off_t offset) {
+    LOAD_MMAP_FUNC();
+    return _mmap(start, length, prot, flags, fd, offset);
+}
+
+void *mmap(void *start, size_t length, int prot, int flags, int fd, off_t offset) {
+    fd_info *i;
+    void *r;
+
+    debug(DEBUG_LEVEL_VERBOSE, __FILE__": mmap()\n");
+
+    if (fd < 0 || !function_enter()) {
+        LOAD_MMAP_FUNC();
+        return _mmap(start, length, prot, flags, fd, offset);
+    }
+
+    if (!(i = fd_info_find(fd))) {
+        function_exit();
+        LOAD_MMAP_FUNC();
+        return _mmap(start, length, prot, flags, fd, offset);
+    }
+
+    r = dsp_mmap(i, start, length, prot, mmap_ring);
+
+    fd_info_unref(i);
+    function_exit();
+
+    return r;
+}
+
+int munmap(void *start, size_t length) {
+    fd_info *i;
+
+    debug(DEBUG_LEVEL_VERBOSE, __FILE__": munmap()\n");
+
+    if (start && function_enter()) {
+
+        /* Stop reading from the ring before it goes away */
+        if ((i = fd_info_find_mmap(start))) {
+            pa_threaded_mainloop_lock(i->mainloop);
+            i->mmap_buf = NULL;
+            pa_threaded_mainloop_unlock(i->mainloop);
+
+            fd_info_unref(i);
+        }
+
+        function_exit();
+    }
+
+    LOAD_MUNMAP_FUNC();
+    return _munmap(start, length);
+}
+
 int access(const char *pathname, int mode) {
 
     debug(DEBUG_LEVEL_VERBOSE, __FILE__": access(%s)\n", pathname?pathname:"NULL");
@@ -2701,6 +2938,31 @@ FILE *fopen64(const char *filename, const char *mode) {
     return fopen(filename, mode);
 }
 
+void *mmap64(void *start, size_t length, int prot, int flags, int fd, off64_t offset) {
+    fd_info *i;
+    void *r;
+
+    debug(DEBUG_LEVEL_VERBOSE, __FILE__": mmap64()\n");
+
+    if (fd < 0 || !function_enter()) {
+        LOAD_MMAP64_FUNC();
+        return _mmap64(start, length, prot, flags, fd, offset);
+    }
+
+    if (!(i = fd_info_find(fd))) {
+        function_exit();
+        LOAD_MMAP64_FUNC();
+        return _mmap64(start, length, prot, flags, fd, offset);
+    }
+
+    r = dsp_mmap(i, start, length, prot, mmap_ring);
+
+    fd_info_unref(i);
+    function_exit();
+
+    return r;
+}
+
 #endif
 
 int fclose(FILE *f) {